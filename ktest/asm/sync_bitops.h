@@ -22,6 +22,15 @@
 
 #define ADDR				(*(volatile long *)addr)
 
+static inline void
+sync_set_bit(long nr, volatile unsigned long *addr)
+{
+	asm volatile("lock; bts %1,%0"
+		     : "+m" (ADDR)
+		     : "Ir" (nr)
+		     : "memory");
+}
+
 static inline int
 sync_test_and_set_bit(int nr, volatile unsigned long *addr)
 {
@@ -33,6 +42,15 @@ sync_test_and_set_bit(int nr, volatile unsigned long *addr)
 	return oldbit;
 }
 
+static inline void
+sync_clear_bit(long nr, volatile unsigned long *addr)
+{
+	asm volatile("lock; btr %1,%0"
+		     : "+m" (ADDR)
+		     : "Ir" (nr)
+		     : "memory");
+}
+
 static inline unsigned long
 __ffs(unsigned long word)
 {
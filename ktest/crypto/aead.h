@@ -0,0 +1,85 @@
+/**
+ *	Tempesta kernel emulation unit testing framework.
+ *
+ * Copyright (C) 2020 Tempesta Technologies, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#ifndef __CRYPTO_AEAD_H__
+#define __CRYPTO_AEAD_H__
+
+#include "crypto/hash.h"
+#include "linux/compiler.h"
+#include "linux/scatterlist.h"
+
+/*
+ * The transforms are implemented by the tests, so the structure is opaque
+ * as in the kernel.
+ */
+struct crypto_aead;
+
+typedef void (*crypto_completion_t)(void *req, int err);
+
+struct aead_request {
+	struct crypto_aead	*tfm;
+	unsigned int		assoclen;
+	unsigned int		cryptlen;
+	u8			*iv;
+	struct scatterlist	*src;
+	struct scatterlist	*dst;
+	crypto_completion_t	complete;
+	void			*data;
+	void			*__ctx[] CRYPTO_MINALIGN_ATTR;
+};
+
+struct crypto_aead *crypto_alloc_aead_atomic(struct crypto_alg *alg);
+int crypto_aead_setkey(struct crypto_aead *tfm, const u8 *key,
+		       unsigned int keylen);
+int crypto_aead_setauthsize(struct crypto_aead *tfm, unsigned int authsize);
+void crypto_free_aead(struct crypto_aead *tfm);
+int crypto_aead_encrypt(struct aead_request *req);
+int crypto_aead_decrypt(struct aead_request *req);
+
+static inline void
+aead_request_set_tfm(struct aead_request *req, struct crypto_aead *tfm)
+{
+	req->tfm = tfm;
+}
+
+static inline void
+aead_request_set_callback(struct aead_request *req, u32 flags,
+			  crypto_completion_t compl, void *data)
+{
+	req->complete = compl;
+	req->data = data;
+}
+
+static inline void
+aead_request_set_crypt(struct aead_request *req, struct scatterlist *src,
+		       struct scatterlist *dst, unsigned int cryptlen, u8 *iv)
+{
+	req->src = src;
+	req->dst = dst;
+	req->cryptlen = cryptlen;
+	req->iv = iv;
+}
+
+static inline void
+aead_request_set_ad(struct aead_request *req, unsigned int assoclen)
+{
+	req->assoclen = assoclen;
+}
+
+#endif /* __CRYPTO_AEAD_H__ */
@@ -65,6 +65,26 @@ atomic_dec_and_test(atomic_t *v)
 	return __atomic_sub_fetch(&v->counter, 1, __ATOMIC_SEQ_CST) == 0;
 }
 
+static inline int
+atomic_dec_if_positive(atomic_t *v)
+{
+	int c = atomic_read(v);
+
+	while (c > 0 && !__atomic_compare_exchange_n(&v->counter, &c, c - 1,
+						     false, __ATOMIC_SEQ_CST,
+						     __ATOMIC_RELAXED))
+		;
+	return c - 1;
+}
+
+#define xchg(p, v)		__atomic_exchange_n((p), (v), __ATOMIC_SEQ_CST)
+#define cmpxchg(p, o, n) ({						\
+	typeof(*(p)) __o = (o);						\
+	__atomic_compare_exchange_n((p), &__o, (n), false,		\
+				    __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);\
+	__o;								\
+})
+
 typedef struct {
 	long counter;
 } atomic64_t;
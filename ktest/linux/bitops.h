@@ -20,6 +20,10 @@
 #ifndef __BITOPS_H__
 #define __BITOPS_H__
 
+#include <string.h>
+
+#include "compiler.h"
+
 #define IS_IMMEDIATE(nr)		(__builtin_constant_p(nr))
 #define BITOP_ADDR(x)			"+m" (*(volatile long *) (x))
 #define CONST_MASK_ADDR(nr, addr)	BITOP_ADDR((void *)(addr) + ((nr)>>3))
@@ -40,6 +44,42 @@ set_bit(unsigned int nr, volatile unsigned long *addr)
 	}
 }
 
+static inline void
+clear_bit(unsigned int nr, volatile unsigned long *addr)
+{
+	asm volatile(LOCK_PREFIX "btr %1,%0"
+		: BITOP_ADDR(addr) : "Ir" (nr) : "memory");
+}
+
+static inline int
+test_bit(unsigned int nr, const volatile unsigned long *addr)
+{
+	return (addr[nr / BITS_PER_LONG] >> (nr % BITS_PER_LONG)) & 1;
+}
+
+#define BITS_TO_LONGS(n)	(((n) + BITS_PER_LONG - 1) / BITS_PER_LONG)
+
+static inline unsigned int
+find_next_bit(const unsigned long *addr, unsigned int size,
+	      unsigned int off)
+{
+	for ( ; off < size; ++off)
+		if (test_bit(off, addr))
+			break;
+	return off;
+}
+
+#define for_each_set_bit(bit, addr, size)				\
+	for ((bit) = find_next_bit((addr), (size), 0);			\
+	     (bit) < (size);						\
+	     (bit) = find_next_bit((addr), (size), (bit) + 1))
+
+static inline void
+bitmap_zero(unsigned long *dst, unsigned int nbits)
+{
+	memset(dst, 0, BITS_TO_LONGS(nbits) * sizeof(long));
+}
+
 static inline unsigned long
 ffz(unsigned long word)
 {
@@ -29,11 +29,23 @@ typedef long ktime_t;
 /* asm/types.h */
 #define BITS_PER_LONG	64
 
-#define likely(e)	__builtin_expect((e), 1)
-#define unlikely(e)	__builtin_expect((e), 0)
+#define likely(e)	__builtin_expect(!!(e), 1)
+#define unlikely(e)	__builtin_expect(!!(e), 0)
 
 #define cpu_to_be64(x)	__builtin_bswap64(x)
 
 #define __percpu
 
+#define READ_ONCE(x)	(*(volatile typeof(x) *)&(x))
+#define WRITE_ONCE(x, v)	(*(volatile typeof(x) *)&(x) = (v))
+
+/* asm/barrier.h */
+#define barrier()	asm volatile("" ::: "memory")
+#define smp_mb()	__sync_synchronize()
+#define smp_rmb()	barrier()
+#define smp_wmb()	barrier()
+
+/* asm/processor.h */
+#define cpu_relax()	asm volatile("rep; nop" ::: "memory")
+
 #endif /* __COMPILER_H__ */
@@ -44,6 +44,9 @@
 #define L1_CACHE_BYTES 64
 #endif
 
+/* linux/prefetch.h */
+#define prefetch(x)		__builtin_prefetch(x)
+
 #define SMP_CACHE_BYTES L1_CACHE_BYTES
 #define ____cacheline_aligned __attribute__((__aligned__(SMP_CACHE_BYTES)))
 #define ____cacheline_aligned_in_smp ____cacheline_aligned
@@ -51,7 +54,9 @@
 #define __page_aligned_data	__attribute__((__aligned__(4096)))
 #define CRYPTO_MINALIGN_ATTR __attribute__ ((__aligned__(L1_CACHE_BYTES)))
 
+#ifndef offsetof
 #define offsetof(TYPE, MEMBER)	((size_t)&((TYPE *)0)->MEMBER)
+#endif
 
 #define container_of(ptr, type, member) ({				\
 	void *__mptr = (void *)(ptr);					\
@@ -89,6 +94,31 @@ struct module { /* dummy strut */ };
 #define request_module(...)
 
 #define __init
+#define EXPORT_SYMBOL(sym)
+
+/* linux/err.h */
+#define MAX_ERRNO	4095
+
+#define IS_ERR_VALUE(x)	unlikely((unsigned long)(void *)(x)		\
+				 >= (unsigned long)-MAX_ERRNO)
+
+static inline void *
+ERR_PTR(long error)
+{
+	return (void *)error;
+}
+
+static inline long
+PTR_ERR(const void *ptr)
+{
+	return (long)ptr;
+}
+
+static inline bool
+IS_ERR(const void *ptr)
+{
+	return IS_ERR_VALUE((unsigned long)ptr);
+}
 
 struct list_head {
 	struct list_head *next, *prev;
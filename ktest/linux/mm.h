@@ -0,0 +1,52 @@
+/**
+ *	Tempesta kernel emulation unit testing framework.
+ *
+ * Copyright (C) 2026 Tempesta Technologies, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#ifndef __MM_H__
+#define __MM_H__
+
+#include <stdbool.h>
+
+struct page {
+	int	_refcount;
+};
+
+/*
+ * User space tests never pass the memory to socket buffers, so all the
+ * pages are referenced by their owners only.
+ */
+static struct page __ktest_page = { ._refcount = 1 };
+
+#define virt_to_page(p)		({ (void)(p); &__ktest_page; })
+#define vmalloc_to_page(p)	({ (void)(p); &__ktest_page; })
+#define is_vmalloc_addr(p)	({ (void)(p); false; })
+
+static inline int
+page_count(struct page *page)
+{
+	return page->_refcount;
+}
+
+static inline int
+page_mapcount(struct page *page)
+{
+	(void)page;
+	return 0;
+}
+
+#endif /* __MM_H__ */
@@ -20,6 +20,8 @@
 #ifndef __PERCPU_H__
 #define __PERCPU_H__
 
+#include "preempt.h"
+
 #define DECLARE_PER_CPU(type, name)	extern type name
 #define DEFINE_PER_CPU(type, name)	type name
 
@@ -34,6 +36,7 @@
 #define __alloc_percpu(s, a)		calloc(NR_CPUS, (s))
 #define free_percpu(p)			free(p)
 #define for_each_possible_cpu(c)	for (c = 0; c < NR_CPUS; ++c)
+#define for_each_online_cpu(c)		for_each_possible_cpu(c)
 
 #if NR_CPUS == 1
 
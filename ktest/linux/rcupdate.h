@@ -0,0 +1,60 @@
+/**
+ *	Tempesta kernel emulation unit testing framework.
+ *
+ * Copyright (C) 2020 Tempesta Technologies, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#ifndef __RCUPDATE_H__
+#define __RCUPDATE_H__
+
+#include "compiler.h"
+
+/*
+ * There are no grace periods in user space, so tests must not release
+ * memory concurrently with lock-free readers.
+ */
+#define __rcu
+
+struct rcu_head {
+	struct rcu_head *next;
+	void (*func)(struct rcu_head *head);
+};
+
+#define rcu_read_lock()
+#define rcu_read_unlock()
+#define rcu_read_lock_bh()
+#define rcu_read_unlock_bh()
+#define synchronize_rcu()		__sync_synchronize()
+#define synchronize_rcu_bh()		__sync_synchronize()
+#define synchronize_sched()		__sync_synchronize()
+#define rcu_barrier()			__sync_synchronize()
+
+#define rcu_dereference(p)		READ_ONCE(p)
+#define rcu_dereference_protected(p, c)	(p)
+#define rcu_access_pointer(p)		READ_ONCE(p)
+#define rcu_assign_pointer(p, v)	WRITE_ONCE(p, v)
+#define RCU_INIT_POINTER(p, v)		((p) = (v))
+
+#define lockdep_is_held(lock)		1
+
+/* No readers may run concurrently, so free the object immediately. */
+static inline void
+call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *head))
+{
+	func(head);
+}
+
+#endif /* __RCUPDATE_H__ */
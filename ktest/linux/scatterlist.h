@@ -35,4 +35,20 @@ struct sg_table {
 	unsigned int orig_nents;	/* original size of list */
 };
 
+/* There are no pages in user space, so keep the virtual address instead. */
+static inline void
+sg_init_one(struct scatterlist *sg, const void *buf, unsigned int buflen)
+{
+	sg->page_link = (unsigned long)buf;
+	sg->offset = 0;
+	sg->length = buflen;
+	sg->dma_address = 0;
+}
+
+static inline void *
+sg_virt(struct scatterlist *sg)
+{
+	return (void *)(sg->page_link + sg->offset);
+}
+
 #endif /* __SCATTERLIST_H__ */
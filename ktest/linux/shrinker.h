@@ -0,0 +1,58 @@
+/**
+ *	Tempesta kernel emulation unit testing framework.
+ *
+ * Copyright (C) 2020 Tempesta Technologies, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#ifndef __SHRINKER_H__
+#define __SHRINKER_H__
+
+#include "slab.h"
+
+struct shrink_control {
+	gfp_t		gfp_mask;
+	int		nid;
+	unsigned long	nr_to_scan;
+	unsigned long	nr_scanned;
+};
+
+struct shrinker {
+	unsigned long	(*count_objects)(struct shrinker *,
+					 struct shrink_control *sc);
+	unsigned long	(*scan_objects)(struct shrinker *,
+					struct shrink_control *sc);
+	int		seeks;
+	long		batch;
+	unsigned long	flags;
+};
+
+#define DEFAULT_SEEKS		2
+#define SHRINK_STOP		(~0UL)
+#define SHRINKER_NUMA_AWARE	(1 << 0)
+
+/* There is no memory pressure in user space, the shrinkers are never run. */
+static inline int
+register_shrinker(struct shrinker *s)
+{
+	return 0;
+}
+
+static inline void
+unregister_shrinker(struct shrinker *s)
+{
+}
+
+#endif /* __SHRINKER_H__ */
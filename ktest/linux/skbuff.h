@@ -24,6 +24,8 @@
 #include "compiler.h"
 #include "kernel.h"
 
+#define MAX_SKB_FRAGS	17
+
 typedef unsigned int __wsum;
 typedef unsigned char *sk_buff_data_t;
 
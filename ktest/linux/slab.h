@@ -58,6 +58,9 @@ kmalloc(size_t size, gfp_t gf_flags)
 	return p;
 }
 
+#define cpu_to_node(cpu)		({ (void)(cpu); NUMA_NO_NODE; })
+#define kmalloc_node(size, flags, node)	kmalloc(size, flags)
+
 /**
  * Emulates buddy system allocating higher order page buddies by aligned
  * addresses.
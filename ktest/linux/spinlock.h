@@ -32,6 +32,8 @@ typedef pthread_mutex_t	spinlock_t;
 #define spin_lock(lock)			pthread_mutex_lock(lock)
 #define spin_trylock(lock)		(!pthread_mutex_trylock(lock))
 #define spin_unlock(lock)		pthread_mutex_unlock(lock)
+#define spin_lock_bh(lock)		pthread_mutex_lock(lock)
+#define spin_unlock_bh(lock)		pthread_mutex_unlock(lock)
 
 /*
  * Pthread doesn't have RW spin-locks,
@@ -22,6 +22,7 @@
 
 #include <stdlib.h>
 
+#include "bug.h"
 #include "kernel.h"
 
 static size_t __thr_max = 0;
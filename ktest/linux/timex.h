@@ -0,0 +1,40 @@
+/**
+ *	Tempesta kernel emulation unit testing framework.
+ *
+ * Copyright (C) 2020 Tempesta Technologies, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#ifndef __TIMEX_H__
+#define __TIMEX_H__
+
+#include <time.h>
+
+typedef unsigned long long cycles_t;
+
+static inline cycles_t
+get_cycles(void)
+{
+	return __builtin_ia32_rdtsc();
+}
+
+/* linux/timekeeping.h */
+static inline unsigned long
+get_seconds(void)
+{
+	return time(NULL);
+}
+
+#endif /* __TIMEX_H__ */
@@ -0,0 +1,48 @@
+/**
+ *	Tempesta kernel emulation unit testing framework.
+ *
+ * Copyright (C) 2020 Tempesta Technologies, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#ifndef __WORKQUEUE_H__
+#define __WORKQUEUE_H__
+
+#include <stdbool.h>
+
+struct work_struct;
+typedef void (*work_func_t)(struct work_struct *work);
+
+struct work_struct {
+	work_func_t	func;
+};
+
+#define INIT_WORK(w, f)		((w)->func = (f))
+
+/* Run the work synchronously, user space has no workers. */
+static inline bool
+schedule_work_on(int cpu, struct work_struct *work)
+{
+	work->func(work);
+	return true;
+}
+
+static inline bool
+cancel_work_sync(struct work_struct *work)
+{
+	return false;
+}
+
+#endif /* __WORKQUEUE_H__ */
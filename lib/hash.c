@@ -39,11 +39,11 @@ __hash_calc(unsigned long *crc0, unsigned long *crc1, const char *data,
 	}
 	if (((n + 1) << 3) <= len) {
 		CRCQ(*crc0, d[n]);
-		for (n = (n + 1) << 3; n < len; ++n)
-			CRCB(*crc1, data[n]);
+		n = (n + 1) << 3;
+		__hash_tail(crc1, data + n, len - n);
 	} else {
-		for (n <<= 3; n < len; ++n)
-			CRCB(*crc0, data[n]);
+		n <<= 3;
+		__hash_tail(crc0, data + n, len - n);
 	}
 }
 EXPORT_SYMBOL(__hash_calc);
@@ -23,9 +23,37 @@
 #define CRCQ(crc, data64) \
 	asm volatile("crc32q %2, %0" : "=r"(crc) : "0"(crc), "r"(data64))
 
+#define CRCL(crc, data32) \
+	asm volatile("crc32l %2, %k0" : "=r"(crc) : "0"(crc), "r"(data32))
+
+#define CRCW(crc, data16) \
+	asm volatile("crc32w %2, %k0" : "=r"(crc) : "0"(crc), "r"(data16))
+
 #define CRCB(crc, data8) \
 	asm volatile("crc32b %2, %0" : "=r"(crc) : "0"(crc), "r"(data8))
 
+/**
+ * Feed @len bytes of @data to @crc using the widest CRC32 instructions.
+ * CRC32C of a word is the same as CRC32C of its bytes in little-endian order,
+ * so the result doesn't depend on how the data is split to the instructions.
+ */
+static inline void
+__hash_tail(unsigned long *crc, const char *data, size_t len)
+{
+	for ( ; len >= 8; data += 8, len -= 8)
+		CRCQ(*crc, *(unsigned long *)data);
+	if (len & 4) {
+		CRCL(*crc, *(unsigned int *)data);
+		data += 4;
+	}
+	if (len & 2) {
+		CRCW(*crc, *(unsigned short *)data);
+		data += 2;
+	}
+	if (len & 1)
+		CRCB(*crc, *data);
+}
+
 void __hash_calc(unsigned long *crc0, unsigned long *crc1, const char *data,
 		 size_t len);
 
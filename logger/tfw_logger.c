@@ -0,0 +1,235 @@
+/**
+ *		Tempesta FW
+ *
+ * Access log reader: drains the per-CPU rings of the binary access log
+ * shared by Tempesta FW and writes the records as text lines.
+ *
+ * Copyright (C) 2020 Tempesta Technologies, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "access_log.h"
+
+#define CPUS_MAX	4096
+
+typedef struct {
+	TfwAccessLogHdr		*hdr;
+	TfwAccessLogRec		*recs;
+	__u64			drops;
+} Ring;
+
+static const char *methods[] = {
+	"-", "COPY", "DELETE", "GET", "HEAD", "LOCK", "MKCOL", "MOVE",
+	"OPTIONS", "PATCH", "POST", "PROPFIND", "PROPPATCH", "PUT", "TRACE",
+	"UNLOCK", "PURGE"
+};
+static const char *srcs[] = {
+	[TFW_ALOG_SRC_UPSTREAM]	= "upstream",
+	[TFW_ALOG_SRC_CACHE]	= "cache",
+	[TFW_ALOG_SRC_LOCAL]	= "local",
+};
+
+static Ring rings[CPUS_MAX];
+static int rings_n;
+static volatile sig_atomic_t stop;
+
+static void
+usage(const char *name)
+{
+	fprintf(stderr, "\nUsage: %s [-f file] [-o file] [-i msecs]\n\n"
+		"  -f <file>   Access log file,"
+		" /proc/tempesta/access_log by default.\n"
+		"  -o <file>   Output file, standard output by default.\n"
+		"  -i <msecs>  Poll interval of the idle rings, 100ms by"
+		" default.\n\n", name);
+	exit(1);
+}
+
+static void
+on_signal(int sig)
+{
+	stop = 1;
+}
+
+static const char *
+addr_str(const __u8 *addr, char *buf, size_t len)
+{
+	static const __u8 v4mapped[12] = {
+		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff
+	};
+
+	if (!memcmp(addr, v4mapped, sizeof(v4mapped)))
+		return inet_ntop(AF_INET, addr + 12, buf, len);
+	return inet_ntop(AF_INET6, addr, buf, len);
+}
+
+static void
+rec_print(FILE *out, const TfwAccessLogRec *r)
+{
+	char addr[INET6_ADDRSTRLEN], up[INET6_ADDRSTRLEN], ts[32];
+	time_t sec = r->ts / 1000000000;
+	struct tm tm;
+
+	gmtime_r(&sec, &tm);
+	strftime(ts, sizeof(ts), "%Y-%m-%dT%H:%M:%S", &tm);
+	fprintf(out, "%s.%06lluZ %s \"%.*s\" %s %u %llu %uus %s",
+		ts, (unsigned long long)(r->ts % 1000000000) / 1000,
+		addr_str(r->addr, addr, sizeof(addr)),
+		TFW_ALOG_VHOST_LEN, r->vhost,
+		r->method < sizeof(methods) / sizeof(methods[0])
+		? methods[r->method] : "UNKNOWN",
+		r->status, (unsigned long long)r->bytes, r->latency,
+		r->src < sizeof(srcs) / sizeof(srcs[0]) ? srcs[r->src] : "-");
+	if (r->src == TFW_ALOG_SRC_UPSTREAM) {
+		const char *u = addr_str(r->upstream, up, sizeof(up));
+
+		fprintf(out, strchr(u, ':') ? " [%s]:%u" : " %s:%u", u,
+			r->upstream_port);
+	}
+	fputc('\n', out);
+}
+
+/*
+ * Map the ring of each CPU. Offline CPUs have no rings, and the mapping
+ * fails with EINVAL past the last possible CPU.
+ */
+static int
+rings_map(const char *path)
+{
+	long page = sysconf(_SC_PAGESIZE);
+	TfwAccessLogHdr *hdr;
+	size_t ring_sz;
+	int fd, cpu;
+
+	if ((fd = open(path, O_RDWR)) < 0) {
+		perror(path);
+		return -1;
+	}
+	hdr = mmap(NULL, page, PROT_READ, MAP_SHARED, fd, 0);
+	if (hdr == MAP_FAILED) {
+		perror("Cannot map the access log, is access_log_buffer set?");
+		goto err;
+	}
+	if (hdr->version != TFW_ALOG_VERSION
+	    || hdr->rec_size != sizeof(TfwAccessLogRec))
+	{
+		fprintf(stderr, "Unsupported access log version %u\n",
+			hdr->version);
+		munmap(hdr, page);
+		goto err;
+	}
+	ring_sz = hdr->ring_size;
+	munmap(hdr, page);
+
+	for (cpu = 0; cpu < CPUS_MAX; ++cpu) {
+		hdr = mmap(NULL, ring_sz, PROT_READ | PROT_WRITE, MAP_SHARED,
+			   fd, (off_t)cpu * ring_sz);
+		if (hdr == MAP_FAILED) {
+			if (errno == ENODEV)
+				continue;
+			break;
+		}
+		rings[rings_n].hdr = hdr;
+		rings[rings_n].recs = (TfwAccessLogRec *)((char *)hdr + page);
+		rings[rings_n].drops = hdr->drops;
+		++rings_n;
+	}
+	close(fd);
+
+	return rings_n ? 0 : -1;
+err:
+	close(fd);
+	return -1;
+}
+
+/* Drain ring @r and return the number of the consumed records. */
+static unsigned long
+ring_drain(FILE *out, Ring *r)
+{
+	TfwAccessLogHdr *hdr = r->hdr;
+	__u64 head = __atomic_load_n(&hdr->head, __ATOMIC_ACQUIRE);
+	__u64 tail = hdr->tail, n = head - tail;
+	__u64 drops = __atomic_load_n(&hdr->drops, __ATOMIC_RELAXED);
+
+	for ( ; tail != head; ++tail)
+		rec_print(out, &r->recs[tail & (hdr->size - 1)]);
+	/* Let the kernel reuse the records. */
+	__atomic_store_n(&hdr->tail, tail, __ATOMIC_RELEASE);
+
+	if (drops != r->drops) {
+		fprintf(stderr, "%llu records dropped\n",
+			(unsigned long long)(drops - r->drops));
+		r->drops = drops;
+	}
+
+	return n;
+}
+
+int
+main(int argc, char *argv[])
+{
+	const char *path = "/proc/tempesta/access_log";
+	FILE *out = stdout;
+	int i, c, intvl = 100;
+
+	while ((c = getopt(argc, argv, "f:o:i:h")) != -1) {
+		switch (c) {
+		case 'f':
+			path = optarg;
+			break;
+		case 'o':
+			if (!(out = fopen(optarg, "a"))) {
+				perror(optarg);
+				return 1;
+			}
+			break;
+		case 'i':
+			intvl = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (rings_map(path))
+		return 1;
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+
+	while (!stop) {
+		unsigned long n = 0;
+
+		for (i = 0; i < rings_n; ++i)
+			n += ring_drain(out, &rings[i]);
+		if (!n) {
+			fflush(out);
+			usleep(intvl * 1000);
+		}
+	}
+	fflush(out);
+
+	return 0;
+}
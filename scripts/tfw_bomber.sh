@@ -2,7 +2,7 @@
 #
 # Tempesta Bomber: a tool for HTTP servers stress testing.
 #
-# Copyright (C) 2015-2016 Tempesta Technologies, Inc.
+# Copyright (C) 2015-2020 Tempesta Technologies, Inc.
 #
 # This program is free software; you can redistribute it and/or modify it
 # under the terms of the GNU General Public License as published by
@@ -23,7 +23,7 @@
 # Path to testing modules.
 tm_path=${TFW_PATH:="$TFW_ROOT/tempesta_fw/t"}
 
-declare conn= iter= msgs= srv= thr= unload= verbose=
+declare conn= iter= msgs= srv= thr= unload= verbose= lat= uris=
 
 declare -r long_opts="help,start,stop"
 
@@ -44,7 +44,11 @@ usage()
 	echo -e "  -d <devs>   Ingress and egress network devices"
 	echo -e "              (ex. -d \"lo ens3\").\n"
 	echo -e "  -i <I>      Number of iterations, 2 by default."
+	echo -e "  -l          Wait for each response and print the latencies."
 	echo -e "  -m <M>      Number messages per connection, 2 by default."
+	echo -e "  -r <uris>   Request mix of URIs with optional weights"
+	echo -e "              (ex. -r \"/index.html:3,/img.png:1\")."
+	echo -e "              Fuzzer generated requests by default."
 	echo -e "  -t <T>      Number of client threads, 2 by default."
 	echo -e "  -u          Unload Tempesta modules on stop action."
 	echo -e "  -v          Verbose output."
@@ -87,13 +91,14 @@ start()
 	insmod $tm_path/tfw_fuzzer.ko
 	[ $? -ne 0 ] && error "cannot load HTTP fuzzer"
 
-	insmod $tm_path/tfw_bomber.ko $conn $iter $msgs $srv $thr $verbose
+	insmod $tm_path/tfw_bomber.ko $conn $iter $msgs $srv $thr $verbose \
+		$lat $uris
 	[ $? -ne 0 ] && error "cannot start bomber"
 
 	stop
 }
 
-args=$(getopt -o "a:c:d:i:m:t:uv" -a -l "$long_opts" -- "$@")
+args=$(getopt -o "a:c:d:i:lm:r:t:uv" -a -l "$long_opts" -- "$@")
 eval set -- "${args}"
 while :; do
 	case "$1" in
@@ -122,10 +127,18 @@ while :; do
 			iter="i=$2"
 			shift 2
 			;;
+		-l)
+			lat="l=1"
+			shift
+			;;
 		-m)
 			msgs="m=$2"
 			shift 2
 			;;
+		-r)
+			uris="u=$2"
+			shift 2
+			;;
 		-t)
 			thr="t=$2"
 			shift 2
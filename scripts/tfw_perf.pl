@@ -0,0 +1,235 @@
+#!/usr/bin/env perl
+#
+# Tempesta FW performance regression suite.
+#
+# Runs the microbenchmarks and, optionally, the bomber loopback scenario,
+# saves the results as JSON and compares them against a baseline.
+#
+# Copyright (C) 2020 Tempesta Technologies, Inc.
+#
+# This program is free software; you can redistribute it and/or modify it
+# under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2 of the License,
+# or (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful, but WITHOUT
+# ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+# FITNESS FOR A PARTICULAR PURPOSE.
+# See the GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License along with
+# this program; if not, write to the Free Software Foundation, Inc., 59
+# Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+use strict;
+use warnings;
+use File::Basename;
+use Getopt::Long qw(:config no_ignore_case);
+use JSON::PP;
+
+my $root = dirname(dirname(__FILE__));
+my $out = "perf.json";
+my ($baseline, $bomber, $kernel, $help);
+my $tolerance = 5;
+my @tolerances;
+
+sub usage
+{
+	print <<EOF;
+
+Tempesta FW performance regression suite
+
+Usage: $0 [options]
+
+Options:
+  -o <file>       Save the results to the file, "perf.json" by default.
+  -B <file>       Compare the results against the baseline file.
+  -t <percent>    Allowed degradation of a metric, 5% by default.
+  -T <re=percent> Allowed degradation of the metrics matching the regular
+                  expression (ex. -T "^bomber\\.=20"), may be repeated.
+  -k              Run the kernel microbenchmarks. Tempesta FW must be loaded
+                  and built with CACHE_BENCH=1 and PARSER_BENCH=1.
+  -b <addr>       Run the bomber latency scenario against the address
+                  (ex. -b 127.0.0.1:80) of a running Tempesta FW.
+  -h              Show this message and exit.
+
+The user space TDB and TLS benchmarks are always run. Metrics with "per_sec"
+in the name are better when higher, the others are better when lower.
+EOF
+	exit(1);
+}
+
+GetOptions("o=s" => \$out, "B=s" => \$baseline, "t=f" => \$tolerance,
+	   "T=s" => \@tolerances, "k" => \$kernel, "b=s" => \$bomber,
+	   "h" => \$help) or usage();
+usage() if $help;
+
+my (%metrics, %samples);
+
+sub add
+{
+	my ($name, $val) = @_;
+
+	push(@{$samples{$name}}, $val);
+}
+
+sub run
+{
+	my ($cmd) = @_;
+
+	print "$cmd\n";
+	my @lines = `$cmd 2>&1`;
+	die "'$cmd' failed\n" if $?;
+
+	return @lines;
+}
+
+# Lines like "prefix: id1=str id2=str cnt=1 x_per_y=2". Fields with '_per_'
+# in the name are the metrics and the non-numeric fields and numbers of
+# fragments identify the run. Results of the same run on different CPUs and
+# nodes are averaged.
+sub parse_kv
+{
+	my ($name, @lines) = @_;
+
+	foreach (@lines) {
+		my (@id, %m);
+
+		next unless /(?:^|\s)\w+=\S+/;
+		s/^.*?\w+_bench:\s*//;
+		foreach (split) {
+			my ($k, $v) = split(/=/, $_, 2);
+			next unless defined($v);
+			if ($k =~ /_per_/) {
+				$m{$k} = $v;
+			} elsif ($v !~ /^-?\d+$/) {
+				push(@id, $v);
+			} elsif ($k eq "frags") {
+				push(@id, "f$v");
+			}
+		}
+		add(join(".", $name, @id, $_), $m{$_}) foreach (keys %m);
+	}
+}
+
+sub dmesg_mark
+{
+	my $mark = "tfw_perf_" . time();
+
+	`echo "$mark" > /dev/kmsg`;
+
+	return $mark;
+}
+
+sub dmesg_since
+{
+	my ($mark) = @_;
+	my @lines = `dmesg`;
+	my $i = 0;
+
+	for ($i = $#lines; $i >= 0; --$i) {
+		last if $lines[$i] =~ /\Q$mark\E/;
+	}
+
+	return @lines[$i + 1 .. $#lines];
+}
+
+sub kmod
+{
+	my ($mod, $args) = @_;
+	my $mark = dmesg_mark();
+
+	run("insmod $root/tempesta_fw/t/$mod.ko $args");
+	`rmmod $mod`;
+
+	return grep(/_bench:/, dmesg_since($mark));
+}
+
+# TDB table: op count Kops/s avg p50 p90 p99 p99.9 max failed.
+sub parse_tdb
+{
+	my ($name, @lines) = @_;
+
+	foreach (@lines) {
+		my @f = split;
+
+		next unless @f >= 9 && $f[0] =~ /^\w+$/ && $f[1] =~ /^\d+$/;
+		add("$name.$f[0].kops_per_sec", $f[2]);
+		add("$name.$f[0].avg_ns", $f[3]);
+		add("$name.$f[0].p99_ns", $f[6]);
+	}
+}
+
+sub parse_bomber
+{
+	foreach (@_) {
+		add("bomber.total_time_ms", $1) if /total time: (\d+)ms/;
+		add("bomber.latency_p${1}_us", $2)
+			if /latency p([\d.]+): < (\d+)us/;
+	}
+}
+
+run("make -C $root/tempesta_db/t tdb_bench");
+parse_tdb("tdb", run("$root/tempesta_db/t/tdb_bench"));
+parse_tdb("tdb_lf", run("$root/tempesta_db/t/tdb_bench -l -m 1:8:0:1"));
+run("make -C $root/tls/t bench_handshake");
+parse_kv("tls", run("$root/tls/t/bench_handshake"));
+
+if ($kernel) {
+	parse_kv("parser", kmod("tfw_parser_bench", ""));
+	parse_kv("cache", kmod("tfw_cache_bench", ""));
+}
+
+if ($bomber) {
+	my $mark = dmesg_mark();
+
+	run("insmod $root/tempesta_fw/t/tfw_fuzzer.ko");
+	run("insmod $root/tempesta_fw/t/tfw_bomber.ko s=$bomber l=1 t=4 c=8"
+	    . " m=10000 i=1 u=/:1");
+	`rmmod tfw_bomber tfw_fuzzer`;
+	parse_bomber(dmesg_since($mark));
+}
+
+foreach (keys %samples) {
+	my @s = @{$samples{$_}};
+	my $sum = 0;
+
+	$sum += $_ foreach (@s);
+	$metrics{$_} = $sum / @s;
+}
+
+open(my $fh, ">", $out) or die "Cannot write $out: $!\n";
+print $fh JSON::PP->new->canonical->pretty->encode({ metrics => \%metrics });
+close($fh);
+print "Results are saved to $out\n";
+
+exit(0) unless $baseline;
+
+open($fh, "<", $baseline) or die "Cannot read $baseline: $!\n";
+my $base = decode_json(do { local $/; <$fh> })->{metrics};
+close($fh);
+
+my $fails = 0;
+foreach my $name (sort keys %$base) {
+	my ($bv, $v, $tol) = ($base->{$name}, $metrics{$name}, $tolerance);
+	my $diff;
+
+	unless (defined($v)) {
+		print "MISSING  $name\n";
+		next;
+	}
+	foreach (@tolerances) {
+		my ($re, $t) = /^(.*)=([\d.]+)$/ or die "Bad tolerance: $_\n";
+		$tol = $t if $name =~ /$re/;
+	}
+	next unless $bv;
+	# Positive difference is a degradation.
+	$diff = ($name =~ /per_sec/ ? $bv - $v : $v - $bv) * 100 / $bv;
+	printf("%-8s %s: %.1f -> %.1f (%+.1f%%)\n",
+	       $diff > $tol ? "REGRESS" : "OK", $name, $bv, $v,
+	       ($v - $bv) * 100 / $bv);
+	++$fails if $diff > $tol;
+}
+print "$fails regressions found\n";
+
+exit($fails ? 2 : 0);
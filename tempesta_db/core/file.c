@@ -22,6 +22,7 @@
  */
 #include <linux/file.h>
 #include <linux/fs.h>
+#include <linux/sizes.h>
 #include <linux/slab.h>
 #include <linux/tempesta.h>
 #include <linux/topology.h>
@@ -164,32 +165,40 @@ ma_free(unsigned long addr, int node)
 
 /**
  * Map file to reserved set of unswappable pages.
+ *
+ * @max_len bytes are reserved for the mapping, so the database can grow up
+ * to the size while only @len bytes of the file are read. Database offsets
+ * are relative to the mapping start, so the mapping must be contiguous and
+ * can't be extended by other areas later.
  */
 static unsigned long
-tempesta_map_file(struct file *file, unsigned long len, int node)
+tempesta_map_file(struct file *file, unsigned long len, unsigned long max_len,
+		  int node)
 {
 	mm_segment_t oldfs;
 	MArea *ma;
 	loff_t off = 0;
 	unsigned long addr = -ENOMEM;
 
-	BUG_ON(len & ~TDB_EXT_MASK);
-	if (file->f_inode->i_size != len) {
-		TDB_ERR("Bad file size %lld while expected is %lu\n",
-			file->f_inode->i_size, len);
+	BUG_ON(max_len & ~TDB_EXT_MASK);
+	if (file->f_inode->i_size != len || (len & ~TDB_EXT_MASK)
+	    || len > max_len)
+	{
+		TDB_ERR("Bad file size %lld while expected is %lu..%lu\n",
+			file->f_inode->i_size, len, max_len);
 		return -EBADF;
 	}
 
 	mutex_lock(&map_mtx);
 
-	ma = ma_get_best_fit(len, node);
+	ma = ma_get_best_fit(max_len, node);
 	if (!ma) {
 		TDB_ERR("Cannot allocate %lu pages at node %d\n",
-			len / PAGE_SIZE, node);
+			max_len / PAGE_SIZE, node);
 		goto err;
 	}
 
-	ma = ma_split(ma, len);
+	ma = ma_split(ma, max_len);
 	if (!ma)
 		goto err;
 
@@ -218,7 +227,7 @@ err:
 }
 
 /**
- * Synchronize memory mapping with the file.
+ * Synchronize memory mapping with the file, the file grows with the database.
  * Called from process context.
  */
 static void
@@ -266,7 +275,7 @@ err:
  * The function must not be called from softirq!
  */
 int
-tdb_file_open(TDB *db, unsigned long size)
+tdb_file_open(TDB *db, unsigned long size, unsigned long max_size)
 {
 	unsigned long ret, addr;
 	struct file *filp;
@@ -296,7 +305,8 @@ tdb_file_open(TDB *db, unsigned long size)
 		return ret;
 	}
 
-	addr = tempesta_map_file(filp, size, db->node);
+	/* The file is larger than @size if the database grew before. */
+	addr = tempesta_map_file(filp, inode->i_size, max_size, db->node);
 	if (IS_ERR((void *)addr)) {
 		TDB_ERR("Cannot map file\n");
 		filp_close(filp, NULL);
@@ -336,6 +346,19 @@ tdb_init_mappings(void)
 		}
 		mas[node].start = tm->addr;
 		mas[node].pages = tm->pages;
+		/*
+		 * 4KB pages mean that the kernel failed to reserve huge pages,
+		 * so all the database lookups suffer from TLB misses.
+		 */
+		if (tm->page_shift <= PAGE_SHIFT)
+			TDB_WARN("%luMB at node %d are mapped by 4KB pages,"
+				 " consider to reserve less memory by"
+				 " tempesta_dbmem\n",
+				 tm->pages / (SZ_1M / PAGE_SIZE), node);
+		else
+			TDB_LOG("%luMB at node %d are mapped by %luKB pages\n",
+				tm->pages / (SZ_1M / PAGE_SIZE), node,
+				(1UL << tm->page_shift) / SZ_1K);
 	}
 	return 0;
 }
@@ -23,7 +23,7 @@
 
 #include "tdb.h"
 
-int tdb_file_open(TDB *db, unsigned long size);
+int tdb_file_open(TDB *db, unsigned long size, unsigned long max_size);
 void tdb_file_close(TDB *db);
 int tdb_init_mappings(void);
 
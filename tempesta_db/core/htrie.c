@@ -29,12 +29,15 @@
  */
 #include <asm/sync_bitops.h>
 #include <linux/bitops.h>
+#include <linux/mm.h>
+#include <linux/rcupdate.h>
 #include <linux/slab.h>
 
 #include "lib/str.h"
 #include "htrie.h"
+#include "snapshot.h"
 
-#define TDB_MAGIC	0x434947414D424454UL /* "TDBMAGIC" */
+#define TDB_MAGIC	0x354947414D424454UL /* "TDBMAGI5" */
 #define TDB_BLK_SZ	PAGE_SIZE
 #define TDB_BLK_MASK	(~(TDB_BLK_SZ - 1))
 
@@ -42,9 +45,23 @@
  * Tempesta DB extent descriptor.
  *
  * @b_bmp	- bitmap of used/free blocks;
+ * @b_ref	- number of users of each data block: records (or their
+ *		  chunks) placed in the block and a CPU writing to the block.
+ *		  The block is returned to @b_bmp when the last user
+ *		  releases it;
+ * @b_free	- number of blocks returned to @b_bmp by records removal, this
+ *		  is a hint for tdb_alloc_blk_freed() to skip full extents;
+ * @b_quar	- blocks released by their last users, but probably still
+ *		  read by lock-free readers;
+ * @b_wait	- quarantined blocks waiting for the end of RCU grace period,
+ *		  used by tdb_htrie_reclaim() only.
  */
 typedef struct {
 	unsigned long	b_bmp[TDB_BLK_BMP_2L];
+	atomic_t	b_ref[TDB_EXT_SZ / TDB_BLK_SZ];
+	atomic_t	b_free;
+	unsigned long	b_quar[TDB_BLK_BMP_2L];
+	unsigned long	b_wait[TDB_BLK_BMP_2L];
 } __attribute__((packed)) TdbExt;
 
 /**
@@ -87,13 +104,14 @@ tdb_set_bit(unsigned long *bmp, unsigned int nr)
 }
 
 static TdbHdr *
-tdb_init_mapping(void *p, size_t db_size, unsigned int rec_len)
+tdb_init_mapping(void *p, size_t db_size, size_t max_size,
+		 unsigned int rec_len)
 {
 	int b, hdr_sz;
 	TdbHdr *hdr = (TdbHdr *)p;
 
-	if (db_size > TDB_MAX_DB_SZ) {
-		TDB_ERR("too large database size (%lu)", db_size);
+	if (max_size > TDB_MAX_DB_SZ) {
+		TDB_ERR("too large database size (%lu)", max_size);
 		return NULL;
 	}
 	/* Use variable-size records for large data to store. */
@@ -102,11 +120,12 @@ tdb_init_mapping(void *p, size_t db_size, unsigned int rec_len)
 		return NULL;
 	}
 
-	/* Zero whole area. */
-	memset(hdr, 0, db_size);
+	/* Zero whole area including the room for growth. */
+	memset(hdr, 0, max_size);
 
 	hdr->magic = TDB_MAGIC;
 	hdr->dbsz = db_size;
+	hdr->max_dbsz = max_size;
 	hdr->rec_len = rec_len;
 
 	/* Set next block to just after block with root index node. */
@@ -139,7 +158,10 @@ tdb_free_data_blk(TdbBucket *bckt)
 static inline void
 tdb_free_fsrec(TdbHdr *dbh, TdbFRec *rec)
 {
-	bzero_fast(rec, TDB_HTRIE_RALIGN(sizeof(*rec) + dbh->rec_len));
+	size_t len = TDB_HTRIE_RALIGN(sizeof(*rec) + dbh->rec_len);
+
+	tdb_snap_cow(dbh, rec, len);
+	bzero_fast(rec, len);
 }
 
 static inline void
@@ -148,6 +170,152 @@ tdb_free_vsrec(TdbVRec *rec)
 	rec->len |= TDB_HTRIE_VRFREED;
 }
 
+static inline atomic_t *
+tdb_blk_ref(TdbHdr *dbh, unsigned long off)
+{
+	return &tdb_ext(dbh, TDB_PTR(dbh, off))->b_ref[(off & ~TDB_EXT_MASK)
+						       / TDB_BLK_SZ];
+}
+
+/**
+ * Zero-copy responses attach pages of the database to socket buffers, so
+ * a removed record can still be in flight while its room is free in the
+ * database. The pages are referenced by their owner and by user space
+ * mappings, see tdb_mmap(), and each other reference is held by a socket
+ * buffer. Huge pages are compound, so the references are counted for the
+ * whole huge page containing @p.
+ *
+ * @return true if the memory at @p can't be zeroed and reused yet.
+ */
+static inline bool
+tdb_mem_busy(const void *p)
+{
+	struct page *pg = is_vmalloc_addr(p) ? vmalloc_to_page(p)
+					     : virt_to_page(p);
+
+	return page_count(pg) > 1 + page_mapcount(pg);
+}
+
+/**
+ * Release data block containing byte offset @off. Lock-free readers can
+ * still walk through the block, so the last user puts the block into
+ * quarantine and tdb_htrie_reclaim() returns it to the extent later.
+ */
+static void
+tdb_put_data_blk(TdbHdr *dbh, unsigned long off)
+{
+	unsigned int b = (off & ~TDB_EXT_MASK) / TDB_BLK_SZ;
+	TdbExt *e = tdb_ext(dbh, TDB_PTR(dbh, off));
+
+	tdb_snap_cow(dbh, e, sizeof(*e));
+	if (!atomic_dec_and_test(&e->b_ref[b]))
+		return;
+
+	TDB_DBG("quarantine dblk %#lx\n", TDB_BLK_O(off));
+
+	sync_set_bit(b % BITS_PER_LONG, &e->b_quar[b / BITS_PER_LONG]);
+}
+
+/**
+ * Return the blocks of extent @e marked in @bmp to the extent, so they can
+ * be allocated again, and clear their bits in @bmp. The block data is zeroed
+ * since the allocator users expect zeroed memory. Blocks still referenced by
+ * socket buffers stay in @bmp until the next call.
+ */
+static unsigned int
+tdb_release_blks(TdbHdr *dbh, TdbExt *e, unsigned long *bmp)
+{
+	unsigned int b, n = 0;
+	char *p, *blk;
+
+	tdb_snap_cow(dbh, e, sizeof(*e));
+	for_each_set_bit(b, bmp, TDB_BLK_BMP_2L * BITS_PER_LONG) {
+		blk = TDB_PTR(dbh, TDB_EXT_BASE(dbh, e) + b * TDB_BLK_SZ);
+		if (tdb_mem_busy(blk))
+			continue;
+
+		TDB_DBG("free dblk %#lx\n", TDB_HTRIE_OFF(dbh, blk));
+
+		/* The first block in an extent starts with its header. */
+		p = b ? blk : (char *)(e + 1);
+		tdb_snap_cow(dbh, p, blk + TDB_BLK_SZ - p);
+		bzero_fast(p, blk + TDB_BLK_SZ - p);
+		sync_clear_bit(b % BITS_PER_LONG, &e->b_bmp[b / BITS_PER_LONG]);
+		atomic_inc(&e->b_free);
+		clear_bit(b, bmp);
+		++n;
+	}
+
+	return n;
+}
+
+/**
+ * Release all the quarantined blocks at once.
+ * Called when there are no readers of the database.
+ */
+static void
+tdb_release_quarantine(TdbHdr *dbh)
+{
+	unsigned long o;
+	TdbExt *e;
+
+	for (o = 0; o < dbh->dbsz; o += TDB_EXT_SZ) {
+		e = tdb_ext(dbh, TDB_PTR(dbh, o));
+		tdb_release_blks(dbh, e, e->b_wait);
+		tdb_release_blks(dbh, e, e->b_quar);
+	}
+}
+
+/**
+ * Return the quarantined blocks to their extents after all lock-free
+ * readers which could see the blocks leave their RCU read side critical
+ * sections. Blocks quarantined during the grace period wait for the next
+ * call, as well as blocks still referenced by socket buffers.
+ *
+ * Called from process context by one thread at a time for a database.
+ * Each extent is processed as a separate write operation since the function
+ * sleeps, see tdb_wr_begin().
+ *
+ * @return number of blocks returned to the extents.
+ */
+unsigned int
+tdb_htrie_reclaim(TdbHdr *dbh)
+{
+	int i;
+	bool pending = false, wait = false;
+	unsigned int n = 0;
+	unsigned long o, dbsz = READ_ONCE(dbh->dbsz);
+	TdbExt *e;
+
+	for (o = 0; o < dbsz; o += TDB_EXT_SZ) {
+		e = tdb_ext(dbh, TDB_PTR(dbh, o));
+		tdb_wr_begin(dbh);
+		for (i = 0; i < TDB_BLK_BMP_2L; ++i) {
+			if (e->b_wait[i])
+				wait = true;
+			if (!READ_ONCE(e->b_quar[i]))
+				continue;
+			tdb_snap_cow(dbh, e, sizeof(*e));
+			e->b_wait[i] |= xchg(&e->b_quar[i], 0);
+			pending = true;
+		}
+		tdb_wr_end(dbh);
+	}
+	if (pending)
+		synchronize_rcu_bh();
+	else if (!wait)
+		return 0;
+
+	for (o = 0; o < dbsz; o += TDB_EXT_SZ) {
+		e = tdb_ext(dbh, TDB_PTR(dbh, o));
+		tdb_wr_begin(dbh);
+		n += tdb_release_blks(dbh, e, e->b_wait);
+		tdb_wr_end(dbh);
+	}
+
+	return n;
+}
+
 /**
  * Allocates a free block (system page) in extent @e.
  * @return start of available room (offset in bytes) at the block.
@@ -158,6 +326,7 @@ __tdb_alloc_blk_ext(TdbHdr *dbh, TdbExt *e)
 	int i = 0;
 	unsigned long r;
 
+	tdb_snap_cow(dbh, e, sizeof(*e));
 repeat:
 	r = e->b_bmp[i];
 
@@ -185,13 +354,69 @@ repeat:
 	       + (i * BITS_PER_LONG + r) * TDB_BLK_SZ;
 }
 
+/**
+ * Scan the extents for blocks freed by records removal.
+ * Called when there is no more free extents.
+ *
+ * Freed blocks can also be reused by the sequential allocation in the
+ * current extent, so @b_free may overestimate the number of free blocks.
+ * The counter is reset if the extent has no free blocks and nobody freed
+ * a block since it was read: a block is returned to the bitmap before the
+ * counter is incremented, so it can't be missed.
+ */
+static unsigned long
+tdb_alloc_blk_freed(TdbHdr *dbh)
+{
+	int n;
+	TdbExt *e;
+	unsigned long o, rptr;
+
+	for (o = 0; o < READ_ONCE(dbh->dbsz); o += TDB_EXT_SZ) {
+		e = tdb_ext(dbh, TDB_PTR(dbh, o));
+		if (!(n = atomic_read(&e->b_free)))
+			continue;
+		rptr = __tdb_alloc_blk_ext(dbh, e);
+		if (rptr) {
+			atomic_dec_if_positive(&e->b_free);
+			return rptr;
+		}
+		atomic_cmpxchg(&e->b_free, n, 0);
+	}
+
+	return 0;
+}
+
+/**
+ * Grow the database of current size @dbsz by one extent if it's allowed
+ * by the maximum size. The memory for the growth is reserved and zeroed
+ * when the database is mapped, so the new extent is ready to use and
+ * concurrent readers and writers aren't affected by the growth.
+ *
+ * @return false if the database cannot grow anymore.
+ */
+static bool
+tdb_htrie_grow(TdbHdr *dbh, unsigned long dbsz)
+{
+	if (dbsz + TDB_EXT_SZ > dbh->max_dbsz)
+		return false;
+	if (cmpxchg(&dbh->dbsz, dbsz, dbsz + TDB_EXT_SZ) == dbsz)
+		TDB_DBG("Grow database %p to %lu bytes\n", dbh,
+			dbsz + TDB_EXT_SZ);
+	/* Or somebody else has just grown the database. */
+	return true;
+}
+
 static unsigned long
 tdb_alloc_blk(TdbHdr *dbh)
 {
 	TdbExt *e;
 	long g_nwb, rptr, next_blk;
+	unsigned long dbsz;
 
+	/* The header keeps the allocation state of the database. */
+	tdb_snap_cow(dbh, dbh, TDB_HDR_SZ(dbh));
 retry:
+	dbsz = READ_ONCE(dbh->dbsz);
 	g_nwb = atomic64_read(&dbh->nwb);
 	e = tdb_ext(dbh, TDB_PTR(dbh, g_nwb));
 
@@ -220,12 +445,20 @@ retry:
 	 * Whole extent shouldn't be fully utilized by concurrent contexts
 	 * while we're in the function, so we expect that it will satisfy
 	 * our allocation request.
+	 *
+	 * Freed blocks are reused before the database grows to keep it
+	 * compact.
 	 */
-	if (unlikely(TDB_HTRIE_OFF(dbh, e) == dbh->dbsz)) {
+	if (unlikely(TDB_HTRIE_OFF(dbh, e) == dbsz)) {
+		rptr = tdb_alloc_blk_freed(dbh);
+		if (likely(rptr))
+			goto allocated;
+		if (tdb_htrie_grow(dbh, dbsz))
+			goto retry;
 		TDB_ERR("out of free space\n");
 		return 0;
 	}
-	BUG_ON(TDB_HTRIE_OFF(dbh, e) > dbh->dbsz);
+	BUG_ON(TDB_HTRIE_OFF(dbh, e) > dbsz);
 	set_bit(TDB_EXT_ID(TDB_EXT_BASE(dbh, e)), dbh->ext_bmp);
 
 	TDB_DBG("Allocated new extent %p\n", e);
@@ -234,6 +467,8 @@ retry:
 	BUG_ON(!rptr);
 
 allocated:
+	/* The caller writes to the block. */
+	tdb_snap_cow(dbh, TDB_PTR(dbh, TDB_BLK_O(rptr)), TDB_BLK_SZ);
 	next_blk = rptr + TDB_BLK_SZ;
 	for ( ; g_nwb <= rptr; g_nwb = atomic64_read(&dbh->nwb))
 		atomic64_cmpxchg(&dbh->nwb, g_nwb, next_blk);
@@ -246,11 +481,52 @@ allocated:
 	return TDB_HTRIE_DALIGN(rptr);
 }
 
+/*
+ * Writers lock buckets as before and also make odd the bucket sequence
+ * counter while they hold the lock, so lock-free readers can detect
+ * concurrent bucket modifications and retry.
+ */
+static inline void
+tdb_bucket_wlock(TdbHdr *dbh, TdbBucket *b)
+{
+	/* Writers modify small records in the bucket under the lock. */
+	tdb_snap_cow(dbh, b, TDB_HTRIE_MINDREC);
+	write_lock_bh(&b->lock);
+	WRITE_ONCE(b->seq, b->seq + 1);
+	smp_wmb();
+}
+
+static inline void
+tdb_bucket_wunlock(TdbBucket *b)
+{
+	smp_wmb();
+	WRITE_ONCE(b->seq, b->seq + 1);
+	write_unlock_bh(&b->lock);
+}
+
+static inline unsigned long
+tdb_bucket_read_begin(TdbBucket *b)
+{
+	unsigned long seq;
+
+	while ((seq = READ_ONCE(b->seq)) & 1)
+		cpu_relax();
+	smp_rmb();
+
+	return seq;
+}
+
+static inline bool
+tdb_bucket_read_retry(TdbBucket *b, unsigned long seq)
+{
+	smp_rmb();
+
+	return READ_ONCE(b->seq) != seq;
+}
+
 static void
-tdb_htrie_init_bucket(TdbBucket *b)
+tdb_bucket_lock_init(TdbBucket *b)
 {
-	b->coll_next = 0;
-	b->flags = 0;
 	rwlock_init(&b->lock);
 #ifdef CONFIG_LOCKDEP
 	/*
@@ -263,6 +539,15 @@ tdb_htrie_init_bucket(TdbBucket *b)
 #endif
 }
 
+static void
+tdb_htrie_init_bucket(TdbBucket *b)
+{
+	b->coll_next = 0;
+	b->flags = 0;
+	b->seq = 0;
+	tdb_bucket_lock_init(b);
+}
+
 /**
  * @return byte offset of the allocated data block and sets @len to actually
  * available room for writing if @len doesn't fit to block.
@@ -303,6 +588,7 @@ tdb_alloc_data(TdbHdr *dbh, size_t *len, int bucket_hdr)
 	    || TDB_BLK_O(rptr + res_len) > TDB_BLK_O(rptr))
 	{
 		size_t max_data_len;
+		unsigned long old_wcl = rptr;
 
 		/*
 		 * Use a new page and/or extent for the data.
@@ -311,6 +597,10 @@ tdb_alloc_data(TdbHdr *dbh, size_t *len, int bucket_hdr)
 		rptr = tdb_alloc_blk(dbh);
 		if (!rptr)
 			goto out;
+		/* The CPU uses the block until it moves to the next one. */
+		atomic_set(tdb_blk_ref(dbh, rptr), 1);
+		if (old_wcl & ~TDB_BLK_MASK)
+			tdb_put_data_blk(dbh, old_wcl);
 
 		max_data_len = TDB_BLK_SZ - (rptr & ~TDB_BLK_MASK);
 		if (res_len > max_data_len) {
@@ -324,11 +614,18 @@ tdb_alloc_data(TdbHdr *dbh, size_t *len, int bucket_hdr)
 
 	BUG_ON(TDB_HTRIE_DALIGN(rptr) != rptr);
 	TDB_DBG("alloc dblk %#lx for len=%lu(%lu)\n", rptr, *len, res_len);
+	tdb_snap_cow(dbh, tdb_ext(dbh, TDB_PTR(dbh, rptr)), sizeof(TdbExt));
+	tdb_snap_cow(dbh, TDB_PTR(dbh, rptr), res_len);
 
 	new_wcl = rptr + res_len;
 	BUG_ON(TDB_HTRIE_DALIGN(new_wcl) != new_wcl);
 	this_cpu_ptr(dbh->pcpu)->d_wcl = new_wcl;
 
+	atomic_inc(tdb_blk_ref(dbh, rptr));
+	if (!(new_wcl & ~TDB_BLK_MASK))
+		/* The block is fully written. */
+		tdb_put_data_blk(dbh, rptr);
+
 	if (bucket_hdr) {
 		tdb_htrie_init_bucket(TDB_PTR(dbh, rptr));
 		rptr += sizeof(TdbBucket);
@@ -364,6 +661,7 @@ tdb_alloc_index(TdbHdr *dbh)
 
 	TDB_DBG("alloc iblk %#lx\n", rptr);
 	BUG_ON(TDB_HTRIE_IALIGN(rptr) != rptr);
+	tdb_snap_cow(dbh, TDB_PTR(dbh, rptr), sizeof(TdbHtrieNode));
 
 	this_cpu_ptr(dbh->pcpu)->i_wcl = rptr + sizeof(TdbHtrieNode);
 
@@ -390,8 +688,12 @@ tdb_htrie_smallrec_link(TdbHdr *dbh, size_t len, TdbBucket *bckt)
 		TDB_HTRIE_FOREACH_REC_UNLOCKED(dbh, bckt, r) {
 			n = (char *)r - (char *)bckt
 			    + TDB_HTRIE_RALIGN(sizeof(*r) + len);
-			if (!tdb_live_vsrec(r) && n <= TDB_HTRIE_MINDREC) {
+			if (!tdb_live_vsrec(r) && n <= TDB_HTRIE_MINDREC
+			    && !tdb_mem_busy(r))
+			{
 				/* Freed record - reuse. */
+				tdb_snap_cow(dbh, r,
+					     sizeof(*r) + TDB_HTRIE_VRLEN(r));
 				bzero_fast(r, sizeof(*r) + TDB_HTRIE_VRLEN(r));
 				o = TDB_HTRIE_OFF(dbh, r);
 				goto done;
@@ -402,7 +704,9 @@ tdb_htrie_smallrec_link(TdbHdr *dbh, size_t len, TdbBucket *bckt)
 		TDB_HTRIE_FOREACH_REC_UNLOCKED(dbh, bckt, r) {
 			n = (char *)r - (char *)bckt
 			    + TDB_HTRIE_RALIGN(sizeof(*r) + len);
-			if (!tdb_live_fsrec(dbh, r) && n <= TDB_HTRIE_MINDREC) {
+			if (!tdb_live_fsrec(dbh, r) && n <= TDB_HTRIE_MINDREC
+			    && !tdb_mem_busy(r))
+			{
 				/* Already freed record - just reuse. */
 				o = TDB_HTRIE_OFF(dbh, r);
 				goto done;
@@ -516,6 +820,7 @@ do {									\
 	k = TDB_HTRIE_IDX(key, bits - TDB_HTRIE_BITS);
 	TDB_DBG("link iblk=%p w/ iblk=%p (%#x) by idx=%#lx\n",
 		*node, new_in, new_in_idx, k);
+	tdb_snap_cow(dbh, &(*node)->shifts[k], sizeof(new_in_idx));
 	(*node)->shifts[k] = new_in_idx;
 	*node = new_in;
 
@@ -587,7 +892,10 @@ tdb_htrie_create_rec(TdbHdr *dbh, unsigned long off, unsigned long key,
 {
 	char *ptr = TDB_PTR(dbh, off);
 	TdbRec *r = (TdbRec *)ptr;
+	size_t hdr_len = TDB_HTRIE_VARLENRECS(dbh) ? sizeof(TdbVRec)
+						   : sizeof(TdbFRec);
 
+	tdb_snap_cow(dbh, ptr, hdr_len + len);
 	BUG_ON(r->key);
 	r->key = key;
 	if (TDB_HTRIE_VARLENRECS(dbh)) {
@@ -611,8 +919,8 @@ tdb_htrie_create_rec(TdbHdr *dbh, unsigned long off, unsigned long key,
  * The function is called to extend just added new record, so it's not expected
  * that it can be called concurrently for the same record.
  */
-TdbVRec *
-tdb_htrie_extend_rec(TdbHdr *dbh, TdbVRec *rec, size_t size)
+static TdbVRec *
+__tdb_htrie_extend_rec(TdbHdr *dbh, TdbVRec *rec, size_t size)
 {
 	unsigned long o;
 	TdbVRec *chunk;
@@ -636,6 +944,7 @@ retry:
 	BUG_ON(!tdb_live_vsrec(rec));
 
 	o = TDB_O2DI(o);
+	tdb_snap_cow(dbh, &rec->chunk_next, sizeof(rec->chunk_next));
 	if (atomic_cmpxchg((atomic_t *)&rec->chunk_next, 0, o))
 		goto retry;
 
@@ -645,6 +954,18 @@ retry:
 	return chunk;
 }
 
+TdbVRec *
+tdb_htrie_extend_rec(TdbHdr *dbh, TdbVRec *rec, size_t size)
+{
+	TdbVRec *chunk;
+
+	tdb_wr_begin(dbh);
+	chunk = __tdb_htrie_extend_rec(dbh, rec, size);
+	tdb_wr_end(dbh);
+
+	return chunk;
+}
+
 /**
  * @len returns number of copied data on success.
  *
@@ -653,8 +974,8 @@ retry:
  * and do CAS on it with comparing the location with zero.
  * If competing context helps the current trx owner, then we get true lock-free.
  */
-TdbRec *
-tdb_htrie_insert(TdbHdr *dbh, unsigned long key, void *data, size_t *len)
+static TdbRec *
+__tdb_htrie_insert(TdbHdr *dbh, unsigned long key, void *data, size_t *len)
 {
 	int bits = 0;
 	unsigned long o;
@@ -681,11 +1002,12 @@ retry:
 		rec = tdb_htrie_create_rec(dbh, o, key, data, *len);
 
 		i = TDB_HTRIE_IDX(key, bits);
+		tdb_snap_cow(dbh, &node->shifts[i], sizeof(node->shifts[i]));
 		if (atomic_cmpxchg((atomic_t *)&node->shifts[i], 0,
 				   TDB_O2DI(o) | TDB_HTRIE_DBIT) == 0)
 			return rec;
 		/* Somebody already created the new brach. */
-		// TODO free just allocated data block
+		tdb_put_data_blk(dbh, o - sizeof(TdbBucket));
 		goto retry;
 	}
 
@@ -696,7 +1018,7 @@ retry:
 	bckt = TDB_PTR(dbh, o);
 	BUG_ON(!bckt);
 
-	write_lock_bh(&bckt->lock);
+	tdb_bucket_wlock(dbh, bckt);
 
 	/*
 	 * Recheck last index node in case of just inserted new nodes -
@@ -714,11 +1036,39 @@ retry:
 		if (!o_new || TDB_DI2O(o_new & ~TDB_HTRIE_DBIT) != o) {
 			/* Try to descend again from the last index node. */
 			bits -= TDB_HTRIE_BITS;
-			write_unlock_bh(&bckt->lock);
+			tdb_bucket_wunlock(bckt);
 			goto retry;
 		}
 	}
 
+	/*
+	 * A large record occupies the bucket alone, so if it was removed,
+	 * then the new large record can be placed at the same room.
+	 * Records in collision chain must have the same key.
+	 */
+	if (TDB_HTRIE_VARLENRECS(dbh)) {
+		TdbVRec *vr = TDB_HTRIE_BCKT_1ST_REC(bckt);
+		size_t room = TDB_HTRIE_VRLEN(vr);
+
+		if (!tdb_live_vsrec(vr)
+		    && TDB_HTRIE_LARGE_REC(room) && TDB_HTRIE_LARGE_REC(*len)
+		    && (!bckt->coll_next || vr->key == key)
+		    && !tdb_mem_busy(vr))
+		{
+			TDB_DBG("Reuse removed record %p (len=%lu) for key"
+				" %#lx\n", vr, room, key);
+
+			tdb_snap_cow(dbh, vr, sizeof(*vr) + room);
+			bzero_fast(vr, sizeof(*vr) + room);
+			if (*len > room)
+				*len = room;
+			rec = tdb_htrie_create_rec(dbh, TDB_HTRIE_OFF(dbh, vr),
+						   key, data, *len);
+			tdb_bucket_wunlock(bckt);
+			return rec;
+		}
+	}
+
 	/*
 	 * Try to place the small record in preallocated room for
 	 * small records. There could be full or partial key match.
@@ -736,7 +1086,7 @@ retry:
 		o = tdb_htrie_smallrec_link(dbh, n, bckt);
 		if (o) {
 			rec = tdb_htrie_create_rec(dbh, o, key, data, *len);
-			write_unlock_bh(&bckt->lock);
+			tdb_bucket_wunlock(bckt);
 			return rec;
 		}
 	}
@@ -750,21 +1100,21 @@ retry:
 
 		while (bckt->coll_next && !(bckt->flags & TDB_HTRIE_VRFREED)) {
 			TdbBucket *next = TDB_HTRIE_BUCKET_NEXT(dbh, bckt);
-			write_lock_bh(&next->lock);
-			write_unlock_bh(&bckt->lock);
+			tdb_bucket_wlock(dbh, next);
+			tdb_bucket_wunlock(bckt);
 			bckt = next;
 		}
 
 		o = tdb_alloc_data(dbh, len, 1);
 		if (!o) {
-			write_unlock_bh(&bckt->lock);
+			tdb_bucket_wunlock(bckt);
 			return NULL;
 		}
 
 		rec = tdb_htrie_create_rec(dbh, o, key, data, *len);
 		bckt->coll_next = TDB_O2DI(o);
 
-		write_unlock_bh(&bckt->lock);
+		tdb_bucket_wunlock(bckt);
 
 		return rec;
 	}
@@ -781,17 +1131,29 @@ retry:
 		bits, key, *len, bckt);
 
 	if (tdb_htrie_burst(dbh, &node, bckt, key, bits)) {
-		write_unlock_bh(&bckt->lock);
+		tdb_bucket_wunlock(bckt);
 		TDB_ERR("Cannot burst node=%p and bckt=%p for key %#lx\n",
 			node, bckt, key);
 		return NULL;
 	}
 
-	write_unlock_bh(&bckt->lock);
+	tdb_bucket_wunlock(bckt);
 
 	goto retry;
 }
 
+TdbRec *
+tdb_htrie_insert(TdbHdr *dbh, unsigned long key, void *data, size_t *len)
+{
+	TdbRec *rec;
+
+	tdb_wr_begin(dbh);
+	rec = __tdb_htrie_insert(dbh, key, data, len);
+	tdb_wr_end(dbh);
+
+	return rec;
+}
+
 TdbBucket *
 tdb_htrie_lookup(TdbHdr *dbh, unsigned long key)
 {
@@ -806,6 +1168,58 @@ tdb_htrie_lookup(TdbHdr *dbh, unsigned long key)
 	return TDB_PTR(dbh, o);
 }
 
+/**
+ * Look up buckets for @n keys at once. The index is descended for all the
+ * keys level by level and the index nodes of the next level are prefetched
+ * for all the keys before any of them is read, so the cache misses for
+ * different keys overlap.
+ *
+ * @bckts receives the found buckets or NULL for keys missing in the index.
+ */
+void
+tdb_htrie_lookup_batch(TdbHdr *dbh, const unsigned long *keys, int n,
+		       TdbBucket **bckts)
+{
+	int i, bits = 0, left = n;
+	unsigned long o;
+	TdbHtrieNode *nodes[TDB_BATCH_SZ];
+
+	BUG_ON(n > TDB_BATCH_SZ);
+
+	for (i = 0; i < n; ++i) {
+		nodes[i] = TDB_HTRIE_ROOT(dbh);
+		bckts[i] = NULL;
+	}
+
+	/* All the keys are resolved by the same number of bits per level. */
+	for ( ; left; bits += TDB_HTRIE_BITS) {
+		BUG_ON(TDB_HTRIE_RESOLVED(bits));
+
+		for (i = 0; i < n; ++i)
+			if (nodes[i])
+				prefetch(&nodes[i]->shifts[
+					TDB_HTRIE_IDX(keys[i], bits)]);
+
+		for (i = 0; i < n; ++i) {
+			if (!nodes[i])
+				continue;
+			o = nodes[i]->shifts[TDB_HTRIE_IDX(keys[i], bits)];
+			if (o & TDB_HTRIE_DBIT) {
+				o ^= TDB_HTRIE_DBIT;
+				bckts[i] = TDB_PTR(dbh, TDB_DI2O(o));
+				prefetch(bckts[i]);
+				nodes[i] = NULL;
+				--left;
+			} else if (!o) {
+				nodes[i] = NULL;
+				--left;
+			} else {
+				nodes[i] = TDB_PTR(dbh, TDB_II2O(o));
+			}
+		}
+	}
+}
+
 #define TDB_HTRIE_FOREACH_REC(dbh, b_tmp, b, r, body)			\
 	read_lock_bh(&(*b)->lock);					\
 	do {								\
@@ -898,18 +1312,272 @@ next_bckt:
 	return NULL;
 }
 
+/**
+ * Lock-free lookup of a record with key @key for which @get returns true.
+ *
+ * The collision chain is read without the bucket locks: the bucket reading
+ * is retried from the index if a writer modifies the bucket meanwhile and
+ * released data blocks aren't reused until the reader leaves its RCU read
+ * side critical section. However, a record can be removed or its room can be
+ * reused by a new record just after or even when @get inspects the record,
+ * so @get must acquire a reference to the record atomically with checking
+ * that the record is still in use and then check the record identity.
+ *
+ * @return the record acquired by @get or NULL if there is no such record.
+ */
+TdbRec *
+tdb_htrie_get_lf(TdbHdr *dbh, unsigned long key,
+		 bool (*get)(TdbRec *, void *), void *data)
+{
+	unsigned long seq;
+	TdbBucket *b, *next;
+	TdbRec *r;
+
+	rcu_read_lock_bh();
+retry:
+	if (!(b = tdb_htrie_lookup(dbh, key)))
+		goto not_found;
+	do {
+		seq = tdb_bucket_read_begin(b);
+		r = TDB_HTRIE_BCKT_1ST_REC(b);
+		do {
+			size_t rlen = TDB_HTRIE_RALIGN(sizeof(*r)
+						+ TDB_HTRIE_RBODYLEN(dbh, r));
+			if ((char *)r + rlen - (char *)b > TDB_HTRIE_MINDREC
+			    && r != TDB_HTRIE_BCKT_1ST_REC(b))
+				break;
+			if (tdb_live_rec(dbh, r) && r->key == key
+			    && get(r, data))
+				goto found;
+			r = (TdbRec *)((char *)r + rlen);
+		} while ((char *)r + sizeof(*r) - (char *)b
+			 <= TDB_HTRIE_MINDREC);
+		next = TDB_HTRIE_BUCKET_NEXT(dbh, b);
+		/* Don't follow a link read from a changed bucket. */
+		if (tdb_bucket_read_retry(b, seq))
+			goto retry;
+		b = next;
+	} while (b);
+not_found:
+	r = NULL;
+found:
+	rcu_read_unlock_bh();
+
+	return r;
+}
+
+/**
+ * Free record @r and all its chunks. The first chunk stays in the bucket
+ * as the bucket is referenced by the index, but further chunks release
+ * their data blocks.
+ *
+ * Called under bucket write lock.
+ */
+static void
+tdb_htrie_free_rec(TdbHdr *dbh, TdbRec *r)
+{
+	TdbVRec *vr = (TdbVRec *)r, *chunk;
+	unsigned int next;
+
+	if (!TDB_HTRIE_VARLENRECS(dbh)) {
+		tdb_free_fsrec(dbh, (TdbFRec *)r);
+		return;
+	}
+
+	for (next = vr->chunk_next; next; ) {
+		chunk = TDB_PTR(dbh, TDB_DI2O(next));
+		next = chunk->chunk_next;
+		tdb_put_data_blk(dbh, TDB_HTRIE_OFF(dbh, chunk));
+	}
+	vr->chunk_next = 0;
+	tdb_free_vsrec(vr);
+}
+
+/**
+ * @return true if bucket @b has live records.
+ * Called under bucket write lock.
+ */
+static bool
+tdb_htrie_bucket_live(TdbHdr *dbh, TdbBucket *b)
+{
+	TdbRec *r = TDB_HTRIE_BCKT_1ST_REC(b);
+
+	do {
+		size_t rlen = TDB_HTRIE_RALIGN(sizeof(*r)
+					       + TDB_HTRIE_RBODYLEN(dbh, r));
+		if ((char *)r + rlen - (char *)b > TDB_HTRIE_MINDREC
+		    && r != TDB_HTRIE_BCKT_1ST_REC(b))
+			break;
+		if (tdb_live_rec(dbh, r))
+			return true;
+		r = (TdbRec *)((char *)r + rlen);
+	} while ((char *)r + sizeof(*r) - (char *)b <= TDB_HTRIE_MINDREC);
+
+	return false;
+}
+
+/**
+ * Remove a record with key @key for which @eq returns true or the first
+ * record with the key if @eq is NULL.
+ *
+ * The record must not be used by the caller, the function waits until
+ * the bucket is released by all readers. Lock-free readers aren't waited
+ * for, see tdb_htrie_get_lf().
+ *
+ * If the last live record is removed from a bucket in a collision chain,
+ * then the bucket is unlinked from the chain and its data block is released.
+ * The head bucket is referenced by the index, so it stays and its room is
+ * reused by following insertions. Collision chains are traversed with
+ * hand-over-hand locking and tdb_htrie_smallrec_link() walks the chain under
+ * the head bucket lock, so the head, the previous and the current buckets
+ * are write locked to unlink a bucket: nobody can reach the bucket after
+ * that and nobody can be inside it.
+ *
+ * @return 0 if the record is removed and -ENOENT if there is no such record.
+ */
+static int
+__tdb_htrie_remove(TdbHdr *dbh, unsigned long key,
+		   bool (*eq)(TdbRec *, void *), void *data)
+{
+	int ret = -ENOENT;
+	TdbBucket *head, *b, *next, *prev = NULL, *unlinked = NULL;
+	TdbRec *r;
+
+	if (!(head = b = tdb_htrie_lookup(dbh, key)))
+		return -ENOENT;
+
+	tdb_bucket_wlock(dbh, b);
+	do {
+		r = TDB_HTRIE_BCKT_1ST_REC(b);
+		do {
+			size_t rlen = TDB_HTRIE_RALIGN(sizeof(*r)
+						+ TDB_HTRIE_RBODYLEN(dbh, r));
+			if ((char *)r + rlen - (char *)b > TDB_HTRIE_MINDREC
+			    && r != TDB_HTRIE_BCKT_1ST_REC(b))
+				break;
+			if (tdb_live_rec(dbh, r) && r->key == key
+			    && (!eq || eq(r, data)))
+			{
+				TDB_DBG("Remove record %p for key %#lx\n",
+					r, key);
+				tdb_htrie_free_rec(dbh, r);
+				ret = 0;
+				goto unlink;
+			}
+			r = (TdbRec *)((char *)r + rlen);
+		} while ((char *)r + sizeof(*r) - (char *)b
+			 <= TDB_HTRIE_MINDREC);
+		next = TDB_HTRIE_BUCKET_NEXT(dbh, b);
+		if (next)
+			tdb_bucket_wlock(dbh, next);
+		if (prev && prev != head)
+			tdb_bucket_wunlock(prev);
+		prev = b;
+		b = next;
+	} while (b);
+	goto out;
+unlink:
+	if (prev && !tdb_htrie_bucket_live(dbh, b)) {
+		TDB_DBG("Unlink empty bucket %p for key %#lx\n", b, key);
+		prev->coll_next = b->coll_next;
+		unlinked = b;
+	}
+out:
+	if (b && b != head)
+		tdb_bucket_wunlock(b);
+	if (prev && prev != head)
+		tdb_bucket_wunlock(prev);
+	tdb_bucket_wunlock(head);
+
+	/* The bucket and its first record are allocated as one data chunk. */
+	if (unlinked)
+		tdb_put_data_blk(dbh, TDB_HTRIE_OFF(dbh, unlinked));
+
+	return ret;
+}
+
+int
+tdb_htrie_remove(TdbHdr *dbh, unsigned long key,
+		 bool (*eq)(TdbRec *, void *), void *data)
+{
+	int ret;
+
+	tdb_wr_begin(dbh);
+	ret = __tdb_htrie_remove(dbh, key, eq, data);
+	tdb_wr_end(dbh);
+
+	return ret;
+}
+
+/**
+ * Reinitialize the bucket locks in the @node subtree of the database read
+ * from a file, which could be written with held locks, e.g. a snapshot.
+ */
+static void
+tdb_htrie_reset_locks(TdbHdr *dbh, TdbHtrieNode *node)
+{
+	int i;
+	unsigned long o;
+	TdbBucket *b;
+
+	for (i = 0; i < TDB_HTRIE_FANOUT; ++i) {
+		if (!(o = node->shifts[i]))
+			continue;
+		if (!(o & TDB_HTRIE_DBIT)) {
+			tdb_htrie_reset_locks(dbh, TDB_PTR(dbh, TDB_II2O(o)));
+			continue;
+		}
+		for (b = TDB_PTR(dbh, TDB_DI2O(o ^ TDB_HTRIE_DBIT)); b;
+		     b = TDB_HTRIE_BUCKET_NEXT(dbh, b))
+		{
+			b->seq &= ~1UL;
+			tdb_bucket_lock_init(b);
+		}
+	}
+}
+
+/**
+ * Initialize the database mapped at @p. @file_size bytes of the mapping are
+ * read from the database file and the mapping has room for @max_size bytes.
+ * The database starts with @db_size bytes and can grow up to @max_size.
+ */
 TdbHdr *
-tdb_htrie_init(void *p, size_t db_size, unsigned int rec_len)
+tdb_htrie_init(void *p, size_t file_size, size_t db_size, size_t max_size,
+	       unsigned int rec_len)
 {
 	int cpu;
 	TdbHdr *hdr = (TdbHdr *)p;
 
+	/*
+	 * Reuse the database stored before the restart if it's compatible
+	 * with the requested one, otherwise start with an empty database.
+	 * The database could grow before the restart, so it's compatible
+	 * if it fits the database file.
+	 */
+	if (hdr->magic == TDB_MAGIC
+	    && (hdr->max_dbsz != max_size || hdr->dbsz > file_size
+		|| hdr->rec_len != rec_len))
+	{
+		TDB_WARN("Drop database with different size %lu (max %lu)"
+			 " and record length %u\n", hdr->dbsz, hdr->max_dbsz,
+			 hdr->rec_len);
+		hdr->magic = 0;
+	}
 	if (hdr->magic != TDB_MAGIC) {
-		hdr = tdb_init_mapping(p, db_size, rec_len);
+		hdr = tdb_init_mapping(p, db_size, max_size, rec_len);
 		if (!hdr) {
 			TDB_ERR("cannot init db mapping\n");
 			return NULL;
 		}
+	} else {
+		/* The tail of the file can be left from a larger database. */
+		memset((char *)hdr + hdr->dbsz, 0, max_size - hdr->dbsz);
+		if (hdr->dbsz < db_size)
+			hdr->dbsz = db_size;
+		hdr->snap = NULL;
+		/* Nobody reads the blocks quarantined before the restart. */
+		tdb_release_quarantine(hdr);
+		tdb_htrie_reset_locks(hdr, TDB_HTRIE_ROOT(hdr));
 	}
 
 	/* Set per-CPU pointers. */
@@ -922,10 +1590,13 @@ tdb_htrie_init(void *p, size_t db_size, unsigned int rec_len)
 		TdbPerCpu *p = per_cpu_ptr(hdr->pcpu, cpu);
 		p->i_wcl = tdb_alloc_blk(hdr);
 		p->d_wcl = tdb_alloc_blk(hdr);
+		if (p->d_wcl)
+			atomic_set(tdb_blk_ref(hdr, p->d_wcl), 1);
 	}
 
-	TDB_DBG("init db header: nwb=%lu db_size=%lu rec_len=%u\n",
-		atomic64_read(&hdr->nwb), hdr->dbsz, hdr->rec_len);
+	TDB_DBG("init db header: nwb=%lu db_size=%lu max_size=%lu"
+		" rec_len=%u\n", atomic64_read(&hdr->nwb), hdr->dbsz,
+		hdr->max_dbsz, hdr->rec_len);
 
 	return hdr;
 }
@@ -933,7 +1604,22 @@ tdb_htrie_init(void *p, size_t db_size, unsigned int rec_len)
 void
 tdb_htrie_exit(TdbHdr *dbh)
 {
+	int cpu;
+
+	/*
+	 * Release the partially written data blocks, so they can be freed
+	 * after the restart when all their records are removed. A CPU holds
+	 * its current block only if the block isn't fully written.
+	 */
+	for_each_possible_cpu(cpu) {
+		TdbPerCpu *p = per_cpu_ptr(dbh->pcpu, cpu);
+
+		if (p->d_wcl & ~TDB_BLK_MASK)
+			tdb_put_data_blk(dbh, p->d_wcl);
+	}
 	free_percpu(dbh->pcpu);
+
+	tdb_release_quarantine(dbh);
 }
 
 static int
@@ -1007,3 +1693,244 @@ tdb_htrie_walk(TdbHdr *dbh, int (*fn)(void *))
 
 	return tdb_htrie_node_visit(dbh, node, fn);
 }
+
+/**
+ * Describe the trie memory layout for read-only user-space readers.
+ */
+void
+tdb_htrie_map_info(TdbHdr *dbh, TdbMapInfo *mi)
+{
+	mi->version = TDB_MAP_VERSION;
+	mi->rec_len = dbh->rec_len;
+	mi->node_sz = TDB_HTRIE_NODE_SZ;
+	mi->bckt_sz = TDB_HTRIE_MINDREC;
+	mi->bckt_hdr = sizeof(TdbBucket);
+	mi->bckt_next = offsetof(TdbBucket, coll_next);
+	mi->bckt_seq = offsetof(TdbBucket, seq);
+	mi->root = TDB_HTRIE_OFF(dbh, TDB_HTRIE_ROOT(dbh));
+	mi->size = dbh->max_dbsz;
+}
+
+/**
+ * Iteration state.
+ *
+ * @c		- the iteration cursor;
+ * @fn		- function to call for matching records;
+ * @data	- the last argument for @fn;
+ * @budget	- number of buckets which can be visited yet;
+ * @ret		- the value returned by @fn;
+ * @resume	- true while the iteration descends to the cursor position;
+ */
+typedef struct {
+	TdbCursor	*c;
+	int		(*fn)(TdbRec *, void *);
+	void		*data;
+	unsigned int	budget;
+	int		ret;
+	bool		resume;
+} TdbIterCtx;
+
+static inline bool
+tdb_cursor_match(const TdbCursor *c, unsigned long key)
+{
+	if (c->pfx_bits >= BITS_PER_LONG)
+		return key == c->pfx;
+	return !((key ^ c->pfx) & ((1UL << c->pfx_bits) - 1));
+}
+
+/**
+ * @return true if branch @i of an index node at level @depth can lead
+ * to keys with the cursor prefix.
+ */
+static inline bool
+tdb_cursor_branch(const TdbCursor *c, int i, int depth)
+{
+	unsigned int bits = depth * TDB_HTRIE_BITS;
+	unsigned int n;
+
+	if (bits >= c->pfx_bits)
+		return true;
+	n = min_t(unsigned int, c->pfx_bits - bits, TDB_HTRIE_BITS);
+
+	return !((i ^ TDB_HTRIE_IDX(c->pfx, bits)) & ((1 << n) - 1));
+}
+
+/**
+ * Call the iteration function for the records of collision chain starting
+ * at bucket @b, skipping the records visited on the previous call.
+ * @return true if the iteration function stopped the iteration.
+ */
+static bool
+tdb_htrie_iter_bucket(TdbHdr *dbh, TdbBucket *b, TdbIterCtx *ic)
+{
+	unsigned int n = 0;
+	TdbBucket *b_tmp;
+	TdbRec *r;
+
+	TDB_HTRIE_FOREACH_REC(dbh, b_tmp, &b, r, {
+		if (tdb_live_rec(dbh, r) && tdb_cursor_match(ic->c, r->key)
+		    && n++ >= ic->c->rec)
+		{
+			ic->ret = ic->fn(r, ic->data);
+			if (unlikely(ic->ret)) {
+				read_unlock_bh(&b->lock);
+				/* Continue from the same record. */
+				ic->c->rec = n - 1;
+				return true;
+			}
+		}
+	});
+	ic->c->rec = 0;
+
+	return false;
+}
+
+/**
+ * Visit the buckets of the @node subtree starting from the cursor position.
+ * @return true if the iteration must stop.
+ */
+static bool
+tdb_htrie_iter_node(TdbHdr *dbh, TdbHtrieNode *node, int depth,
+		    TdbIterCtx *ic)
+{
+	int i = 0;
+	unsigned long o;
+	TdbCursor *c = ic->c;
+
+	if (ic->resume) {
+		i = c->idx[depth];
+		if (depth == c->depth)
+			ic->resume = false;
+	}
+	for ( ; i < TDB_HTRIE_FANOUT; ++i, ic->resume = false) {
+		if (!tdb_cursor_branch(c, i, depth)
+		    || !(o = READ_ONCE(node->shifts[i])))
+			continue;
+		c->idx[depth] = i;
+		if (o & TDB_HTRIE_DBIT) {
+			if (!ic->budget) {
+				c->depth = depth;
+				return true;
+			}
+			--ic->budget;
+			o ^= TDB_HTRIE_DBIT;
+			if (tdb_htrie_iter_bucket(dbh,
+						  TDB_PTR(dbh, TDB_DI2O(o)),
+						  ic))
+			{
+				c->depth = depth;
+				return true;
+			}
+		} else {
+			/* The record position is stale after a burst. */
+			if (depth >= c->depth)
+				c->rec = 0;
+			if (tdb_htrie_iter_node(dbh, TDB_PTR(dbh, TDB_II2O(o)),
+						depth + 1, ic))
+				return true;
+		}
+	}
+
+	return false;
+}
+
+/**
+ * Visit up to @n buckets starting from cursor @c and call @fn for each live
+ * record matching the cursor prefix with @data as the second argument.
+ * @fn is called under the bucket read lock. If @fn returns non-zero, then
+ * the iteration stops and the next call continues from the same record.
+ * Otherwise the next call continues from the next bucket and @c->end is set
+ * when the whole table is visited.
+ *
+ * The index branches which can't lead to the cursor prefix are skipped, so
+ * iteration over a prefix of the key visits only a part of the index.
+ * Records removal and bursts of the tree can move records between the calls,
+ * so some records can be skipped or visited twice.
+ *
+ * @return the value returned by @fn or 0.
+ */
+int
+tdb_htrie_iter(TdbHdr *dbh, TdbCursor *c, unsigned int n,
+	       int (*fn)(TdbRec *, void *), void *data)
+{
+	TdbIterCtx ic = {
+		.c		= c,
+		.fn		= fn,
+		.data		= data,
+		.budget		= n,
+		.resume		= true,
+	};
+
+	if (c->end)
+		return 0;
+	if (!tdb_htrie_iter_node(dbh, TDB_HTRIE_ROOT(dbh), 0, &ic))
+		c->end = 1;
+
+	return ic.ret;
+}
+
+/* Maximum number of keys removed by the sweeper at once. */
+#define TDB_HTRIE_SWEEP_KEYS	16
+
+typedef struct {
+	TdbHdr		*dbh;
+	bool		(*expired)(void *);
+	unsigned int	n;
+	unsigned long	keys[TDB_HTRIE_SWEEP_KEYS];
+} TdbSweepCtx;
+
+static int
+tdb_htrie_sweep_key(TdbRec *r, void *data)
+{
+	TdbSweepCtx *sc = data;
+
+	if (sc->n == TDB_HTRIE_SWEEP_KEYS)
+		return -ENOSPC;
+	if (!sc->n || sc->keys[sc->n - 1] != r->key)
+		sc->keys[sc->n++] = r->key;
+
+	return 0;
+}
+
+static bool
+tdb_htrie_sweep_eq(TdbRec *r, void *data)
+{
+	TdbSweepCtx *sc = data;
+
+	return sc->expired(TDB_HTRIE_VARLENRECS(sc->dbh)
+			   ? ((TdbVRec *)r)->data : r->data);
+}
+
+/**
+ * Visit up to @n buckets starting from cursor @c and remove records
+ * for which @expired returns true. @expired is called under the bucket write
+ * lock. The keys are collected under the bucket read locks and the records
+ * are removed one by one, so the sweeper blocks the buckets for short time.
+ * The sweep starts over when the whole tree is visited.
+ *
+ * @return number of removed records.
+ */
+unsigned int
+tdb_htrie_sweep(TdbHdr *dbh, TdbCursor *c, unsigned int n,
+		bool (*expired)(void *))
+{
+	int i;
+	unsigned int removed = 0;
+	TdbSweepCtx sc = {
+		.dbh		= dbh,
+		.expired	= expired,
+	};
+
+	while (n-- && !c->end) {
+		sc.n = 0;
+		tdb_htrie_iter(dbh, c, 1, tdb_htrie_sweep_key, &sc);
+		for (i = 0; i < sc.n; ++i)
+			while (!tdb_htrie_remove(dbh, sc.keys[i],
+						 tdb_htrie_sweep_eq, &sc))
+				++removed;
+	}
+	if (c->end)
+		tdb_cursor_init(c, 0, 0);
+
+	return removed;
+}
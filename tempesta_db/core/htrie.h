@@ -59,8 +59,9 @@
 #define TDB_HTRIE_DBIT		(1U << (sizeof(int) * 8 - 1))
 #define TDB_HTRIE_OMASK		(TDB_HTRIE_DBIT - 1) /* offset mask */
 #define TDB_HTRIE_IDX(k, b)	(((k) >> (b)) & TDB_HTRIE_KMASK)
-#define TDB_EXT_BMP_2L(h)	(((h)->dbsz / TDB_EXT_SZ + BITS_PER_LONG - 1)\
-				 / BITS_PER_LONG)
+/* The extents bitmap covers the maximum size the database can grow to. */
+#define TDB_EXT_BMP_2L(h)	(((h)->max_dbsz / TDB_EXT_SZ		\
+				  + BITS_PER_LONG - 1) / BITS_PER_LONG)
 #define TDB_MAX_DB_SZ		((1UL << 31) * L1_CACHE_BYTES)
 /* Get internal offset from a pointer. */
 #define TDB_HTRIE_OFF(h, p)	((unsigned long)(p) - (unsigned long)(h))
@@ -71,10 +72,13 @@
  * Header for bucket of small records.
  *
  * @coll_next	- next record offset (in data blocks) in collision chain;
+ * @seq		- sequence counter for lock-free readers, odd while a writer
+ *		  holds @lock;
  */
 typedef struct {
 	unsigned int 	coll_next;
 	unsigned int	flags;
+	unsigned long	seq;
 	rwlock_t	lock;
 } __attribute__((packed)) TdbBucket;
 
@@ -93,6 +97,10 @@ typedef struct {
 				TDB_HTRIE_VRLEN((TdbVRec *)r),		\
 				(h)->rec_len))
 #define TDB_HTRIE_BCKT_1ST_REC(b) ((void *)((b) + 1))
+/* True if variable-length record of data length @n occupies a bucket alone. */
+#define TDB_HTRIE_LARGE_REC(n)	(sizeof(TdbBucket)				\
+				 + TDB_HTRIE_RALIGN(sizeof(TdbVRec) + (n))\
+				 > TDB_HTRIE_MINDREC)
 #define TDB_HTRIE_BUCKET_KEY(b)	(*(unsigned long *)TDB_HTRIE_BCKT_1ST_REC(b))
 /* Iterate over buckets in collision chain. */
 #define TDB_HTRIE_BUCKET_NEXT(h, b) ((b)->coll_next			\
@@ -135,11 +143,24 @@ TdbVRec *tdb_htrie_extend_rec(TdbHdr *dbh, TdbVRec *rec, size_t size);
 TdbRec *tdb_htrie_insert(TdbHdr *dbh, unsigned long key, void *data,
 			 size_t *len);
 TdbBucket *tdb_htrie_lookup(TdbHdr *dbh, unsigned long key);
+void tdb_htrie_lookup_batch(TdbHdr *dbh, const unsigned long *keys, int n,
+			    TdbBucket **bckts);
+int tdb_htrie_remove(TdbHdr *dbh, unsigned long key,
+		     bool (*eq)(TdbRec *, void *), void *data);
 TdbRec *tdb_htrie_bscan_for_rec(TdbHdr *dbh, TdbBucket **b, unsigned long key);
 TdbRec *tdb_htrie_next_rec(TdbHdr *dbh, TdbRec *r, TdbBucket **b,
 			   unsigned long key);
-TdbHdr *tdb_htrie_init(void *p, size_t db_size, unsigned int rec_len);
+TdbRec *tdb_htrie_get_lf(TdbHdr *dbh, unsigned long key,
+			 bool (*get)(TdbRec *, void *), void *data);
+TdbHdr *tdb_htrie_init(void *p, size_t file_size, size_t db_size,
+		       size_t max_size, unsigned int rec_len);
 void tdb_htrie_exit(TdbHdr *dbh);
 int tdb_htrie_walk(TdbHdr *dbh, int (*fn)(void *));
+void tdb_htrie_map_info(TdbHdr *dbh, TdbMapInfo *mi);
+unsigned int tdb_htrie_reclaim(TdbHdr *dbh);
+int tdb_htrie_iter(TdbHdr *dbh, TdbCursor *c, unsigned int n,
+		   int (*fn)(TdbRec *, void *), void *data);
+unsigned int tdb_htrie_sweep(TdbHdr *dbh, TdbCursor *c, unsigned int n,
+			     bool (*expired)(void *));
 
 #endif /* __HTRIE_H__ */
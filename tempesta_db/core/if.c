@@ -31,6 +31,9 @@
 static struct sock *nls;
 static DEFINE_MUTEX(tdb_if_mtx);
 
+/* Maximum number of buckets visited for one page of table scan. */
+#define TDB_IF_SCAN_BUCKETS	4096
+
 #define TDB_NLMSG_MAXSZ		(NL_FR_SZ / 2 - NLMSG_HDRLEN - sizeof(TdbMsg) \
 				 - sizeof(TdbMsgRec))
 
@@ -100,15 +103,46 @@ tdb_if_open_close(struct sk_buff *skb, struct netlink_callback *cb)
 	return 0;
 }
 
+/**
+ * Complete insertion of record @r to just created TDB entry @rec
+ * with @len bytes copied to it.
+ */
+static bool
+tdb_if_insert_tail(TDB *db, TdbMsgRec *r, TdbRec *rec, size_t len)
+{
+	TdbVRec *vr = (TdbVRec *)rec;
+
+	if (!TDB_HTRIE_VARLENRECS(db->hdr)) {
+		if (len != r->dlen) {
+			TDB_ERR("Cannot create fixed-size record\n");
+			return false;
+		}
+		return true;
+	}
+
+	for ( ; len < TDB_MSGREC_LEN(r); ) {
+		vr = tdb_entry_add(db, vr, TDB_MSGREC_LEN(r) - len);
+		if (!vr) {
+			TDB_ERR("Cannot extend variable-size record\n");
+			return false;
+		}
+		memcpy(vr + 1, r->data + len, vr->len);
+		len += vr->len;
+	}
+
+	return true;
+}
+
 static int
 tdb_if_insert(struct sk_buff *skb, struct netlink_callback *cb)
 {
-	unsigned int i, off;
-	unsigned long key, len;
+	unsigned int i, j, n, created, off;
+	unsigned long keys[TDB_BATCH_SZ];
+	void *data[TDB_BATCH_SZ];
+	size_t lens[TDB_BATCH_SZ];
+	TdbRec *recs[TDB_BATCH_SZ];
 	TdbMsg *resp_m, *m = cb->data;
 	TdbMsgRec *r;
-	TdbVRec *vr;
-	TdbFRec *fr;
 	struct nlmsghdr *nlh;
 	TDB *db;
 
@@ -129,43 +163,32 @@ tdb_if_insert(struct sk_buff *skb, struct netlink_callback *cb)
 		return 0;
 	}
 
-	if (TDB_HTRIE_VARLENRECS(db->hdr)) {
-		for (i = 0, off = 0; i < m->rec_n; ++i) {
-			r = (TdbMsgRec *)((char *)m->recs + off);
-			key = hash_calc(r->data, r->klen);
-			len = TDB_MSGREC_LEN(r);
-			vr = (TdbVRec *)tdb_entry_create(db, key, r, &len);
-			if (!vr) {
-				TDB_ERR("Cannot create variable-size record\n");
-				break;
-			}
-			for ( ; len < TDB_MSGREC_LEN(r); ) {
-				vr = tdb_entry_add(db, vr,
-						   TDB_MSGREC_LEN(r) - len);
-				if (!vr) {
-					TDB_ERR("Cannot extend variable-size"
-						" record\n");
-					break;
-				}
-				memcpy(vr + 1, r->data + len, vr->len);
-				len += vr->len;
-			}
-			off += TDB_MSGREC_LEN(r);
+	/* Insert the records by batches to prefetch the index for them. */
+	for (i = 0, off = 0; i < m->rec_n; ) {
+		n = min_t(unsigned int, m->rec_n - i, TDB_BATCH_SZ);
+		for (j = 0, r = (TdbMsgRec *)((char *)m->recs + off); j < n;
+		     ++j, r = (TdbMsgRec *)((char *)r + TDB_MSGREC_LEN(r)))
+		{
+			keys[j] = hash_calc(r->data, r->klen);
+			data[j] = r;
+			lens[j] = TDB_MSGREC_LEN(r);
 		}
-	} else {
-		for (i = 0, off = 0; i < m->rec_n; ++i) {
-			r = (TdbMsgRec *)((char *)m->recs + off);
-			key = hash_calc(r->data, r->klen);
-			len = TDB_MSGREC_LEN(r);
-			fr = (TdbFRec *)tdb_entry_create(db, key, r, &len);
-			if (!fr || len != r->dlen) {
-				TDB_ERR("Cannot create fixed-size record\n");
-				break;
-			}
+
+		created = tdb_entry_create_batch(db, keys, data, lens, recs, n);
+		for (j = 0; j < created; ++j, ++i) {
+			r = data[j];
+			if (!tdb_if_insert_tail(db, r, recs[j], lens[j]))
+				goto done;
 			off += TDB_MSGREC_LEN(r);
 		}
+		if (created < n) {
+			TDB_ERR("Cannot create %s record\n",
+				TDB_HTRIE_VARLENRECS(db->hdr)
+				? "variable-size" : "fixed-size");
+			break;
+		}
 	}
-
+done:
 	tdb_put(db);
 	if (i == m->rec_n)
 		resp_m->type |= TDB_NLF_RESP_OK;
@@ -174,68 +197,270 @@ tdb_if_insert(struct sk_buff *skb, struct netlink_callback *cb)
 	return 0;
 }
 
+/**
+ * Select response under construction.
+ *
+ * @db		- the table to select from;
+ * @resp	- the response message;
+ * @off		- length of the records written to @resp;
+ * @n		- number of the records written to @resp;
+ */
+typedef struct {
+	TDB		*db;
+	TdbMsg		*resp;
+	size_t		off;
+	unsigned int	n;
+} TdbIfSelCtx;
+
+/**
+ * Copy found record @rec to the response. A record which doesn't fit
+ * an empty response is truncated, otherwise it's sent in the next response.
+ */
+static int
+tdb_if_copy_rec(TdbRec *rec, void *data)
+{
+	TdbIfSelCtx *sc = data;
+	TdbHdr *dbh = sc->db->hdr;
+	char *dst = (char *)sc->resp->recs + sc->off;
+	size_t n, len = 0, room = TDB_NLMSG_MAXSZ - sc->off;
+	TdbVRec *vr;
+
+	if (!TDB_HTRIE_VARLENRECS(dbh)) {
+		if (dbh->rec_len > room)
+			return -EMSGSIZE;
+		memcpy(dst, rec->data, dbh->rec_len);
+		sc->off += dbh->rec_len;
+		++sc->n;
+		return 0;
+	}
+
+	for (vr = (TdbVRec *)rec; ; vr = TDB_PTR(dbh, TDB_DI2O(vr->chunk_next)))
+	{
+		len += vr->len;
+		if (!vr->chunk_next)
+			break;
+	}
+	if (len > room && sc->n)
+		return -EMSGSIZE;
+
+	for (vr = (TdbVRec *)rec; ; vr = TDB_PTR(dbh, TDB_DI2O(vr->chunk_next)))
+	{
+		n = min_t(size_t, vr->len, room);
+		memcpy(dst, vr->data, n);
+		dst += n;
+		room -= n;
+		sc->off += n;
+		if (n < vr->len) {
+			sc->resp->type |= TDB_NLF_RESP_TRUNC;
+			break;
+		}
+		if (!vr->chunk_next)
+			break;
+	}
+	++sc->n;
+
+	return 0;
+}
+
+static int
+tdb_if_select_rec(TdbRec *rec, int i, void *data)
+{
+	return tdb_if_copy_rec(rec, data);
+}
+
+/**
+ * Select records for all the keys from the request. The records are looked
+ * up by batches and sent in as many responses as they require: @cb->args[0]
+ * and @cb->args[1] keep the index and the offset of the next key to look up
+ * in the next response. All the records of a table are selected by
+ * TDB_MSG_SCAN, see tdb_if_scan().
+ */
 static int
 tdb_if_select(struct sk_buff *skb, struct netlink_callback *cb)
 {
-	TdbIter iter;
-	unsigned long key;
+	int i, n, done;
+	unsigned long keys[TDB_BATCH_SZ];
+	size_t offs[TDB_BATCH_SZ + 1];
+	TdbMsg *m = cb->data;
+	TdbMsgRec *r;
+	TdbIfSelCtx sc = { 0 };
+	struct nlmsghdr *nlh;
+
+	nlh = nlmsg_put(skb, NETLINK_CB(cb->skb).portid, cb->nlh->nlmsg_seq,
+			cb->nlh->nlmsg_type, TDB_NLMSG_MAXSZ, 0);
+	if (!nlh)
+		return -EMSGSIZE;
+
+	sc.resp = nlmsg_data(nlh);
+	sc.resp->rec_n = 0;
+	sc.resp->type = TDB_MSG_SELECT;
+
+	sc.db = tdb_tbl_lookup(m->t_name, TDB_TBLNAME_LEN);
+	if (!sc.db) {
+		TDB_WARN("Tried to select from non existent table '%s'\n",
+			 m->t_name);
+		return 0;
+	}
+
+	while (cb->args[0] < m->rec_n) {
+		n = min_t(unsigned long, m->rec_n - cb->args[0], TDB_BATCH_SZ);
+		for (i = 0, offs[0] = cb->args[1]; i < n; ++i) {
+			r = (TdbMsgRec *)((char *)m->recs + offs[i]);
+			keys[i] = hash_calc(r->data, r->klen);
+			offs[i + 1] = offs[i] + TDB_MSGREC_LEN(r);
+		}
+
+		done = tdb_rec_get_batch(sc.db, keys, n, tdb_if_select_rec,
+					 &sc);
+		cb->args[0] += done;
+		cb->args[1] = offs[done];
+		if (done < n)
+			break;
+	}
+
+	tdb_put(sc.db);
+	sc.resp->rec_n = sc.n;
+	sc.resp->type |= TDB_NLF_RESP_OK;
+
+	if (cb->args[0] < m->rec_n)
+		return skb->len; /* continue in the next response */
+	sc.resp->type |= TDB_NLF_RESP_END;
+
+	return 0;
+}
+
+/**
+ * Send the next page of the table records starting from the cursor passed
+ * in the request. The first response record is the cursor to request the
+ * next page with, the records found on the page follow it.
+ */
+static int
+tdb_if_scan(struct sk_buff *skb, struct netlink_callback *cb)
+{
+	TdbMsg *m = cb->data;
+	TdbMsgRec *cr;
+	TdbCursor c;
+	TdbIfSelCtx sc = { 0 };
+	struct nlmsghdr *nlh;
+
+	nlh = nlmsg_put(skb, NETLINK_CB(cb->skb).portid, cb->nlh->nlmsg_seq,
+			cb->nlh->nlmsg_type, TDB_NLMSG_MAXSZ, 0);
+	if (!nlh)
+		return -EMSGSIZE;
+
+	sc.resp = nlmsg_data(nlh);
+	sc.resp->rec_n = 0;
+	sc.resp->type = TDB_MSG_SCAN;
+
+	sc.db = tdb_tbl_lookup(m->t_name, TDB_TBLNAME_LEN);
+	if (!sc.db) {
+		TDB_WARN("Tried to scan non existent table '%s'\n",
+			 m->t_name);
+		return 0;
+	}
+
+	memcpy(&c, m->recs[0].data, sizeof(c));
+	cr = sc.resp->recs;
+	cr->klen = 0;
+	cr->dlen = sizeof(c);
+	sc.off = TDB_MSGREC_LEN(cr);
+
+	tdb_entry_iter(sc.db, &c, TDB_IF_SCAN_BUCKETS, tdb_if_copy_rec, &sc);
+
+	tdb_put(sc.db);
+
+	memcpy(cr->data, &c, sizeof(c));
+	sc.resp->rec_n = sc.n + 1;
+	sc.resp->type |= TDB_NLF_RESP_OK | TDB_NLF_RESP_END;
+
+	return 0;
+}
+
+/**
+ * Send the next page of the table records with the secondary key passed in
+ * the request, the records are looked up by the table secondary index. The
+ * cursor is passed and returned as for the table scan.
+ */
+static int
+tdb_if_index(struct sk_buff *skb, struct netlink_callback *cb)
+{
+	TdbMsg *m = cb->data;
+	TdbMsgRec *cr, *kr;
+	TdbCursor c;
+	TdbIfSelCtx sc = { 0 };
+	struct nlmsghdr *nlh;
+
+	nlh = nlmsg_put(skb, NETLINK_CB(cb->skb).portid, cb->nlh->nlmsg_seq,
+			cb->nlh->nlmsg_type, TDB_NLMSG_MAXSZ, 0);
+	if (!nlh)
+		return -EMSGSIZE;
+
+	sc.resp = nlmsg_data(nlh);
+	sc.resp->rec_n = 0;
+	sc.resp->type = TDB_MSG_INDEX;
+
+	sc.db = tdb_tbl_lookup(m->t_name, TDB_TBLNAME_LEN);
+	if (!sc.db) {
+		TDB_WARN("Tried to look up non existent table '%s'\n",
+			 m->t_name);
+		return 0;
+	}
+
+	memcpy(&c, m->recs[0].data, sizeof(c));
+	kr = (TdbMsgRec *)((char *)m->recs + TDB_MSGREC_LEN(&m->recs[0]));
+	cr = sc.resp->recs;
+	cr->klen = 0;
+	cr->dlen = sizeof(c);
+	sc.off = TDB_MSGREC_LEN(cr);
+
+	if (tdb_index_iter(sc.db, &c, TDB_IF_SCAN_BUCKETS,
+			   hash_calc(kr->data, kr->klen), tdb_if_copy_rec,
+			   &sc) == -EINVAL)
+	{
+		TDB_WARN("Table '%s' has no index\n", m->t_name);
+		tdb_put(sc.db);
+		return 0;
+	}
+
+	tdb_put(sc.db);
+
+	memcpy(cr->data, &c, sizeof(c));
+	sc.resp->rec_n = sc.n + 1;
+	sc.resp->type |= TDB_NLF_RESP_OK | TDB_NLF_RESP_END;
+
+	return 0;
+}
+
+/**
+ * Start snapshot of the table to the file passed in the request.
+ */
+static int
+tdb_if_snapshot(struct sk_buff *skb, struct netlink_callback *cb)
+{
 	TdbMsg *resp_m, *m = cb->data;
-	TdbRec *res;
 	struct nlmsghdr *nlh;
 	TDB *db;
 
 	nlh = nlmsg_put(skb, NETLINK_CB(cb->skb).portid, cb->nlh->nlmsg_seq,
-			cb->nlh->nlmsg_type, TDB_NLMSG_MAXSZ, 0);
+			cb->nlh->nlmsg_type, sizeof(TdbMsg), 0);
 	if (!nlh)
 		return -EMSGSIZE;
 
 	resp_m = nlmsg_data(nlh);
 	resp_m->rec_n = 0;
-	resp_m->type = TDB_MSG_SELECT;
+	resp_m->type = TDB_MSG_SNAPSHOT;
 
 	db = tdb_tbl_lookup(m->t_name, TDB_TBLNAME_LEN);
 	if (!db) {
-		TDB_WARN("Tried to select from non existent table '%s'\n",
+		TDB_WARN("Tried to snapshot non existent table '%s'\n",
 			 m->t_name);
 		return 0;
 	}
 
-	/*
-	 * FIXME implement select of all records:
-	 * 1. full HTrie iterator is required;
-	 * 2. use many netlink frames to send probably large data set.
-	 */
-	key = hash_calc(m->recs[0].data, m->recs[0].klen);
-	iter = tdb_rec_get(db, key);
-	res = iter.rec;
-	if (res) {
-		resp_m->rec_n = 1;
-		if (TDB_HTRIE_VARLENRECS(db->hdr)) {
-			TdbVRec *vr = (TdbVRec *)res;
-			size_t off = vr->len;
-			memcpy(resp_m->recs, vr->data, vr->len);
-			while (1) {
-				size_t n = vr->len;
-				if (n + off > TDB_NLMSG_MAXSZ) {
-					n = TDB_NLMSG_MAXSZ - off;
-					resp_m->type |= TDB_NLF_RESP_TRUNC;
-				}
-				memcpy((char *)resp_m->recs + off, vr->data, n);
-				if (n < vr->len || !vr->chunk_next)
-					break;
-				vr = TDB_PTR(db->hdr, TDB_DI2O(vr->chunk_next));
-				off += n;
-			}
-		}
-		else {
-			memcpy(resp_m->recs, res->data, db->hdr->rec_len);
-		}
-		tdb_rec_put(res);
-	}
+	if (!tdb_snapshot(db, m->recs[0].data))
+		resp_m->type |= TDB_NLF_RESP_OK;
 
 	tdb_put(db);
-	/* Only one record is fetched for now. */
-	resp_m->type |= TDB_NLF_RESP_OK | TDB_NLF_RESP_END;
 
 	return 0;
 }
@@ -248,6 +473,9 @@ static const struct {
 	[TDB_MSG_CLOSE - __TDB_MSG_BASE]	= { .dump = tdb_if_open_close },
 	[TDB_MSG_INSERT - __TDB_MSG_BASE]	= { .dump = tdb_if_insert },
 	[TDB_MSG_SELECT - __TDB_MSG_BASE]	= { .dump = tdb_if_select },
+	[TDB_MSG_SCAN - __TDB_MSG_BASE]		= { .dump = tdb_if_scan },
+	[TDB_MSG_SNAPSHOT - __TDB_MSG_BASE]	= { .dump = tdb_if_snapshot },
+	[TDB_MSG_INDEX - __TDB_MSG_BASE]	= { .dump = tdb_if_index },
 };
 
 static int
@@ -266,6 +494,50 @@ tdb_if_check_tblname(const TdbMsg *m)
 	return ret;
 }
 
+/**
+ * Check that @m->rec_n records fit netlink message @nlh.
+ */
+static bool
+tdb_if_check_recs(const struct nlmsghdr *nlh, const TdbMsg *m)
+{
+	unsigned int i;
+	size_t off = 0, len = nlh->nlmsg_len - sizeof(*nlh) - sizeof(*m);
+	const TdbMsgRec *r;
+
+	for (i = 0; i < m->rec_n; ++i) {
+		r = (const TdbMsgRec *)((const char *)m->recs + off);
+		if (off + sizeof(*r) > len || off + TDB_MSGREC_LEN(r) > len) {
+			TDB_ERR("malformed records in netlink msg: rec_n=%u"
+				" len=%u\n", m->rec_n, nlh->nlmsg_len);
+			return false;
+		}
+		off += TDB_MSGREC_LEN(r);
+	}
+
+	return true;
+}
+
+static bool
+tdb_if_check_cursor(const TdbMsg *m)
+{
+	int i;
+	const TdbCursor *c = (const TdbCursor *)m->recs[0].data;
+
+	if (m->recs[0].klen || m->recs[0].dlen != sizeof(*c))
+		goto err;
+	if (c->depth < 0 || c->depth >= TDB_CURSOR_DEPTH
+	    || c->pfx_bits > BITS_PER_LONG)
+		goto err;
+	for (i = 0; i < TDB_CURSOR_DEPTH; ++i)
+		if (c->idx[i] >= TDB_HTRIE_FANOUT)
+			goto err;
+
+	return true;
+err:
+	TDB_ERR("malformed cursor in scan msg\n");
+	return false;
+}
+
 static int
 tdb_if_proc_msg(struct sk_buff *skb, struct nlmsghdr *nlh,
 		struct netlink_ext_ack *extack)
@@ -323,16 +595,58 @@ tdb_if_proc_msg(struct sk_buff *skb, struct nlmsghdr *nlh,
 			TDB_ERR("empty insert msg\n");
 			return -EINVAL;
 		}
-		if (!tdb_if_check_tblname(m))
+		if (!tdb_if_check_tblname(m) || !tdb_if_check_recs(nlh, m))
 			return -EINVAL;
 		break;
 	case TDB_MSG_SELECT:
-		if (m->rec_n != 1) {
+		if (m->rec_n < 1) {
 			TDB_ERR("empty select msg\n");
 			return -EINVAL;
 		}
-		if (!tdb_if_check_tblname(m))
+		if (!tdb_if_check_tblname(m) || !tdb_if_check_recs(nlh, m))
+			return -EINVAL;
+		break;
+	case TDB_MSG_SCAN:
+		if (m->rec_n != 1) {
+			TDB_ERR("no cursor in scan msg\n");
+			return -EINVAL;
+		}
+		if (!tdb_if_check_tblname(m) || !tdb_if_check_recs(nlh, m)
+		    || !tdb_if_check_cursor(m))
+			return -EINVAL;
+		break;
+	case TDB_MSG_SNAPSHOT:
+		if (m->rec_n != 1) {
+			TDB_ERR("no path in snapshot msg\n");
+			return -EINVAL;
+		}
+		if (!tdb_if_check_tblname(m) || !tdb_if_check_recs(nlh, m))
 			return -EINVAL;
+		if (m->recs[0].klen || !m->recs[0].dlen
+		    || m->recs[0].dlen > TDB_PATH_LEN
+		    || m->recs[0].data[m->recs[0].dlen - 1])
+		{
+			TDB_ERR("malformed path in snapshot msg\n");
+			return -EINVAL;
+		}
+		break;
+	case TDB_MSG_INDEX:
+		if (m->rec_n != 2) {
+			TDB_ERR("no cursor or key in index msg\n");
+			return -EINVAL;
+		}
+		if (!tdb_if_check_tblname(m) || !tdb_if_check_recs(nlh, m)
+		    || !tdb_if_check_cursor(m))
+			return -EINVAL;
+		{
+			const TdbMsgRec *kr = (const TdbMsgRec *)
+				((const char *)m->recs
+				 + TDB_MSGREC_LEN(&m->recs[0]));
+			if (!kr->klen || kr->dlen) {
+				TDB_ERR("malformed key in index msg\n");
+				return -EINVAL;
+			}
+		}
 		break;
 	default:
 		TDB_ERR("bad netlink msg type %u\n", m->type);
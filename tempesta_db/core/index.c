@@ -0,0 +1,314 @@
+/**
+ *		Tempesta DB
+ *
+ * Secondary indexes of tables.
+ *
+ * A secondary index is a table of fixed-size records, one for each pair of
+ * a secondary key returned by the user-supplied extractor for a record of
+ * the indexed table and the record primary key. The index record key is
+ * the primary key in the high bits and the secondary key in the low
+ * TDB_IDX_PFX_BITS bits. The trie resolves keys starting from the least
+ * significant bits, so all the records of a secondary key are in one subtree
+ * which is visited by a prefix iteration, see tdb_htrie_iter(), while the
+ * index records of different primary records don't collide.
+ *
+ * The index is updated by tdb_entry_create(), tdb_rec_get_alloc() and
+ * tdb_entry_remove(), but records can be removed by the sweeper or be lost
+ * on a restart, so the lookups check the indexed records and drop stale
+ * index records. The index records are added and dropped under the index
+ * table ga_lock with the indexed record existence checked, so a stale index
+ * record can't be dropped after it's reused by a new record.
+ *
+ * Copyright (C) 2020 Tempesta Technologies, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#include <linux/module.h>
+
+#include "htrie.h"
+#include "index.h"
+
+#define TDB_IDX_PFX_BITS	32
+/* Number of index buckets visited at once by tdb_index_get(). */
+#define TDB_IDX_ITER_BUCKETS	256
+
+/**
+ * Index record data.
+ *
+ * @skey	- the secondary key;
+ * @pkey	- the primary key of the indexed record;
+ */
+typedef struct {
+	unsigned long	skey;
+	unsigned long	pkey;
+} TdbIdxRec;
+
+/**
+ * Index lookup state.
+ *
+ * @db		- the indexed table;
+ * @skey	- the secondary key to look up;
+ * @fn		- function to call for the indexed records;
+ * @data	- the last argument for @fn;
+ * @stale_n	- number of the stale index records found;
+ * @stale	- the stale index records to drop after the iteration;
+ */
+typedef struct {
+	TDB		*db;
+	unsigned long	skey;
+	int		(*fn)(TdbRec *, void *);
+	void		*data;
+	unsigned int	stale_n;
+	TdbIdxRec	stale[TDB_BATCH_SZ];
+} TdbIdxCtx;
+
+static inline unsigned long
+tdb_index_key(unsigned long skey, unsigned long pkey)
+{
+	return (pkey << TDB_IDX_PFX_BITS)
+	       | (skey & ((1UL << TDB_IDX_PFX_BITS) - 1));
+}
+
+static bool
+tdb_index_eq(TdbRec *rec, void *data)
+{
+	return !memcmp(rec->data, data, sizeof(TdbIdxRec));
+}
+
+/**
+ * @return true if @db has a record with @ir->pkey primary key which is
+ * indexed by @ir->skey.
+ */
+static bool
+tdb_index_live(TDB *db, const TdbIdxRec *ir)
+{
+	TdbIter iter;
+
+	iter = tdb_rec_get(db, ir->pkey);
+	while (!TDB_ITER_BAD(iter)) {
+		if (db->idx_key(iter.rec->data) == ir->skey) {
+			tdb_rec_put(iter.rec);
+			return true;
+		}
+		tdb_rec_next(db, &iter);
+	}
+
+	return false;
+}
+
+/**
+ * @return true if the index has record @ir.
+ */
+static bool
+tdb_index_has(TDB *idx, const TdbIdxRec *ir)
+{
+	TdbIter iter;
+
+	iter = tdb_rec_get(idx, tdb_index_key(ir->skey, ir->pkey));
+	while (!TDB_ITER_BAD(iter)) {
+		if (tdb_index_eq(iter.rec, (void *)ir)) {
+			tdb_rec_put(iter.rec);
+			return true;
+		}
+		tdb_rec_next(idx, &iter);
+	}
+
+	return false;
+}
+
+/**
+ * Add just created record @rec of table @db to the table index. Users
+ * creating records by tdb_entry_alloc() must call the function when
+ * the record data used by the index key extractor is written.
+ */
+void
+tdb_index_add(TDB *db, TdbRec *rec)
+{
+	TDB *idx = db->idx;
+	size_t len = sizeof(TdbIdxRec);
+	TdbIdxRec ir;
+
+	if (!idx)
+		return;
+
+	ir.skey = db->idx_key(rec->data);
+	ir.pkey = rec->key;
+
+	spin_lock_bh(&idx->ga_lock);
+	/* Records with the same keys share the index record. */
+	if (!tdb_index_has(idx, &ir)
+	    && !tdb_entry_create(idx, tdb_index_key(ir.skey, ir.pkey), &ir,
+				 &len))
+		TDB_WARN("Cannot index record %#lx in table %s\n", ir.pkey,
+			 db->tbl_name);
+	spin_unlock_bh(&idx->ga_lock);
+}
+EXPORT_SYMBOL(tdb_index_add);
+
+/**
+ * Drop the index record of the record with @pkey primary key and @skey
+ * secondary key unless there is another such record in @db.
+ */
+void
+tdb_index_drop(TDB *db, unsigned long skey, unsigned long pkey)
+{
+	TDB *idx = db->idx;
+	TdbIdxRec ir = { .skey = skey, .pkey = pkey };
+
+	spin_lock_bh(&idx->ga_lock);
+	if (!tdb_index_live(db, &ir))
+		tdb_entry_remove(idx, tdb_index_key(skey, pkey), tdb_index_eq,
+				 &ir);
+	spin_unlock_bh(&idx->ga_lock);
+}
+
+/**
+ * Call the lookup function for the records of the indexed table referenced
+ * by index record @rec. Called under the index bucket lock.
+ */
+static int
+tdb_index_iter_rec(TdbRec *rec, void *data)
+{
+	int r;
+	bool live = false;
+	TdbIdxCtx *ic = data;
+	TdbIdxRec *ir = (TdbIdxRec *)rec->data;
+	TdbIter iter;
+
+	if (ir->skey != ic->skey)
+		return 0;
+
+	iter = tdb_rec_get(ic->db, ir->pkey);
+	while (!TDB_ITER_BAD(iter)) {
+		if (ic->db->idx_key(iter.rec->data) == ic->skey) {
+			live = true;
+			if ((r = ic->fn(iter.rec, ic->data))) {
+				tdb_rec_put(iter.rec);
+				return r;
+			}
+		}
+		tdb_rec_next(ic->db, &iter);
+	}
+	if (!live && ic->stale_n < TDB_BATCH_SZ)
+		ic->stale[ic->stale_n++] = *ir;
+
+	return 0;
+}
+
+/**
+ * Bounded lookup of the records of table @db with secondary key @skey:
+ * up to @n index buckets are visited starting from cursor @c on each call.
+ * @fn is called for each found record with @data as the second argument,
+ * the record is locked during the call as for tdb_rec_get_batch(). The
+ * lookup stops if @fn returns non-zero and the cursor is left at the index
+ * record of the record, so the same records can be visited again on the next
+ * call. A zeroed cursor starts the lookup.
+ *
+ * @return the value returned by @fn or 0.
+ */
+int
+tdb_index_iter(TDB *db, TdbCursor *c, unsigned int n, unsigned long skey,
+	       int (*fn)(TdbRec *, void *), void *data)
+{
+	int i, r;
+	TdbIdxCtx ic = {
+		.db	= db,
+		.skey	= skey,
+		.fn	= fn,
+		.data	= data,
+	};
+
+	if (!db->idx)
+		return -EINVAL;
+
+	c->pfx = skey;
+	c->pfx_bits = TDB_IDX_PFX_BITS;
+	r = tdb_entry_iter(db->idx, c, n, tdb_index_iter_rec, &ic);
+
+	for (i = 0; i < ic.stale_n; ++i)
+		tdb_index_drop(db, ic.stale[i].skey, ic.stale[i].pkey);
+
+	return r;
+}
+EXPORT_SYMBOL(tdb_index_iter);
+
+/**
+ * Look up all the records of table @db with secondary key @skey,
+ * see tdb_index_iter().
+ */
+int
+tdb_index_get(TDB *db, unsigned long skey, int (*fn)(TdbRec *, void *),
+	      void *data)
+{
+	int r = 0;
+	TdbCursor c;
+
+	memset(&c, 0, sizeof(c));
+	while (!c.end && !r)
+		r = tdb_index_iter(db, &c, TDB_IDX_ITER_BUCKETS, skey, fn,
+				   data);
+
+	return r;
+}
+EXPORT_SYMBOL(tdb_index_get);
+
+/**
+ * Open secondary index of table @db in table @path of @size bytes. @key
+ * returns the secondary key of a record with data @data, it's called with
+ * the record locked. User space looks up the records by keys hashed by
+ * hash_calc(), so @key should hash the record fields the same way.
+ *
+ * Only records created after the call are indexed, so the index should be
+ * opened with the table. The index table is reloaded with the table after
+ * a restart.
+ *
+ * The function must not be called from softirq!
+ */
+int
+tdb_index_open(TDB *db, const char *path, size_t size,
+	       unsigned long (*key)(void *data))
+{
+	TDB *idx;
+
+	if (db->idx) {
+		TDB_ERR("Table %s is already indexed\n", db->tbl_name);
+		return -EBUSY;
+	}
+
+	idx = tdb_open(path, size, sizeof(TdbIdxRec), db->node);
+	if (!idx)
+		return -EINVAL;
+	db->idx_key = key;
+	WRITE_ONCE(db->idx, idx);
+
+	TDB_LOG("Table %s is indexed by table %s\n", db->tbl_name,
+		idx->tbl_name);
+
+	return 0;
+}
+EXPORT_SYMBOL(tdb_index_open);
+
+/**
+ * The table must not be modified or looked up by the index concurrently.
+ */
+void
+tdb_index_close(TDB *db)
+{
+	TDB *idx = db->idx;
+
+	db->idx = NULL;
+	tdb_close(idx);
+}
+EXPORT_SYMBOL(tdb_index_close);
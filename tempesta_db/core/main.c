@@ -22,13 +22,18 @@
  */
 #include <linux/module.h>
 #include <linux/slab.h>
+#include <linux/topology.h>
 
 #include "file.h"
 #include "htrie.h"
+#include "index.h"
+#include "mmap.h"
+#include "snapshot.h"
+#include "sweep.h"
 #include "table.h"
 #include "tdb_if.h"
 
-#define TDB_VERSION	"0.1.17"
+#define TDB_VERSION	"0.1.18"
 
 MODULE_AUTHOR("Tempesta Technologies");
 MODULE_DESCRIPTION("Tempesta DB");
@@ -36,10 +41,36 @@ MODULE_VERSION(TDB_VERSION);
 MODULE_LICENSE("GPL");
 
 /**
- * Create TDB entry and copy @len contiguous bytes from @data to the entry.
+ * Replicated tables are read at the current node.
  */
-TdbRec *
-tdb_entry_create(TDB *db, unsigned long key, void *data, size_t *len)
+static inline TDB *
+tdb_local(TDB *db)
+{
+	return likely(!db->repl) ? db : db->repl->db[numa_node_id()];
+}
+
+/**
+ * @return the replica of table @db which stores @p. The current node can
+ * differ from the node which the record is read at if the reader migrated.
+ */
+static TDB *
+tdb_repl_of(TDB *db, void *p)
+{
+	int node;
+	TDB *r;
+
+	if (likely(!db->repl))
+		return db;
+	for_each_node_with_cpus(node) {
+		r = db->repl->db[node];
+		if ((unsigned long)p - (unsigned long)r->hdr < r->hdr->max_dbsz)
+			return r;
+	}
+	BUG();
+}
+
+static TdbRec *
+__tdb_entry_create(TDB *db, unsigned long key, void *data, size_t *len)
 {
 	TdbRec *r = tdb_htrie_insert(db->hdr, key, data, len);
 	if (!r)
@@ -48,16 +79,95 @@ tdb_entry_create(TDB *db, unsigned long key, void *data, size_t *len)
 
 	return r;
 }
+
+/**
+ * Create TDB entry and copy @len contiguous bytes from @data to the entry.
+ *
+ * The entry is created in all the replicas of a replicated table and
+ * the local replica entry is returned. The replicas diverge if some of them
+ * can't store the entry, so NULL is returned in this case.
+ *
+ * The entry is added to the table secondary index if the table has one.
+ */
+TdbRec *
+tdb_entry_create(TDB *db, unsigned long key, void *data, size_t *len)
+{
+	int node;
+	size_t n;
+	TdbRec *r, *local = NULL;
+	TDB *ldb;
+
+	if (likely(!db->repl)) {
+		r = __tdb_entry_create(db, key, data, len);
+		if (r && db->idx)
+			tdb_index_add(db, r);
+		return r;
+	}
+
+	ldb = tdb_local(db);
+	for_each_node_with_cpus(node) {
+		TDB *rdb = db->repl->db[node];
+
+		n = *len;
+		if (!(r = __tdb_entry_create(rdb, key, data, &n)))
+			return NULL;
+		if (rdb == ldb) {
+			local = r;
+			*len = n;
+		}
+	}
+	if (db->idx)
+		tdb_index_add(db, local);
+
+	return local;
+}
 EXPORT_SYMBOL(tdb_entry_create);
 
+/**
+ * Create TDB entries for @n keys @keys. The index nodes for the keys are
+ * prefetched at once, see tdb_htrie_lookup_batch(), and the entries are
+ * created by tdb_entry_create() with @data[i] and @len[i] as arguments for
+ * @keys[i]. @recs[i] receives the created entry.
+ *
+ * @return number of created entries, creation stops on the first failure.
+ */
+int
+tdb_entry_create_batch(TDB *db, const unsigned long *keys, void **data,
+		       size_t *len, TdbRec **recs, int n)
+{
+	int i, j, k;
+	TdbBucket *bckts[TDB_BATCH_SZ];
+
+	for (i = 0; i < n; i += k) {
+		k = min(n - i, TDB_BATCH_SZ);
+		tdb_htrie_lookup_batch(tdb_local(db)->hdr, keys + i, k, bckts);
+		for (j = i; j < i + k; ++j) {
+			recs[j] = tdb_entry_create(db, keys[j], data[j],
+						   &len[j]);
+			if (!recs[j])
+				return j;
+		}
+	}
+
+	return n;
+}
+EXPORT_SYMBOL(tdb_entry_create_batch);
+
 /**
  * Create TDB entry to store @len bytes.
  * TODO #515 function must holds a lock upon return.
+ *
+ * The caller writes the entry directly, so the entry can't be replicated.
  */
 TdbRec *
 tdb_entry_alloc(TDB *db, unsigned long key, size_t *len)
 {
-	TdbRec *r = tdb_htrie_insert(db->hdr, key, NULL, len);
+	TdbRec *r;
+
+	if (WARN_ON_ONCE(db->repl))
+		return NULL;
+
+	r = tdb_htrie_insert(db->hdr, key, NULL, len);
 	if (!r)
 		TDB_ERR("Cannot allocate cache entry for key=%#lx\n", key);
 
@@ -90,13 +200,93 @@ tdb_entry_get_room(TDB *db, TdbVRec **r, char *curr_ptr, size_t tail_len,
 	if (likely((*r)->data + (*r)->len - curr_ptr >= tail_len))
 		return curr_ptr;
 
+	tdb_wr_begin(db->hdr);
+	tdb_snap_cow(db->hdr, &(*r)->len, sizeof((*r)->len));
 	(*r)->len -= curr_ptr - (*r)->data;
+	tdb_wr_end(db->hdr);
 
 	*r = tdb_htrie_extend_rec(db->hdr, *r, tot_size);
 	return *r ? (*r)->data : NULL;
 }
 EXPORT_SYMBOL(tdb_entry_get_room);
 
+static int
+__tdb_entry_remove(TDB *db, unsigned long key, bool (*eq)(TdbRec *, void *),
+		   void *data)
+{
+	int node, r, ret = -ENOENT;
+	TDB *ldb;
+
+	if (likely(!db->repl))
+		return tdb_htrie_remove(db->hdr, key, eq, data);
+
+	ldb = tdb_local(db);
+	for_each_node_with_cpus(node) {
+		r = tdb_htrie_remove(db->repl->db[node]->hdr, key, eq, data);
+		if (db->repl->db[node] == ldb)
+			ret = r;
+	}
+
+	return ret;
+}
+
+/**
+ * The record removal from an indexed table.
+ *
+ * @db		- the table;
+ * @eq		- @eq argument of tdb_entry_remove();
+ * @data	- @data argument of tdb_entry_remove();
+ * @skey	- the secondary key of the removed record;
+ */
+typedef struct {
+	TDB		*db;
+	bool		(*eq)(TdbRec *, void *);
+	void		*data;
+	unsigned long	skey;
+} TdbRmCtx;
+
+static bool
+tdb_entry_remove_eq(TdbRec *r, void *data)
+{
+	TdbRmCtx *rc = data;
+
+	if (rc->eq && !rc->eq(r, rc->data))
+		return false;
+	rc->skey = rc->db->idx_key(r->data);
+
+	return true;
+}
+
+/**
+ * Remove a record by @key. If there are several records with the same key,
+ * then @eq is called for each of them with @data as the second argument
+ * to choose the record to remove.
+ *
+ * The caller must not hold the record or any other record in the same bucket.
+ *
+ * The record is removed from all the replicas of a replicated table and
+ * the result for the local replica is returned. The record is also removed
+ * from the table secondary index.
+ */
+int
+tdb_entry_remove(TDB *db, unsigned long key, bool (*eq)(TdbRec *, void *),
+		 void *data)
+{
+	int r;
+	TdbRmCtx rc = { .db = db, .eq = eq, .data = data };
+
+	if (likely(!db->idx))
+		return __tdb_entry_remove(db, key, eq, data);
+
+	/* Remember the secondary key of the record to drop its index. */
+	r = __tdb_entry_remove(db, key, tdb_entry_remove_eq, &rc);
+	if (!r)
+		tdb_index_drop(db, rc.skey, key);
+
+	return r;
+}
+EXPORT_SYMBOL(tdb_entry_remove);
+
 /**
  * Lookup and get a record.
  * Since we don't copy returned records, we have to lock the memory location
@@ -117,6 +307,7 @@ tdb_rec_get(TDB *db, unsigned long key)
 {
 	TdbIter iter = { NULL };
 
+	db = tdb_local(db);
 	iter.bckt = tdb_htrie_lookup(db->hdr, key);
 	if (!iter.bckt)
 		goto out;
@@ -136,12 +327,53 @@ tdb_rec_next(TDB *db, TdbIter *iter)
 {
 	BUG_ON(!iter->bckt);
 
+	db = tdb_repl_of(db, iter->bckt);
 	iter->rec = tdb_htrie_next_rec(db->hdr, iter->rec,
 				       (TdbBucket **)&iter->bckt,
 				       iter->rec->key);
 }
 EXPORT_SYMBOL(tdb_rec_next);
 
+/**
+ * Lookup records for @n keys @keys at once. The index is descended for
+ * all the keys together, see tdb_htrie_lookup_batch(), and @fn is called
+ * for the first record found for each key with @data as the last argument.
+ * The record bucket is locked during the call as for records returned by
+ * tdb_rec_get() and is unlocked after the call, so @fn must not call
+ * tdb_rec_put(). The lookup stops if @fn returns non-zero.
+ *
+ * @return number of processed keys.
+ */
+int
+tdb_rec_get_batch(TDB *db, const unsigned long *keys, int n,
+		  int (*fn)(TdbRec *rec, int i, void *data), void *data)
+{
+	int i, j, k, r;
+	TdbBucket *bckts[TDB_BATCH_SZ];
+	TdbRec *rec;
+
+	db = tdb_local(db);
+	for (i = 0; i < n; i += k) {
+		k = min(n - i, TDB_BATCH_SZ);
+		tdb_htrie_lookup_batch(db->hdr, keys + i, k, bckts);
+		for (j = 0; j < k; ++j) {
+			if (!bckts[j])
+				continue;
+			rec = tdb_htrie_bscan_for_rec(db->hdr, &bckts[j],
+						      keys[i + j]);
+			if (!rec)
+				continue;
+			r = fn(rec, i + j, data);
+			tdb_rec_put(rec);
+			if (r)
+				return i + j;
+		}
+	}
+
+	return n;
+}
+EXPORT_SYMBOL(tdb_rec_get_batch);
+
 void
 tdb_rec_put(void *rec)
 {
@@ -185,7 +417,7 @@ static TDB *
 tdb_get_db(const char *path, int node)
 {
 	int full_len, len;
-	char *slash;
+	char *slash, tbl_name[TDB_TBLNAME_LEN];
 	TDB *db;
 
 	full_len = strlen(path);
@@ -206,7 +438,10 @@ tdb_get_db(const char *path, int node)
 		return NULL;
 	}
 
-	db = tdb_tbl_lookup(slash + 1, len);
+	/* Tables of different nodes have the same name prefix. */
+	snprintf(tbl_name, TDB_TBLNAME_LEN, "%.*s%X.tdb", len, slash + 1,
+		 node);
+	db = tdb_tbl_lookup(tbl_name, TDB_TBLNAME_LEN);
 	if (db)
 		return db;
 
@@ -217,8 +452,7 @@ tdb_get_db(const char *path, int node)
 	}
 	snprintf(db->path, TDB_PATH_LEN, "%.*s%X.tdb",
 		 (int)(full_len - sizeof(TDB_SUFFIX) + 1), path, node);
-	snprintf(db->tbl_name, TDB_TBLNAME_LEN, "%.*s%X.tdb",
-		 len, slash + 1, node);
+	memcpy(db->tbl_name, tbl_name, TDB_TBLNAME_LEN);
 
 	return tdb_get(db);
 }
@@ -238,7 +472,13 @@ tdb_get_db(const char *path, int node)
  * @return pointer to record with acquired bucket lock if the record is
  * found and create TDB entry without acquired locks otherwise.
  *
- * TODO #515 rework the function in lock-free way.
+ * If @ctx->get_rec is specified, then the record is searched without locks
+ * first and found records are always returned without acquired locks:
+ * @ctx->get_rec must acquire the record for the caller. Records created by
+ * @ctx->init_rec can be seen by lock-free readers at any moment, so
+ * @ctx->init_rec must publish the record for @ctx->get_rec at the end.
+ *
+ * TODO #515 rework record creation in lock-free way.
  * TODO #515 TDB must be extended to support small records with constant memory
  * address.
  */
@@ -248,12 +488,23 @@ tdb_rec_get_alloc(TDB *db, unsigned long key, TdbGetAllocCtx *ctx)
 	TdbIter iter;
 	TdbRec *r;
 
+	ctx->is_new = false;
+	if (ctx->get_rec) {
+		r = tdb_htrie_get_lf(db->hdr, key, ctx->get_rec, ctx->ctx);
+		if (r)
+			return r;
+	}
+
 	spin_lock(&db->ga_lock);
 
-	ctx->is_new = false;
 	iter = tdb_rec_get(db, key);
 	while (!TDB_ITER_BAD(iter)) {
-		if (ctx->eq_rec(iter.rec,  ctx->ctx)) {
+		if (ctx->get_rec && ctx->get_rec(iter.rec, ctx->ctx)) {
+			tdb_rec_put(iter.rec);
+			spin_unlock(&db->ga_lock);
+			return iter.rec;
+		}
+		if (!ctx->get_rec && ctx->eq_rec(iter.rec, ctx->ctx)) {
 			spin_unlock(&db->ga_lock);
 			return iter.rec;
 		}
@@ -267,6 +518,8 @@ tdb_rec_get_alloc(TDB *db, unsigned long key, TdbGetAllocCtx *ctx)
 	ctx->is_new = true;
 	r = tdb_entry_alloc(db, key, &ctx->len);
 	ctx->init_rec(r, ctx->ctx);
+	if (db->idx)
+		tdb_index_add(db, r);
 
 	spin_unlock(&db->ga_lock);
 
@@ -277,25 +530,71 @@ EXPORT_SYMBOL(tdb_rec_get_alloc);
 int
 tdb_entry_walk(TDB *db, int (*fn)(void *))
 {
-	return tdb_htrie_walk(db->hdr, fn);
+	return tdb_htrie_walk(tdb_local(db)->hdr, fn);
 }
 EXPORT_SYMBOL(tdb_entry_walk);
 
 /**
- * Open database file and @return its descriptor.
- * If the database is already opened, then returns the handler.
- *
- * The function must not be called from softirq!
+ * Bounded iteration over the table: up to @n buckets are visited starting
+ * from cursor @c on each call, see tdb_htrie_iter().
  */
-TDB *
-tdb_open(const char *path, size_t fsize, unsigned int rec_size, int node)
+int
+tdb_entry_iter(TDB *db, TdbCursor *c, unsigned int n,
+	       int (*fn)(TdbRec *, void *), void *data)
 {
-	TDB *db;
+	return tdb_htrie_iter(tdb_local(db)->hdr, c, n, fn, data);
+}
+EXPORT_SYMBOL(tdb_entry_iter);
 
-	if ((fsize & ~TDB_EXT_MASK) || fsize < TDB_EXT_SZ) {
-		TDB_ERR("Bad table size: %lu\n", fsize);
-		return NULL;
+/**
+ * Called by the user once the absolute pointers in all the records of table
+ * @db are relocated by @db->reloc, so the current mapping address becomes
+ * the base for the next open.
+ */
+void
+tdb_reloc_done(TDB *db)
+{
+	int node;
+
+	if (likely(!db->repl)) {
+		db->hdr->base = (unsigned long)db->hdr;
+		db->reloc = 0;
+		return;
+	}
+	for_each_node_with_cpus(node) {
+		db->repl->db[node]->hdr->base =
+			(unsigned long)db->repl->db[node]->hdr;
+		db->repl->db[node]->reloc = 0;
+	}
+}
+EXPORT_SYMBOL(tdb_reloc_done);
+
+/**
+ * Make the table records expiring: the background sweeper removes records
+ * for which @expired returns true. @expired is called with record data under
+ * the bucket write lock, so it can atomically check the record expiration
+ * time and users and release the record resources. NULL @expired stops
+ * the sweeping. Each replica of a replicated table is swept independently.
+ */
+void
+tdb_entry_expiry(TDB *db, bool (*expired)(void *))
+{
+	int node;
+
+	if (likely(!db->repl)) {
+		WRITE_ONCE(db->expired, expired);
+		return;
 	}
+	for_each_node_with_cpus(node)
+		WRITE_ONCE(db->repl->db[node]->expired, expired);
+}
+EXPORT_SYMBOL(tdb_entry_expiry);
+
+static TDB *
+__tdb_open(const char *path, size_t fsize, size_t max_size,
+	   unsigned int rec_size, int node)
+{
+	TDB *db;
 
 	db = tdb_get_db(path, node);
 	if (!db)
@@ -303,22 +602,34 @@ tdb_open(const char *path, size_t fsize, unsigned int rec_size, int node)
 
 	db->node = node;
 
-	if (tdb_file_open(db, fsize)) {
+	if (tdb_file_open(db, fsize, max_size)) {
 		TDB_ERR("Cannot open db\n");
 		goto err;
 	}
 
-	db->hdr = tdb_htrie_init(db->hdr, db->filp->f_inode->i_size, rec_size);
+	db->hdr = tdb_htrie_init(db->hdr, db->filp->f_inode->i_size, fsize,
+				 max_size, rec_size);
 	if (!db->hdr) {
 		TDB_ERR("Cannot initialize db header\n");
 		goto err_init;
 	}
 
+	/*
+	 * The file can be mapped at another address than before the restart,
+	 * so users must fix up the absolute pointers stored in the records.
+	 * The new address is stored by tdb_reloc_done() only, so the pointers
+	 * are still relocated on the next open if the user doesn't do it now.
+	 */
+	if (!db->hdr->base)
+		db->hdr->base = (unsigned long)db->hdr;
+	db->reloc = (long)db->hdr - (long)db->hdr->base;
+
 	tdb_tbl_enumerate(db);
 	spin_lock_init(&db->ga_lock);
 
-	TDB_LOG("Opened table %s: size=%lu rec_size=%u base=%p\n",
-		path, fsize, rec_size, db->hdr);
+	TDB_LOG("Opened table %s: size=%lu max_size=%lu rec_size=%u base=%p"
+		" reloc=%ld\n", path, db->hdr->dbsz, max_size, rec_size,
+		db->hdr, db->reloc);
 
 	return db;
 err_init:
@@ -327,27 +638,116 @@ err:
 	tdb_put(db);
 	return NULL;
 }
+
+static void __tdb_close(TDB *db);
+
+/**
+ * Open a replica of the table at each NUMA node with CPUs, the replicas are
+ * stored in separate files as the tables of different nodes.
+ */
+static TDB *
+tdb_open_repl(const char *path, size_t fsize, size_t max_size,
+	      unsigned int rec_size)
+{
+	int node;
+	TDB *db;
+	TdbRepl *repl;
+
+	repl = kzalloc(sizeof(*repl) + nr_node_ids * sizeof(TDB *),
+		       GFP_KERNEL);
+	if (!repl)
+		return NULL;
+
+	for_each_node_with_cpus(node) {
+		db = __tdb_open(path, fsize, max_size, rec_size, node);
+		if (!db)
+			goto err;
+		if (db->repl) {
+			TDB_ERR("Table %s is already opened\n", db->tbl_name);
+			__tdb_close(db);
+			goto err;
+		}
+		atomic_inc(&repl->count);
+		repl->db[node] = db;
+		db->repl = repl;
+	}
+
+	return tdb_local(db);
+err:
+	if (!atomic_read(&repl->count)) {
+		kfree(repl);
+		return NULL;
+	}
+	/* The last replica releases @repl. */
+	for_each_node_with_cpus(node)
+		if (repl->db[node])
+			__tdb_close(repl->db[node]);
+	return NULL;
+}
+
+/**
+ * Open database file and @return its descriptor.
+ * If the database is already opened, then returns the handler.
+ *
+ * The database starts with @fsize bytes and grows by extents on demand up to
+ * @max_size bytes. The memory for the growth is reserved on the open.
+ *
+ * Read-mostly tables can be replicated to all the NUMA nodes with CPUs by
+ * TDB_REPLICATED @node. Lookups read the replica at the current node and
+ * tdb_entry_create() and tdb_entry_remove() write all the replicas. Entries
+ * written directly by users, i.e. allocated by tdb_entry_alloc(), can't be
+ * replicated.
+ *
+ * The function must not be called from softirq!
+ */
+TDB *
+tdb_open_grow(const char *path, size_t fsize, size_t max_size,
+	      unsigned int rec_size, int node)
+{
+	if ((fsize & ~TDB_EXT_MASK) || fsize < TDB_EXT_SZ) {
+		TDB_ERR("Bad table size: %lu\n", fsize);
+		return NULL;
+	}
+	max_size = TDB_EXT_O(max_size + TDB_EXT_SZ - 1);
+	if (max_size < fsize)
+		max_size = fsize;
+
+	if (node == TDB_REPLICATED)
+		return tdb_open_repl(path, fsize, max_size, rec_size);
+
+	return __tdb_open(path, fsize, max_size, rec_size, node);
+}
+EXPORT_SYMBOL(tdb_open_grow);
+
+/**
+ * Open database file of fixed size @fsize, see tdb_open_grow().
+ */
+TDB *
+tdb_open(const char *path, size_t fsize, unsigned int rec_size, int node)
+{
+	return tdb_open_grow(path, fsize, fsize, rec_size, node);
+}
 EXPORT_SYMBOL(tdb_open);
 
 static void
 __do_close_table(TDB *db)
 {
+	/* Release the blocks before the database is written to the file. */
+	tdb_htrie_exit(db->hdr);
+
 	/* Unmapping can be done from process context. */
 	tdb_file_close(db);
 
-	tdb_htrie_exit(db->hdr);
-
 	TDB_LOG("Close table '%s'\n", db->tbl_name);
 
+	if (db->repl && atomic_dec_and_test(&db->repl->count))
+		kfree(db->repl);
 	kfree(db);
 }
 
-void
-tdb_close(TDB *db)
+static void
+__tdb_close(TDB *db)
 {
-	if (!db)
-		return;
-
 	if (!atomic_dec_and_test(&db->count))
 		return;
 
@@ -355,6 +755,27 @@ tdb_close(TDB *db)
 
 	__do_close_table(db);
 }
+
+/**
+ * Close the table or all the replicas of a replicated table.
+ */
+void
+tdb_close(TDB *db)
+{
+	int node;
+	TdbRepl *repl;
+
+	if (!db)
+		return;
+
+	if (likely(!(repl = db->repl))) {
+		__tdb_close(db);
+		return;
+	}
+	/* The last replica releases @repl. */
+	for_each_node_with_cpus(node)
+		__tdb_close(repl->db[node]);
+}
 EXPORT_SYMBOL(tdb_close);
 
 static int __init
@@ -368,10 +789,23 @@ tdb_init(void)
 	if (r)
 		return r;
 
-	r = tdb_if_init();
+	r = tdb_sweep_init();
 	if (r)
 		return r;
 
+	r = tdb_if_init();
+	if (r) {
+		tdb_sweep_exit();
+		return r;
+	}
+
+	r = tdb_mmap_init();
+	if (r) {
+		tdb_if_exit();
+		tdb_sweep_exit();
+		return r;
+	}
+
 	return 0;
 }
 
@@ -380,6 +814,8 @@ tdb_exit(void)
 {
 	TDB_LOG("Shutdown Tempesta DB\n");
 
+	tdb_mmap_exit();
+	tdb_sweep_exit();
 	tdb_if_exit();
 
 	/*
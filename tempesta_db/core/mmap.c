@@ -0,0 +1,141 @@
+/**
+ *		Tempesta DB
+ *
+ * Read-only mapping of tables to user space.
+ *
+ * A process opens the device, binds it to a table by TDB_IOC_MAP and maps
+ * the table memory. The opened device keeps a reference to the table, so
+ * the table memory isn't released or reused by other tables until the last
+ * mapping is destroyed and the device is closed. The readers walk the trie
+ * directly without locks using the layout descriptor returned by
+ * TDB_IOC_MAP, see TdbMapInfo.
+ *
+ * Copyright (C) 2020 Tempesta Technologies, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#include <linux/miscdevice.h>
+#include <linux/mm.h>
+#include <linux/uaccess.h>
+#include <linux/vmalloc.h>
+
+#include "htrie.h"
+#include "mmap.h"
+#include "table.h"
+
+static long
+tdb_mmap_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
+{
+	TdbMapInfo mi;
+	TDB *db;
+
+	if (cmd != TDB_IOC_MAP)
+		return -ENOTTY;
+	if (copy_from_user(&mi, (void __user *)arg, sizeof(mi)))
+		return -EFAULT;
+	mi.tbl_name[TDB_TBLNAME_LEN] = 0;
+
+	db = tdb_tbl_lookup(mi.tbl_name, TDB_TBLNAME_LEN);
+	if (!db)
+		return -ENOENT;
+	if (cmpxchg(&filp->private_data, NULL, db)) {
+		tdb_close(db);
+		return -EBUSY;
+	}
+
+	tdb_htrie_map_info(db->hdr, &mi);
+	if (copy_to_user((void __user *)arg, &mi, sizeof(mi)))
+		return -EFAULT;
+
+	return 0;
+}
+
+/**
+ * The table memory is either a contiguous area of huge pages or vmalloc()'ed
+ * memory, see tempesta_reserve_pages() in the kernel.
+ */
+static int
+tdb_mmap_mmap(struct file *filp, struct vm_area_struct *vma)
+{
+	int r;
+	unsigned long addr, size = vma->vm_end - vma->vm_start;
+	TDB *db = READ_ONCE(filp->private_data);
+	char *p;
+
+	if (!db)
+		return -ENOENT;
+	if (vma->vm_pgoff || size > db->hdr->max_dbsz)
+		return -EINVAL;
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
+
+	vma->vm_flags &= ~VM_MAYWRITE;
+	vma->vm_flags |= VM_DONTEXPAND | VM_DONTDUMP;
+
+	p = (char *)db->hdr;
+	if (!is_vmalloc_addr(p))
+		return remap_pfn_range(vma, vma->vm_start,
+				       virt_to_phys(p) >> PAGE_SHIFT, size,
+				       vma->vm_page_prot);
+
+	for (addr = vma->vm_start; addr < vma->vm_end; addr += PAGE_SIZE) {
+		r = vm_insert_page(vma, addr, vmalloc_to_page(p));
+		if (r)
+			return r;
+		p += PAGE_SIZE;
+	}
+
+	return 0;
+}
+
+static int
+tdb_mmap_release(struct inode *inode, struct file *filp)
+{
+	tdb_close(filp->private_data);
+
+	return 0;
+}
+
+static const struct file_operations tdb_mmap_fops = {
+	.owner		= THIS_MODULE,
+	.unlocked_ioctl	= tdb_mmap_ioctl,
+	.mmap		= tdb_mmap_mmap,
+	.release	= tdb_mmap_release,
+};
+
+static struct miscdevice tdb_mmap_dev = {
+	.minor	= MISC_DYNAMIC_MINOR,
+	.name	= "tempesta_db",
+	.fops	= &tdb_mmap_fops,
+	.mode	= 0400,
+};
+
+int __init
+tdb_mmap_init(void)
+{
+	int r;
+
+	r = misc_register(&tdb_mmap_dev);
+	if (r)
+		TDB_ERR("Cannot register %s device\n", TDB_MAP_DEV);
+
+	return r;
+}
+
+void
+tdb_mmap_exit(void)
+{
+	misc_deregister(&tdb_mmap_dev);
+}
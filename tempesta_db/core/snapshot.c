@@ -0,0 +1,338 @@
+/**
+ *		Tempesta DB
+ *
+ * Point-in-time snapshots of tables.
+ *
+ * A snapshot is written to a file in background while the table is modified.
+ * The snapshot starts when no write operation is in progress, so the table
+ * is consistent at the moment, see tdb_wr_begin(). Since the moment writers
+ * save copies of the blocks which they're going to modify and the snapshot
+ * thread writes the saved copies instead of the modified blocks. Each block
+ * is saved at most once and the copy is released as soon as it's written,
+ * so only blocks modified ahead of the snapshot thread consume memory.
+ *
+ * The snapshot file has the same format as the table file, so the table can
+ * be started from the snapshot. The database magic is written last, so a
+ * snapshot interrupted by a crash isn't loaded as a valid database.
+ *
+ * Copyright (C) 2020 Tempesta Technologies, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#include <linux/file.h>
+#include <linux/fs.h>
+#include <linux/kthread.h>
+#include <linux/module.h>
+#include <linux/vmalloc.h>
+
+#include "htrie.h"
+#include "snapshot.h"
+
+/* Number of blocks written to the file at once. */
+#define TDB_SNAP_BATCH		64
+/* How long the snapshot start waits for the write operations in progress. */
+#define TDB_SNAP_CUT_TIMEOUT	(HZ / 100 ? : 1)
+#define TDB_SNAP_CUT_TRIES	100
+
+void
+__tdb_snap_cow(TdbSnap *s, TdbHdr *dbh, void *p, size_t len)
+{
+	unsigned long b, end, off = TDB_HTRIE_OFF(dbh, p);
+	struct page *page;
+
+	if (READ_ONCE(s->state) != TDB_SNAP_ACTIVE || off >= s->size)
+		return;
+	end = min(off + len, s->size);
+
+	for (b = off / PAGE_SIZE; b <= (end - 1) / PAGE_SIZE; ++b) {
+		if (test_bit(b, s->saved))
+			continue;
+
+		spin_lock_bh(&s->lock);
+		if (test_bit(b, s->saved))
+			goto next;
+		page = alloc_page(GFP_ATOMIC | __GFP_NOWARN);
+		if (!page) {
+			/* Writers can't wait, so just give up the snapshot. */
+			WRITE_ONCE(s->state, TDB_SNAP_FAILED);
+			spin_unlock_bh(&s->lock);
+			return;
+		}
+		copy_page(page_address(page), TDB_PTR(dbh, b * PAGE_SIZE));
+		s->cow[b] = page;
+		set_bit(b, s->saved);
+next:
+		spin_unlock_bh(&s->lock);
+	}
+}
+
+/**
+ * Copy block @b at the snapshot moment to @dst.
+ */
+static void
+tdb_snap_read_blk(TdbSnap *s, TdbHdr *dbh, unsigned long b, void *dst)
+{
+	struct page *page;
+
+	spin_lock_bh(&s->lock);
+	if ((page = s->cow[b])) {
+		s->cow[b] = NULL;
+		spin_unlock_bh(&s->lock);
+		copy_page(dst, page_address(page));
+		__free_page(page);
+		return;
+	}
+	/* The block isn't modified, copy it before writers do this. */
+	BUG_ON(test_bit(b, s->saved));
+	copy_page(dst, TDB_PTR(dbh, b * PAGE_SIZE));
+	set_bit(b, s->saved);
+	spin_unlock_bh(&s->lock);
+}
+
+static int
+tdb_snap_write(TdbSnap *s, void *buf, size_t len, loff_t off)
+{
+	mm_segment_t oldfs;
+	ssize_t r;
+
+	oldfs = get_fs();
+	set_fs(get_ds());
+	r = kernel_write(s->filp, buf, len, &off);
+	set_fs(oldfs);
+
+	if (r != len)
+		return r < 0 ? r : -EIO;
+	return 0;
+}
+
+static void
+tdb_snap_free(TdbSnap *s)
+{
+	unsigned long b;
+
+	if (s->cow)
+		for (b = 0; b < s->nblks; ++b)
+			if (s->cow[b])
+				__free_page(s->cow[b]);
+	vfree(s->cow);
+	vfree(s->saved);
+	s->cow = NULL;
+	s->saved = NULL;
+}
+
+static int
+tdb_snap_alloc(TdbSnap *s, unsigned long size)
+{
+	s->nblks = size / PAGE_SIZE;
+	s->saved = vzalloc(BITS_TO_LONGS(s->nblks) * sizeof(long));
+	s->cow = vzalloc(s->nblks * sizeof(struct page *));
+	if (!s->saved || !s->cow) {
+		tdb_snap_free(s);
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+/**
+ * Wait until there are no write operations in progress and start
+ * the snapshot. The new operations wait for the start, so the caller
+ * gives up if the operations in progress take too long: probably they
+ * in turn wait for some context which has to start a new operation.
+ */
+static int
+tdb_snap_cut(TdbSnap *s, TdbHdr *dbh)
+{
+	int cpu, n;
+	unsigned long ops, timeout;
+
+	for (n = 0; n < TDB_SNAP_CUT_TRIES; ++n) {
+		/* Local softirqs must not wait for us. */
+		local_bh_disable();
+		WRITE_ONCE(s->state, TDB_SNAP_PENDING);
+		smp_mb();
+
+		timeout = jiffies + TDB_SNAP_CUT_TIMEOUT;
+		do {
+			ops = 0;
+			for_each_possible_cpu(cpu)
+				ops += READ_ONCE(per_cpu_ptr(dbh->pcpu,
+							     cpu)->ops);
+			if (ops) {
+				cpu_relax();
+				continue;
+			}
+			smp_rmb();
+			/* The database grew since the allocation. */
+			if (READ_ONCE(dbh->dbsz) > s->nblks * PAGE_SIZE)
+				break;
+			s->size = dbh->dbsz;
+			WRITE_ONCE(s->state, TDB_SNAP_ACTIVE);
+			local_bh_enable();
+			return 0;
+		} while (time_before(jiffies, timeout));
+
+		WRITE_ONCE(s->state, TDB_SNAP_NONE);
+		local_bh_enable();
+
+		if (!ops) {
+			tdb_snap_free(s);
+			if (tdb_snap_alloc(s, READ_ONCE(dbh->dbsz)))
+				return -ENOMEM;
+		}
+		schedule_timeout_uninterruptible(TDB_SNAP_CUT_TIMEOUT);
+	}
+
+	return -EBUSY;
+}
+
+/**
+ * Write all the blocks up to the database size at the snapshot moment.
+ * A reference to the table is held by the snapshot.
+ */
+static int
+tdb_snap_thread(void *data)
+{
+	TdbSnap *s = data;
+	TDB *db = s->db;
+	TdbHdr *dbh = db->hdr;
+	unsigned long b, i, n, magic = 0;
+	int r;
+
+	if ((r = tdb_snap_cut(s, dbh)))
+		goto out;
+
+	for (b = 0; b < s->size / PAGE_SIZE; b += n) {
+		n = min_t(unsigned long, s->size / PAGE_SIZE - b,
+			  TDB_SNAP_BATCH);
+		for (i = 0; i < n; ++i)
+			tdb_snap_read_blk(s, dbh, b + i,
+					  s->buf + i * PAGE_SIZE);
+		if (!b) {
+			/* The image is valid when it's fully written. */
+			TdbHdr *h = (TdbHdr *)s->buf;
+
+			magic = h->magic;
+			h->magic = 0;
+			h->snap = NULL;
+		}
+		if (READ_ONCE(s->state) == TDB_SNAP_FAILED) {
+			r = -ENOMEM;
+			goto out;
+		}
+		if ((r = tdb_snap_write(s, s->buf, n * PAGE_SIZE,
+					b * PAGE_SIZE)))
+			goto out;
+		cond_resched();
+	}
+
+	if ((r = vfs_fsync(s->filp, 0))
+	    || (r = tdb_snap_write(s, &magic, sizeof(magic), 0)))
+		goto out;
+	r = vfs_fsync(s->filp, 0);
+out:
+	WRITE_ONCE(dbh->snap, NULL);
+	/* Wait for writers which could see the snapshot. */
+	synchronize_sched();
+
+	if (r)
+		TDB_ERR("Cannot write snapshot of table %s, err=%d\n",
+			db->tbl_name, r);
+	else
+		TDB_LOG("Snapshot of table %s is written, %lu bytes\n",
+			db->tbl_name, s->size);
+
+	filp_close(s->filp, NULL);
+	tdb_snap_free(s);
+	vfree(s->buf);
+	kfree(s);
+	tdb_close(db);
+
+	module_put_and_exit(r);
+}
+
+/**
+ * Start writing snapshot of table @db to file @path. The snapshot is written
+ * in background, the result is reported to the kernel log. Only one snapshot
+ * of a table can be written at a time.
+ *
+ * The snapshot contains all the modifications of the table made through
+ * TDB calls before the snapshot start. However, records data written by
+ * users directly to memory of records allocated before the snapshot start
+ * can be caught by the snapshot partially, so users must validate such
+ * records when they load a snapshot as they do after a crash.
+ *
+ * The function must not be called from softirq!
+ */
+int
+tdb_snapshot(TDB *db, const char *path)
+{
+	int r;
+	TdbSnap *s;
+	struct task_struct *t;
+
+	if (!strcmp(path, db->path)) {
+		TDB_ERR("Cannot write snapshot to the table file %s\n", path);
+		return -EINVAL;
+	}
+
+	if (!(s = kzalloc(sizeof(*s), GFP_KERNEL)))
+		return -ENOMEM;
+	spin_lock_init(&s->lock);
+	s->db = db;
+	s->buf = vmalloc(TDB_SNAP_BATCH * PAGE_SIZE);
+	if (!s->buf || tdb_snap_alloc(s, READ_ONCE(db->hdr->dbsz))) {
+		r = -ENOMEM;
+		goto err;
+	}
+
+	s->filp = filp_open(path, O_CREAT | O_TRUNC | O_WRONLY | O_LARGEFILE,
+			    0600);
+	if (IS_ERR(s->filp)) {
+		TDB_ERR("Cannot open snapshot file %s\n", path);
+		r = PTR_ERR(s->filp);
+		goto err;
+	}
+
+	if (cmpxchg(&db->hdr->snap, NULL, s)) {
+		TDB_ERR("Snapshot of table %s is already being written\n",
+			db->tbl_name);
+		r = -EBUSY;
+		goto err_file;
+	}
+
+	tdb_get(db);
+	__module_get(THIS_MODULE);
+	t = kthread_run(tdb_snap_thread, s, "tdb_snap/%s", db->tbl_name);
+	if (IS_ERR(t)) {
+		r = PTR_ERR(t);
+		module_put(THIS_MODULE);
+		db->hdr->snap = NULL;
+		tdb_put(db);
+		goto err_file;
+	}
+
+	TDB_LOG("Start snapshot of table %s to %s\n", db->tbl_name, path);
+
+	return 0;
+err_file:
+	filp_close(s->filp, NULL);
+err:
+	tdb_snap_free(s);
+	vfree(s->buf);
+	kfree(s);
+	return r;
+}
+EXPORT_SYMBOL(tdb_snapshot);
@@ -0,0 +1,119 @@
+/**
+ *		Tempesta DB
+ *
+ * Copyright (C) 2020 Tempesta Technologies, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#ifndef __TDB_SNAPSHOT_H__
+#define __TDB_SNAPSHOT_H__
+
+#include <linux/percpu.h>
+#include <linux/spinlock.h>
+
+#include "tdb.h"
+
+enum {
+	TDB_SNAP_NONE,
+	/* Waiting for the write operations in progress. */
+	TDB_SNAP_PENDING,
+	/* Writers save the blocks before modification. */
+	TDB_SNAP_ACTIVE,
+	/* A block couldn't be saved, the snapshot is broken. */
+	TDB_SNAP_FAILED,
+};
+
+/**
+ * Snapshot of a table which is being written to a file.
+ *
+ * @state	- the snapshot state, see TDB_SNAP_* above;
+ * @size	- size of the database at the snapshot moment;
+ * @nblks	- number of blocks, for which @saved and @cow are allocated;
+ * @saved	- bitmap of blocks which writers can modify freely: either
+ *		  the block is already written to the file or its copy
+ *		  is saved in @cow;
+ * @cow		- copies of the blocks taken by writers before they modified
+ *		  the blocks and which aren't written to the file yet;
+ * @lock	- serializes copying of the blocks;
+ * @db		- the table;
+ * @filp	- the snapshot file;
+ * @buf	- buffer to write the blocks to the file by;
+ */
+typedef struct tdb_snap_t {
+	int		state;
+	unsigned long	size;
+	unsigned long	nblks;
+	unsigned long	*saved;
+	struct page	**cow;
+	spinlock_t	lock;
+	TDB		*db;
+	struct file	*filp;
+	char		*buf;
+} TdbSnap;
+
+void __tdb_snap_cow(TdbSnap *s, TdbHdr *dbh, void *p, size_t len);
+
+/**
+ * Save the blocks of @len bytes area at @p for running snapshot before
+ * they're modified.
+ */
+static inline void
+tdb_snap_cow(TdbHdr *dbh, void *p, size_t len)
+{
+	TdbSnap *s = READ_ONCE(dbh->snap);
+
+	if (unlikely(s))
+		__tdb_snap_cow(s, dbh, p, len);
+}
+
+/**
+ * Write operations on the database are enclosed by tdb_wr_begin() and
+ * tdb_wr_end(), so that a snapshot starts at a moment when no operation
+ * is in progress and the database is consistent. The operations must not
+ * sleep. Nested operations, e.g. from softirq interrupting an operation in
+ * process context, don't wait for the snapshot start.
+ */
+static inline void
+tdb_wr_begin(TdbHdr *dbh)
+{
+	TdbSnap *s;
+	TdbPerCpu *p;
+
+	preempt_disable();
+	/*
+	 * A nested operation can interrupt the counter update, but it
+	 * restores the counter on exit.
+	 */
+	p = this_cpu_ptr(dbh->pcpu);
+	while (++p->ops == 1) {
+		smp_mb();
+		s = READ_ONCE(dbh->snap);
+		if (likely(!s) || READ_ONCE(s->state) != TDB_SNAP_PENDING)
+			break;
+		--p->ops;
+		while (READ_ONCE(s->state) == TDB_SNAP_PENDING)
+			cpu_relax();
+	}
+}
+
+static inline void
+tdb_wr_end(TdbHdr *dbh)
+{
+	smp_wmb();
+	--this_cpu_ptr(dbh->pcpu)->ops;
+	preempt_enable();
+}
+
+#endif /* __TDB_SNAPSHOT_H__ */
@@ -0,0 +1,117 @@
+/**
+ *		Tempesta DB
+ *
+ * Background sweeper of expired records.
+ *
+ * Tables with expiring records are swept by low priority per-node kernel
+ * threads. Each thread visits a bounded number of buckets of each table on
+ * its NUMA node per tick, so the sweep doesn't interfere with the records
+ * processing in softirqs and memory used by the tables matches the live
+ * working set. The threads also return data blocks released by records
+ * removal to the tables after RCU grace periods, so the blocks can't be
+ * reused while lock-free readers access them.
+ *
+ * Copyright (C) 2020 Tempesta Technologies, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#include <linux/kthread.h>
+#include <linux/sched.h>
+#include <linux/topology.h>
+
+#include "htrie.h"
+#include "sweep.h"
+#include "table.h"
+
+/* Number of buckets visited in each table per tick. */
+#define TDB_SWEEP_BUCKETS	256
+#define TDB_SWEEP_INTERVAL	(HZ / 10)
+
+static struct task_struct *tdb_sweepers[MAX_NUMNODES];
+
+/**
+ * Called under the tables mutex, so the table can't be closed meanwhile.
+ */
+static void
+tdb_sweep_tbl(TDB *db)
+{
+	unsigned int n;
+	bool (*expired)(void *) = READ_ONCE(db->expired);
+
+	if (db->node != numa_node_id())
+		return;
+
+	if (expired) {
+		n = tdb_htrie_sweep(db->hdr, &db->sweep_pos,
+				    TDB_SWEEP_BUCKETS, expired);
+		if (n)
+			TDB_DBG("Swept %u expired records from table %s\n",
+				n, db->tbl_name);
+	}
+
+	/* Return the blocks released by all the removals to the table. */
+	n = tdb_htrie_reclaim(db->hdr);
+	if (n)
+		TDB_DBG("Reclaimed %u blocks in table %s\n", n, db->tbl_name);
+}
+
+static int
+tdb_sweep_thread(void *data)
+{
+	set_user_nice(current, MAX_NICE);
+
+	while (!kthread_should_stop()) {
+		tdb_tbl_foreach(tdb_sweep_tbl);
+		schedule_timeout_interruptible(TDB_SWEEP_INTERVAL);
+	}
+
+	return 0;
+}
+
+void
+tdb_sweep_exit(void)
+{
+	int node;
+
+	for_each_node_with_cpus(node) {
+		if (!tdb_sweepers[node])
+			continue;
+		kthread_stop(tdb_sweepers[node]);
+		tdb_sweepers[node] = NULL;
+	}
+}
+
+int
+tdb_sweep_init(void)
+{
+	int node;
+	struct task_struct *t;
+
+	for_each_node_with_cpus(node) {
+		t = kthread_create_on_node(tdb_sweep_thread, NULL, node,
+					   "tdb_sweep/%d", node);
+		if (IS_ERR(t)) {
+			TDB_ERR("Cannot create sweeper for node %d\n", node);
+			tdb_sweep_exit();
+			return PTR_ERR(t);
+		}
+		/* numa_node_id() of the thread chooses the tables to sweep. */
+		set_cpus_allowed_ptr(t, cpumask_of_node(node));
+		tdb_sweepers[node] = t;
+		wake_up_process(t);
+	}
+
+	return 0;
+}
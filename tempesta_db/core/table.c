@@ -83,7 +83,13 @@ tdb_tbl_print_all(char *buf, size_t len)
 	mutex_lock(&tbl_mtx);
 
 	for (i = 0; i < tbl_last; ++i) {
-		int r = snprintf(buf + n, len - n, "%s ", tdb_tbls[i].name);
+		TdbHdr *hdr = tdb_tbls[i].db->hdr;
+		/* Sizes are current, high-water mark of usage and maximum. */
+		int r = snprintf(buf + n, len - n,
+				 "%s(size=%lu,hwm=%lld,max=%lu) ",
+				 tdb_tbls[i].name, READ_ONCE(hdr->dbsz),
+				 (long long)atomic64_read(&hdr->nwb),
+				 hdr->max_dbsz);
 		if (r <= 0) {
 			TDB_WARN("Not enough space to print all tables\n");
 			break;
@@ -37,22 +37,32 @@
  *		    TdbHdr->i_wcl and TdbHdr->d_wcl are the global values for
  *		    the variable. The variables are initialized in runtime,
  *		    so we lose some free space on system restart.
+ * @ops		  - number of write operations in progress on the CPU,
+ *		    see tdb_wr_begin();
  */
 typedef struct {
 	unsigned long	i_wcl;
 	unsigned long	d_wcl;
+	unsigned int	ops;
 } TdbPerCpu;
 
+struct tdb_snap_t;
+
 /**
  * Tempesta DB file descriptor.
  *
  * We store independent records in at least cache line size data blocks
  * to avoid false sharing.
  *
- * @dbsz	- the database size in bytes;
- * @nwb		- next to write block (byte offset);
+ * @dbsz	- the database size in bytes, grows up to @max_dbsz;
+ * @nwb		- next to write block (byte offset), also the high-water mark
+ *		  of the database usage;
  * @pcpu	- pointer to per-cpu dynamic data for the TDB handler;
  * @rec_len	- fixed-size records length or zero for variable-length records;
+ * @base	- address the database was mapped at, to relocate absolute
+ *		  pointers stored in the records by previous users;
+ * @max_dbsz	- maximum size of the database in bytes;
+ * @snap	- snapshot being written or NULL, see snapshot.c;
  ** @ext_bmp	- bitmap of used/free extents.
  * 		  Must be small and cache line aligned;
  */
@@ -62,7 +72,10 @@ typedef struct {
 	atomic64_t		nwb;
 	TdbPerCpu __percpu	*pcpu;
 	unsigned int		rec_len;
-	unsigned char		_padding[8 * 3 + 4];
+	unsigned long		base;
+	unsigned long		max_dbsz;
+	unsigned char		_padding[4];
+	struct tdb_snap_t	*snap;
 	unsigned long		ext_bmp[0];
 } __attribute__((packed)) TdbHdr;
 
@@ -73,19 +86,46 @@ typedef struct {
  * @node	- NUMA node ID;
  * @count	- reference counter;
  * @ga_lock	- Lock for atomic execution of lookup and create a record TDB;
+ * @reloc	- difference between the current and the previous mapping
+ *		  addresses of the database file, zero for a new database or
+ *		  after tdb_reloc_done();
+ * @expired	- returns true if the record with data @data is expired and
+ *		  can be removed, the table is swept in background if it's set;
+ * @sweep_pos	- position of the background sweeper in the table;
+ * @repl	- replicas of the table at all the nodes if the table is
+ *		  replicated, NULL otherwise;
+ * @idx		- secondary index of the table or NULL, see index.c;
+ * @idx_key	- returns the secondary key of a record with data @data;
  * @tbl_name	- table name;
  * @path	- path to the table;
  */
-typedef struct {
+typedef struct tdb_t {
 	TdbHdr		*hdr;
 	struct file	*filp;
 	int		node;
 	atomic_t	count;
 	spinlock_t	ga_lock; /* TODO: remove and make lockless. */
+	long		reloc;
+	bool		(*expired)(void *data);
+	TdbCursor	sweep_pos;
+	struct tdb_repl_t *repl;
+	struct tdb_t	*idx;
+	unsigned long	(*idx_key)(void *data);
 	char		tbl_name[TDB_TBLNAME_LEN + 1];
 	char		path[TDB_PATH_LEN];
 } TDB;
 
+/**
+ * Replicas of a table, one per NUMA node with CPUs, see tdb_open_grow().
+ *
+ * @count	- number of the replicas which aren't closed yet;
+ * @db		- the replicas indexed by NUMA node;
+ */
+typedef struct tdb_repl_t {
+	atomic_t	count;
+	TDB		*db[0];
+} TdbRepl;
+
 /**
  * Fixed-size (and typically small) records.
  */
@@ -123,6 +163,8 @@ typedef struct {
 /**
  * Hooks for tdb_rec_get_alloc() function.
  * @eq_rec		- record match function, used in collision chain;
+ * @get_rec		- lock-free record match function, if specified it's
+ *			  used instead of @eq_rec, see tdb_htrie_get_lf();
  * @precreate_rec	- called before a new record will be created int tdb,
  *			record creation will be aborted in non zero return code;
  * @init_rec		- init record before use;
@@ -137,6 +179,7 @@ typedef struct {
  */
 typedef struct {
 	bool		(*eq_rec)(TdbRec *rec, void *ctx);
+	bool		(*get_rec)(TdbRec *rec, void *ctx);
 	int		(*precreate_rec)(void *ctx);
 	void		(*init_rec)(TdbRec *rec, void *ctx);
 	void		*ctx;
@@ -158,6 +201,8 @@ typedef struct {
  * is no room.
  */
 #define TDB_HTRIE_MINDREC	(L1_CACHE_BYTES * 2)
+/* Maximum number of keys resolved at once by batched operations. */
+#define TDB_BATCH_SZ		16
 
 /* Convert internal offset to system pointer. */
 #define TDB_PTR(h, o)		(void *)((char *)(h) + (o))
@@ -192,20 +237,44 @@ typedef struct {
  */
 TdbRec *tdb_entry_alloc(TDB *db, unsigned long key, size_t *len);
 TdbRec *tdb_entry_create(TDB *db, unsigned long key, void *data, size_t *len);
+int tdb_entry_create_batch(TDB *db, const unsigned long *keys, void **data,
+			   size_t *len, TdbRec **recs, int n);
 TdbVRec *tdb_entry_add(TDB *db, TdbVRec *r, size_t size);
 void *tdb_entry_get_room(TDB *db, TdbVRec **r, char *curr_ptr, size_t tail_len,
 			 size_t tot_size);
+int tdb_entry_remove(TDB *db, unsigned long key, bool (*eq)(TdbRec *, void *),
+		     void *data);
 TdbIter tdb_rec_get(TDB *db, unsigned long key);
 void tdb_rec_next(TDB *db, TdbIter *iter);
+int tdb_rec_get_batch(TDB *db, const unsigned long *keys, int n,
+		      int (*fn)(TdbRec *rec, int i, void *data), void *data);
 void tdb_rec_put(void *rec);
 int tdb_info(char *buf, size_t len);
 TdbRec * tdb_rec_get_alloc(TDB *db, unsigned long key, TdbGetAllocCtx *ctx);
 int tdb_entry_walk(TDB *db, int (*fn)(void *));
+int tdb_entry_iter(TDB *db, TdbCursor *c, unsigned int n,
+		   int (*fn)(TdbRec *, void *), void *data);
+void tdb_entry_expiry(TDB *db, bool (*expired)(void *));
+void tdb_reloc_done(TDB *db);
 void tdb_rec_get_lock(void *rec);
 
 /* Open/close database handler. */
+#define TDB_REPLICATED		(-1)	/* the node to replicate a table */
 TDB *tdb_open(const char *path, size_t fsize, unsigned int rec_size, int node);
+TDB *tdb_open_grow(const char *path, size_t fsize, size_t max_size,
+		   unsigned int rec_size, int node);
 void tdb_close(TDB *db);
+int tdb_snapshot(TDB *db, const char *path);
+
+/* Secondary indexes. */
+int tdb_index_open(TDB *db, const char *path, size_t size,
+		   unsigned long (*key)(void *data));
+void tdb_index_close(TDB *db);
+void tdb_index_add(TDB *db, TdbRec *rec);
+int tdb_index_iter(TDB *db, TdbCursor *c, unsigned int n, unsigned long skey,
+		   int (*fn)(TdbRec *, void *), void *data);
+int tdb_index_get(TDB *db, unsigned long skey, int (*fn)(TdbRec *, void *),
+		  void *data);
 
 static inline TDB *
 tdb_get(TDB *db)
@@ -229,4 +298,16 @@ tdb_next_rec_chunk(TDB *db, TdbVRec *r)
 	return TDB_PTR(db->hdr, TDB_DI2O(r->chunk_next));
 }
 
+/**
+ * Start iteration over records with keys having @pfx_bits least significant
+ * bits equal to those of @pfx. Zero @pfx_bits means all the records.
+ */
+static inline void
+tdb_cursor_init(TdbCursor *c, unsigned long pfx, unsigned int pfx_bits)
+{
+	memset(c, 0, sizeof(*c));
+	c->pfx = pfx;
+	c->pfx_bits = pfx_bits;
+}
+
 #endif /* __TDB_H__ */
@@ -22,6 +22,8 @@
 #ifndef __TDB_IF_H__
 #define __TDB_IF_H__
 
+#include <linux/ioctl.h>
+
 #include "extent.h"
 
 #ifndef NETLINK_TEMPESTA
@@ -44,6 +46,9 @@ enum tdb_msg_type {
 	TDB_MSG_CLOSE,
 	TDB_MSG_INSERT,
 	TDB_MSG_SELECT,
+	TDB_MSG_SCAN,
+	TDB_MSG_SNAPSHOT,
+	TDB_MSG_INDEX,
 	__TDB_MSG_TYPE_MAX
 };
 
@@ -62,6 +67,85 @@ typedef struct {
 	char		path[0];
 } TdbCrTblRec;
 
+/* Maximum number of levels in the table index. */
+#define TDB_CURSOR_DEPTH	16
+
+/**
+ * Resumable position of a bounded iteration over a table. Zeroed cursor
+ * starts the iteration from the beginning of the table. The cursor is
+ * passed between the kernel and user space for paging through tables.
+ *
+ * @idx		- index of the current branch at each level of the index;
+ * @depth	- index level of the current bucket;
+ * @rec		- number of already visited records of the current bucket;
+ * @pfx_bits	- the iteration visits only records with keys having
+ *		  @pfx_bits least significant bits equal to those of @pfx;
+ * @end		- the whole table is visited;
+ * @pfx		- key prefix;
+ */
+typedef struct {
+	unsigned char	idx[TDB_CURSOR_DEPTH];
+	int		depth;
+	unsigned int	rec;
+	unsigned int	pfx_bits;
+	unsigned int	end;
+	unsigned long	pfx;
+} TdbCursor;
+
+#define TDB_MAP_DEV		"/dev/tempesta_db"
+/* Bumped on any change of the table memory layout. */
+#define TDB_MAP_VERSION		1
+
+/**
+ * Memory layout of a table for read-only mmap() of the table through
+ * TDB_MAP_DEV. User space sets @tbl_name and TDB_IOC_MAP binds the opened
+ * device to the table and fills the rest of the descriptor. All the offsets
+ * are relative to the mapping start.
+ *
+ * An index node is an array of @node_sz / 4 unsigned int offsets of
+ * descendants: an offset with the most significant bit set is an offset of
+ * a bucket in @bckt_sz units, otherwise it's an offset of an index node in
+ * @node_sz units. Zero offset means no descendant. A bucket header of
+ * @bckt_hdr bytes is followed by records placed within @bckt_sz bytes,
+ * only the first record can be larger. The unsigned int at @bckt_next is
+ * the next bucket in the collision chain in @bckt_sz units.
+ *
+ * Fixed-size records are the unsigned long key followed by @rec_len bytes
+ * of data, a record is free if all its bytes are zero. Variable-size records
+ * are the key, unsigned int offset of the next chunk in @bckt_sz units and
+ * unsigned int length of data in the chunk with the most significant bit
+ * set for freed records. All the records are 8-byte aligned.
+ *
+ * Records are modified concurrently with readers, so a reader must read a
+ * bucket and all its records when the unsigned long at @bckt_seq is even and
+ * retry if it changes meanwhile, and check all the offsets against @size.
+ *
+ * @version	- TDB_MAP_VERSION;
+ * @rec_len	- length of fixed-size records or zero for variable-size ones;
+ * @node_sz	- size of an index node;
+ * @bckt_sz	- size of a bucket;
+ * @bckt_hdr	- size of a bucket header;
+ * @bckt_next	- offset of the next bucket in a bucket header;
+ * @bckt_seq	- offset of the sequence counter in a bucket header;
+ * @root	- offset of the root index node;
+ * @size	- size of the mapping;
+ * @tbl_name	- the table name;
+ */
+typedef struct {
+	unsigned int	version;
+	unsigned int	rec_len;
+	unsigned int	node_sz;
+	unsigned int	bckt_sz;
+	unsigned int	bckt_hdr;
+	unsigned int	bckt_next;
+	unsigned int	bckt_seq;
+	unsigned long	root;
+	unsigned long	size;
+	char		tbl_name[TDB_TBLNAME_LEN + 1];
+} TdbMapInfo;
+
+#define TDB_IOC_MAP		_IOWR('T', 1, TdbMapInfo)
+
 /**
  * Record specification used for update and select queries.
  *
@@ -63,6 +63,15 @@ TdbHndl::LastOpStatus::update(const TdbMsg *m) noexcept
 	case TDB_MSG_SELECT:
 		op = "SELECT";
 		break;
+	case TDB_MSG_SCAN:
+		op = "SCAN";
+		break;
+	case TDB_MSG_SNAPSHOT:
+		op = "SNAPSHOT";
+		break;
+	case TDB_MSG_INDEX:
+		op = "INDEX";
+		break;
 	default:
 		op = "[unspecified]";
 	}
@@ -101,7 +110,7 @@ TdbHndl::lazy_buffer_alloc()
 }
 
 void
-TdbHndl::msg_recv(std::function<bool (nlmsghdr *)> msg_cb)
+TdbHndl::wait_msg()
 {
 	// Call poll(2) just for internal netlink mmap flow control.
 	pollfd pfds[1];
@@ -109,17 +118,26 @@ TdbHndl::msg_recv(std::function<bool (nlmsghdr *)> msg_cb)
 		pfds[0].fd	= fd_;
 		pfds[0].events	= POLLIN | POLLERR;
 		pfds[0].revents	= 0;
-		if ((poll(pfds, 1, -1) < 0 && errno != -EINTR)
+		if ((::poll(pfds, 1, -1) < 0 && errno != -EINTR)
 		    || pfds[0].revents & POLLERR)
 			throw TdbExcept("poll failure");
 	} while (!(pfds[0].revents & POLLIN));
+}
 
+void
+TdbHndl::msg_recv(std::function<bool (nlmsghdr *)> msg_cb)
+{
 	for (bool read_more = true; read_more; ) {
 		nlmsghdr *nlh;
 
 		// Get next frame header.
 		nl_mmap_hdr *hdr = (nl_mmap_hdr *)(rx_ring_ + rx_fr_off_);
 
+		// The kernel continues multi-frame responses, e.g. for
+		// batched queries, when we poll for them.
+		if (hdr->nm_status == NL_MMAP_STATUS_UNUSED)
+			wait_msg();
+
 		if (hdr->nm_status == NL_MMAP_STATUS_VALID) {
 			last_status_.set_copying(false);
 			// Regular memory mapped frame.
@@ -153,21 +171,83 @@ TdbHndl::msg_recv(std::function<bool (nlmsghdr *)> msg_cb)
 	}
 }
 
+/**
+ * Make the kernel process all the valid frames in the TX ring.
+ */
 void
-TdbHndl::send_to_kernel()
+TdbHndl::kick_kernel()
 {
 	sockaddr_nl addr = {
 		.nl_family	= AF_NETLINK,
 	};
 	if (sendto(fd_, NULL, 0, 0, (const sockaddr *)&addr, sizeof(addr)) < 0)
 		throw TdbExcept("cannot send msg to kernel");
+}
+
+void
+TdbHndl::send_to_kernel()
+{
+	kick_kernel();
 
 	advance_frame_offset(tx_fr_off_);
 }
 
+/**
+ * Read the status of the oldest asynchronous transaction frame to the
+ * completion queue.
+ * @return false if @wait is false and the status isn't received yet.
+ */
+bool
+TdbHndl::async_recv(bool wait)
+{
+	nl_mmap_hdr *hdr = (nl_mmap_hdr *)(rx_ring_ + rx_fr_off_);
+
+	if (!wait && hdr->nm_status == NL_MMAP_STATUS_UNUSED)
+		return false;
+
+	msg_recv([this](nlmsghdr *nlh) -> bool {
+		// The message is rejected by the kernel.
+		if (nlh->nlmsg_type == NLMSG_ERROR) {
+			done_.push_back({nlh->nlmsg_seq, false, 0});
+			return false;
+		}
+		if (nlh->nlmsg_len < sizeof(*nlh) + sizeof(TdbMsg))
+			throw TdbExcept("bad transaction status msg");
+
+		TdbMsg *m = (TdbMsg *)NLMSG_DATA(nlh);
+		if ((m->type & TDB_NLF_TYPE_MASK) != TDB_MSG_INSERT)
+			throw TdbExcept("malformed transaction status type=%u",
+					m->type);
+
+		done_.push_back({nlh->nlmsg_seq,
+				 !!(m->type & TDB_NLF_RESP_OK), m->rec_n});
+		last_status_.update(m);
+
+		return false;
+	});
+	--inflight_;
+
+	return true;
+}
+
+/**
+ * Read the statuses of all the asynchronous transaction frames to the
+ * completion queue, so that the response to a synchronous operation is
+ * the next message in the RX ring.
+ */
+void
+TdbHndl::async_drain()
+{
+	flush();
+	while (inflight_)
+		async_recv(true);
+}
+
 void
 TdbHndl::msg_send(std::function<void (nlmsghdr *)> msg_build_cb)
 {
+	async_drain();
+
 	nl_mmap_hdr *hdr = (nl_mmap_hdr *)(tx_ring_ + tx_fr_off_);
 	if (hdr->nm_status != NL_MMAP_STATUS_UNUSED)
 		throw TdbExcept("no tx frame available");
@@ -206,13 +286,50 @@ TdbHndl::alloc_trx_frame() noexcept
 	memset(trx_.tdb_hdr, 0, sizeof(TdbMsg));
 }
 
+/**
+ * Start a transaction. Records of a transaction are sent to the kernel by
+ * messages as large as fit one netlink frame.
+ *
+ * Commit of an asynchronous (@async) transaction only submits its frames,
+ * which are sent to the kernel by flush() or poll() along with the other
+ * submitted frames, so many transactions are pipelined through the netlink
+ * rings without waiting for the kernel. The frames statuses are returned
+ * by poll() with the frames sequence numbers.
+ */
 void
-TdbHndl::trx_begin()
+TdbHndl::trx_begin(bool async)
 {
 	if (trx_)
 		throw TdbExcept("nested trx!");
 
+	// Each frame in flight holds an RX frame for its response.
+	if (async && inflight_ == ring_sz_ / NL_FR_SZ) {
+		flush();
+		async_recv(true);
+	}
+
 	alloc_trx_frame();
+	trx_.async = async;
+}
+
+/**
+ * Finish the current asynchronous transaction frame and queue it for
+ * sending to the kernel.
+ */
+void
+TdbHndl::trx_submit()
+{
+	trx_.msg_hdr->nlmsg_len = sizeof(*trx_.msg_hdr) + sizeof(*trx_.tdb_hdr)
+				  + trx_.off;
+	trx_.msg_hdr->nlmsg_seq = ++seq_;
+	trx_.fr_hdr->nm_len = trx_.msg_hdr->nlmsg_len;
+	trx_.fr_hdr->nm_status = NL_MMAP_STATUS_VALID;
+
+	advance_frame_offset(tx_fr_off_);
+	++queued_;
+	++inflight_;
+
+	trx_.init();
 }
 
 /**
@@ -221,6 +338,14 @@ TdbHndl::trx_begin()
 void
 TdbHndl::trx_commit()
 {
+	if (trx_.async) {
+		trx_submit();
+		return;
+	}
+
+	// The frame must follow the asynchronous frames in the TX ring.
+	async_drain();
+
 	trx_.msg_hdr->nlmsg_len = sizeof(*trx_.msg_hdr) + sizeof(*trx_.tdb_hdr)
 				  + trx_.off;
 	trx_.fr_hdr->nm_len = trx_.msg_hdr->nlmsg_len;
@@ -245,6 +370,48 @@ TdbHndl::trx_commit()
 	});
 }
 
+/**
+ * Send all the submitted asynchronous transaction frames to the kernel by
+ * one system call.
+ */
+void
+TdbHndl::flush()
+{
+	if (!queued_)
+		return;
+
+	kick_kernel();
+	queued_ = 0;
+}
+
+/**
+ * Send the submitted frames and pass the statuses of the processed
+ * asynchronous transaction frames to @done_cb in the submission order.
+ * If @wait is true, then wait for at least one status if there are frames
+ * in flight.
+ * @return the number of the reported statuses.
+ */
+size_t
+TdbHndl::poll(std::function<void (const Completion &)> done_cb, bool wait)
+{
+	size_t n = 0;
+
+	flush();
+	if (wait && done_.empty() && inflight_)
+		async_recv(true);
+	while (inflight_ && async_recv(false))
+		;
+
+	for ( ; !done_.empty(); ++n) {
+		Completion c = done_.front();
+
+		done_.pop_front();
+		done_cb(c);
+	}
+
+	return n;
+}
+
 void
 TdbHndl::get_info(std::function<void (char *)> data_cb)
 {
@@ -387,15 +554,16 @@ TdbHndl::insert(std::string &tbl_name, size_t klen, size_t vlen,
 	if (!in_trx)
 		trx_begin();
 
-	if (trx_.off + sizeof(nlmsghdr) + sizeof(TdbMsgRec) + klen + vlen
-	    > NL_FR_SZ)
-	{
-		// Not enough space in current frame, allocate a new one.
-		advance_frame_offset(tx_fr_off_);
-		alloc_trx_frame();
-	}
 	if (klen + vlen + HDRS_LEN > NL_FR_SZ)
 		throw TdbExcept("too large data for one insertion");
+	if (trx_.off + sizeof(nlmsghdr) + HDRS_LEN + klen + vlen > NL_FR_SZ) {
+		// Not enough space in current frame: send the frame as one
+		// batch and continue the transaction in a new frame.
+		bool async = trx_.async;
+
+		trx_commit();
+		trx_begin(async);
+	}
 
 	if (!trx_.tdb_hdr->type || !trx_.tdb_hdr->t_name[0]) {
 		// New transaction.
@@ -421,30 +589,69 @@ void
 TdbHndl::query(std::string &tbl_name, std::string &key,
 	       std::function<void (char *, size_t, char *, size_t)> process_cb)
 {
+	query_batch(tbl_name, std::vector<std::string>(1, key), process_cb);
+}
+
+/**
+ * Select records for all the @keys. As many keys as fit a frame are sent to
+ * the kernel in one message and the kernel looks them up by batches, so
+ * the lookups hide memory latency of each other.
+ */
+void
+TdbHndl::query_batch(std::string &tbl_name,
+		     const std::vector<std::string> &keys,
+		     std::function<void (char *, size_t, char *, size_t)>
+			process_cb)
+{
+	static const size_t HDRS_LEN = NL_MMAP_HDRLEN + sizeof(nlmsghdr)
+				       + sizeof(TdbMsg);
+
 	if (trx_)
 		throw TdbExcept("cannot run the action inside transaction");
 
 	if (tbl_name.length() > TDB_TBLNAME_LEN)
 		throw TdbExcept("too long table name");
 
-	msg_send([&tbl_name, &key](nlmsghdr *nlh) {
-		TdbMsg *m = (TdbMsg *)NLMSG_DATA(nlh);
-		m->type = TDB_MSG_SELECT;
-		m->rec_n = 1;
-		tbl_name.copy(m->t_name, tbl_name.length());
-		m->t_name[tbl_name.length()] = 0;
+	for (size_t k = 0; k < keys.size(); ) {
+		msg_send([&tbl_name, &keys, &k](nlmsghdr *nlh) {
+			TdbMsg *m = (TdbMsg *)NLMSG_DATA(nlh);
+			m->type = TDB_MSG_SELECT;
+			m->rec_n = 0;
+			tbl_name.copy(m->t_name, tbl_name.length());
+			m->t_name[tbl_name.length()] = 0;
+
+			size_t off = 0;
+			for ( ; k < keys.size(); ++k) {
+				size_t len = sizeof(TdbMsgRec)
+					     + keys[k].length();
+				if (HDRS_LEN + off + len > NL_FR_SZ)
+					break;
+
+				TdbMsgRec *r = (TdbMsgRec *)
+					       ((char *)m->recs + off);
+				r->klen = keys[k].length();
+				r->dlen = 0;
+				keys[k].copy(r->data, r->klen);
+
+				off += len;
+				++m->rec_n;
+			}
+			if (!m->rec_n)
+				throw TdbExcept("too long key for query");
 
-		m->recs[0].klen = key.length();
-		m->recs[0].dlen = 0;
-		key.copy(m->recs[0].data, m->recs[0].klen);
+			nlh->nlmsg_len = sizeof(*nlh) + sizeof(*m) + off;
+			nlh->nlmsg_type = NLMSG_MIN_TYPE + 1;
+			nlh->nlmsg_flags |= NLM_F_REQUEST;
+		});
 
-		nlh->nlmsg_len = sizeof(*nlh) + sizeof(*m) + sizeof(TdbMsgRec)
-				 + m->recs[0].klen;
-		nlh->nlmsg_type = NLMSG_MIN_TYPE + 1;
-		nlh->nlmsg_flags |= NLM_F_REQUEST;
-	});
+		read_query_results(process_cb);
+	}
+}
 
-	// Read results.
+void
+TdbHndl::read_query_results(std::function<void (char *, size_t, char *,
+						size_t)> &process_cb)
+{
 	msg_recv([this, &process_cb](nlmsghdr *nlh) -> bool {
 		if (nlh->nlmsg_len < sizeof(*nlh) + sizeof(TdbMsg))
 			throw TdbExcept("bad info msg len %u", nlh->nlmsg_len);
@@ -473,6 +680,160 @@ TdbHndl::query(std::string &tbl_name, std::string &key,
 
 }
 
+/**
+ * Send scan message of @type with @cursor and optional @key and read
+ * the returned page of records.
+ */
+bool
+TdbHndl::scan_msg(unsigned int type, std::string &tbl_name,
+		  const std::string *key, TdbCursor &cursor,
+		  std::function<void (char *, size_t, char *, size_t)>
+			&process_cb)
+{
+	if (trx_)
+		throw TdbExcept("cannot run the action inside transaction");
+
+	if (tbl_name.length() > TDB_TBLNAME_LEN)
+		throw TdbExcept("too long table name");
+	if (key && (key->empty()
+		    || NL_MMAP_HDRLEN + sizeof(nlmsghdr) + sizeof(TdbMsg)
+		       + 2 * sizeof(TdbMsgRec) + sizeof(cursor)
+		       + key->length() > NL_FR_SZ))
+		throw TdbExcept("bad key length");
+
+	msg_send([type, &tbl_name, key, &cursor](nlmsghdr *nlh) {
+		TdbMsg *m = (TdbMsg *)NLMSG_DATA(nlh);
+		m->type = type;
+		m->rec_n = 1;
+		tbl_name.copy(m->t_name, tbl_name.length());
+		m->t_name[tbl_name.length()] = 0;
+
+		m->recs[0].klen = 0;
+		m->recs[0].dlen = sizeof(cursor);
+		memcpy(m->recs[0].data, &cursor, sizeof(cursor));
+		unsigned int len = TDB_MSGREC_LEN(&m->recs[0]);
+
+		if (key) {
+			TdbMsgRec *r = (TdbMsgRec *)((char *)m->recs + len);
+			r->klen = key->length();
+			r->dlen = 0;
+			key->copy(r->data, key->length());
+			len += TDB_MSGREC_LEN(r);
+			m->rec_n = 2;
+		}
+
+		nlh->nlmsg_len = sizeof(*nlh) + sizeof(*m) + len;
+		nlh->nlmsg_type = NLMSG_MIN_TYPE + 1;
+		nlh->nlmsg_flags |= NLM_F_REQUEST;
+	});
+
+	msg_recv([this, type, &cursor, &process_cb](nlmsghdr *nlh) -> bool {
+		if (nlh->nlmsg_len < sizeof(*nlh) + sizeof(TdbMsg)
+				     + sizeof(TdbMsgRec) + sizeof(cursor))
+			throw TdbExcept("bad scan msg len %u", nlh->nlmsg_len);
+
+		TdbMsg *m = (TdbMsg *)NLMSG_DATA(nlh);
+		if ((m->type & TDB_NLF_TYPE_MASK) != type)
+			throw TdbExcept("malformed scan results type=%u",
+					m->type);
+		if (!(m->type & TDB_NLF_RESP_OK) || !m->rec_n)
+			throw TdbExcept("cannot scan table, see dmesg");
+		if (m->recs[0].dlen != sizeof(cursor))
+			throw TdbExcept("malformed scan cursor");
+
+		memcpy(&cursor, m->recs[0].data, sizeof(cursor));
+
+		unsigned int off = TDB_MSGREC_LEN(&m->recs[0]);
+		for (unsigned int i = 1; i < m->rec_n; ++i) {
+			TdbMsgRec *r = (TdbMsgRec *)((char *)m->recs + off);
+			process_cb(r->data, r->klen,
+				   TDB_MSGREC_DATA(r), r->dlen);
+			off += TDB_MSGREC_LEN(r);
+		}
+
+		last_status_.update(m);
+
+		return false;
+	});
+
+	return !cursor.end;
+}
+
+/**
+ * Read the next page of table records starting from @cursor, which is
+ * updated to read the following page.
+ * @return false if the whole table is read.
+ */
+bool
+TdbHndl::scan(std::string &tbl_name, TdbCursor &cursor,
+	      std::function<void (char *, size_t, char *, size_t)> process_cb)
+{
+	return scan_msg(TDB_MSG_SCAN, tbl_name, NULL, cursor, process_cb);
+}
+
+/**
+ * Read the next page of the table records with secondary key @key looked up
+ * by the table secondary index. The table must be indexed by the kernel
+ * module using it, see tdb_index_open(). @cursor is used as for scan().
+ * @return false if all the records are read.
+ */
+bool
+TdbHndl::index_scan(std::string &tbl_name, const std::string &key,
+		    TdbCursor &cursor,
+		    std::function<void (char *, size_t, char *, size_t)>
+			process_cb)
+{
+	return scan_msg(TDB_MSG_INDEX, tbl_name, &key, cursor, process_cb);
+}
+
+/**
+ * Start writing snapshot of the table to file @path. The kernel writes
+ * the snapshot in background and reports the result to the kernel log.
+ */
+void
+TdbHndl::snapshot(std::string &tbl_name, const std::string &path)
+{
+	if (trx_)
+		throw TdbExcept("cannot run the action inside transaction");
+
+	if (tbl_name.length() > TDB_TBLNAME_LEN)
+		throw TdbExcept("too long table name");
+	if (path.empty() || path[0] != '/' || path.length() >= TDB_PATH_LEN)
+		throw TdbExcept("please specify absolute snapshot path shorter"
+				" than %u bytes", TDB_PATH_LEN);
+
+	msg_send([&tbl_name, &path](nlmsghdr *nlh) {
+		TdbMsg *m = (TdbMsg *)NLMSG_DATA(nlh);
+		memset(m, 0, sizeof(*m));
+		m->type = TDB_MSG_SNAPSHOT;
+		m->rec_n = 1;
+		tbl_name.copy(m->t_name, TDB_TBLNAME_LEN);
+		m->t_name[tbl_name.length()] = 0;
+
+		m->recs[0].klen = 0;
+		m->recs[0].dlen = path.length() + 1;
+		memcpy(m->recs[0].data, path.c_str(), path.length() + 1);
+
+		nlh->nlmsg_len = sizeof(*nlh) + sizeof(*m)
+				 + TDB_MSGREC_LEN(&m->recs[0]);
+		nlh->nlmsg_type = NLMSG_MIN_TYPE + 1;
+		nlh->nlmsg_flags |= NLM_F_REQUEST;
+	});
+
+	msg_recv([=](nlmsghdr *nlh) -> bool {
+		if (nlh->nlmsg_len < sizeof(*nlh) + sizeof(TdbMsg))
+			throw TdbExcept("bad snapshot status msg");
+
+		TdbMsg *m = (TdbMsg *)NLMSG_DATA(nlh);
+		if (m->type != (TDB_MSG_SNAPSHOT | TDB_NLF_RESP_OK))
+			throw TdbExcept("cannot start snapshot, see dmesg");
+
+		last_status_.update(m);
+
+		return false;
+	});
+}
+
 std::string
 TdbHndl::last_status() noexcept
 {
@@ -487,7 +848,10 @@ TdbHndl::TdbHndl(size_t mm_sz)
 	: ring_sz_(mm_sz / 2),
 	rx_fr_off_(0),
 	tx_fr_off_(0),
-	buf_(NULL)
+	buf_(NULL),
+	seq_(0),
+	queued_(0),
+	inflight_(0)
 {
 	fd_ = socket(AF_NETLINK, SOCK_DGRAM, NETLINK_TEMPESTA);
 	if (fd_ < 0)
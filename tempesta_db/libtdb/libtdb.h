@@ -22,8 +22,10 @@
 
 #include <linux/netlink.h>
 
+#include <deque>
 #include <functional>
 #include <iostream>
+#include <vector>
 
 #include <tdb_if.h>
 #include "exception.h"
@@ -32,12 +34,20 @@ class TdbHndl {
 public:
 	static const size_t MMSZ;
 
+	// Status of an asynchronously submitted transaction frame.
+	struct Completion {
+		unsigned int	seq;
+		bool		ok;
+		size_t		rec_n;
+	};
+
 private:
 	// Transaction handling helper.
 	struct Trx {
 		void init() noexcept
 		{
 			off = 0;
+			async = false;
 			fr_hdr = nullptr;
 			msg_hdr = nullptr;
 			tdb_hdr = nullptr;
@@ -54,6 +64,7 @@ private:
 		}
 
 		size_t		off;
+		bool		async;
 		nl_mmap_hdr	*fr_hdr;
 		nlmsghdr	*msg_hdr;
 		TdbMsg		*tdb_hdr;
@@ -85,9 +96,17 @@ public:
 	TdbHndl(size_t mm_sz);
 	~TdbHndl() noexcept;
 
-	void trx_begin();
+	void trx_begin(bool async = false);
 	void trx_commit();
 
+	void flush();
+	size_t poll(std::function<void (const Completion &)> done_cb,
+		    bool wait);
+	size_t inflight() const noexcept
+	{
+		return inflight_ + done_.size();
+	}
+
 	void get_info(std::function<void (char *)> data_cb);
 	void open_table(std::string &db_path, std::string &tbl_name,
 			size_t pages, unsigned int rec_size);
@@ -97,6 +116,18 @@ public:
 	void query(std::string &tbl_name, std::string &key,
 		   std::function<void (char *, size_t, char *, size_t)>
 			process_cb);
+	void query_batch(std::string &tbl_name,
+			 const std::vector<std::string> &keys,
+			 std::function<void (char *, size_t, char *, size_t)>
+				process_cb);
+	bool scan(std::string &tbl_name, TdbCursor &cursor,
+		  std::function<void (char *, size_t, char *, size_t)>
+			process_cb);
+	bool index_scan(std::string &tbl_name, const std::string &key,
+			TdbCursor &cursor,
+			std::function<void (char *, size_t, char *, size_t)>
+				process_cb);
+	void snapshot(std::string &tbl_name, const std::string &path);
 
 	std::string last_status() noexcept;
 
@@ -104,9 +135,20 @@ private:
 	void advance_frame_offset(unsigned int &off) noexcept;
 	void lazy_buffer_alloc();
 	void alloc_trx_frame() noexcept;
+	void trx_submit();
+	void kick_kernel();
 	void send_to_kernel();
+	void wait_msg();
+	bool async_recv(bool wait);
+	void async_drain();
 
 	void msg_recv(std::function<bool (nlmsghdr *)> msg_cb);
+	bool scan_msg(unsigned int type, std::string &tbl_name,
+		      const std::string *key, TdbCursor &cursor,
+		      std::function<void (char *, size_t, char *, size_t)>
+			&process_cb);
+	void read_query_results(std::function<void (char *, size_t, char *,
+						    size_t)> &process_cb);
 	void msg_send(std::function<void (nlmsghdr *)> msg_build_cb);
 
 private:
@@ -117,6 +159,54 @@ private:
 	char *buf_;
 	Trx trx_;
 	LastOpStatus last_status_;
+	// Asynchronous transactions: the last sequence number, the number of
+	// frames submitted and not sent to the kernel yet, the number of
+	// frames with unread responses and the read, but not polled, ones.
+	unsigned int seq_;
+	unsigned int queued_;
+	unsigned int inflight_;
+	std::deque<Completion> done_;
+};
+
+/**
+ * Read-only mapping of a table. The table is walked directly in memory
+ * without syscalls, so this is the fastest way to export large tables.
+ * The records are read concurrently with their modifications, so each
+ * bucket is read again if it changes meanwhile and is skipped if it
+ * changes too frequently.
+ */
+class TdbMap {
+public:
+	static const unsigned int RETRIES;
+
+	TdbMap(const std::string &tbl_name);
+	~TdbMap() noexcept;
+
+	size_t walk(std::function<void (unsigned long, const char *, size_t)>
+			process_cb);
+	size_t skipped() const noexcept
+	{
+		return skipped_;
+	}
+
+private:
+	template<class T> T load(unsigned long off) const noexcept;
+	bool valid(unsigned long off, size_t len) const noexcept;
+	unsigned long rec_size(unsigned long off) const noexcept;
+	bool read_rec(unsigned long off);
+	bool read_bucket(unsigned long off, unsigned long &next);
+	void walk_chain(unsigned long off);
+	void walk_node(unsigned long off, int depth);
+
+private:
+	int fd_;
+	char *addr_;
+	TdbMapInfo mi_;
+	size_t skipped_;
+	size_t rec_n_;
+	std::function<void (unsigned long, const char *, size_t)> cb_;
+	// Records of the current bucket read before the bucket validation.
+	std::vector<std::pair<unsigned long, std::string>> recs_;
 };
 
 #endif // __LIBTDB_H__
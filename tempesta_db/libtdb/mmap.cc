@@ -0,0 +1,262 @@
+/**
+ *		Tempesta DB User-space Library
+ *
+ * Read-only mapping of tables.
+ *
+ * Copyright (C) 2020 Tempesta Technologies, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "libtdb.h"
+
+// Offset flag of buckets in index nodes and freed variable-size records flag.
+static const unsigned int DBIT = 1U << 31;
+// Sizes of fixed-size and variable-size records headers.
+static const unsigned long FREC_HDR = sizeof(unsigned long);
+static const unsigned long VREC_HDR = sizeof(unsigned long)
+				      + 2 * sizeof(unsigned int);
+// Offsets of the next chunk and the chunk length in variable-size records.
+static const unsigned long VREC_NEXT = sizeof(unsigned long);
+static const unsigned long VREC_LEN = VREC_NEXT + sizeof(unsigned int);
+
+const unsigned int TdbMap::RETRIES = 16;
+
+static inline unsigned long
+rec_align(unsigned long n)
+{
+	return (n + 7) & ~7UL;
+}
+
+TdbMap::TdbMap(const std::string &tbl_name)
+	: fd_(-1), addr_(nullptr), skipped_(0), rec_n_(0)
+{
+	if (tbl_name.length() > TDB_TBLNAME_LEN)
+		throw TdbExcept("too long table name");
+
+	memset(&mi_, 0, sizeof(mi_));
+	tbl_name.copy(mi_.tbl_name, tbl_name.length());
+
+	fd_ = open(TDB_MAP_DEV, O_RDONLY);
+	if (fd_ < 0)
+		throw TdbExcept("cannot open %s", TDB_MAP_DEV);
+
+	if (ioctl(fd_, TDB_IOC_MAP, &mi_)) {
+		close(fd_);
+		throw TdbExcept("cannot find table %s", tbl_name.c_str());
+	}
+	if (mi_.version != TDB_MAP_VERSION) {
+		close(fd_);
+		throw TdbExcept("table layout version %u, expected %u",
+				mi_.version, TDB_MAP_VERSION);
+	}
+
+	addr_ = (char *)mmap(NULL, mi_.size, PROT_READ, MAP_SHARED, fd_, 0);
+	if (addr_ == MAP_FAILED) {
+		close(fd_);
+		throw TdbExcept("cannot map table %s", tbl_name.c_str());
+	}
+}
+
+TdbMap::~TdbMap() noexcept
+{
+	munmap(addr_, mi_.size);
+	close(fd_);
+}
+
+template<class T> T
+TdbMap::load(unsigned long off) const noexcept
+{
+	return __atomic_load_n((T *)(addr_ + off), __ATOMIC_RELAXED);
+}
+
+bool
+TdbMap::valid(unsigned long off, size_t len) const noexcept
+{
+	return off + len >= off && off + len <= mi_.size;
+}
+
+/**
+ * @return the aligned size of the record at @off in its bucket.
+ */
+unsigned long
+TdbMap::rec_size(unsigned long off) const noexcept
+{
+	if (mi_.rec_len)
+		return rec_align(FREC_HDR + mi_.rec_len);
+	return rec_align(VREC_HDR
+			 + (load<unsigned int>(off + VREC_LEN) & ~DBIT));
+}
+
+/**
+ * Copy the record at @off with all its chunks to @recs_ if it's alive.
+ * @return false if the record is inconsistent.
+ */
+bool
+TdbMap::read_rec(unsigned long off)
+{
+	std::string data;
+	unsigned long key = load<unsigned long>(off);
+
+	if (mi_.rec_len) {
+		unsigned long rlen = rec_align(FREC_HDR + mi_.rec_len);
+		bool live = false;
+
+		for (unsigned long i = 0; i < rlen; i += sizeof(long))
+			live |= !!load<unsigned long>(off + i);
+		if (live) {
+			data.assign(addr_ + off + FREC_HDR, mi_.rec_len);
+			recs_.emplace_back(key, std::move(data));
+		}
+		return true;
+	}
+
+	unsigned int len = load<unsigned int>(off + VREC_LEN);
+	if (!len || (len & DBIT))
+		return true;
+
+	// The chunks are in different blocks, so the chain is finite.
+	for (size_t n = 0; n < mi_.size / mi_.bckt_sz; ++n) {
+		len &= ~DBIT;
+		if (!valid(off + VREC_HDR, len) || data.length() + len
+						   > mi_.size)
+			return false;
+		data.append(addr_ + off + VREC_HDR, len);
+
+		unsigned int next = load<unsigned int>(off + VREC_NEXT);
+		if (!next) {
+			recs_.emplace_back(key, std::move(data));
+			return true;
+		}
+		off = (unsigned long)next * mi_.bckt_sz;
+		if (!valid(off, VREC_HDR))
+			return false;
+		len = load<unsigned int>(off + VREC_LEN);
+	}
+
+	return false;
+}
+
+/**
+ * Read the records of the bucket at @off to @recs_ the same way as the
+ * kernel does, see TDB_HTRIE_FOREACH_REC(), and return the next bucket of
+ * the collision chain in @next. The bucket is read again if it's being
+ * modified or was modified meanwhile.
+ *
+ * @return false if the bucket can't be read consistently.
+ */
+bool
+TdbMap::read_bucket(unsigned long off, unsigned long &next)
+{
+	unsigned long hdr = mi_.rec_len ? FREC_HDR : VREC_HDR;
+
+	for (unsigned int i = 0; i < RETRIES; ++i) {
+		unsigned long r, rlen, first = off + mi_.bckt_hdr;
+		unsigned long seq = __atomic_load_n((unsigned long *)(addr_
+						    + off + mi_.bckt_seq),
+						    __ATOMIC_ACQUIRE);
+		bool ok = true;
+
+		if (seq & 1) {
+			sched_yield();
+			continue;
+		}
+
+		recs_.clear();
+		r = first;
+		do {
+			rlen = rec_size(r);
+			if (r + rlen - off > mi_.bckt_sz && r != first)
+				break;
+			if (!valid(r, rlen) || !read_rec(r)) {
+				ok = false;
+				break;
+			}
+			r += rlen;
+		} while (r + hdr - off <= mi_.bckt_sz);
+		next = (unsigned long)load<unsigned int>(off + mi_.bckt_next)
+		       * mi_.bckt_sz;
+
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (ok && load<unsigned long>(off + mi_.bckt_seq) == seq)
+			return true;
+	}
+
+	return false;
+}
+
+void
+TdbMap::walk_chain(unsigned long off)
+{
+	unsigned long next;
+
+	for (size_t n = 0; n < mi_.size / mi_.bckt_sz; ++n) {
+		if (!valid(off, mi_.bckt_sz) || !read_bucket(off, next)) {
+			// The rest of the chain is unreachable.
+			++skipped_;
+			return;
+		}
+		for (auto &r : recs_)
+			cb_(r.first, r.second.data(), r.second.length());
+		rec_n_ += recs_.size();
+		if (!next)
+			return;
+		off = next;
+	}
+}
+
+void
+TdbMap::walk_node(unsigned long off, int depth)
+{
+	if (depth >= TDB_CURSOR_DEPTH || !valid(off, mi_.node_sz)) {
+		++skipped_;
+		return;
+	}
+
+	for (unsigned int i = 0; i < mi_.node_sz; i += sizeof(int)) {
+		unsigned int o = load<unsigned int>(off + i);
+
+		if (!o)
+			continue;
+		if (o & DBIT)
+			walk_chain((unsigned long)(o ^ DBIT) * mi_.bckt_sz);
+		else
+			walk_node((unsigned long)o * mi_.node_sz, depth + 1);
+	}
+}
+
+/**
+ * Call @process_cb for each live record of the table with the record key,
+ * data and data length.
+ *
+ * @return number of the visited records. Buckets which couldn't be read
+ * consistently are counted by skipped().
+ */
+size_t
+TdbMap::walk(std::function<void (unsigned long, const char *, size_t)>
+		process_cb)
+{
+	cb_ = process_cb;
+	skipped_ = rec_n_ = 0;
+
+	walk_node(mi_.root, 0);
+
+	return rec_n_;
+}
@@ -0,0 +1,657 @@
+/**
+ * Multi-threaded benchmark for Tempesta DB HTrie storage.
+ *
+ * Worker threads run a mix of insertions, lookups, extensions and removals
+ * on keys drawn from uniform or Zipfian distribution. Latency of each
+ * operation is accounted in log-linear histograms, so the percentiles are
+ * precise up to 1/16 of a power of two. Memory usage per record is reported
+ * in the end of the run.
+ *
+ * ktest has no RCU grace periods, so the quarantined blocks are reclaimed
+ * only after the workers finish.
+ *
+ * Copyright (C) 2020 Tempesta Technologies, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#define _GNU_SOURCE
+#include <getopt.h>
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ktest.h"
+
+/* Include HTrie for test. */
+#include "../core/htrie.c"
+
+/* Snapshots are written by a kernel thread, nobody starts them here. */
+void
+__tdb_snap_cow(TdbSnap *s, TdbHdr *dbh, void *p, size_t len)
+{
+	BUG();
+}
+
+enum {
+	OP_INSERT,
+	OP_LOOKUP,
+	OP_EXTEND,
+	OP_REMOVE,
+	OP_N
+};
+
+static const char *op_names[OP_N] = {
+	"insert", "lookup", "extend", "remove"
+};
+
+/*
+ * Each power of two of nanoseconds is split to 2^HIST_SUB_BITS
+ * linear sub-buckets.
+ */
+#define HIST_SUB_BITS		4
+#define HIST_SUB		(1 << HIST_SUB_BITS)
+#define HIST_N			((64 - HIST_SUB_BITS + 1) * HIST_SUB)
+
+typedef struct {
+	unsigned long	cnt[HIST_N];
+	unsigned long	n;
+	unsigned long	max;
+	unsigned long	sum;
+} Hist;
+
+/**
+ * Benchmark settings.
+ *
+ * @thr_n	- number of worker threads;
+ * @ops_n	- number of operations per worker thread;
+ * @mix	- weights of the operations, see OP_*;
+ * @keys	- size of the key space;
+ * @prefill	- number of records inserted before the run;
+ * @zipf	- Zipf distribution parameter, zero for uniform distribution;
+ * @rec_len	- fixed-size records length or zero for variable-length records;
+ * @vmin, @vmax - size range of values of variable-length records;
+ * @db_sz	- the database size;
+ * @lf		- use lock-free lookups;
+ */
+static struct {
+	unsigned int	thr_n;
+	unsigned long	ops_n;
+	unsigned int	mix[OP_N];
+	unsigned long	keys;
+	unsigned long	prefill;
+	double		zipf;
+	unsigned int	rec_len;
+	size_t		vmin;
+	size_t		vmax;
+	size_t		db_sz;
+	bool		lf;
+} cfg = {
+	.thr_n		= 4,
+	.ops_n		= 1000000,
+	.mix		= { 10, 80, 0, 10 },
+	.keys		= 1000000,
+	.prefill	= 500000,
+	.zipf		= 0,
+	.rec_len	= 0,
+	.vmin		= 64,
+	.vmax		= 512,
+	.db_sz		= 1024 * TDB_EXT_SZ,
+	.lf		= false,
+};
+
+/* Precomputed constants of Zipf distribution, see zipf_next(). */
+static double zipf_zetan, zipf_alpha, zipf_eta;
+
+typedef struct {
+	pthread_t	thr;
+	int		id;
+	unsigned long	rnd;
+	unsigned long	fails[OP_N];
+	Hist		hist[OP_N];
+} Worker;
+
+static TdbHdr *dbh;
+static pthread_barrier_t start_bar;
+static char value[TDB_EXT_SZ];
+
+static inline unsigned long
+splitmix64(unsigned long x)
+{
+	x += 0x9e3779b97f4a7c15UL;
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9UL;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebUL;
+	return x ^ (x >> 31);
+}
+
+static inline unsigned long
+rnd_next(unsigned long *s)
+{
+	*s ^= *s << 13;
+	*s ^= *s >> 7;
+	*s ^= *s << 17;
+	return *s;
+}
+
+static inline double
+rnd_double(unsigned long *s)
+{
+	return (rnd_next(s) >> 11) * (1.0 / (1UL << 53));
+}
+
+static void
+zipf_init(void)
+{
+	unsigned long i;
+	double zeta2 = 1 + pow(0.5, cfg.zipf);
+
+	for (zipf_zetan = 0, i = 1; i <= cfg.keys; ++i)
+		zipf_zetan += pow(1.0 / i, cfg.zipf);
+	zipf_alpha = 1 / (1 - cfg.zipf);
+	zipf_eta = (1 - pow(2.0 / cfg.keys, 1 - cfg.zipf))
+		   / (1 - zeta2 / zipf_zetan);
+}
+
+/**
+ * Zipfian generator from "Quickly Generating Billion-Record Synthetic
+ * Databases" by J. Gray et al., the same as used by YCSB.
+ * @return rank of a key, zero is the most popular one.
+ */
+static unsigned long
+zipf_next(unsigned long *s)
+{
+	double u = rnd_double(s), uz = u * zipf_zetan;
+
+	if (uz < 1)
+		return 0;
+	if (uz < 1 + pow(0.5, cfg.zipf))
+		return 1;
+	return (unsigned long)(cfg.keys
+			       * pow(zipf_eta * u - zipf_eta + 1, zipf_alpha))
+	       % cfg.keys;
+}
+
+/**
+ * Scramble the key ranks, so popular keys are spread over the index.
+ */
+static inline unsigned long
+key_next(unsigned long *s)
+{
+	if (cfg.zipf)
+		return splitmix64(zipf_next(s));
+	return splitmix64(rnd_next(s) % cfg.keys);
+}
+
+static inline size_t
+val_len(unsigned long *s)
+{
+	if (cfg.rec_len)
+		return cfg.rec_len;
+	return cfg.vmin + rnd_next(s) % (cfg.vmax - cfg.vmin + 1);
+}
+
+static inline unsigned long
+now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+static inline unsigned int
+hist_idx(unsigned long v)
+{
+	int msb;
+
+	if (v < HIST_SUB)
+		return v;
+	msb = 63 - __builtin_clzl(v);
+
+	return (msb - HIST_SUB_BITS + 1) * HIST_SUB
+	       + ((v >> (msb - HIST_SUB_BITS)) & (HIST_SUB - 1));
+}
+
+/* @return the upper bound of histogram bucket @i. */
+static unsigned long
+hist_val(unsigned int i)
+{
+	unsigned int e = i / HIST_SUB, m = i % HIST_SUB;
+
+	if (!e)
+		return m;
+	return ((unsigned long)(HIST_SUB + m + 1) << (e - 1)) - 1;
+}
+
+static inline void
+hist_add(Hist *h, unsigned long v)
+{
+	++h->cnt[hist_idx(v)];
+	++h->n;
+	h->sum += v;
+	if (v > h->max)
+		h->max = v;
+}
+
+static void
+hist_merge(Hist *dst, const Hist *src)
+{
+	int i;
+
+	for (i = 0; i < HIST_N; ++i)
+		dst->cnt[i] += src->cnt[i];
+	dst->n += src->n;
+	dst->sum += src->sum;
+	if (src->max > dst->max)
+		dst->max = src->max;
+}
+
+static unsigned long
+hist_pct(const Hist *h, double pct)
+{
+	int i;
+	unsigned long n = 0, lim = (unsigned long)ceil(h->n * pct / 100);
+
+	for (i = 0; i < HIST_N; ++i)
+		if ((n += h->cnt[i]) >= lim)
+			return hist_val(i) < h->max ? hist_val(i) : h->max;
+	return h->max;
+}
+
+static bool
+lf_get(TdbRec *r, void *data)
+{
+	return true;
+}
+
+static bool
+bench_insert(Worker *w, unsigned long key)
+{
+	size_t len = val_len(&w->rnd);
+
+	return tdb_htrie_insert(dbh, key, value, &len);
+}
+
+static bool
+bench_lookup(Worker *w, unsigned long key)
+{
+	TdbBucket *b;
+	TdbRec *r;
+
+	if (cfg.lf)
+		return tdb_htrie_get_lf(dbh, key, lf_get, NULL);
+
+	if (!(b = tdb_htrie_lookup(dbh, key)))
+		return false;
+	if (!(r = tdb_htrie_bscan_for_rec(dbh, &b, key)))
+		return false;
+	read_unlock_bh(&b->lock);
+
+	return true;
+}
+
+/**
+ * Insert a record by two chunks as users do for large records which don't
+ * fit one data block or which size isn't known in advance.
+ */
+static bool
+bench_extend(Worker *w, unsigned long key)
+{
+	size_t n, len = val_len(&w->rnd), head = len / 2 ? : 1;
+	TdbVRec *rec, *chunk;
+
+	rec = (TdbVRec *)tdb_htrie_insert(dbh, key, value, &head);
+	if (!rec)
+		return false;
+	for (n = head; n < len; n += chunk->len) {
+		chunk = tdb_htrie_extend_rec(dbh, rec, len - n);
+		if (!chunk)
+			return false;
+		memcpy(chunk->data, value, chunk->len);
+		rec = chunk;
+	}
+
+	return true;
+}
+
+static bool
+bench_remove(Worker *w, unsigned long key)
+{
+	return !tdb_htrie_remove(dbh, key, NULL, NULL);
+}
+
+static bool (*bench_ops[OP_N])(Worker *, unsigned long) = {
+	bench_insert, bench_lookup, bench_extend, bench_remove
+};
+
+static void *
+worker_f(void *data)
+{
+	int op;
+	unsigned long i, t, key, mix_sum = 0;
+	unsigned int mix[OP_N];
+	Worker *w = data;
+	cpu_set_t cs;
+
+	CPU_ZERO(&cs);
+	CPU_SET(w->id % sysconf(_SC_NPROCESSORS_ONLN), &cs);
+	pthread_setaffinity_np(pthread_self(), sizeof(cs), &cs);
+
+	for (op = 0; op < OP_N; ++op)
+		mix[op] = (mix_sum += cfg.mix[op]);
+
+	pthread_barrier_wait(&start_bar);
+
+	for (i = 0; i < cfg.ops_n; ++i) {
+		t = rnd_next(&w->rnd) % mix_sum;
+		for (op = 0; t >= mix[op]; ++op)
+			;
+		key = key_next(&w->rnd);
+
+		t = now_ns();
+		if (!bench_ops[op](w, key))
+			++w->fails[op];
+		hist_add(&w->hist[op], now_ns() - t);
+	}
+
+	return NULL;
+}
+
+static void
+prefill(void)
+{
+	unsigned long i, rnd = 1;
+	size_t len;
+
+	for (i = 0; i < cfg.prefill; ++i) {
+		len = val_len(&rnd);
+		if (!tdb_htrie_insert(dbh, splitmix64(i % cfg.keys), value,
+				      &len))
+		{
+			fprintf(stderr, "Cannot prefill record %lu,"
+				" the database is full\n", i);
+			exit(1);
+		}
+	}
+}
+
+typedef struct {
+	unsigned long	recs;
+	unsigned long	bytes;
+} MemStat;
+
+static int
+mem_rec_f(TdbRec *r, void *data)
+{
+	MemStat *ms = data;
+	TdbVRec *c;
+
+	++ms->recs;
+	if (TDB_HTRIE_VARLENRECS(dbh))
+		for (c = (TdbVRec *)r; c;
+		     c = c->chunk_next
+			 ? TDB_PTR(dbh, TDB_DI2O(c->chunk_next))
+			 : NULL)
+			ms->bytes += TDB_HTRIE_VRLEN(c);
+	else
+		ms->bytes += dbh->rec_len;
+
+	return 0;
+}
+
+static unsigned long
+used_blocks(void)
+{
+	int i;
+	unsigned long o, n = 0;
+	TdbExt *e;
+
+	for (o = 0; o < dbh->dbsz; o += TDB_EXT_SZ) {
+		e = tdb_ext(dbh, TDB_PTR(dbh, o));
+		for (i = 0; i < TDB_BLK_BMP_2L; ++i)
+			n += __builtin_popcountl(e->b_bmp[i]);
+	}
+
+	return n;
+}
+
+static void
+report_mem(void)
+{
+	TdbCursor c;
+	MemStat ms = { 0 };
+	unsigned long blks, freed, used;
+
+	tdb_cursor_init(&c, 0, 0);
+	tdb_htrie_iter(dbh, &c, UINT_MAX, mem_rec_f, &ms);
+	blks = used_blocks();
+	freed = tdb_htrie_reclaim(dbh);
+	used = (blks - freed) * TDB_BLK_SZ;
+
+	printf("\nmemory: %lu records, %lu payload bytes, %luKB used"
+	       " (%luKB quarantined)\n", ms.recs, ms.bytes, used / 1024,
+	       freed * TDB_BLK_SZ / 1024);
+	if (ms.recs)
+		printf("memory per record: %lu bytes, overhead %ld bytes\n",
+		       used / ms.recs, (long)(used - ms.bytes) / (long)ms.recs);
+}
+
+static void
+report(Worker *w, unsigned long ns)
+{
+	int op, i;
+	Hist *h, total = { { 0 } };
+	unsigned long fails;
+
+	printf("%-8s %10s %10s %8s %8s %8s %8s %8s %8s %10s\n",
+	       "op", "count", "Kops/s", "avg", "p50", "p90", "p99", "p99.9",
+	       "max", "failed");
+	for (op = 0; op < OP_N; ++op) {
+		h = &w[0].hist[op];
+		fails = w[0].fails[op];
+		for (i = 1; i < cfg.thr_n; ++i) {
+			hist_merge(h, &w[i].hist[op]);
+			fails += w[i].fails[op];
+		}
+		if (!h->n)
+			continue;
+		hist_merge(&total, h);
+		printf("%-8s %10lu %10.1f %8lu %8lu %8lu %8lu %8lu %8lu"
+		       " %10lu\n", op_names[op], h->n, h->n * 1e6 / ns,
+		       h->sum / h->n, hist_pct(h, 50), hist_pct(h, 90),
+		       hist_pct(h, 99), hist_pct(h, 99.9), h->max, fails);
+	}
+	printf("%-8s %10lu %10.1f %8lu %8lu %8lu %8lu %8lu %8lu\n", "total",
+	       total.n, total.n * 1e6 / ns, total.sum / total.n,
+	       hist_pct(&total, 50), hist_pct(&total, 90),
+	       hist_pct(&total, 99), hist_pct(&total, 99.9), total.max);
+	printf("(latencies are in nanoseconds)\n");
+}
+
+static void
+usage(const char *name)
+{
+	printf("Usage: %s [options]\n"
+	       "  -t <n>\t\tnumber of worker threads, default %u\n"
+	       "  -n <n>\t\toperations per thread, default %lu\n"
+	       "  -m <i:l:e:r>\tweights of insert, lookup, extend and remove"
+	       " operations,\n\t\tdefault %u:%u:%u:%u\n"
+	       "  -k <n>\t\tnumber of distinct keys, default %lu\n"
+	       "  -p <n>\t\trecords inserted before the run, default %lu\n"
+	       "  -z <theta>\tZipfian keys distribution with parameter"
+	       " 0 < theta < 1,\n\t\tuniform by default\n"
+	       "  -f <n>\t\tfixed-size records of n bytes\n"
+	       "  -s <min[-max]>\tvalue size of variable-length records,"
+	       " default %lu-%lu\n"
+	       "  -M <n>\t\tdatabase size in MB, default %lu\n"
+	       "  -l\t\tlock-free lookups\n",
+	       name, cfg.thr_n, cfg.ops_n, cfg.mix[0], cfg.mix[1],
+	       cfg.mix[2], cfg.mix[3], cfg.keys, cfg.prefill, cfg.vmin,
+	       cfg.vmax, cfg.db_sz >> 20);
+	exit(1);
+}
+
+static void
+parse_args(int argc, char *argv[])
+{
+	int c;
+
+	while ((c = getopt(argc, argv, "t:n:m:k:p:z:f:s:M:lh")) != -1) {
+		switch (c) {
+		case 't':
+			cfg.thr_n = atoi(optarg);
+			break;
+		case 'n':
+			cfg.ops_n = strtoul(optarg, NULL, 0);
+			break;
+		case 'm':
+			if (sscanf(optarg, "%u:%u:%u:%u", &cfg.mix[0],
+				   &cfg.mix[1], &cfg.mix[2], &cfg.mix[3]) != 4)
+				usage(argv[0]);
+			break;
+		case 'k':
+			cfg.keys = strtoul(optarg, NULL, 0);
+			break;
+		case 'p':
+			cfg.prefill = strtoul(optarg, NULL, 0);
+			break;
+		case 'z':
+			cfg.zipf = atof(optarg);
+			break;
+		case 'f':
+			cfg.rec_len = atoi(optarg);
+			break;
+		case 's':
+			if (sscanf(optarg, "%zu-%zu", &cfg.vmin,
+				   &cfg.vmax) == 1)
+				cfg.vmax = cfg.vmin;
+			break;
+		case 'M':
+			cfg.db_sz = strtoul(optarg, NULL, 0) << 20;
+			break;
+		case 'l':
+			cfg.lf = true;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	/* ktest emulates a CPU by each thread, see spawn_thread(). */
+	if (!cfg.thr_n || cfg.thr_n > NR_CPUS - 1) {
+		fprintf(stderr, "Number of threads must be 1..%d\n",
+			NR_CPUS - 1);
+		exit(1);
+	}
+	if (!cfg.keys || cfg.zipf < 0 || cfg.zipf >= 1
+	    || !(cfg.mix[0] + cfg.mix[1] + cfg.mix[2] + cfg.mix[3]))
+		usage(argv[0]);
+	if (cfg.rec_len && cfg.mix[OP_EXTEND]) {
+		fprintf(stderr, "Fixed-size records can't be extended\n");
+		exit(1);
+	}
+	if (!cfg.vmin || cfg.vmin > cfg.vmax || cfg.vmax > sizeof(value)
+	    || cfg.rec_len > sizeof(value))
+	{
+		fprintf(stderr, "Bad value size\n");
+		exit(1);
+	}
+	cfg.db_sz &= TDB_EXT_MASK;
+	if (cfg.db_sz < TDB_EXT_SZ * 2 || cfg.db_sz > TDB_MAX_DB_SZ) {
+		fprintf(stderr, "Bad database size\n");
+		exit(1);
+	}
+}
+
+/**
+ * HTrie requires extent-aligned address.
+ */
+static void *
+db_map(size_t size)
+{
+	char *p;
+
+	p = mmap(NULL, size + TDB_EXT_SZ, PROT_READ | PROT_WRITE,
+		 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (p == MAP_FAILED) {
+		perror("cannot map the database");
+		exit(1);
+	}
+
+	return (void *)TDB_EXT_O(p + TDB_EXT_SZ - 1);
+}
+
+int
+main(int argc, char *argv[])
+{
+	int t;
+	unsigned long ns;
+	Worker *w;
+
+	parse_args(argc, argv);
+	if (cfg.zipf)
+		zipf_init();
+	memset(value, 'x', sizeof(value));
+
+	dbh = tdb_htrie_init(db_map(cfg.db_sz), 0, cfg.db_sz, cfg.db_sz,
+			     cfg.rec_len);
+	if (!dbh) {
+		fprintf(stderr, "cannot initialize htrie\n");
+		return 1;
+	}
+
+	printf("%u threads, %lu ops per thread, mix %u:%u:%u:%u, %lu keys"
+	       " (%s), %lu prefilled, ", cfg.thr_n, cfg.ops_n, cfg.mix[0],
+	       cfg.mix[1], cfg.mix[2], cfg.mix[3], cfg.keys,
+	       cfg.zipf ? "zipf" : "uniform", cfg.prefill);
+	if (cfg.rec_len)
+		printf("%u bytes records", cfg.rec_len);
+	else
+		printf("%zu-%zu bytes values", cfg.vmin, cfg.vmax);
+	printf(", %s lookups\n\n", cfg.lf ? "lock-free" : "locking");
+
+	prefill();
+
+	if (!(w = calloc(cfg.thr_n, sizeof(*w)))) {
+		fprintf(stderr, "cannot allocate workers\n");
+		return 1;
+	}
+	pthread_barrier_init(&start_bar, NULL, cfg.thr_n + 1);
+	for (t = 0; t < cfg.thr_n; ++t) {
+		w[t].id = t;
+		w[t].rnd = splitmix64(t + 1) | 1;
+		if (spawn_thread(&w[t].thr, worker_f, &w[t])) {
+			perror("cannot spawn worker thread");
+			return 1;
+		}
+	}
+
+	pthread_barrier_wait(&start_bar);
+	ns = now_ns();
+	for (t = 0; t < cfg.thr_n; ++t)
+		pthread_join(w[t].thr, NULL);
+	ns = now_ns() - ns;
+
+	report(w, ns);
+	report_mem();
+
+	free(w);
+	tdb_htrie_exit(dbh);
+
+	return 0;
+}
@@ -37,6 +37,26 @@
 /* Include HTrie for test. */
 #include "../core/htrie.c"
 
+/* Kernel implementations of the library routines aren't linked in. */
+void
+memcpy_fast(void *to, const void *from, size_t len)
+{
+	memcpy(to, from, len);
+}
+
+void
+bzero_fast(void *s, size_t len)
+{
+	memset(s, 0, len);
+}
+
+/* The test never runs snapshots, see tempesta_db/core/snapshot.c. */
+void
+__tdb_snap_cow(TdbSnap *s, TdbHdr *dbh, void *p, size_t len)
+{
+	assert(0);
+}
+
 /*
  * HTrie requires extent-aligned address.
  * These are just some good addresses to be mapped to.
@@ -426,7 +446,7 @@ tdb_htrie_test_varsz(const char *fname)
 	printf("\n----------- Variable size records test -------------\n");
 
 	addr = tdb_htrie_open(TDB_MAP_ADDR1, fname, TDB_VSF_SZ, &fd);
-	dbh = tdb_htrie_init(addr, TDB_VSF_SZ, 0);
+	dbh = tdb_htrie_init(addr, TDB_VSF_SZ, TDB_VSF_SZ, TDB_VSF_SZ, 0);
 	if (!dbh)
 		TDB_ERR("cannot initialize htrie for urls");
 
@@ -451,7 +471,7 @@ tdb_htrie_test_varsz(const char *fname)
 	printf("\n	**** Variable size records test reopen ****\n");
 
 	addr = tdb_htrie_open(TDB_MAP_ADDR2, fname, TDB_VSF_SZ, &fd);
-	dbh = tdb_htrie_init(addr, TDB_VSF_SZ, 0);
+	dbh = tdb_htrie_init(addr, TDB_VSF_SZ, TDB_VSF_SZ, TDB_VSF_SZ, 0);
 	if (!dbh)
 		TDB_ERR("cannot initialize htrie for urls");
 
@@ -474,7 +494,8 @@ tdb_htrie_test_fixsz(const char *fname)
 	printf("\n----------- Fixed size records test -------------\n");
 
 	addr = tdb_htrie_open(TDB_MAP_ADDR1, fname, TDB_FSF_SZ, &fd);
-	dbh = tdb_htrie_init(addr, TDB_FSF_SZ, sizeof(ints[0]));
+	dbh = tdb_htrie_init(addr, TDB_FSF_SZ, TDB_FSF_SZ, TDB_FSF_SZ,
+			     sizeof(ints[0]));
 	if (!dbh)
 		TDB_ERR("cannot initialize htrie for ints");
 
@@ -499,7 +520,8 @@ tdb_htrie_test_fixsz(const char *fname)
 	printf("\n	**** Fixed size records test reopen ****\n");
 
 	addr = tdb_htrie_open(TDB_MAP_ADDR2, fname, TDB_FSF_SZ, &fd);
-	dbh = tdb_htrie_init(addr, TDB_FSF_SZ, sizeof(ints[0]));
+	dbh = tdb_htrie_init(addr, TDB_FSF_SZ, TDB_FSF_SZ, TDB_FSF_SZ,
+			     sizeof(ints[0]));
 	if (!dbh)
 		TDB_ERR("cannot initialize htrie for ints");
 
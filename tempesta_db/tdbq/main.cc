@@ -17,6 +17,8 @@
  * this program; if not, write to the Free Software Foundation, Inc., 59
  * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
  */
+#include <chrono>
+#include <fstream>
 #include <iostream>
 #include <string>
 
@@ -30,6 +32,17 @@ enum {
 	ACT_CLOSE,
 	ACT_INSERT,
 	ACT_SELECT,
+	ACT_SCAN,
+	ACT_DUMP,
+	ACT_LOAD,
+	ACT_SNAPSHOT,
+	ACT_INDEX,
+};
+
+// Formats of streamed records for load and dump actions.
+enum {
+	FMT_TEXT,
+	FMT_BINARY,
 };
 
 namespace po = boost::program_options;
@@ -43,6 +56,8 @@ struct Cfg {
 	std::string	table;
 	std::string	key;
 	std::string	val;
+	std::string	file;
+	int		format;
 
 	Cfg &
 	operator=(po::variables_map &&vm)
@@ -64,6 +79,14 @@ struct Cfg {
 					sizeof(TdbMsgRec) + 2);
 		}
 		mm_sz = vm["mmap"].as<size_t>();
+		file = std::move(vm["file"].as<std::string>());
+		std::string f = std::move(vm["format"].as<std::string>());
+		if (f == "text")
+			format = FMT_TEXT;
+		else if (f == "binary")
+			format = FMT_BINARY;
+		else
+			throw TdbExcept("bad format: %s", f.c_str());
 
 		if (!vm.count("action"))
 			throw TdbExcept("please specify an action to do");
@@ -78,6 +101,16 @@ struct Cfg {
 			action = ACT_INSERT;
 		} else if (a == "select") {
 			action = ACT_SELECT;
+		} else if (a == "scan") {
+			action = ACT_SCAN;
+		} else if (a == "dump") {
+			action = ACT_DUMP;
+		} else if (a == "load") {
+			action = ACT_LOAD;
+		} else if (a == "snapshot") {
+			action = ACT_SNAPSHOT;
+		} else if (a == "index") {
+			action = ACT_INDEX;
 		} else {
 			throw TdbExcept("bad action: %s", a.c_str());
 		}
@@ -93,8 +126,14 @@ struct Cfg {
 			throw TdbExcept("please specify exact key");
 		if (table == "*" && action != ACT_INFO)
 			throw TdbExcept("please specify a table");
+		if (action == ACT_LOAD && !key.empty())
+			throw TdbExcept("keys are read from the loaded file");
 		if (action == ACT_OPEN && db_path.empty())
 			throw TdbExcept("please specify database path");
+		if (action == ACT_INDEX && (key.empty() || key == "*"))
+			throw TdbExcept("please specify secondary key");
+		if (action == ACT_SNAPSHOT && file == "-")
+			throw TdbExcept("please specify snapshot file");
 
 		if (mm_sz % 2)
 			throw TdbExcept("mmap size must be multiple of 2");
@@ -104,6 +143,251 @@ struct Cfg {
 	}
 };
 
+/**
+ * Reports progress and throughput of bulk operations to stderr, so the
+ * reporting doesn't mix with records dumped to stdout.
+ */
+class Progress {
+	typedef std::chrono::steady_clock Clock;
+
+public:
+	Progress(const char *op) noexcept
+		: op_(op), n_(0), bytes_(0), start_(Clock::now()),
+		  last_(start_)
+	{}
+
+	void
+	update(size_t bytes) noexcept
+	{
+		++n_;
+		bytes_ += bytes;
+		// Don't read the clock on each record.
+		if (n_ % 1024)
+			return;
+		Clock::time_point now = Clock::now();
+		if (now - last_ < std::chrono::seconds(1))
+			return;
+		last_ = now;
+		report(now);
+	}
+
+	void
+	done() noexcept
+	{
+		report(Clock::now());
+	}
+
+	size_t
+	records() const noexcept
+	{
+		return n_;
+	}
+
+private:
+	void
+	report(Clock::time_point now) noexcept
+	{
+		double t = std::chrono::duration<double>(now - start_).count();
+		double mb = (double)bytes_ / (1024 * 1024);
+
+		if (t < 1e-6)
+			t = 1e-6;
+		std::cerr << op_ << ": records=" << n_ << " MB=" << (size_t)mb
+			  << " records/s=" << (size_t)(n_ / t)
+			  << " MB/s=" << (size_t)(mb / t) << std::endl;
+	}
+
+	const char		*op_;
+	size_t			n_;
+	size_t			bytes_;
+	Clock::time_point	start_;
+	Clock::time_point	last_;
+};
+
+static void
+write_escaped(std::ostream &os, const char *s, size_t len)
+{
+	for (size_t i = 0; i < len; ++i)
+		switch (s[i]) {
+		case '\\':
+			os << "\\\\";
+			break;
+		case '\t':
+			os << "\\t";
+			break;
+		case '\n':
+			os << "\\n";
+			break;
+		default:
+			os.put(s[i]);
+		}
+}
+
+static std::string
+unescape(const std::string &s, size_t ln)
+{
+	std::string r;
+
+	r.reserve(s.length());
+	for (size_t i = 0; i < s.length(); ++i) {
+		if (s[i] != '\\') {
+			r += s[i];
+			continue;
+		}
+		if (++i == s.length())
+			throw TdbExcept("bad escaping at line %lu", ln);
+		switch (s[i]) {
+		case '\\':
+			r += '\\';
+			break;
+		case 't':
+			r += '\t';
+			break;
+		case 'n':
+			r += '\n';
+			break;
+		default:
+			throw TdbExcept("bad escaping at line %lu", ln);
+		}
+	}
+
+	return r;
+}
+
+/**
+ * Read next record @key and @val in format @fmt from @is.
+ * @return false at the end of the input.
+ */
+static bool
+read_rec(std::istream &is, int fmt, std::string &key, std::string &val,
+	 size_t &n)
+{
+	++n;
+	if (fmt == FMT_BINARY) {
+		TdbMsgRec r;
+
+		if (!is.read((char *)&r, sizeof(r))) {
+			if (is.gcount())
+				throw TdbExcept("truncated record %lu", n);
+			return false;
+		}
+		if (r.klen + r.dlen > NL_FR_SZ)
+			throw TdbExcept("too large record %lu", n);
+		key.resize(r.klen);
+		val.resize(r.dlen);
+		if (!is.read(&key[0], r.klen) || !is.read(&val[0], r.dlen))
+			throw TdbExcept("truncated record %lu", n);
+		return true;
+	}
+
+	std::string line;
+	if (!std::getline(is, line))
+		return false;
+	size_t tab = line.find('\t');
+	if (tab == std::string::npos)
+		throw TdbExcept("no tab between key and value at line %lu", n);
+	key = unescape(line.substr(0, tab), n);
+	val = unescape(line.substr(tab + 1), n);
+
+	return true;
+}
+
+/**
+ * Write all the records of the table read from its read-only mapping.
+ * Only records inserted through the netlink interface, i.e. with TdbMsgRec
+ * as the record data, are written.
+ */
+static void
+dump(Cfg &cfg)
+{
+	std::ofstream f;
+	std::ostream *os = &std::cout;
+	Progress p("DUMP");
+	size_t bad = 0;
+
+	if (cfg.file != "-") {
+		f.open(cfg.file, std::ios::binary | std::ios::trunc);
+		if (!f)
+			throw TdbExcept("cannot open %s", cfg.file.c_str());
+		os = &f;
+	}
+
+	TdbMap tm(cfg.table);
+	tm.walk([&](unsigned long key, const char *rec, size_t len) {
+		const TdbMsgRec *r = (const TdbMsgRec *)rec;
+
+		if (len < sizeof(*r) || len < TDB_MSGREC_LEN(r)) {
+			++bad;
+			return;
+		}
+		if (cfg.format == FMT_BINARY) {
+			os->write(rec, TDB_MSGREC_LEN(r));
+		} else {
+			write_escaped(*os, r->data, r->klen);
+			os->put('\t');
+			write_escaped(*os, TDB_MSGREC_DATA(r), r->dlen);
+			os->put('\n');
+		}
+		p.update(TDB_MSGREC_LEN(r));
+	});
+	os->flush();
+	if (!*os)
+		throw TdbExcept("cannot write records");
+
+	p.done();
+	std::cerr << "DUMP: records=" << p.records()
+		  << " skipped_buckets=" << tm.skipped()
+		  << " bad_records=" << bad << std::endl;
+}
+
+/**
+ * Insert all the records from the input in one asynchronous transaction,
+ * which sends the records to the kernel by as large batches as fit netlink
+ * frames and doesn't wait for a frame status before sending the next frames.
+ */
+static void
+load(TdbHndl &th, Cfg &cfg)
+{
+	std::ifstream f;
+	std::istream *is = &std::cin;
+	std::string key, val;
+	Progress p("LOAD");
+	size_t n = 0;
+
+	if (cfg.file != "-") {
+		f.open(cfg.file, std::ios::binary);
+		if (!f)
+			throw TdbExcept("cannot open %s", cfg.file.c_str());
+		is = &f;
+	}
+
+	while (read_rec(*is, cfg.format, key, val, n)) {
+		if (!p.records())
+			th.trx_begin(true);
+		th.insert(cfg.table, key.length(), val.length(),
+			  [&](char *k, char *v)
+			  {
+				key.copy(k, key.length());
+				val.copy(v, val.length());
+			  });
+		p.update(sizeof(TdbMsgRec) + key.length() + val.length());
+	}
+	if (is->bad())
+		throw TdbExcept("cannot read records");
+	if (p.records()) {
+		th.trx_commit();
+		while (th.inflight())
+			th.poll([](const TdbHndl::Completion &c) {
+					if (!c.ok)
+						throw TdbExcept("transaction"
+								" failed, see"
+								" dmesg");
+				}, true);
+	}
+
+	p.done();
+}
+
 int
 main(int argc, char *argv[])
 {
@@ -112,6 +396,14 @@ main(int argc, char *argv[])
 				     "\nUsage:");
 	desc.add_options()
 		("debug,d", "Switch on debug mode")
+		("file,f", po::value<std::string>()->default_value("-"),
+		 "File to load records from or dump them to, '-' for standard"
+		 " input or output, or absolute path of a snapshot file")
+		("format,F", po::value<std::string>()->default_value("text"),
+		 "Format of loaded and dumped records: 'text' for a record per"
+		 " line with key and value separated by tab and tabs, newlines"
+		 " and backslashes in them escaped by backslash, or 'binary'"
+		 " for the records as TdbMsgRec structures")
 		("help,h", "Show this message and exit")
 		("mmap,m", po::value<size_t>()->default_value(TdbHndl::MMSZ),
 		 "Size of mmap()'ed ring for communications w/ kernel in pages")
@@ -122,7 +414,15 @@ main(int argc, char *argv[])
 		 "  open    - open and create a new table if necessary;\n"
 		 "  close   - close a table;\n"
 		 "  insert  - insert a record to a table;\n"
-		 "  select  - select from a table")
+		 "  select  - select from a table;\n"
+		 "  scan    - print all records of a table page by page;\n"
+		 "  dump    - write all records of a table read directly from"
+		 " read-only mapping of the table to a file;\n"
+		 "  load    - insert all records from a file to a table;\n"
+		 "  snapshot - start writing point-in-time image of a table"
+		 " to a file in background;\n"
+		 "  index   - print records of a table with the secondary key"
+		 " specified by --key looked up by the table index")
 		("key,k", po::value<std::string>(), "The record key")
 		("path,p", po::value<std::string>(), "Path to database files")
 		("rec_size,r", po::value<size_t>()->default_value(0),
@@ -195,6 +495,49 @@ main(int argc, char *argv[])
 					std::cout << "'" << std::endl;
 				 });
 			break;
+		case ACT_SCAN: {
+			TdbCursor c = {};
+			while (th.scan(cfg.table, c,
+				       [=](char *key, size_t klen,
+					   char *val, size_t vlen)
+				       {
+					std::cout << "'";
+					std::cout.write(key, klen);
+					std::cout << "' -> '";
+					std::cout.write(val, vlen);
+					std::cout << "'" << std::endl;
+				       }))
+				;
+			break;
+		}
+		case ACT_INDEX: {
+			TdbCursor c = {};
+			while (th.index_scan(cfg.table, cfg.key, c,
+					     [=](char *key, size_t klen,
+						 char *val, size_t vlen)
+					     {
+						std::cout << "'";
+						std::cout.write(key, klen);
+						std::cout << "' -> '";
+						std::cout.write(val, vlen);
+						std::cout << "'" << std::endl;
+					     }))
+				;
+			break;
+		}
+		case ACT_DUMP:
+			dump(cfg);
+			// The table is read w/o netlink, so there is no status.
+			return 0;
+		case ACT_LOAD:
+			load(th, cfg);
+			break;
+		case ACT_SNAPSHOT:
+			th.snapshot(cfg.table, cfg.file);
+			std::cout << "snapshot of table " << cfg.table
+				  << " started, see dmesg for the result"
+				  << std::endl;
+			break;
 		default:
 			throw TdbExcept("bad action number %d", cfg.action);
 		}
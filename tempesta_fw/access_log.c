@@ -0,0 +1,267 @@
+/**
+ *		Tempesta FW
+ *
+ * Binary access log.
+ *
+ * printk() is too slow to log each request, so the access log records are
+ * written to per-CPU ring buffers shared with a user space reader, which
+ * mmap()s /proc/tempesta/access_log, drains the rings and formats the
+ * records. The rings are single producer and single consumer: the records
+ * are written in softirq of the CPU, so no locking is needed. If a ring is
+ * full, i.e. the reader falls behind, then the record is dropped and
+ * counted.
+ *
+ * Each CPU ring is mapped separately at offset of CPU number multiplied by
+ * the ring size, including the header page. The reader may map the first
+ * page of the CPU 0 ring to read the ring size from the header.
+ *
+ * Copyright (C) 2020 Tempesta Technologies, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#include <linux/log2.h>
+#include <linux/mm.h>
+#include <linux/proc_fs.h>
+#include <linux/vmalloc.h>
+
+#include "tempesta_fw.h"
+#include "access_log.h"
+#include "cfg.h"
+#include "log.h"
+#include "server.h"
+#include "vhost.h"
+
+#define TFW_ALOG_PROC	"tempesta/access_log"
+
+/**
+ * Per-CPU ring buffer. The kernel doesn't trust the values in the shared
+ * header and keeps its own copies.
+ *
+ * @hdr		- the ring header followed by the records;
+ * @head	- the kernel copy of @hdr->head;
+ */
+typedef struct {
+	TfwAccessLogHdr		*hdr;
+	u64			head;
+} TfwAccessLogRing;
+
+bool tfw_alog_enabled __read_mostly;
+/* Number of records in each ring minus one, the rings size is 2^n. */
+static unsigned int tfw_alog_mask __read_mostly;
+/* Size of each ring in bytes, including the header page. */
+static unsigned long tfw_alog_ring_sz __read_mostly;
+static unsigned int tfw_alog_cfg_size;
+static DEFINE_PER_CPU(TfwAccessLogRing, tfw_alog_ring);
+
+void
+__tfw_access_log(TfwHttpReq *req, TfwHttpResp *resp)
+{
+	TfwAccessLogRing *ring;
+	TfwAccessLogHdr *hdr;
+	TfwAccessLogRec *rec;
+
+	local_bh_disable();
+
+	ring = this_cpu_ptr(&tfw_alog_ring);
+	if (unlikely(!(hdr = ring->hdr)))
+		goto out;
+	/* Order reading of the records by the reader and their overwriting. */
+	if (ring->head - smp_load_acquire(&hdr->tail) > tfw_alog_mask) {
+		WRITE_ONCE(hdr->drops, hdr->drops + 1);
+		goto out;
+	}
+	rec = (TfwAccessLogRec *)((char *)hdr + PAGE_SIZE)
+	      + (ring->head & tfw_alog_mask);
+
+	rec->ts = ktime_get_real_ns();
+	rec->bytes = resp->msg.len;
+	memcpy(rec->addr, &req->conn->peer->addr.sin6_addr, sizeof(rec->addr));
+	if (resp->conn) {
+		TfwAddr *addr = &resp->conn->peer->addr;
+
+		memcpy(rec->upstream, &addr->sin6_addr, sizeof(rec->upstream));
+		rec->upstream_port = ntohs(addr->sin6_port);
+		rec->src = TFW_ALOG_SRC_UPSTREAM;
+	} else {
+		memset(rec->upstream, 0, sizeof(rec->upstream));
+		rec->upstream_port = 0;
+		rec->src = test_bit(TFW_HTTP_B_RESP_CACHED, resp->flags)
+			   ? TFW_ALOG_SRC_CACHE : TFW_ALOG_SRC_LOCAL;
+	}
+	if (req->vhost)
+		strncpy(rec->vhost, req->vhost->name.data, sizeof(rec->vhost));
+	else
+		rec->vhost[0] = 0;
+	rec->latency = jiffies_to_usecs(jiffies - req->jrxtstamp);
+	rec->status = resp->status;
+	rec->method = req->method;
+
+	/* Publish the record. */
+	smp_store_release(&hdr->head, ++ring->head);
+out:
+	local_bh_enable();
+}
+
+/**
+ * Total number of the records dropped because the reader fell behind.
+ */
+u64
+tfw_access_log_drops(void)
+{
+	int cpu;
+	u64 drops = 0;
+
+	if (!READ_ONCE(tfw_alog_enabled))
+		return 0;
+	for_each_online_cpu(cpu) {
+		TfwAccessLogHdr *hdr = per_cpu(tfw_alog_ring, cpu).hdr;
+
+		if (hdr)
+			drops += READ_ONCE(hdr->drops);
+	}
+
+	return drops;
+}
+
+static int
+tfw_alog_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	unsigned long cpu, off = vma->vm_pgoff << PAGE_SHIFT;
+	TfwAccessLogHdr *hdr;
+
+	if (!tfw_alog_enabled)
+		return -ENODEV;
+	cpu = off / tfw_alog_ring_sz;
+	if (off % tfw_alog_ring_sz || cpu >= nr_cpu_ids
+	    || vma->vm_end - vma->vm_start > tfw_alog_ring_sz)
+		return -EINVAL;
+	if (!(hdr = per_cpu(tfw_alog_ring, cpu).hdr))
+		return -ENODEV;
+
+	return remap_vmalloc_range(vma, hdr, 0);
+}
+
+static const struct file_operations tfw_alog_fops = {
+	.owner		= THIS_MODULE,
+	.mmap		= tfw_alog_mmap,
+};
+
+static void
+tfw_alog_free(void)
+{
+	int cpu;
+
+	WRITE_ONCE(tfw_alog_enabled, false);
+	/* Wait for the writers in softirq. */
+	synchronize_rcu_bh();
+	for_each_possible_cpu(cpu) {
+		TfwAccessLogRing *ring = per_cpu_ptr(&tfw_alog_ring, cpu);
+
+		/* The pages are released on unmapping if still mapped. */
+		vfree(ring->hdr);
+		ring->hdr = NULL;
+		ring->head = 0;
+	}
+}
+
+static int
+tfw_alog_start(void)
+{
+	int cpu;
+	unsigned int n;
+
+	if (tfw_runstate_is_reconfig()) {
+		if (tfw_alog_cfg_size != (tfw_alog_enabled
+					  ? tfw_alog_ring_sz - PAGE_SIZE : 0))
+			T_WARN_NL("access_log_buffer is changed, restart"
+				  " Tempesta FW to apply it\n");
+		return 0;
+	}
+	if (!tfw_alog_cfg_size)
+		return 0;
+
+	n = rounddown_pow_of_two(tfw_alog_cfg_size / sizeof(TfwAccessLogRec));
+	tfw_alog_mask = n - 1;
+	tfw_alog_ring_sz = PAGE_SIZE + tfw_alog_cfg_size;
+	for_each_online_cpu(cpu) {
+		TfwAccessLogRing *ring = per_cpu_ptr(&tfw_alog_ring, cpu);
+
+		if (!(ring->hdr = vmalloc_user(tfw_alog_ring_sz))) {
+			T_ERR_NL("Can't allocate access log buffer\n");
+			tfw_alog_free();
+			return -ENOMEM;
+		}
+		ring->hdr->size = n;
+		ring->hdr->rec_size = sizeof(TfwAccessLogRec);
+		ring->hdr->ring_size = tfw_alog_ring_sz;
+		ring->hdr->version = TFW_ALOG_VERSION;
+	}
+	WRITE_ONCE(tfw_alog_enabled, true);
+
+	T_LOG_NL("Access log: %u records per CPU\n", n);
+
+	return 0;
+}
+
+static void
+tfw_alog_stop(void)
+{
+	if (tfw_runstate_is_reconfig())
+		return;
+	tfw_alog_free();
+}
+
+static TfwCfgSpec tfw_alog_specs[] = {
+	{
+		.name = "access_log_buffer",
+		.deflt = "0",
+		.handler = tfw_cfg_set_int,
+		.dest = &tfw_alog_cfg_size,
+		.spec_ext = &(TfwCfgSpecInt) {
+			.multiple_of = PAGE_SIZE,
+			.range = { 0, (1 << 30) },
+		},
+		.allow_reconfig = true,
+	},
+	{ 0 }
+};
+
+TfwMod tfw_access_log_mod = {
+	.name	= "access_log",
+	.start	= tfw_alog_start,
+	.stop	= tfw_alog_stop,
+	.specs	= tfw_alog_specs,
+};
+
+int __init
+tfw_access_log_init(void)
+{
+	BUILD_BUG_ON(sizeof(TfwAccessLogRec) != 96);
+	BUILD_BUG_ON(sizeof(TfwAccessLogHdr) > PAGE_SIZE);
+
+	if (!proc_create(TFW_ALOG_PROC, S_IRUSR | S_IWUSR, NULL,
+			 &tfw_alog_fops))
+		return -ENOMEM;
+	tfw_mod_register(&tfw_access_log_mod);
+
+	return 0;
+}
+
+void
+tfw_access_log_exit(void)
+{
+	tfw_mod_unregister(&tfw_access_log_mod);
+	remove_proc_entry(TFW_ALOG_PROC, NULL);
+}
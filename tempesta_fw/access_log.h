@@ -0,0 +1,117 @@
+/**
+ *		Tempesta FW
+ *
+ * Binary access log shared with user space.
+ *
+ * Copyright (C) 2020 Tempesta Technologies, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#ifndef __TFW_ACCESS_LOG_H__
+#define __TFW_ACCESS_LOG_H__
+
+#include <linux/types.h>
+
+/*
+ * The layout below is shared with user space readers and must be changed
+ * along with TFW_ALOG_VERSION only.
+ */
+#define TFW_ALOG_VERSION	1
+#define TFW_ALOG_VHOST_LEN	32
+
+/* Source of the response. */
+enum {
+	TFW_ALOG_SRC_UPSTREAM,
+	TFW_ALOG_SRC_CACHE,
+	TFW_ALOG_SRC_LOCAL,
+};
+
+/**
+ * Access log record.
+ *
+ * @ts		- time the response is sent at, nanoseconds since the Epoch;
+ * @bytes	- length of the response;
+ * @addr	- IPv6 (IPv4-mapped for IPv4) address of the client;
+ * @upstream	- address of the server, zero if the response isn't from
+ *		  a server;
+ * @vhost	- name of the virtual host, zero terminated if shorter than
+ *		  TFW_ALOG_VHOST_LEN;
+ * @latency	- time since the request is received, in microseconds with
+ *		  jiffy resolution;
+ * @status	- HTTP status code of the response;
+ * @upstream_port - port of @upstream in host byte order;
+ * @method	- request method, TFW_HTTP_METH_*;
+ * @src		- source of the response, TFW_ALOG_SRC_*;
+ */
+typedef struct {
+	__u64	ts;
+	__u64	bytes;
+	__u8	addr[16];
+	__u8	upstream[16];
+	char	vhost[TFW_ALOG_VHOST_LEN];
+	__u32	latency;
+	__u16	status;
+	__u16	upstream_port;
+	__u8	method;
+	__u8	src;
+	__u8	_pad[6];
+} TfwAccessLogRec;
+
+/**
+ * Header of a per-CPU ring buffer, the records start at the next page.
+ * The kernel only writes @head and @drops, the reader only writes @tail.
+ * The reader must read @head with acquire semantics and write @tail with
+ * release semantics after the records are consumed.
+ *
+ * @head	- number of the records ever written;
+ * @tail	- number of the records ever consumed;
+ * @drops	- number of the records dropped because the ring was full;
+ * @size	- number of the records in the ring, a power of two;
+ * @rec_size	- size of a record;
+ * @ring_size	- size of the ring mapping including the header page, the ring
+ *		  of CPU N is mapped at offset N * @ring_size;
+ * @version	- TFW_ALOG_VERSION;
+ */
+typedef struct {
+	__u64	head		__attribute__((aligned(64)));
+	__u64	tail		__attribute__((aligned(64)));
+	__u64	drops		__attribute__((aligned(64)));
+	__u32	size;
+	__u32	rec_size;
+	__u32	ring_size;
+	__u32	version;
+} TfwAccessLogHdr;
+
+#ifdef __KERNEL__
+
+#include "http.h"
+
+extern bool tfw_alog_enabled;
+
+void __tfw_access_log(TfwHttpReq *req, TfwHttpResp *resp);
+u64 tfw_access_log_drops(void);
+
+/*
+ * Log the response @resp to @req, which is about to be sent to the client.
+ */
+static inline void
+tfw_access_log(TfwHttpReq *req, TfwHttpResp *resp)
+{
+	if (unlikely(READ_ONCE(tfw_alog_enabled)))
+		__tfw_access_log(req, resp);
+}
+
+#endif /* __KERNEL__ */
+#endif /* __TFW_ACCESS_LOG_H__ */
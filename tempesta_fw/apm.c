@@ -21,8 +21,10 @@
 #include <linux/atomic.h>
 #include <linux/kernel.h>
 #include <linux/slab.h>
+#include <linux/sort.h>
 #include <linux/spinlock.h>
 #include <linux/stringify.h>
+#include <linux/workqueue.h>
 
 #if DBG_APM == 0
 #undef DEBUG
@@ -40,341 +42,199 @@
  * done by sacrificing the accuracy and giving possibly inexact answers
  * to questions asked by users. The main concepts and requirements are:
  *
- * 1. Small O(1) update time with only few conditions and cache line accesses;
+ * 1. Small O(1) update time with only few conditions and cache line accesses,
+ *    and no writes to memory shared with other CPUs;
  *
- * 2. Very fast O(1) calculation of several percentiles in parallel;
+ * 2. Fast calculation of several percentiles in parallel;
  *
- * 3. Very small overall memory footprint for inexpensive handling of
+ * 3. Small overall memory footprint for inexpensive handling of
  *    performance trends of many servers;
  *
- * 4. Buckets must be dynamically rearranged since server response times
- *    are unknown apriori;
+ * 4. Bounded relative error of the percentiles for any distribution of
+ *    response times, which are unknown apriori and may be multimodal.
  *
- * 5. The adjustments of buckets must be performed in a lock-less fashion
- *    in a multi-core environment;
- *
- * 6. If a user asks for Nth percentile, e.g. 75th, an inaccurate value
- *    may be returned that is in fact for a different percentile, e.g.
- *    81st. That is very possible if there is insufficient data for an
- *    accurate percentiles calculation.
+ * To meet the requirements response times are counted in a log-linear
+ * (HDR-like) histogram: each power of two range of values is split into
+ * 1 << tfw_apm_hbits buckets of the same width, while all the values
+ * below 2 << tfw_apm_hbits have a bucket of their own. So the relative
+ * error of a value is within 1 / (1 << tfw_apm_hbits), the histogram
+ * needs no adjustments, and bucket index calculation is a few bit
+ * operations.
  */
 
 /*
- * Response time statistics data structures.
- *
- * A time range is split into a number of buckets, such that each bucket
- * is efficiently calculated as @begin + (1 << @order).
+ * Response time histogram.
  *
- * @order	- The order of a range. The ranges grow logarithmically.
- *		  Motivation: time estimation error becomes negligible as
- *		  the time grows, so higher response times may be estimated
- *		  with less accuracy;
- * @begin	- the start response time value of a range;
- * @end		- the end response time value of a range;
- * @atomic	- atomic control handler to update all control fields
- * 		  above atomically with a single write operation;
- * @tot_cnt	- global hits counter for all ranges;
+ * @tot_cnt	- global hits counter for all buckets;
  * @tot_val	- the sum of all response time values, for AVG calculation;
  * @min_val	- the minimum response time value;
  * @max_val	- the maximum response time value;
- * @cnt		- the number of hits with a specific response time that
- *		  fall to a specific bucket in a range.
- *
- * Keep the members cache line aligned to minimize false sharing: each range
- * is placed on a separate cache line, and control handlers are also on their
- * own cache lines.
+ * @cnt		- the number of hits with a response time that falls to
+ *		  a specific bucket, tfw_apm_hbkts() buckets.
  */
-#define TFW_STATS_RANGES	4
-#define TFW_STATS_RLAST		(TFW_STATS_RANGES - 1)
-#define TFW_STATS_BCKTS_ORDER	4
-#define TFW_STATS_BCKTS		(1 << TFW_STATS_BCKTS_ORDER)
-
-#define TFW_STATS_RSPAN(order)		((TFW_STATS_BCKTS - 1) << (order))
-#define TFW_STATS_RSPAN_UL(order)	((TFW_STATS_BCKTS - 1UL) << (order))
-
-typedef struct {
-	unsigned int	order;
-	unsigned int	begin;
-	unsigned int	end;
-} TfwPcntCtl;
-
 typedef struct {
-	TfwPcntCtl	ctl[TFW_STATS_RANGES];
-	char		__reset_from[0];
 	unsigned long	tot_cnt;
 	unsigned long	tot_val;
-	unsigned long	min_val;
-	unsigned long	max_val;
-	unsigned long	cnt[TFW_STATS_RANGES][TFW_STATS_BCKTS];
-	char		__reset_till[0];
-} TfwPcntRanges __attribute__((aligned(L1_CACHE_BYTES)));
-
-static inline unsigned long *
-__rng(TfwPcntCtl *pc, unsigned long *cnt, unsigned int r_time)
+	unsigned int	min_val;
+	unsigned int	max_val;
+	unsigned int	cnt[0];
+} TfwPcntHist;
+
+/* Response times are counted up to (1 << TFW_APM_HIST_ORDER) - 1 ms. */
+#define TFW_APM_HIST_ORDER	17
+#define TFW_APM_HIST_MAX	((1U << TFW_APM_HIST_ORDER) - 1)
+#define TFW_APM_MIN_HBITS	2
+#define TFW_APM_MAX_HBITS	5
+#define TFW_APM_DFLT_HBITS	4
+
+static unsigned int tfw_apm_hbits;	/* Sub-buckets order. */
+
+static inline unsigned int
+tfw_apm_hbkts(void)
 {
-	if (r_time <= pc->begin)
-		return &cnt[0];
-	return &cnt[(r_time - pc->begin + ((1 << pc->order) - 1)) >> pc->order];
+	return (TFW_APM_HIST_ORDER - tfw_apm_hbits + 1) << tfw_apm_hbits;
 }
 
-static void
-__range_grow_right(TfwPcntRanges *rng, TfwPcntCtl *pc, int r)
+static inline size_t
+tfw_apm_hist_size(void)
 {
-	int i;
-
-	++pc->order;
-	pc->end = pc->begin + TFW_STATS_RSPAN(pc->order);
-
-	T_DBG3("  -- extend right bound of range %d to begin=%u order=%u"
-	       " end=%u\n", r, pc->begin, pc->order, pc->end);
-
-	/* Coalesce counters to buckets on the left half of the range. */
-	for (i = 0; i < TFW_STATS_BCKTS / 2; ++i)
-		rng->cnt[r][i] = rng->cnt[r][2 * i] + rng->cnt[r][2 * i + 1];
+	return sizeof(TfwPcntHist) + tfw_apm_hbkts() * sizeof(unsigned int);
 }
 
-static void
-__range_shrink_left(TfwPcntRanges *rng, TfwPcntCtl *pc, int r)
+/*
+ * Get the bucket index for the response time @r_time.
+ */
+static inline unsigned int
+tfw_stats_idx(unsigned int r_time)
 {
-	int i;
-	unsigned long cnt_full, cnt_half;
+	unsigned int shift;
 
-	--pc->order;
-	pc->begin = pc->end - TFW_STATS_RSPAN(pc->order);
+	if (r_time < (2U << tfw_apm_hbits))
+		return r_time;
+	r_time = min(r_time, TFW_APM_HIST_MAX);
+	shift = fls(r_time) - tfw_apm_hbits - 1;
 
-	T_DBG3("  -- shrink left bound of range %d to begin=%u order=%u"
-	       " end=%u\n", r, pc->begin, pc->order, pc->end);
-	/*
-	 * Write sum of the left half counters to the first bucket and equally
-	 * split counters of the right half among the rest of the buckets.
-	 */
-	for (i = 1; i < TFW_STATS_BCKTS / 2; ++i)
-		rng->cnt[r][0] += rng->cnt[r][i];
-	cnt_full = rng->cnt[r][TFW_STATS_BCKTS / 2];
-	cnt_half = cnt_full / 2;
-	rng->cnt[r][0] += cnt_half;
-	rng->cnt[r][1] = cnt_full - cnt_half;
-	for (i = 1; i < TFW_STATS_BCKTS / 2; ++i) {
-		cnt_full = rng->cnt[r][TFW_STATS_BCKTS / 2 + i];
-		cnt_half = cnt_full / 2;
-		rng->cnt[r][i * 2] = cnt_half;
-		rng->cnt[r][i * 2 + 1] = cnt_full - cnt_half;
-	}
+	return (shift << tfw_apm_hbits) + (r_time >> shift);
 }
 
-/**
- * Extend the last range so that larger response times can be handled.
+/*
+ * Get the largest response time counted in the bucket @idx.
  */
-static void
-tfw_stats_extend(TfwPcntRanges *rng, unsigned int r_time)
+static inline unsigned int
+tfw_stats_val(unsigned int idx)
 {
-	int i, b;
-	unsigned long end;
-	TfwPcntCtl *pc = &rng->ctl[TFW_STATS_RLAST];
-	unsigned int sum, parts, units, shift, order = pc->order;
+	unsigned int shift, sub = 1U << tfw_apm_hbits;
 
-	BUILD_BUG_ON_NOT_POWER_OF_2(TFW_STATS_BCKTS);
+	if (idx < 2 * sub)
+		return idx;
+	shift = (idx >> tfw_apm_hbits) - 1;
 
-	do {
-		++order;
-		end = pc->begin + TFW_STATS_RSPAN_UL(order);
-	} while (end < r_time);
-
-	/*
-	 * It's conceivable that the value of pc->end was already near
-	 * the upper end of the range that the data type could hold.
-	 * As the value was extended to the next order it's conceivable
-	 * that the new value exceeded the maximum for the data type.
-	 * Considering that TfwPcntCtl{}->end is of type unsigned int,
-	 * it's totally unimaginable that this situation may ever happen.
-	 */
-	BUG_ON(end >= (1UL << (FIELD_SIZEOF(TfwPcntCtl, end) * 8)));
-	pc->end = end;
-
-	shift = min_t(unsigned int, order - pc->order, TFW_STATS_BCKTS_ORDER);
-	units = 1 << shift;
-	parts = TFW_STATS_BCKTS >> shift;
-
-	pc->order = order;
-
-	T_DBG3("  -- extend last range to begin=%u order=%u end=%u\n",
-	       pc->begin, pc->order, pc->end);
-
-	/*
-	 * Coalesce counters to buckets on the left side of the range.
-	 * Clear the buckets that represent the new extended range.
-	 */
-	for (i = 0; i < parts; ++i) {
-		switch (units) {
-		case 2:
-			rng->cnt[TFW_STATS_RLAST][i] =
-				rng->cnt[TFW_STATS_RLAST][2 * i]
-				+ rng->cnt[TFW_STATS_RLAST][2 * i + 1];
-			break;
-		case 4:
-			rng->cnt[TFW_STATS_RLAST][i] =
-				rng->cnt[TFW_STATS_RLAST][4 * i]
-				+ rng->cnt[TFW_STATS_RLAST][4 * i + 1]
-				+ rng->cnt[TFW_STATS_RLAST][4 * i + 2]
-				+ rng->cnt[TFW_STATS_RLAST][4 * i + 3];
-			break;
-		default:
-			sum = 0;
-			for (b = i * units; b < (i + 1) * units; ++b)
-				sum += rng->cnt[TFW_STATS_RLAST][b];
-			rng->cnt[TFW_STATS_RLAST][i] = sum;
-			break;
-		}
-	}
-	memset(&rng->cnt[TFW_STATS_RLAST][parts], 0,
-	       sizeof(rng->cnt[0][0]) * (TFW_STATS_BCKTS - parts));
+	return (((idx & (sub - 1)) | sub) << shift) + (1U << shift) - 1;
 }
 
-/**
- * See if range @r contains large outliers. Adjust it if so.
- *
- * The leftmost bound is fixed to 1ms. The rightmost bound is only growing
- * to handle large values. So the adjustment may either increase the gaps
- * between ranges by decreasing a range order and moving left range bounds,
- * or decrease the gaps by increasing a range order and moving right range
- * bounds. I.e. ranges worm to the right and the algorithm converges at the
- * largest response time faced.
- */
-static void
-tfw_stats_adjust(TfwPcntRanges *rng, int r)
+static inline void
+tfw_stats_init(TfwPcntHist *hist)
 {
-	int i;
-	TfwPcntCtl *pc, *prepc;
-	unsigned long prend, cnt = 0, sum = 0, max = 0, i_max = 0;
-
-	BUG_ON(r == 0);
-
-	for (i = 0; i < TFW_STATS_BCKTS; ++i) {
-		if (rng->cnt[r][i]) {
-			sum += rng->cnt[r][i];
-			++cnt;
-		}
-		if (max < rng->cnt[r][i]) {
-			max = rng->cnt[r][i];
-			i_max = i;
-		}
-	}
-	BUG_ON(!cnt);
-
-	/* outlier means (max < avg * 2) */
-	if (likely(max <= sum * 2 / cnt))
-		return;
-
-	T_DBG3("  -- range %d has an outlier %lu (avg=%lu total=%lu) at"
-	       " bucket %lu\n", r, max, sum / cnt, sum, i_max);
-
-	/*
-	 * If too many hits fall in the gap between r'th and (r - 1)'th
-	 * ranges, and (r - 1)'th range can grow, then grow that range
-	 * and spread these hits evenly in the right half of (r - 1)'th
-	 * range as a rough approximation. Afterwards, move on to reduce
-	 * the range order. The first bucket gets a higher count. Since
-	 * the left bound has been moved, the right bound of (r - 1)'th
-	 * range will be moved next time.
-	 */
-	pc = &rng->ctl[r];
-	prepc = &rng->ctl[r - 1];
-	prend = prepc->begin + TFW_STATS_RSPAN_UL(prepc->order + 1);
-
-	if ((i_max == 0) && (prend < pc->begin)) {
-		__range_grow_right(rng, prepc, r - 1);
-
-		cnt = max / (TFW_STATS_BCKTS / 2 + 1);
-		rng->cnt[r][0] -= cnt * (TFW_STATS_BCKTS / 2);
-		for (i = TFW_STATS_BCKTS / 2; i < TFW_STATS_BCKTS; ++i)
-			rng->cnt[r - 1][i] = cnt;
-	}
-
-	/*
-	 * The range order is too big. Reduce it by moving the left bound.
-	 * If servers are too fast (all responses within 1ms), then there's
-	 * nothing to do here.
-	 */
-	if (likely(pc->order))
-		__range_shrink_left(rng, pc, r);
+	memset(hist, 0, tfw_apm_hist_size());
+	hist->min_val = UINT_MAX;
 }
 
 /*
- * Set the new maximum value.
- * Return true if the new value has been set.
- * Return false if the maximum value remained the same.
+ * Get the range [@beg, @end) of buckets, which may have hits in @hist with
+ * non-zero @tot_cnt. Response times are typically close to each other, so
+ * the range is much shorter than the whole histogram.
  */
-static inline bool
-tfw_stats_adj_max(TfwPcntRanges *rng, unsigned int r_time)
+static inline void
+tfw_stats_range(TfwPcntHist *hist, unsigned int *beg, unsigned int *end)
 {
-	if (r_time > rng->max_val) {
-		rng->max_val = r_time;
-		return true;
-	}
-	return false;
+	*beg = tfw_stats_idx(READ_ONCE(hist->min_val));
+	*end = tfw_stats_idx(READ_ONCE(hist->max_val)) + 1;
+	if (unlikely(*beg >= *end))
+		*beg = 0;
 }
 
 /*
- * Set the new minimum value.
- * Return true if the new value has been set.
- * Return false if the minimum value remained the same.
+ * Reset the buckets of @hist, which may have hits, only.
  */
-static inline bool
-tfw_stats_adj_min(TfwPcntRanges *rng, unsigned int r_time)
+static inline void
+tfw_stats_reset(TfwPcntHist *hist)
 {
-	if (r_time < rng->min_val) {
-		rng->min_val = r_time;
-		return true;
+	unsigned int b, e;
+
+	if (hist->tot_cnt) {
+		tfw_stats_range(hist, &b, &e);
+		memset(&hist->cnt[b], 0, (e - b) * sizeof(hist->cnt[0]));
 	}
-	return false;
+	hist->tot_cnt = 0;
+	hist->tot_val = 0;
+	hist->min_val = UINT_MAX;
+	hist->max_val = 0;
 }
 
 /**
  * Update server response time statistic.
  * @r_time is in milliseconds (1/HZ second), use jiffies to get it.
  */
-static void
-tfw_stats_update(TfwPcntRanges *rng, unsigned int r_time)
+static inline void
+tfw_stats_update(TfwPcntHist *hist, unsigned int r_time)
 {
-	TfwPcntCtl *pc3, *pc2 = &rng->ctl[2];
+	++hist->cnt[tfw_stats_idx(r_time)];
+	if (r_time < hist->min_val)
+		hist->min_val = r_time;
+	if (r_time > hist->max_val)
+		hist->max_val = r_time;
+	hist->tot_val += r_time;
+	++hist->tot_cnt;
+}
 
-	/* Binary search of an appropriate range. */
-	if (r_time <= pc2->end) {
-		TfwPcntCtl *pc0, *pc1 = &rng->ctl[1];
+static inline void
+__tfw_stats_minmax(TfwPcntHist *dst, TfwPcntHist *src)
+{
+	if (src->min_val < dst->min_val)
+		dst->min_val = src->min_val;
+	if (src->max_val > dst->max_val)
+		dst->max_val = src->max_val;
+}
 
-		if (r_time > pc1->end) {
-			++(*__rng(pc2, rng->cnt[2], r_time));
-			tfw_stats_adjust(rng, 2);
-			goto totals;
-		}
+/**
+ * Add the hits of @src histogram to both @dst and @win in one pass over the
+ * buckets of @src having hits. @win keeps the totals only, its minimum and
+ * maximum can't be maintained incrementally.
+ */
+static void
+tfw_stats_merge(TfwPcntHist *dst, TfwPcntHist *win, TfwPcntHist *src)
+{
+	unsigned int i, b, e;
+	unsigned long cnt = READ_ONCE(src->tot_cnt);
+	unsigned long val = READ_ONCE(src->tot_val);
 
-		pc0 = &rng->ctl[0];
-		BUG_ON(pc0->begin != 1); /* left bound is never moved */
-		if (r_time > pc0->end) {
-			++(*__rng(pc1, rng->cnt[1], r_time));
-			tfw_stats_adjust(rng, 1);
-			goto totals;
-		}
+	tfw_stats_range(src, &b, &e);
+	for (i = b; i < e; ++i) {
+		unsigned int c = src->cnt[i];
 
-		++(*__rng(pc0, rng->cnt[0], r_time));
-		goto totals;
+		dst->cnt[i] += c;
+		win->cnt[i] += c;
 	}
+	__tfw_stats_minmax(dst, src);
+	dst->tot_val += val;
+	dst->tot_cnt += cnt;
+	win->tot_val += val;
+	win->tot_cnt += cnt;
+}
 
-	pc3 = &rng->ctl[3];
-	if (unlikely(r_time > pc3->end))
-		tfw_stats_extend(rng, r_time);
-	++(*__rng(pc3, rng->cnt[3], r_time));
-	tfw_stats_adjust(rng, 3);
-
-totals:
-	/* Adjust min/max values. */
-	if (!tfw_stats_adj_min(rng, r_time))
-		tfw_stats_adj_max(rng, r_time);
-	/* Add to @tot_val for AVG calculation. */
-	rng->tot_val += r_time;
-	++rng->tot_cnt;
+/**
+ * Remove the hits of @src histogram from @win.
+ */
+static void
+tfw_stats_sub(TfwPcntHist *win, TfwPcntHist *src)
+{
+	unsigned int i, b, e;
 
-	return;
+	tfw_stats_range(src, &b, &e);
+	for (i = b; i < e; ++i)
+		win->cnt[i] -= src->cnt[i];
+	win->tot_val -= src->tot_val;
+	win->tot_cnt -= src->tot_cnt;
 }
 
 /* Time granularity for HTTP codes accounting during health monitoring. */
@@ -387,8 +247,9 @@ totals:
  * @name	- health monitor's name;
  * @url		- url for requests which will be used in health monitoring;
  * @urlsz	- length of @url string (without terminating zero);
- * @req		- full test request health monitoring;
- * @reqsz	- length of @req string (without terminating zero);
+ * @req		- skbs of the full test request, built once and shared by
+ *		  all the probes;
+ * @reqsz	- length of the @req data;
  * @crc32	- crc32 value for verification of response body checksum;
  * @codes	- pointer to HTTP response codes bitmap (signals that
  *		  backend server alive);
@@ -398,7 +259,7 @@ totals:
 typedef struct {
 	struct list_head	list;
 	char			*name;
-	char			*req;
+	struct sk_buff		*req;
 	unsigned long		reqsz;
 	char			*url;
 	int			urlsz;
@@ -493,46 +354,32 @@ static LIST_HEAD(tfw_hm_codes_list);
 /*
  * A ring buffer entry structure.
  *
- * @pcntrng	- Struct for response time data by the percentiles algorithm.
+ * @hist	- The response times histogram for the time interval.
  * @jtmistamp	- The start of the time interval for the current entry.
- * @reset	- The entry can be reset by one thread at a time.
  */
 typedef struct {
-	TfwPcntRanges	pcntrng;
+	TfwPcntHist	*hist;
 	unsigned long	jtmistamp;
-	atomic_t	reset;
 } TfwApmRBEnt;
 
 /*
  * The ring buffer structure.
  *
+ * The hits of all the entries are also summed up in @whist, which is updated
+ * incrementally: new hits are added to both an entry and @whist, and the
+ * hits of a reused entry are subtracted from @whist. So the percentiles are
+ * calculated in one pass over @whist instead of merging all the entries.
+ *
  * @rbent	- Array of ring buffer entries.
- * @slock	- The lock to adjust the ranges in the current entry.
  * @rbufsz	- The size of @rbent.
+ * @whist	- The sum of the histograms of @rbent.
  */
 typedef struct {
 	TfwApmRBEnt	*rbent;
-	spinlock_t	slock;
 	int		rbufsz;
+	TfwPcntHist	*whist;
 } TfwApmRBuf;
 
-/*
- * The ring buffer control structure.
- *
- * This is a supporting structure. It keeps related data that is useful
- * in making decisions on the need of recalculation of percentiles.
- *
- * @jtmwstamp	- The start of the time window the percentiles are for.
- * @entry_cnt	- The number of hits in the current buffer ring entry.
- * @total_cnt	- The number of hits within the current time window.
- */
-
-typedef struct {
-	unsigned long	jtmwstamp;
-	unsigned long	entry_cnt;
-	unsigned long	total_cnt;
-} TfwApmRBCtl;
-
 /*
  * The stats entry data structure.
  * Keeps the latest values of calculated percentiles.
@@ -566,44 +413,47 @@ typedef struct {
 } TfwApmStats;
 
 /*
- * An update buffer entry that holds RTT data for updates.
+ * The buffer that holds RTT data for updates, per CPU.
  *
- * The value of @centry depends on @jtstamp that comes as part of data
- * for the update. Ideally, @jtstamp and @rtt would be stored instead
- * of @centry and @rtt. However, together they occupy more than 64 bits,
- * and it's highly desirable to read/write them in a single operation.
+ * The response times are counted in a histogram per CPU, so the updates
+ * don't write to shared memory. The histograms are periodically merged
+ * into the ring buffer, and then the percentiles are recalculated, by
+ * a single thread, which removes concurrency between updates and the
+ * calculation. The updates are counted in one histogram of the two,
+ * while the processing thread merges and resets the other one. The
+ * switch between these two histograms is managed by way of @counter by
+ * the processing thread.
  *
- * @centry	- The entry number in the array of ring buffer entries.
- * @rtt		- The RTT of the message, in milliseconds.
+ * @hist	- The histograms for updates (flip-flop manner).
+ * @counter	- The counter that controls which @hist to use.
  */
-typedef union {
-	struct {
-		unsigned int	centry;
-		unsigned int	rtt;
-	} __attribute__((packed));
-	uint64_t		data;
-} TfwApmUBEnt;
+typedef struct {
+	TfwPcntHist	*hist[2];
+	atomic64_t	counter;
+} TfwApmUBuf;
 
 /*
- * The buffer that holds RTT data for updates, per CPU.
+ * Passive outlier detection data of a server.
  *
- * The data for an update is stored in an array per CPU. The actual
- * updates,and then the percentile recalculation is done periodically
- * by a single thread, which removes concurrency between updates and
- * the calculation. The data for an update is stored in one array of
- * the two, while the processing thread processes the accumulated
- * data in the other array. The switch between these two arrays is
- * managed by way of @counter by the processing thread.
+ * The data is updated on each response from several CPUs concurrently
+ * without locking, so a few samples may be lost. That's acceptable for
+ * a moving average.
  *
- * @ubent	- Arrays of ring buffer entries (flip-flop manner).
- * @ubufsz	- The size of @ubent.
- * @counter	- The counter that controls which @ubent to use.
+ * @rtt		- EWMA of the response time, ms << TFW_APM_EWMA_SHIFT;
+ * @err		- EWMA of the errors rate, 1/TFW_APM_OLR_ERR_SCALE units
+ *		  << TFW_APM_EWMA_SHIFT;
+ * @cnt		- number of samples since the last reset;
+ * @jeject	- time (in jiffies) when the current ejection ends or, for
+ *		  not ejected servers, the last ejection time backoff step;
+ * @eject_n	- order of the ejection time backoff;
  */
 typedef struct {
-	TfwApmUBEnt	*ubent[2];
-	size_t		ubufsz;
-	atomic64_t	counter;
-} TfwApmUBuf;
+	unsigned long		rtt;
+	unsigned long		err;
+	unsigned long		cnt;
+	unsigned long		jeject;
+	unsigned int		eject_n;
+} TfwApmOutlier;
 
 /*
  * APM Data structure.
@@ -615,104 +465,57 @@ typedef struct {
  * then the data may need to be organized differently.
  *
  * @rbuf	- The ring buffer for the specified time window.
- * @rbctl	- The control data helpful in taking optimizations.
  * @stats	- The latest percentiles.
  * @ubuf	- The buffer that holds data for updates, per CPU.
- * @timer	- The periodic timer handle.
- * @flags	- The atomic flags (see below).
+ * @list	- The entry in the list of the calculation shard.
+ * @shard	- The calculation shard processing the data.
+ * @hmctl	- The health monitor control data.
+ * @olr		- The passive outlier detection data.
  */
-#define TFW_APM_DATA_F_REARM	(0x0001)	/* Re-arm the timer. */
-
 #define TFW_APM_TIMER_INTVL	(HZ / 20)
-#define TFW_APM_UBUF_SZ		TFW_APM_TIMER_INTVL	/* a slot per ms. */
+
+typedef struct tfw_apm_shard_t TfwApmShard;
 
 typedef struct {
 	TfwApmRBuf		rbuf;
-	TfwApmRBCtl		rbctl;
 	TfwApmStats		stats;
 	TfwApmUBuf __percpu	*ubuf;
-	struct timer_list	timer;
-	unsigned long		flags;
+	struct list_head	list;
+	TfwApmShard		*shard;
 	TfwApmHMCtl		hmctl;
+	TfwApmOutlier		olr;
 } TfwApmData;
 
 /*
- * [1ms, 349ms] should be sufficient for almost any installation,
- * including cross atlantic.
+ * The percentiles of all the APM data are calculated in batches by per-CPU
+ * timers instead of a timer for each server: the data are spread over the
+ * online CPUs on creation and each timer walks the list of its CPU data at
+ * the same tick. This way thousands of servers don't make thousands of timer
+ * callbacks on a single CPU.
+ *
+ * @list	- The APM data processed by the shard.
+ * @lock	- Protects @list.
+ * @timer	- The timer processing @list, armed while @list is non-empty.
+ * @cpu		- The CPU of the shard.
  */
-static const TfwPcntCtl tfw_rngctl_init[TFW_STATS_RANGES] = {
-	{0, 1, 16},
-	{1, 17, 47},
-	{2, 48, 108},
-	{4, 109, 349}
+struct tfw_apm_shard_t {
+	struct list_head	list;
+	spinlock_t		lock;
+	struct timer_list	timer;
+	int			cpu;
 };
 
+static DEFINE_PER_CPU(TfwApmShard, tfw_apm_shards);
+
 static int tfw_apm_jtmwindow;		/* Time window in jiffies. */
 static int tfw_apm_jtmintrvl;		/* Time interval in jiffies. */
 static int tfw_apm_tmwscale;		/* Time window scale. */
 
-/*
- * Get the next bucket in the ring buffer entry that has a non-zero
- * hits count. Set the bucket's sequential number, the range number,
- * and the bucket number. Set the response time value for the bucket.
- */
-/*
- * Ring buffer entry state structure.
- *
- * @v	- The response time value.
- * @i	- The current sequential bucket number across all ranges.
- * @r	- The current range number.
- * @b	- The current bucket number.
- */
-typedef struct {
-	u16	v;
-	u8	i;
-	u8	r : 4;
-	u8	b : 4;
-} __attribute__((packed)) TfwApmRBEState;
-
-static inline void
-__tfw_apm_state_set(TfwApmRBEState *st, u16 v, u8 i, u8 r, u8 b)
-{
-	st->v = v;
-	st->i = i;
-	st->r = r;
-	st->b = b;
-}
-
-static inline void
-__tfw_apm_state_next(TfwPcntRanges *rng, TfwApmRBEState *st)
-{
-	int i = st->i, r, b;
-	unsigned int rtt;
-
-	for (r = i / TFW_STATS_BCKTS; r < TFW_STATS_RANGES; ++r) {
-		for (b = i % TFW_STATS_BCKTS; b < TFW_STATS_BCKTS; ++b, ++i) {
-			if (!rng->cnt[r][b])
-				continue;
-			rtt = rng->ctl[r].begin + (b << rng->ctl[r].order);
-			__tfw_apm_state_set(st, rtt, i, r, b);
-			return;
-		}
-	}
-	__tfw_apm_state_set(st, USHRT_MAX, TFW_STATS_RANGES * TFW_STATS_BCKTS,
-					   TFW_STATS_RANGES, TFW_STATS_BCKTS);
-}
-
-static inline void
-tfw_apm_state_next(TfwPcntRanges *rng, TfwApmRBEState *st)
-{
-	BUG_ON(st->i >= TFW_STATS_RANGES * TFW_STATS_BCKTS);
-
-	++st->i;
-	__tfw_apm_state_next(rng, st);
-}
-
 /*
  * Calculate the latest percentiles from the current stats data.
  */
 static void
-tfw_apm_prnctl_calc(TfwApmRBuf *rbuf, TfwApmRBCtl *rbctl, TfwPrcntlStats *pstats)
+tfw_apm_prnctl_calc(TfwApmRBuf *rbuf, TfwPrcntlStats *pstats)
 {
 #define IDX_MIN		TFW_PSTATS_IDX_MIN
 #define IDX_MAX		TFW_PSTATS_IDX_MAX
@@ -720,53 +523,48 @@ tfw_apm_prnctl_calc(TfwApmRBuf *rbuf, TfwApmRBCtl *rbctl, TfwPrcntlStats *pstats
 #define IDX_ITH		TFW_PSTATS_IDX_ITH
 
 	int i, p;
-	unsigned long cnt = 0, val, pval[pstats->psz];
-	TfwApmRBEState st[rbuf->rbufsz];
-	TfwPcntRanges *pcntrng;
+	unsigned int b, e;
+	unsigned long cnt, pval[pstats->psz];
+	TfwPcntHist *whist = rbuf->whist;
 	TfwApmRBEnt *rbent = rbuf->rbent;
 
+	pstats->val[IDX_MAX] = 0;
+	pstats->val[IDX_MIN] = UINT_MAX;
 	for (i = 0; i < rbuf->rbufsz; i++) {
-		pcntrng = &rbent[i].pcntrng;
-		__tfw_apm_state_set(&st[i], pcntrng->ctl[0].begin, 0, 0, 0);
-		__tfw_apm_state_next(pcntrng, &st[i]);
+		TfwPcntHist *h = rbent[i].hist;
+
+		if (!h->tot_cnt)
+			continue;
+		if (pstats->val[IDX_MIN] > h->min_val)
+			pstats->val[IDX_MIN] = h->min_val;
+		if (pstats->val[IDX_MAX] < h->max_val)
+			pstats->val[IDX_MAX] = h->max_val;
 	}
+	if (likely(whist->tot_cnt))
+		pstats->val[IDX_AVG] = whist->tot_val / whist->tot_cnt;
+
 	/* The number of items to collect for each percentile. */
 	for (i = p = IDX_ITH; i < pstats->psz; ++i) {
-		pval[i] = rbctl->total_cnt * pstats->ith[i] / 100;
+		pval[i] = whist->tot_cnt * pstats->ith[i] / 100;
 		if (!pval[i])
 			pstats->val[p++] = 0;
 	}
-	while (p < pstats->psz) {
-		int v_min = USHRT_MAX;
-		for (i = 0; i < rbuf->rbufsz; i++) {
-			if (st[i].v < v_min)
-				v_min = st[i].v;
-		}
-		BUG_ON(v_min == USHRT_MAX);
-		for (i = 0; i < rbuf->rbufsz; i++) {
-			if (st[i].v != v_min)
-				continue;
-			pcntrng = &rbent[i].pcntrng;
-			cnt += pcntrng->cnt[st[i].r][st[i].b];
-			tfw_apm_state_next(pcntrng, &st[i]);
-		}
+	/*
+	 * Only the buckets between the minimum and the maximum of the window
+	 * may have hits. The bucket value is the largest one for the bucket,
+	 * so don't report it above the maximum actually seen.
+	 */
+	b = tfw_stats_idx(pstats->val[IDX_MIN]);
+	e = tfw_stats_idx(pstats->val[IDX_MAX]) + 1;
+	for (cnt = 0; b < e && p < pstats->psz; ++b) {
+		cnt += whist->cnt[b];
 		for ( ; p < pstats->psz && pval[p] <= cnt; ++p)
-			pstats->val[p] = v_min;
-	}
-	cnt = val = 0;
-	pstats->val[IDX_MAX] = 0;
-	pstats->val[IDX_MIN] = UINT_MAX;
-	for (i = 0; i < rbuf->rbufsz; i++) {
-		pcntrng = &rbent[i].pcntrng;
-		if (pstats->val[IDX_MIN] > pcntrng->min_val)
-			pstats->val[IDX_MIN] = pcntrng->min_val;
-		if (pstats->val[IDX_MAX] < pcntrng->max_val)
-			pstats->val[IDX_MAX] = pcntrng->max_val;
-		cnt += pcntrng->tot_cnt;
-		val += pcntrng->tot_val;
+			pstats->val[p] = min(tfw_stats_val(b),
+					     pstats->val[IDX_MAX]);
 	}
-	if (likely(cnt))
-		pstats->val[IDX_AVG] = val / cnt;
+	/* Some updates may be counted in the totals, but not in buckets. */
+	for ( ; p < pstats->psz; ++p)
+		pstats->val[p] = pstats->val[IDX_MAX];
 
 #undef IDX_ITH
 #undef IDX_AVG
@@ -775,108 +573,31 @@ tfw_apm_prnctl_calc(TfwApmRBuf *rbuf, TfwApmRBCtl *rbctl, TfwPrcntlStats *pstats
 }
 
 /*
- * Reset a ring buffer entry.
- * Note that the ranges are not reset. As Tempesta runs the ranges
- * are adjusted to reflect the actual response time values.
- */
-static inline void
-__tfw_apm_rbent_reset(TfwApmRBEnt *crbent, unsigned long jtmistamp)
-{
-	memset(crbent->pcntrng.__reset_from, 0,
-	       offsetof(TfwPcntRanges, __reset_till)
-	       - offsetof(TfwPcntRanges, __reset_from));
-	crbent->pcntrng.min_val = UINT_MAX;
-	crbent->jtmistamp = jtmistamp;
-	smp_mb__before_atomic();
-	atomic_set(&crbent->reset, 1);
-}
-
-/*
- * Reset a ring buffer entry if it needs to be reused. Only one thread
- * proceeds to reset the entry. While the entry is being reset a number
- * of stats updates may be lost. That's acceptable.
+ * Reset a ring buffer entry if it needs to be reused and remove its hits
+ * from the time window. Only the thread processing the updates resets
+ * entries. Return true if the time window has changed.
  */
-static inline void
-tfw_apm_rbent_checkreset(TfwApmRBEnt *crbent, unsigned long jtmistamp)
-{
-	if (crbent->jtmistamp != jtmistamp) {
-		if (!atomic_dec_and_test(&crbent->reset))
-			return;
-		__tfw_apm_rbent_reset(crbent, jtmistamp);
-	}
-}
-
-/*
- * Update the control information on the APM ring buffer entries with
- * stats for subsequent calculation of percentiles. Use optimizations
- * to avoid the recalculation whenever possible. Maintain values of
- * @entry_cnt, @total_cnt, @jtmwstamp that are used in optimizations.
- *
- * Return true if recalculation of percentiles is required.
- * Return false if the percentile values don't need the recalculation.
- */
-static bool
-tfw_apm_rbctl_update(TfwApmData *data)
+static inline bool
+tfw_apm_rbent_checkreset(TfwApmRBuf *rbuf, TfwApmRBEnt *crbent,
+			 unsigned long jtmistamp)
 {
-	int i, centry;
-	unsigned long jtmnow = jiffies;
-	unsigned long jtmwstart, jtmistart;
-	unsigned long entry_cnt, total_cnt = 0;
-	TfwApmRBuf *rbuf = &data->rbuf;
-	TfwApmRBCtl *rbctl = &data->rbctl;
-	TfwApmRBEnt *rbent = rbuf->rbent;
-
-	/* The start of the current time interval. */
-	jtmistart = jtmnow - (jtmnow % tfw_apm_jtmintrvl);
-	/* The start of the current time window. */
-	jtmwstart = jtmistart - tfw_apm_jtmwindow;
-	/* The index of the current entry. */
-	centry = (jtmnow / tfw_apm_jtmintrvl) % rbuf->rbufsz;
+	bool changed;
 
-	/*
-	 * If the latest percentiles are for a different time window,
-	 * then a recalculation is in order.
-	 */
-	if (unlikely(rbctl->jtmwstamp != jtmwstart)) {
-		tfw_apm_rbent_checkreset(&rbent[centry], jtmistart);
-
-		for (i = 0; i < rbuf->rbufsz; ++i)
-			total_cnt += rbent[i].pcntrng.tot_cnt;
-		entry_cnt = rbent[centry].pcntrng.tot_cnt;
-
-		rbctl->entry_cnt = entry_cnt;
-		rbctl->total_cnt = total_cnt;
-		rbctl->jtmwstamp = jtmwstart;
-
-		T_DBG3("%s: New time window: centry [%d] total_cnt [%lu]\n",
-		       __func__, centry, rbctl->total_cnt);
-
-		return true;
-	}
-
-	/* The latest percentiles are for the current time window.
-	 * In some cases a recalculation is not required. In some
-	 * other cases the recalculation set up can be simpler.
-	 */
-
-	/* Nothing to do if there were no stats updates. */
-	entry_cnt = rbent[centry].pcntrng.tot_cnt;
-	if (unlikely(rbctl->entry_cnt == entry_cnt))
+	if (crbent->jtmistamp == jtmistamp)
 		return false;
-	BUG_ON(rbctl->entry_cnt > entry_cnt);
-
-	/* Update the counts incrementally. */
-	rbctl->total_cnt += entry_cnt - rbctl->entry_cnt;
-	rbctl->entry_cnt = entry_cnt;
 
-	T_DBG3("%s: Old time window: centry [%d] total_cnt [%lu]\n",
-	       __func__, centry, rbctl->total_cnt);
+	changed = crbent->hist->tot_cnt;
+	if (changed) {
+		tfw_stats_sub(rbuf->whist, crbent->hist);
+		tfw_stats_reset(crbent->hist);
+	}
+	crbent->jtmistamp = jtmistamp;
 
-	return true;
+	return changed;
 }
 
 /*
- * Calculate the latest percentiles if necessary.
+ * Store the latest percentiles calculated from the current time window.
  */
 static void
 tfw_apm_calc(TfwApmData *data)
@@ -893,9 +614,7 @@ tfw_apm_calc(TfwApmData *data)
 	rdidx = atomic_read(&data->stats.rdidx);
 	asent = &data->stats.asent[(rdidx + 1) % 2];
 
-	if (!tfw_apm_rbctl_update(data))
-		return;
-	tfw_apm_prnctl_calc(&data->rbuf, &data->rbctl, &pstats);
+	tfw_apm_prnctl_calc(&data->rbuf, &pstats);
 
 	T_DBG3("%s: Percentile values may have changed.\n", __func__);
 	write_lock(&asent->rwlock);
@@ -903,8 +622,6 @@ tfw_apm_calc(TfwApmData *data)
 		    asent->pstats.psz * sizeof(asent->pstats.val[0]));
 	atomic_inc(&data->stats.rdidx);
 	write_unlock(&asent->rwlock);
-
-	return;
 }
 
 /*
@@ -969,44 +686,120 @@ tfw_apm_pstats_verify(TfwPrcntlStats *pstats)
 }
 
 /*
- * Calculate the latest percentiles if necessary.
- * Runs periodically on timer.
+ * Merge the updates to the current time interval and calculate the latest
+ * percentiles if there are any changes in the time window.
  */
 static void
-tfw_apm_prcntl_tmfn(unsigned long fndata)
+tfw_apm_prcntl_update(TfwApmData *data, unsigned long jtmnow)
 {
-	int i, icpu;
-	TfwApmData *data = (TfwApmData *)fndata;
+	int icpu;
+	bool changed;
 	TfwApmRBuf *rbuf = &data->rbuf;
-	TfwApmRBEnt *rbent = rbuf->rbent;
+	unsigned long jtmistart = jtmnow - (jtmnow % tfw_apm_jtmintrvl);
+	TfwApmRBEnt *crbent;
 
-	BUG_ON(!fndata);
+	/*
+	 * The updates are accounted to the time interval in which they're
+	 * processed, i.e. at most TFW_APM_TIMER_INTVL late.
+	 */
+	crbent = &rbuf->rbent[(jtmnow / tfw_apm_jtmintrvl) % rbuf->rbufsz];
+	changed = tfw_apm_rbent_checkreset(rbuf, crbent, jtmistart);
 
 	/*
-	 * Increment the counter and make the updates use the other array
-	 * of the two that are available. In the meanwhile, use the array
-	 * filled with updates to process them and calculate percentiles.
+	 * Increment the counter and make the updates use the other histogram
+	 * of the two that are available. In the meanwhile, merge the histogram
+	 * filled with updates to calculate percentiles.
 	 */
 	for_each_online_cpu(icpu) {
 		TfwApmUBuf *ubuf = per_cpu_ptr(data->ubuf, icpu);
 		unsigned long idxval = atomic64_inc_return(&ubuf->counter);
-		TfwApmUBEnt *ubent = ubuf->ubent[(idxval - 1) % 2];
-		TfwApmUBEnt rtt_data;
-
-		for (i = 0; i < ubuf->ubufsz; ++i) {
-			rtt_data.data = READ_ONCE(ubent[i].data);
-			if (rtt_data.data == ULONG_MAX)
-				continue;
-			WRITE_ONCE(ubent[i].data, ULONG_MAX);
-			tfw_stats_update(&rbent[rtt_data.centry].pcntrng,
-					 rtt_data.rtt);
-		}
+		TfwPcntHist *hist = ubuf->hist[(idxval - 1) % 2];
+
+		if (!READ_ONCE(hist->tot_cnt))
+			continue;
+		tfw_stats_merge(crbent->hist, rbuf->whist, hist);
+		tfw_stats_reset(hist);
+		changed = true;
 	}
-	tfw_apm_calc(data);
 
-	smp_mb();
-	if (test_bit(TFW_APM_DATA_F_REARM, &data->flags))
-		mod_timer(&data->timer, jiffies + TFW_APM_TIMER_INTVL);
+	if (changed)
+		tfw_apm_calc(data);
+}
+
+/*
+ * Process all the APM data of the shard. Runs periodically on timer.
+ */
+static void
+tfw_apm_shard_tmfn(unsigned long fndata)
+{
+	TfwApmShard *sh = (TfwApmShard *)fndata;
+	TfwApmData *data;
+	unsigned long jtmnow = jiffies;
+
+	spin_lock(&sh->lock);
+
+	list_for_each_entry(data, &sh->list, list)
+		tfw_apm_prcntl_update(data, jtmnow);
+	if (!list_empty(&sh->list))
+		mod_timer(&sh->timer, jiffies + TFW_APM_TIMER_INTVL);
+
+	spin_unlock(&sh->lock);
+}
+
+/*
+ * Add @data to the shard of the next online CPU, round robin.
+ */
+static void
+tfw_apm_shard_add(TfwApmData *data)
+{
+	static atomic_t next = ATOMIC_INIT(0);
+	int cpu, n = atomic_inc_return(&next) % num_online_cpus();
+	TfwApmShard *sh;
+
+	for_each_online_cpu(cpu)
+		if (!n--)
+			break;
+	if (cpu >= nr_cpu_ids)
+		cpu = cpumask_first(cpu_online_mask);
+	sh = per_cpu_ptr(&tfw_apm_shards, cpu);
+
+	spin_lock_bh(&sh->lock);
+	data->shard = sh;
+	list_add_tail(&data->list, &sh->list);
+	if (!timer_pending(&sh->timer)) {
+		sh->timer.expires = jiffies + TFW_APM_TIMER_INTVL;
+		add_timer_on(&sh->timer, sh->cpu);
+	}
+	spin_unlock_bh(&sh->lock);
+}
+
+/*
+ * Remove @data from its shard. The shard timer processes its data under
+ * the lock, so the data isn't accessed by the timer after the removal.
+ */
+static void
+tfw_apm_shard_del(TfwApmData *data)
+{
+	TfwApmShard *sh = data->shard;
+
+	spin_lock_bh(&sh->lock);
+	list_del(&data->list);
+	spin_unlock_bh(&sh->lock);
+}
+
+/*
+ * Arm the health monitoring timer of @hmctl. The expiration time is rounded
+ * to a whole second with a per-CPU skew, so the timers of all the servers
+ * armed on the same CPU fire at the same tick and their probes are sent in
+ * one batch instead of waking up the CPU for each server.
+ */
+static void
+tfw_apm_hm_timer_arm(TfwApmHMCtl *hmctl, TfwApmHM *hm)
+{
+	unsigned long exp = round_jiffies(jiffies + hm->tmt * HZ);
+
+	mod_timer(&hmctl->timer, exp);
+	WRITE_ONCE(hmctl->jtmstamp, exp - hm->tmt * HZ);
 }
 
 /*
@@ -1019,7 +812,6 @@ tfw_apm_hm_timer_cb(unsigned long data)
 	TfwServer *srv = (TfwServer *)data;
 	TfwApmData *apmdata = (TfwApmData *)srv->apmref;
 	TfwApmHM *hm = READ_ONCE(apmdata->hmctl.hm);
-	unsigned long now;
 
 	BUG_ON(!hm);
 	if (!atomic64_read(&apmdata->hmctl.rcount))
@@ -1029,33 +821,231 @@ tfw_apm_hm_timer_cb(unsigned long data)
 
 	smp_mb();
 	if (atomic_read(&apmdata->hmctl.rearm)) {
-		now = jiffies;
-		mod_timer(&apmdata->hmctl.timer, now + hm->tmt * HZ);
-		WRITE_ONCE(apmdata->hmctl.jtmstamp, now);
+		tfw_apm_hm_timer_arm(&apmdata->hmctl, hm);
 		return;
 	}
 	WRITE_ONCE(apmdata->hmctl.jtmstamp, 0);
 }
 
 static void
-__tfw_apm_update(TfwApmData *data, unsigned long jtstamp, unsigned int rtt)
+__tfw_apm_update(TfwApmData *data, unsigned int rtt)
 {
 	TfwApmUBuf *ubuf = this_cpu_ptr(data->ubuf);
 	unsigned long idxval = atomic64_add_return(0, &ubuf->counter);
-	TfwApmUBEnt *ubent = ubuf->ubent[idxval % 2];
-	int centry = (jtstamp / tfw_apm_jtmintrvl) % data->rbuf.rbufsz;
-	unsigned long jtmistart = jtstamp - (jtstamp % tfw_apm_jtmintrvl);
-	TfwApmUBEnt rtt_data = { .centry = centry, .rtt = rtt };
 
-	tfw_apm_rbent_checkreset(&data->rbuf.rbent[centry], jtmistart);
-	WRITE_ONCE(ubent[jtstamp % ubuf->ubufsz].data, rtt_data.data);
+	tfw_stats_update(ubuf->hist[idxval % 2], rtt);
+}
+
+/*
+ * Passive outlier detection.
+ *
+ * APM keeps exponentially weighted moving averages of the response time
+ * and of the rate of 5xx responses and connection errors for each server.
+ * Once per interval the averages of each server are compared with the
+ * medians of its group, and a server that exceeds a median by more than
+ * the configured factor is ejected: it's excluded from scheduling for the
+ * ejection time. The ejection time doubles with each repeated ejection, up
+ * to the configured maximum, and gets back by one step for each ejection
+ * time period the server behaves well. No more than a half of a group can
+ * be ejected at once.
+ *
+ * The medians make sense for a group only, while groups can't be traversed
+ * in SoftIRQ, so the check runs in a work queue.
+ */
+#define TFW_APM_EWMA_SHIFT	5	/* New samples weigh 1/32. */
+#define TFW_APM_OLR_INTVL	HZ
+#define TFW_APM_OLR_ERR_SCALE	1000
+#define TFW_APM_OLR_MIN_CNT	(1 << TFW_APM_EWMA_SHIFT)
+/* Servers with lower errors rate aren't ejected, 5%. */
+#define TFW_APM_OLR_MIN_ERR	(50 << TFW_APM_EWMA_SHIFT)
+#define TFW_APM_OLR_MAX_ORDER	16
+
+static unsigned int tfw_apm_olr_factor;		/* 0 if disabled. */
+static unsigned long tfw_apm_olr_jtime;		/* Ejection time. */
+static unsigned long tfw_apm_olr_jtime_max;	/* Maximum ejection time. */
+static bool tfw_apm_olr_rearm;
+
+static void tfw_apm_olr_wfn(struct work_struct *work);
+static DECLARE_DELAYED_WORK(tfw_apm_olr_work, tfw_apm_olr_wfn);
+
+static inline void
+__tfw_apm_ewma(unsigned long *avg, unsigned long cnt, unsigned long val)
+{
+	unsigned long a = READ_ONCE(*avg);
+
+	WRITE_ONCE(*avg, cnt ? a + val - (a >> TFW_APM_EWMA_SHIFT)
+			     : val << TFW_APM_EWMA_SHIFT);
+}
+
+/**
+ * Account a response from the server or a failed connection to it in the
+ * errors rate: @err is true for 5xx responses and connection errors.
+ */
+void
+tfw_apm_update_err(void *apmref, bool err)
+{
+	TfwApmOutlier *olr = &((TfwApmData *)apmref)->olr;
+	unsigned long cnt;
+
+	if (likely(!tfw_apm_olr_factor))
+		return;
+
+	cnt = READ_ONCE(olr->cnt);
+	__tfw_apm_ewma(&olr->err, cnt, err ? TFW_APM_OLR_ERR_SCALE : 0);
+	WRITE_ONCE(olr->cnt, cnt + 1);
+}
+
+static void
+tfw_apm_olr_update_rtt(TfwApmData *data, unsigned int rtt)
+{
+	TfwApmOutlier *olr = &data->olr;
+
+	if (likely(!tfw_apm_olr_factor))
+		return;
+
+	__tfw_apm_ewma(&olr->rtt, READ_ONCE(olr->cnt), rtt);
+}
+
+static inline bool
+tfw_apm_olr_is_outlier(TfwApmOutlier *olr, unsigned long rtt_med,
+		       unsigned long err_med)
+{
+	unsigned long err = READ_ONCE(olr->err);
+
+	return (rtt_med && READ_ONCE(olr->rtt) > rtt_med * tfw_apm_olr_factor)
+	       || (err > TFW_APM_OLR_MIN_ERR
+		   && err > err_med * tfw_apm_olr_factor);
+}
+
+static void
+tfw_apm_olr_eject(TfwServer *srv, TfwApmOutlier *olr)
+{
+	unsigned long jtime = min(tfw_apm_olr_jtime << olr->eject_n,
+				  tfw_apm_olr_jtime_max);
+
+	if (jtime < tfw_apm_olr_jtime_max
+	    && olr->eject_n < TFW_APM_OLR_MAX_ORDER)
+		++olr->eject_n;
+	olr->jeject = jiffies + jtime;
+	set_bit(TFW_SRV_B_EJECT, &srv->flags);
+
+	T_WARN_ADDR("server has been ejected as an outlier", &srv->addr,
+		    TFW_WITH_PORT);
+}
+
+/*
+ * The ejection is over. The collected stats are outdated, so start from
+ * scratch, and let the server warm up after the pause.
+ */
+static void
+tfw_apm_olr_release(TfwServer *srv, TfwApmOutlier *olr)
+{
+	WRITE_ONCE(olr->cnt, 0);
+	olr->jeject = jiffies;
+	clear_bit(TFW_SRV_B_EJECT, &srv->flags);
+	tfw_srv_slow_start(srv);
+
+	T_LOG_ADDR("ejected server is back", &srv->addr, TFW_WITH_PORT);
+}
+
+static int
+tfw_apm_olr_cmp(const void *l, const void *r)
+{
+	unsigned long a = *(unsigned long *)l, b = *(unsigned long *)r;
+
+	return (a < b) ? -1 : (a > b);
+}
+
+static int
+tfw_apm_olr_check_sg(TfwSrvGroup *sg)
+{
+	TfwServer *srv;
+	TfwApmOutlier *olr;
+	unsigned long *rtt, *err, rtt_med, err_med, now = jiffies;
+	size_t n = 0, ejected = 0;
+
+	if (sg->srv_n < 2)
+		return 0;
+	if (!(rtt = kmalloc_array(sg->srv_n * 2, sizeof(*rtt), GFP_KERNEL)))
+		return 0;
+	err = rtt + sg->srv_n;
+
+	list_for_each_entry(srv, &sg->srv_list, list) {
+		if (!srv->apmref)
+			continue;
+		olr = &((TfwApmData *)srv->apmref)->olr;
+		if (test_bit(TFW_SRV_B_EJECT, &srv->flags)) {
+			if (time_before(now, olr->jeject))
+				++ejected;
+			else
+				tfw_apm_olr_release(srv, olr);
+			continue;
+		}
+		if (READ_ONCE(olr->cnt) < TFW_APM_OLR_MIN_CNT)
+			continue;
+		rtt[n] = READ_ONCE(olr->rtt);
+		err[n++] = READ_ONCE(olr->err);
+	}
+	if (n < 2)
+		goto out;
+	/* Take the lower median for even number of servers. */
+	sort(rtt, n, sizeof(*rtt), tfw_apm_olr_cmp, NULL);
+	sort(err, n, sizeof(*err), tfw_apm_olr_cmp, NULL);
+	rtt_med = rtt[(n - 1) / 2];
+	err_med = err[(n - 1) / 2];
+
+	list_for_each_entry(srv, &sg->srv_list, list) {
+		if (!srv->apmref || test_bit(TFW_SRV_B_EJECT, &srv->flags))
+			continue;
+		olr = &((TfwApmData *)srv->apmref)->olr;
+		if (READ_ONCE(olr->cnt) < TFW_APM_OLR_MIN_CNT)
+			continue;
+		if (!tfw_apm_olr_is_outlier(olr, rtt_med, err_med)) {
+			if (olr->eject_n
+			    && time_after(now, olr->jeject + tfw_apm_olr_jtime))
+			{
+				--olr->eject_n;
+				olr->jeject = now;
+			}
+			continue;
+		}
+		if (ejected >= sg->srv_n / 2)
+			continue;
+		tfw_apm_olr_eject(srv, olr);
+		++ejected;
+	}
+out:
+	kfree(rtt);
+	return 0;
+}
+
+static void
+tfw_apm_olr_wfn(struct work_struct *work)
+{
+	tfw_sg_for_each(tfw_apm_olr_check_sg);
+
+	if (READ_ONCE(tfw_apm_olr_rearm))
+		schedule_delayed_work(&tfw_apm_olr_work, TFW_APM_OLR_INTVL);
 }
 
 void
 tfw_apm_update(void *apmref, unsigned long jtstamp, unsigned long jrtt)
 {
+	unsigned int rtt = jiffies_to_msecs(jrtt);
+
 	BUG_ON(!apmref);
-	__tfw_apm_update(apmref, jtstamp, jiffies_to_msecs(jrtt));
+	__tfw_apm_update(apmref, rtt);
+	tfw_apm_olr_update_rtt(apmref, rtt);
+}
+
+/*
+ * Update the latency statistics which aren't bound to a server.
+ */
+void
+tfw_apm_update_lat(void *apmref, unsigned long jrtt)
+{
+	BUG_ON(!apmref);
+	__tfw_apm_update(apmref, jiffies_to_msecs(jrtt));
 }
 
 static void
@@ -1065,22 +1055,12 @@ tfw_apm_destroy(TfwApmData *data)
 
 	for_each_online_cpu(icpu) {
 		TfwApmUBuf *ubuf = per_cpu_ptr(data->ubuf, icpu);
-		kfree(ubuf->ubent[0]);
+		kfree(ubuf->hist[0]);
 	}
 	free_percpu(data->ubuf);
 	kfree(data);
 }
 
-/*
- * Initialize a ring buffer entry.
- */
-static inline void
-tfw_apm_rbent_init(TfwApmRBEnt *rbent, unsigned long jtmistamp)
-{
-	memcpy(rbent->pcntrng.ctl, tfw_rngctl_init, sizeof(rbent->pcntrng.ctl));
-	__tfw_apm_rbent_reset(rbent, jtmistamp);
-}
-
 /*
  * Create and initialize an APM ring buffer for a server.
  *
@@ -1096,6 +1076,8 @@ tfw_apm_create(void)
 	TfwApmHMStats *hmstats;
 	TfwApmHMCfg *ent;
 	int i, icpu, size, hm_size;
+	size_t hsz = tfw_apm_hist_size();
+	char *hist;
 	unsigned int *val[2];
 	int rbufsz = tfw_apm_tmwscale;
 	int psz = ARRAY_SIZE(tfw_pstats_ith);
@@ -1110,7 +1092,7 @@ tfw_apm_create(void)
 
 	/* Keep complete stats for the full time window. */
 	size = sizeof(TfwApmData)
-		+ rbufsz * sizeof(TfwApmRBEnt)
+		+ rbufsz * sizeof(TfwApmRBEnt) + (rbufsz + 1) * hsz
 		+ 2 * psz * sizeof(unsigned int)
 		+ hm_size;
 	if ((data = kzalloc(size, GFP_ATOMIC)) == NULL)
@@ -1125,11 +1107,14 @@ tfw_apm_create(void)
 
 	/* Set up memory areas. */
 	rbent = (TfwApmRBEnt *)(data + 1);
-	val[0] = (unsigned int *)(rbent + rbufsz);
+	hist = (char *)(rbent + rbufsz);
+	val[0] = (unsigned int *)(hist + (rbufsz + 1) * hsz);
 	val[1] = (unsigned int *)(val[0] + psz);
 
 	data->rbuf.rbent = rbent;
 	data->rbuf.rbufsz = rbufsz;
+	data->rbuf.whist = (TfwPcntHist *)(hist + rbufsz * hsz);
+	tfw_stats_init(data->rbuf.whist);
 
 	data->stats.asent[0].pstats.ith = tfw_pstats_ith;
 	data->stats.asent[0].pstats.val = val[0];
@@ -1140,26 +1125,25 @@ tfw_apm_create(void)
 	data->stats.asent[1].pstats.psz = psz;
 
 	/* Initialize data. */
-	for (i = 0; i < rbufsz; ++i)
-		tfw_apm_rbent_init(&rbent[i], 0);
-	spin_lock_init(&data->rbuf.slock);
+	for (i = 0; i < rbufsz; ++i) {
+		rbent[i].hist = (TfwPcntHist *)(hist + i * hsz);
+		tfw_stats_init(rbent[i].hist);
+	}
 
 	rwlock_init(&data->stats.asent[0].rwlock);
 	rwlock_init(&data->stats.asent[1].rwlock);
 	atomic_set(&data->stats.rdidx, 0);
 
-	size = 2 * TFW_APM_UBUF_SZ * sizeof(TfwApmUBEnt);
 	for_each_online_cpu(icpu) {
-		TfwApmUBEnt *ubent;
 		TfwApmUBuf *ubuf = per_cpu_ptr(data->ubuf, icpu);
-		ubent = kmalloc_node(size, GFP_KERNEL, cpu_to_node(icpu));
-		if (!ubent)
+
+		hist = kmalloc_node(2 * hsz, GFP_KERNEL, cpu_to_node(icpu));
+		if (!hist)
 			goto cleanup;
-		for (i = 0; i < 2 * TFW_APM_UBUF_SZ; ++i)
-			WRITE_ONCE(ubent[i].data, ULONG_MAX);
-		ubuf->ubent[0] = ubent;
-		ubuf->ubent[1] = ubent + TFW_APM_UBUF_SZ;
-		ubuf->ubufsz = TFW_APM_UBUF_SZ;
+		ubuf->hist[0] = (TfwPcntHist *)hist;
+		ubuf->hist[1] = (TfwPcntHist *)(hist + hsz);
+		tfw_stats_init(ubuf->hist[0]);
+		tfw_stats_init(ubuf->hist[1]);
 	}
 
 	if (hm_size) {
@@ -1186,21 +1170,44 @@ tfw_apm_hm_stop_timer(TfwApmData *data) {
 	del_timer_sync(&data->hmctl.timer);
 }
 
-int
-tfw_apm_add_srv(TfwServer *srv)
+/*
+ * Create APM data and start the percentile calculation. Besides servers,
+ * the data is used for latency statistics of virtual hosts and locations.
+ */
+void *
+tfw_apm_new(void)
 {
 	TfwApmData *data;
 
-	BUG_ON(srv->apmref);
 	if (!(data = tfw_apm_create()))
-		return -ENOMEM;
+		return NULL;
 
-	/* Start the timer for the percentile calculation. */
-	set_bit(TFW_APM_DATA_F_REARM, &data->flags);
-	setup_timer(&data->timer, tfw_apm_prcntl_tmfn, (unsigned long)data);
-	mod_timer(&data->timer, jiffies + TFW_APM_TIMER_INTVL);
+	/* Start the percentile calculation. */
+	tfw_apm_shard_add(data);
 
-	srv->apmref = data;
+	return data;
+}
+
+void
+tfw_apm_free(void *apmref)
+{
+	TfwApmData *data = apmref;
+
+	if (!data)
+		return;
+
+	/* Stop the percentile calculation. */
+	tfw_apm_shard_del(data);
+
+	tfw_apm_destroy(data);
+}
+
+int
+tfw_apm_add_srv(TfwServer *srv)
+{
+	BUG_ON(srv->apmref);
+	if (!(srv->apmref = tfw_apm_new()))
+		return -ENOMEM;
 
 	return 0;
 }
@@ -1208,21 +1215,14 @@ tfw_apm_add_srv(TfwServer *srv)
 void
 tfw_apm_del_srv(TfwServer *srv)
 {
-	TfwApmData *data = srv->apmref;
-
-	if (!data)
+	if (!srv->apmref)
 		return;
 
 	/* Stop health monitor. */
 	if (test_bit(TFW_SRV_B_HMONITOR, &srv->flags))
 		tfw_apm_hm_disable_srv(srv);
 
-	/* Stop the timer and the percentile calculation. */
-	clear_bit(TFW_APM_DATA_F_REARM, &data->flags);
-	smp_mb__after_atomic();
-	del_timer_sync(&data->timer);
-
-	tfw_apm_destroy(data);
+	tfw_apm_free(srv->apmref);
 	srv->apmref = NULL;
 }
 
@@ -1332,7 +1332,6 @@ void
 tfw_apm_hm_enable_srv(TfwServer *srv, void *hmref)
 {
 	TfwApmHMCtl *hmctl;
-	unsigned long now;
 	TfwApmHM *hm = hmref;
 
 	BUG_ON(!srv->apmref);
@@ -1349,9 +1348,7 @@ tfw_apm_hm_enable_srv(TfwServer *srv, void *hmref)
 	atomic_set(&hmctl->rearm, 1);
 	smp_mb__after_atomic();
 	setup_timer(&hmctl->timer, tfw_apm_hm_timer_cb, (unsigned long)srv);
-	now = jiffies;
-	mod_timer(&hmctl->timer, now + hm->tmt * HZ);
-	WRITE_ONCE(hmctl->jtmstamp, now);
+	tfw_apm_hm_timer_arm(hmctl, hm);
 
 	/* Activate server's health monitor. */
 	set_bit(TFW_SRV_B_HMONITOR, &srv->flags);
@@ -1476,21 +1473,27 @@ tfw_cfgop_apm_add_hm(const char *name)
 	return 0;
 }
 
+/*
+ * Serialize the health monitoring request into skbs once, the probes only
+ * copy the skb heads and share the data pages.
+ */
 static int
 tfw_cfgop_apm_add_hm_req(const char *req_cstr, TfwApmHM *hm_entry)
 {
-	unsigned long size;
+	int r;
+	TfwMsgIter it;
+	TfwStr msg = { .data = (char *)req_cstr, .len = strlen(req_cstr) };
 
-	size = strlen(req_cstr);
-	hm_entry->req = (char *)__get_free_pages(GFP_KERNEL,
-						     get_order(size));
-	if (!hm_entry->req) {
+	ss_skb_queue_purge(&hm_entry->req);
+	if ((r = tfw_msg_iter_setup(&it, &hm_entry->req, msg.len, 0))
+	    || (r = tfw_msg_write(&it, &msg)))
+	{
 		T_ERR_NL("Can't allocate memory for health monitoring request"
 			 "\n");
-		return -ENOMEM;
+		ss_skb_queue_purge(&hm_entry->req);
+		return r;
 	}
-	memcpy(hm_entry->req, req_cstr, size);
-	hm_entry->reqsz = size;
+	hm_entry->reqsz = msg.len;
 
 	return 0;
 }
@@ -1538,7 +1541,7 @@ __tfw_cfgop_cleanup_apm_hm(void)
 	tfw_hm_expl_def = false;
 
 	list_for_each_entry_safe(hm, tmp, &tfw_hm_list, list) {
-		free_pages((unsigned long)hm->req, get_order(hm->reqsz));
+		ss_skb_queue_purge(&hm->req);
 		kfree(hm->url);
 		kfree(hm->codes);
 		list_del(&hm->list);
@@ -1592,6 +1595,16 @@ tfw_apm_cfgend(void)
 	}
 	tfw_apm_jtmwindow = tfw_apm_jtmintrvl * tfw_apm_tmwscale;
 
+	if (!tfw_apm_hbits)
+		tfw_apm_hbits = TFW_APM_DFLT_HBITS;
+	if ((tfw_apm_hbits < TFW_APM_MIN_HBITS)
+	    || (tfw_apm_hbits > TFW_APM_MAX_HBITS))
+	{
+		T_ERR_NL("apm_stats: precision: value '%u' is out of limits.\n",
+			 tfw_apm_hbits);
+		return -EINVAL;
+	}
+
 	/*
 	 * Create 'auto' health monitor for default mode
 	 * if explicit one have not been created during
@@ -1642,6 +1655,7 @@ static void
 tfw_cfgop_cleanup_apm(TfwCfgSpec *cs)
 {
 	tfw_apm_jtmwindow = tfw_apm_tmwscale = 0;
+	tfw_apm_hbits = 0;
 }
 
 static int
@@ -1667,6 +1681,9 @@ tfw_cfgop_apm_stats(TfwCfgSpec *cs, TfwCfgEntry *ce)
 		} else if (!strcasecmp(key, "scale")) {
 			if ((r = tfw_cfg_parse_int(val, &tfw_apm_tmwscale)))
 				return r;
+		} else if (!strcasecmp(key, "precision")) {
+			if ((r = tfw_cfg_parse_uint(val, &tfw_apm_hbits)))
+				return r;
 		} else {
 			T_ERR_NL("%s: unsupported argument: '%s=%s'.\n",
 				 cs->name, key, val);
@@ -1725,6 +1742,57 @@ tfw_cfgop_apm_server_failover(TfwCfgSpec *cs, TfwCfgEntry *ce)
 	return 0;
 }
 
+static int
+tfw_cfgop_apm_outlier_ejection(TfwCfgSpec *cs, TfwCfgEntry *ce)
+{
+	int i, r;
+	const char *key, *val;
+	unsigned int factor = 3, jtime = 30, jtime_max = 300;
+
+	if (ce->val_n) {
+		T_ERR_NL("%s: Arguments must be a key=value pair.\n", cs->name);
+		return -EINVAL;
+	}
+	TFW_CFG_ENTRY_FOR_EACH_ATTR(ce, i, key, val) {
+		if (!strcasecmp(key, "factor")) {
+			if ((r = tfw_cfg_parse_uint(val, &factor)))
+				return r;
+			if (tfw_cfg_check_range(factor, 2, 100))
+				return -EINVAL;
+		} else if (!strcasecmp(key, "time")) {
+			if ((r = tfw_cfg_parse_uint(val, &jtime)))
+				return r;
+			if (tfw_cfg_check_range(jtime, 1, 3600))
+				return -EINVAL;
+		} else if (!strcasecmp(key, "max_time")) {
+			if ((r = tfw_cfg_parse_uint(val, &jtime_max)))
+				return r;
+			if (tfw_cfg_check_range(jtime_max, 1, 86400))
+				return -EINVAL;
+		} else {
+			T_ERR_NL("%s: unsupported argument: '%s=%s'.\n",
+				 cs->name, key, val);
+			return -EINVAL;
+		}
+	}
+	if (jtime_max < jtime) {
+		T_ERR_NL("%s: max_time is less than time.\n", cs->name);
+		return -EINVAL;
+	}
+
+	tfw_apm_olr_factor = factor;
+	tfw_apm_olr_jtime = jtime * HZ;
+	tfw_apm_olr_jtime_max = jtime_max * HZ;
+
+	return 0;
+}
+
+static void
+tfw_cfgop_apm_cleanup_outlier_ejection(TfwCfgSpec *cs)
+{
+	tfw_apm_olr_factor = 0;
+}
+
 static void
 tfw_cfgop_apm_cleanup_server_failover(TfwCfgSpec *cs)
 {
@@ -1925,7 +1993,7 @@ static TfwCfgSpec tfw_apm_hm_specs[] = {
 static TfwCfgSpec tfw_apm_specs[] = {
 	{
 		.name		= "apm_stats",
-		.deflt		= "window=300 scale=5",
+		.deflt		= "window=300 scale=5 precision=4",
 		.handler	= tfw_cfgop_apm_stats,
 		.cleanup	= tfw_cfgop_cleanup_apm,
 		.allow_none	= true,
@@ -1939,6 +2007,14 @@ static TfwCfgSpec tfw_apm_specs[] = {
 		.allow_repeat	= true,
 		.cleanup	= tfw_cfgop_apm_cleanup_server_failover,
 	},
+	{
+		.name		= "server_outlier_ejection",
+		.deflt		= NULL,
+		.handler	= tfw_cfgop_apm_outlier_ejection,
+		.allow_none	= true,
+		.allow_repeat	= false,
+		.cleanup	= tfw_cfgop_apm_cleanup_outlier_ejection,
+	},
 	{
 		.name		= "health_check",
 		.deflt		= NULL,
@@ -1955,22 +2031,63 @@ static TfwCfgSpec tfw_apm_specs[] = {
 	{ 0 }
 };
 
+static int
+tfw_apm_start(void)
+{
+	if (tfw_runstate_is_reconfig() || !tfw_apm_olr_factor)
+		return 0;
+
+	WRITE_ONCE(tfw_apm_olr_rearm, true);
+	schedule_delayed_work(&tfw_apm_olr_work, TFW_APM_OLR_INTVL);
+
+	return 0;
+}
+
+static void
+tfw_apm_stop(void)
+{
+	if (tfw_runstate_is_reconfig())
+		return;
+
+	WRITE_ONCE(tfw_apm_olr_rearm, false);
+	cancel_delayed_work_sync(&tfw_apm_olr_work);
+}
+
 TfwMod tfw_apm_mod = {
 	.name		= "apm",
 	.cfgend		= tfw_apm_cfgend,
 	.cfgclean	= tfw_apm_cfgclean,
+	.start		= tfw_apm_start,
+	.stop		= tfw_apm_stop,
 	.specs		= tfw_apm_specs,
 };
 
 int
 tfw_apm_init(void)
 {
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		TfwApmShard *sh = per_cpu_ptr(&tfw_apm_shards, cpu);
+
+		INIT_LIST_HEAD(&sh->list);
+		spin_lock_init(&sh->lock);
+		sh->cpu = cpu;
+		setup_pinned_timer(&sh->timer, tfw_apm_shard_tmfn,
+				   (unsigned long)sh);
+	}
 	tfw_mod_register(&tfw_apm_mod);
+
 	return 0;
 }
 
 void
 tfw_apm_exit(void)
 {
+	int cpu;
+
 	tfw_mod_unregister(&tfw_apm_mod);
+	/* All the APM data are freed with their servers and vhosts. */
+	for_each_possible_cpu(cpu)
+		del_timer_sync(&per_cpu_ptr(&tfw_apm_shards, cpu)->timer);
 }
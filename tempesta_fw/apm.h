@@ -79,9 +79,13 @@ typedef struct {
 	TfwHMCodeStats	*rsums;
 } TfwHMStats;
 
+void *tfw_apm_new(void);
+void tfw_apm_free(void *apmref);
 int tfw_apm_add_srv(TfwServer *srv);
 void tfw_apm_del_srv(TfwServer *srv);
 void tfw_apm_update(void *apmref, unsigned long jtstamp, unsigned long jrtime);
+void tfw_apm_update_lat(void *apmref, unsigned long jrtime);
+void tfw_apm_update_err(void *apmref, bool err);
 int tfw_apm_stats(void *apmref, TfwPrcntlStats *pstats);
 int tfw_apm_stats_bh(void *apmref, TfwPrcntlStats *pstats);
 int tfw_apm_pstats_verify(TfwPrcntlStats *pstats);
@@ -20,12 +20,22 @@
  * this program; if not, write to the Free Software Foundation, Inc., 59
  * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
  */
+#include <linux/crc32.h>
+#include <linux/ctype.h>
 #include <linux/freezer.h>
+#include <linux/hashtable.h>
 #include <linux/irq_work.h>
 #include <linux/ipv6.h>
 #include <linux/kthread.h>
+#include <linux/random.h>
+#include <linux/sched/clock.h>
+#include <linux/sort.h>
 #include <linux/tcp.h>
+#include <linux/timex.h>
 #include <linux/topology.h>
+#include <linux/vmalloc.h>
+#include <linux/zlib.h>
+#include <asm/unaligned.h>
 
 #include "tdb.h"
 
@@ -33,12 +43,17 @@
 #include "tempesta_fw.h"
 #include "vhost.h"
 #include "cache.h"
+#include "cache_disk.h"
+#include "cache_purge_repl.h"
+#include "hash.h"
 #include "http_msg.h"
 #include "http_sess.h"
+#include "http_trace.h"
 #include "procfs.h"
 #include "sync_socket.h"
 #include "work_queue.h"
 #include "lib/common.h"
+#include "lib/hash.h"
 
 #if MAX_NUMNODES > ((1 << 16) - 1)
 #warning "Please set CONFIG_NODES_SHIFT to less than 16"
@@ -60,20 +75,33 @@ static const TfwStr tfw_cache_raw_headers_304[] = {
 #define TFW_CACHE_304_SPEC_HDRS_NUM	1	/* ETag. */
 #define TFW_CACHE_304_HDRS_NUM						\
 	ARRAY_SIZE(tfw_cache_raw_headers_304) + TFW_CACHE_304_SPEC_HDRS_NUM
+/* Slots of @hdrs_304 rewritten for gzip compressed bodies. */
+#define TFW_CACHE_304_ETAG	0
+#define TFW_CACHE_304_VARY	(TFW_CACHE_304_SPEC_HDRS_NUM + 5)
 
 
 /* Flags stored in a Cache Entry. */
 #define TFW_CE_MUST_REVAL	0x0001		/* MUST revalidate if stale. */
+#define TFW_CE_SUPERSEDED	0x0002		/* Replaced or expired. */
+#define TFW_CE_INCOMPLETE	0x0004		/* Body is being received. */
+#define TFW_CE_GZIP		0x0008		/* Body is gzip compressed. */
+#define TFW_CE_PROMOTED	0x0010		/* Read from disk. */
+#define TFW_CE_SLICED	0x0020		/* Body is stored in slices. */
+#define TFW_CE_SLICE		0x0040		/* Slice of a sliced body. */
 
 /*
  * @trec	- Database record descriptor;
  * @key_len	- length of key (URI + Host header);
+ * @vary_len	- length of secondary key (request headers listed in Vary);
  * @status_len	- length of response status code;
  * @rph_len	- length of response reason phrase;
  * @hdr_num	- number of headers;
  * @hdr_len	- length of whole headers data;
  * @hdr_h2_off	- start of http/2-only headers in the headers list;
  * @body_len	- length of the response body;
+ * @body_ulen	- length of the body before compression if TFW_CE_GZIP is set;
+ * @hpack_len	- length of @hpack block, zero if there is no the block;
+ * @esi_len	- length of @esi, zero if the entry isn't an ESI skeleton;
  * @method	- request method, part of the key;
  * @flags	- various cache entry flags;
  * @age		- the value of response Age: header field;
@@ -81,49 +109,94 @@ static const TfwStr tfw_cache_raw_headers_304[] = {
  * @req_time	- the time the request was issued;
  * @resp_time	- the time the response was received;
  * @lifetime	- the cache entry's current lifetime;
+ * @stale_reval	- time a stale entry may be served while it's revalidated;
  * @last_modified - the value of response Last-Modified: header field;
  * @key		- the cache entry key (URI + Host header);
+ * @vary	- the secondary key, lines of "name:value\n" format for each
+ *		  header listed in response Vary header;
  * @status	- pointer to status line;
  * @hdrs	- pointer to list of HTTP headers;
+ * @hpack	- pointer to HPACK block of all the headers in @hdrs, used to
+ *		  build HTTP/2 responses w/o headers modification;
  * @body	- pointer to response body;
+ * @sid		- identifier of the body slices if TFW_CE_SLICED is set;
  * @hdrs_304	- pointers to headers used to build 304 response;
+ * @cl_hdr	- pointer to Content-Length header replaced in 206 responses;
+ * @esi		- pointer to the segments of ESI skeleton body, see TfwCacheEsi;
  * @version	- HTTP version of the response;
  * @resp_status - Http status of the cached response.
  * @hmflags	- flags of the response after parsing and post-processing.
  * @etag	- entity-tag, stored as a pointer to ETag header in @hdrs.
+ * @accessed	- the entry was hit since the last pass of eviction over it.
+ */
+ *
+ * The fields are ordered by the time they're accessed on a cache hit: the
+ * first cache line holds everything needed to match the key and to check the
+ * entry freshness, the next two lines hold the conditional request and 304
+ * response fields. The fields used to build the full response come last.
+ * The lines are counted from the entry start, which is cache line aligned
+ * only for the first record in a TDB data block.
  */
 typedef struct {
 	TdbVRec		trec;
 #define ce_body		key_len
 	unsigned int	key_len;
-	unsigned int	status_len;
-	unsigned int	rph_len;
-	unsigned int	hdr_num;
-	unsigned int	hdr_h2_off;
-	unsigned int	hdr_len;
-	unsigned int	body_len;
+	unsigned int	vary_len;
 	unsigned int	method: 4;
 	unsigned int	flags: 28;
-	time_t		age;
+	unsigned char	version;
+	unsigned char	accessed;
+	unsigned short	resp_status;
+	long		key;
+	long		vary;
+	time_t		lifetime;
 	time_t		date;
+	/* 2nd cache line. */
+	time_t		age;
 	time_t		req_time;
 	time_t		resp_time;
-	time_t		lifetime;
+	time_t		stale_reval;
+	TfwStr		etag;
+	/* 3rd cache line. */
 	time_t		last_modified;
-	long		key;
+	long		hdrs_304[TFW_CACHE_304_HDRS_NUM];
 	long		status;
 	long		hdrs;
+	long		hpack;
 	long		body;
-	long		hdrs_304[TFW_CACHE_304_HDRS_NUM];
+	long		cl_hdr;
+	long		esi;
+	unsigned long	sid;
+	unsigned long	body_len;
+	unsigned int	status_len;
+	unsigned int	rph_len;
+	unsigned int	hdr_num;
+	unsigned int	hdr_h2_off;
+	unsigned int	hdr_len;
+	unsigned int	body_ulen;
+	unsigned int	hpack_len;
+	unsigned int	esi_len;
 	DECLARE_BITMAP	(hmflags, _TFW_HTTP_FLAGS_NUM);
-	unsigned char	version;
-	unsigned short	resp_status;
-	TfwStr		etag;
 } TfwCacheEntry;
 
 #define CE_BODY_SIZE							\
 	(sizeof(TfwCacheEntry) - offsetof(TfwCacheEntry, ce_body))
 
+/**
+ * Prefetch the header of the record chunk following @trec. Chunks of large
+ * entries are scattered over the database, so each of them costs a cache
+ * miss on following the chunks list. Start the load while the current chunk
+ * is being processed.
+ */
+static inline void
+tfw_cache_chunk_prefetch(TDB *db, TdbVRec *trec)
+{
+	TdbVRec *next = tdb_next_rec_chunk(db, trec);
+
+	if (next)
+		prefetch(next);
+}
+
 /**
  * String header for cache entries used for TfwStr serialization.
  *
@@ -138,24 +211,124 @@ typedef struct {
 #define TFW_CSTR_MAXLEN		(1UL << 56)
 #define TFW_CSTR_HDRLEN		(sizeof(TfwCStr))
 
-/* Work to copy response body to database. */
+/**
+ * Byte range of cached response body requested by a client, RFC 7233 2.1.
+ *
+ * @first	- offset of the first byte of the range;
+ * @last	- offset of the last byte of the range, inclusive;
+ */
+typedef struct {
+	unsigned long	first;
+	unsigned long	last;
+} TfwCacheRange;
+
+/**
+ * HTTP/2 DATA frames of a response body built from the cached data.
+ *
+ * @hdr		- header of the next frame;
+ * @page	- page the frame headers are placed at;
+ * @off		- offset of the next frame header at @page;
+ * @left	- length of the body remaining to be framed;
+ */
+typedef struct {
+	TfwFrameHdr	hdr;
+	struct page	*page;
+	unsigned int	off;
+	unsigned long	left;
+} TfwCacheFrames;
+
+/*
+ * Work for a CPU of another node: process message @msg by @action or, if @msg
+ * is NULL, replicate entry @ce stored with @key in the database of node @nid
+ * or, if @promote is set, store entry @dbuf read from the disk tier.
+ */
 typedef struct {
 	TfwHttpMsg		*msg;
-	tfw_http_cache_cb_t	action;
-	unsigned long		__unused[2];
+	union {
+		tfw_http_cache_cb_t	action;
+		TfwCacheEntry		*ce;
+		TfwCacheDiskBuf		*dbuf;
+	};
+	unsigned long		key;
+	int			nid;
+	bool			promote;
 } TfwCWork;
 
 typedef struct {
 	struct tasklet_struct	tasklet;
 	struct irq_work		ipi_work;
-	TfwRBQueue		wq;
+	TfwNodeQueue		wq;
 } TfwWorkTasklet;
 
+/**
+ * Pending fetch of a cache entry from a backend (request collapsing).
+ *
+ * The first request which misses the cache for @key is forwarded to a backend
+ * as usual and creates the descriptor. All the next requests for the same key
+ * are queued in @waiters until the response is stored in the cache, so they
+ * are serviced from the cache instead of hitting the backend with identical
+ * requests. If the response isn't received within the collapsing timeout or
+ * it can't be cached, then the waiting requests are forwarded.
+ *
+ * @hentry	- entry in the pending fetches hash table;
+ * @waiters	- requests waiting for the response;
+ * @timer	- timer to fall back to forwarding of the waiting requests;
+ * @key		- cache key of the fetched entry;
+ * @action	- callback to forward a waiting request;
+ */
+typedef struct {
+	struct hlist_node	hentry;
+	struct list_head	waiters;
+	struct timer_list	timer;
+	unsigned long		key;
+	tfw_http_cache_cb_t	action;
+} TfwCacheFetch;
+
+typedef struct {
+	struct hlist_head	list;
+	spinlock_t		lock;
+} TfwCacheFetchBucket;
+
+#define TFW_CACHE_FETCH_TBL_BITS	10
+/* Time to give up waiting for a background revalidation response. */
+#define TFW_CACHE_REVAL_TIMEOUT		(10 * HZ)
+
+static TfwCacheFetchBucket cache_fetch_tbl[1 << TFW_CACHE_FETCH_TBL_BITS];
+static struct kmem_cache *cache_fetch_cache;
+
+/* Maximum length of cache tags header name including the colon. */
+#define TFW_CACHE_TAG_HDR_MAXLEN	64
+/* Maximum number of each kind of the cache key normalization parameters. */
+#define TFW_CACHE_KEY_PARAMS_MAX	8
+
 static struct {
 	int cache;
 	unsigned int methods;
 	unsigned int db_size;
+	unsigned int collapse_tmt;
 	const char *db_path;
+	unsigned int tag_db_size;
+	const char *tag_db_path;
+	unsigned int disk_size;
+	const char *disk_path;
+	unsigned int tag_hdr_len;
+	char tag_hdr[TFW_CACHE_TAG_HDR_MAXLEN];
+	bool hpack_block;
+	unsigned int compress;
+	unsigned int compress_budget;
+	unsigned int admit_hits;
+	unsigned int admit_window;
+	struct {
+		bool on;
+		bool sort_args;
+		bool lowercase;
+		unsigned int drop_n;
+		unsigned int hdr_n;
+		unsigned int cookie_n;
+		char *drop[TFW_CACHE_KEY_PARAMS_MAX];
+		char *hdr[TFW_CACHE_KEY_PARAMS_MAX];
+		char *cookie[TFW_CACHE_KEY_PARAMS_MAX];
+	} key;
 } cache_cfg __read_mostly;
 
 /* Cache modes. */
@@ -165,15 +338,238 @@ enum {
 	TFW_CACHE_REPLICA,
 };
 
+/**
+ * Compact validator of a cache entry, so conditional requests for fresh
+ * entries are answered without the entry lookup by the full key, RFC 7232 6.
+ * Validators are stored in a direct-mapped per-node table indexed by the
+ * entry key, so a validator can be displaced by one of another entry.
+ * Entries with Vary aren't tracked since they share the key.
+ *
+ * @lock	- makes validator updates consistent for lockless readers;
+ * @method	- request method of the entry;
+ * @key		- key of the entry;
+ * @etag	- hash of the entity-tag or zero if there is no ETag;
+ * @mtime	- time to compare If-Modified-Since against;
+ * @expires	- time when the entry becomes stale;
+ * @resp_time	- response time of the entry to detect reused records;
+ * @ce		- the entry;
+ */
+typedef struct {
+	seqlock_t	lock;
+	unsigned int	method;
+	unsigned long	key;
+	unsigned long	etag;
+	time_t		mtime;
+	time_t		expires;
+	time_t		resp_time;
+	TfwCacheEntry	*ce;
+} ____cacheline_aligned TfwCacheVld;
+
+#define TFW_CACHE_VLD_BITS	14
+
+/**
+ * Count-min sketch of the keys recently missed in the node cache. A response
+ * is admitted to the cache only if its key is missed at least
+ * @cache_cfg.admit_hits times within the current window, so rarely requested
+ * resources don't evict the popular ones. The cache key is a hash already,
+ * so the sketch rows are indexed by different bits of the key. Counters are
+ * updated without synchronization: a lost update only makes the estimation
+ * slightly less precise.
+ *
+ * @window	- start time of the current window;
+ * @cnt		- saturating counters of the sketch rows;
+ */
+#define TFW_CACHE_CMS_ROWS	4
+#define TFW_CACHE_CMS_BITS	14
+
+typedef struct {
+	time_t		window;
+	unsigned char	cnt[TFW_CACHE_CMS_ROWS][1 << TFW_CACHE_CMS_BITS];
+} TfwCacheCms;
+
+/**
+ * Per-NUMA node cache storage.
+ *
+ * @lru		- usage ordered list of the stored entries, the least
+ *		  recently used entries are at the head;
+ * @lru_lock	- protects @lru and @mem;
+ * @mem		- approximate memory used by the entries in @db;
+ * @tag_db	- index of the node cache entries by tags;
+ * @vld		- validators of the node cache entries, see TfwCacheVld;
+ * @cms		- admission filter of the node, see TfwCacheCms;
+ */
 typedef struct {
 	int		cpu[NR_CPUS];
-	atomic_t	cpu_idx;
 	unsigned int	nr_cpus;
 	TDB		*db;
+	struct list_head lru;
+	spinlock_t	lru_lock;
+	size_t		mem;
+	TDB		*tag_db;
+	TfwCacheVld	*vld;
+	TfwCacheCms	*cms;
 } CaNode;
 
+/**
+ * Tag index record, the record key is hash of the tag. Tags aren't stored,
+ * so a hash collision only leads to invalidation of more entries.
+ *
+ * @key		- the tagged cache entry key;
+ * @ce		- offset of the tagged cache entry in the node database;
+ */
+typedef struct {
+	unsigned long	key;
+	long		ce;
+} TfwCacheTag;
+
+/**
+ * Context of processing of a tags list.
+ *
+ * @node	- the node to add tag records to;
+ * @rec		- the tag record to add;
+ * @nr		- number of invalidated cache entries;
+ */
+typedef struct {
+	CaNode		*node;
+	TfwCacheTag	rec;
+	unsigned int	nr;
+} TfwCacheTagCtx;
+
+/**
+ * Cache entry descriptor in the node eviction list. The list is maintained
+ * in CLOCK order: a hit only marks the entry as accessed and eviction moves
+ * accessed entries to the list tail instead of removing them, so there are
+ * no lock operations on the hot hit path.
+ *
+ * @list	- entry in CaNode->lru;
+ * @key		- the cache entry key;
+ * @ce		- the cache entry in the node database;
+ * @acct	- accounting of the vhost the entry belongs to, NULL for
+ *		  entries stored before the restart;
+ * @size	- size of the cache entry;
+ */
+typedef struct {
+	struct list_head	list;
+	unsigned long		key;
+	TfwCacheEntry		*ce;
+	TfwCacheAcct		*acct;
+	size_t			size;
+} TfwCacheLru;
+
+/**
+ * Cache usage accounting of a vhost. The accounting is bound to the vhost
+ * name, so it survives reconfigurations. The descriptors are freed only on
+ * the module unloading, since they're referenced by the eviction lists.
+ *
+ * @list	- entry in the list of all the accounting descriptors;
+ * @hits	- number of responses to the vhost requests served from cache;
+ * @misses	- number of the vhost requests not found in cache;
+ * @evicted	- number of evicted entries of the vhost;
+ * @rejected	- number of responses not stored due to the quota;
+ * @quota	- current quota of the vhost, copy of TfwVhost->cache_quota;
+ * @name	- name of the vhost;
+ * @mem		- memory used by the vhost entries in each node database;
+ */
+struct tfw_cache_acct_t {
+	struct list_head	list;
+	atomic64_t		hits;
+	atomic64_t		misses;
+	atomic64_t		evicted;
+	atomic64_t		rejected;
+	unsigned int		quota;
+	const char		*name;
+	atomic64_t		mem[0];
+};
+
+/*
+ * Start eviction before the database is full: the index, buckets and
+ * partially written blocks are out of accounting.
+ */
+#define TFW_CACHE_EVICT_WMARK	(cache_cfg.db_size / 8 * 7)
+/* Eviction passes limit for one allocation. */
+#define TFW_CACHE_EVICT_BUDGET	64
+
+static struct kmem_cache *cache_lru_cache;
+
 static CaNode c_nodes[MAX_NUMNODES];
 
+static LIST_HEAD(cache_acct_list);
+static DEFINE_SPINLOCK(cache_acct_lock);
+
+/**
+ * State of copying of a response to a cache entry.
+ *
+ * @p		- current write position in the entry;
+ * @trec	- current record chunk of the entry;
+ * @tot_len	- length of the data remaining to be written;
+ * @etag_off	- offset of ETag header in the entry;
+ * @etag_trec	- record chunk containing ETag header;
+ * @body_chunk	- index of the body chunk being copied;
+ * @body_off	- number of copied bytes of @body_chunk;
+ */
+typedef struct {
+	char		*p;
+	TdbVRec		*trec;
+	size_t		tot_len;
+	long		etag_off;
+	TdbVRec		*etag_trec;
+	unsigned int	body_chunk;
+	size_t		body_off;
+} TfwCacheCopy;
+
+/*
+ * Responses with body at least of the size are stored in the cache while
+ * the body is received.
+ */
+#define TFW_CACHE_STREAM_MIN	(64 * 1024)
+
+/*
+ * Bodies of streamed responses larger than a slice are stored in slices of
+ * the size, so parts of large objects are stored, evicted and served
+ * independently. A slice is a separate record keyed by the slice identifier
+ * of the entry and the slice index. The record starts with a cache entry
+ * header, which has only @flags, @sid, @body and @body_len set. The entry is
+ * available as soon as its head is received, so requests for the body parts
+ * which are already stored are served while the rest of the body is being
+ * received. Requests for a part which isn't stored are forwarded. Slices of
+ * removed entries are just evicted in turn.
+ */
+#define TFW_CACHE_SLICE_SZ	(1UL << 20)
+
+/**
+ * Response stored in the cache while its body is received, so the body
+ * chunks are copied to the database as they arrive instead of copying the
+ * whole response at once when it's received in full.
+ *
+ * @cp		- state of copying of the response to @ce;
+ * @ce		- the cache entry being built, NULL if there is no one;
+ * @acct	- accounting of the vhost the response belongs to;
+ * @key		- the cache entry key;
+ * @data_len	- full size of the cache entry;
+ * @nid		- NUMA node of the database storing @ce;
+ * @sid		- slice identifier of @ce if it's sliced and available,
+ *		  zero otherwise, @cp is the state of copying to @sl then;
+ * @sl		- the slice being built, NULL if there is no one;
+ * @sl_key	- key of @sl;
+ * @sl_len	- full size of @sl;
+ * @sl_idx	- index of the next slice;
+ * @body_len	- length of the body remaining to be sliced;
+ */
+struct tfw_cache_stream_t {
+	TfwCacheCopy		cp;
+	TfwCacheEntry		*ce;
+	TfwCacheAcct		*acct;
+	unsigned long		key;
+	size_t			data_len;
+	int			nid;
+	unsigned long		sid;
+	TfwCacheEntry		*sl;
+	unsigned long		sl_key;
+	size_t			sl_len;
+	unsigned long		sl_idx;
+	unsigned long		body_len;
+};
+
 typedef int tfw_cache_write_actor_t(TDB *, TdbVRec **, TfwHttpResp *, char **,
 				    size_t, TfwDecodeCacheIter *);
 /*
@@ -184,11 +580,129 @@ typedef int tfw_cache_write_actor_t(TDB *, TdbVRec **, TfwHttpResp *, char **,
 static struct task_struct *cache_mgr_thr;
 #endif
 static DEFINE_PER_CPU(TfwWorkTasklet, cache_wq);
+/* Round robin index of the remote node CPUs, see tfw_cache_sched_cpu(). */
+static DEFINE_PER_CPU(unsigned int, cache_sched_idx);
 
 #define RESP_BUF_LEN		128
 
 static DEFINE_PER_CPU(char[RESP_BUF_LEN], g_c_buf);
 
+/*
+ * Maximum length of cache entry secondary key, responses with longer
+ * keys aren't cached.
+ */
+#define TFW_CACHE_VARY_MAXLEN	1024
+
+/*
+ * Buffers to build and compare secondary keys: the first one is for a stored
+ * key or Vary field names and the second one is for request headers values.
+ */
+static DEFINE_PER_CPU(char[2][TFW_CACHE_VARY_MAXLEN], g_vary_buf);
+/*
+ * Secondary key of the response being stored. The key is used until the
+ * response is stored in all the nodes, while the entries of the same request
+ * are matched with g_vary_buf, so a separate buffer is used.
+ */
+static DEFINE_PER_CPU(char[TFW_CACHE_VARY_MAXLEN], g_vary_key);
+
+/*
+ * Maximum length of normalized URI part of the cache key and maximum number
+ * of query arguments in it. The key isn't normalized for longer URIs.
+ */
+#define TFW_CACHE_KEY_MAXLEN		2048
+#define TFW_CACHE_KEY_ARGS_MAX		32
+
+/*
+ * Buffers to normalize the cache key: the first one is for the request URI
+ * and Cookie header and the second one is for the normalized key.
+ */
+static DEFINE_PER_CPU(char[2][TFW_CACHE_KEY_MAXLEN], g_key_buf);
+
+/*
+ * Edge Side Includes (ESI) assembly of cached pages.
+ *
+ * The body of a response marked by 'Surrogate-Control: content="ESI/1.0"'
+ * is stored as is, along with the list of its segments: the literal parts
+ * of the body and the fragments included by '<esi:include src="/path"/>'
+ * tags. The fragments are usual cache entries, stored under their own keys
+ * and with their own lifetimes. A response to the skeleton is assembled by
+ * referencing the literal parts and the fragments bodies in sequence, there
+ * is no copying. Missing or stale fragments are fetched by background
+ * requests all at once, and the client request waits for them.
+ *
+ * The fragment keys are calculated from the raw src paths and the host of
+ * the skeleton, so ESI isn't processed if the cache keys are normalized.
+ * Also the fragments must be in the local node database, so it's processed
+ * in the replicated cache mode only.
+ */
+#define TFW_CACHE_ESI_MAXLEN		4096
+#define TFW_CACHE_ESI_SEGS		64
+
+/**
+ * Segment of the ESI skeleton body.
+ *
+ * @key		- key of the included fragment or zero for a literal part;
+ * @off		- offset of the literal part in the body, or offset of the
+ *		  fragment src path from the start of TfwCacheEsi;
+ * @len		- length of the literal part or the fragment src path;
+ * @body_len	- length of the fragment body, set while the response is
+ *		  built;
+ */
+typedef struct {
+	unsigned long	key;
+	unsigned int	off;
+	unsigned int	len;
+	unsigned int	body_len;
+} TfwCacheEsiSeg;
+
+/**
+ * Segments of the ESI skeleton body followed by the fragments src paths.
+ *
+ * @n		- number of the segments;
+ * @seg		- the segments in order of the body;
+ */
+typedef struct {
+	unsigned int	n;
+	TfwCacheEsiSeg	seg[0];
+} TfwCacheEsi;
+
+/* Buffer to build the segments of a stored skeleton and to read them. */
+static DEFINE_PER_CPU_ALIGNED(char[TFW_CACHE_ESI_MAXLEN], g_esi_buf);
+
+/*
+ * Compression of cached bodies, see tfw_cache_gzip(). Larger bodies are
+ * streamed to the cache, so they're never compressed and the compressed
+ * body is built in a per-CPU buffer before the cache entry is allocated.
+ * The bodies are stored as gzip members with the fixed header.
+ */
+#define TFW_CACHE_GZIP_MAXLEN	TFW_CACHE_STREAM_MIN
+#define TFW_CACHE_GZIP_HDRLEN	10
+#define TFW_CACHE_GZIP_TRLEN	8
+
+static const unsigned char tfw_cache_gzip_hdr[TFW_CACHE_GZIP_HDRLEN] = {
+	0x1f, 0x8b, Z_DEFLATED, 0, 0, 0, 0, 0, 0, 3 /* Unix */
+};
+
+/**
+ * Per-CPU compression state.
+ *
+ * @def		- deflate stream, used only if the compression is configured;
+ * @inf		- inflate stream, entries stored compressed before
+ *		  a restart can be served with the compression switched off;
+ * @buf		- buffer for compressed body, TFW_CACHE_GZIP_MAXLEN bytes;
+ * @win		- start of the current second of the compression budget;
+ * @ns		- time spent on compression in the current second;
+ */
+typedef struct {
+	z_stream	def;
+	z_stream	inf;
+	char		*buf;
+	unsigned long	win;
+	u64		ns;
+} TfwCacheGzip;
+
+static DEFINE_PER_CPU(TfwCacheGzip, cache_gz);
+
 static TfwStr g_crlf = { .data = S_CRLF, .len = SLEN(S_CRLF) };
 
 /* Iterate over request URI and Host header to process request key. */
@@ -244,7 +758,9 @@ __cache_method_test(tfw_http_meth_t method)
 bool
 tfw_cache_msg_cacheable(TfwHttpReq *req)
 {
-	return cache_cfg.cache && __cache_method_test(req->method);
+	/* Upgrade requests must reach the server to switch the protocols. */
+	return cache_cfg.cache && __cache_method_test(req->method)
+	       && !test_bit(TFW_HTTP_B_CONN_UPGRADE, req->flags);
 }
 
 /**
@@ -286,17 +802,17 @@ node_db(void)
  * The request should be processed on remote node, use round robin strategy
  * to distribute such requests.
  *
- * Note that atomic_t is a signed 32-bit value, and it's intentionally
- * cast to unsigned type value before taking a modulo operation.
- * If this place becomes a hot spot, then @cpu_idx may be made per_cpu.
+ * The round robin index is per-CPU, so the CPUs queueing works to the same
+ * node don't bounce a shared cache line. The CPU identifier is added to the
+ * index to not start from the same remote CPU on all the CPUs.
  */
 static int
-tfw_cache_sched_cpu(TfwHttpReq *req)
+tfw_cache_sched_cpu(int nid)
 {
-	CaNode *node = &c_nodes[req->node];
-	unsigned int idx = atomic_inc_return(&node->cpu_idx);
+	CaNode *node = &c_nodes[nid];
+	unsigned int idx = this_cpu_inc_return(cache_sched_idx);
 
-	return node->cpu[idx % node->nr_cpus];
+	return node->cpu[(idx + smp_processor_id()) % node->nr_cpus];
 }
 
 /*
@@ -393,6 +909,31 @@ tfw_cache_status_bydef(TfwHttpResp *resp)
 	return false;
 }
 
+/*
+ * Find negative caching policy for @resp status. Policies of the request
+ * location are searched first, then the default policies of the vhost and
+ * the global default ones.
+ */
+static TfwCaNeg *
+tfw_cache_negative(TfwHttpResp *resp)
+{
+	TfwCaNeg *caneg;
+	TfwHttpReq *req = resp->req;
+	TfwVhost *vhost = req->vhost, *vhost_dflt;
+
+	if (resp->status < 400 || !vhost)
+		return NULL;
+	if (req->location && (caneg = tfw_caneg_match(req->location,
+						      resp->status)))
+		return caneg;
+	if (vhost->loc_dflt && vhost->loc_dflt->caneg_sz)
+		return tfw_caneg_match(vhost->loc_dflt, resp->status);
+	if ((vhost_dflt = vhost->vhost_dflt) && vhost_dflt->loc_dflt)
+		return tfw_caneg_match(vhost_dflt->loc_dflt, resp->status);
+
+	return NULL;
+}
+
 static bool
 tfw_cache_employ_resp(TfwHttpResp *resp)
 {
@@ -427,7 +968,7 @@ tfw_cache_employ_resp(TfwHttpResp *resp)
 	    && !(req->cache_ctl.flags & CC_RESP_AUTHCAN))
 		return false;
 	if (!(resp->cache_ctl.flags & CC_RESP_CACHEIT)
-	    && !tfw_cache_status_bydef(resp))
+	    && !tfw_cache_status_bydef(resp) && !tfw_cache_negative(resp))
 		return false;
 #undef CC_RESP_AUTHCAN
 #undef CC_RESP_CACHEIT
@@ -437,6 +978,80 @@ tfw_cache_employ_resp(TfwHttpResp *resp)
 	return true;
 }
 
+static inline unsigned int
+tfw_cache_cms_idx(unsigned long key, int row)
+{
+	BUILD_BUG_ON(TFW_CACHE_CMS_ROWS * TFW_CACHE_CMS_BITS > BITS_PER_LONG);
+
+	return (key >> (row * TFW_CACHE_CMS_BITS))
+	       & ((1 << TFW_CACHE_CMS_BITS) - 1);
+}
+
+static unsigned int
+tfw_cache_cms_get(TfwCacheCms *cms, unsigned long key)
+{
+	int i;
+	unsigned int n = UCHAR_MAX;
+
+	for (i = 0; i < TFW_CACHE_CMS_ROWS; ++i)
+		n = min_t(unsigned int, n,
+			  READ_ONCE(cms->cnt[i][tfw_cache_cms_idx(key, i)]));
+
+	return n;
+}
+
+/**
+ * Account a cache miss of @req in the admission filter of the current node.
+ * Only the counters having the minimal value are incremented (conservative
+ * update), which reduces the overestimation. The counters are reset when
+ * the window expires, the concurrent resets are harmless.
+ */
+static void
+tfw_cache_freq_inc(TfwHttpReq *req)
+{
+	int i;
+	unsigned int n;
+	unsigned long key;
+	unsigned char *c;
+	time_t w, now = tfw_current_timestamp();
+	TfwCacheCms *cms = c_nodes[numa_node_id()].cms;
+
+	if (!cms || cache_cfg.admit_hits <= 1)
+		return;
+
+	w = READ_ONCE(cms->window);
+	if (now >= w + cache_cfg.admit_window
+	    && cmpxchg(&cms->window, w, now) == w)
+		memset(cms->cnt, 0, sizeof(cms->cnt));
+
+	key = tfw_http_req_key_calc(req);
+	if ((n = tfw_cache_cms_get(cms, key)) == UCHAR_MAX)
+		return;
+	for (i = 0; i < TFW_CACHE_CMS_ROWS; ++i) {
+		c = &cms->cnt[i][tfw_cache_cms_idx(key, i)];
+		if (READ_ONCE(*c) == n)
+			WRITE_ONCE(*c, n + 1);
+	}
+}
+
+/**
+ * The admission filter: the response to @req can be stored in the cache only
+ * if the request key is missed in the cache frequently enough. Background
+ * revalidation requests are for already stored entries, so they're admitted.
+ */
+static bool
+tfw_cache_freq_admit(TfwHttpReq *req)
+{
+	TfwCacheCms *cms = c_nodes[numa_node_id()].cms;
+
+	if (!cms || cache_cfg.admit_hits <= 1
+	    || test_bit(TFW_HTTP_B_CACHE_BG, req->flags))
+		return true;
+
+	return tfw_cache_cms_get(cms, tfw_http_req_key_calc(req))
+	       >= cache_cfg.admit_hits;
+}
+
 /*
  * Calculate freshness lifetime according to RFC 7234 4.2.1.
  */
@@ -444,6 +1059,7 @@ static time_t
 tfw_cache_calc_lifetime(TfwHttpResp *resp)
 {
 	time_t lifetime;
+	TfwCaNeg *caneg;
 
 	if (resp->cache_ctl.flags & TFW_HTTP_CC_S_MAXAGE)
 		lifetime = resp->cache_ctl.s_maxage;
@@ -451,6 +1067,9 @@ tfw_cache_calc_lifetime(TfwHttpResp *resp)
 		lifetime = resp->cache_ctl.max_age;
 	else if (resp->cache_ctl.flags & TFW_HTTP_CC_HDR_EXPIRES)
 		lifetime = resp->cache_ctl.expires - resp->date;
+	else if ((caneg = tfw_cache_negative(resp)))
+		/* Error responses are cached only for configured time. */
+		lifetime = caneg->ttl;
 	else
 		/* For now, set "unlimited" lifetime in this case. */
 		lifetime = UINT_MAX;	/* TODO: Heuristic lifetime. */
@@ -458,6 +1077,22 @@ tfw_cache_calc_lifetime(TfwHttpResp *resp)
 	return lifetime;
 }
 
+/*
+ * Calculate the time a stale response may be served while it's revalidated
+ * in background, RFC 5861 3. RFC 7234 5.2.2.1 and 5.2.2.7 forbid to serve
+ * stale responses with must-revalidate and proxy-revalidate directives.
+ */
+static time_t
+tfw_cache_calc_stale_reval(TfwHttpResp *resp)
+{
+	if (!(resp->cache_ctl.flags & TFW_HTTP_CC_STALE_REVAL)
+	    || (resp->cache_ctl.flags
+		& (TFW_HTTP_CC_MUST_REVAL | TFW_HTTP_CC_PROXY_REVAL)))
+		return 0;
+
+	return resp->cache_ctl.stale_reval;
+}
+
 /*
  * Calculate the current entry age according to RFC 7234 4.2.3.
  */
@@ -484,13 +1119,17 @@ tfw_cache_entry_age(TfwCacheEntry *ce)
  * Note that if the returned value of lifetime is greater than
  * ce->lifetime, then the entry is stale but still may be served
  * to a client, provided that the cache policy allows that.
+ *
+ * @reval is set to true if the stale entry is served only for the time
+ * of its revalidation (RFC 5861 3), so the revalidation must be started.
  */
 static time_t
-tfw_cache_entry_is_live(TfwHttpReq *req, TfwCacheEntry *ce)
+tfw_cache_entry_is_live(TfwHttpReq *req, TfwCacheEntry *ce, bool *reval)
 {
 	time_t ce_age = tfw_cache_entry_age(ce);
 	time_t ce_lifetime, lt_fresh = UINT_MAX;
 
+	*reval = false;
 	if (ce->lifetime <= 0)
 		return 0;
 
@@ -509,9 +1148,22 @@ tfw_cache_entry_is_live(TfwHttpReq *req, TfwCacheEntry *ce)
 		time_t lt_max_stale = ce->lifetime + req->cache_ctl.max_stale;
 		ce_lifetime = min(lt_fresh, lt_max_stale);
 	}
+
+	if (ce_lifetime > ce_age)
+		return ce_lifetime;
+	/*
+	 * The client doesn't restrict the response freshness, so the stale
+	 * response can be served while it's revalidated.
+	 */
+	if (!(req->cache_ctl.flags & CC_LIFETIME_FRESH)
+	    && ce->lifetime + ce->stale_reval > ce_age)
+	{
+		*reval = true;
+		return ce->lifetime + ce->stale_reval;
+	}
 #undef CC_LIFETIME_FRESH
 
-	return ce_lifetime > ce_age ? ce_lifetime : 0;
+	return 0;
 }
 
 static bool
@@ -577,6 +1229,7 @@ tfw_cache_h2_write(TDB *db, TdbVRec **trec, TfwHttpResp *resp, char **data,
 
 		tr = *trec = tdb_next_rec_chunk(db, tr);
 		BUG_ON(!tr);
+		tfw_cache_chunk_prefetch(db, tr);
 		*data = tr->data;
 	}
 
@@ -617,15 +1270,22 @@ tfw_cache_h2_decode_write(TDB *db, TdbVRec **trec, TfwHttpResp *resp,
 
 		tr = *trec = tdb_next_rec_chunk(db, tr);
 		BUG_ON(!tr);
+		tfw_cache_chunk_prefetch(db, tr);
 		*data = tr->data;
 	}
 
 	return r;
 }
 
+/**
+ * Write status line or ':status' pseudo-header of the cached response. If
+ * @partial is true, then the stored status is skipped and 206 status is
+ * written instead.
+ */
 static int
 tfw_cache_set_status(TDB *db, TfwCacheEntry *ce, TfwHttpResp *resp,
-		     TdbVRec **trec, char **p, unsigned long *acc_len)
+		     TdbVRec **trec, char **p, unsigned long *acc_len,
+		     bool partial)
 {
 	int r;
 	TfwMsgIter *it = &resp->mit.iter;
@@ -635,15 +1295,28 @@ tfw_cache_set_status(TDB *db, TfwCacheEntry *ce, TfwHttpResp *resp,
 
 	if (h2_mode)
 		resp->mit.start_off = FRAME_HEADER_SIZE;
-	else
+	if (!h2_mode || partial)
 		dc_iter.skip = true;
 
-
 	r = tfw_cache_h2_write(db, trec, resp, p, ce->status_len, &dc_iter);
 	if (unlikely(r))
 		return r;
 
-	if (!h2_mode) {
+	if (h2_mode && partial) {
+		r = tfw_h2_resp_status_write(resp, 206, true);
+		if (unlikely(r))
+			return r;
+	}
+	else if (partial) {
+		TfwStr s_line = TFW_STR_STRING(S_0 "206 Partial Content");
+
+		r = tfw_http_msg_expand_data(it, skb_head, &s_line, NULL);
+		if (unlikely(r))
+			return r;
+
+		*acc_len += s_line.len;
+	}
+	else if (!h2_mode) {
 		char buf[H2_STAT_VAL_LEN];
 		TfwStr s_line = {
 			.chunks = (TfwStr []){
@@ -665,7 +1338,7 @@ tfw_cache_set_status(TDB *db, TfwCacheEntry *ce, TfwHttpResp *resp,
 		*acc_len += s_line.len;
 	}
 
-	dc_iter.skip = h2_mode ? true : false;
+	dc_iter.skip = h2_mode || partial;
 
 	r = tfw_cache_h2_write(db, trec, resp, p, ce->rph_len, &dc_iter);
 	if (unlikely(r))
@@ -729,6 +1402,10 @@ tfw_cache_build_resp_hdr(TDB *db, TfwHttpResp *resp, TfwHdrMods *hmods,
 	return r;
 }
 
+static bool tfw_cache_accept_gzip(TfwHttpReq *req);
+static bool tfw_cache_gzip_vld_skip(TDB *db, TfwCacheEntry *ce, char *p);
+static int tfw_cache_set_hdr_gzip_vld(TfwHttpResp *resp, TfwCacheEntry *ce);
+
 /**
  * RFC 7232 Section-4.1: The server generating a 304 response MUST generate:
  * Cache-Control, Content-Location, Date, ETag, Expires, and Vary.
@@ -737,24 +1414,22 @@ tfw_cache_build_resp_hdr(TDB *db, TfwHttpResp *resp, TfwHdrMods *hmods,
  * The 304 response should be as short as possible, we don't need to add
  * extra headers.
  */
-static void
-tfw_cache_send_304(TfwHttpReq *req, TfwCacheEntry *ce)
+static TfwHttpResp *
+tfw_cache_build_304(TfwHttpReq *req, TfwCacheEntry *ce,
+		    unsigned int *stream_id, unsigned long *h_len)
 {
 	char *p;
 	int r, i;
 	TfwMsgIter *it;
 	TfwHttpResp *resp;
 	struct sk_buff **skb_head;
-	unsigned int stream_id = 0;
-	unsigned long h_len = 0;
+	unsigned long acc_len;
 	TdbVRec *trec = &ce->trec;
 	TDB *db = node_db();
-
-	WARN_ON_ONCE(!list_empty(&req->fwd_list));
-	WARN_ON_ONCE(!list_empty(&req->nip_list));
+	bool gz = (ce->flags & TFW_CE_GZIP) && tfw_cache_accept_gzip(req);
 
 	if (!(resp = tfw_http_msg_alloc_resp_light(req)))
-		goto err_create;
+		return NULL;
 
 	it = &resp->mit.iter;
 	skb_head = &resp->msg.skb_head;
@@ -764,15 +1439,14 @@ tfw_cache_send_304(TfwHttpReq *req, TfwCacheEntry *ce)
 		if (unlikely(r))
 			goto err_setup;
 	} else {
-		stream_id = tfw_h2_stream_id_close(req, HTTP2_HEADERS,
-						   HTTP2_F_END_STREAM);
-		if (unlikely(!stream_id))
+		*stream_id = tfw_h2_stream_id_close(req, HTTP2_HEADERS,
+						    HTTP2_F_END_STREAM);
+		if (unlikely(!*stream_id))
 			goto err_setup;
 
 		resp->mit.start_off = FRAME_HEADER_SIZE;
 
-		r = tfw_h2_resp_status_write(resp, 304, TFW_H2_TRANS_EXPAND,
-					     true);
+		r = tfw_h2_resp_status_write(resp, 304, true);
 		if (unlikely(r))
 			goto err_setup;
 	}
@@ -783,38 +1457,67 @@ tfw_cache_send_304(TfwHttpReq *req, TfwCacheEntry *ce)
 			continue;
 
 		p = TDB_PTR(db->hdr, ce->hdrs_304[i]);
+		if (gz && tfw_cache_gzip_vld_skip(db, ce, p))
+			continue;
 		while (trec && (p > trec->data + trec->len))
 			trec = tdb_next_rec_chunk(db, trec);
 		BUG_ON(!trec);
 
-		if (tfw_cache_build_resp_hdr(db, resp, NULL, &trec, &p, &h_len,
+		if (tfw_cache_build_resp_hdr(db, resp, NULL, &trec, &p, h_len,
 					     false))
 		{
 			goto err_setup;
 		}
 	}
-
-	if (!TFW_MSG_H2(req)) {
-		if (tfw_http_msg_expand_data(it, skb_head, &g_crlf, NULL))
+	if (gz) {
+		acc_len = resp->mit.acc_len;
+		if (tfw_cache_set_hdr_gzip_vld(resp, ce))
 			goto err_setup;
-
-		tfw_http_resp_fwd(resp);
-
-		return;
+		*h_len += resp->mit.acc_len - acc_len;
 	}
 
-	if (tfw_h2_frame_local_resp(resp, stream_id, h_len, NULL))
+	if (!TFW_MSG_H2(req)
+	    && tfw_http_msg_expand_data(it, skb_head, &g_crlf, NULL))
 		goto err_setup;
 
-	tfw_h2_resp_fwd(resp);
-
-	return;
+	return resp;
 err_setup:
 	T_WARN("Can't build 304 response, key=%lx\n", ce->key);
 	tfw_http_msg_free((TfwHttpMsg *)resp);
-err_create:
-	tfw_http_resp_build_error(req);
-}
+
+	return NULL;
+}
+
+static void
+tfw_cache_send_304(TfwHttpReq *req, TfwCacheEntry *ce)
+{
+	TfwHttpResp *resp;
+	unsigned int stream_id = 0;
+	unsigned long h_len = 0;
+
+	WARN_ON_ONCE(!list_empty(&req->fwd_list));
+	WARN_ON_ONCE(!list_empty(&req->nip_list));
+
+	if (!(resp = tfw_cache_build_304(req, ce, &stream_id, &h_len)))
+		goto err;
+
+	if (!TFW_MSG_H2(req)) {
+		tfw_http_resp_fwd(resp);
+		return;
+	}
+
+	if (tfw_h2_frame_local_resp(resp, stream_id, h_len, NULL)) {
+		T_WARN("Can't build 304 response, key=%lx\n", ce->key);
+		tfw_http_msg_free((TfwHttpMsg *)resp);
+		goto err;
+	}
+
+	tfw_h2_resp_fwd(resp);
+
+	return;
+err:
+	tfw_http_resp_build_error(req);
+}
 
 /**
  * Received request can contain validation information. Process it according to
@@ -879,30 +1582,24 @@ tfw_handle_validation_req(TfwHttpReq *req, TfwCacheEntry *ce)
 	return true;
 }
 
+/**
+ * Match URI path @path and Host header value @host_val against the key of
+ * cache entry @ce.
+ */
 static bool
-tfw_cache_entry_key_eq(TDB *db, TfwHttpReq *req, TfwCacheEntry *ce)
+__tfw_cache_entry_key_eq(TDB *db, TfwStr *path, TfwStr *host_val,
+			 TfwCacheEntry *ce)
 {
 	/* Record key starts at first data chunk. */
 	int n, c_off = 0, t_off;
 	TdbVRec *trec = &ce->trec;
 	TfwStr *c, *h_start, *u_end, *h_end;
-	TfwStr host_val, *host = &req->h_tbl->tbl[TFW_HTTP_HDR_HOST];
-
-	if ((req->method != TFW_HTTP_METH_PURGE) && (ce->method != req->method))
-		return false;
-
-	/*
-	 * Get 'host' header value (from HTTP/2 or HTTP/1.1 request) for
-	 * strict comparison.
-	 */
-	tfw_http_msg_clnthdr_val(req, host, TFW_HTTP_HDR_HOST, &host_val);
 
-	if (req->uri_path.len + host_val.len != ce->key_len)
+	if (path->len + host_val->len != ce->key_len)
 		return false;
 
 	t_off = CE_BODY_SIZE;
-	TFW_CACHE_REQ_KEYITER(c, &req->uri_path, &host_val, u_end, h_start,
-			      h_end)
+	TFW_CACHE_REQ_KEYITER(c, path, host_val, u_end, h_start, h_end)
 	{
 		if (!trec)
 			return false;
@@ -925,1093 +1622,4617 @@ this_chunk:
 	return true;
 }
 
-static TfwCacheEntry *
-tfw_cache_dbce_get(TDB *db, TdbIter *iter, TfwHttpReq *req)
+static bool
+tfw_cache_entry_key_eq(TDB *db, TfwHttpReq *req, TfwCacheEntry *ce)
 {
-	TfwCacheEntry *ce;
-	unsigned long key = tfw_http_req_key_calc(req);
+	TfwStr host_val, *host = &req->h_tbl->tbl[TFW_HTTP_HDR_HOST];
+
+	if ((req->method != TFW_HTTP_METH_PURGE) && (ce->method != req->method))
+		return false;
 
-	*iter = tdb_rec_get(db, key);
-	if (TDB_ITER_BAD(*iter)) {
-		TFW_INC_STAT_BH(cache.misses);
-		return NULL;
-	}
 	/*
-	 * Cache may store one or more responses to the effective Request URI.
-	 * Basically, it is sufficient to store only the most recent response and
-	 * remove other representations from cache. (RFC 7234 4: When more than
-	 * one suitable response is stored, a cache MUST use the most recent
-	 * response) But there are still some cases when it is needed to store
-	 * more than one representation:
-	 *   - If selected representation of the effective Request URI depends
-	 *     on client capabilities. See RFC 7234 4.1 (Vary Header).
-	 *   - If origin server has several states of the resource, so during
-	 *     revalidation we can get the current state without downloading the
-	 *     full representation. This can reduce traffic to origin server.
-	 *     See RFC 7323 2.1 for the example.
-	 *
-	 * TODO: tfw_cache_entry_key_eq() should be extended to support
-	 * secondary keys (#508) and to skip not current representations.
-	 * Currently this function is used in two cases: to serve client and to
-	 * invalidate all cached responses (purge method).
+	 * Get 'host' header value (from HTTP/2 or HTTP/1.1 request) for
+	 * strict comparison.
 	 */
-	ce = (TfwCacheEntry *)iter->rec;
-	do {
-		/*
-		 * Basically we don't need to compare keys if only one record
-		 * is in the bucket. Checking for next record instead of
-		 * comparing the keys would has sense for long URI, but
-		 * performance benchmarks don't show any improvement.
-		 */
-		if (tfw_cache_entry_key_eq(db, req, ce))
-			break;
-		tdb_rec_next(db, iter);
-		if (!(ce = (TfwCacheEntry *)iter->rec)) {
-			TFW_INC_STAT_BH(cache.misses);
-			return NULL;
-		}
-	} while (true);
+	tfw_http_msg_clnthdr_val(req, host, TFW_HTTP_HDR_HOST, &host_val);
 
-	return ce;
+	return __tfw_cache_entry_key_eq(db, tfw_cache_key_path(req), &host_val,
+					ce);
 }
 
-static inline void
-tfw_cache_dbce_put(TfwCacheEntry *ce)
+/**
+ * Match name of header @hdr against lower case @name of @nlen bytes.
+ * HTTP/1 header names end with colon, while HTTP/2 ones are followed by
+ * the value chunks.
+ */
+static bool
+tfw_cache_hdr_name_eq(TfwStr *hdr, const char *name, size_t nlen, bool h2)
 {
-	if (ce)
-		tdb_rec_put(ce);
+	size_t i, n = 0;
+	TfwStr *c, *end;
+
+	if (TFW_STR_DUP(hdr))
+		hdr = hdr->chunks;
+	TFW_STR_FOR_EACH_CHUNK(c, hdr, end) {
+		if (h2 && (c->flags & TFW_STR_HDR_VALUE))
+			break;
+		for (i = 0; i < c->len; ++i, ++n) {
+			if (!h2 && c->data[i] == ':')
+				return n == nlen;
+			if (n == nlen || tolower(c->data[i]) != name[n])
+				return false;
+		}
+	}
+
+	return h2 && n == nlen;
 }
 
 /**
- * Copies plain TfwStr @src to TdbRec @trec.
- * @return number of copied bytes (@src length).
+ * Write normalized value of header @hdr to @p: OWS at the ends and around
+ * commas are removed and values of duplicate headers are joined with
+ * commas, so semantically equal values match, RFC 7234 4.1.
  *
- * The function copies part of some large data of length @tot_len,
- * so it tries to minimize total number of allocations regardless
- * how many chunks are copied.
+ * @return pointer to the end of written value or NULL if there is no room
+ * up to @end.
  */
-static long
-__tfw_cache_strcpy(char **p, TdbVRec **trec, TfwStr *src, size_t tot_len,
-		   void cpy(void *dest, const void *src, size_t n))
+static char *
+tfw_cache_hdr_val_norm(TfwStr *hdr, bool h2, char *p, char *end)
 {
-	long copied = 0;
+	int i;
+	char *start = p;
+	TfwStr *d, *d_end, *c, *c_end;
 
-	while (copied < src->len) {
-		int room = (*trec)->data + (*trec)->len - *p;
-		BUG_ON(room < 0);
-		if (!room) {
-			BUG_ON(tot_len < copied);
-			*trec = tdb_entry_add(node_db(), *trec,
-					      tot_len - copied);
-			if (!*trec)
-				return -ENOMEM;
-			*p = (*trec)->data;
-			room = (*trec)->len;
+	TFW_STR_FOR_EACH_DUP(d, hdr, d_end) {
+		bool val = false, ows = false;
+
+		if (p != start) {
+			if (p == end)
+				return NULL;
+			*p++ = ',';
+		}
+		TFW_STR_FOR_EACH_CHUNK(c, d, c_end) {
+			if (h2 && (c->flags & TFW_STR_HDR_VALUE))
+				val = true;
+			else if (h2)
+				continue;
+			for (i = 0; i < c->len; ++i) {
+				char ch = c->data[i];
+
+				if (!val) {
+					val = ch == ':';
+					continue;
+				}
+				if (ch == ' ' || ch == '\t') {
+					ows = true;
+					continue;
+				}
+				if (p + 2 > end)
+					return NULL;
+				if (ows && ch != ',' && p != start
+				    && p[-1] != ',')
+					*p++ = ' ';
+				ows = false;
+				*p++ = ch;
+			}
 		}
+	}
 
-		T_DBG3("Cache: copy [%.*s](%lu) to rec=%p(len=%u, next=%u),"
-		       " p=%p tot_len=%lu room=%d copied=%ld\n",
-		       PR_TFW_STR(src), src->len, *trec, (*trec)->len,
-		       (*trec)->chunk_next, *p, tot_len, room, copied);
+	return p;
+}
 
-		room = min((unsigned long)room, src->len - copied);
-		cpy(*p, src->data + copied, room);
-		*p += room;
-		copied += room;
+/**
+ * Write normalized value of request header @name of @nlen bytes to @p.
+ * Absent header is represented by an empty value.
+ */
+static char *
+tfw_cache_req_hdr_val(TfwHttpReq *req, const char *name, size_t nlen,
+		      char *p, char *end)
+{
+	TfwStr *hdr, *hdr_end;
+	bool h2 = TFW_MSG_H2(req);
+
+	FOR_EACH_HDR_FIELD_FROM(hdr, hdr_end, req, TFW_HTTP_HDR_REGULAR) {
+		if (TFW_STR_EMPTY(hdr)
+		    || !tfw_cache_hdr_name_eq(hdr, name, nlen, h2))
+			continue;
+		return tfw_cache_hdr_val_norm(hdr, h2, p, end);
 	}
 
-	return copied;
+	return p;
 }
 
 /**
- * We need the function wrapper if memcpy() is defined as __inline_memcpy().
+ * Check if query argument @arg of @len bytes must be dropped from the cache
+ * key. Names ending with '*' match all the arguments with the name prefix.
  */
-static void
-__tfw_memcpy(void *dst ,const void *src, size_t n)
+static bool
+tfw_cache_key_arg_dropped(const char *arg, size_t len)
 {
-	memcpy_fast(dst, src, n);
+	int i;
+	size_t nlen;
+	const char *eq = memchr(arg, '=', len);
+
+	if (eq)
+		len = eq - arg;
+	for (i = 0; i < cache_cfg.key.drop_n; ++i) {
+		const char *name = cache_cfg.key.drop[i];
+
+		nlen = strlen(name);
+		if (nlen && name[nlen - 1] == '*') {
+			if (len >= nlen - 1 && !memcmp(arg, name, nlen - 1))
+				return true;
+		}
+		else if (len == nlen && !memcmp(arg, name, len)) {
+			return true;
+		}
+	}
+
+	return false;
 }
 
-static inline long
-tfw_cache_strcpy(char **p, TdbVRec **trec, TfwStr *src, size_t tot_len)
+typedef struct {
+	const char	*data;
+	size_t		len;
+} TfwCacheKeyArg;
+
+static int
+tfw_cache_key_arg_cmp(const void *a, const void *b)
 {
-	return __tfw_cache_strcpy(p, trec, src, tot_len, __tfw_memcpy);
+	const TfwCacheKeyArg *a1 = a, *a2 = b;
+	int r = memcmp(a1->data, a2->data, min(a1->len, a2->len));
+
+	return r ? : (int)a1->len - (int)a2->len;
 }
 
 /**
- * The same as tfw_cache_strcpy(), but copies @src with lower case conversion.
+ * Find value of cookie @name of @nlen bytes in normalized value [@c, @end)
+ * of Cookie header.
  */
-static inline long
-tfw_cache_strcpy_lc(char **p, TdbVRec **trec, TfwStr *src, size_t tot_len)
+static const char *
+tfw_cache_cookie_val(const char *c, const char *end, const char *name,
+		     size_t nlen, size_t *vlen)
 {
-	return __tfw_cache_strcpy(p, trec, src, tot_len, tfw_cstrtolower);
-}
-
-#define CSTR_MOVE_HDR()				\
-do {						\
-	cs = (TfwCStr *)*p;			\
-	*p += TFW_CSTR_HDRLEN;			\
-	*tot_len -= TFW_CSTR_HDRLEN;		\
-	ce->hdr_len += TFW_CSTR_HDRLEN;		\
-} while (0)
+	const char *semi;
+
+	for ( ; c < end; c = semi + 1) {
+		if (!(semi = memchr(c, ';', end - c)))
+			semi = end;
+		while (c < semi && *c == ' ')
+			++c;
+		if (semi - c > nlen && c[nlen] == '=' && !memcmp(c, name, nlen))
+		{
+			*vlen = semi - c - nlen - 1;
+			return c + nlen + 1;
+		}
+	}
 
-#define CSTR_WRITE_HDR(f, l)			\
-do {						\
-	cs->flags = f;				\
-	cs->len = l;				\
-} while (0)
+	return NULL;
+}
 
 /**
- * Copies plain or compound (chunked) TfwStr @src to TdbRec @trec.
+ * Write normalized URI part of the cache key of @req to @p: the path is
+ * lower cased, the listed query arguments are dropped and the rest ones are
+ * sorted, the listed request headers and cookies are appended as lines of
+ * "name:value" format. The URI fragment is never a part of the key.
  *
- * @src is copied
- * @return number of copied bytes on success and negative value otherwise.
+ * @return length of the key or negative value if there is no room up to
+ * @end for the key.
  */
-static int
-tfw_cache_h2_copy_str(unsigned int *acc_len, char **p, TdbVRec **trec,
-		      TfwStr *src, size_t *tot_len)
+static long
+tfw_cache_key_norm(TfwHttpReq *req, char *p, char *end)
 {
-	long n;
-	TfwStr *c, *end;
+	int i, n = 0;
+	size_t len;
+	char *start = p, *uri = (*this_cpu_ptr(&g_key_buf))[0];
+	char *u_end, *q, *a, *amp;
+	TfwCacheKeyArg args[TFW_CACHE_KEY_ARGS_MAX];
 
-	BUG_ON(TFW_STR_DUP(src));
+	if (req->uri_path.len >= TFW_CACHE_KEY_MAXLEN)
+		return -E2BIG;
+	len = tfw_str_to_cstr(&req->uri_path, uri, TFW_CACHE_KEY_MAXLEN);
+	u_end = uri + len;
+	if ((q = memchr(uri, '#', u_end - uri)))
+		u_end = q;
+	if (!(q = memchr(uri, '?', u_end - uri)))
+		q = u_end;
+
+	len = q - uri;
+	if (cache_cfg.key.lowercase)
+		tfw_cstrtolower(p, uri, len);
+	else
+		memcpy_fast(p, uri, len);
+	p += len;
 
-	if (unlikely(!src->len))
-		return 0;
+	for (a = q + 1; a < u_end; a = amp + 1) {
+		if (!(amp = memchr(a, '&', u_end - a)))
+			amp = u_end;
+		if (amp == a || tfw_cache_key_arg_dropped(a, amp - a))
+			continue;
+		if (n == TFW_CACHE_KEY_ARGS_MAX)
+			return -E2BIG;
+		args[n].data = a;
+		args[n++].len = amp - a;
+	}
+	if (cache_cfg.key.sort_args)
+		sort(args, n, sizeof(args[0]), tfw_cache_key_arg_cmp, NULL);
+	/* The arguments take no more room than in the URI. */
+	for (i = 0; i < n; ++i) {
+		*p++ = i ? '&' : '?';
+		memcpy_fast(p, args[i].data, args[i].len);
+		p += args[i].len;
+	}
 
-	TFW_STR_FOR_EACH_CHUNK(c, src, end) {
-		if ((n = tfw_cache_strcpy(p, trec, c, *tot_len)) < 0) {
-			T_ERR("Cache: cannot copy chunk of HTTP/2 string\n");
-			return -ENOMEM;
-		}
+	for (i = 0; i < cache_cfg.key.hdr_n; ++i) {
+		const char *name = cache_cfg.key.hdr[i];
 
-		*tot_len -= n;
-		*acc_len += n;
+		len = strlen(name);
+		if (p + len + 2 > end)
+			return -E2BIG;
+		*p++ = '\n';
+		memcpy_fast(p, name, len);
+		p += len;
+		*p++ = ':';
+		if (!(p = tfw_cache_req_hdr_val(req, name, len, p, end)))
+			return -E2BIG;
 	}
 
-	return 0;
+	if (cache_cfg.key.cookie_n) {
+		const char *c, *c_end;
+
+		/* The URI isn't needed any more, reuse its buffer. */
+		c_end = tfw_cache_req_hdr_val(req, "cookie", 6, uri,
+					      uri + TFW_CACHE_KEY_MAXLEN);
+		if (!c_end)
+			return -E2BIG;
+		for (i = 0; i < cache_cfg.key.cookie_n; ++i) {
+			const char *name = cache_cfg.key.cookie[i];
+			size_t vlen = 0;
+
+			len = strlen(name);
+			if (!(c = tfw_cache_cookie_val(uri, c_end, name, len,
+						       &vlen)))
+				c = uri;
+			if (p + SLEN("\ncookie:") + len + 1 + vlen > end)
+				return -E2BIG;
+			memcpy_fast(p, "\ncookie:", SLEN("\ncookie:"));
+			p += SLEN("\ncookie:");
+			memcpy_fast(p, name, len);
+			p += len;
+			*p++ = '=';
+			memcpy_fast(p, c, vlen);
+			p += vlen;
+		}
+	}
+
+	return p - start;
 }
 
-static inline int
-tfw_cache_h2_copy_int(unsigned int *acc_len, unsigned long src,
-		      unsigned short max, char **p, TdbVRec **trec,
-		      size_t *tot_len)
+/**
+ * Get URI part of the cache key of @req. The key is normalized only once
+ * for a request, so the same key is used by the cache and the hash
+ * scheduler. Requests with too long URIs or headers for the normalization
+ * use the raw URI.
+ */
+TfwStr *
+tfw_cache_key_path(TfwHttpReq *req)
 {
-	int r;
-	TfwHPackInt hp_int;
-	TfwStr str = {};
+	long len;
+	TfwStr *s;
+	char *buf;
+
+	if (req->key_path)
+		return req->key_path;
+	if (!cache_cfg.key.on || test_bit(TFW_HTTP_B_HMONITOR, req->flags))
+		return &req->uri_path;
+
+	req->key_path = &req->uri_path;
+	buf = (*this_cpu_ptr(&g_key_buf))[1];
+	len = tfw_cache_key_norm(req, buf, buf + TFW_CACHE_KEY_MAXLEN);
+	if (len < 0) {
+		T_DBG2("Cache: cannot normalize key, use raw URI\n");
+		return req->key_path;
+	}
+	if (!(s = tfw_pool_alloc(req->pool, sizeof(TfwStr) + len)))
+		return req->key_path;
+	TFW_STR_INIT(s);
+	s->data = (char *)(s + 1);
+	s->len = len;
+	memcpy_fast(s->data, buf, len);
+	req->key_path = s;
+
+	return s;
+}
 
-	write_int(src, max, 0, &hp_int);
+/**
+ * Build secondary key of a response to @req, which representation depends
+ * on comma separated lower case request header names @names of @nlen bytes
+ * listed in Vary header. The key is written at @*p.
+ */
+static int
+tfw_cache_vary_key_build(TfwHttpReq *req, const char *names, size_t nlen,
+			 char **p, char *end)
+{
+	const char *n, *n_end = names + nlen, *comma;
 
-	str.data = hp_int.buf;
-	str.len = hp_int.sz;
+	for (n = names; n < n_end; n = comma + 1) {
+		size_t len;
 
-	if ((r = tfw_cache_h2_copy_str(acc_len, p, trec, &str, tot_len)))
-		return r;
+		if (!(comma = memchr(n, ',', n_end - n)))
+			comma = n_end;
+		if (!(len = comma - n))
+			continue;
+		/* RFC 7234 4.1: "*" always fails to match. */
+		if (len == 1 && *n == '*')
+			return -EINVAL;
+
+		if (*p + len + 1 >= end)
+			return -E2BIG;
+		memcpy_fast(*p, n, len);
+		*p += len;
+		*(*p)++ = ':';
+		if (!(*p = tfw_cache_req_hdr_val(req, n, len, *p, end))
+		    || *p == end)
+			return -E2BIG;
+		*(*p)++ = '\n';
+	}
 
 	return 0;
 }
 
 /**
- * Deep HTTP header copy to TdbRec.
- * @hdr is copied in depth first fashion to speed up upcoming scans.
- * @return number of copied bytes on success and negative value otherwise.
+ * Build secondary key @key of the cached response @resp from the request
+ * headers listed in the response Vary header. @key is empty if there is no
+ * Vary header.
  */
-static long
-tfw_cache_h2_copy_hdr(TfwCacheEntry *ce, char **p, TdbVRec **trec, TfwStr *hdr,
-		      size_t *tot_len)
+static int
+tfw_cache_vary_key(TfwHttpResp *resp, TfwStr *key)
 {
-	TfwCStr *cs;
-	long n = sizeof(TfwCStr);
-	unsigned short st_index = 0;
-	bool dupl = TFW_STR_DUP(hdr);
-	unsigned int init_len = ce->hdr_len;
-	TfwStr s_nm, s_val, *dup, *dup_end;
+	int r;
+	char *names, *p, *end;
+	unsigned int id;
+	static const TfwStr vary = TFW_STR_STRING("vary:");
 
-	T_DBG3("%s: ce=[%p] p=[%p], trec=[%p], tot_len='%zu'\n", __func__, ce,
-	       *p, *trec, *tot_len);
-
-	if (likely(!dupl)) {
-		unsigned long h_len;
+	TFW_STR_INIT(key);
+	id = tfw_http_msg_hdr_lookup((TfwHttpMsg *)resp, &vary);
+	if (id == resp->h_tbl->off)
+		return 0;
 
-		TFW_STR_INIT(&s_nm);
-		TFW_STR_INIT(&s_val);
-		tfw_http_hdr_split(hdr, &s_nm, &s_val, true);
+	names = (*this_cpu_ptr(&g_vary_buf))[0];
+	end = tfw_cache_hdr_val_norm(&resp->h_tbl->tbl[id], false, names,
+				     names + TFW_CACHE_VARY_MAXLEN);
+	if (!end)
+		return -E2BIG;
+	tfw_cstrtolower(names, names, end - names);
 
-		st_index = hdr->hpack_idx;
-		h_len = tfw_h2_hdr_size(s_nm.len, s_val.len, st_index);
+	key->data = p = *this_cpu_ptr(&g_vary_key);
+	r = tfw_cache_vary_key_build(resp->req, names, end - names, &p,
+				     key->data + TFW_CACHE_VARY_MAXLEN);
+	key->len = p - (char *)key->data;
 
-		/* Don't split short strings. */
-		if (sizeof(TfwCStr) + h_len <= L1_CACHE_BYTES)
-			n += h_len;
-	}
+	return r;
+}
 
-	*p = tdb_entry_get_room(node_db(), trec, *p, n, *tot_len);
-	if (unlikely(!*p)) {
-		T_WARN("Cache: cannot allocate TDB space\n");
-		return -ENOMEM;
-	}
+/**
+ * Copy @len bytes of cache entry @ce data at offset @off to @buf.
+ */
+static int
+tfw_cache_entry_read(TDB *db, TfwCacheEntry *ce, long off, char *buf,
+		     size_t len)
+{
+	size_t n;
+	TdbVRec *trec = &ce->trec;
+	char *p = TDB_PTR(db->hdr, off);
 
-	CSTR_MOVE_HDR();
+	while (p < trec->data || p > trec->data + trec->len)
+		if (!(trec = tdb_next_rec_chunk(db, trec)))
+			return -EINVAL;
 
-	if (TFW_STR_DUP(hdr)) {
-		CSTR_WRITE_HDR(TFW_STR_DUPLICATE, hdr->nchunks);
-		CSTR_MOVE_HDR();
+	while (len) {
+		if (p == trec->data + trec->len) {
+			if (!(trec = tdb_next_rec_chunk(db, trec)))
+				return -EINVAL;
+			p = trec->data;
+		}
+		n = min(len, (size_t)(trec->data + trec->len - p));
+		memcpy_fast(buf, p, n);
+		buf += n;
+		p += n;
+		len -= n;
 	}
 
-	TFW_STR_FOR_EACH_DUP(dup, hdr, dup_end) {
-		unsigned int prev_len = ce->hdr_len;
+	return 0;
+}
 
-		if (dupl) {
-			TFW_STR_INIT(&s_nm);
-			TFW_STR_INIT(&s_val);
-			tfw_http_hdr_split(dup, &s_nm, &s_val, true);
-			st_index = dup->hpack_idx;
-			CSTR_MOVE_HDR();
-		}
+/**
+ * Match request @req headers against secondary key of cache entry @ce.
+ */
+static bool
+tfw_cache_entry_vary_eq(TDB *db, TfwHttpReq *req, TfwCacheEntry *ce)
+{
+	char *s, *s_end, *nl, *colon, *v, *v_end;
 
-		if (st_index) {
-			if (tfw_cache_h2_copy_int(&ce->hdr_len, st_index, 0xF,
-						  p, trec, tot_len))
-				return -ENOMEM;
-		}
-		else {
-			if (tfw_cache_h2_copy_int(&ce->hdr_len, 0, 0xF, p, trec,
-						  tot_len)
-			    || tfw_cache_h2_copy_int(&ce->hdr_len, s_nm.len,
-						     0x7f, p, trec, tot_len)
-			    || tfw_cache_h2_copy_str(&ce->hdr_len, p, trec,
-						     &s_nm, tot_len))
-				return -ENOMEM;
-		}
+	if (!ce->vary_len)
+		return true;
+	if (req->method == TFW_HTTP_METH_PURGE)
+		return true;
 
-		if (tfw_cache_h2_copy_int(&ce->hdr_len, s_val.len, 0x7f, p,
-					  trec, tot_len)
-		    || tfw_cache_h2_copy_str(&ce->hdr_len, p, trec, &s_val,
-					     tot_len))
-			return -ENOMEM;
+	s = (*this_cpu_ptr(&g_vary_buf))[0];
+	v = (*this_cpu_ptr(&g_vary_buf))[1];
+	if (WARN_ON_ONCE(ce->vary_len > TFW_CACHE_VARY_MAXLEN)
+	    || tfw_cache_entry_read(db, ce, ce->vary, s, ce->vary_len))
+		return false;
 
-		CSTR_WRITE_HDR(0, ce->hdr_len - prev_len);
+	for (s_end = s + ce->vary_len; s < s_end; s = nl + 1) {
+		if (!(nl = memchr(s, '\n', s_end - s))
+		    || !(colon = memchr(s, ':', nl - s)))
+			return false;
+		v_end = tfw_cache_req_hdr_val(req, s, colon - s, v,
+					      v + TFW_CACHE_VARY_MAXLEN);
+		if (!v_end || v_end - v != nl - colon - 1
+		    || memcmp(v, colon + 1, v_end - v))
+			return false;
 	}
 
-	T_DBG3("%s: p=[%p], trec=[%p], ce->hdr_len='%u', tot_len='%zu'\n",
-	       __func__, *p, *trec, ce->hdr_len, *tot_len);
-
-	return ce->hdr_len - init_len;
+	return true;
 }
 
-static long
-tfw_cache_h2_add_hdr(TfwCacheEntry *ce, char **p, TdbVRec **trec,
-		     unsigned short st_idx, TfwStr *val, size_t *tot_len)
+static bool
+tfw_cache_range_num(char **p, char *end, unsigned long *val)
 {
-	TfwCStr *cs;
-	unsigned long len;
-	unsigned int prev_len = ce->hdr_len;
-	long n = TFW_CSTR_HDRLEN;
+	char *start = *p;
 
-	BUG_ON(!st_idx || TFW_STR_EMPTY(val));
-
-	len = tfw_hpack_int_size(st_idx, 0xF)
-		+ tfw_hpack_int_size(val->len, 0x7F)
-		+ val->len;
-
-	if (unlikely(len >= TFW_CSTR_MAXLEN)) {
-		T_WARN("Cache: trying to store too big string %lx\n", len);
-		return -E2BIG;
+	for (*val = 0; *p < end && isdigit(**p); ++*p) {
+		if (*val > (ULONG_MAX - 9) / 10)
+			return false;
+		*val = *val * 10 + **p - '0';
 	}
 
-	/* Don't split short strings. */
-	if (TFW_CSTR_HDRLEN + len <= L1_CACHE_BYTES)
-		n += len;
-
-	*p = tdb_entry_get_room(node_db(), trec, *p, n, *tot_len);
-	if (unlikely(!*p)) {
-		T_WARN("jCache: cannot allocate TDB space\n");
-		return -ENOMEM;
-	}
+	return *p != start;
+}
 
-	CSTR_MOVE_HDR();
+/**
+ * Get the byte range of cached response @ce body requested by @req Range
+ * header. Only single range requests to full 200 responses, which aren't
+ * assembled from ESI fragments, are served with 206 responses, for all
+ * other requests the full response is sent since RFC 7233 3.1 allows to
+ * ignore Range header. Unsatisfiable ranges are also served with full
+ * responses instead of 416.
+ */
+static bool
+tfw_cache_req_range(TfwHttpReq *req, TfwCacheEntry *ce, TfwCacheRange *range)
+{
+	char *v, *p, *end;
+	bool has_first, has_last;
+	unsigned long len = ce->body_len;
 
-	if (tfw_cache_h2_copy_int(&ce->hdr_len, st_idx, 0xF, p, trec, tot_len))
-		return -ENOMEM;
+	if (req->method != TFW_HTTP_METH_GET || ce->resp_status != 200
+	    || !len || test_bit(TFW_HTTP_B_CHUNKED, ce->hmflags)
+	    || (ce->flags & TFW_CE_GZIP) || ce->esi_len)
+		return false;
 
-	if (tfw_cache_h2_copy_int(&ce->hdr_len, val->len, 0x7f, p, trec,
-				  tot_len))
-		return -ENOMEM;
+	v = (*this_cpu_ptr(&g_vary_buf))[0];
+	end = v + TFW_CACHE_VARY_MAXLEN;
+	/*
+	 * If-Range validators aren't evaluated, just send the full
+	 * response, RFC 7233 3.2.
+	 */
+	if (tfw_cache_req_hdr_val(req, "if-range", SLEN("if-range"), v, end)
+	    != v)
+		return false;
+	end = tfw_cache_req_hdr_val(req, "range", SLEN("range"), v, end);
+	if (!end || end - v <= SLEN("bytes=")
+	    || strncasecmp(v, "bytes=", SLEN("bytes=")))
+		return false;
 
-	if (tfw_cache_h2_copy_str(&ce->hdr_len, p, trec, val, tot_len))
-		return -ENOMEM;
+	p = v + SLEN("bytes=");
+	has_first = tfw_cache_range_num(&p, end, &range->first);
+	if (p == end || *p++ != '-')
+		return false;
+	has_last = tfw_cache_range_num(&p, end, &range->last);
+	/* Multiple ranges aren't supported. */
+	if (p != end)
+		return false;
 
-	CSTR_WRITE_HDR(0, ce->hdr_len - prev_len - TFW_CSTR_HDRLEN);
+	if (has_first) {
+		if (range->first >= len
+		    || (has_last && range->last < range->first))
+			return false;
+		if (!has_last || range->last >= len)
+			range->last = len - 1;
+	} else {
+		/* suffix-byte-range-spec. */
+		if (!has_last || !range->last)
+			return false;
+		range->first = range->last >= len ? 0 : len - range->last;
+		range->last = len - 1;
+	}
 
-	return ce->hdr_len - prev_len;
+	return true;
 }
 
 /**
- * Fill @ce->etag with entity-tag value. RFC 7232 Section-2.3 doesn't limit
- * etag size, so can't just have a copy of entity-tag value somewhere in @ce,
- * instead fill @ce->etag TfwStr to correct offset in @ce->hdrs. Also set
- * WEAK tag to the first chunk of @ce->etag if applied. This is needed for Range
- * requests.
- *
- * @h_off, @h_trec	- supposed offset and record of stored 'ETag:' header;
- * @curr_p, @curr_rec	- used to store compound @ce->etag.
+ * Check if the client of request @req accepts gzip content-coding, RFC 7231
+ * 5.3.4. A coding with zero qvalue isn't acceptable. The identity coding is
+ * used if there is no Accept-Encoding header, since it's always acceptable.
  */
-static int
-__set_etag(TfwCacheEntry *ce, TfwHttpResp *resp, long h_off, TdbVRec *h_trec,
-	   char *curr_p, TdbVRec **curr_trec)
+static bool
+tfw_cache_accept_gzip(TfwHttpReq *req)
 {
-	char *e_p;
-	size_t c_size;
-	TDB *db = node_db();
-	size_t len = 0;
-	unsigned short flags = 0;
-	TfwStr h_val, *c, *end, *h = &resp->h_tbl->tbl[TFW_HTTP_HDR_ETAG];
-	TfwStr s_dummy = {}, s_val = {};
+	char *v, *p, *q, *tok, *end;
+	size_t n;
+
+	v = (*this_cpu_ptr(&g_vary_buf))[0];
+	end = tfw_cache_req_hdr_val(req, "accept-encoding",
+				    SLEN("accept-encoding"), v,
+				    v + TFW_CACHE_VARY_MAXLEN);
+	if (!end)
+		return false;
 
-#define CHECK_REC_SPACE()						\
-	while (c_size) {						\
-		size_t tail = h_trec->len - (e_p - h_trec->data);	\
-		if (c_size > tail) {					\
-			c_size -= tail;					\
-			h_trec = tdb_next_rec_chunk(db, h_trec);	\
-			e_p = h_trec->data;				\
-		} else {						\
-			e_p += c_size;					\
-			c_size = 0;					\
-		}							\
+	for (p = v; p < end; p = tok + 1) {
+		tok = memchr(p, ',', end - p) ? : end;
+		q = memchr(p, ';', tok - p) ? : tok;
+		for (n = q - p; n && p[n - 1] == ' '; --n)
+			;
+		if (!(n == 1 && *p == '*')
+		    && !(n == SLEN("gzip") && !strncasecmp(p, "gzip", n))
+		    && !(n == SLEN("x-gzip") && !strncasecmp(p, "x-gzip", n)))
+			continue;
+		if (q == tok)
+			return true;
+		for (++q; q < tok && *q == ' '; ++q)
+			;
+		if (tok - q < 2 || strncasecmp(q, "q=", 2))
+			return true;
+		/* q=0, q=0.0 and so on. */
+		for (q += 2; q < tok && (*q == '0' || *q == '.'); ++q)
+			;
+		return q != tok;
 	}
 
-	if (TFW_STR_EMPTY(h))
-		return 0;
-
-	tfw_http_msg_srvhdr_val(h, TFW_HTTP_HDR_ETAG, &h_val);
+	return false;
+}
 
-	/* Update supposed Etag offset to real value. */
-	/* FIXME: #803 */
-	e_p = TDB_PTR(db->hdr, h_off);
-	if (e_p + TFW_CSTR_HDRLEN > h_trec->data + h_trec->len) {
-		h_trec = tdb_next_rec_chunk(db, h_trec);
-		e_p = h_trec->data;
-	}
-	/*
-	 * Skip anything that is not etag value. Note, since headers are
-	 * stored in cache in HTTP/2 representation (and the name of 'etag'
-	 * header is always statically indexed), we should also skip index
-	 * and value length fields; the 'etag' header has the 34 index in
-	 * HPACK static table, thus we definitely now here, that it will
-	 * occupy 2 bytes (RFC 7541 section 6.2.2).
-	 */
-	e_p += TFW_CSTR_HDRLEN;
-	tfw_http_hdr_split(h, &s_dummy, &s_val, true);
-	c_size = 2 + tfw_hpack_int_size(s_val.len, 0x7F);
-	CHECK_REC_SPACE();
-	TFW_STR_FOR_EACH_CHUNK(c, &h_val, end) {
-		if (c->flags & TFW_STR_VALUE) {
-			flags = c->flags;
-			break;
-		}
-		c_size = c->len;
-		CHECK_REC_SPACE();
-	}
-	for ( ; (c < end) && (c->flags & TFW_STR_VALUE); ++c)
-		len += c->len;
+/**
+ * Get cache usage accounting of @vhost, create it on first use of the cache
+ * by the vhost.
+ */
+static TfwCacheAcct *
+tfw_cache_acct_get(TfwVhost *vhost)
+{
+	TfwCacheAcct *acct;
+	size_t size;
 
-	/* Create TfWStr that contains only entity-tag value. */
-	ce->etag.data = e_p;
-	ce->etag.flags = flags;
-	ce->etag.len = min(len, (size_t)(h_trec->len -
-					 (e_p - h_trec->data)));
-	len -= ce->etag.len;
+	if (unlikely(!vhost))
+		return NULL;
+	if (likely(acct = READ_ONCE(vhost->cache_acct)))
+		return acct;
 
-	while (len) {
-		h_trec = tdb_next_rec_chunk(db, h_trec);
-		e_p = h_trec->data;
-		c = tfw_str_add_compound(resp->pool, &ce->etag);
-		if (!c)
-			return -ENOMEM;
-		c->data = e_p;
-		c->len = min(len, (size_t)(h_trec->len -
-					   (e_p - h_trec->data)));
-		len -= c->len;
+	spin_lock_bh(&cache_acct_lock);
+	if ((acct = vhost->cache_acct))
+		goto out;
+	list_for_each_entry(acct, &cache_acct_list, list)
+		if (!strcmp(acct->name, vhost->name.data))
+			goto found;
+
+	size = sizeof(TfwCacheAcct) + sizeof(atomic64_t) * nr_node_ids;
+	if (!(acct = kzalloc(size + vhost->name.len + 1, GFP_ATOMIC))) {
+		T_WARN("Cache: cannot allocate accounting for vhost '%s'\n",
+		       (char *)vhost->name.data);
+		goto out;
 	}
+	acct->name = (char *)acct + size;
+	memcpy((char *)acct->name, vhost->name.data, vhost->name.len);
+	list_add_tail(&acct->list, &cache_acct_list);
+found:
+	acct->quota = vhost->cache_quota;
+	WRITE_ONCE(vhost->cache_acct, acct);
+out:
+	spin_unlock_bh(&cache_acct_lock);
 
-	/* Compound string was allocated in resp->pool, move to cache entry. */
-	if (!TFW_STR_PLAIN(&ce->etag)) {
-		len = sizeof(TfwStr *) * ce->etag.nchunks;
-		curr_p = tdb_entry_get_room(node_db(), curr_trec, curr_p, len,
-					    len);
-		if (!curr_p)
-			return -ENOMEM;
-		memcpy_fast(curr_p, ce->etag.data, len);
-		ce->etag.data = curr_p;
-		/* Old ce->etag.data will be destroyed with resp. */
-	}
+	return acct;
+}
 
-	return 0;
+static void
+tfw_cache_acct_stat(TfwHttpReq *req, bool hit)
+{
+	TfwCacheAcct *acct;
 
-#undef CHECK_REC_SPACE
+	trace_tfw_cache_lookup(req, hit);
+
+	acct = tfw_cache_acct_get(req->vhost);
+	if (unlikely(!acct))
+		return;
+	if (hit)
+		atomic64_inc(&acct->hits);
+	else
+		atomic64_inc(&acct->misses);
 }
 
 /**
- * Check if the header @hdr must be present in 304 response. If yes save its
- * offset in cache entry @ce for fast creation of 304 response in
- * tfw_cahe_send_304().
+ * Print cache usage of each vhost.
  */
-static bool
-__save_hdr_304_off(TfwCacheEntry *ce, TfwHttpResp *resp, TfwStr *hdr, long off)
+void
+tfw_cache_acct_show(struct seq_file *seq)
 {
-	int i;
-	unsigned int num;
-	const TfwStr *match;
+	int nid;
+	long mem;
+	TfwCacheAcct *acct;
 
-	if (TFW_STR_EMPTY(hdr))
-		return false;
-
-	num = hdr - resp->h_tbl->tbl;
-	if (num < TFW_HTTP_HDR_RAW) {
-		if (!tfw_cache_spec_headers_304[num])
-			return false;
-
-		for (i = 0; ce->hdrs_304[i]; ++i)
-			;
-		ce->hdrs_304[i] = off;
-		return true;
+	spin_lock_bh(&cache_acct_lock);
+	list_for_each_entry(acct, &cache_acct_list, list) {
+		mem = 0;
+		for_each_node_with_cpus(nid)
+			mem += atomic64_read(&acct->mem[nid]);
+		seq_printf(seq, "Cache vhost '%s'\t\t\t: mem %ld quota %u"
+			   " hits %lld misses %lld evicted %lld"
+			   " rejected %lld\n",
+			   acct->name, mem, acct->quota,
+			   (long long)atomic64_read(&acct->hits),
+			   (long long)atomic64_read(&acct->misses),
+			   (long long)atomic64_read(&acct->evicted),
+			   (long long)atomic64_read(&acct->rejected));
 	}
+	spin_unlock_bh(&cache_acct_lock);
+}
 
-	match = tfw_http_msg_find_hdr(hdr, tfw_cache_raw_headers_304);
-	if (match) {
-		unsigned char sc = *(unsigned char *)match->data;
+/**
+ * Print cache usage of @vhost.
+ */
+void
+tfw_cache_acct_vhost_show(struct seq_file *seq, TfwVhost *vhost)
+{
+	int nid;
+	long mem = 0;
+	TfwCacheAcct *acct = READ_ONCE(vhost->cache_acct);
 
-		/* RFC 7234 4.1: Don't send Last-Modified if ETag is present. */
-		 if ((sc == 'l')
-		     && !TFW_STR_EMPTY(&resp->h_tbl->tbl[TFW_HTTP_HDR_ETAG]))
-			return false;
+	if (!acct)
+		return;
+	for_each_node_with_cpus(nid)
+		mem += atomic64_read(&acct->mem[nid]);
+	seq_printf(seq, "Cache memory\t\t: %ld\n", mem);
+	seq_printf(seq, "Cache quota\t\t: %u\n", acct->quota);
+	seq_printf(seq, "Cache hits\t\t: %lld\n",
+		   (long long)atomic64_read(&acct->hits));
+	seq_printf(seq, "Cache misses\t\t: %lld\n",
+		   (long long)atomic64_read(&acct->misses));
+}
 
-		i = match - tfw_cache_raw_headers_304;
-		ce->hdrs_304[i + TFW_CACHE_304_SPEC_HDRS_NUM] = off;
-		return true;
-	}
+/*
+ * Number of the cache works queued to the current CPU by other NUMA nodes.
+ */
+unsigned int
+tfw_cache_wq_backlog(void)
+{
+	TfwWorkTasklet *ct = this_cpu_ptr(&cache_wq);
 
-	return false;
+	/* The queues aren't allocated if the cache isn't used. */
+	return ct->wq.rings ? tfw_nq_size(&ct->wq) : 0;
 }
 
-/**
- * Copy response skbs to database mapped area.
- * @tot_len	- total length of actual data to write w/o TfwCStr's etc;
- * @rph		- response reason-phrase to be saved in the cache.
- *
- * It's nasty to copy data on CPU, but we can't use DMA for mmaped file
- * as well as for unaligned memory areas.
+/*
+ * Print the cache metrics in Prometheus exposition format, see
+ * tfw_metrics_seq_show().
  */
-static int
-tfw_cache_copy_resp(TfwCacheEntry *ce, TfwHttpResp *resp, TfwStr *rph,
-		    size_t tot_len)
+void
+tfw_cache_metrics_show(struct seq_file *seq)
 {
-	int r, i;
-	char *p;
-	unsigned short status_idx;
-	TfwStr *field, *h, *end1, *end2;
-	TDB *db = node_db();
-	TdbVRec *trec = &ce->trec, *etag_trec = NULL;
-	long n, etag_off = 0;
-	TfwHttpReq *req = resp->req;
-	TfwGlobal *g_vhost = tfw_vhost_get_global();
-	TfwStr h_val, *host = &req->h_tbl->tbl[TFW_HTTP_HDR_HOST];
-	TfwStr val_srv = TFW_STR_STRING(TFW_SERVER);
-	TfwStr val_via = {
-		.chunks = (TfwStr []) {
-			{ .data = S_VIA_H2_PROTO, .len = SLEN(S_VIA_H2_PROTO) },
-			{ .data = *this_cpu_ptr(&g_c_buf),
-			  .len = g_vhost->hdr_via_len },
-		},
-		.len = SLEN(S_VIA_H2_PROTO) + g_vhost->hdr_via_len,
-		.nchunks = 2
-	};
-
-	p = (char *)(ce + 1);
-	tot_len -= CE_BODY_SIZE;
+	int nid;
+	long mem;
+	TfwCacheAcct *acct;
 
-	/* Write record key (URI + Host header). */
-	ce->key = TDB_OFF(db->hdr, p);
-	ce->key_len = 0;
+	if (!cache_cfg.cache)
+		return;
 
-	/*
-	 * Get 'host' header value (from HTTP/2 or HTTP/1.1 request) for
-	 * strict comparison.
-	 */
-	tfw_http_msg_clnthdr_val(req, host, TFW_HTTP_HDR_HOST, &h_val);
-	TFW_CACHE_REQ_KEYITER(field, &req->uri_path, &h_val, end1, h, end2) {
-		if ((n = tfw_cache_strcpy_lc(&p, &trec, field, tot_len)) < 0) {
-			T_ERR("Cache: cannot copy request key\n");
-			return -ENOMEM;
-		}
-		BUG_ON(n > tot_len);
-		tot_len -= n;
-		ce->key_len += n;
+	seq_printf(seq, "# TYPE tempesta_cache_db_size_bytes gauge\n");
+	for_each_node_with_cpus(nid)
+		seq_printf(seq, "tempesta_cache_db_size_bytes{node=\"%d\"} %u\n",
+			   nid, cache_cfg.db_size);
+	seq_printf(seq, "# TYPE tempesta_cache_mem_bytes gauge\n");
+	for_each_node_with_cpus(nid)
+		seq_printf(seq, "tempesta_cache_mem_bytes{node=\"%d\"} %zu\n",
+			   nid, READ_ONCE(c_nodes[nid].mem));
+
+	spin_lock_bh(&cache_acct_lock);
+	list_for_each_entry(acct, &cache_acct_list, list) {
+		mem = 0;
+		for_each_node_with_cpus(nid)
+			mem += atomic64_read(&acct->mem[nid]);
+		seq_printf(seq, "tempesta_cache_vhost_mem_bytes{vhost=\"%s\"}"
+			   " %ld\n", acct->name, mem);
+		seq_printf(seq, "tempesta_cache_vhost_quota_bytes{vhost=\"%s\"}"
+			   " %u\n", acct->name, acct->quota);
+		seq_printf(seq, "tempesta_cache_vhost_hits_total{vhost=\"%s\"}"
+			   " %lld\n", acct->name,
+			   (long long)atomic64_read(&acct->hits));
+		seq_printf(seq, "tempesta_cache_vhost_misses_total{vhost=\"%s\"}"
+			   " %lld\n", acct->name,
+			   (long long)atomic64_read(&acct->misses));
+		seq_printf(seq, "tempesta_cache_vhost_evicted_total"
+			   "{vhost=\"%s\"} %lld\n", acct->name,
+			   (long long)atomic64_read(&acct->evicted));
+		seq_printf(seq, "tempesta_cache_vhost_rejected_total"
+			   "{vhost=\"%s\"} %lld\n", acct->name,
+			   (long long)atomic64_read(&acct->rejected));
 	}
+	spin_unlock_bh(&cache_acct_lock);
+}
 
-	/* Request method is a part of the cache record key. */
-	ce->method = req->method;
-
-	/* Write ':status' pseudo-header. */
-	ce->status = TDB_OFF(db->hdr, p);
-	status_idx = tfw_h2_pseudo_index(resp->status);
-	if (status_idx) {
-		TfwHPackInt hp_idx;
-		TfwStr str = {};
+static void
+tfw_cache_acct_free(void)
+{
+	TfwCacheAcct *acct, *tmp;
 
-		write_int(status_idx, 0x7F, 0x80, &hp_idx);
-		str.data = hp_idx.buf;
-		str.len = hp_idx.sz;
+	list_for_each_entry_safe(acct, tmp, &cache_acct_list, list)
+		kfree(acct);
+	INIT_LIST_HEAD(&cache_acct_list);
+}
 
-		if (tfw_cache_h2_copy_str(&ce->status_len, &p, &trec, &str,
-					  &tot_len))
-			return -ENOMEM;
-	} else {
-		char buf[H2_STAT_VAL_LEN];
-		TfwStr str = {
-			.data = buf,
-			.len = H2_STAT_VAL_LEN
-		};
+static TfwCacheEntry *
+tfw_cache_dbce_get(TDB *db, TdbIter *iter, TfwHttpReq *req)
+{
+	TfwCacheEntry *ce;
+	unsigned long key = tfw_http_req_key_calc(req);
 
+	*iter = tdb_rec_get(db, key);
+	if (TDB_ITER_BAD(*iter))
+		return NULL;
+	/*
+	 * Cache may store one or more responses to the effective Request URI.
+	 * Basically, it is sufficient to store only the most recent response and
+	 * remove other representations from cache. (RFC 7234 4: When more than
+	 * one suitable response is stored, a cache MUST use the most recent
+	 * response) But there are still some cases when it is needed to store
+	 * more than one representation:
+	 *   - If selected representation of the effective Request URI depends
+	 *     on client capabilities. See RFC 7234 4.1 (Vary Header).
+	 *   - If origin server has several states of the resource, so during
+	 *     revalidation we can get the current state without downloading the
+	 *     full representation. This can reduce traffic to origin server.
+	 *     See RFC 7323 2.1 for the example.
+	 *
+	 * Representations selected by request headers listed in Vary are
+	 * matched by secondary keys. Older responses for the same request are
+	 * marked as superseded when a new one is stored, so only the most
+	 * recent response is used.
+	 */
+	ce = (TfwCacheEntry *)iter->rec;
+	do {
 		/*
-		 * If the ':status' pseudo-header is not fully indexed, set
-		 * the default static index (8) just for the name.
+		 * Basically we don't need to compare keys if only one record
+		 * is in the bucket. Checking for next record instead of
+		 * comparing the keys would has sense for long URI, but
+		 * performance benchmarks don't show any improvement.
+		 *
+		 * The key is stored right after the entry header, so start
+		 * loading it while the first header line is checked.
 		 */
-		if (tfw_cache_h2_copy_int(&ce->status_len, 8, 0xF, &p, &trec,
-					  &tot_len)
-		    || tfw_cache_h2_copy_int(&ce->status_len, H2_STAT_VAL_LEN,
-					     0x7f, &p, &trec, &tot_len))
-			return -ENOMEM;
+		prefetch(ce->trec.data + CE_BODY_SIZE);
+		if (!(ce->flags & (TFW_CE_SUPERSEDED | TFW_CE_INCOMPLETE
+				   | TFW_CE_SLICE))
+		    && tfw_cache_entry_key_eq(db, req, ce)
+		    && tfw_cache_entry_vary_eq(db, req, ce))
+			break;
+		tdb_rec_next(db, iter);
+		if (!(ce = (TfwCacheEntry *)iter->rec))
+			return NULL;
+	} while (true);
 
-		if (!tfw_ultoa(resp->status, str.data, H2_STAT_VAL_LEN))
-			return -E2BIG;
+	/*
+	 * The entry freshness and the conditional request fields are checked
+	 * next, and the response is built from the following record chunk
+	 * for large entries.
+	 */
+	prefetch(&ce->age);
+	prefetch(&ce->last_modified);
+	tfw_cache_chunk_prefetch(db, &ce->trec);
 
-		if (tfw_cache_h2_copy_str(&ce->status_len, &p, &trec, &str,
-					  &tot_len))
-			return -ENOMEM;
-	}
+	return ce;
+}
 
-	if (tfw_cache_h2_copy_str(&ce->rph_len, &p, &trec, rph, &tot_len))
-		return -ENOMEM;
+static inline void
+tfw_cache_dbce_put(TfwCacheEntry *ce)
+{
+	if (ce)
+		tdb_rec_put(ce);
+}
 
-	ce->hdrs = TDB_OFF(db->hdr, p);
-	ce->hdr_len = 0;
-	ce->hdr_num = resp->h_tbl->off;
-	FOR_EACH_HDR_FIELD_FROM(field, end1, resp, TFW_HTTP_HDR_REGULAR) {
-		int hid = field - resp->h_tbl->tbl;
-		/*
-		 * Skip hop-by-hop headers. Also skip 'Server' header (with
-		 * possible duplicates), since we will substitute it with our
-		 * version of this header.
-		 */
-		if ((field->flags & TFW_STR_HBH_HDR)
-		    || hid == TFW_HTTP_HDR_SERVER
-		    || TFW_STR_EMPTY(field))
-		{
-			--ce->hdr_num;
-			continue;
-		}
+static bool
+tfw_cache_rec_eq(TdbRec *rec, void *ce)
+{
+	return (void *)rec == ce;
+}
 
-		if (hid == TFW_HTTP_HDR_ETAG) {
-			/* Must be updated after tfw_cache_h2_copy_hdr(). */
-			etag_off = TDB_OFF(db->hdr, p);
-			etag_trec = trec;
+/**
+ * Hash of entity-tag value @etag up to the closing quote. Zero is reserved
+ * for absent entity-tag.
+ */
+static unsigned long
+tfw_cache_etag_hash(const TfwStr *etag)
+{
+	char *p;
+	unsigned long h, len = 0;
+	const TfwStr *c, *end;
+
+	TFW_STR_FOR_EACH_CHUNK(c, etag, end) {
+		if ((p = memchr(c->data, '"', c->len))) {
+			len += p - c->data;
+			break;
 		}
+		len += c->len;
+	}
+	h = tfw_hash_str_len(etag, len);
 
-		__save_hdr_304_off(ce, resp, field, TDB_OFF(db->hdr, p));
+	return h ? : 1;
+}
 
-		n = tfw_cache_h2_copy_hdr(ce, &p, &trec, field, &tot_len);
-		if (unlikely(n < 0))
-			return n;
-	}
+static inline TfwCacheVld *
+tfw_cache_vld_slot(CaNode *node, unsigned long key)
+{
+	return &node->vld[hash_min(key, TFW_CACHE_VLD_BITS)];
+}
 
-	/* Add 'server' header. */
-	n = tfw_cache_h2_add_hdr(ce, &p, &trec, 54, &val_srv, &tot_len);
-	if (unlikely(n < 0))
-		return n;
+/**
+ * Update the validator of just stored or freshened entry @ce in @node.
+ */
+static void
+tfw_cache_vld_set(CaNode *node, TfwCacheEntry *ce)
+{
+	TfwCacheVld *v;
+	unsigned long etag = 0;
 
-	/* Headers added only for h2 responses. */
-	/* Add 'via' header. */
-	memcpy_fast(__TFW_STR_CH(&val_via, 1)->data, g_vhost->hdr_via,
-		    g_vhost->hdr_via_len);
-	n = tfw_cache_h2_add_hdr(ce, &p, &trec, 60, &val_via, &tot_len);
-	if (unlikely(n < 0))
-		return n;
+	if (!node->vld || ce->vary_len
+	    || ((ce->resp_status != 200) && (ce->resp_status != 206)))
+		return;
+	if (!TFW_STR_EMPTY(&ce->etag))
+		etag = tfw_cache_etag_hash(&ce->etag);
+
+	v = tfw_cache_vld_slot(node, ce->trec.key);
+	write_seqlock_bh(&v->lock);
+	v->method = ce->method;
+	v->key = ce->trec.key;
+	v->etag = etag;
+	if (ce->last_modified)
+		v->mtime = ce->last_modified;
+	else if (ce->date)
+		v->mtime = ce->date;
+	else
+		v->mtime = ce->resp_time;
+	v->expires = tfw_current_timestamp() + ce->lifetime
+		     - tfw_cache_entry_age(ce);
+	v->resp_time = ce->resp_time;
+	v->ce = ce;
+	write_sequnlock_bh(&v->lock);
+}
 
-	ce->hdr_h2_off = ce->hdr_num + 1;
-	ce->hdr_num += 2;
+/**
+ * Drop the validator of entry @ce with @key from @node before the entry
+ * removal, so the record can't be referenced after it's reused.
+ */
+static void
+tfw_cache_vld_clear(CaNode *node, unsigned long key, TfwCacheEntry *ce)
+{
+	TfwCacheVld *v;
 
-	/* Write HTTP response body. */
-	ce->body = TDB_OFF(db->hdr, p);
-	r = tfw_cache_h2_copy_str(&ce->body_len, &p, &trec, &resp->body,
-				  &tot_len);
-	if (unlikely(r)) {
-		T_ERR("Cache: cannot copy HTTP body\n");
-		return -ENOMEM;
-	}
+	if (!node->vld)
+		return;
+	v = tfw_cache_vld_slot(node, key);
+	if (READ_ONCE(v->ce) != ce)
+		return;
 
-	if (WARN_ON_ONCE(tot_len != 0))
-		return -EINVAL;
+	write_seqlock_bh(&v->lock);
+	if (v->ce == ce)
+		v->ce = NULL;
+	write_sequnlock_bh(&v->lock);
+}
 
-	ce->version = resp->version;
-	tfw_http_copy_flags(ce->hmflags, resp->flags);
+/**
+ * Account cache entry @ce of @size bytes stored in @node database as the most
+ * recently used one. @acct is accounting of the vhost the entry belongs to.
+ */
+static int
+tfw_cache_lru_add(CaNode *node, unsigned long key, TfwCacheEntry *ce,
+		  TfwCacheAcct *acct, size_t size)
+{
+	TfwCacheLru *cl;
 
-	if (resp->cache_ctl.flags
-	    & (TFW_HTTP_CC_MUST_REVAL | TFW_HTTP_CC_PROXY_REVAL))
-		ce->flags |= TFW_CE_MUST_REVAL;
-	ce->date = resp->date;
-	ce->age = resp->cache_ctl.age;
-	ce->req_time = req->cache_ctl.timestamp;
-	ce->resp_time = resp->cache_ctl.timestamp;
-	ce->lifetime = tfw_cache_calc_lifetime(resp);
-	ce->last_modified = resp->last_modified;
-	ce->resp_status = resp->status;
+	if (!(cl = kmem_cache_alloc(cache_lru_cache, GFP_ATOMIC)))
+		return -ENOMEM;
+	cl->key = key;
+	cl->ce = ce;
+	cl->acct = acct;
+	cl->size = size;
+	if (acct)
+		atomic64_add(size, &acct->mem[node - c_nodes]);
+
+	spin_lock_bh(&node->lru_lock);
+	list_add_tail(&cl->list, &node->lru);
+	node->mem += size;
+	spin_unlock_bh(&node->lru_lock);
 
-	if ((r = __set_etag(ce, resp, etag_off, etag_trec, p, &trec))) {
-		T_ERR("Cache: cannot copy entity-tag\n");
-		return r;
-	}
+	return 0;
+}
 
-	/* Update offsets of 304 headers to real values */
-	/* FIXME: #803 */
+/**
+ * Cache entry demoted to the disk tier. The header is followed by @nr chunk
+ * descriptors and the data of the chunks. The entry fields address the
+ * database the entry was demoted from, so the addresses of the chunks in the
+ * database are kept to translate the fields on promotion.
+ *
+ * @base	- address of the database the entry was demoted from;
+ * @nr		- number of the entry chunks;
+ */
+typedef struct {
+	unsigned long	base;
+	unsigned int	nr;
+} TfwCacheDiskHdr;
+
+typedef struct {
+	unsigned long	addr;
+	size_t		len;
+} TfwCacheDiskChunk;
+
+/* Maximum size of cache entries demoted to the disk tier. */
+#define TFW_CACHE_DISK_ENTRY_MAX	(16UL << 20)
+
+/**
+ * Copy entry @ce with @key evicted from @db to the disk tier. Entries which
+ * can't be served any more are just dropped.
+ */
+static void
+tfw_cache_demote(TDB *db, unsigned long key, TfwCacheEntry *ce)
+{
+	unsigned int i;
+	size_t off, len = 0;
+	TdbVRec *trec;
+	TfwCacheDiskBuf *b;
+	TfwCacheDiskChunk ch;
+	TfwCacheDiskHdr dh = { .base = (unsigned long)db->hdr };
+
+	if ((ce->flags & (TFW_CE_SUPERSEDED | TFW_CE_INCOMPLETE))
+	    || tfw_cache_entry_age(ce) >= ce->lifetime + ce->stale_reval)
+		return;
+	/* Slices are looked up in the node database only. */
+	if (ce->flags & (TFW_CE_SLICED | TFW_CE_SLICE))
+		goto skip;
+
+	for (trec = &ce->trec; trec; trec = tdb_next_rec_chunk(db, trec)) {
+		len += trec->len;
+		dh.nr++;
+	}
+	off = sizeof(dh) + dh.nr * sizeof(ch);
+	if (len > TFW_CACHE_DISK_ENTRY_MAX)
+		goto skip;
+	b = tfw_cache_disk_buf_alloc(off + len, GFP_ATOMIC | __GFP_NOWARN);
+	if (!b)
+		goto skip;
+	b->key = key;
+
+	tfw_cache_disk_buf_write(b, 0, &dh, sizeof(dh));
 	trec = &ce->trec;
-	for (i = 0; i < ARRAY_SIZE(ce->hdrs_304); ++i) {
-		if (!ce->hdrs_304[i])
-			continue;
+	for (i = 0; i < dh.nr; ++i) {
+		ch.addr = (unsigned long)trec->data;
+		ch.len = trec->len;
+		tfw_cache_disk_buf_write(b, sizeof(dh) + i * sizeof(ch), &ch,
+					 sizeof(ch));
+		tfw_cache_disk_buf_write(b, off, trec->data, trec->len);
+		off += trec->len;
+		trec = tdb_next_rec_chunk(db, trec);
+	}
 
-		p = TDB_PTR(db->hdr, ce->hdrs_304[i]);
-		while (trec && (p + TFW_CSTR_HDRLEN > trec->data + trec->len)) {
-			trec = tdb_next_rec_chunk(db, trec);
+	if (tfw_cache_disk_store(b)) {
+		TFW_INC_STAT_BH(cache.demoted);
+		return;
+	}
+skip:
+	TFW_INC_STAT_BH(cache.demote_skipped);
+}
+
+/**
+ * Evict entries from @node database until at least @need bytes are freed.
+ * Entries hit since the previous pass over them get the second chance.
+ * If @acct isn't NULL, then only entries of the vhost are evicted and the
+ * entries of other vhosts are skipped, but still spend the passes budget
+ * to keep the lock hold time bounded. The victims are unlinked under the
+ * lock and removed from the database after it's released.
+ * The caller must not hold any cache entry.
+ *
+ * @return number of freed bytes.
+ */
+static size_t
+tfw_cache_evict(CaNode *node, size_t need, TfwCacheAcct *acct)
+{
+	TfwCacheLru *cl, *tmp;
+	size_t freed = 0, taken = 0;
+	int nid = node - c_nodes, budget = TFW_CACHE_EVICT_BUDGET;
+	LIST_HEAD(victims);
+
+	spin_lock_bh(&node->lru_lock);
+	list_for_each_entry_safe(cl, tmp, &node->lru, list) {
+		if (taken >= need || budget-- <= 0)
+			break;
+		if (acct && cl->acct != acct)
+			continue;
+		/*
+		 * The entry can't be removed while it's in the list,
+		 * so it's safe to access it without the bucket lock.
+		 */
+		if (READ_ONCE(cl->ce->accessed)
+		    && !(cl->ce->flags & TFW_CE_SUPERSEDED))
+		{
+			WRITE_ONCE(cl->ce->accessed, 0);
+			list_move_tail(&cl->list, &node->lru);
+			continue;
 		}
-		BUG_ON(!trec);
+		list_move_tail(&cl->list, &victims);
+		node->mem -= cl->size;
+		taken += cl->size;
+	}
+	spin_unlock_bh(&node->lru_lock);
+
+	list_for_each_entry_safe(cl, tmp, &victims, list) {
+		T_DBG2("Cache: evict entry key=%lx ce=%p size=%lu\n",
+		       cl->key, cl->ce, cl->size);
+		tfw_cache_vld_clear(node, cl->key, cl->ce);
+		if (tfw_cache_disk_enabled())
+			tfw_cache_demote(node->db, cl->key, cl->ce);
+		if (!tdb_entry_remove(node->db, cl->key, tfw_cache_rec_eq,
+				      cl->ce))
+		{
+			freed += cl->size;
+			TFW_INC_STAT_BH(cache.evicted);
+			if (cl->acct)
+				atomic64_inc(&cl->acct->evicted);
+		}
+		if (cl->acct)
+			atomic64_sub(cl->size, &cl->acct->mem[nid]);
+		kmem_cache_free(cache_lru_cache, cl);
+	}
 
-		ce->hdrs_304[i] = TDB_OFF(db->hdr, p);
+	return freed;
+}
+
+/**
+ * Make room for a new entry of @size bytes if the node database is going
+ * to be full.
+ */
+static void
+tfw_cache_evict_reserve(CaNode *node, size_t size)
+{
+	size_t mem = READ_ONCE(node->mem);
+
+	if (mem + size > TFW_CACHE_EVICT_WMARK)
+		tfw_cache_evict(node, mem + size - TFW_CACHE_EVICT_WMARK, NULL);
+}
+
+/**
+ * Check that the new entry of @size bytes doesn't exceed the vhost quota
+ * in @node database. Older entries of the vhost are evicted to make room
+ * for the new one.
+ */
+static bool
+tfw_cache_acct_admit(CaNode *node, TfwCacheAcct *acct, size_t size)
+{
+	int nid = node - c_nodes;
+	long mem;
+
+	if (!acct || !acct->quota)
+		return true;
+	if (size > acct->quota)
+		goto reject;
+
+	mem = atomic64_read(&acct->mem[nid]);
+	if (mem + size > acct->quota)
+		tfw_cache_evict(node, mem + size - acct->quota, acct);
+	if (atomic64_read(&acct->mem[nid]) + size <= acct->quota)
+		return true;
+reject:
+	T_DBG2("Cache: vhost '%s' quota %u exceeded, size=%lu\n",
+	       acct->name, acct->quota, size);
+	atomic64_inc(&acct->rejected);
+	return false;
+}
+
+static void
+tfw_cache_lru_free(CaNode *node)
+{
+	TfwCacheLru *cl, *tmp;
+
+	list_for_each_entry_safe(cl, tmp, &node->lru, list) {
+		if (cl->acct)
+			atomic64_sub(cl->size, &cl->acct->mem[node - c_nodes]);
+		kmem_cache_free(cache_lru_cache, cl);
 	}
+	INIT_LIST_HEAD(&node->lru);
+	node->mem = 0;
+}
 
-	T_DBG("Cache copied msg: content-length=%lu msg_len=%lu, ce=%p"
-	      " (len=%u key_len=%u status_len=%u hdr_num=%u hdr_len=%u"
-	      " key_off=%ld status_off=%ld hdrs_off=%ld body_off=%ld)\n",
-	      resp->content_length, resp->msg.len, ce, ce->trec.len,
-	      ce->key_len, ce->status_len, ce->hdr_num, ce->hdr_len,
-	      ce->key, ce->status, ce->hdrs, ce->body);
+/* The node which entries are loaded by tfw_cache_lru_load_entry(). */
+static CaNode *cache_lru_load_node;
+
+/**
+ * Fix up pointers of the cache entry stored before the restart if the
+ * database is mapped at another address now.
+ */
+static int
+tfw_cache_entry_reloc(void *data)
+{
+	TfwCacheEntry *ce = (TfwCacheEntry *)((TdbRec *)data - 1);
+	long reloc = cache_lru_load_node->db->reloc;
+	TfwStr *c, *end;
+
+	if (TFW_STR_EMPTY(&ce->etag))
+		return 0;
+
+	ce->etag.data += reloc;
+	if (TFW_STR_PLAIN(&ce->etag))
+		return 0;
+	TFW_STR_FOR_EACH_CHUNK(c, &ce->etag, end)
+		c->data += reloc;
 
 	return 0;
 }
 
-static long
-__cache_entry_size(TfwHttpResp *resp)
+static int
+tfw_cache_lru_load_entry(void *data)
 {
-	TfwStr host_val, *hdr, *hdr_end;
-	TfwHttpReq *req = resp->req;
-	long size, res_size = CE_BODY_SIZE;
-	TfwStr *host = &req->h_tbl->tbl[TFW_HTTP_HDR_HOST];
-	unsigned long via_sz = SLEN(S_VIA_H2_PROTO)
-		+ tfw_vhost_get_global()->hdr_via_len;
+	/* tdb_entry_walk() passes data of a fixed-size record. */
+	TfwCacheEntry *ce = (TfwCacheEntry *)((TdbRec *)data - 1);
+	TdbVRec *trec = &ce->trec;
+	size_t size = 0;
 
-	/* Add compound key size */
-	res_size += req->uri_path.len;
-	tfw_http_msg_clnthdr_val(req, host, TFW_HTTP_HDR_HOST, &host_val);
-	res_size += host_val.len;
+	do {
+		size += trec->len;
+	} while ((trec = tdb_next_rec_chunk(cache_lru_load_node->db, trec)));
+
+	if (!(ce->flags & (TFW_CE_SUPERSEDED | TFW_CE_INCOMPLETE
+			   | TFW_CE_SLICE)))
+		tfw_cache_vld_set(cache_lru_load_node, ce);
+
+	return tfw_cache_lru_add(cache_lru_load_node, ce->trec.key, ce, NULL,
+				 size);
+}
+
+/**
+ * Put entries stored in the node database before the restart to the
+ * eviction list, so they can be evicted as well as the new ones. The
+ * entries are served right after the restart, expired ones are dropped
+ * only when they're met by requests.
+ */
+static int
+tfw_cache_lru_load(CaNode *node)
+{
+	int r;
 
+	cache_lru_load_node = node;
 	/*
-	 * Add the length of ':status' pseudo-header: one byte if fully indexed,
-	 * or five bytes (one byte for name index, one for status code length
-	 * and three for status code itself) if only name is indexed.
+	 * All the entries are relocated before any of them can fail to load,
+	 * so they're never relocated twice.
 	 */
-	++res_size;
-	res_size += (1 + H2_STAT_VAL_LEN) * !tfw_h2_pseudo_index(resp->status);
+	if (node->db->reloc) {
+		tdb_entry_walk(node->db, tfw_cache_entry_reloc);
+		tdb_reloc_done(node->db);
+	}
+	if ((r = tdb_entry_walk(node->db, tfw_cache_lru_load_entry)))
+		T_ERR_NL("Cache: cannot load entries for eviction, %d\n", r);
+	cache_lru_load_node = NULL;
 
-	/* Add all the headers size */
-	FOR_EACH_HDR_FIELD_FROM(hdr, hdr_end, resp, TFW_HTTP_HDR_REGULAR) {
-		TfwStr *d, *d_end;
-		int hid = hdr - resp->h_tbl->tbl;
-		/*
-		 * Skip hop-by-hop headers. Also skip 'Server' header (with
-		 * possible duplicates), since we will substitute it with our
-		 * version of this header.
-		 */
-		if ((hdr->flags & TFW_STR_HBH_HDR)
-		    || hid == TFW_HTTP_HDR_SERVER
-		    || TFW_STR_EMPTY(hdr))
-			continue;
+	return r;
+}
 
-		size = sizeof(TfwCStr);
+/**
+ * Copies plain TfwStr @src to TdbRec @trec.
+ * @return number of copied bytes (@src length).
+ *
+ * The function copies part of some large data of length @tot_len,
+ * so it tries to minimize total number of allocations regardless
+ * how many chunks are copied.
+ */
+static long
+__tfw_cache_strcpy(char **p, TdbVRec **trec, TfwStr *src, size_t tot_len,
+		   void cpy(void *dest, const void *src, size_t n))
+{
+	long copied = 0;
 
-		if (!TFW_STR_DUP(hdr)) {
-			TfwStr s_nm = {}, s_val = {};
+	while (copied < src->len) {
+		int room = (*trec)->data + (*trec)->len - *p;
+		BUG_ON(room < 0);
+		if (!room) {
+			BUG_ON(tot_len < copied);
+			*trec = tdb_entry_add(node_db(), *trec,
+					      tot_len - copied);
+			if (!*trec)
+				return -ENOMEM;
+			*p = (*trec)->data;
+			room = (*trec)->len;
+		}
 
-			tfw_http_hdr_split(hdr, &s_nm, &s_val, true);
-			size += tfw_h2_hdr_size(s_nm.len, s_val.len,
-						hdr->hpack_idx);
-		} else {
-			TFW_STR_FOR_EACH_DUP(d, hdr, d_end) {
-				TfwStr s_nm = {}, s_val = {};
+		T_DBG3("Cache: copy [%.*s](%lu) to rec=%p(len=%u, next=%u),"
+		       " p=%p tot_len=%lu room=%d copied=%ld\n",
+		       PR_TFW_STR(src), src->len, *trec, (*trec)->len,
+		       (*trec)->chunk_next, *p, tot_len, room, copied);
 
-				size += sizeof(TfwCStr);
-				tfw_http_hdr_split(d, &s_nm, &s_val, true);
-				size += tfw_h2_hdr_size(s_nm.len, s_val.len,
-							d->hpack_idx);
-			}
+		room = min((unsigned long)room, src->len - copied);
+		cpy(*p, src->data + copied, room);
+		*p += room;
+		copied += room;
+	}
+
+	return copied;
+}
+
+/**
+ * We need the function wrapper if memcpy() is defined as __inline_memcpy().
+ */
+static void
+__tfw_memcpy(void *dst ,const void *src, size_t n)
+{
+	memcpy_fast(dst, src, n);
+}
+
+static inline long
+tfw_cache_strcpy(char **p, TdbVRec **trec, TfwStr *src, size_t tot_len)
+{
+	return __tfw_cache_strcpy(p, trec, src, tot_len, __tfw_memcpy);
+}
+
+/**
+ * The same as tfw_cache_strcpy(), but copies @src with lower case conversion.
+ */
+static inline long
+tfw_cache_strcpy_lc(char **p, TdbVRec **trec, TfwStr *src, size_t tot_len)
+{
+	return __tfw_cache_strcpy(p, trec, src, tot_len, tfw_cstrtolower);
+}
+
+#define CSTR_MOVE_HDR()				\
+do {						\
+	cs = (TfwCStr *)*p;			\
+	*p += TFW_CSTR_HDRLEN;			\
+	*tot_len -= TFW_CSTR_HDRLEN;		\
+	ce->hdr_len += TFW_CSTR_HDRLEN;		\
+} while (0)
+
+#define CSTR_WRITE_HDR(f, l)			\
+do {						\
+	cs->flags = f;				\
+	cs->len = l;				\
+} while (0)
+
+/**
+ * Copies plain or compound (chunked) TfwStr @src to TdbRec @trec.
+ *
+ * @src is copied
+ * @return number of copied bytes on success and negative value otherwise.
+ */
+static int
+tfw_cache_h2_copy_str(unsigned int *acc_len, char **p, TdbVRec **trec,
+		      TfwStr *src, size_t *tot_len)
+{
+	long n;
+	TfwStr *c, *end;
+
+	BUG_ON(TFW_STR_DUP(src));
+
+	if (unlikely(!src->len))
+		return 0;
+
+	TFW_STR_FOR_EACH_CHUNK(c, src, end) {
+		if ((n = tfw_cache_strcpy(p, trec, c, *tot_len)) < 0) {
+			T_ERR("Cache: cannot copy chunk of HTTP/2 string\n");
+			return -ENOMEM;
 		}
 
-		if (unlikely(size >= TFW_CSTR_MAXLEN))
-			goto err;
-		res_size += size;
+		*tot_len -= n;
+		*acc_len += n;
 	}
 
-	/*
-	 * Add the length of our version of 'Server' header and 'Via' header.
-	 * Note, that we need two bytes for static index, since in the first
-	 * byte we have only four available bits for the index (we do not use
-	 * dynamic indexing during headers storing into the cache, thus `without
-	 * indexing` code must be set in the first index byte, see RFC 7541
-	 * section 6.2.2 for details), and the 'Server' (as well as 'Via')
-	 * static index doesn't fit to that space.
-	 */
-	res_size += sizeof(TfwCStr);
-	res_size += 2;
-	res_size += tfw_hpack_int_size(SLEN(TFW_SERVER), 0x7F);
-	res_size += SLEN(TFW_SERVER);
+	return 0;
+}
+
+static inline int
+tfw_cache_h2_copy_int(unsigned int *acc_len, unsigned long src,
+		      unsigned short max, char **p, TdbVRec **trec,
+		      size_t *tot_len)
+{
+	int r;
+	TfwHPackInt hp_int;
+	TfwStr str = {};
+
+	write_int(src, max, 0, &hp_int);
+
+	str.data = hp_int.buf;
+	str.len = hp_int.sz;
+
+	if ((r = tfw_cache_h2_copy_str(acc_len, p, trec, &str, tot_len)))
+		return r;
+
+	return 0;
+}
+
+/**
+ * Deep HTTP header copy to TdbRec.
+ * @hdr is copied in depth first fashion to speed up upcoming scans.
+ * @return number of copied bytes on success and negative value otherwise.
+ */
+static long
+tfw_cache_h2_copy_hdr(TfwCacheEntry *ce, char **p, TdbVRec **trec, TfwStr *hdr,
+		      size_t *tot_len)
+{
+	TfwCStr *cs;
+	long n = sizeof(TfwCStr);
+	unsigned short st_index = 0;
+	bool dupl = TFW_STR_DUP(hdr);
+	unsigned int init_len = ce->hdr_len;
+	TfwStr s_nm, s_val, *dup, *dup_end;
+
+	T_DBG3("%s: ce=[%p] p=[%p], trec=[%p], tot_len='%zu'\n", __func__, ce,
+	       *p, *trec, *tot_len);
+
+	if (likely(!dupl)) {
+		unsigned long h_len;
+
+		TFW_STR_INIT(&s_nm);
+		TFW_STR_INIT(&s_val);
+		tfw_http_hdr_split(hdr, &s_nm, &s_val, true);
+
+		st_index = hdr->hpack_idx;
+		h_len = tfw_h2_hdr_size(s_nm.len, s_val.len, st_index);
+
+		/* Don't split short strings. */
+		if (sizeof(TfwCStr) + h_len <= L1_CACHE_BYTES)
+			n += h_len;
+	}
+
+	*p = tdb_entry_get_room(node_db(), trec, *p, n, *tot_len);
+	if (unlikely(!*p)) {
+		T_WARN("Cache: cannot allocate TDB space\n");
+		return -ENOMEM;
+	}
+
+	CSTR_MOVE_HDR();
+
+	if (TFW_STR_DUP(hdr)) {
+		CSTR_WRITE_HDR(TFW_STR_DUPLICATE, hdr->nchunks);
+		CSTR_MOVE_HDR();
+	}
+
+	TFW_STR_FOR_EACH_DUP(dup, hdr, dup_end) {
+		unsigned int prev_len = ce->hdr_len;
+
+		if (dupl) {
+			TFW_STR_INIT(&s_nm);
+			TFW_STR_INIT(&s_val);
+			tfw_http_hdr_split(dup, &s_nm, &s_val, true);
+			st_index = dup->hpack_idx;
+			CSTR_MOVE_HDR();
+		}
+
+		if (st_index) {
+			if (tfw_cache_h2_copy_int(&ce->hdr_len, st_index, 0xF,
+						  p, trec, tot_len))
+				return -ENOMEM;
+		}
+		else {
+			if (tfw_cache_h2_copy_int(&ce->hdr_len, 0, 0xF, p, trec,
+						  tot_len)
+			    || tfw_cache_h2_copy_int(&ce->hdr_len, s_nm.len,
+						     0x7f, p, trec, tot_len)
+			    || tfw_cache_h2_copy_str(&ce->hdr_len, p, trec,
+						     &s_nm, tot_len))
+				return -ENOMEM;
+		}
+
+		if (tfw_cache_h2_copy_int(&ce->hdr_len, s_val.len, 0x7f, p,
+					  trec, tot_len)
+		    || tfw_cache_h2_copy_str(&ce->hdr_len, p, trec, &s_val,
+					     tot_len))
+			return -ENOMEM;
+
+		CSTR_WRITE_HDR(0, ce->hdr_len - prev_len);
+	}
+
+	T_DBG3("%s: p=[%p], trec=[%p], ce->hdr_len='%u', tot_len='%zu'\n",
+	       __func__, *p, *trec, ce->hdr_len, *tot_len);
+
+	return ce->hdr_len - init_len;
+}
+
+static long
+tfw_cache_h2_add_hdr(TfwCacheEntry *ce, char **p, TdbVRec **trec,
+		     unsigned short st_idx, TfwStr *val, size_t *tot_len)
+{
+	TfwCStr *cs;
+	unsigned long len;
+	unsigned int prev_len = ce->hdr_len;
+	long n = TFW_CSTR_HDRLEN;
+
+	BUG_ON(!st_idx || TFW_STR_EMPTY(val));
+
+	len = tfw_hpack_int_size(st_idx, 0xF)
+		+ tfw_hpack_int_size(val->len, 0x7F)
+		+ val->len;
+
+	if (unlikely(len >= TFW_CSTR_MAXLEN)) {
+		T_WARN("Cache: trying to store too big string %lx\n", len);
+		return -E2BIG;
+	}
+
+	/* Don't split short strings. */
+	if (TFW_CSTR_HDRLEN + len <= L1_CACHE_BYTES)
+		n += len;
+
+	*p = tdb_entry_get_room(node_db(), trec, *p, n, *tot_len);
+	if (unlikely(!*p)) {
+		T_WARN("jCache: cannot allocate TDB space\n");
+		return -ENOMEM;
+	}
+
+	CSTR_MOVE_HDR();
+
+	if (tfw_cache_h2_copy_int(&ce->hdr_len, st_idx, 0xF, p, trec, tot_len))
+		return -ENOMEM;
+
+	if (tfw_cache_h2_copy_int(&ce->hdr_len, val->len, 0x7f, p, trec,
+				  tot_len))
+		return -ENOMEM;
+
+	if (tfw_cache_h2_copy_str(&ce->hdr_len, p, trec, val, tot_len))
+		return -ENOMEM;
+
+	CSTR_WRITE_HDR(0, ce->hdr_len - prev_len - TFW_CSTR_HDRLEN);
+
+	return ce->hdr_len - prev_len;
+}
+
+/**
+ * Fill @ce->etag with entity-tag value. RFC 7232 Section-2.3 doesn't limit
+ * etag size, so can't just have a copy of entity-tag value somewhere in @ce,
+ * instead fill @ce->etag TfwStr to correct offset in @ce->hdrs. Also set
+ * WEAK tag to the first chunk of @ce->etag if applied. This is needed for Range
+ * requests.
+ *
+ * @h_off, @h_trec	- supposed offset and record of stored 'ETag:' header;
+ * @curr_p, @curr_rec	- used to store compound @ce->etag.
+ */
+static int
+__set_etag(TfwCacheEntry *ce, TfwHttpResp *resp, long h_off, TdbVRec *h_trec,
+	   char *curr_p, TdbVRec **curr_trec)
+{
+	char *e_p;
+	size_t c_size;
+	TDB *db = node_db();
+	size_t len = 0;
+	unsigned short flags = 0;
+	TfwStr h_val, *c, *end, *h = &resp->h_tbl->tbl[TFW_HTTP_HDR_ETAG];
+	TfwStr s_dummy = {}, s_val = {};
+
+#define CHECK_REC_SPACE()						\
+	while (c_size) {						\
+		size_t tail = h_trec->len - (e_p - h_trec->data);	\
+		if (c_size > tail) {					\
+			c_size -= tail;					\
+			h_trec = tdb_next_rec_chunk(db, h_trec);	\
+			e_p = h_trec->data;				\
+		} else {						\
+			e_p += c_size;					\
+			c_size = 0;					\
+		}							\
+	}
+
+	if (TFW_STR_EMPTY(h))
+		return 0;
+
+	tfw_http_msg_srvhdr_val(h, TFW_HTTP_HDR_ETAG, &h_val);
+
+	/* Update supposed Etag offset to real value. */
+	/* FIXME: #803 */
+	e_p = TDB_PTR(db->hdr, h_off);
+	if (e_p + TFW_CSTR_HDRLEN > h_trec->data + h_trec->len) {
+		h_trec = tdb_next_rec_chunk(db, h_trec);
+		e_p = h_trec->data;
+	}
+	/*
+	 * Skip anything that is not etag value. Note, since headers are
+	 * stored in cache in HTTP/2 representation (and the name of 'etag'
+	 * header is always statically indexed), we should also skip index
+	 * and value length fields; the 'etag' header has the 34 index in
+	 * HPACK static table, thus we definitely now here, that it will
+	 * occupy 2 bytes (RFC 7541 section 6.2.2).
+	 */
+	e_p += TFW_CSTR_HDRLEN;
+	tfw_http_hdr_split(h, &s_dummy, &s_val, true);
+	c_size = 2 + tfw_hpack_int_size(s_val.len, 0x7F);
+	CHECK_REC_SPACE();
+	TFW_STR_FOR_EACH_CHUNK(c, &h_val, end) {
+		if (c->flags & TFW_STR_VALUE) {
+			flags = c->flags;
+			break;
+		}
+		c_size = c->len;
+		CHECK_REC_SPACE();
+	}
+	for ( ; (c < end) && (c->flags & TFW_STR_VALUE); ++c)
+		len += c->len;
+
+	/* Create TfWStr that contains only entity-tag value. */
+	ce->etag.data = e_p;
+	ce->etag.flags = flags;
+	ce->etag.len = min(len, (size_t)(h_trec->len -
+					 (e_p - h_trec->data)));
+	len -= ce->etag.len;
+
+	while (len) {
+		h_trec = tdb_next_rec_chunk(db, h_trec);
+		e_p = h_trec->data;
+		c = tfw_str_add_compound(resp->pool, &ce->etag);
+		if (!c)
+			return -ENOMEM;
+		c->data = e_p;
+		c->len = min(len, (size_t)(h_trec->len -
+					   (e_p - h_trec->data)));
+		len -= c->len;
+	}
+
+	/* Compound string was allocated in resp->pool, move to cache entry. */
+	if (!TFW_STR_PLAIN(&ce->etag)) {
+		len = sizeof(TfwStr *) * ce->etag.nchunks;
+		curr_p = tdb_entry_get_room(node_db(), curr_trec, curr_p, len,
+					    len);
+		if (!curr_p)
+			return -ENOMEM;
+		memcpy_fast(curr_p, ce->etag.data, len);
+		ce->etag.data = curr_p;
+		/* Old ce->etag.data will be destroyed with resp. */
+	}
+
+	return 0;
+
+#undef CHECK_REC_SPACE
+}
+
+/**
+ * Check if the header @hdr must be present in 304 response. If yes save its
+ * offset in cache entry @ce for fast creation of 304 response in
+ * tfw_cahe_send_304().
+ */
+static bool
+__save_hdr_304_off(TfwCacheEntry *ce, TfwHttpResp *resp, TfwStr *hdr, long off)
+{
+	int i;
+	unsigned int num;
+	const TfwStr *match;
+
+	if (TFW_STR_EMPTY(hdr))
+		return false;
+
+	num = hdr - resp->h_tbl->tbl;
+	if (num < TFW_HTTP_HDR_RAW) {
+		if (!tfw_cache_spec_headers_304[num])
+			return false;
+
+		for (i = 0; ce->hdrs_304[i]; ++i)
+			;
+		ce->hdrs_304[i] = off;
+		return true;
+	}
+
+	match = tfw_http_msg_find_hdr(hdr, tfw_cache_raw_headers_304);
+	if (match) {
+		unsigned char sc = *(unsigned char *)match->data;
+
+		/* RFC 7234 4.1: Don't send Last-Modified if ETag is present. */
+		 if ((sc == 'l')
+		     && !TFW_STR_EMPTY(&resp->h_tbl->tbl[TFW_HTTP_HDR_ETAG]))
+			return false;
+
+		i = match - tfw_cache_raw_headers_304;
+		ce->hdrs_304[i + TFW_CACHE_304_SPEC_HDRS_NUM] = off;
+		return true;
+	}
+
+	return false;
+}
+
+/**
+ * Get the stored header descriptor at @p and move @p to the header data.
+ */
+static TfwCStr *
+tfw_cache_cstr_next(TDB *db, TdbVRec **trec, char **p)
+{
+	TfwCStr *s;
+
+	if (*p == (*trec)->data + (*trec)->len) {
+		*trec = tdb_next_rec_chunk(db, *trec);
+		BUG_ON(!*trec);
+		*p = (*trec)->data;
+	}
+	s = (TfwCStr *)*p;
+	*p += TFW_CSTR_HDRLEN;
+
+	return s;
+}
+
+/**
+ * Copy the headers already stored in the cache entry @ce, starting in record
+ * chunk @h_trec, once more as a plain HPACK block w/o TfwCStr descriptors.
+ * The headers are stored with static table indexes only, so the block can be
+ * sent on cache hits as is, instead of copying the headers one by one.
+ * @tot_len is the size of data to be written after the block.
+ */
+static int
+tfw_cache_copy_hpack(TfwCacheEntry *ce, TdbVRec *h_trec, char **p,
+		     TdbVRec **trec, size_t tot_len)
+{
+	int h, d, dn;
+	long n;
+	TfwCStr *s;
+	size_t len;
+	TfwStr c = {};
+	TDB *db = node_db();
+	char *hp = TDB_PTR(db->hdr, ce->hdrs);
+
+	ce->hpack = TDB_OFF(db->hdr, *p);
+	for (h = TFW_HTTP_HDR_REGULAR; h < ce->hdr_num; ++h) {
+		s = tfw_cache_cstr_next(db, &h_trec, &hp);
+		dn = 1;
+		if (s->flags & TFW_STR_DUPLICATE) {
+			dn = s->len;
+			s = tfw_cache_cstr_next(db, &h_trec, &hp);
+		}
+		for (d = 0; d < dn; ++d) {
+			if (d)
+				s = tfw_cache_cstr_next(db, &h_trec, &hp);
+			for (len = s->len; len; len -= c.len) {
+				if (hp == h_trec->data + h_trec->len) {
+					h_trec = tdb_next_rec_chunk(db, h_trec);
+					BUG_ON(!h_trec);
+					hp = h_trec->data;
+				}
+				c.data = hp;
+				c.len = min_t(size_t, len, h_trec->data
+						    + h_trec->len - hp);
+				n = tfw_cache_strcpy(p, trec, &c,
+						     tot_len + len);
+				if (n < 0)
+					return n;
+				hp += c.len;
+				ce->hpack_len += c.len;
+			}
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Copy the response head, i.e. everything except the body, to database
+ * mapped area and set the body offset. @rph is the response reason-phrase
+ * to be saved in the cache.
+ */
+static int
+tfw_cache_copy_head(TfwCacheEntry *ce, TfwHttpResp *resp, TfwStr *rph,
+		    TfwStr *vary, TfwCacheCopy *cp)
+{
+	char *p = cp->p;
+	unsigned short status_idx;
+	TfwStr *field, *h, *end1, *end2;
+	TDB *db = node_db();
+	TdbVRec *trec = cp->trec, *h_trec;
+	size_t tot_len = cp->tot_len;
+	long n;
+	TfwHttpReq *req = resp->req;
+	TfwGlobal *g_vhost = tfw_vhost_get_global();
+	TfwStr h_val, *host = &req->h_tbl->tbl[TFW_HTTP_HDR_HOST];
+	TfwStr val_srv = TFW_STR_STRING(TFW_SERVER);
+	TfwStr val_via = {
+		.chunks = (TfwStr []) {
+			{ .data = S_VIA_H2_PROTO, .len = SLEN(S_VIA_H2_PROTO) },
+			{ .data = *this_cpu_ptr(&g_c_buf),
+			  .len = g_vhost->hdr_via_len },
+		},
+		.len = SLEN(S_VIA_H2_PROTO) + g_vhost->hdr_via_len,
+		.nchunks = 2
+	};
+
+	/* Write record key (URI + Host header). */
+	ce->key = TDB_OFF(db->hdr, p);
+	ce->key_len = 0;
+
+	/*
+	 * Get 'host' header value (from HTTP/2 or HTTP/1.1 request) for
+	 * strict comparison.
+	 */
+	tfw_http_msg_clnthdr_val(req, host, TFW_HTTP_HDR_HOST, &h_val);
+	TFW_CACHE_REQ_KEYITER(field, tfw_cache_key_path(req), &h_val, end1, h,
+			      end2)
+	{
+		if ((n = tfw_cache_strcpy_lc(&p, &trec, field, tot_len)) < 0) {
+			T_ERR("Cache: cannot copy request key\n");
+			return -ENOMEM;
+		}
+		BUG_ON(n > tot_len);
+		tot_len -= n;
+		ce->key_len += n;
+	}
+
+	/* Write secondary key. */
+	ce->vary = TDB_OFF(db->hdr, p);
+	ce->vary_len = 0;
+	if (vary->len) {
+		if ((n = tfw_cache_strcpy(&p, &trec, vary, tot_len)) < 0) {
+			T_ERR("Cache: cannot copy secondary key\n");
+			return -ENOMEM;
+		}
+		tot_len -= n;
+		ce->vary_len = n;
+	}
+
+	/* Request method is a part of the cache record key. */
+	ce->method = req->method;
+
+	/* Write ':status' pseudo-header. */
+	ce->status = TDB_OFF(db->hdr, p);
+	status_idx = tfw_h2_pseudo_index(resp->status);
+	if (status_idx) {
+		TfwHPackInt hp_idx;
+		TfwStr str = {};
+
+		write_int(status_idx, 0x7F, 0x80, &hp_idx);
+		str.data = hp_idx.buf;
+		str.len = hp_idx.sz;
+
+		if (tfw_cache_h2_copy_str(&ce->status_len, &p, &trec, &str,
+					  &tot_len))
+			return -ENOMEM;
+	} else {
+		char buf[H2_STAT_VAL_LEN];
+		TfwStr str = {
+			.data = buf,
+			.len = H2_STAT_VAL_LEN
+		};
+
+		/*
+		 * If the ':status' pseudo-header is not fully indexed, set
+		 * the default static index (8) just for the name.
+		 */
+		if (tfw_cache_h2_copy_int(&ce->status_len, 8, 0xF, &p, &trec,
+					  &tot_len)
+		    || tfw_cache_h2_copy_int(&ce->status_len, H2_STAT_VAL_LEN,
+					     0x7f, &p, &trec, &tot_len))
+			return -ENOMEM;
+
+		if (!tfw_ultoa(resp->status, str.data, H2_STAT_VAL_LEN))
+			return -E2BIG;
+
+		if (tfw_cache_h2_copy_str(&ce->status_len, &p, &trec, &str,
+					  &tot_len))
+			return -ENOMEM;
+	}
+
+	if (tfw_cache_h2_copy_str(&ce->rph_len, &p, &trec, rph, &tot_len))
+		return -ENOMEM;
+
+	ce->hdrs = TDB_OFF(db->hdr, p);
+	h_trec = trec;
+	ce->hdr_len = 0;
+	ce->hdr_num = resp->h_tbl->off;
+	ce->cl_hdr = 0;
+	FOR_EACH_HDR_FIELD_FROM(field, end1, resp, TFW_HTTP_HDR_REGULAR) {
+		int hid = field - resp->h_tbl->tbl;
+		/*
+		 * Skip hop-by-hop headers. Also skip 'Server' header (with
+		 * possible duplicates), since we will substitute it with our
+		 * version of this header.
+		 */
+		if ((field->flags & TFW_STR_HBH_HDR)
+		    || hid == TFW_HTTP_HDR_SERVER
+		    || TFW_STR_EMPTY(field))
+		{
+			--ce->hdr_num;
+			continue;
+		}
+
+		if (hid == TFW_HTTP_HDR_ETAG) {
+			/* Must be updated after tfw_cache_h2_copy_hdr(). */
+			cp->etag_off = TDB_OFF(db->hdr, p);
+			cp->etag_trec = trec;
+		}
+
+		__save_hdr_304_off(ce, resp, field, TDB_OFF(db->hdr, p));
+		if (hid == TFW_HTTP_HDR_CONTENT_LENGTH)
+			ce->cl_hdr = TDB_OFF(db->hdr, p);
+
+		n = tfw_cache_h2_copy_hdr(ce, &p, &trec, field, &tot_len);
+		if (unlikely(n < 0))
+			return n;
+	}
+
+	/* Add 'server' header. */
+	n = tfw_cache_h2_add_hdr(ce, &p, &trec, 54, &val_srv, &tot_len);
+	if (unlikely(n < 0))
+		return n;
+
+	/* Headers added only for h2 responses. */
+	/* Add 'via' header. */
+	memcpy_fast(__TFW_STR_CH(&val_via, 1)->data, g_vhost->hdr_via,
+		    g_vhost->hdr_via_len);
+	n = tfw_cache_h2_add_hdr(ce, &p, &trec, 60, &val_via, &tot_len);
+	if (unlikely(n < 0))
+		return n;
+
+	ce->hdr_h2_off = ce->hdr_num + 1;
+	ce->hdr_num += 2;
+
+	ce->hpack = 0;
+	ce->hpack_len = 0;
+	if (cache_cfg.hpack_block
+	    && tfw_cache_copy_hpack(ce, h_trec, &p, &trec, tot_len))
+		return -ENOMEM;
+
+	ce->body = TDB_OFF(db->hdr, p);
+	ce->body_len = 0;
+	ce->esi = 0;
+	ce->esi_len = 0;
+
+	cp->p = p;
+	cp->trec = trec;
+	cp->tot_len = tot_len;
+
+	return 0;
+}
+
+/**
+ * Copy the part of response @body which isn't copied yet, but not more than
+ * @cp->tot_len bytes. The body may be received not in full yet, so the last
+ * chunk may grow on the next call and the copying is continued from the last
+ * chunk.
+ */
+static int
+tfw_cache_copy_body(TfwCacheEntry *ce, TfwStr *body, TfwCacheCopy *cp)
+{
+	long n;
+	TfwStr *c, s = {};
+	unsigned int nchunks = TFW_STR_PLAIN(body) ? 1 : body->nchunks;
+
+	while (true) {
+		c = TFW_STR_PLAIN(body) ? body : __TFW_STR_CH(body,
+							      cp->body_chunk);
+		if (c->len > cp->body_off) {
+			s.data = c->data + cp->body_off;
+			s.len = min(c->len - cp->body_off, cp->tot_len);
+			n = tfw_cache_strcpy(&cp->p, &cp->trec, &s,
+					     cp->tot_len);
+			if (n < 0) {
+				T_ERR("Cache: cannot copy HTTP body\n");
+				return -ENOMEM;
+			}
+			cp->tot_len -= n;
+			cp->body_off += n;
+			ce->body_len += n;
+		}
+		if (c->len > cp->body_off || cp->body_chunk + 1 >= nchunks)
+			break;
+		++cp->body_chunk;
+		cp->body_off = 0;
+	}
+
+	return 0;
+}
+
+/**
+ * Fill in the cache entry metadata when the response is copied in full.
+ */
+static int
+tfw_cache_copy_meta(TfwCacheEntry *ce, TfwHttpResp *resp, TfwCacheCopy *cp)
+{
+	int r, i;
+	char *p;
+	TDB *db = node_db();
+	TdbVRec *trec = cp->trec;
+	TfwHttpReq *req = resp->req;
+
+	if (WARN_ON_ONCE(cp->tot_len != 0))
+		return -EINVAL;
+
+	ce->version = resp->version;
+	tfw_http_copy_flags(ce->hmflags, resp->flags);
+
+	if (resp->cache_ctl.flags
+	    & (TFW_HTTP_CC_MUST_REVAL | TFW_HTTP_CC_PROXY_REVAL))
+		ce->flags |= TFW_CE_MUST_REVAL;
+	ce->date = resp->date;
+	ce->age = resp->cache_ctl.age;
+	ce->req_time = req->cache_ctl.timestamp;
+	ce->resp_time = resp->cache_ctl.timestamp;
+	ce->lifetime = tfw_cache_calc_lifetime(resp);
+	ce->stale_reval = tfw_cache_calc_stale_reval(resp);
+	ce->last_modified = resp->last_modified;
+	ce->resp_status = resp->status;
+
+	if ((r = __set_etag(ce, resp, cp->etag_off, cp->etag_trec, cp->p,
+			    &trec)))
+	{
+		T_ERR("Cache: cannot copy entity-tag\n");
+		return r;
+	}
+
+	/* Update offsets of 304 headers to real values */
+	/* FIXME: #803 */
+	trec = &ce->trec;
+	for (i = 0; i < ARRAY_SIZE(ce->hdrs_304); ++i) {
+		if (!ce->hdrs_304[i])
+			continue;
+
+		p = TDB_PTR(db->hdr, ce->hdrs_304[i]);
+		while (trec && (p + TFW_CSTR_HDRLEN > trec->data + trec->len)) {
+			trec = tdb_next_rec_chunk(db, trec);
+		}
+		BUG_ON(!trec);
+
+		ce->hdrs_304[i] = TDB_OFF(db->hdr, p);
+	}
+
+	T_DBG("Cache copied msg: content-length=%lu msg_len=%lu, ce=%p"
+	      " (len=%u key_len=%u status_len=%u hdr_num=%u hdr_len=%u"
+	      " key_off=%ld status_off=%ld hdrs_off=%ld body_off=%ld)\n",
+	      resp->content_length, resp->msg.len, ce, ce->trec.len,
+	      ce->key_len, ce->status_len, ce->hdr_num, ce->hdr_len,
+	      ce->key, ce->status, ce->hdrs, ce->body);
+
+	return 0;
+}
+
+/**
+ * Check if the body of response @resp is worth compressing: it's a text
+ * which isn't encoded by the server and which isn't too short or streamed.
+ * Responses with no-transform directive aren't compressed, RFC 7234 5.2.2.4.
+ */
+static bool
+tfw_cache_gzip_employ(TfwHttpResp *resp)
+{
+	int i;
+	char ct[128], *end;
+	TfwStr *hdr = &resp->h_tbl->tbl[TFW_HTTP_HDR_CONTENT_TYPE];
+	static const TfwStr enc = TFW_STR_STRING("content-encoding:");
+	static const char *const types[] = {
+		"text/", "application/json", "application/javascript",
+		"application/xml", "application/xhtml+xml", "image/svg+xml",
+	};
+
+	if (!cache_cfg.compress || resp->body.len < cache_cfg.compress
+	    || resp->body.len > TFW_CACHE_GZIP_MAXLEN
+	    || resp->status != 200
+	    || test_bit(TFW_HTTP_B_CHUNKED, resp->flags)
+	    || test_bit(TFW_HTTP_B_VOID_BODY, resp->flags)
+	    || test_bit(TFW_HTTP_B_CACHE_ESI, resp->req->flags)
+	    || (resp->cache_ctl.flags & TFW_HTTP_CC_NO_TRANSFORM)
+	    || TFW_STR_EMPTY(hdr))
+		return false;
+	if (tfw_http_msg_hdr_lookup((TfwHttpMsg *)resp, &enc)
+	    != resp->h_tbl->off)
+		return false;
+
+	if (!(end = tfw_cache_hdr_val_norm(hdr, false, ct, ct + sizeof(ct))))
+		return false;
+	for (i = 0; i < ARRAY_SIZE(types); ++i)
+		if (end - ct >= strlen(types[i])
+		    && !strncasecmp(ct, types[i], strlen(types[i])))
+			return true;
+
+	return false;
+}
+
+static bool
+__tfw_cache_gzip(TfwCacheGzip *g, TfwHttpResp *resp, TfwStr *gz)
+{
+	int r = Z_OK;
+	u32 crc = ~0;
+	TfwStr *c, *end;
+	z_stream *s = &g->def;
+	/* Save at least 1/8 of the body. */
+	size_t max = resp->body.len - resp->body.len / 8;
+
+	if (!g->buf || !s->workspace
+	    || max <= TFW_CACHE_GZIP_HDRLEN + TFW_CACHE_GZIP_TRLEN
+	    || zlib_deflateReset(s) != Z_OK)
+		return false;
+
+	memcpy(g->buf, tfw_cache_gzip_hdr, TFW_CACHE_GZIP_HDRLEN);
+	s->next_out = g->buf + TFW_CACHE_GZIP_HDRLEN;
+	s->avail_out = max - TFW_CACHE_GZIP_HDRLEN - TFW_CACHE_GZIP_TRLEN;
+	TFW_STR_FOR_EACH_CHUNK(c, &resp->body, end) {
+		crc = crc32_le(crc, c->data, c->len);
+		s->next_in = c->data;
+		s->avail_in = c->len;
+		r = zlib_deflate(s, c + 1 == end ? Z_FINISH : Z_NO_FLUSH);
+		/* The output buffer is full: the body is poorly compressed. */
+		if ((r != Z_OK && r != Z_STREAM_END) || s->avail_in)
+			return false;
+	}
+	if (r != Z_STREAM_END)
+		return false;
+
+	put_unaligned_le32(crc ^ ~0U, s->next_out);
+	put_unaligned_le32(resp->body.len, s->next_out + 4);
+	gz->data = g->buf;
+	gz->len = TFW_CACHE_GZIP_HDRLEN + s->total_out + TFW_CACHE_GZIP_TRLEN;
+	gz->nchunks = 0;
+
+	return true;
+}
+
+/**
+ * Compress the body of response @resp to gzip member @gz in the per-CPU
+ * buffer. The fastest compression level is used, since the body is
+ * compressed in softirq on the way to the client.
+ *
+ * Each CPU spends at most cache_compress_budget percent of each second on
+ * the compression, the bodies are stored uncompressed for the rest of the
+ * second, so the compression doesn't take the CPU from the traffic
+ * processing under overload.
+ *
+ * @return false if the body isn't compressed well enough to store it
+ * compressed or the budget is exhausted.
+ */
+static bool
+tfw_cache_gzip(TfwHttpResp *resp, TfwStr *gz)
+{
+	bool r;
+	u64 t;
+	TfwCacheGzip *g = this_cpu_ptr(&cache_gz);
+
+	if (time_after_eq(jiffies, g->win + HZ)) {
+		g->win = jiffies;
+		g->ns = 0;
+	}
+	if (g->ns >= cache_cfg.compress_budget * (NSEC_PER_SEC / 100)) {
+		T_DBG3("%s: compression budget is exhausted\n", __func__);
+		return false;
+	}
+
+	t = local_clock();
+	r = __tfw_cache_gzip(g, resp, gz);
+	g->ns += local_clock() - t;
+
+	return r;
+}
+
+/**
+ * Check if response @resp is an ESI skeleton, which is assembled from the
+ * cache.
+ */
+static bool
+tfw_cache_esi_employ(TfwHttpResp *resp)
+{
+	char sc[128], *end;
+	unsigned int i;
+	static const TfwStr name = TFW_STR_STRING("surrogate-control:");
+
+	if (cache_cfg.cache != TFW_CACHE_REPLICA || cache_cfg.key.on
+	    || resp->status != 200 || !resp->body.len
+	    || test_bit(TFW_HTTP_B_CHUNKED, resp->flags)
+	    || test_bit(TFW_HTTP_B_VOID_BODY, resp->flags)
+	    || test_bit(TFW_HTTP_B_CACHE_ESI, resp->req->flags)
+	    || test_bit(TFW_HTTP_B_REQ_STREAMED, resp->req->flags))
+		return false;
+	i = tfw_http_msg_hdr_lookup((TfwHttpMsg *)resp, &name);
+	if (i == resp->h_tbl->off)
+		return false;
+	end = tfw_cache_hdr_val_norm(&resp->h_tbl->tbl[i], false, sc,
+				     sc + sizeof(sc));
+
+	return end && strnstr(sc, "ESI/1.0", end - sc);
+}
+
+/**
+ * Build the segments of the body of ESI skeleton @resp in the per-CPU
+ * buffer. The tags are matched literally, the tags not matched or not
+ * including an absolute path are left in the body as is.
+ *
+ * @return length of the segments or zero if the body doesn't include any
+ * fragments or too many of them.
+ */
+static unsigned int
+tfw_cache_esi_parse(TfwHttpResp *resp)
+{
+	static const char open[] = "<esi:include src=\"";
+	enum { ESI_OPEN, ESI_SRC, ESI_SLASH, ESI_GT } st = ESI_OPEN;
+	char *buf = *this_cpu_ptr(&g_esi_buf), *src = NULL;
+	TfwCacheEsi *esi = (TfwCacheEsi *)buf;
+	char *str = (char *)&esi->seg[TFW_CACHE_ESI_SEGS], *s = str;
+	unsigned int i, m = 0, pos = 0, lit = 0, tag = 0, frags = 0;
+	unsigned long h_key = 0;
+	TfwStr *c, *end, host, path;
+	TfwHttpReq *req = resp->req;
+
+	tfw_http_msg_clnthdr_val(req, &req->h_tbl->tbl[TFW_HTTP_HDR_HOST],
+				 TFW_HTTP_HDR_HOST, &host);
+	if (!TFW_STR_EMPTY(&host))
+		h_key = tfw_hash_str(&host);
+
+	esi->n = 0;
+	TFW_STR_FOR_EACH_CHUNK(c, &resp->body, end) {
+		for (i = 0; i < c->len; ++i, ++pos) {
+			char ch = c->data[i];
+
+			switch (st) {
+			case ESI_OPEN:
+				if (ch == open[m]) {
+					if (!m)
+						tag = pos;
+					if (++m == SLEN(open)) {
+						st = ESI_SRC;
+						src = s;
+					}
+					continue;
+				}
+				break;
+			case ESI_SRC:
+				if (ch == '"' && s > src && *src == '/') {
+					st = ESI_SLASH;
+					continue;
+				}
+				if (ch > ' ' && ch != '"' && ch != '<'
+				    && s < buf + TFW_CACHE_ESI_MAXLEN)
+				{
+					*s++ = ch;
+					continue;
+				}
+				break;
+			case ESI_SLASH:
+				if (ch == ' ')
+					continue;
+				if (ch == '/') {
+					st = ESI_GT;
+					continue;
+				}
+				break;
+			case ESI_GT:
+				if (ch != '>')
+					break;
+				if (esi->n + 2 > TFW_CACHE_ESI_SEGS)
+					return 0;
+				if (tag > lit)
+					esi->seg[esi->n++] = (TfwCacheEsiSeg) {
+						.off = lit, .len = tag - lit
+					};
+				path = (TfwStr){ .data = src, .len = s - src };
+				esi->seg[esi->n++] = (TfwCacheEsiSeg) {
+					.key = tfw_hash_str(&path) ^ h_key,
+					.off = src - buf,
+					.len = s - src
+				};
+				++frags;
+				lit = pos + 1;
+				st = ESI_OPEN;
+				m = 0;
+				continue;
+			}
+			/* Not a tag, the character may start the next one. */
+			if (st != ESI_OPEN)
+				s = src;
+			st = ESI_OPEN;
+			m = ch == '<';
+			tag = pos;
+		}
+	}
+	if (!frags || (pos > lit && esi->n == TFW_CACHE_ESI_SEGS))
+		return 0;
+	if (pos > lit)
+		esi->seg[esi->n++] = (TfwCacheEsiSeg) {
+			.off = lit, .len = pos - lit
+		};
+
+	/* Move the src paths right after the segments. */
+	m = str - (char *)&esi->seg[esi->n];
+	memmove(str - m, str, s - str);
+	for (i = 0; i < esi->n; ++i)
+		if (esi->seg[i].key)
+			esi->seg[i].off -= m;
+
+	return s - m - buf;
+}
+
+/**
+ * Copy response skbs to database mapped area.
+ * @tot_len	- total length of actual data to write w/o TfwCStr's etc;
+ * @rph		- response reason-phrase to be saved in the cache.
+ * @gz		- the compressed body to store instead of the response body
+ *		  or NULL.
+ * @esi		- the segments of ESI skeleton body, stored after the body,
+ *		  or NULL.
+ *
+ * It's nasty to copy data on CPU, but we can't use DMA for mmaped file
+ * as well as for unaligned memory areas.
+ */
+static int
+tfw_cache_copy_resp(TfwCacheEntry *ce, TfwHttpResp *resp, TfwStr *rph,
+		    TfwStr *vary, TfwStr *gz, TfwStr *esi, size_t tot_len)
+{
+	int r;
+	TfwCacheCopy cp = {
+		.p		= (char *)(ce + 1),
+		.trec		= &ce->trec,
+		.tot_len	= tot_len - CE_BODY_SIZE,
+	};
+
+	if ((r = tfw_cache_copy_head(ce, resp, rph, vary, &cp)))
+		return r;
+	if ((r = tfw_cache_copy_body(ce, gz ? : &resp->body, &cp)))
+		return r;
+	if (gz) {
+		ce->flags |= TFW_CE_GZIP;
+		ce->body_ulen = resp->body.len;
+	}
+	if (esi) {
+		ce->esi = TDB_OFF(node_db()->hdr, cp.p);
+		ce->esi_len = esi->len;
+		if (tfw_cache_strcpy(&cp.p, &cp.trec, esi, cp.tot_len) < 0)
+			return -ENOMEM;
+		cp.tot_len -= esi->len;
+	}
+
+	return tfw_cache_copy_meta(ce, resp, &cp);
+}
+
+static long
+__cache_entry_size(TfwHttpResp *resp)
+{
+	TfwStr host_val, *hdr, *hdr_end;
+	TfwHttpReq *req = resp->req;
+	long size, res_size = CE_BODY_SIZE, hpack_size = 0;
+	TfwStr *host = &req->h_tbl->tbl[TFW_HTTP_HDR_HOST];
+	unsigned long via_sz = SLEN(S_VIA_H2_PROTO)
+		+ tfw_vhost_get_global()->hdr_via_len;
+
+	/* Add compound key size */
+	res_size += tfw_cache_key_path(req)->len;
+	tfw_http_msg_clnthdr_val(req, host, TFW_HTTP_HDR_HOST, &host_val);
+	res_size += host_val.len;
+
+	/*
+	 * Add the length of ':status' pseudo-header: one byte if fully indexed,
+	 * or five bytes (one byte for name index, one for status code length
+	 * and three for status code itself) if only name is indexed.
+	 */
+	++res_size;
+	res_size += (1 + H2_STAT_VAL_LEN) * !tfw_h2_pseudo_index(resp->status);
+
+	/* Add all the headers size */
+	FOR_EACH_HDR_FIELD_FROM(hdr, hdr_end, resp, TFW_HTTP_HDR_REGULAR) {
+		TfwStr *d, *d_end;
+		int hid = hdr - resp->h_tbl->tbl;
+		/*
+		 * Skip hop-by-hop headers. Also skip 'Server' header (with
+		 * possible duplicates), since we will substitute it with our
+		 * version of this header.
+		 */
+		if ((hdr->flags & TFW_STR_HBH_HDR)
+		    || hid == TFW_HTTP_HDR_SERVER
+		    || TFW_STR_EMPTY(hdr))
+			continue;
+
+		size = sizeof(TfwCStr);
+
+		if (!TFW_STR_DUP(hdr)) {
+			TfwStr s_nm = {}, s_val = {};
+
+			tfw_http_hdr_split(hdr, &s_nm, &s_val, true);
+			size += tfw_h2_hdr_size(s_nm.len, s_val.len,
+						hdr->hpack_idx);
+			hpack_size += size - sizeof(TfwCStr);
+		} else {
+			TFW_STR_FOR_EACH_DUP(d, hdr, d_end) {
+				TfwStr s_nm = {}, s_val = {};
+				unsigned long d_size;
+
+				size += sizeof(TfwCStr);
+				tfw_http_hdr_split(d, &s_nm, &s_val, true);
+				d_size = tfw_h2_hdr_size(s_nm.len, s_val.len,
+							 d->hpack_idx);
+				size += d_size;
+				hpack_size += d_size;
+			}
+		}
+
+		if (unlikely(size >= TFW_CSTR_MAXLEN))
+			goto err;
+		res_size += size;
+	}
+
+	/*
+	 * Add the length of our version of 'Server' header and 'Via' header.
+	 * Note, that we need two bytes for static index, since in the first
+	 * byte we have only four available bits for the index (we do not use
+	 * dynamic indexing during headers storing into the cache, thus `without
+	 * indexing` code must be set in the first index byte, see RFC 7541
+	 * section 6.2.2 for details), and the 'Server' (as well as 'Via')
+	 * static index doesn't fit to that space.
+	 */
+	res_size += sizeof(TfwCStr);
+	res_size += 2;
+	res_size += tfw_hpack_int_size(SLEN(TFW_SERVER), 0x7F);
+	res_size += SLEN(TFW_SERVER);
+
+	res_size += sizeof(TfwCStr);
+	res_size += 2;
+	res_size += tfw_hpack_int_size(via_sz, 0x7F);
+	res_size += via_sz;
+
+	/*
+	 * The HPACK block copied by tfw_cache_copy_hpack() repeats all the
+	 * stored headers w/o the TfwCStr descriptors.
+	 */
+	if (cache_cfg.hpack_block) {
+		hpack_size += 2 + tfw_hpack_int_size(SLEN(TFW_SERVER), 0x7F)
+			      + SLEN(TFW_SERVER);
+		hpack_size += 2 + tfw_hpack_int_size(via_sz, 0x7F) + via_sz;
+		res_size += hpack_size;
+	}
+
+	/* Add body size. */
+	res_size += resp->body.len;
+
+	return res_size;
+err:
+	T_WARN("Cache: trying to store too big string %ld\n", size);
+	return -E2BIG;
+}
+
+/**
+ * Mark entries for the same request as the just stored entry @new has as
+ * superseded, so they aren't used any more and are evicted in the first place.
+ */
+static void
+tfw_cache_supersede(TDB *db, TfwHttpReq *req, TfwCacheEntry *new)
+{
+	TdbIter iter;
+	TfwCacheEntry *ce;
+
+	iter = tdb_rec_get(db, tfw_http_req_key_calc(req));
+	while ((ce = (TfwCacheEntry *)iter.rec)) {
+		if (ce != new && !(ce->flags & TFW_CE_SUPERSEDED)
+		    && tfw_cache_entry_key_eq(db, req, ce)
+		    && tfw_cache_entry_vary_eq(db, req, ce))
+			ce->flags |= TFW_CE_SUPERSEDED;
+		tdb_rec_next(db, &iter);
+	}
+}
+
+/**
+ * Call @fn for each tag listed in @tags up to @end. Tags are separated by
+ * spaces or commas.
+ */
+static int
+tfw_cache_tags_for_each(char *tags, char *end, void *data,
+			int (*fn)(const char *tag, size_t len, void *data))
+{
+	int r = 0;
+	char *t, *t_end;
+
+	for (t = tags; t < end; t = t_end + 1) {
+		for (t_end = t; t_end < end && *t_end != ' ' && *t_end != ',';
+		     ++t_end)
+			;
+		if (t_end != t)
+			r |= fn(t, t_end - t, data);
+	}
+
+	return r;
+}
+
+static int
+tfw_cache_tag_add(const char *tag, size_t len, void *data)
+{
+	TfwCacheTagCtx *ctx = data;
+	TfwCacheTag *rec = &ctx->rec;
+	size_t rlen = sizeof(*rec);
+
+	if (!tdb_entry_create(ctx->node->tag_db, hash_calc(tag, len), rec,
+			      &rlen))
+	{
+		T_DBG("Cache: cannot add tag %.*s, key=%lx\n", (int)len, tag,
+		      rec->key);
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+/**
+ * Index the cache entry @ce stored in @node by the tags listed in the
+ * configured tags header of @resp.
+ */
+static void
+tfw_cache_tag_entry(CaNode *node, TfwHttpResp *resp, unsigned long key,
+		    TfwCacheEntry *ce)
+{
+	char *tags, *end;
+	unsigned int id;
+	TfwCacheTagCtx ctx;
+	TfwStr hdr = {
+		.data = cache_cfg.tag_hdr,
+		.len = cache_cfg.tag_hdr_len
+	};
+
+	if (!node->tag_db)
+		return;
+	id = tfw_http_msg_hdr_lookup((TfwHttpMsg *)resp, &hdr);
+	if (id == resp->h_tbl->off)
+		return;
+
+	tags = (*this_cpu_ptr(&g_vary_buf))[0];
+	end = tfw_cache_hdr_val_norm(&resp->h_tbl->tbl[id], false, tags,
+				     tags + TFW_CACHE_VARY_MAXLEN);
+	if (!end) {
+		T_DBG("Cache: too long tags list, key=%lx\n", key);
+		return;
+	}
+
+	ctx.node = node;
+	ctx.rec.key = key;
+	ctx.rec.ce = TDB_OFF(node->db->hdr, ce);
+	if (tfw_cache_tags_for_each(tags, end, &ctx, tfw_cache_tag_add))
+		T_DBG("Cache: cannot index entry by tags, key=%lx\n", key);
+}
+
+/**
+ * Delete the partially built cache entry of response stream @st. The entry,
+ * which body is being sliced, is already available, so only the slice being
+ * built is deleted and the stored slices are still served.
+ */
+static void
+tfw_cache_stream_drop(TfwCacheStream *st)
+{
+	TDB *db = c_nodes[st->nid].db;
+
+	T_DBG2("Cache: drop streamed entry key=%lx ce=%p sl=%p\n", st->key,
+	       st->ce, st->sl);
+	if (st->sl) {
+		tdb_entry_remove(db, st->sl_key, tfw_cache_rec_eq, st->sl);
+		st->sl = NULL;
+	}
+	if (!st->sid)
+		tdb_entry_remove(db, st->key, tfw_cache_rec_eq, st->ce);
+	st->ce = NULL;
+}
+
+static inline unsigned long
+tfw_cache_slice_key(unsigned long sid, unsigned long idx)
+{
+	return hash_64(sid + idx, 64);
+}
+
+/**
+ * Allocate the next slice of the entry body being sliced by stream @st.
+ */
+static int
+tfw_cache_slice_alloc(TfwCacheStream *st)
+{
+	size_t len, n = min(st->body_len, TFW_CACHE_SLICE_SZ);
+	TfwCacheEntry *sl;
+	CaNode *node = &c_nodes[st->nid];
+
+	st->sl_key = tfw_cache_slice_key(st->sid, st->sl_idx);
+	st->sl_len = CE_BODY_SIZE + n;
+	if (!tfw_cache_acct_admit(node, st->acct, st->sl_len))
+		return -ENOSPC;
+	tfw_cache_evict_reserve(node, st->sl_len);
+	len = st->sl_len;
+	sl = (TfwCacheEntry *)tdb_entry_alloc(node->db, st->sl_key, &len);
+	if (!sl)
+		return -ENOMEM;
+	BUG_ON(len <= sizeof(TfwCacheEntry));
+
+	memset(&sl->ce_body, 0, CE_BODY_SIZE);
+	sl->flags = TFW_CE_SLICE | TFW_CE_INCOMPLETE;
+	sl->sid = st->sid;
+	sl->body = TDB_OFF(node->db->hdr, sl + 1);
+
+	st->sl = sl;
+	st->cp.p = (char *)(sl + 1);
+	st->cp.trec = &sl->trec;
+	st->cp.tot_len = n;
+	st->body_len -= n;
+	++st->sl_idx;
+
+	return 0;
+}
+
+/**
+ * Copy the part of @body which isn't copied yet to the slices of the entry
+ * of stream @st. Each slice is available as soon as it's copied in full.
+ */
+static int
+tfw_cache_stream_slices(TfwCacheStream *st, TfwStr *body)
+{
+	int r;
+	TfwCacheEntry *sl;
+
+	while (st->sl || st->body_len) {
+		if (!st->sl && (r = tfw_cache_slice_alloc(st)))
+			return r;
+		if ((r = tfw_cache_copy_body(st->sl, body, &st->cp)))
+			return r;
+		if (st->cp.tot_len)
+			break;
+
+		sl = st->sl;
+		if (tfw_cache_lru_add(&c_nodes[st->nid], st->sl_key, sl,
+				      st->acct, st->sl_len))
+			return -ENOMEM;
+		st->sl = NULL;
+		smp_wmb();
+		WRITE_ONCE(sl->flags, sl->flags & ~TFW_CE_INCOMPLETE);
+	}
+
+	return 0;
+}
+
+/**
+ * Copy the part of response @body which isn't copied yet to the entry of
+ * stream @st. The data copying helpers work with the local node database,
+ * so the copying is continued only on the node the entry is stored in.
+ */
+static int
+tfw_cache_stream_copy(TfwCacheStream *st, TfwStr *body)
+{
+	if (st->nid != numa_node_id())
+		return -EINVAL;
+	if (st->sid)
+		return tfw_cache_stream_slices(st, body);
+	return tfw_cache_copy_body(st->ce, body, &st->cp);
+}
+
+/**
+ * Make the entry of stream @st, which body is sliced, available as soon as
+ * the head of response @resp is copied to it. The body slices are stored
+ * after that.
+ */
+static int
+tfw_cache_stream_sliced(TfwCacheStream *st, TfwHttpResp *resp)
+{
+	TfwCacheEntry *ce = st->ce;
+	CaNode *node = &c_nodes[st->nid];
+
+	if (tfw_cache_copy_meta(ce, resp, &st->cp)
+	    || tfw_cache_lru_add(node, st->key, ce, st->acct, st->data_len))
+		return -ENOMEM;
+	ce->flags |= TFW_CE_SLICED;
+	ce->body_len = resp->content_length;
+	ce->sid = get_random_long() ? : 1;
+	smp_wmb();
+	WRITE_ONCE(ce->flags, ce->flags & ~TFW_CE_INCOMPLETE);
+
+	tfw_cache_supersede(node->db, resp->req, ce);
+	tfw_cache_tag_entry(node, resp, st->key, ce);
+	tfw_cache_vld_set(node, ce);
+
+	/* The entry may be evicted since now, so it must not be accessed. */
+	st->sid = ce->sid;
+	st->body_len = resp->content_length;
+
+	return tfw_cache_stream_slices(st, &resp->body);
+}
+
+/**
+ * Response destructor: delete the cache entry if the response is freed
+ * before it's received in full.
+ */
+static void
+tfw_cache_stream_destruct(void *msg)
+{
+	TfwCacheStream *st = ((TfwHttpResp *)msg)->cstream;
+
+	if (st->ce)
+		tfw_cache_stream_drop(st);
+}
+
+/**
+ * Start storing of response @resp in the local node cache when its headers
+ * are received. @resp->cstream is set anyway, so that the response isn't
+ * checked again on next chunks.
+ */
+static void
+tfw_cache_stream_start(TfwHttpResp *resp)
+{
+	size_t len;
+	long data_len;
+	unsigned long key;
+	TfwStr rph, vary;
+	TfwCacheStream *st;
+	TfwCacheEntry *ce;
+	TfwHttpReq *req = resp->req;
+	int nid = numa_node_id();
+	CaNode *node = &c_nodes[nid];
+	bool sliced;
+
+	if (!(st = tfw_pool_alloc(resp->pool, sizeof(TfwCacheStream))))
+		return;
+	st->ce = NULL;
+	st->sid = 0;
+	st->sl = NULL;
+	resp->cstream = st;
+
+	if (resp->content_length < TFW_CACHE_STREAM_MIN
+	    || test_bit(TFW_HTTP_B_CHUNKED, resp->flags)
+	    || test_bit(TFW_HTTP_B_VOID_BODY, resp->flags)
+	    || test_bit(TFW_HTTP_B_CACHE_BG, req->flags)
+	    || test_bit(TFW_HTTP_B_REQ_MIRROR, req->flags)
+	    || req->method == TFW_HTTP_METH_PURGE)
+		return;
+	if (!tfw_cache_msg_cacheable(req) || !tfw_cache_employ_resp(resp))
+		return;
+	if (!tfw_cache_freq_admit(req)) {
+		TFW_INC_STAT_BH(cache.not_admitted);
+		return;
+	}
+	key = tfw_http_req_key_calc(req);
+	if (cache_cfg.cache == TFW_CACHE_SHARD
+	    && tfw_cache_key_node(key) != nid)
+		return;
+	if (tfw_cache_vary_key(resp, &vary))
+		return;
+
+	rph = tfw_str_next_str_val(&resp->h_tbl->tbl[TFW_HTTP_STATUS_LINE]);
+	if (TFW_STR_EMPTY(&rph) || (data_len = __cache_entry_size(resp)) < 0)
+		return;
+	/*
+	 * Only part of the body is received for now. The body of the sliced
+	 * entry isn't stored in the entry itself.
+	 */
+	sliced = resp->content_length > TFW_CACHE_SLICE_SZ;
+	data_len += rph.len + vary.len - resp->body.len;
+	if (!sliced)
+		data_len += resp->content_length;
+
+	st->acct = tfw_cache_acct_get(req->vhost);
+	if (!tfw_cache_acct_admit(node, st->acct, data_len))
+		return;
+	tfw_cache_evict_reserve(node, data_len);
+	len = data_len;
+	if (!(ce = (TfwCacheEntry *)tdb_entry_alloc(node->db, key, &len)))
+		return;
+	BUG_ON(len <= sizeof(TfwCacheEntry));
+	/* Don't let lookups use the entry until it's built in full. */
+	ce->flags = TFW_CE_INCOMPLETE;
+
+	st->ce = ce;
+	st->key = key;
+	st->data_len = data_len;
+	st->nid = nid;
+	st->cp = (TfwCacheCopy) {
+		.p		= (char *)(ce + 1),
+		.trec		= &ce->trec,
+		.tot_len	= data_len - CE_BODY_SIZE,
+	};
+	resp->destructor = tfw_cache_stream_destruct;
+
+	T_DBG2("Cache: stream entry key=%lx ce=%p data_len=%ld sliced=%d\n",
+	       key, ce, data_len, sliced);
+	if (tfw_cache_copy_head(ce, resp, &rph, &vary, &st->cp)
+	    || (sliced ? tfw_cache_stream_sliced(st, resp)
+		       : tfw_cache_copy_body(ce, &resp->body, &st->cp)))
+		tfw_cache_stream_drop(st);
+}
+
+/**
+ * Process the next chunk of response @resp received from a server.
+ */
+void
+tfw_cache_resp_chunk(TfwHttpResp *resp)
+{
+	TfwCacheStream *st = resp->cstream;
+
+	if (likely(!st)) {
+		if (cache_cfg.cache && (resp->crlf.flags & TFW_STR_COMPLETE))
+			tfw_cache_stream_start(resp);
+		return;
+	}
+	if (!st->ce)
+		return;
+	if (tfw_cache_stream_copy(st, &resp->body))
+		tfw_cache_stream_drop(st);
+}
+
+/**
+ * Finish storing of the streamed response @resp when it's received in full.
+ */
+static TfwCacheEntry *
+tfw_cache_stream_finish(TfwHttpResp *resp)
+{
+	TfwCacheStream *st = resp->cstream;
+	TfwCacheEntry *ce = st->ce;
+	CaNode *node = &c_nodes[st->nid];
+
+	if (st->sid) {
+		/* The body is shorter than Content-Length if a slice is left. */
+		if (tfw_cache_stream_copy(st, &resp->body) || st->sl) {
+			tfw_cache_stream_drop(st);
+			return NULL;
+		}
+		st->ce = NULL;
+		return ce;
+	}
+	if (tfw_cache_stream_copy(st, &resp->body)
+	    || tfw_cache_copy_meta(ce, resp, &st->cp)
+	    || tfw_cache_lru_add(node, st->key, ce, st->acct, st->data_len))
+	{
+		tfw_cache_stream_drop(st);
+		return NULL;
+	}
+	st->ce = NULL;
+	smp_wmb();
+	WRITE_ONCE(ce->flags, ce->flags & ~TFW_CE_INCOMPLETE);
+
+	tfw_cache_supersede(node->db, resp->req, ce);
+	tfw_cache_tag_entry(node, resp, st->key, ce);
+	tfw_cache_vld_set(node, ce);
+
+	return ce;
+}
+
+static TfwCacheEntry *
+__cache_add_node(int nid, TfwHttpResp *resp, unsigned long key, TfwStr *vary)
+{
+	size_t len;
+	TfwCacheEntry *ce;
+	TfwStr rph, *s_line, gz = {}, *gzp = NULL, esi = {}, *esip = NULL;
+	CaNode *node = &c_nodes[nid];
+	TDB *db = node->db;
+	bool evicted = false;
+	long data_len;
+	TfwCacheAcct *acct;
+
+	/* The response is already stored in the node database. */
+	if (resp->cstream && resp->cstream->ce && resp->cstream->nid == nid)
+		return tfw_cache_stream_finish(resp);
+
+	acct = tfw_cache_acct_get(resp->req->vhost);
+	if (unlikely((data_len = __cache_entry_size(resp)) < 0))
+		return NULL;
+
+	/*
+	 * We need to save the reason-phrase for the case of HTTP/1.1-response
+	 * creation from cache. Note, that reason-phrase is always the last part
+	 * of status-line with the TFW_STR_VALUE flag set.
+	 */
+	s_line = &resp->h_tbl->tbl[TFW_HTTP_STATUS_LINE];
+	rph = tfw_str_next_str_val(s_line);
+	if (WARN_ON_ONCE(TFW_STR_EMPTY(&rph)))
+		return NULL;
+
+	data_len += rph.len + vary->len;
+	/* The ESI skeleton is stored uncompressed along with its segments. */
+	if (tfw_cache_esi_employ(resp)
+	    && (esi.len = tfw_cache_esi_parse(resp)))
+	{
+		esi.data = *this_cpu_ptr(&g_esi_buf);
+		esip = &esi;
+		data_len += esi.len;
+	}
+	/* The compressed body replaces the response body. */
+	else if (tfw_cache_gzip_employ(resp) && tfw_cache_gzip(resp, &gz)) {
+		gzp = &gz;
+		data_len -= resp->body.len - gz.len;
+	}
+
+	T_DBG3("%s: db=[%p] resp=[%p], req=[%p], key='%lu', data_len='%ld'\n",
+	       __func__, db, resp, resp->req, key, data_len);
+
+	/* TODO #788: revalidate existing entries before inserting a new one. */
+
+	if (!tfw_cache_acct_admit(node, acct, data_len))
+		return NULL;
+	tfw_cache_evict_reserve(node, data_len);
+retry:
+	/*
+	 * Try to place the cached response in single memory chunk.
+	 * TDB should provide enough space to place at least head of
+	 * the record key at first chunk.
+	 */
+	len = data_len;
+	ce = (TfwCacheEntry *)tdb_entry_alloc(db, key, &len);
+	if (!ce)
+		goto evict;
+	BUG_ON(len <= sizeof(TfwCacheEntry));
+
+	T_DBG3("%s: ce=[%p], alloc_len='%lu'\n", __func__, ce, len);
+
+	if (tfw_cache_copy_resp(ce, resp, &rph, vary, gzp, esip, data_len)) {
+		/* Delete the probably partially built TDB entry. */
+		tdb_entry_remove(db, key, tfw_cache_rec_eq, ce);
+		goto evict;
+	}
+
+	if (tfw_cache_lru_add(node, key, ce, acct, data_len)) {
+		/* Don't keep the entry which can't be evicted. */
+		tdb_entry_remove(db, key, tfw_cache_rec_eq, ce);
+		return NULL;
+	}
+	tfw_cache_supersede(db, resp->req, ce);
+	tfw_cache_tag_entry(node, resp, key, ce);
+	tfw_cache_vld_set(node, ce);
+
+	return ce;
+evict:
+	/* The database is full, evict some entries and try once more. */
+	if (evicted || !tfw_cache_evict(node, data_len, NULL))
+		return NULL;
+	evicted = true;
+	goto retry;
+}
+
+/*
+ * Replication of the cache entries in TFW_CACHE_REPLICA mode.
+ *
+ * An entry is stored in the node database of the CPU receiving the response,
+ * and the replicas are stored asynchronously by CPUs of the other nodes, so
+ * the copying is distributed among the nodes and the response isn't delayed.
+ * A replica has the same chunks layout as the original entry: the record data
+ * is copied as is and only the entry offsets and pointers are rebased. The
+ * replication is skipped if the work queue of the node CPU is loaded. Replicas
+ * aren't indexed by tags, they're invalidated together with the original
+ * entry instead.
+ */
+#define TFW_CACHE_REPL_QLEN	512
+
+static void tfw_cache_ipi(struct irq_work *work);
+
+/**
+ * Compare @len bytes of data at offsets @off1 and @off2 of entries @ce1 and
+ * @ce2 stored in @db.
+ */
+static bool
+tfw_cache_entry_data_eq(TDB *db, TfwCacheEntry *ce1, long off1,
+			TfwCacheEntry *ce2, long off2, size_t len)
+{
+	size_t n;
+	TdbVRec *t1 = &ce1->trec, *t2 = &ce2->trec;
+	char *p1 = TDB_PTR(db->hdr, off1), *p2 = TDB_PTR(db->hdr, off2);
+
+	while (p1 < t1->data || p1 > t1->data + t1->len)
+		if (!(t1 = tdb_next_rec_chunk(db, t1)))
+			return false;
+	while (p2 < t2->data || p2 > t2->data + t2->len)
+		if (!(t2 = tdb_next_rec_chunk(db, t2)))
+			return false;
+
+	while (len) {
+		if (p1 == t1->data + t1->len) {
+			if (!(t1 = tdb_next_rec_chunk(db, t1)))
+				return false;
+			p1 = t1->data;
+		}
+		if (p2 == t2->data + t2->len) {
+			if (!(t2 = tdb_next_rec_chunk(db, t2)))
+				return false;
+			p2 = t2->data;
+		}
+		n = min3(len, (size_t)(t1->data + t1->len - p1),
+			 (size_t)(t2->data + t2->len - p2));
+		if (memcmp(p1, p2, n))
+			return false;
+		p1 += n;
+		p2 += n;
+		len -= n;
+	}
+
+	return true;
+}
+
+/**
+ * Mark entries for the same request as replica @new has in @db as superseded.
+ * The replica itself is superseded if there is a more recent entry.
+ */
+static void
+tfw_cache_supersede_replica(TDB *db, TfwCacheEntry *new)
+{
+	TdbIter iter;
+	TfwCacheEntry *ce;
+
+	iter = tdb_rec_get(db, new->trec.key);
+	while ((ce = (TfwCacheEntry *)iter.rec)) {
+		if (ce != new && !(ce->flags & TFW_CE_SUPERSEDED)
+		    && ce->method == new->method
+		    && ce->key_len == new->key_len
+		    && ce->vary_len == new->vary_len
+		    && tfw_cache_entry_data_eq(db, ce, ce->key, new, new->key,
+					       ce->key_len)
+		    && tfw_cache_entry_data_eq(db, ce, ce->vary, new,
+					       new->vary, ce->vary_len))
+		{
+			if (ce->resp_time > new->resp_time)
+				new->flags |= TFW_CE_SUPERSEDED;
+			else
+				ce->flags |= TFW_CE_SUPERSEDED;
+		}
+		tdb_rec_next(db, &iter);
+	}
+}
+
+/**
+ * Translation of addresses of a source entry to the same addresses of its
+ * copy, which has the same chunks.
+ *
+ * @db		- database of the copy;
+ * @ce		- the copy;
+ * @sbase	- base address of the offsets in the source entry;
+ * @rebase	- translates address @p of the source entry;
+ * @sdb		- database of the source entry for replicas;
+ * @src		- the source entry for replicas;
+ * @b		- disk object of the source entry for promoted entries;
+ * @nr		- number of chunks in @b;
+ */
+typedef struct tfw_cache_rebase_t TfwCacheRebase;
+struct tfw_cache_rebase_t {
+	TDB		*db;
+	TfwCacheEntry	*ce;
+	char		*sbase;
+	int		(*rebase)(TfwCacheRebase *rb, char **p);
+	union {
+		struct {
+			TDB		*sdb;
+			TfwCacheEntry	*src;
+		};
+		struct {
+			TfwCacheDiskBuf	*b;
+			unsigned int	nr;
+		};
+	};
+};
+
+static int
+tfw_cache_rebase_off(TfwCacheRebase *rb, long *off)
+{
+	char *p;
+
+	if (!*off)
+		return 0;
+	p = rb->sbase + *off;
+	if (rb->rebase(rb, &p))
+		return -EINVAL;
+	*off = TDB_OFF(rb->db->hdr, p);
+
+	return 0;
+}
+
+/**
+ * Translate the fields of header @hdr of the source entry to the copy.
+ */
+static int
+tfw_cache_entry_rebase(TfwCacheRebase *rb, TfwCacheEntry *hdr)
+{
+	int i;
+	TfwStr *c, *end;
+
+	if (tfw_cache_rebase_off(rb, &hdr->key)
+	    || tfw_cache_rebase_off(rb, &hdr->vary)
+	    || tfw_cache_rebase_off(rb, &hdr->status)
+	    || tfw_cache_rebase_off(rb, &hdr->hdrs)
+	    || tfw_cache_rebase_off(rb, &hdr->hpack)
+	    || tfw_cache_rebase_off(rb, &hdr->body)
+	    || tfw_cache_rebase_off(rb, &hdr->cl_hdr)
+	    || tfw_cache_rebase_off(rb, &hdr->esi))
+		return -EINVAL;
+	for (i = 0; i < ARRAY_SIZE(hdr->hdrs_304); ++i)
+		if (tfw_cache_rebase_off(rb, &hdr->hdrs_304[i]))
+			return -EINVAL;
+
+	if (TFW_STR_EMPTY(&hdr->etag))
+		return 0;
+	if (rb->rebase(rb, &hdr->etag.data))
+		return -EINVAL;
+	if (TFW_STR_PLAIN(&hdr->etag))
+		return 0;
+	/* The chunks are already copied to the copy entry. */
+	TFW_STR_FOR_EACH_CHUNK(c, &hdr->etag, end)
+		if (rb->rebase(rb, &c->data))
+			return -EINVAL;
+
+	return 0;
+}
+
+/**
+ * Translate address @p in entry @rb->src stored in @rb->sdb to the same
+ * address in replica @rb->ce stored in @rb->db.
+ */
+static int
+tfw_cache_replica_rebase(TfwCacheRebase *rb, char **p)
+{
+	TdbVRec *s = &rb->src->trec, *d = &rb->ce->trec;
+
+	while (*p < s->data || *p > s->data + s->len) {
+		s = tdb_next_rec_chunk(rb->sdb, s);
+		d = tdb_next_rec_chunk(rb->db, d);
+		if (WARN_ON_ONCE(!s || !d))
+			return -EINVAL;
+	}
+	*p = d->data + (*p - s->data);
+
+	return 0;
+}
+
+/**
+ * Copy data of entry @src stored in @sdb to replica @ce stored in @db, which
+ * has only the first chunk allocated. The entry fields are built in @hdr and
+ * are written to the replica by the caller.
+ */
+static int
+tfw_cache_replica_copy(TDB *db, TfwCacheEntry *ce, TDB *sdb,
+		       TfwCacheEntry *src, TfwCacheEntry *hdr)
+{
+	TdbVRec *s = &src->trec, *d = &ce->trec;
+	TfwCacheRebase rb = {
+		.db	= db,
+		.ce	= ce,
+		.sbase	= (char *)sdb->hdr,
+		.rebase	= tfw_cache_replica_rebase,
+		.sdb	= sdb,
+		.src	= src,
+	};
+
+	if (d->len < s->len)
+		return -ENOMEM;
+	d->len = s->len;
+	memcpy_fast(d->data + CE_BODY_SIZE, s->data + CE_BODY_SIZE,
+		    s->len - CE_BODY_SIZE);
+	while ((s = tdb_next_rec_chunk(sdb, s))) {
+		if (!(d = tdb_entry_add(db, d, s->len)) || d->len < s->len)
+			return -ENOMEM;
+		d->len = s->len;
+		memcpy_fast(d->data, s->data, s->len);
+	}
+
+	memcpy_fast(&hdr->ce_body, &src->ce_body, CE_BODY_SIZE);
+
+	return tfw_cache_entry_rebase(&rb, hdr);
+}
+
+/**
+ * Get entry @ce stored with @key in @db if it's still there.
+ */
+static TfwCacheEntry *
+tfw_cache_replica_src(TDB *db, unsigned long key, TfwCacheEntry *ce)
+{
+	TdbIter iter = tdb_rec_get(db, key);
+
+	while (iter.rec && (TfwCacheEntry *)iter.rec != ce)
+		tdb_rec_next(db, &iter);
+	if (!iter.rec)
+		return NULL;
+	if (ce->flags & (TFW_CE_SUPERSEDED | TFW_CE_INCOMPLETE)) {
+		tdb_rec_put(ce);
+		return NULL;
+	}
+
+	return ce;
+}
+
+/**
+ * Store a replica of the entry described by @cw in the current node database.
+ * The database bucket of the entry isn't held while the replica is allocated
+ * or removed, so replication between two nodes in opposite directions doesn't
+ * deadlock on the buckets locks.
+ */
+static void
+tfw_cache_replica_add(TfwCWork *cw)
+{
+	size_t len, size = 0;
+	TfwCacheEntry *src, *ce, hdr;
+	TdbVRec *trec;
+	CaNode *node = &c_nodes[numa_node_id()];
+	TDB *db = node->db, *sdb = c_nodes[cw->nid].db;
+
+	if (!(src = tfw_cache_replica_src(sdb, cw->key, cw->ce)))
+		return;
+	len = src->trec.len;
+	for (trec = &src->trec; trec; trec = tdb_next_rec_chunk(sdb, trec))
+		size += trec->len;
+	tdb_rec_put(src);
+
+	tfw_cache_evict_reserve(node, size);
+	if (!(ce = (TfwCacheEntry *)tdb_entry_alloc(db, cw->key, &len)))
+		goto skip;
+	ce->flags = TFW_CE_INCOMPLETE;
+
+	if (!(src = tfw_cache_replica_src(sdb, cw->key, cw->ce)))
+		goto remove;
+	if (tfw_cache_replica_copy(db, ce, sdb, src, &hdr)) {
+		tdb_rec_put(src);
+		goto remove;
+	}
+	tdb_rec_put(src);
+
+	hdr.flags |= TFW_CE_INCOMPLETE;
+	hdr.accessed = 0;
+	memcpy_fast(&ce->ce_body, &hdr.ce_body, CE_BODY_SIZE);
+	if (tfw_cache_lru_add(node, cw->key, ce, NULL, size))
+		goto remove;
+	smp_wmb();
+	WRITE_ONCE(ce->flags, ce->flags & ~TFW_CE_INCOMPLETE);
+
+	tfw_cache_supersede_replica(db, ce);
+	tfw_cache_vld_set(node, ce);
+	TFW_INC_STAT_BH(cache.replicated);
+
+	return;
+remove:
+	tdb_entry_remove(db, cw->key, tfw_cache_rec_eq, ce);
+skip:
+	TFW_INC_STAT_BH(cache.repl_skipped);
+}
+
+/**
+ * Schedule replication of entry @ce just stored with @key in the database of
+ * node @nid to the other nodes.
+ */
+static void
+tfw_cache_replicate(int nid, unsigned long key, TfwCacheEntry *ce)
+{
+	int n, cpu;
+	TfwWorkTasklet *ct;
+	TfwCWork cw = { .ce = ce, .key = key, .nid = nid };
+
+	for_each_node_with_cpus(n) {
+		if (n == nid)
+			continue;
+		cpu = tfw_cache_sched_cpu(n);
+		ct = per_cpu_ptr(&cache_wq, cpu);
+		if (tfw_nq_size(&ct->wq) >= TFW_CACHE_REPL_QLEN
+		    || tfw_nq_push(&ct->wq, &cw, cpu, &ct->ipi_work,
+				   tfw_cache_ipi))
+			TFW_INC_STAT_BH(cache.repl_skipped);
+	}
+}
+
+/**
+ * Invalidate replicas of the entry with @key and @resp_time stored in @db in
+ * the databases of the other nodes.
+ */
+static void
+tfw_cache_replicas_invalidate(TDB *db, unsigned long key, time_t resp_time)
+{
+	int nid;
+	TdbIter iter;
+	TfwCacheEntry *ce;
+
+	for_each_node_with_cpus(nid) {
+		if (c_nodes[nid].db == db)
+			continue;
+		iter = tdb_rec_get(c_nodes[nid].db, key);
+		while ((ce = (TfwCacheEntry *)iter.rec)) {
+			if (ce->resp_time == resp_time)
+				ce->lifetime = 0;
+			tdb_rec_next(c_nodes[nid].db, &iter);
+		}
+	}
+}
+
+/**
+ * Update stored response with the metadata from 304 response @resp to
+ * a background revalidation request, RFC 7234 4.3.4.
+ */
+static bool
+__cache_freshen_node(CaNode *node, TfwHttpResp *resp)
+{
+	TdbIter iter;
+	TfwCacheEntry *ce;
+	TfwHttpReq *req = resp->req;
+
+	if (!(ce = tfw_cache_dbce_get(node->db, &iter, req)))
+		return false;
+
+	ce->date = resp->date;
+	ce->age = resp->cache_ctl.age;
+	ce->req_time = req->cache_ctl.timestamp;
+	ce->resp_time = resp->cache_ctl.timestamp;
+	if (resp->cache_ctl.flags
+	    & (TFW_HTTP_CC_S_MAXAGE | TFW_HTTP_CC_MAX_AGE
+	       | TFW_HTTP_CC_HDR_EXPIRES))
+		ce->lifetime = tfw_cache_calc_lifetime(resp);
+	if (resp->cache_ctl.flags & TFW_HTTP_CC_IS_PRESENT)
+		ce->stale_reval = tfw_cache_calc_stale_reval(resp);
+	tfw_cache_vld_set(node, ce);
+
+	tfw_cache_dbce_put(ce);
+
+	return true;
+}
+
+static bool
+tfw_cache_freshen(TfwHttpResp *resp)
+{
+	int nid;
+	bool r = false;
+
+	if (cache_cfg.cache == TFW_CACHE_SHARD)
+		return __cache_freshen_node(&c_nodes[numa_node_id()], resp);
+
+	for_each_node_with_cpus(nid)
+		r |= __cache_freshen_node(&c_nodes[nid], resp);
+
+	return r;
+}
+
+static void cache_req_process_node(TfwHttpReq *req, tfw_http_cache_cb_t action,
+				   bool collapse);
+
+static inline TfwCacheFetchBucket *
+tfw_cache_fetch_bucket(unsigned long key)
+{
+	return &cache_fetch_tbl[hash_min(key, TFW_CACHE_FETCH_TBL_BITS)];
+}
+
+/**
+ * Release all the requests waiting for the pending fetch @cf. If the fetched
+ * response is @stored in the cache, then the requests are serviced from the
+ * cache, otherwise they're forwarded to backends. @cf must be already removed
+ * from the hash table.
+ */
+static void
+tfw_cache_fetch_release(TfwCacheFetch *cf, bool stored)
+{
+	TfwHttpReq *req, *tmp;
+
+	list_for_each_entry_safe(req, tmp, &cf->waiters, wait_list) {
+		list_del_init(&req->wait_list);
+		if (stored)
+			cache_req_process_node(req, cf->action, false);
+		else
+			cf->action((TfwHttpMsg *)req);
+	}
+
+	kmem_cache_free(cache_fetch_cache, cf);
+}
+
+static void
+tfw_cache_fetch_timer_cb(unsigned long data)
+{
+	TfwCacheFetch *cf = (TfwCacheFetch *)data;
+	TfwCacheFetchBucket *hb = tfw_cache_fetch_bucket(cf->key);
+
+	spin_lock(&hb->lock);
+	/* The fetch is completed and is being released right now. */
+	if (hlist_unhashed(&cf->hentry)) {
+		spin_unlock(&hb->lock);
+		return;
+	}
+	hlist_del_init(&cf->hentry);
+	spin_unlock(&hb->lock);
+
+	T_DBG2("Cache: pending fetch timed out, key=%lx\n", cf->key);
+
+	tfw_cache_fetch_release(cf, false);
+}
+
+static TfwCacheFetch *
+__tfw_cache_fetch_lookup(TfwCacheFetchBucket *hb, unsigned long key)
+{
+	TfwCacheFetch *cf;
+
+	hlist_for_each_entry(cf, &hb->list, hentry)
+		if (cf->key == key)
+			return cf;
+
+	return NULL;
+}
+
+static TfwCacheFetch *
+__tfw_cache_fetch_add(TfwCacheFetchBucket *hb, unsigned long key,
+		      tfw_http_cache_cb_t action, unsigned long tmt)
+{
+	TfwCacheFetch *cf;
+
+	if (!(cf = kmem_cache_alloc(cache_fetch_cache, GFP_ATOMIC)))
+		return NULL;
+
+	INIT_LIST_HEAD(&cf->waiters);
+	cf->key = key;
+	cf->action = action;
+	hlist_add_head(&cf->hentry, &hb->list);
+	setup_timer(&cf->timer, tfw_cache_fetch_timer_cb, (unsigned long)cf);
+	mod_timer(&cf->timer, jiffies + tmt);
+
+	return cf;
+}
+
+/**
+ * Join the pending fetch for the @req key if there is one, or create a new
+ * pending fetch, so @req becomes the fetch leader and is forwarded as usual.
+ *
+ * Return true if @req is queued and is serviced later or false if it must be
+ * forwarded right now.
+ */
+static bool
+tfw_cache_fetch_wait(TfwHttpReq *req, tfw_http_cache_cb_t action)
+{
+	TfwCacheFetch *cf;
+	unsigned long key = tfw_http_req_key_calc(req);
+	TfwCacheFetchBucket *hb = tfw_cache_fetch_bucket(key);
+
+	spin_lock(&hb->lock);
+
+	if ((cf = __tfw_cache_fetch_lookup(hb, key))) {
+		list_add_tail(&req->wait_list, &cf->waiters);
+		spin_unlock(&hb->lock);
+		TFW_INC_STAT_BH(cache.collapsed);
+		return true;
+	}
+	__tfw_cache_fetch_add(hb, key, action, cache_cfg.collapse_tmt);
+
+	spin_unlock(&hb->lock);
+
+	return false;
+}
+
+/**
+ * Start a pending fetch for @key unless there is one already, e.g. to make
+ * only one background revalidation request for a stale cache entry.
+ * Return true if the fetch is started.
+ */
+static bool
+tfw_cache_fetch_start(unsigned long key, tfw_http_cache_cb_t action)
+{
+	bool r = false;
+	TfwCacheFetchBucket *hb = tfw_cache_fetch_bucket(key);
+
+	spin_lock(&hb->lock);
+
+	if (!__tfw_cache_fetch_lookup(hb, key)) {
+		__tfw_cache_fetch_add(hb, key, action,
+				      max_t(unsigned long,
+					    cache_cfg.collapse_tmt,
+					    TFW_CACHE_REVAL_TIMEOUT));
+		r = true;
+	}
+
+	spin_unlock(&hb->lock);
+
+	return r;
+}
+
+/**
+ * Queue @req to the pending fetch for @key if there is one, e.g. a fetch of
+ * an ESI fragment. Return true if @req is queued.
+ */
+static bool
+tfw_cache_fetch_join(TfwHttpReq *req, unsigned long key)
+{
+	TfwCacheFetch *cf;
+	TfwCacheFetchBucket *hb = tfw_cache_fetch_bucket(key);
+
+	spin_lock(&hb->lock);
+	if ((cf = __tfw_cache_fetch_lookup(hb, key)))
+		list_add_tail(&req->wait_list, &cf->waiters);
+	spin_unlock(&hb->lock);
+
+	return cf;
+}
+
+/**
+ * The response for @key is received: release the requests waiting for it.
+ */
+static void
+tfw_cache_fetch_done(unsigned long key, bool stored)
+{
+	TfwCacheFetch *cf;
+	TfwCacheFetchBucket *hb = tfw_cache_fetch_bucket(key);
+
+	if (hlist_empty(&hb->list))
+		return;
+
+	spin_lock(&hb->lock);
+	if ((cf = __tfw_cache_fetch_lookup(hb, key)))
+		hlist_del_init(&cf->hentry);
+	spin_unlock(&hb->lock);
+
+	if (!cf)
+		return;
+	del_timer_sync(&cf->timer);
+
+	tfw_cache_fetch_release(cf, stored);
+}
+
+/**
+ * Forward all the requests waiting for responses, e.g. on shutdown.
+ */
+static void
+tfw_cache_fetch_flush(void)
+{
+	int i;
+	TfwCacheFetch *cf;
+	struct hlist_node *tmp;
+
+	for (i = 0; i < ARRAY_SIZE(cache_fetch_tbl); ++i) {
+		TfwCacheFetchBucket *hb = &cache_fetch_tbl[i];
+		HLIST_HEAD(list);
+
+		spin_lock_bh(&hb->lock);
+		hlist_move_list(&hb->list, &list);
+		hlist_for_each_entry(cf, &list, hentry)
+			cf->hentry.pprev = NULL;
+		spin_unlock_bh(&hb->lock);
+
+		hlist_for_each_entry_safe(cf, tmp, &list, hentry) {
+			del_timer_sync(&cf->timer);
+			local_bh_disable();
+			tfw_cache_fetch_release(cf, false);
+			local_bh_enable();
+		}
+	}
+}
+
+/* Time to give up waiting for an entry read from the disk tier. */
+#define TFW_CACHE_DISK_TIMEOUT		HZ
+
+/**
+ * Queue @req until the entry for @key is read from the disk tier, unless
+ * there is a pending fetch for the key to join already.
+ * Return true if @req is queued and is serviced later.
+ */
+static bool
+tfw_cache_fetch_disk(TfwHttpReq *req, unsigned long key,
+		     tfw_http_cache_cb_t action)
+{
+	TfwCacheFetch *cf;
+	bool leader = false;
+	TfwCacheFetchBucket *hb = tfw_cache_fetch_bucket(key);
+
+	spin_lock(&hb->lock);
+
+	if (!(cf = __tfw_cache_fetch_lookup(hb, key))) {
+		cf = __tfw_cache_fetch_add(hb, key, action,
+					   TFW_CACHE_DISK_TIMEOUT);
+		if (!cf) {
+			spin_unlock(&hb->lock);
+			return false;
+		}
+		leader = true;
+	}
+	list_add_tail(&req->wait_list, &cf->waiters);
+
+	spin_unlock(&hb->lock);
+
+	if (leader && !tfw_cache_disk_read(key, req->node))
+		tfw_cache_fetch_done(key, false);
+
+	return true;
+}
+
+/**
+ * Translate address @p of the entry demoted to disk object @rb->b to the
+ * same address of entry @rb->ce promoted to @rb->db.
+ */
+static int
+tfw_cache_disk_rebase(TfwCacheRebase *rb, char **p)
+{
+	unsigned int i;
+	TfwCacheDiskChunk ch;
+	TdbVRec *d = &rb->ce->trec;
+
+	for (i = 0; i < rb->nr; ++i) {
+		tfw_cache_disk_buf_read(rb->b, sizeof(TfwCacheDiskHdr)
+					       + i * sizeof(ch),
+					&ch, sizeof(ch));
+		if (*p >= (char *)ch.addr && *p <= (char *)ch.addr + ch.len) {
+			*p = d->data + (*p - (char *)ch.addr);
+			return 0;
+		}
+		if (!(d = tdb_next_rec_chunk(rb->db, d)))
+			break;
+	}
+	WARN_ON_ONCE(1);
+
+	return -EINVAL;
+}
+
+/**
+ * Store entry @cw->dbuf read from the disk tier in the current node database
+ * with the same chunks as it had before the demotion, and release the
+ * requests waiting for it.
+ */
+static void
+tfw_cache_promote(TfwCWork *cw)
+{
+	unsigned int i;
+	size_t off, len, size;
+	bool stored = false;
+	TdbVRec *d;
+	TfwCacheDiskHdr dh;
+	TfwCacheDiskChunk ch;
+	TfwCacheEntry *ce, hdr;
+	TfwCacheDiskBuf *b = cw->dbuf;
+	CaNode *node = &c_nodes[numa_node_id()];
+	TfwCacheRebase rb = {
+		.db	= node->db,
+		.rebase	= tfw_cache_disk_rebase,
+		.b	= b,
+	};
+
+	tfw_cache_disk_buf_read(b, 0, &dh, sizeof(dh));
+	off = sizeof(dh) + dh.nr * sizeof(ch);
+	size = b->len - off;
+	rb.sbase = (char *)dh.base;
+	rb.nr = dh.nr;
+
+	tfw_cache_disk_buf_read(b, sizeof(dh), &ch, sizeof(ch));
+	len = ch.len;
+	tfw_cache_evict_reserve(node, size);
+	if (!(ce = (TfwCacheEntry *)tdb_entry_alloc(node->db, cw->key, &len)))
+		goto out;
+	ce->flags = TFW_CE_INCOMPLETE;
+	rb.ce = ce;
+
+	d = &ce->trec;
+	if (d->len < ch.len)
+		goto remove;
+	d->len = ch.len;
+	tfw_cache_disk_buf_read(b, off, &hdr.ce_body, CE_BODY_SIZE);
+	tfw_cache_disk_buf_read(b, off + CE_BODY_SIZE, d->data + CE_BODY_SIZE,
+				ch.len - CE_BODY_SIZE);
+	off += ch.len;
+	for (i = 1; i < dh.nr; ++i) {
+		tfw_cache_disk_buf_read(b, sizeof(dh) + i * sizeof(ch), &ch,
+					sizeof(ch));
+		d = tdb_entry_add(node->db, d, ch.len);
+		if (!d || d->len < ch.len)
+			goto remove;
+		d->len = ch.len;
+		tfw_cache_disk_buf_read(b, off, d->data, ch.len);
+		off += ch.len;
+	}
+	if (tfw_cache_entry_rebase(&rb, &hdr))
+		goto remove;
+
+	hdr.flags |= TFW_CE_INCOMPLETE | TFW_CE_PROMOTED;
+	hdr.accessed = 0;
+	memcpy_fast(&ce->ce_body, &hdr.ce_body, CE_BODY_SIZE);
+	if (tfw_cache_lru_add(node, cw->key, ce, NULL, size))
+		goto remove;
+	smp_wmb();
+	WRITE_ONCE(ce->flags, ce->flags & ~TFW_CE_INCOMPLETE);
+
+	tfw_cache_supersede_replica(node->db, ce);
+	tfw_cache_vld_set(node, ce);
+	TFW_INC_STAT_BH(cache.promoted);
+	stored = true;
+	goto out;
+remove:
+	tdb_entry_remove(node->db, cw->key, tfw_cache_rec_eq, ce);
+out:
+	tfw_cache_disk_buf_free(b);
+	tfw_cache_fetch_done(cw->key, stored);
+}
+
+/**
+ * Schedule promotion of entry @b read from the disk tier for @key to node
+ * @nid or, if the entry can't be read, release the requests waiting for it.
+ * Called from process context.
+ */
+static void
+tfw_cache_disk_done(unsigned long key, int nid, TfwCacheDiskBuf *b)
+{
+	int cpu;
+	TfwWorkTasklet *ct;
+	TfwCWork cw = { .dbuf = b, .key = key, .promote = true };
+
+	local_bh_disable();
+	if (b) {
+		cpu = tfw_cache_sched_cpu(nid);
+		ct = per_cpu_ptr(&cache_wq, cpu);
+		if (!tfw_nq_push(&ct->wq, &cw, cpu, &ct->ipi_work,
+				 tfw_cache_ipi))
+			goto out;
+		tfw_cache_disk_buf_free(b);
+	}
+	tfw_cache_fetch_done(key, false);
+out:
+	local_bh_enable();
+}
+
+static void
+tfw_cache_add(TfwHttpResp *resp, tfw_http_cache_cb_t action)
+{
+	unsigned long key;
+	TfwStr vary;
+	bool keep_skb = false, stored = false;
+	TfwHttpReq *req = resp->req;
+	TfwCacheEntry *ce = NULL;
+
+	key = tfw_http_req_key_calc(req);
+
+	if (unlikely(resp->status == 304
+		     && test_bit(TFW_HTTP_B_CACHE_BG, req->flags)))
+	{
+		stored = tfw_cache_freshen(resp);
+		goto out;
+	}
+
+	if (!tfw_cache_employ_resp(resp))
+		goto out;
+	/*
+	 * The head of a streamed response is already adjusted for the client,
+	 * only the copy made while the response was received can be stored.
+	 */
+	if (test_bit(TFW_HTTP_B_REQ_STREAMED, req->flags)
+	    && !(resp->cstream && resp->cstream->ce
+		 && resp->cstream->nid == numa_node_id()))
+		goto out;
+	if (!tfw_cache_freq_admit(req)) {
+		TFW_INC_STAT_BH(cache.not_admitted);
+		goto out;
+	}
+	if (tfw_cache_vary_key(resp, &vary)) {
+		T_DBG2("Cache: cannot build secondary key, key=%lx\n", key);
+		goto out;
+	}
+
+	if (cache_cfg.cache == TFW_CACHE_SHARD) {
+		BUG_ON(req->node != numa_node_id());
+		stored = !!__cache_add_node(numa_node_id(), resp, key, &vary);
+	} else {
+		int nid = numa_node_id();
+
+		if ((ce = __cache_add_node(nid, resp, key, &vary))) {
+			stored = true;
+			/* Slices are stored in the local node only. */
+			if (!resp->cstream || !resp->cstream->sid)
+				tfw_cache_replicate(nid, key, ce);
+		}
+	}
+
+	/*
+	 * The skeleton isn't sent as is: the client gets the page assembled
+	 * from the cache, which fetches the missing fragments first.
+	 */
+	if (ce && ce->esi_len && !test_bit(TFW_HTTP_B_CACHE_BG, req->flags)) {
+		tfw_http_conn_msg_free((TfwHttpMsg *)resp);
+		cache_req_process_node(req, tfw_http_req_cache_cb, false);
+		tfw_cache_fetch_done(key, stored);
+		return;
+	}
+
+	/*
+	 * Cache population is synchronous now. Don't forget to set
+	 * @keep_skb properly in case of asynchronous operation is being
+	 * performed.
+	 */
+
+out:
+	resp->msg.ss_flags |= keep_skb ? SS_F_KEEP_SKB : 0;
+	action((TfwHttpMsg *)resp);
+
+	tfw_cache_fetch_done(key, stored);
+}
+
+/**
+ * Invalidate a cache entry.
+ * In fact, this is implemented by making the cache entry stale.
+ */
+static int
+tfw_cache_purge_invalidate(TfwHttpReq *req)
+{
+	TdbIter iter;
+	TDB *db = node_db();
+	TfwCacheEntry *ce = NULL;
+	bool dropped = tfw_cache_disk_drop(tfw_http_req_key_calc(req));
+
+	if (!(ce = tfw_cache_dbce_get(db, &iter, req)))
+		return dropped ? 0 : -ENOENT;
+	ce->lifetime = 0;
+
+	do {
+		tdb_rec_next(db, &iter);
+		ce = (TfwCacheEntry *)iter.rec;
+		if (ce && tfw_cache_entry_key_eq(db, req, ce))
+			ce->lifetime = 0;
+	} while (ce);
+
+	tfw_cache_dbce_put(ce);
+
+	return 0;
+}
+
+/**
+ * Invalidate the cache entry referenced by tag record @tag in @db.
+ * The entry is looked up by its key, so records of already removed
+ * entries are just skipped.
+ */
+static bool
+tfw_cache_tag_invalidate(TDB *db, TfwCacheTag *tag)
+{
+	TdbIter iter;
+	TfwCacheEntry *ce;
+	bool r = false;
+
+	iter = tdb_rec_get(db, tag->key);
+	while ((ce = (TfwCacheEntry *)iter.rec)) {
+		if (TDB_OFF(db->hdr, ce) == tag->ce) {
+			time_t resp_time = ce->resp_time;
+
+			ce->lifetime = 0;
+			tdb_rec_put(ce);
+			if (cache_cfg.cache == TFW_CACHE_REPLICA)
+				tfw_cache_replicas_invalidate(db, tag->key,
+							      resp_time);
+			return true;
+		}
+		/*
+		 * Promoted entries are moved, so the tag records don't point
+		 * to them and all the promoted entries with the key are
+		 * invalidated.
+		 */
+		if (ce->flags & TFW_CE_PROMOTED) {
+			ce->lifetime = 0;
+			r = true;
+		}
+		tdb_rec_next(db, &iter);
+	}
+
+	return r;
+}
 
-	res_size += sizeof(TfwCStr);
-	res_size += 2;
-	res_size += tfw_hpack_int_size(via_sz, 0x7F);
-	res_size += via_sz;
+/* Replicate purge of @tag to other Tempesta nodes. */
+static int
+tfw_cache_tag_repl(const char *tag, size_t len, void *data)
+{
+	tfw_cache_purge_repl_tag(tag, len);
+
+	return 0;
+}
+
+static int
+tfw_cache_tag_purge(const char *tag, size_t len, void *data)
+{
+	int nid;
+	TdbIter iter;
+	TfwCacheTagCtx *ctx = data;
+	unsigned long hash = hash_calc(tag, len);
+
+	for_each_node_with_cpus(nid) {
+		TDB *tag_db = c_nodes[nid].tag_db;
+
+		iter = tdb_rec_get(tag_db, hash);
+		while (!TDB_ITER_BAD(iter)) {
+			TfwCacheTag *rec = (TfwCacheTag *)iter.rec->data;
+
+			ctx->nr += tfw_cache_tag_invalidate(c_nodes[nid].db,
+							    rec);
+			/* The demoted entries with the key may have the tag. */
+			ctx->nr += tfw_cache_disk_drop(rec->key);
+			tdb_rec_next(tag_db, &iter);
+		}
+		/* All the records are invalidated, so drop the index. */
+		while (!tdb_entry_remove(tag_db, hash, NULL, NULL))
+			;
+	}
+
+	return 0;
+}
+
+/**
+ * Invalidate all the cache entries tagged with any of the tags listed in
+ * the configured tags header of PURGE request @req. The work is
+ * proportional to the number of the tagged entries.
+ *
+ * @return -ENODATA if there is no tags header in @req.
+ */
+static int
+tfw_cache_purge_tags(TfwHttpReq *req)
+{
+	char *tags, *end;
+	TfwCacheTagCtx ctx = {};
+
+	if (!cache_cfg.tag_hdr_len)
+		return -ENODATA;
+	tags = (*this_cpu_ptr(&g_vary_buf))[0];
+	end = tfw_cache_req_hdr_val(req, cache_cfg.tag_hdr,
+				    cache_cfg.tag_hdr_len - 1, tags,
+				    tags + TFW_CACHE_VARY_MAXLEN);
+	if (!end)
+		return -E2BIG;
+	if (end == tags)
+		return -ENODATA;
+
+	tfw_cache_tags_for_each(tags, end, &ctx, tfw_cache_tag_purge);
+	T_DBG("Cache: %u entries are purged by tags\n", ctx.nr);
+	tfw_cache_tags_for_each(tags, end, NULL, tfw_cache_tag_repl);
+
+	return ctx.nr ? 0 : -ENOENT;
+}
+
+/**
+ * Invalidate all the cache entries with @key at all the nodes. Used to apply
+ * purges replicated from other Tempesta nodes, so there is no request to
+ * compare the full keys of the entries with.
+ */
+void
+tfw_cache_purge_key(unsigned long key)
+{
+	int nid;
+	TdbIter iter;
+	TfwCacheEntry *ce;
+
+	if (!cache_cfg.cache)
+		return;
+	for_each_node_with_cpus(nid) {
+		TDB *db = c_nodes[nid].db;
+
+		iter = tdb_rec_get(db, key);
+		while ((ce = (TfwCacheEntry *)iter.rec)) {
+			ce->lifetime = 0;
+			tdb_rec_next(db, &iter);
+		}
+	}
+	tfw_cache_disk_drop(key);
+}
+
+/**
+ * Invalidate all the cache entries tagged with @tag of @len bytes. Used to
+ * apply tag purges replicated from other Tempesta nodes.
+ */
+void
+tfw_cache_purge_tag(const char *tag, size_t len)
+{
+	TfwCacheTagCtx ctx = {};
+
+	if (cache_cfg.cache && cache_cfg.tag_hdr_len)
+		tfw_cache_tag_purge(tag, len, &ctx);
+}
+
+/**
+ * Process PURGE request method according to the configuration.
+ */
+static void
+tfw_cache_purge_method(TfwHttpReq *req)
+{
+	int ret;
+	TfwAddr saddr;
+	TfwGlobal *g_vhost = tfw_vhost_get_global();
+
+	/* Deny PURGE requests by default. */
+	if (!(cache_cfg.cache && g_vhost->cache_purge && g_vhost->cache_purge_acl)) {
+		tfw_http_send_resp(req, 403, "purge: not configured");
+		return;
+	}
+
+	/* Accept requests from configured hosts only. */
+	ss_getpeername(req->conn->sk, &saddr);
+	if (!tfw_capuacl_match(&saddr)) {
+		tfw_http_send_resp(req, 403, "purge: ACL violation");
+		return;
+	}
+
+	/* Only "invalidate" option is implemented at this time. */
+	switch (g_vhost->cache_purge_mode) {
+	case TFW_D_CACHE_PURGE_INVALIDATE:
+		ret = tfw_cache_purge_tags(req);
+		if (ret == -ENODATA) {
+			tfw_cache_purge_repl_key(tfw_http_req_key_calc(req));
+			ret = tfw_cache_purge_invalidate(req);
+		}
+		break;
+	default:
+		tfw_http_send_resp(req, 403, "purge: invalid option");
+		return;
+	}
+
+	if (ret)
+		tfw_http_send_resp(req, 404, "purge: processing error");
+	else
+		tfw_http_send_resp(req, 200, "purge: success");
+}
+
+/**
+ * Build the message body as paged fragments of skb.
+ * See do_tcp_sendpages() as reference.
+ *
+ * Cached pages are reused in skbs and SKBTX_SHARED_FRAG is set to avoid any
+ * data copies. In-place crypto operations aren't allowed for shared data, so
+ * for https connections the data is copied right before it's pushed into
+ * network, along with the encryption.
+ *
+ * For h2 connections every response has unique DATA frame headers, so they
+ * are placed to their own fragments preceding the cached body fragments.
+ * @fr is the state of the frames or NULL for HTTP/1.1 responses.
+ */
+static int
+__tfw_cache_build_resp_body(TDB *db, TdbVRec *trec, TfwMsgIter *it, char *p,
+			    unsigned long body_sz, TfwCacheFrames *fr)
+{
+	int r = 0;
+
+	while (1) {
+		int f_size;
+
+		/* Only the chunk headers are read, the data is sent as is. */
+		tfw_cache_chunk_prefetch(db, trec);
+		f_size = trec->data + trec->len - p;
+		if (f_size) {
+			f_size = min(body_sz, (unsigned long)f_size);
+			body_sz -= f_size;
+			if (fr) {
+				fr->left -= f_size;
+				fr->hdr.flags = fr->left
+						? 0 : HTTP2_F_END_STREAM;
+				fr->hdr.length = f_size;
+				r = tfw_http_msg_add_frame_hdr(it, &fr->hdr,
+							       &fr->page,
+							       &fr->off);
+				if (r)
+					break;
+			}
+			r = tfw_http_msg_add_frag(it, virt_to_page(p),
+					       (unsigned long)p & ~PAGE_MASK,
+					       f_size);
+			if (r)
+				break;
+		}
+		if (!body_sz || !(trec = tdb_next_rec_chunk(db, trec)))
+			break;
+		/*
+		 * Broken record: body is not fully copied yet, but there is
+		 * no data in the next record part.
+		 */
+		if (WARN_ON_ONCE(!trec->len)) {
+			r = -EINVAL;
+			break;
+		}
+		p = trec->data;
+	}
+
+	return r;
+}
+
+static int
+tfw_cache_build_resp_body(TDB *db, TdbVRec *trec, TfwMsgIter *it, char *p,
+			  unsigned long body_sz, bool h2, unsigned int stream_id)
+{
+	int r;
+	TfwCacheFrames fr = {
+		.hdr = { .stream_id = stream_id, .type = HTTP2_DATA },
+		.left = body_sz,
+	};
+
+	if ((r = tfw_http_msg_body_skb(it)))
+		return r;
+	r = __tfw_cache_build_resp_body(db, trec, it, p, body_sz,
+					h2 ? &fr : NULL);
+	if (fr.page)
+		put_page(fr.page);
+
+	return r;
+}
+
+/**
+ * Get slice @idx of the body of sliced entry @ce.
+ */
+static TfwCacheEntry *
+tfw_cache_slice_get(TDB *db, TfwCacheEntry *ce, unsigned long idx,
+		    TdbIter *iter)
+{
+	TfwCacheEntry *sl;
+
+	*iter = tdb_rec_get(db, tfw_cache_slice_key(ce->sid, idx));
+	if (TDB_ITER_BAD(*iter))
+		return NULL;
+	while ((sl = (TfwCacheEntry *)iter->rec)) {
+		if ((sl->flags & (TFW_CE_SLICE | TFW_CE_INCOMPLETE))
+		    == TFW_CE_SLICE && sl->sid == ce->sid)
+			return sl;
+		tdb_rec_next(db, iter);
+	}
+
+	return NULL;
+}
+
+/**
+ * Check that all the slices of sliced entry @ce needed for @range of
+ * the body, or for the whole body if @range is NULL, are stored.
+ */
+static bool
+tfw_cache_slices_ready(TDB *db, TfwCacheEntry *ce, TfwCacheRange *range)
+{
+	TdbIter iter;
+	unsigned long i = range ? range->first / TFW_CACHE_SLICE_SZ : 0;
+	unsigned long last = range ? range->last : ce->body_len - 1;
+
+	for ( ; i <= last / TFW_CACHE_SLICE_SZ; ++i) {
+		if (!tfw_cache_slice_get(db, ce, i, &iter))
+			return false;
+		tdb_rec_put(iter.rec);
+	}
+
+	return true;
+}
+
+/**
+ * Build the message body of @body_sz bytes starting at offset @off of
+ * the body of sliced entry @ce. The slices are referenced as well as
+ * the body of not sliced entries.
+ */
+static int
+tfw_cache_build_resp_slices(TDB *db, TfwCacheEntry *ce, TfwMsgIter *it,
+			    unsigned long off, unsigned long body_sz, bool h2,
+			    unsigned int stream_id)
+{
+	int r;
+	char *p;
+	unsigned long n, idx = off / TFW_CACHE_SLICE_SZ;
+	TdbIter iter;
+	TdbVRec *trec;
+	TfwCacheEntry *sl;
+	TfwCacheFrames fr = {
+		.hdr = { .stream_id = stream_id, .type = HTTP2_DATA },
+		.left = body_sz,
+	};
+
+	if ((r = tfw_http_msg_body_skb(it)))
+		return r;
+
+	for (off %= TFW_CACHE_SLICE_SZ; body_sz; off = 0, ++idx) {
+		/* The slice may be evicted since the check. */
+		if (!(sl = tfw_cache_slice_get(db, ce, idx, &iter))) {
+			r = -ENOENT;
+			break;
+		}
+		if (!sl->accessed)
+			WRITE_ONCE(sl->accessed, 1);
+		trec = &sl->trec;
+		p = TDB_PTR(db->hdr, sl->body);
+		n = min(body_sz, sl->body_len - off);
+		if (WARN_ON_ONCE(off >= sl->body_len))
+			r = -EINVAL;
+		else if (!(r = tfw_cache_skip_data(db, &trec, &p, off)))
+			r = __tfw_cache_build_resp_body(db, trec, it, p, n,
+							h2 ? &fr : NULL);
+		tdb_rec_put(sl);
+		if (r)
+			break;
+		body_sz -= n;
+	}
+
+	if (fr.page)
+		put_page(fr.page);
+
+	return r;
+}
+
+/*
+ * Write the Age header of the response built from @ce in a single buffer
+ * expansion. The HTTP/2 representation doesn't use the dynamic index, so it
+ * is encoded right away without the HPACK encoder state.
+ */
+static int
+tfw_cache_set_hdr_age(TfwHttpResp *resp, TfwCacheEntry *ce)
+{
+	int r;
+	size_t digs;
+	bool to_h2 = TFW_MSG_H2(resp->req);
+	TfwHttpTransIter *mit = &resp->mit;
+	struct sk_buff **skb_head = &resp->msg.skb_head;
+	time_t age = tfw_cache_entry_age(ce);
+	char cstr_age[TFW_ULTOA_BUF_SIZ] = {0};
+	char h2_age[SLEN("age") + TFW_ULTOA_BUF_SIZ + HPACK_ENC_HDR_OVERHEAD];
+	char *name = to_h2 ? "age" : "age" S_DLM;
+	unsigned int nlen = to_h2 ? SLEN("age") : SLEN("age" S_DLM);
+	TfwStr h_age = {
+		.chunks = (TfwStr []){
+			{ .data = name, .len = nlen },
+			{},
+			{ .data = S_CRLF, .len = SLEN(S_CRLF) }
+		},
+		.len = nlen + SLEN(S_CRLF),
+		.nchunks = 3
+	};
+	TfwStr h2 = { .data = h2_age };
+
+	if (!(digs = tfw_ultoa(age, cstr_age, TFW_ULTOA_BUF_SIZ))) {
+		r = -E2BIG;
+		goto err;
+	}
+
+	__TFW_STR_CH(&h_age, 1)->data = cstr_age;
+	__TFW_STR_CH(&h_age, 1)->len = digs;
+	h_age.len += digs;
+
+	if (to_h2) {
+		h_age.nchunks = 2;
+		h_age.len -= SLEN(S_CRLF);
+		h_age.hpack_idx = 21;
+		h2.len = tfw_hpack_encode_nodyn(&h_age, h2_age);
+		r = tfw_http_msg_expand_data(&mit->iter, skb_head, &h2,
+					     &mit->start_off);
+		if (r)
+			goto err;
+		mit->acc_len += h2.len;
+	} else {
+		if ((r = tfw_http_msg_expand_data(&mit->iter, skb_head,
+						  &h_age, NULL)))
+			goto err;
+	}
+
+	return 0;
+
+err:
+	T_WARN("Unable to add Age: header, cached response [%p] dropped"
+	       " (err: %d)\n", resp, r);
+	return r;
+}
+
+static int
+tfw_cache_add_hdr(TfwHttpResp *resp, char *name, size_t nlen, char *val,
+		  size_t vlen, unsigned short hpack_idx)
+{
+	int r;
+	TfwHttpTransIter *mit = &resp->mit;
+	struct sk_buff **skb_head = &resp->msg.skb_head;
+	TfwStr hdr = {
+		.chunks = (TfwStr []){
+			{ .data = name, .len = nlen },
+			{ .data = S_DLM, .len = SLEN(S_DLM) },
+			{ .data = val, .len = vlen }
+		},
+		.len = nlen + SLEN(S_DLM) + vlen,
+		.nchunks = 3
+	};
+
+	if (TFW_MSG_H2(resp->req)) {
+		/* HTTP/2 headers have no delimiter. */
+		hdr.chunks[1] = hdr.chunks[2];
+		hdr.len -= SLEN(S_DLM);
+		hdr.nchunks = 2;
+		hdr.hpack_idx = hpack_idx;
+		return tfw_hpack_encode(resp, &hdr, TFW_H2_TRANS_EXPAND,
+					false);
+	}
+
+	if ((r = tfw_http_msg_expand_data(&mit->iter, skb_head, &hdr, NULL)))
+		return r;
+
+	return tfw_http_msg_expand_data(&mit->iter, skb_head, &g_crlf, NULL);
+}
+
+/**
+ * Add Content-Length and Content-Range headers of 206 response for @range
+ * of cached response @ce body, RFC 7233 4.1. The original Content-Length
+ * header is skipped.
+ */
+static int
+tfw_cache_set_hdr_range(TfwHttpResp *resp, TfwCacheEntry *ce,
+			TfwCacheRange *range)
+{
+	int r;
+	size_t n;
+	char buf[SLEN("bytes -/") + TFW_ULTOA_BUF_SIZ * 3];
+
+	if (!(n = tfw_ultoa(range->last - range->first + 1, buf,
+			    TFW_ULTOA_BUF_SIZ)))
+	{
+		r = -E2BIG;
+		goto err;
+	}
+	if ((r = tfw_cache_add_hdr(resp, "content-length",
+				   SLEN("content-length"), buf, n, 28)))
+		goto err;
 
-	/* Add body size. */
-	res_size += resp->body.len;
+	n = snprintf(buf, sizeof(buf), "bytes %lu-%lu/%lu", range->first,
+		     range->last, ce->body_len);
+	if ((r = tfw_cache_add_hdr(resp, "content-range",
+				   SLEN("content-range"), buf, n, 30)))
+		goto err;
 
-	return res_size;
+	return 0;
 err:
-	T_WARN("Cache: trying to store too big string %ld\n", size);
-	return -E2BIG;
+	T_WARN("Unable to add Content-Range: header, cached response [%p]"
+	       " dropped (err: %d)\n", resp, r);
+	return r;
 }
 
-static void
-__cache_add_node(TDB *db, TfwHttpResp *resp, unsigned long key)
+/**
+ * Add Content-Length header for the body of @len bytes, which replaces
+ * the stored header.
+ */
+static int
+tfw_cache_set_hdr_clen(TfwHttpResp *resp, unsigned long len)
 {
-	size_t len;
-	TfwCacheEntry *ce;
-	TfwStr rph, *s_line;
-	long data_len = __cache_entry_size(resp);
+	size_t n;
+	char buf[TFW_ULTOA_BUF_SIZ];
 
-	if (unlikely(data_len < 0))
-		return;
+	if (!(n = tfw_ultoa(len, buf, TFW_ULTOA_BUF_SIZ)))
+		return -E2BIG;
 
-	/*
-	 * We need to save the reason-phrase for the case of HTTP/1.1-response
-	 * creation from cache. Note, that reason-phrase is always the last part
-	 * of status-line with the TFW_STR_VALUE flag set.
-	 */
-	s_line = &resp->h_tbl->tbl[TFW_HTTP_STATUS_LINE];
-	rph = tfw_str_next_str_val(s_line);
-	if (WARN_ON_ONCE(TFW_STR_EMPTY(&rph)))
-		return;
+	return tfw_cache_add_hdr(resp, "content-length", SLEN("content-length"),
+				 buf, n, 28);
+}
 
-	data_len += rph.len;
-	len = data_len;
+/**
+ * Check if the stored header at @p of cache entry @ce is replaced by
+ * tfw_cache_set_hdr_gzip_vld() for the gzip compressed body.
+ */
+static bool
+tfw_cache_gzip_vld_skip(TDB *db, TfwCacheEntry *ce, char *p)
+{
+	long vary = ce->hdrs_304[TFW_CACHE_304_VARY];
+	long etag = ce->hdrs_304[TFW_CACHE_304_ETAG];
 
-	T_DBG3("%s: db=[%p] resp=[%p], req=[%p], key='%lu', data_len='%ld'\n",
-	       __func__, db, resp, resp->req, key, data_len);
+	if (vary && p == TDB_PTR(db->hdr, vary))
+		return true;
 
-	/* TODO #788: revalidate existing entries before inserting a new one. */
+	return etag && !(ce->etag.flags & TFW_STR_ETAG_WEAK)
+	       && p == TDB_PTR(db->hdr, etag);
+}
 
-	/*
-	 * Try to place the cached response in single memory chunk.
-	 * TDB should provide enough space to place at least head of
-	 * the record key at first chunk.
-	 */
-	ce = (TfwCacheEntry *)tdb_entry_alloc(db, key, &len);
-	BUG_ON(len <= sizeof(TfwCacheEntry));
-	if (!ce)
-		return;
+/**
+ * Add validator headers of gzip compressed body of the cache entry @ce. The
+ * compressed body isn't byte-identical to the tagged one, so strong
+ * entity-tag is sent as weak, RFC 7232 2.1. Accept-Encoding is merged into
+ * the field names from the stored Vary header, which are taken from the
+ * secondary key.
+ */
+static int
+tfw_cache_set_hdr_gzip_vld(TfwHttpResp *resp, TfwCacheEntry *ce)
+{
+	int r;
+	size_t n;
+	char *buf, *p, *s, *s_end, *nl, *colon;
+	const TfwStr *c, *end;
+	bool ae = false;
 
-	T_DBG3("%s: ce=[%p], alloc_len='%lu'\n", __func__, ce, len);
+	if (!TFW_STR_EMPTY(&ce->etag)
+	    && !(ce->etag.flags & TFW_STR_ETAG_WEAK))
+	{
+		/* The stored entity-tag contains the closing DQUOTE only. */
+		n = SLEN("W/\"") + ce->etag.len;
+		if (!(buf = tfw_pool_alloc(resp->pool, n)))
+			return -ENOMEM;
+		memcpy_fast(buf, "W/\"", SLEN("W/\""));
+		p = buf + SLEN("W/\"");
+		TFW_STR_FOR_EACH_CHUNK(c, &ce->etag, end) {
+			memcpy_fast(p, c->data, c->len);
+			p += c->len;
+		}
+		if ((r = tfw_cache_add_hdr(resp, "etag", SLEN("etag"), buf, n,
+					   34)))
+			return r;
+	}
 
-	if (tfw_cache_copy_resp(ce, resp, &rph, data_len)) {
-		/* TODO delete the probably partially built TDB entry. */
+	s = (*this_cpu_ptr(&g_vary_buf))[0];
+	p = buf = (*this_cpu_ptr(&g_vary_buf))[1];
+	if (WARN_ON_ONCE(ce->vary_len > TFW_CACHE_VARY_MAXLEN)
+	    || (ce->vary_len
+		&& tfw_cache_entry_read(node_db(), ce, ce->vary, s,
+					ce->vary_len)))
+		return -EINVAL;
+	/* Each line is longer than the field name and ", " separator. */
+	for (s_end = s + ce->vary_len; s < s_end; s = nl + 1) {
+		if (!(nl = memchr(s, '\n', s_end - s))
+		    || !(colon = memchr(s, ':', nl - s)))
+			return -EINVAL;
+		if (p != buf) {
+			memcpy_fast(p, ", ", 2);
+			p += 2;
+		}
+		n = colon - s;
+		ae |= n == SLEN("accept-encoding")
+		      && !memcmp(s, "accept-encoding", n);
+		memcpy_fast(p, s, n);
+		p += n;
+	}
+	if (!ae) {
+		if (p + SLEN(", accept-encoding") > buf + TFW_CACHE_VARY_MAXLEN)
+			return -E2BIG;
+		if (p != buf) {
+			memcpy_fast(p, ", ", 2);
+			p += 2;
+		}
+		memcpy_fast(p, "accept-encoding", SLEN("accept-encoding"));
+		p += SLEN("accept-encoding");
 	}
+
+	return tfw_cache_add_hdr(resp, "vary", SLEN("vary"), buf, p - buf, 59);
 }
 
-static void
-tfw_cache_add(TfwHttpResp *resp, tfw_http_cache_cb_t action)
+/**
+ * Add headers of gzip compressed body of the cache entry @ce. The stored
+ * Content-Length header is skipped, since it's the length of the body before
+ * the compression, as well as the validators which are rewritten.
+ */
+static int
+tfw_cache_set_hdr_gzip(TfwHttpResp *resp, TfwCacheEntry *ce)
 {
-	unsigned long key;
-	bool keep_skb = false;
-	TfwHttpReq *req = resp->req;
+	int r;
 
-	if (!tfw_cache_employ_resp(resp))
-		goto out;
+	if ((r = tfw_cache_set_hdr_clen(resp, ce->body_len))
+	    || (r = tfw_cache_add_hdr(resp, "content-encoding",
+				      SLEN("content-encoding"), "gzip",
+				      SLEN("gzip"), 26))
+	    || (r = tfw_cache_set_hdr_gzip_vld(resp, ce)))
+		goto err;
 
-	key = tfw_http_req_key_calc(req);
+	return 0;
+err:
+	T_WARN("Unable to add Content-Encoding: header, cached response [%p]"
+	       " dropped (err: %d)\n", resp, r);
+	return r;
+}
 
-	if (cache_cfg.cache == TFW_CACHE_SHARD) {
-		BUG_ON(req->node != numa_node_id());
-		__cache_add_node(node_db(), resp, key);
-	} else {
-		int nid;
-		/*
-		 * TODO probably it's better to do this in TDB per-node threads
-		 * rather than in softirq...
-		 */
-		for_each_node_with_cpus(nid)
-			__cache_add_node(c_nodes[nid].db, resp, key);
-	}
+/**
+ * Move @p pointing to a cache entry data forward by @off bytes.
+ */
+static int
+tfw_cache_skip_data(TDB *db, TdbVRec **trec, char **p, unsigned long off)
+{
+	unsigned long n;
 
-	/*
-	 * Cache population is synchronous now. Don't forget to set
-	 * @keep_skb properly in case of asynchronous operation is being
-	 * performed.
-	 */
+	while (off > (n = (*trec)->data + (*trec)->len - *p)) {
+		off -= n;
+		if (!(*trec = tdb_next_rec_chunk(db, *trec)))
+			return -EINVAL;
+		*p = (*trec)->data;
+	}
+	*p += off;
 
-out:
-	resp->msg.ss_flags |= keep_skb ? SS_F_KEEP_SKB : 0;
-	action((TfwHttpMsg *)resp);
+	return 0;
 }
 
 /**
- * Invalidate a cache entry.
- * In fact, this is implemented by making the cache entry stale.
+ * Read the segments of ESI skeleton @ce to the per-CPU buffer.
  */
-static int
-tfw_cache_purge_invalidate(TfwHttpReq *req)
+static TfwCacheEsi *
+tfw_cache_esi_read(TDB *db, TfwCacheEntry *ce)
 {
-	TdbIter iter;
-	TDB *db = node_db();
-	TfwCacheEntry *ce = NULL;
+	TfwCacheEsi *esi = (TfwCacheEsi *)*this_cpu_ptr(&g_esi_buf);
 
-	if (!(ce = tfw_cache_dbce_get(db, &iter, req)))
-		return -ENOENT;
-	ce->lifetime = 0;
+	if (WARN_ON_ONCE(ce->esi_len > TFW_CACHE_ESI_MAXLEN)
+	    || tfw_cache_entry_read(db, ce, ce->esi, (char *)esi, ce->esi_len)
+	    || WARN_ON_ONCE(esi->n > TFW_CACHE_ESI_SEGS))
+		return NULL;
 
-	do {
-		tdb_rec_next(db, &iter);
-		ce = (TfwCacheEntry *)iter.rec;
-		if (ce && tfw_cache_entry_key_eq(db, req, ce))
-			ce->lifetime = 0;
-	} while (ce);
+	return esi;
+}
 
-	tfw_cache_dbce_put(ce);
+/**
+ * Get the fresh cache entry of the fragment included by segment @seg of
+ * ESI skeleton @esi requested by @req. Only full uncompressed 200 responses
+ * without Vary can be included.
+ */
+static TfwCacheEntry *
+tfw_cache_esi_frag_get(TDB *db, TfwHttpReq *req, TfwCacheEsi *esi,
+		       TfwCacheEsiSeg *seg, TdbIter *iter)
+{
+	TfwCacheEntry *fe;
+	TfwStr host, path = { .data = (char *)esi + seg->off, .len = seg->len };
 
-	return 0;
+	tfw_http_msg_clnthdr_val(req, &req->h_tbl->tbl[TFW_HTTP_HDR_HOST],
+				 TFW_HTTP_HDR_HOST, &host);
+
+	*iter = tdb_rec_get(db, seg->key);
+	if (TDB_ITER_BAD(*iter))
+		return NULL;
+	while ((fe = (TfwCacheEntry *)iter->rec)) {
+		if (!(fe->flags & (TFW_CE_SUPERSEDED | TFW_CE_INCOMPLETE
+				   | TFW_CE_GZIP | TFW_CE_SLICED
+				   | TFW_CE_SLICE))
+		    && fe->method == TFW_HTTP_METH_GET
+		    && fe->resp_status == 200
+		    && !fe->vary_len && !fe->esi_len
+		    && tfw_cache_entry_age(fe) < fe->lifetime
+		    && __tfw_cache_entry_key_eq(db, &path, &host, fe))
+			return fe;
+		tdb_rec_next(db, iter);
+	}
+
+	return NULL;
 }
 
 /**
- * Process PURGE request method according to the configuration.
+ * Read the segments of ESI skeleton @ce and set the lengths of the included
+ * fragments, the missing fragments have zero length and are omitted.
+ * @body_len is set to the length of the assembled body.
  */
-static void
-tfw_cache_purge_method(TfwHttpReq *req)
+static TfwCacheEsi *
+tfw_cache_esi_resolve(TDB *db, TfwHttpReq *req, TfwCacheEntry *ce,
+		      unsigned long *body_len)
 {
-	int ret;
-	TfwAddr saddr;
-	TfwGlobal *g_vhost = tfw_vhost_get_global();
+	unsigned int i;
+	TdbIter iter;
+	TfwCacheEntry *fe;
+	TfwCacheEsi *esi;
 
-	/* Deny PURGE requests by default. */
-	if (!(cache_cfg.cache && g_vhost->cache_purge && g_vhost->cache_purge_acl)) {
-		tfw_http_send_resp(req, 403, "purge: not configured");
-		return;
-	}
+	if (!(esi = tfw_cache_esi_read(db, ce)))
+		return NULL;
 
-	/* Accept requests from configured hosts only. */
-	ss_getpeername(req->conn->sk, &saddr);
-	if (!tfw_capuacl_match(&saddr)) {
-		tfw_http_send_resp(req, 403, "purge: ACL violation");
-		return;
-	}
+	*body_len = 0;
+	for (i = 0; i < esi->n; ++i) {
+		TfwCacheEsiSeg *seg = &esi->seg[i];
 
-	/* Only "invalidate" option is implemented at this time. */
-	switch (g_vhost->cache_purge_mode) {
-	case TFW_D_CACHE_PURGE_INVALIDATE:
-		ret = tfw_cache_purge_invalidate(req);
-		break;
-	default:
-		tfw_http_send_resp(req, 403, "purge: invalid option");
-		return;
+		if (!seg->key) {
+			*body_len += seg->len;
+			continue;
+		}
+		seg->body_len = 0;
+		if ((fe = tfw_cache_esi_frag_get(db, req, esi, seg, &iter))) {
+			seg->body_len = fe->body_len;
+			tdb_rec_put(fe);
+		}
+		*body_len += seg->body_len;
 	}
 
-	if (ret)
-		tfw_http_send_resp(req, 404, "purge: processing error");
-	else
-		tfw_http_send_resp(req, 200, "purge: success");
+	return esi;
 }
 
 /**
- * Add page from cache into response.
+ * Build the message body of @body_sz bytes assembled from the literal parts
+ * of ESI skeleton body at @p and the bodies of the fragments resolved by
+ * tfw_cache_esi_resolve(). The fragments bodies are referenced as well as
+ * the skeleton body.
  */
 static int
-tfw_cache_add_body_page(TfwMsgIter *it, char *p, int sz, TfwFrameHdr *frame_hdr,
-			bool h2, bool last_frag)
+tfw_cache_build_resp_esi(TDB *db, TfwHttpReq *req, TfwCacheEsi *esi,
+			 TdbVRec *trec, TfwMsgIter *it, char *p,
+			 unsigned long body_sz, bool h2, unsigned int stream_id)
 {
-	int off;
-	struct page *page;
+	int r;
+	unsigned int i;
+	unsigned long pos = 0;
+	char *fp;
+	TdbIter iter;
+	TdbVRec *ftrec;
+	TfwCacheEntry *fe;
+	TfwCacheFrames fr = {
+		.hdr = { .stream_id = stream_id, .type = HTTP2_DATA },
+		.left = body_sz,
+	};
 
-	/*
-	 * @sz is guarantied to be bigger than FRAME_HEADER_SIZE if frame header
-	 * is stored in cache before data. True for first fragment.
-	 */
-	if (h2) {
-		char *new_p;
-		if (!(page = alloc_page(GFP_ATOMIC))) {
-			return -ENOMEM;
+	if ((r = tfw_http_msg_body_skb(it)))
+		return r;
+
+	for (i = 0; i < esi->n && !r; ++i) {
+		TfwCacheEsiSeg *seg = &esi->seg[i];
+
+		if (!seg->key) {
+			if (!(r = tfw_cache_skip_data(db, &trec, &p,
+						      seg->off - pos)))
+				r = __tfw_cache_build_resp_body(db, trec, it,
+								p, seg->len,
+								h2 ? &fr
+								   : NULL);
+			pos = seg->off;
+			continue;
 		}
-		new_p = page_address(page);
-		off = 0;
-		frame_hdr->flags = last_frag ? HTTP2_F_END_STREAM : 0;
-		frame_hdr->length = sz;
-		memcpy_fast(new_p + FRAME_HEADER_SIZE, p, sz);
-		sz += FRAME_HEADER_SIZE;
-		tfw_h2_pack_frame_header(new_p, frame_hdr);
-	}
-	else {
-		off = ((unsigned long)p & ~PAGE_MASK);
-		page = virt_to_page(p);
+		if (!seg->body_len)
+			continue;
+		/* The fragment may be evicted or replaced since the check. */
+		fe = tfw_cache_esi_frag_get(db, req, esi, seg, &iter);
+		if (!fe || fe->body_len != seg->body_len) {
+			r = -ENOENT;
+		} else {
+			if (!fe->accessed)
+				WRITE_ONCE(fe->accessed, 1);
+			fp = TDB_PTR(db->hdr, fe->body);
+			for (ftrec = &fe->trec;
+			     ftrec && (unsigned long)(fp - ftrec->data)
+				      > ftrec->len;
+			     ftrec = tdb_next_rec_chunk(db, ftrec))
+				;
+			r = ftrec ? __tfw_cache_build_resp_body(db, ftrec, it,
+								fp,
+								seg->body_len,
+								h2 ? &fr
+								   : NULL)
+				  : -EINVAL;
+		}
+		if (fe)
+			tdb_rec_put(fe);
 	}
 
-	skb_fill_page_desc(it->skb, it->frag, page, off, sz);
-	skb_frag_ref(it->skb, it->frag);
-	ss_skb_adjust_data_len(it->skb, sz);
-	++it->frag;
+	if (fr.page)
+		put_page(fr.page);
 
-	return 0;
+	return r;
 }
 
 /**
- * Build the message body as paged fragments of skb.
- * See do_tcp_sendpages() as reference.
- *
- * Different strategies are used to avoid extra data copying depending on
- * client connection type:
- * - for http connections - pages are reused in skbs and SKBTX_SHARED_FRAG is
- * set to avoid any data copies.
- * - for https connections - pages are reused in skbs and SKBTX_SHARED_FRAG is
- * set, but in-place crypto operations are not allowed, so data copy happens
- * right before data is pushed into network.
- * - for h2 connections - every response has unique frame header, so need to
- * copy on constructing response body from cache. SKBTX_SHARED_FRAG is left
- * unset to allow in-place crypto operations.
- *
- * Since we can't encrypt shared data in-place we always copy it, so we need
- * reserve some space in cached pages to avoid extra skb fragmentation. Since
- * body fragments are stored in cache by pages with at least cache record
- * header preceding, which is bigger than h2 frame header, it's always possible
- * to fit body fragment and h2 header into a single page. So there is no need
- * to actually reserve any space for h2 frame header.
+ * Build the message body of @body_sz bytes decompressed from the gzip member
+ * at @p for a client which doesn't accept the compressed body. The body is
+ * decompressed to new pages, which are added to skb as for the cached body.
  */
 static int
-tfw_cache_build_resp_body(TDB *db, TdbVRec *trec, TfwMsgIter *it, char *p,
-			  unsigned long body_sz, bool h2, unsigned int stream_id)
+tfw_cache_build_resp_gunzip(TDB *db, TdbVRec *trec, TfwMsgIter *it, char *p,
+			    unsigned long body_sz, bool h2,
+			    unsigned int stream_id)
 {
-	int r;
+	int r, zr = Z_OK;
+	unsigned int n, fh_off = 0;
+	struct page *page, *fh_page = NULL;
+	z_stream *s = &this_cpu_ptr(&cache_gz)->inf;
 	TfwFrameHdr frame_hdr = {.stream_id = stream_id, .type = HTTP2_DATA};
-	bool sh_frag = h2 ? false : true;
 
-	if (WARN_ON_ONCE(!it->skb_head))
-		return -EINVAL;
-	/*
-	 * If all skbs/frags are used up (see @tfw_http_msg_expand_data()),
-	 * create new skb with empty frags to reference the cached body;
-	 * otherwise, use next empty frag in current skb. Create a new skb, if
-	 * TX flags for headers and body differ.
-	 */
-	if (!it->skb || (++it->frag >= MAX_SKB_FRAGS)
-	    || (sh_frag ^ (skb_shinfo(it->skb)->tx_flags & SKBTX_SHARED_FRAG)))
-	{
-		if  ((r = tfw_msg_iter_append_skb(it)))
-			return r;
-		if (!sh_frag)
-			skb_shinfo(it->skb)->tx_flags &= ~SKBTX_SHARED_FRAG;
-		else
-			skb_shinfo(it->skb)->tx_flags |= SKBTX_SHARED_FRAG;
-	}
-	if (WARN_ON_ONCE(it->frag < 0))
+	if ((r = tfw_http_msg_body_skb(it)))
+		return r;
+	if (!s->workspace || zlib_inflateReset(s) != Z_OK
+	    || tfw_cache_skip_data(db, &trec, &p, TFW_CACHE_GZIP_HDRLEN))
 		return -EINVAL;
+	s->next_in = p;
+	s->avail_in = trec->data + trec->len - p;
 
-	while (1) {
-		int off, f_size;
-
-		off = (unsigned long)p & ~PAGE_MASK;
-		f_size = trec->data + trec->len - p;
-		if (f_size) {
-			f_size = min(body_sz, (unsigned long)f_size);
-			body_sz -= f_size;
-			r = tfw_cache_add_body_page(it, p, f_size, &frame_hdr,
-						    h2, !body_sz);
-			if (r)
-				return r;
+	while (body_sz) {
+		if (!(page = ss_skb_page_alloc())) {
+			r = -ENOMEM;
+			break;
 		}
-		if (!body_sz || !(trec = tdb_next_rec_chunk(db, trec)))
+		n = min_t(unsigned long, body_sz, PAGE_SIZE);
+		s->next_out = page_address(page);
+		s->avail_out = n;
+		while (s->avail_out && zr != Z_STREAM_END) {
+			if (!s->avail_in) {
+				trec = tdb_next_rec_chunk(db, trec);
+				if (!trec || !trec->len)
+					break;
+				s->next_in = trec->data;
+				s->avail_in = trec->len;
+			}
+			zr = zlib_inflate(s, Z_SYNC_FLUSH);
+			if (zr != Z_OK && zr != Z_STREAM_END)
+				break;
+		}
+		/* Broken entry: the body is shorter than it's stored. */
+		if (WARN_ON_ONCE(s->avail_out)) {
+			put_page(page);
+			r = -EINVAL;
 			break;
-		/*
-		 * Broken record: body is not fully copied yet, but there is
-		 * no data in the next record part.
-		 */
-		if (WARN_ON_ONCE(!trec->len))
-			return -EINVAL;
-		p = trec->data;
-
-		if (it->frag == MAX_SKB_FRAGS
-		    && (r = tfw_msg_iter_append_skb(it)))
-		{
-			return r;
 		}
+		body_sz -= n;
+		if (h2) {
+			frame_hdr.flags = body_sz ? 0 : HTTP2_F_END_STREAM;
+			frame_hdr.length = n;
+			r = tfw_http_msg_add_frame_hdr(it, &frame_hdr, &fh_page,
+						    &fh_off);
+		}
+		if (!r)
+			r = tfw_http_msg_add_frag(it, page, 0, n);
+		put_page(page);
+		if (r)
+			break;
 	}
 
-	return 0;
+	if (fh_page)
+		put_page(fh_page);
+
+	return r;
 }
 
+/**
+ * Write the stored HPACK block of the cache entry @ce headers to HTTP/2
+ * response @resp and move @p and @trec to the response body.
+ */
 static int
-tfw_cache_set_hdr_age(TfwHttpResp *resp, TfwCacheEntry *ce)
-{
-	int r;
-	size_t digs;
-	bool to_h2 = TFW_MSG_H2(resp->req);
-	TfwHttpTransIter *mit = &resp->mit;
-	struct sk_buff **skb_head = &resp->msg.skb_head;
-	time_t age = tfw_cache_entry_age(ce);
-	char cstr_age[TFW_ULTOA_BUF_SIZ] = {0};
-	char *name = to_h2 ? "age" : "age" S_DLM;
-	unsigned int nlen = to_h2 ? SLEN("age") : SLEN("age" S_DLM);
-	TfwStr h_age = {
-		.chunks = (TfwStr []){
-			{ .data = name, .len = nlen },
-			{}
-		},
-		.len = nlen,
-		.nchunks = 2
-	};
-
-	if (!(digs = tfw_ultoa(age, cstr_age, TFW_ULTOA_BUF_SIZ))) {
-		r = -E2BIG;
-		goto err;
-	}
-
-	__TFW_STR_CH(&h_age, 1)->data = cstr_age;
-	__TFW_STR_CH(&h_age, 1)->len = digs;
-	h_age.len += digs;
-
-	if (to_h2) {
-		h_age.hpack_idx = 21;
-		if ((r = tfw_hpack_encode(resp, &h_age, TFW_H2_TRANS_EXPAND,
-					  false)))
-			goto err;
-	} else {
-		if ((r = tfw_http_msg_expand_data(&mit->iter, skb_head,
-						  &h_age, NULL)))
-			goto err;
+tfw_cache_build_resp_hpack(TDB *db, TfwHttpResp *resp, TfwCacheEntry *ce,
+			   TdbVRec **trec, char **p, unsigned long *acc_len)
+{
+	int r;
+	TfwDecodeCacheIter dc_iter = {};
 
-		if ((r = tfw_http_msg_expand_data(&mit->iter, skb_head,
-						  &g_crlf, NULL)))
-			goto err;
-	}
+	*p = TDB_PTR(db->hdr, ce->hpack);
+	while (*trec && (unsigned long)(*p - (*trec)->data) > (*trec)->len)
+		*trec = tdb_next_rec_chunk(db, *trec);
+	if (WARN_ON_ONCE(!*trec))
+		return -EINVAL;
 
-	return 0;
+	if ((r = tfw_cache_h2_write(db, trec, resp, p, ce->hpack_len,
+				    &dc_iter)))
+		return r;
+	*acc_len += dc_iter.acc_len;
 
-err:
-	T_WARN("Unable to add Age: header, cached response [%p] dropped"
-	       " (err: %d)\n", resp, r);
-	return r;
+	*p = TDB_PTR(db->hdr, ce->body);
+	while (*trec && (unsigned long)(*p - (*trec)->data) > (*trec)->len)
+		*trec = tdb_next_rec_chunk(db, *trec);
+	if (WARN_ON_ONCE(!*trec))
+		return -EINVAL;
+
+	return 0;
 }
 
 /**
@@ -2034,19 +6255,28 @@ err:
  * However, the pointer must be zeroed on TDB shutdown and recovery.
  *
  * TODO use iterator and passed skbs to be called from net_tx_action.
+ *
+ * If @range isn't NULL, then 206 response with only the requested part of
+ * the body is built. The body fragments reference the cached data, so the
+ * range costs no copying.
+ *
+ * Compressed bodies are sent as they're stored to clients accepting gzip
+ * and are decompressed for all the other clients.
  */
 static TfwHttpResp *
 tfw_cache_build_resp(TfwHttpReq *req, TfwCacheEntry *ce, time_t lifetime,
-		     unsigned int stream_id)
+		     unsigned int stream_id, TfwCacheRange *range)
 {
-	int h;
+	int h, r;
 	TfwStr dummy_body = { 0 };
 	TfwMsgIter *it;
 	TfwHttpResp *resp;
 	char *p;
+	bool gz = false, gunzip = false;
 	TfwHttpTransIter *mit;
+	TfwCacheEsi *esi = NULL;
 	TDB *db = node_db();
-	unsigned long h_len = 0;
+	unsigned long h_len = 0, body_len = ce->body_len;
 	struct sk_buff **skb_head;
 	TdbVRec *trec = &ce->trec;
 	TfwHdrMods *h_mods = tfw_vhost_get_hdr_mods(req->location, req->vhost,
@@ -2063,6 +6293,16 @@ tfw_cache_build_resp(TfwHttpReq *req, TfwCacheEntry *ce, time_t lifetime,
 	resp->version = ce->version;
 	tfw_http_copy_flags(resp->flags, ce->hmflags);
 
+	if (ce->flags & TFW_CE_GZIP) {
+		gz = tfw_cache_accept_gzip(req);
+		gunzip = !gz;
+		if (gunzip)
+			body_len = ce->body_ulen;
+	}
+	if (ce->esi_len
+	    && !(esi = tfw_cache_esi_resolve(db, req, ce, &body_len)))
+		goto free;
+
 	/* Skip record key until status line. */
 	for (p = TDB_PTR(db->hdr, ce->status);
 	     trec && (unsigned long)(p - trec->data) > trec->len;
@@ -2074,17 +6314,38 @@ tfw_cache_build_resp(TfwHttpReq *req, TfwCacheEntry *ce, time_t lifetime,
 		goto free;
 	}
 
-	if (tfw_cache_set_status(db, ce, resp, &trec, &p, &h_len))
+	if (tfw_cache_set_status(db, ce, resp, &trec, &p, &h_len, !!range))
 		goto free;
 
+	if (TFW_MSG_H2(req) && ce->hpack_len && !h_mods && !range && !gz
+	    && !esi)
+	{
+		if (tfw_cache_build_resp_hpack(db, resp, ce, &trec, &p, &h_len))
+			goto free;
+		goto hdrs_done;
+	}
 	for (h = TFW_HTTP_HDR_REGULAR; h < ce->hdr_num; ++h) {
 		bool skip = !TFW_MSG_H2(req) && (h >= ce->hdr_h2_off);
 
+		/*
+		 * Content-Length is rewritten for the body range,
+		 * the compressed body and the assembled ESI body.
+		 */
+		if ((range || gz || esi) && ce->cl_hdr
+		    && p == TDB_PTR(db->hdr, ce->cl_hdr))
+			skip = true;
+		if (gz && tfw_cache_gzip_vld_skip(db, ce, p))
+			skip = true;
+
 		if (tfw_cache_build_resp_hdr(db, resp, h_mods, &trec, &p,
 					     &h_len, skip))
 			goto free;
 	}
-
+	/* The HPACK block of the headers is stored right after them. */
+	if (ce->hpack_len
+	    && tfw_cache_skip_data(db, &trec, &p, ce->hpack_len))
+		goto free;
+hdrs_done:
 	mit = &resp->mit;
 	skb_head = &resp->msg.skb_head;
 	WARN_ON_ONCE(mit->acc_len);
@@ -2103,13 +6364,22 @@ tfw_cache_build_resp(TfwHttpReq *req, TfwCacheEntry *ce, time_t lifetime,
 	 */
 	if (tfw_cache_set_hdr_age(resp, ce))
 		goto free;
+	if (gz && tfw_cache_set_hdr_gzip(resp, ce))
+		goto free;
+	if (esi && tfw_cache_set_hdr_clen(resp, body_len))
+		goto free;
+	if (range) {
+		if (tfw_cache_set_hdr_range(resp, ce, range))
+			goto free;
+		body_len = range->last - range->first + 1;
+	}
 
 	if (!TFW_MSG_H2(req)) {
 		/*
 		 * Set additional headers and final CRLF for HTTP/1.1
 		 * response.
 		 */
-		if (tfw_http_expand_hbh(resp, ce->resp_status)
+		if (tfw_http_expand_hbh(resp, range ? 206 : ce->resp_status)
 		    || tfw_http_expand_hdr_via(resp)
 		    || tfw_http_set_loc_hdrs((TfwHttpMsg *)resp, req, true)
 		    || (lifetime > ce->lifetime
@@ -2129,7 +6399,7 @@ tfw_cache_build_resp(TfwHttpReq *req, TfwCacheEntry *ce, time_t lifetime,
 	    || (lifetime > ce->lifetime
 		&& tfw_h2_set_stale_warn(resp))
 	    || (!test_bit(TFW_HTTP_B_HDR_DATE, resp->flags)
-		&& tfw_h2_add_hdr_date(resp, TFW_H2_TRANS_EXPAND, true)))
+		&& tfw_h2_add_hdr_date(resp, true)))
 		goto free;
 
 	h_len += mit->acc_len;
@@ -2138,7 +6408,7 @@ tfw_cache_build_resp(TfwHttpReq *req, TfwCacheEntry *ce, time_t lifetime,
 	 * Split response to h2 frames. Don't write body with generic function,
 	 * just indicate that we have body for correct framing.
 	 */
-	dummy_body.len = ce->body_len;
+	dummy_body.len = body_len;
 	if (tfw_h2_frame_local_resp(resp, stream_id, h_len, &dummy_body))
 		goto free;
 	it->skb = ss_skb_peek_tail(&it->skb_head);
@@ -2147,9 +6417,33 @@ tfw_cache_build_resp(TfwHttpReq *req, TfwCacheEntry *ce, time_t lifetime,
 write_body:
 	/* Fill skb with body from cache for HTTP/2 or HTTP/1.1 response. */
 	BUG_ON(p != TDB_PTR(db->hdr, ce->body));
-	if (ce->body_len) {
-		if (tfw_cache_build_resp_body(db, trec, it, p, ce->body_len,
-					      TFW_MSG_H2(req), stream_id))
+	if (range && !(ce->flags & TFW_CE_SLICED)
+	    && tfw_cache_skip_data(db, &trec, &p, range->first))
+		goto free;
+	if (body_len) {
+		if (ce->flags & TFW_CE_SLICED)
+			r = tfw_cache_build_resp_slices(db, ce, it,
+							range ? range->first
+							      : 0,
+							body_len,
+							TFW_MSG_H2(req),
+							stream_id);
+		else if (gunzip)
+			r = tfw_cache_build_resp_gunzip(db, trec, it, p,
+							body_len,
+							TFW_MSG_H2(req),
+							stream_id);
+		else if (esi)
+			r = tfw_cache_build_resp_esi(db, req, esi, trec, it, p,
+						     body_len,
+						     TFW_MSG_H2(req),
+						     stream_id);
+		else
+			r = tfw_cache_build_resp_body(db, trec, it, p,
+						      body_len,
+						      TFW_MSG_H2(req),
+						      stream_id);
+		if (r)
 			goto free;
 		if (!TFW_MSG_H2(req)
 		    && test_bit(TFW_HTTP_B_CHUNKED, resp->flags)
@@ -2167,8 +6461,321 @@ out:
 	return NULL;
 }
 
+static char *
+tfw_cache_cpy_str(char *p, const TfwStr *str)
+{
+	const TfwStr *c, *end;
+
+	TFW_STR_FOR_EACH_CHUNK(c, str, end) {
+		memcpy_fast(p, c->data, c->len);
+		p += c->len;
+	}
+
+	return p;
+}
+
+/**
+ * Send a conditional request to revalidate stale cache entry @ce in
+ * background, while the client request @req is serviced with the stale
+ * response, RFC 5861 3. Only one revalidation request per key is sent at
+ * a time, the response to it updates the cache entry.
+ */
+static void
+tfw_cache_revalidate(TfwHttpReq *req, TfwCacheEntry *ce,
+		     tfw_http_cache_cb_t action)
+{
+#define S_REVAL_VER	" " S_VERSION11 S_CRLF "host: "
+#define S_REVAL_INM	S_CRLF "if-none-match: "
+#define S_REVAL_IMS	S_CRLF "if-modified-since: "
+#define S_REVAL_WEAK	"W/"
+
+	char *p, *v, *v_end, *nl;
+	size_t len;
+	TfwStr data, host_val;
+	unsigned long key = tfw_http_req_key_calc(req);
+	bool weak = ce->etag.flags & TFW_STR_ETAG_WEAK;
+
+	if (!tfw_cache_fetch_start(key, action))
+		return;
+
+	/*
+	 * Headers listed in Vary are sent unchanged, so the response selects
+	 * the same representation. The secondary key lines are valid HTTP/1
+	 * header fields.
+	 */
+	v = (*this_cpu_ptr(&g_vary_buf))[0];
+	v_end = v + ce->vary_len;
+	if (ce->vary_len
+	    && (ce->vary_len > TFW_CACHE_VARY_MAXLEN
+		|| tfw_cache_entry_read(node_db(), ce, ce->vary, v,
+					ce->vary_len)))
+		goto err;
+
+	tfw_http_msg_clnthdr_val(req, &req->h_tbl->tbl[TFW_HTTP_HDR_HOST],
+				 TFW_HTTP_HDR_HOST, &host_val);
+
+	len = SLEN("GET ") + req->uri_path.len + SLEN(S_REVAL_VER)
+	      + host_val.len + SLEN(S_CRLF S_CRLF);
+	if (!TFW_STR_EMPTY(&ce->etag))
+		len += SLEN(S_REVAL_INM S_REVAL_WEAK "\"") + ce->etag.len;
+	else if (ce->last_modified)
+		len += SLEN(S_REVAL_IMS S_V_DATE);
+	/* Each line feed is replaced with leading CRLF. */
+	for (nl = v; (nl = memchr(nl, '\n', v_end - nl)); ++nl)
+		++len;
+	len += ce->vary_len;
+
+	if (!(p = tfw_pool_alloc(req->pool, len)))
+		goto err;
+	data.data = p;
+	data.len = len;
+	data.nchunks = 0;
+	data.flags = 0;
+
+	memcpy_fast(p, "GET ", SLEN("GET "));
+	p = tfw_cache_cpy_str(p + SLEN("GET "), &req->uri_path);
+	memcpy_fast(p, S_REVAL_VER, SLEN(S_REVAL_VER));
+	p = tfw_cache_cpy_str(p + SLEN(S_REVAL_VER), &host_val);
+	if (!TFW_STR_EMPTY(&ce->etag)) {
+		memcpy_fast(p, S_REVAL_INM, SLEN(S_REVAL_INM));
+		p += SLEN(S_REVAL_INM);
+		if (weak) {
+			memcpy_fast(p, S_REVAL_WEAK, SLEN(S_REVAL_WEAK));
+			p += SLEN(S_REVAL_WEAK);
+		}
+		/* The stored entity-tag contains the closing DQUOTE only. */
+		*p++ = '"';
+		p = tfw_cache_cpy_str(p, &ce->etag);
+	}
+	else if (ce->last_modified) {
+		memcpy_fast(p, S_REVAL_IMS, SLEN(S_REVAL_IMS));
+		p += SLEN(S_REVAL_IMS);
+		tfw_http_prep_date_from(p, ce->last_modified);
+		p += SLEN(S_V_DATE);
+	}
+	for ( ; v < v_end; v = nl + 1) {
+		nl = memchr(v, '\n', v_end - v);
+		/* Skip headers absent in the original request. */
+		if (nl[-1] == ':')
+			continue;
+		memcpy_fast(p, S_CRLF, SLEN(S_CRLF));
+		memcpy_fast(p + SLEN(S_CRLF), v, nl - v);
+		p += SLEN(S_CRLF) + (nl - v);
+	}
+	memcpy_fast(p, S_CRLF S_CRLF, SLEN(S_CRLF S_CRLF));
+	p += SLEN(S_CRLF S_CRLF);
+	data.len = p - (char *)data.data;
+
+	T_DBG2("Cache: revalidate stale entry in background, key=%lx\n", key);
+
+	if (!tfw_http_req_bg_send(req, &data, 0))
+		return;
+err:
+	T_DBG("Cache: cannot send revalidation request, key=%lx\n", key);
+	tfw_cache_fetch_done(key, false);
+
+#undef S_REVAL_WEAK
+#undef S_REVAL_IMS
+#undef S_REVAL_INM
+#undef S_REVAL_VER
+}
+
+/**
+ * Send a background request for the fragment included by segment @seg of
+ * ESI skeleton @esi requested by @req, unless the fragment is being fetched
+ * already. The response to it is stored in the cache as usual.
+ */
+static void
+tfw_cache_esi_fetch(TfwHttpReq *req, TfwCacheEsi *esi, TfwCacheEsiSeg *seg,
+		    tfw_http_cache_cb_t action)
+{
+#define S_ESI_VER	" " S_VERSION11 S_CRLF "host: "
+
+	char *p;
+	TfwStr data = {}, host_val;
+
+	if (!tfw_cache_fetch_start(seg->key, action))
+		return;
+
+	tfw_http_msg_clnthdr_val(req, &req->h_tbl->tbl[TFW_HTTP_HDR_HOST],
+				 TFW_HTTP_HDR_HOST, &host_val);
+
+	data.len = SLEN("GET ") + seg->len + SLEN(S_ESI_VER) + host_val.len
+		   + SLEN(S_CRLF S_CRLF);
+	if (!(p = tfw_pool_alloc(req->pool, data.len)))
+		goto err;
+	data.data = p;
+
+	memcpy_fast(p, "GET ", SLEN("GET "));
+	memcpy_fast(p + SLEN("GET "), (char *)esi + seg->off, seg->len);
+	p += SLEN("GET ") + seg->len;
+	memcpy_fast(p, S_ESI_VER, SLEN(S_ESI_VER));
+	p = tfw_cache_cpy_str(p + SLEN(S_ESI_VER), &host_val);
+	memcpy_fast(p, S_CRLF S_CRLF, SLEN(S_CRLF S_CRLF));
+
+	T_DBG2("Cache: fetch ESI fragment in background, key=%lx\n", seg->key);
+
+	if (!tfw_http_req_bg_send(req, &data, TFW_HTTP_B_CACHE_ESI))
+		return;
+err:
+	T_DBG("Cache: cannot send ESI fragment request, key=%lx\n", seg->key);
+	tfw_cache_fetch_done(seg->key, false);
+
+#undef S_ESI_VER
+}
+
+/**
+ * Fetch all the fragments of ESI skeleton @ce missing in the cache and queue
+ * @req to a pending fetch of one of them. The fragments are fetched at once,
+ * so the others are likely stored as well when @req is serviced again.
+ * A request waits only once, the fragments still missing after that are
+ * omitted. Return true if @req is queued.
+ */
+static bool
+tfw_cache_esi_wait(TfwHttpReq *req, TfwCacheEntry *ce,
+		   tfw_http_cache_cb_t action)
+{
+	unsigned int i;
+	TdbIter iter;
+	TfwCacheEntry *fe;
+	TfwCacheEsi *esi;
+	TDB *db = node_db();
+	DECLARE_BITMAP(miss, TFW_CACHE_ESI_SEGS) = { 0 };
+
+	if (test_bit(TFW_HTTP_B_ESI_WAITED, req->flags)
+	    || !(esi = tfw_cache_esi_read(db, ce)))
+		return false;
+
+	for (i = 0; i < esi->n; ++i) {
+		TfwCacheEsiSeg *seg = &esi->seg[i];
+
+		if (!seg->key)
+			continue;
+		if ((fe = tfw_cache_esi_frag_get(db, req, esi, seg, &iter))) {
+			tdb_rec_put(fe);
+			continue;
+		}
+		__set_bit(i, miss);
+		tfw_cache_esi_fetch(req, esi, seg, action);
+	}
+
+	/* @req may be serviced on other CPU right after it's queued. */
+	__set_bit(TFW_HTTP_B_ESI_WAITED, req->flags);
+	for_each_set_bit(i, miss, esi->n)
+		if (tfw_cache_fetch_join(req, esi->seg[i].key))
+			return true;
+
+	return false;
+}
+
+static bool
+tfw_cache_vld_etag_match(TfwHttpReq *req, unsigned long etag)
+{
+	TfwStr match_list, iter;
+
+	if (req->cond.flags & TFW_HTTP_COND_ETAG_ANY)
+		return true;
+
+	match_list = req->h_tbl->tbl[TFW_HTTP_HDR_IF_NONE_MATCH];
+	iter = tfw_str_next_str_val(&match_list);
+
+	while (!TFW_STR_EMPTY(&iter)) {
+		if (tfw_cache_etag_hash(&iter) == etag)
+			return true;
+
+		iter = tfw_str_next_str_val(&iter);
+	}
+
+	return false;
+}
+
+/**
+ * Send 304 response to conditional GET or HEAD request @req if the entry
+ * validator matches the request validators and the entry is fresh. The entry
+ * is referenced by the validator, so the TDB bucket isn't scanned. The full
+ * key is still compared since different URIs may share the key hash. Requests
+ * restricting the entry freshness are processed in the usual way.
+ *
+ * Return true if the 304 response is sent.
+ */
+static bool
+tfw_cache_vld_304(TfwHttpReq *req)
+{
+	TdbIter iter;
+	TfwCacheVld *v;
+	TfwCacheEntry *ce;
+	unsigned int seq;
+	unsigned long key, etag;
+	time_t mtime, expires, resp_time;
+	bool match;
+	CaNode *node = &c_nodes[numa_node_id()];
+	TfwStr *inm = &req->h_tbl->tbl[TFW_HTTP_HDR_IF_NONE_MATCH];
+
+	if (!node->vld
+	    || ((req->method != TFW_HTTP_METH_GET)
+		&& (req->method != TFW_HTTP_METH_HEAD))
+	    || (req->cache_ctl.flags & (TFW_HTTP_CC_MAX_AGE
+					| TFW_HTTP_CC_MIN_FRESH
+					| TFW_HTTP_CC_MAX_STALE))
+	    || (TFW_STR_EMPTY(inm) && !req->cond.m_date))
+		return false;
+
+	key = tfw_http_req_key_calc(req);
+	v = tfw_cache_vld_slot(node, key);
+	do {
+		seq = read_seqbegin(&v->lock);
+		match = v->key == key && v->method == req->method;
+		etag = v->etag;
+		mtime = v->mtime;
+		expires = v->expires;
+		resp_time = v->resp_time;
+		ce = v->ce;
+	} while (read_seqretry(&v->lock, seq));
+
+	if (!ce || !match || expires <= tfw_current_timestamp())
+		return false;
+	/* The same precedence as in tfw_handle_validation_req(). */
+	if (!TFW_STR_EMPTY(inm)) {
+		if (!etag || !tfw_cache_vld_etag_match(req, etag))
+			return false;
+	}
+	else if (mtime > req->cond.m_date) {
+		return false;
+	}
+
+	/* Hold the entry, it may be removed concurrently. */
+	iter = tdb_rec_get(node->db, key);
+	while (iter.rec && (TfwCacheEntry *)iter.rec != ce)
+		tdb_rec_next(node->db, &iter);
+	if (TDB_ITER_BAD(iter))
+		return false;
+	if ((ce->flags & (TFW_CE_SUPERSEDED | TFW_CE_INCOMPLETE))
+	    || ce->lifetime <= 0 || ce->resp_time != resp_time
+	    || !tfw_cache_entry_key_eq(node->db, req, ce)
+	    || !tfw_cache_entry_vary_eq(node->db, req, ce))
+	{
+		tdb_rec_put(ce);
+		return false;
+	}
+
+	TFW_INC_STAT_BH(cache.hits);
+	tfw_cache_acct_stat(req, true);
+	if (!ce->accessed)
+		WRITE_ONCE(ce->accessed, 1);
+	tfw_cache_send_304(req, ce);
+	tdb_rec_put(ce);
+
+	return true;
+}
+
+/**
+ * Service @req from the cache or pass it to @action for forwarding. If
+ * @collapse is true and the cached entry is missing or stale, then @req may
+ * be queued for a response to an identical request already sent to a backend.
+ */
 static void
-cache_req_process_node(TfwHttpReq *req, tfw_http_cache_cb_t action)
+cache_req_process_node(TfwHttpReq *req, tfw_http_cache_cb_t action,
+		       bool collapse)
 {
 	TfwCacheEntry *ce = NULL;
 	TfwHttpResp *resp = NULL;
@@ -2176,12 +6783,31 @@ cache_req_process_node(TfwHttpReq *req, tfw_http_cache_cb_t action)
 	TDB *db = node_db();
 	TdbIter iter;
 	time_t lifetime;
+	bool reval, partial;
+	TfwCacheRange range;
 
-	if (!(ce = tfw_cache_dbce_get(db, &iter, req)))
-		goto out;
+	if (tfw_cache_vld_304(req))
+		return;
+	/*
+	 * Only client lookups are accounted as misses, PURGE and background
+	 * freshening look entries up on their own.
+	 */
+	if (!(ce = tfw_cache_dbce_get(db, &iter, req))) {
+		TFW_INC_STAT_BH(cache.misses);
+		tfw_cache_acct_stat(req, false);
+		goto miss;
+	}
 
-	if (!(lifetime = tfw_cache_entry_is_live(req, ce)))
-		goto out;
+	if (!(lifetime = tfw_cache_entry_is_live(req, ce, &reval))) {
+		/*
+		 * Drop the entry which can't be served even while it's
+		 * revalidated, e.g. one expired during Tempesta FW restart.
+		 * It's skipped by the next lookups and evicted first.
+		 */
+		if (tfw_cache_entry_age(ce) >= ce->lifetime + ce->stale_reval)
+			ce->flags |= TFW_CE_SUPERSEDED;
+		goto miss;
+	}
 
 	T_DBG("Cache: service request w/ key=%lx, ce=%p (len=%u key_len=%u"
 	      " status_len=%u hdr_num=%u hdr_len=%u key_off=%ld"
@@ -2190,10 +6816,23 @@ cache_req_process_node(TfwHttpReq *req, tfw_http_cache_cb_t action)
 		ce->hdr_num, ce->hdr_len, ce->key, ce->status, ce->hdrs,
 		ce->body);
 	TFW_INC_STAT_BH(cache.hits);
+	tfw_cache_acct_stat(req, true);
+	/* Give the entry the second chance on eviction. */
+	if (!ce->accessed)
+		WRITE_ONCE(ce->accessed, 1);
 
 	if (!tfw_handle_validation_req(req, ce))
 		goto put;
 
+	partial = tfw_cache_req_range(req, ce, &range);
+	/* Forward the request if a slice of the requested body isn't stored. */
+	if ((ce->flags & TFW_CE_SLICED)
+	    && !tfw_cache_slices_ready(db, ce, partial ? &range : NULL))
+		goto miss;
+	/* Wait for the ESI fragments which aren't stored yet. */
+	if (ce->esi_len && tfw_cache_esi_wait(req, ce, action))
+		goto put;
+
 	/*
 	 * If the stream for HTTP/2-request is already closed (due to some
 	 * error or just reset from the client side), there is no sense to
@@ -2207,7 +6846,8 @@ cache_req_process_node(TfwHttpReq *req, tfw_http_cache_cb_t action)
 		}
 	}
 
-	resp = tfw_cache_build_resp(req, ce, lifetime, id);
+	resp = tfw_cache_build_resp(req, ce, lifetime, id,
+				    partial ? &range : NULL);
 	/*
 	 * The stream of HTTP/2-request should be closed here since we have
 	 * successfully created the resulting response from cache and will
@@ -2223,6 +6863,28 @@ cache_req_process_node(TfwHttpReq *req, tfw_http_cache_cb_t action)
 			goto put;
 		}
 	}
+	if (resp && reval)
+		tfw_cache_revalidate(req, ce, action);
+	goto out;
+miss:
+	tfw_cache_freq_inc(req);
+	/* Wait for the entry to be read if it's demoted to the disk tier. */
+	if (tfw_cache_disk_enabled()) {
+		unsigned long key = tfw_http_req_key_calc(req);
+
+		if (tfw_cache_disk_lookup(key)
+		    && tfw_cache_fetch_disk(req, key, action))
+			goto put;
+	}
+	/*
+	 * Only one request per cache key goes to a backend, all the others
+	 * wait for the response to be stored in the cache.
+	 */
+	if (collapse && cache_cfg.collapse_tmt
+	    && req->method == TFW_HTTP_METH_GET
+	    && !(req->cache_ctl.flags & TFW_HTTP_CC_OIFCACHED)
+	    && tfw_cache_fetch_wait(req, action))
+		goto put;
 out:
 	if (!resp && (req->cache_ctl.flags & TFW_HTTP_CC_OIFCACHED))
 		tfw_http_send_resp(req, 504, "resource not cached");
@@ -2237,6 +6899,63 @@ put:
 	tfw_cache_dbce_put(ce);
 }
 
+/**
+ * Build the response pushed on HTTP/2 stream @stream_id along with the
+ * response to @req (RFC 7540 section 8.2): the fresh full 200 response to
+ * GET of @path on the host of @req, stored by the local node, with the body
+ * fitting @budget bytes. @budget is decreased by the body length. Responses
+ * with Vary or ESI aren't pushed, since the promised request carries no
+ * client headers. The response is paired with @req, NULL is returned on
+ * a cache miss.
+ */
+TfwHttpResp *
+tfw_cache_push(TfwHttpReq *req, TfwStr *path, unsigned int stream_id,
+	       unsigned long *budget)
+{
+	TfwCacheEntry *ce;
+	TfwHttpResp *resp;
+	TdbIter iter;
+	TfwStr host;
+	TDB *db = node_db();
+	unsigned long key = tfw_hash_str(path);
+
+	if (!cache_cfg.cache || cache_cfg.key.on)
+		return NULL;
+
+	tfw_http_msg_clnthdr_val(req, &req->h_tbl->tbl[TFW_HTTP_HDR_HOST],
+				 TFW_HTTP_HDR_HOST, &host);
+	if (!TFW_STR_EMPTY(&host))
+		key ^= tfw_hash_str(&host);
+
+	iter = tdb_rec_get(db, key);
+	if (TDB_ITER_BAD(iter))
+		return NULL;
+	while ((ce = (TfwCacheEntry *)iter.rec)) {
+		if (!(ce->flags & (TFW_CE_SUPERSEDED | TFW_CE_INCOMPLETE
+				   | TFW_CE_SLICED | TFW_CE_SLICE))
+		    && ce->method == TFW_HTTP_METH_GET
+		    && ce->resp_status == 200
+		    && !ce->vary_len && !ce->esi_len
+		    && ce->body_len <= *budget
+		    && tfw_cache_entry_age(ce) < ce->lifetime
+		    && __tfw_cache_entry_key_eq(db, path, &host, ce))
+			break;
+		tdb_rec_next(db, &iter);
+	}
+	if (!ce)
+		return NULL;
+
+	T_DBG("Cache: push w/ key=%lx, ce=%p, stream_id=%u\n", key, ce,
+	      stream_id);
+	TFW_INC_STAT_BH(cache.hits);
+	resp = tfw_cache_build_resp(req, ce, ce->lifetime, stream_id, NULL);
+	if (resp)
+		*budget -= ce->body_len;
+	tdb_rec_put(ce);
+
+	return resp;
+}
+
 static void
 tfw_cache_do_action(TfwHttpMsg *msg, tfw_http_cache_cb_t action)
 {
@@ -2251,7 +6970,7 @@ tfw_cache_do_action(TfwHttpMsg *msg, tfw_http_cache_cb_t action)
 	if (unlikely(req->method == TFW_HTTP_METH_PURGE))
 		tfw_cache_purge_method(req);
 	else
-		cache_req_process_node(req, action);
+		cache_req_process_node(req, action, true);
 }
 
 static void
@@ -2259,6 +6978,7 @@ tfw_cache_ipi(struct irq_work *work)
 {
 	TfwWorkTasklet *ct = container_of(work, TfwWorkTasklet, ipi_work);
 	clear_bit(TFW_QUEUE_IPI, &ct->wq.flags);
+	TFW_INC_STAT_BH(cache.wq_ipis);
 	tasklet_schedule(&ct->tasklet);
 }
 
@@ -2292,7 +7012,10 @@ do_cache:
 
 	/*
 	 * Queue the cache work only when it must be served by a remote node.
-	 * Otherwise we can do everything right now on local CPU.
+	 * Otherwise we can do everything right now on local CPU: the lookup
+	 * and the response building run in the current softirq without any
+	 * queue round trip or IPI. That's always the case for the replicated
+	 * cache, and for the sharded cache if the key belongs to the node.
 	 *
 	 * TODO #391: it appears that req->node is not really needed and can
 	 * be eliminated from TfwHttpReq{} structure and it can easily be
@@ -2305,13 +7028,13 @@ do_cache:
 
 	cw.msg = msg;
 	cw.action = action;
-	cpu = tfw_cache_sched_cpu(req);
+	cpu = tfw_cache_sched_cpu(req->node);
 	ct = per_cpu_ptr(&cache_wq, cpu);
 
 	T_DBG2("Cache: schedule tasklet w/ work: to_cpu=%d from_cpu=%d"
 	       " msg=%p key=%lx\n", cpu, smp_processor_id(),
 	       cw.msg, key);
-	if (tfw_wq_push(&ct->wq, &cw, cpu, &ct->ipi_work, tfw_cache_ipi)) {
+	if (tfw_nq_push(&ct->wq, &cw, cpu, &ct->ipi_work, tfw_cache_ipi)) {
 		T_WARN("Cache work queue overrun: [%s]\n",
 		       resp ? "response" : "request");
 		return -EBUSY;
@@ -2323,17 +7046,34 @@ dont_cache:
 	return 0;
 }
 
+/* Number of cache works popped from the queue at once. */
+#define TFW_CACHE_WQ_BATCH	16
+
 static void
 tfw_wq_tasklet(unsigned long data)
 {
 	TfwWorkTasklet *ct = (TfwWorkTasklet *)data;
-	TfwRBQueue *wq = &ct->wq;
-	TfwCWork cw;
-
-	while (!tfw_wq_pop(wq, &cw))
-		tfw_cache_do_action(cw.msg, cw.action);
+	TfwNodeQueue *wq = &ct->wq;
+	TfwCWork cw[TFW_CACHE_WQ_BATCH];
+	unsigned int i, b, n = 0;
+
+	while ((b = tfw_nq_pop_batch(wq, cw, TFW_CACHE_WQ_BATCH))) {
+		for (i = 0; i < b; ++i) {
+			if (likely(cw[i].msg))
+				tfw_cache_do_action(cw[i].msg, cw[i].action);
+			else if (cw[i].promote)
+				tfw_cache_promote(&cw[i]);
+			else
+				tfw_cache_replica_add(&cw[i]);
+		}
+		n += b;
+	}
+	if (n) {
+		TFW_INC_STAT_BH(cache.wq_batches);
+		TFW_ADD_STAT_BH(n, cache.wq_works);
+	}
 
-	TFW_WQ_IPI_SYNC(tfw_wq_size, wq);
+	TFW_WQ_IPI_SYNC(tfw_nq_size, wq);
 
 	tasklet_schedule(&ct->tasklet);
 }
@@ -2342,28 +7082,121 @@ tfw_wq_tasklet(unsigned long data)
  * Cache management thread.
  * The thread loads and preprocesses static Web content using inotify (TODO).
  */
-#if 0
+#if 0
+static int
+tfw_cache_mgr(void *arg)
+{
+	do {
+		/*
+		 * TODO wait while the thread is propagating disk Web data
+		 * to the cache when the server starts.
+		 */
+
+		if (!freezing(current)) {
+			set_current_state(TASK_INTERRUPTIBLE);
+			schedule();
+			__set_current_state(TASK_RUNNING);
+		}
+		else
+			try_to_freeze();
+	} while (!kthread_should_stop());
+
+	return 0;
+}
+#endif
+
+static void
+tfw_cache_node_free(CaNode *node)
+{
+	vfree(node->vld);
+	node->vld = NULL;
+	vfree(node->cms);
+	node->cms = NULL;
+}
+
+/**
+ * Allocate the in-memory tables of @node: the entry validators and the
+ * admission filter if it's configured.
+ */
+static int
+tfw_cache_node_alloc(CaNode *node, int nid)
+{
+	int i;
+
+	node->vld = vzalloc_node(sizeof(TfwCacheVld) << TFW_CACHE_VLD_BITS,
+				 nid);
+	if (!node->vld)
+		return -ENOMEM;
+	for (i = 0; i < (1 << TFW_CACHE_VLD_BITS); ++i)
+		seqlock_init(&node->vld[i].lock);
+
+	if (cache_cfg.admit_hits > 1) {
+		node->cms = vzalloc_node(sizeof(TfwCacheCms), nid);
+		if (!node->cms) {
+			tfw_cache_node_free(node);
+			return -ENOMEM;
+		}
+		node->cms->window = tfw_current_timestamp();
+	}
+
+	return 0;
+}
+
+static void
+tfw_cache_gzip_free(void)
+{
+	int cpu;
+
+	for_each_online_cpu(cpu) {
+		TfwCacheGzip *g = per_cpu_ptr(&cache_gz, cpu);
+
+		vfree(g->def.workspace);
+		vfree(g->inf.workspace);
+		vfree(g->buf);
+		memset(g, 0, sizeof(*g));
+	}
+}
+
+/**
+ * Allocate the per-CPU compression state. The decompression state is always
+ * allocated, since the cache may have entries compressed before a restart
+ * with other configuration.
+ */
 static int
-tfw_cache_mgr(void *arg)
+tfw_cache_gzip_alloc(void)
 {
-	do {
-		/*
-		 * TODO wait while the thread is propagating disk Web data
-		 * to the cache when the server starts.
-		 */
+	int cpu, nid;
+	TfwCacheGzip *g;
 
-		if (!freezing(current)) {
-			set_current_state(TASK_INTERRUPTIBLE);
-			schedule();
-			__set_current_state(TASK_RUNNING);
-		}
-		else
-			try_to_freeze();
-	} while (!kthread_should_stop());
+	for_each_online_cpu(cpu) {
+		g = per_cpu_ptr(&cache_gz, cpu);
+		nid = cpu_to_node(cpu);
+
+		g->inf.workspace = vmalloc_node(zlib_inflate_workspacesize(),
+						nid);
+		if (!g->inf.workspace
+		    || zlib_inflateInit2(&g->inf, -MAX_WBITS) != Z_OK)
+			goto err;
+		if (!cache_cfg.compress)
+			continue;
+
+		g->def.workspace = vzalloc_node(
+			zlib_deflate_workspacesize(MAX_WBITS, MAX_MEM_LEVEL),
+			nid);
+		g->buf = vmalloc_node(TFW_CACHE_GZIP_MAXLEN, nid);
+		if (!g->def.workspace || !g->buf
+		    || zlib_deflateInit2(&g->def, Z_BEST_SPEED, Z_DEFLATED,
+					 -MAX_WBITS, MAX_MEM_LEVEL,
+					 Z_DEFAULT_STRATEGY) != Z_OK)
+			goto err;
+	}
 
 	return 0;
+err:
+	T_ERR_NL("Cannot allocate cache compression state\n");
+	tfw_cache_gzip_free();
+	return -ENOMEM;
 }
-#endif
 
 static int
 tfw_cache_start(void)
@@ -2371,6 +7204,7 @@ tfw_cache_start(void)
 	int i, r = 1;
 	TfwGlobal *g_vhost = tfw_vhost_get_global();
 
+	tfw_http_parse_need(TFW_HTTP_PARSE_CACHE, cache_cfg.cache);
 	if (tfw_runstate_is_reconfig())
 		return 0;
 	if (!(cache_cfg.cache || g_vhost->cache_purge))
@@ -2381,7 +7215,21 @@ tfw_cache_start(void)
 					 cache_cfg.db_size, 0, i);
 		if (!c_nodes[i].db)
 			goto close_db;
+		if (cache_cfg.tag_hdr_len) {
+			c_nodes[i].tag_db = tdb_open(cache_cfg.tag_db_path,
+						     cache_cfg.tag_db_size,
+						     sizeof(TfwCacheTag), i);
+			if (!c_nodes[i].tag_db)
+				goto close_db;
+		}
+		if (cache_cfg.cache) {
+			r = tfw_cache_node_alloc(&c_nodes[i], i);
+			if (r || (r = tfw_cache_lru_load(&c_nodes[i])))
+				goto close_db;
+		}
 	}
+	if (cache_cfg.cache && (r = tfw_cache_gzip_alloc()))
+		goto close_db;
 #if 0
 	cache_mgr_thr = kthread_run(tfw_cache_mgr, NULL, "tfw_cache_mgr");
 	if (IS_ERR(cache_mgr_thr)) {
@@ -2395,15 +7243,32 @@ tfw_cache_start(void)
 	TFW_WQ_CHECKSZ(TfwCWork);
 	for_each_online_cpu(i) {
 		TfwWorkTasklet *ct = &per_cpu(cache_wq, i);
-		tfw_wq_init(&ct->wq, cpu_to_node(i));
+		if ((r = tfw_nq_init(&ct->wq, cpu_to_node(i))))
+			goto close_wq;
 		init_irq_work(&ct->ipi_work, tfw_cache_ipi);
 		tasklet_init(&ct->tasklet, tfw_wq_tasklet, (unsigned long)ct);
 	}
+	if (cache_cfg.cache && cache_cfg.disk_size) {
+		r = tfw_cache_disk_open(cache_cfg.disk_path,
+					(unsigned long)cache_cfg.disk_size << 20,
+					tfw_cache_disk_done);
+		if (r)
+			goto close_wq;
+	}
 
 	return 0;
+close_wq:
+	for_each_online_cpu(i)
+		tfw_nq_destroy(&per_cpu(cache_wq, i).wq);
 close_db:
-	for_each_node_with_cpus(i)
+	tfw_cache_gzip_free();
+	for_each_node_with_cpus(i) {
+		tfw_cache_lru_free(&c_nodes[i]);
+		tfw_cache_node_free(&c_nodes[i]);
+		tdb_close(c_nodes[i].tag_db);
+		c_nodes[i].tag_db = NULL;
 		tdb_close(c_nodes[i].db);
+	}
 	return r;
 }
 
@@ -2417,19 +7282,296 @@ tfw_cache_stop(void)
 	if (!cache_cfg.cache)
 		return;
 
+	/* Complete the disk reads while the cache works are processed. */
+	tfw_cache_disk_close();
 	for_each_online_cpu(i) {
 		TfwWorkTasklet *ct = &per_cpu(cache_wq, i);
 		tasklet_kill(&ct->tasklet);
 		irq_work_sync(&ct->ipi_work);
-		tfw_wq_destroy(&ct->wq);
+		tfw_nq_destroy(&ct->wq);
 	}
+	tfw_cache_fetch_flush();
 #if 0
 	kthread_stop(cache_mgr_thr);
 #endif
+	tfw_cache_gzip_free();
 
-	for_each_node_with_cpus(i)
+	for_each_node_with_cpus(i) {
+		tfw_cache_lru_free(&c_nodes[i]);
+		tfw_cache_node_free(&c_nodes[i]);
+		tdb_close(c_nodes[i].tag_db);
+		c_nodes[i].tag_db = NULL;
 		tdb_close(c_nodes[i].db);
+	}
+}
+
+#ifdef TFW_CACHE_BENCH
+/*
+ * ------------------------------------------------------------------------
+ *	Cache hit path microbenchmarks
+ * ------------------------------------------------------------------------
+ *
+ * The benchmark populates the local node cache with synthetic entries and
+ * measures the hit path functions directly, without sockets and without
+ * the rest of HTTP processing. The driver is t/cache_bench.c.
+ */
+#define TFW_CACHE_BENCH_REQ	"GET /tfw-bench/%010u HTTP/1.1\r\n"	\
+				"Host: tfw-bench\r\n"			\
+				"\r\n"
+#define TFW_CACHE_BENCH_RESP	"HTTP/1.1 200 OK\r\n"			\
+				"Date: %.*s\r\n"			\
+				"Cache-Control: max-age=86400\r\n"	\
+				"ETag: \"%010u\"\r\n"			\
+				"Content-Length: %u\r\n"		\
+				"\r\n"
+/* Offset of the key digits in the request line. */
+#define TFW_CACHE_BENCH_KOFF	SLEN("GET /tfw-bench/")
+#define TFW_CACHE_BENCH_KLEN	10
+/* Number of operations done with disabled softirqs. */
+#define TFW_CACHE_BENCH_BATCH	256
+
+typedef struct {
+	TfwConn		conn_req;
+	TfwConn		conn_resp;
+	unsigned int	req_len;
+	unsigned int	resp_len;
+	char		req[SLEN(TFW_CACHE_BENCH_REQ) + 16];
+	char		resp[0];
+} TfwCacheBench;
+
+static TfwCacheBench *
+tfw_cache_bench_alloc(unsigned int body_len)
+{
+	TfwCacheBench *b;
+
+	b = kmalloc(sizeof(*b) + SLEN(TFW_CACHE_BENCH_RESP) + SLEN(S_V_DATE)
+		    + 32 + body_len, GFP_KERNEL);
+	if (!b)
+		return NULL;
+	memset(b, 0, sizeof(*b));
+
+	return b;
+}
+
+static TfwHttpMsg *
+tfw_cache_bench_parse(TfwConn *conn, int type, char *data, size_t len)
+{
+	int r;
+	TfwMsgIter it;
+	TfwHttpMsg *hm;
+	unsigned int parsed;
+
+	if (!(hm = __tfw_http_msg_alloc(type, true)))
+		return NULL;
+	if (tfw_http_msg_setup(hm, &it, len, 0))
+		goto err;
+
+	memset(conn, 0, sizeof(*conn));
+	tfw_connection_init(conn);
+	conn->proto.type = type;
+	hm->conn = conn;
+	hm->stream = &conn->stream;
+
+	if (type == Conn_HttpClnt) {
+		tfw_http_init_parser_req((TfwHttpReq *)hm);
+		r = tfw_http_parse_req(hm, data, len, &parsed);
+	} else {
+		tfw_http_init_parser_resp((TfwHttpResp *)hm);
+		r = tfw_http_parse_resp(hm, data, len, &parsed);
+	}
+	if (r != TFW_PASS || parsed != len) {
+		T_WARN("Cache bench: cannot parse %.*s\n", (int)len, data);
+		goto err;
+	}
+	hm->cache_ctl.timestamp = tfw_current_timestamp();
+
+	return hm;
+err:
+	tfw_http_msg_free(hm);
+	return NULL;
+}
+
+/**
+ * Make the parsed bench request @req to address key @key. The key digits are
+ * rewritten in place, so the parsed URI still points to the right data.
+ */
+static void
+tfw_cache_bench_key(TfwCacheBench *b, TfwHttpReq *req, unsigned int key)
+{
+	char digits[TFW_CACHE_BENCH_KLEN + 1];
+
+	snprintf(digits, sizeof(digits), "%010u", key);
+	memcpy(b->req + TFW_CACHE_BENCH_KOFF, digits, TFW_CACHE_BENCH_KLEN);
+	req->hash = 0;
+	req->key_path = NULL;
+}
+
+static TfwHttpReq *
+tfw_cache_bench_req(TfwCacheBench *b, unsigned int key)
+{
+	b->req_len = snprintf(b->req, sizeof(b->req), TFW_CACHE_BENCH_REQ, key);
+
+	return (TfwHttpReq *)tfw_cache_bench_parse(&b->conn_req, Conn_HttpClnt,
+						   b->req, b->req_len);
+}
+
+static TfwHttpResp *
+tfw_cache_bench_resp(TfwCacheBench *b, TfwHttpReq *req, unsigned int key,
+		     unsigned int body_len)
+{
+	TfwHttpResp *resp;
+	char date[SLEN(S_V_DATE)];
+
+	tfw_http_prep_date_from(date, tfw_current_timestamp());
+	b->resp_len = sprintf(b->resp, TFW_CACHE_BENCH_RESP,
+			      (int)sizeof(date), date, key, body_len);
+	memset(b->resp + b->resp_len, 'x', body_len);
+	b->resp_len += body_len;
+
+	resp = (TfwHttpResp *)tfw_cache_bench_parse(&b->conn_resp,
+						    Conn_HttpSrv, b->resp,
+						    b->resp_len);
+	if (resp)
+		tfw_http_msg_pair(resp, req);
+
+	return resp;
+}
+
+/**
+ * Store @n entries with keys [0, @n) and bodies of @body_len bytes to the
+ * cache of the current NUMA node. Must be called from process context.
+ */
+int
+tfw_cache_bench_fill(unsigned int n, unsigned int body_len)
+{
+	int r = 0, nid = numa_node_id();
+	unsigned int i;
+	TfwStr vary;
+	TfwCacheBench *b;
+	TfwHttpReq *req;
+	TfwHttpResp *resp;
+
+	if (!cache_cfg.cache || !node_db())
+		return -ENOENT;
+	if (!(b = tfw_cache_bench_alloc(body_len)))
+		return -ENOMEM;
+
+	for (i = 0; i < n && !r; ++i) {
+		if (!(req = tfw_cache_bench_req(b, i))) {
+			r = -EINVAL;
+			break;
+		}
+		if (!(resp = tfw_cache_bench_resp(b, req, i, body_len))) {
+			tfw_http_msg_free((TfwHttpMsg *)req);
+			r = -EINVAL;
+			break;
+		}
+
+		local_bh_disable();
+		if (tfw_cache_vary_key(resp, &vary)
+		    || !__cache_add_node(nid, resp, tfw_http_req_key_calc(req),
+					 &vary))
+			r = -ENOMEM;
+		local_bh_enable();
+
+		tfw_http_msg_free((TfwHttpMsg *)resp);
+		tfw_http_msg_free((TfwHttpMsg *)req);
+		cond_resched();
+	}
+	kfree(b);
+
+	return r;
+}
+EXPORT_SYMBOL(tfw_cache_bench_fill);
+
+static cycles_t
+tfw_cache_bench_op(int op, TDB *db, TfwHttpReq *req, unsigned int *misses)
+{
+	TdbIter iter;
+	cycles_t t;
+	bool reval;
+	TfwCacheEntry *ce;
+	TfwHttpResp *resp;
+	unsigned int stream_id = 0;
+	unsigned long h_len = 0;
+
+	if (op == TFW_CACHE_BENCH_GET) {
+		t = get_cycles();
+		ce = tfw_cache_dbce_get(db, &iter, req);
+		t = get_cycles() - t;
+		if (!ce)
+			++*misses;
+		tfw_cache_dbce_put(ce);
+		return t;
+	}
+
+	if (!(ce = tfw_cache_dbce_get(db, &iter, req))) {
+		++*misses;
+		return 0;
+	}
+	t = get_cycles();
+	if (op == TFW_CACHE_BENCH_BUILD)
+		resp = tfw_cache_build_resp(req, ce,
+					    tfw_cache_entry_is_live(req, ce,
+								    &reval),
+					    0, NULL);
+	else
+		resp = tfw_cache_build_304(req, ce, &stream_id, &h_len);
+	t = get_cycles() - t;
+	tfw_cache_dbce_put(ce);
+
+	if (!resp)
+		++*misses;
+	tfw_http_msg_free((TfwHttpMsg *)resp);
+
+	return t;
+}
+
+/**
+ * Run the operation @op for each of @n keys from @keys against the cache of
+ * the current NUMA node. The spent CPU cycles are returned in @cycles and
+ * the number of failed operations, e.g. cache misses, in @misses. Must be
+ * called from process context.
+ */
+int
+tfw_cache_bench_run(int op, const unsigned int *keys, unsigned int n,
+		    unsigned long *cycles, unsigned int *misses)
+{
+	unsigned int i, end;
+	TfwCacheBench *b;
+	TfwHttpReq *req;
+	TDB *db = node_db();
+
+	if (op < 0 || op >= TFW_CACHE_BENCH_OPS)
+		return -EINVAL;
+	if (!cache_cfg.cache || !db)
+		return -ENOENT;
+	if (!(b = tfw_cache_bench_alloc(0)))
+		return -ENOMEM;
+	if (!(req = tfw_cache_bench_req(b, 0))) {
+		kfree(b);
+		return -EINVAL;
+	}
+
+	*cycles = 0;
+	*misses = 0;
+	for (i = 0; i < n; ) {
+		local_bh_disable();
+		for (end = min(i + TFW_CACHE_BENCH_BATCH, n); i < end; ++i) {
+			tfw_cache_bench_key(b, req, keys[i]);
+			*cycles += tfw_cache_bench_op(op, db, req, misses);
+		}
+		local_bh_enable();
+		cond_resched();
+	}
+
+	tfw_http_msg_free((TfwHttpMsg *)req);
+	kfree(b);
+
+	return 0;
 }
+EXPORT_SYMBOL(tfw_cache_bench_run);
+#endif /* TFW_CACHE_BENCH */
 
 static const TfwCfgEnum cache_http_methods_enum[] = {
 	{ "copy",	TFW_HTTP_METH_COPY },
@@ -2489,6 +7631,115 @@ tfw_cfgop_cleanup_cache_methods(TfwCfgSpec *cs)
 	cache_cfg.methods = 0;
 }
 
+static int
+tfw_cfgop_cache_collapse_timeout(TfwCfgSpec *cs, TfwCfgEntry *ce)
+{
+	unsigned int msecs;
+	int r;
+
+	cs->dest = &msecs;
+	r = tfw_cfg_set_int(cs, ce);
+	cs->dest = NULL;
+	if (!r)
+		cache_cfg.collapse_tmt = msecs_to_jiffies(msecs);
+
+	return r;
+}
+
+static int
+tfw_cfgop_cache_tag_header(TfwCfgSpec *cs, TfwCfgEntry *ce)
+{
+	size_t len;
+
+	if (tfw_cfg_check_single_val(ce))
+		return -EINVAL;
+	len = strlen(ce->vals[0]);
+	if (len >= sizeof(cache_cfg.tag_hdr)) {
+		T_ERR_NL("%s: too long header name: '%s'\n", cs->name,
+			 ce->vals[0]);
+		return -EINVAL;
+	}
+	/* Header names are matched in lower case with the colon. */
+	tfw_cstrtolower(cache_cfg.tag_hdr, ce->vals[0], len);
+	cache_cfg.tag_hdr[len] = ':';
+	cache_cfg.tag_hdr_len = len + 1;
+
+	return 0;
+}
+
+static void
+tfw_cfgop_cleanup_cache_tag_header(TfwCfgSpec *cs)
+{
+	cache_cfg.tag_hdr_len = 0;
+}
+
+static int
+tfw_cfgop_cache_key(TfwCfgSpec *cs, TfwCfgEntry *ce)
+{
+	int i;
+	const char *key, *val;
+
+	TFW_CFG_ENTRY_FOR_EACH_VAL(ce, i, val) {
+		if (!strcasecmp(val, "sort_args")) {
+			cache_cfg.key.sort_args = true;
+		} else if (!strcasecmp(val, "lowercase")) {
+			cache_cfg.key.lowercase = true;
+		} else {
+			T_ERR_NL("%s: unsupported argument: '%s'\n", cs->name,
+				 val);
+			return -EINVAL;
+		}
+	}
+	TFW_CFG_ENTRY_FOR_EACH_ATTR(ce, i, key, val) {
+		char **params, *p;
+		unsigned int *n;
+
+		if (!strcasecmp(key, "drop_arg")) {
+			params = cache_cfg.key.drop;
+			n = &cache_cfg.key.drop_n;
+		} else if (!strcasecmp(key, "header")) {
+			params = cache_cfg.key.hdr;
+			n = &cache_cfg.key.hdr_n;
+		} else if (!strcasecmp(key, "cookie")) {
+			params = cache_cfg.key.cookie;
+			n = &cache_cfg.key.cookie_n;
+		} else {
+			T_ERR_NL("%s: unsupported attribute: '%s=%s'\n",
+				 cs->name, key, val);
+			return -EINVAL;
+		}
+		if (*n == TFW_CACHE_KEY_PARAMS_MAX) {
+			T_ERR_NL("%s: too many '%s' attributes, %u at most\n",
+				 cs->name, key, TFW_CACHE_KEY_PARAMS_MAX);
+			return -EINVAL;
+		}
+		if (!(params[*n] = kstrdup(val, GFP_KERNEL)))
+			return -ENOMEM;
+		/* Header names are matched in lower case. */
+		if (params == cache_cfg.key.hdr)
+			for (p = params[*n]; *p; ++p)
+				*p = tolower(*p);
+		++*n;
+	}
+	cache_cfg.key.on = true;
+
+	return 0;
+}
+
+static void
+tfw_cfgop_cleanup_cache_key(TfwCfgSpec *cs)
+{
+	int i;
+
+	for (i = 0; i < cache_cfg.key.drop_n; ++i)
+		kfree(cache_cfg.key.drop[i]);
+	for (i = 0; i < cache_cfg.key.hdr_n; ++i)
+		kfree(cache_cfg.key.hdr[i]);
+	for (i = 0; i < cache_cfg.key.cookie_n; ++i)
+		kfree(cache_cfg.key.cookie[i]);
+	memset(&cache_cfg.key, 0, sizeof(cache_cfg.key));
+}
+
 static TfwCfgSpec tfw_cache_specs[] = {
 	{
 		.name = "cache",
@@ -2517,6 +7768,15 @@ static TfwCfgSpec tfw_cache_specs[] = {
 			.range = { PAGE_SIZE, (1 << 30) },
 		}
 	},
+	{
+		.name = "cache_collapse_timeout",
+		.deflt = "0",
+		.handler = tfw_cfgop_cache_collapse_timeout,
+		.allow_none = true,
+		.spec_ext = &(TfwCfgSpecInt) {
+			.range = { 0, 60000 },
+		},
+	},
 	{
 		.name = "cache_db",
 		.deflt = "/opt/tempesta/db/cache.tdb",
@@ -2526,6 +7786,100 @@ static TfwCfgSpec tfw_cache_specs[] = {
 			.len_range = { 1, PATH_MAX },
 		}
 	},
+	{
+		.name = "cache_key",
+		.deflt = NULL,
+		.handler = tfw_cfgop_cache_key,
+		.allow_none = true,
+		.allow_repeat = false,
+		.cleanup = tfw_cfgop_cleanup_cache_key,
+	},
+	{
+		.name = "cache_admit_hits",
+		.deflt = "1",
+		.handler = tfw_cfg_set_int,
+		.dest = &cache_cfg.admit_hits,
+		.spec_ext = &(TfwCfgSpecInt) {
+			.range = { 1, 255 },
+		},
+	},
+	{
+		.name = "cache_admit_window",
+		.deflt = "60",
+		.handler = tfw_cfg_set_int,
+		.dest = &cache_cfg.admit_window,
+		.spec_ext = &(TfwCfgSpecInt) {
+			.range = { 1, 86400 },
+		},
+	},
+	{
+		.name = "cache_hpack_block",
+		.deflt = "off",
+		.handler = tfw_cfg_set_bool,
+		.dest = &cache_cfg.hpack_block,
+	},
+	{
+		.name = "cache_compress",
+		.deflt = "0",
+		.handler = tfw_cfg_set_int,
+		.dest = &cache_cfg.compress,
+		.spec_ext = &(TfwCfgSpecInt) {
+			.range = { 0, TFW_CACHE_GZIP_MAXLEN },
+		},
+	},
+	{
+		.name = "cache_compress_budget",
+		.deflt = "25",
+		.handler = tfw_cfg_set_int,
+		.dest = &cache_cfg.compress_budget,
+		.spec_ext = &(TfwCfgSpecInt) {
+			.range = { 1, 100 },
+		},
+	},
+	{
+		.name = "cache_tag_header",
+		.deflt = NULL,
+		.handler = tfw_cfgop_cache_tag_header,
+		.allow_none = true,
+		.cleanup = tfw_cfgop_cleanup_cache_tag_header,
+	},
+	{
+		.name = "cache_tag_db",
+		.deflt = "/opt/tempesta/db/cache_tags.tdb",
+		.handler = tfw_cfg_set_str,
+		.dest = &cache_cfg.tag_db_path,
+		.spec_ext = &(TfwCfgSpecStr) {
+			.len_range = { 1, PATH_MAX },
+		}
+	},
+	{
+		.name = "cache_tag_db_size",
+		.deflt = "16777216",
+		.handler = tfw_cfg_set_int,
+		.dest = &cache_cfg.tag_db_size,
+		.spec_ext = &(TfwCfgSpecInt) {
+			.multiple_of = PAGE_SIZE,
+			.range = { PAGE_SIZE, (1 << 30) },
+		}
+	},
+	{
+		.name = "cache_disk_db",
+		.deflt = "/opt/tempesta/db/cache_disk.db",
+		.handler = tfw_cfg_set_str,
+		.dest = &cache_cfg.disk_path,
+		.spec_ext = &(TfwCfgSpecStr) {
+			.len_range = { 1, PATH_MAX },
+		}
+	},
+	{
+		.name = "cache_disk_size",
+		.deflt = "0",
+		.handler = tfw_cfg_set_int,
+		.dest = &cache_cfg.disk_size,
+		.spec_ext = &(TfwCfgSpecInt) {
+			.range = { 0, (1 << 24) },
+		}
+	},
 	{ 0 }
 };
 
@@ -2539,6 +7893,33 @@ TfwMod tfw_cache_mod = {
 int
 tfw_cache_init(void)
 {
+	int i;
+
+	BUILD_BUG_ON(offsetof(TfwCacheEntry, age) != L1_CACHE_BYTES);
+	BUILD_BUG_ON(offsetof(TfwCacheEntry, last_modified)
+		     != L1_CACHE_BYTES * 2);
+
+	cache_fetch_cache = kmem_cache_create("tfw_cache_fetch_cache",
+					      sizeof(TfwCacheFetch), 0, 0,
+					      NULL);
+	if (!cache_fetch_cache)
+		return -ENOMEM;
+	cache_lru_cache = kmem_cache_create("tfw_cache_lru_cache",
+					    sizeof(TfwCacheLru), 0, 0, NULL);
+	if (!cache_lru_cache) {
+		kmem_cache_destroy(cache_fetch_cache);
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(cache_fetch_tbl); ++i) {
+		INIT_HLIST_HEAD(&cache_fetch_tbl[i].list);
+		spin_lock_init(&cache_fetch_tbl[i].lock);
+	}
+	for (i = 0; i < MAX_NUMNODES; ++i) {
+		INIT_LIST_HEAD(&c_nodes[i].lru);
+		spin_lock_init(&c_nodes[i].lru_lock);
+	}
+
 	tfw_mod_register(&tfw_cache_mod);
 	return 0;
 }
@@ -2547,4 +7928,7 @@ void
 tfw_cache_exit(void)
 {
 	tfw_mod_unregister(&tfw_cache_mod);
+	tfw_cache_acct_free();
+	kmem_cache_destroy(cache_lru_cache);
+	kmem_cache_destroy(cache_fetch_cache);
 }
@@ -21,9 +21,35 @@
 #ifndef __TFW_CACHE_H__
 #define __TFW_CACHE_H__
 
+#include <linux/seq_file.h>
+
 #include "http.h"
 
 bool tfw_cache_msg_cacheable(TfwHttpReq *req);
+TfwStr *tfw_cache_key_path(TfwHttpReq *req);
 int tfw_cache_process(TfwHttpMsg *msg, tfw_http_cache_cb_t action);
+void tfw_cache_resp_chunk(TfwHttpResp *resp);
+void tfw_cache_acct_show(struct seq_file *seq);
+void tfw_cache_acct_vhost_show(struct seq_file *seq, TfwVhost *vhost);
+void tfw_cache_metrics_show(struct seq_file *seq);
+unsigned int tfw_cache_wq_backlog(void);
+void tfw_cache_purge_key(unsigned long key);
+void tfw_cache_purge_tag(const char *tag, size_t len);
+TfwHttpResp *tfw_cache_push(TfwHttpReq *req, TfwStr *path,
+			    unsigned int stream_id, unsigned long *budget);
+
+#ifdef TFW_CACHE_BENCH
+/* Cache hit path operations measured by the cache benchmark. */
+enum {
+	TFW_CACHE_BENCH_GET,
+	TFW_CACHE_BENCH_BUILD,
+	TFW_CACHE_BENCH_304,
+	TFW_CACHE_BENCH_OPS
+};
+
+int tfw_cache_bench_fill(unsigned int n, unsigned int body_len);
+int tfw_cache_bench_run(int op, const unsigned int *keys, unsigned int n,
+			unsigned long *cycles, unsigned int *misses);
+#endif
 
 #endif /* __TFW_CACHE_H__ */
@@ -0,0 +1,529 @@
+/**
+ *		Tempesta FW
+ *
+ * Disk tier of the cache.
+ *
+ * The in-memory cache database is limited by RAM, so entries evicted from it
+ * may be demoted to a file on a fast disk and promoted back to the database
+ * on the next request. The file is a circular log of the objects, so a new
+ * object overwrites the oldest ones. The objects are indexed by the cache
+ * keys in memory only, so the disk tier is empty after restart.
+ *
+ * Softirqs never wait for the disk: demoted objects are copied to pages and
+ * queued, and the requests for objects on the disk are queued by the caller
+ * until the objects are read. All the writes and reads are done by a single
+ * worker, so the log head is changed and the objects are overwritten by the
+ * worker only and an object being read can't be overwritten. The file is
+ * opened with O_DIRECT if the filesystem supports it, so the objects don't
+ * occupy the page cache.
+ *
+ * Copyright (C) 2020 Tempesta Technologies, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#include <linux/bvec.h>
+#include <linux/fs.h>
+#include <linux/hash.h>
+#include <linux/slab.h>
+#include <linux/uio.h>
+#include <linux/vmalloc.h>
+#include <linux/workqueue.h>
+
+#include "cache_disk.h"
+#include "log.h"
+
+#define TFW_CACHE_DISK_IDX_BITS		16
+/* Maximum size of the demoted objects waiting to be written. */
+#define TFW_CACHE_DISK_QUEUE_MAX	(64UL << 20)
+
+/**
+ * Object stored in the disk tier.
+ *
+ * @hentry	- entry in the index bucket;
+ * @list	- entry in the log order list;
+ * @key		- the object key;
+ * @off		- offset of the object in the file;
+ * @len		- length of the object data, whole pages are written;
+ */
+typedef struct {
+	struct hlist_node	hentry;
+	struct list_head	list;
+	unsigned long		key;
+	loff_t			off;
+	size_t			len;
+} TfwCacheDiskObj;
+
+/**
+ * @filp	- the file storing the objects;
+ * @size	- size of the file;
+ * @head	- offset to write the next object at;
+ * @idx		- index of the objects by keys;
+ * @log		- the objects in the order of their offsets from @head,
+ *		  the oldest ones first;
+ * @ops		- queue of the disk writes and reads for the worker;
+ * @ops_bytes	- size of the objects in @ops;
+ * @lock	- protects @idx, @log, @ops and @ops_bytes;
+ * @work	- the worker doing the disk operations;
+ * @wq		- ordered workqueue of @work;
+ * @cb		- called when an object is read;
+ * @on		- the disk tier is opened;
+ */
+static struct {
+	struct file		*filp;
+	unsigned long		size;
+	loff_t			head;
+	struct hlist_head	*idx;
+	struct list_head	log;
+	struct list_head	ops;
+	size_t			ops_bytes;
+	spinlock_t		lock;
+	struct work_struct	work;
+	struct workqueue_struct	*wq;
+	tfw_cache_disk_cb_t	cb;
+	bool			on;
+} cdisk;
+
+TfwCacheDiskBuf *
+tfw_cache_disk_buf_alloc(size_t len, gfp_t gfp)
+{
+	unsigned int i, nr = DIV_ROUND_UP(len, PAGE_SIZE);
+	TfwCacheDiskBuf *b;
+
+	if (!(b = kmalloc(sizeof(*b) + nr * sizeof(struct page *), gfp)))
+		return NULL;
+	b->len = len;
+	for (b->nr = 0; b->nr < nr; ++b->nr)
+		if (!(b->pages[b->nr] = alloc_page(gfp)))
+			goto err;
+
+	return b;
+err:
+	for (i = 0; i < b->nr; ++i)
+		__free_page(b->pages[i]);
+	kfree(b);
+
+	return NULL;
+}
+
+void
+tfw_cache_disk_buf_free(TfwCacheDiskBuf *b)
+{
+	unsigned int i;
+
+	if (!b)
+		return;
+	for (i = 0; i < b->nr; ++i)
+		__free_page(b->pages[i]);
+	kfree(b);
+}
+
+/* Copy @n bytes between @p and @b at offset @off. */
+static void
+__tfw_cache_disk_buf_copy(TfwCacheDiskBuf *b, size_t off, void *p, size_t n,
+			  bool to_buf)
+{
+	while (n) {
+		char *addr = page_address(b->pages[off >> PAGE_SHIFT]);
+		size_t c = min_t(size_t, n, PAGE_SIZE - offset_in_page(off));
+
+		addr += offset_in_page(off);
+		if (to_buf)
+			memcpy(addr, p, c);
+		else
+			memcpy(p, addr, c);
+		p += c;
+		off += c;
+		n -= c;
+	}
+}
+
+void
+tfw_cache_disk_buf_write(TfwCacheDiskBuf *b, size_t off, const void *src,
+			 size_t n)
+{
+	BUG_ON(off + n > b->len);
+	__tfw_cache_disk_buf_copy(b, off, (void *)src, n, true);
+}
+
+void
+tfw_cache_disk_buf_read(TfwCacheDiskBuf *b, size_t off, void *dst, size_t n)
+{
+	BUG_ON(off + n > b->len);
+	__tfw_cache_disk_buf_copy(b, off, dst, n, false);
+}
+
+static inline struct hlist_head *
+tfw_cache_disk_bucket(unsigned long key)
+{
+	return &cdisk.idx[hash_long(key, TFW_CACHE_DISK_IDX_BITS)];
+}
+
+static TfwCacheDiskObj *
+__tfw_cache_disk_obj_get(unsigned long key)
+{
+	TfwCacheDiskObj *o;
+
+	hlist_for_each_entry(o, tfw_cache_disk_bucket(key), hentry)
+		if (o->key == key)
+			return o;
+
+	return NULL;
+}
+
+static void
+__tfw_cache_disk_obj_del(TfwCacheDiskObj *o)
+{
+	hlist_del(&o->hentry);
+	list_del(&o->list);
+	kfree(o);
+}
+
+/* Read or write the whole pages of @b at offset @off of the file. */
+static int
+tfw_cache_disk_io(TfwCacheDiskBuf *b, loff_t off, bool write)
+{
+	unsigned int i;
+	size_t len = (size_t)b->nr << PAGE_SHIFT;
+	struct bio_vec *bv;
+	struct iov_iter it;
+	ssize_t r;
+
+	if (!(bv = kmalloc_array(b->nr, sizeof(*bv), GFP_KERNEL)))
+		return -ENOMEM;
+	for (i = 0; i < b->nr; ++i) {
+		bv[i].bv_page = b->pages[i];
+		bv[i].bv_len = PAGE_SIZE;
+		bv[i].bv_offset = 0;
+	}
+
+	if (write) {
+		iov_iter_bvec(&it, ITER_BVEC | WRITE, bv, b->nr, len);
+		file_start_write(cdisk.filp);
+		r = vfs_iter_write(cdisk.filp, &it, &off, 0);
+		file_end_write(cdisk.filp);
+	} else {
+		iov_iter_bvec(&it, ITER_BVEC | READ, bv, b->nr, len);
+		r = vfs_iter_read(cdisk.filp, &it, &off, 0);
+	}
+	kfree(bv);
+
+	if (r == len)
+		return 0;
+	return r < 0 ? r : -EIO;
+}
+
+/*
+ * Write the demoted object @b at the log head. The oldest objects in the
+ * way are dropped.
+ */
+static void
+tfw_cache_disk_write(TfwCacheDiskBuf *b)
+{
+	size_t len = (size_t)b->nr << PAGE_SHIFT;
+	TfwCacheDiskObj *obj, *o, *tmp;
+	loff_t off;
+	bool wrap;
+
+	if (len > cdisk.size || !(obj = kmalloc(sizeof(*obj), GFP_KERNEL)))
+		goto out;
+
+	spin_lock_bh(&cdisk.lock);
+	off = cdisk.head;
+	if ((wrap = off + len > cdisk.size))
+		off = 0;
+	list_for_each_entry_safe(o, tmp, &cdisk.log, list) {
+		bool overlap = o->off < off + len
+			       && o->off + PAGE_ALIGN(o->len) > off;
+
+		if (!overlap && !(wrap && o->off >= cdisk.head))
+			break;
+		__tfw_cache_disk_obj_del(o);
+	}
+	cdisk.head = off + len;
+	spin_unlock_bh(&cdisk.lock);
+
+	if (tfw_cache_disk_io(b, off, true)) {
+		T_WARN("Cache: cannot write %lu bytes to disk\n", b->len);
+		kfree(obj);
+		goto out;
+	}
+
+	obj->key = b->key;
+	obj->off = off;
+	obj->len = b->len;
+	spin_lock_bh(&cdisk.lock);
+	hlist_add_head(&obj->hentry, tfw_cache_disk_bucket(obj->key));
+	list_add_tail(&obj->list, &cdisk.log);
+	spin_unlock_bh(&cdisk.lock);
+out:
+	tfw_cache_disk_buf_free(b);
+}
+
+/*
+ * Read the newest object for the key of read operation @op. The object
+ * leaves the disk tier, since it's promoted to the database.
+ */
+static void
+tfw_cache_disk_fetch(TfwCacheDiskBuf *op)
+{
+	unsigned long key = op->key;
+	int nid = op->nid;
+	TfwCacheDiskBuf *b = NULL;
+	TfwCacheDiskObj *o;
+
+	tfw_cache_disk_buf_free(op);
+
+	spin_lock_bh(&cdisk.lock);
+	if ((o = __tfw_cache_disk_obj_get(key))) {
+		hlist_del(&o->hentry);
+		list_del(&o->list);
+	}
+	spin_unlock_bh(&cdisk.lock);
+	if (!o)
+		goto done;
+
+	if ((b = tfw_cache_disk_buf_alloc(o->len, GFP_KERNEL))) {
+		b->key = key;
+		b->nid = nid;
+		if (tfw_cache_disk_io(b, o->off, false)) {
+			T_WARN("Cache: cannot read %lu bytes from disk\n",
+			       o->len);
+			tfw_cache_disk_buf_free(b);
+			b = NULL;
+		}
+	}
+	kfree(o);
+done:
+	cdisk.cb(key, nid, b);
+}
+
+static void
+tfw_cache_disk_work(struct work_struct *work)
+{
+	TfwCacheDiskBuf *b;
+
+	while (true) {
+		spin_lock_bh(&cdisk.lock);
+		b = list_first_entry_or_null(&cdisk.ops, TfwCacheDiskBuf,
+					     list);
+		if (b) {
+			list_del(&b->list);
+			cdisk.ops_bytes -= b->len;
+		}
+		spin_unlock_bh(&cdisk.lock);
+		if (!b)
+			break;
+
+		if (b->nr)
+			tfw_cache_disk_write(b);
+		else
+			tfw_cache_disk_fetch(b);
+		cond_resched();
+	}
+}
+
+static bool
+tfw_cache_disk_queue(TfwCacheDiskBuf *b)
+{
+	spin_lock_bh(&cdisk.lock);
+	if (!cdisk.on || cdisk.ops_bytes + b->len > TFW_CACHE_DISK_QUEUE_MAX) {
+		spin_unlock_bh(&cdisk.lock);
+		tfw_cache_disk_buf_free(b);
+		return false;
+	}
+	list_add_tail(&b->list, &cdisk.ops);
+	cdisk.ops_bytes += b->len;
+	spin_unlock_bh(&cdisk.lock);
+
+	queue_work(cdisk.wq, &cdisk.work);
+
+	return true;
+}
+
+bool
+tfw_cache_disk_enabled(void)
+{
+	return READ_ONCE(cdisk.on);
+}
+
+/**
+ * Queue object @b, filled with the data and the key, to be written to the
+ * disk. @b is freed if the queue is full.
+ */
+bool
+tfw_cache_disk_store(TfwCacheDiskBuf *b)
+{
+	return tfw_cache_disk_queue(b);
+}
+
+/**
+ * Check if there is an object for @key on the disk.
+ */
+bool
+tfw_cache_disk_lookup(unsigned long key)
+{
+	bool r;
+
+	spin_lock_bh(&cdisk.lock);
+	r = cdisk.on && __tfw_cache_disk_obj_get(key);
+	spin_unlock_bh(&cdisk.lock);
+
+	return r;
+}
+
+/**
+ * Queue reading of the newest object for @key for node @nid. The callback
+ * is called for the object if the read is queued.
+ */
+bool
+tfw_cache_disk_read(unsigned long key, int nid)
+{
+	TfwCacheDiskBuf *op;
+
+	if (!(op = tfw_cache_disk_buf_alloc(0, GFP_ATOMIC | __GFP_NOWARN)))
+		return false;
+	op->key = key;
+	op->nid = nid;
+
+	return tfw_cache_disk_queue(op);
+}
+
+/**
+ * Drop all the objects for @key, e.g. on the key invalidation.
+ * Return true if there were such objects.
+ */
+bool
+tfw_cache_disk_drop(unsigned long key)
+{
+	bool r = false;
+	TfwCacheDiskObj *o;
+	struct hlist_node *tmp;
+
+	if (!tfw_cache_disk_enabled())
+		return false;
+
+	spin_lock_bh(&cdisk.lock);
+	if (!cdisk.on)
+		goto out;
+	hlist_for_each_entry_safe(o, tmp, tfw_cache_disk_bucket(key), hentry)
+		if (o->key == key) {
+			__tfw_cache_disk_obj_del(o);
+			r = true;
+		}
+out:
+	spin_unlock_bh(&cdisk.lock);
+
+	return r;
+}
+
+/**
+ * Open the disk tier in file @path of @size bytes, @cb is called for each
+ * read object. Called from process context.
+ */
+int
+tfw_cache_disk_open(const char *path, unsigned long size,
+		    tfw_cache_disk_cb_t cb)
+{
+	int r;
+	struct file *filp;
+
+	filp = filp_open(path, O_CREAT | O_RDWR | O_LARGEFILE | O_DIRECT,
+			 0600);
+	if (PTR_ERR(filp) == -EINVAL) {
+		T_WARN_NL("Cache: %s doesn't support direct IO, the disk cache"
+			  " uses the page cache\n", path);
+		filp = filp_open(path, O_CREAT | O_RDWR | O_LARGEFILE, 0600);
+	}
+	if (IS_ERR(filp)) {
+		T_ERR_NL("Cache: cannot open disk cache file %s\n", path);
+		return PTR_ERR(filp);
+	}
+	/* Allocate the space in advance, so the writes don't fail. */
+	if ((r = vfs_fallocate(filp, 0, 0, size))) {
+		T_ERR_NL("Cache: cannot allocate %lu bytes for %s, %d\n",
+			 size, path, r);
+		goto err_file;
+	}
+
+	r = -ENOMEM;
+	cdisk.idx = vzalloc(sizeof(struct hlist_head)
+			    << TFW_CACHE_DISK_IDX_BITS);
+	if (!cdisk.idx)
+		goto err_file;
+	cdisk.wq = alloc_ordered_workqueue("tfw_cache_disk", WQ_MEM_RECLAIM);
+	if (!cdisk.wq)
+		goto err_idx;
+
+	cdisk.filp = filp;
+	cdisk.size = size & PAGE_MASK;
+	cdisk.head = 0;
+	cdisk.ops_bytes = 0;
+	cdisk.cb = cb;
+	INIT_LIST_HEAD(&cdisk.log);
+	INIT_LIST_HEAD(&cdisk.ops);
+	spin_lock_init(&cdisk.lock);
+	INIT_WORK(&cdisk.work, tfw_cache_disk_work);
+	WRITE_ONCE(cdisk.on, true);
+
+	T_LOG_NL("Cache: %luMB disk tier in %s\n", size >> 20, path);
+
+	return 0;
+err_idx:
+	vfree(cdisk.idx);
+	cdisk.idx = NULL;
+err_file:
+	filp_close(filp, NULL);
+	return r;
+}
+
+/**
+ * Close the disk tier. The queued reads are completed with the callback,
+ * so the requests waiting for them are released, and the queued writes
+ * are dropped.
+ */
+void
+tfw_cache_disk_close(void)
+{
+	TfwCacheDiskBuf *b, *tmp;
+	TfwCacheDiskObj *o, *otmp;
+	struct hlist_head *idx;
+	LIST_HEAD(ops);
+
+	if (!cdisk.on)
+		return;
+
+	spin_lock_bh(&cdisk.lock);
+	cdisk.on = false;
+	list_splice_init(&cdisk.ops, &ops);
+	cdisk.ops_bytes = 0;
+	spin_unlock_bh(&cdisk.lock);
+
+	list_for_each_entry_safe(b, tmp, &ops, list) {
+		if (!b->nr)
+			cdisk.cb(b->key, b->nid, NULL);
+		tfw_cache_disk_buf_free(b);
+	}
+	destroy_workqueue(cdisk.wq);
+
+	spin_lock_bh(&cdisk.lock);
+	list_for_each_entry_safe(o, otmp, &cdisk.log, list)
+		__tfw_cache_disk_obj_del(o);
+	idx = cdisk.idx;
+	cdisk.idx = NULL;
+	spin_unlock_bh(&cdisk.lock);
+	vfree(idx);
+	filp_close(cdisk.filp, NULL);
+	cdisk.filp = NULL;
+}
@@ -0,0 +1,70 @@
+/**
+ *		Tempesta FW
+ *
+ * Copyright (C) 2020 Tempesta Technologies, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#ifndef __TFW_CACHE_DISK_H__
+#define __TFW_CACHE_DISK_H__
+
+#include <linux/list.h>
+#include <linux/mm_types.h>
+
+/**
+ * Buffer of an object of the disk cache tier, built of single pages since
+ * objects are demoted from softirq.
+ *
+ * @list	- entry in the queue of the disk operations;
+ * @key		- the object key;
+ * @len		- length of the object data;
+ * @nid		- node the object is read for;
+ * @nr		- number of pages in @pages, zero for a read operation;
+ * @pages	- the object data;
+ */
+typedef struct {
+	struct list_head	list;
+	unsigned long		key;
+	size_t			len;
+	int			nid;
+	unsigned int		nr;
+	struct page		*pages[0];
+} TfwCacheDiskBuf;
+
+/*
+ * Called in process context with object @b read for node @nid or with NULL
+ * if the object for @key can't be read. The callee owns @b.
+ */
+typedef void (*tfw_cache_disk_cb_t)(unsigned long key, int nid,
+				    TfwCacheDiskBuf *b);
+
+TfwCacheDiskBuf *tfw_cache_disk_buf_alloc(size_t len, gfp_t gfp);
+void tfw_cache_disk_buf_free(TfwCacheDiskBuf *b);
+void tfw_cache_disk_buf_write(TfwCacheDiskBuf *b, size_t off, const void *src,
+			      size_t n);
+void tfw_cache_disk_buf_read(TfwCacheDiskBuf *b, size_t off, void *dst,
+			     size_t n);
+
+bool tfw_cache_disk_enabled(void);
+bool tfw_cache_disk_store(TfwCacheDiskBuf *b);
+bool tfw_cache_disk_lookup(unsigned long key);
+bool tfw_cache_disk_read(unsigned long key, int nid);
+bool tfw_cache_disk_drop(unsigned long key);
+
+int tfw_cache_disk_open(const char *path, unsigned long size,
+			tfw_cache_disk_cb_t cb);
+void tfw_cache_disk_close(void);
+
+#endif /* __TFW_CACHE_DISK_H__ */
@@ -0,0 +1,652 @@
+/**
+ *		Tempesta FW
+ *
+ * Replication of cache purges between Tempesta nodes.
+ *
+ * A PURGE request received by one Tempesta node of a cluster invalidates
+ * the cached responses at the node only. The node also broadcasts the purge
+ * events, cache keys and tags, to the peer nodes, which invalidate the same
+ * entries. The peers must use the same cache_key configuration, since the
+ * keys are replicated instead of the request URIs.
+ *
+ * The events are appended to a log of the node with increasing sequence
+ * numbers. A kernel thread sends the new events of the log to all the peers
+ * over UDP each replication interval, heartbeats with the last sequence number
+ * are sent if there are no new events. The thread also receives the events of
+ * the peers and applies them in order. A gap in the sequence numbers of a peer,
+ * e.g. a lost datagram or a peer which was unreachable for a while, is filled
+ * by a replay request to the peer, which sends the missed events again while
+ * they're in its log. A peer with a new log, e.g. a restarted one, is replayed
+ * from the beginning of its log. The events are idempotent, so repeated events
+ * just invalidate the entries stored after the original purges once more.
+ *
+ * Copyright (C) 2020 Tempesta Technologies, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#include <linux/kthread.h>
+#include <linux/net.h>
+#include <linux/random.h>
+#include <net/ipv6.h>
+#include <net/sock.h>
+#include <asm/fpu/api.h>
+#include <asm/unaligned.h>
+
+#include "tempesta_fw.h"
+#include "addr.h"
+#include "cache.h"
+#include "cache_purge_repl.h"
+#include "cfg.h"
+#include "log.h"
+
+#define TFW_PURGE_REPL_MAGIC	0x54465050	/* "TFPP" */
+#define TFW_PURGE_REPL_PEERS_MAX	16
+/* Fits the Ethernet MTU with IPv6 and UDP headers. */
+#define TFW_PURGE_REPL_DGRAM_SZ	1400
+/* Number of the events in the log, a power of two. */
+#define TFW_PURGE_REPL_LOG_SZ	1024
+/* Maximum length of an event data, the longer tags aren't replicated. */
+#define TFW_PURGE_REPL_DATA_MAX	126
+/* Maximum number of datagrams sent in reply to a replay request. */
+#define TFW_PURGE_REPL_REPLAY_MAX	32
+#define TFW_PURGE_REPL_HEARTBEAT	HZ
+
+/* Datagram types. */
+enum {
+	TFW_PURGE_REPL_EVENTS,
+	TFW_PURGE_REPL_REPLAY,
+};
+
+/* Purge event types. */
+enum {
+	TFW_PURGE_EV_KEY,
+	TFW_PURGE_EV_TAG,
+};
+
+/**
+ * Replication datagram header.
+ *
+ * @magic	- TFW_PURGE_REPL_MAGIC;
+ * @epoch	- identifier of the sender log, a new one is chosen on start;
+ * @seq		- sequence number of the first event in the datagram or of
+ *		  the first event to replay for TFW_PURGE_REPL_REPLAY;
+ * @base	- sequence number of the oldest event in the sender log;
+ * @last	- sequence number of the last event in the sender log;
+ * @n		- number of events following the header;
+ * @type	- TFW_PURGE_REPL_*;
+ */
+typedef struct {
+	__be32		magic;
+	__be32		epoch;
+	__be64		seq;
+	__be64		base;
+	__be64		last;
+	__be16		n;
+	u8		type;
+	u8		_pad;
+} __attribute__((packed)) TfwPurgeReplHdr;
+
+/**
+ * Replicated purge event, the cache key in network byte order or the tag.
+ *
+ * @type	- TFW_PURGE_EV_*;
+ * @len		- length of @data;
+ * @data	- the event data;
+ */
+typedef struct {
+	u8		type;
+	u8		len;
+	char		data[0];
+} __attribute__((packed)) TfwPurgeReplRec;
+
+typedef struct {
+	u8		type;
+	u8		len;
+	char		data[TFW_PURGE_REPL_DATA_MAX];
+} TfwPurgeReplEvent;
+
+/**
+ * State of a peer.
+ *
+ * @addr	- the peer address;
+ * @epoch	- identifier of the peer log the events are applied from;
+ * @next	- sequence number of the next event to apply, zero if no events
+ *		  of the peer are received yet;
+ * @replay_ts	- time of the last replay request to the peer;
+ */
+typedef struct {
+	TfwAddr		addr;
+	u32		epoch;
+	u64		next;
+	unsigned long	replay_ts;
+} TfwPurgeReplPeer;
+
+static struct {
+	TfwAddr			listen;
+	TfwPurgeReplPeer	peers[TFW_PURGE_REPL_PEERS_MAX];
+	unsigned int		peers_n;
+	unsigned int		interval;
+} purge_repl_cfg __read_mostly;
+
+/**
+ * Log of the local purge events. The event with sequence number N is stored
+ * at N modulo the log size, the sequence numbers start from one.
+ *
+ * @lock	- protects the log against the replication thread;
+ * @epoch	- identifier of the log;
+ * @last	- sequence number of the last event;
+ * @ev		- the events;
+ */
+static struct {
+	spinlock_t		lock;
+	u32			epoch;
+	u64			last;
+	TfwPurgeReplEvent	ev[TFW_PURGE_REPL_LOG_SZ];
+} purge_repl_log;
+
+static bool purge_repl_enabled __read_mostly;
+static struct socket *purge_repl_sock;
+static struct task_struct *purge_repl_thr;
+/* Used by the replication thread only. */
+static u64 purge_repl_sent;
+static unsigned long purge_repl_ts;
+static char purge_repl_buf[TFW_PURGE_REPL_DGRAM_SZ];
+
+static inline u64
+tfw_purge_repl_base(u64 last)
+{
+	return last >= TFW_PURGE_REPL_LOG_SZ
+	       ? last - TFW_PURGE_REPL_LOG_SZ + 1 : 1;
+}
+
+/**
+ * Append a purge event to the log. Called in softirq.
+ */
+static void
+tfw_purge_repl_push(int type, const void *data, size_t len)
+{
+	TfwPurgeReplEvent *ev;
+
+	if (!READ_ONCE(purge_repl_enabled))
+		return;
+	if (len > TFW_PURGE_REPL_DATA_MAX) {
+		T_DBG("purge_repl: too long event data, %zu bytes\n", len);
+		return;
+	}
+
+	spin_lock_bh(&purge_repl_log.lock);
+	ev = &purge_repl_log.ev[++purge_repl_log.last
+				& (TFW_PURGE_REPL_LOG_SZ - 1)];
+	ev->type = type;
+	ev->len = len;
+	memcpy(ev->data, data, len);
+	spin_unlock_bh(&purge_repl_log.lock);
+}
+
+void
+tfw_cache_purge_repl_key(unsigned long key)
+{
+	__be64 k = cpu_to_be64(key);
+
+	tfw_purge_repl_push(TFW_PURGE_EV_KEY, &k, sizeof(k));
+}
+
+void
+tfw_cache_purge_repl_tag(const char *tag, size_t len)
+{
+	tfw_purge_repl_push(TFW_PURGE_EV_TAG, tag, len);
+}
+
+/**
+ * Build a datagram of the log events starting from @seq and up to @to,
+ * the events which are already overwritten are skipped. A heartbeat is
+ * built if @seq is greater than @to.
+ *
+ * @return the sequence number of the first event which isn't in the datagram.
+ */
+static u64
+tfw_purge_repl_build(u64 seq, u64 to, size_t *len)
+{
+	u64 base;
+	unsigned int n = 0;
+	TfwPurgeReplRec *r;
+	TfwPurgeReplEvent *ev;
+	TfwPurgeReplHdr *hdr = (TfwPurgeReplHdr *)purge_repl_buf;
+	char *p = purge_repl_buf + sizeof(*hdr);
+	char *end = purge_repl_buf + sizeof(purge_repl_buf);
+
+	spin_lock_bh(&purge_repl_log.lock);
+	base = tfw_purge_repl_base(purge_repl_log.last);
+	seq = max(seq, base);
+	to = min(to, purge_repl_log.last);
+	hdr->seq = cpu_to_be64(seq);
+	hdr->base = cpu_to_be64(base);
+	hdr->last = cpu_to_be64(purge_repl_log.last);
+
+	for ( ; seq <= to; ++seq, ++n) {
+		ev = &purge_repl_log.ev[seq & (TFW_PURGE_REPL_LOG_SZ - 1)];
+		if (p + sizeof(*r) + ev->len > end)
+			break;
+		r = (TfwPurgeReplRec *)p;
+		r->type = ev->type;
+		r->len = ev->len;
+		memcpy(r->data, ev->data, ev->len);
+		p += sizeof(*r) + ev->len;
+	}
+	spin_unlock_bh(&purge_repl_log.lock);
+
+	hdr->magic = htonl(TFW_PURGE_REPL_MAGIC);
+	hdr->epoch = htonl(purge_repl_log.epoch);
+	hdr->n = htons(n);
+	hdr->type = TFW_PURGE_REPL_EVENTS;
+	hdr->_pad = 0;
+	*len = p - purge_repl_buf;
+
+	return seq;
+}
+
+static void
+tfw_purge_repl_send(TfwAddr *addr, size_t len)
+{
+	struct kvec iov = { .iov_base = purge_repl_buf, .iov_len = len };
+	struct msghdr msg = {
+		.msg_name	= addr,
+		.msg_namelen	= sizeof(TfwAddr),
+		.msg_flags	= MSG_DONTWAIT
+	};
+
+	if (kernel_sendmsg(purge_repl_sock, &msg, &iov, 1, len) < 0)
+		T_DBG_ADDR("purge_repl: cannot send events to", addr,
+			   TFW_WITH_PORT);
+}
+
+static void
+tfw_purge_repl_bcast(size_t len)
+{
+	int i;
+
+	for (i = 0; i < purge_repl_cfg.peers_n; ++i)
+		tfw_purge_repl_send(&purge_repl_cfg.peers[i].addr, len);
+}
+
+/**
+ * Send the new events to all the peers or a heartbeat if there are no new
+ * events for a while.
+ */
+static void
+tfw_purge_repl_flush(void)
+{
+	u64 last = READ_ONCE(purge_repl_log.last);
+	size_t len;
+
+	while (purge_repl_sent < last) {
+		purge_repl_sent = tfw_purge_repl_build(purge_repl_sent + 1,
+						       last, &len) - 1;
+		tfw_purge_repl_bcast(len);
+		purge_repl_ts = jiffies;
+	}
+	if (time_before(jiffies, purge_repl_ts + TFW_PURGE_REPL_HEARTBEAT))
+		return;
+	tfw_purge_repl_build(last + 1, last, &len);
+	tfw_purge_repl_bcast(len);
+	purge_repl_ts = jiffies;
+}
+
+/**
+ * Send the events starting from @seq again to peer @p.
+ */
+static void
+tfw_purge_repl_replay(TfwPurgeReplPeer *p, u64 seq)
+{
+	int i;
+	size_t len;
+	u64 last = READ_ONCE(purge_repl_log.last);
+
+	for (i = 0; i < TFW_PURGE_REPL_REPLAY_MAX && seq <= last; ++i) {
+		seq = tfw_purge_repl_build(seq, last, &len);
+		tfw_purge_repl_send(&p->addr, len);
+	}
+}
+
+/**
+ * Ask peer @p to replay its events starting from the next one to apply.
+ * The requests are sent not more often than once per the interval, since
+ * the gap is detected on each datagram until the replayed events arrive.
+ */
+static void
+tfw_purge_repl_request(TfwPurgeReplPeer *p)
+{
+	TfwPurgeReplHdr *hdr = (TfwPurgeReplHdr *)purge_repl_buf;
+	unsigned long intvl = msecs_to_jiffies(purge_repl_cfg.interval);
+
+	if (p->replay_ts && time_before(jiffies, p->replay_ts + intvl))
+		return;
+	p->replay_ts = jiffies;
+
+	memset(hdr, 0, sizeof(*hdr));
+	hdr->magic = htonl(TFW_PURGE_REPL_MAGIC);
+	hdr->epoch = htonl(p->epoch);
+	hdr->seq = cpu_to_be64(p->next);
+	hdr->type = TFW_PURGE_REPL_REPLAY;
+	tfw_purge_repl_send(&p->addr, sizeof(*hdr));
+}
+
+static void
+tfw_purge_repl_apply_rec(const TfwPurgeReplRec *r)
+{
+	local_bh_disable();
+	kernel_fpu_begin();
+
+	switch (r->type) {
+	case TFW_PURGE_EV_KEY:
+		if (r->len == sizeof(__be64))
+			tfw_cache_purge_key(get_unaligned_be64(r->data));
+		break;
+	case TFW_PURGE_EV_TAG:
+		tfw_cache_purge_tag(r->data, r->len);
+		break;
+	}
+
+	kernel_fpu_end();
+	local_bh_enable();
+}
+
+/**
+ * Apply the events of datagram @hdr of @len bytes received from peer @p
+ * in order of the sequence numbers.
+ */
+static void
+tfw_purge_repl_apply(TfwPurgeReplPeer *p, const TfwPurgeReplHdr *hdr,
+		     size_t len)
+{
+	unsigned int i, n = ntohs(hdr->n), rlen;
+	u32 epoch = ntohl(hdr->epoch);
+	u64 seq = be64_to_cpu(hdr->seq), base = be64_to_cpu(hdr->base);
+	const TfwPurgeReplRec *r;
+	const char *d = (const char *)(hdr + 1);
+
+	/* Apply all the stored events of a new log or of a new peer. */
+	if (p->epoch != epoch || !p->next) {
+		p->epoch = epoch;
+		p->next = base;
+	}
+	if (p->next < base) {
+		T_WARN_ADDR("purge_repl: events are lost, the cache can be"
+			    " stale, peer", &p->addr, TFW_WITH_PORT);
+		p->next = base;
+	}
+	if (seq > p->next) {
+		tfw_purge_repl_request(p);
+		return;
+	}
+
+	len -= sizeof(*hdr);
+	for (i = 0; i < n; ++i, ++seq, d += rlen, len -= rlen) {
+		r = (const TfwPurgeReplRec *)d;
+		if (len < sizeof(*r) || len < (rlen = sizeof(*r) + r->len))
+			return;
+		if (seq < p->next)
+			continue;
+		tfw_purge_repl_apply_rec(r);
+		p->next = seq + 1;
+	}
+}
+
+/**
+ * Only the configured peers can replicate purges to the node.
+ */
+static TfwPurgeReplPeer *
+tfw_purge_repl_peer(const TfwAddr *addr)
+{
+	int i;
+
+	for (i = 0; i < purge_repl_cfg.peers_n; ++i)
+		if (ipv6_addr_equal(&addr->sin6_addr,
+				    &purge_repl_cfg.peers[i].addr.sin6_addr))
+			return &purge_repl_cfg.peers[i];
+
+	return NULL;
+}
+
+static void
+tfw_purge_repl_recv(void)
+{
+	int r;
+	TfwAddr addr;
+	struct kvec iov;
+	struct msghdr msg;
+	TfwPurgeReplPeer *p;
+	TfwPurgeReplHdr *hdr = (TfwPurgeReplHdr *)purge_repl_buf;
+
+	while (!kthread_should_stop()) {
+		iov.iov_base = purge_repl_buf;
+		iov.iov_len = sizeof(purge_repl_buf);
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_name = &addr;
+		msg.msg_namelen = sizeof(addr);
+
+		r = kernel_recvmsg(purge_repl_sock, &msg, &iov, 1,
+				   sizeof(purge_repl_buf), MSG_DONTWAIT);
+		if (r <= 0)
+			return;
+		if (msg.msg_namelen < sizeof(addr)
+		    || !(p = tfw_purge_repl_peer(&addr)))
+		{
+			T_DBG_ADDR("purge_repl: drop datagram from", &addr,
+				   TFW_WITH_PORT);
+			continue;
+		}
+		if (r < sizeof(*hdr)
+		    || hdr->magic != htonl(TFW_PURGE_REPL_MAGIC))
+			continue;
+
+		if (hdr->type == TFW_PURGE_REPL_EVENTS)
+			tfw_purge_repl_apply(p, hdr, r);
+		else if (hdr->type == TFW_PURGE_REPL_REPLAY
+			 && ntohl(hdr->epoch) == purge_repl_log.epoch)
+			tfw_purge_repl_replay(p, be64_to_cpu(hdr->seq));
+	}
+}
+
+static int
+tfw_purge_repl_thread(void *data)
+{
+	unsigned long intvl = msecs_to_jiffies(purge_repl_cfg.interval);
+
+	set_user_nice(current, MAX_NICE);
+
+	while (!kthread_should_stop()) {
+		tfw_purge_repl_flush();
+		tfw_purge_repl_recv();
+		schedule_timeout_interruptible(intvl);
+	}
+
+	return 0;
+}
+
+static void
+tfw_purge_repl_stop(void)
+{
+	if (!purge_repl_enabled)
+		return;
+
+	WRITE_ONCE(purge_repl_enabled, false);
+	kthread_stop(purge_repl_thr);
+	purge_repl_thr = NULL;
+	sock_release(purge_repl_sock);
+	purge_repl_sock = NULL;
+}
+
+static int
+tfw_purge_repl_start(void)
+{
+	int i, r;
+	struct task_struct *t;
+
+	if (tfw_runstate_is_reconfig() || !purge_repl_cfg.peers_n)
+		return 0;
+
+	spin_lock_init(&purge_repl_log.lock);
+	purge_repl_log.epoch = get_random_u32();
+	purge_repl_log.last = 0;
+	purge_repl_sent = 0;
+	purge_repl_ts = jiffies;
+	for (i = 0; i < purge_repl_cfg.peers_n; ++i) {
+		purge_repl_cfg.peers[i].next = 0;
+		purge_repl_cfg.peers[i].replay_ts = 0;
+	}
+
+	r = sock_create_kern(&init_net, AF_INET6, SOCK_DGRAM, IPPROTO_UDP,
+			     &purge_repl_sock);
+	if (r) {
+		T_ERR_NL("purge_repl: cannot create socket, %d\n", r);
+		return r;
+	}
+	r = kernel_bind(purge_repl_sock,
+			tfw_addr_sa(&purge_repl_cfg.listen),
+			tfw_addr_sa_len(&purge_repl_cfg.listen));
+	if (r) {
+		T_ERR_NL("purge_repl: cannot bind socket, %d\n", r);
+		goto err;
+	}
+
+	t = kthread_run(tfw_purge_repl_thread, NULL, "tfw_purge_repl");
+	if (IS_ERR(t)) {
+		r = PTR_ERR(t);
+		T_ERR_NL("purge_repl: cannot start thread, %d\n", r);
+		goto err;
+	}
+	purge_repl_thr = t;
+	WRITE_ONCE(purge_repl_enabled, true);
+
+	return 0;
+err:
+	sock_release(purge_repl_sock);
+	purge_repl_sock = NULL;
+	return r;
+}
+
+static int
+tfw_cfgop_purge_repl_addr(TfwCfgEntry *ce, TfwAddr *addr)
+{
+	int port;
+	const char *in_str;
+
+	if (tfw_cfg_check_val_n(ce, 1) || ce->attr_n)
+		return -EINVAL;
+	in_str = ce->vals[0];
+
+	/* A single port means all the addresses at the port. */
+	if (!tfw_cfg_parse_int(in_str, &port)) {
+		if (tfw_cfg_check_range(port, 1, 65535))
+			return -EINVAL;
+		*addr = (TfwAddr){
+			.sin6_family	= AF_INET6,
+			.sin6_addr	= in6addr_any,
+			.sin6_port	= htons(port)
+		};
+		return 0;
+	}
+
+	return tfw_addr_pton(&TFW_STR_FROM_CSTR(in_str), addr);
+}
+
+static int
+tfw_cfgop_purge_repl_listen(TfwCfgSpec *cs, TfwCfgEntry *ce)
+{
+	if (tfw_cfgop_purge_repl_addr(ce, &purge_repl_cfg.listen)) {
+		T_ERR_NL("Invalid address for '%s'\n", cs->name);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static int
+tfw_cfgop_purge_repl_peer(TfwCfgSpec *cs, TfwCfgEntry *ce)
+{
+	TfwAddr *addr;
+
+	if (purge_repl_cfg.peers_n == TFW_PURGE_REPL_PEERS_MAX) {
+		T_ERR_NL("Too many '%s' entries, %d is the maximum\n",
+			 cs->name, TFW_PURGE_REPL_PEERS_MAX);
+		return -EINVAL;
+	}
+	addr = &purge_repl_cfg.peers[purge_repl_cfg.peers_n].addr;
+	if (tfw_cfgop_purge_repl_addr(ce, addr)
+	    || ipv6_addr_any(&addr->sin6_addr))
+	{
+		T_ERR_NL("Invalid address for '%s'\n", cs->name);
+		return -EINVAL;
+	}
+	purge_repl_cfg.peers_n++;
+
+	return 0;
+}
+
+static void
+tfw_cfgop_purge_repl_cleanup(TfwCfgSpec *cs)
+{
+	purge_repl_cfg.peers_n = 0;
+}
+
+static TfwCfgSpec tfw_purge_repl_specs[] = {
+	{
+		.name = "cache_purge_repl_listen",
+		.deflt = "7701",
+		.handler = tfw_cfgop_purge_repl_listen,
+	},
+	{
+		.name = "cache_purge_repl_peer",
+		.handler = tfw_cfgop_purge_repl_peer,
+		.cleanup = tfw_cfgop_purge_repl_cleanup,
+		.allow_none = true,
+		.allow_repeat = true,
+	},
+	{
+		.name = "cache_purge_repl_interval",
+		.deflt = "100",
+		.handler = tfw_cfg_set_int,
+		.dest = &purge_repl_cfg.interval,
+		.spec_ext = &(TfwCfgSpecInt) {
+			.range = { 1, 10000 },
+		}
+	},
+	{ 0 }
+};
+
+TfwMod tfw_cache_purge_repl_mod = {
+	.name	= "cache_purge_repl",
+	.start	= tfw_purge_repl_start,
+	.stop	= tfw_purge_repl_stop,
+	.specs	= tfw_purge_repl_specs,
+};
+
+int __init
+tfw_cache_purge_repl_init(void)
+{
+	BUILD_BUG_ON(TFW_PURGE_REPL_DATA_MAX > U8_MAX);
+	BUILD_BUG_ON(TFW_PURGE_REPL_LOG_SZ & (TFW_PURGE_REPL_LOG_SZ - 1));
+
+	tfw_mod_register(&tfw_cache_purge_repl_mod);
+
+	return 0;
+}
+
+void
+tfw_cache_purge_repl_exit(void)
+{
+	tfw_mod_unregister(&tfw_cache_purge_repl_mod);
+}
@@ -82,8 +82,11 @@
  */
 #include <linux/ctype.h>
 #include <linux/frame.h>
+#include <linux/hashtable.h>
 #include <linux/kernel.h>
+#include <linux/ktime.h>
 #include <linux/moduleparam.h>
+#include <linux/stringhash.h>
 
 #if DBG_CFG == 0
 #undef DEBUG
@@ -980,14 +983,70 @@ parse_cfg_entry(TfwCfgParserState *ps)
  * logic between these two cases.
  */
 
+/**
+ * Index of the specs found during the current parsing. Large configurations
+ * consist of many repeated entries of the same few specs, e.g. hundreds of
+ * vhosts each with a dozen of directives, so the first lookup of a directive
+ * in a specs array walks the array and the following lookups of the
+ * directive in the same array go through the hash table.
+ *
+ * The index is filled lazily and freed at the end of each parsing, so it
+ * never refers to specs of an unloaded module. Parsing is serialized by the
+ * caller, so no locking is needed.
+ *
+ * @hnode	- node in the hash table;
+ * @specs	- the specs array containing @spec;
+ * @spec	- the found spec;
+ * @hash	- hash of @specs and the spec name;
+ */
+typedef struct {
+	struct hlist_node	hnode;
+	const TfwCfgSpec	*specs;
+	TfwCfgSpec		*spec;
+	unsigned int		hash;
+} TfwCfgSpecIdx;
+
+#define TFW_CFG_SPEC_IDX_BITS	8
+
+static DEFINE_HASHTABLE(tfw_cfg_spec_idx, TFW_CFG_SPEC_IDX_BITS);
+
+static void
+spec_idx_free(void)
+{
+	TfwCfgSpecIdx *si;
+	struct hlist_node *tmp;
+	int b;
+
+	hash_for_each_safe(tfw_cfg_spec_idx, b, tmp, si, hnode) {
+		hash_del(&si->hnode);
+		kfree(si);
+	}
+}
+
 static TfwCfgSpec *
 spec_find(TfwCfgSpec specs[], const char *name)
 {
 	TfwCfgSpec *spec;
+	TfwCfgSpecIdx *si;
+	unsigned int hash = full_name_hash(specs, name, strlen(name));
+
+	hash_for_each_possible(tfw_cfg_spec_idx, si, hnode, hash) {
+		if (si->hash == hash && si->specs == specs
+		    && !strcmp(si->spec->name, name))
+			return si->spec;
+	}
 
 	TFW_CFG_FOR_EACH_SPEC(spec, specs) {
-		if (!strcmp(spec->name, name))
-			return spec;
+		if (strcmp(spec->name, name))
+			continue;
+		/* The index is only an optimization, so ignore ENOMEM. */
+		if ((si = kmalloc(sizeof(*si), GFP_KERNEL))) {
+			si->specs = specs;
+			si->spec = spec;
+			si->hash = hash;
+			hash_add(tfw_cfg_spec_idx, &si->hnode, hash);
+		}
+		return spec;
 	}
 
 	return NULL;
@@ -1825,10 +1884,21 @@ print_parse_error(const TfwCfgParserState *ps)
 TfwCfgSpec *
 tfw_cfg_spec_find(TfwCfgSpec specs[], const char *name)
 {
-	return spec_find(specs, name);
+	TfwCfgSpec *spec;
+
+	/* Don't populate the parsing index out of the parsing. */
+	TFW_CFG_FOR_EACH_SPEC(spec, specs) {
+		if (!strcmp(spec->name, name))
+			return spec;
+	}
+
+	return NULL;
 }
 EXPORT_SYMBOL(tfw_cfg_spec_find);
 
+/* Number of top-level entries to wait for the RCU callbacks after. */
+#define TFW_CFG_RCU_BATCH	256
+
 /**
  * The top-level parsing routine.
  *
@@ -1846,6 +1916,7 @@ tfw_cfg_parse_mods(const char *cfg_text, struct list_head *mod_list)
 	};
 	TfwMod *mod;
 	TfwCfgSpec *matching_spec = NULL;
+	unsigned int n = 0;
 	int r = -EINVAL;
 
 	MOD_FOR_EACH(mod, mod_list) {
@@ -1876,7 +1947,16 @@ tfw_cfg_parse_mods(const char *cfg_text, struct list_head *mod_list)
 			goto err;
 		entry_reset(&ps.e);
 
-		tfw_srv_loop_sched_rcu();
+		/*
+		 * Waiting for the RCU callbacks after each entry takes much
+		 * more time than the parsing itself for configurations with
+		 * thousands of top-level entries, so wait for them only
+		 * after a batch of entries.
+		 */
+		if (!(++n % TFW_CFG_RCU_BATCH))
+			tfw_srv_loop_sched_rcu();
+		else
+			cond_resched_rcu_qs();
 	} while (ps.t);
 
 	MOD_FOR_EACH(mod, mod_list) {
@@ -1884,11 +1964,13 @@ tfw_cfg_parse_mods(const char *cfg_text, struct list_head *mod_list)
 		if (r)
 			goto err;
 	}
+	spec_idx_free();
 
 	return 0;
 err:
 	print_parse_error(&ps);
 	entry_reset(&ps.e);
+	spec_idx_free();
 	return -EINVAL;
 }
 EXPORT_SYMBOL(tfw_cfg_parse_mods);
@@ -1916,14 +1998,21 @@ tfw_cfg_parse(struct list_head *mod_list)
 	int ret;
 	size_t file_size = 0;
 	char *cfg_text_buf;
+	ktime_t t0, t1;
 
 	T_DBG3("reading configuration file...\n");
+	t0 = ktime_get();
 	if (!(cfg_text_buf = tfw_cfg_read_file(tfw_cfg_path, &file_size, 0)))
 		return -ENOENT;
 
 	T_DBG2("parsing configuration and pushing it to modules...\n");
+	t1 = ktime_get();
 	if ((ret = tfw_cfg_parse_mods(cfg_text_buf, mod_list)))
 		T_DBG("Error parsing configuration data\n");
+	else
+		T_LOG_NL("Configuration of %zu bytes is read in %lldms and "
+			 "parsed in %lldms\n", file_size, ktime_ms_delta(t1, t0),
+			 ktime_ms_delta(ktime_get(), t1));
 
 	free_pages((unsigned long)cfg_text_buf, get_order(file_size));
 
@@ -21,6 +21,7 @@
  * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
  */
 #include <linux/hashtable.h>
+#include <linux/kernel.h>
 #include <linux/slab.h>
 
 #include "lib/hash.h"
@@ -38,6 +39,7 @@
 
 static struct {
 	unsigned int	db_size;
+	unsigned int	db_max_size;
 	const char	*db_path;
 	unsigned int	expires_time;
 } client_cfg __read_mostly;
@@ -66,7 +68,44 @@ typedef struct {
 	char		user_agent[UA_CMP_LEN];
 } TfwClientEntry;
 
-static TDB *client_db;
+/*
+ * The clients are sharded among the NUMA nodes with CPUs by the address
+ * hash, so the tables initialization, growth and sweeping don't contend
+ * among the nodes and each shard is allocated at its own node.
+ *
+ * @client_db		- the shards indexed by node;
+ * @client_nodes	- the nodes with the shards;
+ * @client_nodes_n	- number of the shards, zero if the table is closed;
+ */
+static TDB *client_db[MAX_NUMNODES];
+static int client_nodes[MAX_NUMNODES];
+static unsigned int client_nodes_n;
+
+/*
+ * Fixed-size key of a client address, without the generic hash function
+ * call: the common case is a client without X-Forwarded-For and User-Agent.
+ */
+static inline unsigned long
+tfw_client_addr_key(const struct in6_addr *addr)
+{
+	unsigned long crc0 = 0, crc1 = 0;
+
+	CRCQ(crc0, *(unsigned long *)&addr->s6_addr32[0]);
+	CRCQ(crc1, *(unsigned long *)&addr->s6_addr32[2]);
+
+	return (crc1 << 32) | crc0;
+}
+
+/*
+ * The shard of the client table for @key. TDB indexes the records by the
+ * lower bits of the key, so the shard is chosen by the upper ones.
+ */
+static inline TDB *
+tfw_client_db(unsigned long key)
+{
+	return client_db[client_nodes[reciprocal_scale(key >> 32,
+						       client_nodes_n)]];
+}
 
 /**
  * Called when a client socket is closed.
@@ -205,12 +244,10 @@ tfw_client_obtain(TfwAddr addr, TfwAddr *xff_addr, TfwStr *user_agent,
 
 	ctx.addr = addr;
 
-	key = hash_calc((const char *)&addr.sin6_addr,
-			sizeof(addr.sin6_addr));
+	key = tfw_client_addr_key(&addr.sin6_addr);
 
 	if (xff_addr) {
-		key ^= hash_calc((const char *)&xff_addr->sin6_addr,
-				 sizeof(xff_addr->sin6_addr));
+		key ^= tfw_client_addr_key(&xff_addr->sin6_addr);
 		ctx.xff_addr = *xff_addr;
 	} else {
 		ctx.xff_addr.sin6_addr = any_addr;
@@ -227,7 +264,7 @@ tfw_client_obtain(TfwAddr addr, TfwAddr *xff_addr, TfwStr *user_agent,
 	tdb_ctx.init_rec = tfw_client_ent_init;
 	tdb_ctx.len = sizeof(TfwClientEntry);
 	tdb_ctx.ctx = &ctx;
-	rec = tdb_rec_get_alloc(client_db, key, &tdb_ctx);
+	rec = tdb_rec_get_alloc(tfw_client_db(key), key, &tdb_ctx);
 	BUG_ON(tdb_ctx.len < sizeof(TfwClientEntry));
 	if (!rec) {
 		T_WARN("cannot allocate TDB space for client\n");
@@ -248,15 +285,57 @@ tfw_client_obtain(TfwAddr addr, TfwAddr *xff_addr, TfwStr *user_agent,
 }
 EXPORT_SYMBOL(tfw_client_obtain);
 
+/**
+ * Find the client obtained for @addr only, i.e. on the connection level,
+ * without allocating a new one or taking a reference. The result is intended
+ * for peeking into the accounting data of a client which hasn't expired yet:
+ * the entry may be reused for another peer as soon as the client expires.
+ */
+TfwClient *
+tfw_client_lookup(const TfwAddr *addr)
+{
+	TDB *db;
+	TdbIter iter;
+	unsigned long key;
+
+	if (unlikely(!READ_ONCE(client_nodes_n)))
+		return NULL;
+
+	key = tfw_client_addr_key(&addr->sin6_addr);
+	db = tfw_client_db(key);
+	iter = tdb_rec_get(db, key);
+	while (!TDB_ITER_BAD(iter)) {
+		TfwClientEntry *ent = (TfwClientEntry *)iter.rec->data;
+
+		if (!memcmp_fast(&ent->cli.addr.sin6_addr, &addr->sin6_addr,
+				 sizeof(addr->sin6_addr))
+		    && !memcmp_fast(&ent->xff_addr.sin6_addr, &any_addr,
+				    sizeof(any_addr))
+		    && !ent->user_agent_len
+		    && READ_ONCE(ent->expires) >= tfw_current_timestamp())
+		{
+			tdb_rec_put(iter.rec);
+			return &ent->cli;
+		}
+		tdb_rec_next(db, &iter);
+	}
+
+	return NULL;
+}
+
 /**
  * Beware: @fn is called under client hash bucket spin lock.
  */
 int
 tfw_client_for_each(int (*fn)(void *))
 {
-	if (!client_db)
-		return 0;
-	return tdb_entry_walk(client_db, fn);
+	int i, r;
+
+	for (i = 0; i < client_nodes_n; ++i)
+		if ((r = tdb_entry_walk(client_db[client_nodes[i]], fn)))
+			return r;
+
+	return 0;
 }
 
 void
@@ -267,9 +346,43 @@ tfw_client_set_expires_time(unsigned int expires_time)
 	}
 }
 
+/**
+ * Called by the TDB sweeper under the bucket lock, so nobody can obtain
+ * the client concurrently.
+ */
+static bool
+tfw_client_expired(void *data)
+{
+	bool expired;
+	TfwClientEntry *ent = (TfwClientEntry *)data;
+
+	/* The entry is just allocated and isn't initialized yet. */
+	if (!READ_ONCE(ent->expires))
+		return false;
+
+	spin_lock(&ent->lock);
+	expired = !atomic_read(&ent->users)
+		  && tfw_current_timestamp() > ent->expires;
+	spin_unlock(&ent->lock);
+
+	return expired;
+}
+
+static void
+tfw_client_db_close(unsigned int n)
+{
+	while (n--) {
+		tdb_close(client_db[client_nodes[n]]);
+		client_db[client_nodes[n]] = NULL;
+	}
+}
+
 static int
 tfw_client_start(void)
 {
+	int nid;
+	unsigned int n = 0;
+
 	if (tfw_runstate_is_reconfig())
 		return 0;
 	/*
@@ -278,10 +391,19 @@ tfw_client_start(void)
 	 * grows, while big ones has constant location.
 	 */
 	BUILD_BUG_ON(sizeof(TfwClientEntry) <= TDB_HTRIE_MINDREC);
-	client_db = tdb_open(client_cfg.db_path, client_cfg.db_size,
-			     sizeof(TfwClientEntry), numa_node_id());
-	if (!client_db)
-		return -EINVAL;
+	for_each_node_with_cpus(nid) {
+		TDB *db = tdb_open_grow(client_cfg.db_path, client_cfg.db_size,
+					client_cfg.db_max_size,
+					sizeof(TfwClientEntry), nid);
+		if (!db) {
+			tfw_client_db_close(n);
+			return -EINVAL;
+		}
+		tdb_entry_expiry(db, tfw_client_expired);
+		client_db[nid] = db;
+		client_nodes[n++] = nid;
+	}
+	WRITE_ONCE(client_nodes_n, n);
 
 	return 0;
 }
@@ -289,10 +411,12 @@ tfw_client_start(void)
 static void
 tfw_client_stop(void)
 {
+	unsigned int n = client_nodes_n;
+
 	if (tfw_runstate_is_reconfig())
 		return;
-	if (client_db)
-		tdb_close(client_db);
+	WRITE_ONCE(client_nodes_n, 0);
+	tfw_client_db_close(n);
 }
 
 static TfwCfgSpec tfw_client_specs[] = {
@@ -306,6 +430,16 @@ static TfwCfgSpec tfw_client_specs[] = {
 			.range = { PAGE_SIZE, (1 << 30) },
 		}
 	},
+	{
+		.name = "client_tbl_max_size",
+		.deflt = "0",
+		.handler = tfw_cfg_set_int,
+		.dest = &client_cfg.db_max_size,
+		.spec_ext = &(TfwCfgSpecInt) {
+			.multiple_of = PAGE_SIZE,
+			.range = { 0, (1 << 30) },
+		}
+	},
 	{
 		.name = "client_db",
 		.deflt = "/opt/tempesta/db/client.tdb",
@@ -38,6 +38,7 @@ typedef struct {
 
 TfwClient *tfw_client_obtain(TfwAddr addr, TfwAddr *cli_addr,
 			     TfwStr *user_agent, void (*init)(void *));
+TfwClient *tfw_client_lookup(const TfwAddr *addr);
 void tfw_client_put(TfwClient *cli);
 int tfw_client_for_each(int (*fn)(void *));
 void tfw_client_set_expires_time(unsigned int expires_time);
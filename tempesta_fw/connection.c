@@ -22,6 +22,7 @@
  */
 #include "connection.h"
 #include "gfsm.h"
+#include "http_trace.h"
 #include "log.h"
 #include "sync_socket.h"
 
@@ -52,6 +53,8 @@ tfw_connection_link_peer(TfwConn *conn, TfwPeer *peer)
 int
 tfw_connection_new(TfwConn *conn)
 {
+	trace_tfw_conn_new(conn, TFW_CONN_TYPE(conn));
+
 	return TFW_CONN_HOOK_CALL(conn, conn_init);
 }
 
@@ -67,6 +70,8 @@ tfw_connection_repair(TfwConn *conn)
 int
 tfw_connection_close(TfwConn *conn, bool sync)
 {
+	trace_tfw_conn_close(conn, TFW_CONN_TYPE(conn));
+
 	return TFW_CONN_HOOK_CALL(conn, conn_close, sync);
 }
 
@@ -76,6 +81,7 @@ tfw_connection_close(TfwConn *conn, bool sync)
 void
 tfw_connection_drop(TfwConn *conn)
 {
+	trace_tfw_conn_drop(conn, TFW_CONN_TYPE(conn));
 	/* Ask higher levels to free resources at connection close. */
 	TFW_CONN_HOOK_CALL(conn, conn_drop);
 	BUG_ON(conn->stream.msg);
@@ -87,6 +93,7 @@ tfw_connection_drop(TfwConn *conn)
 void
 tfw_connection_release(TfwConn *conn)
 {
+	trace_tfw_conn_release(conn, TFW_CONN_TYPE(conn));
 	/* Ask higher levels to free resources at connection release. */
 	TFW_CONN_HOOK_CALL(conn, conn_release);
 	BUG_ON((TFW_CONN_TYPE(conn) & Conn_Clnt)
@@ -110,15 +117,47 @@ tfw_connection_send(TfwConn *conn, TfwMsg *msg)
 	return TFW_CONN_HOOK_CALL(conn, conn_send, msg);
 }
 
+/*
+ * Process the batch of skbs received on the connection socket, see
+ * ss_tcp_process_data(). The HTTP layer walks the whole batch in one FSM
+ * shot. TLS records are placed into the TLS context skb by skb, so the skbs
+ * are passed to the TLS layer one by one, and the HTTP layer gets them
+ * in batches of decrypted records.
+ */
 int
 tfw_connection_recv(void *cdata, struct sk_buff *skb)
 {
+	int r = T_OK;
 	TfwConn *conn = cdata;
+	struct sock *sk = conn->sk;
+	struct sk_buff *next;
 	TfwFsmData fsm_data = {
 		.skb = skb,
 	};
 
-	return tfw_gfsm_dispatch(&conn->state, conn, &fsm_data);
+	if (!TFW_CONN_TLS(conn))
+		return tfw_gfsm_dispatch(&conn->state, conn, &fsm_data);
+
+	if (skb->prev)
+		skb->prev->next = NULL;
+	for ( ; skb; skb = next) {
+		next = skb->next;
+		skb->next = skb->prev = NULL;
+		if (unlikely((r != T_OK && r != T_POSTPONE)
+			     || (TFW_CONN_TYPE(conn) & Conn_Stop)))
+		{
+			__kfree_skb(skb);
+			continue;
+		}
+		if (unlikely(sk->sk_user_data != conn)) {
+			r = SS_CALL(connection_recv, sk->sk_user_data, skb);
+			continue;
+		}
+		fsm_data.skb = skb;
+		r = tfw_gfsm_dispatch(&conn->state, conn, &fsm_data);
+	}
+
+	return r;
 }
 
 void
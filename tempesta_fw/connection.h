@@ -23,6 +23,7 @@
 #ifndef __TFW_CONNECTION_H__
 #define __TFW_CONNECTION_H__
 
+#include <linux/llist.h>
 #include <net/sock.h>
 
 #include "gfsm.h"
@@ -30,6 +31,7 @@
 #include "sync_socket.h"
 #include "http_frame.h"
 #include "tls.h"
+#include "twheel.h"
 
 /*
  * Flag bits definition for SsProto.type field.
@@ -77,28 +79,33 @@ enum {
  * a separate reference counter in @peer.
  *
  * These are the properties of a connection that are common to client
- * and server connections.
+ * and server connections. The members used on each message are placed
+ * first to fit the first cache line along with the head of @state, the
+ * connection caches are cache line aligned.
  *
  * @proto	- protocol handler. Base class, must be first;
- * @state	- connection processing state;
- * @list	- member in the list of connections with @peer;
  * @refcnt	- number of users of the connection structure instance;
- * @timer	- The keep-alive/retry timer for the connection;
- * @stream	- instance for control messages processing;
- * @peer	- TfwClient or TfwServer handler. Hop-by-hop peer;
+ * @hdrs_avg	- moving average of the header table usage by the messages
+ *		  of the connection, a sizing hint for the next messages;
  * @sk		- an appropriate sock handler;
+ * @peer	- TfwClient or TfwServer handler. Hop-by-hop peer;
+ * @state	- connection processing state;
  * @destructor	- called when a connection is destroyed;
+ * @list	- member in the list of connections with @peer;
+ * @timer	- The retry timer for server connections;
+ * @stream	- instance for control messages processing;
  */
 #define TFW_CONN_COMMON					\
 	SsProto			proto;			\
+	atomic_t		refcnt;			\
+	unsigned short		hdrs_avg;		\
+	struct sock		*sk;			\
+	TfwPeer 		*peer;			\
 	TfwGState		state;			\
+	void			(*destructor)(void *);	\
 	struct list_head	list;			\
-	atomic_t		refcnt;			\
 	struct timer_list	timer;			\
-	TfwStream		stream;			\
-	TfwPeer 		*peer;			\
-	struct sock		*sk;			\
-	void			(*destructor)(void *);
+	TfwStream		stream;
 
 typedef struct {
 	TFW_CONN_COMMON;
@@ -141,20 +148,50 @@ typedef struct {
  * That way NO locking hierarchy is involved. Please see the code.
  */
 
+typedef struct tfw_tun_conn_t TfwTunConn;
+
 /*
  * These are specific properties that are relevant to client connections.
  *
  * @seq_queue	- queue of client's messages in the order they came;
  * @seq_qlock	- lock for accessing @seq_queue;
  * @ret_qlock	- lock for serializing sets of responses;
+ * @tunnel	- server side of the connection upgraded by a server, NULL
+ *		  for HTTP connections or TFW_CONN_TUN_CLOSED if the client
+ *		  connection is being closed;
+ * @ka_timer	- keepalive timer, used instead of @timer to not relink
+ *		  the timer on each message sent to the client;
  */
 typedef struct {
 	TFW_CONN_COMMON;
 	struct list_head	seq_queue;
 	spinlock_t		seq_qlock;
 	spinlock_t		ret_qlock;
+	TfwTunConn		*tunnel;
+	TfwTimer		ka_timer;
 } TfwCliConn;
 
+/*
+ * Server side of a tunnel, to which a client connection is switched once
+ * a server upgrades it, e.g. to WebSocket. The data is passed between the
+ * client and the server sockets as is. The tunnel takes over the socket of
+ * a server connection, which is re-established then, so it carries only
+ * the data needed by Sync Sockets layer and to reach the client.
+ *
+ * @proto	- Sync Sockets protocol descriptor, must be the first member;
+ * @refcnt	- references by the socket and by the client connection;
+ * @sk		- the server socket;
+ * @cli_conn	- client side of the tunnel, referenced by the tunnel;
+ */
+struct tfw_tun_conn_t {
+	SsProto			proto;
+	atomic_t		refcnt;
+	struct sock		*sk;
+	TfwCliConn		*cli_conn;
+};
+
+#define TFW_CONN_TUN_CLOSED	((TfwTunConn *)ERR_PTR(-ENOTCONN))
+
 /*
  * These are specific properties that are relevant to server connections.
  * See the description of special features of this structure in sock_srv.c.
@@ -162,23 +199,37 @@ typedef struct {
  * @fwd_queue	- queue of messages to be sent to a back-end server;
  * @nip_queue	- queue of non-idempotent messages in server's @fwd_queue;
  * @fwd_qlock	- lock for accessing @fwd_queue and @nip_queue;
+ * @fwd_pend	- requests to be added to @fwd_queue by the lock holder;
  * @flags	- atomic flags related to server connection's state;
  * @qsize	- current number of requests in server's @fwd_queue;
  * @recns	- the number of reconnect attempts;
+ * @cpu		- CPU, to which RSS directs the connection's packets;
  * @msg_sent	- request that was sent last in a server connection;
  * @jbusytstamp - timestamp (in jiffies) until which connection is considered
  *		  as inactive due to busy corresponding work queue;
+ * @jtxtstamp	- timestamp (in jiffies) of the last request queued to the
+ *		  connection;
+ * @rx_timer	- timer polling @rx_wait while receiving is paused;
+ * @rx_wait	- slow client connection, for which receiving from the server
+ *		  connection is paused;
+ * @rx_held	- amount of data queued to @rx_wait at the last check;
  */
 typedef struct {
 	TFW_CONN_COMMON;
 	struct list_head	fwd_queue;
 	struct list_head	nip_queue;
 	spinlock_t		fwd_qlock;
+	struct llist_head	fwd_pend;
 	unsigned long		flags;
 	unsigned int		qsize;
 	unsigned int		recns;
+	int			cpu;
 	TfwMsg			*msg_sent;
 	unsigned long		jbusytstamp;
+	unsigned long		jtxtstamp;
+	struct timer_list	rx_timer;
+	TfwCliConn		*rx_wait;
+	long			rx_held;
 } TfwSrvConn;
 
 #define TFW_CONN_DEATHCNT	(INT_MIN / 2)
@@ -197,15 +248,23 @@ enum {
 	/* Connection is in use or at least scheduled to be established. */
 	TFW_CONN_B_ACTIVE,
 	/* Connection is disconnected and stopped. */
-	TFW_CONN_B_STOPPED
+	TFW_CONN_B_STOPPED,
+	/* Receiving is paused until a slow client reads its data. */
+	TFW_CONN_B_RX_PAUSED,
+	/* Established connection kept unscheduled to replace a failed one. */
+	TFW_CONN_B_SPARE
 };
 
 /**
  * TLS hardened connection.
+ *
+ * @sign_node	- entry in the queue of a crypto worker signing the server
+ *		  handshake flight;
  */
 typedef struct {
-	TfwCliConn	cli_conn;
-	TlsCtx		tls;
+	TfwCliConn		cli_conn;
+	TlsCtx			tls;
+	struct llist_node	sign_node;
 } TfwTlsConn;
 
 #define tfw_tls_context(conn)	((TlsCtx *)(&((TfwTlsConn *)conn)->tls))
@@ -295,6 +354,28 @@ tfw_srv_conn_restricted(TfwSrvConn *srv_conn)
 	return test_bit(TFW_CONN_B_RESEND, &srv_conn->flags);
 }
 
+/*
+ * Tell if a connection is a spare one. A spare connection is established,
+ * but is not available to schedulers until another connection to the same
+ * server fails.
+ */
+static inline bool
+tfw_srv_conn_spare(TfwSrvConn *srv_conn)
+{
+	return test_bit(TFW_CONN_B_SPARE, &srv_conn->flags);
+}
+
+/*
+ * Tell if a connection is served by the current CPU, so a request sent
+ * through it and the response to it don't go through the cross-CPU work
+ * queues. Must be called with softirqs disabled.
+ */
+static inline bool
+tfw_srv_conn_local(TfwSrvConn *srv_conn)
+{
+	return READ_ONCE(srv_conn->cpu) == smp_processor_id();
+}
+
 /*
  * Tell if a connection has non-idempotent requests.
  */
@@ -507,4 +588,8 @@ void tfw_connection_release(TfwConn *conn);
 
 int tfw_connection_recv(void *cdata, struct sk_buff *skb);
 
+/* Tunnels of upgraded client connections, see sock_srv.c. */
+int tfw_sock_srv_tunnel(TfwSrvConn *srv_conn, TfwCliConn *cli_conn);
+void tfw_sock_srv_tunnel_close(TfwCliConn *cli_conn);
+
 #endif /* __TFW_CONNECTION_H__ */
@@ -33,6 +33,7 @@
  * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
  */
 #include <linux/module.h>
+#include <linux/netdevice.h>
 #include <linux/netfilter.h>
 #include <linux/netfilter_ipv4.h>
 #include <linux/netfilter_ipv6.h>
@@ -45,22 +46,49 @@
 #include "http_limits.h"
 #include "filter.h"
 #include "log.h"
+#include "lpm.h"
 
 enum {
 	TFW_F_DROP,
 };
 
+/* Value of denied prefixes in the filter prefixes set. */
+#define TFW_F_LPM_DENY		1
+
 typedef struct {
 	struct in6_addr	addr;
 	int		action;
 } TfwFRule;
 
+/*
+ * Ingress filtering hook of a network device.
+ */
+typedef struct {
+	struct list_head	list;
+	struct nf_hook_ops	ops;
+} TfwIngressHook;
+
 static struct {
 	unsigned int	db_size;
 	const char	*db_path;
+	bool		ingress;
 } filter_cfg __read_mostly;
 
 static TDB *ip_filter_db;
+/*
+ * Denied prefixes, the active set used by the netfilter hooks and the set
+ * being built from the new configuration.
+ */
+static TfwLpm __rcu *tfw_filter_lpm;
+static TfwLpm *tfw_filter_lpm_reconfig;
+/* Ingress hooks of all the network devices, protected by RTNL. */
+static LIST_HEAD(tfw_ingress_hooks);
+/*
+ * True if all the network devices have the ingress hooks, so the blocked
+ * clients needn't be checked on the IP layer.
+ */
+static bool tfw_ingress_all __read_mostly;
+static bool tfw_ingress_on;
 
 static unsigned long
 tfw_ipv6_hash(const struct in6_addr *addr)
@@ -83,7 +111,6 @@ tfw_filter_block_ip(const TfwAddr *addr)
 
 	T_DBG_ADDR("filter: block", addr, TFW_NO_PORT);
 
-	/* TODO create records on all NUMA nodes. */
 	if (!tdb_entry_create(ip_filter_db, key, &rule, &len)) {
 		T_WARN_ADDR("cannot create blocking rule", addr, TFW_NO_PORT);
 	} else {
@@ -102,6 +129,12 @@ static int
 tfw_filter_check_ip(struct in6_addr *addr)
 {
 	TdbIter iter;
+	TfwLpm *lpm;
+
+	/* Netfilter hooks are called under RCU read lock. */
+	lpm = rcu_dereference(tfw_filter_lpm);
+	if (lpm && tfw_lpm_lookup(lpm, addr) == TFW_F_LPM_DENY)
+		return TFW_BLOCK;
 
 	iter = tdb_rec_get(ip_filter_db, tfw_ipv6_hash(addr));
 	while (!TDB_ITER_BAD(iter)) {
@@ -159,7 +192,8 @@ tfw_ipv4_nf_hook(void *priv, struct sk_buff *skb,
 
 	ipv6_addr_set_v4mapped(ih->saddr, &addr6);
 
-	if (tfw_filter_check_ip(&addr6) == TFW_BLOCK)
+	if (!READ_ONCE(tfw_ingress_all)
+	    && tfw_filter_check_ip(&addr6) == TFW_BLOCK)
 		return NF_DROP;
 
 	/* Check classifiers for Layer 3. */
@@ -241,7 +275,8 @@ tfw_ipv6_nf_hook(void *priv, struct sk_buff *skb,
 	if (!ih)
 		return NF_DROP;
 
-	if (tfw_filter_check_ip(&ih->saddr) == TFW_BLOCK)
+	if (!READ_ONCE(tfw_ingress_all)
+	    && tfw_filter_check_ip(&ih->saddr) == TFW_BLOCK)
 		return NF_DROP;
 
 	/* Check classifiers for Layer 3. */
@@ -271,6 +306,99 @@ static struct nf_hook_ops tfw_nf_ops[] __read_mostly = {
 	},
 };
 
+/**
+ * Drop packets from blocked clients right after the packets are received
+ * by a network device, before any protocol handling. Malformed packets are
+ * passed to the IP layer which drops them.
+ */
+static unsigned int
+tfw_ingress_nf_hook(void *priv, struct sk_buff *skb,
+		    const struct nf_hook_state *state)
+{
+	struct in6_addr addr6;
+
+	switch (skb->protocol) {
+	case htons(ETH_P_IP):
+		if (!pskb_may_pull(skb, sizeof(struct iphdr)))
+			return NF_ACCEPT;
+		ipv6_addr_set_v4mapped(ip_hdr(skb)->saddr, &addr6);
+		break;
+	case htons(ETH_P_IPV6):
+		if (!pskb_may_pull(skb, sizeof(struct ipv6hdr)))
+			return NF_ACCEPT;
+		addr6 = ipv6_hdr(skb)->saddr;
+		break;
+	default:
+		return NF_ACCEPT;
+	}
+
+	return tfw_filter_check_ip(&addr6) == TFW_BLOCK ? NF_DROP : NF_ACCEPT;
+}
+
+static void
+tfw_ingress_hook_add(struct net_device *dev)
+{
+	int r = -ENOMEM;
+	TfwIngressHook *h;
+
+	if (!(h = kzalloc(sizeof(TfwIngressHook), GFP_KERNEL)))
+		goto err;
+	h->ops.hook = tfw_ingress_nf_hook;
+	h->ops.pf = NFPROTO_NETDEV;
+	h->ops.hooknum = NF_NETDEV_INGRESS;
+	h->ops.priority = INT_MIN;
+	h->ops.dev = dev;
+	if ((r = nf_register_net_hook(dev_net(dev), &h->ops))) {
+		kfree(h);
+		goto err;
+	}
+	list_add(&h->list, &tfw_ingress_hooks);
+
+	return;
+err:
+	/* Fall back to the IP layer filtering for all the devices. */
+	WRITE_ONCE(tfw_ingress_all, false);
+	T_WARN("filter: can't add ingress hook for %s, err=%d\n",
+	       dev->name, r);
+}
+
+static void
+tfw_ingress_hook_del(struct net_device *dev)
+{
+	TfwIngressHook *h;
+
+	list_for_each_entry(h, &tfw_ingress_hooks, list) {
+		if (h->ops.dev != dev)
+			continue;
+		nf_unregister_net_hook(dev_net(dev), &h->ops);
+		list_del(&h->list);
+		kfree(h);
+		return;
+	}
+}
+
+static int
+tfw_ingress_dev_event(struct notifier_block *nb, unsigned long event,
+		      void *ptr)
+{
+	struct net_device *dev = netdev_notifier_info_to_dev(ptr);
+
+	switch (event) {
+	case NETDEV_REGISTER:
+		tfw_ingress_hook_add(dev);
+		break;
+	case NETDEV_UNREGISTER:
+		tfw_ingress_hook_del(dev);
+		break;
+	}
+
+	return NOTIFY_DONE;
+}
+
+static struct notifier_block tfw_ingress_nb = {
+	.notifier_call = tfw_ingress_dev_event,
+};
+
 static int
 tfw_nf_register(struct net *net)
 {
@@ -288,26 +416,83 @@ static struct pernet_operations tfw_net_ops = {
 	.exit = tfw_nf_unregister,
 };
 
+/*
+ * Replace the active denied prefixes set with the newly configured one.
+ */
+static void
+tfw_filter_lpm_apply(void)
+{
+	TfwLpm *old = rcu_dereference_protected(tfw_filter_lpm, 1);
+
+	if (tfw_filter_lpm_reconfig)
+		T_DBG("filter: %lu nodes in denied prefixes set\n",
+		      tfw_filter_lpm_reconfig->nodes);
+	rcu_assign_pointer(tfw_filter_lpm, tfw_filter_lpm_reconfig);
+	tfw_filter_lpm_reconfig = NULL;
+	if (old) {
+		synchronize_net();
+		tfw_lpm_free(old);
+	}
+}
+
+/*
+ * Free the active denied prefixes set when the netfilter hooks are removed.
+ */
+static void
+tfw_filter_lpm_free(void)
+{
+	tfw_lpm_free(rcu_dereference_protected(tfw_filter_lpm, 1));
+	RCU_INIT_POINTER(tfw_filter_lpm, NULL);
+}
+
 static int
 tfw_filter_start(void)
 {
 	int r;
 
-	if (tfw_runstate_is_reconfig())
+	/* Denied prefixes can be changed on live reconfiguration. */
+	if (tfw_runstate_is_reconfig()) {
+		tfw_filter_lpm_apply();
 		return 0;
+	}
 
+	/* The filter is checked for each packet on all the nodes. */
 	ip_filter_db = tdb_open(filter_cfg.db_path, filter_cfg.db_size,
-				sizeof(TfwFRule), numa_node_id());
+				sizeof(TfwFRule), TDB_REPLICATED);
 	if (!ip_filter_db)
 		return -EINVAL;
+	tfw_filter_lpm_apply();
+
+	/*
+	 * The notifier adds the ingress hooks for all the existing network
+	 * devices on registration, and removes them on unregistration.
+	 */
+	if (filter_cfg.ingress) {
+		tfw_ingress_all = true;
+		if ((r = register_netdevice_notifier(&tfw_ingress_nb))) {
+			T_ERR_NL("can't register ingress filtering\n");
+			goto err_ingress;
+		}
+		tfw_ingress_on = true;
+	}
 
 	if ((r = register_pernet_subsys(&tfw_net_ops)))	{
 		T_ERR_NL("can't register netfilter hooks\n");
-		tdb_close(ip_filter_db);
-		return r;
+		goto err_nf;
 	}
 
 	return 0;
+err_nf:
+	if (tfw_ingress_on) {
+		unregister_netdevice_notifier(&tfw_ingress_nb);
+		tfw_ingress_on = false;
+	}
+err_ingress:
+	tfw_ingress_all = false;
+	tfw_filter_lpm_free();
+	tdb_close(ip_filter_db);
+	ip_filter_db = NULL;
+	return r;
 }
 
 static void
@@ -317,8 +502,90 @@ tfw_filter_stop(void)
 		return;
 	if (ip_filter_db) {
 		unregister_pernet_subsys(&tfw_net_ops);
+		if (tfw_ingress_on) {
+			unregister_netdevice_notifier(&tfw_ingress_nb);
+			tfw_ingress_all = tfw_ingress_on = false;
+		}
 		tdb_close(ip_filter_db);
+		ip_filter_db = NULL;
+	}
+	tfw_filter_lpm_free();
+}
+
+static int
+tfw_cfgop_filter_deny_add(const char *prefix)
+{
+	TfwAddr addr;
+
+	if (tfw_addr_pton_cidr(prefix, &addr)) {
+		T_ERR_NL("filter: invalid address prefix: '%s'\n", prefix);
+		return -EINVAL;
 	}
+	if (!tfw_filter_lpm_reconfig
+	    && !(tfw_filter_lpm_reconfig = tfw_lpm_new()))
+		return -ENOMEM;
+
+	return tfw_lpm_insert(tfw_filter_lpm_reconfig, &addr.sin6_addr,
+			      addr.in6_prefix, TFW_F_LPM_DENY);
+}
+
+static int
+tfw_cfgop_filter_deny(TfwCfgSpec *cs, TfwCfgEntry *ce)
+{
+	int r;
+	size_t i;
+	const char *val;
+
+	if (!ce->val_n) {
+		T_ERR_NL("%s: at least one address prefix is required\n",
+			 cs->name);
+		return -EINVAL;
+	}
+	TFW_CFG_ENTRY_FOR_EACH_VAL(ce, i, val)
+		if ((r = tfw_cfgop_filter_deny_add(val)))
+			return r;
+
+	return 0;
+}
+
+/*
+ * Load a large list of denied prefixes from a file, one prefix per line.
+ * Empty lines and lines starting with '#' are skipped.
+ */
+static int
+tfw_cfgop_filter_deny_file(TfwCfgSpec *cs, TfwCfgEntry *ce)
+{
+	int r = 0;
+	size_t size;
+	unsigned int n = 0;
+	char *data, *p, *line;
+
+	if (tfw_cfg_check_single_val(ce))
+		return -EINVAL;
+	if (!(data = tfw_cfg_read_file(ce->vals[0], &size, 0)))
+		return -EINVAL;
+
+	for (p = data; (line = strsep(&p, "\n")); ) {
+		++n;
+		line = strim(line);
+		if (!*line || *line == '#')
+			continue;
+		if ((r = tfw_cfgop_filter_deny_add(line))) {
+			T_ERR_NL("%s: bad line %u in '%s'\n", cs->name, n,
+				 ce->vals[0]);
+			break;
+		}
+	}
+	free_pages((unsigned long)data, get_order(size));
+
+	return r;
+}
+
+static void
+tfw_cfgop_cleanup_filter_deny(TfwCfgSpec *cs)
+{
+	tfw_lpm_free(tfw_filter_lpm_reconfig);
+	tfw_filter_lpm_reconfig = NULL;
 }
 
 static TfwCfgSpec tfw_filter_specs[] = {
@@ -341,6 +608,30 @@ static TfwCfgSpec tfw_filter_specs[] = {
 			.len_range = { 1, PATH_MAX },
 		}
 	},
+	{
+		.name = "filter_ingress",
+		.deflt = "off",
+		.handler = tfw_cfg_set_bool,
+		.dest = &filter_cfg.ingress,
+	},
+	{
+		.name = "filter_deny",
+		.deflt = NULL,
+		.handler = tfw_cfgop_filter_deny,
+		.allow_repeat = true,
+		.allow_none = true,
+		.allow_reconfig = true,
+		.cleanup = tfw_cfgop_cleanup_filter_deny,
+	},
+	{
+		.name = "filter_deny_file",
+		.deflt = NULL,
+		.handler = tfw_cfgop_filter_deny_file,
+		.allow_repeat = true,
+		.allow_none = true,
+		.allow_reconfig = true,
+		.cleanup = tfw_cfgop_cleanup_filter_deny,
+	},
 	{ 0 }
 };
 
@@ -0,0 +1,361 @@
+/**
+ *		Tempesta FW
+ *
+ * HTTP/1 request method state machine generator.
+ *
+ * The grammar at the below is a list of methods with their enum values. The
+ * program prints the switch over the first 4 bytes for the rare methods, the
+ * switch over the first character and the 1-character states for fragmented
+ * methods. All of them are used by Req_Method of tfw_http_parse_req().
+ *
+ * Copyright (C) 2020 Tempesta Technologies, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#include <assert.h>
+#include <ctype.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Column of the line continuation backslashes of the printed macros. */
+#define BS_COL		72
+#define NAME_MAX_LEN	16
+
+typedef struct {
+	const char	*name;
+	int		hot;
+} Meth;
+
+/*
+ * The methods in the order of the 1-character switch. @hot methods are
+ * matched by the hand-written fast path of Req_Method, so they're excluded
+ * from the 4-byte switch.
+ */
+static const Meth grammar[] = {
+	{"GET",		1},
+	{"HEAD",	0},
+	{"POST",	1},
+	{"PATCH",	0},
+	{"PROPFIND",	0},
+	{"PROPPATCH",	0},
+	/* PURGE Method for Tempesta Configuration. */
+	{"PURGE",	0},
+	{"PUT",		0},
+	{"COPY",	0},
+	{"DELETE",	0},
+	{"LOCK",	0},
+	{"MKCOL",	0},
+	{"MOVE",	0},
+	{"OPTIONS",	0},
+	{"TRACE",	0},
+	{"UNLOCK",	0},
+};
+
+#define GR_N		(sizeof(grammar) / sizeof(grammar[0]))
+
+static char line[256];
+static int line_n;
+/* Indentation of the macro body. */
+static int base;
+
+/* Print the accumulated macro line padded to the backslash column. */
+static void
+ln_end(int last)
+{
+	int w = 0, i;
+
+	for (i = 0; i < line_n; i++)
+		w = line[i] == '\t' ? (w / 8 + 1) * 8 : w + 1;
+	assert(w < BS_COL);
+
+	fwrite(line, 1, line_n, stdout);
+	if (!last) {
+		while (w < BS_COL) {
+			putchar('\t');
+			w = (w / 8 + 1) * 8;
+		}
+		putchar('\\');
+	}
+	putchar('\n');
+	line_n = 0;
+}
+
+static void __attribute__((format(printf, 2, 3)))
+ln(int indent, const char *fmt, ...)
+{
+	va_list ap;
+
+	if (line_n)
+		ln_end(0);
+	for (indent += base; indent; indent--)
+		line[line_n++] = '\t';
+	va_start(ap, fmt);
+	line_n += vsnprintf(line + line_n, sizeof(line) - line_n, fmt, ap);
+	va_end(ap);
+	assert(line_n < sizeof(line));
+}
+
+/* Parser state name for prefix @n characters long of method @m. */
+static const char *
+st_name(const char *m, size_t n)
+{
+	static char buf[2][32];
+	static int k;
+	char *s = buf[k ^= 1];
+	size_t i;
+
+	i = sprintf(s, "Req_Meth%c", m[0]);
+	for (n--, m++; n; n--, m++)
+		s[i++] = tolower(*m);
+	s[i] = '\0';
+
+	return s;
+}
+
+/* Index of the first method, which has the same @n characters as @m. */
+static size_t
+prefix_first(const char *m, size_t n)
+{
+	size_t i;
+
+	for (i = 0; i < GR_N; i++)
+		if (!strncmp(grammar[i].name, m, n))
+			break;
+	return i;
+}
+
+/* Number of different characters following the @n characters of @m. */
+static size_t
+prefix_branches(const char *m, size_t n)
+{
+	size_t i, r = 0;
+
+	for (i = 0; i < GR_N; i++)
+		if (!strncmp(grammar[i].name, m, n)
+		    && prefix_first(grammar[i].name, n + 1) == i)
+			r++;
+	return r;
+}
+
+static void
+grammar_check(void)
+{
+	size_t i, j;
+
+	for (i = 0; i < GR_N; i++) {
+		const char *m = grammar[i].name;
+
+		assert(strlen(m) >= 2 && strlen(m) < NAME_MAX_LEN);
+		for (j = 0; j < GR_N; j++)
+			/* A method mustn't be a prefix of other method. */
+			assert(i == j || strncmp(m, grammar[j].name,
+						 strlen(m)));
+	}
+}
+
+/*
+ * Number of bytes read by the 4-byte switch: methods, which are 1 character
+ * shorter than a 4-byte word boundary, are matched with the trailing SP.
+ */
+static size_t
+meth_read_len(const char *m)
+{
+	size_t n = strlen(m);
+
+	return n % 4 == 3 ? n + 1 : n;
+}
+
+static void
+print_cond(const char *m, size_t len)
+{
+	size_t i = 4;
+	const char *op = "if (likely(";
+
+	for ( ; i + 4 <= len; i += 4) {
+		ln(1, "%sPI(p + %zu)", op, i);
+		ln(1, "    == TFW_CHAR4_INT('%c', '%c', '%c', '%c')",
+		   m[i], m[i + 1], m[i + 2], m[i + 3] ? m[i + 3] : ' ');
+		op = "    && ";
+	}
+	for ( ; i < len; i++) {
+		ln(1, "%s*(p + %zu) == '%c'", op, i, m[i]);
+		op = "    && ";
+	}
+	line[line_n++] = ')';
+	line[line_n++] = ')';
+}
+
+static void
+print_word_switch(void)
+{
+	size_t i, j;
+
+	ln(0, "#define __FSM_REQ_METH_WORD_SWITCH()");
+	ln(0, "do {");
+	base = 1;
+	ln(0, "switch (PI(p)) {");
+	for (i = 0; i < GR_N; i++) {
+		const char *m = grammar[i].name;
+		int uncond = 0;
+
+		if (grammar[i].hot || prefix_first(m, 4) != i)
+			continue;
+		ln(0, "case TFW_CHAR4_INT('%c', '%c', '%c', '%c'):",
+		   m[0], m[1], m[2], m[3] ? m[3] : ' ');
+		for (j = i; j < GR_N; j++) {
+			const char *mj = grammar[j].name;
+			size_t len = meth_read_len(mj);
+
+			if (grammar[j].hot || strncmp(mj, m, 4))
+				continue;
+			if (len == 4) {
+				uncond = 1;
+				if (len == strlen(mj)) {
+					ln(1, "__MATCH_METH(%s, 0);", mj);
+				} else {
+					ln(1, "req->method = TFW_HTTP_METH_%s;",
+					   mj);
+					ln(1, "__FSM_MOVE_nofixup_n(Req_Uri,"
+					   " 4);");
+				}
+				break;
+			}
+			print_cond(mj, len);
+			if (len != strlen(mj)) {
+				ln(1, "{");
+				ln(2, "req->method = TFW_HTTP_METH_%s;", mj);
+				ln(2, "__FSM_MOVE_nofixup_n(Req_Uri, %zu);",
+				   len);
+				ln(1, "}");
+			} else {
+				ln(2, "__MATCH_METH(%s, %zu);", mj, len - 4);
+			}
+		}
+		if (!uncond)
+			ln(1, "__FSM_MOVE_nofixup_n(%s, 4);", st_name(m, 4));
+	}
+	ln(0, "default:");
+	ln(1, "__FSM_MOVE_nofixup(Req_MethodUnknown);");
+	ln(0, "}");
+	base = 0;
+	ln(0, "} while (0)");
+	ln_end(1);
+	putchar('\n');
+}
+
+/*
+ * Print the switch over character @n of the methods having the same @n - 1
+ * characters prefix as method @m.
+ */
+static void
+print_char_cases(const char *m, size_t n, int indent)
+{
+	size_t i;
+
+	for (i = 0; i < GR_N; i++) {
+		const char *mi = grammar[i].name;
+
+		if (strncmp(mi, m, n) || prefix_first(mi, n + 1) != i)
+			continue;
+		ln(indent, "case '%c':", mi[n]);
+		if (!mi[n + 1]) {
+			ln(indent + 1, "req->method = TFW_HTTP_METH_%s;", mi);
+			ln(indent + 1, "__FSM_MOVE_nofixup(Req_MUSpace);");
+		} else {
+			ln(indent + 1, "__FSM_MOVE_nofixup(%s);",
+			   st_name(mi, n + 1));
+		}
+	}
+}
+
+static void
+print_1char_switch(void)
+{
+	ln(0, "#define __FSM_REQ_METH_1CHAR_SWITCH()");
+	ln(0, "do {");
+	base = 1;
+	ln(0, "switch (c) {");
+	print_char_cases("", 0, 0);
+	ln(0, "}");
+	ln(0, "__FSM_MOVE_nofixup(Req_MethodUnknown);");
+	base = 0;
+	ln(0, "} while (0)");
+	ln_end(1);
+	putchar('\n');
+}
+
+static void
+print_states(void)
+{
+	size_t i, n;
+
+	ln(0, "#define __FSM_REQ_METH_STATES()");
+	for (i = 0; i < GR_N; i++) {
+		const char *m = grammar[i].name;
+
+		for (n = 1; m[n]; n++) {
+			/* The state is printed for the first method only. */
+			if (prefix_first(m, n) != i)
+				continue;
+			if (prefix_branches(m, n) > 1) {
+				ln(0, "__FSM_STATE(%s, cold) {",
+				   st_name(m, n));
+				ln(1, "switch (c) {");
+				print_char_cases(m, n, 1);
+				ln(1, "}");
+				ln(1, "__FSM_MOVE_nofixup(Req_MethodUnknown);");
+				ln(0, "}");
+			} else if (!m[n + 1]) {
+				const char *st = st_name(m, n);
+
+				if (strlen(st) + strlen(m) + 46 < BS_COL) {
+					ln(0, "__FSM_METH_MOVE_finish(%s, '%c',"
+					   " TFW_HTTP_METH_%s);", st, m[n], m);
+				} else {
+					ln(0, "__FSM_METH_MOVE_finish(%s,"
+					   " '%c',", st, m[n]);
+					ln(2, "       TFW_HTTP_METH_%s);", m);
+				}
+			} else {
+				ln(0, "__FSM_METH_MOVE(%s, '%c', %s);",
+				   st_name(m, n), m[n], st_name(m, n + 1));
+			}
+		}
+	}
+	ln_end(1);
+	putchar('\n');
+}
+
+int
+main(int argc, char *argv[])
+{
+	size_t i, data_min = 4;
+
+	grammar_check();
+
+	for (i = 0; i < GR_N; i++)
+		if (!grammar[i].hot && meth_read_len(grammar[i].name)
+				       > data_min)
+			data_min = meth_read_len(grammar[i].name);
+	printf("#define TFW_HTTP_METH_DATA_MIN\t%zu\n\n", data_min);
+
+	print_word_switch();
+	print_1char_switch();
+	print_states();
+
+	return 0;
+}
@@ -18,7 +18,11 @@
  * this program; if not, write to the Free Software Foundation, Inc., 59
  * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
  */
+#include <linux/bitops.h>
+#include <asm/unaligned.h>
+
 #include "str.h"
+#include "hash.h"
 
 #include "lib/hash.h"
 
@@ -40,28 +44,38 @@ tfw_hash_str_len(const TfwStr *str, unsigned long str_len)
 	else {
 		const TfwStr *c = str->chunks;
 		const TfwStr *end = c + str->nchunks;
-		unsigned char *p, *e;
+		const char *p, *e;
 		unsigned int tail = 0;
 
 		while (c < end && str_len) {
-			unsigned long len;
+			unsigned long len, n;
 
 			p = c->data;
 			len = min(c->len, str_len);
 			e = p + len;
 			str_len -= len;
 
+			/*
+			 * Complete the 16-byte block started by the previous
+			 * chunk word by word, as it's done for plain data.
+			 */
 			if (tail) {
-				for ( ; tail < 8; ++p, ++tail) {
-					if (unlikely(p == e))
-						goto next_chunk;
-					CRCB(crc0, *p);
+				if (tail < 8) {
+					n = min_t(unsigned long, 8 - tail,
+						  e - p);
+					__hash_tail(&crc0, p, n);
+					p += n;
+					tail += n;
 				}
-				for ( ; tail < 16; ++p, ++tail) {
-					if (unlikely(p == e))
-						goto next_chunk;
-					CRCB(crc1, *p);
+				if (tail >= 8) {
+					n = min_t(unsigned long, 16 - tail,
+						  e - p);
+					__hash_tail(&crc1, p, n);
+					p += n;
+					tail += n;
 				}
+				if (unlikely(tail < 16))
+					goto next_chunk;
 			}
 
 			__hash_calc(&crc0, &crc1, p, e - p);
@@ -73,3 +87,98 @@ next_chunk:
 
 	return (crc1 << 32) | crc0;
 }
+
+/*
+ * SipHash-2-4 with 128-bit output, see "SipHash: a fast short-input PRF" by
+ * J.-P. Aumasson and D. J. Bernstein. Unlike siphash() from the kernel
+ * library the input may be fed by pieces, e.g. by chunks of TfwStr.
+ */
+#define SIPROUND(v)							\
+do {									\
+	v[0] += v[1]; v[1] = rol64(v[1], 13); v[1] ^= v[0];		\
+	v[0] = rol64(v[0], 32);						\
+	v[2] += v[3]; v[3] = rol64(v[3], 16); v[3] ^= v[2];		\
+	v[0] += v[3]; v[3] = rol64(v[3], 21); v[3] ^= v[0];		\
+	v[2] += v[1]; v[1] = rol64(v[1], 17); v[1] ^= v[2];		\
+	v[2] = rol64(v[2], 32);						\
+} while (0)
+
+static inline void
+__siphash_compress(u64 *v, u64 m)
+{
+	v[3] ^= m;
+	SIPROUND(v);
+	SIPROUND(v);
+	v[0] ^= m;
+}
+
+/**
+ * Compute the initial state from @k of TFW_SIPHASH_KEY_LEN bytes.
+ */
+void
+tfw_siphash_setkey(TfwSipHashKey *key, const u8 *k)
+{
+	u64 k0 = get_unaligned_le64(k), k1 = get_unaligned_le64(k + 8);
+
+	key->v[0] = k0 ^ 0x736f6d6570736575ULL;
+	/* 128-bit output mode. */
+	key->v[1] = k1 ^ 0x646f72616e646f6dULL ^ 0xee;
+	key->v[2] = k0 ^ 0x6c7967656e657261ULL;
+	key->v[3] = k1 ^ 0x7465646279746573ULL;
+}
+
+void
+tfw_siphash_init(TfwSipHash *h, const TfwSipHashKey *key)
+{
+	memcpy(h->v, key->v, sizeof(h->v));
+	h->tail = 0;
+	h->len = 0;
+}
+
+void
+tfw_siphash_update(TfwSipHash *h, const void *data, size_t len)
+{
+	const u8 *p = data, *end = p + len;
+	unsigned int t = h->len & 7;
+
+	h->len += len;
+	if (t) {
+		for ( ; t < 8 && p < end; ++t, ++p)
+			h->tail |= (u64)*p << (t * 8);
+		if (t < 8)
+			return;
+		__siphash_compress(h->v, h->tail);
+		h->tail = 0;
+	}
+	for ( ; end - p >= 8; p += 8)
+		__siphash_compress(h->v, get_unaligned_le64(p));
+	for (t = 0; p < end; ++t, ++p)
+		h->tail |= (u64)*p << (t * 8);
+}
+
+/**
+ * Finish the calculation and write TFW_SIPHASH_LEN bytes of the hash to @out.
+ */
+void
+tfw_siphash_final(TfwSipHash *h, u8 *out)
+{
+	u64 *v = h->v;
+
+	__siphash_compress(v, ((u64)h->len << 56) | h->tail);
+
+	v[2] ^= 0xee;
+	SIPROUND(v);
+	SIPROUND(v);
+	SIPROUND(v);
+	SIPROUND(v);
+	put_unaligned_le64(v[0] ^ v[1] ^ v[2] ^ v[3], out);
+
+	v[1] ^= 0xdd;
+	SIPROUND(v);
+	SIPROUND(v);
+	SIPROUND(v);
+	SIPROUND(v);
+	put_unaligned_le64(v[0] ^ v[1] ^ v[2] ^ v[3], out + 8);
+}
+
+#undef SIPROUND
@@ -26,4 +26,33 @@
 unsigned long tfw_hash_str_len(const TfwStr *str, unsigned long str_len);
 #define tfw_hash_str(str)     tfw_hash_str_len((str), ULONG_MAX)
 
+#define TFW_SIPHASH_KEY_LEN	16
+#define TFW_SIPHASH_LEN		16
+
+/**
+ * Initial SipHash state computed from a secret key, so the key setup isn't
+ * repeated for each hash calculation.
+ */
+typedef struct {
+	u64		v[4];
+} TfwSipHashKey;
+
+/**
+ * SipHash calculation state.
+ *
+ * @v		- the internal state;
+ * @tail	- the last incomplete 8-byte word of the input;
+ * @len		- the input length processed so far;
+ */
+typedef struct {
+	u64		v[4];
+	u64		tail;
+	size_t		len;
+} TfwSipHash;
+
+void tfw_siphash_setkey(TfwSipHashKey *key, const u8 *k);
+void tfw_siphash_init(TfwSipHash *h, const TfwSipHashKey *key);
+void tfw_siphash_update(TfwSipHash *h, const void *data, size_t len);
+void tfw_siphash_final(TfwSipHash *h, u8 *out);
+
 #endif /* __TFW_HASH_H__ */
@@ -22,9 +22,12 @@
 #undef DEBUG
 #endif
 
+#include "lib/hash.h"
 #include "lib/str.h"
 #include "pool.h"
+#include "procfs.h"
 #include "str.h"
+#include "tempesta_fw.h"
 #include "http_msg.h"
 #include "hpack.h"
 
@@ -250,7 +253,7 @@ do {								\
 	hp->curr += 8;						\
 	hp->hctx = hp->hctx << 8 | *src++;			\
 	--hp->length;						\
-	T_DBG3("%s: set next, hp->curr=%d, hp->hctx=%hx,"	\
+	T_DBG3("%s: set next, hp->curr=%d, hp->hctx=%x,"	\
 	       " hp->length=%lu, n=%lu, to_parse=%lu\n",	\
 	       __func__, hp->curr, hp->hctx, hp->length, n,	\
 	       last - src);					\
@@ -465,6 +468,30 @@ tfw_hpack_huffman_write(char sym, TfwHttpReq *__restrict req)
 	return tfw_hpack_exp_hdr(req->pool, 1, it) ? 0 : -ENOMEM;
 }
 
+/*
+ * Write the symbols decoded by multi-symbol table entry @ms.
+ */
+static inline int
+tfw_hpack_huffman_write_ms(const HTMState *__restrict ms,
+			   TfwHttpReq *__restrict req)
+{
+	unsigned int i;
+	TfwMsgParseIter *it = &req->pit;
+
+	if (likely(it->rspace >= HT_MS_SYMS)) {
+		memcpy(it->pos, ms->sym, HT_MS_SYMS);
+		it->pos += ms->n;
+		it->rspace -= ms->n;
+		return 0;
+	}
+
+	for (i = 0; i < ms->n; ++i)
+		if (tfw_hpack_huffman_write(ms->sym[i], req))
+			return -ENOMEM;
+
+	return 0;
+}
+
 static int
 huffman_decode_tail(TfwHPack *__restrict hp, TfwHttpReq *__restrict req,
 		    unsigned int offset)
@@ -484,7 +511,7 @@ huffman_decode_tail(TfwHPack *__restrict hp, TfwHttpReq *__restrict req,
 
 		i = (hp->hctx << -hp->curr) & HT_NMASK;
 		shift = ht_decode[offset + i].shift;
-		T_DBG3("%s: hp->curr=%d, hp->hctx=%hx, hp->length=%lu,"
+		T_DBG3("%s: hp->curr=%d, hp->hctx=%x, hp->length=%lu,"
 		       " i=%u, shift=%d, offset=%u\n", __func__,
 		       hp->curr, hp->hctx, hp->length, i, shift, offset);
 		if (likely(shift > 0)) {
@@ -553,7 +580,7 @@ huffman_decode_tail_s(TfwHPack *__restrict hp, TfwHttpReq *__restrict req,
 	i = (hp->hctx << -hp->curr) & HT_MMASK;
 	shift = ht_decode[offset + i].shift;
 
-	T_DBG3("%s: hp->curr=%d, hp->hctx=%hx, hp->length=%lu, i=%u,"
+	T_DBG3("%s: hp->curr=%d, hp->hctx=%x, hp->length=%lu, i=%u,"
 	       " shift=%d, offset=%u\n", __func__, hp->curr, hp->hctx,
 	       hp->length, i, shift, offset);
 
@@ -595,6 +622,31 @@ tfw_huffman_decode(TfwHPack *__restrict hp, TfwHttpReq *__restrict req,
 			int shift;
 			unsigned int i;
 
+			/*
+			 * Decode whole symbols by HT_MS_BITS prefixes while
+			 * there are enough input bits, the state machine
+			 * below is left for long codes and the string tail.
+			 */
+			if (likely(!offset)) {
+				const HTMState *ms;
+
+				while (hp->curr < HT_MS_BITS - HT_NBITS
+				       && src < last)
+					SET_NEXT();
+				if (hp->curr < HT_MS_BITS - HT_NBITS)
+					goto slow;
+				shift = hp->curr - (HT_MS_BITS - HT_NBITS);
+				i = (hp->hctx >> shift) & HT_MS_MASK;
+				ms = &ht_ms_decode[i];
+				if (likely(ms->n)) {
+					if (tfw_hpack_huffman_write_ms(ms, req))
+						return T_DROP;
+					hp->curr -= ms->bits;
+					continue;
+				}
+			}
+slow:
+
 			if (hp->curr <= 0) {
 				if (likely(src < last)) {
 					SET_NEXT();
@@ -612,7 +664,7 @@ tfw_huffman_decode(TfwHPack *__restrict hp, TfwHttpReq *__restrict req,
 			i = (hp->hctx >> hp->curr) & HT_NMASK;
 			shift = ht_decode[offset + i].shift;
 			offset = ht_decode[offset + i].offset;
-			T_DBG3("%s: shift, hp->curr=%d, hp->hctx=%hx,"
+			T_DBG3("%s: shift, hp->curr=%d, hp->hctx=%x,"
 			       " hp->length=%lu, n=%lu, to_parse=%lu, i=%u,"
 			       " shift=%d, offset=%u, offset=%c\n", __func__,
 			       hp->curr, hp->hctx, hp->length, n, last - src,
@@ -660,7 +712,7 @@ tfw_huffman_decode(TfwHPack *__restrict hp, TfwHttpReq *__restrict req,
 			i = (hp->hctx >> hp->curr) & HT_MMASK;
 			shift = ht_decode[offset + i].shift;
 			offset = ht_decode[offset + i].offset;
-			T_DBG3("%s: short shift, hp->curr=%d, hp->hctx=%hx,"
+			T_DBG3("%s: short shift, hp->curr=%d, hp->hctx=%x,"
 			       " hp->length=%lu, n=%lu, to_parse=%lu, i=%u,"
 			       " shift=%d, offset=%u, offset=%c\n", __func__,
 			       hp->curr, hp->hctx, hp->length, n, last - src,
@@ -684,23 +736,40 @@ end:
 	return T_DROP;
 }
 
-static int
-tfw_hpack_set_entry(TfwPool *__restrict h_pool, TfwMsgParseIter *__restrict it,
-		    TfwHPackEntry *__restrict entry, bool *__restrict np)
+/* Size of the decoder dynamic table entry for header @s in the ring buffer. */
+#define HPACK_DENTRY_SZ(s)						\
+	ALIGN(sizeof(TfwHPackEntry)					\
+	      + ((s)->nchunks + 1) * sizeof(TfwStr) + (s)->len, sizeof(long))
+
+/*
+ * Point the header descriptor of @entry and its chunks to the data following
+ * them in the ring buffer.
+ */
+static void
+tfw_hpack_link_entry(TfwHPackEntry *__restrict entry)
 {
 	char *data;
-	TfwStr *d, *d_hdr;
-	const TfwStr *s, *end, *s_hdr = it->parsed_hdr;
-	unsigned long size = sizeof(TfwHPackEntry);
+	TfwStr *c, *end, *hdr = (TfwStr *)(entry + 1);
 
-	if (WARN_ON_ONCE(TFW_STR_PLAIN(s_hdr) || TFW_STR_DUP(s_hdr)))
-		return -EINVAL;
+	entry->hdr = hdr;
+	hdr->chunks = hdr + 1;
+	data = (char *)(TFW_STR_LAST(hdr) + 1);
+	TFW_STR_FOR_EACH_CHUNK(c, hdr, end) {
+		c->data = data;
+		data += c->len;
+	}
+}
 
-	size += (s_hdr->nchunks + 1) * sizeof(TfwStr) + s_hdr->len;
-	T_DBG3("%s: size=%lu, s_hdr->nchunks=%u, s_hdr->len=%lu\n", __func__,
-	       size, s_hdr->nchunks, s_hdr->len);
-	if (!(d_hdr = __tfw_pool_alloc(h_pool, size, true, np)))
-		return -ENOMEM;
+static void
+tfw_hpack_set_entry(TfwMsgParseIter *__restrict it,
+		    TfwHPackEntry *__restrict entry, unsigned int rsize)
+{
+	char *data;
+	TfwStr *d, *d_hdr = (TfwStr *)(entry + 1);
+	const TfwStr *s, *end, *s_hdr = it->parsed_hdr;
+
+	T_DBG3("%s: rsize=%u, s_hdr->nchunks=%u, s_hdr->len=%lu\n", __func__,
+	       rsize, s_hdr->nchunks, s_hdr->len);
 
 	*d_hdr = *s_hdr;
 	d_hdr->chunks = d_hdr + 1;
@@ -727,7 +796,117 @@ tfw_hpack_set_entry(TfwPool *__restrict h_pool, TfwMsgParseIter *__restrict it,
 	entry->name_len = it->nm_len;
 	entry->name_num = it->nm_num;
 	entry->tag = it->tag;
-	entry->last = false;
+	entry->rsize = rsize;
+}
+
+/*
+ * Evict the eldest entries from the decoder dynamic table until its
+ * pseudo-length is not greater than @size. The evicted entries just free
+ * the space in the ring buffer.
+ */
+static void
+tfw_hpack_evict(TfwHPackDTbl *__restrict tbl, unsigned int size)
+{
+	while (tbl->size > size) {
+		const TfwHPackEntry *cp;
+
+		if (WARN_ON_ONCE(!tbl->n))
+			break;
+		cp = (TfwHPackEntry *)(tbl->rbuf + tbl->rb_head);
+		tbl->size -= HPACK_ENTRY_OVERHEAD + cp->hdr->len;
+		T_DBG3("%s: drop entry at %u, n=%u, size=%u\n", __func__,
+		       tbl->rb_head, tbl->n, tbl->size);
+
+		if (!--tbl->n) {
+			tbl->rb_head = tbl->rb_tail = tbl->rb_wrap = 0;
+			continue;
+		}
+		tbl->rb_head += cp->rsize;
+		if (tbl->rb_head == tbl->rb_wrap)
+			tbl->rb_head = tbl->rb_wrap = 0;
+	}
+	WARN_ON_ONCE(!tbl->n && tbl->size);
+}
+
+/*
+ * Reserve @rsize bytes for a new entry at the end of the ring buffer.
+ *
+ * @return offset of the entry or -ENOSPC if the free space is too small.
+ */
+static int
+tfw_hpack_rb_reserve(TfwHPackDTbl *__restrict tbl, unsigned int rsize)
+{
+	unsigned int off;
+
+	if (tbl->rb_wrap) {
+		if (tbl->rb_head - tbl->rb_tail < rsize)
+			return -ENOSPC;
+	}
+	else if (tbl->rb_size - tbl->rb_tail < rsize) {
+		/* Wrap the entries if there is room before the eldest one. */
+		if (tbl->rb_head < rsize)
+			return -ENOSPC;
+		tbl->rb_wrap = tbl->rb_tail;
+		tbl->rb_tail = 0;
+	}
+
+	off = tbl->rb_tail;
+	tbl->rb_tail += rsize;
+
+	return off;
+}
+
+/*
+ * Reallocate the ring buffer, so the current entries and a new one of @rsize
+ * bytes fit it, and move the entries to the new buffer start.
+ */
+static int
+tfw_hpack_rb_grow(TfwHPackDTbl *__restrict tbl, unsigned int rsize)
+{
+	char *rbuf;
+	unsigned int i, slot, off = tbl->rb_head, n_off = 0;
+	unsigned long size = tbl->rb_size ? : tbl->window;
+	unsigned long need = (unsigned long)rsize + tbl->rb_tail;
+
+	if (tbl->rb_wrap)
+		need += tbl->rb_wrap - tbl->rb_head;
+	else
+		need -= tbl->rb_head;
+	while (size < need)
+		size <<= 1;
+	if (unlikely(size > INT_MAX))
+		return -ENOMEM;
+
+	T_DBG3("%s: grow ring buffer from %u to %lu bytes\n", __func__,
+	       tbl->rb_size, size);
+	if (!(rbuf = tfw_pool_alloc(tbl->pool, size)))
+		return -ENOMEM;
+
+	/* Move the entries in the order from the eldest to the recent. */
+	for (i = tbl->n; i; --i) {
+		TfwHPackEntry *entry = (TfwHPackEntry *)(rbuf + n_off);
+		const TfwHPackEntry *cp = (TfwHPackEntry *)(tbl->rbuf + off);
+
+		if (tbl->curr >= i)
+			slot = tbl->curr - i;
+		else
+			slot = tbl->curr + tbl->length - i;
+		memcpy_fast(entry, cp, cp->rsize);
+		tfw_hpack_link_entry(entry);
+		tbl->idx[slot] = n_off;
+
+		n_off += cp->rsize;
+		off += cp->rsize;
+		if (off == tbl->rb_wrap)
+			off = 0;
+	}
+
+	/* Free the pages of the previous buffer. */
+	tfw_pool_clean(tbl->pool, NULL);
+	tbl->rbuf = rbuf;
+	tbl->rb_size = size;
+	tbl->rb_head = tbl->rb_wrap = 0;
+	tbl->rb_tail = n_off;
 
 	return 0;
 }
@@ -740,30 +919,26 @@ tfw_hpack_set_entry(TfwPool *__restrict h_pool, TfwMsgParseIter *__restrict it,
  *	   greater than it's standardized pseudo-size (RFC 7541 section 4.1);
  * 	3. Store the records with variable size (headers strings and their
  *	   @TfwStr descriptors).
- * To meet this specification, the current decoder dynamic table is using two
- * pools (see @pool and @h_pool members in @TfwHPackDTbl structure description):
- * the first one is intended for storage of constant length entries (because we
- * need a quick access by index for the entries of decoder table) and it is
- * always a single resizable chunk in the memory, relocatable between different
- * pages in the pool (in case of storage growth); the purpose of the second pool
- * is to store records with variable size (the headers strings and their @TfwStr
- * descriptors) - this storage area cannot be relocated during growth due to
- * internal pointers of @TfwStr, but can be shared between different pages of
- * the pool; in general scheme the first module refers to the second one.
+ * To meet this specification, the entries with their descriptors and data are
+ * stored contiguously in one ring buffer (see @TfwHPackDTbl description) and
+ * the evicted entries just release the buffer space for the new ones, so the
+ * table memory doesn't depend on how many headers passed through it. Since
+ * there are at most @window / HPACK_ENTRY_OVERHEAD entries, the offsets of
+ * the entries are kept in the circular array of fixed length. The buffer is
+ * reallocated only if the descriptors of the entries don't fit it, which is
+ * bounded by the maximum table size.
  */
 static int
 tfw_hpack_add_index(TfwHPackDTbl *__restrict tbl,
 		    TfwMsgParseIter *__restrict it)
 {
-	int r;
-	bool new_page;
-	unsigned int delta;
-	unsigned int window, size, new_size;
-	unsigned long hdr_len = it->parsed_hdr->len;
-	unsigned int count = tbl->n;
-	unsigned int curr = tbl->curr;
-	unsigned int length = tbl->length;
-	TfwHPackEntry *entry, *prev_entry, *entries = tbl->entries;
+	int off;
+	unsigned int delta, rsize;
+	const TfwStr *s_hdr = it->parsed_hdr;
+	unsigned long hdr_len = s_hdr->len;
+
+	if (WARN_ON_ONCE(TFW_STR_PLAIN(s_hdr) || TFW_STR_DUP(s_hdr)))
+		return -EINVAL;
 
 	/* Check for integer overflow occurred during @delta calculation. */
 	if ((delta = HPACK_ENTRY_OVERHEAD + hdr_len) < hdr_len)	{
@@ -772,157 +947,38 @@ tfw_hpack_add_index(TfwHPackDTbl *__restrict tbl,
 		return -EINVAL;
 	}
 
-	size = tbl->size;
-	new_size = size + delta;
-	window = tbl->window;
-
-	T_DBG3("%s: max table size: %u, current size: %u, new size: %u, delta:"
-	       " %u\n", __func__, window, size, new_size, delta);
+	T_DBG3("%s: max table size: %u, current size: %u, delta: %u\n",
+	       __func__, tbl->window, tbl->size, delta);
 	/*
-	 * The last condition 'new_size < delta' was added to handle an
-	 * integer overflow, which can occur during summation of the actual
-	 * window size with delta.
+	 * The entry greater than the table size just cleans the entire table
+	 * (RFC 7541 section 4.4).
 	 */
-	if (new_size > window || unlikely(new_size < delta)) {
-		if (delta <= window) {
-			TfwHPackEntry *cp;
-			unsigned int early = curr;
-
-			if (curr >= count) {
-				early -= count;
-			} else {
-				early += length - count;
-			}
-
-			window -= delta;
-			T_DBG3("%s: curr: %u, early entry: %u (%u entries),"
-			       "maximum allowed decreased size: %u\n",  __func__,
-			       curr, early, count, window);
-
-			cp = entries + early;
-			do {
-				size -= HPACK_ENTRY_OVERHEAD + cp->hdr->len;
-				T_DBG3("%s: dropped index: %u\n", __func__,
-				       early);
-				if (cp->last)
-					tfw_pool_clean(tbl->h_pool, cp->hdr);
-				early++;
-				cp++;
-				count--;
-				if (unlikely(early == length)) {
-					early = 0;
-					cp = entries;
-				}
-			} while (size > window);
-
-			new_size = size + delta;
-		} else {
-			/*
-			 * This branch handles rare case where delta itself is
-			 * greater than the current window size. Clean of the
-			 * entire table and exit in this case.
-			 */
-			T_DBG3("%s: cleaning of the entire table...",  __func__);
-			if (count) {
-				TfwHPackEntry *cp;
-
-				if (curr >= count) {
-					curr -= count;
-				} else {
-					curr += length - count;
-				}
-
-				cp = entries + curr;
-				do {
-					T_DBG3("%s: drop index: %u\n", __func__,
-					       curr);
-					if (cp->last)
-						tfw_pool_clean(tbl->h_pool,
-							       cp->hdr);
-					curr++;
-					cp++;
-					if (unlikely(curr == length)) {
-						curr = 0;
-						cp = entries;
-					}
-				} while (--count);
-				tbl->n = 0;
-				tbl->curr = 0;
-				tbl->size = 0;
-			}
-			return 0;
-		}
-	} else if (unlikely(count == length)) {
-		TfwHPackEntry *previous = entries;
-		TfwPool *pool = tbl->pool;
-		unsigned long block, new_block, wrap, tail;
-
-		T_DBG3("%s: reallocation index structures...", __func__);
-		if (length) {
-			block = length * sizeof(TfwHPackEntry);
-			new_block = block << 1;
-			entries = tfw_pool_realloc_no_copy(pool, entries,
-							   block, new_block);
-			if (unlikely(!entries))
-				return -ENOMEM;
-
-			length <<= 1;
-			wrap = curr * sizeof(TfwHPackEntry);
-			tail = block - wrap;
-			if (!curr && entries == previous) {
-				curr = count;
-			}
-			else if (entries == previous) {
-				memcpy_fast(entries + new_block - tail,
-					    entries + wrap, tail);
-			}
-			else {
-				if (tail)
-					memcpy_fast(entries, previous + wrap,
-						    tail);
-				if (wrap)
-					memcpy_fast(entries + tail, previous,
-						    wrap);
-
-				tfw_pool_clean(pool, NULL);
-				curr = count;
-			}
-		} else {
-			length = 32;
-			new_block = length * sizeof(TfwHPackEntry);
-			entries = tfw_pool_alloc(pool, new_block);
-			if (unlikely(!entries))
-				return -ENOMEM;
-		}
-		T_DBG3("%s: table extended, length=%u, curr=%u\n", __func__,
-		       length, curr);
-
-		tbl->length = length;
-		tbl->entries = entries;
+	if (delta > tbl->window) {
+		T_DBG3("%s: cleaning of the entire table...",  __func__);
+		tfw_hpack_evict(tbl, 0);
+		return 0;
 	}
+	tfw_hpack_evict(tbl, tbl->window - delta);
+	if (WARN_ON_ONCE(tbl->n >= tbl->length))
+		return -EINVAL;
 
-	entry = entries + curr;
-	if ((r = tfw_hpack_set_entry(tbl->h_pool, it, entry, &new_page)))
-		return r;
-	/*
-	 * If the new entry is placed into the new page, and previous entry
-	 * exists, then mark it as last entry in previous page (in order to
-	 * free unused pages during entries eviction stage).
-	 */
-	if (count && new_page) {
-		prev_entry = curr ? (entry - 1) : (entries + length - 1);
-		prev_entry->last = true;
+	rsize = HPACK_DENTRY_SZ(s_hdr);
+	if ((off = tfw_hpack_rb_reserve(tbl, rsize)) < 0) {
+		if (tfw_hpack_rb_grow(tbl, rsize))
+			return -ENOMEM;
+		off = tfw_hpack_rb_reserve(tbl, rsize);
+		BUG_ON(off < 0);
 	}
+	tfw_hpack_set_entry(it, (TfwHPackEntry *)(tbl->rbuf + off), rsize);
 
-	curr++;
-	if (unlikely(curr == length))
-		curr = 0;
-	tbl->curr = curr;
-	tbl->n = count + 1;
-	tbl->size = new_size;
+	tbl->idx[tbl->curr] = off;
+	if (unlikely(++tbl->curr == tbl->length))
+		tbl->curr = 0;
+	tbl->n++;
+	tbl->size += delta;
 
-	T_DBG3("%s: item added, tbl->curr=%u, tbl->n=%u, tbl->length=%u\n",
-	       __func__, tbl->curr, tbl->n, tbl->length);
+	T_DBG3("%s: item added, tbl->curr=%u, tbl->n=%u, off=%d\n",
+	       __func__, tbl->curr, tbl->n, off);
 
 	return 0;
 }
@@ -949,7 +1005,7 @@ tfw_hpack_find_index(TfwHPackDTbl *__restrict tbl, unsigned long index)
 		T_DBG3("%s: tbl->length=%u, tbl->curr=%u, curr=%u, index=%lu\n",
 		      __func__, tbl->length, tbl->curr, curr, index);
 
-		entry = tbl->entries + curr;
+		entry = (TfwHPackEntry *)(tbl->rbuf + tbl->idx[curr]);
 		WARN_ON_ONCE(!entry->name_num);
 	}
 
@@ -962,50 +1018,13 @@ static int
 tfw_hpack_set_length(TfwHPack *__restrict hp, unsigned long new_size)
 {
 	TfwHPackDTbl *tbl = &hp->dec_tbl;
-	unsigned int size = tbl->size;
 
 	if (new_size > hp->max_window)
 		return -EINVAL;
 
-	if (size > new_size) {
-		unsigned int count = tbl->n;
-		unsigned int early = tbl->curr;
-		const unsigned int length = tbl->length;
-		TfwHPackEntry *const entries = tbl->entries;
-		TfwHPackEntry *cp;
-
-		if (early >= count) {
-			early -= count;
-		} else {
-			early += length - count;
-		}
-		T_DBG3("%s: tbl->curr=%u, early=%u, count=%u, length=%u,"
-		       " new_size=%lu\n", __func__, tbl->curr, early, count,
-		       length, new_size);
-		cp = entries + early;
-		do {
-			unsigned long hdr_len = cp->hdr->len;
-
-			WARN_ON_ONCE(!hdr_len);
-			size -= HPACK_ENTRY_OVERHEAD + hdr_len;
-
-			T_DBG3("%s: drop index, early=%u, count=%u,"
-			       " length=%u\n", __func__, early, count, length);
-			if (cp->last)
-				tfw_pool_clean(tbl->h_pool, cp->hdr);
-			early++;
-			cp++;
-			count--;
-			if (unlikely(early == length)) {
-				early = 0;
-				cp = entries;
-			}
-		} while (size > new_size);
-
-		tbl->n = count;
-		tbl->size = size;
-	}
-
+	T_DBG3("%s: tbl->size=%u, tbl->n=%u, new_size=%lu\n", __func__,
+	       tbl->size, tbl->n, new_size);
+	tfw_hpack_evict(tbl, new_size);
 	tbl->window = new_size;
 
 	return 0;
@@ -1017,38 +1036,125 @@ tfw_huffman_init(TfwHPack *__restrict hp)
 	hp->curr = -HT_NBITS;
 }
 
+#define HPACK_ENC_MAG_SZ	16
+
+/**
+ * Per-CPU magazine of encoder ring buffers.
+ *
+ * The encoder ring buffer is a multi-page chunk, which isn't cached by the
+ * pools page cache, and it's allocated and freed with each connection, so
+ * the buffers of closed connections are kept on the current CPU for the
+ * next connections. The decoder pools start from a single page and are
+ * served by the pools page cache.
+ *
+ * @n		- number of the cached buffers;
+ * @pool	- the pools holding the cached buffers;
+ * @rbuf	- the cached buffers;
+ */
+typedef struct {
+	unsigned int	n;
+	TfwPool		*pool[HPACK_ENC_MAG_SZ];
+	char		*rbuf[HPACK_ENC_MAG_SZ];
+} TfwHPackEncMag;
+
+static DEFINE_PER_CPU(TfwHPackEncMag, hpack_enc_mag);
+
+static int
+tfw_hpack_enc_rbuf_get(TfwHPackETbl *__restrict et)
+{
+	bool np;
+	TfwHPackEncMag *mag;
+
+	local_bh_disable();
+	mag = this_cpu_ptr(&hpack_enc_mag);
+	if (likely(mag->n)) {
+		--mag->n;
+		et->pool = mag->pool[mag->n];
+		et->rbuf = mag->rbuf[mag->n];
+		local_bh_enable();
+		return 0;
+	}
+	local_bh_enable();
+
+	if (!(et->pool = __tfw_pool_new(HPACK_ENC_TABLE_MAX_SIZE)))
+		return -ENOMEM;
+	tfw_pool_acct(et->pool, TFW_MEM_HPACK);
+	et->rbuf = __tfw_pool_alloc(et->pool, HPACK_ENC_TABLE_MAX_SIZE,
+				    true, &np);
+	BUG_ON(np || !et->rbuf);
+
+	return 0;
+}
+
+static void
+tfw_hpack_enc_rbuf_put(TfwHPackETbl *__restrict et)
+{
+	TfwHPackEncMag *mag;
+
+	local_bh_disable();
+	mag = this_cpu_ptr(&hpack_enc_mag);
+	if (likely(mag->n < HPACK_ENC_MAG_SZ)) {
+		mag->pool[mag->n] = et->pool;
+		mag->rbuf[mag->n] = et->rbuf;
+		++mag->n;
+		local_bh_enable();
+		return;
+	}
+	local_bh_enable();
+
+	tfw_pool_destroy(et->pool);
+}
+
+/**
+ * Free the cached encoder buffers. Called on the module unloading when
+ * all the connections are closed.
+ */
+void
+tfw_hpack_cache_drain(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		TfwHPackEncMag *mag = per_cpu_ptr(&hpack_enc_mag, cpu);
+
+		while (mag->n)
+			tfw_pool_destroy(mag->pool[--mag->n]);
+	}
+}
+
 int
 tfw_hpack_init(TfwHPack *__restrict hp, unsigned int htbl_sz)
 {
-	bool np;
 	TfwHPackETbl *et = &hp->enc_tbl;
 	TfwHPackDTbl *dt = &hp->dec_tbl;
 
 	BUILD_BUG_ON(sizeof(TfwHPackNode) > HPACK_ENTRY_OVERHEAD
 		     || HPACK_ENC_TABLE_MAX_SIZE > SHRT_MAX);
+	BUILD_BUG_ON(sizeof(((HTMState *)0)->sym) != HT_MS_SYMS);
 
 	tfw_huffman_init(hp);
 
 	dt->window = hp->max_window = htbl_sz;
-	if (!(dt->pool = __tfw_pool_new(0)))
+	dt->length = htbl_sz / HPACK_ENTRY_OVERHEAD;
+	if (!(dt->pool = __tfw_pool_new(dt->length * sizeof(*dt->idx))))
 		return -ENOMEM;
-	if (!(dt->h_pool = __tfw_pool_new(0)))
-		goto err_dt;
+	tfw_pool_acct(dt->pool, TFW_MEM_HPACK);
+	/* The ring buffer is allocated on the first entry. */
+	if (dt->length
+	    && !(dt->idx = tfw_pool_alloc(dt->pool,
+					  dt->length * sizeof(*dt->idx))))
+		goto err;
 
 	et->window = htbl_sz;
+	memset(et->htbl, 0xff, sizeof(et->htbl));
 	spin_lock_init(&et->lock);
 	et->rb_size = HPACK_ENC_TABLE_MAX_SIZE;
-	if (!(et->pool = __tfw_pool_new(HPACK_ENC_TABLE_MAX_SIZE)))
-		goto err_et;
-	et->rbuf = __tfw_pool_alloc(et->pool, HPACK_ENC_TABLE_MAX_SIZE,
-				    true, &np);
-	BUG_ON(np || !et->rbuf);
+	if (tfw_hpack_enc_rbuf_get(et))
+		goto err;
 
 	return 0;
 
-err_et:
-	tfw_pool_destroy(dt->h_pool);
-err_dt:
+err:
 	tfw_pool_destroy(dt->pool);
 
 	return -ENOMEM;
@@ -1057,8 +1163,7 @@ err_dt:
 void
 tfw_hpack_clean(TfwHPack *__restrict hp)
 {
-	tfw_pool_destroy(hp->enc_tbl.pool);
-	tfw_pool_destroy(hp->dec_tbl.h_pool);
+	tfw_hpack_enc_rbuf_put(&hp->enc_tbl);
 	tfw_pool_destroy(hp->dec_tbl.pool);
 	WARN_ON_ONCE(act_hp_str_n);
 }
@@ -1095,19 +1200,18 @@ tfw_hpack_hdr_name_set(TfwHPack *__restrict hp, TfwHttpReq *__restrict req,
 	if (WARN_ON_ONCE(!num || num > s_hdr->nchunks))
 		return -EINVAL;
 
-	if (!(data = tfw_pool_alloc_not_align(it->pool, sz)))
-		return T_BAD;
-
 	d_hdr->len = sz;
 	d_hdr->nchunks = num;
-	d_hdr->flags = s_hdr->flags;
+	d_hdr->flags = s_hdr->flags & ~TFW_STR_CN_RESERVE;
 	if (!(d_hdr->chunks = tfw_pool_alloc(req->pool, num * sizeof(TfwStr))))
 		return T_BAD;
 
 	/*
 	 * Since headers in static table cannot be changed, we need to copy only
 	 * descriptors (i.e. only high-level and the name descriptors), because
-	 * they will grow during further processing.
+	 * they will grow during further processing. The name data is
+	 * referenced in place, so the copy buffer is allocated for dynamically
+	 * indexed names only.
 	 */
 	d = d_hdr->chunks;
 	if (hp->index <= HPACK_STATIC_ENTRIES) {
@@ -1115,6 +1219,9 @@ tfw_hpack_hdr_name_set(TfwHPack *__restrict hp, TfwHttpReq *__restrict req,
 		goto done;
 	}
 
+	if (!(data = tfw_pool_alloc_not_align(it->pool, sz)))
+		return T_BAD;
+
 	for (s = s_hdr->chunks, end = s_hdr->chunks + num; s < end; ++s) {
 		*d = *s;
 		d->data = data;
@@ -1176,7 +1283,7 @@ tfw_hpack_hdr_set(TfwHPack *__restrict hp, TfwHttpReq *__restrict req,
 		return T_BAD;
 
 	d_hdr->len = s_hdr->len;
-	d_hdr->flags = s_hdr->flags;
+	d_hdr->flags = s_hdr->flags & ~TFW_STR_CN_RESERVE;
 	d_hdr->nchunks = s_hdr->nchunks;
 
 	d = d_hdr->chunks;
@@ -2048,6 +2155,13 @@ out:
  * last (i.e. the newest) entry in the ring buffer, and @root field which is the
  * pointer to the root entry of red-black tree.
  *
+ * Most of the response headers are found in the table as a whole, so the
+ * nodes are also linked into the @htbl hash index by the hash of the stored
+ * header through the @hnext field. The encoder looks a header up in the hash
+ * index first and compares the header strings only for the nodes of the same
+ * hash; the red-black tree is searched if the whole header isn't found, to
+ * find a node with the same header name or the place for the new node.
+ *
  * For instance, if the encoder table has 3 headers stored in it - e.g.
  * 'accept-encoding', 'accept-range' and 'referer', which had been added exactly
  * in the given order - they should have the following layout in the ring buffer
@@ -2870,6 +2984,95 @@ tfw_hpack_rbtree_erase(TfwHPackETbl *__restrict tbl,
 		tfw_hpack_rbtree_del_rebalance(tbl, nchild, parent, left_child);
 }
 
+/*
+ * Hash of header name @nm and value @val as they're stored in the encoder
+ * dynamic table. The name is hashed in lower case, as it's compared by
+ * tfw_hpack_node_compare(), and the hash doesn't depend on the chunks layout
+ * of the header.
+ */
+static unsigned int
+tfw_hpack_node_hash(const TfwStr *__restrict nm, const TfwStr *__restrict val)
+{
+	const TfwStr *c, *end;
+	unsigned long crc = 0;
+
+	TFW_STR_FOR_EACH_CHUNK(c, nm, end) {
+		const unsigned char *p = c->data, *e = p + c->len;
+
+		for ( ; p < e; ++p)
+			CRCB(crc, (unsigned char)(*p | 0x20));
+	}
+	TFW_STR_FOR_EACH_CHUNK(c, val, end) {
+		const unsigned char *p = c->data, *e = p + c->len;
+
+		for ( ; p < e; ++p)
+			CRCB(crc, *p);
+	}
+
+	return crc;
+}
+
+#define HPACK_HT_BUCKET(tbl, hash)					\
+	(&(tbl)->htbl[(hash) & (HPACK_ENC_HT_SZ - 1)])
+
+static void
+tfw_hpack_ht_add(TfwHPackETbl *__restrict tbl, TfwHPackNode *__restrict node)
+{
+	short *bucket = HPACK_HT_BUCKET(tbl, node->hash);
+
+	node->hnext = *bucket;
+	*bucket = HPACK_NODE_OFF(tbl, node);
+}
+
+static void
+tfw_hpack_ht_del(TfwHPackETbl *__restrict tbl, TfwHPackNode *__restrict node)
+{
+	short off = HPACK_NODE_OFF(tbl, node);
+	short *poff = HPACK_HT_BUCKET(tbl, node->hash);
+
+	while (!HPACK_NODE_EMPTY(*poff)) {
+		if (*poff == off) {
+			*poff = node->hnext;
+			return;
+		}
+		poff = &HPACK_NODE(tbl, *poff)->hnext;
+	}
+	WARN_ON_ONCE(1);
+}
+
+/*
+ * Find node which matches the whole header @hdr with @hash in the hash index.
+ */
+static const TfwHPackNode *
+tfw_hpack_ht_find(TfwHPackETbl *__restrict tbl, const TfwStr *__restrict hdr,
+		  unsigned int hash)
+{
+	const TfwHPackNode *nm_node = NULL;
+	short off = *HPACK_HT_BUCKET(tbl, hash);
+
+	while (!HPACK_NODE_EMPTY(off)) {
+		const TfwHPackNode *node = HPACK_NODE(tbl, off);
+
+		if (node->hash == hash
+		    && !tfw_hpack_node_compare(hdr, node, &nm_node))
+			return node;
+		off = node->hnext;
+	}
+
+	return NULL;
+}
+
+/*
+ * Remove specified node from the encoder dynamic index.
+ */
+static inline void
+tfw_hpack_node_erase(TfwHPackETbl *__restrict tbl,
+		     TfwHPackNode *__restrict node)
+{
+	tfw_hpack_ht_del(tbl, node);
+	tfw_hpack_rbtree_erase(tbl, node);
+}
+
 static inline void
 tfw_hpack_rbuf_iter(TfwHPackETbl *__restrict tbl,
 		    TfwHPackETblIter *__restrict iter)
@@ -2921,7 +3124,7 @@ tfw_hpack_rbuf_calc(TfwHPackETbl *__restrict tbl, unsigned short new_size,
 		if (del_list)
 			del_list[i++] = (TfwHPackNode *)first;
 		else
-			tfw_hpack_rbtree_erase(tbl, (TfwHPackNode *)first);
+			tfw_hpack_node_erase(tbl, (TfwHPackNode *)first);
 
 		if (last < first && rb_len - f_len == last - rbuf + last_len) {
 			it->rb_size = HPACK_ENC_TABLE_MAX_SIZE;
@@ -2956,10 +3159,11 @@ tfw_hpack_rbuf_commit(TfwHPackETbl *__restrict tbl,
 
 		if (!del_node)
 			break;
-		tfw_hpack_rbtree_erase(tbl, del_node);
+		tfw_hpack_node_erase(tbl, del_node);
 	}
 
 	tfw_hpack_rbtree_add(tbl, iter->last, place);
+	tfw_hpack_ht_add(tbl, iter->last);
 
 	tbl->first = iter->first;
 	tbl->last = iter->last;
@@ -2986,7 +3190,7 @@ tfw_hpack_add_node(TfwHPackETbl *__restrict tbl, TfwStr *__restrict hdr,
 	TfwHPackETblIter it = {};
 
 	hdr_len = tfw_http_hdr_split(hdr, &s_nm, &s_val,
-				     op == TFW_H2_TRANS_INPLACE);
+				     op == TFW_H2_TRANS_COPY);
 
 	WARN_ON_ONCE(cur_size > window || window > HPACK_ENC_TABLE_MAX_SIZE);
 	if ((node_size = hdr_len + HPACK_ENTRY_OVERHEAD) > window) {
@@ -3079,6 +3283,7 @@ commit:
 	it.size += node_size;
 	it.rb_len += node_len;
 	it.last->hdr_len = hdr_len;
+	it.last->hash = tfw_hpack_node_hash(&s_nm, &s_val);
 	it.last->rindex = ++tbl->idx_acc;
 
 	ptr = tfw_hpack_write(&s_nm, it.last->hdr);
@@ -3104,21 +3309,29 @@ tfw_hpack_encoder_index(TfwHPackETbl *__restrict tbl,
 			unsigned long *__restrict flags,
 			TfwH2TransOp op)
 {
+	unsigned int hash;
 	TfwHPackNodeIter place = {};
 	const TfwHPackNode *node = NULL;
 	TfwHPackETblRes res = HPACK_IDX_ST_NOT_FOUND;
+	TfwStr s_nm = {}, s_val = {};
 
 	BUILD_BUG_ON(HPACK_IDX_ST_MASK < _HPACK_IDX_ST_NUM - 1);
 	if (WARN_ON_ONCE(!hdr))
 		return -EINVAL;
 
+	tfw_http_hdr_split(hdr, &s_nm, &s_val, op == TFW_H2_TRANS_COPY);
+	hash = tfw_hpack_node_hash(&s_nm, &s_val);
+
 	spin_lock(&tbl->lock);
 
 	if (!test_bit(TFW_HTTP_B_H2_TRANS_ENTERED, flags)
 	    && atomic64_read(&tbl->guard) < 0)
 		goto out;
 
-	res = tfw_hpack_rbtree_find(tbl, hdr, &node, &place);
+	if ((node = tfw_hpack_ht_find(tbl, hdr, hash)))
+		res = HPACK_IDX_ST_FOUND;
+	else
+		res = tfw_hpack_rbtree_find(tbl, hdr, &node, &place);
 
 	WARN_ON_ONCE(!node && res != HPACK_IDX_ST_NOT_FOUND);
 
@@ -3194,139 +3407,95 @@ tfw_hpack_enc_release(TfwHPack *__restrict hp, unsigned long *flags)
 	__clear_bit(TFW_HTTP_B_H2_TRANS_ENTERED, flags);
 }
 
+/**
+ * Calculate length of the Huffman encoded @str. Eight symbols are summed
+ * a time and the calculation stops as soon as the encoded string can't be
+ * shorter than @str.
+ *
+ * @return the encoded length or zero if the encoding doesn't shrink @str.
+ */
 static unsigned long
 tfw_huffman_encode_string_len(TfwStr *str)
 {
 	TfwStr *c, *end;
-	unsigned long n = 0;
+	unsigned long n = 0, lim = str->len << 3;
 
 	BUG_ON(TFW_STR_DUP(str));
 
 	TFW_STR_FOR_EACH_CHUNK(c, str, end) {
-		unsigned long i;
-
-		for (i = 0; i < c->len; i++) {
-			n += ht_length[(unsigned char)c->data[i]];
+		const unsigned char *p = c->data, *e = p + c->len;
+
+		for ( ; p + 8 <= e; p += 8) {
+			n += ht_length[p[0]] + ht_length[p[1]]
+			     + ht_length[p[2]] + ht_length[p[3]]
+			     + ht_length[p[4]] + ht_length[p[5]]
+			     + ht_length[p[6]] + ht_length[p[7]];
+			if (n >= lim)
+				return 0;
 		}
+		for ( ; p < e; ++p)
+			n += ht_length[*p];
 	}
+	n = (n + 7) >> 3;
 
-	return (n + 7) >> 3;
+	return n < str->len ? n : 0;
 }
 
-static int
-tfw_huffman_encode_copy(TfwStr *__restrict src, TfwStr *__restrict dst_str)
+/**
+ * Encode @src into @dst. The codes are accumulated in a 64-bit word which
+ * is flushed by 32-bit big-endian words, the accumulator never overflows
+ * since the codes are at most 30 bits. The tail word is written as a whole,
+ * so @dst must have 3 spare bytes after the encoded string.
+ */
+static void
+tfw_huffman_encode_copy(TfwStr *__restrict src, char *__restrict dst)
 {
 	TfwStr *c, *end;
-	int off = 0;
-	u64 last_word = 0;
-	u64 *dst = (u64 *)dst_str->data;
-	const char *dst_end = dst_str->data + dst_str->len;
-
-#define JOIN_BITS(a, len, b) (((a) << (len)) | (b))
-#define write_bytes(n)							\
-do {									\
-	unsigned int __n = n;						\
-	do {								\
-		if (unlikely(dst_end - (char *)dst == 0))		\
-			return -EINVAL;					\
-		*(char *)dst++ = (char)last_word;			\
-		last_word >>= 8;					\
-	} while (--__n);						\
-} while (0)
-
-	BUG_ON(!TFW_STR_PLAIN(dst_str));
+	unsigned int bits = 0;
+	u64 acc = 0;
 
 	TFW_STR_FOR_EACH_CHUNK(c, src, end) {
-		unsigned long i;
-
-		for (i = 0; i < c->len; i++) {
-			const unsigned int s = c->data[i];
-			const unsigned int d = 64 - off;
-			const unsigned int e = ht_encode[s];
-			const unsigned int l = ht_length[s];
-
-			off += l;
-			if (l <= d) {
-				last_word = JOIN_BITS(last_word, l, e);
-			} else {
-				off -= 64;
-				last_word = JOIN_BITS(last_word, d, e >> off);
-				if (dst_end - (char *)dst >= sizeof(u64)) {
-					last_word = cpu_to_be64(last_word);
-					*dst = last_word;
-					dst++;
-				} else {
-					write_bytes(sizeof(u64));
-				}
-				last_word = e;
+		const unsigned char *p = c->data, *e = p + c->len;
+
+		for ( ; p < e; ++p) {
+			acc = (acc << ht_length[*p]) | ht_encode[*p];
+			bits += ht_length[*p];
+			if (bits >= 32) {
+				bits -= 32;
+				*(__be32 *)dst = cpu_to_be32(acc >> bits);
+				dst += sizeof(u32);
 			}
 		}
 	}
 
-	if (off) {
-		unsigned int tail = off & 7;
+	if (bits) {
+		unsigned int tail = bits & 7;
 
+		/* Pad the last byte by the most significant bits of EOS. */
 		if (tail) {
-			unsigned int d = 8 - tail;
-
-			last_word = JOIN_BITS(last_word, d, HT_EOS_HIGH >> tail);
-			off += d;
-		}
-		last_word <<= 64 - off;
-		last_word = cpu_to_be64(last_word);
-		if (off == 64) {
-			if (dst_end - (char *)dst >= sizeof(u64)) {
-				*dst = last_word;
-				dst++;
-			} else {
-				write_bytes(sizeof(u64));
-			}
-			goto done;
-		}
-		if (off > 31) {
-			if (dst_end - (char *)dst >= sizeof(u32)) {
-				*(u32 *)dst = (u32)last_word;
-				dst = (u64 *)((u32 *)dst + 1);
-			} else {
-				write_bytes(sizeof(u32));
-			}
-			last_word >>= 32;
-			off -= 32;
-		}
-		if (off > 15) {
-			if (dst_end - (char *)dst >= sizeof(u16)) {
-				*(u16 *)dst = (u16)last_word;
-				dst = (u64 *)((u16 *)dst + 1);
-			} else {
-				write_bytes(sizeof(u16));
-			}
-			last_word >>= 16;
-			off -= 16;
-		}
-		if (off) {
-			if (unlikely(dst_end - (char *)dst == 0))
-				return -EINVAL;
-			*(u8 *)dst = (u8)last_word;
+			acc = (acc << (8 - tail)) | (HT_EOS_HIGH >> tail);
+			bits += 8 - tail;
 		}
+		*(__be32 *)dst = cpu_to_be32(acc << (32 - bits));
 	}
-
-#undef JOIN_BITS
-#undef write_bytes
-
-done:
-	return 0;
 }
 
+/**
+ * Huffman encode @str into a new string allocated from @pool.
+ *
+ * @return the encoded string, NULL if the encoding doesn't make @str shorter
+ * or an error pointer.
+ */
 static TfwStr *
 tfw_huffman_encode_string(TfwStr *str, TfwPool *pool)
 {
 	unsigned long enc_len = tfw_huffman_encode_string_len(str);
 	TfwStr *encoded;
-	int r;
 
 	if (!enc_len)
-		return ERR_PTR(-EINVAL);
-	encoded = tfw_pool_alloc(pool, sizeof(TfwStr) + enc_len);
+		return NULL;
+	encoded = tfw_pool_alloc(pool, sizeof(TfwStr) + enc_len
+				       + sizeof(u32) - 1);
 	if (!encoded)
 		return ERR_PTR(-ENOMEM);
 
@@ -3334,28 +3503,9 @@ tfw_huffman_encode_string(TfwStr *str, TfwPool *pool)
 	encoded->data = (char *)(encoded + 1);
 	encoded->len = enc_len;
 
-	r = tfw_huffman_encode_copy(str, encoded);
+	tfw_huffman_encode_copy(str, encoded->data);
 
-	return r ? ERR_PTR(r) : encoded;
-}
-
-static int
-tfw_hpack_str_add_raw(TfwHttpTransIter *mit, TfwStr *str, bool in_huffman)
-{
-	int r = 0;
-	TfwHPackInt len;
-	TfwStr len_str = { 0 };
-	unsigned short mask = in_huffman ? 0x80 : 0x0;
-
-	write_int(str->len, 0x7F, mask, &len);
-	len_str.data = len.buf;
-	len_str.len = len.sz;
-
-	r = tfw_h2_msg_rewrite_data(mit, &len_str, mit->bnd);
-	if (unlikely(r))
-		return r;
-
-	return tfw_h2_msg_rewrite_data(mit, str, mit->bnd);
+	return encoded;
 }
 
 static int
@@ -3386,119 +3536,38 @@ tfw_hpack_str_expand_raw(TfwHttpTransIter *mit, TfwMsgIter *it,
 }
 
 /*
- * Family of functions to add new or append of h2 response. Huffman encoding
- * is never used due to performance considerations:
- * - We must write first the size of the string, it has variable size, and
- *   string encoded with Huffman codes may be shorter or longer than original
- *   string. The size will be known only after the string is completely encoded.
- * - We can't encode @str in-place in @str: due to variable-sized coding, we
- *   can't overwrite symbol-by symbol in place. But this is also not possible
- *   due to @str origin, some strings are predefined strings from const memory
- *   region, others are shared for all messages to the same vhost.
- * - For skb management we need to have exact data size before using API.
+ * Family of functions to add new or append of h2 response. A string is
+ * Huffman encoded only if this makes it shorter, so the encoded length is
+ * calculated first: we must write first the size of the string and for skb
+ * management we need to have exact data size before using API.
  *
- * Since these reasons we can't encode @str on the fly or encode it while
- * writing to skb, so allocate a new string and copy @str encoded value there.
- * It heavily affect performance, since we have two allocations and two copy
- * operations here. We decided to keep the code, but our core use cases shows
- * no performance improvement opportunities. According to RFC we are free to
- * choose encoding (static/dynamic/Huffman) when modifying already existent
- * headers (e.g. in cases of HTTP/1.1=>HTTP/2 or HTTP/2=>HTTP/2 response proxy),
- * thus avoiding Huffman encodings is completely RFC-compliant behaviour.
+ * We can't encode @str in-place in @str: due to variable-sized coding, we
+ * can't overwrite symbol-by symbol in place. But this is also not possible
+ * due to @str origin, some strings are predefined strings from const memory
+ * region, others are shared for all messages to the same vhost. So allocate
+ * a new string and copy @str encoded value there. According to RFC we are
+ * free to choose encoding (static/dynamic/Huffman) when modifying already
+ * existent headers (e.g. in cases of HTTP/1.1=>HTTP/2 or HTTP/2=>HTTP/2
+ * response proxy), so raw strings are still written if they can't be shrunk.
  */
-static inline int
-tfw_hpack_str_add(TfwHttpTransIter *mit, TfwStr *str, TfwPool *pool)
-{
-	bool in_huffman = false;
-
-	if (0) {
-		str = tfw_huffman_encode_string(str, pool);
-
-		if (IS_ERR(str))
-			return PTR_ERR(str);
-		in_huffman = true;
-	}
-
-	return tfw_hpack_str_add_raw(mit, str, in_huffman);
-}
-
 static inline int
 tfw_hpack_str_expand(TfwHttpTransIter *mit, TfwMsgIter *it,
 		     struct sk_buff **skb_head, TfwStr *str,
 		     TfwPool *pool)
 {
 	bool in_huffman = false;
+	TfwStr *enc = tfw_huffman_encode_string(str, pool);
 
-	if (0) {
-		str = tfw_huffman_encode_string(str, pool);
-
-		if (IS_ERR(str))
-			return PTR_ERR(str);
+	if (IS_ERR(enc))
+		return PTR_ERR(enc);
+	if (enc) {
+		str = enc;
 		in_huffman = true;
 	}
 
 	return tfw_hpack_str_expand_raw(mit, it, skb_head, str, in_huffman);
 }
 
-/*
- * Add header @hdr in HTTP/2 HPACK format with metadata @idx into the
- * response @resp.
- */
-static int
-tfw_hpack_hdr_add(TfwHttpResp *__restrict resp, TfwStr *__restrict hdr,
-		  TfwHPackInt *__restrict idx, bool name_indexed)
-{
-	int r;
-	TfwStr *c, *end;
-	TfwHttpTransIter *mit = &resp->mit;
-	TfwStr s_val;
-	const TfwStr s_idx = {
-		.data = idx->buf,
-		.len = idx->sz,
-	};
-
-	T_DBG3("%s: s_idx->len=%lu, s_idx->data='%.*s'\n",
-	       __func__, s_idx.len, (int)s_idx.len, s_idx.data);
-
-	r = tfw_h2_msg_rewrite_data(mit, &s_idx, mit->bnd);
-	if (unlikely(r))
-		return r;
-
-	if (!hdr)
-		return 0;
-
-	if (WARN_ON_ONCE(TFW_STR_PLAIN(hdr)))
-		return -EINVAL;
-
-	if (unlikely(!name_indexed)) {
-		r = tfw_hpack_str_add(mit, TFW_STR_CHUNK(hdr, 0), resp->pool);
-		if (unlikely(r))
-			return r;
-	}
-
-	/*
-	 * During headers addition into the message the source @hdr must have
-	 * the following chunk structure (without the OWS):
-	 *
-	 *	{ name [S_DLM] value1 [value2 [value3 ...]] }.
-	 *
-	 */
-	c = TFW_STR_CHUNK(hdr, 1);
-	if (WARN_ON_ONCE(!c))
-		return -EINVAL;
-
-	if (c->len == SLEN(S_DLM) && *(short *)c->data == *(short *)S_DLM) {
-		c = TFW_STR_CHUNK(hdr, 2);
-		if (WARN_ON_ONCE(!c))
-			return -EINVAL;
-	}
-
-	end = hdr->chunks + hdr->nchunks;
-	tfw_str_collect_cmp(c, end, &s_val, NULL);
-
-	return tfw_hpack_str_add(mit,&s_val, resp->pool);
-}
-
 /*
  * Expand the response @resp with the new @hdr in HTTP/2 HPACK format, via
  * extending of skb/frags chain.
@@ -3534,7 +3603,7 @@ tfw_hpack_hdr_expand(TfwHttpResp *__restrict resp, TfwStr *__restrict hdr,
 
 	if (unlikely(!name_indexed)) {
 		ret = tfw_hpack_str_expand(mit, iter, skb_head,
-					   TFW_STR_CHUNK(hdr, 0), NULL);
+					   TFW_STR_CHUNK(hdr, 0), resp->pool);
 		if (unlikely(ret))
 			return ret;
 	}
@@ -3564,94 +3633,180 @@ tfw_hpack_hdr_expand(TfwHttpResp *__restrict resp, TfwStr *__restrict hdr,
 	end = hdr->chunks + hdr->nchunks;
 	tfw_str_collect_cmp(c, end, &s_val, NULL);
 
-	return tfw_hpack_str_expand(mit, iter, skb_head, &s_val, NULL);
+	return tfw_hpack_str_expand(mit, iter, skb_head, &s_val, resp->pool);
 }
 
 /*
- * Transform the HTTP/1.1 header @hdr in-place into HTTP/2 HPACK format in the
- * response @resp.
+ * Copy the HTTP/1.1 header @hdr of the parsed response @resp into the new
+ * header block of @resp in HTTP/2 HPACK format. The colon and OWS around the
+ * header value are in separate chunks of @hdr and are skipped.
  */
 static int
-tfw_hpack_hdr_inplace(TfwHttpResp *__restrict resp, TfwStr *__restrict hdr,
-		      TfwHPackInt *__restrict idx, bool name_indexed,
-		      bool indexed)
+tfw_hpack_hdr_copy(TfwHttpResp *__restrict resp, TfwStr *__restrict hdr,
+		   TfwHPackInt *__restrict idx, bool name_indexed,
+		   bool indexed)
 {
 	int r;
-	const char *bnd;
-	TfwHPackInt vlen;
 	TfwHttpTransIter *mit = &resp->mit;
-	TfwStr s_name = {}, s_val = {}, s_vlen = {};
-	const TfwStr s_idx = {
+	TfwMsgIter *iter = &mit->iter;
+	struct sk_buff **skb_head = &resp->msg.skb_head;
+	TfwStr s_name = {}, s_val = {};
+	TfwStr s_idx = {
 		.data = idx->buf,
 		.len = idx->sz,
 	};
 
-	T_DBG3("%s: s_idx->len=%lu, s_idx->data='%.*s'\n",
-	       __func__, s_idx.len, (int)s_idx.len, s_idx.data);
-
-	if (!hdr || WARN_ON_ONCE(TFW_STR_PLAIN(hdr) || TFW_STR_DUP(hdr)))
+	if (WARN_ON_ONCE(TFW_STR_PLAIN(hdr) || TFW_STR_DUP(hdr)))
 		return -EINVAL;
 
-	tfw_http_hdr_split(hdr, &s_name, &s_val, true);
+	r = tfw_http_msg_expand_data(iter, skb_head, &s_idx, &mit->start_off);
+	if (unlikely(r))
+		return r;
+	mit->acc_len += s_idx.len;
 
-	if (unlikely(!name_indexed)) {
-		TfwHPackInt nlen;
-		TfwStr s_nlen = {};
+	if (indexed)
+		return 0;
 
-		bnd = __TFW_STR_CH(&s_name, 0)->data;
+	tfw_http_hdr_split(hdr, &s_name, &s_val, true);
 
-		r = tfw_h2_msg_rewrite_data(mit, &s_idx, bnd);
+	if (unlikely(!name_indexed)) {
+		r = tfw_hpack_str_expand(mit, iter, skb_head, &s_name,
+					 resp->pool);
 		if (unlikely(r))
 			return r;
+	}
 
-		write_int(s_name.len, 0x7F, 0, &nlen);
-		s_nlen.data = nlen.buf;
-		s_nlen.len = nlen.sz;
+	return tfw_hpack_str_expand(mit, iter, skb_head, &s_val, resp->pool);
+}
 
-		r = tfw_h2_msg_rewrite_data(mit, &s_nlen, bnd);
-		if (unlikely(r))
-			return r;
+/*
+ * Dictionary of the most frequent values of response headers, which names
+ * are in the static table. The HPACK string representations of the values
+ * are built once by tfw_hpack_dict_init(), so the headers are written by
+ * a plain copy without Huffman encoding, whether they're added to the
+ * dynamic table on the first use in a connection or not. The dictionary is
+ * read-only afterwards and is shared by all the connections.
+ *
+ * @st_index	- static table index of the header name;
+ * @len		- length of @val;
+ * @val		- the header value;
+ * @enc_len	- length of @enc;
+ * @enc		- HPACK string representation of @val;
+ */
+#define HPACK_DICT_ENC_SZ	64
 
-		bnd = __TFW_STR_CH(&s_val, 0)->data;
+typedef struct {
+	unsigned short	st_index;
+	unsigned short	len;
+	const char	*val;
+	unsigned int	enc_len;
+	char		enc[HPACK_DICT_ENC_SZ];
+} TfwHPackDictEnt;
+
+#define HPACK_DICT_ENT(idx, v)	{ .st_index = idx, .len = SLEN(v), .val = v }
+
+static TfwHPackDictEnt hpack_dict[] __read_mostly = {
+	HPACK_DICT_ENT(18, "bytes"),
+	HPACK_DICT_ENT(24, "no-cache"),
+	HPACK_DICT_ENT(24, "no-store"),
+	HPACK_DICT_ENT(24, "private"),
+	HPACK_DICT_ENT(24, "public"),
+	HPACK_DICT_ENT(24, "max-age=0"),
+	HPACK_DICT_ENT(24, "no-cache, no-store, must-revalidate"),
+	HPACK_DICT_ENT(24, "public, max-age=31536000"),
+	HPACK_DICT_ENT(26, "gzip"),
+	HPACK_DICT_ENT(26, "br"),
+	HPACK_DICT_ENT(31, "text/html"),
+	HPACK_DICT_ENT(31, "text/html; charset=utf-8"),
+	HPACK_DICT_ENT(31, "text/html; charset=UTF-8"),
+	HPACK_DICT_ENT(31, "text/plain"),
+	HPACK_DICT_ENT(31, "text/plain; charset=utf-8"),
+	HPACK_DICT_ENT(31, "text/css"),
+	HPACK_DICT_ENT(31, "application/javascript"),
+	HPACK_DICT_ENT(31, "application/json"),
+	HPACK_DICT_ENT(31, "application/json; charset=utf-8"),
+	HPACK_DICT_ENT(31, "application/octet-stream"),
+	HPACK_DICT_ENT(31, "image/gif"),
+	HPACK_DICT_ENT(31, "image/jpeg"),
+	HPACK_DICT_ENT(31, "image/png"),
+	HPACK_DICT_ENT(31, "image/svg+xml"),
+	HPACK_DICT_ENT(31, "image/webp"),
+	HPACK_DICT_ENT(54, TFW_SERVER),
+	HPACK_DICT_ENT(59, "Accept-Encoding"),
+	HPACK_DICT_ENT(59, "Origin"),
+};
 
-		r = tfw_h2_msg_rewrite_data(mit, &s_name, bnd);
-		if (unlikely(r))
-			return r;
-	} else {
-		bnd = indexed
-			? mit->bnd
-			: __TFW_STR_CH(&s_val, 0)->data;
+/* Bit mask of the static indexes of the names in the dictionary. */
+static u64 hpack_dict_names __read_mostly;
 
-		r = tfw_h2_msg_rewrite_data(mit, &s_idx, bnd);
-		if (unlikely(r))
-			return r;
+/*
+ * Find the value of header @hdr, which is written by @op, in the dictionary.
+ */
+static const TfwHPackDictEnt *
+tfw_hpack_dict_find(TfwStr *__restrict hdr, TfwH2TransOp op)
+{
+	const TfwHPackDictEnt *d;
+	TfwStr *c, s_nm = {}, s_val = {};
 
-		if (indexed)
-			return 0;
-	}
+	if (hdr->hpack_idx >= 64
+	    || !(hpack_dict_names & BIT_ULL(hdr->hpack_idx))
+	    || TFW_STR_PLAIN(hdr) || TFW_STR_DUP(hdr))
+		return NULL;
+	/* A header being added may have no value yet. */
+	if (op == TFW_H2_TRANS_EXPAND) {
+		if (!(c = TFW_STR_CHUNK(hdr, 1)))
+			return NULL;
+		if (c->len == SLEN(S_DLM) && *(short *)c->data == *(short *)S_DLM
+		    && !TFW_STR_CHUNK(hdr, 2))
+			return NULL;
+	}
+	tfw_http_hdr_split(hdr, &s_nm, &s_val, op == TFW_H2_TRANS_COPY);
+
+	for (d = hpack_dict; d < hpack_dict + ARRAY_SIZE(hpack_dict); ++d)
+		if (d->st_index == hdr->hpack_idx && d->len == s_val.len
+		    && tfw_str_eq_cstr(&s_val, d->val, d->len,
+				       TFW_STR_EQ_DEFAULT))
+			return d;
+
+	return NULL;
+}
 
-	write_int(s_val.len, 0x7F, 0, &vlen);
-	s_vlen.data = vlen.buf;
-	s_vlen.len = vlen.sz;
+/*
+ * Write the header with the name index @idx and the value from dictionary
+ * entry @d at the end of the header block of @resp.
+ */
+static int
+tfw_hpack_hdr_dict(TfwHttpResp *__restrict resp, TfwHPackInt *__restrict idx,
+		   const TfwHPackDictEnt *__restrict d)
+{
+	int r;
+	TfwHttpTransIter *mit = &resp->mit;
+	struct sk_buff **skb_head = &resp->msg.skb_head;
+	TfwStr s = {
+		.data = idx->buf,
+		.len = idx->sz,
+	};
 
-	r = tfw_h2_msg_rewrite_data(mit, &s_vlen, bnd);
+	r = tfw_http_msg_expand_data(&mit->iter, skb_head, &s, &mit->start_off);
 	if (unlikely(r))
 		return r;
+	mit->acc_len += s.len;
 
-	r = tfw_h2_msg_rewrite_data(mit, &s_val, mit->bnd);
+	s.data = (char *)d->enc;
+	s.len = d->enc_len;
+	r = tfw_http_msg_expand_data(&mit->iter, skb_head, &s, NULL);
 	if (unlikely(r))
 		return r;
+	mit->acc_len += s.len;
 
 	return 0;
 }
 
 /*
- * Perform encoding of the header @hdr into the HTTP/2 HPACK format. The four
- * operation types can be executed here: addition, substitution, in-place
- * transformation and expansion. In cases of addition, substitution and in-place
- * operations the new headers overwrites the old data in the existing skb(s).
- * In the expansion case new headers are added along with new skb(s) creation
- * into the internally generated message.
+ * Perform encoding of the header @hdr into the HTTP/2 HPACK format. The header
+ * is always written at the end of the header block of @resp, which is built
+ * in new skb(s): @TFW_H2_TRANS_COPY copies a header of the parsed HTTP/1.1
+ * response and @TFW_H2_TRANS_EXPAND adds a header constructed by Tempesta.
  */
 int
 tfw_hpack_encode(TfwHttpResp *__restrict resp, TfwStr *__restrict hdr,
@@ -3659,6 +3814,7 @@ tfw_hpack_encode(TfwHttpResp *__restrict resp, TfwStr *__restrict hdr,
 {
 	TfwHPackInt idx;
 	bool st_full_index;
+	const TfwHPackDictEnt *d;
 	unsigned short st_index, index = 0;
 	TfwH2Ctx *ctx = tfw_h2_context(resp->req->conn);
 	TfwHPackETbl *tbl = &ctx->hpack.enc_tbl;
@@ -3691,18 +3847,9 @@ tfw_hpack_encode(TfwHttpResp *__restrict resp, TfwStr *__restrict hdr,
 		WARN_ON_ONCE(!index);
 
 		write_int(index, 0x7F, 0x80, &idx);
-		switch (op) {
-		case TFW_H2_TRANS_SUB:
-		case TFW_H2_TRANS_ADD:
-			return tfw_hpack_hdr_add(resp, NULL, &idx, true);
-		case TFW_H2_TRANS_EXPAND:
-			return tfw_hpack_hdr_expand(resp, NULL, &idx, true);
-		case TFW_H2_TRANS_INPLACE:
-			return tfw_hpack_hdr_inplace(resp, hdr, &idx, true,
-						     true);
-		default:
-			BUG();
-		}
+		if (op == TFW_H2_TRANS_COPY)
+			return tfw_hpack_hdr_copy(resp, hdr, &idx, true, true);
+		return tfw_hpack_hdr_expand(resp, NULL, &idx, true);
 	}
 
 	if (st_index || HPACK_IDX_RES(r) == HPACK_IDX_ST_NM_FOUND) {
@@ -3721,18 +3868,11 @@ tfw_hpack_encode(TfwHttpResp *__restrict resp, TfwStr *__restrict hdr,
 		else
 			write_int(index, 0xF, 0, &idx);
 
-		switch (op) {
-		case TFW_H2_TRANS_SUB:
-		case TFW_H2_TRANS_ADD:
-			return tfw_hpack_hdr_add(resp, hdr, &idx, true);
-		case TFW_H2_TRANS_EXPAND:
-			return tfw_hpack_hdr_expand(resp, hdr, &idx, true);
-		case TFW_H2_TRANS_INPLACE:
-			return tfw_hpack_hdr_inplace(resp, hdr, &idx, true,
-						     false);
-		default:
-			BUG();
-		}
+		if (st_index && (d = tfw_hpack_dict_find(hdr, op)))
+			return tfw_hpack_hdr_dict(resp, &idx, d);
+		if (op == TFW_H2_TRANS_COPY)
+			return tfw_hpack_hdr_copy(resp, hdr, &idx, true, false);
+		return tfw_hpack_hdr_expand(resp, hdr, &idx, true);
 	}
 
 	WARN_ON_ONCE(index || st_index);
@@ -3740,17 +3880,92 @@ tfw_hpack_encode(TfwHttpResp *__restrict resp, TfwStr *__restrict hdr,
 	idx.sz = 1;
 	idx.buf[0] = (r & HPACK_IDX_FLAG_ADD) ? 0x40 : 0;
 
-	switch (op) {
-	case TFW_H2_TRANS_SUB:
-	case TFW_H2_TRANS_ADD:
-		return tfw_hpack_hdr_add(resp, hdr, &idx, false);
-	case TFW_H2_TRANS_EXPAND:
-		return tfw_hpack_hdr_expand(resp, hdr, &idx, false);
-	case TFW_H2_TRANS_INPLACE:
-		return tfw_hpack_hdr_inplace(resp, hdr, &idx, false,
-					     false);
-	default:
-		BUG();
+	if (op == TFW_H2_TRANS_COPY)
+		return tfw_hpack_hdr_copy(resp, hdr, &idx, false, false);
+	return tfw_hpack_hdr_expand(resp, hdr, &idx, false);
+}
+
+static char *
+__hpack_str_write(char *p, TfwStr *str)
+{
+	TfwHPackInt len;
+	TfwStr *c, *end;
+	unsigned long enc_len = tfw_huffman_encode_string_len(str);
+
+	write_int(enc_len ? : str->len, 0x7F, enc_len ? 0x80 : 0, &len);
+	memcpy(p, len.buf, len.sz);
+	p += len.sz;
+	if (enc_len) {
+		tfw_huffman_encode_copy(str, p);
+		return p + enc_len;
+	}
+	TFW_STR_FOR_EACH_CHUNK(c, str, end) {
+		memcpy(p, c->data, c->len);
+		p += c->len;
+	}
+
+	return p;
+}
+
+/**
+ * Encode the header @hdr with a value, which is constructed by Tempesta, into
+ * @buf the same way as tfw_hpack_encode() does it without the dynamic index.
+ * Such representation doesn't depend on a connection, so configured headers
+ * are encoded once instead of each response. @buf must have room for
+ * @hdr->len + HPACK_ENC_HDR_OVERHEAD bytes.
+ *
+ * @return the length of the encoded header.
+ */
+unsigned long
+tfw_hpack_encode_nodyn(TfwStr *__restrict hdr, char *__restrict buf)
+{
+	TfwHPackInt idx;
+	TfwStr *c, *end, s_val = {};
+	unsigned short st_index = hdr->hpack_idx;
+	char *p = buf;
+
+	if (hdr->flags & TFW_STR_FULL_INDEX) {
+		write_int(st_index, 0x7F, 0x80, &idx);
+		memcpy(p, idx.buf, idx.sz);
+		return idx.sz;
+	}
+
+	if (st_index) {
+		write_int(st_index, 0xF, 0, &idx);
+		memcpy(p, idx.buf, idx.sz);
+		p += idx.sz;
+	} else {
+		*p++ = 0;
+		p = __hpack_str_write(p, TFW_STR_CHUNK(hdr, 0));
+	}
+
+	c = TFW_STR_CHUNK(hdr, 1);
+	if (WARN_ON_ONCE(!c))
+		return 0;
+	if (c->len == SLEN(S_DLM) && *(short *)c->data == *(short *)S_DLM)
+		c = TFW_STR_CHUNK(hdr, 2);
+	end = hdr->chunks + hdr->nchunks;
+	tfw_str_collect_cmp(c, end, &s_val, NULL);
+	p = __hpack_str_write(p, &s_val);
+
+	return p - buf;
+}
+
+/**
+ * Build the HPACK representations of the dictionary values.
+ */
+void
+tfw_hpack_dict_init(void)
+{
+	TfwHPackDictEnt *d;
+
+	for (d = hpack_dict; d < hpack_dict + ARRAY_SIZE(hpack_dict); ++d) {
+		TfwStr s = { .data = (char *)d->val, .len = d->len };
+
+		/* The Huffman encoder writes up to 3 bytes after the string. */
+		BUG_ON(d->len + HPACK_MAX_INT + 3 > HPACK_DICT_ENC_SZ);
+		d->enc_len = __hpack_str_write(d->enc, &s) - d->enc;
+		hpack_dict_names |= BIT_ULL(d->st_index);
 	}
 }
 
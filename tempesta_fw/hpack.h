@@ -29,6 +29,17 @@
  */
 #define HPACK_TABLE_DEF_SIZE		4096
 #define HPACK_ENC_TABLE_MAX_SIZE	HPACK_TABLE_DEF_SIZE
+/*
+ * Number of buckets in the hash index of encoder dynamic table, the table
+ * holds at most HPACK_ENC_TABLE_MAX_SIZE / HPACK_ENTRY_OVERHEAD entries.
+ */
+#define HPACK_ENC_HT_SZ			64
+/*
+ * Max size of the HPACK representation of a header above the length of its
+ * name and value: the literal type byte, two string lengths and spare bytes
+ * for the Huffman encoder, see tfw_hpack_encode_nodyn().
+ */
+#define HPACK_ENC_HDR_OVERHEAD		16
 
 /**
  * Red-black tree node representation in the ring buffer.
@@ -46,6 +57,8 @@
  * @parent	- parent node offset in the ring buffer (in bytes);
  * @left	- left child offset in the ring buffer (in bytes);
  * @right	- right child offset in the ring buffer (in bytes);
+ * @hnext	- next node offset in the hash index bucket (in bytes);
+ * @hash	- hash of the stored header, see tfw_hpack_node_hash();
  * @hdr		- pointer to header string.
  */
 typedef struct {
@@ -55,6 +68,8 @@ typedef struct {
 	short			parent;
 	short			left;
 	short			right;
+	short			hnext;
+	unsigned int		hash;
 	char			hdr[0];
 } TfwHPackNode;
 
@@ -76,12 +91,14 @@ typedef struct {
 
 /**
  * HPack encoder dynamic index, implemented as ring buffer with entries
- * organized in form of binary tree.
+ * organized in form of binary tree and hash index.
  *
  * @window	- maximum pseudo-length of the dynamic table (in bytes); this
  *		  value used as threshold to flushing old entries;
  * @rbuf	- pointer to the ring buffer;
  * @root	- pointer to the root node of binary tree;
+ * @htbl	- hash index buckets, offsets of the first nodes in the ring
+ *		  buffer (in bytes);
  * @pool	- memory pool for dynamic table;
  * @idx_acc	- current accumulated index, intended for real indexes
  *		  calculation;
@@ -94,6 +111,7 @@ typedef struct {
 	unsigned short		window;
 	char			*rbuf;
 	TfwHPackNode		*root;
+	short			htbl[HPACK_ENC_HT_SZ];
 	TfwPool			*pool;
 	unsigned long		idx_acc;
 	atomic64_t		guard;
@@ -107,10 +125,16 @@ typedef struct {
 	TFW_HPACK_ETBL_COMMON;
 } TfwHPackETblIter;
 
+/**
+ * Source of a header encoded into HTTP/2 response.
+ *
+ * @TFW_H2_TRANS_COPY	- a header of the parsed HTTP/1.1 response, the colon
+ *			  and OWS are in separate chunks;
+ * @TFW_H2_TRANS_EXPAND	- a header built by Tempesta with the chunks structure
+ *			  { name [S_DLM] value1 [value2 [value3 ...]] }.
+ */
 typedef enum {
-	TFW_H2_TRANS_INPLACE	= 0,
-	TFW_H2_TRANS_SUB,
-	TFW_H2_TRANS_ADD,
+	TFW_H2_TRANS_COPY	= 0,
 	TFW_H2_TRANS_EXPAND,
 } TfwH2TransOp;
 
@@ -140,47 +164,59 @@ typedef enum {
 } TfwHPackTag;
 
 /**
- * Representation of the entry in HPack decoder index.
+ * Representation of the entry in HPack decoder index. The entries of the
+ * dynamic table are followed by the header descriptor, its chunks and data.
  *
  * @hdr		- pointer to the header data descriptor;
  * @name_len	- length of the header's name part;
  * @name_num	- chunks count of the header's name part;
  * @tag		- tag of the indexed header;
- * @last	- flag bit indicating that corresponding header is the last on
- *		  the page.
+ * @rsize	- size of the dynamic table entry in the ring buffer.
  */
 typedef struct {
 	TfwStr			*hdr;
 	unsigned long		name_len;
 	unsigned long		name_num;
 	unsigned int		tag;
-	unsigned char		last : 1;
+	unsigned int		rsize;
 } TfwHPackEntry;
 
 /**
  * HPack decoder dynamic index table.
  *
- * @entries	- dynamic table of entries;
- * @pool	- memory pool for constantly sized entries (i.e. the entry
- *		  descriptors);
- * @h_pool	- memory pool for entries of variable size (headers themselves
- *		- and @TfwStr descriptors for them);
+ * The entries are stored one after another in the @rbuf ring buffer, which
+ * is allocated for @window bytes and grows only if the entry descriptors
+ * don't fit it. An entry is never split by the end of the buffer: if the
+ * entries wrap, @rb_wrap is the end of the eldest of them. @idx keeps offsets
+ * of the entries in @rbuf for direct access by the entry index.
+ *
+ * @pool	- memory pool for the ring buffer and the offsets;
+ * @rbuf	- ring buffer of the entries;
+ * @idx		- circular buffer of the entry offsets in @rbuf;
  * @n		- actual number of entries in the table;
- * @curr	- circular buffer index of recent entry;
- * @length	- current length of the dynamic table (in entries);
+ * @curr	- @idx index for the next entry;
+ * @length	- length of @idx, i.e. maximum number of entries;
  * @size	- current pseudo-length of the dynamic headers table (in bytes);
  * @window	- maximum pseudo-length of the dynamic table (in bytes); this
  *		  value used as threshold to flushing old entries;
+ * @rb_size	- size of @rbuf;
+ * @rb_head	- offset of the eldest entry in @rbuf;
+ * @rb_tail	- offset of the free space after the recent entry in @rbuf;
+ * @rb_wrap	- end of the eldest entries if the entries wrap, zero otherwise;
  */
 typedef struct {
-	TfwHPackEntry		*entries;
 	TfwPool			*pool;
-	TfwPool			*h_pool;
+	char			*rbuf;
+	unsigned int		*idx;
 	unsigned int		n;
 	unsigned int		curr;
 	unsigned int		length;
 	unsigned int		size;
 	unsigned int		window;
+	unsigned int		rb_size;
+	unsigned int		rb_head;
+	unsigned int		rb_tail;
+	unsigned int		rb_wrap;
 } TfwHPackDTbl;
 
 /**
@@ -205,7 +241,7 @@ typedef struct {
 	unsigned long		length;
 	unsigned int		max_window;
 	int			curr;
-	unsigned short		hctx;
+	unsigned int		hctx;
 	char			__off[0];
 	unsigned int		state;
 	unsigned int		shift;
@@ -265,8 +301,12 @@ void write_int(unsigned long index, unsigned short max, unsigned short mask,
 	       TfwHPackInt *__restrict res_idx);
 int tfw_hpack_init(TfwHPack *__restrict hp, unsigned int htbl_sz);
 void tfw_hpack_clean(TfwHPack *__restrict hp);
+void tfw_hpack_cache_drain(void);
+void tfw_hpack_dict_init(void);
 int tfw_hpack_encode(TfwHttpResp *__restrict resp, TfwStr *__restrict hdr,
 		     TfwH2TransOp op, bool dyn_indexing);
+unsigned long tfw_hpack_encode_nodyn(TfwStr *__restrict hdr,
+				     char *__restrict buf);
 void tfw_hpack_set_rbuf_size(TfwHPackETbl *__restrict tbl,
 			     unsigned short new_size);
 int tfw_hpack_decode(TfwHPack *__restrict hp, unsigned char *__restrict src,
@@ -304,6 +304,16 @@ static HCode source[] = {
 
 #define BAD_SYMBOL	(-2)
 
+/*
+ * Multi-symbol decoding table: @MS_BITS of input decode to up to @MS_SYMS
+ * symbols at once. The shortest code is 5 bits, so 12 bits give at most two
+ * symbols while the table entries still fit a 32-bit word and the whole
+ * table is 16KB.
+ */
+#define MS_BITS		12
+#define MS_SYMS		(MS_BITS / 5)
+#define MS_BIG		(1 << MS_BITS)
+
 static uint32_t codes[257];
 static uint8_t codes_n[257];
 
@@ -525,6 +535,55 @@ ht_out16(const HTree *base, unsigned int offset, const unsigned int last)
 	return offset;
 }
 
+/*
+ * Decode as many symbols as possible from the @MS_BITS prefix @v. Symbols
+ * with codes longer than the prefix, like EOS, are left for the state
+ * machine above.
+ */
+static unsigned int
+ms_decode(unsigned int v, uint8_t *syms, unsigned int *bits)
+{
+	unsigned int n, s, used = 0;
+
+	for (n = 0; n < MS_SYMS; n++) {
+		for (s = 0; s < 256; s++) {
+			unsigned int len = codes_n[s];
+			unsigned int shift = MS_BITS - used - len;
+
+			if (len <= MS_BITS - used
+			    && ((v >> shift) & ((1 << len) - 1)) == codes[s])
+				break;
+		}
+		if (s == 256)
+			break;
+		syms[n] = s;
+		used += codes_n[s];
+	}
+	*bits = used;
+
+	return n;
+}
+
+static void
+ms_out(void)
+{
+	unsigned int i, j, n, bits;
+	uint8_t syms[MS_SYMS];
+
+	printf("static const HTMState ht_ms_decode[] __page_aligned_data"
+	       " = {\n");
+	for (i = 0; i < MS_BIG; i++) {
+		n = ms_decode(i, syms, &bits);
+		for (j = n; j < MS_SYMS; j++)
+			syms[j] = 0;
+		printf("%s{%2u, %u, {", i % 3 ? " " : "\t", bits, n);
+		for (j = 0; j < MS_SYMS; j++)
+			printf("%s%3u", j ? ", " : "", syms[j]);
+		printf("}}%s", i == MS_BIG - 1 ? "\n};\n\n"
+					      : i % 3 == 2 ? ",\n" : ",");
+	}
+}
+
 int
 main(int argc, char *argv[])
 {
@@ -559,7 +618,10 @@ main(int argc, char *argv[])
 
 	code = codes[256];
 	length = codes_n[256];
-	printf("#define HT_EOS_HIGH\t0x%02X\n\n", code >> (length - 8));
+	printf("#define HT_EOS_HIGH\t0x%02X\n", code >> (length - 8));
+	printf("#define HT_MS_BITS\t%u\n", MS_BITS);
+	printf("#define HT_MS_MASK\t%u\n", MS_BIG - 1);
+	printf("#define HT_MS_SYMS\t%u\n\n", MS_SYMS);
 
 	printf("static const unsigned int ht_encode[] __page_aligned_data"
 	       " = {\n\t");
@@ -586,7 +648,10 @@ main(int argc, char *argv[])
 	puts("static const HTState ht_decode[] __page_aligned_data = {");
 	ht_out(root, 0, offset16);
 	ht_out16(root, offset, offset16);
-	puts("};\n\n#endif /* __TFW_HTTP_HPACK_TBL_H__ */");
+	puts("};\n");
+
+	ms_out();
+	puts("#endif /* __TFW_HTTP_HPACK_TBL_H__ */");
 
 	return 0;
 }
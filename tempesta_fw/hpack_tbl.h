@@ -47,6 +47,21 @@ typedef struct {
 	short	offset;
 } __attribute__((packed)) HTState;
 
+/**
+ * Multi-symbol Huffman decoder table entry for a HT_MS_BITS input prefix:
+ *
+ * @bits	- number of bits taken by the decoded symbols;
+ * @n		- number of the decoded symbols, zero if the prefix doesn't
+ *		  contain a whole code and the state machine above must be
+ *		  used;
+ * @sym		- the decoded symbols, exactly HT_MS_SYMS of them;
+ */
+typedef struct {
+	unsigned char	bits;
+	unsigned char	n;
+	unsigned char	sym[2];
+} HTMState;
+
 /*
  * All the below is generated by hpack/hgen.c. DO NOT EDIT IT BY HANDS!
  * If you need to change the constants, then update the generation program,
@@ -61,6 +76,9 @@ typedef struct {
 #define HT_MMASK	7
 #define HT_SMALL	640
 #define HT_EOS_HIGH	0xFF
+#define HT_MS_BITS	12
+#define HT_MS_MASK	4095
+#define HT_MS_SYMS	2
 
 static const unsigned int ht_encode[] __page_aligned_data = {
 	0x00001FF8, 0x007FFFD8, 0x0FFFFFE2, 0x0FFFFFE3,
@@ -1030,4 +1048,1373 @@ static const HTState ht_decode[] __page_aligned_data = {
 	{-6,    0}, /* 2: EOS */
 };
 
+static const HTMState ht_ms_decode[] __page_aligned_data = {
+	{10, 2, { 48,  48}}, {10, 2, { 48,  48}}, {10, 2, { 48,  48}},
+	{10, 2, { 48,  48}}, {10, 2, { 48,  49}}, {10, 2, { 48,  49}},
+	{10, 2, { 48,  49}}, {10, 2, { 48,  49}}, {10, 2, { 48,  50}},
+	{10, 2, { 48,  50}}, {10, 2, { 48,  50}}, {10, 2, { 48,  50}},
+	{10, 2, { 48,  97}}, {10, 2, { 48,  97}}, {10, 2, { 48,  97}},
+	{10, 2, { 48,  97}}, {10, 2, { 48,  99}}, {10, 2, { 48,  99}},
+	{10, 2, { 48,  99}}, {10, 2, { 48,  99}}, {10, 2, { 48, 101}},
+	{10, 2, { 48, 101}}, {10, 2, { 48, 101}}, {10, 2, { 48, 101}},
+	{10, 2, { 48, 105}}, {10, 2, { 48, 105}}, {10, 2, { 48, 105}},
+	{10, 2, { 48, 105}}, {10, 2, { 48, 111}}, {10, 2, { 48, 111}},
+	{10, 2, { 48, 111}}, {10, 2, { 48, 111}}, {10, 2, { 48, 115}},
+	{10, 2, { 48, 115}}, {10, 2, { 48, 115}}, {10, 2, { 48, 115}},
+	{10, 2, { 48, 116}}, {10, 2, { 48, 116}}, {10, 2, { 48, 116}},
+	{10, 2, { 48, 116}}, {11, 2, { 48,  32}}, {11, 2, { 48,  32}},
+	{11, 2, { 48,  37}}, {11, 2, { 48,  37}}, {11, 2, { 48,  45}},
+	{11, 2, { 48,  45}}, {11, 2, { 48,  46}}, {11, 2, { 48,  46}},
+	{11, 2, { 48,  47}}, {11, 2, { 48,  47}}, {11, 2, { 48,  51}},
+	{11, 2, { 48,  51}}, {11, 2, { 48,  52}}, {11, 2, { 48,  52}},
+	{11, 2, { 48,  53}}, {11, 2, { 48,  53}}, {11, 2, { 48,  54}},
+	{11, 2, { 48,  54}}, {11, 2, { 48,  55}}, {11, 2, { 48,  55}},
+	{11, 2, { 48,  56}}, {11, 2, { 48,  56}}, {11, 2, { 48,  57}},
+	{11, 2, { 48,  57}}, {11, 2, { 48,  61}}, {11, 2, { 48,  61}},
+	{11, 2, { 48,  65}}, {11, 2, { 48,  65}}, {11, 2, { 48,  95}},
+	{11, 2, { 48,  95}}, {11, 2, { 48,  98}}, {11, 2, { 48,  98}},
+	{11, 2, { 48, 100}}, {11, 2, { 48, 100}}, {11, 2, { 48, 102}},
+	{11, 2, { 48, 102}}, {11, 2, { 48, 103}}, {11, 2, { 48, 103}},
+	{11, 2, { 48, 104}}, {11, 2, { 48, 104}}, {11, 2, { 48, 108}},
+	{11, 2, { 48, 108}}, {11, 2, { 48, 109}}, {11, 2, { 48, 109}},
+	{11, 2, { 48, 110}}, {11, 2, { 48, 110}}, {11, 2, { 48, 112}},
+	{11, 2, { 48, 112}}, {11, 2, { 48, 114}}, {11, 2, { 48, 114}},
+	{11, 2, { 48, 117}}, {11, 2, { 48, 117}}, {12, 2, { 48,  58}},
+	{12, 2, { 48,  66}}, {12, 2, { 48,  67}}, {12, 2, { 48,  68}},
+	{12, 2, { 48,  69}}, {12, 2, { 48,  70}}, {12, 2, { 48,  71}},
+	{12, 2, { 48,  72}}, {12, 2, { 48,  73}}, {12, 2, { 48,  74}},
+	{12, 2, { 48,  75}}, {12, 2, { 48,  76}}, {12, 2, { 48,  77}},
+	{12, 2, { 48,  78}}, {12, 2, { 48,  79}}, {12, 2, { 48,  80}},
+	{12, 2, { 48,  81}}, {12, 2, { 48,  82}}, {12, 2, { 48,  83}},
+	{12, 2, { 48,  84}}, {12, 2, { 48,  85}}, {12, 2, { 48,  86}},
+	{12, 2, { 48,  87}}, {12, 2, { 48,  89}}, {12, 2, { 48, 106}},
+	{12, 2, { 48, 107}}, {12, 2, { 48, 113}}, {12, 2, { 48, 118}},
+	{12, 2, { 48, 119}}, {12, 2, { 48, 120}}, {12, 2, { 48, 121}},
+	{12, 2, { 48, 122}}, { 5, 1, { 48,   0}}, { 5, 1, { 48,   0}},
+	{ 5, 1, { 48,   0}}, { 5, 1, { 48,   0}}, {10, 2, { 49,  48}},
+	{10, 2, { 49,  48}}, {10, 2, { 49,  48}}, {10, 2, { 49,  48}},
+	{10, 2, { 49,  49}}, {10, 2, { 49,  49}}, {10, 2, { 49,  49}},
+	{10, 2, { 49,  49}}, {10, 2, { 49,  50}}, {10, 2, { 49,  50}},
+	{10, 2, { 49,  50}}, {10, 2, { 49,  50}}, {10, 2, { 49,  97}},
+	{10, 2, { 49,  97}}, {10, 2, { 49,  97}}, {10, 2, { 49,  97}},
+	{10, 2, { 49,  99}}, {10, 2, { 49,  99}}, {10, 2, { 49,  99}},
+	{10, 2, { 49,  99}}, {10, 2, { 49, 101}}, {10, 2, { 49, 101}},
+	{10, 2, { 49, 101}}, {10, 2, { 49, 101}}, {10, 2, { 49, 105}},
+	{10, 2, { 49, 105}}, {10, 2, { 49, 105}}, {10, 2, { 49, 105}},
+	{10, 2, { 49, 111}}, {10, 2, { 49, 111}}, {10, 2, { 49, 111}},
+	{10, 2, { 49, 111}}, {10, 2, { 49, 115}}, {10, 2, { 49, 115}},
+	{10, 2, { 49, 115}}, {10, 2, { 49, 115}}, {10, 2, { 49, 116}},
+	{10, 2, { 49, 116}}, {10, 2, { 49, 116}}, {10, 2, { 49, 116}},
+	{11, 2, { 49,  32}}, {11, 2, { 49,  32}}, {11, 2, { 49,  37}},
+	{11, 2, { 49,  37}}, {11, 2, { 49,  45}}, {11, 2, { 49,  45}},
+	{11, 2, { 49,  46}}, {11, 2, { 49,  46}}, {11, 2, { 49,  47}},
+	{11, 2, { 49,  47}}, {11, 2, { 49,  51}}, {11, 2, { 49,  51}},
+	{11, 2, { 49,  52}}, {11, 2, { 49,  52}}, {11, 2, { 49,  53}},
+	{11, 2, { 49,  53}}, {11, 2, { 49,  54}}, {11, 2, { 49,  54}},
+	{11, 2, { 49,  55}}, {11, 2, { 49,  55}}, {11, 2, { 49,  56}},
+	{11, 2, { 49,  56}}, {11, 2, { 49,  57}}, {11, 2, { 49,  57}},
+	{11, 2, { 49,  61}}, {11, 2, { 49,  61}}, {11, 2, { 49,  65}},
+	{11, 2, { 49,  65}}, {11, 2, { 49,  95}}, {11, 2, { 49,  95}},
+	{11, 2, { 49,  98}}, {11, 2, { 49,  98}}, {11, 2, { 49, 100}},
+	{11, 2, { 49, 100}}, {11, 2, { 49, 102}}, {11, 2, { 49, 102}},
+	{11, 2, { 49, 103}}, {11, 2, { 49, 103}}, {11, 2, { 49, 104}},
+	{11, 2, { 49, 104}}, {11, 2, { 49, 108}}, {11, 2, { 49, 108}},
+	{11, 2, { 49, 109}}, {11, 2, { 49, 109}}, {11, 2, { 49, 110}},
+	{11, 2, { 49, 110}}, {11, 2, { 49, 112}}, {11, 2, { 49, 112}},
+	{11, 2, { 49, 114}}, {11, 2, { 49, 114}}, {11, 2, { 49, 117}},
+	{11, 2, { 49, 117}}, {12, 2, { 49,  58}}, {12, 2, { 49,  66}},
+	{12, 2, { 49,  67}}, {12, 2, { 49,  68}}, {12, 2, { 49,  69}},
+	{12, 2, { 49,  70}}, {12, 2, { 49,  71}}, {12, 2, { 49,  72}},
+	{12, 2, { 49,  73}}, {12, 2, { 49,  74}}, {12, 2, { 49,  75}},
+	{12, 2, { 49,  76}}, {12, 2, { 49,  77}}, {12, 2, { 49,  78}},
+	{12, 2, { 49,  79}}, {12, 2, { 49,  80}}, {12, 2, { 49,  81}},
+	{12, 2, { 49,  82}}, {12, 2, { 49,  83}}, {12, 2, { 49,  84}},
+	{12, 2, { 49,  85}}, {12, 2, { 49,  86}}, {12, 2, { 49,  87}},
+	{12, 2, { 49,  89}}, {12, 2, { 49, 106}}, {12, 2, { 49, 107}},
+	{12, 2, { 49, 113}}, {12, 2, { 49, 118}}, {12, 2, { 49, 119}},
+	{12, 2, { 49, 120}}, {12, 2, { 49, 121}}, {12, 2, { 49, 122}},
+	{ 5, 1, { 49,   0}}, { 5, 1, { 49,   0}}, { 5, 1, { 49,   0}},
+	{ 5, 1, { 49,   0}}, {10, 2, { 50,  48}}, {10, 2, { 50,  48}},
+	{10, 2, { 50,  48}}, {10, 2, { 50,  48}}, {10, 2, { 50,  49}},
+	{10, 2, { 50,  49}}, {10, 2, { 50,  49}}, {10, 2, { 50,  49}},
+	{10, 2, { 50,  50}}, {10, 2, { 50,  50}}, {10, 2, { 50,  50}},
+	{10, 2, { 50,  50}}, {10, 2, { 50,  97}}, {10, 2, { 50,  97}},
+	{10, 2, { 50,  97}}, {10, 2, { 50,  97}}, {10, 2, { 50,  99}},
+	{10, 2, { 50,  99}}, {10, 2, { 50,  99}}, {10, 2, { 50,  99}},
+	{10, 2, { 50, 101}}, {10, 2, { 50, 101}}, {10, 2, { 50, 101}},
+	{10, 2, { 50, 101}}, {10, 2, { 50, 105}}, {10, 2, { 50, 105}},
+	{10, 2, { 50, 105}}, {10, 2, { 50, 105}}, {10, 2, { 50, 111}},
+	{10, 2, { 50, 111}}, {10, 2, { 50, 111}}, {10, 2, { 50, 111}},
+	{10, 2, { 50, 115}}, {10, 2, { 50, 115}}, {10, 2, { 50, 115}},
+	{10, 2, { 50, 115}}, {10, 2, { 50, 116}}, {10, 2, { 50, 116}},
+	{10, 2, { 50, 116}}, {10, 2, { 50, 116}}, {11, 2, { 50,  32}},
+	{11, 2, { 50,  32}}, {11, 2, { 50,  37}}, {11, 2, { 50,  37}},
+	{11, 2, { 50,  45}}, {11, 2, { 50,  45}}, {11, 2, { 50,  46}},
+	{11, 2, { 50,  46}}, {11, 2, { 50,  47}}, {11, 2, { 50,  47}},
+	{11, 2, { 50,  51}}, {11, 2, { 50,  51}}, {11, 2, { 50,  52}},
+	{11, 2, { 50,  52}}, {11, 2, { 50,  53}}, {11, 2, { 50,  53}},
+	{11, 2, { 50,  54}}, {11, 2, { 50,  54}}, {11, 2, { 50,  55}},
+	{11, 2, { 50,  55}}, {11, 2, { 50,  56}}, {11, 2, { 50,  56}},
+	{11, 2, { 50,  57}}, {11, 2, { 50,  57}}, {11, 2, { 50,  61}},
+	{11, 2, { 50,  61}}, {11, 2, { 50,  65}}, {11, 2, { 50,  65}},
+	{11, 2, { 50,  95}}, {11, 2, { 50,  95}}, {11, 2, { 50,  98}},
+	{11, 2, { 50,  98}}, {11, 2, { 50, 100}}, {11, 2, { 50, 100}},
+	{11, 2, { 50, 102}}, {11, 2, { 50, 102}}, {11, 2, { 50, 103}},
+	{11, 2, { 50, 103}}, {11, 2, { 50, 104}}, {11, 2, { 50, 104}},
+	{11, 2, { 50, 108}}, {11, 2, { 50, 108}}, {11, 2, { 50, 109}},
+	{11, 2, { 50, 109}}, {11, 2, { 50, 110}}, {11, 2, { 50, 110}},
+	{11, 2, { 50, 112}}, {11, 2, { 50, 112}}, {11, 2, { 50, 114}},
+	{11, 2, { 50, 114}}, {11, 2, { 50, 117}}, {11, 2, { 50, 117}},
+	{12, 2, { 50,  58}}, {12, 2, { 50,  66}}, {12, 2, { 50,  67}},
+	{12, 2, { 50,  68}}, {12, 2, { 50,  69}}, {12, 2, { 50,  70}},
+	{12, 2, { 50,  71}}, {12, 2, { 50,  72}}, {12, 2, { 50,  73}},
+	{12, 2, { 50,  74}}, {12, 2, { 50,  75}}, {12, 2, { 50,  76}},
+	{12, 2, { 50,  77}}, {12, 2, { 50,  78}}, {12, 2, { 50,  79}},
+	{12, 2, { 50,  80}}, {12, 2, { 50,  81}}, {12, 2, { 50,  82}},
+	{12, 2, { 50,  83}}, {12, 2, { 50,  84}}, {12, 2, { 50,  85}},
+	{12, 2, { 50,  86}}, {12, 2, { 50,  87}}, {12, 2, { 50,  89}},
+	{12, 2, { 50, 106}}, {12, 2, { 50, 107}}, {12, 2, { 50, 113}},
+	{12, 2, { 50, 118}}, {12, 2, { 50, 119}}, {12, 2, { 50, 120}},
+	{12, 2, { 50, 121}}, {12, 2, { 50, 122}}, { 5, 1, { 50,   0}},
+	{ 5, 1, { 50,   0}}, { 5, 1, { 50,   0}}, { 5, 1, { 50,   0}},
+	{10, 2, { 97,  48}}, {10, 2, { 97,  48}}, {10, 2, { 97,  48}},
+	{10, 2, { 97,  48}}, {10, 2, { 97,  49}}, {10, 2, { 97,  49}},
+	{10, 2, { 97,  49}}, {10, 2, { 97,  49}}, {10, 2, { 97,  50}},
+	{10, 2, { 97,  50}}, {10, 2, { 97,  50}}, {10, 2, { 97,  50}},
+	{10, 2, { 97,  97}}, {10, 2, { 97,  97}}, {10, 2, { 97,  97}},
+	{10, 2, { 97,  97}}, {10, 2, { 97,  99}}, {10, 2, { 97,  99}},
+	{10, 2, { 97,  99}}, {10, 2, { 97,  99}}, {10, 2, { 97, 101}},
+	{10, 2, { 97, 101}}, {10, 2, { 97, 101}}, {10, 2, { 97, 101}},
+	{10, 2, { 97, 105}}, {10, 2, { 97, 105}}, {10, 2, { 97, 105}},
+	{10, 2, { 97, 105}}, {10, 2, { 97, 111}}, {10, 2, { 97, 111}},
+	{10, 2, { 97, 111}}, {10, 2, { 97, 111}}, {10, 2, { 97, 115}},
+	{10, 2, { 97, 115}}, {10, 2, { 97, 115}}, {10, 2, { 97, 115}},
+	{10, 2, { 97, 116}}, {10, 2, { 97, 116}}, {10, 2, { 97, 116}},
+	{10, 2, { 97, 116}}, {11, 2, { 97,  32}}, {11, 2, { 97,  32}},
+	{11, 2, { 97,  37}}, {11, 2, { 97,  37}}, {11, 2, { 97,  45}},
+	{11, 2, { 97,  45}}, {11, 2, { 97,  46}}, {11, 2, { 97,  46}},
+	{11, 2, { 97,  47}}, {11, 2, { 97,  47}}, {11, 2, { 97,  51}},
+	{11, 2, { 97,  51}}, {11, 2, { 97,  52}}, {11, 2, { 97,  52}},
+	{11, 2, { 97,  53}}, {11, 2, { 97,  53}}, {11, 2, { 97,  54}},
+	{11, 2, { 97,  54}}, {11, 2, { 97,  55}}, {11, 2, { 97,  55}},
+	{11, 2, { 97,  56}}, {11, 2, { 97,  56}}, {11, 2, { 97,  57}},
+	{11, 2, { 97,  57}}, {11, 2, { 97,  61}}, {11, 2, { 97,  61}},
+	{11, 2, { 97,  65}}, {11, 2, { 97,  65}}, {11, 2, { 97,  95}},
+	{11, 2, { 97,  95}}, {11, 2, { 97,  98}}, {11, 2, { 97,  98}},
+	{11, 2, { 97, 100}}, {11, 2, { 97, 100}}, {11, 2, { 97, 102}},
+	{11, 2, { 97, 102}}, {11, 2, { 97, 103}}, {11, 2, { 97, 103}},
+	{11, 2, { 97, 104}}, {11, 2, { 97, 104}}, {11, 2, { 97, 108}},
+	{11, 2, { 97, 108}}, {11, 2, { 97, 109}}, {11, 2, { 97, 109}},
+	{11, 2, { 97, 110}}, {11, 2, { 97, 110}}, {11, 2, { 97, 112}},
+	{11, 2, { 97, 112}}, {11, 2, { 97, 114}}, {11, 2, { 97, 114}},
+	{11, 2, { 97, 117}}, {11, 2, { 97, 117}}, {12, 2, { 97,  58}},
+	{12, 2, { 97,  66}}, {12, 2, { 97,  67}}, {12, 2, { 97,  68}},
+	{12, 2, { 97,  69}}, {12, 2, { 97,  70}}, {12, 2, { 97,  71}},
+	{12, 2, { 97,  72}}, {12, 2, { 97,  73}}, {12, 2, { 97,  74}},
+	{12, 2, { 97,  75}}, {12, 2, { 97,  76}}, {12, 2, { 97,  77}},
+	{12, 2, { 97,  78}}, {12, 2, { 97,  79}}, {12, 2, { 97,  80}},
+	{12, 2, { 97,  81}}, {12, 2, { 97,  82}}, {12, 2, { 97,  83}},
+	{12, 2, { 97,  84}}, {12, 2, { 97,  85}}, {12, 2, { 97,  86}},
+	{12, 2, { 97,  87}}, {12, 2, { 97,  89}}, {12, 2, { 97, 106}},
+	{12, 2, { 97, 107}}, {12, 2, { 97, 113}}, {12, 2, { 97, 118}},
+	{12, 2, { 97, 119}}, {12, 2, { 97, 120}}, {12, 2, { 97, 121}},
+	{12, 2, { 97, 122}}, { 5, 1, { 97,   0}}, { 5, 1, { 97,   0}},
+	{ 5, 1, { 97,   0}}, { 5, 1, { 97,   0}}, {10, 2, { 99,  48}},
+	{10, 2, { 99,  48}}, {10, 2, { 99,  48}}, {10, 2, { 99,  48}},
+	{10, 2, { 99,  49}}, {10, 2, { 99,  49}}, {10, 2, { 99,  49}},
+	{10, 2, { 99,  49}}, {10, 2, { 99,  50}}, {10, 2, { 99,  50}},
+	{10, 2, { 99,  50}}, {10, 2, { 99,  50}}, {10, 2, { 99,  97}},
+	{10, 2, { 99,  97}}, {10, 2, { 99,  97}}, {10, 2, { 99,  97}},
+	{10, 2, { 99,  99}}, {10, 2, { 99,  99}}, {10, 2, { 99,  99}},
+	{10, 2, { 99,  99}}, {10, 2, { 99, 101}}, {10, 2, { 99, 101}},
+	{10, 2, { 99, 101}}, {10, 2, { 99, 101}}, {10, 2, { 99, 105}},
+	{10, 2, { 99, 105}}, {10, 2, { 99, 105}}, {10, 2, { 99, 105}},
+	{10, 2, { 99, 111}}, {10, 2, { 99, 111}}, {10, 2, { 99, 111}},
+	{10, 2, { 99, 111}}, {10, 2, { 99, 115}}, {10, 2, { 99, 115}},
+	{10, 2, { 99, 115}}, {10, 2, { 99, 115}}, {10, 2, { 99, 116}},
+	{10, 2, { 99, 116}}, {10, 2, { 99, 116}}, {10, 2, { 99, 116}},
+	{11, 2, { 99,  32}}, {11, 2, { 99,  32}}, {11, 2, { 99,  37}},
+	{11, 2, { 99,  37}}, {11, 2, { 99,  45}}, {11, 2, { 99,  45}},
+	{11, 2, { 99,  46}}, {11, 2, { 99,  46}}, {11, 2, { 99,  47}},
+	{11, 2, { 99,  47}}, {11, 2, { 99,  51}}, {11, 2, { 99,  51}},
+	{11, 2, { 99,  52}}, {11, 2, { 99,  52}}, {11, 2, { 99,  53}},
+	{11, 2, { 99,  53}}, {11, 2, { 99,  54}}, {11, 2, { 99,  54}},
+	{11, 2, { 99,  55}}, {11, 2, { 99,  55}}, {11, 2, { 99,  56}},
+	{11, 2, { 99,  56}}, {11, 2, { 99,  57}}, {11, 2, { 99,  57}},
+	{11, 2, { 99,  61}}, {11, 2, { 99,  61}}, {11, 2, { 99,  65}},
+	{11, 2, { 99,  65}}, {11, 2, { 99,  95}}, {11, 2, { 99,  95}},
+	{11, 2, { 99,  98}}, {11, 2, { 99,  98}}, {11, 2, { 99, 100}},
+	{11, 2, { 99, 100}}, {11, 2, { 99, 102}}, {11, 2, { 99, 102}},
+	{11, 2, { 99, 103}}, {11, 2, { 99, 103}}, {11, 2, { 99, 104}},
+	{11, 2, { 99, 104}}, {11, 2, { 99, 108}}, {11, 2, { 99, 108}},
+	{11, 2, { 99, 109}}, {11, 2, { 99, 109}}, {11, 2, { 99, 110}},
+	{11, 2, { 99, 110}}, {11, 2, { 99, 112}}, {11, 2, { 99, 112}},
+	{11, 2, { 99, 114}}, {11, 2, { 99, 114}}, {11, 2, { 99, 117}},
+	{11, 2, { 99, 117}}, {12, 2, { 99,  58}}, {12, 2, { 99,  66}},
+	{12, 2, { 99,  67}}, {12, 2, { 99,  68}}, {12, 2, { 99,  69}},
+	{12, 2, { 99,  70}}, {12, 2, { 99,  71}}, {12, 2, { 99,  72}},
+	{12, 2, { 99,  73}}, {12, 2, { 99,  74}}, {12, 2, { 99,  75}},
+	{12, 2, { 99,  76}}, {12, 2, { 99,  77}}, {12, 2, { 99,  78}},
+	{12, 2, { 99,  79}}, {12, 2, { 99,  80}}, {12, 2, { 99,  81}},
+	{12, 2, { 99,  82}}, {12, 2, { 99,  83}}, {12, 2, { 99,  84}},
+	{12, 2, { 99,  85}}, {12, 2, { 99,  86}}, {12, 2, { 99,  87}},
+	{12, 2, { 99,  89}}, {12, 2, { 99, 106}}, {12, 2, { 99, 107}},
+	{12, 2, { 99, 113}}, {12, 2, { 99, 118}}, {12, 2, { 99, 119}},
+	{12, 2, { 99, 120}}, {12, 2, { 99, 121}}, {12, 2, { 99, 122}},
+	{ 5, 1, { 99,   0}}, { 5, 1, { 99,   0}}, { 5, 1, { 99,   0}},
+	{ 5, 1, { 99,   0}}, {10, 2, {101,  48}}, {10, 2, {101,  48}},
+	{10, 2, {101,  48}}, {10, 2, {101,  48}}, {10, 2, {101,  49}},
+	{10, 2, {101,  49}}, {10, 2, {101,  49}}, {10, 2, {101,  49}},
+	{10, 2, {101,  50}}, {10, 2, {101,  50}}, {10, 2, {101,  50}},
+	{10, 2, {101,  50}}, {10, 2, {101,  97}}, {10, 2, {101,  97}},
+	{10, 2, {101,  97}}, {10, 2, {101,  97}}, {10, 2, {101,  99}},
+	{10, 2, {101,  99}}, {10, 2, {101,  99}}, {10, 2, {101,  99}},
+	{10, 2, {101, 101}}, {10, 2, {101, 101}}, {10, 2, {101, 101}},
+	{10, 2, {101, 101}}, {10, 2, {101, 105}}, {10, 2, {101, 105}},
+	{10, 2, {101, 105}}, {10, 2, {101, 105}}, {10, 2, {101, 111}},
+	{10, 2, {101, 111}}, {10, 2, {101, 111}}, {10, 2, {101, 111}},
+	{10, 2, {101, 115}}, {10, 2, {101, 115}}, {10, 2, {101, 115}},
+	{10, 2, {101, 115}}, {10, 2, {101, 116}}, {10, 2, {101, 116}},
+	{10, 2, {101, 116}}, {10, 2, {101, 116}}, {11, 2, {101,  32}},
+	{11, 2, {101,  32}}, {11, 2, {101,  37}}, {11, 2, {101,  37}},
+	{11, 2, {101,  45}}, {11, 2, {101,  45}}, {11, 2, {101,  46}},
+	{11, 2, {101,  46}}, {11, 2, {101,  47}}, {11, 2, {101,  47}},
+	{11, 2, {101,  51}}, {11, 2, {101,  51}}, {11, 2, {101,  52}},
+	{11, 2, {101,  52}}, {11, 2, {101,  53}}, {11, 2, {101,  53}},
+	{11, 2, {101,  54}}, {11, 2, {101,  54}}, {11, 2, {101,  55}},
+	{11, 2, {101,  55}}, {11, 2, {101,  56}}, {11, 2, {101,  56}},
+	{11, 2, {101,  57}}, {11, 2, {101,  57}}, {11, 2, {101,  61}},
+	{11, 2, {101,  61}}, {11, 2, {101,  65}}, {11, 2, {101,  65}},
+	{11, 2, {101,  95}}, {11, 2, {101,  95}}, {11, 2, {101,  98}},
+	{11, 2, {101,  98}}, {11, 2, {101, 100}}, {11, 2, {101, 100}},
+	{11, 2, {101, 102}}, {11, 2, {101, 102}}, {11, 2, {101, 103}},
+	{11, 2, {101, 103}}, {11, 2, {101, 104}}, {11, 2, {101, 104}},
+	{11, 2, {101, 108}}, {11, 2, {101, 108}}, {11, 2, {101, 109}},
+	{11, 2, {101, 109}}, {11, 2, {101, 110}}, {11, 2, {101, 110}},
+	{11, 2, {101, 112}}, {11, 2, {101, 112}}, {11, 2, {101, 114}},
+	{11, 2, {101, 114}}, {11, 2, {101, 117}}, {11, 2, {101, 117}},
+	{12, 2, {101,  58}}, {12, 2, {101,  66}}, {12, 2, {101,  67}},
+	{12, 2, {101,  68}}, {12, 2, {101,  69}}, {12, 2, {101,  70}},
+	{12, 2, {101,  71}}, {12, 2, {101,  72}}, {12, 2, {101,  73}},
+	{12, 2, {101,  74}}, {12, 2, {101,  75}}, {12, 2, {101,  76}},
+	{12, 2, {101,  77}}, {12, 2, {101,  78}}, {12, 2, {101,  79}},
+	{12, 2, {101,  80}}, {12, 2, {101,  81}}, {12, 2, {101,  82}},
+	{12, 2, {101,  83}}, {12, 2, {101,  84}}, {12, 2, {101,  85}},
+	{12, 2, {101,  86}}, {12, 2, {101,  87}}, {12, 2, {101,  89}},
+	{12, 2, {101, 106}}, {12, 2, {101, 107}}, {12, 2, {101, 113}},
+	{12, 2, {101, 118}}, {12, 2, {101, 119}}, {12, 2, {101, 120}},
+	{12, 2, {101, 121}}, {12, 2, {101, 122}}, { 5, 1, {101,   0}},
+	{ 5, 1, {101,   0}}, { 5, 1, {101,   0}}, { 5, 1, {101,   0}},
+	{10, 2, {105,  48}}, {10, 2, {105,  48}}, {10, 2, {105,  48}},
+	{10, 2, {105,  48}}, {10, 2, {105,  49}}, {10, 2, {105,  49}},
+	{10, 2, {105,  49}}, {10, 2, {105,  49}}, {10, 2, {105,  50}},
+	{10, 2, {105,  50}}, {10, 2, {105,  50}}, {10, 2, {105,  50}},
+	{10, 2, {105,  97}}, {10, 2, {105,  97}}, {10, 2, {105,  97}},
+	{10, 2, {105,  97}}, {10, 2, {105,  99}}, {10, 2, {105,  99}},
+	{10, 2, {105,  99}}, {10, 2, {105,  99}}, {10, 2, {105, 101}},
+	{10, 2, {105, 101}}, {10, 2, {105, 101}}, {10, 2, {105, 101}},
+	{10, 2, {105, 105}}, {10, 2, {105, 105}}, {10, 2, {105, 105}},
+	{10, 2, {105, 105}}, {10, 2, {105, 111}}, {10, 2, {105, 111}},
+	{10, 2, {105, 111}}, {10, 2, {105, 111}}, {10, 2, {105, 115}},
+	{10, 2, {105, 115}}, {10, 2, {105, 115}}, {10, 2, {105, 115}},
+	{10, 2, {105, 116}}, {10, 2, {105, 116}}, {10, 2, {105, 116}},
+	{10, 2, {105, 116}}, {11, 2, {105,  32}}, {11, 2, {105,  32}},
+	{11, 2, {105,  37}}, {11, 2, {105,  37}}, {11, 2, {105,  45}},
+	{11, 2, {105,  45}}, {11, 2, {105,  46}}, {11, 2, {105,  46}},
+	{11, 2, {105,  47}}, {11, 2, {105,  47}}, {11, 2, {105,  51}},
+	{11, 2, {105,  51}}, {11, 2, {105,  52}}, {11, 2, {105,  52}},
+	{11, 2, {105,  53}}, {11, 2, {105,  53}}, {11, 2, {105,  54}},
+	{11, 2, {105,  54}}, {11, 2, {105,  55}}, {11, 2, {105,  55}},
+	{11, 2, {105,  56}}, {11, 2, {105,  56}}, {11, 2, {105,  57}},
+	{11, 2, {105,  57}}, {11, 2, {105,  61}}, {11, 2, {105,  61}},
+	{11, 2, {105,  65}}, {11, 2, {105,  65}}, {11, 2, {105,  95}},
+	{11, 2, {105,  95}}, {11, 2, {105,  98}}, {11, 2, {105,  98}},
+	{11, 2, {105, 100}}, {11, 2, {105, 100}}, {11, 2, {105, 102}},
+	{11, 2, {105, 102}}, {11, 2, {105, 103}}, {11, 2, {105, 103}},
+	{11, 2, {105, 104}}, {11, 2, {105, 104}}, {11, 2, {105, 108}},
+	{11, 2, {105, 108}}, {11, 2, {105, 109}}, {11, 2, {105, 109}},
+	{11, 2, {105, 110}}, {11, 2, {105, 110}}, {11, 2, {105, 112}},
+	{11, 2, {105, 112}}, {11, 2, {105, 114}}, {11, 2, {105, 114}},
+	{11, 2, {105, 117}}, {11, 2, {105, 117}}, {12, 2, {105,  58}},
+	{12, 2, {105,  66}}, {12, 2, {105,  67}}, {12, 2, {105,  68}},
+	{12, 2, {105,  69}}, {12, 2, {105,  70}}, {12, 2, {105,  71}},
+	{12, 2, {105,  72}}, {12, 2, {105,  73}}, {12, 2, {105,  74}},
+	{12, 2, {105,  75}}, {12, 2, {105,  76}}, {12, 2, {105,  77}},
+	{12, 2, {105,  78}}, {12, 2, {105,  79}}, {12, 2, {105,  80}},
+	{12, 2, {105,  81}}, {12, 2, {105,  82}}, {12, 2, {105,  83}},
+	{12, 2, {105,  84}}, {12, 2, {105,  85}}, {12, 2, {105,  86}},
+	{12, 2, {105,  87}}, {12, 2, {105,  89}}, {12, 2, {105, 106}},
+	{12, 2, {105, 107}}, {12, 2, {105, 113}}, {12, 2, {105, 118}},
+	{12, 2, {105, 119}}, {12, 2, {105, 120}}, {12, 2, {105, 121}},
+	{12, 2, {105, 122}}, { 5, 1, {105,   0}}, { 5, 1, {105,   0}},
+	{ 5, 1, {105,   0}}, { 5, 1, {105,   0}}, {10, 2, {111,  48}},
+	{10, 2, {111,  48}}, {10, 2, {111,  48}}, {10, 2, {111,  48}},
+	{10, 2, {111,  49}}, {10, 2, {111,  49}}, {10, 2, {111,  49}},
+	{10, 2, {111,  49}}, {10, 2, {111,  50}}, {10, 2, {111,  50}},
+	{10, 2, {111,  50}}, {10, 2, {111,  50}}, {10, 2, {111,  97}},
+	{10, 2, {111,  97}}, {10, 2, {111,  97}}, {10, 2, {111,  97}},
+	{10, 2, {111,  99}}, {10, 2, {111,  99}}, {10, 2, {111,  99}},
+	{10, 2, {111,  99}}, {10, 2, {111, 101}}, {10, 2, {111, 101}},
+	{10, 2, {111, 101}}, {10, 2, {111, 101}}, {10, 2, {111, 105}},
+	{10, 2, {111, 105}}, {10, 2, {111, 105}}, {10, 2, {111, 105}},
+	{10, 2, {111, 111}}, {10, 2, {111, 111}}, {10, 2, {111, 111}},
+	{10, 2, {111, 111}}, {10, 2, {111, 115}}, {10, 2, {111, 115}},
+	{10, 2, {111, 115}}, {10, 2, {111, 115}}, {10, 2, {111, 116}},
+	{10, 2, {111, 116}}, {10, 2, {111, 116}}, {10, 2, {111, 116}},
+	{11, 2, {111,  32}}, {11, 2, {111,  32}}, {11, 2, {111,  37}},
+	{11, 2, {111,  37}}, {11, 2, {111,  45}}, {11, 2, {111,  45}},
+	{11, 2, {111,  46}}, {11, 2, {111,  46}}, {11, 2, {111,  47}},
+	{11, 2, {111,  47}}, {11, 2, {111,  51}}, {11, 2, {111,  51}},
+	{11, 2, {111,  52}}, {11, 2, {111,  52}}, {11, 2, {111,  53}},
+	{11, 2, {111,  53}}, {11, 2, {111,  54}}, {11, 2, {111,  54}},
+	{11, 2, {111,  55}}, {11, 2, {111,  55}}, {11, 2, {111,  56}},
+	{11, 2, {111,  56}}, {11, 2, {111,  57}}, {11, 2, {111,  57}},
+	{11, 2, {111,  61}}, {11, 2, {111,  61}}, {11, 2, {111,  65}},
+	{11, 2, {111,  65}}, {11, 2, {111,  95}}, {11, 2, {111,  95}},
+	{11, 2, {111,  98}}, {11, 2, {111,  98}}, {11, 2, {111, 100}},
+	{11, 2, {111, 100}}, {11, 2, {111, 102}}, {11, 2, {111, 102}},
+	{11, 2, {111, 103}}, {11, 2, {111, 103}}, {11, 2, {111, 104}},
+	{11, 2, {111, 104}}, {11, 2, {111, 108}}, {11, 2, {111, 108}},
+	{11, 2, {111, 109}}, {11, 2, {111, 109}}, {11, 2, {111, 110}},
+	{11, 2, {111, 110}}, {11, 2, {111, 112}}, {11, 2, {111, 112}},
+	{11, 2, {111, 114}}, {11, 2, {111, 114}}, {11, 2, {111, 117}},
+	{11, 2, {111, 117}}, {12, 2, {111,  58}}, {12, 2, {111,  66}},
+	{12, 2, {111,  67}}, {12, 2, {111,  68}}, {12, 2, {111,  69}},
+	{12, 2, {111,  70}}, {12, 2, {111,  71}}, {12, 2, {111,  72}},
+	{12, 2, {111,  73}}, {12, 2, {111,  74}}, {12, 2, {111,  75}},
+	{12, 2, {111,  76}}, {12, 2, {111,  77}}, {12, 2, {111,  78}},
+	{12, 2, {111,  79}}, {12, 2, {111,  80}}, {12, 2, {111,  81}},
+	{12, 2, {111,  82}}, {12, 2, {111,  83}}, {12, 2, {111,  84}},
+	{12, 2, {111,  85}}, {12, 2, {111,  86}}, {12, 2, {111,  87}},
+	{12, 2, {111,  89}}, {12, 2, {111, 106}}, {12, 2, {111, 107}},
+	{12, 2, {111, 113}}, {12, 2, {111, 118}}, {12, 2, {111, 119}},
+	{12, 2, {111, 120}}, {12, 2, {111, 121}}, {12, 2, {111, 122}},
+	{ 5, 1, {111,   0}}, { 5, 1, {111,   0}}, { 5, 1, {111,   0}},
+	{ 5, 1, {111,   0}}, {10, 2, {115,  48}}, {10, 2, {115,  48}},
+	{10, 2, {115,  48}}, {10, 2, {115,  48}}, {10, 2, {115,  49}},
+	{10, 2, {115,  49}}, {10, 2, {115,  49}}, {10, 2, {115,  49}},
+	{10, 2, {115,  50}}, {10, 2, {115,  50}}, {10, 2, {115,  50}},
+	{10, 2, {115,  50}}, {10, 2, {115,  97}}, {10, 2, {115,  97}},
+	{10, 2, {115,  97}}, {10, 2, {115,  97}}, {10, 2, {115,  99}},
+	{10, 2, {115,  99}}, {10, 2, {115,  99}}, {10, 2, {115,  99}},
+	{10, 2, {115, 101}}, {10, 2, {115, 101}}, {10, 2, {115, 101}},
+	{10, 2, {115, 101}}, {10, 2, {115, 105}}, {10, 2, {115, 105}},
+	{10, 2, {115, 105}}, {10, 2, {115, 105}}, {10, 2, {115, 111}},
+	{10, 2, {115, 111}}, {10, 2, {115, 111}}, {10, 2, {115, 111}},
+	{10, 2, {115, 115}}, {10, 2, {115, 115}}, {10, 2, {115, 115}},
+	{10, 2, {115, 115}}, {10, 2, {115, 116}}, {10, 2, {115, 116}},
+	{10, 2, {115, 116}}, {10, 2, {115, 116}}, {11, 2, {115,  32}},
+	{11, 2, {115,  32}}, {11, 2, {115,  37}}, {11, 2, {115,  37}},
+	{11, 2, {115,  45}}, {11, 2, {115,  45}}, {11, 2, {115,  46}},
+	{11, 2, {115,  46}}, {11, 2, {115,  47}}, {11, 2, {115,  47}},
+	{11, 2, {115,  51}}, {11, 2, {115,  51}}, {11, 2, {115,  52}},
+	{11, 2, {115,  52}}, {11, 2, {115,  53}}, {11, 2, {115,  53}},
+	{11, 2, {115,  54}}, {11, 2, {115,  54}}, {11, 2, {115,  55}},
+	{11, 2, {115,  55}}, {11, 2, {115,  56}}, {11, 2, {115,  56}},
+	{11, 2, {115,  57}}, {11, 2, {115,  57}}, {11, 2, {115,  61}},
+	{11, 2, {115,  61}}, {11, 2, {115,  65}}, {11, 2, {115,  65}},
+	{11, 2, {115,  95}}, {11, 2, {115,  95}}, {11, 2, {115,  98}},
+	{11, 2, {115,  98}}, {11, 2, {115, 100}}, {11, 2, {115, 100}},
+	{11, 2, {115, 102}}, {11, 2, {115, 102}}, {11, 2, {115, 103}},
+	{11, 2, {115, 103}}, {11, 2, {115, 104}}, {11, 2, {115, 104}},
+	{11, 2, {115, 108}}, {11, 2, {115, 108}}, {11, 2, {115, 109}},
+	{11, 2, {115, 109}}, {11, 2, {115, 110}}, {11, 2, {115, 110}},
+	{11, 2, {115, 112}}, {11, 2, {115, 112}}, {11, 2, {115, 114}},
+	{11, 2, {115, 114}}, {11, 2, {115, 117}}, {11, 2, {115, 117}},
+	{12, 2, {115,  58}}, {12, 2, {115,  66}}, {12, 2, {115,  67}},
+	{12, 2, {115,  68}}, {12, 2, {115,  69}}, {12, 2, {115,  70}},
+	{12, 2, {115,  71}}, {12, 2, {115,  72}}, {12, 2, {115,  73}},
+	{12, 2, {115,  74}}, {12, 2, {115,  75}}, {12, 2, {115,  76}},
+	{12, 2, {115,  77}}, {12, 2, {115,  78}}, {12, 2, {115,  79}},
+	{12, 2, {115,  80}}, {12, 2, {115,  81}}, {12, 2, {115,  82}},
+	{12, 2, {115,  83}}, {12, 2, {115,  84}}, {12, 2, {115,  85}},
+	{12, 2, {115,  86}}, {12, 2, {115,  87}}, {12, 2, {115,  89}},
+	{12, 2, {115, 106}}, {12, 2, {115, 107}}, {12, 2, {115, 113}},
+	{12, 2, {115, 118}}, {12, 2, {115, 119}}, {12, 2, {115, 120}},
+	{12, 2, {115, 121}}, {12, 2, {115, 122}}, { 5, 1, {115,   0}},
+	{ 5, 1, {115,   0}}, { 5, 1, {115,   0}}, { 5, 1, {115,   0}},
+	{10, 2, {116,  48}}, {10, 2, {116,  48}}, {10, 2, {116,  48}},
+	{10, 2, {116,  48}}, {10, 2, {116,  49}}, {10, 2, {116,  49}},
+	{10, 2, {116,  49}}, {10, 2, {116,  49}}, {10, 2, {116,  50}},
+	{10, 2, {116,  50}}, {10, 2, {116,  50}}, {10, 2, {116,  50}},
+	{10, 2, {116,  97}}, {10, 2, {116,  97}}, {10, 2, {116,  97}},
+	{10, 2, {116,  97}}, {10, 2, {116,  99}}, {10, 2, {116,  99}},
+	{10, 2, {116,  99}}, {10, 2, {116,  99}}, {10, 2, {116, 101}},
+	{10, 2, {116, 101}}, {10, 2, {116, 101}}, {10, 2, {116, 101}},
+	{10, 2, {116, 105}}, {10, 2, {116, 105}}, {10, 2, {116, 105}},
+	{10, 2, {116, 105}}, {10, 2, {116, 111}}, {10, 2, {116, 111}},
+	{10, 2, {116, 111}}, {10, 2, {116, 111}}, {10, 2, {116, 115}},
+	{10, 2, {116, 115}}, {10, 2, {116, 115}}, {10, 2, {116, 115}},
+	{10, 2, {116, 116}}, {10, 2, {116, 116}}, {10, 2, {116, 116}},
+	{10, 2, {116, 116}}, {11, 2, {116,  32}}, {11, 2, {116,  32}},
+	{11, 2, {116,  37}}, {11, 2, {116,  37}}, {11, 2, {116,  45}},
+	{11, 2, {116,  45}}, {11, 2, {116,  46}}, {11, 2, {116,  46}},
+	{11, 2, {116,  47}}, {11, 2, {116,  47}}, {11, 2, {116,  51}},
+	{11, 2, {116,  51}}, {11, 2, {116,  52}}, {11, 2, {116,  52}},
+	{11, 2, {116,  53}}, {11, 2, {116,  53}}, {11, 2, {116,  54}},
+	{11, 2, {116,  54}}, {11, 2, {116,  55}}, {11, 2, {116,  55}},
+	{11, 2, {116,  56}}, {11, 2, {116,  56}}, {11, 2, {116,  57}},
+	{11, 2, {116,  57}}, {11, 2, {116,  61}}, {11, 2, {116,  61}},
+	{11, 2, {116,  65}}, {11, 2, {116,  65}}, {11, 2, {116,  95}},
+	{11, 2, {116,  95}}, {11, 2, {116,  98}}, {11, 2, {116,  98}},
+	{11, 2, {116, 100}}, {11, 2, {116, 100}}, {11, 2, {116, 102}},
+	{11, 2, {116, 102}}, {11, 2, {116, 103}}, {11, 2, {116, 103}},
+	{11, 2, {116, 104}}, {11, 2, {116, 104}}, {11, 2, {116, 108}},
+	{11, 2, {116, 108}}, {11, 2, {116, 109}}, {11, 2, {116, 109}},
+	{11, 2, {116, 110}}, {11, 2, {116, 110}}, {11, 2, {116, 112}},
+	{11, 2, {116, 112}}, {11, 2, {116, 114}}, {11, 2, {116, 114}},
+	{11, 2, {116, 117}}, {11, 2, {116, 117}}, {12, 2, {116,  58}},
+	{12, 2, {116,  66}}, {12, 2, {116,  67}}, {12, 2, {116,  68}},
+	{12, 2, {116,  69}}, {12, 2, {116,  70}}, {12, 2, {116,  71}},
+	{12, 2, {116,  72}}, {12, 2, {116,  73}}, {12, 2, {116,  74}},
+	{12, 2, {116,  75}}, {12, 2, {116,  76}}, {12, 2, {116,  77}},
+	{12, 2, {116,  78}}, {12, 2, {116,  79}}, {12, 2, {116,  80}},
+	{12, 2, {116,  81}}, {12, 2, {116,  82}}, {12, 2, {116,  83}},
+	{12, 2, {116,  84}}, {12, 2, {116,  85}}, {12, 2, {116,  86}},
+	{12, 2, {116,  87}}, {12, 2, {116,  89}}, {12, 2, {116, 106}},
+	{12, 2, {116, 107}}, {12, 2, {116, 113}}, {12, 2, {116, 118}},
+	{12, 2, {116, 119}}, {12, 2, {116, 120}}, {12, 2, {116, 121}},
+	{12, 2, {116, 122}}, { 5, 1, {116,   0}}, { 5, 1, {116,   0}},
+	{ 5, 1, {116,   0}}, { 5, 1, {116,   0}}, {11, 2, { 32,  48}},
+	{11, 2, { 32,  48}}, {11, 2, { 32,  49}}, {11, 2, { 32,  49}},
+	{11, 2, { 32,  50}}, {11, 2, { 32,  50}}, {11, 2, { 32,  97}},
+	{11, 2, { 32,  97}}, {11, 2, { 32,  99}}, {11, 2, { 32,  99}},
+	{11, 2, { 32, 101}}, {11, 2, { 32, 101}}, {11, 2, { 32, 105}},
+	{11, 2, { 32, 105}}, {11, 2, { 32, 111}}, {11, 2, { 32, 111}},
+	{11, 2, { 32, 115}}, {11, 2, { 32, 115}}, {11, 2, { 32, 116}},
+	{11, 2, { 32, 116}}, {12, 2, { 32,  32}}, {12, 2, { 32,  37}},
+	{12, 2, { 32,  45}}, {12, 2, { 32,  46}}, {12, 2, { 32,  47}},
+	{12, 2, { 32,  51}}, {12, 2, { 32,  52}}, {12, 2, { 32,  53}},
+	{12, 2, { 32,  54}}, {12, 2, { 32,  55}}, {12, 2, { 32,  56}},
+	{12, 2, { 32,  57}}, {12, 2, { 32,  61}}, {12, 2, { 32,  65}},
+	{12, 2, { 32,  95}}, {12, 2, { 32,  98}}, {12, 2, { 32, 100}},
+	{12, 2, { 32, 102}}, {12, 2, { 32, 103}}, {12, 2, { 32, 104}},
+	{12, 2, { 32, 108}}, {12, 2, { 32, 109}}, {12, 2, { 32, 110}},
+	{12, 2, { 32, 112}}, {12, 2, { 32, 114}}, {12, 2, { 32, 117}},
+	{ 6, 1, { 32,   0}}, { 6, 1, { 32,   0}}, { 6, 1, { 32,   0}},
+	{ 6, 1, { 32,   0}}, { 6, 1, { 32,   0}}, { 6, 1, { 32,   0}},
+	{ 6, 1, { 32,   0}}, { 6, 1, { 32,   0}}, { 6, 1, { 32,   0}},
+	{ 6, 1, { 32,   0}}, { 6, 1, { 32,   0}}, { 6, 1, { 32,   0}},
+	{ 6, 1, { 32,   0}}, { 6, 1, { 32,   0}}, { 6, 1, { 32,   0}},
+	{ 6, 1, { 32,   0}}, { 6, 1, { 32,   0}}, { 6, 1, { 32,   0}},
+	{11, 2, { 37,  48}}, {11, 2, { 37,  48}}, {11, 2, { 37,  49}},
+	{11, 2, { 37,  49}}, {11, 2, { 37,  50}}, {11, 2, { 37,  50}},
+	{11, 2, { 37,  97}}, {11, 2, { 37,  97}}, {11, 2, { 37,  99}},
+	{11, 2, { 37,  99}}, {11, 2, { 37, 101}}, {11, 2, { 37, 101}},
+	{11, 2, { 37, 105}}, {11, 2, { 37, 105}}, {11, 2, { 37, 111}},
+	{11, 2, { 37, 111}}, {11, 2, { 37, 115}}, {11, 2, { 37, 115}},
+	{11, 2, { 37, 116}}, {11, 2, { 37, 116}}, {12, 2, { 37,  32}},
+	{12, 2, { 37,  37}}, {12, 2, { 37,  45}}, {12, 2, { 37,  46}},
+	{12, 2, { 37,  47}}, {12, 2, { 37,  51}}, {12, 2, { 37,  52}},
+	{12, 2, { 37,  53}}, {12, 2, { 37,  54}}, {12, 2, { 37,  55}},
+	{12, 2, { 37,  56}}, {12, 2, { 37,  57}}, {12, 2, { 37,  61}},
+	{12, 2, { 37,  65}}, {12, 2, { 37,  95}}, {12, 2, { 37,  98}},
+	{12, 2, { 37, 100}}, {12, 2, { 37, 102}}, {12, 2, { 37, 103}},
+	{12, 2, { 37, 104}}, {12, 2, { 37, 108}}, {12, 2, { 37, 109}},
+	{12, 2, { 37, 110}}, {12, 2, { 37, 112}}, {12, 2, { 37, 114}},
+	{12, 2, { 37, 117}}, { 6, 1, { 37,   0}}, { 6, 1, { 37,   0}},
+	{ 6, 1, { 37,   0}}, { 6, 1, { 37,   0}}, { 6, 1, { 37,   0}},
+	{ 6, 1, { 37,   0}}, { 6, 1, { 37,   0}}, { 6, 1, { 37,   0}},
+	{ 6, 1, { 37,   0}}, { 6, 1, { 37,   0}}, { 6, 1, { 37,   0}},
+	{ 6, 1, { 37,   0}}, { 6, 1, { 37,   0}}, { 6, 1, { 37,   0}},
+	{ 6, 1, { 37,   0}}, { 6, 1, { 37,   0}}, { 6, 1, { 37,   0}},
+	{ 6, 1, { 37,   0}}, {11, 2, { 45,  48}}, {11, 2, { 45,  48}},
+	{11, 2, { 45,  49}}, {11, 2, { 45,  49}}, {11, 2, { 45,  50}},
+	{11, 2, { 45,  50}}, {11, 2, { 45,  97}}, {11, 2, { 45,  97}},
+	{11, 2, { 45,  99}}, {11, 2, { 45,  99}}, {11, 2, { 45, 101}},
+	{11, 2, { 45, 101}}, {11, 2, { 45, 105}}, {11, 2, { 45, 105}},
+	{11, 2, { 45, 111}}, {11, 2, { 45, 111}}, {11, 2, { 45, 115}},
+	{11, 2, { 45, 115}}, {11, 2, { 45, 116}}, {11, 2, { 45, 116}},
+	{12, 2, { 45,  32}}, {12, 2, { 45,  37}}, {12, 2, { 45,  45}},
+	{12, 2, { 45,  46}}, {12, 2, { 45,  47}}, {12, 2, { 45,  51}},
+	{12, 2, { 45,  52}}, {12, 2, { 45,  53}}, {12, 2, { 45,  54}},
+	{12, 2, { 45,  55}}, {12, 2, { 45,  56}}, {12, 2, { 45,  57}},
+	{12, 2, { 45,  61}}, {12, 2, { 45,  65}}, {12, 2, { 45,  95}},
+	{12, 2, { 45,  98}}, {12, 2, { 45, 100}}, {12, 2, { 45, 102}},
+	{12, 2, { 45, 103}}, {12, 2, { 45, 104}}, {12, 2, { 45, 108}},
+	{12, 2, { 45, 109}}, {12, 2, { 45, 110}}, {12, 2, { 45, 112}},
+	{12, 2, { 45, 114}}, {12, 2, { 45, 117}}, { 6, 1, { 45,   0}},
+	{ 6, 1, { 45,   0}}, { 6, 1, { 45,   0}}, { 6, 1, { 45,   0}},
+	{ 6, 1, { 45,   0}}, { 6, 1, { 45,   0}}, { 6, 1, { 45,   0}},
+	{ 6, 1, { 45,   0}}, { 6, 1, { 45,   0}}, { 6, 1, { 45,   0}},
+	{ 6, 1, { 45,   0}}, { 6, 1, { 45,   0}}, { 6, 1, { 45,   0}},
+	{ 6, 1, { 45,   0}}, { 6, 1, { 45,   0}}, { 6, 1, { 45,   0}},
+	{ 6, 1, { 45,   0}}, { 6, 1, { 45,   0}}, {11, 2, { 46,  48}},
+	{11, 2, { 46,  48}}, {11, 2, { 46,  49}}, {11, 2, { 46,  49}},
+	{11, 2, { 46,  50}}, {11, 2, { 46,  50}}, {11, 2, { 46,  97}},
+	{11, 2, { 46,  97}}, {11, 2, { 46,  99}}, {11, 2, { 46,  99}},
+	{11, 2, { 46, 101}}, {11, 2, { 46, 101}}, {11, 2, { 46, 105}},
+	{11, 2, { 46, 105}}, {11, 2, { 46, 111}}, {11, 2, { 46, 111}},
+	{11, 2, { 46, 115}}, {11, 2, { 46, 115}}, {11, 2, { 46, 116}},
+	{11, 2, { 46, 116}}, {12, 2, { 46,  32}}, {12, 2, { 46,  37}},
+	{12, 2, { 46,  45}}, {12, 2, { 46,  46}}, {12, 2, { 46,  47}},
+	{12, 2, { 46,  51}}, {12, 2, { 46,  52}}, {12, 2, { 46,  53}},
+	{12, 2, { 46,  54}}, {12, 2, { 46,  55}}, {12, 2, { 46,  56}},
+	{12, 2, { 46,  57}}, {12, 2, { 46,  61}}, {12, 2, { 46,  65}},
+	{12, 2, { 46,  95}}, {12, 2, { 46,  98}}, {12, 2, { 46, 100}},
+	{12, 2, { 46, 102}}, {12, 2, { 46, 103}}, {12, 2, { 46, 104}},
+	{12, 2, { 46, 108}}, {12, 2, { 46, 109}}, {12, 2, { 46, 110}},
+	{12, 2, { 46, 112}}, {12, 2, { 46, 114}}, {12, 2, { 46, 117}},
+	{ 6, 1, { 46,   0}}, { 6, 1, { 46,   0}}, { 6, 1, { 46,   0}},
+	{ 6, 1, { 46,   0}}, { 6, 1, { 46,   0}}, { 6, 1, { 46,   0}},
+	{ 6, 1, { 46,   0}}, { 6, 1, { 46,   0}}, { 6, 1, { 46,   0}},
+	{ 6, 1, { 46,   0}}, { 6, 1, { 46,   0}}, { 6, 1, { 46,   0}},
+	{ 6, 1, { 46,   0}}, { 6, 1, { 46,   0}}, { 6, 1, { 46,   0}},
+	{ 6, 1, { 46,   0}}, { 6, 1, { 46,   0}}, { 6, 1, { 46,   0}},
+	{11, 2, { 47,  48}}, {11, 2, { 47,  48}}, {11, 2, { 47,  49}},
+	{11, 2, { 47,  49}}, {11, 2, { 47,  50}}, {11, 2, { 47,  50}},
+	{11, 2, { 47,  97}}, {11, 2, { 47,  97}}, {11, 2, { 47,  99}},
+	{11, 2, { 47,  99}}, {11, 2, { 47, 101}}, {11, 2, { 47, 101}},
+	{11, 2, { 47, 105}}, {11, 2, { 47, 105}}, {11, 2, { 47, 111}},
+	{11, 2, { 47, 111}}, {11, 2, { 47, 115}}, {11, 2, { 47, 115}},
+	{11, 2, { 47, 116}}, {11, 2, { 47, 116}}, {12, 2, { 47,  32}},
+	{12, 2, { 47,  37}}, {12, 2, { 47,  45}}, {12, 2, { 47,  46}},
+	{12, 2, { 47,  47}}, {12, 2, { 47,  51}}, {12, 2, { 47,  52}},
+	{12, 2, { 47,  53}}, {12, 2, { 47,  54}}, {12, 2, { 47,  55}},
+	{12, 2, { 47,  56}}, {12, 2, { 47,  57}}, {12, 2, { 47,  61}},
+	{12, 2, { 47,  65}}, {12, 2, { 47,  95}}, {12, 2, { 47,  98}},
+	{12, 2, { 47, 100}}, {12, 2, { 47, 102}}, {12, 2, { 47, 103}},
+	{12, 2, { 47, 104}}, {12, 2, { 47, 108}}, {12, 2, { 47, 109}},
+	{12, 2, { 47, 110}}, {12, 2, { 47, 112}}, {12, 2, { 47, 114}},
+	{12, 2, { 47, 117}}, { 6, 1, { 47,   0}}, { 6, 1, { 47,   0}},
+	{ 6, 1, { 47,   0}}, { 6, 1, { 47,   0}}, { 6, 1, { 47,   0}},
+	{ 6, 1, { 47,   0}}, { 6, 1, { 47,   0}}, { 6, 1, { 47,   0}},
+	{ 6, 1, { 47,   0}}, { 6, 1, { 47,   0}}, { 6, 1, { 47,   0}},
+	{ 6, 1, { 47,   0}}, { 6, 1, { 47,   0}}, { 6, 1, { 47,   0}},
+	{ 6, 1, { 47,   0}}, { 6, 1, { 47,   0}}, { 6, 1, { 47,   0}},
+	{ 6, 1, { 47,   0}}, {11, 2, { 51,  48}}, {11, 2, { 51,  48}},
+	{11, 2, { 51,  49}}, {11, 2, { 51,  49}}, {11, 2, { 51,  50}},
+	{11, 2, { 51,  50}}, {11, 2, { 51,  97}}, {11, 2, { 51,  97}},
+	{11, 2, { 51,  99}}, {11, 2, { 51,  99}}, {11, 2, { 51, 101}},
+	{11, 2, { 51, 101}}, {11, 2, { 51, 105}}, {11, 2, { 51, 105}},
+	{11, 2, { 51, 111}}, {11, 2, { 51, 111}}, {11, 2, { 51, 115}},
+	{11, 2, { 51, 115}}, {11, 2, { 51, 116}}, {11, 2, { 51, 116}},
+	{12, 2, { 51,  32}}, {12, 2, { 51,  37}}, {12, 2, { 51,  45}},
+	{12, 2, { 51,  46}}, {12, 2, { 51,  47}}, {12, 2, { 51,  51}},
+	{12, 2, { 51,  52}}, {12, 2, { 51,  53}}, {12, 2, { 51,  54}},
+	{12, 2, { 51,  55}}, {12, 2, { 51,  56}}, {12, 2, { 51,  57}},
+	{12, 2, { 51,  61}}, {12, 2, { 51,  65}}, {12, 2, { 51,  95}},
+	{12, 2, { 51,  98}}, {12, 2, { 51, 100}}, {12, 2, { 51, 102}},
+	{12, 2, { 51, 103}}, {12, 2, { 51, 104}}, {12, 2, { 51, 108}},
+	{12, 2, { 51, 109}}, {12, 2, { 51, 110}}, {12, 2, { 51, 112}},
+	{12, 2, { 51, 114}}, {12, 2, { 51, 117}}, { 6, 1, { 51,   0}},
+	{ 6, 1, { 51,   0}}, { 6, 1, { 51,   0}}, { 6, 1, { 51,   0}},
+	{ 6, 1, { 51,   0}}, { 6, 1, { 51,   0}}, { 6, 1, { 51,   0}},
+	{ 6, 1, { 51,   0}}, { 6, 1, { 51,   0}}, { 6, 1, { 51,   0}},
+	{ 6, 1, { 51,   0}}, { 6, 1, { 51,   0}}, { 6, 1, { 51,   0}},
+	{ 6, 1, { 51,   0}}, { 6, 1, { 51,   0}}, { 6, 1, { 51,   0}},
+	{ 6, 1, { 51,   0}}, { 6, 1, { 51,   0}}, {11, 2, { 52,  48}},
+	{11, 2, { 52,  48}}, {11, 2, { 52,  49}}, {11, 2, { 52,  49}},
+	{11, 2, { 52,  50}}, {11, 2, { 52,  50}}, {11, 2, { 52,  97}},
+	{11, 2, { 52,  97}}, {11, 2, { 52,  99}}, {11, 2, { 52,  99}},
+	{11, 2, { 52, 101}}, {11, 2, { 52, 101}}, {11, 2, { 52, 105}},
+	{11, 2, { 52, 105}}, {11, 2, { 52, 111}}, {11, 2, { 52, 111}},
+	{11, 2, { 52, 115}}, {11, 2, { 52, 115}}, {11, 2, { 52, 116}},
+	{11, 2, { 52, 116}}, {12, 2, { 52,  32}}, {12, 2, { 52,  37}},
+	{12, 2, { 52,  45}}, {12, 2, { 52,  46}}, {12, 2, { 52,  47}},
+	{12, 2, { 52,  51}}, {12, 2, { 52,  52}}, {12, 2, { 52,  53}},
+	{12, 2, { 52,  54}}, {12, 2, { 52,  55}}, {12, 2, { 52,  56}},
+	{12, 2, { 52,  57}}, {12, 2, { 52,  61}}, {12, 2, { 52,  65}},
+	{12, 2, { 52,  95}}, {12, 2, { 52,  98}}, {12, 2, { 52, 100}},
+	{12, 2, { 52, 102}}, {12, 2, { 52, 103}}, {12, 2, { 52, 104}},
+	{12, 2, { 52, 108}}, {12, 2, { 52, 109}}, {12, 2, { 52, 110}},
+	{12, 2, { 52, 112}}, {12, 2, { 52, 114}}, {12, 2, { 52, 117}},
+	{ 6, 1, { 52,   0}}, { 6, 1, { 52,   0}}, { 6, 1, { 52,   0}},
+	{ 6, 1, { 52,   0}}, { 6, 1, { 52,   0}}, { 6, 1, { 52,   0}},
+	{ 6, 1, { 52,   0}}, { 6, 1, { 52,   0}}, { 6, 1, { 52,   0}},
+	{ 6, 1, { 52,   0}}, { 6, 1, { 52,   0}}, { 6, 1, { 52,   0}},
+	{ 6, 1, { 52,   0}}, { 6, 1, { 52,   0}}, { 6, 1, { 52,   0}},
+	{ 6, 1, { 52,   0}}, { 6, 1, { 52,   0}}, { 6, 1, { 52,   0}},
+	{11, 2, { 53,  48}}, {11, 2, { 53,  48}}, {11, 2, { 53,  49}},
+	{11, 2, { 53,  49}}, {11, 2, { 53,  50}}, {11, 2, { 53,  50}},
+	{11, 2, { 53,  97}}, {11, 2, { 53,  97}}, {11, 2, { 53,  99}},
+	{11, 2, { 53,  99}}, {11, 2, { 53, 101}}, {11, 2, { 53, 101}},
+	{11, 2, { 53, 105}}, {11, 2, { 53, 105}}, {11, 2, { 53, 111}},
+	{11, 2, { 53, 111}}, {11, 2, { 53, 115}}, {11, 2, { 53, 115}},
+	{11, 2, { 53, 116}}, {11, 2, { 53, 116}}, {12, 2, { 53,  32}},
+	{12, 2, { 53,  37}}, {12, 2, { 53,  45}}, {12, 2, { 53,  46}},
+	{12, 2, { 53,  47}}, {12, 2, { 53,  51}}, {12, 2, { 53,  52}},
+	{12, 2, { 53,  53}}, {12, 2, { 53,  54}}, {12, 2, { 53,  55}},
+	{12, 2, { 53,  56}}, {12, 2, { 53,  57}}, {12, 2, { 53,  61}},
+	{12, 2, { 53,  65}}, {12, 2, { 53,  95}}, {12, 2, { 53,  98}},
+	{12, 2, { 53, 100}}, {12, 2, { 53, 102}}, {12, 2, { 53, 103}},
+	{12, 2, { 53, 104}}, {12, 2, { 53, 108}}, {12, 2, { 53, 109}},
+	{12, 2, { 53, 110}}, {12, 2, { 53, 112}}, {12, 2, { 53, 114}},
+	{12, 2, { 53, 117}}, { 6, 1, { 53,   0}}, { 6, 1, { 53,   0}},
+	{ 6, 1, { 53,   0}}, { 6, 1, { 53,   0}}, { 6, 1, { 53,   0}},
+	{ 6, 1, { 53,   0}}, { 6, 1, { 53,   0}}, { 6, 1, { 53,   0}},
+	{ 6, 1, { 53,   0}}, { 6, 1, { 53,   0}}, { 6, 1, { 53,   0}},
+	{ 6, 1, { 53,   0}}, { 6, 1, { 53,   0}}, { 6, 1, { 53,   0}},
+	{ 6, 1, { 53,   0}}, { 6, 1, { 53,   0}}, { 6, 1, { 53,   0}},
+	{ 6, 1, { 53,   0}}, {11, 2, { 54,  48}}, {11, 2, { 54,  48}},
+	{11, 2, { 54,  49}}, {11, 2, { 54,  49}}, {11, 2, { 54,  50}},
+	{11, 2, { 54,  50}}, {11, 2, { 54,  97}}, {11, 2, { 54,  97}},
+	{11, 2, { 54,  99}}, {11, 2, { 54,  99}}, {11, 2, { 54, 101}},
+	{11, 2, { 54, 101}}, {11, 2, { 54, 105}}, {11, 2, { 54, 105}},
+	{11, 2, { 54, 111}}, {11, 2, { 54, 111}}, {11, 2, { 54, 115}},
+	{11, 2, { 54, 115}}, {11, 2, { 54, 116}}, {11, 2, { 54, 116}},
+	{12, 2, { 54,  32}}, {12, 2, { 54,  37}}, {12, 2, { 54,  45}},
+	{12, 2, { 54,  46}}, {12, 2, { 54,  47}}, {12, 2, { 54,  51}},
+	{12, 2, { 54,  52}}, {12, 2, { 54,  53}}, {12, 2, { 54,  54}},
+	{12, 2, { 54,  55}}, {12, 2, { 54,  56}}, {12, 2, { 54,  57}},
+	{12, 2, { 54,  61}}, {12, 2, { 54,  65}}, {12, 2, { 54,  95}},
+	{12, 2, { 54,  98}}, {12, 2, { 54, 100}}, {12, 2, { 54, 102}},
+	{12, 2, { 54, 103}}, {12, 2, { 54, 104}}, {12, 2, { 54, 108}},
+	{12, 2, { 54, 109}}, {12, 2, { 54, 110}}, {12, 2, { 54, 112}},
+	{12, 2, { 54, 114}}, {12, 2, { 54, 117}}, { 6, 1, { 54,   0}},
+	{ 6, 1, { 54,   0}}, { 6, 1, { 54,   0}}, { 6, 1, { 54,   0}},
+	{ 6, 1, { 54,   0}}, { 6, 1, { 54,   0}}, { 6, 1, { 54,   0}},
+	{ 6, 1, { 54,   0}}, { 6, 1, { 54,   0}}, { 6, 1, { 54,   0}},
+	{ 6, 1, { 54,   0}}, { 6, 1, { 54,   0}}, { 6, 1, { 54,   0}},
+	{ 6, 1, { 54,   0}}, { 6, 1, { 54,   0}}, { 6, 1, { 54,   0}},
+	{ 6, 1, { 54,   0}}, { 6, 1, { 54,   0}}, {11, 2, { 55,  48}},
+	{11, 2, { 55,  48}}, {11, 2, { 55,  49}}, {11, 2, { 55,  49}},
+	{11, 2, { 55,  50}}, {11, 2, { 55,  50}}, {11, 2, { 55,  97}},
+	{11, 2, { 55,  97}}, {11, 2, { 55,  99}}, {11, 2, { 55,  99}},
+	{11, 2, { 55, 101}}, {11, 2, { 55, 101}}, {11, 2, { 55, 105}},
+	{11, 2, { 55, 105}}, {11, 2, { 55, 111}}, {11, 2, { 55, 111}},
+	{11, 2, { 55, 115}}, {11, 2, { 55, 115}}, {11, 2, { 55, 116}},
+	{11, 2, { 55, 116}}, {12, 2, { 55,  32}}, {12, 2, { 55,  37}},
+	{12, 2, { 55,  45}}, {12, 2, { 55,  46}}, {12, 2, { 55,  47}},
+	{12, 2, { 55,  51}}, {12, 2, { 55,  52}}, {12, 2, { 55,  53}},
+	{12, 2, { 55,  54}}, {12, 2, { 55,  55}}, {12, 2, { 55,  56}},
+	{12, 2, { 55,  57}}, {12, 2, { 55,  61}}, {12, 2, { 55,  65}},
+	{12, 2, { 55,  95}}, {12, 2, { 55,  98}}, {12, 2, { 55, 100}},
+	{12, 2, { 55, 102}}, {12, 2, { 55, 103}}, {12, 2, { 55, 104}},
+	{12, 2, { 55, 108}}, {12, 2, { 55, 109}}, {12, 2, { 55, 110}},
+	{12, 2, { 55, 112}}, {12, 2, { 55, 114}}, {12, 2, { 55, 117}},
+	{ 6, 1, { 55,   0}}, { 6, 1, { 55,   0}}, { 6, 1, { 55,   0}},
+	{ 6, 1, { 55,   0}}, { 6, 1, { 55,   0}}, { 6, 1, { 55,   0}},
+	{ 6, 1, { 55,   0}}, { 6, 1, { 55,   0}}, { 6, 1, { 55,   0}},
+	{ 6, 1, { 55,   0}}, { 6, 1, { 55,   0}}, { 6, 1, { 55,   0}},
+	{ 6, 1, { 55,   0}}, { 6, 1, { 55,   0}}, { 6, 1, { 55,   0}},
+	{ 6, 1, { 55,   0}}, { 6, 1, { 55,   0}}, { 6, 1, { 55,   0}},
+	{11, 2, { 56,  48}}, {11, 2, { 56,  48}}, {11, 2, { 56,  49}},
+	{11, 2, { 56,  49}}, {11, 2, { 56,  50}}, {11, 2, { 56,  50}},
+	{11, 2, { 56,  97}}, {11, 2, { 56,  97}}, {11, 2, { 56,  99}},
+	{11, 2, { 56,  99}}, {11, 2, { 56, 101}}, {11, 2, { 56, 101}},
+	{11, 2, { 56, 105}}, {11, 2, { 56, 105}}, {11, 2, { 56, 111}},
+	{11, 2, { 56, 111}}, {11, 2, { 56, 115}}, {11, 2, { 56, 115}},
+	{11, 2, { 56, 116}}, {11, 2, { 56, 116}}, {12, 2, { 56,  32}},
+	{12, 2, { 56,  37}}, {12, 2, { 56,  45}}, {12, 2, { 56,  46}},
+	{12, 2, { 56,  47}}, {12, 2, { 56,  51}}, {12, 2, { 56,  52}},
+	{12, 2, { 56,  53}}, {12, 2, { 56,  54}}, {12, 2, { 56,  55}},
+	{12, 2, { 56,  56}}, {12, 2, { 56,  57}}, {12, 2, { 56,  61}},
+	{12, 2, { 56,  65}}, {12, 2, { 56,  95}}, {12, 2, { 56,  98}},
+	{12, 2, { 56, 100}}, {12, 2, { 56, 102}}, {12, 2, { 56, 103}},
+	{12, 2, { 56, 104}}, {12, 2, { 56, 108}}, {12, 2, { 56, 109}},
+	{12, 2, { 56, 110}}, {12, 2, { 56, 112}}, {12, 2, { 56, 114}},
+	{12, 2, { 56, 117}}, { 6, 1, { 56,   0}}, { 6, 1, { 56,   0}},
+	{ 6, 1, { 56,   0}}, { 6, 1, { 56,   0}}, { 6, 1, { 56,   0}},
+	{ 6, 1, { 56,   0}}, { 6, 1, { 56,   0}}, { 6, 1, { 56,   0}},
+	{ 6, 1, { 56,   0}}, { 6, 1, { 56,   0}}, { 6, 1, { 56,   0}},
+	{ 6, 1, { 56,   0}}, { 6, 1, { 56,   0}}, { 6, 1, { 56,   0}},
+	{ 6, 1, { 56,   0}}, { 6, 1, { 56,   0}}, { 6, 1, { 56,   0}},
+	{ 6, 1, { 56,   0}}, {11, 2, { 57,  48}}, {11, 2, { 57,  48}},
+	{11, 2, { 57,  49}}, {11, 2, { 57,  49}}, {11, 2, { 57,  50}},
+	{11, 2, { 57,  50}}, {11, 2, { 57,  97}}, {11, 2, { 57,  97}},
+	{11, 2, { 57,  99}}, {11, 2, { 57,  99}}, {11, 2, { 57, 101}},
+	{11, 2, { 57, 101}}, {11, 2, { 57, 105}}, {11, 2, { 57, 105}},
+	{11, 2, { 57, 111}}, {11, 2, { 57, 111}}, {11, 2, { 57, 115}},
+	{11, 2, { 57, 115}}, {11, 2, { 57, 116}}, {11, 2, { 57, 116}},
+	{12, 2, { 57,  32}}, {12, 2, { 57,  37}}, {12, 2, { 57,  45}},
+	{12, 2, { 57,  46}}, {12, 2, { 57,  47}}, {12, 2, { 57,  51}},
+	{12, 2, { 57,  52}}, {12, 2, { 57,  53}}, {12, 2, { 57,  54}},
+	{12, 2, { 57,  55}}, {12, 2, { 57,  56}}, {12, 2, { 57,  57}},
+	{12, 2, { 57,  61}}, {12, 2, { 57,  65}}, {12, 2, { 57,  95}},
+	{12, 2, { 57,  98}}, {12, 2, { 57, 100}}, {12, 2, { 57, 102}},
+	{12, 2, { 57, 103}}, {12, 2, { 57, 104}}, {12, 2, { 57, 108}},
+	{12, 2, { 57, 109}}, {12, 2, { 57, 110}}, {12, 2, { 57, 112}},
+	{12, 2, { 57, 114}}, {12, 2, { 57, 117}}, { 6, 1, { 57,   0}},
+	{ 6, 1, { 57,   0}}, { 6, 1, { 57,   0}}, { 6, 1, { 57,   0}},
+	{ 6, 1, { 57,   0}}, { 6, 1, { 57,   0}}, { 6, 1, { 57,   0}},
+	{ 6, 1, { 57,   0}}, { 6, 1, { 57,   0}}, { 6, 1, { 57,   0}},
+	{ 6, 1, { 57,   0}}, { 6, 1, { 57,   0}}, { 6, 1, { 57,   0}},
+	{ 6, 1, { 57,   0}}, { 6, 1, { 57,   0}}, { 6, 1, { 57,   0}},
+	{ 6, 1, { 57,   0}}, { 6, 1, { 57,   0}}, {11, 2, { 61,  48}},
+	{11, 2, { 61,  48}}, {11, 2, { 61,  49}}, {11, 2, { 61,  49}},
+	{11, 2, { 61,  50}}, {11, 2, { 61,  50}}, {11, 2, { 61,  97}},
+	{11, 2, { 61,  97}}, {11, 2, { 61,  99}}, {11, 2, { 61,  99}},
+	{11, 2, { 61, 101}}, {11, 2, { 61, 101}}, {11, 2, { 61, 105}},
+	{11, 2, { 61, 105}}, {11, 2, { 61, 111}}, {11, 2, { 61, 111}},
+	{11, 2, { 61, 115}}, {11, 2, { 61, 115}}, {11, 2, { 61, 116}},
+	{11, 2, { 61, 116}}, {12, 2, { 61,  32}}, {12, 2, { 61,  37}},
+	{12, 2, { 61,  45}}, {12, 2, { 61,  46}}, {12, 2, { 61,  47}},
+	{12, 2, { 61,  51}}, {12, 2, { 61,  52}}, {12, 2, { 61,  53}},
+	{12, 2, { 61,  54}}, {12, 2, { 61,  55}}, {12, 2, { 61,  56}},
+	{12, 2, { 61,  57}}, {12, 2, { 61,  61}}, {12, 2, { 61,  65}},
+	{12, 2, { 61,  95}}, {12, 2, { 61,  98}}, {12, 2, { 61, 100}},
+	{12, 2, { 61, 102}}, {12, 2, { 61, 103}}, {12, 2, { 61, 104}},
+	{12, 2, { 61, 108}}, {12, 2, { 61, 109}}, {12, 2, { 61, 110}},
+	{12, 2, { 61, 112}}, {12, 2, { 61, 114}}, {12, 2, { 61, 117}},
+	{ 6, 1, { 61,   0}}, { 6, 1, { 61,   0}}, { 6, 1, { 61,   0}},
+	{ 6, 1, { 61,   0}}, { 6, 1, { 61,   0}}, { 6, 1, { 61,   0}},
+	{ 6, 1, { 61,   0}}, { 6, 1, { 61,   0}}, { 6, 1, { 61,   0}},
+	{ 6, 1, { 61,   0}}, { 6, 1, { 61,   0}}, { 6, 1, { 61,   0}},
+	{ 6, 1, { 61,   0}}, { 6, 1, { 61,   0}}, { 6, 1, { 61,   0}},
+	{ 6, 1, { 61,   0}}, { 6, 1, { 61,   0}}, { 6, 1, { 61,   0}},
+	{11, 2, { 65,  48}}, {11, 2, { 65,  48}}, {11, 2, { 65,  49}},
+	{11, 2, { 65,  49}}, {11, 2, { 65,  50}}, {11, 2, { 65,  50}},
+	{11, 2, { 65,  97}}, {11, 2, { 65,  97}}, {11, 2, { 65,  99}},
+	{11, 2, { 65,  99}}, {11, 2, { 65, 101}}, {11, 2, { 65, 101}},
+	{11, 2, { 65, 105}}, {11, 2, { 65, 105}}, {11, 2, { 65, 111}},
+	{11, 2, { 65, 111}}, {11, 2, { 65, 115}}, {11, 2, { 65, 115}},
+	{11, 2, { 65, 116}}, {11, 2, { 65, 116}}, {12, 2, { 65,  32}},
+	{12, 2, { 65,  37}}, {12, 2, { 65,  45}}, {12, 2, { 65,  46}},
+	{12, 2, { 65,  47}}, {12, 2, { 65,  51}}, {12, 2, { 65,  52}},
+	{12, 2, { 65,  53}}, {12, 2, { 65,  54}}, {12, 2, { 65,  55}},
+	{12, 2, { 65,  56}}, {12, 2, { 65,  57}}, {12, 2, { 65,  61}},
+	{12, 2, { 65,  65}}, {12, 2, { 65,  95}}, {12, 2, { 65,  98}},
+	{12, 2, { 65, 100}}, {12, 2, { 65, 102}}, {12, 2, { 65, 103}},
+	{12, 2, { 65, 104}}, {12, 2, { 65, 108}}, {12, 2, { 65, 109}},
+	{12, 2, { 65, 110}}, {12, 2, { 65, 112}}, {12, 2, { 65, 114}},
+	{12, 2, { 65, 117}}, { 6, 1, { 65,   0}}, { 6, 1, { 65,   0}},
+	{ 6, 1, { 65,   0}}, { 6, 1, { 65,   0}}, { 6, 1, { 65,   0}},
+	{ 6, 1, { 65,   0}}, { 6, 1, { 65,   0}}, { 6, 1, { 65,   0}},
+	{ 6, 1, { 65,   0}}, { 6, 1, { 65,   0}}, { 6, 1, { 65,   0}},
+	{ 6, 1, { 65,   0}}, { 6, 1, { 65,   0}}, { 6, 1, { 65,   0}},
+	{ 6, 1, { 65,   0}}, { 6, 1, { 65,   0}}, { 6, 1, { 65,   0}},
+	{ 6, 1, { 65,   0}}, {11, 2, { 95,  48}}, {11, 2, { 95,  48}},
+	{11, 2, { 95,  49}}, {11, 2, { 95,  49}}, {11, 2, { 95,  50}},
+	{11, 2, { 95,  50}}, {11, 2, { 95,  97}}, {11, 2, { 95,  97}},
+	{11, 2, { 95,  99}}, {11, 2, { 95,  99}}, {11, 2, { 95, 101}},
+	{11, 2, { 95, 101}}, {11, 2, { 95, 105}}, {11, 2, { 95, 105}},
+	{11, 2, { 95, 111}}, {11, 2, { 95, 111}}, {11, 2, { 95, 115}},
+	{11, 2, { 95, 115}}, {11, 2, { 95, 116}}, {11, 2, { 95, 116}},
+	{12, 2, { 95,  32}}, {12, 2, { 95,  37}}, {12, 2, { 95,  45}},
+	{12, 2, { 95,  46}}, {12, 2, { 95,  47}}, {12, 2, { 95,  51}},
+	{12, 2, { 95,  52}}, {12, 2, { 95,  53}}, {12, 2, { 95,  54}},
+	{12, 2, { 95,  55}}, {12, 2, { 95,  56}}, {12, 2, { 95,  57}},
+	{12, 2, { 95,  61}}, {12, 2, { 95,  65}}, {12, 2, { 95,  95}},
+	{12, 2, { 95,  98}}, {12, 2, { 95, 100}}, {12, 2, { 95, 102}},
+	{12, 2, { 95, 103}}, {12, 2, { 95, 104}}, {12, 2, { 95, 108}},
+	{12, 2, { 95, 109}}, {12, 2, { 95, 110}}, {12, 2, { 95, 112}},
+	{12, 2, { 95, 114}}, {12, 2, { 95, 117}}, { 6, 1, { 95,   0}},
+	{ 6, 1, { 95,   0}}, { 6, 1, { 95,   0}}, { 6, 1, { 95,   0}},
+	{ 6, 1, { 95,   0}}, { 6, 1, { 95,   0}}, { 6, 1, { 95,   0}},
+	{ 6, 1, { 95,   0}}, { 6, 1, { 95,   0}}, { 6, 1, { 95,   0}},
+	{ 6, 1, { 95,   0}}, { 6, 1, { 95,   0}}, { 6, 1, { 95,   0}},
+	{ 6, 1, { 95,   0}}, { 6, 1, { 95,   0}}, { 6, 1, { 95,   0}},
+	{ 6, 1, { 95,   0}}, { 6, 1, { 95,   0}}, {11, 2, { 98,  48}},
+	{11, 2, { 98,  48}}, {11, 2, { 98,  49}}, {11, 2, { 98,  49}},
+	{11, 2, { 98,  50}}, {11, 2, { 98,  50}}, {11, 2, { 98,  97}},
+	{11, 2, { 98,  97}}, {11, 2, { 98,  99}}, {11, 2, { 98,  99}},
+	{11, 2, { 98, 101}}, {11, 2, { 98, 101}}, {11, 2, { 98, 105}},
+	{11, 2, { 98, 105}}, {11, 2, { 98, 111}}, {11, 2, { 98, 111}},
+	{11, 2, { 98, 115}}, {11, 2, { 98, 115}}, {11, 2, { 98, 116}},
+	{11, 2, { 98, 116}}, {12, 2, { 98,  32}}, {12, 2, { 98,  37}},
+	{12, 2, { 98,  45}}, {12, 2, { 98,  46}}, {12, 2, { 98,  47}},
+	{12, 2, { 98,  51}}, {12, 2, { 98,  52}}, {12, 2, { 98,  53}},
+	{12, 2, { 98,  54}}, {12, 2, { 98,  55}}, {12, 2, { 98,  56}},
+	{12, 2, { 98,  57}}, {12, 2, { 98,  61}}, {12, 2, { 98,  65}},
+	{12, 2, { 98,  95}}, {12, 2, { 98,  98}}, {12, 2, { 98, 100}},
+	{12, 2, { 98, 102}}, {12, 2, { 98, 103}}, {12, 2, { 98, 104}},
+	{12, 2, { 98, 108}}, {12, 2, { 98, 109}}, {12, 2, { 98, 110}},
+	{12, 2, { 98, 112}}, {12, 2, { 98, 114}}, {12, 2, { 98, 117}},
+	{ 6, 1, { 98,   0}}, { 6, 1, { 98,   0}}, { 6, 1, { 98,   0}},
+	{ 6, 1, { 98,   0}}, { 6, 1, { 98,   0}}, { 6, 1, { 98,   0}},
+	{ 6, 1, { 98,   0}}, { 6, 1, { 98,   0}}, { 6, 1, { 98,   0}},
+	{ 6, 1, { 98,   0}}, { 6, 1, { 98,   0}}, { 6, 1, { 98,   0}},
+	{ 6, 1, { 98,   0}}, { 6, 1, { 98,   0}}, { 6, 1, { 98,   0}},
+	{ 6, 1, { 98,   0}}, { 6, 1, { 98,   0}}, { 6, 1, { 98,   0}},
+	{11, 2, {100,  48}}, {11, 2, {100,  48}}, {11, 2, {100,  49}},
+	{11, 2, {100,  49}}, {11, 2, {100,  50}}, {11, 2, {100,  50}},
+	{11, 2, {100,  97}}, {11, 2, {100,  97}}, {11, 2, {100,  99}},
+	{11, 2, {100,  99}}, {11, 2, {100, 101}}, {11, 2, {100, 101}},
+	{11, 2, {100, 105}}, {11, 2, {100, 105}}, {11, 2, {100, 111}},
+	{11, 2, {100, 111}}, {11, 2, {100, 115}}, {11, 2, {100, 115}},
+	{11, 2, {100, 116}}, {11, 2, {100, 116}}, {12, 2, {100,  32}},
+	{12, 2, {100,  37}}, {12, 2, {100,  45}}, {12, 2, {100,  46}},
+	{12, 2, {100,  47}}, {12, 2, {100,  51}}, {12, 2, {100,  52}},
+	{12, 2, {100,  53}}, {12, 2, {100,  54}}, {12, 2, {100,  55}},
+	{12, 2, {100,  56}}, {12, 2, {100,  57}}, {12, 2, {100,  61}},
+	{12, 2, {100,  65}}, {12, 2, {100,  95}}, {12, 2, {100,  98}},
+	{12, 2, {100, 100}}, {12, 2, {100, 102}}, {12, 2, {100, 103}},
+	{12, 2, {100, 104}}, {12, 2, {100, 108}}, {12, 2, {100, 109}},
+	{12, 2, {100, 110}}, {12, 2, {100, 112}}, {12, 2, {100, 114}},
+	{12, 2, {100, 117}}, { 6, 1, {100,   0}}, { 6, 1, {100,   0}},
+	{ 6, 1, {100,   0}}, { 6, 1, {100,   0}}, { 6, 1, {100,   0}},
+	{ 6, 1, {100,   0}}, { 6, 1, {100,   0}}, { 6, 1, {100,   0}},
+	{ 6, 1, {100,   0}}, { 6, 1, {100,   0}}, { 6, 1, {100,   0}},
+	{ 6, 1, {100,   0}}, { 6, 1, {100,   0}}, { 6, 1, {100,   0}},
+	{ 6, 1, {100,   0}}, { 6, 1, {100,   0}}, { 6, 1, {100,   0}},
+	{ 6, 1, {100,   0}}, {11, 2, {102,  48}}, {11, 2, {102,  48}},
+	{11, 2, {102,  49}}, {11, 2, {102,  49}}, {11, 2, {102,  50}},
+	{11, 2, {102,  50}}, {11, 2, {102,  97}}, {11, 2, {102,  97}},
+	{11, 2, {102,  99}}, {11, 2, {102,  99}}, {11, 2, {102, 101}},
+	{11, 2, {102, 101}}, {11, 2, {102, 105}}, {11, 2, {102, 105}},
+	{11, 2, {102, 111}}, {11, 2, {102, 111}}, {11, 2, {102, 115}},
+	{11, 2, {102, 115}}, {11, 2, {102, 116}}, {11, 2, {102, 116}},
+	{12, 2, {102,  32}}, {12, 2, {102,  37}}, {12, 2, {102,  45}},
+	{12, 2, {102,  46}}, {12, 2, {102,  47}}, {12, 2, {102,  51}},
+	{12, 2, {102,  52}}, {12, 2, {102,  53}}, {12, 2, {102,  54}},
+	{12, 2, {102,  55}}, {12, 2, {102,  56}}, {12, 2, {102,  57}},
+	{12, 2, {102,  61}}, {12, 2, {102,  65}}, {12, 2, {102,  95}},
+	{12, 2, {102,  98}}, {12, 2, {102, 100}}, {12, 2, {102, 102}},
+	{12, 2, {102, 103}}, {12, 2, {102, 104}}, {12, 2, {102, 108}},
+	{12, 2, {102, 109}}, {12, 2, {102, 110}}, {12, 2, {102, 112}},
+	{12, 2, {102, 114}}, {12, 2, {102, 117}}, { 6, 1, {102,   0}},
+	{ 6, 1, {102,   0}}, { 6, 1, {102,   0}}, { 6, 1, {102,   0}},
+	{ 6, 1, {102,   0}}, { 6, 1, {102,   0}}, { 6, 1, {102,   0}},
+	{ 6, 1, {102,   0}}, { 6, 1, {102,   0}}, { 6, 1, {102,   0}},
+	{ 6, 1, {102,   0}}, { 6, 1, {102,   0}}, { 6, 1, {102,   0}},
+	{ 6, 1, {102,   0}}, { 6, 1, {102,   0}}, { 6, 1, {102,   0}},
+	{ 6, 1, {102,   0}}, { 6, 1, {102,   0}}, {11, 2, {103,  48}},
+	{11, 2, {103,  48}}, {11, 2, {103,  49}}, {11, 2, {103,  49}},
+	{11, 2, {103,  50}}, {11, 2, {103,  50}}, {11, 2, {103,  97}},
+	{11, 2, {103,  97}}, {11, 2, {103,  99}}, {11, 2, {103,  99}},
+	{11, 2, {103, 101}}, {11, 2, {103, 101}}, {11, 2, {103, 105}},
+	{11, 2, {103, 105}}, {11, 2, {103, 111}}, {11, 2, {103, 111}},
+	{11, 2, {103, 115}}, {11, 2, {103, 115}}, {11, 2, {103, 116}},
+	{11, 2, {103, 116}}, {12, 2, {103,  32}}, {12, 2, {103,  37}},
+	{12, 2, {103,  45}}, {12, 2, {103,  46}}, {12, 2, {103,  47}},
+	{12, 2, {103,  51}}, {12, 2, {103,  52}}, {12, 2, {103,  53}},
+	{12, 2, {103,  54}}, {12, 2, {103,  55}}, {12, 2, {103,  56}},
+	{12, 2, {103,  57}}, {12, 2, {103,  61}}, {12, 2, {103,  65}},
+	{12, 2, {103,  95}}, {12, 2, {103,  98}}, {12, 2, {103, 100}},
+	{12, 2, {103, 102}}, {12, 2, {103, 103}}, {12, 2, {103, 104}},
+	{12, 2, {103, 108}}, {12, 2, {103, 109}}, {12, 2, {103, 110}},
+	{12, 2, {103, 112}}, {12, 2, {103, 114}}, {12, 2, {103, 117}},
+	{ 6, 1, {103,   0}}, { 6, 1, {103,   0}}, { 6, 1, {103,   0}},
+	{ 6, 1, {103,   0}}, { 6, 1, {103,   0}}, { 6, 1, {103,   0}},
+	{ 6, 1, {103,   0}}, { 6, 1, {103,   0}}, { 6, 1, {103,   0}},
+	{ 6, 1, {103,   0}}, { 6, 1, {103,   0}}, { 6, 1, {103,   0}},
+	{ 6, 1, {103,   0}}, { 6, 1, {103,   0}}, { 6, 1, {103,   0}},
+	{ 6, 1, {103,   0}}, { 6, 1, {103,   0}}, { 6, 1, {103,   0}},
+	{11, 2, {104,  48}}, {11, 2, {104,  48}}, {11, 2, {104,  49}},
+	{11, 2, {104,  49}}, {11, 2, {104,  50}}, {11, 2, {104,  50}},
+	{11, 2, {104,  97}}, {11, 2, {104,  97}}, {11, 2, {104,  99}},
+	{11, 2, {104,  99}}, {11, 2, {104, 101}}, {11, 2, {104, 101}},
+	{11, 2, {104, 105}}, {11, 2, {104, 105}}, {11, 2, {104, 111}},
+	{11, 2, {104, 111}}, {11, 2, {104, 115}}, {11, 2, {104, 115}},
+	{11, 2, {104, 116}}, {11, 2, {104, 116}}, {12, 2, {104,  32}},
+	{12, 2, {104,  37}}, {12, 2, {104,  45}}, {12, 2, {104,  46}},
+	{12, 2, {104,  47}}, {12, 2, {104,  51}}, {12, 2, {104,  52}},
+	{12, 2, {104,  53}}, {12, 2, {104,  54}}, {12, 2, {104,  55}},
+	{12, 2, {104,  56}}, {12, 2, {104,  57}}, {12, 2, {104,  61}},
+	{12, 2, {104,  65}}, {12, 2, {104,  95}}, {12, 2, {104,  98}},
+	{12, 2, {104, 100}}, {12, 2, {104, 102}}, {12, 2, {104, 103}},
+	{12, 2, {104, 104}}, {12, 2, {104, 108}}, {12, 2, {104, 109}},
+	{12, 2, {104, 110}}, {12, 2, {104, 112}}, {12, 2, {104, 114}},
+	{12, 2, {104, 117}}, { 6, 1, {104,   0}}, { 6, 1, {104,   0}},
+	{ 6, 1, {104,   0}}, { 6, 1, {104,   0}}, { 6, 1, {104,   0}},
+	{ 6, 1, {104,   0}}, { 6, 1, {104,   0}}, { 6, 1, {104,   0}},
+	{ 6, 1, {104,   0}}, { 6, 1, {104,   0}}, { 6, 1, {104,   0}},
+	{ 6, 1, {104,   0}}, { 6, 1, {104,   0}}, { 6, 1, {104,   0}},
+	{ 6, 1, {104,   0}}, { 6, 1, {104,   0}}, { 6, 1, {104,   0}},
+	{ 6, 1, {104,   0}}, {11, 2, {108,  48}}, {11, 2, {108,  48}},
+	{11, 2, {108,  49}}, {11, 2, {108,  49}}, {11, 2, {108,  50}},
+	{11, 2, {108,  50}}, {11, 2, {108,  97}}, {11, 2, {108,  97}},
+	{11, 2, {108,  99}}, {11, 2, {108,  99}}, {11, 2, {108, 101}},
+	{11, 2, {108, 101}}, {11, 2, {108, 105}}, {11, 2, {108, 105}},
+	{11, 2, {108, 111}}, {11, 2, {108, 111}}, {11, 2, {108, 115}},
+	{11, 2, {108, 115}}, {11, 2, {108, 116}}, {11, 2, {108, 116}},
+	{12, 2, {108,  32}}, {12, 2, {108,  37}}, {12, 2, {108,  45}},
+	{12, 2, {108,  46}}, {12, 2, {108,  47}}, {12, 2, {108,  51}},
+	{12, 2, {108,  52}}, {12, 2, {108,  53}}, {12, 2, {108,  54}},
+	{12, 2, {108,  55}}, {12, 2, {108,  56}}, {12, 2, {108,  57}},
+	{12, 2, {108,  61}}, {12, 2, {108,  65}}, {12, 2, {108,  95}},
+	{12, 2, {108,  98}}, {12, 2, {108, 100}}, {12, 2, {108, 102}},
+	{12, 2, {108, 103}}, {12, 2, {108, 104}}, {12, 2, {108, 108}},
+	{12, 2, {108, 109}}, {12, 2, {108, 110}}, {12, 2, {108, 112}},
+	{12, 2, {108, 114}}, {12, 2, {108, 117}}, { 6, 1, {108,   0}},
+	{ 6, 1, {108,   0}}, { 6, 1, {108,   0}}, { 6, 1, {108,   0}},
+	{ 6, 1, {108,   0}}, { 6, 1, {108,   0}}, { 6, 1, {108,   0}},
+	{ 6, 1, {108,   0}}, { 6, 1, {108,   0}}, { 6, 1, {108,   0}},
+	{ 6, 1, {108,   0}}, { 6, 1, {108,   0}}, { 6, 1, {108,   0}},
+	{ 6, 1, {108,   0}}, { 6, 1, {108,   0}}, { 6, 1, {108,   0}},
+	{ 6, 1, {108,   0}}, { 6, 1, {108,   0}}, {11, 2, {109,  48}},
+	{11, 2, {109,  48}}, {11, 2, {109,  49}}, {11, 2, {109,  49}},
+	{11, 2, {109,  50}}, {11, 2, {109,  50}}, {11, 2, {109,  97}},
+	{11, 2, {109,  97}}, {11, 2, {109,  99}}, {11, 2, {109,  99}},
+	{11, 2, {109, 101}}, {11, 2, {109, 101}}, {11, 2, {109, 105}},
+	{11, 2, {109, 105}}, {11, 2, {109, 111}}, {11, 2, {109, 111}},
+	{11, 2, {109, 115}}, {11, 2, {109, 115}}, {11, 2, {109, 116}},
+	{11, 2, {109, 116}}, {12, 2, {109,  32}}, {12, 2, {109,  37}},
+	{12, 2, {109,  45}}, {12, 2, {109,  46}}, {12, 2, {109,  47}},
+	{12, 2, {109,  51}}, {12, 2, {109,  52}}, {12, 2, {109,  53}},
+	{12, 2, {109,  54}}, {12, 2, {109,  55}}, {12, 2, {109,  56}},
+	{12, 2, {109,  57}}, {12, 2, {109,  61}}, {12, 2, {109,  65}},
+	{12, 2, {109,  95}}, {12, 2, {109,  98}}, {12, 2, {109, 100}},
+	{12, 2, {109, 102}}, {12, 2, {109, 103}}, {12, 2, {109, 104}},
+	{12, 2, {109, 108}}, {12, 2, {109, 109}}, {12, 2, {109, 110}},
+	{12, 2, {109, 112}}, {12, 2, {109, 114}}, {12, 2, {109, 117}},
+	{ 6, 1, {109,   0}}, { 6, 1, {109,   0}}, { 6, 1, {109,   0}},
+	{ 6, 1, {109,   0}}, { 6, 1, {109,   0}}, { 6, 1, {109,   0}},
+	{ 6, 1, {109,   0}}, { 6, 1, {109,   0}}, { 6, 1, {109,   0}},
+	{ 6, 1, {109,   0}}, { 6, 1, {109,   0}}, { 6, 1, {109,   0}},
+	{ 6, 1, {109,   0}}, { 6, 1, {109,   0}}, { 6, 1, {109,   0}},
+	{ 6, 1, {109,   0}}, { 6, 1, {109,   0}}, { 6, 1, {109,   0}},
+	{11, 2, {110,  48}}, {11, 2, {110,  48}}, {11, 2, {110,  49}},
+	{11, 2, {110,  49}}, {11, 2, {110,  50}}, {11, 2, {110,  50}},
+	{11, 2, {110,  97}}, {11, 2, {110,  97}}, {11, 2, {110,  99}},
+	{11, 2, {110,  99}}, {11, 2, {110, 101}}, {11, 2, {110, 101}},
+	{11, 2, {110, 105}}, {11, 2, {110, 105}}, {11, 2, {110, 111}},
+	{11, 2, {110, 111}}, {11, 2, {110, 115}}, {11, 2, {110, 115}},
+	{11, 2, {110, 116}}, {11, 2, {110, 116}}, {12, 2, {110,  32}},
+	{12, 2, {110,  37}}, {12, 2, {110,  45}}, {12, 2, {110,  46}},
+	{12, 2, {110,  47}}, {12, 2, {110,  51}}, {12, 2, {110,  52}},
+	{12, 2, {110,  53}}, {12, 2, {110,  54}}, {12, 2, {110,  55}},
+	{12, 2, {110,  56}}, {12, 2, {110,  57}}, {12, 2, {110,  61}},
+	{12, 2, {110,  65}}, {12, 2, {110,  95}}, {12, 2, {110,  98}},
+	{12, 2, {110, 100}}, {12, 2, {110, 102}}, {12, 2, {110, 103}},
+	{12, 2, {110, 104}}, {12, 2, {110, 108}}, {12, 2, {110, 109}},
+	{12, 2, {110, 110}}, {12, 2, {110, 112}}, {12, 2, {110, 114}},
+	{12, 2, {110, 117}}, { 6, 1, {110,   0}}, { 6, 1, {110,   0}},
+	{ 6, 1, {110,   0}}, { 6, 1, {110,   0}}, { 6, 1, {110,   0}},
+	{ 6, 1, {110,   0}}, { 6, 1, {110,   0}}, { 6, 1, {110,   0}},
+	{ 6, 1, {110,   0}}, { 6, 1, {110,   0}}, { 6, 1, {110,   0}},
+	{ 6, 1, {110,   0}}, { 6, 1, {110,   0}}, { 6, 1, {110,   0}},
+	{ 6, 1, {110,   0}}, { 6, 1, {110,   0}}, { 6, 1, {110,   0}},
+	{ 6, 1, {110,   0}}, {11, 2, {112,  48}}, {11, 2, {112,  48}},
+	{11, 2, {112,  49}}, {11, 2, {112,  49}}, {11, 2, {112,  50}},
+	{11, 2, {112,  50}}, {11, 2, {112,  97}}, {11, 2, {112,  97}},
+	{11, 2, {112,  99}}, {11, 2, {112,  99}}, {11, 2, {112, 101}},
+	{11, 2, {112, 101}}, {11, 2, {112, 105}}, {11, 2, {112, 105}},
+	{11, 2, {112, 111}}, {11, 2, {112, 111}}, {11, 2, {112, 115}},
+	{11, 2, {112, 115}}, {11, 2, {112, 116}}, {11, 2, {112, 116}},
+	{12, 2, {112,  32}}, {12, 2, {112,  37}}, {12, 2, {112,  45}},
+	{12, 2, {112,  46}}, {12, 2, {112,  47}}, {12, 2, {112,  51}},
+	{12, 2, {112,  52}}, {12, 2, {112,  53}}, {12, 2, {112,  54}},
+	{12, 2, {112,  55}}, {12, 2, {112,  56}}, {12, 2, {112,  57}},
+	{12, 2, {112,  61}}, {12, 2, {112,  65}}, {12, 2, {112,  95}},
+	{12, 2, {112,  98}}, {12, 2, {112, 100}}, {12, 2, {112, 102}},
+	{12, 2, {112, 103}}, {12, 2, {112, 104}}, {12, 2, {112, 108}},
+	{12, 2, {112, 109}}, {12, 2, {112, 110}}, {12, 2, {112, 112}},
+	{12, 2, {112, 114}}, {12, 2, {112, 117}}, { 6, 1, {112,   0}},
+	{ 6, 1, {112,   0}}, { 6, 1, {112,   0}}, { 6, 1, {112,   0}},
+	{ 6, 1, {112,   0}}, { 6, 1, {112,   0}}, { 6, 1, {112,   0}},
+	{ 6, 1, {112,   0}}, { 6, 1, {112,   0}}, { 6, 1, {112,   0}},
+	{ 6, 1, {112,   0}}, { 6, 1, {112,   0}}, { 6, 1, {112,   0}},
+	{ 6, 1, {112,   0}}, { 6, 1, {112,   0}}, { 6, 1, {112,   0}},
+	{ 6, 1, {112,   0}}, { 6, 1, {112,   0}}, {11, 2, {114,  48}},
+	{11, 2, {114,  48}}, {11, 2, {114,  49}}, {11, 2, {114,  49}},
+	{11, 2, {114,  50}}, {11, 2, {114,  50}}, {11, 2, {114,  97}},
+	{11, 2, {114,  97}}, {11, 2, {114,  99}}, {11, 2, {114,  99}},
+	{11, 2, {114, 101}}, {11, 2, {114, 101}}, {11, 2, {114, 105}},
+	{11, 2, {114, 105}}, {11, 2, {114, 111}}, {11, 2, {114, 111}},
+	{11, 2, {114, 115}}, {11, 2, {114, 115}}, {11, 2, {114, 116}},
+	{11, 2, {114, 116}}, {12, 2, {114,  32}}, {12, 2, {114,  37}},
+	{12, 2, {114,  45}}, {12, 2, {114,  46}}, {12, 2, {114,  47}},
+	{12, 2, {114,  51}}, {12, 2, {114,  52}}, {12, 2, {114,  53}},
+	{12, 2, {114,  54}}, {12, 2, {114,  55}}, {12, 2, {114,  56}},
+	{12, 2, {114,  57}}, {12, 2, {114,  61}}, {12, 2, {114,  65}},
+	{12, 2, {114,  95}}, {12, 2, {114,  98}}, {12, 2, {114, 100}},
+	{12, 2, {114, 102}}, {12, 2, {114, 103}}, {12, 2, {114, 104}},
+	{12, 2, {114, 108}}, {12, 2, {114, 109}}, {12, 2, {114, 110}},
+	{12, 2, {114, 112}}, {12, 2, {114, 114}}, {12, 2, {114, 117}},
+	{ 6, 1, {114,   0}}, { 6, 1, {114,   0}}, { 6, 1, {114,   0}},
+	{ 6, 1, {114,   0}}, { 6, 1, {114,   0}}, { 6, 1, {114,   0}},
+	{ 6, 1, {114,   0}}, { 6, 1, {114,   0}}, { 6, 1, {114,   0}},
+	{ 6, 1, {114,   0}}, { 6, 1, {114,   0}}, { 6, 1, {114,   0}},
+	{ 6, 1, {114,   0}}, { 6, 1, {114,   0}}, { 6, 1, {114,   0}},
+	{ 6, 1, {114,   0}}, { 6, 1, {114,   0}}, { 6, 1, {114,   0}},
+	{11, 2, {117,  48}}, {11, 2, {117,  48}}, {11, 2, {117,  49}},
+	{11, 2, {117,  49}}, {11, 2, {117,  50}}, {11, 2, {117,  50}},
+	{11, 2, {117,  97}}, {11, 2, {117,  97}}, {11, 2, {117,  99}},
+	{11, 2, {117,  99}}, {11, 2, {117, 101}}, {11, 2, {117, 101}},
+	{11, 2, {117, 105}}, {11, 2, {117, 105}}, {11, 2, {117, 111}},
+	{11, 2, {117, 111}}, {11, 2, {117, 115}}, {11, 2, {117, 115}},
+	{11, 2, {117, 116}}, {11, 2, {117, 116}}, {12, 2, {117,  32}},
+	{12, 2, {117,  37}}, {12, 2, {117,  45}}, {12, 2, {117,  46}},
+	{12, 2, {117,  47}}, {12, 2, {117,  51}}, {12, 2, {117,  52}},
+	{12, 2, {117,  53}}, {12, 2, {117,  54}}, {12, 2, {117,  55}},
+	{12, 2, {117,  56}}, {12, 2, {117,  57}}, {12, 2, {117,  61}},
+	{12, 2, {117,  65}}, {12, 2, {117,  95}}, {12, 2, {117,  98}},
+	{12, 2, {117, 100}}, {12, 2, {117, 102}}, {12, 2, {117, 103}},
+	{12, 2, {117, 104}}, {12, 2, {117, 108}}, {12, 2, {117, 109}},
+	{12, 2, {117, 110}}, {12, 2, {117, 112}}, {12, 2, {117, 114}},
+	{12, 2, {117, 117}}, { 6, 1, {117,   0}}, { 6, 1, {117,   0}},
+	{ 6, 1, {117,   0}}, { 6, 1, {117,   0}}, { 6, 1, {117,   0}},
+	{ 6, 1, {117,   0}}, { 6, 1, {117,   0}}, { 6, 1, {117,   0}},
+	{ 6, 1, {117,   0}}, { 6, 1, {117,   0}}, { 6, 1, {117,   0}},
+	{ 6, 1, {117,   0}}, { 6, 1, {117,   0}}, { 6, 1, {117,   0}},
+	{ 6, 1, {117,   0}}, { 6, 1, {117,   0}}, { 6, 1, {117,   0}},
+	{ 6, 1, {117,   0}}, {12, 2, { 58,  48}}, {12, 2, { 58,  49}},
+	{12, 2, { 58,  50}}, {12, 2, { 58,  97}}, {12, 2, { 58,  99}},
+	{12, 2, { 58, 101}}, {12, 2, { 58, 105}}, {12, 2, { 58, 111}},
+	{12, 2, { 58, 115}}, {12, 2, { 58, 116}}, { 7, 1, { 58,   0}},
+	{ 7, 1, { 58,   0}}, { 7, 1, { 58,   0}}, { 7, 1, { 58,   0}},
+	{ 7, 1, { 58,   0}}, { 7, 1, { 58,   0}}, { 7, 1, { 58,   0}},
+	{ 7, 1, { 58,   0}}, { 7, 1, { 58,   0}}, { 7, 1, { 58,   0}},
+	{ 7, 1, { 58,   0}}, { 7, 1, { 58,   0}}, { 7, 1, { 58,   0}},
+	{ 7, 1, { 58,   0}}, { 7, 1, { 58,   0}}, { 7, 1, { 58,   0}},
+	{ 7, 1, { 58,   0}}, { 7, 1, { 58,   0}}, { 7, 1, { 58,   0}},
+	{ 7, 1, { 58,   0}}, { 7, 1, { 58,   0}}, { 7, 1, { 58,   0}},
+	{12, 2, { 66,  48}}, {12, 2, { 66,  49}}, {12, 2, { 66,  50}},
+	{12, 2, { 66,  97}}, {12, 2, { 66,  99}}, {12, 2, { 66, 101}},
+	{12, 2, { 66, 105}}, {12, 2, { 66, 111}}, {12, 2, { 66, 115}},
+	{12, 2, { 66, 116}}, { 7, 1, { 66,   0}}, { 7, 1, { 66,   0}},
+	{ 7, 1, { 66,   0}}, { 7, 1, { 66,   0}}, { 7, 1, { 66,   0}},
+	{ 7, 1, { 66,   0}}, { 7, 1, { 66,   0}}, { 7, 1, { 66,   0}},
+	{ 7, 1, { 66,   0}}, { 7, 1, { 66,   0}}, { 7, 1, { 66,   0}},
+	{ 7, 1, { 66,   0}}, { 7, 1, { 66,   0}}, { 7, 1, { 66,   0}},
+	{ 7, 1, { 66,   0}}, { 7, 1, { 66,   0}}, { 7, 1, { 66,   0}},
+	{ 7, 1, { 66,   0}}, { 7, 1, { 66,   0}}, { 7, 1, { 66,   0}},
+	{ 7, 1, { 66,   0}}, { 7, 1, { 66,   0}}, {12, 2, { 67,  48}},
+	{12, 2, { 67,  49}}, {12, 2, { 67,  50}}, {12, 2, { 67,  97}},
+	{12, 2, { 67,  99}}, {12, 2, { 67, 101}}, {12, 2, { 67, 105}},
+	{12, 2, { 67, 111}}, {12, 2, { 67, 115}}, {12, 2, { 67, 116}},
+	{ 7, 1, { 67,   0}}, { 7, 1, { 67,   0}}, { 7, 1, { 67,   0}},
+	{ 7, 1, { 67,   0}}, { 7, 1, { 67,   0}}, { 7, 1, { 67,   0}},
+	{ 7, 1, { 67,   0}}, { 7, 1, { 67,   0}}, { 7, 1, { 67,   0}},
+	{ 7, 1, { 67,   0}}, { 7, 1, { 67,   0}}, { 7, 1, { 67,   0}},
+	{ 7, 1, { 67,   0}}, { 7, 1, { 67,   0}}, { 7, 1, { 67,   0}},
+	{ 7, 1, { 67,   0}}, { 7, 1, { 67,   0}}, { 7, 1, { 67,   0}},
+	{ 7, 1, { 67,   0}}, { 7, 1, { 67,   0}}, { 7, 1, { 67,   0}},
+	{ 7, 1, { 67,   0}}, {12, 2, { 68,  48}}, {12, 2, { 68,  49}},
+	{12, 2, { 68,  50}}, {12, 2, { 68,  97}}, {12, 2, { 68,  99}},
+	{12, 2, { 68, 101}}, {12, 2, { 68, 105}}, {12, 2, { 68, 111}},
+	{12, 2, { 68, 115}}, {12, 2, { 68, 116}}, { 7, 1, { 68,   0}},
+	{ 7, 1, { 68,   0}}, { 7, 1, { 68,   0}}, { 7, 1, { 68,   0}},
+	{ 7, 1, { 68,   0}}, { 7, 1, { 68,   0}}, { 7, 1, { 68,   0}},
+	{ 7, 1, { 68,   0}}, { 7, 1, { 68,   0}}, { 7, 1, { 68,   0}},
+	{ 7, 1, { 68,   0}}, { 7, 1, { 68,   0}}, { 7, 1, { 68,   0}},
+	{ 7, 1, { 68,   0}}, { 7, 1, { 68,   0}}, { 7, 1, { 68,   0}},
+	{ 7, 1, { 68,   0}}, { 7, 1, { 68,   0}}, { 7, 1, { 68,   0}},
+	{ 7, 1, { 68,   0}}, { 7, 1, { 68,   0}}, { 7, 1, { 68,   0}},
+	{12, 2, { 69,  48}}, {12, 2, { 69,  49}}, {12, 2, { 69,  50}},
+	{12, 2, { 69,  97}}, {12, 2, { 69,  99}}, {12, 2, { 69, 101}},
+	{12, 2, { 69, 105}}, {12, 2, { 69, 111}}, {12, 2, { 69, 115}},
+	{12, 2, { 69, 116}}, { 7, 1, { 69,   0}}, { 7, 1, { 69,   0}},
+	{ 7, 1, { 69,   0}}, { 7, 1, { 69,   0}}, { 7, 1, { 69,   0}},
+	{ 7, 1, { 69,   0}}, { 7, 1, { 69,   0}}, { 7, 1, { 69,   0}},
+	{ 7, 1, { 69,   0}}, { 7, 1, { 69,   0}}, { 7, 1, { 69,   0}},
+	{ 7, 1, { 69,   0}}, { 7, 1, { 69,   0}}, { 7, 1, { 69,   0}},
+	{ 7, 1, { 69,   0}}, { 7, 1, { 69,   0}}, { 7, 1, { 69,   0}},
+	{ 7, 1, { 69,   0}}, { 7, 1, { 69,   0}}, { 7, 1, { 69,   0}},
+	{ 7, 1, { 69,   0}}, { 7, 1, { 69,   0}}, {12, 2, { 70,  48}},
+	{12, 2, { 70,  49}}, {12, 2, { 70,  50}}, {12, 2, { 70,  97}},
+	{12, 2, { 70,  99}}, {12, 2, { 70, 101}}, {12, 2, { 70, 105}},
+	{12, 2, { 70, 111}}, {12, 2, { 70, 115}}, {12, 2, { 70, 116}},
+	{ 7, 1, { 70,   0}}, { 7, 1, { 70,   0}}, { 7, 1, { 70,   0}},
+	{ 7, 1, { 70,   0}}, { 7, 1, { 70,   0}}, { 7, 1, { 70,   0}},
+	{ 7, 1, { 70,   0}}, { 7, 1, { 70,   0}}, { 7, 1, { 70,   0}},
+	{ 7, 1, { 70,   0}}, { 7, 1, { 70,   0}}, { 7, 1, { 70,   0}},
+	{ 7, 1, { 70,   0}}, { 7, 1, { 70,   0}}, { 7, 1, { 70,   0}},
+	{ 7, 1, { 70,   0}}, { 7, 1, { 70,   0}}, { 7, 1, { 70,   0}},
+	{ 7, 1, { 70,   0}}, { 7, 1, { 70,   0}}, { 7, 1, { 70,   0}},
+	{ 7, 1, { 70,   0}}, {12, 2, { 71,  48}}, {12, 2, { 71,  49}},
+	{12, 2, { 71,  50}}, {12, 2, { 71,  97}}, {12, 2, { 71,  99}},
+	{12, 2, { 71, 101}}, {12, 2, { 71, 105}}, {12, 2, { 71, 111}},
+	{12, 2, { 71, 115}}, {12, 2, { 71, 116}}, { 7, 1, { 71,   0}},
+	{ 7, 1, { 71,   0}}, { 7, 1, { 71,   0}}, { 7, 1, { 71,   0}},
+	{ 7, 1, { 71,   0}}, { 7, 1, { 71,   0}}, { 7, 1, { 71,   0}},
+	{ 7, 1, { 71,   0}}, { 7, 1, { 71,   0}}, { 7, 1, { 71,   0}},
+	{ 7, 1, { 71,   0}}, { 7, 1, { 71,   0}}, { 7, 1, { 71,   0}},
+	{ 7, 1, { 71,   0}}, { 7, 1, { 71,   0}}, { 7, 1, { 71,   0}},
+	{ 7, 1, { 71,   0}}, { 7, 1, { 71,   0}}, { 7, 1, { 71,   0}},
+	{ 7, 1, { 71,   0}}, { 7, 1, { 71,   0}}, { 7, 1, { 71,   0}},
+	{12, 2, { 72,  48}}, {12, 2, { 72,  49}}, {12, 2, { 72,  50}},
+	{12, 2, { 72,  97}}, {12, 2, { 72,  99}}, {12, 2, { 72, 101}},
+	{12, 2, { 72, 105}}, {12, 2, { 72, 111}}, {12, 2, { 72, 115}},
+	{12, 2, { 72, 116}}, { 7, 1, { 72,   0}}, { 7, 1, { 72,   0}},
+	{ 7, 1, { 72,   0}}, { 7, 1, { 72,   0}}, { 7, 1, { 72,   0}},
+	{ 7, 1, { 72,   0}}, { 7, 1, { 72,   0}}, { 7, 1, { 72,   0}},
+	{ 7, 1, { 72,   0}}, { 7, 1, { 72,   0}}, { 7, 1, { 72,   0}},
+	{ 7, 1, { 72,   0}}, { 7, 1, { 72,   0}}, { 7, 1, { 72,   0}},
+	{ 7, 1, { 72,   0}}, { 7, 1, { 72,   0}}, { 7, 1, { 72,   0}},
+	{ 7, 1, { 72,   0}}, { 7, 1, { 72,   0}}, { 7, 1, { 72,   0}},
+	{ 7, 1, { 72,   0}}, { 7, 1, { 72,   0}}, {12, 2, { 73,  48}},
+	{12, 2, { 73,  49}}, {12, 2, { 73,  50}}, {12, 2, { 73,  97}},
+	{12, 2, { 73,  99}}, {12, 2, { 73, 101}}, {12, 2, { 73, 105}},
+	{12, 2, { 73, 111}}, {12, 2, { 73, 115}}, {12, 2, { 73, 116}},
+	{ 7, 1, { 73,   0}}, { 7, 1, { 73,   0}}, { 7, 1, { 73,   0}},
+	{ 7, 1, { 73,   0}}, { 7, 1, { 73,   0}}, { 7, 1, { 73,   0}},
+	{ 7, 1, { 73,   0}}, { 7, 1, { 73,   0}}, { 7, 1, { 73,   0}},
+	{ 7, 1, { 73,   0}}, { 7, 1, { 73,   0}}, { 7, 1, { 73,   0}},
+	{ 7, 1, { 73,   0}}, { 7, 1, { 73,   0}}, { 7, 1, { 73,   0}},
+	{ 7, 1, { 73,   0}}, { 7, 1, { 73,   0}}, { 7, 1, { 73,   0}},
+	{ 7, 1, { 73,   0}}, { 7, 1, { 73,   0}}, { 7, 1, { 73,   0}},
+	{ 7, 1, { 73,   0}}, {12, 2, { 74,  48}}, {12, 2, { 74,  49}},
+	{12, 2, { 74,  50}}, {12, 2, { 74,  97}}, {12, 2, { 74,  99}},
+	{12, 2, { 74, 101}}, {12, 2, { 74, 105}}, {12, 2, { 74, 111}},
+	{12, 2, { 74, 115}}, {12, 2, { 74, 116}}, { 7, 1, { 74,   0}},
+	{ 7, 1, { 74,   0}}, { 7, 1, { 74,   0}}, { 7, 1, { 74,   0}},
+	{ 7, 1, { 74,   0}}, { 7, 1, { 74,   0}}, { 7, 1, { 74,   0}},
+	{ 7, 1, { 74,   0}}, { 7, 1, { 74,   0}}, { 7, 1, { 74,   0}},
+	{ 7, 1, { 74,   0}}, { 7, 1, { 74,   0}}, { 7, 1, { 74,   0}},
+	{ 7, 1, { 74,   0}}, { 7, 1, { 74,   0}}, { 7, 1, { 74,   0}},
+	{ 7, 1, { 74,   0}}, { 7, 1, { 74,   0}}, { 7, 1, { 74,   0}},
+	{ 7, 1, { 74,   0}}, { 7, 1, { 74,   0}}, { 7, 1, { 74,   0}},
+	{12, 2, { 75,  48}}, {12, 2, { 75,  49}}, {12, 2, { 75,  50}},
+	{12, 2, { 75,  97}}, {12, 2, { 75,  99}}, {12, 2, { 75, 101}},
+	{12, 2, { 75, 105}}, {12, 2, { 75, 111}}, {12, 2, { 75, 115}},
+	{12, 2, { 75, 116}}, { 7, 1, { 75,   0}}, { 7, 1, { 75,   0}},
+	{ 7, 1, { 75,   0}}, { 7, 1, { 75,   0}}, { 7, 1, { 75,   0}},
+	{ 7, 1, { 75,   0}}, { 7, 1, { 75,   0}}, { 7, 1, { 75,   0}},
+	{ 7, 1, { 75,   0}}, { 7, 1, { 75,   0}}, { 7, 1, { 75,   0}},
+	{ 7, 1, { 75,   0}}, { 7, 1, { 75,   0}}, { 7, 1, { 75,   0}},
+	{ 7, 1, { 75,   0}}, { 7, 1, { 75,   0}}, { 7, 1, { 75,   0}},
+	{ 7, 1, { 75,   0}}, { 7, 1, { 75,   0}}, { 7, 1, { 75,   0}},
+	{ 7, 1, { 75,   0}}, { 7, 1, { 75,   0}}, {12, 2, { 76,  48}},
+	{12, 2, { 76,  49}}, {12, 2, { 76,  50}}, {12, 2, { 76,  97}},
+	{12, 2, { 76,  99}}, {12, 2, { 76, 101}}, {12, 2, { 76, 105}},
+	{12, 2, { 76, 111}}, {12, 2, { 76, 115}}, {12, 2, { 76, 116}},
+	{ 7, 1, { 76,   0}}, { 7, 1, { 76,   0}}, { 7, 1, { 76,   0}},
+	{ 7, 1, { 76,   0}}, { 7, 1, { 76,   0}}, { 7, 1, { 76,   0}},
+	{ 7, 1, { 76,   0}}, { 7, 1, { 76,   0}}, { 7, 1, { 76,   0}},
+	{ 7, 1, { 76,   0}}, { 7, 1, { 76,   0}}, { 7, 1, { 76,   0}},
+	{ 7, 1, { 76,   0}}, { 7, 1, { 76,   0}}, { 7, 1, { 76,   0}},
+	{ 7, 1, { 76,   0}}, { 7, 1, { 76,   0}}, { 7, 1, { 76,   0}},
+	{ 7, 1, { 76,   0}}, { 7, 1, { 76,   0}}, { 7, 1, { 76,   0}},
+	{ 7, 1, { 76,   0}}, {12, 2, { 77,  48}}, {12, 2, { 77,  49}},
+	{12, 2, { 77,  50}}, {12, 2, { 77,  97}}, {12, 2, { 77,  99}},
+	{12, 2, { 77, 101}}, {12, 2, { 77, 105}}, {12, 2, { 77, 111}},
+	{12, 2, { 77, 115}}, {12, 2, { 77, 116}}, { 7, 1, { 77,   0}},
+	{ 7, 1, { 77,   0}}, { 7, 1, { 77,   0}}, { 7, 1, { 77,   0}},
+	{ 7, 1, { 77,   0}}, { 7, 1, { 77,   0}}, { 7, 1, { 77,   0}},
+	{ 7, 1, { 77,   0}}, { 7, 1, { 77,   0}}, { 7, 1, { 77,   0}},
+	{ 7, 1, { 77,   0}}, { 7, 1, { 77,   0}}, { 7, 1, { 77,   0}},
+	{ 7, 1, { 77,   0}}, { 7, 1, { 77,   0}}, { 7, 1, { 77,   0}},
+	{ 7, 1, { 77,   0}}, { 7, 1, { 77,   0}}, { 7, 1, { 77,   0}},
+	{ 7, 1, { 77,   0}}, { 7, 1, { 77,   0}}, { 7, 1, { 77,   0}},
+	{12, 2, { 78,  48}}, {12, 2, { 78,  49}}, {12, 2, { 78,  50}},
+	{12, 2, { 78,  97}}, {12, 2, { 78,  99}}, {12, 2, { 78, 101}},
+	{12, 2, { 78, 105}}, {12, 2, { 78, 111}}, {12, 2, { 78, 115}},
+	{12, 2, { 78, 116}}, { 7, 1, { 78,   0}}, { 7, 1, { 78,   0}},
+	{ 7, 1, { 78,   0}}, { 7, 1, { 78,   0}}, { 7, 1, { 78,   0}},
+	{ 7, 1, { 78,   0}}, { 7, 1, { 78,   0}}, { 7, 1, { 78,   0}},
+	{ 7, 1, { 78,   0}}, { 7, 1, { 78,   0}}, { 7, 1, { 78,   0}},
+	{ 7, 1, { 78,   0}}, { 7, 1, { 78,   0}}, { 7, 1, { 78,   0}},
+	{ 7, 1, { 78,   0}}, { 7, 1, { 78,   0}}, { 7, 1, { 78,   0}},
+	{ 7, 1, { 78,   0}}, { 7, 1, { 78,   0}}, { 7, 1, { 78,   0}},
+	{ 7, 1, { 78,   0}}, { 7, 1, { 78,   0}}, {12, 2, { 79,  48}},
+	{12, 2, { 79,  49}}, {12, 2, { 79,  50}}, {12, 2, { 79,  97}},
+	{12, 2, { 79,  99}}, {12, 2, { 79, 101}}, {12, 2, { 79, 105}},
+	{12, 2, { 79, 111}}, {12, 2, { 79, 115}}, {12, 2, { 79, 116}},
+	{ 7, 1, { 79,   0}}, { 7, 1, { 79,   0}}, { 7, 1, { 79,   0}},
+	{ 7, 1, { 79,   0}}, { 7, 1, { 79,   0}}, { 7, 1, { 79,   0}},
+	{ 7, 1, { 79,   0}}, { 7, 1, { 79,   0}}, { 7, 1, { 79,   0}},
+	{ 7, 1, { 79,   0}}, { 7, 1, { 79,   0}}, { 7, 1, { 79,   0}},
+	{ 7, 1, { 79,   0}}, { 7, 1, { 79,   0}}, { 7, 1, { 79,   0}},
+	{ 7, 1, { 79,   0}}, { 7, 1, { 79,   0}}, { 7, 1, { 79,   0}},
+	{ 7, 1, { 79,   0}}, { 7, 1, { 79,   0}}, { 7, 1, { 79,   0}},
+	{ 7, 1, { 79,   0}}, {12, 2, { 80,  48}}, {12, 2, { 80,  49}},
+	{12, 2, { 80,  50}}, {12, 2, { 80,  97}}, {12, 2, { 80,  99}},
+	{12, 2, { 80, 101}}, {12, 2, { 80, 105}}, {12, 2, { 80, 111}},
+	{12, 2, { 80, 115}}, {12, 2, { 80, 116}}, { 7, 1, { 80,   0}},
+	{ 7, 1, { 80,   0}}, { 7, 1, { 80,   0}}, { 7, 1, { 80,   0}},
+	{ 7, 1, { 80,   0}}, { 7, 1, { 80,   0}}, { 7, 1, { 80,   0}},
+	{ 7, 1, { 80,   0}}, { 7, 1, { 80,   0}}, { 7, 1, { 80,   0}},
+	{ 7, 1, { 80,   0}}, { 7, 1, { 80,   0}}, { 7, 1, { 80,   0}},
+	{ 7, 1, { 80,   0}}, { 7, 1, { 80,   0}}, { 7, 1, { 80,   0}},
+	{ 7, 1, { 80,   0}}, { 7, 1, { 80,   0}}, { 7, 1, { 80,   0}},
+	{ 7, 1, { 80,   0}}, { 7, 1, { 80,   0}}, { 7, 1, { 80,   0}},
+	{12, 2, { 81,  48}}, {12, 2, { 81,  49}}, {12, 2, { 81,  50}},
+	{12, 2, { 81,  97}}, {12, 2, { 81,  99}}, {12, 2, { 81, 101}},
+	{12, 2, { 81, 105}}, {12, 2, { 81, 111}}, {12, 2, { 81, 115}},
+	{12, 2, { 81, 116}}, { 7, 1, { 81,   0}}, { 7, 1, { 81,   0}},
+	{ 7, 1, { 81,   0}}, { 7, 1, { 81,   0}}, { 7, 1, { 81,   0}},
+	{ 7, 1, { 81,   0}}, { 7, 1, { 81,   0}}, { 7, 1, { 81,   0}},
+	{ 7, 1, { 81,   0}}, { 7, 1, { 81,   0}}, { 7, 1, { 81,   0}},
+	{ 7, 1, { 81,   0}}, { 7, 1, { 81,   0}}, { 7, 1, { 81,   0}},
+	{ 7, 1, { 81,   0}}, { 7, 1, { 81,   0}}, { 7, 1, { 81,   0}},
+	{ 7, 1, { 81,   0}}, { 7, 1, { 81,   0}}, { 7, 1, { 81,   0}},
+	{ 7, 1, { 81,   0}}, { 7, 1, { 81,   0}}, {12, 2, { 82,  48}},
+	{12, 2, { 82,  49}}, {12, 2, { 82,  50}}, {12, 2, { 82,  97}},
+	{12, 2, { 82,  99}}, {12, 2, { 82, 101}}, {12, 2, { 82, 105}},
+	{12, 2, { 82, 111}}, {12, 2, { 82, 115}}, {12, 2, { 82, 116}},
+	{ 7, 1, { 82,   0}}, { 7, 1, { 82,   0}}, { 7, 1, { 82,   0}},
+	{ 7, 1, { 82,   0}}, { 7, 1, { 82,   0}}, { 7, 1, { 82,   0}},
+	{ 7, 1, { 82,   0}}, { 7, 1, { 82,   0}}, { 7, 1, { 82,   0}},
+	{ 7, 1, { 82,   0}}, { 7, 1, { 82,   0}}, { 7, 1, { 82,   0}},
+	{ 7, 1, { 82,   0}}, { 7, 1, { 82,   0}}, { 7, 1, { 82,   0}},
+	{ 7, 1, { 82,   0}}, { 7, 1, { 82,   0}}, { 7, 1, { 82,   0}},
+	{ 7, 1, { 82,   0}}, { 7, 1, { 82,   0}}, { 7, 1, { 82,   0}},
+	{ 7, 1, { 82,   0}}, {12, 2, { 83,  48}}, {12, 2, { 83,  49}},
+	{12, 2, { 83,  50}}, {12, 2, { 83,  97}}, {12, 2, { 83,  99}},
+	{12, 2, { 83, 101}}, {12, 2, { 83, 105}}, {12, 2, { 83, 111}},
+	{12, 2, { 83, 115}}, {12, 2, { 83, 116}}, { 7, 1, { 83,   0}},
+	{ 7, 1, { 83,   0}}, { 7, 1, { 83,   0}}, { 7, 1, { 83,   0}},
+	{ 7, 1, { 83,   0}}, { 7, 1, { 83,   0}}, { 7, 1, { 83,   0}},
+	{ 7, 1, { 83,   0}}, { 7, 1, { 83,   0}}, { 7, 1, { 83,   0}},
+	{ 7, 1, { 83,   0}}, { 7, 1, { 83,   0}}, { 7, 1, { 83,   0}},
+	{ 7, 1, { 83,   0}}, { 7, 1, { 83,   0}}, { 7, 1, { 83,   0}},
+	{ 7, 1, { 83,   0}}, { 7, 1, { 83,   0}}, { 7, 1, { 83,   0}},
+	{ 7, 1, { 83,   0}}, { 7, 1, { 83,   0}}, { 7, 1, { 83,   0}},
+	{12, 2, { 84,  48}}, {12, 2, { 84,  49}}, {12, 2, { 84,  50}},
+	{12, 2, { 84,  97}}, {12, 2, { 84,  99}}, {12, 2, { 84, 101}},
+	{12, 2, { 84, 105}}, {12, 2, { 84, 111}}, {12, 2, { 84, 115}},
+	{12, 2, { 84, 116}}, { 7, 1, { 84,   0}}, { 7, 1, { 84,   0}},
+	{ 7, 1, { 84,   0}}, { 7, 1, { 84,   0}}, { 7, 1, { 84,   0}},
+	{ 7, 1, { 84,   0}}, { 7, 1, { 84,   0}}, { 7, 1, { 84,   0}},
+	{ 7, 1, { 84,   0}}, { 7, 1, { 84,   0}}, { 7, 1, { 84,   0}},
+	{ 7, 1, { 84,   0}}, { 7, 1, { 84,   0}}, { 7, 1, { 84,   0}},
+	{ 7, 1, { 84,   0}}, { 7, 1, { 84,   0}}, { 7, 1, { 84,   0}},
+	{ 7, 1, { 84,   0}}, { 7, 1, { 84,   0}}, { 7, 1, { 84,   0}},
+	{ 7, 1, { 84,   0}}, { 7, 1, { 84,   0}}, {12, 2, { 85,  48}},
+	{12, 2, { 85,  49}}, {12, 2, { 85,  50}}, {12, 2, { 85,  97}},
+	{12, 2, { 85,  99}}, {12, 2, { 85, 101}}, {12, 2, { 85, 105}},
+	{12, 2, { 85, 111}}, {12, 2, { 85, 115}}, {12, 2, { 85, 116}},
+	{ 7, 1, { 85,   0}}, { 7, 1, { 85,   0}}, { 7, 1, { 85,   0}},
+	{ 7, 1, { 85,   0}}, { 7, 1, { 85,   0}}, { 7, 1, { 85,   0}},
+	{ 7, 1, { 85,   0}}, { 7, 1, { 85,   0}}, { 7, 1, { 85,   0}},
+	{ 7, 1, { 85,   0}}, { 7, 1, { 85,   0}}, { 7, 1, { 85,   0}},
+	{ 7, 1, { 85,   0}}, { 7, 1, { 85,   0}}, { 7, 1, { 85,   0}},
+	{ 7, 1, { 85,   0}}, { 7, 1, { 85,   0}}, { 7, 1, { 85,   0}},
+	{ 7, 1, { 85,   0}}, { 7, 1, { 85,   0}}, { 7, 1, { 85,   0}},
+	{ 7, 1, { 85,   0}}, {12, 2, { 86,  48}}, {12, 2, { 86,  49}},
+	{12, 2, { 86,  50}}, {12, 2, { 86,  97}}, {12, 2, { 86,  99}},
+	{12, 2, { 86, 101}}, {12, 2, { 86, 105}}, {12, 2, { 86, 111}},
+	{12, 2, { 86, 115}}, {12, 2, { 86, 116}}, { 7, 1, { 86,   0}},
+	{ 7, 1, { 86,   0}}, { 7, 1, { 86,   0}}, { 7, 1, { 86,   0}},
+	{ 7, 1, { 86,   0}}, { 7, 1, { 86,   0}}, { 7, 1, { 86,   0}},
+	{ 7, 1, { 86,   0}}, { 7, 1, { 86,   0}}, { 7, 1, { 86,   0}},
+	{ 7, 1, { 86,   0}}, { 7, 1, { 86,   0}}, { 7, 1, { 86,   0}},
+	{ 7, 1, { 86,   0}}, { 7, 1, { 86,   0}}, { 7, 1, { 86,   0}},
+	{ 7, 1, { 86,   0}}, { 7, 1, { 86,   0}}, { 7, 1, { 86,   0}},
+	{ 7, 1, { 86,   0}}, { 7, 1, { 86,   0}}, { 7, 1, { 86,   0}},
+	{12, 2, { 87,  48}}, {12, 2, { 87,  49}}, {12, 2, { 87,  50}},
+	{12, 2, { 87,  97}}, {12, 2, { 87,  99}}, {12, 2, { 87, 101}},
+	{12, 2, { 87, 105}}, {12, 2, { 87, 111}}, {12, 2, { 87, 115}},
+	{12, 2, { 87, 116}}, { 7, 1, { 87,   0}}, { 7, 1, { 87,   0}},
+	{ 7, 1, { 87,   0}}, { 7, 1, { 87,   0}}, { 7, 1, { 87,   0}},
+	{ 7, 1, { 87,   0}}, { 7, 1, { 87,   0}}, { 7, 1, { 87,   0}},
+	{ 7, 1, { 87,   0}}, { 7, 1, { 87,   0}}, { 7, 1, { 87,   0}},
+	{ 7, 1, { 87,   0}}, { 7, 1, { 87,   0}}, { 7, 1, { 87,   0}},
+	{ 7, 1, { 87,   0}}, { 7, 1, { 87,   0}}, { 7, 1, { 87,   0}},
+	{ 7, 1, { 87,   0}}, { 7, 1, { 87,   0}}, { 7, 1, { 87,   0}},
+	{ 7, 1, { 87,   0}}, { 7, 1, { 87,   0}}, {12, 2, { 89,  48}},
+	{12, 2, { 89,  49}}, {12, 2, { 89,  50}}, {12, 2, { 89,  97}},
+	{12, 2, { 89,  99}}, {12, 2, { 89, 101}}, {12, 2, { 89, 105}},
+	{12, 2, { 89, 111}}, {12, 2, { 89, 115}}, {12, 2, { 89, 116}},
+	{ 7, 1, { 89,   0}}, { 7, 1, { 89,   0}}, { 7, 1, { 89,   0}},
+	{ 7, 1, { 89,   0}}, { 7, 1, { 89,   0}}, { 7, 1, { 89,   0}},
+	{ 7, 1, { 89,   0}}, { 7, 1, { 89,   0}}, { 7, 1, { 89,   0}},
+	{ 7, 1, { 89,   0}}, { 7, 1, { 89,   0}}, { 7, 1, { 89,   0}},
+	{ 7, 1, { 89,   0}}, { 7, 1, { 89,   0}}, { 7, 1, { 89,   0}},
+	{ 7, 1, { 89,   0}}, { 7, 1, { 89,   0}}, { 7, 1, { 89,   0}},
+	{ 7, 1, { 89,   0}}, { 7, 1, { 89,   0}}, { 7, 1, { 89,   0}},
+	{ 7, 1, { 89,   0}}, {12, 2, {106,  48}}, {12, 2, {106,  49}},
+	{12, 2, {106,  50}}, {12, 2, {106,  97}}, {12, 2, {106,  99}},
+	{12, 2, {106, 101}}, {12, 2, {106, 105}}, {12, 2, {106, 111}},
+	{12, 2, {106, 115}}, {12, 2, {106, 116}}, { 7, 1, {106,   0}},
+	{ 7, 1, {106,   0}}, { 7, 1, {106,   0}}, { 7, 1, {106,   0}},
+	{ 7, 1, {106,   0}}, { 7, 1, {106,   0}}, { 7, 1, {106,   0}},
+	{ 7, 1, {106,   0}}, { 7, 1, {106,   0}}, { 7, 1, {106,   0}},
+	{ 7, 1, {106,   0}}, { 7, 1, {106,   0}}, { 7, 1, {106,   0}},
+	{ 7, 1, {106,   0}}, { 7, 1, {106,   0}}, { 7, 1, {106,   0}},
+	{ 7, 1, {106,   0}}, { 7, 1, {106,   0}}, { 7, 1, {106,   0}},
+	{ 7, 1, {106,   0}}, { 7, 1, {106,   0}}, { 7, 1, {106,   0}},
+	{12, 2, {107,  48}}, {12, 2, {107,  49}}, {12, 2, {107,  50}},
+	{12, 2, {107,  97}}, {12, 2, {107,  99}}, {12, 2, {107, 101}},
+	{12, 2, {107, 105}}, {12, 2, {107, 111}}, {12, 2, {107, 115}},
+	{12, 2, {107, 116}}, { 7, 1, {107,   0}}, { 7, 1, {107,   0}},
+	{ 7, 1, {107,   0}}, { 7, 1, {107,   0}}, { 7, 1, {107,   0}},
+	{ 7, 1, {107,   0}}, { 7, 1, {107,   0}}, { 7, 1, {107,   0}},
+	{ 7, 1, {107,   0}}, { 7, 1, {107,   0}}, { 7, 1, {107,   0}},
+	{ 7, 1, {107,   0}}, { 7, 1, {107,   0}}, { 7, 1, {107,   0}},
+	{ 7, 1, {107,   0}}, { 7, 1, {107,   0}}, { 7, 1, {107,   0}},
+	{ 7, 1, {107,   0}}, { 7, 1, {107,   0}}, { 7, 1, {107,   0}},
+	{ 7, 1, {107,   0}}, { 7, 1, {107,   0}}, {12, 2, {113,  48}},
+	{12, 2, {113,  49}}, {12, 2, {113,  50}}, {12, 2, {113,  97}},
+	{12, 2, {113,  99}}, {12, 2, {113, 101}}, {12, 2, {113, 105}},
+	{12, 2, {113, 111}}, {12, 2, {113, 115}}, {12, 2, {113, 116}},
+	{ 7, 1, {113,   0}}, { 7, 1, {113,   0}}, { 7, 1, {113,   0}},
+	{ 7, 1, {113,   0}}, { 7, 1, {113,   0}}, { 7, 1, {113,   0}},
+	{ 7, 1, {113,   0}}, { 7, 1, {113,   0}}, { 7, 1, {113,   0}},
+	{ 7, 1, {113,   0}}, { 7, 1, {113,   0}}, { 7, 1, {113,   0}},
+	{ 7, 1, {113,   0}}, { 7, 1, {113,   0}}, { 7, 1, {113,   0}},
+	{ 7, 1, {113,   0}}, { 7, 1, {113,   0}}, { 7, 1, {113,   0}},
+	{ 7, 1, {113,   0}}, { 7, 1, {113,   0}}, { 7, 1, {113,   0}},
+	{ 7, 1, {113,   0}}, {12, 2, {118,  48}}, {12, 2, {118,  49}},
+	{12, 2, {118,  50}}, {12, 2, {118,  97}}, {12, 2, {118,  99}},
+	{12, 2, {118, 101}}, {12, 2, {118, 105}}, {12, 2, {118, 111}},
+	{12, 2, {118, 115}}, {12, 2, {118, 116}}, { 7, 1, {118,   0}},
+	{ 7, 1, {118,   0}}, { 7, 1, {118,   0}}, { 7, 1, {118,   0}},
+	{ 7, 1, {118,   0}}, { 7, 1, {118,   0}}, { 7, 1, {118,   0}},
+	{ 7, 1, {118,   0}}, { 7, 1, {118,   0}}, { 7, 1, {118,   0}},
+	{ 7, 1, {118,   0}}, { 7, 1, {118,   0}}, { 7, 1, {118,   0}},
+	{ 7, 1, {118,   0}}, { 7, 1, {118,   0}}, { 7, 1, {118,   0}},
+	{ 7, 1, {118,   0}}, { 7, 1, {118,   0}}, { 7, 1, {118,   0}},
+	{ 7, 1, {118,   0}}, { 7, 1, {118,   0}}, { 7, 1, {118,   0}},
+	{12, 2, {119,  48}}, {12, 2, {119,  49}}, {12, 2, {119,  50}},
+	{12, 2, {119,  97}}, {12, 2, {119,  99}}, {12, 2, {119, 101}},
+	{12, 2, {119, 105}}, {12, 2, {119, 111}}, {12, 2, {119, 115}},
+	{12, 2, {119, 116}}, { 7, 1, {119,   0}}, { 7, 1, {119,   0}},
+	{ 7, 1, {119,   0}}, { 7, 1, {119,   0}}, { 7, 1, {119,   0}},
+	{ 7, 1, {119,   0}}, { 7, 1, {119,   0}}, { 7, 1, {119,   0}},
+	{ 7, 1, {119,   0}}, { 7, 1, {119,   0}}, { 7, 1, {119,   0}},
+	{ 7, 1, {119,   0}}, { 7, 1, {119,   0}}, { 7, 1, {119,   0}},
+	{ 7, 1, {119,   0}}, { 7, 1, {119,   0}}, { 7, 1, {119,   0}},
+	{ 7, 1, {119,   0}}, { 7, 1, {119,   0}}, { 7, 1, {119,   0}},
+	{ 7, 1, {119,   0}}, { 7, 1, {119,   0}}, {12, 2, {120,  48}},
+	{12, 2, {120,  49}}, {12, 2, {120,  50}}, {12, 2, {120,  97}},
+	{12, 2, {120,  99}}, {12, 2, {120, 101}}, {12, 2, {120, 105}},
+	{12, 2, {120, 111}}, {12, 2, {120, 115}}, {12, 2, {120, 116}},
+	{ 7, 1, {120,   0}}, { 7, 1, {120,   0}}, { 7, 1, {120,   0}},
+	{ 7, 1, {120,   0}}, { 7, 1, {120,   0}}, { 7, 1, {120,   0}},
+	{ 7, 1, {120,   0}}, { 7, 1, {120,   0}}, { 7, 1, {120,   0}},
+	{ 7, 1, {120,   0}}, { 7, 1, {120,   0}}, { 7, 1, {120,   0}},
+	{ 7, 1, {120,   0}}, { 7, 1, {120,   0}}, { 7, 1, {120,   0}},
+	{ 7, 1, {120,   0}}, { 7, 1, {120,   0}}, { 7, 1, {120,   0}},
+	{ 7, 1, {120,   0}}, { 7, 1, {120,   0}}, { 7, 1, {120,   0}},
+	{ 7, 1, {120,   0}}, {12, 2, {121,  48}}, {12, 2, {121,  49}},
+	{12, 2, {121,  50}}, {12, 2, {121,  97}}, {12, 2, {121,  99}},
+	{12, 2, {121, 101}}, {12, 2, {121, 105}}, {12, 2, {121, 111}},
+	{12, 2, {121, 115}}, {12, 2, {121, 116}}, { 7, 1, {121,   0}},
+	{ 7, 1, {121,   0}}, { 7, 1, {121,   0}}, { 7, 1, {121,   0}},
+	{ 7, 1, {121,   0}}, { 7, 1, {121,   0}}, { 7, 1, {121,   0}},
+	{ 7, 1, {121,   0}}, { 7, 1, {121,   0}}, { 7, 1, {121,   0}},
+	{ 7, 1, {121,   0}}, { 7, 1, {121,   0}}, { 7, 1, {121,   0}},
+	{ 7, 1, {121,   0}}, { 7, 1, {121,   0}}, { 7, 1, {121,   0}},
+	{ 7, 1, {121,   0}}, { 7, 1, {121,   0}}, { 7, 1, {121,   0}},
+	{ 7, 1, {121,   0}}, { 7, 1, {121,   0}}, { 7, 1, {121,   0}},
+	{12, 2, {122,  48}}, {12, 2, {122,  49}}, {12, 2, {122,  50}},
+	{12, 2, {122,  97}}, {12, 2, {122,  99}}, {12, 2, {122, 101}},
+	{12, 2, {122, 105}}, {12, 2, {122, 111}}, {12, 2, {122, 115}},
+	{12, 2, {122, 116}}, { 7, 1, {122,   0}}, { 7, 1, {122,   0}},
+	{ 7, 1, {122,   0}}, { 7, 1, {122,   0}}, { 7, 1, {122,   0}},
+	{ 7, 1, {122,   0}}, { 7, 1, {122,   0}}, { 7, 1, {122,   0}},
+	{ 7, 1, {122,   0}}, { 7, 1, {122,   0}}, { 7, 1, {122,   0}},
+	{ 7, 1, {122,   0}}, { 7, 1, {122,   0}}, { 7, 1, {122,   0}},
+	{ 7, 1, {122,   0}}, { 7, 1, {122,   0}}, { 7, 1, {122,   0}},
+	{ 7, 1, {122,   0}}, { 7, 1, {122,   0}}, { 7, 1, {122,   0}},
+	{ 7, 1, {122,   0}}, { 7, 1, {122,   0}}, { 8, 1, { 38,   0}},
+	{ 8, 1, { 38,   0}}, { 8, 1, { 38,   0}}, { 8, 1, { 38,   0}},
+	{ 8, 1, { 38,   0}}, { 8, 1, { 38,   0}}, { 8, 1, { 38,   0}},
+	{ 8, 1, { 38,   0}}, { 8, 1, { 38,   0}}, { 8, 1, { 38,   0}},
+	{ 8, 1, { 38,   0}}, { 8, 1, { 38,   0}}, { 8, 1, { 38,   0}},
+	{ 8, 1, { 38,   0}}, { 8, 1, { 38,   0}}, { 8, 1, { 38,   0}},
+	{ 8, 1, { 42,   0}}, { 8, 1, { 42,   0}}, { 8, 1, { 42,   0}},
+	{ 8, 1, { 42,   0}}, { 8, 1, { 42,   0}}, { 8, 1, { 42,   0}},
+	{ 8, 1, { 42,   0}}, { 8, 1, { 42,   0}}, { 8, 1, { 42,   0}},
+	{ 8, 1, { 42,   0}}, { 8, 1, { 42,   0}}, { 8, 1, { 42,   0}},
+	{ 8, 1, { 42,   0}}, { 8, 1, { 42,   0}}, { 8, 1, { 42,   0}},
+	{ 8, 1, { 42,   0}}, { 8, 1, { 44,   0}}, { 8, 1, { 44,   0}},
+	{ 8, 1, { 44,   0}}, { 8, 1, { 44,   0}}, { 8, 1, { 44,   0}},
+	{ 8, 1, { 44,   0}}, { 8, 1, { 44,   0}}, { 8, 1, { 44,   0}},
+	{ 8, 1, { 44,   0}}, { 8, 1, { 44,   0}}, { 8, 1, { 44,   0}},
+	{ 8, 1, { 44,   0}}, { 8, 1, { 44,   0}}, { 8, 1, { 44,   0}},
+	{ 8, 1, { 44,   0}}, { 8, 1, { 44,   0}}, { 8, 1, { 59,   0}},
+	{ 8, 1, { 59,   0}}, { 8, 1, { 59,   0}}, { 8, 1, { 59,   0}},
+	{ 8, 1, { 59,   0}}, { 8, 1, { 59,   0}}, { 8, 1, { 59,   0}},
+	{ 8, 1, { 59,   0}}, { 8, 1, { 59,   0}}, { 8, 1, { 59,   0}},
+	{ 8, 1, { 59,   0}}, { 8, 1, { 59,   0}}, { 8, 1, { 59,   0}},
+	{ 8, 1, { 59,   0}}, { 8, 1, { 59,   0}}, { 8, 1, { 59,   0}},
+	{ 8, 1, { 88,   0}}, { 8, 1, { 88,   0}}, { 8, 1, { 88,   0}},
+	{ 8, 1, { 88,   0}}, { 8, 1, { 88,   0}}, { 8, 1, { 88,   0}},
+	{ 8, 1, { 88,   0}}, { 8, 1, { 88,   0}}, { 8, 1, { 88,   0}},
+	{ 8, 1, { 88,   0}}, { 8, 1, { 88,   0}}, { 8, 1, { 88,   0}},
+	{ 8, 1, { 88,   0}}, { 8, 1, { 88,   0}}, { 8, 1, { 88,   0}},
+	{ 8, 1, { 88,   0}}, { 8, 1, { 90,   0}}, { 8, 1, { 90,   0}},
+	{ 8, 1, { 90,   0}}, { 8, 1, { 90,   0}}, { 8, 1, { 90,   0}},
+	{ 8, 1, { 90,   0}}, { 8, 1, { 90,   0}}, { 8, 1, { 90,   0}},
+	{ 8, 1, { 90,   0}}, { 8, 1, { 90,   0}}, { 8, 1, { 90,   0}},
+	{ 8, 1, { 90,   0}}, { 8, 1, { 90,   0}}, { 8, 1, { 90,   0}},
+	{ 8, 1, { 90,   0}}, { 8, 1, { 90,   0}}, {10, 1, { 33,   0}},
+	{10, 1, { 33,   0}}, {10, 1, { 33,   0}}, {10, 1, { 33,   0}},
+	{10, 1, { 34,   0}}, {10, 1, { 34,   0}}, {10, 1, { 34,   0}},
+	{10, 1, { 34,   0}}, {10, 1, { 40,   0}}, {10, 1, { 40,   0}},
+	{10, 1, { 40,   0}}, {10, 1, { 40,   0}}, {10, 1, { 41,   0}},
+	{10, 1, { 41,   0}}, {10, 1, { 41,   0}}, {10, 1, { 41,   0}},
+	{10, 1, { 63,   0}}, {10, 1, { 63,   0}}, {10, 1, { 63,   0}},
+	{10, 1, { 63,   0}}, {11, 1, { 39,   0}}, {11, 1, { 39,   0}},
+	{11, 1, { 43,   0}}, {11, 1, { 43,   0}}, {11, 1, {124,   0}},
+	{11, 1, {124,   0}}, {12, 1, { 35,   0}}, {12, 1, { 62,   0}},
+	{ 0, 0, {  0,   0}}, { 0, 0, {  0,   0}}, { 0, 0, {  0,   0}},
+	{ 0, 0, {  0,   0}}
+};
+
 #endif /* __TFW_HTTP_HPACK_TBL_H__ */
@@ -86,9 +86,12 @@
 #include <linux/vmalloc.h>
 #include <linux/sort.h>
 #include <linux/bsearch.h>
+#include <linux/random.h>
 
 #include "lib/hash.h"
 #include "lib/str.h"
+#include "access_log.h"
+#include "http_bpf.h"
 #include "cache.h"
 #include "hash.h"
 #include "http_limits.h"
@@ -103,6 +106,8 @@
 #include "server.h"
 #include "tls.h"
 #include "apm.h"
+#define CREATE_TRACE_POINTS
+#include "http_trace.h"
 
 #include "sync_socket.h"
 #include "lib/common.h"
@@ -122,6 +127,17 @@
 
 static DEFINE_PER_CPU(char[RESP_BUF_LEN], g_buf);
 int ghprio; /* GFSM hook priority. */
+/* Collect statistics of request processing stages durations. */
+static bool tfw_http_stage_stats __read_mostly;
+/* Minimum received body size to start response streaming, 0 to disable. */
+static int tfw_http_resp_stream_thr __read_mostly;
+/* Limits of data queued to client connections, 0 means no limit. */
+static int tfw_http_cli_buf_limit __read_mostly;
+static long tfw_http_cli_buf_total __read_mostly;
+/* Backlog of the CPU to start shedding of low priority requests at. */
+static int tfw_http_shed_backlog __read_mostly;
+/* Bodies length pushed to an HTTP/2 connection, 0 to disable the push. */
+static int tfw_h2_push_budget __read_mostly;
 
 #define TFW_CFG_BLK_DEF		(TFW_BLK_ERR_REPLY)
 unsigned short tfw_blk_flags = TFW_CFG_BLK_DEF;
@@ -136,6 +152,7 @@ static struct {
 #define S_HTTP			"http://"
 #define S_HTTPS			"https://"
 
+#define S_103			"HTTP/1.1 103 Early Hints"
 #define S_200			"HTTP/1.1 200 OK"
 #define S_302			"HTTP/1.1 302 Found"
 #define S_304			"HTTP/1.1 304 Not Modified"
@@ -161,7 +178,6 @@ static struct {
 #define S_F_SERVER		"server: "
 
 
-#define S_V_DATE		"Sun, 06 Nov 1994 08:49:37 GMT"
 #define S_V_CONTENT_LENGTH	"9999"
 #define S_V_CONN_CLOSE		"close"
 #define S_V_CONN_KA		"keep-alive"
@@ -370,11 +386,58 @@ static TfwStr http_5xx_resp_body = {
 	.len = 0,
 };
 
+/*
+ * Bodies of @http_predef_resps copied to shared pages on start, so the
+ * local responses reference the pages instead of copying the bodies.
+ */
+static TfwHttpSharedBody http_predef_bodies[RESP_NUM];
+
+/*
+ * Headers of the local responses are built once a second on each CPU for
+ * each response code and protocol, so a response, e.g. blocking a flood,
+ * costs only copying of the headers block and referencing the body pages.
+ * Only the HTTP/2 stream id differs in responses of the same second, and
+ * it lives in the frame headers.
+ *
+ * The HTTP/1 templates differ by Connection header. The HTTP/2 templates
+ * don't use the HPACK dynamic index, so they don't depend on a connection.
+ */
+#define TFW_LRESP_MAXLEN	256
+
+enum {
+	TFW_LRESP_H1,
+	TFW_LRESP_H1_KA,
+	TFW_LRESP_H1_CLOSE,
+	TFW_LRESP_H2,
+	TFW_LRESP_NUM
+};
+
+/**
+ * Template of the local response headers.
+ *
+ * @ts		- the time of the Date header;
+ * @gen		- the configuration generation the template is built for;
+ * @len		- length of the headers block;
+ * @buf		- the headers block;
+ */
+typedef struct {
+	time_t		ts;
+	unsigned int	gen;
+	unsigned int	len;
+	char		buf[TFW_LRESP_MAXLEN];
+} TfwLocalRespTmpl;
+
+typedef TfwLocalRespTmpl TfwLocalRespTmpls[RESP_NUM][TFW_LRESP_NUM];
+
+static TfwLocalRespTmpls __percpu *lresp_tmpl;
+/* Incremented on each start to rebuild the templates. */
+static unsigned int lresp_gen;
+
 /*
  * Prepare current date in the format required for HTTP "Date:"
  * header field. See RFC 2616 section 3.3.
  */
-static void
+void
 tfw_http_prep_date_from(char *buf, time_t date)
 {
 	struct tm tm;
@@ -414,15 +477,53 @@ tfw_http_prep_date_from(char *buf, time_t date)
 #undef PRINT_2DIGIT
 }
 
-static inline void
-tfw_http_prep_date(char *buf)
+/**
+ * The Date header value formatted for time @ts and the HPACK representation
+ * of the header with the value, see tfw_http_date().
+ */
+typedef struct {
+	time_t		ts;
+	unsigned int	h2_len;
+	char		h1[SLEN(S_V_DATE)];
+	char		h2[SLEN(S_V_DATE) + HPACK_ENC_HDR_OVERHEAD];
+} TfwHttpDate;
+
+static DEFINE_PER_CPU(TfwHttpDate, g_date);
+
+/*
+ * Almost all the Date headers are built for the current time, so format the
+ * date, and Huffman encode it for HTTP/2, only once a second on each CPU.
+ */
+static const TfwHttpDate *
+tfw_http_date(time_t date)
 {
-	tfw_http_prep_date_from(buf, tfw_current_timestamp());
+	TfwHttpDate *d = this_cpu_ptr(&g_date);
+	TfwStr hdr = {
+		.chunks = (TfwStr []){
+			{ .data = "date", .len = SLEN("date") },
+			{ .data = d->h1, .len = SLEN(S_V_DATE) },
+		},
+		.len = SLEN("date") + SLEN(S_V_DATE),
+		.nchunks = 2,
+		.hpack_idx = 33
+	};
+
+	if (likely(d->ts == date && d->h2_len))
+		return d;
+	tfw_http_prep_date_from(d->h1, date);
+	d->h2_len = tfw_hpack_encode_nodyn(&hdr, d->h2);
+	d->ts = date;
+
+	return d;
 }
 
+static int tfw_h2_make_frames(TfwHttpResp *resp, unsigned int stream_id,
+			      unsigned long h_len, struct sk_buff *body,
+			      bool local_response, bool local_body);
+
 int
 tfw_h2_prep_redirect(TfwHttpResp *resp, unsigned short status, TfwStr *rmark,
-		     TfwStr *cookie, TfwStr *body)
+		     TfwStr *cookie, const TfwHttpSharedBody *body)
 {
 	int r;
 	TfwHPackInt vlen;
@@ -444,12 +545,12 @@ tfw_h2_prep_redirect(TfwHttpResp *resp, unsigned short status, TfwStr *rmark,
 
 	/* Set HTTP/2 ':status' pseudo-header. */
 	mit->start_off = FRAME_HEADER_SIZE;
-	r = tfw_h2_resp_status_write(resp, status, TFW_H2_TRANS_EXPAND, false);
+	r = tfw_h2_resp_status_write(resp, status, false);
 	if (unlikely(r))
 		return r;
 
 	/* Add 'date' header. */
-	r = tfw_h2_add_hdr_date(resp, TFW_H2_TRANS_EXPAND, false);
+	r = tfw_h2_add_hdr_date(resp, false);
 	if (unlikely(r))
 		return r;
 
@@ -519,7 +620,12 @@ tfw_h2_prep_redirect(TfwHttpResp *resp, unsigned short status, TfwStr *rmark,
 	hdrs_len += s_vlen.len + cookie->len;
 	hdrs_len += mit->acc_len;
 
-	return tfw_h2_frame_local_resp(resp, stream_id, hdrs_len, body);
+	r = tfw_h2_make_frames(resp, stream_id, hdrs_len, NULL, true,
+			       body && body->len);
+	if (unlikely(r) || !body)
+		return r;
+
+	return tfw_http_msg_add_shared_body(iter, body, stream_id);
 }
 
 #define S_REDIR_302	S_302 S_CRLF
@@ -535,11 +641,12 @@ tfw_h2_prep_redirect(TfwHttpResp *resp, unsigned short status, TfwStr *rmark,
  * The response redirects the client to the same URI as the original request,
  * but it includes 'Set-Cookie:' header field that sets Tempesta sticky cookie.
  * If JS challenge is enabled, then body contained JS challenge is provided.
- * Body string contains the 'Content-Length' header, CRLF and body itself.
+ * The body is prepared at configuration time and its pages are referenced by
+ * the response, only the headers are built for each response.
  */
 int
 tfw_h1_prep_redirect(TfwHttpResp *resp, unsigned short status, TfwStr *rmark,
-		     TfwStr *cookie, TfwStr *body)
+		     TfwStr *cookie, const TfwHttpSharedBody *body)
 {
 	TfwHttpReq *req = resp->req;
 	size_t data_len;
@@ -562,7 +669,7 @@ tfw_h1_prep_redirect(TfwHttpResp *resp, unsigned short status, TfwStr *rmark,
 	TfwStr h_common_1 = {
 		.chunks = (TfwStr []){
 			{ .data = S_REDIR_P_01, .len = SLEN(S_REDIR_P_01) },
-			{ .data = *this_cpu_ptr(&g_buf), .len = SLEN(S_V_DATE) },
+			{ .len = SLEN(S_V_DATE) },
 			{ .data = S_REDIR_P_02, .len = SLEN(S_REDIR_P_02) }
 		},
 		.len = SLEN(S_REDIR_P_01 S_V_DATE S_REDIR_P_02),
@@ -626,12 +733,12 @@ tfw_h1_prep_redirect(TfwHttpResp *resp, unsigned short status, TfwStr *rmark,
 	data_len += rmark->len;
 	data_len += req->uri_path.len + h_common_2.len + cookie->len;
 	data_len += cookie_crlf->len + c_len_crlf.len;
-	data_len += body ? body->len : 0;
 
 	if (tfw_http_msg_setup((TfwHttpMsg *)resp, &it, data_len, 0))
 		return TFW_BLOCK;
 
-	tfw_http_prep_date(__TFW_STR_CH(&h_common_1, 1)->data);
+	__TFW_STR_CH(&h_common_1, 1)->data =
+		(char *)tfw_http_date(tfw_current_timestamp())->h1;
 
 	ret = tfw_msg_write(&it, rh);
 	ret |= tfw_msg_write(&it, &h_common_1);
@@ -652,8 +759,8 @@ tfw_h1_prep_redirect(TfwHttpResp *resp, unsigned short status, TfwStr *rmark,
 	ret |= tfw_msg_write(&it, cookie);
 	ret |= tfw_msg_write(&it, cookie_crlf);
 	ret |= tfw_msg_write(&it, &c_len_crlf);
-	if (body)
-		ret |= tfw_msg_write(&it, body);
+	if (!ret && body)
+		ret = tfw_http_msg_add_shared_body(&it, body, 0);
 
 	return ret;
 }
@@ -698,6 +805,37 @@ tfw_http_prep_304(TfwHttpReq *req, struct sk_buff **skb_head, TfwMsgIter *it)
 	return 0;
 }
 
+/*
+ * Messages of the same connection usually have similar numbers of headers,
+ * so @conn->hdrs_avg keeps the moving average of the header table usage,
+ * with weight 1/2^TFW_HDRS_AVG_SHIFT of the last message, in fixed point.
+ * New messages get tables large enough for the average to avoid growing
+ * the tables by reallocations while parsing. The table still doubles if
+ * it's exceeded. The average is updated without synchronization: this is
+ * just a hint and a lost update does no harm.
+ */
+#define TFW_HDRS_AVG_SHIFT	2
+#define TFW_HDRS_AVG_MAX	(USHRT_MAX >> TFW_HDRS_AVG_SHIFT)
+/* Do not preallocate more than 128 entries. */
+#define TFW_HDRS_ORDER_MAX	8
+
+static inline unsigned int
+tfw_http_conn_hdrs_order(TfwConn *conn)
+{
+	unsigned int avg = READ_ONCE(conn->hdrs_avg) >> TFW_HDRS_AVG_SHIFT;
+
+	return min(avg / TFW_HTTP_HDR_NUM + 1, (unsigned int)TFW_HDRS_ORDER_MAX);
+}
+
+static inline void
+tfw_http_conn_hdrs_update(TfwConn *conn, TfwHttpHdrTbl *ht)
+{
+	unsigned int avg = READ_ONCE(conn->hdrs_avg);
+	unsigned int n = min(ht->off, (unsigned int)TFW_HDRS_AVG_MAX);
+
+	WRITE_ONCE(conn->hdrs_avg, avg - (avg >> TFW_HDRS_AVG_SHIFT) + n);
+}
+
 /*
  * Free an HTTP message.
  * Also, free the connection instance if there's no more references.
@@ -728,6 +866,9 @@ tfw_http_conn_msg_free(TfwHttpMsg *hm)
 		 */
 		WARN_ON_ONCE((TFW_CONN_TYPE(hm->conn) & Conn_Clnt) && hm->pair);
 
+		if (hm->h_tbl)
+			tfw_http_conn_hdrs_update(hm->conn, hm->h_tbl);
+
 		/*
 		 * Unlink the connection while there is at least one
 		 * reference. Use atomic exchange to avoid races with
@@ -802,6 +943,21 @@ tfw_http_resp_build_error(TfwHttpReq *req)
 	TFW_INC_STAT_BH(clnt.msgs_otherr);
 }
 
+/*
+ * A part of the response to @req is already forwarded to the client, see
+ * tfw_http_resp_stream(), so nothing else can be sent in reply to the
+ * request. Close the client connection to let the client know that the
+ * response is truncated.
+ */
+static bool
+tfw_http_req_streamed_close(TfwHttpReq *req)
+{
+	if (likely(!test_bit(TFW_HTTP_B_REQ_STREAMED, req->flags)))
+		return false;
+	tfw_http_resp_build_error(req);
+	return true;
+}
+
 static inline resp_code_t
 tfw_http_enum_resp_code(int status)
 {
@@ -835,8 +991,7 @@ tfw_http_enum_resp_code(int status)
  * https://httpwg.org/specs/rfc7540.html#rfc.section.8.1.2.4.
  */
 int
-tfw_h2_resp_status_write(TfwHttpResp *resp, unsigned short status,
-			 TfwH2TransOp op, bool cache)
+tfw_h2_resp_status_write(TfwHttpResp *resp, unsigned short status, bool cache)
 {
 	int ret;
 	unsigned short index = tfw_h2_pseudo_index(status);
@@ -851,8 +1006,6 @@ tfw_h2_resp_status_write(TfwHttpResp *resp, unsigned short status,
 		.hpack_idx = index ? index : 8
 	};
 
-	WARN_ON_ONCE(op != TFW_H2_TRANS_EXPAND && op != TFW_H2_TRANS_SUB);
-
 	/*
 	 * If the status code is not in the static table, set the default
 	 * static index just for the ':status' name.
@@ -864,19 +1017,90 @@ tfw_h2_resp_status_write(TfwHttpResp *resp, unsigned short status,
 	if (!tfw_ultoa(status, __TFW_STR_CH(&s_hdr, 1)->data, H2_STAT_VAL_LEN))
 		return -E2BIG;
 
-	if ((ret = tfw_hpack_encode(resp, &s_hdr, op, !cache)))
+	if ((ret = tfw_hpack_encode(resp, &s_hdr, TFW_H2_TRANS_EXPAND, !cache)))
 		return ret;
 
 	return 0;
 }
 
+/*
+ * Mark the beginning of processing stage @stage of request @req.
+ */
+static inline void
+tfw_http_req_stage(TfwHttpReq *req, unsigned int stage)
+{
+	if (tfw_http_stage_stats)
+		req->stage_ts[stage] = get_cycles();
+}
+
+static inline void
+__tfw_http_stage_account(TfwHttpReq *req, unsigned int stage, u64 cycles)
+{
+	TfwHttpStageStat *st = this_cpu_ptr(&tfw_http_stage_stat);
+	unsigned int i = min_t(unsigned int, fls64(cycles),
+			       TFW_HTTP_STAGE_HBKTS - 1);
+
+	++st->cnt[stage][i];
+	st->sum[stage] += cycles;
+	trace_tfw_http_stage(req, stage, cycles);
+}
+
+/*
+ * A response to @req is about to be sent to the client, account durations
+ * of all the processing stages passed by the request. Each stage lasts
+ * until the beginning of the next passed stage. The stages may be run on
+ * different CPUs, so don't trust slightly unsynchronized TSC deltas.
+ */
+static void
+tfw_http_req_stage_stats(TfwHttpReq *req)
+{
+	int i;
+	u64 ts, now, end;
+
+	if (!(ts = req->stage_ts[TFW_HTTP_STAGE_PARSE]))
+		return;
+
+	end = now = get_cycles();
+	__tfw_http_stage_account(req, TFW_HTTP_STAGE_TOTAL,
+				 now > ts ? now - ts : 0);
+	for (i = TFW_HTTP_STAGE_NUM - 1; i >= 0; --i) {
+		if (!(ts = req->stage_ts[i]))
+			continue;
+		__tfw_http_stage_account(req, i, end > ts ? end - ts : 0);
+		end = min(end, ts);
+	}
+	req->stage_ts[TFW_HTTP_STAGE_PARSE] = 0;
+}
+
+/*
+ * Response @resp to request @req is about to be sent to the client, account
+ * the response size and the CPU cycles spent on the response since its
+ * processing started.
+ */
+static inline void
+tfw_http_req_acct_resp(TfwHttpReq *req, TfwHttpResp *resp)
+{
+	u64 now;
+
+	if (req->acct_ts) {
+		now = get_cycles();
+		req->acct_cycles += now > req->acct_ts ? now - req->acct_ts : 0;
+		req->acct_ts = 0;
+	}
+	req->acct_tx += resp->msg.len;
+}
+
 void
 tfw_h2_resp_fwd(TfwHttpResp *resp)
 {
 	TfwHttpReq *req = resp->req;
 	TfwH2Ctx *ctx = tfw_h2_context(req->conn);
 
-	if (tfw_cli_conn_send((TfwCliConn *)req->conn, (TfwMsg *)resp)) {
+	tfw_http_req_stage_stats(req);
+	tfw_http_req_acct_resp(req, resp);
+	tfw_access_log(req, resp);
+	trace_tfw_http_req_end(req, resp->status, resp->msg.len);
+	if (tfw_h2_resp_xmit(ctx, (TfwMsg *)resp)) {
 		T_DBG("%s: cannot send data to client via HTTP/2\n", __func__);
 		TFW_INC_STAT_BH(serv.msgs_otherr);
 		tfw_connection_close(req->conn, true);
@@ -890,22 +1114,166 @@ tfw_h2_resp_fwd(TfwHttpResp *resp)
 	tfw_http_resp_pair_free(req);
 }
 
+static int
+tfw_h1_lresp_build(TfwLocalRespTmpl *t, const TfwStr *msg, int v, time_t ts)
+{
+	static const TfwStr crlfs[] = {
+		[TFW_LRESP_H1]		= TFW_STR_STRING(S_CRLF),
+		[TFW_LRESP_H1_KA]	= TFW_STR_STRING(S_H_CONN_KA),
+		[TFW_LRESP_H1_CLOSE]	= TFW_STR_STRING(S_H_CONN_CLOSE),
+	};
+	const TfwStr *date = TFW_STR_DATE_CH(msg), *c, *end;
+	char *p = t->buf;
+	size_t len = crlfs[v].len;
+
+	/* All the chunks up to CRLF and the Connection header instead of it. */
+	end = TFW_STR_CRLF_CH(msg);
+	for (c = msg->chunks; c < end; ++c)
+		len += c->len;
+	if (WARN_ON_ONCE(len > TFW_LRESP_MAXLEN))
+		return -E2BIG;
+
+	for (c = msg->chunks; c < end; p += c->len, ++c) {
+		if (c == date)
+			memcpy_fast(p, tfw_http_date(ts)->h1, SLEN(S_V_DATE));
+		else
+			memcpy_fast(p, c->data, c->len);
+	}
+	memcpy_fast(p, crlfs[v].data, crlfs[v].len);
+	t->len = len;
+
+	return 0;
+}
+
+/* Static table index of the names of the local response headers. */
+static unsigned short
+tfw_h2_lresp_hdr_idx(const char *name, size_t len)
+{
+#define NAME_IS(n)	(len == SLEN(n) && !memcmp(name, n, len))
+	if (NAME_IS("content-length"))
+		return 28;
+	if (NAME_IS("retry-after"))
+		return 53;
+	if (NAME_IS("server"))
+		return 54;
+#undef NAME_IS
+	return 0;
+}
+
+static int
+__tfw_h2_lresp_hdr(TfwLocalRespTmpl *t, const char *name, size_t nlen,
+		   const char *val, size_t vlen, unsigned short idx)
+{
+	TfwStr hdr = {
+		.chunks = (TfwStr []){
+			{ .data = (char *)name,	.len = nlen },
+			{ .data = (char *)val,	.len = vlen },
+		},
+		.len = nlen + vlen,
+		.nchunks = 2,
+		.hpack_idx = idx
+	};
+
+	if (WARN_ON_ONCE(t->len + hdr.len + HPACK_ENC_HDR_OVERHEAD
+			 > TFW_LRESP_MAXLEN))
+		return -E2BIG;
+	t->len += tfw_hpack_encode_nodyn(&hdr, t->buf + t->len);
+
+	return 0;
+}
+
+/*
+ * Encode the HTTP/1 header lines of @hdrs, which are "name: value\r\n" and
+ * start with CRLF if @crlf is set, to the HTTP/2 template @t.
+ */
+static int
+__tfw_h2_lresp_lines(TfwLocalRespTmpl *t, const TfwStr *hdrs, bool crlf)
+{
+	int r;
+	const char *p = hdrs->data, *end = p + hdrs->len, *v, *nl;
+
+	for (p += crlf ? SLEN(S_CRLF) : 0; p < end; p = nl + SLEN(S_CRLF)) {
+		if (!(v = memchr(p, ':', end - p))
+		    || !(nl = memchr(v, '\r', end - v)))
+			return -EINVAL;
+		r = __tfw_h2_lresp_hdr(t, p, v - p, v + SLEN(S_DLM),
+				       nl - v - SLEN(S_DLM),
+				       tfw_h2_lresp_hdr_idx(p, v - p));
+		if (r)
+			return r;
+	}
+
+	return 0;
+}
+
+static int
+tfw_h2_lresp_build(TfwLocalRespTmpl *t, const TfwStr *msg, time_t ts)
+{
+	int r;
+	unsigned short status, idx;
+	const TfwHttpDate *date = tfw_http_date(ts);
+	const char *st = TFW_STR_START_CH(msg)->data + SLEN(S_0);
+
+	status = (st[0] - '0') * 100 + (st[1] - '0') * 10 + st[2] - '0';
+	t->len = 0;
+	/* Fully indexed ':status' or the indexed name with the value. */
+	if ((idx = tfw_h2_pseudo_index(status))) {
+		t->buf[t->len++] = 0x80 | idx;
+	} else {
+		r = __tfw_h2_lresp_hdr(t, S_H2_STAT, SLEN(S_H2_STAT), st,
+				       H2_STAT_VAL_LEN, 8);
+		if (r)
+			return r;
+	}
+
+	if (WARN_ON_ONCE(t->len + date->h2_len > TFW_LRESP_MAXLEN))
+		return -E2BIG;
+	memcpy_fast(t->buf + t->len, date->h2, date->h2_len);
+	t->len += date->h2_len;
+	if ((r = __tfw_h2_lresp_lines(t, TFW_STR_CLEN_CH(msg), true)))
+		return r;
+
+	return __tfw_h2_lresp_lines(t, TFW_STR_SRV_CH(msg), false);
+}
+
+/**
+ * Get the template of the headers of local response @code for variant @v,
+ * one of TFW_LRESP_*, rebuilding it if the second or the configuration has
+ * changed since the template was built.
+ */
+static const TfwLocalRespTmpl *
+tfw_lresp_tmpl(resp_code_t code, int v)
+{
+	int r;
+	time_t ts = tfw_current_timestamp();
+	unsigned int gen = READ_ONCE(lresp_gen);
+	TfwLocalRespTmpl *t = &(*this_cpu_ptr(lresp_tmpl))[code][v];
+	const TfwStr *msg = &http_predef_resps[code];
+
+	if (likely(t->ts == ts && t->gen == gen))
+		return t;
+
+	r = v == TFW_LRESP_H2 ? tfw_h2_lresp_build(t, msg, ts)
+			      : tfw_h1_lresp_build(t, msg, v, ts);
+	if (unlikely(r)) {
+		t->ts = 0;
+		return NULL;
+	}
+	t->ts = ts;
+	t->gen = gen;
+
+	return t;
+}
+
 static void
 tfw_h2_send_resp(TfwHttpReq *req, int status, unsigned int stream_id)
 {
-	TfwStr *msg;
 	resp_code_t code;
 	TfwHttpResp *resp;
-	struct sk_buff **skb_head;
 	TfwHttpTransIter *mit;
-	char *date_val, *data_ptr;
-	unsigned long nlen, vlen;
-	TfwStr *start, *date, *clen, *srv, *body;
-	TfwH2Ctx *ctx = tfw_h2_context(req->conn);
-	TfwStr hdr = {
-		.chunks = (TfwStr []){ {}, {} },
-		.nchunks = 2
-	};
+	const TfwLocalRespTmpl *t;
+	const TfwHttpSharedBody *body;
+	TfwStr hdrs = {};
 
 	if (!stream_id) {
 		stream_id = tfw_h2_stream_id_close(req, HTTP2_HEADERS,
@@ -921,67 +1289,25 @@ tfw_h2_send_resp(TfwHttpReq *req, int status, unsigned int stream_id)
 		T_WARN("Unexpected response error code: [%d]\n", status);
 		code = RESP_500;
 	}
-	msg = &http_predef_resps[code];
+	if (unlikely(!(t = tfw_lresp_tmpl(code, TFW_LRESP_H2))))
+		goto err;
+	hdrs.data = (char *)t->buf;
+	hdrs.len = t->len;
+	body = &http_predef_bodies[code];
 
 	resp = tfw_http_msg_alloc_resp_light(req);
 	if (unlikely(!resp))
 		goto err;
-
 	mit = &resp->mit;
-	skb_head = &resp->msg.skb_head;
-	body = TFW_STR_BODY_CH(msg);
 
-	/* Set HTTP/2 ':status' pseudo-header. */
 	mit->start_off = FRAME_HEADER_SIZE;
-	if (tfw_h2_resp_status_write(resp, status, TFW_H2_TRANS_EXPAND, false))
-		goto err_setup;
-
-	/*
-	 * Form and write HTTP/2 response headers excluding "\r\n", ':'
-	 * separators and OWS.
-	 */
-	start = TFW_STR_START_CH(msg);
-	date = TFW_STR_DATE_CH(msg);
-	__TFW_STR_CH(&hdr, 0)->data = start->data + start->len - SLEN(S_F_DATE);
-	__TFW_STR_CH(&hdr, 0)->len = nlen = SLEN(S_F_DATE) - 2;
-	date_val = *this_cpu_ptr(&g_buf);
-	tfw_http_prep_date(date_val);
-	__TFW_STR_CH(&hdr, 1)->data = date_val;
-	__TFW_STR_CH(&hdr, 1)->len = vlen = date->len;
-	hdr.len = nlen + vlen;
-	hdr.hpack_idx = 33;
-	if (tfw_hpack_encode(resp, &hdr, TFW_H2_TRANS_EXPAND, true))
-		goto err_setup;
-
-	clen = TFW_STR_CLEN_CH(msg);
-	__TFW_STR_CH(&hdr, 0)->data = data_ptr = clen->data + SLEN(S_CRLF);
-	__TFW_STR_CH(&hdr, 0)->len = nlen = SLEN(S_F_CONTENT_LENGTH) - 2;
-	__TFW_STR_CH(&hdr, 1)->data = data_ptr = data_ptr + nlen + 2;
-	__TFW_STR_CH(&hdr, 1)->len = vlen = clen->data + clen->len
-		- data_ptr - SLEN(S_CRLF);
-	hdr.len = nlen + vlen;
-	hdr.hpack_idx = 28;
-	if (tfw_hpack_encode(resp, &hdr, TFW_H2_TRANS_EXPAND, true))
+	if (tfw_http_msg_expand_data(&mit->iter, &resp->msg.skb_head, &hdrs,
+				     &mit->start_off)
+	    || tfw_h2_make_frames(resp, stream_id, hdrs.len, NULL, true,
+				  body->len)
+	    || tfw_http_msg_add_shared_body(&mit->iter, body, stream_id))
 		goto err_setup;
 
-	srv = TFW_STR_SRV_CH(msg);
-	__TFW_STR_CH(&hdr, 0)->data = data_ptr = srv->data;
-	__TFW_STR_CH(&hdr, 0)->len = nlen = SLEN(S_F_SERVER) - 2;
-	__TFW_STR_CH(&hdr, 1)->data = data_ptr = data_ptr + nlen + 2;
-	__TFW_STR_CH(&hdr, 1)->len = vlen = srv->data + srv->len
-		- data_ptr - SLEN(S_CRLF);
-	hdr.len = nlen + vlen;
-	hdr.hpack_idx = 54;
-	if (tfw_hpack_encode(resp, &hdr, TFW_H2_TRANS_EXPAND, true))
-		goto err_setup;
-
-	if (WARN_ON_ONCE(!mit->acc_len))
-		goto err_setup;
-
-	if (tfw_h2_frame_local_resp(resp, stream_id, mit->acc_len, body))
-		goto err_setup;
-
-	/* Send resulting HTTP/2 response and release HPACK encoder index. */
 	tfw_h2_resp_fwd(resp);
 
 	return;
@@ -990,8 +1316,6 @@ err_setup:
 	T_DBG("%s: HTTP/2 response message transformation error: conn=[%p]\n",
 	      __func__, req->conn);
 
-	tfw_hpack_enc_release(&ctx->hpack, resp->flags);
-
 	tfw_http_msg_free((TfwHttpMsg *)resp);
 err:
 	tfw_http_resp_build_error(req);
@@ -999,14 +1323,10 @@ err:
 
 /*
  * Perform operations common to sending an error response to a client.
- * Set current date in the header of an HTTP error response, and set
- * the "Connection:" header field if it was present in the request.
- * If memory allocation error or message setup errors occurred, then
- * client connection should be closed, because response-request
- * pairing for pipelined requests is violated.
- *
- * NOTE: This function expects the predefined order of chunks in @msg:
- * the fourth chunk must be CRLF.
+ * The headers template has the current date and the "Connection:" header
+ * field if it was present in the request. If memory allocation error or
+ * message setup errors occurred, then client connection should be closed,
+ * because response-request pairing for pipelined requests is violated.
  */
 static void
 tfw_h1_send_resp(TfwHttpReq *req, int status)
@@ -1014,12 +1334,12 @@ tfw_h1_send_resp(TfwHttpReq *req, int status)
 	TfwMsgIter it;
 	resp_code_t code;
 	TfwHttpResp *resp;
-	TfwStr *date, *crlf, *body;
-	TfwStr msg = {
-		.chunks = (TfwStr []){ {}, {}, {}, {}, {}, {} },
-		.len = 0,
-		.nchunks = 6
-	};
+	const TfwLocalRespTmpl *t;
+	int v = TFW_LRESP_H1;
+	TfwStr hdrs = {};
+
+	if (tfw_http_req_streamed_close(req))
+		return;
 
 	code = tfw_http_enum_resp_code(status);
 	if (code == RESP_NUM) {
@@ -1027,37 +1347,20 @@ tfw_h1_send_resp(TfwHttpReq *req, int status)
 		code = RESP_500;
 	}
 
-	if (tfw_strcpy_desc(&msg, &http_predef_resps[code]))
+	if (test_bit(TFW_HTTP_B_CONN_CLOSE, req->flags))
+		v = TFW_LRESP_H1_CLOSE;
+	else if (test_bit(TFW_HTTP_B_CONN_KA, req->flags))
+		v = TFW_LRESP_H1_KA;
+	if (unlikely(!(t = tfw_lresp_tmpl(code, v))))
 		goto err;
-
-	crlf = TFW_STR_CRLF_CH(&msg);
-	if (test_bit(TFW_HTTP_B_CONN_KA, req->flags)
-	    || test_bit(TFW_HTTP_B_CONN_CLOSE, req->flags))
-	{
-		unsigned long crlf_len = crlf->len;
-		if (test_bit(TFW_HTTP_B_CONN_CLOSE, req->flags)) {
-			crlf->data = S_H_CONN_CLOSE;
-			crlf->len = SLEN(S_H_CONN_CLOSE);
-		} else {
-			crlf->data = S_H_CONN_KA;
-			crlf->len = SLEN(S_H_CONN_KA);
-		}
-		msg.len += crlf->len - crlf_len;
-	}
+	hdrs.data = (char *)t->buf;
+	hdrs.len = t->len;
 
 	if (!(resp = tfw_http_msg_alloc_resp_light(req)))
 		goto err;
-	if (tfw_http_msg_setup((TfwHttpMsg *)resp, &it, msg.len, 0))
-		goto err_setup;
-
-	body = TFW_STR_BODY_CH(&msg);
-	date = TFW_STR_DATE_CH(&msg);
-	date->data = *this_cpu_ptr(&g_buf);
-	tfw_http_prep_date(date->data);
-	if (!body->data)
-		msg.nchunks = 5;
-
-	if (tfw_msg_write(&it, &msg))
+	if (tfw_http_msg_setup((TfwHttpMsg *)resp, &it, hdrs.len, 0)
+	    || tfw_msg_write(&it, &hdrs)
+	    || tfw_http_msg_add_shared_body(&it, &http_predef_bodies[code], 0))
 		goto err_setup;
 
 	tfw_http_resp_fwd(resp);
@@ -1227,6 +1530,18 @@ __tfw_http_conn_msg_sent_prev(TfwSrvConn *srv_conn)
 		NULL : (TfwMsg *)list_prev_entry(req_sent, fwd_list);
 }
 
+/*
+ * All the requests are removed from the forwarding queue of @srv_conn.
+ */
+static void
+tfw_http_fwdq_delist_all(TfwSrvConn *srv_conn)
+{
+	TfwHttpReq *req;
+
+	list_for_each_entry(req, &srv_conn->fwd_queue, fwd_list)
+		this_cpu_dec(tfw_http_queue_stat.queued[req->priority]);
+}
+
 /*
  * Reset server connection's @fwd_queue and move all requests
  * to @dst list.
@@ -1234,6 +1549,7 @@ __tfw_http_conn_msg_sent_prev(TfwSrvConn *srv_conn)
 static inline void
 tfw_http_fwdq_reset(TfwSrvConn *srv_conn, struct list_head *dst)
 {
+	tfw_http_fwdq_delist_all(srv_conn);
 	list_splice_tail_init(&srv_conn->fwd_queue, dst);
 	srv_conn->qsize = 0;
 	srv_conn->msg_sent = NULL;
@@ -1241,14 +1557,71 @@ tfw_http_fwdq_reset(TfwSrvConn *srv_conn, struct list_head *dst)
 	clear_bit(TFW_CONN_B_HASNIP, &srv_conn->flags);
 }
 
+/*
+ * Priority of request @req configured for its location, the priority is
+ * resolved once. Requests without a virtual host, e.g. health monitoring
+ * requests, have normal priority.
+ */
+static unsigned int
+tfw_http_req_priority(TfwHttpReq *req)
+{
+	unsigned int prio = TFW_HTTP_PRIO_NORMAL;
+
+	if (likely(req->priority))
+		return req->priority;
+	/* TODO #862: req->location must be the full set of options. */
+	if (!req->vhost)
+		goto done;
+	if (req->location && req->location->priority)
+		prio = req->location->priority;
+	else if (req->vhost->loc_dflt && req->vhost->loc_dflt->priority)
+		prio = req->vhost->loc_dflt->priority;
+	else if (req->vhost->vhost_dflt
+		 && req->vhost->vhost_dflt->loc_dflt->priority)
+		prio = req->vhost->vhost_dflt->loc_dflt->priority;
+done:
+	req->priority = prio;
+
+	return prio;
+}
+
+/*
+ * A request may be overtaken by requests of higher priority only a limited
+ * number of times, so requests of low priority aren't starved.
+ */
+#define TFW_HTTP_REQ_OVERTAKE_MAX	8
+
 /**
  * Add @req to the server connection's forwarding queue.
+ *
+ * The request is queued before the unsent requests of lower priority, so
+ * e.g. a burst of slow report requests doesn't delay API calls to the same
+ * servers. Neither sent requests nor non-idempotent ones are overtaken: the
+ * order of responses of the former is defined by the server, and the latter
+ * hold the connection. Without priorities configured only the queue tail is
+ * checked.
  */
 static inline void
 tfw_http_req_enlist(TfwSrvConn *srv_conn, TfwHttpReq *req)
 {
-	list_add_tail(&req->fwd_list, &srv_conn->fwd_queue);
+	struct list_head *pos = srv_conn->fwd_queue.prev;
+	unsigned int prio = tfw_http_req_priority(req);
+
+	for ( ; pos != &srv_conn->fwd_queue; pos = pos->prev) {
+		TfwHttpReq *r = list_entry(pos, TfwHttpReq, fwd_list);
+
+		if (r->priority >= prio
+		    || r->overtaken >= TFW_HTTP_REQ_OVERTAKE_MAX
+		    || (TfwMsg *)r == srv_conn->msg_sent
+		    || tfw_http_req_is_nip(r))
+			break;
+		r->overtaken++;
+	}
+	list_add(&req->fwd_list, pos);
+	req->fwd_qts = get_cycles();
+	this_cpu_inc(tfw_http_queue_stat.queued[prio]);
 	srv_conn->qsize++;
+	srv_conn->jtxtstamp = jiffies;
 	if (tfw_http_req_is_nip(req))
 		tfw_http_req_nip_enlist(srv_conn, req);
 }
@@ -1263,9 +1636,29 @@ tfw_http_req_delist(TfwSrvConn *srv_conn, TfwHttpReq *req)
 {
 	tfw_http_req_nip_delist(srv_conn, req);
 	list_del_init(&req->fwd_list);
+	this_cpu_dec(tfw_http_queue_stat.queued[req->priority]);
 	srv_conn->qsize--;
 }
 
+/*
+ * Account the time request @req waited in the forwarding queue.
+ */
+static inline void
+tfw_http_req_fwd_account(TfwHttpReq *req)
+{
+	TfwHttpQueueStat *st = this_cpu_ptr(&tfw_http_queue_stat);
+	u64 now = get_cycles(), cycles;
+	unsigned int i;
+
+	if (!req->fwd_qts)
+		return;
+	cycles = now > req->fwd_qts ? now - req->fwd_qts : 0;
+	i = min_t(unsigned int, fls64(cycles), TFW_HTTP_STAGE_HBKTS - 1);
+	++st->cnt[req->priority][i];
+	st->sum[req->priority] += cycles;
+	req->fwd_qts = 0;
+}
+
 /*
  * Common actions in case of an error while forwarding requests.
  * Erroneous requests are removed from the forwarding queue and placed
@@ -1304,6 +1697,15 @@ tfw_http_nip_req_resched_err(TfwSrvConn *srv_conn, TfwHttpReq *req,
 void
 tfw_http_send_resp(TfwHttpReq *req, int status, const char *reason)
 {
+	/*
+	 * There is no client for health monitoring and background requests,
+	 * so nobody to send the response to.
+	 */
+	if (unlikely(!req->conn)) {
+		tfw_http_conn_msg_free((TfwHttpMsg *)req);
+		return;
+	}
+
 	if (!(tfw_blk_flags & TFW_BLK_ERR_NOLOG)) {
 		T_WARN_ADDR_STATUS(reason, &req->conn->peer->addr,
 				   TFW_WITH_PORT, status);
@@ -1497,14 +1899,44 @@ tfw_http_req_evict_retries(TfwSrvConn *srv_conn, TfwServer *srv,
 				 " of retries exceeded");
 		return true;
 	}
+	/* Don't pile retries on the rest of the group during an outage. */
+	if (unlikely(!tfw_sg_rbudget_retry(srv->sg))) {
+		T_DBG2("%s: Eviction: req=[%p] retry budget exhausted\n",
+		       __func__, req);
+		tfw_http_req_err(srv_conn, req, eq, 504,
+				 "request evicted: retry budget"
+				 " exhausted");
+		return true;
+	}
 	return false;
 }
 
+/*
+ * If the response to @req was partially forwarded to the client and then
+ * the server connection failed, then the request can't be re-sent since
+ * the client can't get another response. Move it to the error queue @eq,
+ * the client connection is closed instead of sending an error response.
+ */
+static inline bool
+tfw_http_req_evict_streamed(TfwSrvConn *srv_conn, TfwHttpReq *req,
+			    struct list_head *eq)
+{
+	if (likely(!test_bit(TFW_HTTP_B_REQ_STREAMED, req->flags))
+	    || req->pair)
+		return false;
+	T_DBG2("%s: Eviction: req=[%p] response is partially forwarded\n",
+	       __func__, req);
+	tfw_http_req_err(srv_conn, req, eq, 502,
+			 "request evicted: response is partially forwarded");
+	return true;
+}
+
 static inline bool
 tfw_http_req_evict_stale_req(TfwSrvConn *srv_conn, TfwServer *srv,
 			     TfwHttpReq *req, struct list_head *eq)
 {
 	return tfw_http_req_evict_dropped(srv_conn, req)
+	       || tfw_http_req_evict_streamed(srv_conn, req, eq)
 	       || tfw_http_req_evict_timeout(srv_conn, srv, req, eq);
 }
 
@@ -1513,6 +1945,7 @@ tfw_http_req_evict(TfwSrvConn *srv_conn, TfwServer *srv, TfwHttpReq *req,
 		   struct list_head *eq)
 {
 	return tfw_http_req_evict_dropped(srv_conn, req)
+	       || tfw_http_req_evict_streamed(srv_conn, req, eq)
 	       || tfw_http_req_evict_timeout(srv_conn, srv, req, eq)
 	       || tfw_http_req_evict_retries(srv_conn, srv, req, eq);
 }
@@ -1531,6 +1964,7 @@ tfw_http_req_fwd_send(TfwSrvConn *srv_conn, TfwServer *srv, TfwHttpReq *req,
 	int r;
 
 	req->jtxtstamp = jiffies;
+	tfw_http_req_stage(req, TFW_HTTP_STAGE_UPSTREAM);
 	tfw_http_req_init_ss_flags(srv_conn, req);
 
 	if (!(r = tfw_connection_send((TfwConn *)srv_conn, (TfwMsg *)req)))
@@ -1571,6 +2005,7 @@ tfw_http_req_fwd_single(TfwSrvConn *srv_conn, TfwServer *srv,
 	if ((r = tfw_http_req_fwd_send(srv_conn, srv, req, eq)))
 		return r;
 	srv_conn->msg_sent = (TfwMsg *)req;
+	tfw_http_req_fwd_account(req);
 	TFW_INC_STAT_BH(clnt.msgs_forwarded);
 	return 0;
 }
@@ -1632,20 +2067,60 @@ tfw_http_conn_fwd_unsent(TfwSrvConn *srv_conn, struct list_head *eq)
 }
 
 /*
- * Forward the request @req to server connection @srv_conn.
- *
- * The request is added to the server connection's forwarding queue.
- * If forwarding is on hold at the moment, then the request will be
- * forwarded later. Otherwise, forward the request to the server now.
+ * Lock the forwarding queue of @srv_conn and move the requests pending for
+ * forwarding to the connection into the queue. Return false without the
+ * lock if there are no pending requests.
  *
- * Forwarding to a server is considered to be on hold after
- * a non-idempotent request is forwarded. The hold is removed when
- * a response is received to the holding request. The hold is also
- * removed when the holding non-idempotent request is followed by
- * another request from the same client. Effectively, that re-enables
- * pipelining. See RFC 7230 6.3.2.
- *
- * Requests must be forwarded in the same order they are put in the
+ * A CPU forwarding a request adds it to @srv_conn->fwd_pend and calls the
+ * function until it returns false, forwarding the queue each time. Only
+ * one of the CPUs concurrently forwarding requests to the connection takes
+ * the lock and forwards all their requests in one run, and the others are
+ * done once their requests are moved to the queue. Since the lock holder
+ * checks @fwd_pend again after the unlock, no request is left pending.
+ */
+static bool
+tfw_http_conn_fwd_lock(TfwSrvConn *srv_conn)
+{
+	struct llist_node *pend;
+	TfwHttpReq *req, *tmp;
+
+	for ( ; ; ) {
+		/* Pairs with llist_add() of a CPU failed to take the lock. */
+		smp_mb();
+		if (llist_empty(&srv_conn->fwd_pend))
+			return false;
+		if (!spin_trylock(&srv_conn->fwd_qlock)) {
+			cpu_relax();
+			continue;
+		}
+		if ((pend = llist_del_all(&srv_conn->fwd_pend)))
+			break;
+		spin_unlock(&srv_conn->fwd_qlock);
+	}
+
+	/* Keep the order, in which the requests were added. */
+	pend = llist_reverse_order(pend);
+	llist_for_each_entry_safe(req, tmp, pend, pend_node)
+		tfw_http_req_enlist(srv_conn, req);
+
+	return true;
+}
+
+/*
+ * Forward the request @req to server connection @srv_conn.
+ *
+ * The request is added to the server connection's forwarding queue.
+ * If forwarding is on hold at the moment, then the request will be
+ * forwarded later. Otherwise, forward the request to the server now.
+ *
+ * Forwarding to a server is considered to be on hold after
+ * a non-idempotent request is forwarded. The hold is removed when
+ * a response is received to the holding request. The hold is also
+ * removed when the holding non-idempotent request is followed by
+ * another request from the same client. Effectively, that re-enables
+ * pipelining. See RFC 7230 6.3.2.
+ *
+ * Requests must be forwarded in the same order they are put in the
  * queue, and so it must be done under the queue lock, otherwise
  * pairing of requests with responses may get broken. Take a simple
  * scenario. CPU-1 locks the queue, adds a request to it, unlocks
@@ -1653,6 +2128,11 @@ tfw_http_conn_fwd_unsent(TfwSrvConn *srv_conn, struct list_head *eq)
  * After that CPU-1 and CPU-2 are fully concurrent. If CPU-2 happens
  * to proceed first with forwarding, then pairing gets broken.
  *
+ * To not serialize the CPUs forwarding requests to the same connection on
+ * the queue lock, the requests are passed through @fwd_pend, see
+ * tfw_http_conn_fwd_lock(). Rescheduled requests are rare, so they're
+ * forwarded under the lock as is to know the forwarding result.
+ *
  * TODO: In current design @fwd_queue is locked until after a request
  * is submitted to SS for sending. It shouldn't be necessary to lock
  * @fwd_queue for that. There's the ordered @fwd_queue. Also there's
@@ -1672,6 +2152,18 @@ tfw_http_req_fwd(TfwSrvConn *srv_conn, TfwHttpReq *req, struct list_head *eq,
 	T_DBG2("%s: srv_conn=%pK req=%pK\n", __func__, srv_conn, req);
 	BUG_ON(!(TFW_CONN_TYPE(srv_conn) & Conn_Srv));
 
+	if (!resched) {
+		llist_add(&req->pend_node, &srv_conn->fwd_pend);
+		local_bh_disable();
+		while (tfw_http_conn_fwd_lock(srv_conn)) {
+			if (!tfw_http_conn_on_hold(srv_conn))
+				tfw_http_conn_fwd_unsent(srv_conn, eq);
+			spin_unlock(&srv_conn->fwd_qlock);
+		}
+		local_bh_enable();
+		return 0;
+	}
+
 	spin_lock_bh(&srv_conn->fwd_qlock);
 	tfw_http_req_enlist(srv_conn, req);
 	/*
@@ -1875,6 +2367,7 @@ tfw_http_conn_snip_fwd_queue(TfwSrvConn *srv_conn, struct list_head *out_queue)
 	list_for_each_entry_safe(req, tmp, &srv_conn->nip_queue, nip_list)
 		list_del_init(&req->nip_list);
 	tfw_http_conn_nip_reset(srv_conn);
+	tfw_http_fwdq_delist_all(srv_conn);
 	list_splice_tail_init(&srv_conn->fwd_queue, out_queue);
 	srv_conn->qsize = 0;
 	srv_conn->msg_sent = NULL;
@@ -1890,12 +2383,21 @@ tfw_http_get_srv_conn(TfwMsg *msg)
 {
 	TfwHttpReq *req = (TfwHttpReq *)msg;
 	TfwHttpSess *sess = req->sess;
+	TfwSrvConn *srv_conn;
 
+	/* Mirrored requests are sent to the shadow server group only. */
+	if (unlikely(test_bit(TFW_HTTP_B_REQ_MIRROR, req->flags)))
+		srv_conn = tfw_vhost_get_mirror_srv_conn(msg);
 	/* Sticky cookies are disabled or client doesn't support cookies. */
-	if (!sess)
-		return tfw_vhost_get_srv_conn(msg);
+	else if (!sess)
+		srv_conn = tfw_vhost_get_srv_conn(msg);
+	else
+		srv_conn = tfw_http_sess_get_srv_conn(msg);
+
+	trace_tfw_http_sched(req, srv_conn,
+			     srv_conn ? &srv_conn->peer->addr : NULL);
 
-	return tfw_http_sess_get_srv_conn(msg);
+	return srv_conn;
 }
 
 /*
@@ -1978,6 +2480,89 @@ tfw_http_fwdq_resched(TfwSrvConn *srv_conn, struct list_head *resch_queue,
 	}
 }
 
+/*
+ * Move at most TFW_SRV_DRAIN_BATCH of the oldest unsent requests from the
+ * forwarding queue of @srv_conn to @dst. Called under the queue lock.
+ */
+static void
+tfw_http_conn_cut_unsent(TfwSrvConn *srv_conn, struct list_head *dst)
+{
+	TfwHttpReq *req, *tmp;
+	struct list_head *fwdq = &srv_conn->fwd_queue;
+	unsigned int n = 0;
+
+	if (tfw_http_conn_drained(srv_conn))
+		return;
+
+	req = srv_conn->msg_sent
+	    ? list_next_entry((TfwHttpReq *)srv_conn->msg_sent, fwd_list)
+	    : list_first_entry(fwdq, TfwHttpReq, fwd_list);
+
+	list_for_each_entry_safe_from(req, tmp, fwdq, fwd_list) {
+		if (n++ == TFW_SRV_DRAIN_BATCH)
+			break;
+		tfw_http_req_delist(srv_conn, req);
+		list_add_tail(&req->fwd_list, dst);
+	}
+}
+
+/*
+ * Reschedule the unsent requests @migq of a draining server connection
+ * @srv_conn to other servers. Unlike tfw_http_fwdq_resched(), the first
+ * attempt isn't a retry since neither the requests were sent, nor the
+ * server failed.
+ */
+static void
+tfw_http_fwdq_migrate(TfwSrvConn *srv_conn, struct list_head *migq,
+		      struct list_head *eq)
+{
+	TfwHttpReq *req, *tmp;
+	TfwServer *srv = (TfwServer *)srv_conn->peer;
+
+	list_for_each_entry_safe(req, tmp, migq, fwd_list) {
+		INIT_LIST_HEAD(&req->fwd_list);
+		if (tfw_http_req_evict_stale_req(NULL, srv, req, eq)
+		    || !tfw_http_req_resched(req, srv, eq))
+			continue;
+		while (!tfw_http_req_evict_retries(NULL, srv, req, eq)) {
+			if (!tfw_http_req_resched(req, srv, eq))
+				break;
+		}
+	}
+}
+
+/**
+ * Drain connection @srv_conn of a removed server: requests sent to the
+ * server stay in the connection until their responses come, and a batch of
+ * the unsent requests is moved to other servers. The rest of the unsent
+ * requests are moved by tfw_http_popreq() as the responses come or by the
+ * next call of the function.
+ *
+ * Return true if the forwarding queue is empty, so the connection can be
+ * closed.
+ */
+bool
+tfw_http_conn_migrate(TfwSrvConn *srv_conn)
+{
+	LIST_HEAD(migq);
+	LIST_HEAD(eq);
+
+	spin_lock_bh(&srv_conn->fwd_qlock);
+	if (list_empty(&srv_conn->fwd_queue)) {
+		spin_unlock_bh(&srv_conn->fwd_qlock);
+		return true;
+	}
+	/* Requests of a connection in repair aren't in order yet. */
+	if (!tfw_srv_conn_restricted(srv_conn))
+		tfw_http_conn_cut_unsent(srv_conn, &migq);
+	spin_unlock_bh(&srv_conn->fwd_qlock);
+
+	tfw_http_fwdq_migrate(srv_conn, &migq, &eq);
+	tfw_http_req_zap_error(&eq);
+
+	return false;
+}
+
 /*
  * Forward @req into server connection @srv_conn. Timed-out and dropped
  * requests are evicted to error queue @eq for sending an error response
@@ -1994,19 +2579,23 @@ tfw_http_req_fwd_resched(TfwSrvConn *srv_conn, TfwHttpReq *req,
 	T_DBG2("%s: srv_conn=[%p], req=[%p]\n", __func__, srv_conn, req);
 	BUG_ON(!(TFW_CONN_TYPE(srv_conn) & Conn_Srv));
 
-	spin_lock_bh(&srv_conn->fwd_qlock);
-	tfw_http_req_enlist(srv_conn, req);
-	if (tfw_http_conn_on_hold(srv_conn)
-	    || !tfw_http_conn_fwd_unsent(srv_conn, eq))
-	{
-		spin_unlock_bh(&srv_conn->fwd_qlock);
-		return;
-	}
-	tfw_srv_set_busy_delay(srv_conn);
-	tfw_http_fwdq_reset(srv_conn, &reschq);
-	spin_unlock_bh(&srv_conn->fwd_qlock);
+	llist_add(&req->pend_node, &srv_conn->fwd_pend);
+	local_bh_disable();
+	while (tfw_http_conn_fwd_lock(srv_conn)) {
+		if (tfw_http_conn_on_hold(srv_conn)
+		    || !tfw_http_conn_fwd_unsent(srv_conn, eq))
+		{
+			spin_unlock(&srv_conn->fwd_qlock);
+			continue;
+		}
+		tfw_srv_set_busy_delay(srv_conn);
+		tfw_http_fwdq_reset(srv_conn, &reschq);
+		spin_unlock(&srv_conn->fwd_qlock);
 
-	tfw_http_fwdq_resched(srv_conn, &reschq, eq);
+		tfw_http_fwdq_resched(srv_conn, &reschq, eq);
+		INIT_LIST_HEAD(&reschq);
+	}
+	local_bh_enable();
 }
 
 /**
@@ -2198,6 +2787,33 @@ out:
 	tfw_http_req_zap_error(&eq);
 }
 
+/**
+ * Account request @req in the adaptive concurrency limit of the group of
+ * server @srv. A re-scheduled request keeps the slot it got initially.
+ */
+static bool
+tfw_http_req_conc_get(TfwHttpReq *req, TfwServer *srv)
+{
+	if (req->conc_sg || !READ_ONCE(srv->sg->conc_max))
+		return true;
+	if (!tfw_sg_conc_get(srv->sg))
+		return false;
+	tfw_sg_get(srv->sg);
+	req->conc_sg = srv->sg;
+
+	return true;
+}
+
+static void
+tfw_http_req_conc_put(TfwHttpReq *req)
+{
+	if (!req->conc_sg)
+		return;
+	tfw_sg_conc_put(req->conc_sg);
+	tfw_sg_put(req->conc_sg);
+	req->conc_sg = NULL;
+}
+
 /*
  * Destructor for a request message.
  */
@@ -2209,13 +2825,26 @@ tfw_http_req_destruct(void *msg)
 	WARN_ON_ONCE(!list_empty(&req->msg.seq_list));
 	WARN_ON_ONCE(!list_empty(&req->fwd_list));
 	WARN_ON_ONCE(!list_empty(&req->nip_list));
-
+	WARN_ON_ONCE(!list_empty(&req->wait_list));
+
+	if (test_bit(TFW_HTTP_B_REQ_MIRROR, req->flags))
+		tfw_sg_mirror_put(tfw_vhost_mirror_location(msg)->mirror_sg);
+	tfw_http_req_conc_put(req);
+	/* Internal copies of the requests aren't a client traffic. */
+	if (!test_bit(TFW_HTTP_B_REQ_MIRROR, req->flags)
+	    && !test_bit(TFW_HTTP_B_REQ_HEDGE, req->flags)
+	    && !test_bit(TFW_HTTP_B_HMONITOR, req->flags)
+	    && !test_bit(TFW_HTTP_B_CACHE_BG, req->flags))
+		tfw_vhost_acct(req->vhost, req->acct_cycles, req->msg.len,
+			       req->acct_tx);
 	tfw_vhost_put(req->vhost);
 	if (req->sess)
 		tfw_http_sess_put(req->sess);
 
 	if (req->peer)
 		tfw_client_put(req->peer);
+	if (test_bit(TFW_HTTP_B_REQ_HEDGE, req->flags))
+		tfw_srv_conn_put(req->hedge->srv_conn);
 }
 
 /**
@@ -2266,7 +2895,8 @@ static TfwMsg *
 tfw_http_conn_msg_alloc(TfwConn *conn, TfwStream *stream)
 {
 	int type = TFW_CONN_TYPE(conn);
-	TfwHttpMsg *hm = __tfw_http_msg_alloc(type, true);
+	unsigned int order = tfw_http_conn_hdrs_order(conn);
+	TfwHttpMsg *hm = __tfw_http_msg_alloc_tbl(type, order);
 	if (unlikely(!hm))
 		return NULL;
 
@@ -2290,6 +2920,7 @@ tfw_http_conn_msg_alloc(TfwConn *conn, TfwStream *stream)
 
 	if (type & Conn_Clnt) {
 		TFW_INC_STAT_BH(clnt.rx_messages);
+		trace_tfw_http_req_start(hm, conn);
 	} else {
 		if (unlikely(tfw_http_resp_pair(hm)))
 			goto clean;
@@ -2324,6 +2955,120 @@ clean:
  * Called when a connection is created. Initialize the connection's
  * state machine here.
  */
+/*
+ * ------------------------------------------------------------------------
+ *	Backpressure for slow clients
+ * ------------------------------------------------------------------------
+ *
+ * Data forwarded to a client is queued in the client socket regardless of
+ * its send buffer size, see ss_send(), so a slow client makes Tempesta hold
+ * whole responses for it. If a client connection has too much data queued,
+ * then receiving on the server connection, which delivers a response to the
+ * client, is paused, so the server gets the TCP receive window shrunk and
+ * stops sending. The client socket is polled by a timer, which resumes the
+ * server connection when the client reads enough of its data.
+ */
+#define TFW_HTTP_RX_POLL_INTVL	(HZ / 50 ? : 1)
+
+/*
+ * Tell if a client with socket @sk has too much data queued. Besides the
+ * per-connection limit, check the global limit of TCP memory, which is mostly
+ * used by the write queues of slow clients under the pressure: clients which
+ * have more data queued than their send buffer size are throttled then.
+ */
+static bool
+tfw_http_cli_slow(struct sock *sk)
+{
+	long queued = READ_ONCE(sk->sk_wmem_queued);
+
+	if (tfw_http_cli_buf_limit && queued > tfw_http_cli_buf_limit)
+		return true;
+	return tfw_http_cli_buf_total && queued > READ_ONCE(sk->sk_sndbuf)
+	       && (sk_memory_allocated(sk) << PAGE_SHIFT)
+		  > tfw_http_cli_buf_total;
+}
+
+static void
+__tfw_http_srv_rx_unwait(TfwSrvConn *srv_conn)
+{
+	TFW_ADD_STAT_BH(-srv_conn->rx_held, clnt.slow_held);
+	TFW_DEC_STAT_BH(serv.rx_paused);
+	tfw_cli_conn_put(srv_conn->rx_wait);
+	srv_conn->rx_wait = NULL;
+	srv_conn->rx_held = 0;
+	clear_bit(TFW_CONN_B_RX_PAUSED, &srv_conn->flags);
+}
+
+static void
+tfw_http_srv_rx_tmfn(unsigned long data)
+{
+	TfwSrvConn *srv_conn = (TfwSrvConn *)data;
+	struct sock *sk = READ_ONCE(srv_conn->rx_wait->sk);
+	long held = sk ? READ_ONCE(sk->sk_wmem_queued) : 0;
+
+	TFW_ADD_STAT_BH(held - srv_conn->rx_held, clnt.slow_held);
+	srv_conn->rx_held = held;
+	/*
+	 * Keep the server connection paused while the client is alive and
+	 * slow or the work queue is full: try again a bit later.
+	 */
+	if ((sk && ss_sock_live(sk) && tfw_http_cli_slow(sk))
+	    || ss_rx_resume(srv_conn->sk))
+	{
+		mod_timer(&srv_conn->rx_timer, jiffies + TFW_HTTP_RX_POLL_INTVL);
+		return;
+	}
+	T_DBG2("%s: resume srv_conn=[%p]\n", __func__, srv_conn);
+	__tfw_http_srv_rx_unwait(srv_conn);
+}
+
+/*
+ * Pause receiving on server connection @srv_conn if the response @resp,
+ * which is being received on it, is for a slow client. Called in the
+ * context of the server connection receiving, so the rest of the received
+ * response data is left in the server socket.
+ */
+static void
+tfw_http_srv_rx_throttle(TfwSrvConn *srv_conn, TfwHttpResp *resp)
+{
+	TfwCliConn *cli_conn = (TfwCliConn *)resp->req->conn;
+	struct sock *sk;
+
+	if (likely(!tfw_http_cli_buf_limit && !tfw_http_cli_buf_total))
+		return;
+	if (!cli_conn || TFW_MSG_H2(resp->req)
+	    || test_bit(TFW_HTTP_B_REQ_DROP, resp->req->flags))
+		return;
+	sk = READ_ONCE(cli_conn->sk);
+	if (!sk || !tfw_http_cli_slow(sk))
+		return;
+	if (test_and_set_bit(TFW_CONN_B_RX_PAUSED, &srv_conn->flags))
+		return;
+
+	T_DBG2("%s: pause srv_conn=[%p] for cli_conn=[%p]\n",
+	       __func__, srv_conn, cli_conn);
+	tfw_cli_conn_get(cli_conn);
+	srv_conn->rx_wait = cli_conn;
+	srv_conn->rx_held = READ_ONCE(sk->sk_wmem_queued);
+	TFW_ADD_STAT_BH(srv_conn->rx_held, clnt.slow_held);
+	TFW_INC_STAT_BH(serv.rx_paused);
+	ss_rx_pause(srv_conn->sk);
+	mod_timer(&srv_conn->rx_timer, jiffies + TFW_HTTP_RX_POLL_INTVL);
+}
+
+/*
+ * The server connection is dropped, it doesn't wait for the client any more.
+ */
+static void
+tfw_http_srv_rx_release(TfwSrvConn *srv_conn)
+{
+	if (!test_bit(TFW_CONN_B_RX_PAUSED, &srv_conn->flags))
+		return;
+	del_timer_sync(&srv_conn->rx_timer);
+	if (test_bit(TFW_CONN_B_RX_PAUSED, &srv_conn->flags))
+		__tfw_http_srv_rx_unwait(srv_conn);
+}
+
 static int
 tfw_http_conn_init(TfwConn *conn)
 {
@@ -2335,6 +3080,8 @@ tfw_http_conn_init(TfwConn *conn)
 			set_bit(TFW_CONN_B_RESEND, &srv_conn->flags);
 			TFW_INC_STAT_BH(serv.conn_restricted);
 		}
+		setup_timer(&srv_conn->rx_timer, tfw_http_srv_rx_tmfn,
+			    (unsigned long)srv_conn);
 	}
 	tfw_gfsm_state_init(&conn->state, conn, TFW_HTTP_FSM_INIT);
 	return 0;
@@ -2483,13 +3230,16 @@ tfw_http_conn_drop(TfwConn *conn)
 	T_DBG2("%s: conn=[%p]\n", __func__, conn);
 
 	if (TFW_CONN_TYPE(conn) & Conn_Clnt) {
+		tfw_sock_srv_tunnel_close((TfwCliConn *)conn);
 		if (h2_mode)
 			tfw_h2_conn_streams_cleanup(tfw_h2_context(conn));
 		else
 			tfw_http_conn_cli_drop((TfwCliConn *)conn);
 	}
-	else if (conn->stream.msg) { /* server connection */
-		if (!tfw_http_parse_terminate((TfwHttpMsg *)conn->stream.msg))
+	else {
+		tfw_http_srv_rx_release((TfwSrvConn *)conn);
+		if (conn->stream.msg
+		    && !tfw_http_parse_terminate((TfwHttpMsg *)conn->stream.msg))
 			tfw_http_resp_terminate((TfwHttpMsg *)conn->stream.msg);
 	}
 
@@ -2505,6 +3255,9 @@ tfw_http_conn_drop(TfwConn *conn)
 static int
 tfw_http_conn_send(TfwConn *conn, TfwMsg *msg)
 {
+	/* The socket is taken over by a tunnel, see tfw_sock_srv_tunnel(). */
+	if (unlikely(!conn->sk))
+		return -EBADF;
 	return ss_send(conn->sk, &msg->skb_head, msg->ss_flags);
 }
 
@@ -2548,11 +3301,10 @@ static int
 tfw_http_set_hdr_date(TfwHttpMsg *hm)
 {
 	int r;
-	char *s_date = *this_cpu_ptr(&g_buf);
+	const char *s_date = tfw_http_date(((TfwHttpResp *)hm)->date)->h1;
 
-	tfw_http_prep_date_from(s_date, ((TfwHttpResp *)hm)->date);
 	r = tfw_http_msg_hdr_xfrm(hm, "date", sizeof("date") - 1,
-				  s_date, SLEN(S_V_DATE),
+				  (char *)s_date, SLEN(S_V_DATE),
 				  TFW_HTTP_HDR_RAW, 0);
 	if (r)
 		T_ERR("Unable to add Date: header to msg [%p]\n", hm);
@@ -2570,18 +3322,17 @@ tfw_http_expand_hdr_date(TfwHttpResp *resp)
 	int r;
 	struct sk_buff **skb_head = &resp->msg.skb_head;
 	TfwHttpTransIter *mit = &resp->mit;
-	char *date = *this_cpu_ptr(&g_buf);
+	const TfwHttpDate *date = tfw_http_date(resp->date);
 	TfwStr h_date = {
 		.chunks = (TfwStr []){
 			{ .data = S_F_DATE, .len = SLEN(S_F_DATE) },
-			{ .data = date, .len = SLEN(S_V_DATE) },
+			{ .data = (char *)date->h1, .len = SLEN(S_V_DATE) },
 			{ .data = S_CRLF, .len = SLEN(S_CRLF) }
 		},
 		.len = SLEN(S_F_DATE) + SLEN(S_V_DATE) + SLEN(S_CRLF),
 		.nchunks = 3
 	};
 
-	tfw_http_prep_date_from(date, resp->date);
 	r = tfw_http_msg_expand_data(&mit->iter, skb_head, &h_date, NULL);
 	if (r)
 		T_ERR("Unable to expand resp [%p] with 'Date:' header\n", resp);
@@ -2679,12 +3430,35 @@ tfw_http_set_hdr_connection(TfwHttpMsg *hm, unsigned long conn_flg)
 	case BIT(TFW_HTTP_B_CONN_KA):
 		return TFW_HTTP_MSG_HDR_XFRM(hm, "Connection", "keep-alive",
 					     TFW_HTTP_HDR_CONNECTION, 0);
+	case BIT(TFW_HTTP_B_CONN_UPGRADE):
+		return TFW_HTTP_MSG_HDR_XFRM(hm, "Connection", "upgrade",
+					     TFW_HTTP_HDR_CONNECTION, 0);
 	default:
 		return TFW_HTTP_MSG_HDR_DEL(hm, "Connection",
 					    TFW_HTTP_HDR_CONNECTION);
 	}
 }
 
+/**
+ * Upgrade header is hop-by-hop, but it's passed through as is for a message
+ * switching the client connection to a tunnel, see tfw_http_resp_tunnel().
+ *
+ * @return false if there is no Upgrade header in @hm.
+ */
+static bool
+tfw_http_keep_hdr_upgrade(TfwHttpMsg *hm)
+{
+	static const TfwStr s_upgrade = TFW_STR_STRING("upgrade:");
+	TfwHttpHdrTbl *ht = hm->h_tbl;
+	unsigned int hid = tfw_http_msg_hdr_lookup(hm, &s_upgrade);
+
+	if (hid == ht->off)
+		return false;
+	ht->tbl[hid].flags &= ~TFW_STR_HBH_HDR;
+
+	return true;
+}
+
 /**
  * Add/Replace/Remove Keep-Alive header field to/from HTTP message.
  */
@@ -2897,32 +3671,23 @@ tfw_http_set_loc_hdrs(TfwHttpMsg *hm, TfwHttpReq *req, bool cache)
 	if (!h_mods)
 		return 0;
 
-	for (i = 0; i < h_mods->sz; ++i) {
-		int r;
-		TfwHdrModsDesc *d = &h_mods->hdrs[i];
+	if (!hm_req && cache) {
+		TfwHttpResp *resp = (TfwHttpResp *)hm;
+		TfwHttpTransIter *mit = &resp->mit;
+
 		/*
-		 * Header is stored optimized for HTTP2: without delimiter
-		 * between header and value. Add it as separate chunk as
-		 * required for tfw_http_msg_hdr_xfrm_str.
+		 * If none of the configured headers have been processed during
+		 * cache reading, copy all the serialized lines at once.
 		 */
-		TfwStr h_mdf = {
-			.chunks = (TfwStr []){
-				{},
-				{ .data = S_DLM, .len = SLEN(S_DLM) },
-				{}
-			},
-			.len = SLEN(S_DLM),
-			.nchunks = 2 /* header name + delimeter. */
-		};
+		if (bitmap_empty(mit->found, h_mods->sz))
+			return tfw_http_msg_expand_data(&mit->iter,
+							&resp->msg.skb_head,
+							&h_mods->h1, NULL);
+	}
 
-		h_mdf.chunks[0] = d->hdr->chunks[0];
-		if (d->hdr->nchunks == 2) {
-			h_mdf.chunks[2] = d->hdr->chunks[1];
-			h_mdf.nchunks += 1;
-		}
-		h_mdf.len += d->hdr->len;
-		h_mdf.flags = d->hdr->flags;
-		h_mdf.eolen += d->hdr->eolen;
+	for (i = 0; i < h_mods->sz; ++i) {
+		int r;
+		TfwHdrModsDesc *d = &h_mods->hdrs[i];
 
 		if (!hm_req && cache) {
 			TfwHttpResp *resp = (TfwHttpResp *)hm;
@@ -2933,13 +3698,13 @@ tfw_http_set_loc_hdrs(TfwHttpMsg *hm, TfwHttpReq *req, bool cache)
 			 * processed it during cache reading, or if the header
 			 * is configured for deletion (without value chunk).
 			 */
-			if (test_bit(i, mit->found) || h_mdf.nchunks < 3)
+			if (test_bit(i, mit->found) || TFW_STR_EMPTY(&d->h1))
 				continue;
 
 			r = tfw_http_msg_expand_data(&mit->iter, skb_head,
-						     &h_mdf, NULL);
+						     &d->h1, NULL);
 		} else {
-			r = tfw_http_msg_hdr_xfrm_str(hm, &h_mdf, d->hid,
+			r = tfw_http_msg_hdr_xfrm_str(hm, &d->h1_hdr, d->hid,
 						      d->append);
 		}
 
@@ -2963,11 +3728,14 @@ tfw_h1_adjust_req(TfwHttpReq *req)
 {
 	int r;
 	TfwHttpMsg *hm = (TfwHttpMsg *)req;
+	unsigned long conn_flg = BIT(TFW_HTTP_B_CONN_KA);
 
 	r = tfw_http_sess_req_process(req);
 	if (r)
 		return r;
 
+	tfw_http_msg_hdrs_defer(hm);
+
 	r = tfw_http_add_x_forwarded_for(hm);
 	if (r)
 		return r;
@@ -2993,7 +3761,14 @@ tfw_h1_adjust_req(TfwHttpReq *req)
 			return r;
 	}
 
-	return tfw_http_set_hdr_connection(hm, BIT(TFW_HTTP_B_CONN_KA));
+	if (test_bit(TFW_HTTP_B_CONN_UPGRADE, req->flags))
+		conn_flg = BIT(TFW_HTTP_B_CONN_UPGRADE);
+
+	r = tfw_http_set_hdr_connection(hm, conn_flg);
+	if (r)
+		return r;
+
+	return tfw_http_msg_hdrs_apply(hm);
 }
 
 static inline void
@@ -3491,9 +4266,18 @@ tfw_http_adjust_resp(TfwHttpResp *resp)
 	 * and close connection to Tempesta. Don't encourage client to send
 	 * more such requests and cause performance degradation, close the
 	 * client connection.
+	 *
+	 * The client connection is a tunnel after 101 response to an upgrade
+	 * request, see tfw_http_resp_tunnel().
 	 */
-	if (test_bit(TFW_HTTP_B_CONN_CLOSE, resp->flags)
-	    && (resp->status / 100 == 4))
+	if (resp->status == 101
+	    && test_bit(TFW_HTTP_B_CONN_UPGRADE, req->flags))
+	{
+		tfw_http_keep_hdr_upgrade(hm);
+		conn_flg = BIT(TFW_HTTP_B_CONN_UPGRADE);
+	}
+	else if (test_bit(TFW_HTTP_B_CONN_CLOSE, resp->flags)
+		 && (resp->status / 100 == 4))
 	{
 		tfw_http_req_set_conn_close(req);
 		conn_flg = BIT(TFW_HTTP_B_CONN_CLOSE);
@@ -3514,6 +4298,8 @@ tfw_http_adjust_resp(TfwHttpResp *resp)
 	if (r < 0)
 		return r;
 
+	tfw_http_msg_hdrs_defer(hm);
+
 	r = tfw_http_set_hdr_keep_alive(hm, conn_flg);
 	if (r < 0)
 		return r;
@@ -3536,8 +4322,12 @@ tfw_http_adjust_resp(TfwHttpResp *resp)
 			return r;
 	}
 
-	return TFW_HTTP_MSG_HDR_XFRM(hm, "Server", TFW_NAME "/" TFW_VERSION,
-				     TFW_HTTP_HDR_SERVER, 0);
+	r = TFW_HTTP_MSG_HDR_XFRM(hm, "Server", TFW_NAME "/" TFW_VERSION,
+				  TFW_HTTP_HDR_SERVER, 0);
+	if (r < 0)
+		return r;
+
+	return tfw_http_msg_hdrs_apply(hm);
 }
 
 /*
@@ -3582,6 +4372,10 @@ tfw_http_resp_fwd(TfwHttpResp *resp)
 
 	T_DBG2("%s: req=[%p], resp=[%p]\n", __func__, req, resp);
 	WARN_ON_ONCE(req->resp != resp);
+	tfw_http_req_stage_stats(req);
+	tfw_http_req_acct_resp(req, resp);
+	tfw_access_log(req, resp);
+	trace_tfw_http_req_end(req, resp->status, resp->msg.len);
 
 	/*
 	 * If the list is empty, then it's either a bug, or the client
@@ -3741,7 +4535,7 @@ tfw_h2_add_hdr_via(TfwHttpResp *resp)
 
 	via.hpack_idx = 60;
 
-	r = tfw_hpack_encode(resp, &via, TFW_H2_TRANS_ADD, true);
+	r = tfw_hpack_encode(resp, &via, TFW_H2_TRANS_EXPAND, true);
 	if (unlikely(r))
 		T_ERR("HTTP/2: unable to add 'via' header (resp=[%p])\n", resp);
 	else
@@ -3754,24 +4548,34 @@ tfw_h2_add_hdr_via(TfwHttpResp *resp)
  * transformation.
  */
 int
-tfw_h2_add_hdr_date(TfwHttpResp *resp, TfwH2TransOp op, bool cache)
+tfw_h2_add_hdr_date(TfwHttpResp *resp, bool cache)
 {
 	int r;
-	char *s_date = *this_cpu_ptr(&g_buf);
+	TfwHttpTransIter *mit = &resp->mit;
+	const TfwHttpDate *date = tfw_http_date(resp->date);
 	TfwStr hdr = {
 		.chunks = (TfwStr []){
 			{ .data = "date", .len = SLEN("date") },
-			{ .data = s_date, .len = SLEN(S_V_DATE) },
+			{ .data = (char *)date->h1, .len = SLEN(S_V_DATE) },
 		},
 		.len = SLEN("date") + SLEN(S_V_DATE),
-		.nchunks = 2
+		.nchunks = 2,
+		.hpack_idx = 33
 	};
+	TfwStr h2 = { .data = (char *)date->h2, .len = date->h2_len };
 
-	tfw_http_prep_date_from(s_date, resp->date);
-
-	hdr.hpack_idx = 33;
-
-	r = tfw_hpack_encode(resp, &hdr, op, !cache);
+	/*
+	 * Responses from the cache don't use the dynamic index, so the header
+	 * is copied already encoded.
+	 */
+	if (cache) {
+		r = tfw_http_msg_expand_data(&mit->iter, &resp->msg.skb_head,
+					     &h2, &mit->start_off);
+		if (likely(!r))
+			mit->acc_len += h2.len;
+	} else {
+		r = tfw_hpack_encode(resp, &hdr, TFW_H2_TRANS_EXPAND, true);
+	}
 	if (unlikely(r))
 		T_ERR("HTTP/2: unable to add 'date' header to response"
 			" [%p]\n", resp);
@@ -3934,17 +4738,40 @@ tfw_h2_hdr_size(unsigned long n_len, unsigned long v_len,
 	return size;
 }
 
+/* Append the HPACK encoded data @data to the header block of @resp. */
+static int
+__tfw_h2_resp_add_data(TfwHttpResp *resp, const TfwStr *data)
+{
+	int r;
+	TfwHttpTransIter *mit = &resp->mit;
+
+	r = tfw_http_msg_expand_data(&mit->iter, &resp->msg.skb_head, data,
+				     &mit->start_off);
+	if (unlikely(r))
+		return r;
+	mit->acc_len += data->len;
+
+	return 0;
+}
+
 int
 tfw_h2_resp_add_loc_hdrs(TfwHttpResp *resp, const TfwHdrMods *h_mods,
 			 bool cache)
 {
 	unsigned int i;
 	TfwHttpTransIter *mit = &resp->mit;
-	TfwH2TransOp op = cache ? TFW_H2_TRANS_EXPAND : TFW_H2_TRANS_ADD;
 
 	if (!h_mods)
 		return 0;
 
+	/*
+	 * Responses from the cache don't use the dynamic index, so copy the
+	 * HPACK representations prepared on start, all at once if none of the
+	 * configured headers have been processed during cache reading.
+	 */
+	if (cache && bitmap_empty(mit->found, h_mods->sz))
+		return __tfw_h2_resp_add_data(resp, &h_mods->h2);
+
 	for (i = 0; i < h_mods->sz; ++i) {
 		const TfwHdrModsDesc *desc = &h_mods->hdrs[i];
 		int r;
@@ -3952,7 +4779,11 @@ tfw_h2_resp_add_loc_hdrs(TfwHttpResp *resp, const TfwHdrMods *h_mods,
 		if (test_bit(i, mit->found) || !TFW_STR_CHUNK(desc->hdr, 1))
 			continue;
 
-		r = tfw_hpack_encode(resp, desc->hdr, op, !cache);
+		if (cache)
+			r = __tfw_h2_resp_add_data(resp, &desc->h2);
+		else
+			r = tfw_hpack_encode(resp, desc->hdr,
+					     TFW_H2_TRANS_EXPAND, true);
 		if (unlikely(r))
 			return r;
 	}
@@ -3961,30 +4792,23 @@ tfw_h2_resp_add_loc_hdrs(TfwHttpResp *resp, const TfwHdrMods *h_mods,
 }
 
 /*
- * Get next header from the @mit->map. Procedure designed to be called from the
- * outer cycle with changing of @mit iterator (including @mit->curr index of
- * current header in the indirection map). Note, for optimization purposes, on
- * each iteration function produces the boundary pointer @mit->bnd for current
- * iteration and the operation instance @mit->next - for the next iteration
- * (including source header @mit->next.s_hdr).
- *
- * TODO #1103: This function should be treated as a foundation for #1103 issue.
+ * Copy the headers of HTTP/1.1 response @resp into the new HTTP/2 header block
+ * in one pass over the @mit->map (i.e. in order of the headers in the
+ * message) with the modifications from @h_mods applied on the way. The
+ * configured headers which aren't found in the response are added later by
+ * tfw_h2_resp_add_loc_hdrs().
  */
 static int
-tfw_h2_resp_next_hdr(TfwHttpResp *resp, const TfwHdrMods *h_mods)
+tfw_h2_resp_copy_hdrs(TfwHttpResp *resp, const TfwHdrMods *h_mods)
 {
 	int r;
 	unsigned int i;
 	TfwHttpTransIter *mit = &resp->mit;
 	TfwHttpHdrMap *map = mit->map;
-	TfwNextHdrOp *next = &mit->next;
 	TfwHttpHdrTbl *ht = resp->h_tbl;
 
-	mit->bnd = NULL;
-
-	for (i = mit->curr; i < map->count; ++i) {
+	for (i = 0; i < map->count; ++i) {
 		int k;
-		TfwStr *first;
 		unsigned short hid = map->index[i].idx;
 		unsigned short d_num = map->index[i].d_idx;
 		TfwStr *tgt = &ht->tbl[hid];
@@ -3994,8 +4818,6 @@ tfw_h2_resp_next_hdr(TfwHttpResp *resp, const TfwHdrMods *h_mods)
 		if (TFW_STR_DUP(tgt))
 			tgt = TFW_STR_CHUNK(tgt, d_num);
 
-		first = TFW_STR_CHUNK(tgt, 0);
-
 		if (WARN_ON_ONCE(!tgt
 				 || TFW_STR_EMPTY(tgt)
 				 || TFW_STR_DUP(tgt)))
@@ -4025,20 +4847,14 @@ tfw_h2_resp_next_hdr(TfwHttpResp *resp, const TfwHdrMods *h_mods)
 		val = TFW_STR_CHUNK(f_desc->hdr, 2);
 		/*
 		 * If this is a duplicate of already processed header,
-		 * leave this duplicate as is (for transformation
-		 * in-place) in case of appending operation, and remove
-		 * it (by skipping) in case of substitution or deletion
-		 * operations.
+		 * copy this duplicate as is in case of appending operation,
+		 * and remove it (by skipping) in case of substitution or
+		 * deletion operations.
 		 */
 		if (test_bit(k, mit->found)) {
 			if (!val || !f_desc->append)
 				continue;
-
-			mit->bnd = first->data;
-			next->s_hdr = *tgt;
-			next->op = TFW_H2_TRANS_INPLACE;
-
-			break;
+			goto copy;
 		}
 
 		__set_bit(k, mit->found);
@@ -4050,12 +4866,9 @@ tfw_h2_resp_next_hdr(TfwHttpResp *resp, const TfwHdrMods *h_mods)
 		if (!val)
 			continue;
 
-		mit->bnd = first->data;
-
 		/*
 		 * If the header configured for value appending,
-		 * concatenate it with the target header in skb for
-		 * subsequent in-place rewriting.
+		 * concatenate it with the target header for copying.
 		 */
 		if (f_desc->append) {
 			TfwStr h_app = {
@@ -4071,16 +4884,14 @@ tfw_h2_resp_next_hdr(TfwHttpResp *resp, const TfwHdrMods *h_mods)
 			r = tfw_strcat(resp->pool, tgt, &h_app);
 			if (unlikely(r))
 				return r;
-
-			next->s_hdr = *tgt;
-			next->op = TFW_H2_TRANS_INPLACE;
-			break;
+			goto copy;
 		}
 
-		next->s_hdr = *f_desc->hdr;
-		next->op = TFW_H2_TRANS_SUB;
-		break;
-
+		r = tfw_hpack_encode(resp, f_desc->hdr, TFW_H2_TRANS_EXPAND,
+				     true);
+		if (unlikely(r))
+			return r;
+		continue;
 def:
 		/*
 		 * Remove 'Connection', 'Keep-Alive' headers and all hop-by-hop
@@ -4099,23 +4910,58 @@ def:
 		 */
 		if (hid == TFW_HTTP_HDR_SERVER)
 			continue;
-
-		/*
-		 * In general case the header should be transformed in-place
-		 * from its original HTTP/1.1-representation in skb.
-		 */
-		mit->bnd = first->data;
-		next->s_hdr = *tgt;
-		next->op = TFW_H2_TRANS_INPLACE;
-
-		break;
+copy:
+		r = tfw_hpack_encode(resp, tgt, TFW_H2_TRANS_COPY, true);
+		if (unlikely(r))
+			return r;
 	}
 
-	mit->curr = i + 1;
-
 	return 0;
 }
 
+/*
+ * Evict the HTTP/1.1 status line and headers from the beginning of the
+ * original skbs @skb_head of response @resp, so only the response body is
+ * left in the skbs.
+ */
+static int
+tfw_h2_resp_cut_hdrs(TfwHttpResp *resp, struct sk_buff **skb_head)
+{
+	int i, r;
+	unsigned int off;
+	struct sk_buff *skb;
+	TfwStr *last = TFW_STR_LAST(&resp->crlf);
+	char *end = last->data + last->len;
+	TfwMsgIter it = { .skb = *skb_head, .skb_head = *skb_head };
+
+	if ((r = tfw_http_iter_set_at(&it, end)))
+		return r;
+
+	while ((skb = *skb_head) != it.skb) {
+		ss_skb_unlink(skb_head, skb);
+		kfree_skb(skb);
+	}
+
+	if (it.frag < 0) {
+		off = end - (char *)skb->data;
+	} else {
+		skb_frag_t *frag = &skb_shinfo(skb)->frags[it.frag];
+
+		off = skb_headlen(skb);
+		for (i = 0; i < it.frag; ++i)
+			off += skb_frag_size(&skb_shinfo(skb)->frags[i]);
+		off += end - (char *)skb_frag_address(frag);
+	}
+
+	if (off == skb->len) {
+		ss_skb_unlink(skb_head, skb);
+		kfree_skb(skb);
+		return 0;
+	}
+
+	return off ? ss_skb_chop_head_tail(*skb_head, skb, off, 0) : 0;
+}
+
 #define __tfw_h2_make_frames(len, hdr_flags)				\
 do {									\
 	r = tfw_msg_iter_move(iter, (unsigned char **)&data,		\
@@ -4187,7 +5033,7 @@ tfw_h2_append_predefined_body(TfwHttpResp *resp, unsigned int stream_id,
 		frame_hdr.flags = len ? 0 : HTTP2_F_END_STREAM;
 		frame_hdr.length = copy;
 
-		if (!(page = alloc_page(GFP_ATOMIC))) {
+		if (!(page = ss_skb_page_alloc())) {
 			return -ENOMEM;
 		}
 		p = page_address(page);
@@ -4219,6 +5065,8 @@ tfw_h2_append_predefined_body(TfwHttpResp *resp, unsigned int stream_id,
  * @resp		- response to be framed.
  * @stream_id		- HTTP/2 stream id.
  * @h_len		- total length of HTTP headers.
+ * @body		- original skbs of forwarded response with the body
+ *			  only, the function takes ownership of them.
  * @local_response	- response is generated locally by Tempesta,
  *			  all foreign responses represents responses converted
  *			  from h1 to h2 and require some additional processing.
@@ -4238,8 +5086,8 @@ tfw_h2_append_predefined_body(TfwHttpResp *resp, unsigned int stream_id,
  */
 static int
 tfw_h2_make_frames(TfwHttpResp *resp, unsigned int stream_id,
-		   unsigned long h_len, bool local_response,
-		   bool local_body)
+		   unsigned long h_len, struct sk_buff *body,
+		   bool local_response, bool local_body)
 {
 	int r;
 	char *data;
@@ -4251,6 +5099,14 @@ tfw_h2_make_frames(TfwHttpResp *resp, unsigned int stream_id,
 	TfwMsgIter *iter = &mit->iter;
 	TfwH2Ctx *ctx = tfw_h2_context(resp->req->conn);
 	unsigned long max_sz = ctx->rsettings.max_frame_sz;
+	/*
+	 * DATA frames are sent only whole, so they must fit the initial
+	 * stream window.
+	 */
+	unsigned long d_max_sz = ctx->rsettings.wnd_sz
+				 ? min_t(unsigned long, max_sz,
+					 ctx->rsettings.wnd_sz)
+				 : max_sz;
 	unsigned char fr_flags = (b_len || local_body)
 			? HTTP2_F_END_HEADERS
 			: HTTP2_F_END_HEADERS | HTTP2_F_END_STREAM;
@@ -4261,8 +5117,10 @@ tfw_h2_make_frames(TfwHttpResp *resp, unsigned int stream_id,
 	 * First frame header before HEADERS block. A data enough to store
 	 * the header is reserved at the beginning of the skb data.
 	 */
-	if (WARN_ON_ONCE(!(skb_headlen(resp->msg.skb_head))))
+	if (WARN_ON_ONCE(!(skb_headlen(resp->msg.skb_head)))) {
+		ss_skb_queue_purge(&body);
 		return -ENOMEM;
+	}
 	frame_hdr.type = HTTP2_HEADERS;
 	frame_hdr.length = min(max_sz, h_len);
 	frame_hdr.flags = (h_len <= max_sz) ? fr_flags : 0;
@@ -4271,33 +5129,27 @@ tfw_h2_make_frames(TfwHttpResp *resp, unsigned int stream_id,
 	memcpy_fast(data, buf, sizeof(buf));
 
 	/*
-	 * In responses built locally headers fragments are added one by one
-	 * when needed, while forwarded responses may have extra space after
-	 * h1-> h2 transformation, since h2 messages are generally smaller
-	 * than h1 ones. When this function is called, all headers just have
-	 * been added and message iterator points at the end of the last header
-	 * and protected from overwriting body. Use this immediately to put the
-	 * first body hrame header and cut extra data after it. It's possible
-	 * to do in reverse order, but we save a few fragment operations here.
+	 * The header block of a forwarded response is built in new skbs, so
+	 * put the first body frame header at the end of the block and attach
+	 * the original skbs with the body after it.
 	 */
 	if (!local_response) {
 		if (b_len) {
-			frame_hdr.length = min(max_sz, b_len);
+			frame_hdr.length = min(d_max_sz, b_len);
 			frame_hdr.type = HTTP2_DATA;
 			frame_hdr.flags = (frame_hdr.length == b_len)
 					? HTTP2_F_END_STREAM : 0;
 			tfw_h2_pack_frame_header(buf, &frame_hdr);
 
-			r = tfw_h2_msg_rewrite_data(mit, &frame_hdr_str,
-						    mit->bnd);
-			if (unlikely(r))
+			r = tfw_http_msg_expand_data(iter, &resp->msg.skb_head,
+						     &frame_hdr_str, NULL);
+			if (unlikely(r)) {
+				ss_skb_queue_purge(&body);
 				return r;
+			}
 		}
-
-		r = ss_skb_cut_extra_data(iter->skb_head, iter->skb, iter->frag,
-					  mit->curr_ptr, mit->bnd);
-		if (unlikely(r))
-			return r;
+		if (body)
+			ss_skb_queue_append(&resp->msg.skb_head, body);
 	}
 
 	/* Add more frame headers for HEADER block. */
@@ -4317,7 +5169,7 @@ tfw_h2_make_frames(TfwHttpResp *resp, unsigned int stream_id,
 		return 0;
 
 	/* Add more frame headers for DATA block. */
-	if (b_len > max_sz) {
+	if (b_len > d_max_sz) {
 		unsigned long skew = 0;
 
 		iter->skb = resp->body.skb;
@@ -4325,6 +5177,7 @@ tfw_h2_make_frames(TfwHttpResp *resp, unsigned int stream_id,
 		if ((r = tfw_http_iter_set_at(iter, data)))
 			return r;
 
+		max_sz = d_max_sz;
 		b_len -= max_sz;
 		frame_hdr.type = HTTP2_DATA;
 		__tfw_h2_make_frames(b_len, HTTP2_F_END_STREAM);
@@ -4338,9 +5191,9 @@ tfw_h2_make_frames(TfwHttpResp *resp, unsigned int stream_id,
  */
 int
 tfw_h2_frame_fwd_resp(TfwHttpResp *resp, unsigned int stream_id,
-		     unsigned long h_len)
+		      unsigned long h_len, struct sk_buff *body)
 {
-	return tfw_h2_make_frames(resp, stream_id, h_len, false, false);
+	return tfw_h2_make_frames(resp, stream_id, h_len, body, false, false);
 }
 
 /**
@@ -4352,7 +5205,7 @@ tfw_h2_frame_local_resp(TfwHttpResp *resp, unsigned int stream_id,
 {
 	int r;
 
-	r = tfw_h2_make_frames(resp, stream_id, h_len, true,
+	r = tfw_h2_make_frames(resp, stream_id, h_len, NULL, true,
 			       body ? body->len : false);
 	if (r)
 		return r;
@@ -4360,6 +5213,29 @@ tfw_h2_frame_local_resp(TfwHttpResp *resp, unsigned int stream_id,
 	return tfw_h2_append_predefined_body(resp, stream_id, body);
 }
 
+/*
+ * Free the skbs of the streamed response @resp which are already sent to the
+ * client, so only the rest of the response is forwarded. The response
+ * must not be accessed through its TfwStr descriptors after the call.
+ */
+static int
+tfw_http_resp_stream_cut(TfwHttpResp *resp)
+{
+	struct sk_buff *skb_head = resp->msg.skb_head, *skb;
+
+	if (!resp->stream_last)
+		return 0;
+	/* The last skb of the response is never streamed. */
+	skb = resp->stream_last->next;
+	if (WARN_ON_ONCE(skb == skb_head))
+		return -EINVAL;
+	ss_skb_queue_split(skb_head, skb);
+	resp->msg.skb_head = skb;
+	ss_skb_queue_purge(&skb_head);
+
+	return 0;
+}
+
 static void
 tfw_h1_resp_adjust_fwd(TfwHttpResp *resp)
 {
@@ -4378,6 +5254,19 @@ tfw_h1_resp_adjust_fwd(TfwHttpResp *resp)
 		tfw_http_resp_pair_free(req);
 		return;
 	}
+	/*
+	 * The head of the streamed response is already adjusted and sent
+	 * along with a part of the body, forward the rest of the response.
+	 */
+	if (test_bit(TFW_HTTP_B_REQ_STREAMED, req->flags)) {
+		if (unlikely(tfw_http_resp_stream_cut(resp))) {
+			tfw_http_conn_msg_free((TfwHttpMsg *)resp);
+			tfw_http_resp_build_error(req);
+			return;
+		}
+		tfw_http_resp_fwd(resp);
+		return;
+	}
 	/*
 	 * Typically we're at a node far from the node where @resp was
 	 * received, so we do an inter-node transfer. However, this is
@@ -4503,6 +5392,8 @@ tfw_h1_error_resp(TfwHttpReq *req, int status, bool reply, bool attack,
 {
 	TfwCliConn *cli_conn = (TfwCliConn *)req->conn;
 
+	if (tfw_http_req_streamed_close(req))
+		return;
 	/* The client connection is to be closed with the last resp sent. */
 	reply &= !test_bit(TFW_HTTP_B_REQ_DROP, req->flags);
 	if (reply) {
@@ -4652,11 +5543,10 @@ tfw_h2_resp_adjust_fwd(TfwHttpResp *resp)
 {
 	int r;
 	unsigned int stream_id;
-	bool hdrs_end = false;
+	struct sk_buff *body;
 	TfwHttpReq *req = resp->req;
 	TfwH2Ctx *ctx = tfw_h2_context(req->conn);
 	TfwHttpTransIter *mit = &resp->mit;
-	TfwNextHdrOp *next = &mit->next;
 	const TfwHdrMods *h_mods = tfw_vhost_get_hdr_mods(req->location,
 							  req->vhost,
 							  TFW_VHOST_HDRMOD_RESP);
@@ -4670,46 +5560,25 @@ tfw_h2_resp_adjust_fwd(TfwHttpResp *resp)
 		goto out;
 
 	/*
-	 * Transform HTTP/1.1 headers into HTTP/2 form, in parallel with
-	 * adjusting of particular headers.
+	 * Build HTTP/2 header block in new skbs in one pass over HTTP/1.1
+	 * headers, in parallel with adjusting of particular headers. The
+	 * original skbs are left for the response body only.
 	 */
-	WARN_ON_ONCE(mit->acc_len || mit->curr);
+	WARN_ON_ONCE(mit->acc_len);
 
-	tfw_h2_msg_transform_setup(mit, resp->msg.skb_head, true);
+	body = resp->msg.skb_head;
+	resp->msg.skb_head = NULL;
+	bzero_fast(&mit->iter, sizeof(mit->iter));
+	mit->start_off = FRAME_HEADER_SIZE;
 
-	r = tfw_h2_resp_next_hdr(resp, h_mods);
+	r = tfw_h2_resp_status_write(resp, resp->status, false);
 	if (unlikely(r))
 		goto clean;
 
-	r = tfw_h2_resp_status_write(resp, resp->status, TFW_H2_TRANS_SUB,
-				     false);
+	r = tfw_h2_resp_copy_hdrs(resp, h_mods);
 	if (unlikely(r))
 		goto clean;
 
-	if (WARN_ON_ONCE(!mit->bnd))
-		goto clean;
-
-	do {
-		TfwStr *last;
-		TfwStr hdr = next->s_hdr;
-		TfwH2TransOp op = next->op;
-
-		r = tfw_h2_resp_next_hdr(resp, h_mods);
-		if (unlikely(r))
-			goto clean;
-
-		if (!mit->bnd) {
-			last = TFW_STR_LAST(&resp->crlf);
-			mit->bnd = last->data + last->len;
-			hdrs_end = true;
-		}
-
-		r = tfw_hpack_encode(resp, &hdr, op, true);
-		if (unlikely(r))
-			goto clean;
-
-	} while (!hdrs_end);
-
 	/*
 	 * Write additional headers in HTTP/2 format in the end of the
 	 * headers block, including configured headers which haven't been
@@ -4725,7 +5594,7 @@ tfw_h2_resp_adjust_fwd(TfwHttpResp *resp)
 		goto clean;
 
 	if (!test_bit(TFW_HTTP_B_HDR_DATE, resp->flags)) {
-		r = tfw_h2_add_hdr_date(resp, TFW_H2_TRANS_ADD, false);
+		r = tfw_h2_add_hdr_date(resp, false);
 		if (unlikely(r))
 			goto clean;
 	}
@@ -4738,7 +5607,12 @@ tfw_h2_resp_adjust_fwd(TfwHttpResp *resp)
 	if (unlikely(r))
 		goto clean;
 
-	r = tfw_h2_frame_fwd_resp(resp, stream_id, mit->acc_len);
+	r = tfw_h2_resp_cut_hdrs(resp, &body);
+	if (unlikely(r))
+		goto clean;
+
+	r = tfw_h2_frame_fwd_resp(resp, stream_id, mit->acc_len, body);
+	body = NULL;
 	if (unlikely(r))
 		goto clean;
 
@@ -4746,6 +5620,7 @@ tfw_h2_resp_adjust_fwd(TfwHttpResp *resp)
 
 	return;
 clean:
+	ss_skb_queue_purge(&body);
 	tfw_http_conn_msg_free((TfwHttpMsg *)resp);
 	if (!(tfw_blk_flags & TFW_BLK_ERR_NOLOG))
 		T_WARN_ADDR_STATUS("response dropped: processing error",
@@ -4772,6 +5647,10 @@ tfw_http_req_cache_service(TfwHttpResp *resp)
 	WARN_ON_ONCE(!list_empty(&req->fwd_list));
 	WARN_ON_ONCE(!list_empty(&req->nip_list));
 
+	tfw_vhost_lat_stats_update(req->vhost, req->location,
+				   TFW_LAT_STATS_CACHE,
+				   jiffies - req->jrxtstamp);
+	__set_bit(TFW_HTTP_B_RESP_CACHED, resp->flags);
 	if (TFW_MSG_H2(req))
 		tfw_h2_resp_fwd(resp);
 	else
@@ -4780,26 +5659,580 @@ tfw_http_req_cache_service(TfwHttpResp *resp)
 	TFW_INC_STAT_BH(clnt.msgs_fromcache);
 }
 
+/*
+ * Parse background request @bg_req, which is built from skbs in its own
+ * message, and bind it to the vhost and location of client request @req.
+ * The request is built by us, but it must be parsed anyway to be processed
+ * by the cache and the schedulers as a regular request. @flag tells the
+ * kind of the background request.
+ */
+static int
+tfw_http_req_bg_init(TfwHttpReq *bg_req, TfwHttpReq *req, unsigned int flag)
+{
+	int r;
+	TfwStream *stream;
+	TfwHttpMsg *hmreq = (TfwHttpMsg *)bg_req;
+	unsigned int parsed = 0;
+
+	if (!(stream = tfw_pool_alloc(hmreq->pool, sizeof(TfwStream))))
+		return -ENOMEM;
+	bzero_fast(stream, sizeof(TfwStream));
+	hmreq->stream = stream;
+	tfw_http_init_parser_req(bg_req);
+	r = ss_skb_process(hmreq->msg.skb_head, 0, tfw_http_parse_req, bg_req,
+			   &bg_req->chunk_cnt, &parsed);
+	hmreq->stream = NULL;
+	if (WARN_ON_ONCE(r != TFW_PASS))
+		return -EINVAL;
+	hmreq->msg.len = parsed;
+
+	__set_bit(flag, bg_req->flags);
+	bg_req->jrxtstamp = jiffies;
+	bg_req->cache_ctl.timestamp = tfw_current_timestamp();
+	bg_req->node = req->node;
+	bg_req->vhost = req->vhost;
+	tfw_vhost_get(bg_req->vhost);
+	bg_req->location = req->location;
+	bg_req->priority = req->priority;
+
+	return 0;
+}
+
+/*
+ * Requests hedging.
+ *
+ * An idempotent request to a location with hedging enabled is copied before
+ * forwarding. If the request isn't answered within the configured APM
+ * percentile of the server response time, then the copy is sent to another
+ * server of the group. The first response wins.
+ *
+ * The copy is a background request, just like cache revalidation requests:
+ * it isn't bound to a client connection, so it can't be dropped or answered
+ * with an error on its own. If the original request gets its response first,
+ * then the response to the copy is only stored in the cache. If the copy gets
+ * its response first, then the original request takes the response and the
+ * copy takes the place of the original request in the forwarding queue, so
+ * the pairing of pipelined responses isn't broken. The late response is then
+ * only stored in the cache.
+ *
+ * The original request may be rescheduled, evicted or answered and freed at
+ * any time, so the copy never dereferences it: it's only looked up in the
+ * forwarding queue of the server connection it was forwarded to, under the
+ * queue lock. The copy holds a reference to the server connection.
+ */
+#define TFW_HTTP_HEDGE_SCHED_TRIES	2
+
+static unsigned int
+tfw_http_req_hedge_pidx(TfwHttpReq *req)
+{
+	/* TODO #862: req->location must be the full set of options. */
+	if (req->location && req->location->hedge_pidx)
+		return req->location->hedge_pidx;
+	if (req->vhost->loc_dflt && req->vhost->loc_dflt->hedge_pidx)
+		return req->vhost->loc_dflt->hedge_pidx;
+	if (req->vhost->vhost_dflt)
+		return req->vhost->vhost_dflt->loc_dflt->hedge_pidx;
+
+	return 0;
+}
+
+/*
+ * Find the original request of hedged copy @hreq that is still waiting for
+ * a response. Only requests in the forwarding queue are dereferenced;
+ * the queue must be locked.
+ */
+static TfwHttpReq *
+__tfw_http_req_hedge_orig(TfwHttpReq *hreq)
+{
+	TfwHttpReq *req;
+	TfwHttpHedge *hedge = hreq->hedge;
+
+	if (!hedge->req)
+		return NULL;
+	list_for_each_entry(req, &hedge->srv_conn->fwd_queue, fwd_list)
+		if (req == hedge->req && req->hedge == hedge)
+			return req->pair ? NULL : req;
+
+	return NULL;
+}
+
+/*
+ * The original request is overdue: send the hedged copy to another server,
+ * or just free the copy if the request is answered already.
+ */
+static void
+tfw_http_req_hedge_tmfn(unsigned long data)
+{
+	int i;
+	TfwHttpReq *hreq = (TfwHttpReq *)data;
+	TfwSrvConn *srv_conn = hreq->hedge->srv_conn, *sch_conn;
+	bool pending;
+	LIST_HEAD(eq);
+
+	spin_lock(&srv_conn->fwd_qlock);
+	pending = __tfw_http_req_hedge_orig(hreq);
+	spin_unlock(&srv_conn->fwd_qlock);
+	if (!pending)
+		goto drop;
+
+	for (i = 0; i < TFW_HTTP_HEDGE_SCHED_TRIES; ++i) {
+		if (!(sch_conn = tfw_http_get_srv_conn((TfwMsg *)hreq)))
+			goto drop;
+		if (sch_conn->peer != srv_conn->peer)
+			goto fwd;
+		tfw_srv_conn_put(sch_conn);
+	}
+drop:
+	tfw_http_msg_free((TfwHttpMsg *)hreq);
+	return;
+fwd:
+	T_DBG2("%s: hedge req=[%p] to srv_conn=[%p]\n",
+	       __func__, hreq, sch_conn);
+	tfw_http_req_fwd(sch_conn, hreq, &eq, false);
+	tfw_http_req_zap_error(&eq);
+	tfw_srv_conn_put(sch_conn);
+}
+
+/*
+ * Prepare a hedged copy of request @req which is about to be forwarded to
+ * server connection @srv_conn. The copy is built from the already adjusted
+ * request, so it's ready for forwarding as is. The hedging deadline is
+ * armed by tfw_http_req_hedge_arm() after the request is forwarded.
+ */
+static TfwHttpReq *
+tfw_http_req_hedge_new(TfwHttpReq *req, TfwSrvConn *srv_conn)
+{
+	TfwHttpReq *hreq;
+	TfwHttpHedge *hedge;
+	TfwServer *srv = (TfwServer *)srv_conn->peer;
+	struct sk_buff *skb, *twin_skb;
+	unsigned int pidx, val[ARRAY_SIZE(tfw_pstats_ith)] = { 0 };
+	TfwPrcntlStats pstats = {
+		.ith = tfw_pstats_ith,
+		.val = val,
+		.psz = ARRAY_SIZE(tfw_pstats_ith),
+	};
+
+	if (likely(!(pidx = tfw_http_req_hedge_pidx(req)))
+	    || tfw_http_req_is_nip(req) || !req->msg.skb_head
+	    || !srv->apmref)
+		return NULL;
+	/* There is no deadline until the server response time is known. */
+	tfw_apm_stats_bh(srv->apmref, &pstats);
+	if (!val[pidx])
+		return NULL;
+
+	if (!(hreq = (TfwHttpReq *)__tfw_http_msg_alloc(Conn_HttpClnt, true)))
+		return NULL;
+	skb = req->msg.skb_head;
+	do {
+		if (!(twin_skb = pskb_copy_for_clone(skb, GFP_ATOMIC)))
+			goto err;
+		ss_skb_queue_tail(&hreq->msg.skb_head, twin_skb);
+		skb = skb->next;
+	} while (skb != req->msg.skb_head);
+	if (tfw_http_req_bg_init(hreq, req, TFW_HTTP_B_CACHE_BG))
+		goto err;
+	hreq->jrxtstamp = req->jrxtstamp;
+
+	if (!(hedge = tfw_pool_alloc(hreq->pool, sizeof(TfwHttpHedge))))
+		goto err;
+	setup_timer(&hedge->timer, tfw_http_req_hedge_tmfn,
+		    (unsigned long)hreq);
+	hedge->tmo = msecs_to_jiffies(val[pidx]);
+	hedge->srv_conn = srv_conn;
+	tfw_srv_conn_get(srv_conn);
+	hedge->req = req;
+	hreq->hedge = req->hedge = hedge;
+	__set_bit(TFW_HTTP_B_REQ_HEDGE, hreq->flags);
+
+	return hreq;
+err:
+	tfw_http_msg_free((TfwHttpMsg *)hreq);
+	return NULL;
+}
+
+static inline void
+tfw_http_req_hedge_arm(TfwHttpReq *hreq)
+{
+	TfwHttpHedge *hedge = hreq->hedge;
+
+	mod_timer(&hedge->timer, jiffies + hedge->tmo);
+}
+
+/*
+ * Response @hmresp to hedged copy @hreq is received. If the original request
+ * is still waiting for its response, then hand @hmresp over to it and put
+ * the copy in place of the original request into the forwarding queue.
+ * Return the request that @hmresp is paired with.
+ */
+static TfwHttpReq *
+tfw_http_req_hedge_win(TfwHttpMsg *hmresp, TfwHttpReq *hreq)
+{
+	TfwHttpReq *req;
+	TfwSrvConn *srv_conn = hreq->hedge->srv_conn;
+
+	spin_lock(&srv_conn->fwd_qlock);
+	if (!(req = __tfw_http_req_hedge_orig(hreq))) {
+		spin_unlock(&srv_conn->fwd_qlock);
+		return hreq;
+	}
+	WARN_ON_ONCE(!list_empty(&req->nip_list));
+	list_replace_init(&req->fwd_list, &hreq->fwd_list);
+	if ((TfwMsg *)req == srv_conn->msg_sent)
+		srv_conn->msg_sent = (TfwMsg *)hreq;
+	hreq->jtxtstamp = req->jtxtstamp;
+	hreq->hedge->req = NULL;
+	spin_unlock(&srv_conn->fwd_qlock);
+
+	T_DBG2("%s: hedge req=[%p] won over req=[%p]\n", __func__, hreq, req);
+	hreq->resp = NULL;
+	hmresp->req = NULL;
+	tfw_http_msg_pair((TfwHttpResp *)hmresp, req);
+
+	return req;
+}
+
+/*
+ * Traffic mirroring.
+ *
+ * A sampled share of requests to a location with traffic mirroring enabled
+ * is copied to a shadow server group, e.g. running a new version of the
+ * application, and the responses from the group are just discarded.
+ *
+ * The copy is built from the already adjusted request. Its skbs are clones
+ * referencing the data of the original request, so the data isn't copied.
+ * Like health monitoring and background requests, the copy has no client
+ * connection, so it never affects the client and it's silently dropped on
+ * any error. The shadow group caps the rate and the number in flight of the
+ * mirrored requests, so it can't take resources from the real traffic.
+ */
+static TfwHttpReq *
+tfw_http_req_mirror_new(TfwHttpReq *req)
+{
+	TfwHttpReq *mreq;
+	TfwLocation *loc;
+	struct sk_buff *skb, *twin_skb;
+
+	if (likely(!(loc = tfw_vhost_mirror_location((TfwMsg *)req)))
+	    || !req->msg.skb_head)
+		return NULL;
+	if (loc->mirror_ratio < 100
+	    && prandom_u32_max(100) >= loc->mirror_ratio)
+		return NULL;
+	if (!tfw_sg_mirror_get(loc->mirror_sg)) {
+		TFW_INC_STAT_BH(clnt.mirror_capped);
+		return NULL;
+	}
+
+	if (!(mreq = (TfwHttpReq *)__tfw_http_msg_alloc(Conn_HttpClnt, true)))
+		goto err;
+	skb = req->msg.skb_head;
+	do {
+		if (!(twin_skb = skb_clone(skb, GFP_ATOMIC)))
+			goto err;
+		ss_skb_queue_tail(&mreq->msg.skb_head, twin_skb);
+		skb = skb->next;
+	} while (skb != req->msg.skb_head);
+	/* Once the flag is set, the request destructor releases the slot. */
+	if (tfw_http_req_bg_init(mreq, req, TFW_HTTP_B_REQ_MIRROR))
+		goto err;
+	mreq->jrxtstamp = req->jrxtstamp;
+
+	return mreq;
+err:
+	if (!mreq || !test_bit(TFW_HTTP_B_REQ_MIRROR, mreq->flags))
+		tfw_sg_mirror_put(loc->mirror_sg);
+	if (mreq)
+		tfw_http_msg_free((TfwHttpMsg *)mreq);
+	return NULL;
+}
+
+/*
+ * Send mirrored request @mreq to the shadow server group.
+ */
+static void
+tfw_http_req_mirror_fwd(TfwHttpReq *mreq)
+{
+	TfwSrvConn *srv_conn;
+	LIST_HEAD(eq);
+
+	if (!(srv_conn = tfw_http_get_srv_conn((TfwMsg *)mreq))) {
+		T_DBG2("Unable to find a shadow server for mirrored request\n");
+		tfw_http_msg_free((TfwHttpMsg *)mreq);
+		return;
+	}
+
+	T_DBG2("%s: mirror req=[%p] to srv_conn=[%p]\n",
+	       __func__, mreq, srv_conn);
+	tfw_http_req_fwd(srv_conn, mreq, &eq, false);
+	tfw_http_req_zap_error(&eq);
+	tfw_srv_conn_put(srv_conn);
+	TFW_INC_STAT_BH(clnt.msgs_mirrored);
+}
+
 /**
  * Depending on results of processing of a request, either send the request
  * to an appropriate server, or return the cached response. If none of that
  * can be done for any reason, return HTTP 500 or 502 error to the client.
  */
+static int
+tfw_h1_send_early_hints(TfwHttpResp *resp, const TfwHdrMods *h_mods)
+{
+	int r;
+	TfwMsgIter it;
+	TfwHttpReq *req = resp->req;
+	TfwCliConn *cli_conn = (TfwCliConn *)req->conn;
+	TfwStr msg = {
+		.chunks = (TfwStr []){
+			{ .data = S_103 S_CRLF,	.len = SLEN(S_103 S_CRLF) },
+			{ .data = h_mods->h1.data, .len = h_mods->h1.len },
+			{ .data = S_CRLF,	.len = SLEN(S_CRLF) }
+		},
+		.len = SLEN(S_103 S_CRLF) + h_mods->h1.len + SLEN(S_CRLF),
+		.nchunks = 3
+	};
+
+	if ((r = tfw_http_msg_setup((TfwHttpMsg *)resp, &it, msg.len, 0))
+	    || (r = tfw_msg_write(&it, &msg)))
+		return r;
+
+	/*
+	 * The responses to the previous requests must go first, so send
+	 * the hints only if @req is at the head of @seq_queue. The responses
+	 * cut off the queue are sent under @ret_qlock, see
+	 * tfw_http_resp_fwd().
+	 */
+	spin_lock_bh(&cli_conn->seq_qlock);
+	if (list_first_entry_or_null(&cli_conn->seq_queue, TfwHttpReq,
+				     msg.seq_list) != req)
+	{
+		spin_unlock_bh(&cli_conn->seq_qlock);
+		return 0;
+	}
+	spin_lock_bh(&cli_conn->ret_qlock);
+	spin_unlock_bh(&cli_conn->seq_qlock);
+
+	r = tfw_cli_conn_send(cli_conn, (TfwMsg *)resp);
+
+	spin_unlock_bh(&cli_conn->ret_qlock);
+
+	return r;
+}
+
+static int
+tfw_h2_send_early_hints(TfwHttpResp *resp, const TfwHdrMods *h_mods)
+{
+	int r;
+	TfwHttpReq *req = resp->req;
+	TfwHttpTransIter *mit = &resp->mit;
+	unsigned int stream_id = tfw_h2_stream_id(req);
+
+	/* The stream is already reset by the client. */
+	if (!stream_id)
+		return 0;
+
+	mit->start_off = FRAME_HEADER_SIZE;
+	if ((r = tfw_h2_resp_status_write(resp, 103, true))
+	    || (r = __tfw_h2_resp_add_data(resp, &h_mods->h2)))
+		return r;
+	/*
+	 * The final response follows on the stream, so frame the hints as
+	 * a response with a body to not end the stream.
+	 */
+	r = tfw_h2_make_frames(resp, stream_id, mit->acc_len, NULL, true,
+			       true);
+	if (r)
+		return r;
+
+	return tfw_h2_resp_xmit(tfw_h2_context(req->conn), (TfwMsg *)resp);
+}
+
+/**
+ * Send 103 Early Hints (RFC 8297) with the Link headers configured for the
+ * request location, so the client starts to preload the page subresources
+ * while the request is being processed by a backend server. The hints are
+ * a best effort: they aren't sent to HTTP/1.0 clients, and errors are left
+ * to the final response.
+ */
+static void
+tfw_http_send_early_hints(TfwHttpReq *req)
+{
+	int r;
+	TfwHttpResp *resp;
+	const TfwHdrMods *h_mods;
+
+	h_mods = tfw_vhost_get_hdr_mods(req->location, req->vhost,
+					TFW_VHOST_HDRMOD_HINTS);
+	if (!h_mods || (!TFW_MSG_H2(req) && req->version < TFW_HTTP_VER_11))
+		return;
+
+	/* The interim response isn't paired with @req. */
+	if (!(resp = (TfwHttpResp *)__tfw_http_msg_alloc(Conn_Srv, false)))
+		return;
+	resp->req = req;
+
+	r = TFW_MSG_H2(req)
+		? tfw_h2_send_early_hints(resp, h_mods)
+		: tfw_h1_send_early_hints(resp, h_mods);
+	if (r)
+		T_DBG("%s: cannot send early hints: conn=[%p] r=%d\n",
+		      __func__, req->conn, r);
+
+	resp->req = NULL;
+	tfw_http_msg_free((TfwHttpMsg *)resp);
+}
+
+/*
+ * Get @path of the resource to push from Link header @val configured by
+ * 'early_hint' directive, e.g. "</css/main.css>; rel=preload; as=style".
+ * Only preloaded resources of the same origin are pushed.
+ */
+static bool
+tfw_h2_push_path(const TfwStr *val, TfwStr *path)
+{
+	char *p = val->data, *gt;
+
+	if (val->len < 3 || p[0] != '<' || p[1] != '/')
+		return false;
+	if (!(gt = memchr(p, '>', val->len)))
+		return false;
+	*path = (TfwStr){ .data = p + 1, .len = gt - p - 1 };
+
+	return strnstr(gt, "rel=preload", p + val->len - gt);
+}
+
+/*
+ * Build the header block of the promised GET request of @path to @host in
+ * @hb. The block doesn't use the HPACK dynamic table, so it doesn't depend
+ * on the order of the header blocks of the connection.
+ */
+static int
+tfw_h2_push_hblock(TfwHttpReq *req, const TfwStr *host, const TfwStr *path,
+		   TfwStr *hb)
+{
+	char *auth;
+	TfwStr h_meth = { .hpack_idx = 2, .flags = TFW_STR_FULL_INDEX };
+	TfwStr h_scheme = { .hpack_idx = 7, .flags = TFW_STR_FULL_INDEX };
+	TfwStr h_path = {
+		.chunks = (TfwStr []){ {}, *path },
+		.len = path->len,
+		.nchunks = 2,
+		.hpack_idx = 4
+	};
+	TfwStr h_auth = {
+		.chunks = (TfwStr []){ {}, {} },
+		.len = host->len,
+		.nchunks = 2,
+		.hpack_idx = 1
+	};
+
+	auth = tfw_pool_alloc(req->pool, host->len + 1 + h_path.len
+				       + h_auth.len + 2
+				       + 2 * HPACK_ENC_HDR_OVERHEAD);
+	if (!auth)
+		return -ENOMEM;
+	__TFW_STR_CH(&h_auth, 1)->data = auth;
+	__TFW_STR_CH(&h_auth, 1)->len = tfw_str_to_cstr(host, auth,
+							host->len + 1);
+
+	hb->data = auth + host->len + 1;
+	hb->len = tfw_hpack_encode_nodyn(&h_meth, hb->data);
+	hb->len += tfw_hpack_encode_nodyn(&h_scheme, hb->data + hb->len);
+	hb->len += tfw_hpack_encode_nodyn(&h_path, hb->data + hb->len);
+	hb->len += tfw_hpack_encode_nodyn(&h_auth, hb->data + hb->len);
+
+	return 0;
+}
+
+/**
+ * Push the responses to the resources preloaded by the page requested by
+ * @req (RFC 7540 section 8.2), i.e. 'early_hint' Link headers of the request
+ * location with rel=preload. Only the resources stored in the cache are
+ * pushed, within the budget of the connection, and each resource is pushed
+ * once, so the bandwidth isn't wasted on the resources which the client
+ * likely has already. The promises precede the response to @req.
+ */
 static void
+tfw_h2_push(TfwHttpReq *req)
+{
+	int r;
+	unsigned int i, n, id;
+	unsigned long key, left;
+	TfwStr host, path, hb, *val;
+	TfwHttpResp *resp;
+	const TfwHdrMods *h_mods;
+	TfwH2Ctx *ctx = tfw_h2_context(req->conn);
+
+	if (!tfw_h2_push_budget || req->method != TFW_HTTP_METH_GET
+	    || ctx->push_bytes >= tfw_h2_push_budget)
+		return;
+	h_mods = tfw_vhost_get_hdr_mods(req->location, req->vhost,
+					TFW_VHOST_HDRMOD_HINTS);
+	if (!h_mods)
+		return;
+	tfw_http_msg_clnthdr_val(req, &req->h_tbl->tbl[TFW_HTTP_HDR_HOST],
+				 TFW_HTTP_HDR_HOST, &host);
+
+	for (i = 0; i < h_mods->sz; ++i) {
+		val = TFW_STR_CHUNK(h_mods->hdrs[i].hdr, 1);
+		if (!val || !tfw_h2_push_path(val, &path))
+			continue;
+
+		key = tfw_hash_str(&path);
+		if (!TFW_STR_EMPTY(&host))
+			key ^= tfw_hash_str(&host);
+		n = min_t(unsigned int, ctx->push_n, TFW_H2_PUSH_KEYS);
+		while (n && ctx->push_keys[n - 1] != key)
+			--n;
+		if (n)
+			continue;
+
+		if (!(id = tfw_h2_push_id_next(ctx)))
+			return;
+		left = tfw_h2_push_budget - ctx->push_bytes;
+		if (!(resp = tfw_cache_push(req, &path, id, &left)))
+			continue;
+		if (tfw_h2_push_hblock(req, &host, &path, &hb)
+		    || tfw_h2_push_promise(req, id, &hb))
+		{
+			tfw_http_msg_free((TfwHttpMsg *)resp);
+			return;
+		}
+		ctx->push_bytes = tfw_h2_push_budget - left;
+		ctx->push_keys[ctx->push_n++ % TFW_H2_PUSH_KEYS] = key;
+
+		T_DBG("%s: push stream id=%u, req=[%p]\n", __func__, id, req);
+		r = tfw_h2_resp_xmit(ctx, (TfwMsg *)resp);
+		tfw_hpack_enc_release(&ctx->hpack, resp->flags);
+		tfw_http_msg_free((TfwHttpMsg *)resp);
+		tfw_h2_push_close(req, id, r);
+		if (r) {
+			T_DBG("%s: cannot push response\n", __func__);
+			tfw_connection_close(req->conn, true);
+			return;
+		}
+	}
+}
+
+void
 tfw_http_req_cache_cb(TfwHttpMsg *msg)
 {
 	int r;
-	TfwHttpReq *req = (TfwHttpReq *)msg;
+	TfwHttpReq *req = (TfwHttpReq *)msg, *hreq, *mreq;
 	TfwSrvConn *srv_conn = NULL;
 	LIST_HEAD(eq);
 
 	T_DBG2("%s: req = %p, resp = %p\n", __func__, req, req->resp);
 
 	if (req->resp) {
+		req->acct_ts = get_cycles();
 		tfw_http_req_cache_service(req->resp);
 		return;
 	}
 
+	tfw_http_req_stage(req, TFW_HTTP_STAGE_SCHED);
+
 	/*
 	 * Dispatch request to an appropriate server. Schedulers should
 	 * make a decision based on an unmodified request, so this must
@@ -4815,6 +6248,21 @@ tfw_http_req_cache_cb(TfwHttpMsg *msg)
 		T_DBG("Unable to find a backend server\n");
 		goto send_502;
 	}
+	/*
+	 * Shed the request if the servers are saturated: requests queued
+	 * over the concurrency limit only add latency to all of them.
+	 */
+	if (req->conn
+	    && !tfw_http_req_conc_get(req, (TfwServer *)srv_conn->peer))
+	{
+		T_DBG("Concurrency limit of a server group is reached\n");
+		tfw_http_send_resp(req, 503,
+				   "request dropped: concurrency limit");
+		TFW_INC_STAT_BH(clnt.msgs_otherr);
+		goto conn_put;
+	}
+
+	tfw_http_send_early_hints(req);
 
 	r = TFW_MSG_H2(req)
 		? tfw_h2_adjust_req(req)
@@ -4825,9 +6273,17 @@ tfw_http_req_cache_cb(TfwHttpMsg *msg)
 	/* Account current request in APM health monitoring statistics */
 	tfw_http_hm_srv_update((TfwServer *)srv_conn->peer, req);
 
+	/* The request may be gone right after forwarding, copy it before. */
+	hreq = tfw_http_req_hedge_new(req, srv_conn);
+	mreq = tfw_http_req_mirror_new(req);
+
 	/* Forward request to the server. */
 	tfw_http_req_fwd_resched(srv_conn, req, &eq);
 	tfw_http_req_zap_error(&eq);
+	if (hreq)
+		tfw_http_req_hedge_arm(hreq);
+	if (mreq)
+		tfw_http_req_mirror_fwd(mreq);
 	goto conn_put;
 
 send_502:
@@ -4855,6 +6311,12 @@ tfw_http_req_mark_nip(TfwHttpReq *req)
 	BUILD_BUG_ON(sizeof(safe_methods) * BITS_PER_BYTE
 		     < _TFW_HTTP_METH_COUNT);
 
+	/*
+	 * The server connection must be on hold after an upgrade request,
+	 * no other requests may be sent to the server switching protocols.
+	 */
+	if (test_bit(TFW_HTTP_B_CONN_UPGRADE, req->flags))
+		goto nip_match;
 	if (!req->vhost)
 		return;
 	/*
@@ -4896,7 +6358,7 @@ nip_match:
  * Set the flag if @req is non-idempotent. Add the request to the list
  * of the client connection to preserve the correct order of responses.
  * If the request follows a non-idempotent request in flight, then the
- * preceding request becomes idempotent.
+ * preceding request becomes idempotent, unless it's an upgrade request.
  */
 static void
 tfw_http_req_add_seq_queue(TfwHttpReq *req)
@@ -4910,7 +6372,8 @@ tfw_http_req_add_seq_queue(TfwHttpReq *req)
 	spin_lock(&cli_conn->seq_qlock);
 	req_prev = list_empty(seq_queue) ?
 		   NULL : list_last_entry(seq_queue, TfwHttpReq, msg.seq_list);
-	if (req_prev && tfw_http_req_is_nip(req_prev))
+	if (req_prev && tfw_http_req_is_nip(req_prev)
+	    && !test_bit(TFW_HTTP_B_CONN_UPGRADE, req_prev->flags))
 		clear_bit(TFW_HTTP_B_NON_IDEMP, req_prev->flags);
 	list_add_tail(&req->msg.seq_list, seq_queue);
 	spin_unlock(&cli_conn->seq_qlock);
@@ -5003,6 +6466,27 @@ tfw_http_req_client_link(TfwConn *conn, TfwHttpReq *req)
 	return 0;
 }
 
+/**
+ * A request with "Connection: upgrade" may switch the client connection to
+ * a tunnel, see tfw_http_resp_tunnel(), if it's an HTTP/1.1 GET request with
+ * Upgrade header, which is the only request in flight and isn't followed by
+ * pipelined data @skb. Otherwise Upgrade is just a hop-by-hop header.
+ */
+static void
+tfw_h1_req_upgrade(TfwHttpReq *req, struct sk_buff *skb)
+{
+	TfwCliConn *cli_conn = (TfwCliConn *)req->conn;
+
+	if (req->version == TFW_HTTP_VER_11
+	    && req->method == TFW_HTTP_METH_GET
+	    && !test_bit(TFW_HTTP_B_CONN_CLOSE, req->flags)
+	    && !skb && list_empty_careful(&cli_conn->seq_queue)
+	    && tfw_http_keep_hdr_upgrade((TfwHttpMsg *)req))
+		return;
+
+	__clear_bit(TFW_HTTP_B_CONN_UPGRADE, req->flags);
+}
+
 static TfwHttpMsg *
 tfw_h1_req_process(TfwStream *stream, struct sk_buff *skb)
 {
@@ -5031,6 +6515,9 @@ tfw_h1_req_process(TfwStream *stream, struct sk_buff *skb)
 		__set_bit(TFW_HTTP_B_CONN_CLOSE, req->flags);
 	}
 
+	if (test_bit(TFW_HTTP_B_CONN_UPGRADE, req->flags))
+		tfw_h1_req_upgrade(req, skb);
+
 	/*
 	 * The request has been successfully parsed and processed.
 	 * If the connection will be closed after the response to
@@ -5091,6 +6578,348 @@ tfw_h1_req_process(TfwStream *stream, struct sk_buff *skb)
 	return hmsib;
 }
 
+/*
+ * Maximum number of pipelined requests parsed before they're passed to
+ * the cache and forwarded.
+ */
+#define TFW_HTTP_REQ_BATCH	16
+
+/**
+ * Pipelined requests received in the same skb. The requests are parsed and
+ * filtered first and only then passed to the cache and the servers one after
+ * another, so the cache works for a remote node are queued back to back and
+ * a single IPI wakes up the node for all of them, and so are the requests
+ * forwarded to the same server connection.
+ *
+ * @n		- number of the parsed requests;
+ * @reqs	- the parsed requests in order of receiving;
+ */
+typedef struct {
+	unsigned int	n;
+	TfwHttpReq	*reqs[TFW_HTTP_REQ_BATCH];
+} TfwHttpReqBatch;
+
+/*
+ * The host used by HTTP tables, see match_host().
+ */
+void
+tfw_http_req_host(const TfwHttpReq *req, TfwStr *host)
+{
+	if (req->host.len)
+		*host = req->host;
+	else
+		tfw_http_msg_clnthdr_val(req,
+					 &req->h_tbl->tbl[TFW_HTTP_HDR_HOST],
+					 TFW_HTTP_HDR_HOST, host);
+}
+
+/**
+ * Pipelined requests are usually sent to the same host, so if HTTP tables
+ * choose virtual hosts by the host only, the virtual host of the previous
+ * request @prev in the batch is reused for @req with the same host. So is
+ * the location if the URI path is the same.
+ *
+ * @return true if the virtual host is reused.
+ */
+static bool
+tfw_http_req_vhost_reuse(TfwHttpReq *req, const TfwHttpReq *prev)
+{
+	TfwStr host, prev_host;
+
+	if (!prev || !prev->vhost || !tfw_http_tbl_by_host())
+		return false;
+
+	tfw_http_req_host(req, &host);
+	tfw_http_req_host(prev, &prev_host);
+	if (TFW_STR_DUP(&host) || TFW_STR_DUP(&prev_host)
+	    || tfw_stricmp(&host, &prev_host))
+		return false;
+
+	req->vhost = prev->vhost;
+	tfw_vhost_get(req->vhost);
+	req->location = tfw_strcmp(&req->uri_path, &prev->uri_path)
+			? tfw_location_match(req->vhost, &req->uri_path)
+			: prev->location;
+
+	return true;
+}
+
+/**
+ * Shed request @req if the current CPU is saturated, so requests of higher
+ * priority, e.g. health checks of the site, keep working. The CPU load is
+ * estimated by the backlog of the socket and cache works queued to the CPU
+ * by other CPUs: the works are processed in softirq along with the received
+ * packets, so the queues grow once softirq doesn't keep up with the load.
+ * Low priority requests are shed at the configured backlog, normal ones at
+ * twice of it, and high priority requests are never shed.
+ */
+static bool
+tfw_http_req_shed(TfwHttpReq *req)
+{
+	unsigned int prio, backlog, thr = READ_ONCE(tfw_http_shed_backlog);
+
+	if (likely(!thr))
+		return false;
+	prio = tfw_http_req_priority(req);
+	if (prio == TFW_HTTP_PRIO_HIGH)
+		return false;
+	backlog = ss_wq_backlog() + tfw_cache_wq_backlog();
+
+	return backlog >= (prio == TFW_HTTP_PRIO_LOW ? thr : thr * 2);
+}
+
+/*
+ * Pass the parsed and filtered request @req to the cache and further
+ * to a server or respond to the client right away.
+ */
+static void
+tfw_http_req_dispatch(TfwHttpReq *req)
+{
+	tfw_http_req_stage(req, TFW_HTTP_STAGE_CACHE);
+
+	/*
+	 * Response is already prepared for the client by sticky module.
+	 */
+	if (unlikely(req->resp)) {
+		if (TFW_MSG_H2(req))
+			tfw_h2_resp_fwd(req->resp);
+		else
+			tfw_http_resp_fwd(req->resp);
+	}
+	/*
+	 * If no virtual host has been found for current request, there
+	 * is no sense for its further processing, so we drop it, send
+	 * error response to client and move on to the next request.
+	 */
+	else if (unlikely(!req->vhost)) {
+		tfw_http_send_resp(req, 404,
+				   "request dropped: cannot find appropriate "
+				   "virtual host");
+		TFW_INC_STAT_BH(clnt.msgs_otherr);
+	}
+	/*
+	 * Don't spend the CPU on the cache lookup for the shed request, the
+	 * predefined error response is the cheapest one.
+	 */
+	else if (unlikely(tfw_http_req_shed(req))) {
+		tfw_http_send_resp(req, 503, "request dropped: CPU overload");
+		TFW_INC_STAT_BH(clnt.msgs_otherr);
+	}
+	/*
+	 * Throttle the requests of the vhost exceeding its resource budget,
+	 * but not the high priority ones, the same way as for the shedding.
+	 */
+	else if (tfw_http_req_priority(req) != TFW_HTTP_PRIO_HIGH
+		 && unlikely(tfw_vhost_over_budget(req->vhost)))
+	{
+		tfw_http_send_resp(req, 503, "request dropped: vhost budget"
+					     " is exceeded");
+		TFW_INC_STAT_BH(clnt.msgs_otherr);
+	}
+	else {
+		if (TFW_MSG_H2(req))
+			tfw_h2_push(req);
+		if (tfw_cache_process((TfwHttpMsg *)req,
+				      tfw_http_req_cache_cb))
+		{
+			/*
+			 * The request should either be stored or released.
+			 * Otherwise we lose the reference to it and get
+			 * a leak.
+			 */
+			tfw_http_send_resp(req, 500, "request dropped:"
+						     " processing error");
+			TFW_INC_STAT_BH(clnt.msgs_otherr);
+		}
+	}
+}
+
+static void
+tfw_http_req_batch_flush(TfwHttpReqBatch *batch)
+{
+	unsigned int i;
+
+	for (i = 0; i < batch->n; ++i)
+		tfw_http_req_dispatch(batch->reqs[i]);
+	batch->n = 0;
+}
+
+/**
+ * Assign the virtual host and the location to request @req. @prev is the
+ * previous request parsed from the same skb, if any.
+ *
+ * @return true if the request must be blocked by the eBPF classifier or
+ * the HTTP tables.
+ */
+static bool
+tfw_http_req_route(TfwHttpReq *req, const TfwHttpReq *prev)
+{
+	bool block = false;
+
+	__set_bit(TFW_HTTP_B_REQ_ROUTED, req->flags);
+	if (tfw_http_bpf_classify(req))
+		return true;
+	if (tfw_http_req_vhost_reuse(req, prev))
+		return false;
+	req->vhost = tfw_http_tbl_vhost((TfwMsg *)req, &block);
+	if (unlikely(block))
+		return true;
+	if (req->vhost)
+		req->location = tfw_location_match(req->vhost, &req->uri_path);
+
+	return false;
+}
+
+/**
+ * Start the validation of the multipart body of request @req if it's
+ * required for the request location. The boundary is checked at once, the
+ * body is validated as it's received by tfw_http_req_mp_feed(). Chunked
+ * bodies aren't validated since the parser keeps the chunks framing in the
+ * body data.
+ */
+static int
+tfw_http_req_mp_init(TfwHttpReq *req)
+{
+	if (req->method != TFW_HTTP_METH_POST
+	    || !test_bit(TFW_HTTP_B_CT_MULTIPART, req->flags)
+	    || !req->vhost
+	    || !tfw_http_should_validate_post_req(req)
+	    || test_bit(TFW_HTTP_B_CHUNKED, req->flags))
+		return 0;
+
+	if (!test_bit(TFW_HTTP_B_CT_MULTIPART_HAS_BOUNDARY, req->flags)
+	    || !req->multipart_boundary.len
+	    || req->multipart_boundary.len > TFW_HTTP_MP_BOUNDARY_MAX
+	    || !req->content_length)
+		return -EINVAL;
+
+	if (!(req->mp = tfw_pool_alloc(req->pool, sizeof(TfwHttpMultipart))))
+		return -ENOMEM;
+	req->mp->seen = 0;
+	req->mp->tail_len = 0;
+
+	return 0;
+}
+
+/**
+ * Validate the next received part of the multipart body of request @req.
+ * The body must start with the dash-boundary, a preamble isn't allowed, and
+ * the last bytes of the body are kept for tfw_http_req_mp_closed().
+ */
+static int
+tfw_http_req_mp_feed(void *data, unsigned char *buf, size_t len,
+		     unsigned int *read)
+{
+	TfwHttpReq *req = data;
+	TfwHttpMultipart *mp = req->mp;
+	const TfwStr *b = &req->multipart_boundary;
+	size_t i, off, keep;
+
+	len = min_t(size_t, len, req->body.len - mp->seen);
+	for (i = 0, off = mp->seen; i < len && off < b->len + 2; i++, off++)
+		if (buf[i] != (off < 2 ? '-' : b->data[off - 2]))
+			return TFW_BLOCK;
+
+	if (len >= TFW_HTTP_MP_TAIL_SZ) {
+		memcpy(mp->tail, buf + len - TFW_HTTP_MP_TAIL_SZ,
+		       TFW_HTTP_MP_TAIL_SZ);
+		mp->tail_len = TFW_HTTP_MP_TAIL_SZ;
+	} else {
+		keep = min_t(size_t, mp->tail_len, TFW_HTTP_MP_TAIL_SZ - len);
+		memmove(mp->tail, mp->tail + mp->tail_len - keep, keep);
+		memcpy(mp->tail + keep, buf, len);
+		mp->tail_len = keep + len;
+	}
+	mp->seen += len;
+	*read = len;
+
+	return mp->seen < req->body.len ? TFW_POSTPONE : TFW_PASS;
+}
+
+/**
+ * Tell whether the complete multipart body of request @req ends with the
+ * close delimiter, optionally followed by a CRLF.
+ */
+static bool
+tfw_http_req_mp_closed(const TfwHttpReq *req)
+{
+	const TfwHttpMultipart *mp = req->mp;
+	const TfwStr *b = &req->multipart_boundary;
+	const unsigned char *p = mp->tail + mp->tail_len;
+	size_t n = mp->tail_len;
+
+	if (n >= 2 && p[-2] == '\r' && p[-1] == '\n') {
+		p -= 2;
+		n -= 2;
+	}
+	if (n < b->len + 6)
+		return false;
+	p -= b->len + 6;
+
+	return !memcmp(p, "\r\n--", 4) && !memcmp(p + 4, b->data, b->len)
+	       && !memcmp(p + 4 + b->len, "--", 2);
+}
+
+/**
+ * Process the part of HTTP/1 request @req received in @skb, @parsed bytes
+ * of which belong to the request. Once the request headers are parsed, the
+ * request gets its virtual host and location, so the location settings,
+ * e.g. Frang limits, apply to the request body while it's still coming.
+ * The multipart body validation, if required, runs on each received part
+ * of the body, so an invalid request is blocked at once instead of being
+ * buffered in full.
+ *
+ * The requests preceding @req in the skb are in @batch, which is flushed
+ * if the request is blocked.
+ */
+static int
+tfw_http_req_hdrs_check(TfwHttpReq *req, TfwHttpReqBatch *batch,
+			struct sk_buff *skb, unsigned int parsed)
+{
+	int r;
+	unsigned int chunks = 0, n = 0, off;
+
+	if (TFW_MSG_H2(req) || !(req->crlf.flags & TFW_STR_COMPLETE))
+		return TFW_PASS;
+
+	if (!test_bit(TFW_HTTP_B_REQ_ROUTED, req->flags)) {
+		if (tfw_http_req_route(req, batch->n
+					    ? batch->reqs[batch->n - 1]
+					    : NULL))
+		{
+			TFW_INC_STAT_BH(clnt.msgs_filtout);
+			tfw_http_req_batch_flush(batch);
+			tfw_http_req_parse_block(req, 403,
+				"request has been filtered out via http table");
+			return TFW_BLOCK;
+		}
+		if ((r = tfw_http_req_mp_init(req))) {
+			TFW_INC_STAT_BH(clnt.msgs_parserr);
+			tfw_http_req_batch_flush(batch);
+			tfw_http_req_parse_block(req, r == -ENOMEM ? 500 : 400,
+				"can't validate multipart request");
+			return TFW_BLOCK;
+		}
+	}
+
+	if (!req->mp || req->mp->seen == req->body.len)
+		return TFW_PASS;
+	/* The new body data is at the end of the parsed data. */
+	off = parsed - (req->body.len - req->mp->seen);
+	r = ss_skb_process(skb, off, tfw_http_req_mp_feed, req, &chunks, &n);
+	if (r == TFW_BLOCK || ((req->body.flags & TFW_STR_COMPLETE)
+			       && !tfw_http_req_mp_closed(req)))
+	{
+		TFW_INC_STAT_BH(clnt.msgs_parserr);
+		tfw_http_req_batch_flush(batch);
+		tfw_http_req_parse_block(req, 400,
+			"multipart body doesn't match the boundary");
+		return TFW_BLOCK;
+	}
+
+	return TFW_PASS;
+}
+
 /**
  * @return zero on success and negative value otherwise.
  * TODO enter the function depending on current GFSM state.
@@ -5098,16 +6927,18 @@ tfw_h1_req_process(TfwStream *stream, struct sk_buff *skb)
 static int
 tfw_http_req_process(TfwConn *conn, TfwStream *stream, const TfwFsmData *data)
 {
-	bool block;
+	u64 ts;
 	ss_skb_actor_t *actor;
 	unsigned int parsed;
 	struct sk_buff *skb = data->skb;
 	TfwHttpReq *req;
 	TfwHttpMsg *hmsib;
 	TfwFsmData data_up;
+	TfwHttpReqBatch batch;
 	int r = TFW_BLOCK;
 
 	BUG_ON(!stream->msg);
+	batch.n = 0;
 
 	T_DBG2("Received %u client data bytes on conn=%p msg=%p\n",
 	       skb->len, conn, stream->msg);
@@ -5115,15 +6946,19 @@ tfw_http_req_process(TfwConn *conn, TfwStream *stream, const TfwFsmData *data)
 	/*
 	 * Process pipelined requests in a loop
 	 * until all data in the SKB is processed.
+	 * The requests are collected in @batch until they're all parsed,
+	 * the requests parsed before an error are still served.
 	 */
 next_msg:
-	block = false;
+	ts = get_cycles();
 	parsed = 0;
 	hmsib = NULL;
 	req = (TfwHttpReq *)stream->msg;
 	actor = TFW_MSG_H2(req) ? tfw_h2_parse_req : tfw_http_parse_req;
+	if (!req->stage_ts[TFW_HTTP_STAGE_PARSE])
+		tfw_http_req_stage(req, TFW_HTTP_STAGE_PARSE);
 
-	r = ss_skb_process(skb, actor, req, &req->chunk_cnt, &parsed);
+	r = ss_skb_process(skb, 0, actor, req, &req->chunk_cnt, &parsed);
 	req->msg.len += parsed;
 	TFW_ADD_STAT_BH(parsed, clnt.rx_bytes);
 
@@ -5146,6 +6981,7 @@ next_msg:
 	case TFW_BLOCK:
 		T_DBG2("Block invalid HTTP request\n");
 		TFW_INC_STAT_BH(clnt.msgs_parserr);
+		tfw_http_req_batch_flush(&batch);
 		tfw_http_req_parse_drop(req, 400, "failed to parse request");
 		return TFW_BLOCK;
 	case TFW_POSTPONE:
@@ -5155,6 +6991,7 @@ next_msg:
 			 * all available data, but that weren't enough.
 			 */
 			TFW_INC_STAT_BH(clnt.msgs_otherr);
+			tfw_http_req_batch_flush(&batch);
 			tfw_http_req_parse_block(req, 500,
 				"Request parsing inconsistency");
 			return TFW_BLOCK;
@@ -5162,17 +6999,21 @@ next_msg:
 		if (TFW_MSG_H2(req) && tfw_h2_stream_req_complete(req->stream)) {
 			if (tfw_h2_parse_req_finish(req)) {
 				TFW_INC_STAT_BH(clnt.msgs_otherr);
+				tfw_http_req_batch_flush(&batch);
 				tfw_http_req_parse_block(req, 500,
 					"Request parsing inconsistency");
 				return TFW_BLOCK;
 			}
 		}
 		else {
+			if (tfw_http_req_hdrs_check(req, &batch, skb, parsed))
+				return TFW_BLOCK;
 			r = tfw_gfsm_move(&conn->state, TFW_HTTP_FSM_REQ_CHUNK,
 					  &data_up);
 			T_DBG3("TFW_HTTP_FSM_REQ_CHUNK return code %d\n", r);
 			if (r == TFW_BLOCK) {
 				TFW_INC_STAT_BH(clnt.msgs_filtout);
+				tfw_http_req_batch_flush(&batch);
 				tfw_http_req_parse_block(req, 403,
 					"postponed request has been filtered out");
 				return TFW_BLOCK;
@@ -5183,6 +7024,8 @@ next_msg:
 			 * just supply data for parsing. They only want to know
 			 * if processing of a message should continue or not.
 			 */
+			req->acct_cycles += get_cycles() - ts;
+			tfw_http_req_batch_flush(&batch);
 			return TFW_PASS;
 		}
 	case TFW_PASS:
@@ -5194,8 +7037,11 @@ next_msg:
 		if (WARN_ON_ONCE(!test_bit(TFW_HTTP_B_CHUNKED, req->flags)
 				 && (req->content_length != req->body.len)))
 		{
+			tfw_http_req_batch_flush(&batch);
 			return TFW_BLOCK;
 		}
+		if (tfw_http_req_hdrs_check(req, &batch, skb, parsed))
+			return TFW_BLOCK;
 	}
 
 	/*
@@ -5210,6 +7056,7 @@ next_msg:
 		skb = ss_skb_split(skb, parsed);
 		if (unlikely(!skb)) {
 			TFW_INC_STAT_BH(clnt.msgs_otherr);
+			tfw_http_req_batch_flush(&batch);
 			tfw_http_req_parse_block(req, 500,
 						 "Can't split pipelined requests");
 			return TFW_BLOCK;
@@ -5218,8 +7065,10 @@ next_msg:
 		skb = NULL;
 	}
 
-	if ((r = tfw_http_req_client_link(conn, req)))
+	if ((r = tfw_http_req_client_link(conn, req))) {
+		tfw_http_req_batch_flush(&batch);
 		return r;
+	}
 	/*
 	 * Assign a target virtual host for the current request before further
 	 * processing.
@@ -5241,15 +7090,16 @@ next_msg:
 	 * rules, such as `mark` rule. Even if http_chains is the
 	 * slowest method we have, we can't simply skip it.
 	 */
-	req->vhost = tfw_http_tbl_vhost((TfwMsg *)req, &block);
-	if (unlikely(block)) {
+	if (!test_bit(TFW_HTTP_B_REQ_ROUTED, req->flags)
+	    && tfw_http_req_route(req, batch.n ? batch.reqs[batch.n - 1]
+					       : NULL))
+	{
 		TFW_INC_STAT_BH(clnt.msgs_filtout);
+		tfw_http_req_batch_flush(&batch);
 		tfw_http_req_parse_block(req, 403,
 			"request has been filtered out via http table");
 		return TFW_BLOCK;
 	}
-	if (req->vhost)
-		req->location = tfw_location_match(req->vhost, &req->uri_path);
 	/*
 	 * If vhost is not found the request will be dropped, but it will still
 	 * go through some processing stages since some subsystems need to track
@@ -5282,6 +7132,7 @@ next_msg:
 	/* Don't accept any following requests from the peer. */
 	if (r == TFW_BLOCK) {
 		TFW_INC_STAT_BH(clnt.msgs_filtout);
+		tfw_http_req_batch_flush(&batch);
 		tfw_http_req_parse_block(req, 403,
 			"parsed request has been filtered out");
 		return TFW_BLOCK;
@@ -5305,6 +7156,7 @@ next_msg:
 
 	case TFW_HTTP_SESS_VIOLATE:
 		TFW_INC_STAT_BH(clnt.msgs_filtout);
+		tfw_http_req_batch_flush(&batch);
 		tfw_http_req_parse_block(req, 503,
 			"request dropped: sticky cookie challenge was failed");
 		return TFW_BLOCK;
@@ -5315,12 +7167,14 @@ next_msg:
 		 * responses and close the connection to allow client to recover.
 		 */
 		TFW_INC_STAT_BH(clnt.msgs_filtout);
+		tfw_http_req_batch_flush(&batch);
 		tfw_http_req_parse_block(req, 503,
 			"request dropped: can't send JS challenge");
 		return TFW_BLOCK;
 
 	default:
 		TFW_INC_STAT_BH(clnt.msgs_otherr);
+		tfw_http_req_batch_flush(&batch);
 		tfw_http_req_parse_block(req, 500,
 			"request dropped: internal error in Sticky module");
 		return TFW_BLOCK;
@@ -5343,35 +7197,11 @@ next_msg:
 	if (!TFW_MSG_H2(req))
 		hmsib = tfw_h1_req_process(stream, skb);
 
-	/*
-	 * Response is already prepared for the client by sticky module.
-	 */
-	if (unlikely(req->resp)) {
-		if (TFW_MSG_H2(req))
-			tfw_h2_resp_fwd(req->resp);
-		else
-			tfw_http_resp_fwd(req->resp);
-	}
-	/*
-	 * If no virtual host has been found for current request, there
-	 * is no sense for its further processing, so we drop it, send
-	 * error response to client and move on to the next request.
-	 */
-	else if (unlikely(!req->vhost)) {
-		tfw_http_send_resp(req, 404,
-				   "request dropped: cannot find appropriate "
-				   "virtual host");
-		TFW_INC_STAT_BH(clnt.msgs_otherr);
-	}
-	else if (tfw_cache_process((TfwHttpMsg *)req, tfw_http_req_cache_cb)) {
-		/*
-		 * The request should either be stored or released.
-		 * Otherwise we lose the reference to it and get a leak.
-		 */
-		tfw_http_send_resp(req, 500, "request dropped:"
-					     " processing error");
-		TFW_INC_STAT_BH(clnt.msgs_otherr);
-	}
+	req->acct_cycles += get_cycles() - ts;
+	batch.reqs[batch.n++] = req;
+	if (batch.n == TFW_HTTP_REQ_BATCH)
+		tfw_http_req_batch_flush(&batch);
+
 	/*
 	 * According to RFC 7230 6.3.2, connection with a client
 	 * must be dropped after a response is sent to that client,
@@ -5397,6 +7227,8 @@ next_msg:
 		goto next_msg;
 	}
 
+	tfw_http_req_batch_flush(&batch);
+
 	return r;
 }
 
@@ -5409,6 +7241,21 @@ next_msg:
  * better to transfer requests to a TDB node to make any adjustments.
  * The other benefit of the scheme is that less work is done in SoftIRQ.
  */
+/**
+ * The second half of background request response processing: the response
+ * is already stored in the cache, so just free the request-response pair.
+ */
+static void
+tfw_http_resp_cache_bg_cb(TfwHttpMsg *msg)
+{
+	TfwHttpReq *req = msg->req;
+
+	T_DBG2("%s: req = %p, resp = %p\n", __func__, req, msg);
+
+	tfw_http_conn_msg_free(msg);
+	tfw_http_msg_free((TfwHttpMsg *)req);
+}
+
 static void
 tfw_http_resp_cache_cb(TfwHttpMsg *msg)
 {
@@ -5416,7 +7263,11 @@ tfw_http_resp_cache_cb(TfwHttpMsg *msg)
 
 	T_DBG2("%s: req = %p, resp = %p\n", __func__, resp->req, resp);
 
+	resp->req->acct_ts = get_cycles();
 	tfw_http_sess_learn(resp);
+	tfw_vhost_lat_stats_update(resp->req->vhost, resp->req->location,
+				   TFW_LAT_STATS_UPSTREAM,
+				   jiffies - resp->req->jrxtstamp);
 
 	if (TFW_MSG_H2(resp->req))
 		tfw_h2_resp_adjust_fwd(resp);
@@ -5452,7 +7303,9 @@ tfw_http_popreq(TfwHttpMsg *hmresp, bool fwd_unsent)
 	int err = 0;
 	TfwHttpReq *req = hmresp->req;
 	TfwSrvConn *srv_conn = (TfwSrvConn *)hmresp->conn;
+	TfwServer *srv = (TfwServer *)srv_conn->peer;
 	LIST_HEAD(reschq);
+	LIST_HEAD(migq);
 	LIST_HEAD(eq);
 
 	spin_lock(&srv_conn->fwd_qlock);
@@ -5467,7 +7320,10 @@ tfw_http_popreq(TfwHttpMsg *hmresp, bool fwd_unsent)
 	}
 	/*
 	 * Run special processing if the connection is in repair
-	 * mode. Otherwise, forward pending requests to the server.
+	 * mode. A connection of a draining server gets no new requests,
+	 * instead a batch of the unsent requests is moved to other servers
+	 * each time the connection frees up. Otherwise, forward pending
+	 * requests to the server.
 	 *
 	 * @hmresp is holding a reference to the server connection
 	 * while forwarding is done, so there's no need to take an
@@ -5475,10 +7331,13 @@ tfw_http_popreq(TfwHttpMsg *hmresp, bool fwd_unsent)
 	 */
 	if (unlikely(tfw_srv_conn_restricted(srv_conn)))
 		err = tfw_http_conn_fwd_repair(srv_conn, &eq);
+	else if (unlikely(test_bit(TFW_SRV_B_DRAIN, &srv->flags)))
+		tfw_http_conn_cut_unsent(srv_conn, &migq);
 	else if (tfw_http_conn_need_fwd(srv_conn))
 		err = tfw_http_conn_fwd_unsent(srv_conn, &eq);
 	if (!err) {
 		spin_unlock(&srv_conn->fwd_qlock);
+		tfw_http_fwdq_migrate(srv_conn, &migq, &eq);
 		goto out;
 	}
 	/*
@@ -5542,6 +7401,7 @@ tfw_http_resp_cache(TfwHttpMsg *hmresp)
 {
 	TfwHttpResp *resp = (TfwHttpResp *)hmresp;
 	TfwHttpReq *req = hmresp->req;
+	TfwServer *srv = (TfwServer *)resp->conn->peer;
 	TfwFsmData data;
 	time_t timestamp = tfw_current_timestamp();
 
@@ -5559,9 +7419,11 @@ tfw_http_resp_cache(TfwHttpMsg *hmresp)
 		((TfwHttpResp *)hmresp)->date = timestamp;
 	/*
 	 * Response is fully received, delist corresponding request from
-	 * fwd_queue.
+	 * fwd_queue. The server connection is dead only if it's just been
+	 * switched to a tunnel, the queued requests are re-sent once it's
+	 * re-established.
 	 */
-	tfw_http_popreq(hmresp, true);
+	tfw_http_popreq(hmresp, tfw_srv_conn_live(hmresp->conn));
 	/*
 	 * TODO: Currently APM holds the pure roundtrip time (RTT) from
 	 * the time a request is forwarded to the time a response to it
@@ -5570,16 +7432,39 @@ tfw_http_resp_cache(TfwHttpMsg *hmresp)
 	 * a fast and simple algorithm for that? Keep in mind, that the
 	 * value of RTT has an upper boundary in the APM.
 	 */
-	tfw_apm_update(((TfwServer *)resp->conn->peer)->apmref,
-		       resp->jrxtstamp, resp->jrxtstamp - req->jtxtstamp);
+	tfw_apm_update(srv->apmref, resp->jrxtstamp,
+		       resp->jrxtstamp - req->jtxtstamp);
+	tfw_apm_update_err(srv->apmref, resp->status >= 500);
+	if (resp->status < 500)
+		tfw_sg_rbudget_ok(srv->sg);
+	tfw_sg_conc_update(srv->sg, resp->jrxtstamp - req->jtxtstamp);
+	tfw_http_req_conc_put(req);
+	if (unlikely(test_bit(TFW_HTTP_B_REQ_HEDGE, req->flags)))
+		req = tfw_http_req_hedge_win(hmresp, req);
+	tfw_http_req_stage(req, TFW_HTTP_STAGE_RESP);
 	/*
-	 * Health monitor request means that its response need not to
-	 * send anywhere.
+	 * Health monitor and mirrored requests mean that their responses
+	 * need not to send anywhere.
 	 */
-	if (test_bit(TFW_HTTP_B_HMONITOR, req->flags)) {
+	if (test_bit(TFW_HTTP_B_HMONITOR, req->flags)
+	    || test_bit(TFW_HTTP_B_REQ_MIRROR, req->flags))
+	{
 		tfw_http_hm_drop_resp((TfwHttpResp *)hmresp);
 		return;
 	}
+	/*
+	 * Response to a background request is only stored in the cache,
+	 * there is no client to forward it to.
+	 */
+	if (test_bit(TFW_HTTP_B_CACHE_BG, req->flags)) {
+		tfw_stream_unlink_msg(hmresp->stream);
+		if (tfw_cache_process(hmresp, tfw_http_resp_cache_bg_cb)) {
+			tfw_http_conn_msg_free(hmresp);
+			tfw_http_msg_free((TfwHttpMsg *)req);
+			TFW_INC_STAT_BH(serv.msgs_otherr);
+		}
+		return;
+	}
 	/*
 	 * This hook isn't in tfw_http_resp_fwd() because responses from the
 	 * cache shouldn't be accounted.
@@ -5655,6 +7540,152 @@ tfw_http_resp_terminate(TfwHttpMsg *hm)
 	tfw_http_resp_cache(hm);
 }
 
+/*
+ * Tell if the response @resp, which isn't received in full yet, can be
+ * streamed to the client. Only HTTP/1 responses with known framing are
+ * streamed, so no transformations of the body are needed. Responses which
+ * can be replaced by another response, e.g. by a response to a hedged
+ * request copy, aren't streamed.
+ */
+static bool
+tfw_http_resp_stream_allowed(TfwHttpResp *resp)
+{
+	TfwHttpReq *req = resp->req;
+
+	if (!req->conn || TFW_MSG_H2(req) || req->hedge
+	    || test_bit(TFW_HTTP_B_REQ_DROP, req->flags)
+	    || test_bit(TFW_HTTP_B_CACHE_BG, req->flags))
+		return false;
+
+	return (resp->crlf.flags & TFW_STR_COMPLETE)
+	       && !test_bit(TFW_HTTP_B_UNLIMITED, resp->flags)
+	       && resp->body.len >= tfw_http_resp_stream_thr;
+}
+
+/*
+ * Forward the received part of response @resp to the client without waiting
+ * for the rest of the response, so the client gets the response head and the
+ * body as they come from the server. The response skbs are kept until the
+ * response is received in full, since the cache and the final processing of
+ * the response still need them, and only their copies sharing the paged data
+ * are sent. The rest of the response is forwarded by tfw_http_resp_fwd() as
+ * usual when the response is complete.
+ *
+ * The response can be streamed only when the paired request is the first one
+ * in the client's @seq_queue, i.e. responses to all the previous requests are
+ * already sent. The received data is also left for later while the client
+ * socket has more data queued than its send buffer size, so a slow client
+ * doesn't make the whole response to pile up in its write queue.
+ *
+ * @return negative value if the response can't be adjusted for the client.
+ */
+static int
+tfw_http_resp_stream(TfwHttpResp *resp)
+{
+	int r;
+	TfwHttpReq *req = resp->req;
+	TfwCliConn *cli_conn = (TfwCliConn *)req->conn;
+	struct sk_buff *skb, *twin_skb;
+	struct sock *sk;
+	TfwMsg msg = {};
+
+	if (likely(!tfw_http_resp_stream_thr))
+		return 0;
+	if (!test_bit(TFW_HTTP_B_REQ_STREAMED, req->flags)
+	    && !tfw_http_resp_stream_allowed(resp))
+		return 0;
+	sk = READ_ONCE(cli_conn->sk);
+	if (!sk || sk->sk_wmem_queued > sk->sk_sndbuf)
+		return 0;
+	if (READ_ONCE(cli_conn->seq_queue.next) != &req->msg.seq_list)
+		return 0;
+
+	if (!test_bit(TFW_HTTP_B_REQ_STREAMED, req->flags)) {
+		if ((r = tfw_http_adjust_resp(resp)))
+			return r;
+		set_bit(TFW_HTTP_B_REQ_STREAMED, req->flags);
+		TFW_INC_STAT_BH(serv.msgs_streamed);
+	}
+	skb = resp->stream_last ? resp->stream_last->next
+				: resp->msg.skb_head;
+	if (skb == resp->msg.skb_head && resp->stream_last)
+		return 0;
+	do {
+		if (!(twin_skb = pskb_copy_for_clone(skb, GFP_ATOMIC))) {
+			ss_skb_queue_purge(&msg.skb_head);
+			return 0;
+		}
+		ss_skb_queue_tail(&msg.skb_head, twin_skb);
+		msg.len += skb->len;
+		skb = skb->next;
+	} while (skb != resp->msg.skb_head);
+	resp->stream_last = ss_skb_peek_tail(&resp->msg.skb_head);
+
+	/* Order the sending with tfw_http_resp_fwd(), see the comments there. */
+	spin_lock_bh(&cli_conn->seq_qlock);
+	if (unlikely(cli_conn->seq_queue.next != &req->msg.seq_list)) {
+		/* The client is disconnected. */
+		spin_unlock_bh(&cli_conn->seq_qlock);
+		ss_skb_queue_purge(&msg.skb_head);
+		return 0;
+	}
+	tfw_cli_conn_get(cli_conn);
+	spin_lock_bh(&cli_conn->ret_qlock);
+	spin_unlock_bh(&cli_conn->seq_qlock);
+
+	if (tfw_cli_conn_send(cli_conn, &msg))
+		tfw_connection_close((TfwConn *)cli_conn, true);
+
+	spin_unlock_bh(&cli_conn->ret_qlock);
+	tfw_cli_conn_put(cli_conn);
+	ss_skb_queue_purge(&msg.skb_head);
+
+	return 0;
+}
+
+/**
+ * The server has switched the protocols for the upgrade request, so switch
+ * the client connection to a tunnel, forward the response to the client and
+ * pass @skb, the data following the response, through the tunnel. The client
+ * mustn't send anything before it receives the response, so the protocol is
+ * broken if the request isn't the last one of the client connection.
+ */
+static int
+tfw_http_resp_tunnel(TfwHttpMsg *hmresp, struct sk_buff *skb)
+{
+	int r = -ENOTCONN;
+	TfwHttpReq *req = hmresp->req;
+	TfwSrvConn *srv_conn = (TfwSrvConn *)hmresp->conn;
+	TfwCliConn *cli_conn = (TfwCliConn *)req->conn;
+	struct sock *sk = srv_conn->sk;
+	bool last;
+
+	spin_lock(&cli_conn->seq_qlock);
+	last = list_is_last(&req->msg.seq_list, &cli_conn->seq_queue);
+	spin_unlock(&cli_conn->seq_qlock);
+
+	if (likely(last)) {
+		spin_lock(&srv_conn->fwd_qlock);
+		r = tfw_sock_srv_tunnel(srv_conn, cli_conn);
+		spin_unlock(&srv_conn->fwd_qlock);
+	}
+	if (unlikely(r)) {
+		tfw_http_conn_error_log(hmresp->conn, "Can't switch to tunnel");
+		if (skb)
+			__kfree_skb(skb);
+		return r;
+	}
+
+	tfw_http_resp_cache(hmresp);
+	if (skb && SS_CALL(connection_recv, sk->sk_user_data, skb))
+		ss_close(sk, 0);
+
+	tfw_connection_drop((TfwConn *)srv_conn);
+	tfw_srv_conn_put(srv_conn);
+
+	return 0;
+}
+
 /**
  * @return zero on success and negative value otherwise.
  * TODO enter the function depending on current GFSM state.
@@ -5662,6 +7693,7 @@ tfw_http_resp_terminate(TfwHttpMsg *hm)
 static int
 tfw_http_resp_process(TfwConn *conn, TfwStream *stream, const TfwFsmData *data)
 {
+	u64 ts;
 	int r = TFW_BLOCK;
 	unsigned int chunks_unused, parsed;
 	struct sk_buff *skb = data->skb;
@@ -5690,8 +7722,11 @@ next_msg:
 	hmsib = NULL;
 	hmresp = (TfwHttpMsg *)stream->msg;
 
-	r = ss_skb_process(skb, tfw_http_parse_resp, hmresp, &chunks_unused,
+	ts = get_cycles();
+	r = ss_skb_process(skb, 0, tfw_http_parse_resp, hmresp, &chunks_unused,
 			   &parsed);
+	if (hmresp->req)
+		hmresp->req->acct_cycles += get_cycles() - ts;
 	hmresp->msg.len += parsed;
 	TFW_ADD_STAT_BH(parsed, serv.rx_bytes);
 
@@ -5739,6 +7774,15 @@ next_msg:
 			filtout = true;
 			goto bad_msg;
 		}
+		/* Store the received part of the response in the cache. */
+		tfw_cache_resp_chunk((TfwHttpResp *)hmresp);
+		/* Forward the received part of the response to the client. */
+		if (tfw_http_resp_stream((TfwHttpResp *)hmresp)) {
+			TFW_INC_STAT_BH(serv.msgs_otherr);
+			goto bad_msg;
+		}
+		tfw_http_srv_rx_throttle((TfwSrvConn *)conn,
+					 (TfwHttpResp *)hmresp);
 		/*
 		 * TFW_POSTPONE status means that parsing succeeded
 		 * but more data is needed to complete it. Lower layers
@@ -5802,6 +7846,14 @@ next_msg:
 	if (unlikely(r < TFW_PASS))
 		return TFW_BLOCK;
 
+	if (unlikely(r == TFW_PASS && ((TfwHttpResp *)hmresp)->status == 101
+		     && test_bit(TFW_HTTP_B_CONN_UPGRADE, hmresp->req->flags)))
+	{
+		if (tfw_http_resp_tunnel(hmresp, skb))
+			goto bad_msg;
+		return TFW_PASS;
+	}
+
 	/*
 	 * If @skb's data has not been processed in full, then
 	 * we have pipelined responses. Create a sibling message.
@@ -5907,11 +7959,42 @@ tfw_http_msg_process_generic(TfwConn *conn, TfwStream *stream, TfwFsmData *data)
 		: tfw_http_resp_process(conn, stream, data);
 }
 
+/**
+ * Pass the data received from the client through the tunnel to the server
+ * as is. Frang still accounts the data.
+ */
+static int
+tfw_http_tunnel_recv(TfwCliConn *cli_conn, TfwTunConn *tun, TfwFsmData *data)
+{
+	int r;
+	struct sk_buff *skb_head = NULL;
+
+	data->req = data->resp = NULL;
+	r = tfw_gfsm_move(&cli_conn->state, TFW_HTTP_FSM_TUNNEL_CHUNK, data);
+	if (r == TFW_BLOCK) {
+		__kfree_skb(data->skb);
+		return TFW_BLOCK;
+	}
+
+	TFW_ADD_STAT_BH(data->skb->len, clnt.rx_bytes);
+	ss_skb_queue_tail(&skb_head, data->skb);
+	if (ss_send(tun->sk, &skb_head, 0)) {
+		ss_skb_queue_purge(&skb_head);
+		return TFW_BLOCK;
+	}
+
+	return TFW_PASS;
+}
+
 /**
  * TLS can send us list of decrypted skbs, it doesn't care about the list any
  * more. Meantime, HTTP uses it's own skb lists, so here we process the list
  * and pretend that we have each skb separately.
  *
+ * A client connection may be switched to a tunnel, and a server connection
+ * may hand its socket over to a tunnel in the middle of the list, see
+ * tfw_http_resp_tunnel(). The rest of the data goes through the tunnel then.
+ *
  * We responsible for freeing all consumed skbs, including the skb which
  * returned an error code on. The rest of skbs are freed by us.
  */
@@ -5920,7 +8003,9 @@ tfw_http_msg_process(void *conn, TfwFsmData *data)
 {
 	int r = T_OK;
 	TfwStream *stream = &((TfwConn *)conn)->stream;
+	struct sock *sk = ((TfwConn *)conn)->sk;
 	struct sk_buff *next;
+	TfwTunConn *tun;
 
 	if (data->skb->prev)
 		data->skb->prev->next = NULL;
@@ -5929,6 +8014,27 @@ tfw_http_msg_process(void *conn, TfwFsmData *data)
 	{
 		if (likely(r == T_OK || r == T_POSTPONE)) {
 			data->skb->next = data->skb->prev = NULL;
+			if (unlikely(sk->sk_user_data != conn)) {
+				r = SS_CALL(connection_recv, sk->sk_user_data,
+					    data->skb);
+				continue;
+			}
+			/*
+			 * Drop the rest of the socket batch of a closing
+			 * connection, see ss_tcp_process_data().
+			 */
+			if (unlikely(TFW_CONN_TYPE((TfwConn *)conn)
+				     & Conn_Stop))
+			{
+				__kfree_skb(data->skb);
+				continue;
+			}
+			tun = (TFW_CONN_TYPE((TfwConn *)conn) & Conn_Clnt)
+			      ? READ_ONCE(((TfwCliConn *)conn)->tunnel) : NULL;
+			if (unlikely(!IS_ERR_OR_NULL(tun))) {
+				r = tfw_http_tunnel_recv(conn, tun, data);
+				continue;
+			}
 			r = TFW_CONN_H2(conn)
 				? tfw_h2_frame_process(conn, data)
 				: tfw_http_msg_process_generic(conn, stream, data);
@@ -5945,26 +8051,30 @@ tfw_http_msg_process(void *conn, TfwFsmData *data)
  * suspended) in the sense of HTTP accessibility.
  */
 void
-tfw_http_hm_srv_send(TfwServer *srv, char *data, unsigned long len)
+tfw_http_hm_srv_send(TfwServer *srv, struct sk_buff *skb_head,
+		     unsigned long len)
 {
-	TfwMsgIter it;
 	TfwHttpReq *req;
 	TfwHttpMsg *hmreq;
 	TfwSrvConn *srv_conn;
-	TfwStr msg = {
-		.data = data,
-		.len = len,
-	};
+	struct sk_buff *skb = skb_head, *copy;
 	LIST_HEAD(equeue);
 	bool block = false;
 
 	if (!(req = tfw_http_msg_alloc_req_light()))
 		return;
 	hmreq = (TfwHttpMsg *)req;
-	if (tfw_http_msg_setup(hmreq, &it, msg.len, 0))
-		goto cleanup;
-	if (tfw_msg_write(&it, &msg))
-		goto cleanup;
+	/*
+	 * The request is never adjusted, so the data pages of the probe
+	 * serialized on configuration are shared by all the probes.
+	 */
+	do {
+		if (!(copy = pskb_copy(skb, GFP_ATOMIC)))
+			goto cleanup;
+		ss_skb_queue_tail(&hmreq->msg.skb_head, copy);
+		skb = skb->next;
+	} while (skb != skb_head);
+	hmreq->msg.len = len;
 
 	__set_bit(TFW_HTTP_B_HMONITOR, req->flags);
 	req->jrxtstamp = jiffies;
@@ -6009,6 +8119,54 @@ cleanup:
 	tfw_http_msg_free(hmreq);
 }
 
+/**
+ * Send background request @data to a backend server on behalf of client
+ * request @req, e.g. to revalidate a stale cache entry while the client is
+ * serviced with the stale one. Like health monitoring requests, background
+ * requests aren't bound to any client connection: the responses are only
+ * stored in the cache and aren't forwarded anywhere. @flag is an additional
+ * flag of the background request, zero if there is none.
+ */
+int
+tfw_http_req_bg_send(TfwHttpReq *req, TfwStr *data, unsigned int flag)
+{
+	int r;
+	TfwMsgIter it;
+	TfwHttpReq *bg_req;
+	TfwHttpMsg *hmreq;
+	TfwSrvConn *srv_conn;
+	LIST_HEAD(equeue);
+
+	if (!(hmreq = __tfw_http_msg_alloc(Conn_HttpClnt, true)))
+		return -ENOMEM;
+	bg_req = (TfwHttpReq *)hmreq;
+	if ((r = tfw_http_msg_setup(hmreq, &it, data->len, 0)))
+		goto cleanup;
+	if ((r = tfw_msg_write(&it, data)))
+		goto cleanup;
+	if ((r = tfw_http_req_bg_init(bg_req, req, TFW_HTTP_B_CACHE_BG)))
+		goto cleanup;
+	if (flag)
+		__set_bit(flag, bg_req->flags);
+
+	if (!(srv_conn = tfw_vhost_get_srv_conn((TfwMsg *)bg_req))) {
+		T_DBG("Unable to find a backend server for background"
+		      " request\n");
+		r = -ENOENT;
+		goto cleanup;
+	}
+
+	tfw_http_req_fwd(srv_conn, bg_req, &equeue, false);
+	tfw_http_req_zap_error(&equeue);
+
+	tfw_srv_conn_put(srv_conn);
+
+	return 0;
+cleanup:
+	tfw_http_msg_free(hmreq);
+	return r;
+}
+
 /**
  * Calculate the key of an HTTP request by hashing URI and Host header values.
  */
@@ -6020,7 +8178,7 @@ tfw_http_req_key_calc(TfwHttpReq *req)
 	if (req->hash)
 		return req->hash;
 
-	req->hash = tfw_hash_str(&req->uri_path);
+	req->hash = tfw_hash_str(tfw_cache_key_path(req));
 
 	if (test_bit(TFW_HTTP_B_HMONITOR, req->flags))
 		return req->hash;
@@ -6296,6 +8454,49 @@ tfw_http_msg_body_dup(const char *filename, size_t *len)
 	return __tfw_http_msg_body_dup(filename, NULL, len, &b_off);
 }
 
+/**
+ * Copy @len bytes of @data into order-0 pages of @sb, so the pages can be
+ * referenced from skbs of many responses. Release the body with
+ * tfw_http_shared_body_free(), the pages live until the last response using
+ * them is sent.
+ */
+int
+tfw_http_shared_body_init(TfwHttpSharedBody *sb, const char *data, size_t len)
+{
+	unsigned int i, n = DIV_ROUND_UP(len, PAGE_SIZE);
+
+	bzero_fast(sb, sizeof(*sb));
+	if (!len)
+		return 0;
+	if (!(sb->pages = kcalloc(n, sizeof(struct page *), GFP_KERNEL)))
+		return -ENOMEM;
+
+	for (i = 0; i < n; ++i) {
+		size_t copy = min_t(size_t, len - sb->len, PAGE_SIZE);
+
+		if (!(sb->pages[i] = alloc_page(GFP_KERNEL))) {
+			tfw_http_shared_body_free(sb);
+			return -ENOMEM;
+		}
+		++sb->nr_pages;
+		memcpy_fast(page_address(sb->pages[i]), data + sb->len, copy);
+		sb->len += copy;
+	}
+
+	return 0;
+}
+
+void
+tfw_http_shared_body_free(TfwHttpSharedBody *sb)
+{
+	unsigned int i;
+
+	for (i = 0; i < sb->nr_pages; ++i)
+		put_page(sb->pages[i]);
+	kfree(sb->pages);
+	bzero_fast(sb, sizeof(*sb));
+}
+
 
 /**
  * Set message body for predefined response with corresponding code.
@@ -6662,11 +8863,99 @@ static TfwCfgSpec tfw_http_specs[] = {
 		.allow_none = true,
 		.cleanup = tfw_cfgop_cleanup_brange_cookie,
 	},
+	{
+		.name = "http_stage_stats",
+		.deflt = "off",
+		.handler = tfw_cfg_set_bool,
+		.dest = &tfw_http_stage_stats,
+	},
+	{
+		.name = "response_stream_threshold",
+		.deflt = "0",
+		.handler = tfw_cfg_set_int,
+		.dest = &tfw_http_resp_stream_thr,
+		.spec_ext = &(TfwCfgSpecInt) {
+			.range = { 0, INT_MAX },
+		},
+	},
+	{
+		.name = "client_buffer_limit",
+		.deflt = "0",
+		.handler = tfw_cfg_set_int,
+		.dest = &tfw_http_cli_buf_limit,
+		.spec_ext = &(TfwCfgSpecInt) {
+			.range = { 0, INT_MAX },
+		},
+	},
+	{
+		.name = "client_buffer_limit_total",
+		.deflt = "0",
+		.handler = tfw_cfg_set_long,
+		.dest = &tfw_http_cli_buf_total,
+		.spec_ext = &(TfwCfgSpecInt) {
+			.range = { 0, LONG_MAX },
+		},
+	},
+	{
+		.name = "load_shedding_backlog",
+		.deflt = "0",
+		.handler = tfw_cfg_set_int,
+		.dest = &tfw_http_shed_backlog,
+		.spec_ext = &(TfwCfgSpecInt) {
+			.range = { 0, INT_MAX / 2 },
+		},
+		.allow_reconfig = true,
+	},
+	{
+		.name = "http2_push_budget",
+		.deflt = "0",
+		.handler = tfw_cfg_set_int,
+		.dest = &tfw_h2_push_budget,
+		.spec_ext = &(TfwCfgSpecInt) {
+			.range = { 0, INT_MAX },
+		},
+		.allow_reconfig = true,
+	},
 	{ 0 }
 };
 
+/**
+ * Copy the configured bodies of the local responses to shared pages and
+ * invalidate the headers templates.
+ */
+static int
+tfw_http_start(void)
+{
+	int r;
+	resp_code_t i;
+
+	for (i = 0; i < RESP_NUM; ++i) {
+		TfwStr *body = TFW_STR_BODY_CH(&http_predef_resps[i]);
+		TfwHttpSharedBody sb, old = http_predef_bodies[i];
+
+		if ((r = tfw_http_shared_body_init(&sb, body->data, body->len)))
+			return r;
+		http_predef_bodies[i] = sb;
+		tfw_http_shared_body_free(&old);
+	}
+	WRITE_ONCE(lresp_gen, lresp_gen + 1);
+
+	return 0;
+}
+
+static void
+tfw_http_stop(void)
+{
+	resp_code_t i;
+
+	for (i = 0; i < RESP_NUM; ++i)
+		tfw_http_shared_body_free(&http_predef_bodies[i]);
+}
+
 TfwMod tfw_http_mod  = {
 	.name	= "http",
+	.start	= tfw_http_start,
+	.stop	= tfw_http_stop,
 	.specs	= tfw_http_specs,
 };
 
@@ -6681,9 +8970,14 @@ tfw_http_init(void)
 {
 	int r;
 
+	if (!(lresp_tmpl = alloc_percpu(TfwLocalRespTmpls)))
+		return -ENOMEM;
+
 	r = tfw_gfsm_register_fsm(TFW_FSM_HTTP, tfw_http_msg_process);
-	if (r)
+	if (r) {
+		free_percpu(lresp_tmpl);
 		return r;
+	}
 
 	tfw_connection_hooks_register(&http_conn_hooks, TFW_FSM_HTTP);
 
@@ -6694,6 +8988,7 @@ tfw_http_init(void)
 	if (ghprio < 0) {
 		tfw_connection_hooks_unregister(TFW_FSM_HTTP);
 		tfw_gfsm_unregister_fsm(TFW_FSM_HTTP);
+		free_percpu(lresp_tmpl);
 		return ghprio;
 	}
 
@@ -6709,4 +9004,5 @@ tfw_http_exit(void)
 	tfw_gfsm_unregister_hook(TFW_FSM_TLS, ghprio, TFW_TLS_FSM_DATA_READY);
 	tfw_connection_hooks_unregister(TFW_FSM_HTTP);
 	tfw_gfsm_unregister_fsm(TFW_FSM_HTTP);
+	free_percpu(lresp_tmpl);
 }
@@ -27,6 +27,7 @@
 #include "connection.h"
 #include "gfsm.h"
 #include "msg.h"
+#include "procfs.h"
 #include "server.h"
 #include "str.h"
 #include "vhost.h"
@@ -82,6 +83,9 @@ enum {
 
 	TFW_HTTP_FSM_RESP_MSG_FWD	= TFW_GFSM_HTTP_STATE(6),
 
+	/* Called on each skb received through a client's upgraded tunnel. */
+	TFW_HTTP_FSM_TUNNEL_CHUNK	= TFW_GFSM_HTTP_STATE(7),
+
 	TFW_HTTP_FSM_DONE	= TFW_GFSM_HTTP_STATE(TFW_GFSM_STATE_LAST)
 };
 
@@ -139,6 +143,7 @@ enum {
 #define TFW_HTTP_CC_PUBLIC		0x00000400
 #define TFW_HTTP_CC_PRIVATE		0x00000800
 #define TFW_HTTP_CC_S_MAXAGE		0x00001000
+#define TFW_HTTP_CC_STALE_REVAL		0x00002000
 /* Mask to indicate that CC header is present. */
 #define TFW_HTTP_CC_IS_PRESENT		0x0000ffff
 /* Headers that affect Cache Control. */
@@ -155,6 +160,7 @@ typedef struct {
 	unsigned int	s_maxage;
 	unsigned int	max_stale;
 	unsigned int	min_fresh;
+	unsigned int	stale_reval;
 	time_t		timestamp;
 	time_t		age;
 	time_t		expires;
@@ -227,6 +233,9 @@ enum {
 	 * CONN_KA: 'Connection:' header contains 'keep-alive' term. The flag
 	 * is not set for HTTP/1.1 connections which are persistent by default.
 	 * CONN_EXTRA: 'Connection:' header contains additional terms.
+	 * CONN_UPGRADE: 'Connection:' header contains 'upgrade' term. The
+	 * flag is kept for requests only if the connection can be tunneled
+	 * once the server switches protocols with 101 response.
 	 *
 	 * There is no requirement for mutual exclusivity for CONN_CLOSE and
 	 * CONN_KA flags, their meaning is not limited by connection
@@ -236,6 +245,7 @@ enum {
 	TFW_HTTP_B_CONN_CLOSE	= TFW_HTTP_FLAGS_COMMON,
 	TFW_HTTP_B_CONN_KA,
 	TFW_HTTP_B_CONN_EXTRA,
+	TFW_HTTP_B_CONN_UPGRADE,
 	/* Chunked is last transfer encoding. */
 	TFW_HTTP_B_CHUNKED,
 	/* Chunked in the middle of applied transfer encodings. */
@@ -275,6 +285,22 @@ enum {
 	TFW_HTTP_B_WHITELIST,
 	/* Client was disconnected, drop the request. */
 	TFW_HTTP_B_REQ_DROP,
+	/* Request is created by the cache to revalidate a stale entry. */
+	TFW_HTTP_B_CACHE_BG,
+	/* Request is a hedged copy of an overdue client request. */
+	TFW_HTTP_B_REQ_HEDGE,
+	/* Request is a copy of a client request for a shadow server group. */
+	TFW_HTTP_B_REQ_MIRROR,
+	/* Request body is tracked by its length only, see the parser. */
+	TFW_HTTP_B_BODY_TUNNEL,
+	/* Response to the request is being streamed to the client. */
+	TFW_HTTP_B_REQ_STREAMED,
+	/* Virtual host and location of the request are assigned. */
+	TFW_HTTP_B_REQ_ROUTED,
+	/* Request is created by the cache to fetch an ESI fragment. */
+	TFW_HTTP_B_CACHE_ESI,
+	/* Request has waited for fragments of a cached ESI skeleton. */
+	TFW_HTTP_B_ESI_WAITED,
 
 	/* Response flags */
 	TFW_HTTP_FLAGS_RESP,
@@ -286,12 +312,15 @@ enum {
 	TFW_HTTP_B_HDR_LMODIFIED,
 	/* Response is fully processed and ready to be forwarded to the client. */
 	TFW_HTTP_B_RESP_READY,
+	/* Response is built from the cache. */
+	TFW_HTTP_B_RESP_CACHED,
 
 	_TFW_HTTP_FLAGS_NUM
 };
 
 #define __TFW_HTTP_MSG_M_CONN						\
-	(BIT(TFW_HTTP_B_CONN_CLOSE) | BIT(TFW_HTTP_B_CONN_KA))
+	(BIT(TFW_HTTP_B_CONN_CLOSE) | BIT(TFW_HTTP_B_CONN_KA)		\
+	 | BIT(TFW_HTTP_B_CONN_UPGRADE))
 
 #define TFW_MSG_H2(hmmsg)						\
 	test_bit(TFW_HTTP_B_H2, ((TfwHttpMsg *)hmmsg)->flags)
@@ -318,6 +347,7 @@ typedef struct {
  * @msg			- the base data of an HTTP message;
  * @pool		- message's memory allocation pool;
  * @h_tbl		- table of message's HTTP headers in internal form;
+ * @h_pend		- headers added to the message, but not written yet;
  * @httperr		- HTTP error data used to form an error response;
  * @pair		- the message paired with this one;
  * @req			- the request paired with this response;
@@ -343,6 +373,7 @@ typedef struct {
 	TfwMsg		msg;						\
 	TfwPool		*pool;						\
 	TfwHttpHdrTbl	*h_tbl;						\
+	TfwHttpHdrPend	*h_pend;					\
 	union {								\
 		TfwHttpMsg	*pair;					\
 		TfwHttpReq	*req;					\
@@ -391,6 +422,45 @@ typedef struct {
 	time_t		m_date;
 } TfwHttpCond;
 
+/**
+ * Hedging of an idempotent request: a copy of the request is sent to
+ * another server if the original one isn't answered in time.
+ *
+ * @timer	- fires when the original request becomes overdue;
+ * @srv_conn	- server connection the original request was forwarded to;
+ * @req		- the original request, used as a key only: it may be
+ *		  already freed, so it's just looked up in @srv_conn;
+ * @tmo		- hedging deadline, in jiffies;
+ */
+typedef struct {
+	struct timer_list	timer;
+	TfwSrvConn		*srv_conn;
+	TfwHttpReq		*req;
+	unsigned long		tmo;
+} TfwHttpHedge;
+
+/*
+ * Maximum boundary length of a multipart body (RFC 2046 5.1.1) and the
+ * number of the last body bytes kept to find the close delimiter, which is
+ * the boundary surrounded by a CRLF and by dashes, and a trailing CRLF.
+ */
+#define TFW_HTTP_MP_BOUNDARY_MAX	70
+#define TFW_HTTP_MP_TAIL_SZ		80
+
+/**
+ * State of the validation of a multipart/form-data request body, which is
+ * validated part by part as the body is received.
+ *
+ * @seen	- number of the validated body bytes;
+ * @tail_len	- number of bytes in @tail;
+ * @tail	- the last received bytes of the body;
+ */
+typedef struct {
+	unsigned long	seen;
+	unsigned int	tail_len;
+	unsigned char	tail[TFW_HTTP_MP_TAIL_SZ];
+} TfwHttpMultipart;
+
 /**
  * HTTP Request.
  *
@@ -400,6 +470,13 @@ typedef struct {
  * @peer	- end-to-end peer. The peer is not set if
  *		  hop-by-hop peer (TfwConnection->peer) and end-to-end peer are
  *		  the same;
+ * @hedge	- hedging descriptor of the request and its hedged copy. Only
+ *		  the copy owns the descriptor, the original request just
+ *		  refers to it and must never dereference it;
+ * @conc_sg	- server group the request is accounted in the concurrency
+ *		  limit of, see tfw_sg_conc_get();
+ * @mp		- state of the multipart body validation, NULL if the body
+ *		  isn't validated;
  * @pit		- iterator for tracking transformed data allocation (applicable
  *		  for HTTP/2 mode only);
  * @userinfo	- userinfo in URI, not mandatory;
@@ -410,15 +487,33 @@ typedef struct {
  * @multipart_boundary - decoded multipart boundary;
  * @fwd_list	- member in the queue of forwarded/backlogged requests;
  * @nip_list	- member in the queue of non-idempotent requests;
+ * @pend_node	- member in the list of requests pending for forwarding;
+ * @wait_list	- member in the queue of requests waiting for a pending cache
+ *		  fetch;
  * @jtxtstamp	- time the request is forwarded to a server, in jiffies;
  * @jrxtstamp	- time the request is received from a client, in jiffies;
  * @tm_header	- time HTTP header started coming;
  * @tm_bchunk	- time previous chunk of HTTP body had come at;
+ * @stage_ts	- time the request processing stages started at, in CPU
+ *		  cycles, zero for the stages not passed or if the stages
+ *		  statistics is disabled;
+ * @fwd_qts	- time the request was queued to a server connection, in CPU
+ *		  cycles, zero once the request is forwarded;
+ * @acct_ts	- time the processing of the response to the request started
+ *		  at, in CPU cycles, zero if the response isn't processed;
+ * @acct_cycles	- CPU cycles spent on the request and its response, they're
+ *		  accounted to the vhost when the request is destroyed;
+ * @acct_tx	- bytes of the response sent to the client;
+ * @key_path	- URI part of the cache key, normalized according to cache_key
+ *		  configuration, or @uri_path;
  * @hash	- hash value for caching calculated for the request;
  * @frang_st	- current state of FRANG classifier;
  * @chunk_cnt	- header or body chunk count for Frang classifier;
  * @node	- NUMA node where request is serviced;
  * @retries	- the number of re-send attempts;
+ * @priority	- priority of the request, see tfw_http_req_priority();
+ * @overtaken	- number of the requests of higher priority forwarded before
+ *		  the request while it was queued;
  * @method	- HTTP request method, one of GET/PORT/HEAD/etc;
  * @method_override - Overridden HTTP request method, passed in request headers.
  *
@@ -430,6 +525,9 @@ struct tfw_http_req_t {
 	TfwLocation		*location;
 	TfwHttpSess		*sess;
 	TfwClient		*peer;
+	TfwHttpHedge		*hedge;
+	TfwSrvGroup		*conc_sg;
+	TfwHttpMultipart	*mp;
 	TfwHttpCond		cond;
 	TfwMsgParseIter		pit;
 	TfwStr			userinfo;
@@ -440,15 +538,25 @@ struct tfw_http_req_t {
 	TfwStr			multipart_boundary;
 	struct list_head	fwd_list;
 	struct list_head	nip_list;
+	struct llist_node	pend_node;
+	struct list_head	wait_list;
 	unsigned long		jtxtstamp;
 	unsigned long		jrxtstamp;
 	unsigned long		tm_header;
 	unsigned long		tm_bchunk;
+	u64			stage_ts[TFW_HTTP_STAGE_NUM];
+	u64			fwd_qts;
+	u64			acct_ts;
+	u64			acct_cycles;
+	unsigned long		acct_tx;
+	TfwStr			*key_path;
 	unsigned long		hash;
 	unsigned int		frang_st;
 	unsigned int		chunk_cnt;
 	unsigned short		node;
 	unsigned short		retries;
+	unsigned char		priority;
+	unsigned char		overtaken;
 	unsigned char		method;
 	unsigned char		method_override;
 };
@@ -459,22 +567,6 @@ struct tfw_http_req_t {
 #define TFW_IDX_BITS		12
 #define TFW_D_IDX_BITS		4
 
-/**
- * Representation of operation with the next header (in order of headers in the
- * message) during HTTP/1.1=>HTTP/2 transformation process.
- *
- * @s_hdr	- source header for transformation;
- * @off		- offset of not copied data from last processed @chunk;
- * @chunk	- last chunk to be processed from @s_hdr;
- * @op		- transformation operation which should be executed.
- */
-typedef struct {
-	TfwStr		s_hdr;
-	unsigned long	off;
-	unsigned int	chunk;
-	TfwH2TransOp	op;
-} TfwNextHdrOp;
-
 /**
  * The indirection map entry.
  *
@@ -508,24 +600,14 @@ typedef struct {
  * @map		- indirection map for tracking headers order in skb;
  * @start_off	- initial offset during copying response data into
  *		  skb (for subsequent insertion of HTTP/2 frame header);
- * @curr	- current header index in the @map;
- * @next	- operation (with necessary attributes) which should be executed
- *		  with next header;
  * @found	- bit mask of configured headers found in the message.
- * @curr_ptr	- pointer in the skb to write the current header;
- * @bnd		- pointer to the boundary data (which should not be
- *		  overwritten);
  * @iter	- skb expansion iterator;
  * @acc_len	- accumulated length of transformed message.
  */
 typedef struct {
 	TfwHttpHdrMap	*map;
 	unsigned int	start_off;
-	unsigned int	curr;
-	TfwNextHdrOp	next;
 	DECLARE_BITMAP	(found, TFW_USRHDRS_ARRAY_SZ);
-	char		*curr_ptr;
-	char		*bnd;
 	TfwMsgIter	iter;
 	unsigned long	acc_len;
 } TfwHttpTransIter;
@@ -535,6 +617,10 @@ typedef struct {
  * TfwStr members must be the first for efficient scanning.
  *
  * @jrxtstamp	- time the message has been received, in jiffies;
+ * @cstream	- state of storing the response in the cache while it's
+ *		  received, set by the cache when the headers are parsed;
+ * @stream_last	- last skb of the response which is already forwarded to
+ *		  the client while the response is streamed;
  * @mit		- iterator for controlling HTTP/1.1 => HTTP/2 message
  *		  transformation process (applicable for HTTP/2 mode only).
  */
@@ -544,6 +630,8 @@ struct tfw_http_resp_t {
 	time_t			date;
 	time_t			last_modified;
 	unsigned long		jrxtstamp;
+	TfwCacheStream		*cstream;
+	struct sk_buff		*stream_last;
 	TfwHttpTransIter	mit;
 };
 
@@ -642,6 +730,22 @@ tfw_h2_pseudo_index(unsigned short status)
 	}
 }
 
+/**
+ * Body of locally generated responses, which is built at configuration time
+ * and is shared by all the responses: skbs of the responses reference the
+ * body pages instead of copying them.
+ *
+ * @pages	- order-0 pages with the body, all of them are full except the
+ *		  last one;
+ * @nr_pages	- number of @pages;
+ * @len		- total body length;
+ */
+typedef struct {
+	struct page	**pages;
+	unsigned int	nr_pages;
+	size_t		len;
+} TfwHttpSharedBody;
+
 typedef void (*tfw_http_cache_cb_t)(TfwHttpMsg *);
 
 /* External HTTP functions. */
@@ -651,42 +755,53 @@ int tfw_http_msg_process_generic(TfwConn *conn, TfwStream *stream,
 unsigned long tfw_http_req_key_calc(TfwHttpReq *req);
 void tfw_http_req_destruct(void *msg);
 void tfw_http_resp_fwd(TfwHttpResp *resp);
+void tfw_http_req_cache_cb(TfwHttpMsg *msg);
 void tfw_http_resp_build_error(TfwHttpReq *req);
 int tfw_cfgop_parse_http_status(const char *status, int *out);
-void tfw_http_hm_srv_send(TfwServer *srv, char *data, unsigned long len);
+void tfw_http_hm_srv_send(TfwServer *srv, struct sk_buff *skb_head,
+			  unsigned long len);
+int tfw_http_req_bg_send(TfwHttpReq *req, TfwStr *data, unsigned int flag);
 int tfw_http_set_loc_hdrs(TfwHttpMsg *hm, TfwHttpReq *req, bool cache);
+void tfw_http_prep_date_from(char *buf, time_t date);
 int tfw_http_expand_stale_warn(TfwHttpResp *resp);
 int tfw_http_expand_hdr_date(TfwHttpResp *resp);
 int tfw_http_expand_hbh(TfwHttpResp *resp, unsigned short status);
 int tfw_http_expand_hdr_via(TfwHttpResp *resp);
 void tfw_h2_resp_fwd(TfwHttpResp *resp);
 int tfw_h2_hdr_map(TfwHttpResp *resp, const TfwStr *hdr, unsigned int id);
-int tfw_h2_add_hdr_date(TfwHttpResp *resp, TfwH2TransOp op, bool cache);
+int tfw_h2_add_hdr_date(TfwHttpResp *resp, bool cache);
 int tfw_h2_set_stale_warn(TfwHttpResp *resp);
 int tfw_h2_resp_add_loc_hdrs(TfwHttpResp *resp, const TfwHdrMods *h_mods,
 			     bool cache);
 int tfw_h2_resp_status_write(TfwHttpResp *resp, unsigned short status,
-			     TfwH2TransOp op, bool cache);
+			     bool cache);
 /*
  * Functions to send an HTTP error response to a client.
  */
 int tfw_h2_prep_redirect(TfwHttpResp *resp, unsigned short status,
-			 TfwStr *rmark, TfwStr *cookie, TfwStr *body);
+			 TfwStr *rmark, TfwStr *cookie,
+			 const TfwHttpSharedBody *body);
 int tfw_h1_prep_redirect(TfwHttpResp *resp, unsigned short status,
-			 TfwStr *rmark, TfwStr *cookie, TfwStr *body);
+			 TfwStr *rmark, TfwStr *cookie,
+			 const TfwHttpSharedBody *body);
 int tfw_http_prep_304(TfwHttpReq *req, struct sk_buff **skb_head,
 		      TfwMsgIter *it);
 void tfw_http_conn_msg_free(TfwHttpMsg *hm);
+bool tfw_http_conn_migrate(TfwSrvConn *srv_conn);
 void tfw_http_send_resp(TfwHttpReq *req, int status, const char *reason);
 
 /* Helper functions */
 char *tfw_http_msg_body_dup(const char *filename, size_t *len);
+int tfw_http_shared_body_init(TfwHttpSharedBody *sb, const char *data,
+			      size_t len);
+void tfw_http_shared_body_free(TfwHttpSharedBody *sb);
+void tfw_http_req_host(const TfwHttpReq *req, TfwStr *host);
 unsigned long tfw_http_hdr_split(TfwStr *hdr, TfwStr *name_out, TfwStr *val_out,
 				 bool inplace);
 unsigned long tfw_h2_hdr_size(unsigned long n_len, unsigned long v_len,
 			      unsigned short st_index);
 int tfw_h2_frame_fwd_resp(TfwHttpResp *resp, unsigned int stream_id,
-			  unsigned long h_len);
+			  unsigned long h_len, struct sk_buff *body);
 int tfw_h2_frame_local_resp(TfwHttpResp *resp, unsigned int stream_id,
 			    unsigned long h_len, const TfwStr *body);
 
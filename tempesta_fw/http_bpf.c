@@ -0,0 +1,255 @@
+/**
+ *		Tempesta FW
+ *
+ * eBPF request classifier.
+ *
+ * A socket filter eBPF program attached by user space runs for each request
+ * once its headers are parsed and before the HTTP tables lookup. The program
+ * gets a private skb with TfwHttpBpfReq at the data start followed by the
+ * request fields, which it reads with bpf_skb_load_bytes() or LD_ABS, so it
+ * can't change the request. The return value is either a verdict or the
+ * mark of the request, which is matched by 'mark' rules of HTTP tables.
+ *
+ * The loader writes the program file descriptor, valid in its own process,
+ * to /proc/tempesta/http_bpf to attach or replace the program on the fly,
+ * negative value detaches the program. Reading the file shows the attached
+ * program ID, zero if there is no program.
+ *
+ * Copyright (C) 2020 Tempesta Technologies, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#include <linux/bpf.h>
+#include <linux/filter.h>
+#include <linux/mutex.h>
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
+#include <linux/skbuff.h>
+
+#include "tempesta_fw.h"
+#include "http_bpf.h"
+#include "http_msg.h"
+#include "log.h"
+
+#define TFW_HTTP_BPF_PROC	"tempesta/http_bpf"
+#define TFW_HTTP_BPF_DATA_MAX	(sizeof(TfwHttpBpfReq) + TFW_HTTP_BPF_URI_MAX \
+				 + TFW_HTTP_BPF_HDR_NUM * TFW_HTTP_BPF_HDR_MAX)
+
+struct bpf_prog __rcu *tfw_http_bpf_prog __read_mostly;
+/* Serializes the program updates. */
+static DEFINE_MUTEX(tfw_http_bpf_mtx);
+static DEFINE_PER_CPU(struct sk_buff *, tfw_http_bpf_skb);
+
+/*
+ * Copy at most @max bytes of @str to the end of @skb and describe them
+ * in @f.
+ */
+static void
+tfw_http_bpf_put(struct sk_buff *skb, TfwHttpBpfStr *f, const TfwStr *str,
+		 unsigned int max)
+{
+	const TfwStr *c, *end;
+	unsigned int n;
+
+	f->off = skb->len;
+	if (TFW_STR_EMPTY(str))
+		return;
+	TFW_STR_FOR_EACH_CHUNK(c, str, end) {
+		n = min_t(unsigned int, c->len, max - f->len);
+		memcpy(skb_put(skb, n), c->data, n);
+		if ((f->len += n) == max)
+			break;
+	}
+}
+
+/*
+ * Build the classifier context of request @req in @skb.
+ */
+static void
+tfw_http_bpf_ctx(TfwHttpReq *req, struct sk_buff *skb)
+{
+	TfwHttpBpfReq *br;
+	TfwStr *hdr, val;
+	unsigned int i;
+
+	__skb_trim(skb, 0);
+	br = (TfwHttpBpfReq *)skb_put(skb, sizeof(*br));
+	memset(br, 0, sizeof(*br));
+	br->version = TFW_HTTP_BPF_VERSION;
+	br->method = req->method;
+	br->http_ver = req->version;
+	memcpy(br->addr, &req->conn->peer->addr.sin6_addr, sizeof(br->addr));
+	skb->mark = req->msg.skb_head->mark;
+
+	tfw_http_bpf_put(skb, &br->uri, &req->uri_path, TFW_HTTP_BPF_URI_MAX);
+	tfw_http_req_host(req, &val);
+	tfw_http_bpf_put(skb, &br->hdr[0], &val, TFW_HTTP_BPF_HDR_MAX);
+	for (i = 1; i < TFW_HTTP_BPF_HDR_NUM; ++i) {
+		hdr = &req->h_tbl->tbl[TFW_HTTP_HDR_REGULAR + i];
+		if (TFW_STR_EMPTY(hdr)) {
+			br->hdr[i].off = skb->len;
+			continue;
+		}
+		if (TFW_STR_DUP(hdr))
+			hdr = TFW_STR_CHUNK(hdr, 0);
+		tfw_http_msg_clnthdr_val(req, hdr, TFW_HTTP_HDR_REGULAR + i,
+					 &val);
+		tfw_http_bpf_put(skb, &br->hdr[i], &val, TFW_HTTP_BPF_HDR_MAX);
+	}
+}
+
+bool
+__tfw_http_bpf_classify(TfwHttpReq *req)
+{
+	struct bpf_prog *prog;
+	struct sk_buff *skb;
+	u32 r = TFW_HTTP_BPF_PASS;
+
+	rcu_read_lock_bh();
+
+	if (!(prog = rcu_dereference_bh(tfw_http_bpf_prog)))
+		goto done;
+	skb = this_cpu_read(tfw_http_bpf_skb);
+	tfw_http_bpf_ctx(req, skb);
+	r = bpf_prog_run_clear_cb(prog, skb);
+	T_DBG2("http_bpf: request %p verdict %#x\n", req, r);
+done:
+	rcu_read_unlock_bh();
+
+	if (r == TFW_HTTP_BPF_BLOCK)
+		return true;
+	if (r != TFW_HTTP_BPF_PASS)
+		req->msg.skb_head->mark = r;
+
+	return false;
+}
+
+/*
+ * Replace the classifier by @prog, NULL detaches the current one.
+ */
+static void
+tfw_http_bpf_attach(struct bpf_prog *prog)
+{
+	struct bpf_prog *old;
+
+	mutex_lock(&tfw_http_bpf_mtx);
+	old = rcu_dereference_protected(tfw_http_bpf_prog,
+					lockdep_is_held(&tfw_http_bpf_mtx));
+	rcu_assign_pointer(tfw_http_bpf_prog, prog);
+	mutex_unlock(&tfw_http_bpf_mtx);
+
+	if (old) {
+		/* Wait for the classifiers in softirq. */
+		synchronize_rcu_bh();
+		bpf_prog_put(old);
+	}
+}
+
+static ssize_t
+tfw_http_bpf_write(struct file *file, const char __user *buf, size_t len,
+		   loff_t *off)
+{
+	struct bpf_prog *prog = NULL;
+	int r, fd;
+
+	if ((r = kstrtoint_from_user(buf, len, 10, &fd)))
+		return r;
+	if (fd >= 0) {
+		prog = bpf_prog_get_type(fd, BPF_PROG_TYPE_SOCKET_FILTER);
+		if (IS_ERR(prog))
+			return PTR_ERR(prog);
+		T_LOG_NL("http_bpf: attach classifier program %u\n",
+			 prog->aux->id);
+	} else {
+		T_LOG_NL("http_bpf: detach classifier program\n");
+	}
+	tfw_http_bpf_attach(prog);
+
+	return len;
+}
+
+static int
+tfw_http_bpf_show(struct seq_file *seq, void *off)
+{
+	struct bpf_prog *prog;
+
+	mutex_lock(&tfw_http_bpf_mtx);
+	prog = rcu_dereference_protected(tfw_http_bpf_prog,
+					 lockdep_is_held(&tfw_http_bpf_mtx));
+	seq_printf(seq, "%u\n", prog ? prog->aux->id : 0);
+	mutex_unlock(&tfw_http_bpf_mtx);
+
+	return 0;
+}
+
+static int
+tfw_http_bpf_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, tfw_http_bpf_show, NULL);
+}
+
+static const struct file_operations tfw_http_bpf_fops = {
+	.owner		= THIS_MODULE,
+	.open		= tfw_http_bpf_open,
+	.read		= seq_read,
+	.write		= tfw_http_bpf_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static void
+tfw_http_bpf_free(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		kfree_skb(per_cpu(tfw_http_bpf_skb, cpu));
+}
+
+int __init
+tfw_http_bpf_init(void)
+{
+	int cpu;
+
+	BUILD_BUG_ON(sizeof(TfwHttpBpfReq) != 72);
+	BUILD_BUG_ON(TFW_HTTP_BPF_HDR_NUM
+		     != TFW_HTTP_HDR_RAW - TFW_HTTP_HDR_REGULAR);
+
+	for_each_possible_cpu(cpu) {
+		struct sk_buff *skb = alloc_skb(TFW_HTTP_BPF_DATA_MAX,
+						GFP_KERNEL);
+		if (!skb) {
+			tfw_http_bpf_free();
+			return -ENOMEM;
+		}
+		per_cpu(tfw_http_bpf_skb, cpu) = skb;
+	}
+	if (!proc_create(TFW_HTTP_BPF_PROC, S_IRUSR | S_IWUSR, NULL,
+			 &tfw_http_bpf_fops))
+	{
+		tfw_http_bpf_free();
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+void
+tfw_http_bpf_exit(void)
+{
+	remove_proc_entry(TFW_HTTP_BPF_PROC, NULL);
+	tfw_http_bpf_attach(NULL);
+	tfw_http_bpf_free();
+}
@@ -0,0 +1,98 @@
+/**
+ *		Tempesta FW
+ *
+ * eBPF request classifier.
+ *
+ * Copyright (C) 2020 Tempesta Technologies, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#ifndef __TFW_HTTP_BPF_H__
+#define __TFW_HTTP_BPF_H__
+
+#include <linux/types.h>
+
+/*
+ * The layout below is shared with the classifier programs and must be
+ * changed along with TFW_HTTP_BPF_VERSION only.
+ */
+#define TFW_HTTP_BPF_VERSION	1
+/* Headers from Host up to the raw ones, see tfw_http_hdr_t. */
+#define TFW_HTTP_BPF_HDR_NUM	11
+#define TFW_HTTP_BPF_URI_MAX	1024
+#define TFW_HTTP_BPF_HDR_MAX	256
+
+/* Verdicts of the classifier, any other value is the request mark. */
+#define TFW_HTTP_BPF_PASS	0
+#define TFW_HTTP_BPF_BLOCK	0xffffffffU
+
+/**
+ * A field of the request, the data is at @off from the data start of the
+ * classifier skb and isn't zero terminated. Empty for absent headers.
+ */
+typedef struct {
+	__u16	off;
+	__u16	len;
+} TfwHttpBpfStr;
+
+/**
+ * Request description at the data start of the classifier skb, the data
+ * of the fields follows it. The skb mark is the mark of the first request
+ * skb, e.g. set by netfilter.
+ *
+ * @addr	- IPv6 (IPv4-mapped for IPv4) address of the client;
+ * @uri		- URI path, at most TFW_HTTP_BPF_URI_MAX bytes;
+ * @hdr		- header values, at most TFW_HTTP_BPF_HDR_MAX bytes each,
+ *		  indexed by TFW_HTTP_HDR_* - TFW_HTTP_HDR_REGULAR; the Host
+ *		  is the one used by HTTP tables, see match_host();
+ * @version	- TFW_HTTP_BPF_VERSION;
+ * @method	- request method, TFW_HTTP_METH_*;
+ * @http_ver	- HTTP version, TFW_HTTP_VER_*;
+ */
+typedef struct {
+	__u8		addr[16];
+	TfwHttpBpfStr	uri;
+	TfwHttpBpfStr	hdr[TFW_HTTP_BPF_HDR_NUM];
+	__u8		version;
+	__u8		method;
+	__u8		http_ver;
+	__u8		_pad[5];
+} TfwHttpBpfReq;
+
+#ifdef __KERNEL__
+
+#include <linux/rcupdate.h>
+
+#include "http.h"
+
+extern struct bpf_prog __rcu *tfw_http_bpf_prog;
+
+bool __tfw_http_bpf_classify(TfwHttpReq *req);
+
+/*
+ * Run the attached classifier for request @req with the parsed headers.
+ *
+ * @return true if the request must be blocked.
+ */
+static inline bool
+tfw_http_bpf_classify(TfwHttpReq *req)
+{
+	if (likely(!rcu_access_pointer(tfw_http_bpf_prog)))
+		return false;
+	return __tfw_http_bpf_classify(req);
+}
+
+#endif /* __KERNEL__ */
+#endif /* __TFW_HTTP_BPF_H__ */
@@ -26,6 +26,7 @@
 #include "procfs.h"
 #include "http.h"
 #include "http_frame.h"
+#include "tls.h"
 
 #define FRAME_PREFACE_CLI_MAGIC		"PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n"
 #define FRAME_PREFACE_CLI_MAGIC_LEN	24
@@ -44,6 +45,14 @@
 
 #define MAX_WND_SIZE			((1U << 31) - 1)
 #define DEF_WND_SIZE			((1U << 16) - 1)
+/*
+ * Initial and maximum sizes of the receive windows tuned to BDP of
+ * a connection. The windows grown above the initial size are limited by
+ * the global budget of 1/2^TFW_H2_WND_MEM_SHIFT of RAM.
+ */
+#define TFW_H2_WND_INIT			(1U << 18)
+#define TFW_H2_WND_MAX			(1U << 24)
+#define TFW_H2_WND_MEM_SHIFT		4
 
 #define TFW_MAX_CLOSED_STREAMS		5
 
@@ -185,9 +194,16 @@ do {									\
 	}								\
 })
 
+static atomic_long_t tfw_h2_wnd_mem = ATOMIC_LONG_INIT(0);
+static unsigned long tfw_h2_wnd_mem_max;
+
 int
 tfw_h2_init(void)
 {
+	tfw_h2_wnd_mem_max = (totalram_pages << PAGE_SHIFT)
+			     >> TFW_H2_WND_MEM_SHIFT;
+	tfw_hpack_dict_init();
+
 	return tfw_h2_stream_cache_create();
 }
 
@@ -195,6 +211,7 @@ void
 tfw_h2_cleanup(void)
 {
 	tfw_h2_stream_cache_destroy();
+	tfw_hpack_cache_drain();
 }
 
 int
@@ -207,20 +224,20 @@ tfw_h2_context_init(TfwH2Ctx *ctx)
 	bzero_fast(ctx, sizeof(*ctx));
 
 	ctx->state = HTTP2_RECV_CLI_START_SEQ;
-	ctx->loc_wnd = MAX_WND_SIZE;
+	ctx->loc_wnd = TFW_H2_WND_INIT;
+	ctx->rem_wnd = DEF_WND_SIZE;
+	ctx->rcv_wnd = TFW_H2_WND_INIT;
 	spin_lock_init(&ctx->lock);
 	INIT_LIST_HEAD(&hclosed_streams->list);
+	tfw_h2_sched_init(&ctx->sched);
 
 	lset->hdr_tbl_sz = rset->hdr_tbl_sz = HPACK_TABLE_DEF_SIZE;
 	lset->push = rset->push = 1;
 	lset->max_streams = rset->max_streams = 0xffffffff;
 	lset->max_frame_sz = rset->max_frame_sz = FRAME_DEF_LENGTH;
 	lset->max_lhdr_sz = rset->max_lhdr_sz = UINT_MAX;
-	/*
-	 * We ignore client's window size until #498, so currently
-	 * we set it to maximum allowed value.
-	 */
-	lset->wnd_sz = rset->wnd_sz = MAX_WND_SIZE;
+	lset->wnd_sz = TFW_H2_WND_INIT;
+	rset->wnd_sz = DEF_WND_SIZE;
 
 	return tfw_hpack_init(&ctx->hpack, HPACK_TABLE_DEF_SIZE);
 }
@@ -229,6 +246,9 @@ void
 tfw_h2_context_clear(TfwH2Ctx *ctx)
 {
 	WARN_ON_ONCE(ctx->streams_num);
+	if (ctx->rcv_wnd > TFW_H2_WND_INIT)
+		atomic_long_sub(ctx->rcv_wnd - TFW_H2_WND_INIT,
+				&tfw_h2_wnd_mem);
 	tfw_hpack_clean(&ctx->hpack);
 }
 
@@ -253,33 +273,16 @@ tfw_h2_unpack_priority(TfwFramePri *pri, const unsigned char *buf)
 }
 
 /**
- * Prepare and send HTTP/2 frame to the client; @hdr must contain
- * the valid data to fill in the frame's header; @data may carry
- * additional data as frame's payload.
- *
- * NOTE: Caller must leave first chunk of @data unoccupied - to
- * provide the place for frame's header which will be packed and
- * written in this procedure.
+ * Send ready HTTP/2 frames @data to the client.
  */
 static int
-__tfw_h2_send_frame(TfwH2Ctx *ctx, TfwFrameHdr *hdr, TfwStr *data, bool close)
+__tfw_h2_send_data(TfwH2Ctx *ctx, TfwStr *data, bool close)
 {
 	int r;
 	TfwMsgIter it;
 	TfwMsg msg = {};
-	unsigned char buf[FRAME_HEADER_SIZE];
-	TfwStr *hdr_str = TFW_STR_CHUNK(data, 0);
 	TfwH2Conn *conn = container_of(ctx, TfwH2Conn, h2);
 
-	BUG_ON(hdr_str->data);
-	hdr_str->data = buf;
-	hdr_str->len = FRAME_HEADER_SIZE;
-
-	if (data != hdr_str)
-		data->len += FRAME_HEADER_SIZE;
-
-	tfw_h2_pack_frame_header(buf, hdr);
-
 	T_DBG2("Preparing HTTP/2 message with %lu bytes data\n", data->len);
 
 	msg.len = data->len;
@@ -310,6 +313,33 @@ err:
 	return r;
 }
 
+/**
+ * Prepare and send HTTP/2 frame to the client; @hdr must contain
+ * the valid data to fill in the frame's header; @data may carry
+ * additional data as frame's payload.
+ *
+ * NOTE: Caller must leave first chunk of @data unoccupied - to
+ * provide the place for frame's header which will be packed and
+ * written in this procedure.
+ */
+static int
+__tfw_h2_send_frame(TfwH2Ctx *ctx, TfwFrameHdr *hdr, TfwStr *data, bool close)
+{
+	unsigned char buf[FRAME_HEADER_SIZE];
+	TfwStr *hdr_str = TFW_STR_CHUNK(data, 0);
+
+	BUG_ON(hdr_str->data);
+	hdr_str->data = buf;
+	hdr_str->len = FRAME_HEADER_SIZE;
+
+	if (data != hdr_str)
+		data->len += FRAME_HEADER_SIZE;
+
+	tfw_h2_pack_frame_header(buf, hdr);
+
+	return __tfw_h2_send_data(ctx, data, close);
+}
+
 static inline int
 tfw_h2_send_frame(TfwH2Ctx *ctx, TfwFrameHdr *hdr, TfwStr *data)
 {
@@ -346,30 +376,70 @@ tfw_h2_send_ping(TfwH2Ctx *ctx)
 
 }
 
-static inline int
-tfw_h2_send_wnd_update(TfwH2Ctx *ctx, unsigned int id, unsigned int wnd_incr)
+/*
+ * Send all the pending WINDOW_UPDATE frames in one message.
+ */
+static int
+tfw_h2_send_wnd_updates(TfwH2Ctx *ctx)
 {
-	unsigned char incr_buf[WND_INCREMENT_SIZE];
-	TfwStr data = {
-		.chunks = (TfwStr []){
-			{},
-			{ .data = incr_buf, .len = WND_INCREMENT_SIZE }
-		},
-		.len = WND_INCREMENT_SIZE,
-		.nchunks = 2
-	};
+	unsigned int i;
+	unsigned char buf[TFW_H2_WND_UPD_BATCH
+			  * (FRAME_HEADER_SIZE + WND_INCREMENT_SIZE)];
+	unsigned char *p = buf;
+	TfwStr data = { .data = buf };
 	TfwFrameHdr hdr = {
-		.length = data.len,
-		.stream_id = id,
+		.length = WND_INCREMENT_SIZE,
 		.type = HTTP2_WINDOW_UPDATE,
 		.flags = 0
 	};
 
-	WARN_ON_ONCE((unsigned int)(wnd_incr & FRAME_RESERVED_BIT_MASK));
+	if (!ctx->wnd_upd_n)
+		return 0;
 
-	*(unsigned int *)incr_buf = htonl(wnd_incr);
+	for (i = 0; i < ctx->wnd_upd_n; ++i) {
+		TfwWndUpd *wu = &ctx->wnd_upd[i];
 
-	return tfw_h2_send_frame(ctx, &hdr, &data);
+		WARN_ON_ONCE(wu->incr & FRAME_RESERVED_BIT_MASK);
+
+		hdr.stream_id = wu->id;
+		tfw_h2_pack_frame_header(p, &hdr);
+		p += FRAME_HEADER_SIZE;
+		*(unsigned int *)p = htonl(wu->incr);
+		p += WND_INCREMENT_SIZE;
+	}
+	ctx->wnd_upd_n = 0;
+	data.len = p - buf;
+
+	return __tfw_h2_send_data(ctx, &data, false);
+}
+
+/*
+ * Queue WINDOW_UPDATE frame for stream @id (or the connection if @id is
+ * zero). The frames are sent by tfw_h2_send_wnd_updates() together at the
+ * end of a received skb processing, the increments of the same window are
+ * merged.
+ */
+static int
+tfw_h2_send_wnd_update(TfwH2Ctx *ctx, unsigned int id, unsigned int wnd_incr)
+{
+	int r;
+	unsigned int i;
+
+	for (i = 0; i < ctx->wnd_upd_n; ++i)
+		if (ctx->wnd_upd[i].id == id) {
+			ctx->wnd_upd[i].incr += wnd_incr;
+			return 0;
+		}
+
+	if (ctx->wnd_upd_n == TFW_H2_WND_UPD_BATCH
+	    && (r = tfw_h2_send_wnd_updates(ctx)))
+		return r;
+
+	ctx->wnd_upd[ctx->wnd_upd_n].id = id;
+	ctx->wnd_upd[ctx->wnd_upd_n].incr = wnd_incr;
+	++ctx->wnd_upd_n;
+
+	return 0;
 }
 
 static inline int
@@ -541,9 +611,11 @@ tfw_h2_headers_pri_process(TfwH2Ctx *ctx)
 
 /*
  * Create a new stream and add it to the streams storage and to the dependency
- * tree. Note, that we do not need to protect the streams storage in @sched from
- * concurrent access, since all operations with it (adding, searching and
- * deletion) are done only in receiving flow of Frame layer.
+ * tree. All the modifications of the streams storage and the dependency tree
+ * are done only in receiving flow of Frame layer, so the receiving flow can
+ * search the storage without locking. However, the transmission flow works
+ * with the streams of @sched on other CPUs, so the modifications are made
+ * under @ctx->lock.
  */
 static TfwStream *
 tfw_h2_stream_create(TfwH2Ctx *ctx, unsigned int id)
@@ -555,13 +627,19 @@ tfw_h2_stream_create(TfwH2Ctx *ctx, unsigned int id)
 	if (tfw_h2_find_stream_dep(&ctx->sched, pri->stream_id, &dep))
 		return NULL;
 
+	spin_lock(&ctx->lock);
+
 	stream = tfw_h2_add_stream(&ctx->sched, id, pri->weight,
-				      ctx->lsettings.wnd_sz);
+				   ctx->lsettings.wnd_sz,
+				   ctx->rsettings.wnd_sz);
+	if (stream)
+		tfw_h2_add_stream_dep(&ctx->sched, stream, dep, excl);
+
+	spin_unlock(&ctx->lock);
+
 	if (!stream)
 		return NULL;
 
-	tfw_h2_add_stream_dep(&ctx->sched, stream, dep, excl);
-
 	++ctx->streams_num;
 
 	T_DBG3("%s: stream added, id=%u, stream=[%p] weight=%hu,"
@@ -575,7 +653,9 @@ tfw_h2_stream_create(TfwH2Ctx *ctx, unsigned int id)
 static inline void
 tfw_h2_stream_clean(TfwH2Ctx *ctx, TfwStream *stream)
 {
+	spin_lock(&ctx->lock);
 	tfw_h2_stop_stream(&ctx->sched, stream);
+	spin_unlock(&ctx->lock);
 	tfw_h2_delete_stream(stream);
 	--ctx->streams_num;
 }
@@ -662,16 +742,6 @@ __tfw_h2_stream_add_closed(TfwClosedQueue *hclosed_streams, TfwStream *stream)
 	++hclosed_streams->num;
 }
 
-static inline void
-tfw_h2_stream_add_closed(TfwH2Ctx *ctx, TfwStream *stream)
-{
-	spin_lock(&ctx->lock);
-
-	__tfw_h2_stream_add_closed(&ctx->hclosed_streams, stream);
-
-	spin_unlock(&ctx->lock);
-}
-
 /*
  * Stream closing procedure: move the stream into special queue of closed
  * streams and send RST_STREAM frame to peer. This procedure is intended
@@ -686,7 +756,12 @@ tfw_h2_stream_close(TfwH2Ctx *ctx, unsigned int id, TfwStream **stream,
 		    TfwH2Err err_code)
 {
 	if (stream && *stream) {
-		tfw_h2_stream_add_closed(ctx, *stream);
+		spin_lock(&ctx->lock);
+		/* No DATA frames can be sent after RST_STREAM. */
+		ss_skb_queue_purge(&(*stream)->xmit);
+		tfw_h2_sched_update(&ctx->sched, *stream);
+		__tfw_h2_stream_add_closed(&ctx->hclosed_streams, *stream);
+		spin_unlock(&ctx->lock);
 		*stream = NULL;
 	}
 
@@ -751,14 +826,128 @@ tfw_h2_stream_id_close(TfwHttpReq *req, unsigned char type,
 	return id;
 }
 
+/*
+ * Get the ID of the next stream reserved by the server push (RFC 7540
+ * section 5.1.1), zero if the client disabled the push or the IDs are
+ * exhausted.
+ */
+unsigned int
+tfw_h2_push_id_next(TfwH2Ctx *ctx)
+{
+	if (!ctx->rsettings.push || !ctx->rsettings.max_streams
+	    || ctx->push_id + 2 > FRAME_STREAM_ID_MASK)
+		return 0;
+
+	return ctx->push_id + 2;
+}
+
+/*
+ * Reserve stream @id got from tfw_h2_push_id_next() and send PUSH_PROMISE
+ * frame with the request header block @hblock on the stream of @req (RFC
+ * 7540 section 6.6). The promise must be sent before the response to @req,
+ * so the stream of @req must wait for the response yet. The response to
+ * the promised request is sent right away, so the stream is moved to
+ * 'half-closed (remote)' state without 'reserved (local)' one and depends
+ * on the stream of @req to be scheduled after the response to @req.
+ *
+ * Called in receiving flow of Frame layer only.
+ */
+int
+tfw_h2_push_promise(TfwHttpReq *req, unsigned int id, const TfwStr *hblock)
+{
+	int r;
+	TfwStream *stream = NULL;
+	unsigned char buf[SREAM_ID_SIZE];
+	TfwH2Ctx *ctx = tfw_h2_context(req->conn);
+	TfwStr data = {
+		.chunks = (TfwStr []){
+			{},
+			{ .data = buf, .len = SREAM_ID_SIZE },
+			{ .data = hblock->data, .len = hblock->len }
+		},
+		.len = SREAM_ID_SIZE + hblock->len,
+		.nchunks = 3
+	};
+	TfwFrameHdr hdr = {
+		.length = data.len,
+		.type = HTTP2_PUSH_PROMISE,
+		.flags = HTTP2_F_END_HEADERS
+	};
+
+	if (data.len > ctx->rsettings.max_frame_sz)
+		return -E2BIG;
+
+	spin_lock(&ctx->lock);
+
+	if (req->stream && tfw_h2_stream_req_complete(req->stream)) {
+		hdr.stream_id = req->stream->id;
+		stream = tfw_h2_add_stream(&ctx->sched, id, 0,
+					   ctx->lsettings.wnd_sz,
+					   ctx->rsettings.wnd_sz);
+	}
+	if (stream) {
+		tfw_h2_add_stream_dep(&ctx->sched, stream, req->stream, false);
+		stream->state = HTTP2_STREAM_REM_HALF_CLOSED;
+	}
+
+	spin_unlock(&ctx->lock);
+
+	if (!stream)
+		return -ENOENT;
+
+	++ctx->streams_num;
+	ctx->push_id = id;
+
+	T_DBG3("%s: stream promised, id=%u, stream=[%p], parent_id=%u,"
+	       " streams_num=%lu\n", __func__, id, stream, hdr.stream_id,
+	       ctx->streams_num);
+
+	*(unsigned int *)buf = htonl(id);
+
+	if ((r = tfw_h2_send_frame(ctx, &hdr, &data))) {
+		spin_lock(&ctx->lock);
+		__tfw_h2_stream_add_closed(&ctx->hclosed_streams, stream);
+		spin_unlock(&ctx->lock);
+	}
+
+	return r;
+}
+
+/*
+ * Close the pushed stream @id once the response is passed to the streams
+ * scheduler, or reset it if the response can't be sent.
+ *
+ * Called in receiving flow of Frame layer only.
+ */
+void
+tfw_h2_push_close(TfwHttpReq *req, unsigned int id, bool reset)
+{
+	TfwH2Ctx *ctx = tfw_h2_context(req->conn);
+	TfwStream *stream = tfw_h2_find_stream(&ctx->sched, id);
+
+	if (reset) {
+		tfw_h2_stream_close(ctx, id, &stream, HTTP2_ECODE_CANCEL);
+		return;
+	}
+	if (!stream)
+		return;
+
+	spin_lock(&ctx->lock);
+
+	STREAM_SEND_PROCESS(stream, HTTP2_HEADERS, HTTP2_F_END_STREAM);
+	__tfw_h2_stream_add_closed(&ctx->hclosed_streams, stream);
+
+	spin_unlock(&ctx->lock);
+}
+
 /*
  * Clean the queue of closed streams if its size has exceeded a certain
- * value.
+ * value. Streams which responses are still being sent are skipped.
  */
 static void
 tfw_h2_closed_streams_shrink(TfwH2Ctx *ctx)
 {
-	TfwStream *cur;
+	TfwStream *cur, *iter;
 	unsigned int max_streams = ctx->lsettings.max_streams;
 	TfwClosedQueue *hclosed_streams = &ctx->hclosed_streams;
 
@@ -775,8 +964,18 @@ tfw_h2_closed_streams_shrink(TfwH2Ctx *ctx)
 		}
 
 		BUG_ON(list_empty(&hclosed_streams->list));
-		cur = list_first_entry(&hclosed_streams->list, TfwStream,
-				       hcl_node);
+		cur = NULL;
+		list_for_each_entry(iter, &hclosed_streams->list, hcl_node) {
+			if (!iter->xmit) {
+				cur = iter;
+				break;
+			}
+		}
+		/* All the responses are still being sent. */
+		if (!cur) {
+			spin_unlock(&ctx->lock);
+			break;
+		}
 		__tfw_h2_stream_unlink(ctx, cur);
 
 		spin_unlock(&ctx->lock);
@@ -850,19 +1049,381 @@ tfw_h2_headers_process(TfwH2Ctx *ctx)
 	return tfw_h2_stream_state_process(ctx);
 }
 
+/*
+ * Read header of the frame at the beginning of @skb_head list.
+ */
+static int
+tfw_h2_skb_frame_hdr(struct sk_buff *skb_head, TfwFrameHdr *hdr)
+{
+	unsigned char buf[FRAME_HEADER_SIZE];
+	struct sk_buff *skb = skb_head;
+	unsigned int n, off = 0;
+
+	do {
+		n = min_t(unsigned int, skb->len, sizeof(buf) - off);
+		if (skb_copy_bits(skb, 0, buf + off, n))
+			return -EINVAL;
+		off += n;
+		skb = skb->next;
+	} while (off < sizeof(buf) && skb != skb_head);
+
+	if (off < sizeof(buf))
+		return -EINVAL;
+	tfw_h2_unpack_frame_header(hdr, buf);
+
+	return 0;
+}
+
+/*
+ * Overwrite header of the frame at the beginning of @skb_head list with @hdr.
+ */
+static int
+tfw_h2_skb_frame_hdr_set(struct sk_buff *skb_head, TfwFrameHdr *hdr)
+{
+	unsigned char buf[FRAME_HEADER_SIZE];
+	struct sk_buff *skb = skb_head;
+	unsigned int n, off = 0;
+
+	tfw_h2_pack_frame_header(buf, hdr);
+	do {
+		n = min_t(unsigned int, skb->len, sizeof(buf) - off);
+		if (skb_store_bits(skb, 0, buf + off, n))
+			return -EINVAL;
+		off += n;
+		skb = skb->next;
+	} while (off < sizeof(buf) && skb != skb_head);
+
+	return off < sizeof(buf) ? -EINVAL : 0;
+}
+
+/*
+ * Move the frame of @len bytes from the beginning of @skb_head list to the
+ * end of @out list. An skb going beyond @len bytes is split. The last skb of
+ * the frame is marked, so that a TLS record doesn't start a frame which
+ * doesn't fit the record, see tfw_tls_encrypt().
+ */
+static int
+tfw_h2_skb_queue_cut(struct sk_buff **skb_head, struct sk_buff **out,
+		     unsigned int len)
+{
+	struct sk_buff *skb, *buff;
+
+	while (len) {
+		if (WARN_ON_ONCE(!(skb = *skb_head)))
+			return -EINVAL;
+		if (skb->len > len) {
+			if (!(buff = ss_skb_split(skb, len)))
+				return -ENOMEM;
+			buff->next = skb->next;
+			buff->prev = skb;
+			skb->next->prev = buff;
+			skb->next = buff;
+		}
+		len -= skb->len;
+		ss_skb_unlink(skb_head, skb);
+		ss_skb_queue_tail(out, skb);
+	}
+	if (*out)
+		ss_skb_peek_tail(out)->tls_msg_end = 1;
+
+	return 0;
+}
+
+/*
+ * Move the first @len bytes of payload of the next DATA frame of @stream to
+ * @out list as a separate frame. The rest of the payload is left in the
+ * stream queue with a new frame header, which inherits the frame flags.
+ */
+static int
+tfw_h2_stream_frame_split(TfwStream *stream, struct sk_buff **out,
+			  unsigned int len)
+{
+	int r;
+	TfwFrameHdr hdr;
+	struct sk_buff *skb;
+	unsigned char *p;
+
+	if ((r = tfw_h2_skb_frame_hdr(stream->xmit, &hdr)))
+		return r;
+	if (WARN_ON_ONCE(hdr.type != HTTP2_DATA || hdr.length <= len))
+		return -EINVAL;
+
+	if (!(skb = ss_skb_alloc(FRAME_HEADER_SIZE)))
+		return -ENOMEM;
+	p = ss_skb_put(skb, FRAME_HEADER_SIZE);
+	hdr.length -= len;
+	tfw_h2_pack_frame_header(p, &hdr);
+
+	hdr.length = len;
+	hdr.flags &= ~HTTP2_F_END_STREAM;
+	r = tfw_h2_skb_frame_hdr_set(stream->xmit, &hdr);
+	if (!r)
+		r = tfw_h2_skb_queue_cut(&stream->xmit, out,
+					 FRAME_HEADER_SIZE + len);
+	if (unlikely(r)) {
+		kfree_skb(skb);
+		return r;
+	}
+
+	/* The payload rest is still queued, so @skb becomes the list head. */
+	ss_skb_queue_tail(&stream->xmit, skb);
+	stream->xmit = skb;
+
+	return 0;
+}
+
+/*
+ * Fetch the frame header of the next queued DATA frame of @stream and update
+ * readiness of the stream for transmission.
+ */
+static int
+tfw_h2_stream_xmit_next(TfwH2Ctx *ctx, TfwStream *stream)
+{
+	TfwFrameHdr hdr;
+	int r = 0;
+
+	if (stream->xmit) {
+		if (!(r = tfw_h2_skb_frame_hdr(stream->xmit, &hdr)))
+			stream->xmit_len = hdr.length;
+		else
+			ss_skb_queue_purge(&stream->xmit);
+	}
+	tfw_h2_sched_update(&ctx->sched, stream);
+
+	return r;
+}
+
+/*
+ * Move DATA frames of the streams ready for transmission to @out list in the
+ * order of the streams scheduler while the connection flow control window
+ * allows. The frames are only sent whole, so the connection and a stream
+ * wait for a window update if the next frame doesn't fit the window.
+ *
+ * The frames are built up to the maximum frame size, but a frame is split
+ * here to fit the TLS record size for the current congestion window, see
+ * tfw_tls_rec_payload(), so the client can process a frame as soon as it
+ * decrypts the record. The frames grow up to full size records as the
+ * window grows.
+ */
+static int
+__tfw_h2_sched_xmit(TfwH2Ctx *ctx, struct sk_buff **out)
+{
+	int r;
+	unsigned int len, max_len = UINT_MAX;
+	TfwStream *stream;
+	TfwH2Conn *conn = container_of(ctx, TfwH2Conn, h2);
+	struct sock *sk = READ_ONCE(((TfwConn *)conn)->sk);
+
+	if (sk)
+		max_len = tfw_tls_rec_payload(sk) - FRAME_HEADER_SIZE;
+
+	while ((stream = tfw_h2_sched_next(&ctx->sched))) {
+		len = min(stream->xmit_len, max_len);
+		if ((long)len > ctx->rem_wnd)
+			break;
+		if (len < stream->xmit_len)
+			r = tfw_h2_stream_frame_split(stream, out, len);
+		else
+			r = tfw_h2_skb_queue_cut(&stream->xmit, out,
+						 FRAME_HEADER_SIZE + len);
+		if (unlikely(r))
+			return r;
+
+		stream->rem_wnd -= len;
+		ctx->rem_wnd -= len;
+		tfw_h2_sched_charge(&ctx->sched, stream,
+				    FRAME_HEADER_SIZE + len);
+
+		if ((r = tfw_h2_stream_xmit_next(ctx, stream)))
+			return r;
+	}
+
+	return 0;
+}
+
+static int
+tfw_h2_skb_send(TfwH2Ctx *ctx, struct sk_buff **skb_head, int ss_flags)
+{
+	int r;
+	struct sk_buff *skb;
+	TfwH2Conn *conn = container_of(ctx, TfwH2Conn, h2);
+	TfwMsg msg = { .skb_head = *skb_head, .ss_flags = ss_flags };
+
+	if (!msg.skb_head)
+		return 0;
+	*skb_head = NULL;
+
+	skb = msg.skb_head;
+	do {
+		msg.len += skb->len;
+		skb = skb->next;
+	} while (skb != msg.skb_head);
+
+	if ((r = tfw_cli_conn_send((TfwCliConn *)conn, &msg)))
+		ss_skb_queue_purge(&msg.skb_head);
+
+	return r;
+}
+
+/*
+ * Send the frames allowed by the flow control windows. Called under
+ * @ctx->lock, so the frames of the connection are sent in the order chosen
+ * by the scheduler even if they are sent from several CPUs.
+ */
+static int
+tfw_h2_sched_xmit(TfwH2Ctx *ctx)
+{
+	int r, rs;
+	struct sk_buff *out = NULL;
+
+	r = __tfw_h2_sched_xmit(ctx, &out);
+	rs = tfw_h2_skb_send(ctx, &out, 0);
+
+	return r ? : rs;
+}
+
+/**
+ * Send HTTP/2 response @msg to the client. HEADERS and CONTINUATION frames
+ * aren't flow controlled and are sent right away to keep the header blocks
+ * in the order of HPACK encoding. DATA frames are queued to the response
+ * stream and are sent by the streams scheduler within the stream and the
+ * connection flow control windows (RFC 7540 sections 5.2 and 5.3).
+ */
+int
+tfw_h2_resp_xmit(TfwH2Ctx *ctx, TfwMsg *msg)
+{
+	int r, rs;
+	TfwFrameHdr hdr;
+	TfwStream *stream;
+	struct sk_buff *out = NULL;
+	TfwH2Conn *conn = container_of(ctx, TfwH2Conn, h2);
+
+	spin_lock(&ctx->lock);
+
+	/*
+	 * The skbs are still used by the caller or the connection is being
+	 * closed, so the response is sent as is.
+	 */
+	if (msg->ss_flags & (SS_F_KEEP_SKB | SS_F_CONN_CLOSE)) {
+		r = tfw_cli_conn_send((TfwCliConn *)conn, msg);
+		goto out;
+	}
+
+	while (msg->skb_head) {
+		if ((r = tfw_h2_skb_frame_hdr(msg->skb_head, &hdr)))
+			goto err;
+		if (hdr.type == HTTP2_DATA)
+			break;
+		r = tfw_h2_skb_queue_cut(&msg->skb_head, &out,
+					 FRAME_HEADER_SIZE + hdr.length);
+		if (unlikely(r))
+			goto err;
+	}
+
+	if (msg->skb_head) {
+		stream = tfw_h2_find_stream(&ctx->sched, hdr.stream_id);
+		/* The stream is already reset by the client. */
+		if (!stream) {
+			ss_skb_queue_purge(&msg->skb_head);
+		}
+		else if (stream->xmit) {
+			ss_skb_queue_append(&stream->xmit, msg->skb_head);
+			msg->skb_head = NULL;
+		}
+		else {
+			stream->xmit = msg->skb_head;
+			msg->skb_head = NULL;
+			stream->xmit_len = hdr.length;
+			tfw_h2_sched_update(&ctx->sched, stream);
+		}
+	}
+
+	r = __tfw_h2_sched_xmit(ctx, &out);
+	rs = tfw_h2_skb_send(ctx, &out, msg->ss_flags);
+	r = r ? : rs;
+out:
+	spin_unlock(&ctx->lock);
+
+	return r;
+err:
+	ss_skb_queue_purge(&out);
+	ss_skb_queue_purge(&msg->skb_head);
+	goto out;
+}
+
+/*
+ * Apply new initial window size @wnd_sz to all the streams (RFC 7540 section
+ * 6.9.2) and send the frames allowed by the new windows. The connection is
+ * terminated with FLOW_CONTROL_ERROR if any window exceeds the maximum size.
+ */
+static int
+tfw_h2_streams_wnd_adjust(TfwH2Ctx *ctx, unsigned int wnd_sz)
+{
+	int r;
+	TfwStream *cur, *next;
+	long delta = (long)wnd_sz - ctx->rsettings.wnd_sz;
+
+	spin_lock(&ctx->lock);
+
+	if (delta > 0) {
+		rbtree_postorder_for_each_entry_safe(cur, next,
+						     &ctx->sched.streams, node)
+		{
+			if (cur->rem_wnd + delta > MAX_WND_SIZE) {
+				spin_unlock(&ctx->lock);
+				tfw_h2_conn_terminate(ctx, HTTP2_ECODE_FLOW);
+				return -EINVAL;
+			}
+		}
+	}
+
+	ctx->rsettings.wnd_sz = wnd_sz;
+	rbtree_postorder_for_each_entry_safe(cur, next, &ctx->sched.streams,
+					     node)
+	{
+		cur->rem_wnd += delta;
+		tfw_h2_sched_update(&ctx->sched, cur);
+	}
+	r = tfw_h2_sched_xmit(ctx);
+
+	spin_unlock(&ctx->lock);
+
+	return r;
+}
+
 static int
 tfw_h2_wnd_update_process(TfwH2Ctx *ctx)
 {
+	int r;
 	unsigned int wnd_incr;
 	TfwFrameHdr *hdr = &ctx->hdr;
+	TfwStream *stream = ctx->cur_stream;
 
 	wnd_incr = ntohl(*(unsigned int *)ctx->rbuf) & ((1U << 31) - 1);
 	if (wnd_incr) {
-		/*
-		 * TODO #498: apply new window size for entire connection or
-		 * particular stream.
-		 */
-		return T_OK;
+		spin_lock(&ctx->lock);
+
+		if (!hdr->stream_id) {
+			if (ctx->rem_wnd + wnd_incr > MAX_WND_SIZE) {
+				spin_unlock(&ctx->lock);
+				tfw_h2_conn_terminate(ctx, HTTP2_ECODE_FLOW);
+				return T_DROP;
+			}
+			ctx->rem_wnd += wnd_incr;
+		}
+		else if (stream) {
+			if (stream->rem_wnd + wnd_incr > MAX_WND_SIZE) {
+				spin_unlock(&ctx->lock);
+				goto flow_err;
+			}
+			stream->rem_wnd += wnd_incr;
+			tfw_h2_sched_update(&ctx->sched, stream);
+		}
+		r = tfw_h2_sched_xmit(ctx);
+
+		spin_unlock(&ctx->lock);
+
+		return r ? T_DROP : T_OK;
 	}
 
 	if (!ctx->cur_stream) {
@@ -875,6 +1436,12 @@ tfw_h2_wnd_update_process(TfwH2Ctx *ctx)
 
 	return tfw_h2_stream_close(ctx, hdr->stream_id, &ctx->cur_stream,
 				   HTTP2_ECODE_PROTO);
+flow_err:
+	if (STREAM_SEND_PROCESS(ctx->cur_stream, HTTP2_RST_STREAM, 0))
+		return T_OK;
+
+	return tfw_h2_stream_close(ctx, hdr->stream_id, &ctx->cur_stream,
+				   HTTP2_ECODE_FLOW);
 }
 
 static inline int
@@ -890,9 +1457,11 @@ tfw_h2_priority_process(TfwH2Ctx *ctx)
 		       " excl=%hhu\n", __func__, hdr->stream_id, pri->stream_id,
 		       pri->weight, pri->exclusive);
 
+		spin_lock(&ctx->lock);
 		tfw_h2_change_stream_dep(&ctx->sched, hdr->stream_id,
 					 pri->stream_id, pri->weight,
 					 pri->exclusive);
+		spin_unlock(&ctx->lock);
 		return T_OK;
 	}
 
@@ -945,10 +1514,11 @@ tfw_h2_apply_settings_entry(TfwH2Ctx *ctx, unsigned short id,
 		break;
 
 	case HTTP2_SETTINGS_INIT_WND_SIZE:
-		if (val > MAX_WND_SIZE)
+		if (val > MAX_WND_SIZE) {
+			tfw_h2_conn_terminate(ctx, HTTP2_ECODE_FLOW);
 			return T_BAD;
-		dest->wnd_sz = val;
-		break;
+		}
+		return tfw_h2_streams_wnd_adjust(ctx, val) ? T_BAD : T_OK;
 
 	case HTTP2_SETTINGS_MAX_FRAME_SIZE:
 		if (val < FRAME_DEF_LENGTH || val > FRAME_MAX_LENGTH)
@@ -1061,6 +1631,16 @@ tfw_h2_first_settings_verify(TfwH2Ctx *ctx)
 	return T_OK;
 }
 
+/*
+ * Check if stream @id is idle, i.e. isn't opened by the client or reserved
+ * by the server push yet (RFC 7540 section 5.1).
+ */
+static inline bool
+tfw_h2_stream_id_idle(TfwH2Ctx *ctx, unsigned int id)
+{
+	return id & 1 ? id > ctx->lstream_id : id > ctx->push_id;
+}
+
 static inline int
 tfw_h2_stream_id_verify(TfwH2Ctx *ctx)
 {
@@ -1106,12 +1686,54 @@ tfw_h2_stream_id_verify(TfwH2Ctx *ctx)
 	return T_OK;
 }
 
+/*
+ * Tune the receive windows to BDP of the connection in the same way as
+ * tcp_rcv_space_adjust() does it for TCP: if the peer sends more than a half
+ * of the window during RTT, then the window limits the peer and it's grown
+ * to twice the data received in RTT; if the peer sends much less, e.g. the
+ * connection was idle, then the window is halved. The windows above the
+ * initial size are charged to the global memory budget.
+ */
+static void
+tfw_h2_rcv_wnd_tune(TfwH2Ctx *ctx, unsigned int len)
+{
+	TfwH2Conn *conn = container_of(ctx, TfwH2Conn, h2);
+	struct tcp_sock *tp = tcp_sk(((TfwConn *)conn)->sk);
+	u32 rtt = tp->srtt_us >> 3;
+	unsigned int wnd = ctx->rcv_wnd;
+	long delta;
+
+	ctx->rcv_bytes += len;
+	if (!rtt || tp->tcp_mstamp - ctx->rcv_tstamp < rtt)
+		return;
+
+	if (ctx->rcv_bytes > wnd / 2)
+		wnd = min_t(unsigned long, 2UL * ctx->rcv_bytes,
+			    TFW_H2_WND_MAX);
+	else if (ctx->rcv_bytes < wnd / 8)
+		wnd = max(wnd / 2, TFW_H2_WND_INIT);
+
+	delta = (long)wnd - ctx->rcv_wnd;
+	if (delta > 0 && atomic_long_add_return(delta, &tfw_h2_wnd_mem)
+			 > tfw_h2_wnd_mem_max)
+	{
+		atomic_long_sub(delta, &tfw_h2_wnd_mem);
+	}
+	else {
+		if (delta < 0)
+			atomic_long_add(delta, &tfw_h2_wnd_mem);
+		ctx->rcv_wnd = wnd;
+	}
+
+	ctx->rcv_bytes = 0;
+	ctx->rcv_tstamp = tp->tcp_mstamp;
+}
+
 static inline int
 tfw_h2_flow_control(TfwH2Ctx *ctx)
 {
 	TfwFrameHdr *hdr = &ctx->hdr;
 	TfwStream *stream = ctx->cur_stream;
-	TfwSettings *lset = &ctx->lsettings;
 
 	BUG_ON(!stream);
 	if (hdr->length > stream->loc_wnd)
@@ -1125,22 +1747,24 @@ tfw_h2_flow_control(TfwH2Ctx *ctx)
 	stream->loc_wnd -= hdr->length;
 	ctx->loc_wnd -= hdr->length;
 
-	if (stream->loc_wnd <= lset->wnd_sz / 2) {
-		if( tfw_h2_send_wnd_update(ctx, stream->id,
-					   lset->wnd_sz - stream->loc_wnd))
+	tfw_h2_rcv_wnd_tune(ctx, hdr->length);
+
+	if (stream->loc_wnd <= ctx->rcv_wnd / 2) {
+		if (tfw_h2_send_wnd_update(ctx, stream->id,
+					   ctx->rcv_wnd - stream->loc_wnd))
 		{
 			return T_DROP;
 		}
-		stream->loc_wnd = lset->wnd_sz;
+		stream->loc_wnd = ctx->rcv_wnd;
 	}
 
-
-	if (ctx->loc_wnd <= MAX_WND_SIZE / 2) {
-		if (tfw_h2_send_wnd_update(ctx, 0, MAX_WND_SIZE - ctx->loc_wnd))
+	if (ctx->loc_wnd <= ctx->rcv_wnd / 2) {
+		if (tfw_h2_send_wnd_update(ctx, 0,
+					   ctx->rcv_wnd - ctx->loc_wnd))
 		{
 			return T_DROP;
 		}
-		ctx->loc_wnd = MAX_WND_SIZE;
+		ctx->loc_wnd = ctx->rcv_wnd;
 	}
 
 	return T_OK;
@@ -1225,7 +1849,7 @@ tfw_h2_frame_type_process(TfwH2Ctx *ctx)
 		 * DATA frames are not allowed for idle streams (see RFC 7540
 		 * section 5.1 for details).
 		 */
-		if (hdr->stream_id > ctx->lstream_id) {
+		if (tfw_h2_stream_id_idle(ctx, hdr->stream_id)) {
 			err_code = HTTP2_ECODE_PROTO;
 			goto conn_term;
 		}
@@ -1322,7 +1946,7 @@ tfw_h2_frame_type_process(TfwH2Ctx *ctx)
 		 * WINDOW_UPDATE frame not allowed for idle streams (see RFC
 		 * 7540 section 5.1 for details).
 		 */
-		if (hdr->stream_id > ctx->lstream_id) {
+		if (tfw_h2_stream_id_idle(ctx, hdr->stream_id)) {
 			err_code = HTTP2_ECODE_PROTO;
 			goto conn_term;
 		}
@@ -1400,7 +2024,7 @@ tfw_h2_frame_type_process(TfwH2Ctx *ctx)
 		 * RST_STREAM frames are not allowed for idle streams (see RFC
 		 * 7540 section 5.1 and section 6.4 for details).
 		 */
-		if (hdr->stream_id > ctx->lstream_id) {
+		if (tfw_h2_stream_id_idle(ctx, hdr->stream_id)) {
 			err_code = HTTP2_ECODE_PROTO;
 			goto conn_term;
 		}
@@ -1440,7 +2064,7 @@ tfw_h2_frame_type_process(TfwH2Ctx *ctx)
 		 * CONTINUATION frames are not allowed for idle streams (see
 		 * RFC 7540 section 5.1 and section 6.4 for details).
 		 */
-		if (hdr->stream_id > ctx->lstream_id) {
+		if (tfw_h2_stream_id_idle(ctx, hdr->stream_id)) {
 			err_code = HTTP2_ECODE_PROTO;
 			goto conn_term;
 		}
@@ -1503,7 +2127,7 @@ tfw_h2_frame_recv(void *data, unsigned char *buf, size_t len,
 
 		if (tfw_h2_send_settings_init(ctx)
 		    || tfw_h2_send_wnd_update(ctx, 0,
-						 MAX_WND_SIZE - DEF_WND_SIZE))
+					      ctx->rcv_wnd - DEF_WND_SIZE))
 		{
 			FRAME_FSM_EXIT(T_DROP);
 		}
@@ -1696,12 +2320,12 @@ tfw_h2_context_reinit(TfwH2Ctx *ctx, bool postponed)
 	}
 }
 
-int
-tfw_h2_frame_process(void *c, TfwFsmData *data)
+static int
+__tfw_h2_frame_process(void *c, TfwFsmData *data)
 {
 	int r;
 	bool postponed;
-	unsigned int parsed, unused;
+	unsigned int parsed, unused, off = 0;
 	TfwFsmData data_up = {};
 	TfwH2Ctx *h2 = tfw_h2_context(c);
 	struct sk_buff *nskb = NULL, *skb = data->skb;
@@ -1709,8 +2333,10 @@ tfw_h2_frame_process(void *c, TfwFsmData *data)
 next_msg:
 	postponed = false;
 	ss_skb_queue_tail(&h2->skb_head, skb);
+	if (off)
+		h2->skb_off = off;
 	parsed = 0;
-	r = ss_skb_process(skb, tfw_h2_frame_recv, h2, &unused, &parsed);
+	r = ss_skb_process(skb, off, tfw_h2_frame_recv, h2, &unused, &parsed);
 
 	switch (r) {
 	default:
@@ -1743,14 +2369,17 @@ next_msg:
 
 	/*
 	 * For fully received frames possibly there are other frames
-	 * in the current @skb, so create an skb sibling with next
-	 * frame and process it on the next iteration. This situation
+	 * in the current @skb. The skb with an app frame is passed to the
+	 * upper layer, so create an skb sibling with next frame and process
+	 * it on the next iteration. Service frames are processed in place,
+	 * at the offset of the next frame in the same skb. This situation
 	 * is excluded for postponed frames, since for them the value
 	 * of @parsed must be always equal to the length of skb currently
 	 * processed.
 	 */
-	if (parsed < skb->len) {
-		nskb = ss_skb_split(skb, parsed);
+	off += parsed;
+	if (off < skb->len && APP_FRAME(h2)) {
+		nskb = ss_skb_split(skb, off);
 		if (unlikely(!nskb)) {
 			TFW_INC_STAT_BH(clnt.msgs_otherr);
 			r = T_DROP;
@@ -1769,9 +2398,11 @@ next_msg:
 	 * will be just split into separate skb (above).
 	 */
 	if (APP_FRAME(h2)) {
-		while (unlikely(h2->skb_head->len <= h2->data_off)) {
+		unsigned int data_off = h2->skb_off + h2->data_off;
+
+		while (unlikely(h2->skb_head->len <= data_off)) {
 			struct sk_buff *skb = ss_skb_dequeue(&h2->skb_head);
-			h2->data_off -= skb->len;
+			data_off -= skb->len;
 			kfree_skb(skb);
 			/*
 			 * Special case when the frame is postponed just
@@ -1779,7 +2410,8 @@ next_msg:
 			 * frame header fields processed.
 			 */
 			if (!h2->skb_head) {
-				WARN_ON_ONCE(h2->data_off);
+				WARN_ON_ONCE(data_off);
+				h2->skb_off = h2->data_off = 0;
 				return T_OK;
 			}
 		}
@@ -1789,13 +2421,12 @@ next_msg:
 		 */
 		WARN_ON_ONCE(h2->skb_head != h2->skb_head->next);
 		data_up.skb = h2->skb_head;
-		if (ss_skb_chop_head_tail(NULL, data_up.skb, h2->data_off, 0))
-		{
+		if (ss_skb_chop_head_tail(NULL, data_up.skb, data_off, 0)) {
 			r = T_DROP;
 			kfree_skb(nskb);
 			goto out;
 		}
-		h2->data_off = 0;
+		h2->skb_off = h2->data_off = 0;
 		h2->skb_head = data_up.skb->next = data_up.skb->prev = NULL;
 		r = tfw_http_msg_process_generic(c, h2->cur_stream, &data_up);
 		if (r == T_DROP) {
@@ -1803,7 +2434,14 @@ next_msg:
 			goto out;
 		}
 	} else {
+		/* Keep @skb if the next frame starts in it. */
+		if (off < skb->len)
+			ss_skb_unlink(&h2->skb_head, skb);
 		ss_skb_queue_purge(&h2->skb_head);
+		if (off < skb->len) {
+			tfw_h2_context_reinit(h2, postponed);
+			goto next_msg;
+		}
 	}
 
 	tfw_h2_context_reinit(h2, postponed);
@@ -1811,6 +2449,7 @@ next_msg:
 	if (nskb) {
 		skb = nskb;
 		nskb = NULL;
+		off = 0;
 		goto next_msg;
 	}
 
@@ -1818,3 +2457,17 @@ out:
 	ss_skb_queue_purge(&h2->skb_head);
 	return r;
 }
+
+int
+tfw_h2_frame_process(void *c, TfwFsmData *data)
+{
+	TfwH2Ctx *h2 = tfw_h2_context(c);
+	int r = __tfw_h2_frame_process(c, data);
+
+	if (r == T_DROP) {
+		h2->wnd_upd_n = 0;
+		return r;
+	}
+
+	return tfw_h2_send_wnd_updates(h2) ? T_DROP : r;
+}
@@ -133,6 +133,20 @@ typedef struct {
 	unsigned long		num;
 } TfwClosedQueue;
 
+#define TFW_H2_WND_UPD_BATCH		8
+#define TFW_H2_PUSH_KEYS		8
+
+/**
+ * WINDOW_UPDATE frame waiting for transmission.
+ *
+ * @id			- stream ID, zero for the connection window;
+ * @incr		- window size increment;
+ */
+typedef struct {
+	unsigned int	id;
+	unsigned int	incr;
+} TfwWndUpd;
+
 /**
  * Context for HTTP/2 frames processing.
  *
@@ -140,14 +154,30 @@ typedef struct {
  * @lsettings		- local settings for HTTP/2 connection;
  * @rsettings		- settings for HTTP/2 connection received from the
  *			  remote endpoint;
- * @streams_num		- number of the streams initiated by client;
+ * @streams_num		- number of the streams initiated by client or
+ *			  reserved by the server push;
  * @sched		- streams' priority scheduler;
  * @hclosed_streams	- queue of half-closed streams (in
  *			  HTTP2_STREAM_LOC_CLOSED or HTTP2_STREAM_REM_CLOSED
  *			  states), which are waiting for removal;
  * @lstream_id		- ID of last stream initiated by client and processed on
  *			  the server side;
+ * @push_id		- ID of last stream reserved by the server push;
+ * @push_bytes		- length of the responses pushed to the client;
+ * @push_n		- number of the pushed responses;
+ * @push_keys		- ring of the cache keys of the last pushed responses,
+ *			  to not push the same resource on the connection;
  * @loc_wnd		- connection's current flow controlled window;
+ * @rem_wnd		- connection's flow controlled window of the remote
+ *			  peer;
+ * @rcv_wnd		- size of the connection and stream windows which
+ *			  the peer's windows are updated to, tuned to BDP of
+ *			  the connection;
+ * @rcv_bytes		- DATA payload received since @rcv_tstamp;
+ * @rcv_tstamp		- start of the current window tuning round, usecs;
+ * @wnd_upd_n		- number of WINDOW_UPDATE frames in @wnd_upd;
+ * @wnd_upd		- WINDOW_UPDATE frames sent at the end of processing
+ *			  of a received skb;
  * @hpack		- HPACK context, used in processing of
  *			  HEADERS/CONTINUATION frames;
  * @__off		- offset to reinitialize processing context;
@@ -170,6 +200,8 @@ typedef struct {
  * @padlen		- length of current frame's padding (if exists);
  * @data_off		- offset of app data in HEADERS, CONTINUATION and DATA
  *			  frames (after all service payloads);
+ * @skb_off		- offset of the current frame in the first skb of
+ *			  @skb_head, if the skb also held previous frames;
  *
  * NOTE: we can keep HPACK context in general connection-wide HTTP/2 context
  * (instead of separate HPACK context for each stream), since frames from other
@@ -184,7 +216,17 @@ typedef struct {
 	TfwStreamSched	sched;
 	TfwClosedQueue	hclosed_streams;
 	unsigned int	lstream_id;
+	unsigned int	push_id;
+	unsigned long	push_bytes;
+	unsigned int	push_n;
+	unsigned long	push_keys[TFW_H2_PUSH_KEYS];
 	unsigned int	loc_wnd;
+	long		rem_wnd;
+	unsigned int	rcv_wnd;
+	unsigned int	rcv_bytes;
+	u64		rcv_tstamp;
+	unsigned int	wnd_upd_n;
+	TfwWndUpd	wnd_upd[TFW_H2_WND_UPD_BATCH];
 	TfwHPack	hpack;
 	char		__off[0];
 	struct sk_buff	*skb_head;
@@ -198,6 +240,7 @@ typedef struct {
 	unsigned char	rbuf[FRAME_HEADER_SIZE];
 	unsigned char	padlen;
 	unsigned char	data_off;
+	unsigned int	skb_off;
 } TfwH2Ctx;
 
 int tfw_h2_init(void);
@@ -211,6 +254,10 @@ unsigned int tfw_h2_stream_id_close(TfwHttpReq *req, unsigned char type,
 				    unsigned char flags);
 void tfw_h2_conn_terminate_close(TfwH2Ctx *ctx, TfwH2Err err_code, bool close);
 int tfw_h2_send_rst_stream(TfwH2Ctx *ctx, unsigned int id, TfwH2Err err_code);
+unsigned int tfw_h2_push_id_next(TfwH2Ctx *ctx);
+int tfw_h2_push_promise(TfwHttpReq *req, unsigned int id, const TfwStr *hblock);
+void tfw_h2_push_close(TfwHttpReq *req, unsigned int id, bool reset);
+int tfw_h2_resp_xmit(TfwH2Ctx *ctx, TfwMsg *msg);
 
 static inline void
 tfw_h2_pack_frame_header(unsigned char *p, const TfwFrameHdr *hdr)
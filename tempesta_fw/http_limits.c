@@ -24,7 +24,10 @@
  * TODO: #488 add socket/connection options adjusting to change client QoS
  */
 #include <linux/ctype.h>
-#include <linux/spinlock.h>
+#include <linux/ip.h>
+#include <linux/ktime.h>
+#include <net/ipv6.h>
+#include <net/tcp.h>
 
 #include "lib/fsm.h"
 #include "tdb.h"
@@ -38,6 +41,7 @@
 #include "gfsm.h"
 #include "http_msg.h"
 #include "vhost.h"
+#include "http_trace.h"
 #include "log.h"
 
 /*
@@ -113,20 +117,28 @@ tfw_classifier_cleanup_inport(void)
 	memset(&tfw_inports, 0, sizeof(tfw_inports));
 }
 
+static bool
+tfw_classify_inport(struct sock *sk)
+{
+	int i;
+	unsigned short sport = tfw_addr_get_sk_sport(sk);
+
+	for (i = 0; i < tfw_inports.count; ++i)
+		if (sport == tfw_inports.ports[i])
+			return true;
+	return false;
+}
+
 static int
 tfw_classify_conn_estab(struct sock *sk)
 {
 	int i;
-	unsigned short sport = tfw_addr_get_sk_sport(sk);
 	TfwClassifier *clfr;
 
 	/* Pass the packet if it's not for us. */
-	for (i = 0; i < tfw_inports.count; ++i)
-		if (sport == tfw_inports.ports[i])
-			goto ours;
-	return TFW_PASS;
+	if (!tfw_classify_inport(sk))
+		return TFW_PASS;
 
-ours:
 	rcu_read_lock();
 
 	clfr = rcu_dereference(classifier);
@@ -151,14 +163,18 @@ tfw_classify_conn_close(struct sock *sk)
 /**
  * Called from sk_filter() called from tcp_v4_rcv() and tcp_v6_rcv(),
  * i.e. when IP fragments are already assembled and we can process TCP.
+ * For listening sockets this happens before a request socket is allocated
+ * for a SYN segment.
  */
 static int
 tfw_classify_tcp(struct sock *sk, struct sk_buff *skb)
 {
-	struct tcphdr *th = tcp_hdr(skb);
 	TfwClassifier *clfr = rcu_dereference(classifier);
 
-	return clfr && clfr->classify_tcp ? clfr->classify_tcp(th) : TFW_PASS;
+	if (!clfr || !clfr->classify_tcp || !tfw_classify_inport(sk))
+		return TFW_PASS;
+
+	return clfr->classify_tcp(sk, skb);
 }
 
 /*
@@ -197,40 +213,42 @@ static TempestaOps tempesta_ops = {
  * ------------------------------------------------------------------------
  */
 
-typedef struct {
-	unsigned long	ts;
-	unsigned int	conn_new;
-	unsigned int	req;
-} FrangRates;
-
-/**
- * Response code record.
- *
- * @cnt	- Amount of responses in a time frame part;
- * @ts	- Response time in seconds. Four bytes could be used to store enough
- *   number of seconds in the assumption that there won't be delays between user
- *   responses longer than 68 years;
+/*
+ * Rate accounting slot of a ring-buffer history: the time frame number is
+ * stored in the upper 32 bits and the number of events in the frame is in
+ * the lower 32 bits, so the slot is updated by a single cmpxchg. Four bytes
+ * are enough for the frame numbers until the buffer wraps around once per
+ * 17 years.
  */
-typedef struct {
-	unsigned int	cnt;
-	unsigned int	ts;
-} __attribute__((packed)) FrangRespCodeStat;
+#define FRANG_SLOT_TS(v)	((unsigned int)((u64)(v) >> 32))
+#define FRANG_SLOT_CNT(v)	((unsigned int)(v))
+#define FRANG_SLOT(ts, cnt)	((s64)(((u64)(ts) << 32) | (cnt)))
 
 /**
- * Main descriptor of client resource accounting.
- * @lock can be removed if RSS is tuned to schedule packets based on
- * <proto, src_ip> tuple. However, the hashing could produce bad CPU load
- * balancing so, such settings are not desirable.
+ * Main descriptor of client resource accounting. The same client may send
+ * traffic through many connections processed on different CPUs, e.g. when
+ * the client is a large NAT, so all the counters are updated by atomic
+ * operations only and no lock is taken for the client.
  *
  * @conn_curr		- current connections number;
- * @history		- bursts history organized as a ring-buffer;
- * @resp_code_stat	- response code record
+ * @conn_new		- new connections history, ring-buffer of slots;
+ * @req			- requests history, ring-buffer of slots;
+ * @resp_code_stat	- response codes history, ring-buffer of slots, the
+ *			  time frames are in http_resp_code_block quantums;
+ * @req_tat		- theoretical arrival time of the next request for
+ *			  the request rate GCRA, in nanoseconds;
+ * @req_btat		- the same for the request burst GCRA;
+ * @tun_tat		- theoretical arrival time of the next byte sent through
+ *			  the client tunnels, in nanoseconds;
  */
 typedef struct {
-	unsigned int		conn_curr;
-	spinlock_t		lock;
-	FrangRates		history[FRANG_FREQ];
-	FrangRespCodeStat	resp_code_stat[FRANG_FREQ];
+	atomic_t		conn_curr;
+	atomic64_t		conn_new[FRANG_FREQ];
+	atomic64_t		req[FRANG_FREQ];
+	atomic64_t		resp_code_stat[FRANG_FREQ];
+	atomic64_t		req_tat;
+	atomic64_t		req_btat;
+	atomic64_t		tun_tat;
 } FrangAcc;
 
 #define FRANG_CLI2ACC(c)	((FrangAcc *)(&(c)->class_prvt))
@@ -238,7 +256,10 @@ typedef struct {
 					     TfwClient, class_prvt)
 
 #define frang_msg(check, addr, fmt, ...)				\
-	T_WARN_MOD_ADDR(frang, check, addr, TFW_NO_PORT, fmt, ##__VA_ARGS__)
+do {									\
+	trace_tfw_frang_block(addr, check);				\
+	T_WARN_MOD_ADDR(frang, check, addr, TFW_NO_PORT, fmt, ##__VA_ARGS__); \
+} while (0)
 
 /*
  * Client actions has triggered a security event. Log the client addr and
@@ -267,18 +288,63 @@ do {									\
 #define frang_dbg(...)
 #endif
 
+/**
+ * Account an event at time frame @ts in the ring-buffer @slots and return
+ * the number of events in the frame including the new one. A slot left from
+ * a previous round of the ring-buffer is reset.
+ */
+static unsigned int
+frang_slot_inc(atomic64_t *slots, unsigned int ts)
+{
+	atomic64_t *slot = &slots[ts % FRANG_FREQ];
+	s64 old = atomic64_read(slot), new, prev;
+
+	for ( ; ; ) {
+		new = FRANG_SLOT_TS(old) == ts ? old + 1 : FRANG_SLOT(ts, 1);
+		prev = atomic64_cmpxchg(slot, old, new);
+		if (likely(prev == old))
+			return FRANG_SLOT_CNT(new);
+		old = prev;
+	}
+}
+
+/**
+ * The number of events in frame @ts of the ring-buffer @slots.
+ */
+static unsigned int
+frang_slot_cnt(atomic64_t *slots, unsigned int ts)
+{
+	s64 v = atomic64_read(&slots[ts % FRANG_FREQ]);
+
+	return FRANG_SLOT_TS(v) == ts ? FRANG_SLOT_CNT(v) : 0;
+}
+
+/**
+ * Sum of the events in the ring-buffer @slots which happened less than
+ * @span time frames before @ts. The slots are read one by one, so a
+ * concurrent update may be missed, which is fine for the rate limits.
+ */
+static unsigned int
+frang_slots_sum(atomic64_t *slots, unsigned int ts, unsigned int span)
+{
+	int i;
+	unsigned int sum = 0;
+
+	for (i = 0; i < FRANG_FREQ; i++) {
+		s64 v = atomic64_read(&slots[i]);
+
+		if (ts - FRANG_SLOT_TS(v) < span)
+			sum += FRANG_SLOT_CNT(v);
+	}
+
+	return sum;
+}
+
 static int
 frang_conn_limit(FrangAcc *ra, FrangGlobCfg *conf)
 {
-	unsigned long ts = (jiffies * FRANG_FREQ) / HZ;
-	unsigned int csum = 0;
-	int i = ts % FRANG_FREQ;
-
-	if (ra->history[i].ts != ts) {
-		ra->history[i].ts = ts;
-		ra->history[i].conn_new = 0;
-		ra->history[i].req = 0;
-	}
+	unsigned int ts = (jiffies * FRANG_FREQ) / HZ;
+	unsigned int curr, cnew, csum;
 
 	/*
 	 * Increment connection counters even when we return TFW_BLOCK.
@@ -288,25 +354,23 @@ frang_conn_limit(FrangAcc *ra, FrangGlobCfg *conf)
 	 * connection attempts and connections that were successfully
 	 * established.
 	 */
-	ra->history[i].conn_new++;
-	ra->conn_curr++;
+	cnew = frang_slot_inc(ra->conn_new, ts);
+	curr = atomic_inc_return(&ra->conn_curr);
 
-	if (conf->conn_max && ra->conn_curr > conf->conn_max) {
-		frang_limmsg("connections max num.", ra->conn_curr,
+	if (conf->conn_max && curr > conf->conn_max) {
+		frang_limmsg("connections max num.", curr,
 			     conf->conn_max, &FRANG_ACC2CLI(ra)->addr);
 		return TFW_BLOCK;
 	}
 
-	if (conf->conn_burst && ra->history[i].conn_new > conf->conn_burst) {
-		frang_limmsg("new connections burst", ra->history[i].conn_new,
+	if (conf->conn_burst && cnew > conf->conn_burst) {
+		frang_limmsg("new connections burst", cnew,
 			     conf->conn_burst, &FRANG_ACC2CLI(ra)->addr);
 		return TFW_BLOCK;
 	}
 
 	/* Collect current connection sum. */
-	for (i = 0; i < FRANG_FREQ; i++)
-		if (ra->history[i].ts + FRANG_FREQ >= ts)
-			csum += ra->history[i].conn_new;
+	csum = frang_slots_sum(ra->conn_new, ts, FRANG_FREQ + 1);
 	if (conf->conn_rate && csum > conf->conn_rate) {
 		frang_limmsg("new connections rate", csum, conf->conn_rate,
 			     &FRANG_ACC2CLI(ra)->addr);
@@ -322,7 +386,9 @@ __frang_init_acc(void *data)
 	TfwClient *cli = (TfwClient *)data;
 	FrangAcc *ra = FRANG_CLI2ACC(cli);
 
-	spin_lock_init(&ra->lock);
+	atomic64_set(&ra->req_tat, 0);
+	atomic64_set(&ra->req_btat, 0);
+	atomic64_set(&ra->tun_tat, 0);
 }
 
 static int
@@ -352,8 +418,6 @@ frang_conn_new(struct sock *sk)
 
 	ra = FRANG_CLI2ACC(cli);
 
-	spin_lock(&ra->lock);
-
 	/*
 	 * sk->sk_user_data references TfwConn{} which in turn references
 	 * TfwPeer, so basically we can get FrangAcc from TfwConn{}.
@@ -385,7 +449,68 @@ frang_conn_new(struct sock *sk)
 		tfw_client_put(cli);
 	}
 
-	spin_unlock(&ra->lock);
+	tfw_vhost_put(dflt_vh);
+
+	return r;
+}
+
+/**
+ * Check connection rate limits for a new connection request, i.e. a TCP SYN
+ * segment hitting a listening socket. The kernel doesn't allocate anything
+ * for the connection yet, so a client exceeding the limits is refused at the
+ * lowest possible cost. The accounting data is only read here to not create
+ * clients (and let spoofed SYNs to fill the clients database) and account
+ * connection attempts twice: frang_conn_new() still accounts and enforces
+ * the limits for the established connections.
+ */
+static int
+frang_conn_syn(struct sock *sk, struct sk_buff *skb)
+{
+	int r = TFW_PASS;
+	unsigned int ts;
+	struct tcphdr *th = tcp_hdr(skb);
+	FrangGlobCfg *conf;
+	FrangAcc *ra;
+	TfwClient *cli;
+	TfwAddr addr;
+	TfwVhost *dflt_vh;
+
+	if (sk->sk_state != TCP_LISTEN || !th->syn || th->ack)
+		return TFW_PASS;
+
+	dflt_vh = tfw_vhost_lookup_default();
+	if (unlikely(!dflt_vh))
+		return TFW_PASS;
+	conf = dflt_vh->frang_gconf;
+	if (!conf->conn_syn || (!conf->conn_rate && !conf->conn_burst))
+		goto out;
+
+	bzero_fast(&addr, sizeof(addr));
+	addr.sin6_family = AF_INET6;
+	ipv6_addr_set_v4mapped(ip_hdr(skb)->saddr, &addr.sin6_addr);
+	if (!(cli = tfw_client_lookup(&addr)))
+		goto out;
+	ra = FRANG_CLI2ACC(cli);
+
+	ts = (jiffies * FRANG_FREQ) / HZ;
+
+	if (conf->conn_burst
+	    && frang_slot_cnt(ra->conn_new, ts) >= conf->conn_burst)
+	{
+		frang_dbg("new connections burst exceeded on SYN for %s\n",
+			  &addr);
+		r = TFW_BLOCK;
+		goto out;
+	}
+	if (conf->conn_rate
+	    && frang_slots_sum(ra->conn_new, ts, FRANG_FREQ + 1)
+	       >= conf->conn_rate)
+	{
+		frang_dbg("new connections rate exceeded on SYN for %s\n",
+			  &addr);
+		r = TFW_BLOCK;
+	}
+out:
 	tfw_vhost_put(dflt_vh);
 
 	return r;
@@ -400,50 +525,107 @@ frang_conn_close(struct sock *sk)
 	FrangAcc *ra = sk->sk_security;
 
 	BUG_ON(!ra);
+	BUG_ON(atomic_dec_return(&ra->conn_curr) < 0);
 
-	spin_lock(&ra->lock);
+	tfw_client_put(FRANG_ACC2CLI(ra));
+}
 
-	BUG_ON(!ra->conn_curr);
-	ra->conn_curr--;
+/*
+ * Generic Cell Rate Algorithm: a request conforms to @n requests per @period
+ * nanoseconds if the theoretical arrival time @tat of the next request isn't
+ * ahead of @now for more than the burst tolerance. The tolerance allows @n
+ * requests to come at once, just like the sliding window does. Only the
+ * conforming requests move @tat forward by @t nanoseconds.
+ */
+static bool
+__frang_gcra(atomic64_t *tat, u64 now, u64 t, u64 tau)
+{
+	s64 old = atomic64_read(tat), prev;
 
-	spin_unlock(&ra->lock);
+	for ( ; ; ) {
+		u64 base = max_t(u64, old, now);
 
-	tfw_client_put(FRANG_ACC2CLI(ra));
+		if (base - now > tau)
+			return false;
+		prev = atomic64_cmpxchg(tat, old, base + t);
+		if (likely(prev == old))
+			return true;
+		old = prev;
+	}
 }
 
-static int
-frang_time_in_frame(const unsigned long tcur, const unsigned long tprev)
+static inline bool
+frang_gcra(atomic64_t *tat, u64 now, u64 period, unsigned int n)
 {
-	return tprev + FRANG_FREQ > tcur;
+	u64 t = div_u64(period, n);
+
+	return __frang_gcra(tat, now, t, period - t);
 }
 
+/*
+ * Data of the client tunnels isn't parsed, so only the bytes rate is limited,
+ * by GCRA with each byte as a cell and the tolerance of a second of data.
+ */
 static int
-frang_req_limit(FrangAcc *ra, unsigned int req_burst, unsigned int req_rate)
+frang_tunnel_limit(FrangAcc *ra, unsigned int tunnel_rate, unsigned int len)
 {
-	unsigned long ts = jiffies * FRANG_FREQ / HZ;
-	unsigned int rsum = 0;
-	int i = ts % FRANG_FREQ;
+	u64 t = div_u64((u64)len * NSEC_PER_SEC, tunnel_rate);
 
-	if (!req_burst && !req_rate)
+	if (__frang_gcra(&ra->tun_tat, ktime_get_mono_fast_ns(), t,
+			 NSEC_PER_SEC))
 		return TFW_PASS;
+	frang_msg("tunnel data rate exceeded", &FRANG_ACC2CLI(ra)->addr,
+		  ": (lim=%u)\n", tunnel_rate);
+
+	return TFW_BLOCK;
+}
+
+/*
+ * GCRA version of frang_req_limit(): the same burst and rate semantics, but
+ * a single timestamp for each of the limits is updated by cmpxchg instead of
+ * the ring-buffer slots, so the rate check doesn't need to read the whole
+ * history.
+ */
+static int
+frang_req_limit_gcra(FrangAcc *ra, unsigned int req_burst,
+		     unsigned int req_rate)
+{
+	u64 now = ktime_get_mono_fast_ns();
 
-	if (ra->history[i].ts != ts) {
-		ra->history[i].ts = ts;
-		ra->history[i].conn_new = 0;
-		ra->history[i].req = 0;
+	if (req_burst && !frang_gcra(&ra->req_btat, now,
+				     NSEC_PER_SEC / FRANG_FREQ, req_burst))
+	{
+		frang_msg("requests burst exceeded", &FRANG_ACC2CLI(ra)->addr,
+			  ": (lim=%u)\n", req_burst);
+		return TFW_BLOCK;
+	}
+	if (req_rate && !frang_gcra(&ra->req_tat, now, NSEC_PER_SEC, req_rate))
+	{
+		frang_msg("request rate exceeded", &FRANG_ACC2CLI(ra)->addr,
+			  ": (lim=%u)\n", req_rate);
+		return TFW_BLOCK;
 	}
-	ra->history[i].req++;
 
-	if (req_burst && ra->history[i].req > req_burst) {
-		frang_limmsg("requests burst", ra->history[i].req,
+	return TFW_PASS;
+}
+
+static int
+__frang_req_limit(FrangAcc *ra, unsigned int req_burst, unsigned int req_rate)
+{
+	unsigned int ts = jiffies * FRANG_FREQ / HZ;
+	unsigned int rcnt, rsum;
+
+	rcnt = frang_slot_inc(ra->req, ts);
+	if (req_burst && rcnt > req_burst) {
+		frang_limmsg("requests burst", rcnt,
 			     req_burst, &FRANG_ACC2CLI(ra)->addr);
 		return TFW_BLOCK;
 	}
 	/* Collect current request sum. */
-	for (i = 0; i < FRANG_FREQ; i++)
-		if (frang_time_in_frame(ts, ra->history[i].ts))
-			rsum += ra->history[i].req;
-	if (req_rate && rsum > req_rate) {
+	if (!req_rate)
+		return TFW_PASS;
+	rsum = frang_slots_sum(ra->req, ts, FRANG_FREQ);
+	if (rsum > req_rate) {
 		frang_limmsg("request rate", rsum, req_rate,
 			     &FRANG_ACC2CLI(ra)->addr);
 		return TFW_BLOCK;
@@ -452,6 +634,23 @@ frang_req_limit(FrangAcc *ra, unsigned int req_burst, unsigned int req_rate)
 	return TFW_PASS;
 }
 
+/*
+ * Only the request rate limits use the client accounting data shared by all
+ * the client connections, all the other request checks use the request and
+ * the configuration only.
+ */
+static int
+frang_req_limit(FrangAcc *ra, FrangGlobCfg *fg_cfg)
+{
+	if (!fg_cfg->req_burst && !fg_cfg->req_rate)
+		return TFW_PASS;
+	if (fg_cfg->req_gcra)
+		return frang_req_limit_gcra(ra, fg_cfg->req_burst,
+					    fg_cfg->req_rate);
+
+	return __frang_req_limit(ra, fg_cfg->req_burst, fg_cfg->req_rate);
+}
+
 static int
 frang_http_uri_len(const TfwHttpReq *req, FrangAcc *ra, unsigned int uri_len)
 {
@@ -699,6 +898,7 @@ frang_http_host_check(const TfwHttpReq *req, FrangAcc *ra)
 	((TFW_FSM_FRANG_REQ << TFW_GFSM_FSM_SHIFT) | (s))
 enum {
 	TFW_FRANG_REQ_FSM_INIT	= TFW_GFSM_FRANG_REQ_STATE(0),
+	TFW_FRANG_REQ_FSM_TUNNEL = TFW_GFSM_FRANG_REQ_STATE(1),
 	TFW_FRANG_REQ_FSM_DONE	= TFW_GFSM_FRANG_REQ_STATE(TFW_GFSM_STATE_LAST)
 };
 
@@ -967,8 +1167,6 @@ frang_http_req_process(FrangAcc *ra, TfwConn *conn, TfwFsmData *data,
 	if (WARN_ON_ONCE(!fg_cfg || !f_cfg))
 		return TFW_BLOCK;
 
-	spin_lock(&ra->lock);
-
 	/*
 	 * Detect slowloris attack first, and then proceed with more precise
 	 * checks. This is not an FSM state, because the checks are required
@@ -980,10 +1178,8 @@ frang_http_req_process(FrangAcc *ra, TfwConn *conn, TfwFsmData *data,
 	else
 		r = frang_http_req_incomplete_body_check(ra, data, fg_cfg,
 							 f_cfg);
-	if (r) {
-		spin_unlock(&ra->lock);
+	if (r)
 		return r;
-	}
 
 	T_FSM_START(req->frang_st) {
 
@@ -994,7 +1190,7 @@ frang_http_req_process(FrangAcc *ra, TfwConn *conn, TfwFsmData *data,
 	 * that run when a connection is established or destroyed.
 	 */
 	T_FSM_STATE(Frang_Req_0) {
-		r = frang_req_limit(ra, fg_cfg->req_burst, fg_cfg->req_rate);
+		r = frang_req_limit(ra, fg_cfg);
 		/* Set the time the header started coming in. */
 		req->tm_header = jiffies;
 		__FRANG_FSM_MOVE(Frang_Req_Hdr_Method);
@@ -1062,6 +1258,21 @@ frang_http_req_process(FrangAcc *ra, TfwConn *conn, TfwFsmData *data,
 		*/
 		if (f_cfg->http_ct_required || f_cfg->http_ct_vals)
 			r = frang_http_ct_check(req, ra, f_cfg->http_ct_vals);
+		if (r)
+			T_FSM_EXIT();
+		/*
+		 * Don't wait for the body, which is declared to be larger
+		 * than allowed.
+		 */
+		if (f_cfg->http_body_len
+		    && req->content_length > f_cfg->http_body_len)
+		{
+			frang_limmsg("HTTP body length", req->content_length,
+				     f_cfg->http_body_len,
+				     &FRANG_ACC2CLI(ra)->addr);
+			r = TFW_BLOCK;
+			T_FSM_EXIT();
+		}
 
 		__FRANG_FSM_MOVE(Frang_Req_Body_Start);
 	}
@@ -1106,11 +1317,34 @@ frang_http_req_process(FrangAcc *ra, TfwConn *conn, TfwFsmData *data,
 	}
 	T_FSM_FINISH(r, req->frang_st);
 
-	spin_unlock(&ra->lock);
-
 	return r;
 }
 
+/*
+ * Data received through the client tunnel, there is no request.
+ */
+static int
+frang_tunnel_handler(TfwConn *conn, FrangAcc *ra, TfwFsmData *data)
+{
+	int r = TFW_PASS;
+	FrangGlobCfg *fg_cfg;
+	TfwVhost *dvh = tfw_vhost_lookup_default();
+
+	if (WARN_ON_ONCE(!dvh))
+		return TFW_BLOCK;
+	fg_cfg = dvh->frang_gconf;
+	if (fg_cfg->tunnel_rate)
+		r = frang_tunnel_limit(ra, fg_cfg->tunnel_rate,
+				       data->skb->len);
+	if (r == TFW_BLOCK && fg_cfg->ip_block)
+		tfw_filter_block_ip(&FRANG_ACC2CLI(ra)->addr);
+	tfw_vhost_put(dvh);
+	if (r != TFW_PASS)
+		return r;
+
+	return tfw_gfsm_move(&conn->state, TFW_FRANG_REQ_FSM_DONE, data);
+}
+
 static int
 frang_http_req_handler(void *obj, TfwFsmData *data)
 {
@@ -1120,6 +1354,8 @@ frang_http_req_handler(void *obj, TfwFsmData *data)
 	TfwVhost *dvh = NULL;
 	TfwHttpReq *req = (TfwHttpReq *)data->req;
 
+	if (TFW_GFSM_STATE(&conn->state) == TFW_FRANG_REQ_FSM_TUNNEL)
+		return frang_tunnel_handler(conn, ra, data);
 	if (req->peer)
 		ra = FRANG_CLI2ACC(req->peer);
 
@@ -1192,22 +1428,11 @@ frang_resp_quantum(unsigned short tframe)
 static int
 frang_resp_code_limit(FrangAcc *ra, FrangHttpRespCodeBlock *resp_cblk)
 {
-	FrangRespCodeStat *stat = ra->resp_code_stat;
-	unsigned long cnt = 0;
+	unsigned int cnt;
 	const unsigned int ts = frang_resp_quantum(resp_cblk->tf);
-	int i = 0;
 
-	i = ts % FRANG_FREQ;
-	if (ts != stat[i].ts) {
-		stat[i].ts = ts;
-		stat[i].cnt = 1;
-	} else {
-		++stat[i].cnt;
-	}
-	for (i = 0; i < FRANG_FREQ; ++i) {
-		if (frang_time_in_frame(ts, stat[i].ts))
-			cnt += stat[i].cnt;
-	}
+	frang_slot_inc(ra->resp_code_stat, ts);
+	cnt = frang_slots_sum(ra->resp_code_stat, ts, FRANG_FREQ);
 	if (cnt > resp_cblk->limit) {
 		frang_limmsg("http_resp_code_block limit", cnt,
 			     resp_cblk->limit, &FRANG_ACC2CLI(ra)->addr);
@@ -1253,7 +1478,6 @@ frang_resp_fwd_process(TfwHttpResp *resp)
 	    || !test_bit(HTTP_CODE_BIT_NUM(resp->status), conf->codes))
 		return TFW_PASS;
 
-	spin_lock(&ra->lock);
 	/*
 	 * According to the backend response code attacker may be trying to crack
 	 * the password. This security event must be triggered when the response
@@ -1263,7 +1487,6 @@ frang_resp_fwd_process(TfwHttpResp *resp)
 	 * and wipe all their received but not processed requests ASAP.
 	 */
 	r = frang_resp_code_limit(ra, conf);
-	spin_unlock(&ra->lock);
 
 	if (r == TFW_BLOCK) {
 		/* Default vhost has no 'vhost_dflt' member set. */
@@ -1308,6 +1531,7 @@ frang_resp_handler(void *obj, TfwFsmData *data)
 
 static TfwClassifier frang_class_ops = {
 	.name			= "frang",
+	.classify_tcp		= frang_conn_syn,
 	.classify_conn_estab	= frang_conn_new,
 	.classify_conn_close	= frang_conn_close,
 };
@@ -1341,6 +1565,13 @@ static FrangGfsmHook frang_gfsm_hooks[] = {
 		.st0		= TFW_FRANG_REQ_FSM_INIT,
 		.name		= "request_skb_end",
 	},
+	{
+		.prio		= -1,
+		.hook_state	= TFW_HTTP_FSM_TUNNEL_CHUNK,
+		.fsm_id		= TFW_FSM_FRANG_REQ,
+		.st0		= TFW_FRANG_REQ_FSM_TUNNEL,
+		.name		= "tunnel_skb_end",
+	},
 	{
 		.prio		= -1,
 		.hook_state	= TFW_HTTP_FSM_RESP_MSG,
@@ -61,7 +61,7 @@ typedef struct {
 	/*
 	 * Classify TCP segments.
 	 */
-	int	(*classify_tcp)(struct tcphdr *th);
+	int	(*classify_tcp)(struct sock *sk, struct sk_buff *skb);
 	/*
 	 * Called when a new client connection is established (many TCP SYNs
 	 * can precede an established connection, so it's more efficient to
@@ -170,10 +170,16 @@ typedef struct {
  * @req_rate		- Maximum requests per second over all the
  *			  connections from the single client;
  * @req_burst		- Allowed request rate burst;
+ * @req_gcra		- Use Generic Cell Rate Algorithm for @req_rate and
+ *			  @req_burst instead of the sliding window;
  * @conn_rate		- Maximum new connections per second from the same
  *			  client;
  * @conn_burst		- Allowed connection rate burst;
+ * @conn_syn		- Enforce @conn_rate and @conn_burst on TCP SYN
+ *			  segments, before a socket is allocated;
  * @conn_max		- Maximum number of allowed concurrent connections;
+ * @tunnel_rate		- Maximum bytes per second sent by a client via
+ *			  the upgraded connections;
  * @http_hchunk_cnt	- Maximum number of chunks in header part;
  * @http_bchunk_cnt	- Maximum number of chunks in body part;
  * @ip_block		- Block clients by IP address if set, if not - just
@@ -189,11 +195,14 @@ struct frang_global_cfg_t {
 	unsigned int		conn_rate;
 	unsigned int		conn_burst;
 	unsigned int		conn_max;
+	unsigned int		tunnel_rate;
 
 	unsigned int		http_hchunk_cnt;
 	unsigned int		http_bchunk_cnt;
 
 	bool			ip_block;
+	bool			req_gcra;
+	bool			conn_syn;
 };
 
 /**
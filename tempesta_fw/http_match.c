@@ -20,6 +20,7 @@
  *    existence in @arg:
  *    "==": "arg" => eq / "arg*" => eq_prefix / "*arg" => eq_suffix.
  *    "!=": "arg" => non_eq / "arg*" => non_eq_prefix / "*arg" => non_eq_suffix.
+ *    An argument started with '~' is a regular expression, see regex.c.
  *  - @act is a rule action with appropriate type (examples specified above);
  *    possible types are: reference to virtual host (defined before), reference
  *    to other HTTP chain (defined before and not the same), "mark" action for
@@ -45,6 +46,16 @@
  * (the match_fn_tbl). However the code is critical for performance, so perhaps
  * this may be optimized to a kind of jump table.
  *
+ * Tables generated for many hosts or locations have thousands of rules, so
+ * linear matching of such chains is too slow. tfw_http_chain_compile() finds
+ * long runs of consecutive rules comparing the same request field with a
+ * string or method and builds an index for each run: a hash of the arguments
+ * over each length of eq and prefix arguments and another one for suffix
+ * arguments hashed backwards. A request field is scanned once in each
+ * direction, and the first of the found rules is the first matching rule of
+ * the run, just like with the linear matching. Regex arguments of the run
+ * are compiled into a single DFA, which is matched in one more pass.
+ *
  * TODO:
  *   - Compare normalized URIs.
  *   - Handle LWS* between header and value for raw headers.
@@ -68,6 +79,10 @@
  * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
  */
 #include <linux/ctype.h>
+#include <linux/log2.h>
+#include <linux/sort.h>
+#include <linux/stringhash.h>
+
 #include "http_match.h"
 #include "http_msg.h"
 #include "cfg.h"
@@ -88,6 +103,12 @@ map_op_to_str_eq_flags(tfw_http_match_op_t op)
 	return flags_tbl[op];
 }
 
+static inline bool
+match_regex(const TfwHttpMatchRule *rule, const TfwStr *str)
+{
+	return tfw_regex_match(rule->re, str) != TFW_REGEX_NOMATCH;
+}
+
 /**
  * Look up a header in the @req->h_tbl by given @id,
  * and compare @rule->arg with the header's value (skipping name and LWS).
@@ -126,6 +147,8 @@ hdr_val_eq(const TfwHttpReq *req, const TfwHttpMatchRule *rule,
 		return true;
 
 	tfw_http_msg_clnthdr_val(req, hdr, id, &hdr_val);
+	if (op == TFW_HTTP_MATCH_O_REGEX)
+		return match_regex(rule, &hdr_val);
 
 	flags = map_op_to_str_eq_flags(rule->op);
 	/*
@@ -161,6 +184,8 @@ match_uri(const TfwHttpReq *req, const TfwHttpMatchRule *rule)
 
 	if (rule->op == TFW_HTTP_MATCH_O_WILDCARD)
 		return true;
+	if (rule->op == TFW_HTTP_MATCH_O_REGEX)
+		return match_regex(rule, uri_path);
 
 	flags = map_op_to_str_eq_flags(rule->op);
 	/* RFC 7230:
@@ -190,6 +215,8 @@ match_host(const TfwHttpReq *req, const TfwHttpMatchRule *rule)
 
 	if (rule->op == TFW_HTTP_MATCH_O_WILDCARD)
 		return true;
+	if (rule->op == TFW_HTTP_MATCH_O_REGEX)
+		return match_regex(rule, host);
 
 	flags = map_op_to_str_eq_flags(rule->op);
 	/*
@@ -218,36 +245,30 @@ match_host(const TfwHttpReq *req, const TfwHttpMatchRule *rule)
  * case for all headers according to the robustness principle.
  */
 static bool
-match_hdr_raw(const TfwHttpReq *req, const TfwHttpMatchRule *rule)
+__match_hdr_raw(const TfwStr *hdr, const TfwHttpMatchRule *rule, bool h2_mode,
+		tfw_str_eq_flags_t flags)
 {
-	int i;
-	bool h2_mode = TFW_MSG_H2(req);
-	tfw_str_eq_flags_t flags = map_op_to_str_eq_flags(rule->op);
+	bool col_found;
+	const TfwStr *dup, *end, *chunk;
+	const char *c, *cend, *p, *pend;
+	char prev;
+	short cnum;
 
-	for (i = TFW_HTTP_HDR_RAW; i < req->h_tbl->off; ++i) {
-		bool col_found;
-		const TfwStr *hdr, *dup, *end, *chunk;
-		const char *c, *cend, *p, *pend;
-		char prev;
-		short cnum;
+	if (TFW_STR_EMPTY(hdr))
+		return false;
 
-		hdr = &req->h_tbl->tbl[i];
-		if (TFW_STR_EMPTY(hdr)) {
-			continue;
+	TFW_STR_FOR_EACH_DUP(dup, hdr, end) {
+		/* Initialize  the state - get the first chunk. */
+		col_found = false;
+		p = rule->arg.str;
+		pend = rule->arg.str + rule->arg.len;
+		cnum = 0;
+		chunk = TFW_STR_CHUNK(dup, 0);
+		if (!chunk) {
+			return p == NULL;
 		}
-
-		TFW_STR_FOR_EACH_DUP(dup, hdr, end) {
-			/* Initialize  the state - get the first chunk. */
-			col_found = false;
-			p = rule->arg.str;
-			pend = rule->arg.str + rule->arg.len;
-			cnum = 0;
-			chunk = TFW_STR_CHUNK(dup, 0);
-			if (!chunk) {
-				return p == NULL;
-			}
-			c = chunk->data;
-			cend = chunk->data + chunk->len;
+		c = chunk->data;
+		cend = chunk->data + chunk->len;
 
 #define _TRY_NEXT_CHUNK(ok_code, err_code)		\
 	if (unlikely(c == cend))	{		\
@@ -280,98 +301,129 @@ match_hdr_raw(const TfwHttpReq *req, const TfwHttpMatchRule *rule)
 		break;					\
 	}
 
-			prev = *p;
+		prev = *p;
 state_common:
-			while (p != pend && c != cend) {
+		while (p != pend && c != cend) {
+
+			/* If we reached the value chunk of HTTP/2
+			 * header, but colon is not found in the rule
+			 * yet, the header does not fit the rule.
+			 */
+			__H2_VERIFY();
 
-				/* If we reached the value chunk of HTTP/2
-				 * header, but colon is not found in the rule
-				 * yet, the header does not fit the rule.
+			/* The rule convert to lower case on the step of
+			 * handling the configuration.
+			 */
+			if (*p != tolower(*c)) {
+
+				/* If the characters from the rule and
+				 * HTTP/2 header does not match, this
+				 * could be due to colon and subsequent
+				 * OWS in the rule, so, we should skip
+				 * them and check the next character.
 				 */
-				__H2_VERIFY();
+				__H2_VERIFY_NON_MATCH();
 
-				/* The rule convert to lower case on the step of
-				 * handling the configuration.
+				/* If the same position of the header
+				 * field and rule have a different
+				 * number of whitespace characters,
+				 * consider their as equivalent and
+				 * skip whitespace characters after ':'.
 				 */
-				if (*p != tolower(*c)) {
-
-					/* If the characters from the rule and
-					 * HTTP/2 header does not match, this
-					 * could be due to colon and subsequent
-					 * OWS in the rule, so, we should skip
-					 * them and check the next character.
-					 */
-					__H2_VERIFY_NON_MATCH();
-
-					/* If the same position of the header
-					 * field and rule have a different
-					 * number of whitespace characters,
-					 * consider their as equivalent and
-					 * skip whitespace characters after ':'.
-					 */
-					if (isspace(prev) || prev == ':') {
-						if (isspace(*c)) {
-							c++;
-							goto state_hdr_sp;
-						}
-
-						if (isspace(*p)) {
-							prev = *p++;
-							goto state_rule_sp;
-						}
+				if (isspace(prev) || prev == ':') {
+					if (isspace(*c)) {
+						c++;
+						goto state_hdr_sp;
 					}
 
-					break;
+					if (isspace(*p)) {
+						prev = *p++;
+						goto state_rule_sp;
+					}
 				}
 
-				prev = *p++;
-				c++;
+				break;
 			}
 
-			if (p == pend && flags & TFW_STR_EQ_PREFIX) {
-				return true;
-			}
+			prev = *p++;
+			c++;
+		}
 
-			_TRY_NEXT_CHUNK(goto state_common, {
-				/* If header field and rule finished, then
-				 * header field and rule are equivalent.
-				 */
-				if (p == pend) {
-					return true;
-				}
+		if (p == pend && flags & TFW_STR_EQ_PREFIX) {
+			return true;
+		}
 
-				/* If only rule doesn't finished, may be it have
-				 * trailing spaces.
-				 */
-				if (isspace(*p)) {
-					p++;
-					goto state_rule_sp;
-				}
-			});
+		_TRY_NEXT_CHUNK(goto state_common, {
+			/* If header field and rule finished, then
+			 * header field and rule are equivalent.
+			 */
+			if (p == pend) {
+				return true;
+			}
 
-			/* If only header field doesn't finished, may be it have
+			/* If only rule doesn't finished, may be it have
 			 * trailing spaces.
 			 */
-			if (p == pend && isspace(*c)) {
-				c++;
-				goto state_hdr_sp;
+			if (isspace(*p)) {
+				p++;
+				goto state_rule_sp;
 			}
+		});
+
+		/* If only header field doesn't finished, may be it have
+		 * trailing spaces.
+		 */
+		if (p == pend && isspace(*c)) {
+			c++;
+			goto state_hdr_sp;
+		}
 
-			continue;
+		continue;
 
 state_rule_sp:
-			_MOVE_TO_COND(p, pend, !isspace(*p));
-			goto state_common;
+		_MOVE_TO_COND(p, pend, !isspace(*p));
+		goto state_common;
 
 state_hdr_sp:
-			_MOVE_TO_COND(c, cend, !isspace(*c));
-			goto state_common;
-		}
+		_MOVE_TO_COND(c, cend, !isspace(*c));
+		goto state_common;
 	}
 
 	return false;
 }
 
+static bool
+match_hdr_raw(const TfwHttpReq *req, const TfwHttpMatchRule *rule)
+{
+	unsigned int i, id = TFW_HTTP_HDR_RAW;
+	const TfwHttpHdrTbl *ht = req->h_tbl;
+	const TfwHttpHdrIdx *e;
+	bool h2_mode = TFW_MSG_H2(req);
+	tfw_str_eq_flags_t flags = map_op_to_str_eq_flags(rule->op);
+
+	/*
+	 * Only the header with the rule name can match, so probe the indexed
+	 * headers with the same name hash and scan the not indexed ones.
+	 */
+	if (rule->hname_len) {
+		unsigned int tag = TFW_HHTBL_IDX_TAG(rule->hname_hash);
+
+		for (i = rule->hname_hash;
+		     (e = &ht->idx[i % TFW_HHTBL_IDX_SZ])->id; ++i)
+			if (e->tag == tag
+			    && __match_hdr_raw(&ht->tbl[e->id], rule, h2_mode,
+					       flags))
+				return true;
+		id = ht->idx_off;
+	}
+
+	for ( ; id < ht->off; ++id)
+		if (__match_hdr_raw(&ht->tbl[id], rule, h2_mode, flags))
+			return true;
+
+	return false;
+}
+
 static bool
 match_hdr(const TfwHttpReq *req, const TfwHttpMatchRule *rule)
 {
@@ -461,6 +513,437 @@ do_eval(const TfwHttpReq *req, const TfwHttpMatchRule *rule)
 	return true;
 }
 
+/*
+ * ------------------------------------------------------------------------
+ *	Compiled rules runs
+ * ------------------------------------------------------------------------
+ */
+/* Shorter runs of rules are matched linearly. */
+#define TFW_HTTP_MATCH_IDX_MIN		8
+
+/**
+ * Argument of a rule in a rules run index.
+ *
+ * @hlist	- entry in the index hash table;
+ * @rule	- the rule;
+ * @hash	- case-insensitive hash of the argument, reversed for suffixes;
+ * @len		- the argument length;
+ * @pos		- the rule position in the run;
+ * @op		- the rule operator;
+ */
+typedef struct {
+	struct hlist_node	hlist;
+	TfwHttpMatchRule	*rule;
+	unsigned long		hash;
+	unsigned int		len;
+	unsigned int		pos;
+	tfw_http_match_op_t	op;
+} TfwHttpMatchIdxEnt;
+
+/**
+ * Index of a run of consecutive rules comparing the same request field.
+ *
+ * @first	- the first rule of the run;
+ * @last	- the last rule of the run;
+ * @field	- the request field compared by the rules;
+ * @hid		- the compared header ID for TFW_HTTP_MATCH_F_HDR;
+ * @meth	- the first rule for each method for TFW_HTTP_MATCH_F_METHOD;
+ * @buckets	- hash table of the rules arguments;
+ * @bits	- log2 of the @buckets number;
+ * @eq		- there are eq rules in the run;
+ * @pfx_len	- ascending distinct lengths of prefix arguments;
+ * @pfx_n	- number of @pfx_len entries;
+ * @sfx_len	- ascending distinct lengths of suffix arguments;
+ * @sfx_n	- number of @sfx_len entries;
+ * @re		- DFA of the regex arguments;
+ * @re_rule	- the rules with regex arguments in the order of the run;
+ * @re_pos	- positions of @re_rule in the run;
+ * @re_n	- number of @re_rule entries;
+ */
+struct tfw_http_match_idx_t {
+	TfwHttpMatchRule	*first;
+	TfwHttpMatchRule	*last;
+	tfw_http_match_fld_t	field;
+	unsigned int		hid;
+	TfwHttpMatchRule	**meth;
+	struct hlist_head	*buckets;
+	unsigned int		bits;
+	bool			eq;
+	unsigned int		*pfx_len;
+	unsigned int		pfx_n;
+	unsigned int		*sfx_len;
+	unsigned int		sfx_n;
+	TfwRegex		re;
+	TfwHttpMatchRule	**re_rule;
+	unsigned int		*re_pos;
+	unsigned int		re_n;
+};
+
+#define __IDX_HASH(c, h)	partial_name_hash(TFW_LC((unsigned char)(c)), h)
+
+static inline struct hlist_head *
+__idx_bucket(const TfwHttpMatchIdx *idx, unsigned long hash, unsigned int len)
+{
+	return &idx->buckets[hash_long(hash + len, idx->bits)];
+}
+
+/**
+ * Update @best with the first rule of the run having operator @op and the
+ * argument of length @len with hash @hash, which matches @req.
+ */
+static void
+__idx_lookup(const TfwHttpReq *req, const TfwHttpMatchIdx *idx,
+	     tfw_http_match_op_t op, unsigned long hash, unsigned int len,
+	     const TfwHttpMatchIdxEnt **best)
+{
+	const TfwHttpMatchIdxEnt *e;
+
+	hlist_for_each_entry(e, __idx_bucket(idx, hash, len), hlist) {
+		if (e->hash != hash || e->len != len || e->op != op
+		    || (*best && (*best)->pos < e->pos))
+			continue;
+		if (match_fn_tbl[idx->field](req, e->rule))
+			*best = e;
+	}
+}
+
+/**
+ * Get the request field compared by the rules of @idx in the same way as
+ * match_uri(), match_host() and hdr_val_eq() do this.
+ * @return false if the field is absent, so none of the rules match.
+ */
+static bool
+__idx_field(const TfwHttpReq *req, const TfwHttpMatchIdx *idx, TfwStr *val)
+{
+	TfwStr *hdr;
+	unsigned int id = idx->hid;
+
+	switch (idx->field) {
+	case TFW_HTTP_MATCH_F_URI:
+		*val = req->uri_path;
+		return true;
+	case TFW_HTTP_MATCH_F_HOST:
+		if (req->host.len) {
+			*val = req->host;
+			return true;
+		}
+		id = TFW_HTTP_HDR_HOST;
+		break;
+	default:
+		BUG_ON(idx->field != TFW_HTTP_MATCH_F_HDR);
+	}
+
+	hdr = &req->h_tbl->tbl[id];
+	if (TFW_STR_EMPTY(hdr))
+		return false;
+	tfw_http_msg_clnthdr_val(req, hdr, id, val);
+
+	return true;
+}
+
+static TfwHttpMatchRule *
+__idx_match_linear(const TfwHttpReq *req, const TfwHttpMatchIdx *idx)
+{
+	TfwHttpMatchRule *rule = idx->first;
+
+	while (true) {
+		if (do_eval(req, rule))
+			return rule;
+		if (rule == idx->last)
+			return NULL;
+		rule = list_next_entry(rule, list);
+	}
+}
+
+/**
+ * Match @req against the rules run indexed by @idx.
+ * Return the first matching rule of the run.
+ */
+static TfwHttpMatchRule *
+tfw_http_match_idx(const TfwHttpReq *req, const TfwHttpMatchIdx *idx)
+{
+	const TfwHttpMatchIdxEnt *best = NULL;
+	const TfwStr *c, *end;
+	TfwStr val;
+	unsigned long h = 0;
+	unsigned int i = 0, l = 0;
+	int k;
+
+	if (idx->meth)
+		return idx->meth[req->method];
+
+	if (!__idx_field(req, idx, &val))
+		return NULL;
+	if (unlikely(TFW_STR_DUP(&val)))
+		return __idx_match_linear(req, idx);
+
+	/* Eq and prefix arguments: hash the field forward. */
+	if (idx->pfx_n && !idx->pfx_len[0]) {
+		/* Empty prefix matches any field. */
+		__idx_lookup(req, idx, TFW_HTTP_MATCH_O_PREFIX, 0, 0, &best);
+		i = 1;
+	}
+	TFW_STR_FOR_EACH_CHUNK(c, &val, end) {
+		const char *p = c->data, *pend = p + c->len;
+
+		for ( ; p < pend && (idx->eq || i < idx->pfx_n); ++p) {
+			h = __IDX_HASH(*p, h);
+			++l;
+			if (i < idx->pfx_n && idx->pfx_len[i] == l) {
+				__idx_lookup(req, idx, TFW_HTTP_MATCH_O_PREFIX,
+					     h, l, &best);
+				++i;
+			}
+		}
+	}
+	if (idx->eq && l == val.len)
+		__idx_lookup(req, idx, TFW_HTTP_MATCH_O_EQ, h, l, &best);
+
+	/* Suffix arguments: hash the field backward. */
+	h = i = l = 0;
+	c = TFW_STR_CHUNK(&val, 0);
+	for (k = TFW_STR_PLAIN(&val) ? 0 : val.nchunks - 1;
+	     k >= 0 && i < idx->sfx_n; --k)
+	{
+		size_t j = c[k].len;
+		const char *p = c[k].data;
+
+		while (j-- && i < idx->sfx_n) {
+			h = __IDX_HASH(p[j], h);
+			if (++l == idx->sfx_len[i]) {
+				__idx_lookup(req, idx, TFW_HTTP_MATCH_O_SUFFIX,
+					     h, l, &best);
+				++i;
+			}
+		}
+	}
+
+	/* Regex arguments: the DFA returns the first matching one. */
+	if (idx->re_n && (!best || best->pos > idx->re_pos[0])) {
+		unsigned int m = tfw_regex_match(&idx->re, &val);
+
+		if (m != TFW_REGEX_NOMATCH
+		    && (!best || best->pos > idx->re_pos[m]))
+			return idx->re_rule[m];
+	}
+
+	return best ? best->rule : NULL;
+}
+
+/*
+ * Whether the rule can be matched using an index: it compares a string
+ * field or the method without inversion and doesn't set a mark, so it
+ * stops the matching if matches.
+ */
+static bool
+__idx_rule_eligible(const TfwHttpMatchRule *rule)
+{
+	if (rule->inv || rule->act.type == TFW_HTTP_MATCH_ACT_MARK)
+		return false;
+
+	switch (rule->field) {
+	case TFW_HTTP_MATCH_F_METHOD:
+		return rule->op == TFW_HTTP_MATCH_O_EQ;
+	case TFW_HTTP_MATCH_F_HDR:
+		if (rule->hid == TFW_HTTP_HDR_RAW)
+			return false;
+		/* Fall through. */
+	case TFW_HTTP_MATCH_F_HOST:
+	case TFW_HTTP_MATCH_F_URI:
+		return rule->arg.type == TFW_HTTP_MATCH_A_STR
+		       && (rule->op == TFW_HTTP_MATCH_O_EQ
+			   || rule->op == TFW_HTTP_MATCH_O_PREFIX
+			   || rule->op == TFW_HTTP_MATCH_O_REGEX
+			   || (rule->op == TFW_HTTP_MATCH_O_SUFFIX
+			       && rule->arg.len));
+	default:
+		return false;
+	}
+}
+
+static bool
+__idx_same_run(const TfwHttpMatchRule *first, const TfwHttpMatchRule *rule)
+{
+	return __idx_rule_eligible(rule)
+	       && rule->field == first->field
+	       && (rule->field != TFW_HTTP_MATCH_F_HDR
+		   || rule->hid == first->hid);
+}
+
+static int
+__idx_len_cmp(const void *a, const void *b)
+{
+	unsigned int l1 = *(unsigned int *)a, l2 = *(unsigned int *)b;
+
+	return l1 < l2 ? -1 : l1 > l2;
+}
+
+/* Sort the lengths array and remove duplicates, return the new size. */
+static unsigned int
+__idx_len_uniq(unsigned int *len, unsigned int n)
+{
+	unsigned int i, j;
+
+	if (!n)
+		return 0;
+	sort(len, n, sizeof(*len), __idx_len_cmp, NULL);
+	for (i = 0, j = 1; j < n; ++j)
+		if (len[j] != len[i])
+			len[++i] = len[j];
+
+	return i + 1;
+}
+
+/* Compile the regex arguments of the run into a single DFA. */
+static int
+__idx_regex_compile(TfwHttpMatchIdx *idx)
+{
+	int r;
+	unsigned int i;
+	TfwStr *pats;
+
+	if (!(pats = kmalloc_array(idx->re_n, sizeof(TfwStr), GFP_KERNEL)))
+		return -ENOMEM;
+	for (i = 0; i < idx->re_n; ++i) {
+		TFW_STR_INIT(&pats[i]);
+		pats[i].data = idx->re_rule[i]->arg.str;
+		pats[i].len = idx->re_rule[i]->arg.len;
+	}
+	r = tfw_regex_compile(&idx->re, pats, idx->re_n);
+	kfree(pats);
+
+	return r;
+}
+
+/**
+ * Build an index for @n rules starting from @first.
+ */
+static int
+tfw_http_idx_build(TfwHttpChain *chain, TfwHttpMatchRule *first,
+		   unsigned int n)
+{
+	int r = -ENOMEM;
+	TfwHttpMatchIdx *idx;
+	TfwHttpMatchIdxEnt *e;
+	TfwHttpMatchRule *rule = first;
+	unsigned int i, j;
+
+	if (!(idx = tfw_pool_alloc(chain->pool, sizeof(*idx))))
+		return -ENOMEM;
+	memset(idx, 0, sizeof(*idx));
+	idx->first = first;
+	idx->field = first->field;
+	idx->hid = first->hid;
+
+	if (first->field == TFW_HTTP_MATCH_F_METHOD) {
+		size_t sz = sizeof(*idx->meth) * _TFW_HTTP_METH_COUNT;
+
+		if (!(idx->meth = tfw_pool_alloc(chain->pool, sz)))
+			return -ENOMEM;
+		memset(idx->meth, 0, sz);
+		for (i = 0; i < n; ++i, rule = list_next_entry(rule, list)) {
+			if (!idx->meth[rule->arg.method])
+				idx->meth[rule->arg.method] = rule;
+			idx->last = rule;
+		}
+		goto done;
+	}
+
+	idx->bits = ilog2(roundup_pow_of_two(n));
+	idx->buckets = kvzalloc(sizeof(*idx->buckets) << idx->bits,
+				GFP_KERNEL);
+	idx->pfx_len = tfw_pool_alloc(chain->pool, n * sizeof(unsigned int));
+	idx->sfx_len = tfw_pool_alloc(chain->pool, n * sizeof(unsigned int));
+	idx->re_rule = tfw_pool_alloc(chain->pool, n * sizeof(*idx->re_rule));
+	idx->re_pos = tfw_pool_alloc(chain->pool, n * sizeof(unsigned int));
+	if (!idx->buckets || !idx->pfx_len || !idx->sfx_len || !idx->re_rule
+	    || !idx->re_pos)
+		goto err;
+
+	for (i = 0; i < n; ++i, rule = list_next_entry(rule, list)) {
+		const char *s = rule->arg.str;
+
+		idx->last = rule;
+		if (rule->op == TFW_HTTP_MATCH_O_REGEX) {
+			idx->re_rule[idx->re_n] = rule;
+			idx->re_pos[idx->re_n++] = i;
+			continue;
+		}
+		if (!(e = tfw_pool_alloc(chain->pool, sizeof(*e))))
+			goto err;
+		e->rule = rule;
+		e->hash = 0;
+		e->len = rule->arg.len;
+		e->pos = i;
+		e->op = rule->op;
+		if (rule->op == TFW_HTTP_MATCH_O_SUFFIX) {
+			for (j = e->len; j; --j)
+				e->hash = __IDX_HASH(s[j - 1], e->hash);
+			idx->sfx_len[idx->sfx_n++] = e->len;
+		} else {
+			for (j = 0; j < e->len; ++j)
+				e->hash = __IDX_HASH(s[j], e->hash);
+			if (rule->op == TFW_HTTP_MATCH_O_PREFIX)
+				idx->pfx_len[idx->pfx_n++] = e->len;
+			else
+				idx->eq = true;
+		}
+		hlist_add_head(&e->hlist, __idx_bucket(idx, e->hash, e->len));
+	}
+	idx->pfx_n = __idx_len_uniq(idx->pfx_len, idx->pfx_n);
+	idx->sfx_n = __idx_len_uniq(idx->sfx_len, idx->sfx_n);
+
+	if (idx->re_n && (r = __idx_regex_compile(idx))) {
+		if (r != -E2BIG)
+			goto err;
+		/* The rules are still correct for the linear matching. */
+		T_WARN_NL("http_match: chain '%s': too complex regular "
+			  "expressions to index %u rules\n",
+			  chain->name ? : "main", n);
+		kvfree(idx->buckets);
+		return 0;
+	}
+done:
+	first->idx = idx;
+	T_DBG("http_match: chain '%s': indexed %u rules\n",
+	      chain->name ? : "main", n);
+
+	return 0;
+err:
+	kvfree(idx->buckets);
+	return r;
+}
+
+/**
+ * Build indexes for long runs of rules in @chain, which can be matched
+ * without evaluation of each rule. Must be called for a fully configured
+ * chain, so the rules aren't changed after the call.
+ */
+int
+tfw_http_chain_compile(TfwHttpChain *chain)
+{
+	int r;
+	unsigned int n = 0;
+	TfwHttpMatchRule *rule, *first = NULL;
+
+	list_for_each_entry(rule, &chain->match_list, list) {
+		if (first && __idx_same_run(first, rule)) {
+			++n;
+			continue;
+		}
+		if (n >= TFW_HTTP_MATCH_IDX_MIN
+		    && (r = tfw_http_idx_build(chain, first, n)))
+			return r;
+		first = __idx_rule_eligible(rule) ? rule : NULL;
+		n = !!first;
+	}
+	if (n >= TFW_HTTP_MATCH_IDX_MIN)
+		return tfw_http_idx_build(chain, first, n);
+
+	return 0;
+}
+EXPORT_SYMBOL(tfw_http_chain_compile);
+
 static tfw_http_match_arg_t
 tfw_http_tbl_arg_type(tfw_http_match_fld_t field)
 {
@@ -490,6 +973,15 @@ tfw_http_match_req(const TfwHttpReq *req, struct list_head *mlst)
 	T_DBG2("Matching request: %p, list: %p\n", req, mlst);
 
 	list_for_each_entry(rule, mlst, list) {
+		if (rule->idx) {
+			TfwHttpMatchIdx *idx = rule->idx;
+
+			if ((rule = tfw_http_match_idx(req, idx)))
+				return rule;
+			/* Continue with the rule following the run. */
+			rule = idx->last;
+			continue;
+		}
 		if (do_eval(req, rule))
 			return rule;
 	}
@@ -536,8 +1028,25 @@ EXPORT_SYMBOL(tfw_http_chain_add);
 void
 tfw_http_table_free(TfwHttpTable *table)
 {
-	if (table)
-		tfw_pool_destroy(table->pool);
+	TfwHttpChain *chain;
+	TfwHttpMatchRule *rule;
+
+	if (!table)
+		return;
+
+	list_for_each_entry(chain, &table->head, list) {
+		list_for_each_entry(rule, &chain->match_list, list) {
+			if (rule->idx) {
+				kvfree(rule->idx->buckets);
+				tfw_regex_free(&rule->idx->re);
+			}
+			if (rule->re) {
+				tfw_regex_free(rule->re);
+				kfree(rule->re);
+			}
+		}
+	}
+	tfw_pool_destroy(table->pool);
 }
 EXPORT_SYMBOL(tfw_http_table_free);
 
@@ -573,6 +1082,29 @@ tfw_http_rule_new(TfwHttpChain *chain, tfw_http_match_arg_t type,
 }
 EXPORT_SYMBOL(tfw_http_rule_new);
 
+static int
+tfw_http_rule_regex_init(TfwHttpMatchRule *rule)
+{
+	int r;
+	TfwStr pat = { .data = rule->arg.str, .len = rule->arg.len };
+
+	if (!(rule->re = kmalloc(sizeof(TfwRegex), GFP_KERNEL)))
+		return -ENOMEM;
+	if (!(r = tfw_regex_compile(rule->re, &pat, 1)))
+		return 0;
+
+	if (r == -EINVAL)
+		T_ERR_NL("http_match: invalid regular expression: '%s'\n",
+			 rule->arg.str);
+	else if (r == -E2BIG)
+		T_ERR_NL("http_match: too complex regular expression: '%s'\n",
+			 rule->arg.str);
+	kfree(rule->re);
+	rule->re = NULL;
+
+	return r;
+}
+
 int
 tfw_http_rule_arg_init(TfwHttpMatchRule *rule, const char *arg, size_t arg_len)
 {
@@ -608,7 +1140,22 @@ tfw_http_rule_arg_init(TfwHttpMatchRule *rule, const char *arg, size_t arg_len)
 		char *p = rule->arg.str;
 		while ((*p = tolower(*p)))
 			p++;
+		/* The header name is before the colon, see S_DLM. */
+		p = memchr(rule->arg.str, ':', arg_len);
+		if (p && p != rule->arg.str
+		    && rule->op != TFW_HTTP_MATCH_O_REGEX)
+		{
+			TfwStr name = {
+				.data = rule->arg.str,
+				.len = p - rule->arg.str
+			};
+
+			rule->hname_len = name.len;
+			rule->hname_hash = tfw_http_hdr_name_hash(&name);
+		}
 	}
+	if (rule->op == TFW_HTTP_MATCH_O_REGEX)
+		return tfw_http_rule_regex_init(rule);
 
 	return 0;
 }
@@ -628,6 +1175,27 @@ tfw_http_arg_adjust(const char *arg, tfw_http_match_fld_t field,
 
 	*type_out = tfw_http_tbl_arg_type(field);
 
+	/*
+	 * An argument started with '~' is a regular expression, which is
+	 * taken as is, without the wildcards and escaping processing.
+	 */
+	if (arg[0] == '~') {
+		if (*type_out != TFW_HTTP_MATCH_A_STR || raw_hdr_name) {
+			T_ERR_NL("http_match: regular expression can't be "
+				 "matched against the field: '%s'\n", arg);
+			return ERR_PTR(-EINVAL);
+		}
+		if (!(arg_out = kstrdup(arg + 1, GFP_KERNEL))) {
+			T_ERR_NL("http_match: unable to allocate rule "
+				 "argument.\n");
+			return ERR_PTR(-ENOMEM);
+		}
+		*op_out = TFW_HTTP_MATCH_O_REGEX;
+		*size_out = len;
+
+		return arg_out;
+	}
+
 	/*
 	 * If this is simple wildcard argument and this is not raw
 	 * header case, this is wildcard type case and we do not
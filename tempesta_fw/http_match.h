@@ -26,6 +26,7 @@
 #include "addr.h"
 #include "http.h"
 #include "http_tbl.h"
+#include "regex.h"
 
 typedef enum {
 	TFW_HTTP_MATCH_F_NA = 0,
@@ -44,6 +45,7 @@ typedef enum {
 	TFW_HTTP_MATCH_O_EQ,
 	TFW_HTTP_MATCH_O_PREFIX,
 	TFW_HTTP_MATCH_O_SUFFIX,
+	TFW_HTTP_MATCH_O_REGEX,
 	_TFW_HTTP_MATCH_O_COUNT
 } tfw_http_match_op_t;
 
@@ -65,6 +67,7 @@ typedef enum {
 	TFW_HTTP_MATCH_ACT_VHOST,
 	TFW_HTTP_MATCH_ACT_MARK,
 	TFW_HTTP_MATCH_ACT_BLOCK,
+	TFW_HTTP_MATCH_ACT_HOST,
 	_TFW_HTTP_MATCH_ACT_COUNT
 } tfw_http_rule_act_t;
 
@@ -88,6 +91,8 @@ typedef struct {
 	};
 } TfwHttpAction;
 
+typedef struct tfw_http_match_idx_t TfwHttpMatchIdx;
+
 typedef struct {
 	struct list_head	list;
 	tfw_http_match_fld_t	field; /* Field of a HTTP message to compare. */
@@ -95,6 +100,12 @@ typedef struct {
 	TfwHttpAction		act;   /* Rule action. */
 	unsigned int		hid;   /* Header ID. */
 	unsigned int		inv;   /* Comparison inversion (inequality) flag.*/
+	TfwHttpMatchIdx		*idx;  /* Index of the rules run starting from
+					  the rule. */
+	TfwRegex		*re;   /* Compiled regex argument. */
+	unsigned int		hname_len;  /* Raw header name length, zero if
+					       the name isn't fixed. */
+	unsigned int		hname_hash; /* Raw header name hash. */
 	TfwHttpMatchArg 	arg;   /* A value to be compared with the field.
 					  note: the @arg has variable length. */
 } TfwHttpMatchRule;
@@ -108,6 +119,7 @@ typedef struct {
 	(offsetof(TfwHttpMatchRule, arg.str) + arg_len)
 
 TfwHttpChain *tfw_http_chain_add(const char *name, TfwHttpTable *table);
+int tfw_http_chain_compile(TfwHttpChain *chain);
 void tfw_http_table_free(TfwHttpTable *table);
 
 /**
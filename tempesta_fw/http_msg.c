@@ -28,8 +28,10 @@
 
 #include "lib/str.h"
 #include "gfsm.h"
+#include "htype.h"
 #include "http_msg.h"
 #include "http_parser.h"
+#include "procfs.h"
 #include "ss_skb.h"
 
 /**
@@ -320,24 +322,124 @@ __hdr_is_singular(const TfwStr *hdr)
  * The lookup is performed until ':', so header name only is enough in @hdr.
  * @return the header id.
  */
+/**
+ * Case insensitive FNV-1a hash of the name of header @hdr, which can be
+ * in HTTP/2 or HTTP/1.1 format, i.e. the name ends at the value chunk or
+ * at the colon. @hdr can also be just a name.
+ */
 unsigned int
-tfw_http_msg_hdr_lookup(TfwHttpMsg *hm, const TfwStr *hdr)
+tfw_http_hdr_name_hash(const TfwStr *hdr)
 {
-	unsigned int id;
-	TfwHttpHdrTbl *ht = hm->h_tbl;
+	const TfwStr *c, *end;
+	const unsigned char *p, *pend;
+	unsigned int h = 2166136261U;
+
+	/* All the duplicates have the same name. */
+	if (TFW_STR_DUP(hdr))
+		hdr = TFW_STR_CHUNK(hdr, 0);
+	if (TFW_STR_EMPTY(hdr))
+		return h;
 
-	for (id = TFW_HTTP_HDR_RAW; id < ht->off; ++id) {
-		TfwStr *h = &ht->tbl[id];
-		/* There is no sense to compare against all duplicates. */
-		if (h->flags & TFW_STR_DUPLICATE)
-			h = TFW_STR_CHUNK(h, 0);
-		if (!tfw_stricmpspn(hdr, h, ':'))
+	TFW_STR_FOR_EACH_CHUNK(c, hdr, end) {
+		if (c->flags & TFW_STR_HDR_VALUE)
 			break;
+		pend = (unsigned char *)c->data + c->len;
+		for (p = (unsigned char *)c->data; p < pend; ++p) {
+			if (*p == ':')
+				return h;
+			h = (h ^ TFW_LC(*p)) * 16777619U;
+		}
 	}
 
+	return h;
+}
+
+static void
+__hdr_idx_reset(TfwHttpHdrTbl *ht)
+{
+	ht->idx_off = TFW_HTTP_HDR_RAW;
+	bzero_fast(ht->idx, sizeof(ht->idx));
+}
+
+/**
+ * Index the next raw header @id of @ht having the name hash @hash if there
+ * is room in the index.
+ */
+static void
+__hdr_idx_add(TfwHttpHdrTbl *ht, unsigned int id, unsigned int hash)
+{
+	unsigned int i;
+
+	if (id != ht->idx_off
+	    || ht->idx_off - TFW_HTTP_HDR_RAW >= TFW_HHTBL_IDX_MAX)
+		return;
+
+	for (i = hash; ht->idx[i % TFW_HHTBL_IDX_SZ].id; ++i)
+		;
+	ht->idx[i % TFW_HHTBL_IDX_SZ].id = id;
+	ht->idx[i % TFW_HHTBL_IDX_SZ].tag = TFW_HHTBL_IDX_TAG(hash);
+	ht->idx_off++;
+}
+
+/*
+ * Index the raw headers, which were added to @ht bypassing
+ * tfw_http_msg_hdr_close() or follow a removed header.
+ */
+static void
+__hdr_idx_fill(TfwHttpHdrTbl *ht)
+{
+	while (ht->idx_off < ht->off
+	       && ht->idx_off - TFW_HTTP_HDR_RAW < TFW_HHTBL_IDX_MAX)
+		__hdr_idx_add(ht, ht->idx_off,
+			      tfw_http_hdr_name_hash(&ht->tbl[ht->idx_off]));
+}
+
+static inline const TfwStr *
+__hdr_idx_name(const TfwStr *h)
+{
+	/* There is no sense to compare against all duplicates. */
+	return h->flags & TFW_STR_DUPLICATE ? TFW_STR_CHUNK(h, 0) : h;
+}
+
+/**
+ * Find the raw header with the name of @hdr having hash @hash in @ht: only
+ * the indexed headers with the same hash tag and the headers, which aren't
+ * indexed, are compared with @hdr by @cmp.
+ *
+ * @return the header index or @ht->off if there is no such header.
+ */
+static inline unsigned int
+__hdr_idx_lookup(TfwHttpHdrTbl *ht, const TfwStr *hdr, unsigned int hash,
+		 int (*cmp)(const TfwStr *, const TfwStr *))
+{
+	unsigned int i, id, tag = TFW_HHTBL_IDX_TAG(hash);
+	const TfwHttpHdrIdx *e;
+
+	__hdr_idx_fill(ht);
+
+	for (i = hash; (e = &ht->idx[i % TFW_HHTBL_IDX_SZ])->id; ++i)
+		if (e->tag == tag && !cmp(__hdr_idx_name(&ht->tbl[e->id]), hdr))
+			return e->id;
+	for (id = ht->idx_off; id < ht->off; ++id)
+		if (!cmp(__hdr_idx_name(&ht->tbl[id]), hdr))
+			break;
+
 	return id;
 }
 
+static int
+__hdr_spn_cmp(const TfwStr *h, const TfwStr *hdr)
+{
+	return tfw_stricmpspn(hdr, h, ':');
+}
+
+unsigned int
+tfw_http_msg_hdr_lookup(TfwHttpMsg *hm, const TfwStr *hdr)
+{
+	return __hdr_idx_lookup(hm->h_tbl, hdr, tfw_http_hdr_name_hash(hdr),
+				__hdr_spn_cmp);
+}
+
 /**
  * Certain header fields are strictly singular and may not be repeated in
  * an HTTP message. Duplicate of a singular header fields is a bug worth
@@ -455,22 +557,8 @@ __hdr_name_cmp(const TfwStr *hdr, const TfwStr *cmp_hdr)
 int
 __http_hdr_lookup(TfwHttpMsg *hm, const TfwStr *hdr)
 {
-	unsigned int id;
-	TfwHttpHdrTbl *ht = hm->h_tbl;
-
-	for (id = TFW_HTTP_HDR_RAW; id < ht->off; ++id) {
-		TfwStr *h = &ht->tbl[id];
-		/*
-		 * We are looking only for the header's name matching,
-		 * thus, there is no sense to compare against all duplicates.
-		 */
-		if (h->flags & TFW_STR_DUPLICATE)
-			h = TFW_STR_CHUNK(h, 0);
-		if (!__hdr_name_cmp(h, hdr))
-			break;
-	}
-
-	return id;
+	return __hdr_idx_lookup(hm->h_tbl, hdr, tfw_http_hdr_name_hash(hdr),
+				__hdr_name_cmp);
 }
 
 /**
@@ -502,7 +590,7 @@ tfw_http_msg_hdr_close(TfwHttpMsg *hm)
 	TfwStr *hdr, *h;
 	TfwHttpHdrTbl *ht = hm->h_tbl;
 	TfwHttpParser *parser = &hm->stream->parser;
-	unsigned int id = parser->_hdr_tag;
+	unsigned int id = parser->_hdr_tag, hash = 0;
 
 	BUG_ON(parser->hdr.flags & TFW_STR_DUPLICATE);
 	BUG_ON(id > TFW_HTTP_HDR_RAW);
@@ -542,9 +630,11 @@ tfw_http_msg_hdr_close(TfwHttpMsg *hm)
 	 * A new raw header is to be stored, but it can be a duplicate of some
 	 * existing header and we must find appropriate index for it.
 	 * Both the headers, the new one and existing one, can already be
-	 * compound.
+	 * compound. The name chunks were just parsed, so index the header name
+	 * while the data is hot in the cache.
 	 */
-	id = __http_hdr_lookup(hm, &parser->hdr);
+	hash = tfw_http_hdr_name_hash(&parser->hdr);
+	id = __hdr_idx_lookup(ht, &parser->hdr, hash, __hdr_name_cmp);
 
 	/* Allocate some more room if not enough to store the header. */
 	if (unlikely(id == ht->size)) {
@@ -579,6 +669,9 @@ done:
 	    && tfw_h2_hdr_map((TfwHttpResp *)hm, hdr, id))
 		return TFW_BLOCK;
 
+	TFW_INC_STAT_BH(pool.hdr_n);
+	TFW_ADD_STAT_BH(max_t(unsigned int, parser->hdr.nchunks, 1),
+			pool.hdr_chunks);
 	*h = parser->hdr;
 
 	TFW_STR_INIT(&parser->hdr);
@@ -586,8 +679,10 @@ done:
 	       h->data, h->len, h->eolen, h->flags, id);
 
 	/* Move the offset forward if current header is fully read. */
-	if (id == ht->off)
+	if (id == ht->off) {
+		__hdr_idx_add(ht, id, hash);
 		ht->off++;
+	}
 
 	return TFW_PASS;
 }
@@ -657,15 +752,134 @@ tfw_http_msg_grow_hdr_tbl(TfwHttpMsg *hm)
 }
 
 /**
- * Add new header @hdr to the message @hm just before CRLF.
+ * Write the pending headers of @hm to the skbs just before CRLF at once and
+ * move their header table items to the skb data.
  */
 static int
-__hdr_add(TfwHttpMsg *hm, const TfwStr *hdr, unsigned int hid)
+__hdrs_flush(TfwHttpMsg *hm)
 {
 	int r;
+	unsigned int i;
 	TfwStr it = {};
+	TfwHttpHdrPend *pend = hm->h_pend;
 	TfwStr *h = TFW_STR_CHUNK(&hm->crlf, 0);
 
+	if (likely(!pend || !pend->n))
+		return 0;
+
+	r = ss_skb_get_room(hm->msg.skb_head, hm->crlf.skb, h->data,
+			    pend->len, &it);
+	if (r)
+		return r;
+	if (WARN_ON_ONCE(!TFW_STR_PLAIN(&it)))
+		return TFW_BLOCK;
+	memcpy_fast(it.data, pend->data, pend->len);
+
+	for (i = 0; i < pend->n; i++) {
+		h = &hm->h_tbl->tbl[pend->hid[i]];
+		h->data = it.data + (h->data - pend->data);
+		h->skb = it.skb;
+	}
+	pend->n = pend->len = 0;
+
+	return 0;
+}
+
+/**
+ * Write the pending headers if the header with identifier @hid is one of
+ * them and is going to be modified. Modifications of other headers don't
+ * touch the pending data, so they don't need the headers in the skbs.
+ */
+static int
+__hdr_flush_pend(TfwHttpMsg *hm, unsigned int hid)
+{
+	unsigned int i;
+	TfwHttpHdrPend *pend = hm->h_pend;
+
+	if (likely(!pend))
+		return 0;
+	for (i = 0; i < pend->n; i++)
+		if (pend->hid[i] == hid)
+			return __hdrs_flush(hm);
+
+	return 0;
+}
+
+/**
+ * Start deferred mode of adding headers to @hm: the added headers are
+ * collected in @hm->h_pend and written to the skbs by one fragmentation
+ * when a pending header is modified or in tfw_http_msg_hdrs_apply().
+ * Multiple headers added to the end of the message header don't split
+ * the same skb fragment several times this way.
+ */
+void
+tfw_http_msg_hdrs_defer(TfwHttpMsg *hm)
+{
+	if (!hm->h_pend)
+		hm->h_pend = tfw_pool_alloc(hm->pool, sizeof(TfwHttpHdrPend));
+	if (hm->h_pend)
+		hm->h_pend->n = hm->h_pend->len = 0;
+}
+
+/**
+ * Write the pending headers and leave the deferred mode, the message data
+ * and the header table are consistent after the call.
+ */
+int
+tfw_http_msg_hdrs_apply(TfwHttpMsg *hm)
+{
+	int r = __hdrs_flush(hm);
+
+	hm->h_pend = NULL;
+
+	return r;
+}
+
+/**
+ * Add @hdr to the pending headers of @hm. The header table item points to
+ * the pending data, so the header can be found and read as usual.
+ */
+static int
+__hdr_add_pend(TfwHttpMsg *hm, const TfwStr *hdr, unsigned int hid)
+{
+	int r;
+	TfwHttpHdrPend *pend = hm->h_pend;
+	unsigned long len = tfw_str_total_len(hdr);
+	TfwStr it = {};
+
+	if (pend->n == TFW_HTTP_HDR_PEND_N
+	    || pend->len + len > TFW_HTTP_HDR_PEND_SZ)
+		if ((r = __hdrs_flush(hm)))
+			return r;
+
+	it.data = pend->data + pend->len;
+	it.len = len;
+	tfw_str_fixup_eol(&it, tfw_str_eolen(hdr));
+	if (tfw_strcpy(&it, hdr))
+		return TFW_BLOCK;
+
+	hm->h_tbl->tbl[hid] = it;
+	pend->hid[pend->n++] = hid;
+	pend->len += len;
+
+	return 0;
+}
+
+/**
+ * Add new header @hdr to the message @hm just before CRLF.
+ */
+static int
+__hdr_add(TfwHttpMsg *hm, const TfwStr *hdr, unsigned int hid)
+{
+	int r;
+	TfwStr it = {}, *h;
+
+	if (hm->h_pend && tfw_str_total_len(hdr) <= TFW_HTTP_HDR_PEND_SZ)
+		return __hdr_add_pend(hm, hdr, hid);
+	if ((r = __hdrs_flush(hm)))
+		return r;
+
+	h = TFW_STR_CHUNK(&hm->crlf, 0);
 	r = ss_skb_get_room(hm->msg.skb_head, hm->crlf.skb, h->data,
 			    tfw_str_total_len(hdr), &it);
 	if (r)
@@ -698,6 +912,9 @@ __hdr_expand(TfwHttpMsg *hm, TfwStr *orig_hdr, const TfwStr *hdr, bool append)
 	int r;
 	TfwStr *h, it = {};
 
+	if ((r = __hdr_flush_pend(hm, orig_hdr - hm->h_tbl->tbl)))
+		return r;
+
 	if (TFW_STR_DUP(orig_hdr))
 		orig_hdr = __TFW_STR_CH(orig_hdr, 0);
 	BUG_ON(!append && (hdr->len < orig_hdr->len));
@@ -725,6 +942,11 @@ __hdr_del(TfwHttpMsg *hm, unsigned int hid)
 {
 	TfwHttpHdrTbl *ht = hm->h_tbl;
 	TfwStr *dup, *end, *hdr = &ht->tbl[hid];
+	TfwHttpHdrPend *pend = hm->h_pend;
+	unsigned int i;
+
+	if (__hdr_flush_pend(hm, hid))
+		return TFW_BLOCK;
 
 	/* Delete the underlying data. */
 	TFW_STR_FOR_EACH_DUP(dup, hdr, end) {
@@ -741,6 +963,12 @@ __hdr_del(TfwHttpMsg *hm, unsigned int hid)
 			memmove(&ht->tbl[hid], &ht->tbl[hid + 1],
 				(ht->off - hid - 1) * sizeof(TfwStr));
 		--ht->off;
+		/* The header indexes are shifted, so rebuild the index. */
+		__hdr_idx_reset(ht);
+		/* The pending headers are moved in the table as well. */
+		for (i = 0; pend && i < pend->n; i++)
+			if (pend->hid[i] > hid)
+				--pend->hid[i];
 	}
 
 	return 0;
@@ -762,6 +990,9 @@ __hdr_sub(TfwHttpMsg *hm, const TfwStr *hdr, unsigned int hid)
 	TfwHttpHdrTbl *ht = hm->h_tbl;
 	TfwStr *dst, *tmp, *end, *orig_hdr = &ht->tbl[hid];
 
+	if (__hdr_flush_pend(hm, hid))
+		return TFW_BLOCK;
+
 	TFW_STR_FOR_EACH_DUP(dst, orig_hdr, end) {
 		if (dst->len < hdr->len)
 			continue;
@@ -1225,8 +1456,15 @@ tfw_http_msg_free(TfwHttpMsg *m)
 	tfw_http_msg_unpair(m);
 	ss_skb_queue_purge(&m->msg.skb_head);
 
-	if (m->destructor)
+	/* Only requests have the destructor. */
+	if (m->destructor) {
+		TFW_INC_STAT_BH(pool.req_n);
+		TFW_ADD_STAT_BH(m->pool->peak, pool.req_bytes);
 		m->destructor(m);
+	} else {
+		TFW_INC_STAT_BH(pool.resp_n);
+		TFW_ADD_STAT_BH(m->pool->peak, pool.resp_bytes);
+	}
 
 	if (TFW_MSG_H2(m))
 		tfw_pool_destroy(((TfwHttpReq *)m)->pit.pool);
@@ -1241,8 +1479,12 @@ EXPORT_SYMBOL(tfw_http_msg_free);
  * is true, the message is set up and initialized with full support
  * for parsing and subsequent adjustment.
  */
+/**
+ * Allocate a message of @type with a header table of @order, i.e. for
+ * @order * TFW_HTTP_HDR_NUM headers, or without the table if @order is 0.
+ */
 TfwHttpMsg *
-__tfw_http_msg_alloc(int type, bool full)
+__tfw_http_msg_alloc_tbl(int type, unsigned int order)
 {
 	TfwHttpMsg *hm = (type & Conn_Clnt)
 			 ? (TfwHttpMsg *)tfw_pool_new(TfwHttpReq,
@@ -1254,10 +1496,11 @@ __tfw_http_msg_alloc(int type, bool full)
 		       ((type & Conn_Clnt) ? "request" : "response"));
 		return NULL;
 	}
+	tfw_pool_acct(hm->pool, TFW_MEM_MSG);
 
-	if (full) {
+	if (order) {
 		hm->h_tbl = (TfwHttpHdrTbl *)tfw_pool_alloc(hm->pool,
-							    TFW_HHTBL_SZ(1));
+							    TFW_HHTBL_SZ(order));
 		if (unlikely(!hm->h_tbl)) {
 			T_WARN("Insufficient memory to create header table"
 			       " for %s\n",
@@ -1265,9 +1508,10 @@ __tfw_http_msg_alloc(int type, bool full)
 			tfw_pool_destroy(hm->pool);
 			return NULL;
 		}
-		hm->h_tbl->size = __HHTBL_SZ(1);
+		hm->h_tbl->size = __HHTBL_SZ(order);
 		hm->h_tbl->off = TFW_HTTP_HDR_RAW;
-		bzero_fast(hm->h_tbl->tbl, __HHTBL_SZ(1) * sizeof(TfwStr));
+		__hdr_idx_reset(hm->h_tbl);
+		bzero_fast(hm->h_tbl->tbl, __HHTBL_SZ(order) * sizeof(TfwStr));
 	}
 
 	hm->msg.skb_head = NULL;
@@ -1276,6 +1520,7 @@ __tfw_http_msg_alloc(int type, bool full)
 		INIT_LIST_HEAD(&hm->msg.seq_list);
 		INIT_LIST_HEAD(&((TfwHttpReq *)hm)->fwd_list);
 		INIT_LIST_HEAD(&((TfwHttpReq *)hm)->nip_list);
+		INIT_LIST_HEAD(&((TfwHttpReq *)hm)->wait_list);
 		hm->destructor = tfw_http_req_destruct;
 	}
 
@@ -1338,7 +1583,7 @@ this_chunk:
 				it->frag = -1;
 			}
 			else if (cur_len != f_room || c + 1 < end) {
-				struct page *page = alloc_page(GFP_ATOMIC);
+				struct page *page = ss_skb_page_alloc();
 				if (!page)
 					return -ENOMEM;
 				++it->frag;
@@ -1360,103 +1605,128 @@ this_chunk:
 	return 0;
 }
 
+/**
+ * Add @sz bytes at @off of @page into response as the next paged fragment.
+ */
 int
-tfw_h2_msg_rewrite_data(TfwHttpTransIter *mit, const TfwStr *str,
-			const char *stop)
+tfw_http_msg_add_frag(TfwMsgIter *it, struct page *page, int off, int sz)
 {
-	const TfwStr *c, *end;
-	TfwMsgIter *it = &mit->iter;
-	TfwNextHdrOp *next = &mit->next;
-
-	BUG_ON(!stop);
-	BUG_ON(TFW_STR_DUP(str));
+	int r;
 
-	TFW_STR_FOR_EACH_CHUNK(c, str, end) {
-		const char *addr, *next_ptr;
-		long offset, stop_offset;
-		unsigned int c_off = 0, f_size, c_size, f_room, n_copy;
-this_chunk:
-		c_size = c->len - c_off;
-		if (it->frag >= 0) {
-			skb_frag_t *frag = &skb_shinfo(it->skb)->frags[it->frag];
+	if (it->frag == MAX_SKB_FRAGS && (r = tfw_msg_iter_append_skb(it)))
+		return r;
 
-			f_size = skb_frag_size(frag);
-			addr = skb_frag_address(frag);
-		} else {
-			f_size = skb_headlen(it->skb);
-			addr = it->skb->data;
-		}
+	skb_fill_page_desc(it->skb, it->frag, page, off, sz);
+	skb_frag_ref(it->skb, it->frag);
+	ss_skb_adjust_data_len(it->skb, sz);
+	++it->frag;
 
-		offset = mit->curr_ptr - addr;
-		if (WARN_ON_ONCE(offset < 0 || offset >= f_size))
-			return -EINVAL;
+	return 0;
+}
 
-		f_room = f_size - offset;
-		n_copy = min(c_size, f_room);
-		next_ptr = mit->curr_ptr + n_copy;
+/**
+ * Add HTTP/2 DATA frame header @frame_hdr into response. Frame headers are
+ * unique for each response, so they're placed at @*page as separate small
+ * fragments instead of copying the cached body next to them. A new page is
+ * allocated when there is no more room at @*page, the caller must release
+ * the last page.
+ */
+int
+tfw_http_msg_add_frame_hdr(TfwMsgIter *it, TfwFrameHdr *frame_hdr,
+			   struct page **page, unsigned int *off)
+{
+	int r;
 
-		/*
-		 * If the stop mark is met, we should verify that all the data
-		 * will be copied from @str; if not, save offsets for not copied
-		 * data from current @str (for subsequent copying after more
-		 * space allocation) and exit with corresponding error code.
-		 */
-		stop_offset = stop - addr;
-		if (stop_offset >= 0 && stop_offset < f_size
-		    && (next_ptr > stop
-			|| (next_ptr == stop
-			    && (c_size > f_room || c + 1 < end))))
-		{
-			WARN_ON_ONCE(next->chunk || next->off);
-			next->chunk = TFW_STR_PLAIN(str) ? 0 : c - str->chunks;
-			next->off = c_off;
+	if (!*page || *off + FRAME_HEADER_SIZE > PAGE_SIZE) {
+		if (*page)
+			put_page(*page);
+		if (!(*page = ss_skb_page_alloc()))
+			return -ENOMEM;
+		*off = 0;
+	}
 
-			T_WARN("Unable to transform HTTP/1.1 data into HTTP/2"
-			       " format: free space exhausted (accumulated"
-			       " length: %lu\n", mit->acc_len);
+	tfw_h2_pack_frame_header(page_address(*page) + *off, frame_hdr);
+	if ((r = tfw_http_msg_add_frag(it, *page, *off, FRAME_HEADER_SIZE)))
+		return r;
+	*off += FRAME_HEADER_SIZE;
 
-			return -E2BIG;
-		}
+	return 0;
+}
 
-		memcpy_fast(mit->curr_ptr, c->data + c_off, n_copy);
+/**
+ * Prepare skb for the body fragments following the response headers.
+ */
+int
+tfw_http_msg_body_skb(TfwMsgIter *it)
+{
+	int r;
 
-		T_DBG3("%s: acc_len=%lu, n_copy=%u, mit->curr_ptr='%.*s',"
-		       " ptr_diff=%ld\n", __func__, mit->acc_len, n_copy,
-		       n_copy, mit->curr_ptr, stop - mit->curr_ptr);
+	if (WARN_ON_ONCE(!it->skb_head))
+		return -EINVAL;
+	/*
+	 * If all skbs/frags are used up (see @tfw_http_msg_expand_data()),
+	 * create new skb with empty frags to reference the shared body;
+	 * otherwise, use next empty frag in current skb. Create a new skb, if
+	 * TX flags for headers and body differ.
+	 */
+	if (!it->skb || (++it->frag >= MAX_SKB_FRAGS)
+	    || !(skb_shinfo(it->skb)->tx_flags & SKBTX_SHARED_FRAG))
+	{
+		if  ((r = tfw_msg_iter_append_skb(it)))
+			return r;
+		skb_shinfo(it->skb)->tx_flags |= SKBTX_SHARED_FRAG;
+	}
+	if (WARN_ON_ONCE(it->frag < 0))
+		return -EINVAL;
 
-		mit->curr_ptr += n_copy;
-		mit->acc_len += n_copy;
+	return 0;
+}
 
-		/*
-		 * The fragment is exhausted. Move to the next fragment (or skb)
-		 * and reset the @mit->curr_ptr pointer.
-		 */
-		if (c_size >= f_room) {
-			if (skb_shinfo(it->skb)->nr_frags > it->frag + 1) {
-				skb_frag_t *frag;
+/**
+ * Add the shared body @sb into the message after all the other data, which
+ * is already written by @it. The body pages are referenced by the message
+ * and are never copied, so many responses may use the same body. HTTP/2
+ * DATA frame headers are added for a non-zero @stream_id, one frame per
+ * body page.
+ */
+int
+tfw_http_msg_add_shared_body(TfwMsgIter *it, const TfwHttpSharedBody *sb,
+			     unsigned int stream_id)
+{
+	int r = 0;
+	unsigned int i, fh_off = 0;
+	size_t len = sb->len;
+	struct page *fh_page = NULL;
+	TfwFrameHdr frame_hdr = {.stream_id = stream_id, .type = HTTP2_DATA};
 
-				++it->frag;
-				frag = &skb_shinfo(it->skb)->frags[it->frag];
-				mit->curr_ptr = skb_frag_address(frag);
-			}
-			else {
-				if (WARN_ON_ONCE(it->skb_head == it->skb->next &&
-						 (c_size != f_room
-						  || c + 1 < end)))
-					return -EINVAL;
-
-				tfw_h2_msg_transform_setup(mit, it->skb->next,
-							   false);
-			}
+	if (!len)
+		return 0;
+	if (!(it->skb = ss_skb_peek_tail(&it->skb_head)))
+		return -EINVAL;
+	it->frag = skb_shinfo(it->skb)->nr_frags - 1;
+	if ((r = tfw_http_msg_body_skb(it)))
+		return r;
 
-			if (c_size != f_room) {
-				c_off += n_copy;
-				goto this_chunk;
-			}
+	for (i = 0; i < sb->nr_pages; ++i) {
+		size_t n = min_t(size_t, len, PAGE_SIZE);
+
+		len -= n;
+		if (stream_id) {
+			frame_hdr.flags = len ? 0 : HTTP2_F_END_STREAM;
+			frame_hdr.length = n;
+			r = tfw_http_msg_add_frame_hdr(it, &frame_hdr, &fh_page,
+						       &fh_off);
+			if (r)
+				break;
 		}
+		if ((r = tfw_http_msg_add_frag(it, sb->pages[i], 0, n)))
+			break;
 	}
 
-	return 0;
+	if (fh_page)
+		put_page(fh_page);
+
+	return r;
 }
 
 /**
@@ -34,6 +34,7 @@
 #define S_VIA_H2_PROTO		"2.0 "
 #define S_VERSION11		"HTTP/1.1"
 #define S_0			S_VERSION11 " "
+#define S_V_DATE		"Sun, 06 Nov 1994 08:49:37 GMT"
 
 #define SLEN(s)			(sizeof(s) - 1)
 
@@ -83,7 +84,16 @@ tfw_http_msg_srvhdr_val(TfwStr *hdr, unsigned id, TfwStr *val)
 }
 
 void tfw_http_msg_pair(TfwHttpResp *resp, TfwHttpReq *req);
-TfwHttpMsg *__tfw_http_msg_alloc(int type, bool full);
+TfwHttpMsg *__tfw_http_msg_alloc_tbl(int type, unsigned int order);
+
+/*
+ * Allocate a message, a full one has a header table of the minimal order.
+ */
+static inline TfwHttpMsg *
+__tfw_http_msg_alloc(int type, bool full)
+{
+	return __tfw_http_msg_alloc_tbl(type, full ? 1 : 0);
+}
 
 static inline TfwHttpReq *
 tfw_http_msg_alloc_req_light(void)
@@ -113,27 +123,6 @@ tfw_http_msg_alloc_resp_light(TfwHttpReq *req)
 	return __tfw_http_msg_alloc_resp(req, false);
 }
 
-static inline void
-tfw_h2_msg_transform_setup(TfwHttpTransIter *mit, struct sk_buff *skb,
-			   bool init)
-{
-	TfwMsgIter *iter = &mit->iter;
-
-	BUILD_BUG_ON(HTTP2_MAX_OFFSET <= FRAME_HEADER_SIZE);
-	BUG_ON(!skb);
-
-	iter->frag = -1;
-	iter->skb = skb;
-	if (!iter->skb_head)
-		iter->skb_head = skb;
-
-	skb_push(skb, HTTP2_MAX_OFFSET);
-	mit->curr_ptr = skb->data;
-
-	if (init)
-		mit->curr_ptr += FRAME_HEADER_SIZE;
-}
-
 static inline int
 tfw_h2_msg_hdr_add(TfwHttpResp *resp, char *name, size_t nlen, char *val,
 		   size_t vlen, unsigned short idx)
@@ -148,7 +137,7 @@ tfw_h2_msg_hdr_add(TfwHttpResp *resp, char *name, size_t nlen, char *val,
 		.hpack_idx = idx
 	};
 
-	return tfw_hpack_encode(resp, &hdr, TFW_H2_TRANS_ADD, true);
+	return tfw_hpack_encode(resp, &hdr, TFW_H2_TRANS_EXPAND, true);
 }
 
 int __tfw_http_msg_add_str_data(TfwHttpMsg *hm, TfwStr *str, void *data,
@@ -157,6 +146,7 @@ int __tfw_http_msg_add_str_data(TfwHttpMsg *hm, TfwStr *str, void *data,
 	__tfw_http_msg_add_str_data(hm, str, data, len,			\
 				    ss_skb_peek_tail(&hm->msg.skb_head))
 
+unsigned int tfw_http_hdr_name_hash(const TfwStr *hdr);
 unsigned int tfw_http_msg_hdr_lookup(TfwHttpMsg *hm, const TfwStr *hdr);
 int tfw_http_msg_hdr_add(TfwHttpMsg *hm, const TfwStr *hdr);
 int tfw_http_msg_hdr_xfrm_str(TfwHttpMsg *hm, const TfwStr *hdr,
@@ -170,6 +160,8 @@ int tfw_http_msg_hdr_xfrm(TfwHttpMsg *hm, char *name, size_t n_len,
 #define TFW_HTTP_MSG_HDR_DEL(hm, name, hid)				\
 	tfw_http_msg_hdr_xfrm(hm, name, sizeof(name) - 1, NULL, 0, hid, 0)
 
+void tfw_http_msg_hdrs_defer(TfwHttpMsg *hm);
+int tfw_http_msg_hdrs_apply(TfwHttpMsg *hm);
 int tfw_http_msg_del_str(TfwHttpMsg *hm, TfwStr *str);
 int tfw_http_msg_del_hbh_hdrs(TfwHttpMsg *hm);
 int tfw_http_msg_del_eol(struct sk_buff *skb_head, TfwStr *hdr);
@@ -185,10 +177,14 @@ int tfw_http_msg_grow_hdr_tbl(TfwHttpMsg *hm);
 void tfw_http_msg_free(TfwHttpMsg *m);
 int tfw_http_msg_expand_data(TfwMsgIter *it, struct sk_buff **skb_head,
 			     const TfwStr *src, unsigned int *start_off);
+int tfw_http_msg_add_frag(TfwMsgIter *it, struct page *page, int off, int sz);
+int tfw_http_msg_add_frame_hdr(TfwMsgIter *it, TfwFrameHdr *frame_hdr,
+			       struct page **page, unsigned int *off);
+int tfw_http_msg_body_skb(TfwMsgIter *it);
+int tfw_http_msg_add_shared_body(TfwMsgIter *it, const TfwHttpSharedBody *sb,
+				 unsigned int stream_id);
 int __hdr_name_cmp(const TfwStr *hdr, const TfwStr *cmp_hdr);
 int __http_hdr_lookup(TfwHttpMsg *hm, const TfwStr *hdr);
-int tfw_h2_msg_rewrite_data(TfwHttpTransIter *mit, const TfwStr *str,
-			    const char *stop);
 
 int tfw_http_msg_insert(TfwMsgIter *it, char *off, const TfwStr *data);
 
@@ -27,6 +27,9 @@
 #include <linux/ctype.h>
 #include <linux/frame.h>
 #include <linux/kernel.h>
+#ifdef TFW_PARSER_BENCH
+#include <asm/fpu/api.h>
+#endif
 
 #if DBG_HTTP_PARSER == 0
 #undef DEBUG
@@ -34,6 +37,7 @@
 
 #include "gfsm.h"
 #include "http_msg.h"
+#include "http_parser_meth.h"
 #include "htype.h"
 #include "http_sess.h"
 #include "hpack.h"
@@ -44,6 +48,28 @@
  *	Common HTTP parsing routines
  * ------------------------------------------------------------------------
  */
+/*
+ * Features of the active configuration, which need full parsing of request
+ * headers, see tfw_http_parse_need(). All the headers are parsed fully until
+ * the modules report their configuration.
+ */
+static unsigned long tfw_http_parse_feat __read_mostly =
+	(1UL << _TFW_HTTP_PARSE_NUM) - 1;
+
+/**
+ * Enable or disable full parsing of the request headers used by feature
+ * @feat only, see TFW_HTTP_PARSE_*. If no active feature needs a header,
+ * then the header value is only delimited and stored as is.
+ */
+void
+tfw_http_parse_need(unsigned int feat, bool need)
+{
+	if (need)
+		set_bit(feat, &tfw_http_parse_feat);
+	else
+		clear_bit(feat, &tfw_http_parse_feat);
+}
+
 /**
  * The following __data_{} macros help to reduce the amount of direct
  * @data/@len manipulations.
@@ -575,6 +601,22 @@ parse_int_list(unsigned char *data, size_t len, unsigned long *acc)
 	return parse_int_a(data, len, ws_comma_a, acc);
 }
 
+/**
+ * Convert @n hexadecimal digits at @data to an integer, the digits must be
+ * validated by the caller.
+ */
+static __always_inline unsigned long
+__parse_hex(const unsigned char *data, size_t n)
+{
+	unsigned long acc = 0;
+	const unsigned char *p;
+
+	for (p = data; p < data + n; ++p)
+		acc = (acc << 4) + (*p & 0xf) + (*p >> 6) * 9;
+
+	return acc;
+}
+
 /**
  * Parse probably chunked string representation of an hexadecimal integer.
  * @return number of parsed bytes.
@@ -1024,6 +1066,19 @@ __FSM_STATE(st_curr) {							\
 #define TFW_HTTP_PARSE_RAWHDR_VAL(st_curr, hm, func)			\
 	__TFW_HTTP_PARSE_RAWHDR_VAL(st_curr, hm, func, 1)
 
+/*
+ * Header value state @st_curr for a header used by feature @feat only: the
+ * value is parsed at state @st_full if the feature is active and is just
+ * delimited at state @st_lazy otherwise. Both the paths store the same
+ * header, so it's still available for http_tbl rules and forwarding.
+ */
+#define TFW_HTTP_PARSE_HDR_VAL_LAZY(st_curr, feat, st_full, st_lazy)	\
+__FSM_STATE(st_curr) {							\
+	if (test_bit(feat, &tfw_http_parse_feat))			\
+		__FSM_JMP(st_full);					\
+	__FSM_JMP(st_lazy);						\
+}
+
 /*
  * Parse raw (common) HTTP headers.
  * Note that some of these can be extremely large.
@@ -1093,7 +1148,7 @@ __FSM_STATE(RGen_BodyInit, cold) {					\
 	}								\
 	if (msg->content_length) {					\
 		parser->to_read = msg->content_length;			\
-		__FSM_MOVE_nofixup(RGen_BodyStart);			\
+		__FSM_MOVE_nofixup(Req_BodyTunnelStart);		\
 	}								\
 	/* There is no body. */						\
 	msg->body.flags |= TFW_STR_COMPLETE;				\
@@ -1160,6 +1215,36 @@ __FSM_STATE(Resp_BodyUnlimRead) {					\
 	__FSM_MOVE_nf(Resp_BodyUnlimRead, __data_remain(p), &msg->body); \
 }
 
+/*
+ * Request body of known length is tunneled to a server as is: the parser
+ * doesn't build a body chunk for each skb fragment, but only accounts the
+ * body length. @msg->body becomes a plain string descriptor pointing to the
+ * body start in @msg->body.skb with the total body length, so the body data
+ * must be accessed through the skbs only, e.g. with ss_skb_process(), and
+ * never as a contiguous buffer. The body skbs are split off at the message
+ * boundary and moved to the server connection without copying, so this way
+ * the body costs only the length accounting for each data chunk.
+ */
+#define TFW_HTTP_PARSE_REQ_BODY_TUNNEL()				\
+__FSM_STATE(Req_BodyTunnelStart, cold) {				\
+	tfw_http_msg_set_str_data(msg, &msg->body, p);			\
+	__set_bit(TFW_HTTP_B_BODY_TUNNEL, msg->flags);			\
+	/* Fall through. */						\
+}									\
+__FSM_STATE(Req_BodyTunnel, cold) {					\
+	BUG_ON(parser->to_read <= 0);					\
+	__fsm_sz = min_t(long, parser->to_read, __data_remain(p));	\
+	parser->to_read -= __fsm_sz;					\
+	msg->body.len += __fsm_sz;					\
+	p += __fsm_sz;							\
+	parser->state = &&Req_BodyTunnel;				\
+	if (parser->to_read)						\
+		__FSM_EXIT(TFW_POSTPONE);				\
+	/* We've fully read Content-Length bytes. */			\
+	msg->body.flags |= TFW_STR_COMPLETE;				\
+	__FSM_EXIT(TFW_PASS);						\
+}
+
 #define TFW_HTTP_PARSE_BODY(...)					\
 /* Read request|response body. */					\
 __FSM_STATE(RGen_BodyStart, __VA_ARGS__) {				\
@@ -1196,6 +1281,23 @@ __FSM_STATE(RGen_BodyReadChunk, __VA_ARGS__) {				\
 }									\
 __FSM_STATE(RGen_BodyChunkLen, __VA_ARGS__) {				\
 	__fsm_sz = __data_remain(p);					\
+	/*								\
+	 * Fast path: the whole chunk size line without chunk extensions \
+	 * is in the current chunk of data. Limit the number of digits	\
+	 * to not to check the chunk size overflow.			\
+	 */								\
+	if (likely(!parser->_cnt)) {					\
+		__fsm_n = tfw_match_xdigit(p, __fsm_sz);		\
+		if (likely(__fsm_n && __fsm_n < sizeof(long) * 2	\
+			   && __fsm_n + 1 < __fsm_sz			\
+			   && *(p + __fsm_n) == '\r'			\
+			   && *(p + __fsm_n + 1) == '\n'))		\
+		{							\
+			parser->to_read = __parse_hex(p, __fsm_n);	\
+			__FSM_MOVE_nf(RGen_BodyCR, __fsm_n + 1,		\
+				      &msg->body);			\
+		}							\
+	}								\
 	/* Read next chunk length. */					\
 	__fsm_n = parse_int_hex(p, __fsm_sz, &parser->_acc, &parser->_cnt); \
 	T_DBG3("data chunk: remain_len=%zu ret=%d to_read=%lu\n",	\
@@ -1320,10 +1422,10 @@ __parse_connection(TfwHttpMsg *hm, unsigned char *data, size_t len)
 	 * Other headers listed in the header will be compared with names of
 	 * end-to-end headers during saving in __hbh_parser_add_data().
 	 *
-	 * TODO: RFC 6455 WebSocket Protocol
-	 * During handshake client sets "Connection: update" and "Update" header.
-	 * This headers should be passed to server unchanged to allow
-	 * WebSocket protocol.
+	 * "Upgrade" token (RFC 7230 6.7) lists Upgrade header as hop-by-hop
+	 * like any other header name, but also sets the message flag: the
+	 * header is passed through for the protocols switching, e.g. RFC 6455
+	 * WebSocket handshake, once the connection is known to be tunneled.
 	 */
 	__FSM_STATE(I_Conn) {
 		WARN_ON_ONCE(parser->_acc);
@@ -1335,6 +1437,9 @@ __parse_connection(TfwHttpMsg *hm, unsigned char *data, size_t len)
 		TRY_CONN_TOKEN("keep-alive", {
 			__set_bit(TFW_HTTP_B_CONN_KA, &parser->_acc);
 		});
+		TRY_CONN_TOKEN("upgrade", {
+			__set_bit(TFW_HTTP_B_CONN_UPGRADE, &parser->_acc);
+		});
 		TRY_STR_INIT();
 		__FSM_I_JMP(I_ConnOther);
 	}
@@ -1362,6 +1467,12 @@ __parse_connection(TfwHttpMsg *hm, unsigned char *data, size_t len)
 				return CSTR_NEQ;
 			__set_bit(TFW_HTTP_B_CONN_CLOSE, msg->flags);
 		}
+		else if (test_bit(TFW_HTTP_B_CONN_UPGRADE, &parser->_acc)) {
+			if (__hbh_parser_add_data(hm, "upgrade", SLEN("upgrade"),
+						  true))
+				return CSTR_NEQ;
+			__set_bit(TFW_HTTP_B_CONN_UPGRADE, msg->flags);
+		}
 
 		__FSM_I_JMP(I_EoT);
 	}
@@ -2506,12 +2617,12 @@ __req_parse_host(TfwHttpReq *req, unsigned char *data, size_t len)
 
 	__FSM_STATE(Req_I_H) {
 		/* See Req_UriAuthority processing. */
-		if (likely(isalnum(c) || c == '.' || c == '-'))
-			__FSM_I_MOVE(Req_I_H);
+		__FSM_I_MATCH_MOVE(host, Req_I_H);
+		c = *(p + __fsm_sz);
 		if (c == ':')
-			__FSM_I_MOVE(Req_I_H_Port);
+			__FSM_I_MOVE_n(Req_I_H_Port, __fsm_sz + 1);
 		if (IS_CRLFWS(c))
-			return __data_off(p);
+			return __data_off(p + __fsm_sz);
 		return CSTR_NEQ;
 	}
 
@@ -3372,12 +3483,109 @@ tfw_http_init_parser_req(TfwHttpReq *req)
 	hbh_hdrs->spec = 0x1 << TFW_HTTP_HDR_CONNECTION;
 }
 
+/*
+ * Request header field names recognized by the parser, in lower case, and
+ * the value states. C can't index string literals in constant expressions,
+ * so the first and the last characters of the names are listed explicitly
+ * to compute the perfect hash below at compile time.
+ */
+#define TFW_HTTP_REQ_HDRS(X)						\
+	X(ACCEPT,	"accept",		'a', 't', Req_HdrAcceptV) \
+	X(AUTHORIZATION, "authorization",	'a', 'n',		\
+	  Req_HdrAuthorizationV)					\
+	X(CACHE_CONTROL, "cache-control",	'c', 'l',		\
+	  Req_HdrCache_ControlV)					\
+	X(CONNECTION,	"connection",		'c', 'n', Req_HdrConnectionV) \
+	X(CONTENT_LENGTH, "content-length",	'c', 'h',		\
+	  Req_HdrContent_LengthV)					\
+	X(CONTENT_TYPE,	"content-type",		'c', 'e',		\
+	  Req_HdrContent_TypeV)						\
+	X(COOKIE,	"cookie",		'c', 'e', Req_HdrCookieV) \
+	X(HOST,		"host",			'h', 't', Req_HdrHostV)	\
+	X(IF_MODIFIED_SINCE, "if-modified-since", 'i', 'e',		\
+	  Req_HdrIf_Modified_SinceV)					\
+	X(IF_NONE_MATCH, "if-none-match",	'i', 'h',		\
+	  Req_HdrIf_None_MatchV)					\
+	X(KEEP_ALIVE,	"keep-alive",		'k', 'e', Req_HdrKeep_AliveV) \
+	X(PRAGMA,	"pragma",		'p', 'a', Req_HdrPragmaV) \
+	X(REFERER,	"referer",		'r', 'r', Req_HdrRefererV) \
+	X(TRANSFER_ENCODING, "transfer-encoding", 't', 'g',		\
+	  Req_HdrTransfer_EncodingV)					\
+	X(USER_AGENT,	"user-agent",		'u', 't', Req_HdrUser_AgentV) \
+	X(X_FORWARDED_FOR, "x-forwarded-for",	'x', 'r',		\
+	  Req_HdrX_Forwarded_ForV)					\
+	X(X_HTTP_METHOD, "x-http-method",	'x', 'd',		\
+	  Req_HdrX_Method_OverrideV)					\
+	X(X_HTTP_METHOD_OVERRIDE, "x-http-method-override", 'x', 'e',	\
+	  Req_HdrX_Method_OverrideV)					\
+	X(X_METHOD_OVERRIDE, "x-method-override", 'x', 'e',		\
+	  Req_HdrX_Method_OverrideV)
+
+enum {
+#define __REQ_HDR_ID(id, name, c0, cn, st)	TFW_REQ_HDR_##id,
+	TFW_HTTP_REQ_HDRS(__REQ_HDR_ID)
+#undef __REQ_HDR_ID
+	_TFW_REQ_HDR_NUM
+};
+
+/*
+ * The hash function is chosen to have no collisions for the names above,
+ * t/unit/test_http_parser.c checks this.
+ */
+#define TFW_REQ_HDR_SLOTS		64
+#define __REQ_HDR_HASH(len, c0, cn)					\
+	(((len) + ((c0) << 5) + ((cn) << 1)) & (TFW_REQ_HDR_SLOTS - 1))
+
+/**
+ * Slot of the request header names perfect hash table.
+ *
+ * @name	- the header field name in lower case;
+ * @len		- length of @name, zero for empty slots;
+ * @id		- the header identifier, TFW_REQ_HDR_*;
+ */
+typedef struct {
+	const char	*name;
+	unsigned char	len;
+	unsigned char	id;
+} TfwReqHdrName;
+
+static const TfwReqHdrName tfw_req_hdr_tbl[TFW_REQ_HDR_SLOTS] = {
+#define __REQ_HDR_SLOT(id, name, c0, cn, st)				\
+	[__REQ_HDR_HASH(SLEN(name), c0, cn)] = {			\
+		name, SLEN(name), TFW_REQ_HDR_##id			\
+	},
+	TFW_HTTP_REQ_HDRS(__REQ_HDR_SLOT)
+#undef __REQ_HDR_SLOT
+};
+
+/**
+ * @return identifier of the request header field name @s of @len bytes
+ * or -1 if the parser doesn't process the header specially.
+ */
+static inline int
+__req_hdr_lookup(const unsigned char *s, size_t len)
+{
+	const TfwReqHdrName *e;
+
+	e = &tfw_req_hdr_tbl[__REQ_HDR_HASH(len, TFW_LC(s[0]),
+					    TFW_LC(s[len - 1]))];
+	if (e->len != len || tfw_cstricmp_2lc((const char *)s, e->name, len))
+		return -1;
+
+	return e->id;
+}
+
 int
 tfw_http_parse_req(void *req_data, unsigned char *data, size_t len,
 		   unsigned int *parsed)
 {
 	int r = TFW_BLOCK;
 	TfwHttpReq *req = (TfwHttpReq *)req_data;
+	static const void *const req_hdr_st[_TFW_REQ_HDR_NUM] = {
+#define __REQ_HDR_ST(id, name, c0, cn, st)	[TFW_REQ_HDR_##id] = &&st,
+		TFW_HTTP_REQ_HDRS(__REQ_HDR_ST)
+#undef __REQ_HDR_ST
+	};
 	__FSM_DECLARE_VARS(req);
 	*parsed = 0;
 
@@ -3397,7 +3605,7 @@ tfw_http_parse_req(void *req_data, unsigned char *data, size_t len,
 
 	/* HTTP method. */
 	__FSM_STATE(Req_Method, hot) {
-		if (likely(__data_available(p, 9))) {
+		if (likely(__data_available(p, TFW_HTTP_METH_DATA_MIN))) {
 			/*
 			 * Move most frequent methods forward and do not use
 			 * switch to make compiler not to merge it with the
@@ -3480,22 +3688,20 @@ tfw_http_parse_req(void *req_data, unsigned char *data, size_t len,
 	}
 
 	__FSM_STATE(Req_UriAuthority) {
-		if (likely(isalnum(c) || c == '.' || c == '-' || c == '@')) {
-			if (unlikely(c == '@')) {
-				if (!TFW_STR_EMPTY(&req->userinfo)) {
-					T_DBG("Second '@' in authority\n");
-					TFW_PARSER_BLOCK(Req_UriAuthority);
-				}
-				T_DBG3("Authority contains userinfo\n");
-				/* copy current host to userinfo */
-				req->userinfo = req->host;
-				__msg_field_finish(&req->userinfo, p);
-				TFW_STR_INIT(&req->host);
-
-				__FSM_MOVE_nofixup(Req_UriAuthorityResetHost);
+		__FSM_MATCH_MOVE_f(host, Req_UriAuthority, &req->host, 0);
+		p += __fsm_sz;
+		if (unlikely(*p == '@')) {
+			if (!TFW_STR_EMPTY(&req->userinfo)) {
+				T_DBG("Second '@' in authority\n");
+				TFW_PARSER_BLOCK(Req_UriAuthority);
 			}
+			T_DBG3("Authority contains userinfo\n");
+			/* copy current host to userinfo */
+			req->userinfo = req->host;
+			__msg_field_finish(&req->userinfo, p);
+			TFW_STR_INIT(&req->host);
 
-			__FSM_MOVE_f(Req_UriAuthority, &req->host);
+			__FSM_MOVE_nofixup(Req_UriAuthorityResetHost);
 		}
 		__FSM_JMP(Req_UriAuthorityEnd);
 	}
@@ -3659,254 +3865,43 @@ tfw_http_parse_req(void *req_data, unsigned char *data, size_t len,
 
 		tfw_http_msg_hdr_open(msg, p);
 
+		/*
+		 * Fast path: the whole header field name is in the chunk, so
+		 * recognize it by a single lookup in the perfect hash table.
+		 */
+		__fsm_sz = tfw_match_token(p, __data_remain(p));
+		if (likely(__fsm_sz && __fsm_sz < __data_remain(p)
+			   && *(p + __fsm_sz) == ':'))
+		{
+			__fsm_n = __req_hdr_lookup(p, __fsm_sz);
+			__msg_hdr_chunk_fixup(data, __data_off(p + __fsm_sz));
+			parser->_i_st = __fsm_n < 0 ? &&RGen_HdrOtherV
+						    : req_hdr_st[__fsm_n];
+			p += __fsm_sz;
+			__FSM_MOVE_hdr_fixup(RGen_LWS, 1);
+		}
+
+		/* The name is split between chunks, match it char by char. */
 		switch (TFW_LC(c)) {
 		case 'a':
-			if (likely(__data_available(p, 7)
-				   && C4_INT_LCM(p + 1, 'c', 'c', 'e', 'p')
-				   && TFW_LC(*(p + 6)) == 't'
-				   && *(p + 13) == ':'))
-			{
-				__msg_hdr_chunk_fixup(data, __data_off(p + 6));
-				parser->_i_st = &&Req_HdrAcceptV;
-				p += 6;
-				__FSM_MOVE_hdr_fixup(RGen_LWS, 1);
-			}
-			if (likely(__data_available(p, 14)
-				   && C8_INT_LCM(p + 1, 'u', 't', 'h', 'o',
-							'r', 'i', 'z', 'a')
-				   && C4_INT_LCM(p + 9, 't', 'i', 'o', 'n')
-				   && *(p + 13) == ':'))
-			{
-				__msg_hdr_chunk_fixup(data, __data_off(p + 13));
-				parser->_i_st = &&Req_HdrAuthorizationV;
-				p += 13;
-				__FSM_MOVE_hdr_fixup(RGen_LWS, 1);
-			}
 			__FSM_MOVE(Req_HdrA);
 		case 'c':
-			/* Ensure we have enough data for largest match. */
-			if (unlikely(!__data_available(p, 14)))
-				__FSM_MOVE(Req_HdrC);
-			/* Quick switch for HTTP headers with the same prefix. */
-			switch (TFW_P2LCINT(p + 1)) {
-			case TFW_CHAR4_INT('a', 'c', 'h', 'e'):
-				if (likely(*(p + 5) == '-'
-					   && C8_INT7_LCM(p + 6, 'c', 'o', 'n',
-							  't', 'r', 'o', 'l',
-							  ':')))
-				{
-					__msg_hdr_chunk_fixup(data,
-							      __data_off(p + 13));
-					parser->_i_st = &&Req_HdrCache_ControlV;
-					p += 13;
-					__FSM_MOVE_hdr_fixup(RGen_LWS, 1);
-				}
-				__FSM_MOVE_n(RGen_HdrOtherN, 5);
-			case TFW_CHAR4_INT('o', 'n', 'n', 'e'):
-				if (likely(C4_INT_LCM(p + 5, 'c', 't', 'i', 'o')
-					   && TFW_LC(*(p + 9)) == 'n'
-					   && *(p + 10) == ':'))
-				{
-					__msg_hdr_chunk_fixup(data,
-							      __data_off(p + 10));
-					parser->_i_st = &&Req_HdrConnectionV;
-					p += 10;
-					__FSM_MOVE_hdr_fixup(RGen_LWS, 1);
-				}
-				__FSM_MOVE_n(RGen_HdrOtherN, 5);
-			case TFW_CHAR4_INT('o', 'n', 't', 'e'):
-				if (likely(TFW_LC(*(p + 5)) == 'n'
-					   && TFW_LC(*(p + 6)) == 't'
-					   && *(p + 7) == '-'))
-				{
-					__FSM_MOVE_n(Req_HdrContent_, 8);
-				}
-				__FSM_MOVE_n(RGen_HdrOtherN, 5);
-			case TFW_CHAR4_INT('o', 'o', 'k', 'i'):
-				if (likely(TFW_LC(*(p + 5)) == 'e'
-					   && *(p + 6) == ':'))
-				{
-					__msg_hdr_chunk_fixup(data,
-							      __data_off(p + 6));
-					parser->_i_st = &&Req_HdrCookieV;
-					p += 6;
-					__FSM_MOVE_hdr_fixup(RGen_LWS, 1);
-				}
-				__FSM_MOVE_n(RGen_HdrOtherN, 5);
-			default:
-				__FSM_MOVE(RGen_HdrOtherN);
-			}
+			__FSM_MOVE(Req_HdrC);
 		case 'h':
-			if (likely(__data_available(p, 5)
-				   && C4_INT3_LCM(p + 1, 'o', 's', 't', ':')))
-			{
-				__msg_hdr_chunk_fixup(data, __data_off(p + 4));
-				parser->_i_st = &&Req_HdrHostV;
-				parser->_hdr_tag = TFW_HTTP_HDR_HOST;
-				p += 4;
-				__FSM_MOVE_hdr_fixup(RGen_LWS, 1);
-			}
 			__FSM_MOVE(Req_HdrH);
 		case 'i':
-			if (likely(__data_available(p, 18)
-				   && TFW_LC(*(p + 1)) == 'f'
-				   && *(p + 2) == '-'
-				   && C8_INT_LCM(p + 3, 'm', 'o', 'd', 'i',
-							'f', 'i', 'e', 'd')
-				   && *(p + 11) == '-'
-				   && C4_INT_LCM(p + 12, 's', 'i', 'n', 'c')
-				   && TFW_LC(*(p + 16)) == 'e'
-				   && *(p + 17) == ':'))
-			{
-				__msg_hdr_chunk_fixup(data, __data_off(p + 17));
-				parser->_i_st = &&Req_HdrIf_Modified_SinceV;
-				p += 17;
-				__FSM_MOVE_hdr_fixup(RGen_LWS, 1);
-			}
-			if (likely(__data_available(p, 14)
-				   && TFW_LC(*(p + 1)) == 'f'
-				   && *(p + 2) == '-'
-				   && C4_INT_LCM(p + 3, 'n', 'o', 'n', 'e')
-				   && *(p + 7) == '-'
-				   && C4_INT_LCM(p + 8, 'm', 'a', 't', 'c')
-				   && TFW_LC(*(p + 12)) == 'h'
-				   && *(p + 13) == ':'))
-			{
-				__msg_hdr_chunk_fixup(data, __data_off(p + 13));
-				parser->_i_st = &&Req_HdrIf_None_MatchV;
-				p += 13;
-				__FSM_MOVE_hdr_fixup(RGen_LWS, 1);
-			}
 			__FSM_MOVE(Req_HdrI);
 		case 'k':
-			if (likely(__data_available(p, 11)
-				   && C4_INT_LCM(p, 'k', 'e', 'e', 'p')
-				   && *(p + 4) == '-'
-				   && C4_INT_LCM(p + 5, 'a', 'l', 'i', 'v')
-				   && TFW_LC(*(p + 9)) == 'e'
-				   && *(p + 10) == ':'))
-			{
-				__msg_hdr_chunk_fixup(data, __data_off(p + 10));
-				parser->_i_st = &&Req_HdrKeep_AliveV;
-				p += 10;
-				__FSM_MOVE_hdr_fixup(RGen_LWS, 1);
-			}
 			__FSM_MOVE(Req_HdrK);
 		case 'p':
-			if (likely(__data_available(p, 7)
-				   && C4_INT_LCM(p + 1, 'r', 'a', 'g', 'm')
-				   && TFW_LC(*(p + 5)) == 'a'
-				   && *(p + 6) == ':'))
-			{
-				__msg_hdr_chunk_fixup(data, __data_off(p + 6));
-				parser->_i_st = &&Req_HdrPragmaV;
-				p += 6;
-				__FSM_MOVE_hdr_fixup(RGen_LWS, 1);
-			}
 			__FSM_MOVE(Req_HdrP);
 		case 'r':
-			if (likely(__data_available(p, 8)
-				   && C4_INT_LCM(p + 1, 'e', 'f', 'e', 'r')
-				   && TFW_LC(*(p + 5)) == 'e'
-				   && TFW_LC(*(p + 6)) == 'r'
-				   && *(p + 7) == ':'))
-			{
-				__msg_hdr_chunk_fixup(data, __data_off(p + 7));
-				parser->_i_st = &&Req_HdrRefererV;
-				p += 7;
-				__FSM_MOVE_hdr_fixup(RGen_LWS, 1);
-			}
 			__FSM_MOVE(Req_HdrR);
 		case 't':
-			if (likely(__data_available(p, 18)
-				   && C8_INT_LCM(p, 't', 'r', 'a', 'n',
-						    's', 'f', 'e', 'r')
-				   && *(p + 8) == '-'
-				   && C8_INT_LCM(p + 9, 'e', 'n', 'c', 'o',
-							'd', 'i', 'n', 'g')
-				   && *(p + 17) == ':'))
-			{
-				__msg_hdr_chunk_fixup(data, __data_off(p + 17));
-				parser->_i_st = &&Req_HdrTransfer_EncodingV;
-				p += 17;
-				__FSM_MOVE_hdr_fixup(RGen_LWS, 1);
-			}
 			__FSM_MOVE(Req_HdrT);
 		case 'x':
-			if (likely(__data_available(p, 16)
-				   && *(p + 1) == '-'
-				   && *(p + 11) == '-'
-				   /* Safe match: '-' is checked above. */
-				   && C8_INT_LCM(p, 'x', '-', 'f', 'o',
-						 'r', 'w', 'a', 'r')
-				   && C8_INT7_LCM(p + 8, 'd', 'e', 'd', '-',
-						  'f', 'o', 'r', ':')))
-			{
-				__msg_hdr_chunk_fixup(data, __data_off(p + 15));
-				parser->_i_st = &&Req_HdrX_Forwarded_ForV;
-				p += 15;
-				__FSM_MOVE_hdr_fixup(RGen_LWS, 1);
-			}
-			if (likely(__data_available(p, 14)
-				   && *(p + 1) == '-'
-				   && *(p + 7) == '-'
-				   /* Safe match: '-' is checked above. */
-				   && C8_INT_LCM(p, 'x', '-', 'h', 't',
-						 't', 'p', '-', 'm')
-				   && C4_INT_LCM(p + 8, 'e', 't', 'h', 'o')
-				   && TFW_LC(*(p + 12) == 'd')
-				   && *(p + 10) == ':'))
-			{
-				__msg_hdr_chunk_fixup(data, __data_off(p + 13));
-				parser->_i_st = &&Req_HdrX_Method_OverrideV;
-				p += 13;
-				__FSM_MOVE_hdr_fixup(RGen_LWS, 1);
-			}
-			if (likely(__data_available(p, 23)
-				   && *(p + 1) == '-'
-				   && *(p + 7) == '-'
-				   && *(p + 14) == '-'
-				   /* Safe match: '-' is checked above. */
-				   && C8_INT_LCM(p, 'x', '-', 'h', 't',
-						 't', 'p', '-', 'm')
-				   && C8_INT_LCM(p + 8, 'e', 't', 'h', 'o',
-						 'd', '-', 'o', 'v')
-				   && C8_INT7_LCM(p + 16, 'v', 'e', 'r', 'r',
-						  'i', 'd', 'e', ':')))
-			{
-				__msg_hdr_chunk_fixup(data, __data_off(p + 22));
-				parser->_i_st = &&Req_HdrX_Method_OverrideV;
-				p += 22;
-				__FSM_MOVE_hdr_fixup(RGen_LWS, 1);
-			}
-			if (likely(__data_available(p, 18)
-				   && *(p + 1) == '-'
-				   && *(p + 9) == '-'
-				   /* Safe match: '-' is checked above. */
-				   && C8_INT_LCM(p + 2, 'm', 'e', 't', 'h',
-						 'o', 'd', '-', 'o')
-				   && C8_INT7_LCM(p + 10, 'v', 'e', 'r', 'r',
-						 'i', 'd', 'e', ':')))
-			{
-				__msg_hdr_chunk_fixup(data, __data_off(p + 17));
-				parser->_i_st = &&Req_HdrX_Method_OverrideV;
-				p += 17;
-				__FSM_MOVE_hdr_fixup(RGen_LWS, 1);
-			}
 			__FSM_MOVE(Req_HdrX);
 		case 'u':
-			if (likely(__data_available(p, 11)
-				   && C4_INT_LCM(p, 'u', 's', 'e', 'r')
-				   && *(p + 4) == '-'
-				   && C4_INT_LCM(p + 5, 'a', 'g', 'e', 'n')
-				   && TFW_LC(*(p + 9)) == 't'
-				   && *(p + 10) == ':'))
-			{
-				__msg_hdr_chunk_fixup(data, __data_off(p + 10));
-				parser->_i_st = &&Req_HdrUser_AgentV;
-				p += 10;
-				__FSM_MOVE_hdr_fixup(RGen_LWS, 1);
-			}
 			__FSM_MOVE(Req_HdrU);
 		default:
 			__FSM_JMP(RGen_HdrOtherN);
@@ -3944,14 +3939,19 @@ tfw_http_parse_req(void *req_data, unsigned char *data, size_t len,
 	}
 
 	/* 'Accept:*OWS' is read, process field-value. */
-	TFW_HTTP_PARSE_RAWHDR_VAL(Req_HdrAcceptV, req, __req_parse_accept);
+	TFW_HTTP_PARSE_HDR_VAL_LAZY(Req_HdrAcceptV, TFW_HTTP_PARSE_STICKY,
+				    Req_HdrAcceptV_Full, RGen_HdrOtherV);
+	TFW_HTTP_PARSE_RAWHDR_VAL(Req_HdrAcceptV_Full, req,
+				  __req_parse_accept);
 
 	/* 'Authorization:*OWS' is read, process field-value. */
 	TFW_HTTP_PARSE_RAWHDR_VAL(Req_HdrAuthorizationV, req,
 				  __req_parse_authorization);
 
 	/* 'Cache-Control:*OWS' is read, process field-value. */
-	TFW_HTTP_PARSE_RAWHDR_VAL(Req_HdrCache_ControlV, req,
+	TFW_HTTP_PARSE_HDR_VAL_LAZY(Req_HdrCache_ControlV, TFW_HTTP_PARSE_CACHE,
+				    Req_HdrCache_ControlV_Full, RGen_HdrOtherV);
+	TFW_HTTP_PARSE_RAWHDR_VAL(Req_HdrCache_ControlV_Full, req,
 				  __req_parse_cache_control);
 
 	/* 'Connection:*OWS' is read, process field-value. */
@@ -3977,7 +3977,11 @@ tfw_http_parse_req(void *req_data, unsigned char *data, size_t len,
 				     TFW_HTTP_HDR_IF_NONE_MATCH, 0);
 
 	/* 'If-Modified-Since:*OWS' is read, process field-value. */
-	TFW_HTTP_PARSE_RAWHDR_VAL(Req_HdrIf_Modified_SinceV, msg,
+	TFW_HTTP_PARSE_HDR_VAL_LAZY(Req_HdrIf_Modified_SinceV,
+				    TFW_HTTP_PARSE_CACHE,
+				    Req_HdrIf_Modified_SinceV_Full,
+				    RGen_HdrOtherV);
+	TFW_HTTP_PARSE_RAWHDR_VAL(Req_HdrIf_Modified_SinceV_Full, msg,
 				  __req_parse_if_msince);
 
 	/* 'Keep-Alive:*OWS' is read, process field-value. */
@@ -3985,7 +3989,10 @@ tfw_http_parse_req(void *req_data, unsigned char *data, size_t len,
 				     TFW_HTTP_HDR_KEEP_ALIVE, 0);
 
 	/* 'Pragma:*OWS' is read, process field-value. */
-	__TFW_HTTP_PARSE_RAWHDR_VAL(Req_HdrPragmaV, msg, __parse_pragma, 0);
+	TFW_HTTP_PARSE_HDR_VAL_LAZY(Req_HdrPragmaV, TFW_HTTP_PARSE_CACHE,
+				    Req_HdrPragmaV_Full, RGen_HdrOtherV);
+	__TFW_HTTP_PARSE_RAWHDR_VAL(Req_HdrPragmaV_Full, msg, __parse_pragma,
+				    0);
 
 	/* 'Referer:*OWS' is read, process field-value. */
 	TFW_HTTP_PARSE_SPECHDR_VAL(Req_HdrRefererV, msg, __req_parse_referer,
@@ -4006,9 +4013,18 @@ tfw_http_parse_req(void *req_data, unsigned char *data, size_t len,
 				   __req_parse_user_agent,
 				   TFW_HTTP_HDR_USER_AGENT);
 
-	/* 'Cookie:*OWS' is read, process field-value. */
-	__TFW_HTTP_PARSE_SPECHDR_VAL(Req_HdrCookieV, msg, __req_parse_cookie,
-				     TFW_HTTP_HDR_COOKIE, 0);
+	/*
+	 * 'Cookie:*OWS' is read, process field-value. The cookies are split
+	 * to chunks for the sticky cookies only, otherwise the value is
+	 * opaque as User-Agent.
+	 */
+	TFW_HTTP_PARSE_HDR_VAL_LAZY(Req_HdrCookieV, TFW_HTTP_PARSE_STICKY,
+				    Req_HdrCookieV_Full, Req_HdrCookieV_Lazy);
+	__TFW_HTTP_PARSE_SPECHDR_VAL(Req_HdrCookieV_Full, msg,
+				     __req_parse_cookie, TFW_HTTP_HDR_COOKIE,
+				     0);
+	TFW_HTTP_PARSE_SPECHDR_VAL(Req_HdrCookieV_Lazy, msg,
+				   __req_parse_user_agent, TFW_HTTP_HDR_COOKIE);
 
 	/*
 	 * 'X-HTTP-Method:*OWS' OR 'X-HTTP-Method-Override:*OWS' OR
@@ -4032,6 +4048,7 @@ tfw_http_parse_req(void *req_data, unsigned char *data, size_t len,
 	 * Most requests do not have body, so move body parser after the end.
 	 */
 	TFW_HTTP_INIT_REQ_BODY_PARSING();
+	TFW_HTTP_PARSE_REQ_BODY_TUNNEL();
 	TFW_HTTP_PARSE_BODY(cold);
 
 	/*
@@ -4053,6 +4070,9 @@ tfw_http_parse_req(void *req_data, unsigned char *data, size_t len,
 	 *
 	 * We already sure that there is enough data available from fast path
 	 * of Req_Method.
+	 *
+	 * The switches and the states of the rare methods are generated from
+	 * the methods list by fsmgen, see http_parser_meth.h.
 	 */
 Req_Method_RareMethods: __attribute__((cold))
 #define __MATCH_METH(meth, step_inc)					\
@@ -4063,214 +4083,19 @@ do {									\
 } while (0)
 
 	__fsm_n = 4;
-	switch (PI(p)) {
-	case TFW_CHAR4_INT('H', 'E', 'A', 'D'):
-		__MATCH_METH(HEAD, 0);
-	/* PURGE Method for Tempesta Configuration: PURGE. */
-	case TFW_CHAR4_INT('P', 'U', 'R', 'G'):
-		if (likely(*(p + 4) == 'E'))
-			__MATCH_METH(PURGE, 1);
-		__FSM_MOVE_nofixup_n(Req_MethPurg, 4);
-	case TFW_CHAR4_INT('C', 'O', 'P', 'Y'):
-		__MATCH_METH(COPY, 0);
-	case TFW_CHAR4_INT('D', 'E', 'L', 'E'):
-		if (likely(*(p + 4) == 'T' && *(p + 5) == 'E'))
-			__MATCH_METH(DELETE, 2);
-		__FSM_MOVE_nofixup_n(Req_MethDele, 4);
-	case TFW_CHAR4_INT('L', 'O', 'C', 'K'):
-		__MATCH_METH(LOCK, 0);
-	case TFW_CHAR4_INT('M', 'K', 'C', 'O'):
-		if (likely(*(p + 4) == 'L'))
-			__MATCH_METH(MKCOL, 1);
-		__FSM_MOVE_nofixup_n(Req_MethMkco, 4);
-	case TFW_CHAR4_INT('M', 'O', 'V', 'E'):
-		__MATCH_METH(MOVE, 0);
-	case TFW_CHAR4_INT('O', 'P', 'T', 'I'):
-		if (likely(*((unsigned int *)p + 1)
-			 == TFW_CHAR4_INT('O', 'N', 'S', ' ')))
-		{
-			req->method = TFW_HTTP_METH_OPTIONS;
-			__FSM_MOVE_nofixup_n(Req_Uri, 8);
-		}
-		__FSM_MOVE_nofixup_n(Req_MethOpti, 4);
-	case TFW_CHAR4_INT('P', 'A', 'T', 'C'):
-		if (likely(*(p + 4) == 'H'))
-			__MATCH_METH(PATCH, 1);
-		__FSM_MOVE_nofixup_n(Req_MethPatc, 4);
-	case TFW_CHAR4_INT('P', 'R', 'O', 'P'):
-		if (likely(*((unsigned int *)p + 1)
-			  == TFW_CHAR4_INT('F', 'I', 'N', 'D')))
-		{
-			__MATCH_METH(PROPFIND, 4);
-		}
-		if (likely(*((unsigned int *)p + 1)
-			   == TFW_CHAR4_INT('P', 'A', 'T', 'C'))
-				&& (*(p + 8) == 'H'))
-		{
-			__MATCH_METH(PROPPATCH, 5);
-		}
-		__FSM_MOVE_nofixup_n(Req_MethProp, 4);
-	case TFW_CHAR4_INT('P', 'U', 'T', ' '):
-		req->method = TFW_HTTP_METH_PUT;
-		__FSM_MOVE_nofixup_n(Req_Uri, 4);
-	case TFW_CHAR4_INT('T', 'R', 'A', 'C'):
-		if (likely(*(p + 4) == 'E'))
-			__MATCH_METH(TRACE, 1);
-		__FSM_MOVE_nofixup_n(Req_MethTrac, 4);
-	case TFW_CHAR4_INT('U', 'N', 'L', 'O'):
-		if (likely(*(p + 4) == 'C' && *(p + 5) == 'K'))
-			__MATCH_METH(UNLOCK, 2);
-		__FSM_MOVE_nofixup_n(Req_MethUnlo, 4);
-	default:
-		__FSM_MOVE_nofixup(Req_MethodUnknown);
-	}
+	__FSM_REQ_METH_WORD_SWITCH();
 match_meth:
 	__FSM_MOVE_nofixup_n(Req_MUSpace, __fsm_n);
 #undef __MATCH_METH
 
 	/* Req_Method slow path: step char-by-char. */
 Req_Method_1CharStep: __attribute__((cold))
-	switch (c) {
-	case 'G':
-		__FSM_MOVE_nofixup(Req_MethG);
-	case 'H':
-		__FSM_MOVE_nofixup(Req_MethH);
-	case 'P':
-		__FSM_MOVE_nofixup(Req_MethP);
-	case 'C':
-		__FSM_MOVE_nofixup(Req_MethC);
-	case 'D':
-		__FSM_MOVE_nofixup(Req_MethD);
-	case 'L':
-		__FSM_MOVE_nofixup(Req_MethL);
-	case 'M':
-		__FSM_MOVE_nofixup(Req_MethM);
-	case 'O':
-		__FSM_MOVE_nofixup(Req_MethO);
-	case 'T':
-		__FSM_MOVE_nofixup(Req_MethT);
-	case 'U':
-		__FSM_MOVE_nofixup(Req_MethU);
-	}
-	__FSM_MOVE_nofixup(Req_MethodUnknown);
-
+	__FSM_REQ_METH_1CHAR_SWITCH();
 
 	/* ----------------    Improbable states    ---------------- */
 
 	/* HTTP Method processing. */
-	/* GET */
-	__FSM_METH_MOVE(Req_MethG, 'E', Req_MethGe);
-	__FSM_METH_MOVE_finish(Req_MethGe, 'T', TFW_HTTP_METH_GET);
-	/* P* */
-	__FSM_STATE(Req_MethP, cold) {
-		switch (c) {
-		case 'O':
-			__FSM_MOVE_nofixup(Req_MethPo);
-		case 'A':
-			__FSM_MOVE_nofixup(Req_MethPa);
-		case 'R':
-			__FSM_MOVE_nofixup(Req_MethPr);
-		case 'U':
-			__FSM_MOVE_nofixup(Req_MethPu);
-		}
-		__FSM_MOVE_nofixup(Req_MethodUnknown);
-	}
-	/* POST */
-	__FSM_METH_MOVE(Req_MethPo, 'S', Req_MethPos);
-	__FSM_METH_MOVE_finish(Req_MethPos, 'T', TFW_HTTP_METH_POST);
-	/* PATCH */
-	__FSM_METH_MOVE(Req_MethPa, 'T', Req_MethPat);
-	__FSM_METH_MOVE(Req_MethPat, 'C', Req_MethPatc);
-	__FSM_METH_MOVE_finish(Req_MethPatc, 'H', TFW_HTTP_METH_PATCH);
-	/* PROP* */
-	__FSM_METH_MOVE(Req_MethPr, 'O', Req_MethPro);
-	__FSM_METH_MOVE(Req_MethPro, 'P', Req_MethProp);
-	__FSM_STATE(Req_MethProp, cold) {
-		switch (c) {
-		case 'F':
-			__FSM_MOVE_nofixup(Req_MethPropf);
-		case 'P':
-			__FSM_MOVE_nofixup(Req_MethPropp);
-		}
-		__FSM_MOVE_nofixup(Req_MethodUnknown);
-	}
-	/* PROPFIND */
-	__FSM_METH_MOVE(Req_MethPropf, 'I', Req_MethPropfi);
-	__FSM_METH_MOVE(Req_MethPropfi, 'N', Req_MethPropfin);
-	__FSM_METH_MOVE_finish(Req_MethPropfin, 'D', TFW_HTTP_METH_PROPFIND);
-	/* PROPPATCH */
-	__FSM_METH_MOVE(Req_MethPropp, 'A', Req_MethProppa);
-	__FSM_METH_MOVE(Req_MethProppa, 'T', Req_MethProppat);
-	__FSM_METH_MOVE(Req_MethProppat, 'C', Req_MethProppatc);
-	__FSM_METH_MOVE_finish(Req_MethProppatc, 'H', TFW_HTTP_METH_PROPPATCH);
-	/* PU* */
-	__FSM_STATE(Req_MethPu, cold) {
-		switch (c) {
-		case 'R':
-			__FSM_MOVE_nofixup(Req_MethPur);
-		case 'T':
-			/* PUT */
-			req->method = TFW_HTTP_METH_PUT;
-			__FSM_MOVE_nofixup(Req_MUSpace);
-		}
-		__FSM_MOVE_nofixup(Req_MethodUnknown);
-	}
-	/* PURGE */
-	__FSM_METH_MOVE(Req_MethPur, 'G', Req_MethPurg);
-	__FSM_METH_MOVE_finish(Req_MethPurg, 'E', TFW_HTTP_METH_PURGE);
-	/* HEAD */
-	__FSM_METH_MOVE(Req_MethH, 'E', Req_MethHe);
-	__FSM_METH_MOVE(Req_MethHe, 'A', Req_MethHea);
-	__FSM_METH_MOVE_finish(Req_MethHea, 'D', TFW_HTTP_METH_HEAD);
-	/* COPY */
-	__FSM_METH_MOVE(Req_MethC, 'O', Req_MethCo);
-	__FSM_METH_MOVE(Req_MethCo, 'P', Req_MethCop);
-	__FSM_METH_MOVE_finish(Req_MethCop, 'Y', TFW_HTTP_METH_COPY);
-	/* DELETE */
-	__FSM_METH_MOVE(Req_MethD, 'E', Req_MethDe);
-	__FSM_METH_MOVE(Req_MethDe, 'L', Req_MethDel);
-	__FSM_METH_MOVE(Req_MethDel, 'E', Req_MethDele);
-	__FSM_METH_MOVE(Req_MethDele, 'T', Req_MethDelet);
-	__FSM_METH_MOVE_finish(Req_MethDelet, 'E', TFW_HTTP_METH_DELETE);
-	/* LOCK */
-	__FSM_METH_MOVE(Req_MethL, 'O', Req_MethLo);
-	__FSM_METH_MOVE(Req_MethLo, 'C', Req_MethLoc);
-	__FSM_METH_MOVE_finish(Req_MethLoc, 'K', TFW_HTTP_METH_LOCK);
-	/* M* */
-	__FSM_STATE(Req_MethM, cold) {
-		switch (c) {
-		case 'K':
-			__FSM_MOVE_nofixup(Req_MethMk);
-		case 'O':
-			__FSM_MOVE_nofixup(Req_MethMo);
-		}
-		__FSM_MOVE_nofixup(Req_MethodUnknown);
-	}
-	/* MKCOL */
-	__FSM_METH_MOVE(Req_MethMk, 'C', Req_MethMkc);
-	__FSM_METH_MOVE(Req_MethMkc, 'O', Req_MethMkco);
-	__FSM_METH_MOVE_finish(Req_MethMkco, 'L', TFW_HTTP_METH_MKCOL);
-	/* MOVE */
-	__FSM_METH_MOVE(Req_MethMo, 'V', Req_MethMov);
-	__FSM_METH_MOVE_finish(Req_MethMov, 'E', TFW_HTTP_METH_MOVE);
-	/* OPTIONS */
-	__FSM_METH_MOVE(Req_MethO, 'P', Req_MethOp);
-	__FSM_METH_MOVE(Req_MethOp, 'T', Req_MethOpt);
-	__FSM_METH_MOVE(Req_MethOpt, 'I', Req_MethOpti);
-	__FSM_METH_MOVE(Req_MethOpti, 'O', Req_MethOptio);
-	__FSM_METH_MOVE(Req_MethOptio, 'N', Req_MethOption);
-	__FSM_METH_MOVE_finish(Req_MethOption, 'S', TFW_HTTP_METH_OPTIONS);
-	/* TRACE */
-	__FSM_METH_MOVE(Req_MethT, 'R', Req_MethTr);
-	__FSM_METH_MOVE(Req_MethTr, 'A', Req_MethTra);
-	__FSM_METH_MOVE(Req_MethTra, 'C', Req_MethTrac);
-	__FSM_METH_MOVE_finish(Req_MethTrac, 'E', TFW_HTTP_METH_TRACE);
-	/* UNLOCK */
-	__FSM_METH_MOVE(Req_MethU, 'N', Req_MethUn);
-	__FSM_METH_MOVE(Req_MethUn, 'L', Req_MethUnl);
-	__FSM_METH_MOVE(Req_MethUnl, 'O', Req_MethUnlo);
-	__FSM_METH_MOVE(Req_MethUnlo, 'C', Req_MethUnloc);
-	__FSM_METH_MOVE_finish(Req_MethUnloc, 'K', TFW_HTTP_METH_UNLOCK);
+	__FSM_REQ_METH_STATES();
 
 	__FSM_STATE(Req_MethodUnknown, cold) {
 		__FSM_MATCH_MOVE_nofixup(token, Req_MethodUnknown);
@@ -6185,10 +6010,9 @@ __h2_req_parse_host(TfwHttpReq *req, unsigned char *data, size_t len, bool fin)
 
 	__FSM_STATE(Req_I_H) {
 		/* See Req_AuthorityGen processing. */
-		if (likely(isalnum(c) || c == '.' || c == '-'))
-			__FSM_H2_I_MOVE(Req_I_H);
-		if (c == ':')
-			__FSM_H2_I_MOVE(Req_I_H_Port);
+		__FSM_H2_I_MATCH_MOVE(host, Req_I_H);
+		if (*(p + __fsm_sz) == ':')
+			__FSM_H2_I_MOVE_n(Req_I_H_Port, __fsm_sz + 1);
 		return CSTR_NEQ;
 	}
 
@@ -7171,8 +6995,9 @@ tfw_h2_parse_req_hdr(unsigned char *data, unsigned long len, TfwHttpReq *req,
 	}
 
 	__FSM_STATE(Req_AuthorityGen) {
-		if (likely(isalnum(c) || c == '.' || c == '-'))
-			__FSM_H2_PSHDR_MOVE_FIN(Req_AuthorityGen, 1,
+		__FSM_H2_I_MATCH(host);
+		if (likely(__fsm_sz))
+			__FSM_H2_PSHDR_MOVE_FIN(Req_AuthorityGen, __fsm_sz,
 						Req_AuthorityGen);
 		/*
 		 * The value of HTTP/2 authority pseudo-header must not
@@ -7282,7 +7107,9 @@ tfw_h2_parse_req_hdr(unsigned char *data, unsigned long len, TfwHttpReq *req,
 	/* ----------------    Header values    ---------------- */
 
 	/* 'accept' is read, process field-value. */
-	TFW_H2_PARSE_HDR_VAL(Req_HdrAcceptV, req, __h2_req_parse_accept,
+	TFW_HTTP_PARSE_HDR_VAL_LAZY(Req_HdrAcceptV, TFW_HTTP_PARSE_STICKY,
+				    Req_HdrAcceptV_Full, RGen_HdrOtherV);
+	TFW_H2_PARSE_HDR_VAL(Req_HdrAcceptV_Full, req, __h2_req_parse_accept,
 			     TFW_HTTP_HDR_RAW, 1);
 
 	/* 'authorization' is read, process field-value. */
@@ -7290,7 +7117,9 @@ tfw_h2_parse_req_hdr(unsigned char *data, unsigned long len, TfwHttpReq *req,
 			     __h2_req_parse_authorization, TFW_HTTP_HDR_RAW, 1);
 
 	/* 'cache-control' is read, process field-value. */
-	TFW_H2_PARSE_HDR_VAL(Req_HdrCache_ControlV, req,
+	TFW_HTTP_PARSE_HDR_VAL_LAZY(Req_HdrCache_ControlV, TFW_HTTP_PARSE_CACHE,
+				    Req_HdrCache_ControlV_Full, RGen_HdrOtherV);
+	TFW_H2_PARSE_HDR_VAL(Req_HdrCache_ControlV_Full, req,
 			     __h2_req_parse_cache_control, TFW_HTTP_HDR_RAW, 1);
 
 	/* 'content-length' is read, process field-value. */
@@ -7313,12 +7142,18 @@ tfw_h2_parse_req_hdr(unsigned char *data, unsigned long len, TfwHttpReq *req,
 			     TFW_HTTP_HDR_IF_NONE_MATCH, 0);
 
 	/* 'if-modified-since' is read, process field-value. */
-	TFW_H2_PARSE_HDR_VAL(Req_HdrIf_Modified_SinceV, msg,
+	TFW_HTTP_PARSE_HDR_VAL_LAZY(Req_HdrIf_Modified_SinceV,
+				    TFW_HTTP_PARSE_CACHE,
+				    Req_HdrIf_Modified_SinceV_Full,
+				    RGen_HdrOtherV);
+	TFW_H2_PARSE_HDR_VAL(Req_HdrIf_Modified_SinceV_Full, msg,
 			     __h2_req_parse_if_msince,
 			     TFW_HTTP_HDR_RAW, 1);
 
 	/* 'pragma' is read, process field-value. */
-	TFW_H2_PARSE_HDR_VAL(Req_HdrPragmaV, msg, __h2_req_parse_pragma,
+	TFW_HTTP_PARSE_HDR_VAL_LAZY(Req_HdrPragmaV, TFW_HTTP_PARSE_CACHE,
+				    Req_HdrPragmaV_Full, RGen_HdrOtherV);
+	TFW_H2_PARSE_HDR_VAL(Req_HdrPragmaV_Full, msg, __h2_req_parse_pragma,
 			     TFW_HTTP_HDR_RAW, 1);
 
 	/* 'referer' is read, process field-value. */
@@ -7329,9 +7164,13 @@ tfw_h2_parse_req_hdr(unsigned char *data, unsigned long len, TfwHttpReq *req,
 	TFW_H2_PARSE_HDR_VAL(Req_HdrUser_AgentV, msg, __h2_req_parse_user_agent,
 			     TFW_HTTP_HDR_USER_AGENT, 1);
 
-	/* 'cookie' is read, process field-value. */
-	TFW_H2_PARSE_HDR_VAL(Req_HdrCookieV, msg, __h2_req_parse_cookie,
+	/* 'cookie' is read, process field-value, see HTTP/1 Req_HdrCookieV. */
+	TFW_HTTP_PARSE_HDR_VAL_LAZY(Req_HdrCookieV, TFW_HTTP_PARSE_STICKY,
+				    Req_HdrCookieV_Full, Req_HdrCookieV_Lazy);
+	TFW_H2_PARSE_HDR_VAL(Req_HdrCookieV_Full, msg, __h2_req_parse_cookie,
 			     TFW_HTTP_HDR_COOKIE, 0);
+	TFW_H2_PARSE_HDR_VAL(Req_HdrCookieV_Lazy, msg,
+			     __h2_req_parse_user_agent, TFW_HTTP_HDR_COOKIE, 1);
 
 	/* 'x-forwarded-for' is read, process field-value. */
 	TFW_H2_PARSE_HDR_VAL(Req_HdrX_Forwarded_ForV, msg,
@@ -8280,6 +8119,8 @@ __resp_parse_cache_control(TfwHttpResp *resp, unsigned char *data, size_t len)
 	__FSM_STATE(Resp_I_CC_s) {
 		TRY_STR_fixup(&TFW_STR_STRING("s-maxage="), Resp_I_CC_s,
 			      Resp_I_CC_SMaxAgeV);
+		TRY_STR_fixup(&TFW_STR_STRING("stale-while-revalidate="),
+			      Resp_I_CC_s, Resp_I_CC_StaleRevalV);
 		TRY_STR_INIT();
 		__FSM_I_JMP(Resp_I_Ext);
 	}
@@ -8322,6 +8163,26 @@ __resp_parse_cache_control(TfwHttpResp *resp, unsigned char *data, size_t len)
 		__FSM_I_MOVE_fixup(Resp_I_EoT, __fsm_n, 0);
 	}
 
+	/* RFC 5861 3: stale-while-revalidate extension. */
+	__FSM_STATE(Resp_I_CC_StaleRevalV) {
+		if (unlikely(resp->cache_ctl.flags & TFW_HTTP_CC_STALE_REVAL)) {
+			resp->cache_ctl.stale_reval = 0;
+			__FSM_I_JMP(Resp_I_Ext);
+		}
+		__fsm_sz = __data_remain(p);
+		__fsm_n = parse_int_list(p, __fsm_sz, &parser->_acc);
+		if (__fsm_n == CSTR_POSTPONE)
+			__msg_hdr_chunk_fixup(p, __fsm_sz);
+		if (__fsm_n < 0) {
+			if (__fsm_n != CSTR_BADLEN)
+				return __fsm_n;
+			parser->_acc = UINT_MAX;
+		}
+		resp->cache_ctl.stale_reval = parser->_acc;
+		resp->cache_ctl.flags |= TFW_HTTP_CC_STALE_REVAL;
+		__FSM_I_MOVE_fixup(Resp_I_EoT, __fsm_n, 0);
+	}
+
 	__FSM_STATE(Resp_I_Ext) {
 		/* TODO: process cache extensions. */
 		__FSM_I_MATCH_MOVE_fixup(qetoken, Resp_I_Ext, 0);
@@ -9738,3 +9599,196 @@ tfw_http_parse_is_done(TfwHttpMsg *hm)
 {
 	return test_bit(TFW_HTTP_B_FULLY_PARSED, hm->flags);
 }
+
+#ifdef TFW_PARSER_BENCH
+/*
+ * ------------------------------------------------------------------------
+ *	HTTP parser microbenchmarks
+ * ------------------------------------------------------------------------
+ *
+ * The benchmark feeds a message to the parser split into a number of equal
+ * fragments, like the message was received in several skbs, and measures
+ * the parser and the HPACK decoder calls only: the message allocation and
+ * freeing aren't counted. The driver is t/parser_bench.c.
+ */
+/* Number of messages parsed with disabled softirqs. */
+#define TFW_PARSER_BENCH_BATCH	256
+
+static const char tfw_parser_bench_req[] = "GET / HTTP/1.1\r\n"
+					   "Host: tfw-bench\r\n"
+					   "\r\n";
+
+typedef struct {
+	TfwConn		conn;
+	TfwConn		conn_req;
+	TfwHPack	hpack;
+	TfwHttpReq	*req;
+} TfwParserBench;
+
+static TfwHttpMsg *
+tfw_parser_bench_msg(TfwConn *conn, int type, size_t len)
+{
+	TfwMsgIter it;
+	TfwHttpMsg *hm;
+	int ctype = type == TFW_PARSER_BENCH_RESP ? Conn_HttpSrv
+						  : Conn_HttpClnt;
+
+	if (!(hm = __tfw_http_msg_alloc(ctype, true)))
+		return NULL;
+	if (tfw_http_msg_setup(hm, &it, len, 0))
+		goto err;
+
+	memset(conn, 0, sizeof(*conn));
+	tfw_connection_init(conn);
+	conn->proto.type = ctype;
+	hm->conn = conn;
+	hm->stream = &conn->stream;
+
+	if (type == TFW_PARSER_BENCH_RESP) {
+		tfw_http_init_parser_resp((TfwHttpResp *)hm);
+		return hm;
+	}
+	tfw_http_init_parser_req((TfwHttpReq *)hm);
+	if (type == TFW_PARSER_BENCH_H2) {
+		TfwHttpReq *req = (TfwHttpReq *)hm;
+
+		if (!(req->pit.pool = __tfw_pool_new(0)))
+			goto err;
+		req->pit.parsed_hdr = &req->stream->parser.hdr;
+		__set_bit(TFW_HTTP_B_H2, req->flags);
+	}
+
+	return hm;
+err:
+	tfw_http_msg_free(hm);
+	return NULL;
+}
+
+/**
+ * Parse message @data of @len bytes by @frags fragments.
+ * @return the spent CPU cycles or 0 if the message can't be parsed.
+ */
+static cycles_t
+tfw_parser_bench_parse(TfwParserBench *b, int type, TfwHttpMsg *hm,
+		       unsigned char *data, size_t len, unsigned int frags)
+{
+	int r = TFW_BLOCK;
+	size_t off, n, step = DIV_ROUND_UP(len, frags);
+	unsigned int parsed;
+	cycles_t t, sum = 0;
+
+	for (off = 0; off < len; off += n) {
+		n = min(step, len - off);
+		parsed = 0;
+		t = get_cycles();
+		switch (type) {
+		case TFW_PARSER_BENCH_REQ:
+			r = tfw_http_parse_req(hm, data + off, n, &parsed);
+			break;
+		case TFW_PARSER_BENCH_RESP:
+			r = tfw_http_parse_resp(hm, data + off, n, &parsed);
+			break;
+		case TFW_PARSER_BENCH_H2:
+			r = tfw_hpack_decode(&b->hpack, data + off, n,
+					     (TfwHttpReq *)hm, &parsed);
+			break;
+		}
+		sum += get_cycles() - t;
+
+		if (parsed != n)
+			return 0;
+		if (off + n < len
+		    && (type == TFW_PARSER_BENCH_H2 ? r != T_OK
+						    : r != TFW_POSTPONE))
+			return 0;
+	}
+	/* HPACK header blocks are parsed completely on each fragment. */
+	if (r != (type == TFW_PARSER_BENCH_H2 ? T_OK : TFW_PASS))
+		return 0;
+
+	return sum;
+}
+
+/**
+ * Parse message @data of @len bytes, split into @frags fragments, @n times.
+ * @type is the message type: HTTP/1 request or response or a HPACK encoded
+ * header block of HTTP/2 request. HTTP/1 responses are paired with a GET
+ * request. The spent CPU cycles are returned in @cycles. Must be called from
+ * process context.
+ */
+int
+tfw_http_parse_bench_run(int type, unsigned char *data, size_t len,
+			 unsigned int frags, unsigned int n,
+			 unsigned long *cycles)
+{
+	int r = 0;
+	unsigned int i, end;
+	unsigned int parsed;
+	cycles_t t;
+	TfwHttpMsg *hm;
+	TfwParserBench *b;
+
+	if (type < 0 || type >= TFW_PARSER_BENCH_TYPES || !len || !frags
+	    || frags > len)
+		return -EINVAL;
+	if (!(b = kzalloc(sizeof(*b), GFP_KERNEL)))
+		return -ENOMEM;
+	if (type == TFW_PARSER_BENCH_H2
+	    && tfw_hpack_init(&b->hpack, HPACK_TABLE_DEF_SIZE))
+	{
+		kfree(b);
+		return -ENOMEM;
+	}
+	if (type == TFW_PARSER_BENCH_RESP) {
+		hm = tfw_parser_bench_msg(&b->conn_req, TFW_PARSER_BENCH_REQ,
+					  SLEN(tfw_parser_bench_req));
+		if (!(b->req = (TfwHttpReq *)hm)) {
+			r = -ENOMEM;
+			goto out;
+		}
+		kernel_fpu_begin();
+		r = tfw_http_parse_req(b->req,
+				       (unsigned char *)tfw_parser_bench_req,
+				       SLEN(tfw_parser_bench_req), &parsed);
+		kernel_fpu_end();
+		if (r != TFW_PASS) {
+			r = -EINVAL;
+			goto out;
+		}
+		r = 0;
+	}
+
+	*cycles = 0;
+	for (i = 0; i < n && !r; ) {
+		kernel_fpu_begin();
+		for (end = min(i + TFW_PARSER_BENCH_BATCH, n); i < end; ++i) {
+			if (!(hm = tfw_parser_bench_msg(&b->conn, type, len))) {
+				r = -ENOMEM;
+				break;
+			}
+			if (b->req)
+				tfw_http_msg_pair((TfwHttpResp *)hm, b->req);
+			t = tfw_parser_bench_parse(b, type, hm, data, len,
+						   frags);
+			tfw_http_msg_free(hm);
+			if (!t) {
+				T_WARN("Parser bench: cannot parse %.*s\n",
+				       (int)min_t(size_t, len, 200), data);
+				r = -EINVAL;
+				break;
+			}
+			*cycles += t;
+		}
+		kernel_fpu_end();
+		cond_resched();
+	}
+out:
+	tfw_http_msg_free((TfwHttpMsg *)b->req);
+	if (type == TFW_PARSER_BENCH_H2)
+		tfw_hpack_clean(&b->hpack);
+	kfree(b);
+
+	return r;
+}
+EXPORT_SYMBOL(tfw_http_parse_bench_run);
+#endif /* TFW_PARSER_BENCH */
@@ -23,9 +23,41 @@
 #include "str.h"
 #include "http_types.h"
 
+#define TFW_HHTBL_IDX_SZ		32
+/* Keep at least 1/4 of the index slots empty to stop the probing. */
+#define TFW_HHTBL_IDX_MAX		(TFW_HHTBL_IDX_SZ * 3 / 4)
+#define TFW_HHTBL_IDX_TAG(h)		((h) >> 16)
+
+/**
+ * Slot of the raw header names index, @id is zero for an empty slot.
+ *
+ * @id		- header table index of the header;
+ * @tag		- the upper half of the header name hash;
+ */
 typedef struct {
-	unsigned int	size;	/* number of elements in the table */
+	unsigned short	id;
+	unsigned short	tag;
+} TfwHttpHdrIdx;
+
+/**
+ * HTTP message header table.
+ *
+ * The raw headers from TFW_HTTP_HDR_RAW up to @idx_off are indexed by their
+ * names hashes in the open addressing @idx, see tfw_http_hdr_name_hash().
+ * The rest of the raw headers up to @off aren't indexed yet and are looked
+ * up one by one.
+ *
+ * @size	- number of elements in the table;
+ * @off		- the first unused table element;
+ * @idx_off	- the first raw header, which isn't indexed;
+ * @idx		- index of the raw header names;
+ * @tbl		- the headers;
+ */
+typedef struct {
+	unsigned int	size;
 	unsigned int	off;
+	unsigned int	idx_off;
+	TfwHttpHdrIdx	idx[TFW_HHTBL_IDX_SZ];
 	TfwStr		tbl[0];
 } TfwHttpHdrTbl;
 
@@ -34,6 +66,26 @@ typedef struct {
 					 + sizeof(TfwStr) * (s))
 #define TFW_HHTBL_SZ(o)			TFW_HHTBL_EXACTSZ(__HHTBL_SZ(o))
 
+#define TFW_HTTP_HDR_PEND_N		16
+#define TFW_HTTP_HDR_PEND_SZ		512
+
+/**
+ * Headers added to the end of a message header, but not written to the skbs
+ * yet, see tfw_http_msg_hdrs_defer(). The header table items of the headers
+ * point to @data until the headers are written with one skb fragmentation.
+ *
+ * @n		- number of the pending headers;
+ * @len		- length of the pending headers including EOLs;
+ * @hid		- header table indexes of the pending headers;
+ * @data	- the pending headers data;
+ */
+typedef struct {
+	unsigned int	n;
+	unsigned int	len;
+	unsigned int	hid[TFW_HTTP_HDR_PEND_N];
+	char		data[TFW_HTTP_HDR_PEND_SZ];
+} TfwHttpHdrPend;
+
 /** Maximum of hop-by-hop tokens listed in Connection header. */
 #define TFW_HBH_TOKENS_MAX		16
 
@@ -122,6 +174,20 @@ typedef struct {
 	TfwHttpHbhHdrs			hbh_parser;
 } TfwHttpParser;
 
+/*
+ * Features which need full parsing of request headers used by the features
+ * only, see tfw_http_parse_need().
+ */
+enum {
+	/* Cache-Control, If-Modified-Since and Pragma. */
+	TFW_HTTP_PARSE_CACHE,
+	/* Cookie split to name and value chunks, Accept. */
+	TFW_HTTP_PARSE_STICKY,
+	_TFW_HTTP_PARSE_NUM
+};
+
+void tfw_http_parse_need(unsigned int feat, bool need);
+
 void tfw_http_init_parser_req(TfwHttpReq *req);
 void tfw_http_init_parser_resp(TfwHttpResp *resp);
 
@@ -138,4 +204,18 @@ int tfw_http_parse_resp(void *resp_data, unsigned char *data, size_t len,
 int tfw_http_parse_terminate(TfwHttpMsg *hm);
 bool tfw_http_parse_is_done(TfwHttpMsg *hm);
 
+#ifdef TFW_PARSER_BENCH
+/* Message types measured by the parser benchmark. */
+enum {
+	TFW_PARSER_BENCH_REQ,
+	TFW_PARSER_BENCH_RESP,
+	TFW_PARSER_BENCH_H2,
+	TFW_PARSER_BENCH_TYPES
+};
+
+int tfw_http_parse_bench_run(int type, unsigned char *data, size_t len,
+			     unsigned int frags, unsigned int n,
+			     unsigned long *cycles);
+#endif
+
 #endif /* __TFW_HTTP_PARSER_H__ */
@@ -0,0 +1,234 @@
+/**
+ *		Tempesta FW
+ *
+ * Copyright (C) 2020 Tempesta Technologies, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#ifndef __TFW_HTTP_PARSER_METH_H__
+#define __TFW_HTTP_PARSER_METH_H__
+
+/**
+ * HTTP/1 request method state machine of tfw_http_parse_req():
+ *
+ * TFW_HTTP_METH_DATA_MIN		- number of bytes read by the 4-byte
+ *					  switch;
+ * __FSM_REQ_METH_WORD_SWITCH()		- switch over the first 4 bytes of
+ *					  the rare methods, @__fsm_n must be
+ *					  set to 4 and __MATCH_METH() must be
+ *					  defined;
+ * __FSM_REQ_METH_1CHAR_SWITCH()	- switch over the first character of
+ *					  a fragmented method;
+ * __FSM_REQ_METH_STATES()		- 1-character states of fragmented
+ *					  methods named Req_Meth<prefix>, the
+ *					  4-byte switch falls to them on
+ *					  a mismatch.
+ */
+
+/*
+ * All the below is generated by fsmgen/fsmgen.c. DO NOT EDIT IT BY HANDS!
+ * If you need to change the methods, then update the generation program,
+ * remove all the below the comment and run:
+ *
+ *	$ cd fsmgen && make && ./fsmgen >> ../http_parser_meth.h
+ */
+
+#define TFW_HTTP_METH_DATA_MIN	9
+
+#define __FSM_REQ_METH_WORD_SWITCH()					\
+do {									\
+	switch (PI(p)) {						\
+	case TFW_CHAR4_INT('H', 'E', 'A', 'D'):				\
+		__MATCH_METH(HEAD, 0);					\
+	case TFW_CHAR4_INT('P', 'A', 'T', 'C'):				\
+		if (likely(*(p + 4) == 'H'))				\
+			__MATCH_METH(PATCH, 1);				\
+		__FSM_MOVE_nofixup_n(Req_MethPatc, 4);			\
+	case TFW_CHAR4_INT('P', 'R', 'O', 'P'):				\
+		if (likely(PI(p + 4)					\
+		    == TFW_CHAR4_INT('F', 'I', 'N', 'D')))		\
+			__MATCH_METH(PROPFIND, 4);			\
+		if (likely(PI(p + 4)					\
+		    == TFW_CHAR4_INT('P', 'A', 'T', 'C')		\
+		    && *(p + 8) == 'H'))				\
+			__MATCH_METH(PROPPATCH, 5);			\
+		__FSM_MOVE_nofixup_n(Req_MethProp, 4);			\
+	case TFW_CHAR4_INT('P', 'U', 'R', 'G'):				\
+		if (likely(*(p + 4) == 'E'))				\
+			__MATCH_METH(PURGE, 1);				\
+		__FSM_MOVE_nofixup_n(Req_MethPurg, 4);			\
+	case TFW_CHAR4_INT('P', 'U', 'T', ' '):				\
+		req->method = TFW_HTTP_METH_PUT;			\
+		__FSM_MOVE_nofixup_n(Req_Uri, 4);			\
+	case TFW_CHAR4_INT('C', 'O', 'P', 'Y'):				\
+		__MATCH_METH(COPY, 0);					\
+	case TFW_CHAR4_INT('D', 'E', 'L', 'E'):				\
+		if (likely(*(p + 4) == 'T'				\
+		    && *(p + 5) == 'E'))				\
+			__MATCH_METH(DELETE, 2);			\
+		__FSM_MOVE_nofixup_n(Req_MethDele, 4);			\
+	case TFW_CHAR4_INT('L', 'O', 'C', 'K'):				\
+		__MATCH_METH(LOCK, 0);					\
+	case TFW_CHAR4_INT('M', 'K', 'C', 'O'):				\
+		if (likely(*(p + 4) == 'L'))				\
+			__MATCH_METH(MKCOL, 1);				\
+		__FSM_MOVE_nofixup_n(Req_MethMkco, 4);			\
+	case TFW_CHAR4_INT('M', 'O', 'V', 'E'):				\
+		__MATCH_METH(MOVE, 0);					\
+	case TFW_CHAR4_INT('O', 'P', 'T', 'I'):				\
+		if (likely(PI(p + 4)					\
+		    == TFW_CHAR4_INT('O', 'N', 'S', ' ')))		\
+		{							\
+			req->method = TFW_HTTP_METH_OPTIONS;		\
+			__FSM_MOVE_nofixup_n(Req_Uri, 8);		\
+		}							\
+		__FSM_MOVE_nofixup_n(Req_MethOpti, 4);			\
+	case TFW_CHAR4_INT('T', 'R', 'A', 'C'):				\
+		if (likely(*(p + 4) == 'E'))				\
+			__MATCH_METH(TRACE, 1);				\
+		__FSM_MOVE_nofixup_n(Req_MethTrac, 4);			\
+	case TFW_CHAR4_INT('U', 'N', 'L', 'O'):				\
+		if (likely(*(p + 4) == 'C'				\
+		    && *(p + 5) == 'K'))				\
+			__MATCH_METH(UNLOCK, 2);			\
+		__FSM_MOVE_nofixup_n(Req_MethUnlo, 4);			\
+	default:							\
+		__FSM_MOVE_nofixup(Req_MethodUnknown);			\
+	}								\
+} while (0)
+
+#define __FSM_REQ_METH_1CHAR_SWITCH()					\
+do {									\
+	switch (c) {							\
+	case 'G':							\
+		__FSM_MOVE_nofixup(Req_MethG);				\
+	case 'H':							\
+		__FSM_MOVE_nofixup(Req_MethH);				\
+	case 'P':							\
+		__FSM_MOVE_nofixup(Req_MethP);				\
+	case 'C':							\
+		__FSM_MOVE_nofixup(Req_MethC);				\
+	case 'D':							\
+		__FSM_MOVE_nofixup(Req_MethD);				\
+	case 'L':							\
+		__FSM_MOVE_nofixup(Req_MethL);				\
+	case 'M':							\
+		__FSM_MOVE_nofixup(Req_MethM);				\
+	case 'O':							\
+		__FSM_MOVE_nofixup(Req_MethO);				\
+	case 'T':							\
+		__FSM_MOVE_nofixup(Req_MethT);				\
+	case 'U':							\
+		__FSM_MOVE_nofixup(Req_MethU);				\
+	}								\
+	__FSM_MOVE_nofixup(Req_MethodUnknown);				\
+} while (0)
+
+#define __FSM_REQ_METH_STATES()						\
+__FSM_METH_MOVE(Req_MethG, 'E', Req_MethGe);				\
+__FSM_METH_MOVE_finish(Req_MethGe, 'T', TFW_HTTP_METH_GET);		\
+__FSM_METH_MOVE(Req_MethH, 'E', Req_MethHe);				\
+__FSM_METH_MOVE(Req_MethHe, 'A', Req_MethHea);				\
+__FSM_METH_MOVE_finish(Req_MethHea, 'D', TFW_HTTP_METH_HEAD);		\
+__FSM_STATE(Req_MethP, cold) {						\
+	switch (c) {							\
+	case 'O':							\
+		__FSM_MOVE_nofixup(Req_MethPo);				\
+	case 'A':							\
+		__FSM_MOVE_nofixup(Req_MethPa);				\
+	case 'R':							\
+		__FSM_MOVE_nofixup(Req_MethPr);				\
+	case 'U':							\
+		__FSM_MOVE_nofixup(Req_MethPu);				\
+	}								\
+	__FSM_MOVE_nofixup(Req_MethodUnknown);				\
+}									\
+__FSM_METH_MOVE(Req_MethPo, 'S', Req_MethPos);				\
+__FSM_METH_MOVE_finish(Req_MethPos, 'T', TFW_HTTP_METH_POST);		\
+__FSM_METH_MOVE(Req_MethPa, 'T', Req_MethPat);				\
+__FSM_METH_MOVE(Req_MethPat, 'C', Req_MethPatc);			\
+__FSM_METH_MOVE_finish(Req_MethPatc, 'H', TFW_HTTP_METH_PATCH);		\
+__FSM_METH_MOVE(Req_MethPr, 'O', Req_MethPro);				\
+__FSM_METH_MOVE(Req_MethPro, 'P', Req_MethProp);			\
+__FSM_STATE(Req_MethProp, cold) {					\
+	switch (c) {							\
+	case 'F':							\
+		__FSM_MOVE_nofixup(Req_MethPropf);			\
+	case 'P':							\
+		__FSM_MOVE_nofixup(Req_MethPropp);			\
+	}								\
+	__FSM_MOVE_nofixup(Req_MethodUnknown);				\
+}									\
+__FSM_METH_MOVE(Req_MethPropf, 'I', Req_MethPropfi);			\
+__FSM_METH_MOVE(Req_MethPropfi, 'N', Req_MethPropfin);			\
+__FSM_METH_MOVE_finish(Req_MethPropfin, 'D', TFW_HTTP_METH_PROPFIND);	\
+__FSM_METH_MOVE(Req_MethPropp, 'A', Req_MethProppa);			\
+__FSM_METH_MOVE(Req_MethProppa, 'T', Req_MethProppat);			\
+__FSM_METH_MOVE(Req_MethProppat, 'C', Req_MethProppatc);		\
+__FSM_METH_MOVE_finish(Req_MethProppatc, 'H', TFW_HTTP_METH_PROPPATCH);	\
+__FSM_STATE(Req_MethPu, cold) {						\
+	switch (c) {							\
+	case 'R':							\
+		__FSM_MOVE_nofixup(Req_MethPur);			\
+	case 'T':							\
+		req->method = TFW_HTTP_METH_PUT;			\
+		__FSM_MOVE_nofixup(Req_MUSpace);			\
+	}								\
+	__FSM_MOVE_nofixup(Req_MethodUnknown);				\
+}									\
+__FSM_METH_MOVE(Req_MethPur, 'G', Req_MethPurg);			\
+__FSM_METH_MOVE_finish(Req_MethPurg, 'E', TFW_HTTP_METH_PURGE);		\
+__FSM_METH_MOVE(Req_MethC, 'O', Req_MethCo);				\
+__FSM_METH_MOVE(Req_MethCo, 'P', Req_MethCop);				\
+__FSM_METH_MOVE_finish(Req_MethCop, 'Y', TFW_HTTP_METH_COPY);		\
+__FSM_METH_MOVE(Req_MethD, 'E', Req_MethDe);				\
+__FSM_METH_MOVE(Req_MethDe, 'L', Req_MethDel);				\
+__FSM_METH_MOVE(Req_MethDel, 'E', Req_MethDele);			\
+__FSM_METH_MOVE(Req_MethDele, 'T', Req_MethDelet);			\
+__FSM_METH_MOVE_finish(Req_MethDelet, 'E', TFW_HTTP_METH_DELETE);	\
+__FSM_METH_MOVE(Req_MethL, 'O', Req_MethLo);				\
+__FSM_METH_MOVE(Req_MethLo, 'C', Req_MethLoc);				\
+__FSM_METH_MOVE_finish(Req_MethLoc, 'K', TFW_HTTP_METH_LOCK);		\
+__FSM_STATE(Req_MethM, cold) {						\
+	switch (c) {							\
+	case 'K':							\
+		__FSM_MOVE_nofixup(Req_MethMk);				\
+	case 'O':							\
+		__FSM_MOVE_nofixup(Req_MethMo);				\
+	}								\
+	__FSM_MOVE_nofixup(Req_MethodUnknown);				\
+}									\
+__FSM_METH_MOVE(Req_MethMk, 'C', Req_MethMkc);				\
+__FSM_METH_MOVE(Req_MethMkc, 'O', Req_MethMkco);			\
+__FSM_METH_MOVE_finish(Req_MethMkco, 'L', TFW_HTTP_METH_MKCOL);		\
+__FSM_METH_MOVE(Req_MethMo, 'V', Req_MethMov);				\
+__FSM_METH_MOVE_finish(Req_MethMov, 'E', TFW_HTTP_METH_MOVE);		\
+__FSM_METH_MOVE(Req_MethO, 'P', Req_MethOp);				\
+__FSM_METH_MOVE(Req_MethOp, 'T', Req_MethOpt);				\
+__FSM_METH_MOVE(Req_MethOpt, 'I', Req_MethOpti);			\
+__FSM_METH_MOVE(Req_MethOpti, 'O', Req_MethOptio);			\
+__FSM_METH_MOVE(Req_MethOptio, 'N', Req_MethOption);			\
+__FSM_METH_MOVE_finish(Req_MethOption, 'S', TFW_HTTP_METH_OPTIONS);	\
+__FSM_METH_MOVE(Req_MethT, 'R', Req_MethTr);				\
+__FSM_METH_MOVE(Req_MethTr, 'A', Req_MethTra);				\
+__FSM_METH_MOVE(Req_MethTra, 'C', Req_MethTrac);			\
+__FSM_METH_MOVE_finish(Req_MethTrac, 'E', TFW_HTTP_METH_TRACE);		\
+__FSM_METH_MOVE(Req_MethU, 'N', Req_MethUn);				\
+__FSM_METH_MOVE(Req_MethUn, 'L', Req_MethUnl);				\
+__FSM_METH_MOVE(Req_MethUnl, 'O', Req_MethUnlo);			\
+__FSM_METH_MOVE(Req_MethUnlo, 'C', Req_MethUnloc);			\
+__FSM_METH_MOVE_finish(Req_MethUnloc, 'K', TFW_HTTP_METH_UNLOCK);
+
+#endif /* __TFW_HTTP_PARSER_METH_H__ */
@@ -8,15 +8,25 @@
  * The same hash value is always mapped to the same server, therefore HTTP
  * requests with the same Host/URI are always scheduled to the same server.
  *
- * Also, the scheduler utilizes the Rendezvous hashing (Highest Random Weight)
- * method that allows to stick every HTTP message to its server, preserving
- * this mapping when servers are added/deleted and go online/offline.
+ * The scheduler uses Maglev hashing: each server connection has its own
+ * permutation of the lookup table entries, which is derived from the server
+ * address, and the connections fill the table taking turns in the order of
+ * their permutations. A request hash is mapped to a connection with a single
+ * table lookup, and adding or removing a server moves only a small part of
+ * the table entries between the connections, so most of the requests still
+ * go to their home servers.
  *
- * The scheduler hashes not only HTTP requests, but also servers (TfwServer
- * objects), and for each incoming HTTP request it searches for a best match
- * among all server hashes. Each Host/URI hash has only one best matching
- * TfwSrver hash which is chosen, and thus any request always goes to its home
- * server unless it is offline.
+ * If the home connection of a request is dead or overfilled, then the next
+ * table entries are probed, so the load of a failed server is spread among
+ * the rest of the servers. Optionally the scheduler bounds connections load:
+ * a request is also spilled to the next entry if its home connection has
+ * more requests in flight than TFW_HASH_LOAD_FACTOR percents of the average
+ * connection load in the group. That keeps the cache affinity on the backends
+ * and still doesn't let a hot key to overload a server.
+ *
+ * A server in slow start takes only the requests which hash falls into its
+ * current share, so the same resources move to the server as the share
+ * grows and other requests stay at their spill servers meanwhile.
  *
  * Copyright (C) 2014 NatSys Lab. (info@natsys-lab.com).
  * Copyright (C) 2015-2018 Tempesta Technologies, Inc.
@@ -36,6 +46,7 @@
  * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
  */
 #include <linux/hash.h>
+#include <linux/mm.h>
 #include <linux/module.h>
 
 #include "lib/hash.h"
@@ -49,21 +60,58 @@ MODULE_DESCRIPTION("Tempesta hash-based scheduler");
 MODULE_VERSION("0.4.3");
 MODULE_LICENSE("GPL");
 
-typedef struct {
-	unsigned long		hash;
-	TfwSrvConn		*conn;
-} TfwHashConn;
+/* Maximum load of a connection in percents of the average one. */
+#define TFW_HASH_LOAD_FACTOR	125
+/* Number of lookup table entries to probe before a linear scan. */
+#define TFW_HASH_PROBE_N	16
+/* Desired lookup table entries per connection. */
+#define TFW_HASH_TBL_MUL	100
+#define TFW_HASH_TBL_FREE	UINT_MAX
+#define TFW_SCHED_HASH_INTVL	(HZ / 20)	/* The timer periodicity. */
 
+/**
+ * Connections list with Maglev lookup table.
+ *
+ * @rcu		- RCU control structure;
+ * @conn_n	- number of connections in @conns;
+ * @tbl_n	- number of the lookup table entries, a prime number;
+ * @tbl		- lookup table of indexes in @conns;
+ * @conns	- the connections;
+ */
 typedef struct {
 	struct rcu_head		rcu;
 	size_t			conn_n;
-	TfwHashConn		conns[0];
+	size_t			tbl_n;
+	unsigned int		*tbl;
+	TfwSrvConn		*conns[0];
 } TfwHashConnList;
 
+/**
+ * Server group data.
+ *
+ * @rcu		- RCU control structure;
+ * @cap		- maximum number of requests in flight for a connection if
+ *		  the load is bounded, zero otherwise;
+ * @rearm	- indicates if the timer can be re-armed;
+ * @timer	- periodic timer to update @cap;
+ * @cl		- all the connections of the group;
+ */
 typedef struct {
-	TfwServer		*srv;
+	struct rcu_head		rcu;
+	unsigned int		cap;
+	atomic_t		rearm;
+	struct timer_list	timer;
 	TfwHashConnList		*cl;
-} TfwHashSrvConnList;
+} TfwHashGrp;
+
+/*
+ * Prime lookup table sizes. The table size must be a prime number to make
+ * each connection permutation to visit all the table entries.
+ */
+static const unsigned int tfw_hash_tbl_primes[] = {
+	251, 509, 1021, 2039, 4093, 8191, 16381, 32749, 65521, 131071,
+	262139, 524287, 1048573
+};
 
 /* Same as hash_64_generic, but return 64-bit value. */
 static __always_inline unsigned long
@@ -99,113 +147,76 @@ __calc_srv_hash(TfwServer *srv)
 	return __hash_64(hash);
 }
 
-/**
- * Binary search for connection with hash closest to @hash value in connection
- * list @cl. Most likely, that exact @hash value cannot be found.
- *
- * Returns index of closest element in array.
- */
-static ssize_t
-__bsearch(const unsigned long hash, TfwHashConnList *cl)
-{
-	ssize_t start = 0, end = (ssize_t)cl->conn_n - 1, mid = 0;
-	unsigned long mid_hash;
-
-	while (start < end) {
-		mid = start + (end - start) / 2;
-
-		mid_hash = cl->conns[mid].hash;
-		if (hash < mid_hash)
-			end = mid;
-		else if (hash > mid_hash)
-			start = mid + 1;
-		else
-			return mid; /* an unexpected outcome. */
-	}
-	/*
-	 * Most expected outcome: exact @hash not found, @start points to the
-	 * closest item.
-	 */
-	return start;
-}
-
 static inline int
 __is_conn_suitable(TfwSrvConn *conn, bool hmonitor)
 {
 	return (hmonitor || !tfw_srv_suspended((TfwServer *)conn->peer))
 		&& !tfw_srv_conn_restricted(conn)
+		&& !tfw_srv_conn_spare(conn)
 		&& !tfw_srv_conn_busy(conn)
 		&& !tfw_srv_conn_queue_full(conn)
 		&& tfw_srv_conn_get_if_live(conn);
 }
 
+static inline bool
+__is_conn_admitted(TfwSrvConn *conn, unsigned int ss_key)
+{
+	return tfw_srv_slow_start_admit((TfwServer *)conn->peer, ss_key);
+}
+
 /**
  * Find an appropriate server connection for the HTTP request @msg.
  * The server is chosen based on the hash value of URI/Host fields of the @msg,
  * so multiple requests to the same resource are mapped to the same server.
  *
- * Highest Random Weight hashing method is involved: for each message we
- * calculate randomized weights as follows: (msg_hash ^ srv_conn_hash),
- * and pick a server/connection with the highest weight.
- * That sticks messages with certain Host/URI to certain server connection.
- * A server always receives requests with some URI/Host values bound to it,
- * and that holds even if some servers go offline/online.
- *
- * The drawbacks of HRW hashing are:
- *  - A weak hash function adds unfairness to the load balancing.
- *    There may be a case when a server pulls all load from all other servers.
- *    Although it is quite improbable, such condition is quite stable:
- *    it cannot be fixed by adding/removing servers and restarting Tempesta FW.
- *  - For every HTTP request, we have to scan the list of all servers to find
- *    a matching one with the highest weight. That adds some overhead.
+ * The home connection of the request is taken from the lookup table. If it
+ * can't be used or has more than @cap requests in flight, then the request is
+ * spilled to the connections of the next lookup table entries and finally to
+ * the connections following the home one. The spill order is the same for
+ * the same hash, so the requests keep their affinity while the home
+ * connection is overloaded. If @ss is true, then connections of servers in
+ * slow start are also skipped when the request is out of the server share.
  */
-static inline TfwSrvConn *
-__find_best_conn(TfwMsg *msg, TfwHashConnList *cl)
+static TfwSrvConn *
+__find_best_conn(TfwMsg *msg, TfwHashConnList *cl, unsigned int cap, bool ss)
 {
-	ssize_t l_idx, r_idx, idx;
+	size_t i, hidx, tidx;
 	TfwSrvConn *conn;
 	bool hmonitor = test_bit(TFW_HTTP_B_HMONITOR,
 				 ((TfwHttpReq *)msg)->flags);
 	unsigned long msg_hash = tfw_http_req_key_calc((TfwHttpReq *)msg);
-	unsigned long best_hash = (~0UL ^ msg_hash);
+	unsigned int ss_key = hash_64(msg_hash, TFW_SRV_SS_SHIFT);
 
 	if (unlikely(!cl->conn_n))
 		return NULL;
 
-	/*
-	 * Find a connection with hash as close to @best_hash as possible.
-	 * Value of (msg_hash ^ srv_conn_hash) will be biggest for that
-	 * connection.
-	 */
-	idx = __bsearch(best_hash, cl);
-	conn = cl->conns[idx].conn;
-	if (likely(__is_conn_suitable(conn, hmonitor)))
-		return conn;
+	tidx = msg_hash % cl->tbl_n;
+	hidx = cl->tbl[tidx];
+	for (i = 0; i < TFW_HASH_PROBE_N; ++i) {
+		conn = cl->conns[cl->tbl[tidx]];
+		if ((!cap || READ_ONCE(conn->qsize) < cap)
+		    && (!ss || __is_conn_admitted(conn, ss_key))
+		    && likely(__is_conn_suitable(conn, hmonitor)))
+			return conn;
+		if (++tidx == cl->tbl_n)
+			tidx = 0;
+	}
 
-	/*
-	 * The best connection is dead or overfilled. Take the nearest live
-	 * neighbour.
-	*/
-	r_idx = idx + 1;
-	l_idx = idx - 1;
-	while (l_idx >= 0 || r_idx < (ssize_t)cl->conn_n) {
-		unsigned long l_diff = (l_idx >= 0)
-				? (best_hash - cl->conns[l_idx].hash)
-				: ULONG_MAX;
-		unsigned long r_diff = (r_idx < (ssize_t)cl->conn_n)
-				? (cl->conns[r_idx].hash - best_hash)
-				: ULONG_MAX;
-		ssize_t best_idx = (l_diff <= r_diff) ? l_idx : r_idx;
-
-		conn = cl->conns[best_idx].conn;
-		if (likely(__is_conn_suitable(conn, hmonitor)))
+	for (i = 1; i <= cl->conn_n; ++i) {
+		conn = cl->conns[(hidx + i) % cl->conn_n];
+		if ((!cap || READ_ONCE(conn->qsize) < cap)
+		    && (!ss || __is_conn_admitted(conn, ss_key))
+		    && __is_conn_suitable(conn, hmonitor))
 			return conn;
+	}
 
-		if (l_diff <= r_diff)
-			--l_idx;
-		else
-			++r_idx;
-	};
+	/*
+	 * All the connections are overloaded or belong to servers in slow
+	 * start, the load bound was computed before a load spike, so just
+	 * find a live connection.
+	 */
+	if (cap || ss)
+		return __find_best_conn(msg, cl, 0, false);
 
 	return NULL;
 }
@@ -213,14 +224,15 @@ __find_best_conn(TfwMsg *msg, TfwHashConnList *cl)
 static TfwSrvConn *
 tfw_sched_hash_get_sg_conn(TfwMsg *msg, TfwSrvGroup *sg)
 {
-	TfwHashConnList *cl;
+	TfwHashGrp *hg;
 	TfwSrvConn *srv_conn = NULL;
 
 	rcu_read_lock_bh();
-	cl = rcu_dereference_bh(sg->sched_data);
+	hg = rcu_dereference_bh(sg->sched_data);
 
-	if (likely(cl))
-		srv_conn = __find_best_conn(msg, cl);
+	if (likely(hg))
+		srv_conn = __find_best_conn(msg, hg->cl, READ_ONCE(hg->cap),
+					    true);
 
 	rcu_read_unlock_bh();
 
@@ -229,7 +241,7 @@ tfw_sched_hash_get_sg_conn(TfwMsg *msg, TfwSrvGroup *sg)
 
 /**
  * Same as @tfw_sched_hash_get_sg_conn(), but schedule for a specific server
- * in a group.
+ * in a group. The load isn't bounded here since the server is already chosen.
  */
 static TfwSrvConn *
 tfw_sched_hash_get_srv_conn(TfwMsg *msg, TfwServer *srv)
@@ -241,192 +253,267 @@ tfw_sched_hash_get_srv_conn(TfwMsg *msg, TfwServer *srv)
 	cl = rcu_dereference_bh(srv->sched_data);
 
 	if (likely(cl))
-		srv_conn = __find_best_conn(msg, cl);
+		srv_conn = __find_best_conn(msg, cl, 0, false);
 
 	rcu_read_unlock_bh();
 
 	return srv_conn;
 }
 
+/**
+ * Compute the load bound of a connection from the average load in the group.
+ * A request is counted as well, so there is always a room for it in some
+ * connection.
+ */
 static void
-tfw_sched_hash_cleanup_rcu_cb(struct rcu_head *rcu)
+tfw_sched_hash_tmfn(unsigned long tmfn_data)
 {
-	TfwHashConnList *cl = container_of(rcu, TfwHashConnList, rcu);
-	kfree(cl);
+	size_t i;
+	unsigned long load = 0;
+	TfwHashGrp *hg = (TfwHashGrp *)tmfn_data;
+	TfwHashConnList *cl = hg->cl;
+
+	for (i = 0; i < cl->conn_n; ++i)
+		load += READ_ONCE(cl->conns[i]->qsize);
+	WRITE_ONCE(hg->cap, DIV_ROUND_UP(TFW_HASH_LOAD_FACTOR * (load + 1),
+					 100 * cl->conn_n));
+
+	smp_mb();
+	if (atomic_read(&hg->rearm))
+		mod_timer(&hg->timer, jiffies + TFW_SCHED_HASH_INTVL);
 }
 
-static void
-tfw_sched_hash_del_grp(TfwSrvGroup *sg)
+/**
+ * Fill the Maglev lookup table: the connections take turns to occupy the
+ * next free table entry in the order of their permutations. A permutation is
+ * defined by @offset and @skip derived from the connection hash.
+ */
+static int
+__fill_tbl(TfwHashConnList *cl, unsigned long *hashes)
 {
-	TfwServer *srv;
-	TfwHashConnList *cl = rcu_dereference_bh_check(sg->sched_data, 1);
+	size_t i, c, filled = 0;
+	unsigned long *next;
 
-	RCU_INIT_POINTER(sg->sched_data, NULL);
-	list_for_each_entry(srv, &sg->srv_list, list) {
-		WARN_ON_ONCE(rcu_dereference_bh_check(srv->sched_data, 1)
-			     && !cl);
-		RCU_INIT_POINTER(srv->sched_data, NULL);
+	if (unlikely(!cl->conn_n))
+		return 0;
+	if (!(next = kvzalloc(sizeof(unsigned long) * cl->conn_n, GFP_KERNEL)))
+		return -ENOMEM;
+
+	memset(cl->tbl, 0xff, sizeof(unsigned int) * cl->tbl_n);
+	while (1) {
+		for (i = 0; i < cl->conn_n; ++i) {
+			unsigned long offset = hashes[i] % cl->tbl_n;
+			unsigned long skip = (hashes[i] >> 32) % (cl->tbl_n - 1)
+					     + 1;
+			do {
+				c = (offset + next[i] * skip) % cl->tbl_n;
+				++next[i];
+			} while (cl->tbl[c] != TFW_HASH_TBL_FREE);
+
+			cl->tbl[c] = i;
+			if (++filled == cl->tbl_n)
+				goto done;
+		}
 	}
-	if (!cl)
-		return;
+done:
+	kvfree(next);
 
-	call_rcu_bh(&cl->rcu, tfw_sched_hash_cleanup_rcu_cb);
+	return 0;
 }
 
-static int
-__add_conn(TfwHashConnList *cl, TfwSrvConn *conn, unsigned long hash)
+/**
+ * Allocate a connections list for @conn_n connections with a lookup table of
+ * a prime size, which is large enough to evenly distribute the load among
+ * the connections.
+ */
+static TfwHashConnList *
+__alloc_conn_list(size_t conn_n)
 {
-	ssize_t idx;
-	TfwHashConn new_hcon = {hash, conn};
+	size_t i, tbl_n;
+	TfwHashConnList *cl;
 
-	/* @cl is empty. */
-	if (unlikely(!cl->conn_n)) {
-		cl->conns[0] = new_hcon;
-		++cl->conn_n;
+	for (i = 0; i < ARRAY_SIZE(tfw_hash_tbl_primes) - 1; ++i)
+		if (tfw_hash_tbl_primes[i] >= conn_n * TFW_HASH_TBL_MUL)
+			break;
+	tbl_n = tfw_hash_tbl_primes[i];
 
-		return 0;
-	}
-
-	idx = __bsearch(hash, cl);
-	if (cl->conns[idx].hash == hash)
-		return -EEXIST;
+	cl = kvzalloc(sizeof(TfwHashConnList) + sizeof(TfwSrvConn *) * conn_n
+		      + sizeof(unsigned int) * tbl_n, GFP_KERNEL);
+	if (!cl)
+		return NULL;
+	cl->tbl_n = tbl_n;
+	cl->tbl = (unsigned int *)&cl->conns[conn_n];
 
-	/* Need to insert connection before or after found index. */
-	if ((hash > cl->conns[idx].hash) && (idx != (ssize_t)cl->conn_n))
-		++idx;
+	return cl;
+}
 
-	if ((size_t)idx != cl->conn_n)
-		memmove(&cl->conns[idx+1], &cl->conns[idx],
-			sizeof(TfwHashConn) * (cl->conn_n - (size_t)idx));
+/**
+ * Add all connections of @srv to @cl. A connection hash depends only on the
+ * server address and the connection position in the server, so the lookup
+ * table is the same for the same set of servers.
+ */
+static void
+__add_srv_conns(TfwHashConnList *cl, unsigned long *hashes, TfwServer *srv)
+{
+	size_t j = 0;
+	TfwSrvConn *conn;
+	unsigned long srv_hash = __calc_srv_hash(srv);
 
-	cl->conns[idx] = new_hcon;
-	++cl->conn_n;
+	list_for_each_entry(conn, &srv->conn_list, list) {
+		hashes[cl->conn_n] = __hash_64(srv_hash ^ __hash_64(++j));
+		cl->conns[cl->conn_n++] = conn;
+	}
+}
 
-	return 0;
+static void
+tfw_sched_hash_put_cl(struct rcu_head *rcu)
+{
+	TfwHashConnList *cl = container_of(rcu, TfwHashConnList, rcu);
+	kvfree(cl);
 }
 
 /**
- * Fill per-server sched_data according to sched_data of the entire server
- * group.
+ * Create a connection list of a single server @srv.
  */
-static void
-__fill_srv_lists(TfwHashConnList *cl, size_t srv_n, TfwHashSrvConnList *srv_cls)
+static TfwHashConnList *
+__create_srv_cl(TfwServer *srv)
 {
-	size_t i, j;
-
-	for (i = 0; i < srv_n; ++i) {
-		TfwServer *srv = srv_cls[i].srv;
-		TfwHashConnList *scl = srv_cls[i].cl;
-
-		for (j = 0; j < cl->conn_n; ++j) {
-			TfwHashConn *hconn = &cl->conns[j];
-			if ((TfwServer *)hconn->conn->peer == srv) {
-				scl->conns[scl->conn_n] = *hconn;
-				++scl->conn_n;
-			}
-		}
-		rcu_assign_pointer(srv->sched_data, scl);
+	TfwHashConnList *cl;
+	unsigned long *hashes;
+
+	if (!(hashes = kvzalloc(sizeof(unsigned long) * srv->conn_n,
+				GFP_KERNEL)))
+		return NULL;
+	if (!(cl = __alloc_conn_list(srv->conn_n)))
+		goto out;
+
+	__add_srv_conns(cl, hashes, srv);
+	if (WARN_ON_ONCE(cl->conn_n != srv->conn_n) || __fill_tbl(cl, hashes)) {
+		kvfree(cl);
+		cl = NULL;
 	}
+out:
+	kvfree(hashes);
+	return cl;
 }
 
 static void
-tfw_sched_hash_add_conns(TfwServer *srv, TfwHashConnList *cl, size_t *seed,
-			 size_t seed_inc)
+tfw_sched_hash_cleanup_rcu_cb(struct rcu_head *rcu)
 {
-	TfwSrvConn *conn;
-	unsigned long srv_hash = __calc_srv_hash(srv);
+	TfwHashGrp *hg = container_of(rcu, TfwHashGrp, rcu);
 
-	list_for_each_entry(conn, &srv->conn_list, list) {
-		unsigned long hash;
-		do {
-			hash = __hash_64(srv_hash ^ *seed);
-			*seed += seed_inc;
-		} while (__add_conn(cl, conn, hash));
+	kvfree(hg->cl);
+	kfree(hg);
+}
+
+static void
+tfw_sched_hash_del_grp(TfwSrvGroup *sg)
+{
+	TfwServer *srv;
+	TfwHashGrp *hg = rcu_dereference_bh_check(sg->sched_data, 1);
+
+	RCU_INIT_POINTER(sg->sched_data, NULL);
+	list_for_each_entry(srv, &sg->srv_list, list) {
+		TfwHashConnList *cl = rcu_dereference_bh_check(srv->sched_data,
+							       1);
+		WARN_ON_ONCE(cl && !hg);
+		RCU_INIT_POINTER(srv->sched_data, NULL);
+		if (cl)
+			call_rcu_bh(&cl->rcu, tfw_sched_hash_put_cl);
 	}
+	if (!hg)
+		return;
+
+	/* Make sure the timer doesn't re-arm itself. */
+	atomic_set(&hg->rearm, 0);
+	smp_mb__after_atomic();
+	del_timer_sync(&hg->timer);
+
+	call_rcu_bh(&hg->rcu, tfw_sched_hash_cleanup_rcu_cb);
 }
 
 static int
 tfw_sched_hash_add_grp(TfwSrvGroup *sg, void *data)
 {
-	size_t size, conn_n = 0, offset = 0, seed, seed_inc, i = 0;
+	size_t conn_n = 0, i = 0;
 	TfwServer *srv;
-	TfwHashConnList *cl;
-	TfwHashSrvConnList *srv_cls;
+	TfwHashGrp *hg;
+	TfwHashConnList **srv_cls;
+	unsigned long *hashes;
+	int r = -ENOMEM;
 
 	if (unlikely(!sg->srv_n || list_empty(&sg->srv_list)))
 		return -EINVAL;
 
-	seed = get_random_long();
-	seed_inc = get_random_int();
-
 	list_for_each_entry(srv, &sg->srv_list, list)
 		conn_n += srv->conn_n;
 
-	size = sizeof(TfwHashConnList) * (sg->srv_n + 1)
-			+ sizeof(TfwHashConn) * conn_n * 2;
-	if (!(cl = kzalloc(size, GFP_KERNEL)))
+	if (!(hg = kzalloc(sizeof(TfwHashGrp), GFP_KERNEL)))
 		return -ENOMEM;
-	if (!(srv_cls = kcalloc(sg->srv_n, sizeof(TfwHashSrvConnList),
+	if (!(srv_cls = kcalloc(sg->srv_n, sizeof(TfwHashConnList *),
 				GFP_KERNEL)))
-	{
-		kfree(cl);
-		return -ENOMEM;
+		goto err_srv_cls;
+	if (!(hashes = kvzalloc(sizeof(unsigned long) * conn_n, GFP_KERNEL)))
+		goto err_hashes;
+	if (!(hg->cl = __alloc_conn_list(conn_n)))
+		goto err;
+
+	list_for_each_entry(srv, &sg->srv_list, list) {
+		__add_srv_conns(hg->cl, hashes, srv);
+		if (!(srv_cls[i++] = __create_srv_cl(srv)))
+			goto err;
 	}
-	offset = sizeof(TfwHashConnList) + sizeof(TfwHashConn) * conn_n;
+	if (__fill_tbl(hg->cl, hashes))
+		goto err;
 
 	/*
 	 * The add_group() function can be called during live reconfiguration,
-	 * assign srv->sched_data after the data is fully prepared and valid.
+	 * assign sched_data after the data is fully prepared and valid.
 	 */
-	list_for_each_entry(srv, &sg->srv_list, list) {
-
-		srv_cls[i].srv = srv;
-		srv_cls[i].cl = (void *)cl + offset;
-		offset += sizeof(TfwHashConnList)
-				+ sizeof(TfwHashConn) * srv->conn_n;
-		++i;
-
-		tfw_sched_hash_add_conns(srv, cl, &seed, seed_inc);
+	i = 0;
+	list_for_each_entry(srv, &sg->srv_list, list)
+		rcu_assign_pointer(srv->sched_data, srv_cls[i++]);
+	rcu_assign_pointer(sg->sched_data, hg);
+
+	setup_timer(&hg->timer, tfw_sched_hash_tmfn, (unsigned long)hg);
+	if (sg->flags & TFW_SG_F_SCHED_HASH_BOUNDED) {
+		atomic_set(&hg->rearm, 1);
+		smp_mb__after_atomic();
+		mod_timer(&hg->timer, jiffies + TFW_SCHED_HASH_INTVL);
 	}
-	/* Create per-server connection lists. */
-	__fill_srv_lists(cl, sg->srv_n, srv_cls);
-
-	rcu_assign_pointer(sg->sched_data, cl);
+	r = 0;
+	goto out;
+err:
+	while (i)
+		kvfree(srv_cls[--i]);
+	kvfree(hg->cl);
+out:
+	kvfree(hashes);
+err_hashes:
 	kfree(srv_cls);
+err_srv_cls:
+	if (r)
+		kfree(hg);
 
-	return 0;
+	return r;
 }
 
 static int
 tfw_sched_hash_add_srv(TfwServer *srv)
 {
-	size_t size, seed, seed_inc = 0;
 	TfwHashConnList *cl = rcu_dereference_check(srv->sched_data, 1);
 
 	if (unlikely(cl))
 		return -EEXIST;
 
-	seed = get_random_long();
-	seed_inc = get_random_int();
-
-	size = sizeof(TfwHashConnList) + srv->conn_n * sizeof(TfwHashConn);
-	if (!(cl = kzalloc(size, GFP_KERNEL)))
+	if (!(cl = __create_srv_cl(srv)))
 		return -ENOMEM;
 
-	tfw_sched_hash_add_conns(srv, cl, &seed, seed_inc);
-
 	rcu_assign_pointer(srv->sched_data, cl);
 
 	return 0;
 }
 
-static void
-tfw_sched_hash_put_srv_data(struct rcu_head *rcu)
-{
-	TfwHashConnList *cl = container_of(rcu, TfwHashConnList, rcu);
-	kfree(cl);
-}
-
 static void
 tfw_sched_hash_del_srv(TfwServer *srv)
 {
@@ -434,7 +521,7 @@ tfw_sched_hash_del_srv(TfwServer *srv)
 
 	RCU_INIT_POINTER(srv->sched_data, NULL);
 	if (cl)
-		call_rcu_bh(&cl->rcu, tfw_sched_hash_put_srv_data);
+		call_rcu_bh(&cl->rcu, tfw_sched_hash_put_cl);
 }
 
 static TfwScheduler tfw_sched_hash = {
@@ -0,0 +1,481 @@
+/**
+ *		Tempesta FW
+ *
+ * Power of two choices HTTP request scheduler.
+ *
+ * For each request the scheduler takes two random servers of a group and
+ * forwards the request to the less loaded one. A server load is estimated
+ * as the number of requests in flight in the server connection, which is
+ * the next to be used, weighted by the server response time provided by
+ * APM. Comparing two random choices instead of scanning the whole group
+ * keeps the per-request cost O(1) and still avoids overloaded servers far
+ * better than a pure random choice, while the randomness prevents the herd
+ * behavior of "always the least loaded" schedulers.
+ *
+ * The response times are read from APM by a periodic timer, so the request
+ * path doesn't take any locks and reads only the data cached by the timer.
+ *
+ * Copyright (C) 2020 Tempesta Technologies, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/random.h>
+
+#include "tempesta_fw.h"
+#include "apm.h"
+#include "log.h"
+#include "server.h"
+#include "http.h"
+
+#define TFW_SCHED_P2C_INTVL	(HZ / 20)	/* The timer periodicity. */
+
+/**
+ * Individual upstream server descriptor.
+ *
+ * @rcu		- RCU control structure;
+ * @srv		- pointer to server structure;
+ * @conn	- list of pointers to server connection structures;
+ * @counter	- monotonic counter for choosing the next connection;
+ * @conn_n	- number of connections to server;
+ * @seq		- current sequence number for APM stats;
+ * @rtt		- the server response time from APM in msecs, at least 1;
+ */
+typedef struct {
+	struct rcu_head		rcu;
+	TfwServer		*srv;
+	TfwSrvConn		**conn;
+	atomic64_t		counter;
+	size_t			conn_n;
+	unsigned int		seq;
+	unsigned int		rtt;
+} TfwP2cSrvDesc;
+
+/**
+ * The main structure for the group.
+ *
+ * @rcu		- RCU control structure;
+ * @srv_n	- number of upstream servers;
+ * @psidx	- APM pstats[] value index used as a server response time;
+ * @rearm	- indicates if the timer can be re-armed;
+ * @timer	- periodic timer for APM data;
+ * @srvdesc	- array of upstream server descriptors;
+ */
+typedef struct {
+	struct rcu_head		rcu;
+	size_t			srv_n;
+	size_t			psidx;
+	atomic_t		rearm;
+	struct timer_list	timer;
+	TfwP2cSrvDesc		srvdesc[0];
+} TfwP2c;
+
+/**
+ * Update response times of all the servers in the group from APM.
+ */
+static void
+tfw_sched_p2c_tmfn(unsigned long tmfn_data)
+{
+	size_t si;
+	TfwP2c *p2c = (TfwP2c *)tmfn_data;
+
+	for (si = 0; si < p2c->srv_n; ++si) {
+		TfwP2cSrvDesc *srvdesc = &p2c->srvdesc[si];
+		unsigned int val[ARRAY_SIZE(tfw_pstats_ith)] = { 0 };
+		TfwPrcntlStats pstats = {
+			.ith = tfw_pstats_ith,
+			.val = val,
+			.psz = ARRAY_SIZE(tfw_pstats_ith),
+			.seq = srvdesc->seq
+		};
+
+		/* A new server may be not attached to APM yet. */
+		if (unlikely(!srvdesc->srv->apmref)
+		    || !tfw_apm_stats(srvdesc->srv->apmref, &pstats))
+			continue;
+		srvdesc->seq = pstats.seq;
+		WRITE_ONCE(srvdesc->rtt, pstats.val[p2c->psidx] ? : 1);
+	}
+
+	smp_mb();
+	if (atomic_read(&p2c->rearm))
+		mod_timer(&p2c->timer, jiffies + TFW_SCHED_P2C_INTVL);
+}
+
+static inline bool
+__conn_suitable(TfwSrvConn *srv_conn, int skipnip, int *nipconn)
+{
+	if (unlikely(tfw_srv_conn_restricted(srv_conn)
+		     || tfw_srv_conn_spare(srv_conn)
+		     || tfw_srv_conn_busy(srv_conn)
+		     || tfw_srv_conn_queue_full(srv_conn)))
+		return false;
+	if (skipnip && tfw_srv_conn_hasnip(srv_conn)) {
+		if (likely(tfw_srv_conn_live(srv_conn)))
+			++(*nipconn);
+		return false;
+	}
+	return tfw_srv_conn_live(srv_conn);
+}
+
+/**
+ * Find the next suitable connection of the server in round-robin manner.
+ * The returned connection isn't referenced, the caller must get a reference
+ * to it with tfw_srv_conn_get_if_live().
+ */
+static TfwSrvConn *
+__next_conn(TfwP2cSrvDesc *srvdesc, int skipnip, int *nipconn)
+{
+	size_t ci;
+
+	for (ci = 0; ci < srvdesc->conn_n; ++ci) {
+		unsigned long idxval = atomic64_inc_return(&srvdesc->counter);
+		TfwSrvConn *srv_conn = srvdesc->conn[idxval % srvdesc->conn_n];
+
+		if (__conn_suitable(srv_conn, skipnip, nipconn))
+			return srv_conn;
+	}
+
+	return NULL;
+}
+
+/**
+ * Get a reference to the less loaded connection of @c1 and @c2, any of them
+ * may be NULL. @w1 and @w2 are weights of the connections.
+ */
+static inline TfwSrvConn *
+__choose_conn(TfwSrvConn *c1, unsigned long w1, TfwSrvConn *c2,
+	      unsigned long w2)
+{
+	if (c1 && c2
+	    && (READ_ONCE(c2->qsize) + 1UL) * w2
+	       < (READ_ONCE(c1->qsize) + 1UL) * w1)
+		swap(c1, c2);
+	if (likely(c1) && likely(tfw_srv_conn_get_if_live(c1)))
+		return c1;
+	if (c2 && tfw_srv_conn_get_if_live(c2))
+		return c2;
+	return NULL;
+}
+
+static inline TfwSrvConn *
+__sched_srv(TfwP2cSrvDesc *srvdesc, int skipnip, int *nipconn)
+{
+	size_t n = srvdesc->conn_n;
+	TfwSrvConn *c1, *c2, *srv_conn;
+
+	c1 = srvdesc->conn[prandom_u32_max(n)];
+	c2 = srvdesc->conn[prandom_u32_max(n)];
+	if (!__conn_suitable(c1, skipnip, nipconn))
+		c1 = NULL;
+	if (c2 == c1 || !__conn_suitable(c2, skipnip, nipconn))
+		c2 = NULL;
+	if ((srv_conn = __choose_conn(c1, 1, c2, 1)))
+		return srv_conn;
+
+	/* Both the random choices failed, try all the connections. */
+	srv_conn = __next_conn(srvdesc, skipnip, nipconn);
+	if (srv_conn && likely(tfw_srv_conn_get_if_live(srv_conn)))
+		return srv_conn;
+
+	return NULL;
+}
+
+/**
+ * Same as @tfw_sched_p2c_sched_sg_conn(), but schedule for a specific server
+ * in a group. The power of two choices is applied to the server connections.
+ */
+static TfwSrvConn *
+tfw_sched_p2c_sched_srv_conn(TfwMsg *msg, TfwServer *srv)
+{
+	int skipnip = 1, nipconn = 0;
+	TfwP2cSrvDesc *srvdesc;
+	TfwSrvConn *srv_conn = NULL;
+
+	/*
+	 * Bypass the suspend checking if connection is needed for
+	 * health monitoring of backend server.
+	 */
+	if (!test_bit(TFW_HTTP_B_HMONITOR, ((TfwHttpReq *)msg)->flags)
+	    && tfw_srv_suspended(srv))
+		return NULL;
+
+	rcu_read_lock_bh();
+	srvdesc = rcu_dereference_bh(srv->sched_data);
+	if (unlikely(!srvdesc))
+		goto done;
+
+rerun:
+	if ((srv_conn = __sched_srv(srvdesc, skipnip, &nipconn)))
+		goto done;
+	if (skipnip && nipconn) {
+		skipnip = 0;
+		goto rerun;
+	}
+done:
+	rcu_read_unlock_bh();
+	return srv_conn;
+}
+
+/**
+ * Pick two different random servers of the group and forward the request to
+ * the less loaded one.
+ *
+ * As for the ratio scheduler, the number of attempts to find a suitable
+ * connection is limited by the number of servers in the group: if a suitable
+ * connection can not be found after multiple attempts, then something is
+ * wrong with the upstream servers and spinning here would just aggravate
+ * the issue.
+ */
+static TfwSrvConn *
+tfw_sched_p2c_sched_sg_conn(TfwMsg *msg, TfwSrvGroup *sg)
+{
+	int skipnip = 1, nipconn = 0;
+	unsigned int attempts;
+	TfwP2c *p2c;
+	TfwSrvConn *srv_conn = NULL;
+
+	rcu_read_lock_bh();
+	p2c = rcu_dereference_bh(sg->sched_data);
+	if (unlikely(!p2c))
+		goto done;
+rerun:
+	for (attempts = p2c->srv_n; attempts; --attempts) {
+		size_t i1, i2;
+		TfwP2cSrvDesc *sd1, *sd2;
+		TfwSrvConn *c1 = NULL, *c2 = NULL;
+
+		i1 = prandom_u32_max(p2c->srv_n);
+		sd1 = &p2c->srvdesc[i1];
+		if (!tfw_srv_suspended(sd1->srv))
+			c1 = __next_conn(sd1, skipnip, &nipconn);
+
+		sd2 = sd1;
+		if (p2c->srv_n > 1) {
+			i2 = (i1 + 1 + prandom_u32_max(p2c->srv_n - 1))
+			     % p2c->srv_n;
+			sd2 = &p2c->srvdesc[i2];
+			if (!tfw_srv_suspended(sd2->srv))
+				c2 = __next_conn(sd2, skipnip, &nipconn);
+		}
+
+		srv_conn = __choose_conn(c1, READ_ONCE(sd1->rtt),
+					 c2, READ_ONCE(sd2->rtt));
+		if (srv_conn)
+			goto done;
+	}
+	/* Relax the restrictions and re-run the search cycle. */
+	if (skipnip && nipconn) {
+		skipnip = 0;
+		goto rerun;
+	}
+done:
+	rcu_read_unlock_bh();
+	return srv_conn;
+}
+
+static void
+tfw_sched_p2c_cleanup(TfwP2c *p2c)
+{
+	size_t si;
+
+	for (si = 0; si < p2c->srv_n; ++si)
+		kfree(p2c->srvdesc[si].conn);
+	kfree(p2c);
+}
+
+static void
+tfw_sched_p2c_cleanup_rcu_cb(struct rcu_head *rcu)
+{
+	TfwP2c *p2c = container_of(rcu, TfwP2c, rcu);
+	tfw_sched_p2c_cleanup(p2c);
+}
+
+static void
+tfw_sched_p2c_del_grp(TfwSrvGroup *sg)
+{
+	TfwP2c *p2c = rcu_dereference_bh_check(sg->sched_data, 1);
+	TfwServer *srv;
+
+	RCU_INIT_POINTER(sg->sched_data, NULL);
+	list_for_each_entry(srv, &sg->srv_list, list) {
+		WARN_ON_ONCE(rcu_dereference_bh_check(srv->sched_data, 1)
+			     && !p2c);
+		RCU_INIT_POINTER(srv->sched_data, NULL);
+	}
+	if (!p2c)
+		return;
+
+	/* Make sure the timer doesn't re-arm itself. */
+	atomic_set(&p2c->rearm, 0);
+	smp_mb__after_atomic();
+	del_timer_sync(&p2c->timer);
+
+	call_rcu_bh(&p2c->rcu, tfw_sched_p2c_cleanup_rcu_cb);
+}
+
+static int
+tfw_sched_p2c_srvdesc_setup_srv(TfwServer *srv, TfwP2cSrvDesc *srvdesc)
+{
+	size_t size, ci = 0;
+	TfwSrvConn **conn, *srv_conn;
+
+	size = sizeof(TfwSrvConn *) * srv->conn_n;
+	if (!(srvdesc->conn = kzalloc(size, GFP_KERNEL)))
+		return -ENOMEM;
+
+	conn = srvdesc->conn;
+	list_for_each_entry(srv_conn, &srv->conn_list, list) {
+		if (unlikely(ci++ == srv->conn_n))
+			goto err;
+		*conn++ = srv_conn;
+	}
+	if (unlikely(ci != srv->conn_n))
+		goto err;
+
+	srvdesc->conn_n = srv->conn_n;
+	srvdesc->srv = srv;
+	srvdesc->rtt = 1;
+	atomic64_set(&srvdesc->counter, 0);
+
+	return 0;
+err:
+	kfree(srvdesc->conn);
+	srvdesc->conn = NULL;
+	return -EINVAL;
+}
+
+/**
+ * Add a server group to the scheduler. At the time this function is called
+ * the server group is fully formed and populated with all servers and
+ * connections.
+ */
+static int
+tfw_sched_p2c_add_grp(TfwSrvGroup *sg, void *arg)
+{
+	int r;
+	size_t si = 0;
+	TfwServer *srv;
+	TfwP2c *p2c;
+	TfwP2cSrvDesc *srvdesc;
+
+	if (unlikely(!sg->srv_n || list_empty(&sg->srv_list)))
+		return -EINVAL;
+
+	p2c = kzalloc(sizeof(TfwP2c) + sizeof(TfwP2cSrvDesc) * sg->srv_n,
+		      GFP_KERNEL);
+	if (!p2c)
+		return -ENOMEM;
+	p2c->srv_n = sg->srv_n;
+	p2c->psidx = sg->flags & TFW_SG_M_PSTATS_IDX;
+
+	srvdesc = p2c->srvdesc;
+	list_for_each_entry(srv, &sg->srv_list, list) {
+		r = -EINVAL;
+		if (unlikely((si == sg->srv_n) || !srv->conn_n
+			     || list_empty(&srv->conn_list)))
+			goto err;
+		if ((r = tfw_sched_p2c_srvdesc_setup_srv(srv, srvdesc++)))
+			goto err;
+		++si;
+	}
+	r = -EINVAL;
+	if (unlikely(si != sg->srv_n))
+		goto err;
+
+	/*
+	 * The add_group() function can be called during live reconfiguration,
+	 * assign the scheduler data after the data is fully prepared.
+	 */
+	for (si = 0; si < p2c->srv_n; ++si)
+		rcu_assign_pointer(p2c->srvdesc[si].srv->sched_data,
+				   &p2c->srvdesc[si]);
+	rcu_assign_pointer(sg->sched_data, p2c);
+
+	atomic_set(&p2c->rearm, 1);
+	smp_mb__after_atomic();
+	setup_timer(&p2c->timer, tfw_sched_p2c_tmfn, (unsigned long)p2c);
+	mod_timer(&p2c->timer, jiffies + TFW_SCHED_P2C_INTVL);
+
+	return 0;
+err:
+	tfw_sched_p2c_cleanup(p2c);
+	return r;
+}
+
+static int
+tfw_sched_p2c_add_srv(TfwServer *srv)
+{
+	int r;
+	TfwP2cSrvDesc *srvdesc = rcu_dereference_bh_check(srv->sched_data, 1);
+
+	if (unlikely(srvdesc))
+		return -EEXIST;
+
+	if (!(srvdesc = kzalloc(sizeof(TfwP2cSrvDesc), GFP_KERNEL)))
+		return -ENOMEM;
+	if ((r = tfw_sched_p2c_srvdesc_setup_srv(srv, srvdesc))) {
+		kfree(srvdesc);
+		return r;
+	}
+
+	rcu_assign_pointer(srv->sched_data, srvdesc);
+
+	return 0;
+}
+
+static void
+tfw_sched_p2c_put_srv_data(struct rcu_head *rcu)
+{
+	TfwP2cSrvDesc *srvdesc = container_of(rcu, TfwP2cSrvDesc, rcu);
+	kfree(srvdesc->conn);
+	kfree(srvdesc);
+}
+
+static void
+tfw_sched_p2c_del_srv(TfwServer *srv)
+{
+	TfwP2cSrvDesc *srvdesc = rcu_dereference_bh_check(srv->sched_data, 1);
+
+	RCU_INIT_POINTER(srv->sched_data, NULL);
+	if (srvdesc)
+		call_rcu_bh(&srvdesc->rcu, tfw_sched_p2c_put_srv_data);
+}
+
+static TfwScheduler tfw_sched_p2c = {
+	.name		= "p2c",
+	.list		= LIST_HEAD_INIT(tfw_sched_p2c.list),
+	.add_grp	= tfw_sched_p2c_add_grp,
+	.del_grp	= tfw_sched_p2c_del_grp,
+	.add_srv	= tfw_sched_p2c_add_srv,
+	.del_srv	= tfw_sched_p2c_del_srv,
+	.sched_sg_conn	= tfw_sched_p2c_sched_sg_conn,
+	.sched_srv_conn	= tfw_sched_p2c_sched_srv_conn,
+};
+
+int
+tfw_sched_p2c_init(void)
+{
+	T_DBG("%s: init\n", tfw_sched_p2c.name);
+	return tfw_sched_register(&tfw_sched_p2c);
+}
+
+void
+tfw_sched_p2c_exit(void)
+{
+	T_DBG("%s: exit\n", tfw_sched_p2c.name);
+	tfw_sched_unregister(&tfw_sched_p2c);
+}
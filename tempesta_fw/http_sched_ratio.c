@@ -19,6 +19,7 @@
  */
 #include <linux/kernel.h>
 #include <linux/module.h>
+#include <linux/random.h>
 #include <linux/sort.h>
 
 #include "tempesta_fw.h"
@@ -69,7 +70,6 @@ typedef struct {
 /**
  * Scheduler iteration data.
  *
- * @lock	- must be in the same cache line for faster operations.
  * @csidx	- index of current server data entry.
  * @reidx	- index of next server data entry which ratio we need
  *		  to reset, or @srv_n if no resetting is needed.
@@ -81,7 +81,6 @@ typedef struct {
  * @orsum	- original sum of all ratios, used to reset @crsum.
  */
 typedef struct {
-	spinlock_t	lock;
 	size_t		csidx;
 	size_t		reidx;
 	unsigned int	riter;
@@ -89,6 +88,22 @@ typedef struct {
 	unsigned long	orsum;
 } TfwRatioSchData;
 
+/**
+ * Per-CPU scheduler iteration data.
+ *
+ * Each CPU walks through its own copy of the schedule, so that CPUs
+ * neither contend for a lock nor bounce the cache lines with current
+ * ratios. The copies are set up from the ratios calculated for the
+ * group and are only replaced along with them.
+ *
+ * @schdata	- scheduler iteration data of the CPU.
+ * @cratio	- current ratios of server data entries (@cratio[@srv_n]).
+ */
+typedef struct {
+	TfwRatioSchData	schdata;
+	unsigned int	cratio[0];
+} TfwRatioPcpData;
+
 /**
  * Historic (past) data unit for an individual upstream server.
  *
@@ -147,14 +162,19 @@ typedef struct {
  * All servers, either dead or live, are present in the list during
  * the whole run-time. That may change in the future.
  *
+ * @srvdata and @schdata keep the initial state of the schedule, and
+ * @pcpdata are the copies of it that are actually used by the scheduler.
+ *
  * @rcu		- RCU control structure.
  * @srvdata	- scheduler data specific to each server in the group.
  * @schdata	- scheduler data common to all servers in the group.
+ * @pcpdata	- per-CPU scheduler iteration data.
  */
 typedef struct {
-	struct rcu_head		rcu;
-	TfwRatioSrvData		*srvdata;
-	TfwRatioSchData		schdata;
+	struct rcu_head			rcu;
+	TfwRatioSrvData			*srvdata;
+	TfwRatioSchData			schdata;
+	TfwRatioPcpData __percpu	*pcpdata;
 } TfwRatioData;
 
 /**
@@ -617,11 +637,28 @@ tfw_sched_ratio_rtodata_get(TfwRatio *ratio)
 	if (!(rtodata = kmalloc(size, GFP_ATOMIC)))
 		return NULL;
 	rtodata->srvdata = (TfwRatioSrvData *)(rtodata + 1);
-	spin_lock_init(&rtodata->schdata.lock);
+
+	size = sizeof(TfwRatioPcpData) + sizeof(unsigned int) * ratio->srv_n;
+	rtodata->pcpdata = __alloc_percpu_gfp(size,
+					      __alignof__(TfwRatioPcpData),
+					      GFP_ATOMIC);
+	if (!rtodata->pcpdata) {
+		kfree(rtodata);
+		return NULL;
+	}
 
 	return rtodata;
 }
 
+static void
+__tfw_sched_ratio_rtodata_free(TfwRatioData *rtodata)
+{
+	if (!rtodata)
+		return;
+	free_percpu(rtodata->pcpdata);
+	kfree(rtodata);
+}
+
 /**
  * Release a ratio data entry that is no longer used.
  */
@@ -629,9 +666,12 @@ static void
 tfw_sched_ratio_rtodata_put(struct rcu_head *rcup)
 {
 	TfwRatioData *rtodata = container_of(rcup, TfwRatioData, rcu);
-	kfree(rtodata);
+	__tfw_sched_ratio_rtodata_free(rtodata);
 }
 
+static void tfw_sched_ratio_pcpdata_init(TfwRatio *ratio,
+					 TfwRatioData *rtodata);
+
 /**
  * Calculate the latest ratios for each server in the group in real time.
  *
@@ -659,6 +699,7 @@ tfw_sched_ratio_calc_tmfn(TfwRatio *ratio,
 
 	/* Calculate dynamic ratios. */
 	calc_fn(ratio, nrtodata);
+	tfw_sched_ratio_pcpdata_init(ratio, nrtodata);
 
 	/*
 	 * Substitute the current ratio data entry with the new one for
@@ -715,22 +756,22 @@ tfw_sched_ratio_predict_tmfn(unsigned long tmfn_data)
  * TODO: The algorithm may and should be improved.
  */
 static inline bool
-tfw_sched_ratio_is_srv_turn(TfwRatio *ratio, TfwRatioData *rtodata, size_t csidx)
+tfw_sched_ratio_is_srv_turn(TfwRatio *ratio, TfwRatioData *rtodata,
+			    TfwRatioPcpData *pcpdata, size_t csidx)
 {
 	unsigned long headsum2, tailsum2;
-	TfwRatioSrvData *srvdata = rtodata->srvdata;
-	TfwRatioSchData *schdata = &rtodata->schdata;
+	unsigned int *cratio = pcpdata->cratio;
+	size_t lsidx = ratio->srv_n - 1;
 
 	if (!csidx)
 		return true;
 
-	headsum2 = (srvdata[0].cratio + srvdata[csidx - 1].cratio) * csidx;
-	tailsum2 = (srvdata[csidx].cratio
-		    + (srvdata[ratio->srv_n - 1].cratio
-		       ? : srvdata[ratio->srv_n - 1].oratio))
+	headsum2 = (cratio[0] + cratio[csidx - 1]) * csidx;
+	tailsum2 = (cratio[csidx]
+		    + (cratio[lsidx] ? : rtodata->srvdata[lsidx].oratio))
 		   * (ratio->srv_n - csidx);
 
-	return tailsum2 * schdata->riter > headsum2;
+	return tailsum2 * pcpdata->schdata.riter > headsum2;
 }
 
 /*
@@ -740,23 +781,25 @@ tfw_sched_ratio_is_srv_turn(TfwRatio *ratio, TfwRatioData *rtodata, size_t csidx
  * by ratio in descending order, with the higher weight entries moved
  * towards the start of the array.
  *
- * For concurrent use the algorithm is synchronized by a plain spin lock.
  * A lock-free implementation of the algorithm as it is would require too
- * many atomic operations including CMPXCHG and checking loops. It seems
- * that it won't give any advantage.
+ * many atomic operations including CMPXCHG and checking loops, so each
+ * CPU runs the algorithm on its own copy of the iteration data in
+ * @pcpdata. The weights are still honored since every CPU schedules
+ * servers in the same proportions.
  */
 static TfwRatioSrvDesc *
-tfw_sched_ratio_next_srv(TfwRatio *ratio, TfwRatioData *rtodata)
+tfw_sched_ratio_next_srv(TfwRatio *ratio, TfwRatioData *rtodata,
+			 TfwRatioPcpData *pcpdata)
 {
 	size_t csidx;
 	TfwRatioSrvData *srvdata = rtodata->srvdata;
-	TfwRatioSchData *schdata = &rtodata->schdata;
+	TfwRatioSchData *schdata = &pcpdata->schdata;
+	unsigned int *cratio = pcpdata->cratio;
 
 	/* Start with server that has the highest ratio. */
-	spin_lock(&schdata->lock);
 retry:
 	csidx = schdata->csidx;
-	if (!srvdata[csidx].cratio) {
+	if (!cratio[csidx]) {
 		/*
 		 * The server's counter (current ratio) is depleted, but
 		 * the server is not due yet for re-arming. Don't choose
@@ -774,7 +817,7 @@ retry:
 			}
 			goto retry;
 		}
-		srvdata[csidx].cratio = srvdata[csidx].oratio;
+		cratio[csidx] = srvdata[csidx].oratio;
 		++schdata->reidx;
 		/* Fall through */
 	}
@@ -787,8 +830,10 @@ retry:
 	 * the group, then also start from the beginning, but do not
 	 * reset as it's been reset already (make sure of that).
 	 */
-	if (likely(tfw_sched_ratio_is_srv_turn(ratio, rtodata, csidx))) {
-		--srvdata[csidx].cratio;
+	if (likely(tfw_sched_ratio_is_srv_turn(ratio, rtodata, pcpdata,
+					       csidx)))
+	{
+		--cratio[csidx];
 		if (unlikely(!--schdata->crsum)) {
 			schdata->csidx = 0;
 			schdata->riter = 1;
@@ -799,7 +844,6 @@ retry:
 			schdata->csidx = 0;
 			schdata->riter = 1;
 		}
-		spin_unlock(&schdata->lock);
 		return ratio->srvdesc + srvdata[csidx].sdidx;
 	}
 	/*
@@ -811,6 +855,30 @@ retry:
 	goto retry;
 }
 
+/*
+ * Set up the per-CPU copies of the schedule from the freshly calculated
+ * ratio data. If all CPUs started from the same position, then bursts of
+ * requests would hit the same servers at the same time, so each CPU
+ * skips as many positions of the schedule as its ordinal number.
+ */
+static void
+tfw_sched_ratio_pcpdata_init(TfwRatio *ratio, TfwRatioData *rtodata)
+{
+	int cpu;
+	size_t si;
+	unsigned long n, cpu_n = 0;
+
+	for_each_possible_cpu(cpu) {
+		TfwRatioPcpData *pcpdata = per_cpu_ptr(rtodata->pcpdata, cpu);
+
+		pcpdata->schdata = rtodata->schdata;
+		for (si = 0; si < ratio->srv_n; ++si)
+			pcpdata->cratio[si] = rtodata->srvdata[si].cratio;
+		for (n = cpu_n++ % rtodata->schdata.orsum; n; --n)
+			tfw_sched_ratio_next_srv(ratio, rtodata, pcpdata);
+	}
+}
+
 /*
  * Find an available connection to the server described by @srvdesc.
  * Consider the following restrictions:
@@ -821,24 +889,68 @@ retry:
  * The restriction #3 is controlled by @skipnip and can be removed
  * to get a wider selection of available connections.
  */
+static inline bool
+__conn_suitable(TfwSrvConn *srv_conn, int skipnip, int *nipconn)
+{
+	if (unlikely(tfw_srv_conn_restricted(srv_conn)
+		     || tfw_srv_conn_spare(srv_conn)
+		     || tfw_srv_conn_busy(srv_conn)
+		     || tfw_srv_conn_queue_full(srv_conn)))
+		return false;
+	if (skipnip && tfw_srv_conn_hasnip(srv_conn)) {
+		if (likely(tfw_srv_conn_live(srv_conn)))
+			++(*nipconn);
+		return false;
+	}
+	return true;
+}
+
+/*
+ * Same as __sched_srv(), but prefer a connection served by the current CPU.
+ * The connections are scanned from a single round-robin position to not
+ * bounce the counter cache line on each probe. If there is no suitable
+ * local connection, then the first suitable remote one is used.
+ */
+static TfwSrvConn *
+__sched_srv_local(TfwRatioSrvDesc *srvdesc, int skipnip, int *nipconn)
+{
+	size_t ci;
+	unsigned long idxval = atomic64_inc_return(&srvdesc->counter);
+	TfwSrvConn *srv_conn, *remote = NULL;
+
+	for (ci = 0; ci < srvdesc->conn_n; ++ci) {
+		srv_conn = srvdesc->conn[(idxval + ci) % srvdesc->conn_n];
+
+		if (!__conn_suitable(srv_conn, skipnip, nipconn))
+			continue;
+		if (!tfw_srv_conn_local(srv_conn)) {
+			if (!remote && tfw_srv_conn_live(srv_conn))
+				remote = srv_conn;
+			continue;
+		}
+		if (likely(tfw_srv_conn_get_if_live(srv_conn)))
+			return srv_conn;
+	}
+	if (remote && likely(tfw_srv_conn_get_if_live(remote)))
+		return remote;
+
+	return NULL;
+}
+
 static inline TfwSrvConn *
 __sched_srv(TfwRatioSrvDesc *srvdesc, int skipnip, int *nipconn)
 {
 	size_t ci;
 
+	if (READ_ONCE(srvdesc->srv->sg->flags) & TFW_SG_F_CPU_AFFINITY)
+		return __sched_srv_local(srvdesc, skipnip, nipconn);
+
 	for (ci = 0; ci < srvdesc->conn_n; ++ci) {
 		unsigned long idxval = atomic64_inc_return(&srvdesc->counter);
 		TfwSrvConn *srv_conn = srvdesc->conn[idxval % srvdesc->conn_n];
 
-		if (unlikely(tfw_srv_conn_restricted(srv_conn)
-			     || tfw_srv_conn_busy(srv_conn)
-			     || tfw_srv_conn_queue_full(srv_conn)))
+		if (!__conn_suitable(srv_conn, skipnip, nipconn))
 			continue;
-		if (skipnip && tfw_srv_conn_hasnip(srv_conn)) {
-			if (likely(tfw_srv_conn_live(srv_conn)))
-				++(*nipconn);
-			continue;
-		}
 		if (likely(tfw_srv_conn_get_if_live(srv_conn)))
 			return srv_conn;
 	}
@@ -906,9 +1018,10 @@ tfw_sched_ratio_sched_sg_conn(TfwMsg *msg, TfwSrvGroup *sg)
 {
 	unsigned int attempts, skipnip = 1, nipconn = 0;
 	TfwRatio *ratio;
-	TfwRatioSrvDesc *srvdesc;
+	TfwRatioSrvDesc *srvdesc, *ssdesc;
 	TfwSrvConn *srv_conn;
 	TfwRatioData *rtodata;
+	TfwRatioPcpData *pcpdata;
 
 	rcu_read_lock_bh();
 	ratio = rcu_dereference_bh(sg->sched_data);
@@ -919,6 +1032,8 @@ tfw_sched_ratio_sched_sg_conn(TfwMsg *msg, TfwSrvGroup *sg)
 
 	rtodata = rcu_dereference_bh(ratio->rtodata);
 	BUG_ON(!rtodata);
+	/* Softirqs are disabled, so we can't migrate to other CPU. */
+	pcpdata = this_cpu_ptr(rtodata->pcpdata);
 rerun:
 	/*
 	 * Try servers in a group according to their ratios. Attempt to
@@ -947,18 +1062,34 @@ rerun:
 	 * something is wrong with one or more upstream servers in
 	 * this group. Spinning in the loop here would just aggravate
 	 * the issue on Tempesta's side.
+	 *
+	 * A server in slow start takes only its current share of the
+	 * requests, and the rest of them go to the next servers. If all
+	 * the probed servers fail, then the last skipped server is tried
+	 * anyway, it's better than no server at all.
 	 */
+	ssdesc = NULL;
 	attempts = ratio->srv_n;
 	while (attempts--) {
-		srvdesc = tfw_sched_ratio_next_srv(ratio, rtodata);
+		srvdesc = tfw_sched_ratio_next_srv(ratio, rtodata, pcpdata);
 		if (tfw_srv_suspended(srvdesc->srv))
 			continue;
+		if (!tfw_srv_slow_start_admit(srvdesc->srv,
+					      prandom_u32_max(TFW_SRV_SS_SCALE)))
+		{
+			ssdesc = srvdesc;
+			continue;
+		}
 
 		if ((srv_conn = __sched_srv(srvdesc, skipnip, &nipconn))) {
 			rcu_read_unlock_bh();
 			return srv_conn;
 		}
 	}
+	if (ssdesc && (srv_conn = __sched_srv(ssdesc, skipnip, &nipconn))) {
+		rcu_read_unlock_bh();
+		return srv_conn;
+	}
 	/* Relax the restrictions and re-run the search cycle. */
 	if (skipnip && nipconn) {
 		skipnip = 0;
@@ -982,7 +1113,7 @@ tfw_sched_ratio_cleanup(TfwRatio *ratio)
 		kfree(ratio->srvdesc[si].conn);
 
 	kfree(ratio->hstdata);
-	kfree(ratio->rtodata);
+	__tfw_sched_ratio_rtodata_free(ratio->rtodata);
 
 	kfree(ratio);
 }
@@ -1137,6 +1268,7 @@ tfw_sched_ratio_add_grp_static(TfwSrvGroup *sg)
 
 	/* Calculate the static ratio data for each server. */
 	tfw_sched_ratio_calc_static(ratio, ratio->rtodata);
+	tfw_sched_ratio_pcpdata_init(ratio, ratio->rtodata);
 
 	return ratio;
 }
@@ -1187,6 +1319,7 @@ tfw_sched_ratio_add_grp_dynamic(TfwSrvGroup *sg, void *arg)
 	 * the configuration processing routines.
 	 */
 	tfw_sched_ratio_calc_static(ratio, ratio->rtodata);
+	tfw_sched_ratio_pcpdata_init(ratio, ratio->rtodata);
 
 	/* Set up periodic re-calculation of ratios. */
 	if (sg->flags & TFW_SG_F_SCHED_RATIO_DYNAMIC) {
@@ -47,16 +47,34 @@
 #include "hash.h"
 #include "http_msg.h"
 #include "http_sess.h"
+#include "http_sess_repl.h"
 #include "vhost.h"
 #include "filter.h"
 #include "tdb.h"
 
 static struct {
 	unsigned int	db_size;
+	unsigned int	db_max_size;
 	const char	*db_path;
 } sess_db_cfg __read_mostly;
 
-static TDB *sess_db;
+/*
+ * The sessions table is sharded over the NUMA nodes with CPUs by the session
+ * key, i.e. the sticky cookie hash, so concurrent session lookups and
+ * creations contend on different tables and each shard is swept for expired
+ * sessions by the TDB sweeper of its node.
+ */
+static TDB *sess_db[MAX_NUMNODES];
+static unsigned int sess_db_n;
+
+/**
+ * Low key bits index the TDB trie, so use high bits to choose the shard.
+ */
+static inline TDB *
+tfw_http_sess_db(unsigned long key)
+{
+	return sess_db[(unsigned int)(key >> 32) % sess_db_n];
+}
 
 typedef struct {
 	TfwHttpSess	sess;
@@ -116,6 +134,17 @@ void tfw_http_sess_redir_enable(void)
 	redir_mark_enabled_reconfig = true;
 }
 
+/*
+ * Request cookies are split to chunks by the parser only if sticky cookies
+ * are enabled for any vhost.
+ */
+static bool sticky_enabled_reconfig;
+
+void tfw_http_sess_sticky_enable(void)
+{
+	sticky_enabled_reconfig = true;
+}
+
 static inline bool
 tfw_http_sess_cookie_enabled(TfwHttpReq *req)
 {
@@ -180,7 +209,7 @@ tfw_http_sticky_build_redirect(TfwHttpReq *req, StickyVal *sv, RedirMarkVal *mv)
 	TfwStr c_chunks[3], m_chunks[3], cookie = { 0 }, rmark = { 0 };
 	TfwHttpResp *resp;
 	char c_buf[sizeof(*sv) * 2], m_buf[sizeof(*mv) * 2];
-	TfwStr *body = NULL;
+	TfwHttpSharedBody *body = NULL;
 	TfwStickyCookie *sticky;
 	int r;
 
@@ -372,6 +401,21 @@ do {									\
  * - Current timestamp;
  * - The secret key;
  */
+/*
+ * SipHash gives less bytes than HMAC, the rest of the MAC field is zeroed to
+ * keep the same format of the cookie values and the redirection marks with
+ * both the algorithms.
+ */
+static void
+__sess_siphash_final(TfwSipHash *h, unsigned char *mac)
+{
+	BUILD_BUG_ON(STICKY_KEY_HMAC_LEN < TFW_SIPHASH_LEN);
+
+	tfw_siphash_final(h, mac);
+	bzero_fast(mac + TFW_SIPHASH_LEN,
+		   STICKY_KEY_HMAC_LEN - TFW_SIPHASH_LEN);
+}
+
 static int
 __sticky_calc(TfwHttpReq *req, StickyVal *sv)
 {
@@ -388,11 +432,26 @@ __sticky_calc(TfwHttpReq *req, StickyVal *sv)
 		tfw_http_msg_clnthdr_val(req, hdr, TFW_HTTP_HDR_USER_AGENT,
 					 &ua_value);
 
+	T_DBG_PRINT_STICKY_COOKIE(addr, &ua_value, sv);
+
+	if (sticky->siphash) {
+		TfwSipHash h;
+
+		tfw_siphash_init(&h, &sticky->sip_key);
+		tfw_siphash_update(&h, tfw_addr_sa(addr),
+				   tfw_addr_sa_len(addr));
+		if (ua_value.len)
+			TFW_STR_FOR_EACH_CHUNK(c, &ua_value, end)
+				tfw_siphash_update(&h, c->data, c->len);
+		tfw_siphash_update(&h, &sv->ts, sizeof(sv->ts));
+		__sess_siphash_final(&h, sv->hmac);
+
+		return 0;
+	}
+
 	shash_desc->tfm = sticky->shash;
 	shash_desc->flags = 0;
 
-	T_DBG_PRINT_STICKY_COOKIE(addr, &ua_value, sv);
-
 	if ((r = crypto_shash_init(shash_desc)))
 		return r;
 
@@ -458,10 +517,9 @@ tfw_http_sticky_add(TfwHttpResp *resp, bool cache)
 	      PR_TFW_STR(&sticky->name), len, buf);
 
 	if (to_h2) {
-		TfwH2TransOp op = cache ? TFW_H2_TRANS_EXPAND : TFW_H2_TRANS_ADD;
-
 		set_cookie.hpack_idx = 55;
-		r = tfw_hpack_encode(resp, &set_cookie, op, !cache);
+		r = tfw_hpack_encode(resp, &set_cookie, TFW_H2_TRANS_EXPAND,
+				     !cache);
 	}
 	else if (cache) {
 		TfwHttpTransIter *mit = &resp->mit;
@@ -500,12 +558,23 @@ __redir_hmac_calc(TfwHttpReq *req, RedirMarkVal *mv)
 	TfwStickyCookie *sticky = req->vhost->cookie;
 	SHASH_DESC_ON_STACK(shash_desc, sticky->shash);
 
-	shash_desc->tfm = sticky->shash;
-	shash_desc->flags = 0;
-
 	T_DBG("http_sess: calculate redirection mark: ts=%#lx(now=%#lx),"
 	      " att_no=%#x\n", mv->ts, jiffies, mv->att_no);
 
+	if (sticky->siphash) {
+		TfwSipHash h;
+
+		tfw_siphash_init(&h, &sticky->sip_key);
+		tfw_siphash_update(&h, &mv->att_no, sizeof(mv->att_no));
+		tfw_siphash_update(&h, &mv->ts, sizeof(mv->ts));
+		__sess_siphash_final(&h, mv->hmac);
+
+		return 0;
+	}
+
+	shash_desc->tfm = sticky->shash;
+	shash_desc->flags = 0;
+
 	if ((r = crypto_shash_init(shash_desc)))
 		return r;
 	r = crypto_shash_update(shash_desc, (u8 *)&mv->att_no, sizeof(mv->att_no));
@@ -1058,6 +1127,26 @@ found:
 	return true;
 }
 
+/**
+ * Lock-free version of tfw_http_sess_eq(). The session can be removed or
+ * replaced by another session while it's inspected, so the session is
+ * referenced first and compared after that.
+ */
+static bool
+tfw_http_sess_get(TdbRec *rec, void *data)
+{
+	TfwHttpSess *sess = &((TfwSessEntry *)rec->data)->sess;
+
+	/* Removed or not yet initialized session. */
+	if (!atomic_inc_not_zero(&sess->users))
+		return false;
+	if (tfw_http_sess_eq(rec, data))
+		return true;
+
+	tfw_http_sess_put(sess);
+	return false;
+}
+
 static int
 tfw_http_sess_precreate(void *data)
 {
@@ -1099,12 +1188,13 @@ tfw_sess_ent_init(TdbRec *rec, void *data)
 		sess->ts = ctx->sv.ts;
 	}
 
-	atomic_set(&sess->users, 1);
 	atomic64_set(&sess->expires,
 		     sess->ts + (unsigned long)sticky->sess_lifetime * HZ);
 	sess->vhost = ctx->req->vhost;
 	tfw_vhost_get(sess->vhost);
 	rwlock_init(&sess->lock);
+	/* Publish the session for tfw_http_sess_get(). */
+	atomic_set_release(&sess->users, 1);
 
 	T_DBG("http_sess was newly created, %pK\n", sess);
 }
@@ -1161,13 +1251,13 @@ tfw_http_sess_obtain(TfwHttpReq *req)
 		key = hash_calc(sv->hmac, sizeof(sv->hmac));
 	}
 	ctx.req = req;
-	tdb_ctx.eq_rec = tfw_http_sess_eq;
+	tdb_ctx.get_rec = tfw_http_sess_get;
 	tdb_ctx.precreate_rec = tfw_http_sess_precreate;
 	tdb_ctx.init_rec = tfw_sess_ent_init;
 	tdb_ctx.ctx = &ctx;
 	tdb_ctx.len = sizeof(TfwSessEntry);
 
-	rec = tdb_rec_get_alloc(sess_db, key, &tdb_ctx);
+	rec = tdb_rec_get_alloc(tfw_http_sess_db(key), key, &tdb_ctx);
 	BUG_ON(tdb_ctx.len < sizeof(TfwSessEntry));
 	if (!rec) {
 		if (req->vhost->cookie->learn)
@@ -1181,18 +1271,12 @@ tfw_http_sess_obtain(TfwHttpReq *req)
 	}
 	sess = &((TfwSessEntry *)rec->data)->sess;
 
-	atomic_inc(&sess->users);
+	/* Found sessions are referenced by tfw_http_sess_get(). */
+	if (tdb_ctx.is_new)
+		atomic_inc(&sess->users);
 	req->sess = sess;
 	tfw_http_sess_prolong(sess, req->vhost->cookie);
 
-	if (!tdb_ctx.is_new)
-		/*
-		 * The record doesn't change its location in TDB, since it is
-		 * larger than TDB_HTRIE_MINDREC, and we need to unlock the
-		 * bucket with the session as soon as possible.
-		 */
-		tdb_rec_put(rec);
-
 	return TFW_HTTP_SESS_SUCCESS;
 }
 
@@ -1284,13 +1368,13 @@ tfw_http_sess_learn(TfwHttpResp *resp)
 	key = tfw_hash_str(c_val);
 	ctx.req = resp->req;
 	ctx.resp = resp;
-	tdb_ctx.eq_rec = tfw_http_sess_eq;
+	tdb_ctx.get_rec = tfw_http_sess_get;
 	/* no tdb_ctx.precreate_rec hook. */
 	tdb_ctx.init_rec = tfw_sess_ent_init;
 	tdb_ctx.ctx = &ctx;
 	tdb_ctx.len = sizeof(TfwSessEntry);
 
-	rec = tdb_rec_get_alloc(sess_db, key, &tdb_ctx);
+	rec = tdb_rec_get_alloc(tfw_http_sess_db(key), key, &tdb_ctx);
 	BUG_ON(tdb_ctx.len < sizeof(TfwSessEntry));
 	if (!rec) {
 		T_WARN("cannot allocate TDB space for learned http session\n");
@@ -1298,15 +1382,11 @@ tfw_http_sess_learn(TfwHttpResp *resp)
 	}
 	/*
 	 * The session is not required now, it's enough to have a new
-	 * session in tdb. Leave new_sess->users as is.
+	 * session in tdb. Leave new_sess->users as is and release
+	 * the reference to the found session.
 	 */
 	if (!tdb_ctx.is_new)
-		/*
-		 * The record doesn't change its location in TDB, since it is
-		 * larger than TDB_HTRIE_MINDREC, and we need to unlock the
-		 * bucket with the session as soon as possible.
-		 */
-		tdb_rec_put(rec);
+		tfw_http_sess_put(&((TfwSessEntry *)rec->data)->sess);
 }
 
 /**
@@ -1325,6 +1405,7 @@ __try_conn(TfwMsg *msg, TfwSrvConn *srv_conn)
 		return NULL;
 
 	if (!tfw_srv_conn_restricted(srv_conn)
+	    && !tfw_srv_conn_spare(srv_conn)
 	    && !tfw_srv_conn_busy(srv_conn)
 	    && !tfw_srv_conn_queue_full(srv_conn)
 	    && !tfw_srv_conn_hasnip(srv_conn)
@@ -1474,23 +1555,160 @@ tfw_http_sess_get_srv_conn(TfwMsg *msg)
 
 	srv_conn = tfw_vhost_get_srv_conn(msg);
 	tfw_http_sess_pin_srv(sess, srv_conn);
+	/* Sessions with learned cookies aren't replicated. */
+	if (srv_conn && !sess->key_len)
+		tfw_http_sess_repl_push(sess);
 err:
 	write_unlock(&sess->lock);
 
 	return srv_conn;
 }
 
+/**
+ * Context for TDB operations over sessions replicated from other nodes.
+ *
+ * @ts		- session timestamp, the sticky cookie is calculated with;
+ * @hmac	- sticky cookie value of the session;
+ * @vhost	- vhost of the session;
+ * @ttl		- remaining lifetime of the session, in jiffies;
+ */
+typedef struct {
+	unsigned long		ts;
+	const unsigned char	*hmac;
+	TfwVhost		*vhost;
+	unsigned long		ttl;
+} TfwSessReplCtx;
+
+static bool
+tfw_http_sess_repl_get(TdbRec *rec, void *data)
+{
+	TfwHttpSess *sess = &((TfwSessEntry *)rec->data)->sess;
+	TfwSessReplCtx *ctx = (TfwSessReplCtx *)data;
+	bool r;
+
+	if (!atomic_inc_not_zero(&sess->users))
+		return false;
+
+	read_lock(&sess->lock);
+	r = ((unsigned long)atomic64_read(&sess->expires) >= jiffies)
+	    && sess->vhost && !sess->key_len
+	    && !memcmp_fast(ctx->hmac, sess->hmac, sizeof(sess->hmac))
+	    && !tfw_stricmp(&sess->vhost->name, &ctx->vhost->name);
+	read_unlock(&sess->lock);
+	if (r)
+		return true;
+
+	tfw_http_sess_put(sess);
+	return false;
+}
+
+static void
+tfw_http_sess_repl_init(TdbRec *rec, void *data)
+{
+	TfwHttpSess *sess = &((TfwSessEntry *)rec->data)->sess;
+	TfwSessReplCtx *ctx = (TfwSessReplCtx *)data;
+
+	bzero_fast(sess, sizeof(TfwHttpSess));
+
+	memcpy_fast(sess->hmac, ctx->hmac, sizeof(sess->hmac));
+	sess->ts = ctx->ts;
+	atomic64_set(&sess->expires, jiffies + ctx->ttl);
+	sess->vhost = ctx->vhost;
+	tfw_vhost_get(sess->vhost);
+	rwlock_init(&sess->lock);
+	atomic_set_release(&sess->users, 1);
+
+	T_DBG("http_sess was replicated, %pK\n", sess);
+}
+
+/**
+ * Apply a session replicated from another Tempesta node: create the session
+ * with timestamp @ts and sticky cookie value @hmac for @vhost, if there is no
+ * such session yet, and pin the session to server @srv unless it's already
+ * pinned locally. @ttl is the remaining session lifetime in jiffies.
+ *
+ * Must be called with disabled softirqs.
+ */
+void
+tfw_http_sess_repl_apply(unsigned long ts, const unsigned char *hmac,
+			 TfwVhost *vhost, TfwServer *srv, unsigned long ttl)
+{
+	unsigned long key = hash_calc(hmac, STICKY_KEY_HMAC_LEN);
+	TfwHttpSess *sess;
+	TfwSessReplCtx ctx = {
+		.ts	= ts,
+		.hmac	= hmac,
+		.vhost	= vhost,
+		.ttl	= ttl
+	};
+	TdbGetAllocCtx tdb_ctx = { 0 };
+	TdbRec *rec;
+
+	tdb_ctx.get_rec = tfw_http_sess_repl_get;
+	tdb_ctx.init_rec = tfw_http_sess_repl_init;
+	tdb_ctx.ctx = &ctx;
+	tdb_ctx.len = sizeof(TfwSessEntry);
+
+	rec = tdb_rec_get_alloc(tfw_http_sess_db(key), key, &tdb_ctx);
+	if (!rec) {
+		T_DBG("cannot allocate TDB space for replicated session\n");
+		return;
+	}
+	sess = &((TfwSessEntry *)rec->data)->sess;
+
+	write_lock(&sess->lock);
+	if (!sess->srv_conn && !list_empty(&srv->conn_list))
+		tfw_http_sess_pin_srv(sess, list_first_entry(&srv->conn_list,
+							     TfwSrvConn,
+							     list));
+	write_unlock(&sess->lock);
+
+	/* Found sessions are referenced by tfw_http_sess_repl_get(). */
+	if (!tdb_ctx.is_new)
+		tfw_http_sess_put(sess);
+}
+
 static int
 tfw_http_sess_cfgstart(void)
 {
 	redir_mark_enabled_reconfig = false;
+	sticky_enabled_reconfig = false;
 	return 0;
 }
 
+/**
+ * Called by the TDB sweeper under the bucket lock, so nobody can obtain
+ * the session concurrently. The session is removed only if it's referenced
+ * by the table only, so the table reference is released here.
+ */
+static bool
+tfw_http_sess_expired(void *data)
+{
+	TfwHttpSess *sess = &((TfwSessEntry *)data)->sess;
+
+	if ((unsigned long)atomic64_read(&sess->expires) >= jiffies)
+		return false;
+	/* Just allocated and not initialized sessions have no users. */
+	if (atomic_cmpxchg(&sess->users, 1, 0) != 1)
+		return false;
+
+	tfw_http_sess_unpin_srv(sess);
+	if (sess->vhost)
+		tfw_vhost_put(sess->vhost);
+
+	return true;
+}
+
+static void tfw_http_sess_stop(void);
+
 static int
 tfw_http_sess_start(void)
 {
+	int node;
+	TDB *db;
+
 	redir_mark_enabled = redir_mark_enabled_reconfig;
+	tfw_http_parse_need(TFW_HTTP_PARSE_STICKY, sticky_enabled_reconfig);
 
 	if (tfw_runstate_is_reconfig())
 		return 0;
@@ -1500,10 +1718,17 @@ tfw_http_sess_start(void)
 	 * grows, while big ones has constant location.
 	 */
 	BUILD_BUG_ON(sizeof(TfwSessEntry) <= TDB_HTRIE_MINDREC);
-	sess_db = tdb_open(sess_db_cfg.db_path, sess_db_cfg.db_size,
-			   sizeof(TfwSessEntry), numa_node_id());
-	if (!sess_db)
-		return -EINVAL;
+	for_each_node_with_cpus(node) {
+		db = tdb_open_grow(sess_db_cfg.db_path, sess_db_cfg.db_size,
+				   sess_db_cfg.db_max_size,
+				   sizeof(TfwSessEntry), node);
+		if (!db) {
+			tfw_http_sess_stop();
+			return -EINVAL;
+		}
+		tdb_entry_expiry(db, tfw_http_sess_expired);
+		sess_db[sess_db_n++] = db;
+	}
 
 	return 0;
 }
@@ -1521,11 +1746,15 @@ tfw_http_sess_release_entry(void *data)
 static void
 tfw_http_sess_stop(void)
 {
-	if (!sess_db)
-		return;
-
-	tdb_entry_walk(sess_db, tfw_http_sess_release_entry);
-	tdb_close(sess_db);
+	TDB *db;
+
+	while (sess_db_n) {
+		db = sess_db[--sess_db_n];
+		sess_db[sess_db_n] = NULL;
+		tdb_entry_expiry(db, NULL);
+		tdb_entry_walk(db, tfw_http_sess_release_entry);
+		tdb_close(db);
+	}
 }
 
 static TfwCfgSpec tfw_http_sess_specs_table[] = {
@@ -1539,6 +1768,16 @@ static TfwCfgSpec tfw_http_sess_specs_table[] = {
 			.range = { PAGE_SIZE, (1 << 30) },
 		}
 	},
+	{
+		.name = "sessions_tbl_max_size",
+		.deflt = "0",
+		.handler = tfw_cfg_set_int,
+		.dest = &sess_db_cfg.db_max_size,
+		.spec_ext = &(TfwCfgSpecInt) {
+			.multiple_of = PAGE_SIZE,
+			.range = { 0, (1 << 30) },
+		}
+	},
 	{
 		.name = "sessions_db",
 		.deflt = "/opt/tempesta/db/sessions.tdb",
@@ -20,6 +20,7 @@
 #ifndef __TFW_HTTP_SESS_H__
 #define __TFW_HTTP_SESS_H__
 
+#include "hash.h"
 #include "http.h"
 
 /**
@@ -70,7 +71,8 @@
  * To pass JS challenge client must repeat its request in the exact time frame
  * specified by JS code.
  *
- * @body	- body (html with JavaScript code);
+ * @body	- body (html with JavaScript code), shared by all the challenge
+ *		  responses;
  * @delay_min	- minimal timeout client must wait before repeat the request,
  *		  in jiffies;
  * @delay_limit	- maximum time required to deliver request form a client to the
@@ -80,7 +82,7 @@
  * @st_code	- status code for response with JS challenge;
  */
 typedef struct {
-	TfwStr			body;
+	TfwHttpSharedBody	body;
 	unsigned long		delay_min;
 	unsigned long		delay_limit;
 	unsigned long		delay_range;
@@ -92,6 +94,7 @@ typedef struct {
  *
  * @shash		- Secret server value to generate reliable client
  *			  identifiers.
+ * @sip_key		- SipHash state prepared from @key;
  * @name		- name of sticky cookie;
  * @name_eq		- @name plus "=" to make some operations faster;
  * @js_challenge	- JS challenge configuration;
@@ -105,10 +108,13 @@ typedef struct {
  *			  session cookie;
  * @enforce		- don't forward requests to backend unless session
  *			  cookie is set;
+ * @siphash		- use SipHash instead of HMAC for the cookie values and
+ *			  the redirection marks;
  */
 struct tfw_http_cookie_t {
 	struct crypto_shash	*shash;
 	char			key[STICKY_KEY_HMAC_LEN];
+	TfwSipHashKey		sip_key;
 	char			sticky_name[STICKY_NAME_MAXLEN + 1];
 	char			options_str[STICKY_OPT_MAXLEN];
 	TfwStr			options;
@@ -120,7 +126,8 @@ struct tfw_http_cookie_t {
 	unsigned int		max_misses;
 	unsigned int		tmt_sec;
 	unsigned int		learn : 1,
-				enforce : 1;
+				enforce : 1,
+				siphash : 1;
 };
 
 /**
@@ -173,8 +180,12 @@ int tfw_http_sess_req_process(TfwHttpReq *req);
 int tfw_http_sess_resp_process(TfwHttpResp *resp, bool cache);
 void tfw_http_sess_put(TfwHttpSess *sess);
 void tfw_http_sess_pin_vhost(TfwHttpSess *sess, TfwVhost *vhost);
+void tfw_http_sess_repl_apply(unsigned long ts, const unsigned char *hmac,
+			      TfwVhost *vhost, TfwServer *srv,
+			      unsigned long ttl);
 
 void tfw_http_sess_redir_enable(void);
+void tfw_http_sess_sticky_enable(void);
 bool tfw_http_sess_max_misses(void);
 unsigned int tfw_http_sess_mark_size(void);
 const TfwStr *tfw_http_sess_mark_name(void);
@@ -44,9 +44,7 @@ tfw_http_sess_cookie_clean(TfwVhost *vhost)
 	if (!sticky->js_challenge)
 		return;
 
-	if (sticky->js_challenge->body.data)
-		free_pages((unsigned long)sticky->js_challenge->body.data,
-			   get_order(sticky->js_challenge->body.len));
+	tfw_http_shared_body_free(&sticky->js_challenge->body);
 	kfree(sticky->js_challenge);
 
 	return;
@@ -114,6 +112,8 @@ tfw_http_sess_cfgop_finish(TfwVhost *vhost, TfwCfgSpec *cs)
 	} else {
 		sticky->redirect_code = tfw_cfg_redirect_st_code_dflt;
 	}
+	if (!TFW_STR_EMPTY(&sticky->name))
+		tfw_http_sess_sticky_enable();
 
 	cur_vhost = NULL;
 
@@ -357,6 +357,26 @@ tfw_cfgop_sess_lifetime(TfwCfgSpec *cs, TfwCfgEntry *ce)
 	return 0;
 }
 
+/*
+ * SipHash uses shorter key than HMAC, so fold the whole secret into the
+ * SipHash key to not ignore any part of it.
+ */
+static void
+tfw_cfgop_sticky_siphash_setkey(TfwStickyCookie *sticky)
+{
+	int i;
+	u8 k[TFW_SIPHASH_KEY_LEN];
+
+	BUILD_BUG_ON(sizeof(sticky->key) < sizeof(k)
+		     || sizeof(sticky->key) > sizeof(k) * 2);
+
+	memcpy(k, sticky->key, sizeof(k));
+	for (i = sizeof(k); i < sizeof(sticky->key); ++i)
+		k[i - sizeof(k)] ^= sticky->key[i];
+	tfw_siphash_setkey(&sticky->sip_key, k);
+	memzero_explicit(k, sizeof(k));
+}
+
 static int
 tfw_cfgop_sticky_secret(TfwCfgSpec *cs, TfwCfgEntry *ce)
 {
@@ -381,6 +401,28 @@ tfw_cfgop_sticky_secret(TfwCfgSpec *cs, TfwCfgEntry *ce)
 	r = crypto_shash_setkey(sticky->shash, sticky->key, len);
 	if (r)
 		return r;
+	tfw_cfgop_sticky_siphash_setkey(sticky);
+
+	return 0;
+}
+
+static int
+tfw_cfgop_sticky_mac(TfwCfgSpec *cs, TfwCfgEntry *ce)
+{
+	TfwStickyCookie *sticky = cur_vhost->cookie;
+
+	if (tfw_cfg_check_single_val(ce))
+		return -EINVAL;
+
+	if (!strcasecmp(ce->vals[0], "hmac_sha1")) {
+		sticky->siphash = 0;
+	} else if (!strcasecmp(ce->vals[0], "siphash")) {
+		sticky->siphash = 1;
+	} else {
+		T_ERR_NL("%s: unsupported argument: '%s'\n", cs->name,
+			 ce->vals[0]);
+		return -EINVAL;
+	}
 
 	return 0;
 }
@@ -450,16 +492,23 @@ tfw_cfgop_jsch_set_delay_limit(TfwCfgSpec *cs, TfwCfgJsCh *js_ch)
 static int
 tfw_cfgop_jsch_set_body(TfwCfgSpec *cs, TfwCfgJsCh *js_ch, const char *script)
 {
+	int r;
 	char *body_data;
 	size_t sz;
 
 	body_data = tfw_http_msg_body_dup(script, &sz);
 	if (!body_data)
 		return -ENOMEM;
-	js_ch->body.len = sz;
-	js_ch->body.data = body_data;
+	/*
+	 * The challenge is sent to each client without a valid cookie, i.e. to
+	 * every bot, so pre-render the body into pages shared by all the
+	 * responses instead of copying it for each of them.
+	 */
+	if ((r = tfw_http_shared_body_init(&js_ch->body, body_data, sz)))
+		T_ERR_NL("%s: can't allocate memory for the body\n", cs->name);
+	free_pages((unsigned long)body_data, get_order(sz));
 
-	return 0;
+	return r;
 }
 
 static int
@@ -582,6 +631,13 @@ TfwCfgSpec tfw_http_sess_specs[] = {
 		.allow_none = true,
 		.allow_reconfig = true,
 	},
+	{
+		.name = "mac",
+		.deflt = "hmac_sha1",
+		.handler = tfw_cfgop_sticky_mac,
+		.allow_none = true,
+		.allow_reconfig = true,
+	},
 	{
 		/* Value is parsed as int, set max to INT_MAX*/
 		.name = "sess_lifetime",
@@ -0,0 +1,494 @@
+/**
+ *		Tempesta FW
+ *
+ * Replication of HTTP sessions between Tempesta nodes.
+ *
+ * Several Tempesta nodes behind ECMP routing can receive requests of the same
+ * client. A session pinned to a backend server at one node is replicated to
+ * the peer nodes, so the other nodes forward the client requests to the same
+ * server instead of pinning the session to a different one.
+ *
+ * The replication is asynchronous and best effort. Sessions pinned to servers
+ * are queued in per-CPU datagram buffers in softirq and a kernel thread sends
+ * the buffers to all the peers over UDP each replication interval, which
+ * bounds the replication staleness. The thread also receives the datagrams of
+ * the peers and applies the sessions into the local sessions table. If a CPU
+ * buffer is full, then the session isn't replicated.
+ *
+ * Only sessions with Tempesta native sticky cookies are replicated, sessions
+ * with cookies learned from backends are identified by arbitrary long values.
+ *
+ * Copyright (C) 2020 Tempesta Technologies, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#include <linux/kthread.h>
+#include <linux/net.h>
+#include <net/ipv6.h>
+#include <net/sock.h>
+#include <asm/fpu/api.h>
+
+#include "tempesta_fw.h"
+#include "addr.h"
+#include "cfg.h"
+#include "http_sess_repl.h"
+#include "log.h"
+#include "server.h"
+#include "vhost.h"
+
+#define TFW_SESS_REPL_MAGIC	0x54465352	/* "TFSR" */
+#define TFW_SESS_REPL_PEERS_MAX	16
+/* Fits the Ethernet MTU with IPv6 and UDP headers. */
+#define TFW_SESS_REPL_DGRAM_SZ	1400
+
+/**
+ * Replication datagram header.
+ *
+ * @magic	- TFW_SESS_REPL_MAGIC;
+ * @n		- number of session records following the header;
+ */
+typedef struct {
+	__be32		magic;
+	__be32		n;
+} __attribute__((packed)) TfwSessReplHdr;
+
+/**
+ * Replicated session record.
+ *
+ * @ts		- session timestamp;
+ * @ttl		- remaining lifetime of the session in milliseconds;
+ * @port	- port of the pinned server;
+ * @vh_len	- length of the vhost name;
+ * @sg_len	- length of the pinned server group name;
+ * @addr	- address of the pinned server;
+ * @hmac	- sticky cookie value;
+ * @names	- vhost name followed by the server group name;
+ */
+typedef struct {
+	__be64		ts;
+	__be32		ttl;
+	__be16		port;
+	u8		vh_len;
+	u8		sg_len;
+	struct in6_addr	addr;
+	unsigned char	hmac[STICKY_KEY_HMAC_LEN];
+	char		names[0];
+} __attribute__((packed)) TfwSessReplRec;
+
+/**
+ * Per-CPU queue of sessions to replicate.
+ *
+ * @lock	- protects the queue against the replication thread;
+ * @len		- length of the datagram in @buf;
+ * @n		- number of sessions in the datagram;
+ * @buf		- the datagram to send;
+ */
+typedef struct {
+	spinlock_t	lock;
+	unsigned int	len;
+	unsigned int	n;
+	char		buf[TFW_SESS_REPL_DGRAM_SZ];
+} TfwSessReplQueue;
+
+static struct {
+	TfwAddr		listen;
+	TfwAddr		peers[TFW_SESS_REPL_PEERS_MAX];
+	unsigned int	peers_n;
+	unsigned int	interval;
+} sess_repl_cfg __read_mostly;
+
+static bool sess_repl_enabled __read_mostly;
+static struct socket *sess_repl_sock;
+static struct task_struct *sess_repl_thr;
+static DEFINE_PER_CPU(TfwSessReplQueue, sess_repl_q);
+/* Used by the replication thread only. */
+static char sess_repl_buf[TFW_SESS_REPL_DGRAM_SZ];
+
+/**
+ * Queue session @sess, just pinned to a server, for replication.
+ * Called in softirq under the session write lock.
+ */
+void
+tfw_http_sess_repl_push(TfwHttpSess *sess)
+{
+	TfwSessReplQueue *q;
+	TfwSessReplRec *r;
+	TfwServer *srv = (TfwServer *)sess->srv_conn->peer;
+	const TfwStr *vh_name = &sess->vhost->name;
+	long ttl = atomic64_read(&sess->expires) - jiffies;
+	unsigned int len;
+
+	if (!sess_repl_enabled || ttl <= 0)
+		return;
+	if (vh_name->len > U8_MAX || srv->sg->nlen > U8_MAX)
+		return;
+	len = sizeof(*r) + vh_name->len + srv->sg->nlen;
+
+	q = this_cpu_ptr(&sess_repl_q);
+	spin_lock(&q->lock);
+	if (unlikely(q->len + len > sizeof(q->buf))) {
+		spin_unlock(&q->lock);
+		T_DBG("sess_repl: queue is full, drop session %pK\n", sess);
+		return;
+	}
+	r = (TfwSessReplRec *)(q->buf + q->len);
+	r->ts = cpu_to_be64(sess->ts);
+	r->ttl = htonl(jiffies_to_msecs(ttl));
+	r->port = tfw_addr_port(&srv->addr);
+	r->vh_len = vh_name->len;
+	r->sg_len = srv->sg->nlen;
+	r->addr = srv->addr.sin6_addr;
+	memcpy(r->hmac, sess->hmac, sizeof(r->hmac));
+	memcpy(r->names, vh_name->data, vh_name->len);
+	memcpy(r->names + vh_name->len, srv->sg->name, srv->sg->nlen);
+	q->len += len;
+	q->n++;
+	spin_unlock(&q->lock);
+}
+
+static void
+tfw_sess_repl_send(size_t len)
+{
+	int i, r;
+	struct kvec iov = { .iov_base = sess_repl_buf, .iov_len = len };
+	struct msghdr msg = { .msg_flags = MSG_DONTWAIT };
+
+	for (i = 0; i < sess_repl_cfg.peers_n; ++i) {
+		msg.msg_name = &sess_repl_cfg.peers[i];
+		msg.msg_namelen = sizeof(TfwAddr);
+		r = kernel_sendmsg(sess_repl_sock, &msg, &iov, 1, len);
+		if (r < 0)
+			T_DBG_ADDR("sess_repl: cannot send sessions to",
+				   &sess_repl_cfg.peers[i], TFW_WITH_PORT);
+	}
+}
+
+static void
+tfw_sess_repl_flush(void)
+{
+	int cpu;
+	unsigned int len, n;
+	TfwSessReplQueue *q;
+	TfwSessReplHdr *hdr = (TfwSessReplHdr *)sess_repl_buf;
+
+	for_each_online_cpu(cpu) {
+		q = per_cpu_ptr(&sess_repl_q, cpu);
+
+		spin_lock_bh(&q->lock);
+		n = q->n;
+		len = q->len;
+		memcpy(sess_repl_buf + sizeof(*hdr), q->buf + sizeof(*hdr),
+		       len - sizeof(*hdr));
+		q->n = 0;
+		q->len = sizeof(*hdr);
+		spin_unlock_bh(&q->lock);
+
+		if (!n)
+			continue;
+		hdr->magic = htonl(TFW_SESS_REPL_MAGIC);
+		hdr->n = htonl(n);
+		tfw_sess_repl_send(len);
+	}
+}
+
+static void
+tfw_sess_repl_apply_rec(const TfwSessReplRec *r)
+{
+	TfwStr vh_name = { .data = (char *)r->names, .len = r->vh_len };
+	TfwAddr addr = {
+		.sin6_family	= AF_INET6,
+		.sin6_port	= r->port,
+		.sin6_addr	= r->addr
+	};
+	TfwSrvGroup *sg;
+	TfwServer *srv;
+	TfwVhost *vhost;
+
+	/* The servers lookups can sleep, so do them before the sessions. */
+	if (!(sg = tfw_sg_lookup(r->names + r->vh_len, r->sg_len)))
+		return;
+	srv = tfw_server_lookup(sg, &addr);
+	tfw_sg_put(sg);
+	if (!srv)
+		return;
+
+	local_bh_disable();
+	kernel_fpu_begin();
+
+	if ((vhost = tfw_vhost_lookup(&vh_name))) {
+		tfw_http_sess_repl_apply(be64_to_cpu(r->ts), r->hmac, vhost,
+					 srv, msecs_to_jiffies(ntohl(r->ttl)));
+		tfw_vhost_put(vhost);
+	}
+
+	kernel_fpu_end();
+	local_bh_enable();
+
+	tfw_server_put(srv);
+}
+
+static void
+tfw_sess_repl_apply(size_t len)
+{
+	unsigned int i, n, rlen;
+	const TfwSessReplRec *r;
+	const TfwSessReplHdr *hdr = (TfwSessReplHdr *)sess_repl_buf;
+	const char *p = sess_repl_buf + sizeof(*hdr);
+
+	if (len < sizeof(*hdr) || hdr->magic != htonl(TFW_SESS_REPL_MAGIC))
+		return;
+	len -= sizeof(*hdr);
+
+	for (i = 0, n = ntohl(hdr->n); i < n; ++i, p += rlen, len -= rlen) {
+		r = (const TfwSessReplRec *)p;
+		if (len < sizeof(*r))
+			return;
+		rlen = sizeof(*r) + r->vh_len + r->sg_len;
+		if (len < rlen)
+			return;
+		tfw_sess_repl_apply_rec(r);
+	}
+}
+
+/**
+ * Only the configured peers can replicate sessions to the node.
+ */
+static bool
+tfw_sess_repl_peer(const TfwAddr *addr)
+{
+	int i;
+
+	for (i = 0; i < sess_repl_cfg.peers_n; ++i)
+		if (ipv6_addr_equal(&addr->sin6_addr,
+				    &sess_repl_cfg.peers[i].sin6_addr))
+			return true;
+
+	return false;
+}
+
+static void
+tfw_sess_repl_recv(void)
+{
+	int r;
+	TfwAddr addr;
+	struct kvec iov;
+	struct msghdr msg;
+
+	while (!kthread_should_stop()) {
+		iov.iov_base = sess_repl_buf;
+		iov.iov_len = sizeof(sess_repl_buf);
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_name = &addr;
+		msg.msg_namelen = sizeof(addr);
+
+		r = kernel_recvmsg(sess_repl_sock, &msg, &iov, 1,
+				   sizeof(sess_repl_buf), MSG_DONTWAIT);
+		if (r <= 0)
+			return;
+		if (msg.msg_namelen < sizeof(addr) || !tfw_sess_repl_peer(&addr))
+		{
+			T_DBG_ADDR("sess_repl: drop datagram from", &addr,
+				   TFW_WITH_PORT);
+			continue;
+		}
+		tfw_sess_repl_apply(r);
+	}
+}
+
+static int
+tfw_sess_repl_thread(void *data)
+{
+	unsigned long intvl = msecs_to_jiffies(sess_repl_cfg.interval);
+
+	set_user_nice(current, MAX_NICE);
+
+	while (!kthread_should_stop()) {
+		tfw_sess_repl_flush();
+		tfw_sess_repl_recv();
+		schedule_timeout_interruptible(intvl);
+	}
+
+	return 0;
+}
+
+static void
+tfw_sess_repl_stop(void)
+{
+	if (!sess_repl_enabled)
+		return;
+
+	WRITE_ONCE(sess_repl_enabled, false);
+	kthread_stop(sess_repl_thr);
+	sess_repl_thr = NULL;
+	sock_release(sess_repl_sock);
+	sess_repl_sock = NULL;
+}
+
+static int
+tfw_sess_repl_start(void)
+{
+	int r, cpu;
+	TfwSessReplQueue *q;
+	struct task_struct *t;
+
+	if (tfw_runstate_is_reconfig() || !sess_repl_cfg.peers_n)
+		return 0;
+
+	for_each_possible_cpu(cpu) {
+		q = per_cpu_ptr(&sess_repl_q, cpu);
+		spin_lock_init(&q->lock);
+		q->len = sizeof(TfwSessReplHdr);
+		q->n = 0;
+	}
+
+	r = sock_create_kern(&init_net, AF_INET6, SOCK_DGRAM, IPPROTO_UDP,
+			     &sess_repl_sock);
+	if (r) {
+		T_ERR_NL("sess_repl: cannot create socket, %d\n", r);
+		return r;
+	}
+	r = kernel_bind(sess_repl_sock,
+			tfw_addr_sa(&sess_repl_cfg.listen),
+			tfw_addr_sa_len(&sess_repl_cfg.listen));
+	if (r) {
+		T_ERR_NL("sess_repl: cannot bind socket, %d\n", r);
+		goto err;
+	}
+
+	t = kthread_run(tfw_sess_repl_thread, NULL, "tfw_sess_repl");
+	if (IS_ERR(t)) {
+		r = PTR_ERR(t);
+		T_ERR_NL("sess_repl: cannot start thread, %d\n", r);
+		goto err;
+	}
+	sess_repl_thr = t;
+	WRITE_ONCE(sess_repl_enabled, true);
+
+	return 0;
+err:
+	sock_release(sess_repl_sock);
+	sess_repl_sock = NULL;
+	return r;
+}
+
+static int
+tfw_cfgop_sess_repl_addr(TfwCfgEntry *ce, TfwAddr *addr)
+{
+	int port;
+	const char *in_str;
+
+	if (tfw_cfg_check_val_n(ce, 1) || ce->attr_n)
+		return -EINVAL;
+	in_str = ce->vals[0];
+
+	/* A single port means all the addresses at the port. */
+	if (!tfw_cfg_parse_int(in_str, &port)) {
+		if (tfw_cfg_check_range(port, 1, 65535))
+			return -EINVAL;
+		*addr = (TfwAddr){
+			.sin6_family	= AF_INET6,
+			.sin6_addr	= in6addr_any,
+			.sin6_port	= htons(port)
+		};
+		return 0;
+	}
+
+	return tfw_addr_pton(&TFW_STR_FROM_CSTR(in_str), addr);
+}
+
+static int
+tfw_cfgop_sess_repl_listen(TfwCfgSpec *cs, TfwCfgEntry *ce)
+{
+	if (tfw_cfgop_sess_repl_addr(ce, &sess_repl_cfg.listen)) {
+		T_ERR_NL("Invalid address for '%s'\n", cs->name);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static int
+tfw_cfgop_sess_repl_peer(TfwCfgSpec *cs, TfwCfgEntry *ce)
+{
+	TfwAddr *addr;
+
+	if (sess_repl_cfg.peers_n == TFW_SESS_REPL_PEERS_MAX) {
+		T_ERR_NL("Too many '%s' entries, %d is the maximum\n",
+			 cs->name, TFW_SESS_REPL_PEERS_MAX);
+		return -EINVAL;
+	}
+	addr = &sess_repl_cfg.peers[sess_repl_cfg.peers_n];
+	if (tfw_cfgop_sess_repl_addr(ce, addr)
+	    || ipv6_addr_any(&addr->sin6_addr))
+	{
+		T_ERR_NL("Invalid address for '%s'\n", cs->name);
+		return -EINVAL;
+	}
+	sess_repl_cfg.peers_n++;
+
+	return 0;
+}
+
+static void
+tfw_cfgop_sess_repl_cleanup(TfwCfgSpec *cs)
+{
+	sess_repl_cfg.peers_n = 0;
+}
+
+static TfwCfgSpec tfw_sess_repl_specs[] = {
+	{
+		.name = "sessions_repl_listen",
+		.deflt = "7700",
+		.handler = tfw_cfgop_sess_repl_listen,
+	},
+	{
+		.name = "sessions_repl_peer",
+		.handler = tfw_cfgop_sess_repl_peer,
+		.cleanup = tfw_cfgop_sess_repl_cleanup,
+		.allow_none = true,
+		.allow_repeat = true,
+	},
+	{
+		.name = "sessions_repl_interval",
+		.deflt = "100",
+		.handler = tfw_cfg_set_int,
+		.dest = &sess_repl_cfg.interval,
+		.spec_ext = &(TfwCfgSpecInt) {
+			.range = { 1, 10000 },
+		}
+	},
+	{ 0 }
+};
+
+TfwMod tfw_http_sess_repl_mod = {
+	.name	= "http_sess_repl",
+	.start	= tfw_sess_repl_start,
+	.stop	= tfw_sess_repl_stop,
+	.specs	= tfw_sess_repl_specs,
+};
+
+int __init
+tfw_http_sess_repl_init(void)
+{
+	tfw_mod_register(&tfw_http_sess_repl_mod);
+
+	return 0;
+}
+
+void
+tfw_http_sess_repl_exit(void)
+{
+	tfw_mod_unregister(&tfw_http_sess_repl_mod);
+}
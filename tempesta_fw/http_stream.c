@@ -23,11 +23,31 @@
 #if DBG_HTTP_STREAM == 0
 #undef DEBUG
 #endif
+#include "lib/str.h"
 #include "http_frame.h"
+#include "ss_skb.h"
 
 #define HTTP2_DEF_WEIGHT	16
+#define HTTP2_MAX_WEIGHT	256
+#define TFW_STREAM_MAG_SZ	64
+
+/**
+ * Per-CPU magazine of free stream objects.
+ *
+ * Short-lived connections create and free streams at high rates, so freed
+ * streams are kept on the current CPU for the next allocations, and only
+ * the streams out of the magazine space go to the slab cache.
+ *
+ * @n		- number of the cached streams;
+ * @streams	- the cached streams;
+ */
+typedef struct {
+	unsigned int	n;
+	TfwStream	*streams[TFW_STREAM_MAG_SZ];
+} TfwStreamMag;
 
 static struct kmem_cache *stream_cache;
+static DEFINE_PER_CPU(TfwStreamMag, stream_mag);
 
 int
 tfw_h2_stream_cache_create(void)
@@ -43,9 +63,54 @@ tfw_h2_stream_cache_create(void)
 void
 tfw_h2_stream_cache_destroy(void)
 {
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		TfwStreamMag *mag = per_cpu_ptr(&stream_mag, cpu);
+
+		while (mag->n)
+			kmem_cache_free(stream_cache, mag->streams[--mag->n]);
+	}
 	kmem_cache_destroy(stream_cache);
 }
 
+static TfwStream *
+tfw_h2_stream_alloc(void)
+{
+	TfwStream *stream = NULL;
+	TfwStreamMag *mag;
+
+	local_bh_disable();
+	mag = this_cpu_ptr(&stream_mag);
+	if (likely(mag->n))
+		stream = mag->streams[--mag->n];
+	local_bh_enable();
+
+	if (unlikely(!stream))
+		return kmem_cache_alloc(stream_cache, GFP_ATOMIC | __GFP_ZERO);
+
+	bzero_fast(stream, sizeof(*stream));
+
+	return stream;
+}
+
+static void
+tfw_h2_stream_free(TfwStream *stream)
+{
+	TfwStreamMag *mag;
+
+	local_bh_disable();
+	mag = this_cpu_ptr(&stream_mag);
+	if (likely(mag->n < TFW_STREAM_MAG_SZ)) {
+		mag->streams[mag->n++] = stream;
+		stream = NULL;
+	}
+	local_bh_enable();
+
+	if (unlikely(stream))
+		kmem_cache_free(stream_cache, stream);
+}
+
 /*
  * Stream FSM processing during frames receipt (see RFC 7540 section
  * 5.1 for details).
@@ -89,9 +154,10 @@ tfw_h2_stream_fsm(TfwStream *stream, unsigned char type, unsigned char flags,
 	case HTTP2_STREAM_LOC_RESERVED:
 	case HTTP2_STREAM_REM_RESERVED:
 		/*
-		 * TODO: reserved states is not used for now, since client
-		 * cannot push (RFC 7540 section 8.2), and Server Push on
-		 * our side will be implemented in #1194.
+		 * Reserved states aren't used, since client cannot push (RFC
+		 * 7540 section 8.2), and the streams pushed on our side are
+		 * moved to 'half-closed (remote)' state right away, see
+		 * tfw_h2_push_promise().
 		 */
 		BUG();
 
@@ -305,21 +371,43 @@ done:
 
 static inline void
 tfw_h2_init_stream(TfwStream *stream, unsigned int id, unsigned short weight,
-		   unsigned int wnd)
+		   unsigned int loc_wnd, unsigned int rem_wnd)
 {
 	RB_CLEAR_NODE(&stream->node);
 	INIT_LIST_HEAD(&stream->hcl_node);
+	INIT_LIST_HEAD(&stream->sib_node);
+	INIT_LIST_HEAD(&stream->deps.children);
 	spin_lock_init(&stream->st_lock);
 	stream->id = id;
 	stream->state = HTTP2_STREAM_OPENED;
-	stream->loc_wnd = wnd;
+	stream->loc_wnd = loc_wnd;
+	stream->rem_wnd = rem_wnd;
 	stream->weight = weight ? weight : HTTP2_DEF_WEIGHT;
 }
 
+/*
+ * Client-initiated streams have odd IDs, so the lowest bit is dropped.
+ */
+static inline TfwStream **
+tfw_h2_stream_cache_slot(TfwStreamSched *sched, unsigned int id)
+{
+	return &sched->cache[(id >> 1) & (TFW_STREAM_CACHE_SZ - 1)];
+}
+
+/*
+ * The cache is filled on a stream creation and cleared on its removal, both
+ * are done in the receiving flow under the connection lock, so the stream
+ * read from the cache in the receiving flow, or under the lock in other
+ * flows, is alive.
+ */
 TfwStream *
 tfw_h2_find_stream(TfwStreamSched *sched, unsigned int id)
 {
 	struct rb_node *node = sched->streams.rb_node;
+	TfwStream *cached = READ_ONCE(*tfw_h2_stream_cache_slot(sched, id));
+
+	if (cached && cached->id == id)
+		return cached;
 
 	while (node) {
 		TfwStream *stream = rb_entry(node, TfwStream, node);
@@ -337,7 +425,7 @@ tfw_h2_find_stream(TfwStreamSched *sched, unsigned int id)
 
 TfwStream *
 tfw_h2_add_stream(TfwStreamSched *sched, unsigned int id, unsigned short weight,
-		  unsigned int wnd)
+		  unsigned int loc_wnd, unsigned int rem_wnd)
 {
 	TfwStream *new_stream;
 	struct rb_node **new = &sched->streams.rb_node;
@@ -357,14 +445,15 @@ tfw_h2_add_stream(TfwStreamSched *sched, unsigned int id, unsigned short weight,
 		}
 	}
 
-	new_stream = kmem_cache_alloc(stream_cache, GFP_ATOMIC | __GFP_ZERO);
+	new_stream = tfw_h2_stream_alloc();
 	if (unlikely(!new_stream))
 		return NULL;
 
-	tfw_h2_init_stream(new_stream, id, weight, wnd);
+	tfw_h2_init_stream(new_stream, id, weight, loc_wnd, rem_wnd);
 
 	rb_link_node(&new_stream->node, parent, new);
 	rb_insert_color(&new_stream->node, &sched->streams);
+	WRITE_ONCE(*tfw_h2_stream_cache_slot(sched, id), new_stream);
 
 	return new_stream;
 }
@@ -372,52 +461,237 @@ tfw_h2_add_stream(TfwStreamSched *sched, unsigned int id, unsigned short weight,
 void
 tfw_h2_delete_stream(TfwStream *stream)
 {
-	kmem_cache_free(stream_cache, stream);
+	tfw_h2_stream_free(stream);
+}
+
+static inline TfwStreamDeps *
+tfw_h2_stream_parent_deps(TfwStreamSched *sched, TfwStream *stream)
+{
+	return stream->parent ? &stream->parent->deps : &sched->root;
+}
+
+/*
+ * Add @n ready streams to the subtrees of @stream and all its ancestors.
+ * A subtree which becomes ready doesn't get the bandwidth missed while it
+ * was idle: its virtual time catches up with the siblings.
+ */
+static void
+__tfw_h2_sched_nready_add(TfwStreamSched *sched, TfwStream *stream, int n)
+{
+	for ( ; stream; stream = stream->parent) {
+		if (!stream->deps.nready && n > 0) {
+			TfwStreamDeps *pd = tfw_h2_stream_parent_deps(sched,
+								      stream);
+
+			stream->vtime = max(stream->vtime, pd->vclock);
+		}
+		stream->deps.nready += n;
+	}
+	sched->root.nready += n;
+}
+
+/*
+ * Make @stream with all its subtree dependent on @dep, or on the tree root
+ * if @dep is NULL.
+ */
+static void
+tfw_h2_sched_move(TfwStreamSched *sched, TfwStream *stream, TfwStream *dep)
+{
+	int n = stream->deps.nready;
+	TfwStreamDeps *pd;
+
+	if (!list_empty(&stream->sib_node)) {
+		__tfw_h2_sched_nready_add(sched, stream->parent, -n);
+		list_del(&stream->sib_node);
+	}
+
+	stream->parent = dep;
+	pd = tfw_h2_stream_parent_deps(sched, stream);
+	list_add_tail(&stream->sib_node, &pd->children);
+
+	if (n) {
+		stream->vtime = max(stream->vtime, pd->vclock);
+		__tfw_h2_sched_nready_add(sched, dep, n);
+	}
+}
+
+static bool
+tfw_h2_stream_is_dep(TfwStream *stream, TfwStream *anc)
+{
+	for (stream = stream->parent; stream; stream = stream->parent)
+		if (stream == anc)
+			return true;
+
+	return false;
 }
 
+/*
+ * Find the stream which a new stream depends on. A dependency on a stream,
+ * which isn't in the tree, results in the default priority (RFC 7540
+ * section 5.3.1), i.e. the dependency on the tree root.
+ */
 int
 tfw_h2_find_stream_dep(TfwStreamSched *sched, unsigned int id, TfwStream **dep)
 {
-	/*
-	 * TODO: implement dependency/priority logic (according to RFC 7540
-	 * section 5.3) in context of #1196.
-	 */
+	*dep = id ? tfw_h2_find_stream(sched, id) : NULL;
+
 	return 0;
 }
 
+/*
+ * Add just created @stream to the dependency tree: @stream depends on @dep
+ * (or on the tree root if @dep is NULL) and becomes the sole dependency of
+ * @dep if @excl is set (RFC 7540 section 5.3.3).
+ */
 void
 tfw_h2_add_stream_dep(TfwStreamSched *sched, TfwStream *stream, TfwStream *dep,
 		      bool excl)
 {
-	/*
-	 * TODO: implement dependency/priority logic (according to RFC 7540
-	 * section 5.3) in context of #1196.
-	 */
+	TfwStreamDeps *dd = dep ? &dep->deps : &sched->root;
+	TfwStream *child, *tmp;
+
+	if (excl)
+		list_for_each_entry_safe(child, tmp, &dd->children, sib_node)
+			tfw_h2_sched_move(sched, child, stream);
+
+	tfw_h2_sched_move(sched, stream, dep);
 }
 
+/*
+ * Reprioritize stream @stream_id by a PRIORITY frame (RFC 7540 section
+ * 5.3.3). If the new parent depends on the stream, then the parent is moved
+ * to the former stream parent first.
+ */
 void
 tfw_h2_change_stream_dep(TfwStreamSched *sched, unsigned int stream_id,
 			 unsigned int new_dep, unsigned short new_weight,
 			 bool excl)
 {
-	/*
-	 * TODO: implement dependency/priority logic (according to RFC 7540
-	 * section 5.3) in context of #1196.
-	 */
+	TfwStream *stream, *dep, *child, *tmp;
+
+	if (!(stream = tfw_h2_find_stream(sched, stream_id)))
+		return;
+
+	tfw_h2_find_stream_dep(sched, new_dep, &dep);
+	if (new_dep && !dep)
+		new_weight = HTTP2_DEF_WEIGHT;
+	if (dep && tfw_h2_stream_is_dep(dep, stream))
+		tfw_h2_sched_move(sched, dep, stream->parent);
+
+	if (excl) {
+		TfwStreamDeps *dd = dep ? &dep->deps : &sched->root;
+
+		list_for_each_entry_safe(child, tmp, &dd->children, sib_node)
+			if (child != stream)
+				tfw_h2_sched_move(sched, child, stream);
+	}
+
+	tfw_h2_sched_move(sched, stream, dep);
+	stream->weight = new_weight ? new_weight : HTTP2_DEF_WEIGHT;
 }
 
+/*
+ * Remove @stream from the dependency tree. The stream dependents become
+ * dependent on the stream parent and share the stream weight proportionally
+ * to their weights (RFC 7540 section 5.3.4).
+ */
 static void
 tfw_h2_remove_stream_dep(TfwStreamSched *sched, TfwStream *stream)
 {
-	/*
-	 * TODO: implement dependency/priority logic (according to RFC 7540
-	 * section 5.3) in context of #1196.
-	 */
+	TfwStream *child, *tmp;
+	unsigned int total = 0;
+
+	list_for_each_entry(child, &stream->deps.children, sib_node)
+		total += child->weight;
+
+	list_for_each_entry_safe(child, tmp, &stream->deps.children,
+				 sib_node)
+	{
+		child->weight = max(1U, stream->weight * child->weight / total);
+		tfw_h2_sched_move(sched, child, stream->parent);
+	}
+
+	if (!list_empty(&stream->sib_node)) {
+		__tfw_h2_sched_nready_add(sched, stream->parent,
+					  -(int)stream->deps.nready);
+		list_del_init(&stream->sib_node);
+	}
 }
 
 void
 tfw_h2_stop_stream(TfwStreamSched *sched, TfwStream *stream)
 {
+	TfwStream **slot = tfw_h2_stream_cache_slot(sched, stream->id);
+
+	ss_skb_queue_purge(&stream->xmit);
+	tfw_h2_sched_update(sched, stream);
 	tfw_h2_remove_stream_dep(sched, stream);
+	if (*slot == stream)
+		WRITE_ONCE(*slot, NULL);
 	rb_erase(&stream->node, &sched->streams);
 }
+
+void
+tfw_h2_sched_init(TfwStreamSched *sched)
+{
+	INIT_LIST_HEAD(&sched->root.children);
+}
+
+/*
+ * Account @stream as ready for transmission, or not, depending on its
+ * pending data and flow control window.
+ */
+void
+tfw_h2_sched_update(TfwStreamSched *sched, TfwStream *stream)
+{
+	bool ready = stream->xmit && (long)stream->xmit_len <= stream->rem_wnd;
+
+	if (ready == stream->xmit_ready)
+		return;
+	stream->xmit_ready = ready;
+	__tfw_h2_sched_nready_add(sched, stream, ready ? 1 : -1);
+}
+
+/*
+ * Choose the stream to send the next frame: descend from the tree root by
+ * the siblings with ready subtrees and the lowest virtual time until a ready
+ * stream. The siblings are scanned linearly since the number of concurrent
+ * streams with pending data isn't large.
+ */
+TfwStream *
+tfw_h2_sched_next(TfwStreamSched *sched)
+{
+	TfwStreamDeps *deps = &sched->root;
+	TfwStream *stream, *next;
+
+	while (deps->nready) {
+		next = NULL;
+		list_for_each_entry(stream, &deps->children, sib_node)
+			if (stream->deps.nready
+			    && (!next || stream->vtime < next->vtime))
+				next = stream;
+		if (WARN_ON_ONCE(!next))
+			return NULL;
+		if (next->xmit_ready)
+			return next;
+		deps = &next->deps;
+	}
+
+	return NULL;
+}
+
+/*
+ * Account @len bytes sent by @stream in the virtual time of the stream and
+ * all its ancestors.
+ */
+void
+tfw_h2_sched_charge(TfwStreamSched *sched, TfwStream *stream, unsigned int len)
+{
+	for ( ; stream; stream = stream->parent) {
+		TfwStreamDeps *pd = tfw_h2_stream_parent_deps(sched, stream);
+
+		pd->vclock = stream->vtime;
+		stream->vtime += (unsigned long)len * HTTP2_MAX_WEIGHT
+				 / stream->weight;
+	}
+}
@@ -80,41 +80,90 @@ typedef enum {
 	HTTP2_ECODE_HTTP_1_1_REQUIRED
 } TfwH2Err;
 
+/**
+ * Node of the streams dependency tree (RFC 7540 section 5.3): either a stream
+ * or the tree root, i.e. the connection itself.
+ *
+ * @children	- streams depending on the node;
+ * @vclock	- virtual time of the last scheduled child;
+ * @nready	- number of streams ready for transmission in the subtree of
+ *		  the node, including the node itself;
+ */
+typedef struct {
+	struct list_head	children;
+	unsigned long		vclock;
+	unsigned int		nready;
+} TfwStreamDeps;
+
 /**
  * Representation of HTTP/2 stream entity.
  *
  * @node	- entry in per-connection storage of streams (red-black tree);
  * @hcl_node	- entry in queue of half-closed streams;
+ * @sib_node	- entry in the list of the stream siblings in the dependency
+ *		  tree;
+ * @parent	- the stream which the stream depends on, NULL if the stream
+ *		  depends on the tree root;
+ * @deps	- the stream dependents;
+ * @vtime	- virtual time of the stream among its siblings;
  * @id		- stream ID;
  * @state	- stream's current state;
  * @st_lock	- spinlock to synchronize concurrent access to stream FSM;
  * @loc_wnd	- stream's current flow controlled window;
+ * @rem_wnd	- stream's flow controlled window of the remote peer, can be
+ *		  negative after SETTINGS_INITIAL_WINDOW_SIZE change;
+ * @xmit	- DATA frames of the response waiting for transmission;
+ * @xmit_len	- payload length of the first frame in @xmit;
+ * @xmit_ready	- the first frame in @xmit fits @rem_wnd;
  * @weight	- stream's priority weight;
  * @msg		- message that is currently being processed;
  * @parser	- the state of message processing;
  */
-typedef struct {
+typedef struct tfw_stream_t {
 	struct rb_node		node;
 	struct list_head	hcl_node;
+	struct list_head	sib_node;
+	struct tfw_stream_t	*parent;
+	TfwStreamDeps		deps;
+	unsigned long		vtime;
 	unsigned int		id;
 	int			state;
 	spinlock_t		st_lock;
 	unsigned int		loc_wnd;
+	long			rem_wnd;
+	struct sk_buff		*xmit;
+	unsigned int		xmit_len;
+	bool			xmit_ready;
 	unsigned short		weight;
 	TfwMsg			*msg;
 	TfwHttpParser		parser;
 } TfwStream;
 
+/*
+ * Size of the direct-mapped cache of streams. Clients allocate stream IDs
+ * sequentially, so the concurrent streams of a client don't collide in the
+ * cache unless there are more of them than slots.
+ */
+#define TFW_STREAM_CACHE_SZ		128
+
 /**
  * Scheduler for stream's processing distribution based on dependency/priority
- * values.
- * TODO: the structure is not completed yet and should be finished in context
- * of #1196.
+ * values. The streams ready for transmission share the connection by the
+ * weighted fair queuing among siblings: each stream accounts the data sent
+ * by it and its dependents in its virtual time inversely proportional to its
+ * weight and the sibling with the lowest virtual time goes next. A stream is
+ * served before its dependents, which get its share only when it has nothing
+ * to send (RFC 7540 section 5.3.2).
  *
  * @streams	- root red-black tree entry for per-connection streams' storage;
+ * @root	- root of the streams dependency tree;
+ * @cache	- the last created streams indexed by stream ID, looked up
+ *		  before @streams;
  */
 typedef struct {
-	struct rb_root streams;
+	struct rb_root	streams;
+	TfwStreamDeps	root;
+	TfwStream	*cache[TFW_STREAM_CACHE_SZ];
 } TfwStreamSched;
 
 int tfw_h2_stream_cache_create(void);
@@ -124,7 +173,8 @@ TfwStreamFsmRes tfw_h2_stream_fsm(TfwStream *stream, unsigned char type,
 				  TfwH2Err *err);
 TfwStream *tfw_h2_find_stream(TfwStreamSched *sched, unsigned int id);
 TfwStream *tfw_h2_add_stream(TfwStreamSched *sched, unsigned int id,
-			     unsigned short weight, unsigned int wnd);
+			     unsigned short weight, unsigned int loc_wnd,
+			     unsigned int rem_wnd);
 void tfw_h2_delete_stream(TfwStream *stream);
 int tfw_h2_find_stream_dep(TfwStreamSched *sched, unsigned int id,
 			   TfwStream **dep);
@@ -134,6 +184,11 @@ void tfw_h2_change_stream_dep(TfwStreamSched *sched, unsigned int stream_id,
 			      unsigned int new_dep, unsigned short new_weight,
 			      bool excl);
 void tfw_h2_stop_stream(TfwStreamSched *sched, TfwStream *stream);
+void tfw_h2_sched_init(TfwStreamSched *sched);
+void tfw_h2_sched_update(TfwStreamSched *sched, TfwStream *stream);
+TfwStream *tfw_h2_sched_next(TfwStreamSched *sched);
+void tfw_h2_sched_charge(TfwStreamSched *sched, TfwStream *stream,
+			 unsigned int len);
 
 static inline bool
 tfw_h2_stream_req_complete(TfwStream *stream)
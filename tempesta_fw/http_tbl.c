@@ -57,6 +57,12 @@
  *       host == "site2.example.com"   -> ws2;
  *   }
  *
+ * The 'host' action passes requests to the virtual host named by the host,
+ * e.g. "a.example.com" to "a.example.com" or to wildcard "*.example.com",
+ * or to the default virtual host. The lookup is one walk through the trie
+ * of the reversed virtual hosts names, shared with TLS SNI:
+ *                       -> host;
+ *
  * There's also a default match rule that looks like this:
  *                       -> storage;
  * This rule works as last resort option, and if specified it applies designated
@@ -106,6 +112,7 @@
 #include "tempesta_fw.h"
 #include "cfg.h"
 #include "http_match.h"
+#include "http_msg.h"
 #include "server.h"
 
 /* Active HTTP table. */
@@ -115,10 +122,33 @@ static TfwHttpTable *tfw_table_reconfig;
 /* Entry for configuration particular HTTP chain of rules. */
 static TfwHttpChain *tfw_chain_entry;
 
+/*
+ * Find the vhost named by the host of @req, exactly or by a wildcard vhost
+ * name, or the default vhost. The host is taken like in match_host().
+ */
+static TfwVhost *
+tfw_http_tbl_vhost_by_host(TfwHttpReq *req)
+{
+	TfwStr host;
+	TfwVhost *vhost;
+
+	if (req->host.len)
+		host = req->host;
+	else
+		tfw_http_msg_clnthdr_val(req,
+					 &req->h_tbl->tbl[TFW_HTTP_HDR_HOST],
+					 TFW_HTTP_HDR_HOST, &host);
+	if ((vhost = tfw_vhost_lookup(&host)))
+		return vhost;
+
+	return tfw_vhost_lookup_default();
+}
+
 /*
  * Scan all rules in linked chains of current active HTTP table. Main HTTP
  * chain is processed primarily (must be first in the table list); if rule
  * of some chain points to other chain - move to that chain and scan it.
+ * A reference is taken on the returned vhost.
  */
 static TfwVhost *
 tfw_http_tbl_scan(TfwMsg *msg, TfwHttpTable *table, bool *block)
@@ -144,8 +174,12 @@ tfw_http_tbl_scan(TfwMsg *msg, TfwHttpTable *table, bool *block)
 	}
 
 	/* If rule points to virtual host, return the pointer. */
-	if (rule->act.type == TFW_HTTP_MATCH_ACT_VHOST)
-		return  rule->act.vhost;
+	if (rule->act.type == TFW_HTTP_MATCH_ACT_VHOST) {
+		tfw_vhost_get(rule->act.vhost);
+		return rule->act.vhost;
+	}
+	if (rule->act.type == TFW_HTTP_MATCH_ACT_HOST)
+		return tfw_http_tbl_vhost_by_host((TfwHttpReq *)msg);
 
 	/* If rule has 'block' action, request must be blocked. */
 	if (rule->act.type == TFW_HTTP_MATCH_ACT_BLOCK)
@@ -174,13 +208,30 @@ tfw_http_tbl_vhost(TfwMsg *msg, bool *block)
 		goto done;
 
 	BUG_ON(list_empty(&active_table->head));
-	if ((vhost = tfw_http_tbl_scan(msg, active_table, block)))
-		tfw_vhost_get(vhost);
+	vhost = tfw_http_tbl_scan(msg, active_table, block);
 done:
  	rcu_read_unlock_bh();
  	return vhost;
 }
 
+/*
+ * Whether the virtual host of a request is determined by its host alone,
+ * see tfw_http_tbl_vhost().
+ */
+bool
+tfw_http_tbl_by_host(void)
+{
+	bool r;
+	TfwHttpTable *active_table;
+
+	rcu_read_lock_bh();
+	active_table = rcu_dereference_bh(tfw_table);
+	r = active_table && active_table->by_host;
+	rcu_read_unlock_bh();
+
+	return r;
+}
+
 /*
  * ------------------------------------------------------------------------
  *	Configuration handling
@@ -452,6 +503,8 @@ tfw_cfgop_http_rule(TfwCfgSpec *cs, TfwCfgEntry *e)
 		return -EINVAL;
 	} else if (!strcasecmp(action, "block")) {
 		rule->act.type = TFW_HTTP_MATCH_ACT_BLOCK;
+	} else if (!strcasecmp(action, "host")) {
+		rule->act.type = TFW_HTTP_MATCH_ACT_HOST;
 	} else if ((chain = tfw_chain_lookup(action))) {
 		rule->act.type = TFW_HTTP_MATCH_ACT_CHAIN;
 		rule->act.chain = chain;
@@ -512,9 +565,37 @@ tfw_cfgop_replace_active_table(TfwHttpTable *new_table)
 	tfw_cfgop_free_table(active_table);
 }
 
+/*
+ * Returns non-zero if the rule looks at anything besides the host or has
+ * side effects on the request.
+ */
+static int
+tfw_cfgop_rule_beyond_host(TfwHttpMatchRule *rule)
+{
+	return (rule->field != TFW_HTTP_MATCH_F_WILDCARD
+		&& rule->field != TFW_HTTP_MATCH_F_HOST)
+	       || rule->act.type == TFW_HTTP_MATCH_ACT_MARK;
+}
+
 static int
 tfw_http_tbl_start(void)
 {
+	int r = 0;
+	TfwHttpChain *chain;
+
+	list_for_each_entry(chain, &tfw_table_reconfig->head, list) {
+		if ((r = tfw_http_chain_compile(chain))) {
+			T_ERR_NL("http_tbl: can't compile chain '%s'\n",
+				 chain->name ? : "main");
+			return r;
+		}
+	}
+
+	list_for_each_entry(chain, &tfw_table_reconfig->head, list)
+		r |= tfw_http_chain_rules_for_each(chain,
+						   tfw_cfgop_rule_beyond_host);
+	tfw_table_reconfig->by_host = !r;
+
 	tfw_cfgop_replace_active_table(tfw_table_reconfig);
 	tfw_table_reconfig = NULL;
 
@@ -46,15 +46,19 @@ typedef struct {
  * @head	- List of configured HTTP chains.
  * @chain_dflt	- Flag to indicate whether the chain with default rule is
  *		  present in configuration or not.
+ * @by_host	- All the rules match the host only and don't set marks, so
+ *		  requests with the same host get the same virtual host.
  * @pool	- Allocation pool for HTTP table (and all its chains and rules).
  */
 typedef struct {
 	struct list_head head;
 	bool chain_dflt;
+	bool by_host;
 	TfwPool *pool;
 } TfwHttpTable;
 
 TfwVhost *tfw_http_tbl_vhost(TfwMsg *msg, bool *block);
+bool tfw_http_tbl_by_host(void);
 int tfw_http_tbl_method(const char *arg, tfw_http_meth_t *method);
 
 #endif /* __HTTP_TBL__ */
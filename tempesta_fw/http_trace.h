@@ -0,0 +1,269 @@
+/**
+ *		Tempesta FW
+ *
+ * Tracepoints of the connections, HTTP requests and TLS handshakes processing.
+ *
+ * The tracepoints are always compiled in and cost just a static branch while
+ * disabled. Enabled events are written into the per-CPU lock-less ftrace ring
+ * buffers with nanosecond timestamps and are available for perf and bpftrace
+ * as tempesta:<event>, e.g.
+ *
+ *	perf record -e 'tempesta:*' -a
+ *	bpftrace -e 'tracepoint:tempesta:tfw_frang_block { @[str(args->check)]
+ *		     = count(); }'
+ *
+ * Pointers to the connections and the requests are recorded as is to match
+ * the events of the same object.
+ *
+ * Copyright (C) 2020 Tempesta Technologies, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM tempesta
+
+#if !defined(__TFW_HTTP_TRACE_H__) || defined(TRACE_HEADER_MULTI_READ)
+#define __TFW_HTTP_TRACE_H__
+
+#include <linux/tracepoint.h>
+
+#include "addr.h"
+#include "procfs.h"
+
+DECLARE_EVENT_CLASS(tfw_conn_class,
+
+	TP_PROTO(void *conn, unsigned int type),
+
+	TP_ARGS(conn, type),
+
+	TP_STRUCT__entry(
+		__field(void *,		conn)
+		__field(unsigned int,	type)
+	),
+
+	TP_fast_assign(
+		__entry->conn = conn;
+		__entry->type = type;
+	),
+
+	TP_printk("conn=%p type=%#x", __entry->conn, __entry->type)
+);
+
+/* Connection @conn of type TFW_CONN_TYPE() @type is established. */
+DEFINE_EVENT(tfw_conn_class, tfw_conn_new,
+	TP_PROTO(void *conn, unsigned int type),
+	TP_ARGS(conn, type)
+);
+
+/* Tempesta FW closes connection @conn. */
+DEFINE_EVENT(tfw_conn_class, tfw_conn_close,
+	TP_PROTO(void *conn, unsigned int type),
+	TP_ARGS(conn, type)
+);
+
+/* Connection @conn is dropped, either by the peer or by Tempesta FW. */
+DEFINE_EVENT(tfw_conn_class, tfw_conn_drop,
+	TP_PROTO(void *conn, unsigned int type),
+	TP_ARGS(conn, type)
+);
+
+/* The last reference to connection @conn is released. */
+DEFINE_EVENT(tfw_conn_class, tfw_conn_release,
+	TP_PROTO(void *conn, unsigned int type),
+	TP_ARGS(conn, type)
+);
+
+/* A new request @req is received through client connection @conn. */
+TRACE_EVENT(tfw_http_req_start,
+
+	TP_PROTO(void *req, void *conn),
+
+	TP_ARGS(req, conn),
+
+	TP_STRUCT__entry(
+		__field(void *,		req)
+		__field(void *,		conn)
+	),
+
+	TP_fast_assign(
+		__entry->req = req;
+		__entry->conn = conn;
+	),
+
+	TP_printk("req=%p conn=%p", __entry->req, __entry->conn)
+);
+
+/* Response @status of @len bytes to request @req is sent to the client. */
+TRACE_EVENT(tfw_http_req_end,
+
+	TP_PROTO(void *req, unsigned short status, unsigned long len),
+
+	TP_ARGS(req, status, len),
+
+	TP_STRUCT__entry(
+		__field(void *,		req)
+		__field(unsigned short,	status)
+		__field(unsigned long,	len)
+	),
+
+	TP_fast_assign(
+		__entry->req = req;
+		__entry->status = status;
+		__entry->len = len;
+	),
+
+	TP_printk("req=%p status=%u len=%lu", __entry->req, __entry->status,
+		  __entry->len)
+);
+
+/*
+ * Request @req is scheduled to server connection @srv_conn to server @addr.
+ * @srv_conn and @addr are NULL if no server connection is available.
+ */
+TRACE_EVENT(tfw_http_sched,
+
+	TP_PROTO(void *req, void *srv_conn, const TfwAddr *addr),
+
+	TP_ARGS(req, srv_conn, addr),
+
+	TP_STRUCT__entry(
+		__field(void *,		req)
+		__field(void *,		srv_conn)
+		__array(u8,		addr, sizeof(struct in6_addr))
+		__field(u16,		port)
+	),
+
+	TP_fast_assign(
+		__entry->req = req;
+		__entry->srv_conn = srv_conn;
+		if (addr) {
+			memcpy(__entry->addr, &addr->sin6_addr,
+			       sizeof(struct in6_addr));
+			__entry->port = ntohs(addr->sin6_port);
+		} else {
+			memset(__entry->addr, 0, sizeof(struct in6_addr));
+			__entry->port = 0;
+		}
+	),
+
+	TP_printk("req=%p srv_conn=%p addr=[%pI6c]:%u", __entry->req,
+		  __entry->srv_conn, __entry->addr, __entry->port)
+);
+
+/* Cache lookup for request @req is finished with a hit or a miss. */
+TRACE_EVENT(tfw_cache_lookup,
+
+	TP_PROTO(void *req, bool hit),
+
+	TP_ARGS(req, hit),
+
+	TP_STRUCT__entry(
+		__field(void *,		req)
+		__field(bool,		hit)
+	),
+
+	TP_fast_assign(
+		__entry->req = req;
+		__entry->hit = hit;
+	),
+
+	TP_printk("req=%p %s", __entry->req, __entry->hit ? "hit" : "miss")
+);
+
+/*
+ * TLS handshake on connection @conn moved to TTLS FSM state @state, the
+ * upper byte of the state is the handshake message, TTLS_HANDSHAKE_OVER
+ * (0x0e000000) means the finished handshake.
+ */
+TRACE_EVENT(tfw_tls_hs,
+
+	TP_PROTO(void *conn, unsigned int state),
+
+	TP_ARGS(conn, state),
+
+	TP_STRUCT__entry(
+		__field(void *,		conn)
+		__field(unsigned int,	state)
+	),
+
+	TP_fast_assign(
+		__entry->conn = conn;
+		__entry->state = state;
+	),
+
+	TP_printk("conn=%p state=%#x", __entry->conn, __entry->state)
+);
+
+/* Frang @check blocked a request or a connection from client @addr. */
+TRACE_EVENT(tfw_frang_block,
+
+	TP_PROTO(const TfwAddr *addr, const char *check),
+
+	TP_ARGS(addr, check),
+
+	TP_STRUCT__entry(
+		__array(u8,		addr, sizeof(struct in6_addr))
+		__string(check,		check)
+	),
+
+	TP_fast_assign(
+		memcpy(__entry->addr, &addr->sin6_addr,
+		       sizeof(struct in6_addr));
+		__assign_str(check, check);
+	),
+
+	TP_printk("addr=%pI6c check=%s", __entry->addr, __get_str(check))
+);
+
+/*
+ * A request processing stage @stage of request @req took @cycles CPU cycles.
+ */
+TRACE_EVENT(tfw_http_stage,
+
+	TP_PROTO(void *req, unsigned int stage, u64 cycles),
+
+	TP_ARGS(req, stage, cycles),
+
+	TP_STRUCT__entry(
+		__field(void *,		req)
+		__field(unsigned int,	stage)
+		__field(u64,		cycles)
+	),
+
+	TP_fast_assign(
+		__entry->req = req;
+		__entry->stage = stage;
+		__entry->cycles = cycles;
+	),
+
+	TP_printk("req=%p stage=%s cycles=%llu", __entry->req,
+		  __print_symbolic(__entry->stage,
+				   { TFW_HTTP_STAGE_PARSE,	"parse" },
+				   { TFW_HTTP_STAGE_CACHE,	"cache" },
+				   { TFW_HTTP_STAGE_SCHED,	"sched" },
+				   { TFW_HTTP_STAGE_UPSTREAM,	"upstream" },
+				   { TFW_HTTP_STAGE_RESP,	"response" },
+				   { TFW_HTTP_STAGE_TOTAL,	"total" }),
+		  __entry->cycles)
+);
+
+#endif /* __TFW_HTTP_TRACE_H__ */
+
+/* The header is included by path relative to the repository root. */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH tempesta_fw
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE http_trace
+#include <trace/define_trace.h>
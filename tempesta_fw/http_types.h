@@ -31,5 +31,7 @@ typedef struct tfw_hdr_mods_t		TfwHdrMods;
 typedef struct frang_global_cfg_t	FrangGlobCfg;
 typedef struct frang_vhost_cfg_t	FrangVhostCfg;
 typedef struct tfw_http_cookie_t	TfwStickyCookie;
+typedef struct tfw_cache_acct_t		TfwCacheAcct;
+typedef struct tfw_cache_stream_t	TfwCacheStream;
 
 #endif /* __TFW_HTTP_TYPES_H__ */
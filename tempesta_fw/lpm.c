@@ -0,0 +1,207 @@
+/**
+ *		Tempesta FW
+ *
+ * Longest prefix match of IP addresses.
+ *
+ * The prefixes are stored in a multibit trie with 4-bit stride. A prefix is
+ * expanded to all the entries of the node where the prefix ends, the entries
+ * remember the prefix length to let longer prefixes override shorter ones.
+ * A lookup just walks down the trie by address nibbles and remembers the
+ * last set entry, so there are at most 8 steps for IPv4 addresses and 32 for
+ * IPv6. The trie is built in process context and it's read-only after that,
+ * so concurrent lookups need just RCU protection of the whole structure.
+ *
+ * Copyright (C) 2020 Tempesta Technologies, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#include <linux/slab.h>
+#include <net/ipv6.h>
+
+#include "lpm.h"
+
+#define TFW_LPM_STRIDE		4
+#define TFW_LPM_FANOUT		(1 << TFW_LPM_STRIDE)
+#define TFW_LPM_V4_OFF		(128 - 32)
+
+/**
+ * @child	- child nodes for the next address nibble;
+ * @plen	- length of the prefix part in the node, 1..TFW_LPM_STRIDE,
+ *		  for the prefix expanded to the entry, or zero;
+ * @val		- value of the prefix expanded to the entry;
+ */
+struct tfw_lpm_node_t {
+	TfwLpmNode	*child[TFW_LPM_FANOUT];
+	unsigned char	plen[TFW_LPM_FANOUT];
+	unsigned char	val[TFW_LPM_FANOUT];
+};
+
+static inline unsigned int
+tfw_lpm_nibble(const unsigned char *key, unsigned int off)
+{
+	return (key[off >> 3] >> ((off & 4) ^ 4)) & (TFW_LPM_FANOUT - 1);
+}
+
+TfwLpm *
+tfw_lpm_new(void)
+{
+	return kzalloc(sizeof(TfwLpm), GFP_KERNEL);
+}
+
+static void
+tfw_lpm_node_free(TfwLpmNode *node)
+{
+	int i;
+
+	for (i = 0; i < TFW_LPM_FANOUT; ++i)
+		if (node->child[i])
+			tfw_lpm_node_free(node->child[i]);
+	kfree(node);
+}
+
+void
+tfw_lpm_free(TfwLpm *lpm)
+{
+	if (!lpm)
+		return;
+	if (lpm->v4.root)
+		tfw_lpm_node_free(lpm->v4.root);
+	if (lpm->v6.root)
+		tfw_lpm_node_free(lpm->v6.root);
+	kfree(lpm);
+}
+
+static TfwLpmNode *
+tfw_lpm_node_get(TfwLpm *lpm, TfwLpmNode **node)
+{
+	if (!*node) {
+		if (!(*node = kzalloc(sizeof(TfwLpmNode), GFP_KERNEL)))
+			return NULL;
+		++lpm->nodes;
+	}
+
+	return *node;
+}
+
+static int
+__tfw_lpm_insert(TfwLpm *lpm, TfwLpmTrie *trie, const unsigned char *key,
+		 unsigned int plen, unsigned char val)
+{
+	unsigned int i, n, r, off = 0;
+	TfwLpmNode *node, **pnode = &trie->root;
+
+	for ( ; ; ) {
+		if (!(node = tfw_lpm_node_get(lpm, pnode)))
+			return -ENOMEM;
+		if (plen - off <= TFW_LPM_STRIDE)
+			break;
+		pnode = &node->child[tfw_lpm_nibble(key, off)];
+		off += TFW_LPM_STRIDE;
+	}
+
+	r = plen - off;
+	n = 1 << (TFW_LPM_STRIDE - r);
+	i = tfw_lpm_nibble(key, off) & ~(n - 1);
+	for (n += i; i < n; ++i) {
+		if (node->plen[i] > r)
+			continue;
+		node->plen[i] = r;
+		node->val[i] = val;
+	}
+
+	return 0;
+}
+
+static void
+__tfw_lpm_insert_dflt(TfwLpmTrie *trie, unsigned int plen, unsigned char val)
+{
+	if (trie->dflt_val && trie->dflt_plen > plen)
+		return;
+	trie->dflt_plen = plen;
+	trie->dflt_val = val;
+}
+
+/**
+ * Insert prefix @addr/@plen with value @val, @val must not be zero. IPv4
+ * prefixes are IPv4-mapped addresses with @plen including the 96 bits of
+ * the mapped prefix, just as tfw_addr_pton_cidr() returns them.
+ */
+int
+tfw_lpm_insert(TfwLpm *lpm, const struct in6_addr *addr, unsigned int plen,
+	       unsigned char val)
+{
+	static const struct in6_addr v4mapped = {
+		.s6_addr32 = { 0, 0, htonl(0x0000ffff), 0 }
+	};
+
+	if (WARN_ON_ONCE(!val || plen > 128))
+		return -EINVAL;
+
+	if (ipv6_addr_v4mapped(addr) && plen >= TFW_LPM_V4_OFF) {
+		plen -= TFW_LPM_V4_OFF;
+		if (!plen) {
+			__tfw_lpm_insert_dflt(&lpm->v4, TFW_LPM_V4_OFF, val);
+			return 0;
+		}
+		return __tfw_lpm_insert(lpm, &lpm->v4, &addr->s6_addr[12],
+					plen, val);
+	}
+
+	/* A short IPv6 prefix may cover all the IPv4-mapped addresses. */
+	if (ipv6_prefix_equal(addr, &v4mapped, plen))
+		__tfw_lpm_insert_dflt(&lpm->v4, plen, val);
+	if (!plen) {
+		__tfw_lpm_insert_dflt(&lpm->v6, 0, val);
+		return 0;
+	}
+
+	return __tfw_lpm_insert(lpm, &lpm->v6, addr->s6_addr, plen, val);
+}
+
+/**
+ * Return value of the longest prefix matching @addr, or zero if there is no
+ * such prefix.
+ */
+unsigned char
+tfw_lpm_lookup(const TfwLpm *lpm, const struct in6_addr *addr)
+{
+	const TfwLpmTrie *trie;
+	const TfwLpmNode *node;
+	const unsigned char *key;
+	unsigned int off, bits;
+	unsigned char val;
+
+	if (ipv6_addr_v4mapped(addr)) {
+		trie = &lpm->v4;
+		key = &addr->s6_addr[12];
+		bits = 32;
+	} else {
+		trie = &lpm->v6;
+		key = addr->s6_addr;
+		bits = 128;
+	}
+
+	val = trie->dflt_val;
+	node = trie->root;
+	for (off = 0; node && off < bits; off += TFW_LPM_STRIDE) {
+		unsigned int i = tfw_lpm_nibble(key, off);
+
+		if (node->plen[i])
+			val = node->val[i];
+		node = node->child[i];
+	}
+
+	return val;
+}
@@ -0,0 +1,64 @@
+/**
+ *		Tempesta FW
+ *
+ * Longest prefix match of IP addresses.
+ *
+ * Copyright (C) 2020 Tempesta Technologies, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#ifndef __TFW_LPM_H__
+#define __TFW_LPM_H__
+
+#include <linux/in6.h>
+
+typedef struct tfw_lpm_node_t TfwLpmNode;
+
+/**
+ * Multibit trie over address bits, a separate trie is used for IPv4-mapped
+ * addresses, so IPv4 lookups don't walk the constant 96 bits prefix.
+ *
+ * @root	- root node of the trie;
+ * @dflt_plen	- prefix length of the shortest prefix covering all the trie
+ *		  addresses;
+ * @dflt_val	- value of the prefix;
+ */
+typedef struct {
+	TfwLpmNode	*root;
+	unsigned char	dflt_plen;
+	unsigned char	dflt_val;
+} TfwLpmTrie;
+
+/**
+ * Set of IPv6 and IPv4-mapped prefixes with values, the value of the longest
+ * prefix matching an address is looked up in O(prefix length / 4) steps.
+ *
+ * @v4		- trie of IPv4-mapped prefixes;
+ * @v6		- trie of IPv6 prefixes;
+ * @nodes	- total number of the tries nodes;
+ */
+typedef struct {
+	TfwLpmTrie	v4;
+	TfwLpmTrie	v6;
+	unsigned long	nodes;
+} TfwLpm;
+
+TfwLpm *tfw_lpm_new(void);
+void tfw_lpm_free(TfwLpm *lpm);
+int tfw_lpm_insert(TfwLpm *lpm, const struct in6_addr *addr,
+		   unsigned int plen, unsigned char val);
+unsigned char tfw_lpm_lookup(const TfwLpm *lpm, const struct in6_addr *addr);
+
+#endif /* __TFW_LPM_H__ */
@@ -21,6 +21,7 @@
 #include <linux/types.h> /* must be the first */
 #include <asm/fpu/api.h>
 #include <linux/kernel.h>
+#include <linux/ktime.h>
 #include <linux/module.h>
 #include <net/net_namespace.h> /* for sysctl */
 
@@ -228,17 +229,22 @@ static int
 tfw_start(struct list_head *mod_list)
 {
 	int ret;
+	ktime_t t0, t1;
 
 	ss_start();
 	if ((ret = tfw_mods_cfgstart(mod_list)))
 		goto cleanup;
 	if ((ret = tfw_cfg_parse(mod_list)))
 		goto cleanup;
+	t0 = ktime_get();
 	if ((ret = tfw_mods_cfgend(mod_list)))
 		goto cleanup;
+	t1 = ktime_get();
 	if ((ret = tfw_mods_start(mod_list)))
 		goto stop_mods;
 	tfw_cfg_conclude(mod_list);
+	T_LOG_NL("Configuration is finished in %lldms and applied in %lldms\n",
+		 ktime_ms_delta(t1, t0), ktime_ms_delta(ktime_get(), t1));
 	WRITE_ONCE(tfw_started, true);
 	return 0;
 stop_mods:
@@ -452,16 +458,22 @@ tfw_init(void)
 	DO_INIT(filter);
 	DO_INIT(cache);
 	DO_INIT(http_sess);
+	DO_INIT(http_sess_repl);
+	DO_INIT(cache_purge_repl);
 
+	DO_INIT(twheel);
 	DO_INIT(sync_socket);
 	DO_INIT(server);
 	DO_INIT(client);
 	DO_INIT(sock_srv);
 	DO_INIT(sock_clnt);
 	DO_INIT(procfs);
+	DO_INIT(access_log);
+	DO_INIT(http_bpf);
 	DO_INIT(http_tbl);
 	DO_INIT(sched_hash);
 	DO_INIT(sched_ratio);
+	DO_INIT(sched_p2c);
 
 	return 0;
 err:
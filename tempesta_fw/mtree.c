@@ -0,0 +1,295 @@
+/**
+ *		Tempesta FW
+ *
+ * First match of a string against a list of match operators.
+ *
+ * Locations, cache policies and non-idempotent requests definitions are
+ * lists of eq, prefix, suffix, wildcard and regex match operators, and the
+ * first matching entry of a list must be found for each request. Instead of
+ * evaluation of each entry, the list is compiled into a match tree: a trie
+ * of the eq and prefix arguments, a trie of the reversed suffix arguments
+ * and a DFA for all the regex arguments. Each trie node keeps the lists of
+ * the keys ending at the node, sorted by the keys order. The string is
+ * walked once forward and once backward through the tries, and the first
+ * key of the visited lists is the first matching key, just like with the
+ * linear matching of the list.
+ *
+ * The tree is built once on configuration start and is read-only after
+ * that, so it doesn't need any synchronization. The children of a node
+ * are kept in a list since typical URIs have low fan-out.
+ *
+ * Copyright (C) 2020 Tempesta Technologies, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#include <linux/mm.h>
+#include <linux/slab.h>
+
+#include "mtree.h"
+#include "htype.h"
+#include "http_match.h"
+
+/**
+ * Trie node. Index 0 is the root, so zero @child and @sibling mean there
+ * is no such a node.
+ *
+ * @child	- the first child node;
+ * @sibling	- the next child of the parent node;
+ * @pfx		- list of the prefix (suffix) keys ending at the node;
+ * @eq		- list of the eq keys ending at the node;
+ * @c		- the lower case byte of the node;
+ */
+struct tfw_mtree_node_t {
+	unsigned int	child;
+	unsigned int	sibling;
+	unsigned int	pfx;
+	unsigned int	eq;
+	unsigned char	c;
+};
+
+static void
+__mtree_node_init(TfwMtreeNode *node, unsigned char c, unsigned int sibling)
+{
+	node->child = 0;
+	node->sibling = sibling;
+	node->pfx = node->eq = TFW_MTREE_NOMATCH;
+	node->c = c;
+}
+
+/*
+ * Insert @s, reversed if @rev is set, into the trie @nodes of @nodes_n
+ * nodes and return the last node. The trie must have enough room.
+ */
+static TfwMtreeNode *
+__mtree_insert(TfwMtreeNode *nodes, unsigned int *nodes_n, const char *s,
+	       size_t len, bool rev)
+{
+	unsigned int n = 0, ch;
+	size_t i;
+
+	for (i = 0; i < len; ++i) {
+		unsigned char c = s[rev ? len - i - 1 : i];
+
+		c = TFW_LC(c);
+
+		for (ch = nodes[n].child; ch; ch = nodes[ch].sibling)
+			if (nodes[ch].c == c)
+				break;
+		if (!ch) {
+			ch = (*nodes_n)++;
+			__mtree_node_init(&nodes[ch], c, nodes[n].child);
+			nodes[n].child = ch;
+		}
+		n = ch;
+	}
+
+	return &nodes[n];
+}
+
+static int
+__mtree_regex_compile(TfwMtree *t, const TfwMtreeKey *keys, unsigned int n)
+{
+	int r;
+	unsigned int i, j;
+	TfwStr *pats;
+
+	if (!(pats = kmalloc_array(t->re_n, sizeof(TfwStr), GFP_KERNEL)))
+		return -ENOMEM;
+	for (i = 0, j = 0; i < n; ++i) {
+		if (keys[i].op != TFW_HTTP_MATCH_O_REGEX)
+			continue;
+		/* The first matching regex must be the first matching key. */
+		BUG_ON(keys[i].mask != ~0UL);
+		TFW_STR_INIT(&pats[j]);
+		pats[j].data = (char *)keys[i].arg;
+		pats[j].len = keys[i].len;
+		t->re_key[j++] = i;
+	}
+	r = tfw_regex_compile(&t->re, pats, t->re_n);
+	kfree(pats);
+
+	return r;
+}
+
+/**
+ * Build a match tree for @n @keys. Regex keys must have full masks.
+ */
+TfwMtree *
+tfw_mtree_new(const TfwMtreeKey *keys, unsigned int n)
+{
+	int r = -ENOMEM;
+	unsigned int k, fn = 1, rn = 1;
+	TfwMtree *t;
+
+	if (!(t = kzalloc(sizeof(*t), GFP_KERNEL)))
+		return ERR_PTR(-ENOMEM);
+	for (k = 0; k < n; ++k) {
+		if (keys[k].op == TFW_HTTP_MATCH_O_SUFFIX)
+			rn += keys[k].len;
+		else if (keys[k].op == TFW_HTTP_MATCH_O_REGEX)
+			t->re_n++;
+		else
+			fn += keys[k].len;
+	}
+
+	t->nodes = kvmalloc_array(fn, sizeof(TfwMtreeNode), GFP_KERNEL);
+	t->rnodes = kvmalloc_array(rn, sizeof(TfwMtreeNode), GFP_KERNEL);
+	t->next = kvmalloc_array(n + 1, sizeof(unsigned int), GFP_KERNEL);
+	t->mask = kvmalloc_array(n + 1, sizeof(unsigned long), GFP_KERNEL);
+	t->re_key = kvmalloc_array(t->re_n + 1, sizeof(unsigned int),
+				   GFP_KERNEL);
+	if (!t->nodes || !t->rnodes || !t->next || !t->mask || !t->re_key)
+		goto err;
+
+	__mtree_node_init(t->nodes, 0, 0);
+	__mtree_node_init(t->rnodes, 0, 0);
+	fn = rn = 1;
+	t->wc = TFW_MTREE_NOMATCH;
+	/* Push the keys in the reverse order to get sorted lists. */
+	for (k = n; k-- > 0; ) {
+		const TfwMtreeKey *key = &keys[k];
+		unsigned int *head;
+
+		t->mask[k] = key->mask;
+		switch (key->op) {
+		case TFW_HTTP_MATCH_O_WILDCARD:
+			/* Only "*" argument matches, see tfw_match_enum. */
+			if (key->len != 1 || *key->arg != '*')
+				continue;
+			head = &t->wc;
+			break;
+		case TFW_HTTP_MATCH_O_EQ:
+			head = &__mtree_insert(t->nodes, &fn, key->arg, key->len,
+					       false)->eq;
+			break;
+		case TFW_HTTP_MATCH_O_PREFIX:
+			head = &__mtree_insert(t->nodes, &fn, key->arg, key->len,
+					       false)->pfx;
+			break;
+		case TFW_HTTP_MATCH_O_SUFFIX:
+			head = &__mtree_insert(t->rnodes, &rn, key->arg,
+					       key->len, true)->pfx;
+			break;
+		case TFW_HTTP_MATCH_O_REGEX:
+			continue;
+		default:
+			BUG();
+		}
+		t->next[k] = *head;
+		*head = k;
+	}
+
+	if (t->re_n && (r = __mtree_regex_compile(t, keys, n)))
+		goto err;
+
+	return t;
+err:
+	tfw_mtree_free(t);
+	return ERR_PTR(r);
+}
+
+void
+tfw_mtree_free(TfwMtree *t)
+{
+	if (!t)
+		return;
+	tfw_regex_free(&t->re);
+	kvfree(t->nodes);
+	kvfree(t->rnodes);
+	kvfree(t->next);
+	kvfree(t->mask);
+	kvfree(t->re_key);
+	kfree(t);
+}
+
+/* Update @best with the first key of list @k matching @mask. */
+static inline void
+__mtree_list(const TfwMtree *t, unsigned int k, unsigned long mask,
+	     unsigned int *best)
+{
+	for ( ; k < *best; k = t->next[k])
+		if (t->mask[k] & mask) {
+			*best = k;
+			return;
+		}
+}
+
+static inline const TfwMtreeNode *
+__mtree_child(const TfwMtreeNode *nodes, const TfwMtreeNode *node,
+	      unsigned char c)
+{
+	unsigned int ch;
+
+	for (ch = node->child; ch; ch = nodes[ch].sibling)
+		if (nodes[ch].c == c)
+			return &nodes[ch];
+
+	return NULL;
+}
+
+/**
+ * Return the first key of @t matching @str and @mask or TFW_MTREE_NOMATCH.
+ */
+unsigned int
+tfw_mtree_match(const TfwMtree *t, const TfwStr *str, unsigned long mask)
+{
+	const TfwMtreeNode *node = t->nodes;
+	const TfwStr *c, *end;
+	unsigned int best = TFW_MTREE_NOMATCH;
+	int k;
+
+	__mtree_list(t, t->wc, mask, &best);
+
+	/* Eq and prefix keys: walk the string forward. */
+	TFW_STR_FOR_EACH_CHUNK(c, str, end) {
+		const unsigned char *p = c->data, *pend = p + c->len;
+
+		for ( ; p < pend; ++p) {
+			__mtree_list(t, node->pfx, mask, &best);
+			node = __mtree_child(t->nodes, node, TFW_LC(*p));
+			if (!node)
+				goto suffix;
+		}
+	}
+	__mtree_list(t, node->pfx, mask, &best);
+	__mtree_list(t, node->eq, mask, &best);
+
+suffix:
+	/* Suffix keys: walk the string backward. */
+	node = t->rnodes;
+	c = TFW_STR_CHUNK(str, 0);
+	for (k = TFW_STR_PLAIN(str) ? 0 : str->nchunks - 1; k >= 0; --k) {
+		const unsigned char *p = c[k].data;
+		size_t j = c[k].len;
+
+		while (j--) {
+			__mtree_list(t, node->pfx, mask, &best);
+			node = __mtree_child(t->rnodes, node, TFW_LC(p[j]));
+			if (!node)
+				goto regex;
+		}
+	}
+	__mtree_list(t, node->pfx, mask, &best);
+
+regex:
+	if (t->re_n && t->re_key[0] < best) {
+		unsigned int m = tfw_regex_match(&t->re, str);
+
+		if (m != TFW_REGEX_NOMATCH && t->re_key[m] < best)
+			best = t->re_key[m];
+	}
+
+	return best;
+}
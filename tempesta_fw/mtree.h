@@ -0,0 +1,75 @@
+/**
+ *		Tempesta FW
+ *
+ * First match of a string against a list of match operators.
+ *
+ * Copyright (C) 2020 Tempesta Technologies, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#ifndef __TFW_MTREE_H__
+#define __TFW_MTREE_H__
+
+#include "regex.h"
+
+/* None of the keys matches. */
+#define TFW_MTREE_NOMATCH	UINT_MAX
+
+/**
+ * A key of the match tree.
+ *
+ * @op		- match operator, one of TFW_HTTP_MATCH_O_*;
+ * @mask	- the key matches only lookups with an intersecting mask;
+ * @arg		- string for the match operator;
+ * @len		- length of @arg;
+ */
+typedef struct {
+	int		op;
+	unsigned long	mask;
+	const char	*arg;
+	size_t		len;
+} TfwMtreeKey;
+
+typedef struct tfw_mtree_node_t TfwMtreeNode;
+
+/**
+ * Match tree. Each list of keys is sorted by the keys order.
+ *
+ * @nodes	- trie of eq and prefix arguments, the root is the first node;
+ * @rnodes	- trie of reversed suffix arguments;
+ * @next	- next key in the list containing the key;
+ * @mask	- masks of the keys;
+ * @wc		- list of the wildcard keys;
+ * @re_n	- number of the regex keys;
+ * @re_key	- the key of each regex;
+ * @re		- DFA of the regex keys;
+ */
+typedef struct {
+	TfwMtreeNode	*nodes;
+	TfwMtreeNode	*rnodes;
+	unsigned int	*next;
+	unsigned long	*mask;
+	unsigned int	wc;
+	unsigned int	re_n;
+	unsigned int	*re_key;
+	TfwRegex	re;
+} TfwMtree;
+
+TfwMtree *tfw_mtree_new(const TfwMtreeKey *keys, unsigned int n);
+void tfw_mtree_free(TfwMtree *t);
+unsigned int tfw_mtree_match(const TfwMtree *t, const TfwStr *str,
+			     unsigned long mask);
+
+#endif /* __TFW_MTREE_H__ */
@@ -42,9 +42,13 @@
  * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
  */
 #include <linux/gfp.h>
+#include <linux/shrinker.h>
+#include <linux/topology.h>
+#include <linux/workqueue.h>
 
 #include "lib/str.h"
 #include "pool.h"
+#include "procfs.h"
 
 #define TFW_POOL_CHUNK_SZ(p)	(PAGE_SIZE << (p)->order)
 #define TFW_POOL_CHUNK_BASE(c)	((unsigned long)(c) & PAGE_MASK)
@@ -52,10 +56,34 @@
 #define TFW_POOL_ALIGN_SZ(n)	(((n) + 7) & ~7UL)
 #define TFW_POOL_HEAD_OFF	(TFW_POOL_ALIGN_SZ(sizeof(TfwPool))	\
 				 + TFW_POOL_ALIGN_SZ(sizeof(TfwPoolChunk)))
-#define TFW_POOL_PGCACHE_SZ	512
+#define TFW_POOL_PGCACHE_MIN	128
+#define TFW_POOL_PGCACHE_INIT	512
+#define TFW_POOL_PGCACHE_MAX	2048
+#define TFW_POOL_PGCACHE_INTVL	HZ
 
-static DEFINE_PER_CPU(unsigned int, pg_next);
-static unsigned long __percpu (*pg_cache)[TFW_POOL_PGCACHE_SZ];
+/**
+ * Per-CPU page cache.
+ *
+ * @n		- number of cached pages;
+ * @limit	- current capacity of the cache;
+ * @misses	- number of cache misses in the current interval;
+ * @trim	- number of pages to return to the buddy allocator requested by
+ *		  the shrinker;
+ * @jstamp	- time (in jiffies) when the current interval began;
+ * @trim_work	- returns @trim pages on the cache CPU;
+ * @pages	- the cached pages;
+ */
+typedef struct {
+	unsigned int		n;
+	unsigned int		limit;
+	unsigned int		misses;
+	unsigned int		trim;
+	unsigned long		jstamp;
+	struct work_struct	trim_work;
+	unsigned long		pages[TFW_POOL_PGCACHE_MAX];
+} TfwPoolPgCache;
+
+static TfwPoolPgCache __percpu *pg_cache;
 
 /*
  * Per-CPU page cache.
@@ -69,52 +97,117 @@ static unsigned long __percpu (*pg_cache)[TFW_POOL_PGCACHE_SZ];
  * satisfy large realloc (i.e. if the we called from realloc(), then it's
  * likely that the next request will be of doubled size and we typically grow
  * through buddies coalescing). So we never cache multi-pages.
+ *
+ * The cache capacity adapts to the workload: it's doubled if a freed page
+ * doesn't fit the cache while there were many misses in the current interval,
+ * e.g. for large headers, and it's halved with the extra pages returned to
+ * the buddy allocator if there were no misses in the whole interval. Pages
+ * of other NUMA nodes, e.g. of messages freed on a remote CPU, aren't cached
+ * to keep the cache local to the CPU node.
+ *
+ * Under memory pressure the shrinker returns the cached pages of the node
+ * being reclaimed and halves the caches capacity, so that the caches don't
+ * grab the pages back at once. The cache is accessed only on its CPU with
+ * disabled preemption, so the pages are freed by a work on the CPU.
  */
+static void
+tfw_pool_pgcache_shrink(TfwPoolPgCache *pc)
+{
+	if (time_before(jiffies, pc->jstamp + TFW_POOL_PGCACHE_INTVL))
+		return;
+	if (!pc->misses && pc->limit > TFW_POOL_PGCACHE_MIN) {
+		pc->limit /= 2;
+		TFW_ADD_STAT_BH(-(long)pc->limit, pool.pg_cap);
+		while (pc->n > pc->limit)
+			free_page(pc->pages[--pc->n]);
+	}
+	pc->misses = 0;
+	pc->jstamp = jiffies;
+}
+
+static bool
+tfw_pool_pgcache_grow(TfwPoolPgCache *pc)
+{
+	if (pc->limit == TFW_POOL_PGCACHE_MAX || pc->misses < pc->limit / 8)
+		return false;
+	TFW_ADD_STAT_BH(pc->limit, pool.pg_cap);
+	pc->limit *= 2;
+	pc->misses = 0;
+	pc->jstamp = jiffies;
+	return true;
+}
+
 static unsigned long
 tfw_pool_alloc_pages(unsigned int order)
 {
-	unsigned int *pgn;
-	unsigned long pg_res;
+	TfwPoolPgCache *pc;
+	struct page *pg;
 
 	preempt_disable();
 
-	pgn = this_cpu_ptr(&pg_next);
+	pc = this_cpu_ptr(pg_cache);
+	tfw_pool_pgcache_shrink(pc);
 
-	if (likely(*pgn && !order)) {
-		--*pgn;
-		pg_res = ((unsigned long *)this_cpu_ptr(pg_cache))[*pgn];
+	if (likely(!order)) {
+		if (likely(pc->n)) {
+			unsigned long pg_res = pc->pages[--pc->n];
 
-		preempt_enable();
+			TFW_INC_STAT_BH(pool.pg_hits);
+			preempt_enable();
 
-		return pg_res;
+			return pg_res;
+		}
+		++pc->misses;
+		TFW_INC_STAT_BH(pool.pg_misses);
 	}
 	preempt_enable();
 
-	return __get_free_pages(GFP_ATOMIC, order);
+	pg = alloc_pages_node(numa_node_id(), GFP_ATOMIC, order);
+
+	return pg ? (unsigned long)page_address(pg) : 0;
 }
 
 static void
 tfw_pool_free_pages(unsigned long addr, unsigned int order)
 {
-	unsigned int *pgn;
+	TfwPoolPgCache *pc;
 
-	preempt_disable();
+	if (unlikely(order)
+	    || unlikely(page_to_nid(virt_to_page(addr)) != numa_node_id()))
+		goto free;
 
-	pgn = this_cpu_ptr(&pg_next);
+	preempt_disable();
 
-	if (likely(*pgn < TFW_POOL_PGCACHE_SZ && !order)) {
-		((unsigned long *)this_cpu_ptr(pg_cache))[*pgn] = addr;
-		++*pgn;
+	pc = this_cpu_ptr(pg_cache);
+	if (likely(pc->n < pc->limit) || tfw_pool_pgcache_grow(pc)) {
+		pc->pages[pc->n++] = addr;
 
 		preempt_enable();
 
 		return;
 	}
 	preempt_enable();
-
+free:
 	free_pages(addr, order);
 }
 
+/*
+ * Account a chunk of @order allocated for or freed from pool @p.
+ */
+static inline void
+tfw_pool_account(TfwPool *p, unsigned int order, bool alloc)
+{
+	if (alloc) {
+		p->size += PAGE_SIZE << order;
+		if (p->size > p->peak)
+			p->peak = p->size;
+		tfw_mem_acct(p->acct, PAGE_SIZE << order);
+	} else {
+		p->size -= PAGE_SIZE << order;
+		tfw_mem_acct(p->acct, -(PAGE_SIZE << order));
+	}
+}
+
 void *
 __tfw_pool_alloc(TfwPool *p, size_t n, bool align, bool *new_page)
 {
@@ -138,6 +231,7 @@ __tfw_pool_alloc(TfwPool *p, size_t n, bool align, bool *new_page)
 			return NULL;
 		c->next = curr;
 		c->order = order;
+		tfw_pool_account(p, order, true);
 
 		curr->off = p->off;
 
@@ -203,6 +297,7 @@ tfw_pool_free(TfwPool *p, void *ptr, size_t n)
 	/* Free empty chunk which doesn't contain the pool header. */
 	if (unlikely(p->off == TFW_POOL_ALIGN_SZ(sizeof(TfwPoolChunk)))) {
 		TfwPoolChunk *next = p->curr->next;
+		tfw_pool_account(p, p->order, false);
 		tfw_pool_free_pages(TFW_POOL_CHUNK_BASE(p->curr), p->order);
 		p->curr = next;
 		p->order = next->order;
@@ -239,6 +334,7 @@ tfw_pool_clean(TfwPool *pool, void *ptr)
 			}
 			ptr = NULL;
 		}
+		tfw_pool_account(pool, c->order, false);
 		tfw_pool_free_pages(TFW_POOL_CHUNK_BASE(c), c->order);
 	}
 	pool->curr->next = c;
@@ -267,6 +363,9 @@ __tfw_pool_new(size_t n)
 	p->order = c->order = order;
 	p->off = c->off = TFW_POOL_HEAD_OFF;
 	p->curr = c;
+	p->size = p->peak = PAGE_SIZE << order;
+	p->acct = TFW_MEM_POOL;
+	tfw_mem_acct(TFW_MEM_POOL, p->size);
 
 	return p;
 }
@@ -280,6 +379,8 @@ tfw_pool_destroy(TfwPool *p)
 	if (!p)
 		return;
 
+	/* The descriptor lives in the pool pages. */
+	tfw_mem_acct(p->acct, -p->size);
 	for (c = p->curr; c; c = next) {
 		next = c->next;
 		tfw_pool_free_pages(TFW_POOL_CHUNK_BASE(c), c->order);
@@ -287,12 +388,105 @@ tfw_pool_destroy(TfwPool *p)
 }
 EXPORT_SYMBOL(tfw_pool_destroy);
 
+/**
+ * Move the pages of pool @p, including the future ones, to memory footprint
+ * category @type.
+ */
+void
+tfw_pool_acct(TfwPool *p, unsigned int type)
+{
+	tfw_mem_acct(p->acct, -p->size);
+	tfw_mem_acct(type, p->size);
+	p->acct = type;
+}
+EXPORT_SYMBOL(tfw_pool_acct);
+
+static void
+tfw_pool_pgcache_trim(struct work_struct *work)
+{
+	TfwPoolPgCache *pc = container_of(work, TfwPoolPgCache, trim_work);
+	unsigned int n = xchg(&pc->trim, 0);
+	unsigned int limit;
+
+	local_bh_disable();
+	limit = max_t(unsigned int, pc->limit / 2, TFW_POOL_PGCACHE_MIN);
+	TFW_ADD_STAT_BH(-(long)(pc->limit - limit), pool.pg_cap);
+	pc->limit = limit;
+	for (n = min(n, pc->n); n; --n)
+		free_page(pc->pages[--pc->n]);
+	pc->misses = 0;
+	pc->jstamp = jiffies;
+	local_bh_enable();
+}
+
+static unsigned long
+tfw_pool_pgcache_count(struct shrinker *s, struct shrink_control *sc)
+{
+	int cpu;
+	unsigned long n = 0;
+
+	for_each_cpu_and(cpu, cpumask_of_node(sc->nid), cpu_online_mask)
+		n += READ_ONCE(per_cpu_ptr(pg_cache, cpu)->n);
+
+	return n;
+}
+
+/**
+ * Return up to @sc->nr_to_scan cached pages of @sc->nid node. The pages are
+ * freed asynchronously on the cache CPUs, so they're reported as freed right
+ * after the request.
+ */
+static unsigned long
+tfw_pool_pgcache_scan(struct shrinker *s, struct shrink_control *sc)
+{
+	int cpu;
+	unsigned long freed = 0;
+
+	for_each_cpu_and(cpu, cpumask_of_node(sc->nid), cpu_online_mask) {
+		TfwPoolPgCache *pc = per_cpu_ptr(pg_cache, cpu);
+		unsigned int n = min_t(unsigned long, READ_ONCE(pc->n),
+				       sc->nr_to_scan - freed);
+
+		if (!n)
+			continue;
+		WRITE_ONCE(pc->trim, n);
+		schedule_work_on(cpu, &pc->trim_work);
+		if ((freed += n) >= sc->nr_to_scan)
+			break;
+	}
+
+	return freed ? : SHRINK_STOP;
+}
+
+static struct shrinker tfw_pool_shrinker = {
+	.count_objects	= tfw_pool_pgcache_count,
+	.scan_objects	= tfw_pool_pgcache_scan,
+	.seeks		= DEFAULT_SEEKS,
+	.flags		= SHRINKER_NUMA_AWARE,
+};
+
 int
 tfw_pool_init(void)
 {
-	pg_cache = alloc_percpu(unsigned long [TFW_POOL_PGCACHE_SZ]);
+	int i;
+
+	pg_cache = alloc_percpu(TfwPoolPgCache);
 	if (pg_cache == NULL)
 		return -ENOMEM;
+	for_each_possible_cpu(i) {
+		TfwPoolPgCache *pc = per_cpu_ptr(pg_cache, i);
+
+		pc->limit = TFW_POOL_PGCACHE_INIT;
+		pc->jstamp = jiffies;
+		INIT_WORK(&pc->trim_work, tfw_pool_pgcache_trim);
+		per_cpu(tfw_perfstat, i).pool.pg_cap = TFW_POOL_PGCACHE_INIT;
+	}
+
+	if (register_shrinker(&tfw_pool_shrinker)) {
+		free_percpu(pg_cache);
+		return -ENOMEM;
+	}
+
 	return 0;
 }
 
@@ -301,11 +495,14 @@ tfw_pool_exit(void)
 {
 	int i;
 
-	for_each_online_cpu(i) {
-		unsigned int pgn = per_cpu(pg_next, i);
-		unsigned long *pgc = (unsigned long *)per_cpu_ptr(pg_cache, i);
-		while (pgn--)
-			free_page(pgc[pgn]);
+	unregister_shrinker(&tfw_pool_shrinker);
+
+	for_each_possible_cpu(i) {
+		TfwPoolPgCache *pc = per_cpu_ptr(pg_cache, i);
+
+		cancel_work_sync(&pc->trim_work);
+		while (pc->n)
+			free_page(pc->pages[--pc->n]);
 	}
 
 	free_percpu(pg_cache);
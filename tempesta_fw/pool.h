@@ -46,11 +46,17 @@ typedef struct tfw_pool_chunk_t {
  *
  * @curr	- current chunk to allocate memory from;
  * @order,@off	- cached members of @curr;
+ * @size	- total size of the pool chunks;
+ * @peak	- maximum of @size during the pool lifetime;
+ * @acct	- memory footprint category of the pool, TFW_MEM_*;
  */
 typedef struct {
 	TfwPoolChunk	*curr;
 	unsigned int	order;
 	unsigned int	off;
+	unsigned long	size;
+	unsigned long	peak;
+	unsigned int	acct;
 } TfwPool;
 
 #define tfw_pool_new(struct_name, mask)					\
@@ -74,6 +80,7 @@ void *__tfw_pool_alloc(TfwPool *p, size_t n, bool align, bool *new_page);
 void tfw_pool_free(TfwPool *p, void *ptr, size_t n);
 void tfw_pool_clean(TfwPool *p, void *ptr);
 void tfw_pool_destroy(TfwPool *p);
+void tfw_pool_acct(TfwPool *p, unsigned int type);
 void *__tfw_pool_realloc(TfwPool *p, void *ptr, size_t old_n, size_t new_n,
 			 bool copy);
 
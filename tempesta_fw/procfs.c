@@ -19,15 +19,68 @@
  */
 #include <linux/proc_fs.h>
 #include <linux/seq_file.h>
+#include <asm/tsc.h>
 
+#include "access_log.h"
 #include "apm.h"
+#include "cache.h"
 #include "server.h"
 #include "procfs.h"
+#include "tls.h"
+#include "vhost.h"
 
 /*
  * Common Tempesta statistics.
  */
 DEFINE_PER_CPU_ALIGNED(TfwPerfStat, tfw_perfstat);
+DEFINE_PER_CPU_ALIGNED(TfwHttpStageStat, tfw_http_stage_stat);
+DEFINE_PER_CPU_ALIGNED(TfwHttpQueueStat, tfw_http_queue_stat);
+DEFINE_PER_CPU_ALIGNED(TfwMemStat, tfw_mem_stat);
+
+static atomic_long_t tfw_mem_total[TFW_MEM_NUM];
+static atomic_long_t tfw_mem_peak[TFW_MEM_NUM];
+
+static const char *const tfw_mem_names[TFW_MEM_NUM] = {
+	[TFW_MEM_CONN]		= "conn",
+	[TFW_MEM_TLS]		= "tls",
+	[TFW_MEM_H2]		= "h2",
+	[TFW_MEM_HPACK]		= "hpack",
+	[TFW_MEM_MSG]		= "msg",
+	[TFW_MEM_POOL]		= "pool",
+};
+
+void
+__tfw_mem_fold(int type, long delta)
+{
+	long v = atomic_long_add_return(delta, &tfw_mem_total[type]);
+	long peak = atomic_long_read(&tfw_mem_peak[type]);
+
+	while (v > peak) {
+		long old = atomic_long_cmpxchg(&tfw_mem_peak[type], peak, v);
+
+		if (old == peak)
+			break;
+		peak = old;
+	}
+}
+
+/**
+ * Collect the current memory footprint and the high-water marks of all
+ * the categories into @curr and @peak arrays of TFW_MEM_NUM entries.
+ */
+void
+tfw_mem_stat_collect(long *curr, long *peak)
+{
+	int cpu, t;
+
+	for (t = 0; t < TFW_MEM_NUM; ++t) {
+		curr[t] = atomic_long_read(&tfw_mem_total[t]);
+		for_each_online_cpu(cpu)
+			curr[t] += per_cpu_ptr(&tfw_mem_stat, cpu)->delta[t];
+		curr[t] = max(curr[t], 0L);
+		peak[t] = max(atomic_long_read(&tfw_mem_peak[t]), curr[t]);
+	}
+}
 
 void
 tfw_perfstat_collect(TfwPerfStat *stat)
@@ -48,10 +101,34 @@ tfw_perfstat_collect(TfwPerfStat *stat)
 		SADD(ss.pfl_hits);
 		SADD(ss.pfl_misses);
 		SADD(ss.wq_full);
+		SADD(ss.pgpool_hits);
+		SADD(ss.pgpool_misses);
 
 		/* Cache statistics. */
 		SADD(cache.hits);
 		SADD(cache.misses);
+		SADD(cache.collapsed);
+		SADD(cache.evicted);
+		SADD(cache.not_admitted);
+		SADD(cache.wq_ipis);
+		SADD(cache.wq_batches);
+		SADD(cache.wq_works);
+		SADD(cache.replicated);
+		SADD(cache.repl_skipped);
+		SADD(cache.demoted);
+		SADD(cache.demote_skipped);
+		SADD(cache.promoted);
+
+		/* Memory pools statistics. */
+		SADD(pool.pg_hits);
+		SADD(pool.pg_misses);
+		SADD(pool.pg_cap);
+		SADD(pool.req_n);
+		SADD(pool.req_bytes);
+		SADD(pool.resp_n);
+		SADD(pool.resp_bytes);
+		SADD(pool.hdr_n);
+		SADD(pool.hdr_chunks);
 
 		/* Client related statistics. */
 		SADD(clnt.rx_messages);
@@ -61,6 +138,9 @@ tfw_perfstat_collect(TfwPerfStat *stat)
 		SADD(clnt.msgs_filtout);
 		SADD(clnt.msgs_otherr);
 		SADD(clnt.online);
+		SADD(clnt.slow_held);
+		SADD(clnt.msgs_mirrored);
+		SADD(clnt.mirror_capped);
 		SADD(clnt.conn_attempts);
 		SADD(clnt.conn_disconnects);
 		SADD(clnt.conn_established);
@@ -77,6 +157,9 @@ tfw_perfstat_collect(TfwPerfStat *stat)
 		SADD(serv.conn_established);
 		SADD(serv.conn_restricted);
 		SADD(serv.rx_bytes);
+		SADD(serv.msgs_streamed);
+		SADD(serv.rx_paused);
+		SADD(serv.conn_promoted);
 	}
 #undef SADD
 }
@@ -87,7 +170,11 @@ tfw_perfstat_seq_show(struct seq_file *seq, void *off)
 #define SPRNE(m, e)	seq_printf(seq, m": %llu\n", e)
 #define SPRN(m, c)	seq_printf(seq, m": %llu\n", stat.c)
 
+	int i;
 	TfwPerfStat stat;
+	TlsHsMemStat hs_stat;
+	TlsTicketStat tkt_stat;
+	long mem_curr[TFW_MEM_NUM], mem_peak[TFW_MEM_NUM];
 	u64 serv_conn_active, serv_conn_sched;
 	SsStat *ss_stat = kmalloc(sizeof(SsStat) * num_online_cpus(),
 				  GFP_KERNEL);
@@ -101,6 +188,8 @@ tfw_perfstat_seq_show(struct seq_file *seq, void *off)
 	SPRN("SS pfl hits\t\t\t\t", ss.pfl_hits);
 	SPRN("SS pfl misses\t\t\t\t", ss.pfl_misses);
 	SPRN("SS work queue full\t\t\t", ss.wq_full);
+	SPRN("SS page pool hits\t\t\t", ss.pgpool_hits);
+	SPRN("SS page pool misses\t\t\t", ss.pgpool_misses);
 	if (ss_stat) {
 		int cpu;
 
@@ -111,11 +200,15 @@ tfw_perfstat_seq_show(struct seq_file *seq, void *off)
 		seq_printf(seq, "\nSS backlog's sizes\t\t\t:");
 		for_each_online_cpu(cpu)
 			seq_printf(seq, " %u", ss_stat[cpu].backlog_sz);
+		seq_printf(seq, "\nSS work queues' contention\t\t:");
+		for_each_online_cpu(cpu)
+			seq_printf(seq, " %lu", ss_stat[cpu].rb_wq_contended);
 		seq_printf(seq, "\n");
 		kfree(ss_stat);
 	} else {
 		seq_printf(seq, "SS work queues' sizes\t\t\t: n/a\n");
 		seq_printf(seq, "SS backlog's sizes\t\t\t: n/a\n");
+		seq_printf(seq, "SS work queues' contention\t\t: n/a\n");
 	}
 
 	/* Socket buffers kernel statistics. */
@@ -125,6 +218,35 @@ tfw_perfstat_seq_show(struct seq_file *seq, void *off)
 	/* Cache statistics. */
 	SPRN("Cache hits\t\t\t\t", cache.hits);
 	SPRN("Cache misses\t\t\t\t", cache.misses);
+	SPRN("Cache misses collapsed\t\t\t", cache.collapsed);
+	SPRN("Cache entries evicted\t\t\t", cache.evicted);
+	SPRN("Cache entries not admitted\t\t", cache.not_admitted);
+	SPRN("Cache work IPIs\t\t\t\t", cache.wq_ipis);
+	SPRN("Cache work batches\t\t\t", cache.wq_batches);
+	SPRNE("Cache work batch avg size\t\t",
+	      stat.cache.wq_batches
+	      ? div64_u64(stat.cache.wq_works, stat.cache.wq_batches) : 0ULL);
+	SPRN("Cache entries replicated\t\t", cache.replicated);
+	SPRN("Cache replications skipped\t\t", cache.repl_skipped);
+	SPRN("Cache entries demoted to disk\t\t", cache.demoted);
+	SPRN("Cache demotions skipped\t\t\t", cache.demote_skipped);
+	SPRN("Cache entries promoted from disk\t", cache.promoted);
+
+	/* Memory pools statistics. */
+	SPRN("Pool page cache hits\t\t\t", pool.pg_hits);
+	SPRN("Pool page cache misses\t\t\t", pool.pg_misses);
+	SPRN("Pool page cache capacity\t\t", pool.pg_cap);
+	SPRNE("Pool peak bytes per request avg\t\t",
+	      stat.pool.req_n
+	      ? div64_u64(stat.pool.req_bytes, stat.pool.req_n) : 0ULL);
+	SPRNE("Pool peak bytes per response avg\t",
+	      stat.pool.resp_n
+	      ? div64_u64(stat.pool.resp_bytes, stat.pool.resp_n) : 0ULL);
+	SPRN("Pool parsed headers\t\t\t", pool.hdr_n);
+	SPRNE("Pool chunks per header avg\t\t",
+	      stat.pool.hdr_n
+	      ? div64_u64(stat.pool.hdr_chunks, stat.pool.hdr_n) : 0ULL);
+	tfw_cache_acct_show(seq);
 
 	/* Client related statistics. */
 	SPRN("Client messages received\t\t", clnt.rx_messages);
@@ -134,6 +256,10 @@ tfw_perfstat_seq_show(struct seq_file *seq, void *off)
 	SPRN("Client messages filtered out\t\t", clnt.msgs_filtout);
 	SPRN("Client messages other errors\t\t", clnt.msgs_otherr);
 	SPRN("Clients online\t\t\t\t", clnt.online);
+	SPRN("Client bytes held for slow readers\t", clnt.slow_held);
+	SPRNE("Access log records dropped\t\t", tfw_access_log_drops());
+	SPRN("Client messages mirrored\t\t", clnt.msgs_mirrored);
+	SPRN("Client messages mirroring capped\t", clnt.mirror_capped);
 	SPRN("Client connection attempts\t\t", clnt.conn_attempts);
 	SPRN("Client established connections\t\t", clnt.conn_established);
 	SPRNE("Client connections active\t\t",
@@ -147,6 +273,7 @@ tfw_perfstat_seq_show(struct seq_file *seq, void *off)
 
 	SPRN("Server messages received\t\t", serv.rx_messages);
 	SPRN("Server messages forwarded\t\t", serv.msgs_forwarded);
+	SPRN("Server messages streamed\t\t", serv.msgs_streamed);
 	SPRN("Server messages parsing errors\t\t", serv.msgs_parserr);
 	SPRN("Server messages filtered out\t\t", serv.msgs_filtout);
 	SPRN("Server messages other errors\t\t", serv.msgs_otherr);
@@ -154,8 +281,34 @@ tfw_perfstat_seq_show(struct seq_file *seq, void *off)
 	SPRN("Server established connections\t\t", serv.conn_established);
 	SPRNE("Server connections active\t\t", serv_conn_active);
 	SPRNE("Server connections schedulable\t\t", serv_conn_sched);
+	SPRN("Server connections paused\t\t", serv.rx_paused);
+	SPRN("Server spare connections promoted\t", serv.conn_promoted);
 	SPRN("Server RX bytes\t\t\t\t", serv.rx_bytes);
 
+	/* TLS handshakes statistics. */
+	ttls_hs_mem_stat(&hs_stat);
+	SPRNE("TLS handshakes in progress\t\t", (u64)hs_stat.hs_num);
+	SPRNE("TLS handshakes memory in use\t\t", (u64)hs_stat.in_use);
+	SPRNE("TLS handshakes memory cached\t\t", (u64)hs_stat.cached);
+	ttls_ticket_stat(&tkt_stat);
+	SPRNE("TLS session tickets issued\t\t", (u64)tkt_stat.issued);
+	SPRNE("TLS sessions resumed from tickets\t", (u64)tkt_stat.resumed);
+	SPRNE("TLS session tickets rejected\t\t", (u64)tkt_stat.rejected);
+	SPRNE("TLS ticket resumption percent\t\t",
+	      (u64)(tkt_stat.resumed * 100
+		    / (tkt_stat.resumed + tkt_stat.issued ? : 1)));
+	SPRNE("TLS ticket issue avg cycles\t\t",
+	      (u64)(tkt_stat.write_cycles / (tkt_stat.issued ? : 1)));
+	SPRNE("TLS ticket parse avg cycles\t\t",
+	      (u64)(tkt_stat.parse_cycles
+		    / (tkt_stat.resumed + tkt_stat.rejected ? : 1)));
+
+	/* Memory footprint statistics. */
+	tfw_mem_stat_collect(mem_curr, mem_peak);
+	for (i = 0; i < TFW_MEM_NUM; ++i)
+		seq_printf(seq, "Memory %s bytes\t\t\t: %ld (peak %ld)\n",
+			   tfw_mem_names[i], mem_curr[i], mem_peak[i]);
+
 	return 0;
 #undef SPRN
 #undef SPRNE
@@ -167,6 +320,351 @@ tfw_perfstat_seq_open(struct inode *inode, struct file *file)
 	return single_open(file, tfw_perfstat_seq_show, PDE_DATA(inode));
 }
 
+/*
+ * Machine-readable statistics in Prometheus text exposition format.
+ *
+ * All the per-CPU counters are copied at once in the beginning, so the
+ * counters are consistent with each other. 'metrics_percpu' file shows
+ * the counters of each CPU instead of the sums.
+ */
+#define TFW_METRIC(n, f, g)						\
+	{ "tempesta_" n, offsetof(TfwPerfStat, f), g }
+
+static const struct {
+	const char	*name;
+	size_t		off;
+	bool		gauge;
+} tfw_metrics[] = {
+	TFW_METRIC("ss_pfl_hits_total",		ss.pfl_hits, false),
+	TFW_METRIC("ss_pfl_misses_total",	ss.pfl_misses, false),
+	TFW_METRIC("ss_wq_full_total",		ss.wq_full, false),
+	TFW_METRIC("ss_pgpool_hits_total",	ss.pgpool_hits, false),
+	TFW_METRIC("ss_pgpool_misses_total",	ss.pgpool_misses, false),
+	TFW_METRIC("cache_hits_total",		cache.hits, false),
+	TFW_METRIC("cache_misses_total",	cache.misses, false),
+	TFW_METRIC("cache_collapsed_total",	cache.collapsed, false),
+	TFW_METRIC("cache_evicted_total",	cache.evicted, false),
+	TFW_METRIC("cache_not_admitted_total",	cache.not_admitted, false),
+	TFW_METRIC("cache_wq_ipis_total",	cache.wq_ipis, false),
+	TFW_METRIC("cache_wq_batches_total",	cache.wq_batches, false),
+	TFW_METRIC("cache_wq_works_total",	cache.wq_works, false),
+	TFW_METRIC("cache_replicated_total",	cache.replicated, false),
+	TFW_METRIC("cache_repl_skipped_total",	cache.repl_skipped, false),
+	TFW_METRIC("cache_demoted_total",	cache.demoted, false),
+	TFW_METRIC("cache_demote_skipped_total", cache.demote_skipped, false),
+	TFW_METRIC("cache_promoted_total",	cache.promoted, false),
+	TFW_METRIC("pool_pg_hits_total",	pool.pg_hits, false),
+	TFW_METRIC("pool_pg_misses_total",	pool.pg_misses, false),
+	TFW_METRIC("pool_pg_capacity",		pool.pg_cap, true),
+	TFW_METRIC("pool_req_total",		pool.req_n, false),
+	TFW_METRIC("pool_req_peak_bytes_total",	pool.req_bytes, false),
+	TFW_METRIC("pool_resp_total",		pool.resp_n, false),
+	TFW_METRIC("pool_resp_peak_bytes_total", pool.resp_bytes, false),
+	TFW_METRIC("pool_hdr_total",		pool.hdr_n, false),
+	TFW_METRIC("pool_hdr_chunks_total",	pool.hdr_chunks, false),
+	TFW_METRIC("client_rx_messages_total",	clnt.rx_messages, false),
+	TFW_METRIC("client_msgs_forwarded_total", clnt.msgs_forwarded, false),
+	TFW_METRIC("client_msgs_fromcache_total", clnt.msgs_fromcache, false),
+	TFW_METRIC("client_msgs_parserr_total",	clnt.msgs_parserr, false),
+	TFW_METRIC("client_msgs_filtout_total",	clnt.msgs_filtout, false),
+	TFW_METRIC("client_msgs_otherr_total",	clnt.msgs_otherr, false),
+	TFW_METRIC("client_online",		clnt.online, true),
+	TFW_METRIC("client_slow_held_bytes",	clnt.slow_held, true),
+	TFW_METRIC("client_conn_attempts_total", clnt.conn_attempts, false),
+	TFW_METRIC("client_conn_established_total", clnt.conn_established,
+		   false),
+	TFW_METRIC("client_conn_disconnects_total", clnt.conn_disconnects,
+		   false),
+	TFW_METRIC("client_rx_bytes_total",	clnt.rx_bytes, false),
+	TFW_METRIC("server_rx_messages_total",	serv.rx_messages, false),
+	TFW_METRIC("server_msgs_forwarded_total", serv.msgs_forwarded, false),
+	TFW_METRIC("server_msgs_parserr_total",	serv.msgs_parserr, false),
+	TFW_METRIC("server_msgs_filtout_total",	serv.msgs_filtout, false),
+	TFW_METRIC("server_msgs_otherr_total",	serv.msgs_otherr, false),
+	TFW_METRIC("server_conn_attempts_total", serv.conn_attempts, false),
+	TFW_METRIC("server_conn_established_total", serv.conn_established,
+		   false),
+	TFW_METRIC("server_conn_disconnects_total", serv.conn_disconnects,
+		   false),
+	TFW_METRIC("server_conn_restricted",	serv.conn_restricted, true),
+	TFW_METRIC("server_rx_bytes_total",	serv.rx_bytes, false),
+	TFW_METRIC("server_msgs_streamed_total", serv.msgs_streamed, false),
+	TFW_METRIC("server_conn_paused",	serv.rx_paused, true),
+	TFW_METRIC("server_conn_promoted_total", serv.conn_promoted, false),
+};
+
+#undef TFW_METRIC
+
+#define TFW_METRIC_VAL(stat, i)						\
+	(*(u64 *)((char *)(stat) + tfw_metrics[i].off))
+
+static int
+tfw_metrics_srv_show(TfwServer *srv, void *data)
+{
+	struct seq_file *seq = data;
+	size_t i;
+	char addr[TFW_ADDR_STR_BUF_SIZE] = { 0 };
+	unsigned int val[ARRAY_SIZE(tfw_pstats_ith)] = { 0 };
+	TfwPrcntlStats pstats = {
+		.ith = tfw_pstats_ith,
+		.val = val,
+		.psz = ARRAY_SIZE(tfw_pstats_ith)
+	};
+
+	if (!srv->apmref)
+		return 0;
+	tfw_apm_stats_bh(srv->apmref, &pstats);
+	tfw_addr_ntop(&srv->addr, addr, sizeof(addr));
+
+#define SPRN_SRV(m, v)							\
+	seq_printf(seq, "tempesta_server_response_time_" m "_ms"	\
+		   "{group=\"%s\",server=\"%s\"} %u\n",			\
+		   srv->sg->name, addr, v)
+
+	SPRN_SRV("min", pstats.val[TFW_PSTATS_IDX_MIN]);
+	SPRN_SRV("avg", pstats.val[TFW_PSTATS_IDX_AVG]);
+	SPRN_SRV("max", pstats.val[TFW_PSTATS_IDX_MAX]);
+	for (i = TFW_PSTATS_IDX_ITH; i < ARRAY_SIZE(tfw_pstats_ith); ++i)
+		seq_printf(seq, "tempesta_server_response_time_ms"
+			   "{group=\"%s\",server=\"%s\",quantile=\"0.%02u\"}"
+			   " %u\n", srv->sg->name, addr, pstats.ith[i],
+			   pstats.val[i]);
+	seq_printf(seq, "tempesta_server_suspended"
+		   "{group=\"%s\",server=\"%s\"} %d\n",
+		   srv->sg->name, addr, tfw_srv_suspended(srv));
+
+#undef SPRN_SRV
+	return 0;
+}
+
+/*
+ * Show request processing stages durations as Prometheus histograms with
+ * power of 2 CPU cycles buckets bounds converted to nanoseconds.
+ */
+static void
+tfw_metrics_stages_show(struct seq_file *seq)
+{
+	static const char *const names[TFW_HTTP_STAGE_STAT_NUM] = {
+		[TFW_HTTP_STAGE_PARSE]		= "parse",
+		[TFW_HTTP_STAGE_CACHE]		= "cache",
+		[TFW_HTTP_STAGE_SCHED]		= "sched",
+		[TFW_HTTP_STAGE_UPSTREAM]	= "upstream",
+		[TFW_HTTP_STAGE_RESP]		= "response",
+		[TFW_HTTP_STAGE_TOTAL]		= "total",
+	};
+	int cpu;
+	unsigned int s, i;
+
+	if (!tsc_khz)
+		return;
+
+	seq_printf(seq, "# TYPE tempesta_http_stage_duration_ns histogram\n");
+	for (s = 0; s < TFW_HTTP_STAGE_STAT_NUM; ++s) {
+		u64 cnt = 0, sum = 0;
+
+		for (i = 0; i < TFW_HTTP_STAGE_HBKTS; ++i) {
+			for_each_online_cpu(cpu)
+				cnt += per_cpu_ptr(&tfw_http_stage_stat, cpu)
+					->cnt[s][i];
+			if (i == TFW_HTTP_STAGE_HBKTS - 1)
+				break;
+			seq_printf(seq, "tempesta_http_stage_duration_ns_bucket"
+				   "{stage=\"%s\",le=\"%llu\"} %llu\n",
+				   names[s],
+				   mul_u64_u32_div(1ULL << i, 1000000,
+						   tsc_khz),
+				   cnt);
+		}
+		for_each_online_cpu(cpu)
+			sum += per_cpu_ptr(&tfw_http_stage_stat, cpu)->sum[s];
+		seq_printf(seq, "tempesta_http_stage_duration_ns_bucket"
+			   "{stage=\"%s\",le=\"+Inf\"} %llu\n"
+			   "tempesta_http_stage_duration_ns_sum"
+			   "{stage=\"%s\"} %llu\n"
+			   "tempesta_http_stage_duration_ns_count"
+			   "{stage=\"%s\"} %llu\n",
+			   names[s], cnt, names[s],
+			   mul_u64_u32_div(sum, 1000000, tsc_khz),
+			   names[s], cnt);
+	}
+}
+
+/*
+ * Show the forwarding queues sizes and the requests wait time histograms by
+ * priorities of the requests, the same way as tfw_metrics_stages_show().
+ */
+static void
+tfw_metrics_queues_show(struct seq_file *seq)
+{
+	static const char *const names[TFW_HTTP_PRIO_NUM] = {
+		[TFW_HTTP_PRIO_LOW]	= "low",
+		[TFW_HTTP_PRIO_NORMAL]	= "normal",
+		[TFW_HTTP_PRIO_HIGH]	= "high",
+	};
+	int cpu;
+	unsigned int p, i;
+
+	seq_printf(seq, "# TYPE tempesta_fwd_queue_size gauge\n");
+	for (p = TFW_HTTP_PRIO_LOW; p < TFW_HTTP_PRIO_NUM; ++p) {
+		long n = 0;
+
+		for_each_online_cpu(cpu)
+			n += per_cpu_ptr(&tfw_http_queue_stat, cpu)->queued[p];
+		seq_printf(seq, "tempesta_fwd_queue_size{priority=\"%s\"} %ld\n",
+			   names[p], max(n, 0L));
+	}
+
+	if (!tsc_khz)
+		return;
+
+	seq_printf(seq, "# TYPE tempesta_fwd_queue_wait_ns histogram\n");
+	for (p = TFW_HTTP_PRIO_LOW; p < TFW_HTTP_PRIO_NUM; ++p) {
+		u64 cnt = 0, sum = 0;
+
+		for (i = 0; i < TFW_HTTP_STAGE_HBKTS; ++i) {
+			for_each_online_cpu(cpu)
+				cnt += per_cpu_ptr(&tfw_http_queue_stat, cpu)
+					->cnt[p][i];
+			if (i == TFW_HTTP_STAGE_HBKTS - 1)
+				break;
+			seq_printf(seq, "tempesta_fwd_queue_wait_ns_bucket"
+				   "{priority=\"%s\",le=\"%llu\"} %llu\n",
+				   names[p],
+				   mul_u64_u32_div(1ULL << i, 1000000,
+						   tsc_khz),
+				   cnt);
+		}
+		for_each_online_cpu(cpu)
+			sum += per_cpu_ptr(&tfw_http_queue_stat, cpu)->sum[p];
+		seq_printf(seq, "tempesta_fwd_queue_wait_ns_bucket"
+			   "{priority=\"%s\",le=\"+Inf\"} %llu\n"
+			   "tempesta_fwd_queue_wait_ns_sum"
+			   "{priority=\"%s\"} %llu\n"
+			   "tempesta_fwd_queue_wait_ns_count"
+			   "{priority=\"%s\"} %llu\n",
+			   names[p], cnt, names[p],
+			   mul_u64_u32_div(sum, 1000000, tsc_khz),
+			   names[p], cnt);
+	}
+}
+
+static int
+tfw_metrics_seq_show(struct seq_file *seq, void *off)
+{
+	int cpu;
+	size_t i;
+	bool percpu = !!seq->private;
+	TfwPerfStat *stat;
+	TlsHsMemStat hs_stat;
+	TlsTicketStat tkt_stat;
+	SsStat *ss_stat;
+	long mem_curr[TFW_MEM_NUM], mem_peak[TFW_MEM_NUM];
+
+	stat = kmalloc_array(nr_cpu_ids, sizeof(*stat), GFP_KERNEL);
+	ss_stat = kmalloc_array(nr_cpu_ids, sizeof(*ss_stat), GFP_KERNEL);
+	if (!stat || !ss_stat) {
+		kfree(stat);
+		kfree(ss_stat);
+		return -ENOMEM;
+	}
+	for_each_online_cpu(cpu)
+		memcpy(&stat[cpu], per_cpu_ptr(&tfw_perfstat, cpu),
+		       sizeof(*stat));
+	ss_get_stat(ss_stat);
+
+	for (i = 0; i < ARRAY_SIZE(tfw_metrics); ++i) {
+		seq_printf(seq, "# TYPE %s %s\n", tfw_metrics[i].name,
+			   tfw_metrics[i].gauge ? "gauge" : "counter");
+		if (!percpu) {
+			u64 sum = 0;
+
+			for_each_online_cpu(cpu)
+				sum += TFW_METRIC_VAL(&stat[cpu], i);
+			seq_printf(seq, "%s %llu\n", tfw_metrics[i].name, sum);
+			continue;
+		}
+		for_each_online_cpu(cpu)
+			seq_printf(seq, "%s{cpu=\"%d\"} %llu\n",
+				   tfw_metrics[i].name, cpu,
+				   TFW_METRIC_VAL(&stat[cpu], i));
+	}
+
+	seq_printf(seq, "# TYPE tempesta_ss_wq_size gauge\n");
+	for_each_online_cpu(cpu)
+		seq_printf(seq, "tempesta_ss_wq_size{cpu=\"%d\"} %u\n",
+			   cpu, ss_stat[cpu].rb_wq_sz);
+	seq_printf(seq, "# TYPE tempesta_ss_backlog_size gauge\n");
+	for_each_online_cpu(cpu)
+		seq_printf(seq, "tempesta_ss_backlog_size{cpu=\"%d\"} %u\n",
+			   cpu, ss_stat[cpu].backlog_sz);
+	seq_printf(seq, "# TYPE tempesta_ss_wq_contended_total counter\n");
+	for_each_online_cpu(cpu)
+		seq_printf(seq, "tempesta_ss_wq_contended_total{cpu=\"%d\"}"
+			   " %lu\n", cpu, ss_stat[cpu].rb_wq_contended);
+	seq_printf(seq, "# TYPE tempesta_skb_in_flight gauge\n"
+		   "tempesta_skb_in_flight %ld\n", __get_skb_count());
+
+	ttls_hs_mem_stat(&hs_stat);
+	seq_printf(seq, "# TYPE tempesta_tls_hs_num gauge\n"
+		   "tempesta_tls_hs_num %llu\n", (u64)hs_stat.hs_num);
+	seq_printf(seq, "# TYPE tempesta_tls_hs_mem_in_use_bytes gauge\n"
+		   "tempesta_tls_hs_mem_in_use_bytes %llu\n",
+		   (u64)hs_stat.in_use);
+	seq_printf(seq, "# TYPE tempesta_tls_hs_mem_cached_bytes gauge\n"
+		   "tempesta_tls_hs_mem_cached_bytes %llu\n",
+		   (u64)hs_stat.cached);
+	ttls_ticket_stat(&tkt_stat);
+	seq_printf(seq, "# TYPE tempesta_tls_tickets_issued_total counter\n"
+		   "tempesta_tls_tickets_issued_total %lu\n", tkt_stat.issued);
+	seq_printf(seq, "# TYPE tempesta_tls_tickets_resumed_total counter\n"
+		   "tempesta_tls_tickets_resumed_total %lu\n",
+		   tkt_stat.resumed);
+	seq_printf(seq, "# TYPE tempesta_tls_tickets_rejected_total counter\n"
+		   "tempesta_tls_tickets_rejected_total %lu\n",
+		   tkt_stat.rejected);
+	seq_printf(seq, "# TYPE tempesta_tls_tickets_cycles_total counter\n"
+		   "tempesta_tls_tickets_cycles_total{op=\"issue\"} %lu\n"
+		   "tempesta_tls_tickets_cycles_total{op=\"parse\"} %lu\n",
+		   tkt_stat.write_cycles, tkt_stat.parse_cycles);
+	seq_printf(seq, "# TYPE tempesta_access_log_drops_total counter\n"
+		   "tempesta_access_log_drops_total %llu\n",
+		   tfw_access_log_drops());
+
+	tfw_mem_stat_collect(mem_curr, mem_peak);
+	seq_printf(seq, "# TYPE tempesta_mem_bytes gauge\n");
+	for (i = 0; i < TFW_MEM_NUM; ++i)
+		seq_printf(seq, "tempesta_mem_bytes{type=\"%s\"} %ld\n",
+			   tfw_mem_names[i], mem_curr[i]);
+	seq_printf(seq, "# TYPE tempesta_mem_peak_bytes gauge\n");
+	for (i = 0; i < TFW_MEM_NUM; ++i)
+		seq_printf(seq, "tempesta_mem_peak_bytes{type=\"%s\"} %ld\n",
+			   tfw_mem_names[i], mem_peak[i]);
+
+	tfw_cache_metrics_show(seq);
+	tfw_metrics_stages_show(seq);
+	tfw_metrics_queues_show(seq);
+
+	/* Servers may be removed during reconfiguration. */
+	if (!tfw_runstate_is_reconfig()) {
+		seq_printf(seq, "# TYPE tempesta_server_response_time_ms"
+			   " gauge\n");
+		tfw_sg_for_each_srv_data(tfw_metrics_srv_show, seq);
+	}
+
+	kfree(ss_stat);
+	kfree(stat);
+
+	return 0;
+}
+
+#undef TFW_METRIC_VAL
+
+static int
+tfw_metrics_seq_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, tfw_metrics_seq_show, PDE_DATA(inode));
+}
+
 static int
 tfw_srvstats_seq_show(struct seq_file *seq, void *off)
 {
@@ -257,13 +755,154 @@ tfw_srvstats_seq_open(struct inode *inode, struct file *file)
 	return single_open(file, tfw_srvstats_seq_reconfig, PDE_DATA(inode));
 }
 
+static const char *tfw_lat_stats_names[TFW_LAT_STATS_NUM] = {
+	[TFW_LAT_STATS_CACHE]		= "Cache hits",
+	[TFW_LAT_STATS_UPSTREAM]	= "Upstream responses",
+};
+
+static void
+tfw_lat_stats_seq_print(struct seq_file *seq, void *apm_lat[])
+{
+	size_t i, k;
+	unsigned int val[ARRAY_SIZE(tfw_pstats_ith)] = { 0 };
+	TfwPrcntlStats pstats = {
+		.ith = tfw_pstats_ith,
+		.val = val,
+		.psz = ARRAY_SIZE(tfw_pstats_ith)
+	};
+
+	for (k = 0; k < TFW_LAT_STATS_NUM; ++k) {
+		if (!apm_lat[k])
+			continue;
+		tfw_apm_stats_bh(apm_lat[k], &pstats);
+
+		seq_printf(seq, "%s latency\n", tfw_lat_stats_names[k]);
+		seq_printf(seq, "\tMinimal\t: %dms\n",
+			   pstats.val[TFW_PSTATS_IDX_MIN]);
+		seq_printf(seq, "\tAverage\t: %dms\n",
+			   pstats.val[TFW_PSTATS_IDX_AVG]);
+		seq_printf(seq, "\tMaximum\t: %dms\n",
+			   pstats.val[TFW_PSTATS_IDX_MAX]);
+		for (i = TFW_PSTATS_IDX_ITH; i < ARRAY_SIZE(tfw_pstats_ith); ++i)
+			seq_printf(seq, "\t%02d%%\t: %dms\n",
+				   pstats.ith[i], pstats.val[i]);
+	}
+}
+
+/*
+ * End-to-end latency statistics of a vhost or a location: from receiving
+ * of a request to forwarding of the response, separately for responses
+ * from the cache and from upstream servers.
+ */
+static int
+tfw_vhstats_seq_show(struct seq_file *seq, void *off)
+{
+	TfwVhost *vhost = seq->private;
+
+	tfw_lat_stats_seq_print(seq, vhost->apm_lat);
+
+	return 0;
+}
+
+static int
+tfw_locstats_seq_show(struct seq_file *seq, void *off)
+{
+	TfwLocation *loc = seq->private;
+
+	seq_printf(seq, "Location\t: %.*s\n", (int)loc->len, loc->arg);
+	tfw_lat_stats_seq_print(seq, loc->apm_lat);
+
+	return 0;
+}
+
+/*
+ * Resource usage of a vhost summed over all the CPUs.
+ */
+static int
+tfw_vhusage_seq_show(struct seq_file *seq, void *off)
+{
+	int cpu;
+	TfwVhost *vhost = seq->private;
+	TfwVhostAcct sum = {};
+
+	if (vhost->acct)
+		for_each_online_cpu(cpu) {
+			TfwVhostAcct *a = per_cpu_ptr(vhost->acct, cpu);
+
+			sum.cycles += a->cycles;
+			sum.rx_bytes += a->rx_bytes;
+			sum.tx_bytes += a->tx_bytes;
+			sum.reqs += a->reqs;
+			sum.throttled += a->throttled;
+		}
+
+	seq_printf(seq, "Requests		: %llu
+", sum.reqs);
+	seq_printf(seq, "CPU cycles		: %llu
+", sum.cycles);
+	seq_printf(seq, "CPU cycles per request	: %llu
+",
+		   sum.reqs ? div64_u64(sum.cycles, sum.reqs) : 0ULL);
+	seq_printf(seq, "Bytes received		: %llu
+", sum.rx_bytes);
+	seq_printf(seq, "Bytes sent		: %llu
+", sum.tx_bytes);
+	seq_printf(seq, "Requests throttled	: %llu
+", sum.throttled);
+	seq_printf(seq, "CPU budget		: %u%%
+", vhost->budget_cpu);
+	seq_printf(seq, "Bandwidth budget	: %lu
+", vhost->budget_bw);
+	tfw_cache_acct_vhost_show(seq, vhost);
+
+	return 0;
+}
+
+static int
+tfw_vhstats_seq_reconfig(struct seq_file *seq, void *off)
+{
+	/* Reference to vhost may be broken during reconfig. */
+	seq_printf(seq,
+		   "Per-Vhost statistics is unavailable during reconfiguration\n");
+
+	return 0;
+}
+
+static int
+tfw_vhstats_seq_open(struct inode *inode, struct file *file)
+{
+	if (!tfw_runstate_is_reconfig())
+		return single_open(file, tfw_vhstats_seq_show, PDE_DATA(inode));
+	return single_open(file, tfw_vhstats_seq_reconfig, PDE_DATA(inode));
+}
+
+static int
+tfw_vhusage_seq_open(struct inode *inode, struct file *file)
+{
+	if (!tfw_runstate_is_reconfig())
+		return single_open(file, tfw_vhusage_seq_show, PDE_DATA(inode));
+	return single_open(file, tfw_vhstats_seq_reconfig, PDE_DATA(inode));
+}
+
+static int
+tfw_locstats_seq_open(struct inode *inode, struct file *file)
+{
+	if (!tfw_runstate_is_reconfig())
+		return single_open(file, tfw_locstats_seq_show,
+				   PDE_DATA(inode));
+	return single_open(file, tfw_vhstats_seq_reconfig, PDE_DATA(inode));
+}
+
 /*
  * Start/stop routines.
  */
 static struct proc_dir_entry *tfw_procfs_tempesta;
 static struct proc_dir_entry *tfw_procfs_perfstat;
+static struct proc_dir_entry *tfw_procfs_metrics;
+static struct proc_dir_entry *tfw_procfs_metrics_percpu;
 static struct proc_dir_entry *tfw_procfs_srvstats;
 static struct proc_dir_entry *tfw_procfs_sgstats;
+static struct proc_dir_entry *tfw_procfs_vhstats;
 
 static struct file_operations tfw_srvstats_fops = {
 	.owner		= THIS_MODULE,
@@ -273,6 +912,69 @@ static struct file_operations tfw_srvstats_fops = {
 	.release	= single_release,
 };
 
+static struct file_operations tfw_vhstats_fops = {
+	.owner		= THIS_MODULE,
+	.open		= tfw_vhstats_seq_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static struct file_operations tfw_vhusage_fops = {
+	.owner		= THIS_MODULE,
+	.open		= tfw_vhusage_seq_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static struct file_operations tfw_locstats_fops = {
+	.owner		= THIS_MODULE,
+	.open		= tfw_locstats_seq_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+/*
+ * Create 'vhosts/<name>/usage' entry for the vhost resource usage,
+ * 'vhosts/<name>/latency' entry for the vhost statistics and
+ * 'vhosts/<name>/location_<N>' entries for the locations statistics.
+ * Location arguments may contain slashes, so the locations are named
+ * by their order in the configuration.
+ */
+static int
+tfw_procfs_vhost_create(TfwVhost *vhost)
+{
+	size_t i;
+	struct proc_dir_entry *pfs_vh;
+	char loc_name[sizeof("location_") + 20];
+
+	if (!(pfs_vh = proc_mkdir(vhost->name.data, tfw_procfs_vhstats)))
+		return -ENOENT;
+	if (!proc_create_data("usage", S_IRUGO, pfs_vh, &tfw_vhusage_fops,
+			      vhost))
+		return -ENOENT;
+
+	for (i = 0; i < vhost->loc_sz; ++i) {
+		TfwLocation *loc = &vhost->loc[i];
+
+		if (!loc->lat_stats)
+			continue;
+		snprintf(loc_name, sizeof(loc_name), "location_%zu", i);
+		if (!proc_create_data(loc_name, S_IRUGO, pfs_vh,
+				      &tfw_locstats_fops, loc))
+			return -ENOENT;
+	}
+	if (!test_bit(TFW_VHOST_B_LAT_STATS, &vhost->flags))
+		return 0;
+	if (!proc_create_data("latency", S_IRUGO, pfs_vh, &tfw_vhstats_fops,
+			      vhost))
+		return -ENOENT;
+
+	return 0;
+}
+
 static int
 tfw_procfs_srv_create(TfwServer *srv)
 {
@@ -315,17 +1017,25 @@ tfw_procfs_cleanup(void)
 {
 	remove_proc_subtree("servers", tfw_procfs_tempesta);
 	tfw_procfs_srvstats = NULL;
+	remove_proc_subtree("vhosts", tfw_procfs_tempesta);
+	tfw_procfs_vhstats = NULL;
 }
 
 static int
 tfw_procfs_start(void)
 {
+	int r;
+
 	if (!tfw_procfs_tempesta)
 		return -ENOENT;
 
 	tfw_procfs_cleanup();
 	if (!(tfw_procfs_srvstats = proc_mkdir("servers", tfw_procfs_tempesta)))
 		return -ENOENT;
+	if (!(tfw_procfs_vhstats = proc_mkdir("vhosts", tfw_procfs_tempesta)))
+		return -ENOENT;
+	if ((r = tfw_vhost_for_each(tfw_procfs_vhost_create)))
+		return r;
 
 	return tfw_sg_for_each_srv(tfw_procfs_sg_create, tfw_procfs_srv_create);
 }
@@ -359,6 +1069,14 @@ static struct file_operations tfw_perfstat_fops = {
 	.release	= single_release,
 };
 
+static struct file_operations tfw_metrics_fops = {
+	.owner		= THIS_MODULE,
+	.open		= tfw_metrics_seq_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
 int
 tfw_procfs_init(void)
 {
@@ -372,12 +1090,28 @@ tfw_procfs_init(void)
 	if (!tfw_procfs_perfstat)
 		goto out_tempesta;
 
+	tfw_procfs_metrics = proc_create_data("metrics", S_IRUGO,
+					      tfw_procfs_tempesta,
+					      &tfw_metrics_fops, NULL);
+	if (!tfw_procfs_metrics)
+		goto out_perfstat;
+	tfw_procfs_metrics_percpu = proc_create_data("metrics_percpu", S_IRUGO,
+						     tfw_procfs_tempesta,
+						     &tfw_metrics_fops,
+						     (void *)1);
+	if (!tfw_procfs_metrics_percpu)
+		goto out_metrics;
+
 	tfw_mod_register(&tfw_procfs_mod);
 
 	return 0;
 
 out:
 	return -ENOMEM;
+out_metrics:
+	remove_proc_entry("metrics", tfw_procfs_tempesta);
+out_perfstat:
+	remove_proc_entry("perfstat", tfw_procfs_tempesta);
 out_tempesta:
 	remove_proc_entry("tempesta", NULL);
 	goto out;
@@ -387,6 +1121,8 @@ void
 tfw_procfs_exit(void)
 {
 	tfw_mod_unregister(&tfw_procfs_mod);
+	remove_proc_entry("metrics_percpu", tfw_procfs_tempesta);
+	remove_proc_entry("metrics", tfw_procfs_tempesta);
 	remove_proc_entry("perfstat", tfw_procfs_tempesta);
 	remove_proc_entry("tempesta", NULL);
 }
@@ -26,11 +26,15 @@
  * @pfl_hits		- The number of page frag lookup hits.
  * @pfl_misses		- The number of page frag lookup misses.
  * @wq_full		- How many times we faced work queue full.
+ * @pgpool_hits		- The number of skb pages reused from page pool.
+ * @pgpool_misses	- The number of skb pages allocated by page allocator.
  */
 typedef struct {
 	u64	pfl_hits;
 	u64	pfl_misses;
 	u64	wq_full;
+	u64	pgpool_hits;
+	u64	pgpool_misses;
 } TfwSsStat;
 
 /*
@@ -61,19 +65,36 @@ typedef struct {
 	u64	conn_disconnects;					\
 	u64	rx_bytes;
 
+/*
+ * @msgs_streamed	- The number of messages forwarded to clients before
+ *			  they're received in full.
+ * @rx_paused		- The number of connections paused for slow clients.
+ * @conn_promoted	- The number of spare connections promoted to
+ *			  replace failed ones.
+ */
 typedef struct {
 	TFW_STAT_COMMON;
 	u64	conn_restricted;
+	u64	msgs_streamed;
+	u64	rx_paused;
+	u64	conn_promoted;
 } TfwSrvStat;
 
 /*
  * @msgs_fromcache	- The number of messages served from cache.
  * @online		- The number of clients online.
+ * @slow_held		- The number of bytes queued to slow clients.
+ * @msgs_mirrored	- The number of messages mirrored to shadow servers.
+ * @mirror_capped	- The number of messages not mirrored due to the caps
+ *			  of shadow server groups.
  */
 typedef struct {
 	TFW_STAT_COMMON;
 	u64	msgs_fromcache;
 	u64	online;
+	u64	slow_held;
+	u64	msgs_mirrored;
+	u64	mirror_capped;
 } TfwClntStat;
 
 /*
@@ -81,21 +102,190 @@ typedef struct {
  *
  * @hits	- The number of cache hits.
  * @misses	- The number of cache misses.
+ * @collapsed	- The number of cache misses collapsed into a pending fetch.
+ * @evicted	- The number of cache entries evicted to free space.
+ * @not_admitted - The number of responses not stored by admission filter.
+ * @wq_ipis	- The number of IPIs to process queued cross-node cache works.
+ * @wq_batches	- The number of batches of queued cache works processed.
+ * @wq_works	- The number of queued cache works processed in the batches.
+ * @replicated	- The number of cache entries replicated to other nodes.
+ * @repl_skipped - The number of cache entry replications skipped.
+ * @demoted	- The number of evicted cache entries demoted to the disk.
+ * @demote_skipped - The number of evicted cache entries not demoted.
+ * @promoted	- The number of cache entries promoted from the disk.
  */
 typedef struct {
 	u64	hits;
 	u64	misses;
+	u64	collapsed;
+	u64	evicted;
+	u64	not_admitted;
+	u64	wq_ipis;
+	u64	wq_batches;
+	u64	wq_works;
+	u64	replicated;
+	u64	repl_skipped;
+	u64	demoted;
+	u64	demote_skipped;
+	u64	promoted;
 } TfwCacheStat;
 
+/*
+ * Memory pools statistics.
+ *
+ * @pg_hits	- The number of pages allocated from the per-CPU caches.
+ * @pg_misses	- The number of single pages allocated from the buddy allocator.
+ * @pg_cap	- The total capacity of the per-CPU page caches, in pages.
+ * @req_n	- The number of freed requests.
+ * @req_bytes	- The sum of peak pool sizes of the freed requests.
+ * @resp_n	- The number of freed responses.
+ * @resp_bytes	- The sum of peak pool sizes of the freed responses.
+ * @hdr_n	- The number of parsed headers.
+ * @hdr_chunks	- The sum of chunk numbers of the parsed headers.
+ */
+typedef struct {
+	u64	pg_hits;
+	u64	pg_misses;
+	u64	pg_cap;
+	u64	req_n;
+	u64	req_bytes;
+	u64	resp_n;
+	u64	resp_bytes;
+	u64	hdr_n;
+	u64	hdr_chunks;
+} TfwPoolStat;
+
 typedef struct {
 	TfwSsStat	ss;
 	TfwClntStat	clnt;
 	TfwSrvStat	serv;
 	TfwCacheStat	cache;
+	TfwPoolStat	pool;
 } TfwPerfStat;
 
 DECLARE_PER_CPU_ALIGNED(TfwPerfStat, tfw_perfstat);
 
+/*
+ * Request processing stages. Each stage lasts until the next stage passed
+ * by the request, or until the response is sent to the client.
+ *
+ * @TFW_HTTP_STAGE_PARSE	- request parsing and Frang checks;
+ * @TFW_HTTP_STAGE_CACHE	- cache lookup, or cached response building;
+ * @TFW_HTTP_STAGE_SCHED	- scheduling and queueing to a server;
+ * @TFW_HTTP_STAGE_UPSTREAM	- waiting for the server response;
+ * @TFW_HTTP_STAGE_RESP		- response processing;
+ * @TFW_HTTP_STAGE_TOTAL	- the whole request processing time, only
+ *				  for statistics;
+ */
+enum {
+	TFW_HTTP_STAGE_PARSE,
+	TFW_HTTP_STAGE_CACHE,
+	TFW_HTTP_STAGE_SCHED,
+	TFW_HTTP_STAGE_UPSTREAM,
+	TFW_HTTP_STAGE_RESP,
+	TFW_HTTP_STAGE_TOTAL,
+	TFW_HTTP_STAGE_NUM = TFW_HTTP_STAGE_TOTAL,
+	TFW_HTTP_STAGE_STAT_NUM
+};
+
+/* Number of power of 2 buckets of stage durations in CPU cycles. */
+#define TFW_HTTP_STAGE_HBKTS		40
+
+/*
+ * Histograms of request processing stages durations.
+ *
+ * @cnt		- number of stages with duration up to 2^i CPU cycles;
+ * @sum		- total duration of the stages, in CPU cycles;
+ */
+typedef struct {
+	u64	cnt[TFW_HTTP_STAGE_STAT_NUM][TFW_HTTP_STAGE_HBKTS];
+	u64	sum[TFW_HTTP_STAGE_STAT_NUM];
+} TfwHttpStageStat;
+
+DECLARE_PER_CPU_ALIGNED(TfwHttpStageStat, tfw_http_stage_stat);
+
+/*
+ * Priorities of requests, see tfw_http_req_shed() and tfw_http_req_enlist().
+ */
+enum {
+	TFW_HTTP_PRIO_UNSPEC,
+	TFW_HTTP_PRIO_LOW,
+	TFW_HTTP_PRIO_NORMAL,
+	TFW_HTTP_PRIO_HIGH,
+	TFW_HTTP_PRIO_NUM
+};
+
+/*
+ * Statistics of the server connections forwarding queues by priorities of
+ * the requests.
+ *
+ * @queued	- number of the queued requests, the number for a CPU may be
+ *		  negative since requests are queued and dequeued on
+ *		  different CPUs;
+ * @cnt		- number of requests waited for forwarding up to 2^i CPU
+ *		  cycles;
+ * @sum		- total wait time of the requests, in CPU cycles;
+ */
+typedef struct {
+	long	queued[TFW_HTTP_PRIO_NUM];
+	u64	cnt[TFW_HTTP_PRIO_NUM][TFW_HTTP_STAGE_HBKTS];
+	u64	sum[TFW_HTTP_PRIO_NUM];
+} TfwHttpQueueStat;
+
+DECLARE_PER_CPU_ALIGNED(TfwHttpQueueStat, tfw_http_queue_stat);
+
+/*
+ * Memory footprint categories.
+ *
+ * @TFW_MEM_CONN	- client, server and tunnel connection objects without
+ *			  the TLS and HTTP/2 contexts;
+ * @TFW_MEM_TLS		- TLS contexts of the client connections;
+ * @TFW_MEM_H2		- HTTP/2 contexts of the client connections;
+ * @TFW_MEM_HPACK	- pool pages of the HPACK tables;
+ * @TFW_MEM_MSG		- pool pages of the HTTP messages;
+ * @TFW_MEM_POOL	- pages of the other pools;
+ */
+enum {
+	TFW_MEM_CONN,
+	TFW_MEM_TLS,
+	TFW_MEM_H2,
+	TFW_MEM_HPACK,
+	TFW_MEM_MSG,
+	TFW_MEM_POOL,
+	TFW_MEM_NUM
+};
+
+/*
+ * Memory footprint accounting, in bytes. Objects are often freed on another
+ * CPU than allocated, so a per-CPU @delta may be negative. The deltas are
+ * folded into global totals each TFW_MEM_BATCH bytes to track high-water
+ * marks, which are accurate up to TFW_MEM_BATCH bytes per CPU.
+ */
+#define TFW_MEM_BATCH		(64 * 1024)
+
+typedef struct {
+	long	delta[TFW_MEM_NUM];
+} TfwMemStat;
+
+DECLARE_PER_CPU_ALIGNED(TfwMemStat, tfw_mem_stat);
+
+void __tfw_mem_fold(int type, long delta);
+void tfw_mem_stat_collect(long *curr, long *peak);
+
+/*
+ * Account @bytes allocated, or freed if negative, for memory category @type.
+ * Safe in any context.
+ */
+static inline void
+tfw_mem_acct(int type, long bytes)
+{
+	long v = this_cpu_add_return(tfw_mem_stat.delta[type], bytes);
+
+	if (unlikely(v >= TFW_MEM_BATCH || v <= -TFW_MEM_BATCH))
+		__tfw_mem_fold(type, this_cpu_xchg(tfw_mem_stat.delta[type],
+						   0));
+}
+
 /*
  * this_cpu_inc/add() macros are implemented via "do {} while(0)" code
  * block. (see <linux/percpu-defs.h>) Note that it is not a statement
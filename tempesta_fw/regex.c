@@ -0,0 +1,879 @@
+/**
+ *		Tempesta FW
+ *
+ * Multi-pattern regular expressions matching.
+ *
+ * A set of patterns is compiled at configuration time into a single DFA, so
+ * a request field is scanned once and the time of the matching is linear in
+ * the field length regardless of the number and complexity of the patterns.
+ * That is the approach of Hyperscan, however we don't need its streaming and
+ * SIMD machinery: the fields are small and we need only the first matching
+ * pattern, not all the matches.
+ *
+ * Each pattern is parsed into a Thompson NFA, the NFAs of all the patterns
+ * are joined by their initial states, and the subset construction builds the
+ * DFA. The input bytes are split into classes, the bytes having the same
+ * transitions in all the NFA states, so the DFA transitions table has a row
+ * of the classes number for each state.
+ *
+ * The DFA tracks only the patterns, which can be the first matching one:
+ * once a pattern matches a prefix of the input, the NFA states of the pattern
+ * and all the following patterns are removed from the DFA states. Thus the
+ * scanning usually stops on the dead state long before the end of the input.
+ *
+ * Supported syntax is a subset of POSIX ERE: literals, '.', bracket
+ * expressions with ranges and negation, '\d', '\w', '\s' and their negated
+ * forms, grouping with '(' and ')', alternation '|', the '*', '+', '?'
+ * quantifiers and bounded repetitions '{m}', '{m,}' and '{m,n}'. The '^' and
+ * '$' anchors are allowed only at the beginning and at the end of a pattern,
+ * a pattern without the anchors matches any substring of the input. Back
+ * references and lookarounds can't be expressed by a DFA and aren't
+ * supported. Like all the other match operators, the matching is
+ * case-insensitive.
+ *
+ * Copyright (C) 2020 Tempesta Technologies, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#include <linux/bitmap.h>
+#include <linux/ctype.h>
+#include <linux/jhash.h>
+#include <linux/log2.h>
+#include <linux/mm.h>
+
+#include "regex.h"
+
+/* Maximum number of NFA states for all the patterns. */
+#define TFW_REGEX_NFA_MAX	4096
+/* Maximum number of DFA states, the transitions are 16-bit. */
+#define TFW_REGEX_DFA_MAX	(1 << 16)
+/* Maximum memory for the DFA and the subset construction. */
+#define TFW_REGEX_MEM_MAX	(16 << 20)
+/* Maximum nesting of groups. */
+#define TFW_REGEX_DEPTH_MAX	32
+/* Maximum count of a bounded repetition. */
+#define TFW_REGEX_REP_MAX	255
+
+#define TFW_REGEX_NONE		UINT_MAX
+
+enum {
+	TFW_RE_CSET,
+	TFW_RE_EPS,
+	TFW_RE_MATCH,
+};
+
+/**
+ * NFA state.
+ *
+ * @type	- the state type;
+ * @end		- the pattern is anchored at the end, for TFW_RE_MATCH;
+ * @id		- the pattern of the state;
+ * @out		- the next state;
+ * @out1	- the alternative next state for TFW_RE_EPS;
+ * @cset	- the bytes set to move to @out for TFW_RE_CSET;
+ */
+typedef struct {
+	unsigned char	type;
+	bool		end;
+	unsigned int	id;
+	unsigned int	out;
+	unsigned int	out1;
+	DECLARE_BITMAP(cset, 256);
+} TfwReState;
+
+/**
+ * NFA fragment: @s is the initial state and @e is the final state, which
+ * @out isn't linked yet.
+ */
+typedef struct {
+	unsigned int	s;
+	unsigned int	e;
+} TfwReFrag;
+
+typedef struct {
+	const char	*p;
+	const char	*end;
+	TfwReState	*st;
+	unsigned int	n;
+	unsigned int	id;
+	unsigned int	depth;
+} TfwReParser;
+
+static int __re_alt(TfwReParser *P, TfwReFrag *f);
+
+static unsigned int
+__re_state(TfwReParser *P, unsigned char type)
+{
+	TfwReState *st;
+
+	if (P->n == TFW_REGEX_NFA_MAX)
+		return TFW_REGEX_NONE;
+	st = &P->st[P->n];
+	memset(st, 0, sizeof(*st));
+	st->type = type;
+	st->id = P->id;
+	st->out = st->out1 = TFW_REGEX_NONE;
+
+	return P->n++;
+}
+
+static int
+__re_eps(TfwReParser *P, TfwReFrag *f)
+{
+	if ((f->s = f->e = __re_state(P, TFW_RE_EPS)) == TFW_REGEX_NONE)
+		return -E2BIG;
+	return 0;
+}
+
+static void
+__re_cat(TfwReParser *P, TfwReFrag *f, const TfwReFrag *next)
+{
+	if (f->s == TFW_REGEX_NONE) {
+		*f = *next;
+		return;
+	}
+	P->st[f->e].out = next->s;
+	f->e = next->e;
+}
+
+/* Apply '*', '+' (@plus) or '?' (@opt) to @f. */
+static int
+__re_loop(TfwReParser *P, TfwReFrag *f, bool plus, bool opt)
+{
+	unsigned int s, j;
+
+	if ((s = __re_state(P, TFW_RE_EPS)) == TFW_REGEX_NONE
+	    || (j = __re_state(P, TFW_RE_EPS)) == TFW_REGEX_NONE)
+		return -E2BIG;
+	P->st[s].out = f->s;
+	P->st[s].out1 = j;
+	P->st[f->e].out = opt ? j : s;
+	if (!plus)
+		f->s = s;
+	f->e = j;
+
+	return 0;
+}
+
+static void
+__re_casefold(unsigned long *cset)
+{
+	int c;
+
+	for (c = 'a'; c <= 'z'; ++c)
+		if (test_bit(c, cset) || test_bit(toupper(c), cset)) {
+			__set_bit(c, cset);
+			__set_bit(toupper(c), cset);
+		}
+}
+
+/* Add the bytes of the '\d', '\w' or '\s' like class @c to @cset. */
+static bool
+__re_class_esc(unsigned long *cset, char c)
+{
+	DECLARE_BITMAP(tmp, 256);
+	int b;
+
+	/* Only ASCII bytes, the kernel ctype also classifies Latin-1. */
+	bitmap_zero(tmp, 256);
+	for (b = 0; b < 128; ++b)
+		switch (tolower(c)) {
+		case 'd':
+			if (isdigit(b))
+				__set_bit(b, tmp);
+			break;
+		case 'w':
+			if (isalnum(b) || b == '_')
+				__set_bit(b, tmp);
+			break;
+		case 's':
+			if (isspace(b))
+				__set_bit(b, tmp);
+			break;
+		default:
+			return false;
+		}
+	if (isupper(c))
+		bitmap_complement(tmp, tmp, 256);
+	bitmap_or(cset, cset, tmp, 256);
+
+	return true;
+}
+
+static unsigned char
+__re_esc_char(char c)
+{
+	switch (c) {
+	case 't':
+		return '\t';
+	case 'n':
+		return '\n';
+	case 'r':
+		return '\r';
+	}
+	return c;
+}
+
+/* Parse a bracket expression following '['. */
+static int
+__re_bracket(TfwReParser *P, unsigned long *cset)
+{
+	bool neg = false, first = true;
+	int c, hi;
+
+	if (P->p < P->end && *P->p == '^') {
+		neg = true;
+		++P->p;
+	}
+	while (P->p < P->end && (*P->p != ']' || first)) {
+		first = false;
+		c = (unsigned char)*P->p++;
+		if (c == '\\') {
+			if (P->p == P->end)
+				return -EINVAL;
+			if (__re_class_esc(cset, *P->p)) {
+				++P->p;
+				continue;
+			}
+			c = __re_esc_char(*P->p++);
+		}
+		if (P->end - P->p < 2 || P->p[0] != '-' || P->p[1] == ']') {
+			__set_bit(c, cset);
+			continue;
+		}
+		++P->p;
+		hi = (unsigned char)*P->p++;
+		if (hi == '\\') {
+			if (P->p == P->end)
+				return -EINVAL;
+			hi = __re_esc_char(*P->p++);
+		}
+		if (hi < c)
+			return -EINVAL;
+		bitmap_set(cset, c, hi - c + 1);
+	}
+	if (P->p == P->end)
+		return -EINVAL;
+	++P->p;
+
+	__re_casefold(cset);
+	if (neg)
+		bitmap_complement(cset, cset, 256);
+
+	return 0;
+}
+
+static int
+__re_atom(TfwReParser *P, TfwReFrag *f)
+{
+	int r;
+	unsigned int s;
+	unsigned long *cset;
+	char c = *P->p++;
+
+	if (c == '(') {
+		if (++P->depth > TFW_REGEX_DEPTH_MAX)
+			return -EINVAL;
+		if ((r = __re_alt(P, f)))
+			return r;
+		if (P->p == P->end || *P->p != ')')
+			return -EINVAL;
+		++P->p;
+		--P->depth;
+		return 0;
+	}
+	if (strchr("*+?{^$", c))
+		return -EINVAL;
+
+	if ((s = __re_state(P, TFW_RE_CSET)) == TFW_REGEX_NONE)
+		return -E2BIG;
+	f->s = f->e = s;
+	cset = P->st[s].cset;
+
+	switch (c) {
+	case '.':
+		bitmap_fill(cset, 256);
+		return 0;
+	case '[':
+		return __re_bracket(P, cset);
+	case '\\':
+		if (P->p == P->end)
+			return -EINVAL;
+		c = *P->p++;
+		if (__re_class_esc(cset, c))
+			return 0;
+		c = __re_esc_char(c);
+	}
+	__set_bit((unsigned char)c, cset);
+	__re_casefold(cset);
+
+	return 0;
+}
+
+static int
+__re_uint(TfwReParser *P, unsigned int *v)
+{
+	const char *p0 = P->p;
+
+	for (*v = 0; P->p < P->end && isdigit(*P->p); ++P->p) {
+		*v = *v * 10 + *P->p - '0';
+		if (*v > TFW_REGEX_REP_MAX)
+			return -EINVAL;
+	}
+
+	return P->p == p0 ? -EINVAL : 0;
+}
+
+/*
+ * Parse a bounded repetition following '{'. The repeated atom starting at
+ * @atom is parsed once more for each its copy.
+ */
+static int
+__re_bounded(TfwReParser *P, TfwReFrag *f, const char *atom)
+{
+	int r;
+	unsigned int i, min, max;
+	const char *next;
+	TfwReFrag res = { TFW_REGEX_NONE, TFW_REGEX_NONE }, copy = *f;
+
+	if ((r = __re_uint(P, &min)))
+		return r;
+	max = min;
+	if (P->p < P->end && *P->p == ',') {
+		++P->p;
+		max = TFW_REGEX_NONE;
+		if (P->p < P->end && *P->p != '}'
+		    && ((r = __re_uint(P, &max)) || max < min))
+			return -EINVAL;
+	}
+	if (P->p == P->end || *P->p != '}')
+		return -EINVAL;
+	next = ++P->p;
+
+	for (i = 0; i < min || i < max; ++i) {
+		if (i) {
+			P->p = atom;
+			if ((r = __re_atom(P, &copy)))
+				return r;
+		}
+		if (i == min && max == TFW_REGEX_NONE) {
+			if ((r = __re_loop(P, &copy, false, false)))
+				return r;
+			__re_cat(P, &res, &copy);
+			break;
+		}
+		if (i >= min && (r = __re_loop(P, &copy, false, true)))
+			return r;
+		__re_cat(P, &res, &copy);
+	}
+	P->p = next;
+	if (res.s == TFW_REGEX_NONE)
+		return __re_eps(P, f);
+	*f = res;
+
+	return 0;
+}
+
+static int
+__re_repeat(TfwReParser *P, TfwReFrag *f)
+{
+	int r;
+	const char *atom = P->p;
+
+	if ((r = __re_atom(P, f)))
+		return r;
+	if (P->p == P->end)
+		return 0;
+
+	switch (*P->p++) {
+	case '*':
+		r = __re_loop(P, f, false, false);
+		break;
+	case '+':
+		r = __re_loop(P, f, true, false);
+		break;
+	case '?':
+		r = __re_loop(P, f, false, true);
+		break;
+	case '{':
+		r = __re_bounded(P, f, atom);
+		break;
+	default:
+		--P->p;
+		return 0;
+	}
+	/* Stacked quantifiers, e.g. lazy ones, aren't supported. */
+	if (!r && P->p < P->end && strchr("*+?{", *P->p))
+		return -EINVAL;
+
+	return r;
+}
+
+static int
+__re_concat(TfwReParser *P, TfwReFrag *f)
+{
+	int r;
+	TfwReFrag next;
+
+	f->s = f->e = TFW_REGEX_NONE;
+	while (P->p < P->end && *P->p != '|' && *P->p != ')') {
+		if ((r = __re_repeat(P, &next)))
+			return r;
+		__re_cat(P, f, &next);
+	}
+	if (f->s == TFW_REGEX_NONE)
+		return __re_eps(P, f);
+
+	return 0;
+}
+
+static int
+__re_alt(TfwReParser *P, TfwReFrag *f)
+{
+	int r;
+	unsigned int s, j;
+	TfwReFrag alt;
+
+	if ((r = __re_concat(P, f)))
+		return r;
+	while (P->p < P->end && *P->p == '|') {
+		++P->p;
+		if ((r = __re_concat(P, &alt)))
+			return r;
+		if ((s = __re_state(P, TFW_RE_EPS)) == TFW_REGEX_NONE
+		    || (j = __re_state(P, TFW_RE_EPS)) == TFW_REGEX_NONE)
+			return -E2BIG;
+		P->st[s].out = f->s;
+		P->st[s].out1 = alt.s;
+		P->st[f->e].out = j;
+		P->st[alt.e].out = j;
+		f->s = s;
+		f->e = j;
+	}
+
+	return 0;
+}
+
+/*
+ * Parse pattern @pat with index @id. Return the initial state of its NFA or
+ * a negative error code.
+ */
+static long
+__re_parse(TfwReParser *P, const TfwStr *pat, unsigned int id)
+{
+	int r;
+	unsigned int m, s, any;
+	bool start = false, end = false;
+	TfwReFrag f;
+
+	BUG_ON(!TFW_STR_PLAIN(pat));
+	P->p = pat->data;
+	P->end = pat->data + pat->len;
+	P->id = id;
+	P->depth = 0;
+
+	if (P->p < P->end && *P->p == '^') {
+		start = true;
+		++P->p;
+	}
+	/* The trailing '$' is the anchor if it isn't escaped. */
+	if (P->p < P->end && P->end[-1] == '$') {
+		const char *q = P->end - 1;
+
+		while (q > P->p && q[-1] == '\\')
+			--q;
+		if (!((P->end - 1 - q) & 1)) {
+			end = true;
+			--P->end;
+		}
+	}
+
+	if ((r = __re_alt(P, &f)))
+		return r;
+	if (P->p != P->end)
+		return -EINVAL;
+
+	if ((m = __re_state(P, TFW_RE_MATCH)) == TFW_REGEX_NONE)
+		return -E2BIG;
+	P->st[m].end = end;
+	P->st[f.e].out = m;
+	if (start)
+		return f.s;
+
+	/* Unanchored pattern: prepend it with a loop over any byte. */
+	if ((s = __re_state(P, TFW_RE_EPS)) == TFW_REGEX_NONE
+	    || (any = __re_state(P, TFW_RE_CSET)) == TFW_REGEX_NONE)
+		return -E2BIG;
+	bitmap_fill(P->st[any].cset, 256);
+	P->st[any].out = s;
+	P->st[s].out = f.s;
+	P->st[s].out1 = any;
+
+	return s;
+}
+
+/**
+ * Subset construction context.
+ *
+ * @st		- the NFA states;
+ * @nfa_n	- number of the NFA states;
+ * @words	- size of a states set in longs;
+ * @sets	- the NFA states sets of the DFA states;
+ * @stack	- the states stack for the epsilon closure;
+ * @seen	- the states visited by the epsilon closure;
+ * @buckets	- hash table of the DFA states by their sets;
+ * @next	- next DFA state in the hash bucket;
+ * @bits	- log2 of the @buckets number;
+ * @cap		- number of the DFA states the memory is allocated for;
+ * @max		- maximum number of the DFA states;
+ */
+typedef struct {
+	TfwReState	*st;
+	unsigned int	nfa_n;
+	unsigned int	words;
+	unsigned long	*sets;
+	unsigned int	*stack;
+	unsigned long	*seen;
+	unsigned int	*buckets;
+	unsigned int	*next;
+	unsigned int	bits;
+	unsigned int	cap;
+	unsigned int	max;
+} TfwReDfa;
+
+#define __RE_SET(D, i)		((D)->sets + (size_t)(i) * (D)->words)
+
+/* Add state @s and all the states reachable by epsilon moves to @set. */
+static void
+__re_closure(TfwReDfa *D, unsigned long *set, unsigned int s)
+{
+	unsigned int sp = 0;
+
+	D->stack[sp++] = s;
+	while (sp) {
+		s = D->stack[--sp];
+		if (s == TFW_REGEX_NONE || __test_and_set_bit(s, D->seen))
+			continue;
+		if (D->st[s].type != TFW_RE_EPS) {
+			__set_bit(s, set);
+			continue;
+		}
+		D->stack[sp++] = D->st[s].out1;
+		D->stack[sp++] = D->st[s].out;
+	}
+}
+
+/*
+ * Remove the states of the patterns following the first matched one from
+ * @set, they can't be the first matching patterns anymore. Only the match
+ * state of the matched pattern is left, so the DFA states with different
+ * matched patterns are different. Return the first matched pattern.
+ */
+static unsigned int
+__re_prune(TfwReDfa *D, unsigned long *set)
+{
+	unsigned int s, m = TFW_REGEX_NOMATCH;
+
+	for_each_set_bit(s, set, D->nfa_n)
+		if (D->st[s].type == TFW_RE_MATCH && !D->st[s].end)
+			m = min(m, D->st[s].id);
+	if (m == TFW_REGEX_NOMATCH)
+		return m;
+	for_each_set_bit(s, set, D->nfa_n)
+		if (D->st[s].id > m
+		    || (D->st[s].id == m && D->st[s].type != TFW_RE_MATCH))
+			__clear_bit(s, set);
+
+	return m;
+}
+
+static unsigned int
+__re_hash(const TfwReDfa *D, const unsigned long *set)
+{
+	return jhash(set, D->words * sizeof(long), 0) & ((1 << D->bits) - 1);
+}
+
+/* Reallocate @*p of @old bytes to @new bytes. */
+static int
+__re_realloc(void *p, size_t old, size_t new)
+{
+	void **ptr = p, *mem;
+
+	if (!(mem = kvmalloc(new, GFP_KERNEL)))
+		return -ENOMEM;
+	if (*ptr)
+		memcpy(mem, *ptr, min(old, new));
+	kvfree(*ptr);
+	*ptr = mem;
+
+	return 0;
+}
+
+/*
+ * Grow the DFA tables. The sets array has an extra entry for the set being
+ * looked up.
+ */
+static int
+__re_dfa_grow(TfwReDfa *D, TfwRegex *re)
+{
+	unsigned int s, b, cap = min(D->cap ? D->cap * 2 : 64U, D->max);
+	size_t set_sz = D->words * sizeof(long);
+	size_t trans_sz = re->cls_n * sizeof(*re->trans);
+
+	if (__re_realloc(&D->sets, (D->cap + !!D->cap) * set_sz,
+			 (cap + 1) * set_sz)
+	    || __re_realloc(&D->next, D->cap * sizeof(unsigned int),
+			    cap * sizeof(unsigned int))
+	    || __re_realloc(&re->trans, D->cap * trans_sz, cap * trans_sz)
+	    || __re_realloc(&re->match, D->cap * sizeof(unsigned int),
+			    cap * sizeof(unsigned int))
+	    || __re_realloc(&re->match_end, D->cap * sizeof(unsigned int),
+			    cap * sizeof(unsigned int)))
+		return -ENOMEM;
+	D->cap = cap;
+
+	D->bits = order_base_2(cap);
+	kvfree(D->buckets);
+	if (!(D->buckets = kvmalloc(sizeof(unsigned int) << D->bits,
+				    GFP_KERNEL)))
+		return -ENOMEM;
+	memset(D->buckets, 0xff, sizeof(unsigned int) << D->bits);
+	for (s = 0; s < re->states_n; ++s) {
+		b = __re_hash(D, __RE_SET(D, s));
+		D->next[s] = D->buckets[b];
+		D->buckets[b] = s;
+	}
+
+	return 0;
+}
+
+/*
+ * Find the DFA state for the set at index @n, which is the first unused
+ * one, or add a new state. Return the state or TFW_REGEX_NONE if there are
+ * too many states.
+ */
+static unsigned int
+__re_dfa_state(TfwReDfa *D, TfwRegex *re, unsigned int n)
+{
+	unsigned long *set = __RE_SET(D, n);
+	unsigned int s, m, b;
+
+	m = __re_prune(D, set);
+	b = __re_hash(D, set);
+	for (s = D->buckets[b]; s != TFW_REGEX_NONE; s = D->next[s])
+		if (bitmap_equal(__RE_SET(D, s), set, D->nfa_n))
+			return s;
+	if (n == D->cap)
+		return TFW_REGEX_NONE;
+
+	D->next[n] = D->buckets[b];
+	D->buckets[b] = n;
+	re->match[n] = m;
+	re->match_end[n] = TFW_REGEX_NOMATCH;
+	for_each_set_bit(s, set, D->nfa_n)
+		if (D->st[s].type == TFW_RE_MATCH && D->st[s].end)
+			re->match_end[n] = min(re->match_end[n], D->st[s].id);
+	re->states_n = n + 1;
+
+	return n;
+}
+
+/* Split the input bytes into classes of bytes with the same transitions. */
+static void
+__re_byte_classes(TfwRegex *re, TfwReState *st, unsigned int nfa_n)
+{
+	unsigned int s, b;
+	short map[256][2];
+
+	memset(re->cls, 0, sizeof(re->cls));
+	re->cls_n = 1;
+	for (s = 0; s < nfa_n; ++s) {
+		unsigned int n = 0;
+
+		if (st[s].type != TFW_RE_CSET)
+			continue;
+		memset(map, 0xff, sizeof(map));
+		for (b = 0; b < 256; ++b) {
+			short *c = &map[re->cls[b]][!!test_bit(b, st[s].cset)];
+
+			if (*c < 0)
+				*c = n++;
+			re->cls[b] = *c;
+		}
+		re->cls_n = n;
+	}
+}
+
+static int
+__re_dfa_build(TfwReDfa *D, TfwRegex *re, const unsigned int *init,
+	       unsigned int n)
+{
+	int r;
+	unsigned int i, s, k, b, t, rep[256];
+	size_t state_sz;
+
+	for (b = 0, k = 0; b < 256; ++b)
+		if (re->cls[b] == k)
+			rep[k++] = b;
+
+	D->words = BITS_TO_LONGS(D->nfa_n);
+	state_sz = D->words * sizeof(long) + re->cls_n * sizeof(*re->trans)
+		   + 3 * sizeof(unsigned int);
+	D->max = min_t(size_t, TFW_REGEX_DFA_MAX, TFW_REGEX_MEM_MAX / state_sz);
+	D->seen = kvmalloc(D->words * sizeof(long), GFP_KERNEL);
+	D->stack = kvmalloc((D->nfa_n * 2 + 1) * sizeof(unsigned int),
+			    GFP_KERNEL);
+	if (!D->seen || !D->stack)
+		return -ENOMEM;
+	if ((r = __re_dfa_grow(D, re)))
+		return r;
+
+	/* The dead state with the empty set and the initial state. */
+	bitmap_zero(__RE_SET(D, 0), D->nfa_n);
+	__re_dfa_state(D, re, 0);
+	bitmap_zero(__RE_SET(D, 1), D->nfa_n);
+	bitmap_zero(D->seen, D->nfa_n);
+	for (i = 0; i < n; ++i)
+		__re_closure(D, __RE_SET(D, 1), init[i]);
+	if (__re_dfa_state(D, re, 1) != 1)
+		return -EINVAL;
+
+	for (s = 0; s < re->states_n; ++s) {
+		for (k = 0; k < re->cls_n; ++k) {
+			unsigned long *set;
+
+			if (re->states_n == D->cap && D->cap < D->max
+			    && (r = __re_dfa_grow(D, re)))
+				return r;
+			set = __RE_SET(D, re->states_n);
+			bitmap_zero(set, D->nfa_n);
+			bitmap_zero(D->seen, D->nfa_n);
+			for_each_set_bit(i, __RE_SET(D, s), D->nfa_n)
+				if (D->st[i].type == TFW_RE_CSET
+				    && test_bit(rep[k], D->st[i].cset))
+					__re_closure(D, set, D->st[i].out);
+			t = __re_dfa_state(D, re, re->states_n);
+			if (t == TFW_REGEX_NONE)
+				return -E2BIG;
+			re->trans[s * re->cls_n + k] = t;
+		}
+	}
+
+	/* Trim the tables to the actual number of the states. */
+	n = re->states_n;
+	if (__re_realloc(&re->trans, n * re->cls_n * sizeof(*re->trans),
+			 n * re->cls_n * sizeof(*re->trans))
+	    || __re_realloc(&re->match, n * sizeof(unsigned int),
+			    n * sizeof(unsigned int))
+	    || __re_realloc(&re->match_end, n * sizeof(unsigned int),
+			    n * sizeof(unsigned int)))
+		return -ENOMEM;
+
+	return 0;
+}
+
+/**
+ * Compile @n patterns from @pats into @re. The patterns must be plain
+ * strings. Returns -EINVAL for an invalid pattern and -E2BIG for too
+ * complex patterns.
+ */
+int
+tfw_regex_compile(TfwRegex *re, const TfwStr *pats, unsigned int n)
+{
+	int r = 0;
+	long s;
+	unsigned int i, *init;
+	TfwReParser P = {};
+	TfwReDfa D = {};
+
+	memset(re, 0, sizeof(*re));
+	P.st = kvmalloc(TFW_REGEX_NFA_MAX * sizeof(TfwReState), GFP_KERNEL);
+	init = kvmalloc(n * sizeof(unsigned int), GFP_KERNEL);
+	if (!P.st || !init) {
+		r = -ENOMEM;
+		goto out;
+	}
+
+	for (i = 0; i < n; ++i) {
+		if ((s = __re_parse(&P, &pats[i], i)) < 0) {
+			r = s;
+			goto out;
+		}
+		init[i] = s;
+	}
+
+	__re_byte_classes(re, P.st, P.n);
+	D.st = P.st;
+	D.nfa_n = P.n;
+	r = __re_dfa_build(&D, re, init, n);
+out:
+	if (r)
+		tfw_regex_free(re);
+	kvfree(D.sets);
+	kvfree(D.seen);
+	kvfree(D.stack);
+	kvfree(D.buckets);
+	kvfree(D.next);
+	kvfree(init);
+	kvfree(P.st);
+
+	return r;
+}
+
+static unsigned int
+__regex_match(const TfwRegex *re, const TfwStr *str)
+{
+	const TfwStr *c, *end;
+	unsigned int s = 1, best = TFW_REGEX_NOMATCH;
+
+	TFW_STR_FOR_EACH_CHUNK(c, str, end) {
+		const unsigned char *p = c->data, *pend = p + c->len;
+
+		for ( ; p < pend; ++p) {
+			best = min(best, re->match[s]);
+			s = re->trans[s * re->cls_n + re->cls[*p]];
+			if (!s)
+				return best;
+		}
+	}
+	best = min(best, re->match[s]);
+
+	return min(best, re->match_end[s]);
+}
+
+/**
+ * Match @str against the patterns compiled into @re. Return the index of the
+ * first matching pattern or TFW_REGEX_NOMATCH.
+ */
+unsigned int
+tfw_regex_match(const TfwRegex *re, const TfwStr *str)
+{
+	const TfwStr *dup, *end;
+	unsigned int best = TFW_REGEX_NOMATCH;
+
+	TFW_STR_FOR_EACH_DUP(dup, str, end)
+		best = min(best, __regex_match(re, dup));
+
+	return best;
+}
+
+void
+tfw_regex_free(TfwRegex *re)
+{
+	kvfree(re->trans);
+	kvfree(re->match);
+	kvfree(re->match_end);
+	memset(re, 0, sizeof(*re));
+}
@@ -0,0 +1,58 @@
+/**
+ *		Tempesta FW
+ *
+ * Multi-pattern regular expressions matching.
+ *
+ * Copyright (C) 2020 Tempesta Technologies, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#ifndef __TFW_REGEX_H__
+#define __TFW_REGEX_H__
+
+#include "str.h"
+
+/* None of the patterns matches. */
+#define TFW_REGEX_NOMATCH	UINT_MAX
+
+/**
+ * DFA matching a set of patterns in one pass over the input. State 0 is the
+ * dead state, from which no pattern can match, and state 1 is the initial
+ * state.
+ *
+ * @cls		- class of each input byte, the bytes of a class have the
+ *		  same transitions in all the states;
+ * @cls_n	- number of the byte classes;
+ * @states_n	- number of the DFA states;
+ * @trans	- the transitions table, @cls_n entries for each state;
+ * @match	- the first pattern matching a prefix of the input, which
+ *		  ends in the state;
+ * @match_end	- the first pattern matching the whole input, which ends in
+ *		  the state;
+ */
+typedef struct {
+	unsigned char	cls[256];
+	unsigned int	cls_n;
+	unsigned int	states_n;
+	unsigned short	*trans;
+	unsigned int	*match;
+	unsigned int	*match_end;
+} TfwRegex;
+
+int tfw_regex_compile(TfwRegex *re, const TfwStr *pats, unsigned int n);
+unsigned int tfw_regex_match(const TfwRegex *re, const TfwStr *str);
+void tfw_regex_free(TfwRegex *re);
+
+#endif /* __TFW_REGEX_H__ */
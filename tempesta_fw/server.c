@@ -210,10 +210,16 @@ tfw_sg_new(const char *name, unsigned int len, gfp_t flags)
 	sg = kzalloc(sizeof(*sg) + name_size, flags);
 	if (!sg)
 		return NULL;
+	sg->rbudget = alloc_percpu_gfp(TfwSrvRetryBudget, flags);
+	if (!sg->rbudget) {
+		kfree(sg);
+		return NULL;
+	}
 
 	INIT_HLIST_NODE(&sg->list);
 	INIT_HLIST_NODE(&sg->list_reconfig);
 	INIT_LIST_HEAD(&sg->srv_list);
+	spin_lock_init(&sg->conc.lock);
 	atomic64_set(&sg->refcnt, 1);
 	sg->nlen = len;
 	memcpy(sg->name, name, name_size);
@@ -432,6 +438,53 @@ end:
 	return r;
 }
 
+/**
+ * Iterate over all the active server groups and call @cb for each group.
+ * The groups and their servers lists can't change while @cb runs; @cb may
+ * sleep, but must not change the lists.
+ */
+int
+tfw_sg_for_each(int (*cb)(TfwSrvGroup *sg))
+{
+	int i, r = 0;
+	TfwSrvGroup *sg;
+
+	down_read(&sg_sem);
+	hash_for_each(sg_hash, i, sg, list) {
+		if ((r = cb(sg)))
+			break;
+		cond_resched();
+	}
+	up_read(&sg_sem);
+
+	return r;
+}
+
+/**
+ * Iterate over all servers of the active server groups and call @cb for
+ * each server with the @data argument. @cb may sleep, but must not change
+ * the lists.
+ */
+int
+tfw_sg_for_each_srv_data(int (*cb)(TfwServer *srv, void *data), void *data)
+{
+	int i, r = 0;
+	TfwSrvGroup *sg;
+	TfwServer *srv;
+
+	down_read(&sg_sem);
+	hash_for_each(sg_hash, i, sg, list) {
+		list_for_each_entry(srv, &sg->srv_list, list)
+			if ((r = cb(srv, data)))
+				goto end;
+		cond_resched();
+	}
+end:
+	up_read(&sg_sem);
+
+	return r;
+}
+
 /**
  * Same as tfw_sg_for_each_srv() but iterates over reconfig server group lists.
  */
@@ -455,6 +508,176 @@ end:
 	return r;
 }
 
+/**
+ * Check the retry budget of the server group and account the retry if
+ * it's allowed. Retries are allowed while they make less than
+ * @sg->retry_budget percents of successful responses of the group for
+ * the current and the previous time slots, so an outage of a server
+ * doesn't multiply the load on the rest of the group.
+ *
+ * Counters of other CPUs are read without synchronization, the budget
+ * doesn't need to be precise.
+ */
+bool
+tfw_sg_rbudget_retry(TfwSrvGroup *sg)
+{
+	TfwSrvRetryBudget *rb;
+	unsigned long slot = jiffies / TFW_SG_RB_SLOT;
+	unsigned long rb_slot, ok = 0, retries = 0;
+	unsigned int budget = READ_ONCE(sg->retry_budget);
+	int cpu;
+
+	if (!budget)
+		return true;
+
+	for_each_online_cpu(cpu) {
+		rb = per_cpu_ptr(sg->rbudget, cpu);
+		rb_slot = READ_ONCE(rb->slot);
+		if (rb_slot == slot) {
+			ok += READ_ONCE(rb->ok[0]) + READ_ONCE(rb->ok[1]);
+			retries += READ_ONCE(rb->retries[0])
+				   + READ_ONCE(rb->retries[1]);
+		} else if (rb_slot + 1 == slot) {
+			ok += READ_ONCE(rb->ok[0]);
+			retries += READ_ONCE(rb->retries[0]);
+		}
+	}
+	if (retries >= TFW_SG_RB_MIN && retries * 100 >= ok * budget)
+		return false;
+
+	preempt_disable();
+	__tfw_sg_rbudget(sg)->retries[0]++;
+	preempt_enable();
+
+	return true;
+}
+EXPORT_SYMBOL(tfw_sg_rbudget_retry);
+
+/**
+ * Account a request mirrored to the shadow server group @sg if the group
+ * caps allow it: no more than @sg->mirror_conc mirrored requests in flight
+ * and no more than @sg->mirror_rate requests per second. The rate is
+ * enforced by GCRA with the tolerance of a second of requests. The caller
+ * must call tfw_sg_mirror_put() once the accounted request is done.
+ */
+bool
+tfw_sg_mirror_get(TfwSrvGroup *sg)
+{
+	unsigned int rate = READ_ONCE(sg->mirror_rate);
+	unsigned int conc = READ_ONCE(sg->mirror_conc);
+	u64 now, base, t, tau;
+	s64 old, prev;
+
+	if (atomic_inc_return(&sg->mirror_n) > conc && conc)
+		goto err;
+	if (!rate)
+		return true;
+
+	now = ktime_get_mono_fast_ns();
+	t = div_u64(NSEC_PER_SEC, rate);
+	tau = NSEC_PER_SEC - t;
+	for (old = atomic64_read(&sg->mirror_tat); ; old = prev) {
+		base = max_t(u64, old, now);
+		if (base - now > tau)
+			goto err;
+		prev = atomic64_cmpxchg(&sg->mirror_tat, old, base + t);
+		if (likely(prev == old))
+			return true;
+	}
+err:
+	atomic_dec(&sg->mirror_n);
+	return false;
+}
+EXPORT_SYMBOL(tfw_sg_mirror_get);
+
+static inline unsigned int
+__tfw_sg_conc_limit(TfwSrvGroup *sg, unsigned int max)
+{
+	unsigned int limit = READ_ONCE(sg->conc.limit);
+
+	/* The maximum may be decreased on reconfiguration. */
+	return limit ? min(limit, max) : max;
+}
+
+/**
+ * Account a request forwarded to the server group @sg if it fits the
+ * adaptive concurrency limit of the group. The caller must call
+ * tfw_sg_conc_put() once the response is received or the request is
+ * dropped.
+ */
+bool
+tfw_sg_conc_get(TfwSrvGroup *sg)
+{
+	unsigned int max = READ_ONCE(sg->conc_max);
+
+	if (atomic_inc_return(&sg->conc.inflight)
+	    <= __tfw_sg_conc_limit(sg, max))
+		return true;
+	atomic_dec(&sg->conc.inflight);
+
+	return false;
+}
+EXPORT_SYMBOL(tfw_sg_conc_get);
+
+/**
+ * Account the response time @jrtt of the server group @sg and update the
+ * concurrency limit of the group once per TFW_SG_CL_WIN.
+ *
+ * While the servers aren't overloaded, the average response time stays
+ * close to the minimum one and the limit grows by the square root of its
+ * value, so requests queued in the servers don't add much latency. When
+ * the response time grows above 1.5 times the minimum, the limit
+ * decreases by the gradient of the two, but at most by half. Changes are
+ * smoothed to 1/5 for each window. The limit doesn't grow if less than
+ * half of it is used, so an idle group keeps its limit.
+ */
+void
+tfw_sg_conc_update(TfwSrvGroup *sg, unsigned long jrtt)
+{
+	TfwSrvConcLimit *cl = &sg->conc;
+	unsigned int max = READ_ONCE(sg->conc_max), limit, lim_new, n;
+	unsigned long rtt, g;
+
+	if (!max)
+		return;
+
+	atomic64_add(jiffies_to_usecs(max(jrtt, 1UL)), &cl->rtt_sum);
+	n = atomic_inc_return(&cl->rtt_n);
+	if (n < TFW_SG_CL_SAMPLES
+	    || time_before(jiffies, READ_ONCE(cl->win) + TFW_SG_CL_WIN)
+	    || !spin_trylock(&cl->lock))
+		return;
+	if (time_before(jiffies, cl->win + TFW_SG_CL_WIN))
+		goto out;
+
+	/* Concurrently added samples go to either of the windows. */
+	n = atomic_xchg(&cl->rtt_n, 0);
+	rtt = atomic64_xchg(&cl->rtt_sum, 0) / max(n, 1U);
+	WRITE_ONCE(cl->win, jiffies);
+
+	if (!cl->probe-- || !cl->min_rtt || rtt < cl->min_rtt) {
+		cl->min_rtt = rtt;
+		cl->probe = TFW_SG_CL_PROBE;
+	}
+
+	limit = __tfw_sg_conc_limit(sg, max);
+	g = min(1024UL, ((cl->min_rtt * 3 / 2) << 10) / rtt);
+	lim_new = ((limit * max(g, 512UL)) >> 10) + int_sqrt(limit);
+	if (lim_new > limit) {
+		if (atomic_read(&cl->inflight) >= limit / 2)
+			limit = DIV_ROUND_UP(limit * 4 + lim_new, 5);
+	} else {
+		limit = (limit * 4 + lim_new) / 5;
+	}
+	WRITE_ONCE(cl->limit, clamp(limit, min(max, TFW_SG_CL_MIN), max));
+
+	T_DBG3("%s: sg=%s rtt=%lu min_rtt=%lu limit=%u\n", __func__, sg->name,
+	       rtt, cl->min_rtt, cl->limit);
+out:
+	spin_unlock(&cl->lock);
+}
+EXPORT_SYMBOL(tfw_sg_conc_update);
+
 /**
  * Release a single server group with servers.
  */
@@ -464,6 +687,7 @@ tfw_sg_destroy(TfwSrvGroup *sg)
 	T_DBG2("release group: '%s'\n", sg->name);
 	WARN_ON(!list_empty(&sg->srv_list));
 
+	free_percpu(sg->rbudget);
 	kfree(sg);
 	atomic64_dec(&act_sg_n);
 }
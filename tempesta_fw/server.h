@@ -21,6 +21,8 @@
 #ifndef __SERVER_H__
 #define __SERVER_H__
 
+#include <linux/percpu.h>
+
 #include "addr.h"
 #include "connection.h"
 #include "peer.h"
@@ -43,13 +45,19 @@ typedef struct tfw_scheduler_t TfwScheduler;
  *
  * @list	- member pointer in the list of servers of a server group;
  * @gs_timer	- grace shutdown timer;
+ * @pool_timer	- timer to grow and shrink the connections pool;
  * @sg		- back-reference to the server group;
  * @sched_data	- private scheduler data for the server;
  * @apmref	- opaque handle for APM stats;
  * @conn_n	- configured number of connections to the server;
+ * @conn_min	- minimum number of connections to keep in the pool;
+ * @conn_spare	- number of established connections to keep unscheduled;
+ * @spare_n	- current number of spare connections;
  * @sess_n	- number of pinned sticky sessions;
  * @refcnt	- number of users of the server structure instance;
  * @weight	- static server weight for load balancers;
+ * @ss_stamp	- time (in jiffies) when the server slow start began;
+ * @drain_end	- time (in jiffies) when the server drain is finished anyway;
  * @flags	- server related flags: TFW_CFG_M_ACTION and HM atomic flags;
  * @cleanup	- called right before server is destroyed;
  */
@@ -57,13 +65,19 @@ typedef struct {
 	TFW_PEER_COMMON;
 	struct list_head	list;
 	struct timer_list	gs_timer;
+	struct timer_list	pool_timer;
 	TfwSrvGroup		*sg;
 	void __rcu		*sched_data;
 	void			*apmref;
 	size_t			conn_n;
+	size_t			conn_min;
+	size_t			conn_spare;
+	atomic_t		spare_n;
 	atomic64_t		sess_n;
 	atomic64_t		refcnt;
 	unsigned int		weight;
+	unsigned long		ss_stamp;
+	unsigned long		drain_end;
 	unsigned long		flags;
 	void			(*cleanup)(void *);
 } TfwServer;
@@ -79,11 +93,93 @@ enum {
 	TFW_SRV_B_HMONITOR = 0x8,
 
 	/* Server is excluded from processing. */
-	TFW_SRV_B_SUSPEND
+	TFW_SRV_B_SUSPEND,
+
+	/* Server gets only a part of its load during slow start. */
+	TFW_SRV_B_SLOW_START,
+
+	/* Connections pool of the server is resized on the fly. */
+	TFW_SRV_B_POOL,
+
+	/* Server is temporarily ejected by APM as an outlier. */
+	TFW_SRV_B_EJECT,
+
+	/* Removed server finishes its requests before the disconnect. */
+	TFW_SRV_B_DRAIN
 };
 
 #define	TFW_SRV_F_HMONITOR	(1 << TFW_SRV_B_HMONITOR)
 #define	TFW_SRV_F_SUSPEND	(1 << TFW_SRV_B_SUSPEND)
+#define	TFW_SRV_F_SLOW_START	(1 << TFW_SRV_B_SLOW_START)
+#define	TFW_SRV_F_POOL		(1 << TFW_SRV_B_POOL)
+#define	TFW_SRV_F_EJECT		(1 << TFW_SRV_B_EJECT)
+#define	TFW_SRV_F_DRAIN		(1 << TFW_SRV_B_DRAIN)
+
+/*
+ * Maximum number of unsent requests moved from a connection of a draining
+ * server to other servers at once.
+ */
+#define TFW_SRV_DRAIN_BATCH	4
+
+/*
+ * Share of the load a server gets during slow start is measured in
+ * 1/TFW_SRV_SS_SCALE units.
+ */
+#define TFW_SRV_SS_SHIFT	10
+#define TFW_SRV_SS_SCALE	(1U << TFW_SRV_SS_SHIFT)
+
+/**
+ * Per-CPU retry budget counters of a server group. The counters are kept
+ * for the current (index 0) and the previous (index 1) time slots of
+ * TFW_SG_RB_SLOT jiffies, so the budget follows the recent load only.
+ *
+ * @slot	- the time slot number the counters at index 0 belong to;
+ * @ok		- number of successful responses;
+ * @retries	- number of re-forwarded requests;
+ */
+typedef struct {
+	unsigned long		slot;
+	unsigned int		ok[2];
+	unsigned int		retries[2];
+} TfwSrvRetryBudget;
+
+#define TFW_SG_RB_SLOT		(10 * HZ)
+/* Retries always allowed within the budget window, e.g. on low load. */
+#define TFW_SG_RB_MIN		10
+
+/**
+ * Adaptive concurrency limit of a server group. The limit of requests in
+ * flight follows the gradient of the minimum response time of the group
+ * to the average response time of the last window, see
+ * tfw_sg_conc_update().
+ *
+ * @lock	- serializes the limit updates;
+ * @limit	- current limit of requests in flight, 0 before the first
+ *		  update;
+ * @inflight	- number of requests in flight;
+ * @rtt_n	- number of the response times in @rtt_sum;
+ * @rtt_sum	- sum of the response times of the current window, usecs;
+ * @min_rtt	- minimum average response time of the windows, usecs;
+ * @win		- time the current window began at, in jiffies;
+ * @probe	- number of windows left until @min_rtt is measured anew;
+ */
+typedef struct {
+	spinlock_t		lock;
+	unsigned int		limit;
+	atomic_t		inflight;
+	atomic_t		rtt_n;
+	atomic64_t		rtt_sum;
+	unsigned long		min_rtt;
+	unsigned long		win;
+	unsigned int		probe;
+} TfwSrvConcLimit;
+
+#define TFW_SG_CL_WIN		(HZ / 10)
+/* Minimum number of responses in a window to update the limit. */
+#define TFW_SG_CL_SAMPLES	16
+/* Windows between @min_rtt resets, so it follows changes of the servers. */
+#define TFW_SG_CL_PROBE		600
+#define TFW_SG_CL_MIN		4
 
 /**
  * The servers group with the same load balancing, failovering and eviction
@@ -103,7 +199,20 @@ enum {
  * @max_qsize	- maximum queue size of a server connection;
  * @max_refwd	- maximum number of tries for forwarding a request;
  * @max_jqage	- maximum age of a request in a server connection, in jiffies;
+ * @slow_start	- slow start window of recovered and added servers, in jiffies;
  * @max_recns	- maximum number of reconnect attempts;
+ * @retry_budget - retries share (percents) of the recent successful
+ *		  requests allowed to the group, 0 for no limit;
+ * @rbudget	- per-CPU counters of the retry budget;
+ * @mirror_rate	- maximum rate (requests per second) of the requests
+ *		  mirrored to the group, 0 for no limit;
+ * @mirror_conc	- maximum number of the mirrored requests in flight,
+ *		  0 for no limit;
+ * @mirror_n	- number of the mirrored requests in flight;
+ * @mirror_tat	- theoretical arrival time of the next mirrored request, ns;
+ * @conc_max	- maximum of the adaptive concurrency limit, 0 to disable
+ *		  the limit;
+ * @conc	- the adaptive concurrency limit;
  * @flags	- server group related flags;
  * @nlen	- name length;
  * @name	- name of the group specified in the configuration;
@@ -119,7 +228,16 @@ struct tfw_srv_group_t {
 	unsigned int		max_qsize;
 	unsigned int		max_refwd;
 	unsigned long		max_jqage;
+	unsigned long		slow_start;
 	unsigned int		max_recns;
+	unsigned int		retry_budget;
+	TfwSrvRetryBudget __percpu *rbudget;
+	unsigned int		mirror_rate;
+	unsigned int		mirror_conc;
+	atomic_t		mirror_n;
+	atomic64_t		mirror_tat;
+	unsigned int		conc_max;
+	TfwSrvConcLimit		conc;
 	unsigned int		flags;
 	unsigned int		nlen;
 	char			name[0];
@@ -146,8 +264,11 @@ typedef struct {
 #define TFW_SG_M_SCHED_RATIO_TYPE	(TFW_SG_F_SCHED_RATIO_STATIC	\
 					 | TFW_SG_F_SCHED_RATIO_DYNAMIC	\
 					 | TFW_SG_F_SCHED_RATIO_PREDICT)
+#define TFW_SG_F_SCHED_HASH_BOUNDED	0x0080
 
 #define TFW_SRV_RETRY_NIP		0x0100	/* Retry non-idempotent req. */
+#define TFW_SG_F_SLOW_START_EXP		0x0200	/* Exponential slow start. */
+#define TFW_SG_F_CPU_AFFINITY		0x0400	/* Prefer local connections. */
 
 /**
  * Requests scheduling algorithm handler.
@@ -266,21 +387,133 @@ tfw_srv_conn_need_resched(TfwSrvConn *srv_conn)
 }
 
 /*
- * Put server into alive state (in sense of HTTP availability).
+ * Start slow start of the server if it's configured for the group.
+ */
+static inline void
+tfw_srv_slow_start(TfwServer *srv)
+{
+	if (!srv->sg || !READ_ONCE(srv->sg->slow_start))
+		return;
+	WRITE_ONCE(srv->ss_stamp, jiffies);
+	smp_mb__before_atomic();
+	set_bit(TFW_SRV_B_SLOW_START, &srv->flags);
+}
+
+/*
+ * Get the share of the load (in 1/TFW_SRV_SS_SCALE units) the server can
+ * take now. The share ramps up from the minimum to the full load during
+ * the slow start window linearly, or doubles TFW_SRV_SS_SHIFT times if
+ * the slow start is exponential.
+ */
+static inline unsigned int
+tfw_srv_slow_start_share(TfwServer *srv)
+{
+	TfwSrvGroup *sg = srv->sg;
+	unsigned long left, elapsed, window = READ_ONCE(sg->slow_start);
+
+	elapsed = jiffies - READ_ONCE(srv->ss_stamp);
+	if (elapsed >= window) {
+		clear_bit(TFW_SRV_B_SLOW_START, &srv->flags);
+		return TFW_SRV_SS_SCALE;
+	}
+	if (READ_ONCE(sg->flags) & TFW_SG_F_SLOW_START_EXP) {
+		left = (window - elapsed) * TFW_SRV_SS_SHIFT / window;
+		return TFW_SRV_SS_SCALE >> left;
+	}
+
+	return 1 + elapsed * (TFW_SRV_SS_SCALE - 1) / window;
+}
+
+/*
+ * Tell if a request with the @key in [0, TFW_SRV_SS_SCALE) range can be
+ * scheduled to the server. Schedulers pass a random key to get the
+ * requests distributed proportionally to the server share, or a key
+ * derived from the request hash to keep the same requests at the server.
+ */
+static inline bool
+tfw_srv_slow_start_admit(TfwServer *srv, unsigned int key)
+{
+	if (likely(!test_bit(TFW_SRV_B_SLOW_START, &srv->flags)))
+		return true;
+
+	return key < tfw_srv_slow_start_share(srv);
+}
+
+/*
+ * Put server into alive state (in sense of HTTP availability). The server
+ * has just recovered, so it starts with a part of the load.
  */
 static inline void
 tfw_srv_mark_alive(TfwServer *srv)
 {
-	clear_bit(TFW_SRV_B_SUSPEND, &srv->flags);
+	if (test_and_clear_bit(TFW_SRV_B_SUSPEND, &srv->flags))
+		tfw_srv_slow_start(srv);
 }
 
 /*
- * Tell if server is suspended.
+ * Tell if server is suspended by the health monitor, ejected by APM or
+ * drained.
  */
 static inline bool
 tfw_srv_suspended(TfwServer *srv)
 {
-	return test_bit(TFW_SRV_B_SUSPEND, &srv->flags);
+	return READ_ONCE(srv->flags)
+	       & (TFW_SRV_F_SUSPEND | TFW_SRV_F_EJECT | TFW_SRV_F_DRAIN);
+}
+
+/*
+ * Get the retry budget counters of the current CPU, rotate them if the
+ * time slot is over. Must be called with preemption disabled.
+ */
+static inline TfwSrvRetryBudget *
+__tfw_sg_rbudget(TfwSrvGroup *sg)
+{
+	TfwSrvRetryBudget *rb = this_cpu_ptr(sg->rbudget);
+	unsigned long slot = jiffies / TFW_SG_RB_SLOT;
+
+	if (likely(rb->slot == slot))
+		return rb;
+	if (rb->slot + 1 == slot) {
+		rb->ok[1] = rb->ok[0];
+		rb->retries[1] = rb->retries[0];
+	} else {
+		rb->ok[1] = rb->retries[1] = 0;
+	}
+	rb->ok[0] = rb->retries[0] = 0;
+	rb->slot = slot;
+
+	return rb;
+}
+
+/*
+ * Account a successful response from the group for the retry budget.
+ */
+static inline void
+tfw_sg_rbudget_ok(TfwSrvGroup *sg)
+{
+	if (!READ_ONCE(sg->retry_budget))
+		return;
+	preempt_disable();
+	__tfw_sg_rbudget(sg)->ok[0]++;
+	preempt_enable();
+}
+
+/*
+ * A request mirrored to the group is done, see tfw_sg_mirror_get().
+ */
+static inline void
+tfw_sg_mirror_put(TfwSrvGroup *sg)
+{
+	atomic_dec(&sg->mirror_n);
+}
+
+/*
+ * A request accounted by tfw_sg_conc_get() is done.
+ */
+static inline void
+tfw_sg_conc_put(TfwSrvGroup *sg)
+{
+	atomic_dec(&sg->conc.inflight);
 }
 
 /* Server group routines. */
@@ -302,6 +535,13 @@ int __tfw_sg_for_each_srv(TfwSrvGroup *sg,
 int tfw_sg_for_each_srv(int (*sg_cb)(TfwSrvGroup *sg),
 			int (*srv_cb)(TfwServer *srv));
 int tfw_sg_for_each_srv_reconfig(int (*cb)(TfwServer *srv));
+int tfw_sg_for_each(int (*cb)(TfwSrvGroup *sg));
+int tfw_sg_for_each_srv_data(int (*cb)(TfwServer *srv, void *data),
+			     void *data);
+bool tfw_sg_rbudget_retry(TfwSrvGroup *sg);
+bool tfw_sg_mirror_get(TfwSrvGroup *sg);
+bool tfw_sg_conc_get(TfwSrvGroup *sg);
+void tfw_sg_conc_update(TfwSrvGroup *sg, unsigned long jrtt);
 void tfw_sg_destroy(TfwSrvGroup *sg);
 void tfw_sg_release(TfwSrvGroup *sg);
 void tfw_sg_release_all(void);
@@ -19,8 +19,10 @@
  * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
  */
 #include <linux/irq_work.h>
+#include <linux/kthread.h>
 #include <linux/module.h>
 #include <linux/tempesta.h>
+#include <net/busy_poll.h>
 #include <net/protocol.h>
 #include <net/inet_common.h>
 #include <net/ip6_route.h>
@@ -39,6 +41,7 @@
 typedef enum {
 	SS_SEND,
 	SS_CLOSE,
+	SS_RX_RESUME,
 } SsAction;
 
 typedef struct {
@@ -124,6 +127,8 @@ static bool __ss_active = false;
 static DEFINE_PER_CPU(atomic64_t, __ss_act_cnt) ____cacheline_aligned
 	= ATOMIC_INIT(0);
 static DEFINE_PER_CPU(TfwRBQueue, si_wq);
+static DEFINE_PER_CPU(struct task_struct *, ss_bp_task);
+static DEFINE_PER_CPU(unsigned int, ss_napi_id);
 static DEFINE_PER_CPU(struct irq_work, ipi_work);
 /*
  * llist can not be used since llist_del_first() returns the newest added
@@ -340,6 +345,25 @@ ss_sock_active(struct sock *sk)
  * ------------------------------------------------------------------------
  */
 /**
+ * Push the frames entailed by ss_do_send() to the stack.
+ */
+static void
+ss_do_push(struct sock *sk)
+{
+	int size, mss = tcp_send_mss(sk, &size, MSG_DONTWAIT);
+
+	T_DBG3("[%d]: %s: sk=%pK send_head=%pK sk_state=%d mss=%d size=%d\n",
+	       smp_processor_id(), __func__, sk, tcp_send_head(sk),
+	       sk->sk_state, mss, size);
+
+	tcp_push(sk, MSG_DONTWAIT, mss, TCP_NAGLE_OFF|TCP_NAGLE_PUSH, size);
+}
+
+/**
+ * Entail the skbs to the socket write queue. The caller pushes the frames by
+ * ss_do_push(), so the skbs of many work items for the same socket are pushed
+ * at once and TSO gets larger segments.
+ *
  * @skb_head can be invalid after the function call, don't try to use it.
  */
 static void
@@ -347,14 +371,13 @@ ss_do_send(struct sock *sk, struct sk_buff **skb_head, int flags)
 {
 	struct tcp_sock *tp = tcp_sk(sk);
 	struct sk_buff *skb;
-	int size, mss = tcp_send_mss(sk, &size, MSG_DONTWAIT);
 	unsigned int mark = (*skb_head)->mark;
 
 	T_DBG3("[%d]: %s: sk=%pK queue_empty=%d send_head=%pK"
-	       " sk_state=%d mss=%d size=%d\n",
+	       " sk_state=%d\n",
 	       smp_processor_id(), __func__,
 	       sk, tcp_write_queue_empty(sk), tcp_send_head(sk),
-	       sk->sk_state, mss, size);
+	       sk->sk_state);
 
 	/* If the socket is inactive, there's no recourse. Drop the data. */
 	if (unlikely(!ss_sock_active(sk))) {
@@ -397,15 +420,6 @@ ss_do_send(struct sock *sk, struct sk_buff **skb_head, int flags)
 	T_DBG3("[%d]: %s: sk=%p send_head=%p sk_state=%d flags=%x\n",
 	       smp_processor_id(), __func__,
 	       sk, tcp_send_head(sk), sk->sk_state, flags);
-
-	/*
-	 * If connection close flag is specified, then @ss_do_close is used to
-	 * set FIN on final SKB and push all pending frames to the stack.
-	 */
-	if (flags & SS_F_CONN_CLOSE)
-		return;
-
-	tcp_push(sk, MSG_DONTWAIT, mss, TCP_NAGLE_OFF|TCP_NAGLE_PUSH, size);
 }
 
 /**
@@ -694,15 +708,55 @@ err:
 }
 EXPORT_SYMBOL(ss_close);
 
+/**
+ * Stop reading ingress data from the socket @sk. The data is left in the
+ * socket receive queue, so TCP shrinks the receive window advertised to the
+ * peer and the peer stops sending when the queue is full. The data which is
+ * already taken from the receive queue is processed in full.
+ *
+ * Must be called under the socket lock, e.g. from connection_recv() hook.
+ */
+void
+ss_rx_pause(struct sock *sk)
+{
+	SS_CONN_TYPE(sk) |= Conn_RxPause;
+}
+EXPORT_SYMBOL(ss_rx_pause);
+
+/**
+ * Resume reading ingress data from the socket @sk paused by ss_rx_pause().
+ * The data queued in the socket while it was paused is processed on the
+ * socket's CPU in the same way as for ss_send().
+ */
+int
+ss_rx_resume(struct sock *sk)
+{
+	int cpu = sk->sk_incoming_cpu;
+	SsWork sw = {
+		.sk	= sk,
+		.action	= SS_RX_RESUME,
+	};
+
+	sock_hold(sk);
+	if (ss_wq_push(&sw, cpu)) {
+		sock_put(sk);
+		return -EBUSY;
+	}
+
+	return 0;
+}
+EXPORT_SYMBOL(ss_rx_resume);
+
 /*
- * Process a single SKB.
+ * Unroll a single SKB and add its data to the @batch of the receive queue
+ * SKBs for the connection.
  */
 static int
-ss_tcp_process_skb(struct sock *sk, struct sk_buff *skb, int *processed)
+ss_tcp_collect_skb(struct sock *sk, struct sk_buff *skb, int *processed,
+		   struct sk_buff **batch)
 {
 	bool tcp_fin;
 	int r = 0, offset, count;
-	void *conn;
 	struct sk_buff *skb_head = NULL;
 	struct tcp_sock *tp = tcp_sk(sk);
 
@@ -740,33 +794,18 @@ ss_tcp_process_skb(struct sock *sk, struct sk_buff *skb, int *processed)
 		if (unlikely(offset > 0 &&
 			     ss_skb_chop_head_tail(NULL, skb, offset, 0) != 0))
 		{
+			__kfree_skb(skb);
 			r = SS_DROP;
 			goto out;
 		}
 		offset = 0;
 
-		conn = sk->sk_user_data;
-		/*
-		 * If @sk_user_data is unset, then this connection
-		 * had been dropped in a parallel thread. Dropping
-		 * a connection is serialized with the socket lock.
-		 * The receive queue must be empty in that case,
-		 * and the execution path should never reach here.
-		 */
-		BUG_ON(conn == NULL);
-
 		if (SS_CONN_TYPE(sk) & Conn_Stop) {
 			__kfree_skb(skb);
 			continue;
 		}
 
-		r = SS_CALL(connection_recv, conn, skb);
-
-		if (r < 0) {
-			T_DBG2("[%d]: Processing error: sk=%pK r=%d\n",
-			       smp_processor_id(), sk, r);
-			goto out; /* connection must be dropped */
-		}
+		ss_skb_queue_tail(batch, skb);
 	}
 	if (tcp_fin) {
 		T_DBG2("Received data FIN on sk=%p, cpu=%d\n",
@@ -788,23 +827,33 @@ out:
  * tcp_read_sock() calls __kfree_skb() through sk_eat_skb() which is good
  * for copying data from skb, but we need to manage skb's ourselves.
  *
+ * All the SKBs available in the receive queue are taken at once and passed
+ * to the connection as one list, so the upper layer FSM is entered once per
+ * batch and ACK with the window update is sent once after the batch. TCP
+ * already coalesces adjacent in-order segments in the receive queue, see
+ * tcp_try_coalesce(), so the SKBs aren't coalesced once more here.
+ *
  * TODO #873 process URG.
  */
 static bool
 ss_tcp_process_data(struct sock *sk)
 {
-	bool droplink = true;
-	int r, count, processed = 0;
+	int r = 0, count, processed = 0;
 	unsigned int skb_len, skb_seq;
-	struct sk_buff *skb, *tmp;
+	struct sk_buff *skb, *tmp, *batch = NULL;
 	struct tcp_sock *tp = tcp_sk(sk);
+	void *conn;
 
 	skb_queue_walk_safe(&sk->sk_receive_queue, skb, tmp) {
+		/* Keep the rest of the data in the socket, see ss_rx_pause(). */
+		if (unlikely(SS_CONN_TYPE(sk) & Conn_RxPause))
+			break;
 		if (unlikely(before(tp->copied_seq, TCP_SKB_CB(skb)->seq))) {
 			T_WARN("recvmsg bug: TCP sequence gap at seq %X"
 			       " recvnxt %X\n",
 			       tp->copied_seq, TCP_SKB_CB(skb)->seq);
-			goto out;
+			r = SS_DROP;
+			break;
 		}
 
 		__skb_unlink(skb, &sk->sk_receive_queue);
@@ -817,19 +866,40 @@ ss_tcp_process_data(struct sock *sk)
 		skb_seq = TCP_SKB_CB(skb)->seq;
 
 		count = 0;
-		r = ss_tcp_process_skb(sk, skb, &count);
+		r = ss_tcp_collect_skb(sk, skb, &count, &batch);
 		processed += count;
 
 		if (r < 0)
-			goto out;
+			break;
 		else if (!count)
 			T_WARN("recvmsg bug: overlapping TCP segment at %X"
 			       " seq %X rcvnxt %X len %x\n",
 			       tp->copied_seq, skb_seq, tp->rcv_nxt,
 				 skb_len);
 	}
-	droplink = false;
-out:
+
+	/*
+	 * Pass the batch to the connection even if the connection must be
+	 * dropped due to FIN or an error on the rest of the data.
+	 */
+	if (batch) {
+		conn = sk->sk_user_data;
+		/*
+		 * If @sk_user_data is unset, then this connection
+		 * had been dropped in a parallel thread. Dropping
+		 * a connection is serialized with the socket lock.
+		 * The receive queue must be empty in that case,
+		 * and the execution path should never reach here.
+		 */
+		BUG_ON(conn == NULL);
+
+		if (SS_CALL(connection_recv, conn, batch) < 0) {
+			T_DBG2("[%d]: Processing error: sk=%pK\n",
+			       smp_processor_id(), sk);
+			r = SS_DROP; /* connection must be dropped */
+		}
+	}
+
 	/*
 	 * Recalculate an appropriate TCP receive buffer space
 	 * and send ACK to a client with the new window.
@@ -838,7 +908,7 @@ out:
 	if (processed)
 		tcp_cleanup_rbuf(sk, processed);
 
-	return droplink;
+	return r < 0;
 }
 
 /*
@@ -866,6 +936,10 @@ ss_tcp_data_ready(struct sock *sk)
 		T_ERR("error data in socket %p\n", sk);
 	}
 	else if (!skb_queue_empty(&sk->sk_receive_queue)) {
+#ifdef CONFIG_NET_RX_BUSY_POLL
+		/* Let the busy polling thread on the CPU know the RX queue. */
+		__this_cpu_write(ss_napi_id, READ_ONCE(sk->sk_napi_id));
+#endif
 		if (ss_tcp_process_data(sk) &&
 		    !(SS_CONN_TYPE(sk) & Conn_Stop)) {
 			/*
@@ -1347,12 +1421,64 @@ do {								\
 	sock_put(sk); /* paired with ss_do_close() */		\
 } while (0)
 
+/* Maximum number of sockets with deferred pushes in ss_tx_action(). */
+#define SS_TX_PUSH_MAX		32
+
+/**
+ * Push the frames of all the sockets sent to in the current ss_tx_action()
+ * run and release the work items references to the sockets.
+ */
+static void
+ss_tx_push_all(struct sock **push, int *push_n)
+{
+	int i;
+	struct sock *sk;
+
+	for (i = 0; i < *push_n; ++i) {
+		sk = push[i];
+		bh_lock_sock(sk);
+		/*
+		 * The socket could be closed by a later work item, in which
+		 * case ss_do_close() pushed the frames.
+		 */
+		if (!sock_flag(sk, SOCK_DEAD) && ss_sock_active(sk))
+			ss_do_push(sk);
+		bh_unlock_sock(sk);
+		sock_put(sk); /* paired with push() calls */
+	}
+	*push_n = 0;
+}
+
+/**
+ * Defer the push for @sk until the end of the work queue drain, so all the
+ * skbs sent to the socket by the drained work items are pushed at once.
+ * @return true if @sk is added to @push and it keeps the work item reference
+ * to the socket, or false if the socket is already there.
+ */
+static bool
+ss_tx_push_defer(struct sock **push, int *push_n, struct sock *sk)
+{
+	int i;
+
+	/* Typically the same socket is sent to by consecutive work items. */
+	for (i = *push_n - 1; i >= 0; --i)
+		if (push[i] == sk)
+			return false;
+
+	if (unlikely(*push_n == SS_TX_PUSH_MAX))
+		ss_tx_push_all(push, push_n);
+	push[(*push_n)++] = sk;
+
+	return true;
+}
+
 static void
 ss_tx_action(void)
 {
 	SsWork sw;
-	int budget;
+	int budget, push_n = 0;
 	struct sk_buff *skb;
+	struct sock *push[SS_TX_PUSH_MAX];
 	TfwRBQueue *wq = this_cpu_ptr(&si_wq);
 	long ticket = 0;
 
@@ -1376,8 +1502,14 @@ ss_tx_action(void)
 			ss_do_send(sk, &sw.skb_head, sw.flags);
 			if (!(sw.flags & SS_F_CONN_CLOSE)) {
 				bh_unlock_sock(sk);
+				if (ss_tx_push_defer(push, &push_n, sk))
+					continue;
 				break;
 			}
+			/*
+			 * ss_do_close() sets FIN on the final skb and pushes
+			 * all the pending frames to the stack.
+			 */
 			/* paired with bh_lock_sock() */
 			__sk_close_locked(sk);
 			break;
@@ -1403,6 +1535,14 @@ ss_tx_action(void)
 			/* paired with bh_lock_sock() */
 			__sk_close_locked(sk);
 			break;
+		case SS_RX_RESUME:
+			/* The connection may be dropped while it was paused. */
+			if (sk->sk_user_data) {
+				SS_CONN_TYPE(sk) &= ~Conn_RxPause;
+				ss_tcp_data_ready(sk);
+			}
+			bh_unlock_sock(sk);
+			break;
 		default:
 			BUG();
 		}
@@ -1411,6 +1551,7 @@ dead_sock:
 		while ((skb = ss_skb_dequeue(&sw.skb_head)))
 			kfree_skb(skb);
 	}
+	ss_tx_push_all(push, &push_n);
 
 	/*
 	 * Rearm softirq for local CPU if there are more jobs to do.
@@ -1426,6 +1567,104 @@ dead_sock:
 	raise_softirq(NET_TX_SOFTIRQ);
 }
 
+/*
+ * ------------------------------------------------------------------------
+ *	Busy polling
+ * ------------------------------------------------------------------------
+ *
+ * A kernel thread bound to each dedicated CPU polls the NAPI context of the
+ * RX queue, which delivered the last packets to Tempesta sockets on the CPU,
+ * and drains the socket work queue, so producers don't send IPIs to the CPU.
+ * Other pending softirqs, e.g. the cache tasklets and timers, run on each
+ * local_bh_enable() of the thread. The RX queue interrupts are managed by
+ * the NIC driver, so packets still may be processed by softirqs, e.g. until
+ * a NAPI context is known for the CPU.
+ */
+#define SS_BUSY_POLL_USEC	50
+
+#ifdef CONFIG_NET_RX_BUSY_POLL
+static bool
+ss_busy_poll_end(void *arg, unsigned long start)
+{
+	return ss_wq_local_size(this_cpu_ptr(&si_wq))
+	       || busy_loop_current_time() - start > SS_BUSY_POLL_USEC;
+}
+#endif
+
+static int
+ss_busy_poll_fn(void *data)
+{
+	int cpu = (long)data;
+	TfwRBQueue *wq = &per_cpu(si_wq, cpu);
+
+	while (!kthread_should_stop()) {
+#ifdef CONFIG_NET_RX_BUSY_POLL
+		unsigned int napi_id = READ_ONCE(per_cpu(ss_napi_id, cpu));
+
+		if (napi_id >= MIN_NAPI_ID)
+			napi_busy_loop(napi_id, ss_busy_poll_end, NULL);
+#endif
+		if (ss_wq_size(cpu)) {
+			local_bh_disable();
+			ss_tx_action();
+			local_bh_enable();
+		}
+		/* The queue is polled, no need for IPIs. */
+		clear_bit(TFW_QUEUE_IPI, &wq->flags);
+		cond_resched();
+	}
+	/* Reenable IPIs or reraise the softirq for the rest of the works. */
+	local_bh_disable();
+	ss_tx_action();
+	local_bh_enable();
+
+	return 0;
+}
+
+/**
+ * Start the busy polling threads on @cpus. Must be called in process context.
+ */
+int
+ss_busy_poll_start(const struct cpumask *cpus)
+{
+	int cpu;
+	struct task_struct *t;
+
+	for_each_cpu(cpu, cpus) {
+		t = kthread_create_on_node(ss_busy_poll_fn, (void *)(long)cpu,
+					   cpu_to_node(cpu), "tfw_bpoll/%d",
+					   cpu);
+		if (IS_ERR(t)) {
+			T_ERR_NL("Cannot start busy polling on CPU %d\n", cpu);
+			ss_busy_poll_stop();
+			return PTR_ERR(t);
+		}
+		kthread_bind(t, cpu);
+		per_cpu(ss_bp_task, cpu) = t;
+		wake_up_process(t);
+	}
+
+	return 0;
+}
+EXPORT_SYMBOL(ss_busy_poll_start);
+
+void
+ss_busy_poll_stop(void)
+{
+	int cpu;
+
+	might_sleep();
+	for_each_possible_cpu(cpu) {
+		struct task_struct *t = per_cpu(ss_bp_task, cpu);
+
+		if (!t)
+			continue;
+		kthread_stop(t);
+		per_cpu(ss_bp_task, cpu) = NULL;
+	}
+}
+EXPORT_SYMBOL(ss_busy_poll_stop);
+
 /*
  * ------------------------------------------------------------------------
  *  	Management stuff
@@ -1443,12 +1682,25 @@ ss_get_stat(SsStat *stat)
 	for_each_online_cpu(cpu) {
 		SsCloseBacklog *cb = &per_cpu(close_backlog, cpu);
 		TfwRBQueue *wq = &per_cpu(si_wq, cpu);
+		TfwWqStat wq_stat = { 0 };
 
+		tfw_wq_stat(wq, &wq_stat);
 		stat[cpu].rb_wq_sz = tfw_wq_size(wq);
 		stat[cpu].backlog_sz = cb->size;
+		stat[cpu].rb_wq_contended = wq_stat.contended;
 	}
 }
 
+/**
+ * Number of the socket works and closings queued to the current CPU, which
+ * grows when softirq of the CPU doesn't keep up with the load.
+ */
+unsigned int
+ss_wq_backlog(void)
+{
+	return ss_wq_local_size(this_cpu_ptr(&si_wq));
+}
+
 /**
  * Synchronize with establishing new connections. It is guaranteed that there
  * will be no more new client connections and re-established connections to
@@ -1622,4 +1874,5 @@ tfw_sync_socket_exit(void)
 		ss_backlog_validate_cleanup(cpu);
 	}
 	kmem_cache_destroy(ss_cbacklog_cache);
+	ss_skb_pgpool_release();
 }
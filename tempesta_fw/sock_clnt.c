@@ -40,6 +40,8 @@
 static struct kmem_cache *tfw_cli_conn_cache;
 static struct kmem_cache *tfw_h2_conn_cache;
 static int tfw_cli_cfg_ka_timeout = -1;
+/* CPUs dedicated to busy polling of sockets. */
+static cpumask_t tfw_cli_cfg_bp_cpus;
 
 static inline struct kmem_cache *
 tfw_cli_cache(int type)
@@ -52,20 +54,38 @@ tfw_cli_cache(int type)
 		tfw_h2_conn_cache : tfw_cli_conn_cache;
 }
 
+/*
+ * Account the memory footprint of a client connection of @type allocated,
+ * or freed if @n is negative. HTTPS connections also carry the TLS and
+ * the HTTP/2 contexts.
+ */
+static void
+tfw_cli_conn_mem_acct(int type, long n)
+{
+	long conn = kmem_cache_size(tfw_cli_cache(type));
+
+	if (type & TFW_FSM_HTTPS) {
+		tfw_mem_acct(TFW_MEM_TLS, n * (long)sizeof(TlsCtx));
+		tfw_mem_acct(TFW_MEM_H2, n * (long)sizeof(TfwH2Ctx));
+		conn -= sizeof(TlsCtx) + sizeof(TfwH2Ctx);
+	}
+	tfw_mem_acct(TFW_MEM_CONN, n * conn);
+}
+
 static void
-tfw_sock_cli_keepalive_timer_cb(unsigned long data)
+tfw_sock_cli_keepalive_timer_cb(TfwTimer *t)
 {
-	TfwCliConn *cli_conn = (TfwCliConn *)data;
+	TfwCliConn *cli_conn = container_of(t, TfwCliConn, ka_timer);
 
 	T_DBG("Client timeout end\n");
 
 	/*
 	 * Close the socket (and the connection) asynchronously to avoid
-	 * a deadlock on del_timer_sync(). In case of error try to close
+	 * a deadlock on tfw_timer_del_sync(). In case of error try to close
 	 * it one second later.
 	 */
 	if (tfw_connection_close((TfwConn *)cli_conn, false))
-		mod_timer(&cli_conn->timer, jiffies + msecs_to_jiffies(1000));
+		tfw_timer_mod(t, jiffies + msecs_to_jiffies(1000));
 }
 
 static TfwCliConn *
@@ -73,13 +93,23 @@ tfw_cli_conn_alloc(int type)
 {
 	TfwCliConn *cli_conn;
 
-	if (!(cli_conn = kmem_cache_alloc(tfw_cli_cache(type), GFP_ATOMIC)))
+	/*
+	 * RSS delivers all the packets of the connection to the current CPU,
+	 * so allocate the connection, including its TLS and HTTP/2 contexts,
+	 * on the CPU's node: kmem_cache_alloc() may take the objects from
+	 * partial slabs of remote nodes.
+	 */
+	cli_conn = kmem_cache_alloc_node(tfw_cli_cache(type), GFP_ATOMIC,
+					 numa_node_id());
+	if (!cli_conn)
 		return NULL;
+	tfw_cli_conn_mem_acct(type, 1);
 
 	tfw_connection_init((TfwConn *)cli_conn);
 	INIT_LIST_HEAD(&cli_conn->seq_queue);
 	spin_lock_init(&cli_conn->seq_qlock);
 	spin_lock_init(&cli_conn->ret_qlock);
+	cli_conn->tunnel = NULL;
 #ifdef CONFIG_LOCKDEP
 	/*
 	 * The lock is acquired at only one place where there is no conflict
@@ -91,8 +121,7 @@ tfw_cli_conn_alloc(int type)
 			 &__lockdep_no_validate__, 2);
 #endif
 
-	setup_timer(&cli_conn->timer, tfw_sock_cli_keepalive_timer_cb,
-		    (unsigned long)cli_conn);
+	tfw_timer_setup(&cli_conn->ka_timer, tfw_sock_cli_keepalive_timer_cb);
 
 	return cli_conn;
 }
@@ -100,19 +129,20 @@ tfw_cli_conn_alloc(int type)
 static void
 tfw_cli_conn_free(TfwCliConn *cli_conn)
 {
-	BUG_ON(timer_pending(&cli_conn->timer));
+	BUG_ON(tfw_timer_pending(&cli_conn->ka_timer));
 
 	/* Check that all nested resources are freed. */
 	tfw_connection_validate_cleanup((TfwConn *)cli_conn);
 	BUG_ON(!list_empty(&cli_conn->seq_queue));
 
+	tfw_cli_conn_mem_acct(TFW_CONN_TYPE(cli_conn), -1);
 	kmem_cache_free(tfw_cli_cache(TFW_CONN_TYPE(cli_conn)), cli_conn);
 }
 
 void
 tfw_cli_conn_release(TfwCliConn *cli_conn)
 {
-	del_timer_sync(&cli_conn->timer);
+	tfw_timer_del_sync(&cli_conn->ka_timer);
 
 	if (likely(cli_conn->sk))
 		tfw_connection_unlink_to_sk((TfwConn *)cli_conn);
@@ -128,9 +158,9 @@ tfw_cli_conn_send(TfwCliConn *cli_conn, TfwMsg *msg)
 	int r;
 
 	r = tfw_connection_send((TfwConn *)cli_conn, msg);
-	mod_timer(&cli_conn->timer,
-		  jiffies +
-		  msecs_to_jiffies((long)tfw_cli_cfg_ka_timeout * 1000));
+	tfw_timer_mod(&cli_conn->ka_timer,
+		      jiffies +
+		      msecs_to_jiffies((long)tfw_cli_cfg_ka_timeout * 1000));
 
 	if (r)
 		/* Quite usual on system shutdown. */
@@ -206,9 +236,9 @@ tfw_sock_clnt_new(struct sock *sk)
 		sk->sk_write_xmit = tfw_tls_encrypt;
 
 	/* Activate keepalive timer. */
-	mod_timer(&conn->timer,
-		  jiffies +
-		  msecs_to_jiffies((long)tfw_cli_cfg_ka_timeout * 1000));
+	tfw_timer_mod(&((TfwCliConn *)conn)->ka_timer,
+		      jiffies +
+		      msecs_to_jiffies((long)tfw_cli_cfg_ka_timeout * 1000));
 
 	T_DBG3("new client socket is accepted: sk=%p, conn=%p, cli=%p\n",
 	       sk, conn, cli);
@@ -320,6 +350,15 @@ int tfw_cli_conn_close_all_sync(TfwClient *cli)
  * @sk		- The underlying networking representation.
  * @list	- An entry in the tfw_listen_socks list.
  * @addr	- The IP address specified in the configuration.
+ *
+ * TODO: only TCP listening sockets are supported. An HTTP/3 listener needs
+ * a QUIC transport which isn't there: a UDP socket demultiplexing datagrams
+ * to connections by connection IDs instead of Sync Sockets TCP callbacks,
+ * loss recovery and congestion control, QUIC packet protection keys derived
+ * by the TLS 1.3 key schedule (tls/ implements TLS 1.2 records over TCP),
+ * QPACK with its encoder and decoder streams on top of the HPACK tables and
+ * mapping of QUIC streams to TfwStream{} without the HTTP/2 Frame layer.
+ * UDP GSO/GRO batching belongs to the socket I/O of the transport.
  */
 typedef struct {
 	SsProto			proto;
@@ -563,6 +602,28 @@ tfw_cfgop_keepalive_timeout(TfwCfgSpec *cs, TfwCfgEntry *ce)
 	return 0;
 }
 
+static int
+tfw_cfgop_busy_poll_cpus(TfwCfgSpec *cs, TfwCfgEntry *ce)
+{
+	if (ce->val_n != 1 || ce->attr_n) {
+		T_ERR_NL("Invalid number of arguments: %zu\n", ce->val_n);
+		return -EINVAL;
+	}
+	if (cpulist_parse(ce->vals[0], &tfw_cli_cfg_bp_cpus)
+	    || !cpumask_subset(&tfw_cli_cfg_bp_cpus, cpu_online_mask))
+	{
+		T_ERR_NL("Invalid list of online CPUs: '%s'\n", ce->vals[0]);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static void
+tfw_cfgop_cleanup_busy_poll_cpus(TfwCfgSpec *cs)
+{
+	cpumask_clear(&tfw_cli_cfg_bp_cpus);
+}
 
 static void
 tfw_cfgop_cleanup_sock_clnt(TfwCfgSpec *cs)
@@ -599,6 +660,9 @@ tfw_sock_clnt_start(void)
 	if (tfw_runstate_is_reconfig())
 		return 0;
 
+	if ((r = ss_busy_poll_start(&tfw_cli_cfg_bp_cpus)))
+		return r;
+
 	list_for_each_entry(ls, &tfw_listen_socks, list) {
 		if ((r = tfw_listen_sock_start(ls))) {
 			T_ERR_ADDR("can't start listening on", &ls->addr,
@@ -616,6 +680,7 @@ err:
 		ss_release(ls->sk);
 		ls->sk = NULL;
 	}
+	ss_busy_poll_stop();
 
 	return r;
 }
@@ -659,6 +724,8 @@ tfw_sock_clnt_stop(void)
 		local_bh_disable();
 	}
 	local_bh_enable();
+
+	ss_busy_poll_stop();
 }
 
 static TfwCfgSpec tfw_sock_clnt_specs[] = {
@@ -676,6 +743,14 @@ static TfwCfgSpec tfw_sock_clnt_specs[] = {
 		.cleanup = tfw_cfgop_cleanup_sock_clnt,
 		.allow_repeat = false,
 	},
+	{
+		.name = "busy_poll_cpus",
+		.deflt = NULL,
+		.handler = tfw_cfgop_busy_poll_cpus,
+		.cleanup = tfw_cfgop_cleanup_busy_poll_cpus,
+		.allow_none = true,
+		.allow_repeat = false,
+	},
 	{ 0 }
 };
 
@@ -700,7 +775,7 @@ tfw_sock_clnt_init(void)
 	 * Check that flags for SS layer and Connection
 	 * layer are not overlapping.
 	 */
-	BUILD_BUG_ON(Conn_Stop & (Conn_Clnt |
+	BUILD_BUG_ON((Conn_Stop | Conn_RxPause) & (Conn_Clnt |
 				  Conn_Srv |
 				  TFW_FSM_HTTP |
 				  TFW_FSM_HTTPS));
@@ -708,9 +783,11 @@ tfw_sock_clnt_init(void)
 	BUG_ON(tfw_h2_conn_cache);
 
 	tfw_cli_conn_cache = kmem_cache_create("tfw_cli_conn_cache",
-					       sizeof(TfwCliConn), 0, 0, NULL);
+					       sizeof(TfwCliConn), 0,
+					       SLAB_HWCACHE_ALIGN, NULL);
 	tfw_h2_conn_cache = kmem_cache_create("tfw_h2_conn_cache",
-					       sizeof(TfwH2Conn), 0, 0, NULL);
+					       sizeof(TfwH2Conn), 0,
+					       SLAB_HWCACHE_ALIGN, NULL);
 
 	if (tfw_cli_conn_cache && tfw_h2_conn_cache) {
 		tfw_mod_register(&tfw_sock_clnt_mod);
@@ -26,6 +26,7 @@
 #include <net/inet_sock.h>
 
 #include "apm.h"
+#include "client.h"
 #include "tempesta_fw.h"
 #include "connection.h"
 #include "http_sess.h"
@@ -105,6 +106,16 @@
  *    the server, which requires that TfwSrvConn{} instance can be
  *    reused. So the attempt to reconnect has to wait. It is started as
  *    soon as the last client releases the server connection.
+ *
+ * TODO: server connections speak HTTP/1.1 only, so a busy server needs
+ * many connections and a slow response blocks the requests pipelined after
+ * it in @fwd_queue. HTTP/2 upstream connections would multiplex requests by
+ * streams and the schedulers would choose a connection by free streams
+ * rather than by the queue length. This requires a Frame layer context for
+ * TfwSrvConn{} (TfwH2Ctx{} is bound to client TLS connections now),
+ * a request HPACK encoder and framing (the encoder only serializes
+ * responses), an HTTP/2 response parser and mapping of @fwd_queue requests
+ * to TfwStream{} with per-stream eviction and re-sending on failover.
  */
 
 /*
@@ -122,6 +133,18 @@
  */
 static const unsigned long tfw_srv_tmo_vals[] = { 1, 10, 100, 250, 500, 1000 };
 
+/*
+ * Adaptive connections pool parameters: the pool resize interval, number of
+ * requests in a connection queue that are stalled by a pipelined request in
+ * front of them, and the time after which an unused connection is closed.
+ */
+#define TFW_SRV_POOL_INTVL		HZ
+#define TFW_SRV_POOL_STALL_QSIZE	2
+#define TFW_SRV_POOL_IDLE_TMO		(30 * HZ)
+
+/* Interval to move the unsent requests of a draining server. */
+#define TFW_SRV_DRAIN_INTVL		(HZ / 10)
+
 #define srv_warn(check, addr, fmt, ...)					\
 	T_WARN_MOD_ADDR(sock_srv, check, addr, TFW_WITH_PORT, fmt,	\
 			##__VA_ARGS__)
@@ -166,6 +189,11 @@ static inline void
 tfw_sock_srv_connect_try_later(TfwSrvConn *srv_conn)
 {
 	unsigned long timeout;
+	TfwServer *srv = (TfwServer *)srv_conn->peer;
+
+	/* The previous connection attempt has failed. */
+	if (srv_conn->recns && srv->apmref)
+		tfw_apm_update_err(srv->apmref, true);
 
 	if (srv_conn->recns < ARRAY_SIZE(tfw_srv_tmo_vals)) {
 		if (srv_conn->recns)
@@ -327,6 +355,56 @@ tfw_srv_reset_cfg_actions(TfwServer *srv)
 	} while (cmpxchg(&srv->flags, flags, new_flags) != flags);
 }
 
+/*
+ * Spare connections.
+ *
+ * Up to @srv->conn_spare established connections to a server are kept out
+ * of scheduling, so a failed connection is replaced immediately instead of
+ * waiting for the new TCP handshake. A connection becomes a spare when it's
+ * established and there are not enough spares, and it's promoted to the
+ * schedulers when another connection to the server fails. The failed
+ * connection reconnects as usual and likely becomes a spare then.
+ */
+static void
+tfw_sock_srv_spare_hold(TfwServer *srv, TfwSrvConn *srv_conn)
+{
+	if (!srv->conn_spare || tfw_srv_conn_restricted(srv_conn))
+		return;
+	if (atomic_inc_return(&srv->spare_n) > srv->conn_spare) {
+		atomic_dec(&srv->spare_n);
+		return;
+	}
+	set_bit(TFW_CONN_B_SPARE, &srv_conn->flags);
+	T_DBG_ADDR("spare connection", &srv->addr, TFW_WITH_PORT);
+}
+
+static bool
+tfw_sock_srv_spare_release(TfwServer *srv, TfwSrvConn *srv_conn)
+{
+	if (!test_and_clear_bit(TFW_CONN_B_SPARE, &srv_conn->flags))
+		return false;
+	atomic_dec(&srv->spare_n);
+	return true;
+}
+
+static void
+tfw_sock_srv_spare_promote(TfwServer *srv)
+{
+	TfwSrvConn *srv_conn;
+
+	if (!atomic_read(&srv->spare_n))
+		return;
+	list_for_each_entry(srv_conn, &srv->conn_list, list) {
+		if (!tfw_srv_conn_live(srv_conn)
+		    || !tfw_sock_srv_spare_release(srv, srv_conn))
+			continue;
+		T_DBG_ADDR("promote spare connection", &srv->addr,
+			   TFW_WITH_PORT);
+		TFW_INC_STAT_BH(serv.conn_promoted);
+		return;
+	}
+}
+
 /**
  * The hook is executed when a server connection is established.
  */
@@ -346,6 +424,7 @@ tfw_sock_srv_connect_complete(struct sock *sk)
 	}
 
 	/* Let schedulers use the connection hereafter. */
+	tfw_sock_srv_spare_hold(srv, (TfwSrvConn *)conn);
 	tfw_connection_revive(conn);
 
 	/* Repair the connection if necessary. */
@@ -353,6 +432,9 @@ tfw_sock_srv_connect_complete(struct sock *sk)
 		tfw_connection_repair(conn);
 
 	__reset_retry_timer((TfwSrvConn *)conn);
+	WRITE_ONCE(((TfwSrvConn *)conn)->jtxtstamp, jiffies);
+	/* RSS delivers all the following packets of the flow here. */
+	WRITE_ONCE(((TfwSrvConn *)conn)->cpu, smp_processor_id());
 
 	T_DBG_ADDR("connected", &srv->addr, TFW_WITH_PORT);
 	TFW_INC_STAT_BH(serv.conn_established);
@@ -374,6 +456,7 @@ tfw_sock_srv_connect_drop(struct sock *sk)
 		 * SS put()'s the socket.
 		 */
 		TFW_INC_STAT_BH(serv.conn_disconnects);
+		tfw_sock_srv_spare_release(srv, (TfwSrvConn *)conn);
 		tfw_connection_drop(conn);
 		tfw_connection_put(conn);
 		return;
@@ -396,6 +479,8 @@ tfw_sock_srv_connect_drop(struct sock *sk)
 	if (tfw_connection_live(conn)) {
 		TFW_INC_STAT_BH(serv.conn_disconnects);
 		tfw_connection_put_to_death(conn);
+		if (!tfw_sock_srv_spare_release(srv, (TfwSrvConn *)conn))
+			tfw_sock_srv_spare_promote(srv);
 		tfw_connection_drop(conn);
 	}
 
@@ -409,6 +494,147 @@ static const SsHooks tfw_sock_srv_ss_hooks = {
 	.connection_recv	= tfw_connection_recv,
 };
 
+/*
+ * Tunnels.
+ *
+ * A client connection upgraded by a server isn't HTTP anymore, so the data
+ * is passed between the client and the server sockets as is, without any
+ * parsing or messages allocation. The server connection hands its socket
+ * over to a tunnel and fails over as if the socket was closed, so it
+ * reconnects and the servers connections pool doesn't shrink with
+ * the tunnels. The tunnel is referenced by the socket and by the client
+ * connection, whichever side is closed first closes the other one.
+ */
+static struct kmem_cache *tfw_tun_conn_cache;
+
+static void
+tfw_tun_conn_put(TfwTunConn *tun)
+{
+	if (!atomic_dec_and_test(&tun->refcnt))
+		return;
+	ss_sock_put(tun->sk);
+	tfw_cli_conn_put(tun->cli_conn);
+	tfw_mem_acct(TFW_MEM_CONN, -(long)kmem_cache_size(tfw_tun_conn_cache));
+	kmem_cache_free(tfw_tun_conn_cache, tun);
+}
+
+/**
+ * Pass the data received from the server to the client as is. @skb is
+ * a single skb or a batch of skbs from the socket, see ss_tcp_process_data().
+ */
+static int
+tfw_sock_tun_recv(void *cdata, struct sk_buff *skb)
+{
+	int r;
+	TfwTunConn *tun = cdata;
+	TfwMsg msg = {};
+	struct sk_buff *it = skb;
+
+	if (!skb->next)
+		ss_skb_queue_tail(&msg.skb_head, skb);
+	else
+		msg.skb_head = skb;
+	do {
+		msg.len += it->len;
+	} while ((it = it->next) != skb);
+
+	TFW_ADD_STAT_BH(msg.len, serv.rx_bytes);
+	if ((r = tfw_cli_conn_send(tun->cli_conn, &msg)))
+		ss_skb_queue_purge(&msg.skb_head);
+
+	return r ? T_BAD : T_OK;
+}
+
+static void
+tfw_sock_tun_drop(struct sock *sk)
+{
+	TfwTunConn *tun = sk->sk_user_data;
+	TfwCliConn *cli_conn = tun->cli_conn;
+
+	T_DBG2("tunnel closed: sk=%pK cli_conn=%pK\n", sk, cli_conn);
+
+	sk->sk_user_data = NULL;
+	if (xchg(&cli_conn->tunnel, TFW_CONN_TUN_CLOSED) == tun) {
+		tfw_connection_close((TfwConn *)cli_conn, false);
+		tfw_tun_conn_put(tun);
+	}
+	tfw_tun_conn_put(tun);
+}
+
+static const SsHooks tfw_sock_tun_ss_hooks = {
+	.connection_drop	= tfw_sock_tun_drop,
+	.connection_recv	= tfw_sock_tun_recv,
+};
+
+/**
+ * Switch @cli_conn to a tunnel through the socket of @srv_conn, which has
+ * just upgraded the client connection. Nothing can be sent through
+ * @srv_conn after the call, so the caller must hold @srv_conn->fwd_qlock.
+ * The caller must also drop @srv_conn as if its socket was closed once
+ * the response switching the protocols is processed.
+ */
+int
+tfw_sock_srv_tunnel(TfwSrvConn *srv_conn, TfwCliConn *cli_conn)
+{
+	TfwServer *srv = (TfwServer *)srv_conn->peer;
+	struct sock *sk = srv_conn->sk;
+	TfwTunConn *tun;
+
+	assert_spin_locked(&srv_conn->fwd_qlock);
+	BUG_ON(!tfw_srv_conn_live(srv_conn));
+
+	/* The tunnel is used on the CPU of the server connection. */
+	tun = kmem_cache_alloc_node(tfw_tun_conn_cache, GFP_ATOMIC,
+				    numa_node_id());
+	if (!tun)
+		return -ENOMEM;
+	ss_proto_init(&tun->proto, &tfw_sock_tun_ss_hooks, Conn_HttpSrv);
+	atomic_set(&tun->refcnt, 2);
+	tun->sk = sk;
+	tun->cli_conn = cli_conn;
+	/* The client connection is already closed. */
+	if (cmpxchg(&cli_conn->tunnel, NULL, tun)) {
+		kmem_cache_free(tfw_tun_conn_cache, tun);
+		return -ENOTCONN;
+	}
+	ss_sock_hold(sk);
+	tfw_cli_conn_get(cli_conn);
+	tfw_mem_acct(TFW_MEM_CONN, kmem_cache_size(tfw_tun_conn_cache));
+
+	/*
+	 * The client connection can close the tunnel right away, but the
+	 * drop hook is called under the socket lock, which is held by us
+	 * in the socket receive context.
+	 */
+	tfw_connection_unlink_from_sk(sk);
+	sk->sk_user_data = tun;
+	tfw_connection_unlink_to_sk((TfwConn *)srv_conn);
+
+	TFW_INC_STAT_BH(serv.conn_disconnects);
+	tfw_connection_put_to_death((TfwConn *)srv_conn);
+	if (!tfw_sock_srv_spare_release(srv, srv_conn))
+		tfw_sock_srv_spare_promote(srv);
+
+	T_DBG_ADDR("connection upgraded to tunnel", &srv->addr, TFW_WITH_PORT);
+
+	return 0;
+}
+
+/**
+ * The client side of the tunnel @cli_conn is closed, close the server side.
+ * Make sure that the tunnel can't be established any more.
+ */
+void
+tfw_sock_srv_tunnel_close(TfwCliConn *cli_conn)
+{
+	TfwTunConn *tun = xchg(&cli_conn->tunnel, TFW_CONN_TUN_CLOSED);
+
+	if (IS_ERR_OR_NULL(tun))
+		return;
+	ss_close(tun->sk, 0);
+	tfw_tun_conn_put(tun);
+}
+
 /**
  * Close a server connection, or stop attempts to connect if a connection
  * is not established. This is called only in user context at STOP time.
@@ -537,9 +763,146 @@ tfw_sock_srv_conn_activate(TfwServer *srv, TfwSrvConn *srv_conn)
 	set_bit(TFW_CONN_B_ACTIVE, &srv_conn->flags);
 }
 
+/*
+ * ------------------------------------------------------------------------
+ *	Adaptive connections pool.
+ * ------------------------------------------------------------------------
+ *
+ * If @srv->conn_min is less than @srv->conn_n, then only @srv->conn_min
+ * connections are established at start, and the rest of the pre-allocated
+ * TfwSrvConn{} objects are parked. The objects are still in the scheduler
+ * lists, but they are skipped as dead connections, so a connection joins
+ * the scheduling as soon as it's established, without reconfiguration of
+ * the server group.
+ *
+ * The pool timer connects one parked connection per interval if most of
+ * the live connections are stalled, i.e. requests wait behind pipelined
+ * requests in @fwd_queue or the pipelining is blocked by a non-idempotent
+ * request. Otherwise one connection that hasn't been used for a while is
+ * closed and parked while there are more than @srv->conn_min connections.
+ *
+ * A connection is closed as a removed one, so requests that get into it
+ * in the meantime are re-scheduled by tfw_http_conn_release() and no
+ * reconnect attempts are made. The connection is stopped in its destructor
+ * and may be reused after that.
+ *
+ * Spare connections are established in addition to @srv->conn_min ones and
+ * aren't counted by the pool timer.
+ */
+static inline bool
+tfw_sock_srv_conn_parked(TfwSrvConn *srv_conn)
+{
+	return !test_bit(TFW_CONN_B_ACTIVE, &srv_conn->flags)
+	       || test_bit(TFW_CONN_B_STOPPED, &srv_conn->flags);
+}
+
+static inline bool
+tfw_sock_srv_conn_stalled(TfwSrvConn *srv_conn)
+{
+	return READ_ONCE(srv_conn->qsize) >= TFW_SRV_POOL_STALL_QSIZE
+	       || tfw_srv_conn_hasnip(srv_conn)
+	       || tfw_srv_conn_busy(srv_conn);
+}
+
+static inline bool
+tfw_sock_srv_conn_idle(TfwSrvConn *srv_conn)
+{
+	return !READ_ONCE(srv_conn->qsize)
+	       && time_after(jiffies, READ_ONCE(srv_conn->jtxtstamp)
+				      + TFW_SRV_POOL_IDLE_TMO);
+}
+
+static void
+tfw_sock_srv_conn_unpark(TfwServer *srv, TfwSrvConn *srv_conn)
+{
+	T_DBG_ADDR("grow connections pool", &srv->addr, TFW_WITH_PORT);
+
+	clear_bit(TFW_CONN_B_STOPPED, &srv_conn->flags);
+	clear_bit(TFW_CONN_B_DEL, &srv_conn->flags);
+	__reset_retry_timer(srv_conn);
+	tfw_sock_srv_conn_activate(srv, srv_conn);
+	tfw_sock_srv_connect_try_later(srv_conn);
+}
+
+static void
+tfw_sock_srv_conn_park(TfwServer *srv, TfwSrvConn *srv_conn)
+{
+	if (!tfw_srv_conn_get_if_live(srv_conn))
+		return;
+
+	T_DBG_ADDR("shrink connections pool", &srv->addr, TFW_WITH_PORT);
+
+	set_bit(TFW_CONN_B_DEL, &srv_conn->flags);
+	smp_mb__after_atomic();
+	/* The close work can't be queued now, try on the next interval. */
+	if (tfw_connection_close((TfwConn *)srv_conn, false))
+		clear_bit(TFW_CONN_B_DEL, &srv_conn->flags);
+
+	tfw_srv_conn_put(srv_conn);
+}
+
+static void
+tfw_sock_srv_pool_tmfn(unsigned long data)
+{
+	TfwServer *srv = (TfwServer *)data;
+	TfwSrvConn *srv_conn, *parked = NULL, *idle = NULL;
+	size_t active_n = 0, live_n = 0, stalled_n = 0;
+
+	list_for_each_entry(srv_conn, &srv->conn_list, list) {
+		if (tfw_sock_srv_conn_parked(srv_conn)) {
+			parked = srv_conn;
+			continue;
+		}
+		/* The connection is being parked or is a spare one. */
+		if (test_bit(TFW_CONN_B_DEL, &srv_conn->flags)
+		    || tfw_srv_conn_spare(srv_conn))
+			continue;
+		++active_n;
+		if (!tfw_srv_conn_live(srv_conn))
+			continue;
+		++live_n;
+		if (tfw_sock_srv_conn_stalled(srv_conn))
+			++stalled_n;
+		else if (!idle && tfw_sock_srv_conn_idle(srv_conn))
+			idle = srv_conn;
+	}
+
+	if (parked && (active_n < srv->conn_min || stalled_n * 2 > live_n))
+		tfw_sock_srv_conn_unpark(srv, parked);
+	else if (idle && !stalled_n && active_n > srv->conn_min)
+		tfw_sock_srv_conn_park(srv, idle);
+
+	smp_mb();
+	if (test_bit(TFW_SRV_B_POOL, &srv->flags))
+		mod_timer(&srv->pool_timer, jiffies + TFW_SRV_POOL_INTVL);
+}
+
+static void
+tfw_sock_srv_pool_start(TfwServer *srv)
+{
+	if (srv->conn_min >= srv->conn_n)
+		return;
+
+	set_bit(TFW_SRV_B_POOL, &srv->flags);
+	smp_mb__after_atomic();
+	setup_timer(&srv->pool_timer, tfw_sock_srv_pool_tmfn,
+		    (unsigned long)srv);
+	mod_timer(&srv->pool_timer, jiffies + TFW_SRV_POOL_INTVL);
+}
+
+static void
+tfw_sock_srv_pool_stop(TfwServer *srv)
+{
+	if (!test_and_clear_bit(TFW_SRV_B_POOL, &srv->flags))
+		return;
+	smp_mb__after_atomic();
+	del_timer_sync(&srv->pool_timer);
+}
+
 static void
 tfw_sock_srv_connect_srv(TfwServer *srv)
 {
+	size_t i = 0;
 	TfwSrvConn *srv_conn;
 
 	/*
@@ -551,9 +914,12 @@ tfw_sock_srv_connect_srv(TfwServer *srv)
 	 * that parallel execution can't happen with the same socket.
 	 */
 	list_for_each_entry(srv_conn, &srv->conn_list, list) {
+		if (i++ == srv->conn_min + srv->conn_spare)
+			break;
 		tfw_sock_srv_conn_activate(srv, srv_conn);
 		tfw_sock_srv_connect_try_later(srv_conn);
 	}
+	tfw_sock_srv_pool_start(srv);
 }
 
 /**
@@ -570,6 +936,8 @@ tfw_sock_srv_disconnect_srv(TfwServer *srv)
 {
 	TfwConn *conn;
 
+	tfw_sock_srv_pool_stop(srv);
+
 	return tfw_peer_for_each_conn(srv, conn, list,
 				      tfw_sock_srv_disconnect);
 }
@@ -600,6 +968,7 @@ tfw_srv_conn_alloc(void)
 	might_sleep();
 	if (!(srv_conn = kmem_cache_alloc(tfw_srv_conn_cache, GFP_KERNEL)))
 		return NULL;
+	tfw_mem_acct(TFW_MEM_CONN, kmem_cache_size(tfw_srv_conn_cache));
 
 	tfw_connection_init((TfwConn *)srv_conn);
 	memset((char *)srv_conn + sizeof(TfwConn), 0,
@@ -607,6 +976,7 @@ tfw_srv_conn_alloc(void)
 	INIT_LIST_HEAD(&srv_conn->fwd_queue);
 	INIT_LIST_HEAD(&srv_conn->nip_queue);
 	spin_lock_init(&srv_conn->fwd_qlock);
+	init_llist_head(&srv_conn->fwd_pend);
 
 	/*
 	 * Initialization into special value for force releasing
@@ -628,8 +998,10 @@ tfw_srv_conn_free(TfwSrvConn *srv_conn)
 	/* Check that all nested resources are freed. */
 	tfw_connection_validate_cleanup((TfwConn *)srv_conn);
 	BUG_ON(!list_empty(&srv_conn->nip_queue));
+	BUG_ON(!llist_empty(&srv_conn->fwd_pend));
 	BUG_ON(ACCESS_ONCE(srv_conn->qsize));
 
+	tfw_mem_acct(TFW_MEM_CONN, -(long)kmem_cache_size(tfw_srv_conn_cache));
 	kmem_cache_free(tfw_srv_conn_cache, srv_conn);
 }
 
@@ -751,17 +1123,76 @@ tfw_sock_srv_grace_stop(TfwServer *srv)
 	tfw_sock_srv_grace_list_del(srv);
 }
 
+/*
+ * Drain the connections of server @srv: move a batch of the unsent requests
+ * from each live connection to other servers and close the connections with
+ * empty forwarding queues. A connection is closed as a removed one, just like
+ * a parked connection, so it's not restored.
+ *
+ * Return true if there are no live connections with requests anymore.
+ * Requests of failed connections are rescheduled on the server disconnect.
+ */
+static bool
+tfw_sock_srv_drain_conns(TfwServer *srv)
+{
+	bool done = true;
+	TfwSrvConn *srv_conn;
+
+	list_for_each_entry(srv_conn, &srv->conn_list, list) {
+		if (test_bit(TFW_CONN_B_DEL, &srv_conn->flags)
+		    || !tfw_srv_conn_get_if_live(srv_conn))
+			continue;
+		if (!tfw_http_conn_migrate(srv_conn)) {
+			done = false;
+		} else {
+			set_bit(TFW_CONN_B_DEL, &srv_conn->flags);
+			smp_mb__after_atomic();
+			if (tfw_connection_close((TfwConn *)srv_conn, false)) {
+				clear_bit(TFW_CONN_B_DEL, &srv_conn->flags);
+				done = false;
+			}
+		}
+		tfw_srv_conn_put(srv_conn);
+	}
+
+	return done;
+}
+
+/*
+ * The grace shutdown timer. When the grace time is over, the server is
+ * drained: schedulers don't send it new requests, the requests sent to the
+ * server are finished in their connections, and the unsent requests are
+ * moved to other servers in batches every TFW_SRV_DRAIN_INTVL. The server
+ * is disconnected when it's drained or when the requests left in it are
+ * older than the maximum age of a request in the group.
+ */
 static void
 tfw_sock_srv_grace_shutdown_cb(unsigned long data)
 {
 	TfwServer *srv = (TfwServer *)data;
 
-	tfw_sock_srv_grace_stop(srv);
+	if (!test_bit(TFW_SRV_B_DRAIN, &srv->flags)) {
+		T_DBG_ADDR("drain server", &srv->addr, TFW_WITH_PORT);
+		tfw_sock_srv_pool_stop(srv);
+		tfw_server_stop_sched(srv);
+		srv->drain_end = jiffies + srv->sg->max_jqage;
+		set_bit(TFW_SRV_B_DRAIN, &srv->flags);
+		smp_mb__after_atomic();
+	}
+
+	if (tfw_sock_srv_drain_conns(srv)
+	    || time_after(jiffies, srv->drain_end))
+	{
+		tfw_sock_srv_grace_stop(srv);
+		return;
+	}
+	mod_timer(&srv->gs_timer, jiffies + TFW_SRV_DRAIN_INTVL);
 }
 
 /**
  * Schedule graceful shutdown of a server. Allow server to finish it's
- * forward queue or pinned sessions if any.
+ * forward queue or pinned sessions if any. The server is drained after
+ * the grace time or right away if the grace time isn't set.
  *
  * The function is called under server group lock. @sg->srv_list is changed
  * during this function.
@@ -769,27 +1200,24 @@ tfw_sock_srv_grace_shutdown_cb(unsigned long data)
 static int
 tfw_sock_srv_grace_shutdown_srv(TfwSrvGroup *sg, TfwServer *srv, void *data)
 {
-	int r = 0;
+	unsigned long expires = jiffies;
 
 	tfw_server_get(srv);
 	__tfw_sg_del_srv(sg, srv, false);
 	set_bit(TFW_CFG_B_DEL, &srv->flags);
 
-	if (!tfw_cfg_grace_time) {
-		r = tfw_sock_srv_disconnect_srv(srv);
-	} else {
+	if (tfw_cfg_grace_time) {
 		if (atomic64_read(&srv->sess_n))
 			tfw_server_start_sched(srv);
-
-		setup_timer(&srv->gs_timer, tfw_sock_srv_grace_shutdown_cb,
-			    (unsigned long)srv);
-		tfw_sock_srv_grace_list_add(srv);
-		mod_timer(&srv->gs_timer,
-		          jiffies + (unsigned long)tfw_cfg_grace_time * HZ);
+		expires += (unsigned long)tfw_cfg_grace_time * HZ;
 	}
+	setup_timer(&srv->gs_timer, tfw_sock_srv_grace_shutdown_cb,
+		    (unsigned long)srv);
+	tfw_sock_srv_grace_list_add(srv);
+	mod_timer(&srv->gs_timer, expires);
 	tfw_server_put(srv);
 
-	return r;
+	return 0;
 }
 
 static void
@@ -880,6 +1308,8 @@ static struct kmem_cache *tfw_sg_cfg_cache;
  * @list		- member pointer in the sg_cfg_list list;
  * @reconf_flags	- TFW_CFG_MDF_SG_* flags;
  * @nip_flags		- non-idempotent req related flags;
+ * @aff_flags		- CPU affinity flags;
+ * @ss_flags		- slow start flags;
  * @sched_flags		- scheduler flags;
  * @sched_arg		- scheduler init argument.
  * @hm_name		- name of group's health monitor;
@@ -891,6 +1321,8 @@ typedef struct {
 	struct list_head	list;
 	unsigned int		reconf_flags;
 	unsigned int		nip_flags;
+	unsigned int		aff_flags;
+	unsigned int		ss_flags;
 	unsigned int		sched_flags;
 	void			*sched_arg;
 	char			*hm_name;
@@ -917,9 +1349,15 @@ static unsigned int tfw_cfg_grace_time_reconfig = 0;
 static struct {
 	bool max_qsize		: 1;
 	bool max_refwd		: 1;
+	bool retry_budget	: 1;
+	bool mirror_rate	: 1;
+	bool mirror_conc	: 1;
+	bool conc_max		: 1;
 	bool max_jqage		: 1;
 	bool max_recns		: 1;
 	bool nip_flags		: 1;
+	bool aff_flags		: 1;
+	bool slow_start		: 1;
 	bool sched		: 1;
 } __attribute__((packed)) tfw_cfg_is_set;
 
@@ -949,8 +1387,13 @@ tfw_cfgop_sg_copy_opts(TfwSrvGroup *to, TfwSrvGroup *from)
 
 	to->max_qsize = from->max_qsize;
 	to->max_refwd = from->max_refwd;
+	to->retry_budget = from->retry_budget;
+	to->mirror_rate = from->mirror_rate;
+	to->mirror_conc = from->mirror_conc;
+	to->conc_max = from->conc_max;
 	to->max_jqage = from->max_jqage;
 	to->max_recns = from->max_recns;
+	to->slow_start = from->slow_start;
 	to->flags     = from->flags;
 }
 
@@ -1151,6 +1594,67 @@ tfw_cfgop_out_fwd_retries(TfwCfgSpec *cs, TfwCfgEntry *ce)
 	return tfw_cfgop_intval(cs, ce, &tfw_cfg_sg_opts->parsed_sg->max_refwd);
 }
 
+static int
+tfw_cfgop_in_retry_budget(TfwCfgSpec *cs, TfwCfgEntry *ce)
+{
+	TFW_CFGOP_INHERIT_OPT(ce, retry_budget);
+	return tfw_cfgop_intval(cs, ce,
+				&tfw_cfg_sg->parsed_sg->retry_budget);
+}
+
+static int
+tfw_cfgop_out_retry_budget(TfwCfgSpec *cs, TfwCfgEntry *ce)
+{
+	tfw_cfg_is_set.retry_budget = 1;
+	return tfw_cfgop_intval(cs, ce,
+				&tfw_cfg_sg_opts->parsed_sg->retry_budget);
+}
+
+static int
+tfw_cfgop_in_mirror_rate(TfwCfgSpec *cs, TfwCfgEntry *ce)
+{
+	TFW_CFGOP_INHERIT_OPT(ce, mirror_rate);
+	return tfw_cfgop_intval(cs, ce, &tfw_cfg_sg->parsed_sg->mirror_rate);
+}
+
+static int
+tfw_cfgop_out_mirror_rate(TfwCfgSpec *cs, TfwCfgEntry *ce)
+{
+	tfw_cfg_is_set.mirror_rate = 1;
+	return tfw_cfgop_intval(cs, ce,
+				&tfw_cfg_sg_opts->parsed_sg->mirror_rate);
+}
+
+static int
+tfw_cfgop_in_mirror_conc(TfwCfgSpec *cs, TfwCfgEntry *ce)
+{
+	TFW_CFGOP_INHERIT_OPT(ce, mirror_conc);
+	return tfw_cfgop_intval(cs, ce, &tfw_cfg_sg->parsed_sg->mirror_conc);
+}
+
+static int
+tfw_cfgop_out_mirror_conc(TfwCfgSpec *cs, TfwCfgEntry *ce)
+{
+	tfw_cfg_is_set.mirror_conc = 1;
+	return tfw_cfgop_intval(cs, ce,
+				&tfw_cfg_sg_opts->parsed_sg->mirror_conc);
+}
+
+static int
+tfw_cfgop_in_conc_max(TfwCfgSpec *cs, TfwCfgEntry *ce)
+{
+	TFW_CFGOP_INHERIT_OPT(ce, conc_max);
+	return tfw_cfgop_intval(cs, ce, &tfw_cfg_sg->parsed_sg->conc_max);
+}
+
+static int
+tfw_cfgop_out_conc_max(TfwCfgSpec *cs, TfwCfgEntry *ce)
+{
+	tfw_cfg_is_set.conc_max = 1;
+	return tfw_cfgop_intval(cs, ce,
+				&tfw_cfg_sg_opts->parsed_sg->conc_max);
+}
+
 static inline int
 tfw_cfgop_retry_nip(TfwCfgSpec *cs, TfwCfgEntry *ce, unsigned int *sg_flags)
 {
@@ -1187,6 +1691,39 @@ tfw_cfgop_out_retry_nip(TfwCfgSpec *cs, TfwCfgEntry *ce)
 	return tfw_cfgop_retry_nip(cs, ce, &tfw_cfg_sg_opts->nip_flags);
 }
 
+static inline int
+tfw_cfgop_cpu_affinity(TfwCfgSpec *cs, TfwCfgEntry *ce, unsigned int *sg_flags)
+{
+	if (ce->attr_n) {
+		T_ERR_NL("Arguments may not have the '=' sign\n");
+		return -EINVAL;
+	}
+	if (tfw_cfg_is_dflt_value(ce)) {
+		*sg_flags = 0;
+	} else if (!ce->val_n) {
+		*sg_flags = TFW_SG_F_CPU_AFFINITY;
+	} else {
+		T_ERR_NL("Invalid number of arguments: %zu\n", ce->val_n);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static int
+tfw_cfgop_in_cpu_affinity(TfwCfgSpec *cs, TfwCfgEntry *ce)
+{
+	TFW_CFGOP_INHERIT_FLAGS(ce, aff_flags);
+	return tfw_cfgop_cpu_affinity(cs, ce, &tfw_cfg_sg->aff_flags);
+}
+
+static int
+tfw_cfgop_out_cpu_affinity(TfwCfgSpec *cs, TfwCfgEntry *ce)
+{
+	tfw_cfg_is_set.aff_flags = 1;
+	return tfw_cfgop_cpu_affinity(cs, ce, &tfw_cfg_sg_opts->aff_flags);
+}
+
 static bool
 tfw_cfgop_sg_set_hm_name(TfwCfgSrvGroup *sg_cfg, const char *hname)
 {
@@ -1256,6 +1793,61 @@ tfw_cfgop_out_conn_retries(TfwCfgSpec *cs, TfwCfgEntry *ce)
 				      &tfw_cfg_sg_opts->parsed_sg->max_recns);
 }
 
+static int
+tfw_cfgop_slow_start(TfwCfgSpec *cs, TfwCfgEntry *ce, TfwCfgSrvGroup *sg_cfg)
+{
+	int r, time;
+
+	if (ce->attr_n) {
+		T_ERR_NL("Arguments may not have the '=' sign\n");
+		return -EINVAL;
+	}
+	if (ce->val_n < 1 || ce->val_n > 2) {
+		T_ERR_NL("Invalid number of arguments: %zu\n", ce->val_n);
+		return -EINVAL;
+	}
+	if ((r = tfw_cfg_parse_int(ce->vals[0], &time))) {
+		T_ERR_NL("Invalid slow start window: '%s'\n", ce->vals[0]);
+		return r;
+	}
+	if ((r = tfw_cfg_check_range(time, 0, INT_MAX)))
+		return r;
+
+	sg_cfg->ss_flags = 0;
+	if (ce->val_n == 2) {
+		if (!strcasecmp(ce->vals[1], "exponential")) {
+			sg_cfg->ss_flags = TFW_SG_F_SLOW_START_EXP;
+		} else if (strcasecmp(ce->vals[1], "linear")) {
+			T_ERR_NL("Unsupported slow start mode: '%s'\n",
+				 ce->vals[1]);
+			return -EINVAL;
+		}
+	}
+	sg_cfg->parsed_sg->slow_start =
+		msecs_to_jiffies((unsigned long)time * 1000);
+
+	return 0;
+}
+
+static int
+tfw_cfgop_in_slow_start(TfwCfgSpec *cs, TfwCfgEntry *ce)
+{
+	if (TFW_CFGOP_HAS_DFLT(ce, slow_start)) {
+		tfw_cfg_sg->parsed_sg->slow_start =
+			tfw_cfg_sg_opts->parsed_sg->slow_start;
+		tfw_cfg_sg->ss_flags = tfw_cfg_sg_opts->ss_flags;
+		return 0;
+	}
+	return tfw_cfgop_slow_start(cs, ce, tfw_cfg_sg);
+}
+
+static int
+tfw_cfgop_out_slow_start(TfwCfgSpec *cs, TfwCfgEntry *ce)
+{
+	tfw_cfg_is_set.slow_start = 1;
+	return tfw_cfgop_slow_start(cs, ce, tfw_cfg_sg_opts);
+}
+
 /**
  * Mark @sg_cfg as requiring scheduler update if the @srv wasn't present in
  * previous configuration or if it's options changed.
@@ -1273,7 +1865,9 @@ tfw_cfgop_server_orig_lookup(TfwCfgSrvGroup *sg_cfg, TfwServer *srv)
 		set_bit(TFW_CFG_B_ADD, &srv->flags);
 		goto done;
 	}
-	if (orig_srv->conn_n != srv->conn_n)
+	if (orig_srv->conn_n != srv->conn_n
+	    || orig_srv->conn_min != srv->conn_min
+	    || orig_srv->conn_spare != srv->conn_spare)
 		goto changed;
 	if (srv->weight && (srv->weight != orig_srv->weight))
 		goto changed;
@@ -1307,15 +1901,16 @@ tfw_cfgop_server(TfwCfgSpec *cs, TfwCfgEntry *ce, TfwCfgSrvGroup *sg_cfg)
 {
 	TfwAddr addr;
 	TfwServer *srv;
-	int i, conns_n = 0, weight = 0;
-	bool has_conns_n = false, has_weight = false;
+	int i, conns_n = 0, conns_min = 0, conns_spare = 0, weight = 0;
+	bool has_conns_n = false, has_conns_min = false, has_weight = false;
+	bool has_conns_spare = false;
 	const char *key, *val;
 
 	if (ce->val_n != 1) {
 		T_ERR_NL("Invalid number of arguments: %zu\n", ce->val_n);
 		return -EINVAL;
 	}
-	if (ce->attr_n > 3) {
+	if (ce->attr_n > 4) {
 		T_ERR_NL("Invalid number of key=value pairs: %zu\n",
 			 ce->attr_n);
 		return -EINVAL;
@@ -1342,6 +1937,26 @@ tfw_cfgop_server(TfwCfgSpec *cs, TfwCfgEntry *ce, TfwCfgSrvGroup *sg_cfg)
 				return -EINVAL;
 			}
 			has_conns_n = true;
+		} else if (!strcasecmp(key, "conns_min")) {
+			if (has_conns_min) {
+				T_ERR_NL("Duplicate argument: '%s'\n", key);
+				return -EINVAL;
+			}
+			if (tfw_cfg_parse_int(val, &conns_min)) {
+				T_ERR_NL("Invalid value: '%s'\n", val);
+				return -EINVAL;
+			}
+			has_conns_min = true;
+		} else if (!strcasecmp(key, "conns_spare")) {
+			if (has_conns_spare) {
+				T_ERR_NL("Duplicate argument: '%s'\n", key);
+				return -EINVAL;
+			}
+			if (tfw_cfg_parse_int(val, &conns_spare)) {
+				T_ERR_NL("Invalid value: '%s'\n", val);
+				return -EINVAL;
+			}
+			has_conns_spare = true;
 		} else if (!strcasecmp(key, "weight")) {
 			if (has_weight) {
 				T_ERR_NL("Duplicate argument: '%s'\n", key);
@@ -1365,6 +1980,18 @@ tfw_cfgop_server(TfwCfgSpec *cs, TfwCfgEntry *ce, TfwCfgSrvGroup *sg_cfg)
 			 TFW_SRV_MAX_CONN_N, conns_n);
 		return -EINVAL;
 	}
+	if (!has_conns_min) {
+		conns_min = conns_n;
+	} else if ((conns_min < 1) || (conns_min > conns_n)) {
+		T_ERR_NL("Out of range of [1..%d]: 'conns_min=%d'\n",
+			 conns_n, conns_min);
+		return -EINVAL;
+	}
+	if ((conns_spare < 0) || (conns_spare >= conns_n)) {
+		T_ERR_NL("Out of range of [0..%d]: 'conns_spare=%d'\n",
+			 conns_n - 1, conns_spare);
+		return -EINVAL;
+	}
 	/* Default weight is set only for static ratio scheduler. */
 	if (has_weight && ((weight < TFW_CFG_SRV_WEIGHT_MIN)
 			   || (weight > TFW_CFG_SRV_WEIGHT_MAX)))
@@ -1383,6 +2010,8 @@ tfw_cfgop_server(TfwCfgSpec *cs, TfwCfgEntry *ce, TfwCfgSrvGroup *sg_cfg)
 	srv->cleanup = tfw_sock_srv_del_conns;
 	srv->weight = weight;
 	srv->conn_n = conns_n;
+	srv->conn_min = conns_min;
+	srv->conn_spare = conns_spare;
 	tfw_sg_add_srv(sg_cfg->parsed_sg, srv);
 	tfw_cfgop_server_orig_lookup(sg_cfg, srv);
 
@@ -1560,7 +2189,9 @@ tfw_cfgop_sched_changed(TfwCfgSrvGroup *sg_cfg)
 		return true;
 
 	if (sg_cfg->sched_flags !=
-	    (sg_cfg->orig_sg->flags & TFW_SG_M_SCHED_RATIO_TYPE))
+	    (sg_cfg->orig_sg->flags
+	     & (TFW_SG_M_SCHED_RATIO_TYPE | TFW_SG_M_PSTATS_IDX
+		| TFW_SG_F_SCHED_HASH_BOUNDED)))
 		return true;
 
 	/* TODO: check scheduler argument (not supported yet). */
@@ -1579,7 +2210,8 @@ tfw_cfgop_setup_srv_group(TfwCfgSrvGroup *sg_cfg)
 		sg_cfg->reconf_flags |= TFW_CFG_MDF_SG_SRV;
 	}
 
-	sg->flags = sg_cfg->nip_flags | sg_cfg->sched_flags;
+	sg->flags = sg_cfg->nip_flags | sg_cfg->aff_flags | sg_cfg->ss_flags
+		    | sg_cfg->sched_flags;
 	/*
 	 * Check 'ratio' scheduler configuration for incompatibilities.
 	 * Set weight to default value for each server in the group
@@ -1624,30 +2256,34 @@ tfw_cfgop_finish_srv_group(TfwCfgSpec *cs)
 	return 0;
 }
 
+/**
+ * Parse the type of APM response time value starting from @ce->vals[@vi]:
+ * "minimum", "maximum", "average" or "percentile [<NN>]".
+ */
 static int
-tfw_cfg_handle_ratio_predyn_opts(TfwCfgEntry *ce, unsigned int *arg_flags)
+tfw_cfg_handle_pstats_opts(TfwCfgEntry *ce, size_t vi, unsigned int *arg_flags)
 {
 	unsigned int idx, value, flags = *arg_flags;
 
-	if (ce->val_n < 3) {
+	if (ce->val_n <= vi) {
 		/* Default dynamic type. */
 		flags |= TFW_PSTATS_IDX_AVG;
 		goto done;
 	}
-	if (!strcasecmp(ce->vals[2], "minimum")) {
+	if (!strcasecmp(ce->vals[vi], "minimum")) {
 		idx = TFW_PSTATS_IDX_MIN;
-	}else if (!strcasecmp(ce->vals[2], "maximum")) {
+	}else if (!strcasecmp(ce->vals[vi], "maximum")) {
 		idx = TFW_PSTATS_IDX_MAX;
-	} else if (!strcasecmp(ce->vals[2], "average")) {
+	} else if (!strcasecmp(ce->vals[vi], "average")) {
 		idx = TFW_PSTATS_IDX_AVG;
-	} else if (!strcasecmp(ce->vals[2], "percentile")) {
-		if (ce->val_n < 4) {
+	} else if (!strcasecmp(ce->vals[vi], "percentile")) {
+		if (ce->val_n <= vi + 1) {
 			/* Default percentile. */
 			flags |= TFW_PSTATS_IDX_P90;
 			goto done;
 		}
-		if (tfw_cfg_parse_int(ce->vals[3], &value)) {
-			T_ERR_NL("Invalid value: '%s'\n", ce->vals[3]);
+		if (tfw_cfg_parse_int(ce->vals[vi + 1], &value)) {
+			T_ERR_NL("Invalid value: '%s'\n", ce->vals[vi + 1]);
 			return -EINVAL;
 		}
 		for (idx = 0; idx < ARRAY_SIZE(tfw_pstats_ith); ++idx) {
@@ -1657,11 +2293,11 @@ tfw_cfg_handle_ratio_predyn_opts(TfwCfgEntry *ce, unsigned int *arg_flags)
 				break;
 		}
 		if (idx == ARRAY_SIZE(tfw_pstats_ith)) {
-			T_ERR_NL("Invalid value: '%s'\n", ce->vals[3]);
+			T_ERR_NL("Invalid value: '%s'\n", ce->vals[vi + 1]);
 			return -EINVAL;
 		}
 	} else {
-		T_ERR_NL("Unsupported argument: '%s'\n", ce->vals[2]);
+		T_ERR_NL("Unsupported argument: '%s'\n", ce->vals[vi]);
 		return -EINVAL;
 	}
 	flags |= idx;
@@ -1686,7 +2322,7 @@ tfw_cfg_handle_ratio_predict(TfwCfgEntry *ce,
 	bool has_past = false, has_rate = false, has_ahead = false;
 	TfwSchrefPredict arg = { 0 };
 
-	if ((ret = tfw_cfg_handle_ratio_predyn_opts(ce, arg_flags)))
+	if ((ret = tfw_cfg_handle_pstats_opts(ce, 2, arg_flags)))
 		return ret;
 
 	TFW_CFG_ENTRY_FOR_EACH_ATTR(ce, i, key, val) {
@@ -1756,7 +2392,7 @@ tfw_cfg_handle_ratio_dynamic(TfwCfgEntry *ce, unsigned int *arg_flags)
 		return -EINVAL;
 	}
 
-	return tfw_cfg_handle_ratio_predyn_opts(ce, arg_flags);
+	return tfw_cfg_handle_pstats_opts(ce, 2, arg_flags);
 }
 
 static int
@@ -1787,6 +2423,42 @@ tfw_cfg_handle_ratio(TfwCfgEntry *ce, void *scharg, unsigned int *sched_flags)
 	return 0;
 }
 
+static int
+tfw_cfg_handle_p2c(TfwCfgEntry *ce, unsigned int *sched_flags)
+{
+	int ret;
+	unsigned int flags = 0;
+
+	if (ce->attr_n) {
+		T_ERR_NL("Arguments may not have the '=' sign\n");
+		return -EINVAL;
+	}
+	if ((ret = tfw_cfg_handle_pstats_opts(ce, 1, &flags)))
+		return ret;
+
+	*sched_flags = flags;
+	return 0;
+}
+
+static int
+tfw_cfg_handle_hash(TfwCfgEntry *ce, unsigned int *sched_flags)
+{
+	if (ce->attr_n) {
+		T_ERR_NL("Arguments may not have the '=' sign\n");
+		return -EINVAL;
+	}
+	if (ce->val_n < 2) {
+		*sched_flags = 0;
+	} else if (ce->val_n == 2 && !strcasecmp(ce->vals[1], "bounded")) {
+		*sched_flags = TFW_SG_F_SCHED_HASH_BOUNDED;
+	} else {
+		T_ERR_NL("Unsupported argument: '%s'\n", ce->vals[1]);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
 /*
  * Common code to handle 'sched' directive.
  */
@@ -1809,6 +2481,12 @@ tfw_cfgop_sched(TfwCfgSpec *cs, TfwCfgEntry *ce, TfwScheduler **sched_val,
 	if (!strcasecmp(sched->name, "ratio"))
 		if (tfw_cfg_handle_ratio(ce, scharg, sched_flags))
 			return -EINVAL;
+	if (!strcasecmp(sched->name, "p2c"))
+		if (tfw_cfg_handle_p2c(ce, sched_flags))
+			return -EINVAL;
+	if (!strcasecmp(sched->name, "hash"))
+		if (tfw_cfg_handle_hash(ce, sched_flags))
+			return -EINVAL;
 
 	*sched_val = sched;
 
@@ -1983,6 +2661,8 @@ tfw_sock_srv_cfgend(void)
 				    tfw_cfg_sg_opts->sched_arg);
 	tfw_cfg_sg_def->parsed_sg->sched = tfw_cfg_sg_opts->parsed_sg->sched;
 	tfw_cfg_sg_def->nip_flags = tfw_cfg_sg_opts->nip_flags;
+	tfw_cfg_sg_def->aff_flags = tfw_cfg_sg_opts->aff_flags;
+	tfw_cfg_sg_def->ss_flags = tfw_cfg_sg_opts->ss_flags;
 	tfw_cfg_sg_def->sched_flags = tfw_cfg_sg_opts->sched_flags;
 
 	if ((r = tfw_cfgop_setup_srv_group(tfw_cfg_sg_def)))
@@ -2005,6 +2685,8 @@ tfw_cfgop_update_srv(TfwServer *orig_srv, TfwCfgSrvGroup *sg_cfg)
 
 	orig_srv->weight = srv->weight;
 
+	/* The pool timer walks over the connections list. */
+	tfw_sock_srv_pool_stop(orig_srv);
 	if (orig_srv->conn_n < srv->conn_n) {
 		r = tfw_sock_srv_append_conns_n(orig_srv,
 						srv->conn_n - orig_srv->conn_n);
@@ -2019,6 +2701,9 @@ tfw_cfgop_update_srv(TfwServer *orig_srv, TfwCfgSrvGroup *sg_cfg)
 		 * now.
 		 */
 	}
+	orig_srv->conn_min = min(srv->conn_min, orig_srv->conn_n);
+	orig_srv->conn_spare = min(srv->conn_spare, orig_srv->conn_n - 1);
+	tfw_sock_srv_pool_start(orig_srv);
 	tfw_server_put(srv);
 
 	return 0;
@@ -2078,6 +2763,8 @@ tfw_cfgop_update_sg_srv_list(TfwCfgSrvGroup *sg_cfg)
 		tfw_sg_add_srv(sg_cfg->orig_sg, srv);
 		tfw_sg_put(sg_cfg->parsed_sg);
 		tfw_server_put(srv);
+		/* Don't put the full load to the new server at once. */
+		tfw_srv_slow_start(srv);
 
 		if ((r = tfw_sock_srv_start_srv(NULL, srv, sg_cfg->hm_arg))) {
 			T_ERR_NL("cannot establish new server connection\n");
@@ -2260,6 +2947,50 @@ static TfwCfgSpec tfw_srv_group_specs[] = {
 		.allow_repeat = false,
 		.allow_reconfig = true,
 	},
+	{
+		.name = "server_retry_budget",
+		.deflt = "0",
+		.handler = tfw_cfgop_in_retry_budget,
+		.spec_ext = &(TfwCfgSpecInt) {
+			.range = { 0, 100 },
+		},
+		.allow_none = true,
+		.allow_repeat = false,
+		.allow_reconfig = true,
+	},
+	{
+		.name = "server_mirror_rate",
+		.deflt = "0",
+		.handler = tfw_cfgop_in_mirror_rate,
+		.spec_ext = &(TfwCfgSpecInt) {
+			.range = { 0, INT_MAX },
+		},
+		.allow_none = true,
+		.allow_repeat = false,
+		.allow_reconfig = true,
+	},
+	{
+		.name = "server_mirror_concurrency",
+		.deflt = "100",
+		.handler = tfw_cfgop_in_mirror_conc,
+		.spec_ext = &(TfwCfgSpecInt) {
+			.range = { 0, INT_MAX },
+		},
+		.allow_none = true,
+		.allow_repeat = false,
+		.allow_reconfig = true,
+	},
+	{
+		.name = "server_concurrency_limit",
+		.deflt = "0",
+		.handler = tfw_cfgop_in_conc_max,
+		.spec_ext = &(TfwCfgSpecInt) {
+			.range = { 0, INT_MAX },
+		},
+		.allow_none = true,
+		.allow_repeat = false,
+		.allow_reconfig = true,
+	},
 	{
 		.name = "server_retry_nonidempotent",
 		.deflt = TFW_CFG_DFLT_VAL,
@@ -2268,6 +2999,14 @@ static TfwCfgSpec tfw_srv_group_specs[] = {
 		.allow_repeat = false,
 		.allow_reconfig = true,
 	},
+	{
+		.name = "server_cpu_affinity",
+		.deflt = TFW_CFG_DFLT_VAL,
+		.handler = tfw_cfgop_in_cpu_affinity,
+		.allow_none = true,
+		.allow_repeat = false,
+		.allow_reconfig = true,
+	},
 	{
 		.name = "server_connect_retries",
 		.deflt = "10",
@@ -2279,6 +3018,14 @@ static TfwCfgSpec tfw_srv_group_specs[] = {
 		.allow_repeat = false,
 		.allow_reconfig = true,
 	},
+	{
+		.name = "server_slow_start",
+		.deflt = "0",
+		.handler = tfw_cfgop_in_slow_start,
+		.allow_none = true,
+		.allow_repeat = false,
+		.allow_reconfig = true,
+	},
 	{
 		.name = "health",
 		.deflt = NULL,
@@ -2345,6 +3092,54 @@ static TfwCfgSpec tfw_sock_srv_specs[] = {
 		.allow_repeat = false,
 		.allow_reconfig = true,
 	},
+	{
+		.name = "server_retry_budget",
+		.deflt = "0",
+		.handler = tfw_cfgop_out_retry_budget,
+		.cleanup = tfw_cfgop_cleanup_srv_groups,
+		.spec_ext = &(TfwCfgSpecInt) {
+			.range = { 0, 100 },
+		},
+		.allow_none = true,
+		.allow_repeat = false,
+		.allow_reconfig = true,
+	},
+	{
+		.name = "server_mirror_rate",
+		.deflt = "0",
+		.handler = tfw_cfgop_out_mirror_rate,
+		.cleanup = tfw_cfgop_cleanup_srv_groups,
+		.spec_ext = &(TfwCfgSpecInt) {
+			.range = { 0, INT_MAX },
+		},
+		.allow_none = true,
+		.allow_repeat = false,
+		.allow_reconfig = true,
+	},
+	{
+		.name = "server_mirror_concurrency",
+		.deflt = "100",
+		.handler = tfw_cfgop_out_mirror_conc,
+		.cleanup = tfw_cfgop_cleanup_srv_groups,
+		.spec_ext = &(TfwCfgSpecInt) {
+			.range = { 0, INT_MAX },
+		},
+		.allow_none = true,
+		.allow_repeat = false,
+		.allow_reconfig = true,
+	},
+	{
+		.name = "server_concurrency_limit",
+		.deflt = "0",
+		.handler = tfw_cfgop_out_conc_max,
+		.cleanup = tfw_cfgop_cleanup_srv_groups,
+		.spec_ext = &(TfwCfgSpecInt) {
+			.range = { 0, INT_MAX },
+		},
+		.allow_none = true,
+		.allow_repeat = false,
+		.allow_reconfig = true,
+	},
 	{
 		.name = "server_retry_nonidempotent",
 		.deflt = TFW_CFG_DFLT_VAL,
@@ -2354,6 +3149,15 @@ static TfwCfgSpec tfw_sock_srv_specs[] = {
 		.allow_repeat = false,
 		.allow_reconfig = true,
 	},
+	{
+		.name = "server_cpu_affinity",
+		.deflt = TFW_CFG_DFLT_VAL,
+		.handler = tfw_cfgop_out_cpu_affinity,
+		.cleanup = tfw_cfgop_cleanup_srv_groups,
+		.allow_none = true,
+		.allow_repeat = false,
+		.allow_reconfig = true,
+	},
 	{
 		.name = "server_connect_retries",
 		.deflt = "10",
@@ -2366,6 +3170,15 @@ static TfwCfgSpec tfw_sock_srv_specs[] = {
 		.allow_repeat = false,
 		.allow_reconfig = true,
 	},
+	{
+		.name = "server_slow_start",
+		.deflt = "0",
+		.handler = tfw_cfgop_out_slow_start,
+		.cleanup = tfw_cfgop_cleanup_srv_groups,
+		.allow_none = true,
+		.allow_repeat = false,
+		.allow_reconfig = true,
+	},
 	{
 		.name = "health",
 		.deflt = NULL,
@@ -2426,10 +3239,16 @@ tfw_sock_srv_init(void)
 	BUG_ON(tfw_srv_conn_cache);
 
 	tfw_srv_conn_cache = kmem_cache_create("tfw_srv_conn_cache",
-					       sizeof(TfwSrvConn), 0, 0, NULL);
+					       sizeof(TfwSrvConn), 0,
+					       SLAB_HWCACHE_ALIGN, NULL);
 	if (!tfw_srv_conn_cache)
 		return -ENOMEM;
 
+	tfw_tun_conn_cache = kmem_cache_create("tfw_tun_conn_cache",
+					       sizeof(TfwTunConn), 0, 0, NULL);
+	if (!tfw_tun_conn_cache)
+		return -ENOMEM;
+
 	tfw_sg_cfg_cache = kmem_cache_create("tfw_sg_cfg_cache",
 					     sizeof(TfwCfgSrvGroup), 0, 0, NULL);
 	if (!tfw_sg_cfg_cache)
@@ -2445,5 +3264,6 @@ tfw_sock_srv_exit(void)
 {
 	tfw_mod_unregister(&tfw_sock_srv_mod);
 	kmem_cache_destroy(tfw_srv_conn_cache);
+	kmem_cache_destroy(tfw_tun_conn_cache);
 	kmem_cache_destroy(tfw_sg_cfg_cache);
 }
@@ -62,6 +62,112 @@ ss_skb_fmt_src_addr(const struct sk_buff *skb, char *out_buf)
 	return tfw_addr_fmt(&addr, TFW_NO_PORT, out_buf);
 }
 
+/*
+ * Per-CPU pool of recycled pages for skb data.
+ *
+ * The pool keeps a reference to each page it hands out, so the page isn't
+ * returned to the page allocator when the skb using it is freed after the
+ * transmission. A page referenced only by the pool is free and is reused for
+ * a new skb, so under steady traffic the pages circulate between the pool
+ * and the skbs without the page allocator. The pages are allocated at the
+ * local NUMA node. Pages still in flight are rotated to the pool tail, so
+ * a long-lived page, e.g. one sent to a slow client, doesn't block the reuse
+ * of the others. The pool doesn't track more than SS_PGPOOL_SZ pages per CPU,
+ * the rest of the pages are released to the page allocator as usual.
+ */
+#define SS_PGPOOL_SZ		256
+/* Number of the oldest pages checked for reuse per allocation. */
+#define SS_PGPOOL_SCAN		4
+
+/**
+ * @head	- index of the oldest page;
+ * @n		- number of pages in the pool;
+ * @pages	- the pages ring;
+ */
+typedef struct {
+	unsigned int	head;
+	unsigned int	n;
+	struct page	*pages[SS_PGPOOL_SZ];
+} SsPagePool;
+
+static DEFINE_PER_CPU(SsPagePool, ss_pgpool);
+
+static inline struct page *
+ss_pgpool_pop(SsPagePool *pp)
+{
+	struct page *page = pp->pages[pp->head];
+
+	pp->head = (pp->head + 1) % SS_PGPOOL_SZ;
+	pp->n--;
+
+	return page;
+}
+
+static inline void
+ss_pgpool_push(SsPagePool *pp, struct page *page)
+{
+	pp->pages[(pp->head + pp->n) % SS_PGPOOL_SZ] = page;
+	pp->n++;
+}
+
+/**
+ * Allocate a page for skb data. The page is released by put_page() as usual.
+ * Can be called in softirq as well as in process context.
+ */
+struct page *
+ss_skb_page_alloc(void)
+{
+	int i;
+	SsPagePool *pp;
+	struct page *page;
+
+	local_bh_disable();
+	pp = this_cpu_ptr(&ss_pgpool);
+
+	for (i = 0; i < SS_PGPOOL_SCAN && pp->n; ++i) {
+		page = ss_pgpool_pop(pp);
+		ss_pgpool_push(pp, page);
+		/*
+		 * Nobody else references the page, so nobody can get a new
+		 * reference to it concurrently.
+		 */
+		if (page_ref_count(page) == 1) {
+			get_page(page);
+			local_bh_enable();
+			TFW_INC_STAT_BH(ss.pgpool_hits);
+			return page;
+		}
+	}
+
+	page = alloc_page(GFP_ATOMIC);
+	if (page && pp->n < SS_PGPOOL_SZ) {
+		get_page(page);
+		ss_pgpool_push(pp, page);
+	}
+	local_bh_enable();
+	TFW_INC_STAT_BH(ss.pgpool_misses);
+
+	return page;
+}
+
+/**
+ * Release the pool references to the pages. The pages in flight are freed
+ * when the skbs using them are freed.
+ */
+void
+ss_skb_pgpool_release(void)
+{
+	int cpu;
+	SsPagePool *pp;
+
+	for_each_possible_cpu(cpu) {
+		pp = per_cpu_ptr(&ss_pgpool, cpu);
+		while (pp->n)
+			put_page(ss_pgpool_pop(pp));
+		pp->head = 0;
+	}
+}
+
 /**
  * Allocate a new skb that can hold @len bytes of data.
  *
@@ -88,7 +194,7 @@ ss_skb_alloc_pages(size_t len)
 		return NULL;
 
 	for (i = 0; i < nr_frags; ++i) {
-		struct page *page = alloc_page(GFP_ATOMIC);
+		struct page *page = ss_skb_page_alloc();
 		if (!page) {
 			kfree_skb(skb);
 			return NULL;
@@ -388,7 +494,7 @@ __new_pgfrag(struct sk_buff *skb_head, struct sk_buff *skb, int size,
 		off = frag.page_offset;
 		get_page(page);
 	} else {
-		page = alloc_page(GFP_ATOMIC);
+		page = ss_skb_page_alloc();
 		if (!page)
 			return -ENOMEM;
 	}
@@ -1079,31 +1185,38 @@ skb_next_data(struct sk_buff *skb, char *last_ptr, TfwStr *it)
  * it returns, thus allowing an upper layer to process a full message
  * or an error code.
  *
+ * The processing starts at offset @off, so a layer consuming several
+ * messages of one skb, e.g. TLS records or HTTP/2 frames, can handle the
+ * next message in place instead of splitting the skb at the boundary.
+ *
  * @return SS_OK, SS_DROP, SS_POSTPONE, or a negative value of error code.
  * @processed and @chunks are incremented by number of effectively processed
  * bytes and contiguous data chunks correspondingly. A caller must properly
  * initialize them. @actor sees @chunks including current chunk of data.
  */
 int
-ss_skb_process(struct sk_buff *skb, ss_skb_actor_t actor, void *objdata,
-	       unsigned int *chunks, unsigned int *processed)
+ss_skb_process(struct sk_buff *skb, unsigned int off, ss_skb_actor_t actor,
+	       void *objdata, unsigned int *chunks, unsigned int *processed)
 {
 	int i, r = SS_OK;
 	int headlen = skb_headlen(skb);
-	unsigned int _processed;
+	unsigned int _processed, n;
 	struct skb_shared_info *si = skb_shinfo(skb);
 
-	if (WARN_ON_ONCE(skb->len == 0))
+	if (WARN_ON_ONCE(off >= skb->len))
 		return -EIO;
 
 	/* Process linear data. */
-	if (likely(headlen > 0)) {
+	if (likely(headlen > off)) {
 		++*chunks;
 		_processed = 0;
-		r = actor(objdata, skb->data, headlen, &_processed);
+		r = actor(objdata, skb->data + off, headlen - off, &_processed);
 		*processed += _processed;
 		if (r != SS_POSTPONE)
 			return r;
+		off = 0;
+	} else {
+		off -= headlen;
 	}
 
 	/*
@@ -1113,13 +1226,18 @@ ss_skb_process(struct sk_buff *skb, ss_skb_actor_t actor, void *objdata,
 	for (i = 0; i < si->nr_frags; ++i) {
 		const skb_frag_t *frag = &si->frags[i];
 
+		if (unlikely(off >= (n = skb_frag_size(frag)))) {
+			off -= n;
+			continue;
+		}
 		++*chunks;
 		_processed = 0;
-		r = actor(objdata, skb_frag_address(frag), skb_frag_size(frag),
+		r = actor(objdata, skb_frag_address(frag) + off, n - off,
 			  &_processed);
 		*processed += _processed;
 		if (r != SS_POSTPONE)
 			return r;
+		off = 0;
 	}
 
 	return r;
@@ -1196,6 +1314,9 @@ ss_skb_split(struct sk_buff *skb, int len)
 	 */
 	skb_split(skb, buff, len);
 	__copy_ip_header(buff, skb);
+	/* Only the tail part ends a message. */
+	buff->tls_msg_end = skb->tls_msg_end;
+	skb->tls_msg_end = 0;
 
 	return buff;
 }
@@ -1502,97 +1623,3 @@ ss_skb_to_sgvec_with_new_pages(struct sk_buff *skb, struct scatterlist *sgl,
 
 	return out_frags;
 }
-
-/**
- * Evict extra data between @curr and @stop pointers, beginning from the @skb
- * and the @frag_num fragment.
- */
-int
-ss_skb_cut_extra_data(struct sk_buff *skb_head, struct sk_buff *skb,
-		      int frag_num, char *curr, const char *stop)
-{
-	TfwStr it;
-	long offset;
-	int size, ret;
-	const char *addr;
-
-	if (frag_num >= 0) {
-		skb_frag_t *frag = &skb_shinfo(skb)->frags[frag_num];
-
-		size = skb_frag_size(frag);
-		addr = skb_frag_address(frag);
-	} else {
-		size = skb_headlen(skb);
-		addr = skb->data;
-	}
-
-	offset = curr - addr;
-
-	for (;;) {
-		int len, tail = 0;
-		long stop_offset = stop - addr;
-
-		if (WARN_ON_ONCE(offset < 0 || offset >= size))
-			return -EINVAL;
-
-		len = size - offset;
-
-		/*
-		 * We found the stop pointer; evict the delta between @curr and
-		 * @stop, and exit.
-		 */
-		if (stop_offset >= 0 && stop_offset <= size) {
-			if (WARN_ON_ONCE(curr > stop))
-				return -EINVAL;
-
-			if (curr == stop)
-				return 0;
-
-			tail = len;
-			len -= size - stop_offset;
-		}
-
-		T_DBG3("%s: frag_num=%d, size=%d, offset=%ld, stop_offset=%ld,"
-		       " len=%d, tail=%d\n", __func__, frag_num, size, offset,
-		       stop_offset, len, tail);
-
-		if (frag_num >= 0)
-			ret = __split_pgfrag_del(skb_head, skb, frag_num,
-						 offset, len, &it);
-		else
-			ret =  __split_linear_data(skb_head, skb, curr, -len,
-						   &it);
-		if (unlikely(ret))
-			return ret;
-
-		if (tail)
-			return 0;
-
-		/*
-		 * The extra space is evicted from current fragment (or from skb
-		 * head space), but the stop pointer is not reached yet. Move to
-		 * the next fragment (or skb).
-		 */
-		if (skb_shinfo(skb)->nr_frags > frag_num + 1) {
-			skb_frag_t *frag;
-
-			++frag_num;
-			frag = &skb_shinfo(skb)->frags[frag_num];
-			size = skb_frag_size(frag);
-			addr = curr = skb_frag_address(frag);
-		}
-		else {
-			if (WARN_ON_ONCE(skb_head == skb->next))
-				return -EINVAL;
-
-			frag_num = -1;
-			skb = skb->next;
-			size = skb_headlen(skb);
-			addr = curr = skb->data;
-		}
-
-		offset = 0;
-	}
-
-	return 0;
-}
@@ -205,6 +205,9 @@ ss_skb_alloc(size_t n)
 
 char *ss_skb_fmt_src_addr(const struct sk_buff *skb, char *out_buf);
 
+struct page *ss_skb_page_alloc(void);
+void ss_skb_pgpool_release(void);
+
 int ss_skb_alloc_data(struct sk_buff **skb_head, size_t len,
 		      unsigned int tx_flags);
 struct sk_buff *ss_skb_split(struct sk_buff *skb, int len);
@@ -220,15 +223,13 @@ int ss_skb_cutoff_data(struct sk_buff *skb_head, const TfwStr *hdr,
 		       int skip, int tail);
 int skb_next_data(struct sk_buff *skb, char *last_ptr, TfwStr *it);
 
-int ss_skb_process(struct sk_buff *skb, ss_skb_actor_t actor, void *objdata,
-		   unsigned int *chunks, unsigned int *processed);
+int ss_skb_process(struct sk_buff *skb, unsigned int off, ss_skb_actor_t actor,
+		   void *objdata, unsigned int *chunks, unsigned int *processed);
 
 int ss_skb_unroll(struct sk_buff **skb_head, struct sk_buff *skb);
 void ss_skb_init_for_xmit(struct sk_buff *skb);
 void ss_skb_dump(struct sk_buff *skb);
 int ss_skb_to_sgvec_with_new_pages(struct sk_buff *skb, struct scatterlist *sgl,
                                    struct page ***old_pages);
-int ss_skb_cut_extra_data(struct sk_buff *skb_head, struct sk_buff *skb,
-			  int frag_num, char *curr, const char *stop);
 
 #endif /* __TFW_SS_SKB_H__ */
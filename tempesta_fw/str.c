@@ -26,6 +26,7 @@
 #include <linux/kernel.h>
 #include <linux/ctype.h>
 #include <linux/crc32.h>
+#include <linux/log2.h>
 
 #include "lib/str.h"
 #include "htype.h"
@@ -327,6 +328,50 @@ static const unsigned char cookie[] = {
 	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
 };
 
+/*
+ * ASCII codes to accept host names in Host header and URI authority.
+ */
+static const unsigned char host[] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 0,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0,
+	0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0,
+	0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+};
+
+/*
+ * ASCII codes to accept hexadecimal digits of chunk sizes.
+ */
+static const unsigned char xdigit[] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0,
+	0, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+};
+
 static size_t
 __tfw_match_slow(const char *str, size_t len, const unsigned char *tbl)
 {
@@ -369,6 +414,23 @@ TFW_MATCH(ctext_vchar);
 TFW_MATCH(xff);
 TFW_MATCH(cookie);
 
+/*
+ * Host names and chunk sizes aren't configurable by custom alphabets.
+ */
+size_t
+tfw_match_host(const char *str, size_t len)
+{
+	return __tfw_match_slow(str, len, host);
+}
+EXPORT_SYMBOL(tfw_match_host);
+
+size_t
+tfw_match_xdigit(const char *str, size_t len)
+{
+	return __tfw_match_slow(str, len, xdigit);
+}
+EXPORT_SYMBOL(tfw_match_xdigit);
+
 TFW_INIT_CUSTOM_A(uri);
 TFW_INIT_CUSTOM_A(token);
 TFW_INIT_CUSTOM_A(qetoken);
@@ -558,37 +620,50 @@ void tfw_str_collect_cmp(TfwStr *chunk, TfwStr *end, TfwStr *out,
  * TFW_STR_DUPLICATE - grow as duplicate string
  * @return pointer to the first of newly added chunk.
  *
- * TODO do we need exponential growing?
+ * The chunks array grows geometrically: its capacity is rounded up to a power
+ * of two, so strings fragmented over many skbs don't copy the array on each
+ * new chunk if the array isn't at the pool tail. tfw_pool_realloc() still
+ * extends the array in place if it's the last pool allocation.
  */
 static TfwStr *
 __str_grow_tree(TfwPool *pool, TfwStr *str, unsigned int flag, int n)
 {
 	if (str->flags & flag ||
 	    (!flag && str->nchunks)) {
-		unsigned int l;
+		unsigned int cap = str->nchunks;
 		void *p;
 
-		if (unlikely(str->nchunks >= __TFW_STR_CN_MAX)) {
+		if (unlikely(str->nchunks >= __TFW_STR_CN_MAX - n)) {
 			T_WARN("Reaching chunks hard limit\n");
 			return NULL;
 		}
 
-		l = str->nchunks * sizeof(TfwStr);
-		p = tfw_pool_realloc(pool, str->data, l,
-				     l + n * sizeof(TfwStr));
+		if (str->flags & TFW_STR_CN_RESERVE) {
+			cap = roundup_pow_of_two(cap);
+			if (str->nchunks + n <= cap) {
+				str->nchunks += n;
+				goto done;
+			}
+		}
+		p = tfw_pool_realloc(pool, str->data, cap * sizeof(TfwStr),
+				     roundup_pow_of_two(str->nchunks + n)
+				     * sizeof(TfwStr));
 		if (!p)
 			return NULL;
 		str->data = p;
 		str->nchunks += n;
 	}
 	else {
-		TfwStr *a = tfw_pool_alloc(pool, (n + 1) * sizeof(TfwStr));
+		TfwStr *a = tfw_pool_alloc(pool, roundup_pow_of_two(n + 1)
+						 * sizeof(TfwStr));
 		if (!a)
 			return NULL;
 		a[0] = *str;
 		str->chunks = a;
 		str->nchunks = n + 1;
 	}
+	str->flags |= TFW_STR_CN_RESERVE;
+done:
 
 	str = str->chunks + str->nchunks - n;
 	bzero_fast(str, sizeof(TfwStr) * n);
@@ -641,10 +716,14 @@ tfw_strcpy(TfwStr *dst, const TfwStr *src)
 	if (unlikely(src->len > dst->len))
 		return -E2BIG;
 
+	/* Most of header values are plain, so handle them first. */
+	if (likely(mode == 3)) {
+		memcpy_fast(dst->data, src->data, src->len);
+		dst->len = src->len;
+		return 0;
+	}
+
 	switch (mode) {
-	case 3: /* The both are plain. */
-		memcpy_fast(dst->data, src->data, min(src->len, dst->len));
-		break;
 	case 1: /* @src is compound, @dst is plain. */
 		n1 = src->nchunks;
 		end = src->chunks + n1;
@@ -725,6 +804,7 @@ tfw_strdup(TfwPool *pool, const TfwStr *src)
 
 	*dst = *src;
 	dst->chunks = dst + 1;
+	dst->flags &= ~TFW_STR_CN_RESERVE;
 	data = (char *)(TFW_STR_LAST(dst) + 1);
 
 	d_c = TFW_STR_CHUNK(dst, 0);
@@ -764,7 +844,8 @@ tfw_strcpy_desc(TfwStr *dst, TfwStr *src)
 	if (dst_num) {
 		/* The src and dst are compound. */
 		dst->len = src->len;
-		dst->flags = src->flags;
+		dst->flags = (src->flags & ~TFW_STR_CN_RESERVE)
+			     | (dst->flags & TFW_STR_CN_RESERVE);
 	}
 
 	return 0;
@@ -871,9 +952,16 @@ __tfw_strcmp(const TfwStr *s1, const TfwStr *s2, int cs)
 	if (unlikely(!s1->len || !s2->len))
 		goto out;
 
+	n = min(s1->len, s2->len);
+	if (likely(TFW_STR_PLAIN2(s1, s2))) {
+		int r = (*cmp)(s1->data, s2->data, n);
+		if (r)
+			return r;
+		goto out;
+	}
+
 	i1 = i2 = 0;
 	off1 = off2 = 0;
-	n = min(s1->len, s2->len);
 	c1 = TFW_STR_CHUNK(s1, 0);
 	c2 = TFW_STR_CHUNK(s2, 0);
 	while (n) {
@@ -1035,6 +1123,13 @@ tfw_str_eq_cstr(const TfwStr *str, const char *cstr, int cstr_len,
 			       : (typeof(&strncmp))memcmp_fast;
 
 	BUG_ON(str->len && !str->data);
+	if (likely(TFW_STR_PLAIN(str))) {
+		if (str->len < clen
+		    || (str->len > clen && !(flags & TFW_STR_EQ_PREFIX)))
+			return false;
+		return !cmp(cstr, str->data, clen);
+	}
+
 	TFW_STR_FOR_EACH_CHUNK(chunk, str, end) {
 		BUG_ON(chunk->len &&  !chunk->data);
 
@@ -97,6 +97,8 @@ size_t tfw_match_nctl(const char *s, size_t len);
 size_t tfw_match_ctext_vchar(const char *s, size_t len);
 size_t tfw_match_xff(const char *s, size_t len);
 size_t tfw_match_cookie(const char *s, size_t len);
+size_t tfw_match_host(const char *s, size_t len);
+size_t tfw_match_xdigit(const char *s, size_t len);
 
 void tfw_init_custom_uri(const unsigned char *a);
 void tfw_init_custom_token(const unsigned char *a);
@@ -217,6 +219,13 @@ size_t tfw_ultohex(unsigned long ai, char *buf, unsigned int len);
 
 /* The chunk contains only WS characters. */
 #define TFW_STR_OWS		0x100
+/*
+ * The chunks array of the compound or duplicate string has room for
+ * roundup_pow_of_two(@nchunks) chunks, see __str_grow_tree(). The flag
+ * describes the array, so it must not be copied to a string with another
+ * array.
+ */
+#define TFW_STR_CN_RESERVE	0x200
 
 /*
  * @ptr		- pointer to string data or array of nested strings;
@@ -260,6 +269,8 @@ typedef struct tfwstr_t {
 
 #define TFW_STR_EMPTY(s)	(!((s)->nchunks | (s)->len))
 #define TFW_STR_PLAIN(s)	(!((s)->nchunks))
+/* Both the strings are plain, single branch for the common fast paths. */
+#define TFW_STR_PLAIN2(s1, s2)	(!((s1)->nchunks | (s2)->nchunks))
 #define TFW_STR_DUP(s)		((s)->flags & TFW_STR_DUPLICATE)
 
 /* Get @c'th chunk of @s. */
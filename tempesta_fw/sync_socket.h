@@ -51,6 +51,11 @@ enum {
 	 * only for client connections).
 	 */
 	Conn_Stop		= 0x1 << __Flag_Bits,
+	/*
+	 * Ingress data isn't read from the connection socket until the
+	 * flag is cleared, see ss_rx_pause().
+	 */
+	Conn_RxPause		= 0x2 << __Flag_Bits,
 };
 
 /* Table of Synchronous Sockets connection callbacks. */
@@ -70,7 +75,11 @@ typedef struct ss_hooks {
 	 */
 	void (*connection_drop)(struct sock *sk);
 
-	/* Process data received on the socket. */
+	/*
+	 * Process data received on the socket. The socket layer passes all
+	 * the skbs read from the socket at once as a list linked by
+	 * ss_skb_queue_tail(). The callee owns the skbs.
+	 */
 	int (*connection_recv)(void *conn, struct sk_buff *skb);
 } SsHooks;
 
@@ -79,10 +88,12 @@ typedef struct ss_hooks {
  *
  * @rb_wq_sz	- number of items in ring-buffer work queue;
  * @backlog_sz	- size of backlog;
+ * @rb_wq_contended - number of lost pushes races to the work queue;
  */
 typedef struct {
 	unsigned int	rb_wq_sz;
 	unsigned int	backlog_sz;
+	unsigned long	rb_wq_contended;
 } SsStat;
 
 static inline void
@@ -125,6 +136,8 @@ void ss_set_callbacks(struct sock *sk);
 void ss_set_listen(struct sock *sk);
 int ss_send(struct sock *sk, struct sk_buff **skb_head, int flags);
 int ss_close(struct sock *sk, int flags);
+void ss_rx_pause(struct sock *sk);
+int ss_rx_resume(struct sock *sk);
 int ss_sock_create(int family, int type, int protocol, struct sock **res);
 void ss_release(struct sock *sk);
 int ss_connect(struct sock *sk, const TfwAddr *addr, int flags);
@@ -137,6 +150,9 @@ void ss_start(void);
 void ss_stop(void);
 bool ss_active(void);
 void ss_get_stat(SsStat *stat);
+unsigned int ss_wq_backlog(void);
+int ss_busy_poll_start(const struct cpumask *cpus);
+void ss_busy_poll_stop(void);
 
 #define SS_CALL(f, ...)							\
 	(sk->sk_user_data && ((SsProto *)(sk)->sk_user_data)->hooks->f	\
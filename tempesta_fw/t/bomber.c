@@ -3,7 +3,7 @@
  *
  * Tempesta Bomber: a tool for HTTP servers stress testing.
  *
- * Copyright (C) 2015-2018 Tempesta Technologies, Inc.
+ * Copyright (C) 2015-2020 Tempesta Technologies, Inc.
  *
  * This program is free software; you can redistribute it and/or modify it
  * under the terms of the GNU General Public License as published by
@@ -19,9 +19,11 @@
  * this program; if not, write to the Free Software Foundation, Inc., 59
  * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
  */
+#include <linux/ctype.h>
 #include <linux/freezer.h>
 #include <linux/kernel.h>
 #include <linux/kthread.h>
+#include <linux/ktime.h>
 #include <linux/module.h>
 #include <linux/wait.h>
 #include <linux/vmalloc.h>
@@ -39,25 +41,34 @@ static int niters	= 2;
 static int nconns	= 2;
 static int nmessages	= 2;
 static int verbose	= 0;
+static bool latency	= false;
 static char *server	= "127.0.0.1:80";
+static char *uris[16];
+static int nuris	= 0;
 
 module_param_named(t, nthreads,  int, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
 module_param_named(i, niters,    int, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
 module_param_named(c, nconns,    int, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
 module_param_named(m, nmessages, int, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
 module_param_named(v, verbose,   int, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+module_param_named(l, latency,  bool, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
 module_param_named(s, server, charp, 0);
+module_param_array_named(u, uris, charp, &nuris, 0);
 
 MODULE_PARM_DESC(t, "Number of threads (set this to the number of CPU cores)");
 MODULE_PARM_DESC(i, "Number of thread iterations");
 MODULE_PARM_DESC(c, "Number of connections");
 MODULE_PARM_DESC(m, "Number of messages per connection");
 MODULE_PARM_DESC(v, "Verbosity level");
+MODULE_PARM_DESC(l, "Wait for each response and measure the latencies");
 MODULE_PARM_DESC(s, "Server host address and optional port number");
+MODULE_PARM_DESC(u, "Comma separated list of URIs with optional weights,"
+		    " e.g. /index.html:3,/img.png:1, to request instead of"
+		    " the fuzzer generated requests");
 
 MODULE_AUTHOR("Tempesta Technologies, Inc");
 MODULE_DESCRIPTION("Tempesta Bomber");
-MODULE_VERSION("0.2.3");
+MODULE_VERSION("0.3.0");
 MODULE_LICENSE("GPL");
 
 #ifdef TFW_BANNER
@@ -67,30 +78,80 @@ MODULE_LICENSE("GPL");
 
 #define BUF_SIZE		(20 * 1024 * 1024)
 #define DEAD_TRIES		HZ
+/* Bucket N counts latencies in [2^(N-1), 2^N) microseconds. */
+#define LAT_BUCKETS		32
 
 enum {
 	TFW_BMB_SK_INACTIVE,
 	TFW_BMB_SK_ACTIVE
 };
 
+enum {
+	TFW_BMB_RSP_HDR,
+	TFW_BMB_RSP_BODY
+};
+
 struct tfw_bmb_task_t;
 
+/*
+ * The least response parser to find the end of a response for the latency
+ * measurement. Only responses delimited by Content-Length or without a body
+ * are supported.
+ *
+ * @state		- TFW_BMB_RSP_* state of the parser;
+ * @line_len		- number of bytes in @line;
+ * @cl			- value of the Content-Length header;
+ * @body_left		- number of the body bytes to receive;
+ * @line		- the beginning of the current header line;
+ */
+typedef struct {
+	unsigned int		state;
+	unsigned int		line_len;
+	size_t			cl;
+	size_t			body_left;
+	char			line[32];
+} TfwBmbRsp;
+
 /*
  * Connection description.
+ *
+ * @ts			- time of the request sending in nanoseconds, zero if
+ *			  there is no request in flight;
+ * @rsp			- the response parser;
+ * @lat			- histogram of the response latencies;
  */
 typedef struct {
 	SsProto			proto;
 	struct sock 		*sk;
 	struct tfw_bmb_task_t	*task;
+	u64			ts;
+	TfwBmbRsp		rsp;
+	unsigned long		lat[LAT_BUCKETS];
 } TfwBmbConn;
 
+/*
+ * An URI of the request mix.
+ *
+ * @uri		- the URI;
+ * @len		- length of @uri without the weight;
+ * @weight	- relative frequency of the URI requests;
+ */
+typedef struct {
+	const char		*uri;
+	unsigned int		len;
+	unsigned int		weight;
+} TfwBmbUri;
+
 /*
  * Bomber task descriptor.
  *
  * @conn		- connection descriptions
  * @conn_compl		- number of complete connections
  * @conn_error		- number of error connections
- * @conn_wq		- wait queue on all connections establishing
+ * @conn_wq		- wait queue on all connections establishing and
+ *			  on responses receiving
+ * @rsp_compl		- number of received responses
+ * @uri_cnt		- number of the requests generated from the mix
  * @ctx			- context for fuzzer
  * @buf			- request buffer for fuzzer
  */
@@ -100,6 +161,8 @@ typedef struct tfw_bmb_task_t {
 	atomic_t		conn_compl;
 	atomic_t		conn_error;
 	wait_queue_head_t	conn_wq;
+	atomic_t		rsp_compl;
+	unsigned int		uri_cnt;
 	TfwFuzzContext		ctx;
 	char 			buf[BUF_SIZE];
 } TfwBmbTask;
@@ -116,6 +179,8 @@ static atomic_t bmb_request_send	= ATOMIC_INIT(0);
 static TfwAddr bmb_server_address;
 static SsHooks bmb_hooks;
 static TfwBmbTask *bmb_tasks;
+static TfwBmbUri bmb_uris[ARRAY_SIZE(uris)];
+static unsigned int bmb_uris_weight;
 
 static inline void
 __check_conn(TfwBmbConn *conn)
@@ -168,20 +233,110 @@ tfw_bmb_print_msg(void *msg_data, unsigned char *data, size_t len,
 	return 0;
 }
 
-static int
-tfw_bmb_conn_recv(void *cdata, struct sk_buff *skb)
+static void
+tfw_bmb_rsp_done(TfwBmbConn *conn)
 {
-	if (verbose) {
-		unsigned int parsed = 0, chunks = 0;
+	u64 us;
+	int b = 0;
 
-		T_LOG("Server response:\n------------------------------\n");
+	conn->rsp.state = TFW_BMB_RSP_HDR;
+	conn->rsp.cl = 0;
+	if (!conn->ts)
+		return;
 
-		ss_skb_process(skb, tfw_bmb_print_msg, NULL, &chunks, &parsed);
+	us = div_u64(ktime_get_ns() - conn->ts, NSEC_PER_USEC);
+	if (us)
+		b = min(ilog2(us) + 1, LAT_BUCKETS - 1);
+	conn->lat[b]++;
+
+	WRITE_ONCE(conn->ts, 0);
+	atomic_inc(&conn->task->rsp_compl);
+	wake_up(&conn->task->conn_wq);
+}
+
+static int
+tfw_bmb_rsp_parse(void *cdata, unsigned char *data, size_t len,
+		  unsigned int *read)
+{
+	TfwBmbConn *conn = cdata;
+	TfwBmbRsp *rsp = &conn->rsp;
+	unsigned char *p = data, *end = data + len;
+
+	while (p < end) {
+		if (rsp->state == TFW_BMB_RSP_BODY) {
+			size_t n = min_t(size_t, rsp->body_left, end - p);
+
+			p += n;
+			rsp->body_left -= n;
+			if (!rsp->body_left)
+				tfw_bmb_rsp_done(conn);
+			continue;
+		}
 
-		printk(KERN_INFO "\n------------------------------\n");
+		if (*p != '\n') {
+			if (rsp->line_len < sizeof(rsp->line))
+				rsp->line[rsp->line_len++] = tolower(*p);
+			++p;
+			continue;
+		}
+		++p;
+		if (rsp->line_len && rsp->line[rsp->line_len - 1] == '\r')
+			--rsp->line_len;
+
+		if (!rsp->line_len) {
+			/* End of the headers. */
+			if (!rsp->cl) {
+				tfw_bmb_rsp_done(conn);
+			} else {
+				rsp->state = TFW_BMB_RSP_BODY;
+				rsp->body_left = rsp->cl;
+			}
+		}
+		else if (rsp->line_len > 15
+			 && !memcmp(rsp->line, "content-length:", 15))
+		{
+			unsigned int i;
+
+			rsp->cl = 0;
+			for (i = 15; i < rsp->line_len; ++i)
+				if (isdigit(rsp->line[i]))
+					rsp->cl = rsp->cl * 10
+						  + rsp->line[i] - '0';
+		}
+		rsp->line_len = 0;
 	}
+	*read = len;
 
-	__kfree_skb(skb);
+	return SS_POSTPONE;
+}
+
+static int
+tfw_bmb_conn_recv(void *cdata, struct sk_buff *skb_head)
+{
+	struct sk_buff *skb = skb_head;
+
+	do {
+		if (latency) {
+			unsigned int parsed = 0, chunks = 0;
+
+			ss_skb_process(skb, 0, tfw_bmb_rsp_parse, cdata,
+				       &chunks, &parsed);
+		}
+
+		if (verbose) {
+			unsigned int parsed = 0, chunks = 0;
+
+			T_LOG("Server response:\n"
+			      "------------------------------\n");
+
+			ss_skb_process(skb, 0, tfw_bmb_print_msg, NULL,
+				       &chunks, &parsed);
+
+			printk(KERN_INFO "\n------------------------------\n");
+		}
+	} while ((skb = skb->next) != skb_head);
+
+	ss_skb_queue_purge(&skb_head);
 	return TFW_PASS;
 }
 
@@ -209,6 +364,8 @@ tfw_bmb_connect(TfwBmbTask *task, TfwBmbConn *conn)
 	ss_set_callbacks(sk);
 	conn->sk = sk;
 	conn->task = task;
+	conn->ts = 0;
+	memset(&conn->rsp, 0, sizeof(conn->rsp));
 
 	ret = ss_connect(sk, &bmb_server_address, 0);
 	if (ret) {
@@ -235,6 +392,21 @@ tfw_bmb_release_sockets(TfwBmbTask *task)
 	}
 }
 
+/*
+ * Generate the next request of the weighted round robin over the URIs mix.
+ */
+static void
+tfw_bmb_uri_gen(TfwBmbTask *task)
+{
+	unsigned int i, n = task->uri_cnt++ % bmb_uris_weight;
+
+	for (i = 0; n >= bmb_uris[i].weight; ++i)
+		n -= bmb_uris[i].weight;
+
+	snprintf(task->buf, BUF_SIZE, "GET %.*s HTTP/1.1\r\nHost: %s\r\n\r\n",
+		 bmb_uris[i].len, bmb_uris[i].uri, server);
+}
+
 static void
 tfw_bmb_msg_send(TfwBmbTask *task, int cn)
 {
@@ -243,6 +415,10 @@ tfw_bmb_msg_send(TfwBmbTask *task, int cn)
 	TfwMsgIter it;
 	TfwHttpMsg hmreq;
 
+	if (nuris) {
+		tfw_bmb_uri_gen(task);
+		goto send;
+	}
 	do {
 		if (++fz_tries > 10) {
 			T_ERR("Too many fuzzer tries to generate request\n");
@@ -259,6 +435,7 @@ tfw_bmb_msg_send(TfwBmbTask *task, int cn)
 			fuzz_init(&task->ctx, true);
 	} while (r != FUZZ_VALID);
 
+send:
 	msg.data = task->buf;
 	msg.skb = NULL;
 	msg.len = strlen(msg.data);
@@ -312,6 +489,42 @@ do_send_work(TfwBmbTask *task, int to_send)
 	}
 }
 
+/*
+ * Send a request on a connection only after the response to the previous
+ * request is received, so each request latency is measured.
+ */
+static void
+do_send_work_closed(TfwBmbTask *task, int to_send)
+{
+	int c, sent = 0, compl;
+
+	while (sent < to_send || atomic_read(&task->rsp_compl) < sent) {
+		int prev_sent = sent;
+
+		compl = atomic_read(&task->rsp_compl);
+		for (c = 0; c < nconns && sent < to_send; ++c) {
+			TfwBmbConn *conn = &task->conn[c];
+
+			if (conn->proto.type == TFW_BMB_SK_INACTIVE
+			    || READ_ONCE(conn->ts))
+				continue;
+			WRITE_ONCE(conn->ts, ktime_get_ns());
+			tfw_bmb_msg_send(task, c);
+			++sent;
+		}
+		if (prev_sent != sent)
+			continue;
+		if (!wait_event_timeout(task->conn_wq,
+					atomic_read(&task->rsp_compl) != compl,
+					DEAD_TRIES))
+		{
+			T_WARN("No responses, sent %d, received %d\n", sent,
+			       atomic_read(&task->rsp_compl));
+			return;
+		}
+	}
+}
+
 static int
 tfw_bmb_worker(void *data)
 {
@@ -325,6 +538,7 @@ tfw_bmb_worker(void *data)
 		attempt = 0;
 		atomic_set(&task->conn_compl, 0);
 		atomic_set(&task->conn_error, 0);
+		atomic_set(&task->rsp_compl, 0);
 		init_waitqueue_head(&task->conn_wq);
 
 		for (c = 0; c < nconns; c++)
@@ -348,7 +562,10 @@ tfw_bmb_worker(void *data)
 			}
 		} while (!kthread_should_stop());
 
-		do_send_work(task, nconns * nmessages);
+		if (latency)
+			do_send_work_closed(task, nconns * nmessages);
+		else
+			do_send_work(task, nconns * nmessages);
 
 release_sockets:
 		atomic_add(attempt, &bmb_conn_attempt);
@@ -401,6 +618,37 @@ tfw_bmb_stop_threads(void)
 	}
 }
 
+#define R(...)	pr_info(TFW_BANNER __VA_ARGS__)
+
+static void
+tfw_bmb_report_latency(void)
+{
+	static const unsigned int pct[] = { 500, 900, 990, 999 };
+	unsigned long lat[LAT_BUCKETS] = { 0 }, n = 0, sum = 0;
+	int t, c, b, p = 0;
+
+	for (t = 0; t < nthreads; t++)
+		for (c = 0; c < nconns; c++)
+			for (b = 0; b < LAT_BUCKETS; b++)
+				lat[b] += bmb_tasks[t].conn[c].lat[b];
+	for (b = 0; b < LAT_BUCKETS; b++)
+		n += lat[b];
+	if (!n)
+		return;
+
+	R("  total responses: %lu\n", n);
+	for (b = 0; b < LAT_BUCKETS && p < ARRAY_SIZE(pct); b++) {
+		sum += lat[b];
+		for ( ; p < ARRAY_SIZE(pct) && sum * 1000 >= n * pct[p]; p++)
+			R("  latency p%u.%u: < %luus\n", pct[p] / 10,
+			  pct[p] % 10, 1UL << b);
+	}
+	for (b = 0; b < LAT_BUCKETS; b++)
+		if (lat[b])
+			R("    [%lu, %lu)us: %lu\n", b ? 1UL << (b - 1) : 0,
+			  1UL << b, lat[b]);
+}
+
 /*
  * TODO add server performance measurement.
  */
@@ -408,7 +656,6 @@ static void
 tfw_bmb_report(unsigned long ts_start)
 {
 	/* Always print full message regardless debug level. */
-#define R(...)	pr_info(TFW_BANNER __VA_ARGS__)
 	R("BOMBER SUMMARY:");
 	R("  total connections: %d\n", nconns * niters * nthreads);
 	R("  attempted connections: %d\n", atomic_read(&bmb_conn_attempt));
@@ -417,7 +664,42 @@ tfw_bmb_report(unsigned long ts_start)
 	R("  dropped connections: %d\n", atomic_read(&bmb_conn_drop));
 	R("  total requests: %d\n", atomic_read(&bmb_request_send));
 	R("  total time: %ldms\n", jiffies - ts_start);
+	if (latency)
+		tfw_bmb_report_latency();
+}
+
 #undef R
+
+/*
+ * Parse the request mix of the URIs in form of "uri[:weight]".
+ */
+static int
+tfw_bmb_uris_init(void)
+{
+	int i;
+
+	for (i = 0; i < nuris; i++) {
+		TfwBmbUri *u = &bmb_uris[i];
+		const char *w = strrchr(uris[i], ':');
+
+		u->uri = uris[i];
+		u->len = strlen(uris[i]);
+		u->weight = 1;
+		if (w) {
+			u->len = w - uris[i];
+			if (kstrtouint(w + 1, 10, &u->weight) || !u->weight) {
+				T_ERR("Bad weight of URI: %s\n", uris[i]);
+				return -EINVAL;
+			}
+		}
+		if (!u->len || *u->uri != '/') {
+			T_ERR("Bad URI: %s\n", uris[i]);
+			return -EINVAL;
+		}
+		bmb_uris_weight += u->weight;
+	}
+
+	return 0;
 }
 
 static int
@@ -462,6 +744,8 @@ tfw_bmb_init(void)
 		T_ERR("Unable to parse server's address: %s", server);
 		return -EINVAL;
 	}
+	if (tfw_bmb_uris_init())
+		return -EINVAL;
 	T_LOG("Started bomber module, server's address is %s\n", server);
 
 	if (tfw_bmb_alloc())
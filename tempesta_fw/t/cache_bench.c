@@ -0,0 +1,211 @@
+/**
+ *		Tempesta FW
+ *
+ * Tempesta cache benchmark: microbenchmarks for the cache hit path.
+ *
+ * The module fills the cache of each NUMA node with synthetic entries and
+ * measures cache lookup, building of a response from a cache entry and
+ * building of a 304 response on each online CPU. Requested keys follow Zipf
+ * distribution. Tempesta FW must be built with CACHE_BENCH=1 and running
+ * with the cache enabled. Results are printed as one line of key=value pairs
+ * per operation and CPU or NUMA node: op, scope (cpu or node), cpu, node,
+ * ops, misses and cycles_per_op.
+ *
+ * Copyright (C) 2020 Tempesta Technologies, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/random.h>
+#include <linux/topology.h>
+#include <linux/vmalloc.h>
+#include <linux/workqueue.h>
+
+#include "cache.h"
+#include "log.h"
+
+static int nentries	= 10000;
+static int body_len	= 1024;
+static int niters	= 100000;
+static int zipf_s	= 1;
+
+module_param_named(e, nentries, int, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+module_param_named(b, body_len, int, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+module_param_named(i, niters,   int, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+module_param_named(z, zipf_s,   int, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+
+MODULE_PARM_DESC(e, "Number of cache entries per NUMA node");
+MODULE_PARM_DESC(b, "Response body size in bytes");
+MODULE_PARM_DESC(i, "Number of operations per CPU and benchmark");
+MODULE_PARM_DESC(z, "Zipf exponent: 0 (uniform), 1 or 2");
+
+MODULE_AUTHOR("Tempesta Technologies, Inc");
+MODULE_DESCRIPTION("Tempesta cache benchmark");
+MODULE_VERSION("0.1.0");
+MODULE_LICENSE("GPL");
+
+/* Fixed point unit of the Zipf weights. */
+#define BENCH_ZIPF_ONE		(1ULL << 40)
+
+static const char *bench_op_name[TFW_CACHE_BENCH_OPS] = {
+	[TFW_CACHE_BENCH_GET]	= "get",
+	[TFW_CACHE_BENCH_BUILD]	= "build_resp",
+	[TFW_CACHE_BENCH_304]	= "build_304",
+};
+
+typedef struct {
+	int		op;
+	unsigned long	cycles;
+	unsigned int	misses;
+} TfwBenchRun;
+
+static unsigned int *bench_keys;
+static unsigned long bench_cycles[MAX_NUMNODES][TFW_CACHE_BENCH_OPS];
+static unsigned long bench_ops[MAX_NUMNODES][TFW_CACHE_BENCH_OPS];
+static unsigned int bench_misses[MAX_NUMNODES][TFW_CACHE_BENCH_OPS];
+
+/**
+ * Generate @niters keys from [0, @nentries) with Zipf distribution of
+ * exponent @zipf_s, key 0 is the most popular one. The weights 1/k^s are
+ * computed in fixed point, so only integer exponents are supported.
+ */
+static int
+tfw_bench_keys_gen(void)
+{
+	unsigned long *cdf, sum = 0, x;
+	unsigned int i, l, r, m;
+
+	if (!(cdf = vmalloc(nentries * sizeof(*cdf))))
+		return -ENOMEM;
+	for (i = 0; i < nentries; ++i) {
+		unsigned long k = i + 1;
+
+		sum += zipf_s == 0 ? 1
+		       : zipf_s == 1 ? BENCH_ZIPF_ONE / k
+		       : BENCH_ZIPF_ONE / (k * k);
+		cdf[i] = sum;
+	}
+
+	for (i = 0; i < niters; ++i) {
+		x = (((unsigned long)prandom_u32() << 32) | prandom_u32())
+		    % sum;
+		for (l = 0, r = nentries - 1; l < r; ) {
+			m = l + (r - l) / 2;
+			if (cdf[m] > x)
+				r = m;
+			else
+				l = m + 1;
+		}
+		bench_keys[i] = l;
+	}
+	vfree(cdf);
+
+	return 0;
+}
+
+static long
+tfw_bench_fill(void *unused)
+{
+	return tfw_cache_bench_fill(nentries, body_len);
+}
+
+static long
+tfw_bench_run(void *data)
+{
+	TfwBenchRun *run = data;
+
+	return tfw_cache_bench_run(run->op, bench_keys, niters, &run->cycles,
+				   &run->misses);
+}
+
+static void
+tfw_bench_report(const char *scope, int op, int cpu, int nid,
+		 unsigned long ops, unsigned int misses, unsigned long cycles)
+{
+	char cpu_str[16] = "";
+
+	if (cpu >= 0)
+		snprintf(cpu_str, sizeof(cpu_str), " cpu=%d", cpu);
+	/* Always print results regardless debug level. */
+	pr_info("tfw_cache_bench: op=%s scope=%s%s node=%d ops=%lu misses=%u"
+		" cycles_per_op=%lu\n", bench_op_name[op], scope, cpu_str,
+		nid, ops, misses, ops ? cycles / ops : 0);
+}
+
+static int __init
+tfw_bench_init(void)
+{
+	int cpu, nid, op;
+	long r;
+	TfwBenchRun run;
+
+	if (nentries <= 0 || niters <= 0 || body_len < 0
+	    || zipf_s < 0 || zipf_s > 2)
+	{
+		T_ERR("Cache bench: bad parameters\n");
+		return -EINVAL;
+	}
+	if (!(bench_keys = vmalloc(niters * sizeof(*bench_keys))))
+		return -ENOMEM;
+	if ((r = tfw_bench_keys_gen()))
+		goto out;
+
+	for_each_node_with_cpus(nid) {
+		cpu = cpumask_first(cpumask_of_node(nid));
+		if ((r = work_on_cpu(cpu, tfw_bench_fill, NULL))) {
+			T_ERR("Cache bench: cannot fill cache on node %d,"
+			      " %ld\n", nid, r);
+			goto out;
+		}
+	}
+
+	for_each_online_cpu(cpu) {
+		nid = cpu_to_node(cpu);
+		for (op = 0; op < TFW_CACHE_BENCH_OPS; ++op) {
+			run.op = op;
+			if ((r = work_on_cpu(cpu, tfw_bench_run, &run))) {
+				T_ERR("Cache bench: %s failed on CPU %d, %ld\n",
+				      bench_op_name[op], cpu, r);
+				goto out;
+			}
+			tfw_bench_report("cpu", op, cpu, nid, niters,
+					 run.misses, run.cycles);
+			bench_cycles[nid][op] += run.cycles;
+			bench_ops[nid][op] += niters;
+			bench_misses[nid][op] += run.misses;
+		}
+	}
+
+	for_each_node_with_cpus(nid)
+		for (op = 0; op < TFW_CACHE_BENCH_OPS; ++op)
+			tfw_bench_report("node", op, -1, nid,
+					 bench_ops[nid][op],
+					 bench_misses[nid][op],
+					 bench_cycles[nid][op]);
+out:
+	vfree(bench_keys);
+	bench_keys = NULL;
+
+	return r;
+}
+
+static void
+tfw_bench_exit(void)
+{
+}
+
+module_init(tfw_bench_init);
+module_exit(tfw_bench_exit);
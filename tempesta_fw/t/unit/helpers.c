@@ -31,7 +31,9 @@
  * this program; if not, write to the Free Software Foundation, Inc., 59
  * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
  */
+#include "http_bpf.h"
 #include "http_msg.h"
+#include "tls.h"
 
 static TfwConn conn_req, conn_resp;
 
@@ -171,6 +173,32 @@ tfw_cache_process(TfwHttpMsg *msg, tfw_http_cache_cb_t action)
 	return 0;
 }
 
+void
+tfw_cache_resp_chunk(TfwHttpResp *resp)
+{
+}
+
+TfwStr *
+tfw_cache_key_path(TfwHttpReq *req)
+{
+	return &req->uri_path;
+}
+
+TfwHttpResp *
+tfw_cache_push(TfwHttpReq *req, TfwStr *path, unsigned int stream_id,
+	       unsigned long *budget)
+{
+	return NULL;
+}
+
+struct bpf_prog __rcu *tfw_http_bpf_prog;
+
+bool
+__tfw_http_bpf_classify(TfwHttpReq *req)
+{
+	return false;
+}
+
 void
 tfw_tls_cfg_configured(bool global)
 {
@@ -180,3 +208,9 @@ void
 tfw_tls_match_any_sni_to_dflt(bool match)
 {
 }
+
+unsigned int
+tfw_tls_rec_payload(struct sock *sk)
+{
+	return TLS_MAX_PAYLOAD_SIZE;
+}
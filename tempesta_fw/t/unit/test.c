@@ -99,10 +99,15 @@ TEST_SUITE(hash);
 TEST_SUITE(addr);
 TEST_SUITE(sched_ratio);
 TEST_SUITE(sched_hash);
+TEST_SUITE(sched_p2c);
 TEST_SUITE(http_tbl);
 TEST_SUITE(wq);
 TEST_SUITE(tls);
 TEST_SUITE(hpack);
+TEST_SUITE(lpm);
+TEST_SUITE(regex);
+TEST_SUITE(mtree);
+TEST_SUITE(twheel);
 
 int
 test_run_all(void)
@@ -112,6 +117,10 @@ test_run_all(void)
 	/* Run sleeping tests first. */
 	TEST_SUITE_RUN(cfg);
 	TEST_SUITE_RUN(wq);
+	TEST_SUITE_RUN(lpm);
+	TEST_SUITE_RUN(regex);
+	TEST_SUITE_RUN(mtree);
+	TEST_SUITE_RUN(twheel);
 
 	kernel_fpu_begin();
 
@@ -128,6 +137,7 @@ test_run_all(void)
 	TEST_SUITE_RUN(addr);
 	TEST_SUITE_RUN(sched_ratio);
 	TEST_SUITE_RUN(sched_hash);
+	TEST_SUITE_RUN(sched_p2c);
 	TEST_SUITE_RUN(http_tbl);
 	TEST_SUITE_RUN(hpack);
 
@@ -20,6 +20,7 @@
  */
 
 #include <linux/bug.h>
+#include <linux/hash.h>
 
 #include "str.h"
 #include "hash.h"
@@ -200,6 +201,106 @@ TEST(tfw_hash_str, distributes_all_input_across_hash_bits)
 	}
 }
 
+/*
+ * Cache keys differ in a few bytes only, check that the hashes of chunked
+ * keys don't collide and are evenly distributed over hash table buckets.
+ */
+TEST(tfw_hash_str, distributes_cache_keys)
+{
+#define KEYS_N		4096
+#define BUCKETS_SHIFT	8
+	static unsigned long h[KEYS_N];
+	static unsigned int buckets[1 << BUCKETS_SHIFT];
+	char buf[64];
+	TfwStr chunks[] = {
+		{ .data = "www.example.com",	.len = 15 },
+		{ .data = buf,			.len = 8 },
+		{ .data = buf + 8 },
+	};
+	TfwStr key = { .chunks = chunks, .nchunks = ARRAY_SIZE(chunks) };
+	int i, j, n;
+
+	memset(buckets, 0, sizeof(buckets));
+	for (i = 0; i < KEYS_N; ++i) {
+		n = snprintf(buf, sizeof(buf), "/static/img/%d.png?v=%d",
+			     i, i % 13);
+		chunks[2].len = n - 8;
+		key.len = 15 + n;
+		h[i] = tfw_hash_str(&key);
+		++buckets[hash_64(h[i], BUCKETS_SHIFT)];
+	}
+
+	for (i = 0; i < KEYS_N; ++i)
+		for (j = i + 1; j < KEYS_N; ++j)
+			if (h[i] == h[j])
+				TEST_FAIL("Equal hashes %#lx for keys %d and"
+					  " %d", h[i], i, j);
+	/* Allow twice the average bucket load. */
+	for (i = 0; i < ARRAY_SIZE(buckets); ++i)
+		EXPECT_TRUE(buckets[i] <= 2 * KEYS_N >> BUCKETS_SHIFT);
+#undef BUCKETS_SHIFT
+#undef KEYS_N
+}
+
+/* SipHash-2-4-128 test vectors for key 00..0f and message 00..(n - 1). */
+TEST(tfw_siphash, reference_vectors)
+{
+	static const struct {
+		size_t	len;
+		u8	hash[TFW_SIPHASH_LEN];
+	} vectors[] = {
+		{ 0, { 0xa3, 0x81, 0x7f, 0x04, 0xba, 0x25, 0xa8, 0xe6,
+		       0x6d, 0xf6, 0x72, 0x14, 0xc7, 0x55, 0x02, 0x93 } },
+		{ 1, { 0xda, 0x87, 0xc1, 0xd8, 0x6b, 0x99, 0xaf, 0x44,
+		       0x34, 0x76, 0x59, 0x11, 0x9b, 0x22, 0xfc, 0x45 } },
+		{ 63, { 0x51, 0x50, 0xd1, 0x77, 0x2f, 0x50, 0x83, 0x4a,
+			0x50, 0x3e, 0x06, 0x9a, 0x97, 0x3f, 0xbd, 0x7c } },
+	};
+	u8 k[TFW_SIPHASH_KEY_LEN], m[64], out[TFW_SIPHASH_LEN];
+	TfwSipHashKey key;
+	TfwSipHash h;
+	int i;
+
+	for (i = 0; i < sizeof(k); ++i)
+		k[i] = i;
+	for (i = 0; i < sizeof(m); ++i)
+		m[i] = i;
+	tfw_siphash_setkey(&key, k);
+
+	for (i = 0; i < ARRAY_SIZE(vectors); ++i) {
+		tfw_siphash_init(&h, &key);
+		tfw_siphash_update(&h, m, vectors[i].len);
+		tfw_siphash_final(&h, out);
+		EXPECT_ZERO(memcmp(out, vectors[i].hash, sizeof(out)));
+	}
+}
+
+TEST(tfw_siphash, same_hash_for_diff_chunks_n)
+{
+	const char data[] = "The quick brown fox jumps over the lazy dog";
+	size_t a1, a2, len = sizeof(data) - 1;
+	u8 k[TFW_SIPHASH_KEY_LEN] = "0123456789abcdef";
+	u8 expected[TFW_SIPHASH_LEN], out[TFW_SIPHASH_LEN];
+	TfwSipHashKey key;
+	TfwSipHash h;
+
+	tfw_siphash_setkey(&key, k);
+	tfw_siphash_init(&h, &key);
+	tfw_siphash_update(&h, data, len);
+	tfw_siphash_final(&h, expected);
+
+	for (a1 = 0; a1 < len; a1++) {
+		for (a2 = a1; a2 < len; a2++) {
+			tfw_siphash_init(&h, &key);
+			tfw_siphash_update(&h, data, a1);
+			tfw_siphash_update(&h, data + a1, a2 - a1);
+			tfw_siphash_update(&h, data + a2, len - a2);
+			tfw_siphash_final(&h, out);
+			EXPECT_ZERO(memcmp(out, expected, sizeof(out)));
+		}
+	}
+}
+
 TEST_SUITE(hash)
 {
 	TEST_RUN(tfw_hash_str, calcs_diff_hash_for_diff_str);
@@ -207,4 +308,7 @@ TEST_SUITE(hash)
 	TEST_RUN(tfw_hash_str, hashes_all_chars);
 	TEST_RUN(tfw_hash_str, doesnt_read_behind_end_of_buf);
 	TEST_RUN(tfw_hash_str, distributes_all_input_across_hash_bits);
+	TEST_RUN(tfw_hash_str, distributes_cache_keys);
+	TEST_RUN(tfw_siphash, reference_vectors);
+	TEST_RUN(tfw_siphash, same_hash_for_diff_chunks_n);
 }
@@ -377,7 +377,7 @@ TEST(hpack, dec_table_wrap)
 
 	for (shift = 0; shift < 14; ++shift) {
 		TfwHPackEntry *last_entries;
-		const TfwHPackEntry *entries, *entry;
+		const TfwHPackEntry *entry;
 		int i, start_idx = 17, stop_idx = start_idx + shift + 1;
 		int cont_idx = stop_idx, end_idx = cont_idx + 31;
 		unsigned int lentries_size = shift * sizeof(TfwHPackEntry);
@@ -423,6 +423,7 @@ TEST(hpack, dec_table_wrap)
 			EXPECT_OK(tfw_hpack_set_length(hp, shrink_sz));
 			EXPECT_OK(tfw_hpack_set_length(hp,
 						       HPACK_TABLE_DEF_SIZE));
+			EXPECT_EQ(hp->dec_tbl.n, 1);
 
 			start_idx = cont_idx;
 			stop_idx = end_idx;
@@ -430,22 +431,29 @@ TEST(hpack, dec_table_wrap)
 			goto fill_table;
 		}
 
-		EXPECT_EQ(hp->dec_tbl.length, 32);
+		EXPECT_EQ(hp->dec_tbl.length,
+			  HPACK_TABLE_DEF_SIZE / HPACK_ENTRY_OVERHEAD);
 		EXPECT_EQ(hp->dec_tbl.n, 32);
-
 		/*
-		 * Verify that the last added @shift entries are wrapped, i.e
-		 * placed in the beginning of dynamic table.
+		 * The entries with their descriptors don't fit the initial ring
+		 * buffer, so they are moved to the start of the bigger one.
 		 */
-		entries = hp->dec_tbl.entries;
+		EXPECT_EQ(hp->dec_tbl.rb_size, 2 * HPACK_TABLE_DEF_SIZE);
+		EXPECT_EQ(hp->dec_tbl.rb_head, 0);
+		EXPECT_EQ(hp->dec_tbl.rb_wrap, 0);
+
+		/* Verify that the last added @shift entries are found. */
 		for (i = 0; i < shift; ++i) {
 			TfwStr h_name;
 			const TfwHPackEntry *l_entry = &last_entries[i];
-			const TfwHPackEntry *t_entry = &entries[i];
+			const TfwHPackEntry *t_entry;
 
+			t_entry = tfw_hpack_find_index(&hp->dec_tbl,
+						       HPACK_STATIC_ENTRIES
+						       + shift - i);
 			EXPECT_NOT_NULL(l_entry->hdr);
-			EXPECT_NOT_NULL(t_entry->hdr);
-			if (l_entry->hdr) {
+			EXPECT_NOT_NULL(t_entry);
+			if (l_entry->hdr && t_entry) {
 				test_h2_hdr_name(t_entry->hdr, &h_name);
 				EXPECT_TRUE(tfw_strcmp(&h_name, l_entry->hdr) == 0);
 			}
@@ -456,6 +464,53 @@ TEST(hpack, dec_table_wrap)
 	}
 }
 
+/*
+ * Big headers rotating through the dynamic table mustn't grow the table
+ * memory: the evicted entries free the ring buffer space for the new ones.
+ */
+TEST(hpack, dec_table_rotate)
+{
+	int i;
+	char val[1000];
+	TfwStr h_name, *s;
+	const TfwHPackEntry *entry;
+	TfwHPack *hp = &ctx.hpack;
+	TfwMsgParseIter *it = &test_req->pit;
+	TFW_STR(s_name, "cookie");
+	TfwStr s_val = { .data = val, .len = sizeof(val) };
+
+	HDR_COMPOUND_STR(s, s_name, &s_val);
+	test_h2_hdr_name(s, &h_name);
+
+	for (i = 0; i < 1000; ++i) {
+		memset(val, 'a' + i % 26, sizeof(val));
+		it->nm_num = h_name.nchunks;
+		it->nm_len = h_name.len;
+		it->tag = TFW_TAG_HDR_COOKIE;
+		*it->parsed_hdr = *s;
+		EXPECT_OK(tfw_hpack_add_index(&hp->dec_tbl, it));
+	}
+
+	/* Only 3 such entries fit the table. */
+	EXPECT_EQ(hp->dec_tbl.n, 3);
+	EXPECT_EQ(hp->dec_tbl.size, 3 * (HPACK_ENTRY_OVERHEAD + s->len));
+	EXPECT_EQ(hp->dec_tbl.rb_size, 2 * HPACK_TABLE_DEF_SIZE);
+
+	for (i = 0; i < 3; ++i) {
+		memset(val, 'a' + (999 - i) % 26, sizeof(val));
+		entry = tfw_hpack_find_index(&hp->dec_tbl,
+					     HPACK_STATIC_ENTRIES + 1 + i);
+		EXPECT_NOT_NULL(entry);
+		if (entry)
+			EXPECT_TRUE(tfw_strcmp(entry->hdr, s) == 0);
+	}
+	EXPECT_NULL(tfw_hpack_find_index(&hp->dec_tbl,
+					 HPACK_STATIC_ENTRIES + 4));
+
+	tfw_h2_context_clear(&ctx);
+	BUG_ON(tfw_h2_context_init(&ctx));
+}
+
 TEST(hpack, dec_raw)
 {
 	int r;
@@ -1210,6 +1265,7 @@ TEST(hpack, enc_huffman)
 	TfwStr *www_raw = make_compound_str("www.example.com");
 	DEFINE_TFW_STR(www_exp,
 		       "\xF1\xE3\xC2\xE5\xF2\x3A\x6B\xA0\xAB\x90\xF4\xFF");
+	DEFINE_TFW_STR(bin_raw, "\x7F\x80\xFF");
 	TfwStr *custom_key_enc, *custom_val_enc, *no_cache_enc, *www_enc;
 
 	custom_key_enc = tfw_huffman_encode_string(&custom_key_raw, str_pool);
@@ -1228,12 +1284,50 @@ TEST(hpack, enc_huffman)
 	EXPECT_TRUE(!IS_ERR_OR_NULL(www_enc));
 	EXPECT_OK(tfw_strcmp(www_enc, &www_exp));
 
+	/* Strings which aren't shortened by Huffman coding are left raw. */
+	EXPECT_NULL(tfw_huffman_encode_string(&bin_raw, str_pool));
+
 	/*
 	 * TODO: add more test cases: encode<->decode the same text using
 	 * Tempesta functions.
 	 */
 }
 
+TEST(hpack, enc_nodyn)
+{
+	char buf[64];
+	unsigned long n;
+	TfwStr hdr = {
+		.chunks = (TfwStr []){
+			{ .data = "custom-key",		.len = 10 },
+			{ .data = S_DLM,		.len = SLEN(S_DLM) },
+			{ .data = "custom-value",	.len = 12 },
+		},
+		.len = 10 + SLEN(S_DLM) + 12,
+		.nchunks = 3
+	};
+	TfwStr cc = {
+		.chunks = (TfwStr []){
+			{ .data = "cache-control",	.len = 13 },
+			{ .data = "no-cache",		.len = 8 },
+		},
+		.len = 21,
+		.nchunks = 2,
+		.hpack_idx = 24
+	};
+
+	/* Literal header field without indexing and with Huffman strings. */
+	n = tfw_hpack_encode_nodyn(&hdr, buf);
+	EXPECT_EQ(n, 20);
+	EXPECT_ZERO(memcmp(buf, "\x00\x88\x25\xA8\x49\xE9\x5B\xA9\x7D\x7F"
+			   "\x89\x25\xA8\x49\xE9\x5B\xB8\xE8\xB4\xBF", n));
+
+	/* Indexed name from the static table. */
+	n = tfw_hpack_encode_nodyn(&cc, buf);
+	EXPECT_EQ(n, 9);
+	EXPECT_ZERO(memcmp(buf, "\x0F\x09\x86\xA8\xEB\x10\x64\x9C\xBF", n));
+}
+
 TEST(hpack, enc_table_hdr_write)
 {
 	char *buf, *ptr;
@@ -1431,7 +1525,7 @@ TEST(hpack, enc_table_index)
 	res = tfw_hpack_rbtree_find(tbl, s1, &node, &pl);
 	EXPECT_EQ(res, HPACK_IDX_ST_NOT_FOUND);
 	EXPECT_NULL(node);
-	EXPECT_OK(tfw_hpack_add_node(tbl, s1, &pl, TFW_H2_TRANS_INPLACE));
+	EXPECT_OK(tfw_hpack_add_node(tbl, s1, &pl, TFW_H2_TRANS_COPY));
 
 	node = NULL;
 	bzero_fast(&pl, sizeof(pl));
@@ -1441,7 +1535,7 @@ TEST(hpack, enc_table_index)
 	EXPECT_NOT_NULL(pl.parent);
 	if (pl.parent)
 		EXPECT_OK(tfw_hpack_add_node(tbl, s2, &pl,
-					     TFW_H2_TRANS_INPLACE));
+					     TFW_H2_TRANS_COPY));
 
 	node = NULL;
 	bzero_fast(&pl, sizeof(pl));
@@ -1451,7 +1545,7 @@ TEST(hpack, enc_table_index)
 	EXPECT_NOT_NULL(pl.parent);
 	if (pl.parent)
 		EXPECT_OK(tfw_hpack_add_node(tbl, s3, &pl,
-					     TFW_H2_TRANS_INPLACE));
+					     TFW_H2_TRANS_COPY));
 
 	/*
 	 * Verify that headers had been correctly added into encoder dynamic
@@ -1504,6 +1598,64 @@ TEST(hpack, enc_table_index)
 #undef HDR_VALUE_3
 }
 
+TEST(hpack, enc_table_hash)
+{
+	unsigned int hash;
+	TfwHPackETbl *tbl;
+	TfwHPackETblRes res;
+	TfwHPackNodeIter pl = {};
+	const TfwHPackNode *node = NULL;
+	TfwStr s_nm = {}, s_val = {};
+
+	TFW_STR(col, ":");
+	TFW_STR(s1, "X-Custom-Hdr");
+	TFW_STR(s1_lws, " \t");
+	TFW_STR(s1_value, "foo bar");
+	TFW_STR(s1_rws, "  ");
+	TFW_STR(s2, "x-custom-hdr");
+	TFW_STR(s2_value_1, "foo");
+	TFW_STR(s2_value_2, " bar");
+	TFW_STR(s3, "x-custom-hdr");
+	TFW_STR(s3_value, "foo");
+
+	collect_compound_str(s1, col, 0);
+	collect_compound_str(s1, s1_lws, TFW_STR_OWS);
+	collect_compound_str(s1, s1_value, 0);
+	collect_compound_str(s1, s1_rws, TFW_STR_OWS);
+	collect_compound_str(s2, col, 0);
+	collect_compound_str(s2, s2_value_1, 0);
+	collect_compound_str(s2, s2_value_2, 0);
+	collect_compound_str(s3, col, 0);
+	collect_compound_str(s3, s3_value, 0);
+
+	tbl = &ctx.hpack.enc_tbl;
+
+	res = tfw_hpack_rbtree_find(tbl, s1, &node, &pl);
+	EXPECT_EQ(res, HPACK_IDX_ST_NOT_FOUND);
+	EXPECT_OK(tfw_hpack_add_node(tbl, s1, &pl, TFW_H2_TRANS_COPY));
+
+	/*
+	 * The same header with another name case and chunks layout must be
+	 * found in the hash index.
+	 */
+	tfw_http_hdr_split(s2, &s_nm, &s_val, true);
+	hash = tfw_hpack_node_hash(&s_nm, &s_val);
+	node = tfw_hpack_ht_find(tbl, s2, hash);
+	EXPECT_NOT_NULL(node);
+	EXPECT_EQ(node, tbl->last);
+	EXPECT_EQ(HPACK_NODE_GET_INDEX(tbl, node), 62);
+
+	/* Header with the same name only isn't found in the hash index. */
+	bzero_fast(&s_nm, sizeof(s_nm));
+	bzero_fast(&s_val, sizeof(s_val));
+	tfw_http_hdr_split(s3, &s_nm, &s_val, true);
+	EXPECT_NULL(tfw_hpack_ht_find(tbl, s3, tfw_hpack_node_hash(&s_nm,
+								   &s_val)));
+
+	tfw_hpack_node_erase(tbl, tbl->last);
+	EXPECT_NULL(tfw_hpack_ht_find(tbl, s2, hash));
+}
+
 TEST(hpack, enc_table_rbtree)
 {
 	TfwHPackETbl *tbl;
@@ -1570,7 +1722,7 @@ TEST(hpack, enc_table_rbtree)
 	res = tfw_hpack_rbtree_find(tbl, s1, &node, &pl);
 	EXPECT_EQ(res, HPACK_IDX_ST_NOT_FOUND);
 	EXPECT_NULL(node);
-	EXPECT_OK(tfw_hpack_add_node(tbl, s1, &pl, TFW_H2_TRANS_INPLACE));
+	EXPECT_OK(tfw_hpack_add_node(tbl, s1, &pl, TFW_H2_TRANS_COPY));
 	bzero_fast(&pl, sizeof(pl));
 	res = tfw_hpack_rbtree_find(tbl, s1, &n1, &pl);
 	EXPECT_EQ(res, HPACK_IDX_ST_FOUND);
@@ -1594,7 +1746,7 @@ TEST(hpack, enc_table_rbtree)
 		 */
 		EXPECT_EQ(pl.parent, n1);
 		EXPECT_EQ(pl.poff, &n1->right);
-		EXPECT_OK(tfw_hpack_add_node(tbl, s2, &pl, TFW_H2_TRANS_INPLACE));
+		EXPECT_OK(tfw_hpack_add_node(tbl, s2, &pl, TFW_H2_TRANS_COPY));
 	}
 	bzero_fast(&pl, sizeof(pl));
 	res = tfw_hpack_rbtree_find(tbl, s2, &n2, &pl);
@@ -1615,7 +1767,7 @@ TEST(hpack, enc_table_rbtree)
 		 */
 		EXPECT_EQ(pl.parent, n2);
 		EXPECT_EQ(pl.poff, &n2->left);
-		EXPECT_OK(tfw_hpack_add_node(tbl, s3, &pl, TFW_H2_TRANS_INPLACE));
+		EXPECT_OK(tfw_hpack_add_node(tbl, s3, &pl, TFW_H2_TRANS_COPY));
 	}
 	bzero_fast(&pl, sizeof(pl));
 	res = tfw_hpack_rbtree_find(tbl, s3, &n3, &pl);
@@ -1682,7 +1834,7 @@ TEST(hpack, enc_table_rbtree)
 		EXPECT_EQ(pl.parent, n1);
 		EXPECT_EQ(pl.poff, &n1->left);
 		EXPECT_OK(tfw_hpack_add_node(tbl, s4, &pl,
-					     TFW_H2_TRANS_INPLACE));
+					     TFW_H2_TRANS_COPY));
 	}
 	bzero_fast(&pl, sizeof(pl));
 	res = tfw_hpack_rbtree_find(tbl, s4, &n4, &pl);
@@ -1734,7 +1886,7 @@ TEST(hpack, enc_table_rbtree)
 		EXPECT_EQ(pl.parent, n1);
 		EXPECT_EQ(pl.poff, &n1->right);
 		EXPECT_OK(tfw_hpack_add_node(tbl, s5, &pl,
-					     TFW_H2_TRANS_INPLACE));
+					     TFW_H2_TRANS_COPY));
 	}
 	bzero_fast(&pl, sizeof(pl));
 	res = tfw_hpack_rbtree_find(tbl, s5, &n5, &pl);
@@ -1910,11 +2062,14 @@ TEST_SUITE(hpack)
 	TEST_RUN(hpack, dec_table_dynamic);
 	TEST_RUN(hpack, dec_table_dynamic_inc);
 	TEST_RUN(hpack, dec_table_wrap);
+	TEST_RUN(hpack, dec_table_rotate);
 	TEST_RUN(hpack, dec_raw);
 	TEST_RUN(hpack, dec_indexed);
 	TEST_RUN(hpack, dec_huffman);
 	TEST_RUN(hpack, enc_huffman);
+	TEST_RUN(hpack, enc_nodyn);
 	TEST_RUN(hpack, enc_table_hdr_write);
 	TEST_RUN(hpack, enc_table_index);
+	TEST_RUN(hpack, enc_table_hash);
 	TEST_RUN(hpack, enc_table_rbtree);
 }
@@ -500,6 +500,117 @@ TEST(http_match, method_eq)
 	EXPECT_EQ(42, match_id);
 }
 
+TEST(http_match, compiled_chain)
+{
+	static const struct {
+		const char	*uri;
+		int		id;
+	} reqs[] = {
+		{ "/static/img.png",	2 },
+		{ "/static/IMG.PNG",	2 },
+		{ "/img/x.png",		3 },
+		{ "/static/app.js",	4 },
+		{ "/api",		5 },
+		{ "x.js",		6 },
+		{ "/API/V1",		7 },
+		{ "/a/b/c/d",		1 },
+		{ "zzz",		-1 },
+	};
+	TfwHttpMatchRule *first;
+	int i;
+
+	test_chain_add_rule_str(1, TFW_HTTP_MATCH_F_URI, NULL, "/a/b/c*");
+	test_chain_add_rule_str(2, TFW_HTTP_MATCH_F_URI, NULL,
+				"/static/img.png");
+	test_chain_add_rule_str(3, TFW_HTTP_MATCH_F_URI, NULL, "*.png");
+	test_chain_add_rule_str(4, TFW_HTTP_MATCH_F_URI, NULL, "/static/*");
+	test_chain_add_rule_str(5, TFW_HTTP_MATCH_F_URI, NULL, "/api");
+	test_chain_add_rule_str(6, TFW_HTTP_MATCH_F_URI, NULL, "*.js");
+	test_chain_add_rule_str(7, TFW_HTTP_MATCH_F_URI, NULL, "/*");
+	test_chain_add_rule_str(8, TFW_HTTP_MATCH_F_URI, NULL,
+				"/static/app.js");
+	test_chain_add_rule_str(9, TFW_HTTP_MATCH_F_URI, NULL, "/api/v1");
+
+	EXPECT_ZERO(tfw_http_chain_compile(test_chain));
+	first = list_first_entry(&test_chain->match_list, TfwHttpMatchRule,
+				 list);
+	EXPECT_NOT_NULL(first->idx);
+
+	/* The compiled chain must return the first matching rule. */
+	for (i = 0; i < ARRAY_SIZE(reqs); ++i) {
+		set_tfw_str(&test_req->uri_path, reqs[i].uri);
+		EXPECT_EQ(reqs[i].id, test_chain_match());
+	}
+}
+
+TEST(http_match, uri_regex)
+{
+	int match_id;
+
+	test_chain_add_rule_str(1, TFW_HTTP_MATCH_F_URI, NULL,
+				"~^/api/v[0-9]+/");
+	test_chain_add_rule_str(2, TFW_HTTP_MATCH_F_URI, NULL,
+				"~\\.(jpe?g|png)$");
+	test_chain_add_rule_str(3, TFW_HTTP_MATCH_F_URI, NULL, "\\~user");
+
+	set_tfw_str(&test_req->uri_path, "/API/V10/users");
+	match_id = test_chain_match();
+	EXPECT_EQ(1, match_id);
+
+	set_tfw_str(&test_req->uri_path, "/api/v/img.JPEG");
+	match_id = test_chain_match();
+	EXPECT_EQ(2, match_id);
+
+	set_tfw_str(&test_req->uri_path, "~user");
+	match_id = test_chain_match();
+	EXPECT_EQ(3, match_id);
+
+	set_tfw_str(&test_req->uri_path, "/api/img.gif");
+	match_id = test_chain_match();
+	EXPECT_EQ(-1, match_id);
+}
+
+TEST(http_match, compiled_chain_regex)
+{
+	static const struct {
+		const char	*uri;
+		int		id;
+	} reqs[] = {
+		{ "/static/img.png",	2 },
+		{ "/img/x.png",		3 },
+		{ "/static/app.js",	4 },
+		{ "/api",		5 },
+		{ "x.js",		6 },
+		{ "/API/V1",		7 },
+		{ "/a/b/c/d",		1 },
+		{ "zzz",		8 },
+		{ "",			-1 },
+	};
+	TfwHttpMatchRule *first;
+	int i;
+
+	test_chain_add_rule_str(1, TFW_HTTP_MATCH_F_URI, NULL, "/a/b/c*");
+	test_chain_add_rule_str(2, TFW_HTTP_MATCH_F_URI, NULL,
+				"~^/static/.*\\.png$");
+	test_chain_add_rule_str(3, TFW_HTTP_MATCH_F_URI, NULL, "*.png");
+	test_chain_add_rule_str(4, TFW_HTTP_MATCH_F_URI, NULL, "~^/static/");
+	test_chain_add_rule_str(5, TFW_HTTP_MATCH_F_URI, NULL, "/api");
+	test_chain_add_rule_str(6, TFW_HTTP_MATCH_F_URI, NULL, "~\\.js$");
+	test_chain_add_rule_str(7, TFW_HTTP_MATCH_F_URI, NULL, "/*");
+	test_chain_add_rule_str(8, TFW_HTTP_MATCH_F_URI, NULL, "~.");
+	test_chain_add_rule_str(9, TFW_HTTP_MATCH_F_URI, NULL, "/api/v1");
+
+	EXPECT_ZERO(tfw_http_chain_compile(test_chain));
+	first = list_first_entry(&test_chain->match_list, TfwHttpMatchRule,
+				 list);
+	EXPECT_NOT_NULL(first->idx);
+
+	for (i = 0; i < ARRAY_SIZE(reqs); ++i) {
+		set_tfw_str(&test_req->uri_path, reqs[i].uri);
+		EXPECT_EQ(reqs[i].id, test_chain_match());
+	}
+}
+
 TEST_SUITE(http_match)
 {
 	TEST_SETUP(http_match_suite_setup);
@@ -516,4 +627,7 @@ TEST_SUITE(http_match)
 	TEST_RUN(http_match, raw_header_eq);
 	TEST_RUN(http_match, raw_header_eq_ws);
 	TEST_RUN(http_match, method_eq);
+	TEST_RUN(http_match, compiled_chain);
+	TEST_RUN(http_match, uri_regex);
+	TEST_RUN(http_match, compiled_chain_regex);
 }
@@ -26,6 +26,8 @@
 #include "helpers.h"
 #include "fuzzer.h"
 
+/* The benchmark hooks are exported by Tempesta FW module. */
+#undef TFW_PARSER_BENCH
 #include "http_parser.c"
 #include "http_sess.c"
 /* prevent exporting symbols */
@@ -1325,6 +1327,35 @@ TEST(http_parser, parses_connection_value)
 	}
 }
 
+TEST(http_parser, parses_connection_upgrade)
+{
+	unsigned int id;
+	DEFINE_TFW_STR(s_upgrade, "Upgrade:");
+
+	FOR_REQ("GET /chat HTTP/1.1\r\n"
+		"Upgrade: websocket\r\n"
+		"Connection: Upgrade\r\n"
+		"\r\n")
+	{
+		EXPECT_TRUE(test_bit(TFW_HTTP_B_CONN_UPGRADE, req->flags));
+		EXPECT_FALSE(test_bit(TFW_HTTP_B_CONN_EXTRA, req->flags));
+		id = tfw_http_msg_hdr_lookup((TfwHttpMsg *)req, &s_upgrade);
+		EXPECT_TRUE(req->h_tbl->tbl[id].flags & TFW_STR_HBH_HDR);
+	}
+
+	FOR_RESP("HTTP/1.1 101 Switching Protocols\r\n"
+		 "Connection: upgrade, keep-alive\r\n"
+		 "Upgrade: websocket\r\n"
+		 "\r\n")
+	{
+		EXPECT_TRUE(test_bit(TFW_HTTP_B_CONN_UPGRADE, resp->flags));
+		EXPECT_TRUE(test_bit(TFW_HTTP_B_CONN_KA, resp->flags));
+		EXPECT_FALSE(test_bit(TFW_HTTP_B_CONN_EXTRA, resp->flags));
+		id = tfw_http_msg_hdr_lookup((TfwHttpMsg *)resp, &s_upgrade);
+		EXPECT_TRUE(resp->h_tbl->tbl[id].flags & TFW_STR_HBH_HDR);
+	}
+}
+
 TEST(http_parser, content_length)
 {
 	EXPECT_BLOCK_REQ("GET / HTTP/1.1\r\n"
@@ -1768,6 +1799,20 @@ TEST(http_parser, chunk_size)
 		"abcdefg\r\n"
 		"0\r\n"
 		"\r\n");
+
+	FOR_REQ("POST / HTTP/1.1\r\n"
+		"Host:\r\n"
+		"Transfer-Encoding: chunked\r\n"
+		"\r\n"
+		"1A\r\n"
+		"abcdefghijklmnopqrstuvwxyz\r\n"
+		"b\r\n"
+		"0123456789a\r\n"
+		"000000000000000\r\n"
+		"\r\n")
+	{
+		EXPECT_EQ(req->body.len, 65);
+	}
 }
 
 TEST(http_parser, cookie)
@@ -1868,6 +1913,159 @@ TEST(http_parser, cookie)
 		"\r\n");
 }
 
+TEST(http_parser, lazy_hdrs)
+{
+	tfw_http_parse_need(TFW_HTTP_PARSE_CACHE, false);
+	tfw_http_parse_need(TFW_HTTP_PARSE_STICKY, false);
+
+	FOR_REQ("GET / HTTP/1.1\r\n"
+		"Host: g.com\r\n"
+		"Accept: text/html\r\n"
+		"Cache-Control: no-cache, max-age=5\r\n"
+		"Pragma: no-cache\r\n"
+		"Cookie: session=42; theme=dark\r\n"
+		"\r\n")
+	{
+		TfwStr *c, *end;
+		TfwStr *cookie = &req->h_tbl->tbl[TFW_HTTP_HDR_COOKIE];
+
+		EXPECT_FALSE(test_bit(TFW_HTTP_B_ACCEPT_HTML, req->flags));
+		EXPECT_FALSE(req->cache_ctl.flags);
+		EXPECT_TRUE(tfw_str_eq_cstr(cookie,
+					    "Cookie: session=42; theme=dark",
+					    30, 0));
+		TFW_STR_FOR_EACH_CHUNK(c, cookie, end)
+			EXPECT_FALSE(c->flags & (TFW_STR_NAME | TFW_STR_VALUE));
+	}
+
+	/* The values are just delimited, but still must be valid. */
+	EXPECT_BLOCK_REQ("GET / HTTP/1.1\r\n"
+			 "Host: g.com\r\n"
+			 "Cache-Control: no-cache\x7f\r\n"
+			 "\r\n");
+
+	tfw_http_parse_need(TFW_HTTP_PARSE_CACHE, true);
+	tfw_http_parse_need(TFW_HTTP_PARSE_STICKY, true);
+
+	FOR_REQ("GET / HTTP/1.1\r\n"
+		"Host: g.com\r\n"
+		"Accept: text/html\r\n"
+		"Cache-Control: no-cache\r\n"
+		"\r\n")
+	{
+		EXPECT_TRUE(test_bit(TFW_HTTP_B_ACCEPT_HTML, req->flags));
+		EXPECT_TRUE(req->cache_ctl.flags & TFW_HTTP_CC_NO_CACHE);
+	}
+}
+
+#define HDR_LOOKUP(s, len)						\
+	__req_hdr_lookup((const unsigned char *)(s), len)
+
+TEST(http_parser, hdr_names_hash)
+{
+	int i, n = 0;
+
+	for (i = 0; i < TFW_REQ_HDR_SLOTS; ++i) {
+		const TfwReqHdrName *e = &tfw_req_hdr_tbl[i];
+
+		if (!e->len)
+			continue;
+		++n;
+		EXPECT_EQ(strlen(e->name), e->len);
+		EXPECT_EQ(__REQ_HDR_HASH(e->len, e->name[0],
+					 e->name[e->len - 1]), i);
+		EXPECT_EQ(HDR_LOOKUP(e->name, e->len), e->id);
+	}
+	/* A collision overrides a slot. */
+	EXPECT_EQ(n, _TFW_REQ_HDR_NUM);
+
+	EXPECT_EQ(HDR_LOOKUP("HoSt", 4), TFW_REQ_HDR_HOST);
+	EXPECT_EQ(HDR_LOOKUP("hosT-x", 6), -1);
+	EXPECT_EQ(HDR_LOOKUP("cookiE", 6), TFW_REQ_HDR_COOKIE);
+	/* Same slot as Cookie. */
+	EXPECT_EQ(HDR_LOOKUP("cxxxxe", 6), -1);
+
+	FOR_REQ("GET / HTTP/1.1\r\n"
+		"HOST: g.com\r\n"
+		"user-AGENT: UA\r\n"
+		"X-Forwarded-FOR: 1.2.3.4\r\n"
+		"Hostx: h.com\r\n"
+		"\r\n")
+	{
+		TfwStr *ht = req->h_tbl->tbl;
+
+		EXPECT_TRUE(tfw_str_eq_cstr(&ht[TFW_HTTP_HDR_HOST],
+					    "HOST: g.com", 11, 0));
+		EXPECT_TRUE(tfw_str_eq_cstr(&ht[TFW_HTTP_HDR_USER_AGENT],
+					    "user-AGENT: UA", 14, 0));
+		EXPECT_TRUE(tfw_str_eq_cstr(&ht[TFW_HTTP_HDR_X_FORWARDED_FOR],
+					    "X-Forwarded-FOR: 1.2.3.4", 24, 0));
+		EXPECT_TRUE(tfw_str_eq_cstr(&ht[TFW_HTTP_HDR_RAW],
+					    "Hostx: h.com", 12, 0));
+	}
+}
+
+TEST(http_parser, raw_hdr_idx)
+{
+	int i;
+	char name[] = "x-hdr-00:";
+	DEFINE_TFW_STR(s_name, name);
+	DEFINE_TFW_STR(s_none, "X-Hdr-26:");
+
+	/*
+	 * More raw headers than the index can hold, so the last of them are
+	 * looked up one by one.
+	 */
+	FOR_REQ("GET / HTTP/1.1\r\n"
+		"X-Hdr-00: 0\r\n"
+		"X-Hdr-01: 1\r\n"
+		"X-Hdr-02: 2\r\n"
+		"X-Hdr-03: 3\r\n"
+		"X-Hdr-04: 4\r\n"
+		"X-Hdr-05: 5\r\n"
+		"X-Hdr-06: 6\r\n"
+		"X-Hdr-07: 7\r\n"
+		"X-Hdr-08: 8\r\n"
+		"X-Hdr-09: 9\r\n"
+		"X-Hdr-10: 10\r\n"
+		"X-Hdr-11: 11\r\n"
+		"X-Hdr-12: 12\r\n"
+		"X-Hdr-13: 13\r\n"
+		"X-Hdr-14: 14\r\n"
+		"X-Hdr-15: 15\r\n"
+		"X-Hdr-16: 16\r\n"
+		"X-Hdr-17: 17\r\n"
+		"X-Hdr-18: 18\r\n"
+		"X-Hdr-19: 19\r\n"
+		"X-Hdr-20: 20\r\n"
+		"X-Hdr-21: 21\r\n"
+		"X-Hdr-22: 22\r\n"
+		"X-Hdr-23: 23\r\n"
+		"X-Hdr-24: 24\r\n"
+		"X-Hdr-25: 25\r\n"
+		"x-HDR-03: 3\r\n"
+		"X-Hdr-25: 25\r\n"
+		"\r\n")
+	{
+		TfwHttpHdrTbl *ht = req->h_tbl;
+
+		EXPECT_EQ(ht->off, TFW_HTTP_HDR_RAW + 26);
+		EXPECT_EQ(ht->idx_off, TFW_HTTP_HDR_RAW + TFW_HHTBL_IDX_MAX);
+		EXPECT_TRUE(TFW_STR_DUP(&ht->tbl[TFW_HTTP_HDR_RAW + 3]));
+		EXPECT_TRUE(TFW_STR_DUP(&ht->tbl[TFW_HTTP_HDR_RAW + 25]));
+
+		for (i = 0; i < 26; ++i) {
+			name[6] = '0' + i / 10;
+			name[7] = '0' + i % 10;
+			EXPECT_EQ(tfw_http_msg_hdr_lookup((TfwHttpMsg *)req,
+							  &s_name),
+				  TFW_HTTP_HDR_RAW + i);
+		}
+		EXPECT_EQ(tfw_http_msg_hdr_lookup((TfwHttpMsg *)req, &s_none),
+			  ht->off);
+	}
+}
+
 TEST(http_parser, set_cookie)
 {
 	FOR_RESP("HTTP/1.1 200 OK\r\n"
@@ -3280,6 +3478,7 @@ TEST_SUITE(http_parser)
 	TEST_RUN(http_parser, cache_control_flags);
 	TEST_RUN(http_parser, suspicious_x_forwarded_for);
 	TEST_RUN(http_parser, parses_connection_value);
+	TEST_RUN(http_parser, parses_connection_upgrade);
 	TEST_RUN(http_parser, content_length);
 	TEST_RUN(http_parser, eol_crlf);
 	TEST_RUN(http_parser, crlf_trailer);
@@ -3290,6 +3489,9 @@ TEST_SUITE(http_parser)
 	TEST_RUN(http_parser, chunked);
 	TEST_RUN(http_parser, chunk_size);
 	TEST_RUN(http_parser, cookie);
+	TEST_RUN(http_parser, lazy_hdrs);
+	TEST_RUN(http_parser, hdr_names_hash);
+	TEST_RUN(http_parser, raw_hdr_idx);
 	TEST_RUN(http_parser, set_cookie);
 	TEST_RUN(http_parser, etag);
 	TEST_RUN(http_parser, if_none_match);
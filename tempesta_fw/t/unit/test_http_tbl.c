@@ -364,6 +364,96 @@ TEST(http_tbl, one_rule)
 	}
 }
 
+TEST(http_tbl, by_host)
+{
+	int i;
+	static const struct {
+		const char	*rules;
+		bool		by_host;
+	} cases[] = {
+		{ "http_chain {\n -> default;\n}\n", true },
+		{ "http_chain {\nhost == natsys-lab.com -> default;\n}\n",
+		  true },
+		{ "http_chain {\nuri == /foo -> default;\n}\n", false },
+		{ "http_chain {\nhdr Host == natsys-lab.com -> default;\n}\n",
+		  false },
+		{ "http_chain {\nhost == natsys-lab.com -> mark = 1;\n"
+		  " -> default;\n}\n", false },
+	};
+
+	for (i = 0; i < ARRAY_SIZE(cases); ++i) {
+		TfwSrvGroup *sg;
+		char cfg[256];
+
+		sg = test_create_sg("default");
+		test_create_srv("127.0.0.1", sg);
+		test_start_sg(sg, "ratio", TFW_SG_F_SCHED_RATIO_STATIC);
+
+		snprintf(cfg, sizeof(cfg),
+			 "vhost default {\nproxy_pass default;\n}\n%s",
+			 cases[i].rules);
+		if (parse_cfg(cfg))
+			TEST_FAIL("can't parse rules\n");
+
+		EXPECT_EQ(tfw_http_tbl_by_host(), cases[i].by_host);
+
+		cleanup_cfg();
+		test_sg_release_all();
+	}
+}
+
+TEST(http_tbl, vhost_by_host)
+{
+	int i;
+	TfwServer *srv;
+	TfwSrvGroup *sg[4];
+	TfwSrvConn *conn[4];
+	TfwVhost *vhost;
+	TfwStr sni = TFW_STR_STRING("z.b.example.com");
+
+	for (i = 0; i < ARRAY_SIZE(sg); ++i) {
+		char name[8];
+
+		snprintf(name, sizeof(name), "sg%d", i);
+		sg[i] = test_create_sg(name);
+		srv = test_create_srv("127.0.0.1", sg[i]);
+		conn[i] = test_create_srv_conn(srv);
+		test_start_sg(sg[i], "ratio", TFW_SG_F_SCHED_RATIO_STATIC);
+	}
+
+	if (parse_cfg("vhost a.example.com {\nproxy_pass sg0;\n}\n\
+		       vhost \"*.example.com\" {\nproxy_pass sg1;\n}\n\
+		       vhost \"*.b.example.com\" {\nproxy_pass sg2;\n}\n\
+		       vhost default {\nproxy_pass sg3;\n}\n\
+		       http_chain {\n -> host;\n}\n"))
+	{
+		TEST_FAIL("can't parse rules\n");
+	}
+
+	test_req("GET http://a.example.com/ HTTP/1.1\r\n\r\n", conn[0]);
+	test_req("GET / HTTP/1.1\r\nHost: A.Example.com:8080\r\n\r\n",
+		 conn[0]);
+	test_req("GET http://x.example.com/ HTTP/1.1\r\n\r\n", conn[1]);
+	test_req("GET http://b.example.com/ HTTP/1.1\r\n\r\n", conn[1]);
+	test_req("GET http://y.b.example.com/ HTTP/1.1\r\n\r\n", conn[2]);
+	test_req("GET http://example.com/ HTTP/1.1\r\n\r\n", conn[3]);
+	test_req("GET http://xexample.com/ HTTP/1.1\r\n\r\n", conn[3]);
+
+	vhost = tfw_vhost_lookup(&sni);
+	EXPECT_NOT_NULL(vhost);
+	if (vhost) {
+		EXPECT_ZERO(strcmp(vhost->name.data, "*.b.example.com"));
+		tfw_vhost_put(vhost);
+	}
+	sni = TFW_STR_STRING("example.org");
+	EXPECT_NULL(tfw_vhost_lookup(&sni));
+
+	cleanup_cfg();
+	for (i = 0; i < ARRAY_SIZE(sg); ++i)
+		test_conn_release_all(sg[i]);
+	test_sg_release_all();
+}
+
 TEST_SUITE(http_tbl)
 {
 	TfwScheduler *s;
@@ -382,4 +472,6 @@ TEST_SUITE(http_tbl)
 	TEST_RUN(http_tbl, one_wildcard_rule);
 	TEST_RUN(http_tbl, some_rules);
 	TEST_RUN(http_tbl, one_rule);
+	TEST_RUN(http_tbl, by_host);
+	TEST_RUN(http_tbl, vhost_by_host);
 }
@@ -0,0 +1,192 @@
+/**
+ *		Tempesta FW
+ *
+ * Copyright (C) 2020 Tempesta Technologies, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#include <linux/inet.h>
+
+#include "test.h"
+#include "lpm.h"
+
+#include "lpm.c"
+
+static struct in6_addr
+test_ip4(const char *str)
+{
+	struct in6_addr a;
+	__be32 a4 = 0;
+
+	BUG_ON(!in4_pton(str, -1, (u8 *)&a4, -1, NULL));
+	ipv6_addr_set_v4mapped(a4, &a);
+
+	return a;
+}
+
+static struct in6_addr
+test_ip6(const char *str)
+{
+	struct in6_addr a;
+
+	BUG_ON(!in6_pton(str, -1, a.s6_addr, -1, NULL));
+
+	return a;
+}
+
+static void
+test_lpm_insert4(TfwLpm *lpm, const char *addr, unsigned int plen,
+		 unsigned char val)
+{
+	struct in6_addr a = test_ip4(addr);
+
+	EXPECT_ZERO(tfw_lpm_insert(lpm, &a, plen + 96, val));
+}
+
+static void
+test_lpm_insert6(TfwLpm *lpm, const char *addr, unsigned int plen,
+		 unsigned char val)
+{
+	struct in6_addr a = test_ip6(addr);
+
+	EXPECT_ZERO(tfw_lpm_insert(lpm, &a, plen, val));
+}
+
+#define EXPECT_LPM4(lpm, addr, val)					\
+do {									\
+	struct in6_addr __a = test_ip4(addr);				\
+	EXPECT_EQ(tfw_lpm_lookup(lpm, &__a), val);			\
+} while (0)
+
+#define EXPECT_LPM6(lpm, addr, val)					\
+do {									\
+	struct in6_addr __a = test_ip6(addr);				\
+	EXPECT_EQ(tfw_lpm_lookup(lpm, &__a), val);			\
+} while (0)
+
+TEST(tfw_lpm, empty)
+{
+	TfwLpm *lpm = tfw_lpm_new();
+
+	EXPECT_NOT_NULL(lpm);
+	if (!lpm)
+		return;
+	EXPECT_LPM4(lpm, "10.0.0.1", 0);
+	EXPECT_LPM6(lpm, "2001:db8::1", 0);
+
+	tfw_lpm_free(lpm);
+}
+
+TEST(tfw_lpm, ipv4_longest_match)
+{
+	TfwLpm *lpm = tfw_lpm_new();
+
+	EXPECT_NOT_NULL(lpm);
+	if (!lpm)
+		return;
+	/* Longer prefixes inserted before and after shorter ones. */
+	test_lpm_insert4(lpm, "10.1.2.0", 24, 3);
+	test_lpm_insert4(lpm, "10.0.0.0", 8, 1);
+	test_lpm_insert4(lpm, "10.1.0.0", 16, 2);
+	test_lpm_insert4(lpm, "192.168.1.7", 32, 4);
+
+	EXPECT_LPM4(lpm, "10.200.0.1", 1);
+	EXPECT_LPM4(lpm, "10.1.200.1", 2);
+	EXPECT_LPM4(lpm, "10.1.2.255", 3);
+	EXPECT_LPM4(lpm, "192.168.1.7", 4);
+	EXPECT_LPM4(lpm, "192.168.1.6", 0);
+	EXPECT_LPM4(lpm, "11.0.0.1", 0);
+	/* IPv4 prefixes don't match IPv6 addresses. */
+	EXPECT_LPM6(lpm, "a00::1", 0);
+
+	tfw_lpm_free(lpm);
+}
+
+TEST(tfw_lpm, unaligned_prefixes)
+{
+	TfwLpm *lpm = tfw_lpm_new();
+
+	EXPECT_NOT_NULL(lpm);
+	if (!lpm)
+		return;
+	test_lpm_insert4(lpm, "172.16.0.0", 12, 1);
+	test_lpm_insert4(lpm, "172.20.0.0", 14, 2);
+	test_lpm_insert4(lpm, "1.2.3.4", 31, 3);
+
+	EXPECT_LPM4(lpm, "172.15.255.255", 0);
+	EXPECT_LPM4(lpm, "172.16.0.1", 1);
+	EXPECT_LPM4(lpm, "172.19.0.1", 1);
+	EXPECT_LPM4(lpm, "172.20.0.1", 2);
+	EXPECT_LPM4(lpm, "172.23.255.255", 2);
+	EXPECT_LPM4(lpm, "172.24.0.1", 1);
+	EXPECT_LPM4(lpm, "172.32.0.1", 0);
+	EXPECT_LPM4(lpm, "1.2.3.4", 3);
+	EXPECT_LPM4(lpm, "1.2.3.5", 3);
+	EXPECT_LPM4(lpm, "1.2.3.6", 0);
+
+	tfw_lpm_free(lpm);
+}
+
+TEST(tfw_lpm, ipv6)
+{
+	TfwLpm *lpm = tfw_lpm_new();
+
+	EXPECT_NOT_NULL(lpm);
+	if (!lpm)
+		return;
+	test_lpm_insert6(lpm, "2001:db8::", 32, 1);
+	test_lpm_insert6(lpm, "2001:db8:1::", 47, 2);
+	test_lpm_insert6(lpm, "2001:db8:1::1", 128, 3);
+
+	EXPECT_LPM6(lpm, "2001:db8:ffff::1", 1);
+	EXPECT_LPM6(lpm, "2001:db8:1:1::1", 2);
+	EXPECT_LPM6(lpm, "2001:db8:1::1", 3);
+	EXPECT_LPM6(lpm, "2001:db8:1::2", 2);
+	EXPECT_LPM6(lpm, "2001:db9::1", 0);
+	EXPECT_LPM4(lpm, "32.1.13.184", 0);
+
+	tfw_lpm_free(lpm);
+}
+
+TEST(tfw_lpm, default_prefixes)
+{
+	TfwLpm *lpm = tfw_lpm_new();
+
+	EXPECT_NOT_NULL(lpm);
+	if (!lpm)
+		return;
+	/* ::/0 covers IPv4-mapped addresses as well. */
+	test_lpm_insert6(lpm, "::", 0, 1);
+	EXPECT_LPM6(lpm, "2001:db8::1", 1);
+	EXPECT_LPM4(lpm, "10.0.0.1", 1);
+
+	/* ::ffff:0:0/96 is more specific for all IPv4 addresses. */
+	test_lpm_insert4(lpm, "0.0.0.0", 0, 2);
+	test_lpm_insert4(lpm, "10.0.0.0", 8, 3);
+	EXPECT_LPM6(lpm, "2001:db8::1", 1);
+	EXPECT_LPM4(lpm, "11.0.0.1", 2);
+	EXPECT_LPM4(lpm, "10.0.0.1", 3);
+
+	tfw_lpm_free(lpm);
+}
+
+TEST_SUITE(lpm)
+{
+	TEST_RUN(tfw_lpm, empty);
+	TEST_RUN(tfw_lpm, ipv4_longest_match);
+	TEST_RUN(tfw_lpm, unaligned_prefixes);
+	TEST_RUN(tfw_lpm, ipv6);
+	TEST_RUN(tfw_lpm, default_prefixes);
+}
@@ -0,0 +1,135 @@
+/**
+ *		Tempesta FW
+ *
+ * Copyright (C) 2020 Tempesta Technologies, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#include "test.h"
+#include "mtree.h"
+
+#include "mtree.c"
+
+#define KEY(o, a)	{ .op = TFW_HTTP_MATCH_O_##o, .mask = ~0UL,	\
+			  .arg = a, .len = sizeof(a) - 1 }
+
+static unsigned int
+test_mtree_match(const TfwMtree *t, const char *str, unsigned long mask)
+{
+	TfwStr s = { .data = (char *)str, .len = strlen(str) };
+
+	return tfw_mtree_match(t, &s, mask);
+}
+
+TEST(tfw_mtree, first_match)
+{
+	static const TfwMtreeKey keys[] = {
+		KEY(EQ, "/static/index.html"),
+		KEY(SUFFIX, ".jpg"),
+		KEY(PREFIX, "/static/"),
+		KEY(REGEX, "^/img/[0-9]+$"),
+		KEY(PREFIX, "/"),
+		KEY(WILDCARD, "*"),
+	};
+	TfwMtree *t = tfw_mtree_new(keys, ARRAY_SIZE(keys));
+
+	EXPECT_FALSE(IS_ERR(t));
+	if (IS_ERR(t))
+		return;
+	EXPECT_EQ(test_mtree_match(t, "/static/index.html", ~0UL), 0);
+	EXPECT_EQ(test_mtree_match(t, "/STATIC/INDEX.HTML", ~0UL), 0);
+	EXPECT_EQ(test_mtree_match(t, "/static/index.htm", ~0UL), 2);
+	EXPECT_EQ(test_mtree_match(t, "/static/x.JPG", ~0UL), 1);
+	EXPECT_EQ(test_mtree_match(t, "/img/12", ~0UL), 3);
+	EXPECT_EQ(test_mtree_match(t, "/img/12a", ~0UL), 4);
+	EXPECT_EQ(test_mtree_match(t, "img", ~0UL), 5);
+	tfw_mtree_free(t);
+}
+
+TEST(tfw_mtree, mask)
+{
+	TfwMtreeKey keys[] = {
+		KEY(PREFIX, "/a/"),
+		KEY(PREFIX, "/a/b/"),
+		KEY(EQ, "/a/b/c"),
+	};
+	TfwMtree *t;
+
+	keys[0].mask = 1UL << 1;
+	keys[1].mask = 1UL << 2 | 1UL << 3;
+	keys[2].mask = 1UL << 3;
+	t = tfw_mtree_new(keys, ARRAY_SIZE(keys));
+
+	EXPECT_FALSE(IS_ERR(t));
+	if (IS_ERR(t))
+		return;
+	EXPECT_EQ(test_mtree_match(t, "/a/b/c", 1UL << 1), 0);
+	EXPECT_EQ(test_mtree_match(t, "/a/b/c", 1UL << 2), 1);
+	EXPECT_EQ(test_mtree_match(t, "/a/b/c", 1UL << 3), 1);
+	EXPECT_EQ(test_mtree_match(t, "/a/b/c", 1UL << 4), TFW_MTREE_NOMATCH);
+	EXPECT_EQ(test_mtree_match(t, "/a/x", 1UL << 2), TFW_MTREE_NOMATCH);
+	tfw_mtree_free(t);
+}
+
+TEST(tfw_mtree, chunked_string)
+{
+	static const TfwMtreeKey keys[] = {
+		KEY(EQ, "/foo/bar"),
+		KEY(SUFFIX, "r.html"),
+		KEY(PREFIX, "/foo/"),
+	};
+	TfwStr s = {
+		.chunks = (TfwStr []){
+			{ .data = "/fo",	.len = 3 },
+			{ .data = "o/ba",	.len = 4 },
+			{ .data = "r.html",	.len = 6 },
+		},
+		.len = 13,
+		.nchunks = 3
+	};
+	TfwMtree *t = tfw_mtree_new(keys, ARRAY_SIZE(keys));
+
+	EXPECT_FALSE(IS_ERR(t));
+	if (IS_ERR(t))
+		return;
+	EXPECT_EQ(tfw_mtree_match(t, &s, ~0UL), 1);
+	s.chunks[2].len = 1;
+	s.len = 8;
+	EXPECT_EQ(tfw_mtree_match(t, &s, ~0UL), 0);
+	s.nchunks = 2;
+	s.len = 7;
+	EXPECT_EQ(tfw_mtree_match(t, &s, ~0UL), 2);
+	tfw_mtree_free(t);
+}
+
+TEST(tfw_mtree, empty)
+{
+	TfwMtree *t = tfw_mtree_new(NULL, 0);
+
+	EXPECT_FALSE(IS_ERR(t));
+	if (IS_ERR(t))
+		return;
+	EXPECT_EQ(test_mtree_match(t, "/", ~0UL), TFW_MTREE_NOMATCH);
+	EXPECT_EQ(test_mtree_match(t, "", ~0UL), TFW_MTREE_NOMATCH);
+	tfw_mtree_free(t);
+}
+
+TEST_SUITE(mtree)
+{
+	TEST_RUN(tfw_mtree, first_match);
+	TEST_RUN(tfw_mtree, mask);
+	TEST_RUN(tfw_mtree, chunked_string);
+	TEST_RUN(tfw_mtree, empty);
+}
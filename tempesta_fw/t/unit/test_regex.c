@@ -0,0 +1,163 @@
+/**
+ *		Tempesta FW
+ *
+ * Copyright (C) 2020 Tempesta Technologies, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#include "test.h"
+#include "regex.h"
+
+#include "regex.c"
+
+static int
+test_regex_compile(TfwRegex *re, const char **pats, unsigned int n)
+{
+	TfwStr s[8];
+	unsigned int i;
+
+	BUG_ON(n > ARRAY_SIZE(s));
+	for (i = 0; i < n; ++i) {
+		TFW_STR_INIT(&s[i]);
+		s[i].data = (char *)pats[i];
+		s[i].len = strlen(pats[i]);
+	}
+
+	return tfw_regex_compile(re, s, n);
+}
+
+static unsigned int
+test_regex_match(const TfwRegex *re, const char *str)
+{
+	TfwStr s = { .data = (char *)str, .len = strlen(str) };
+
+	return tfw_regex_match(re, &s);
+}
+
+#define EXPECT_REGEX(pat, str, m)					\
+do {									\
+	TfwRegex __re;							\
+	const char *__p = pat;						\
+									\
+	EXPECT_ZERO(test_regex_compile(&__re, &__p, 1));		\
+	EXPECT_EQ(test_regex_match(&__re, str), (m) ? 0 : UINT_MAX);	\
+	tfw_regex_free(&__re);						\
+} while (0)
+
+TEST(tfw_regex, anchors)
+{
+	EXPECT_REGEX("abc", "xxabcxx", true);
+	EXPECT_REGEX("^abc", "xxabc", false);
+	EXPECT_REGEX("^abc", "abcd", true);
+	EXPECT_REGEX("abc$", "zabc", true);
+	EXPECT_REGEX("^abc$", "abcd", false);
+	EXPECT_REGEX("^abc$", "ABC", true);
+	EXPECT_REGEX("^$", "", true);
+	EXPECT_REGEX("^$", "a", false);
+	EXPECT_REGEX("", "any", true);
+	EXPECT_REGEX("a\\$", "a$", true);
+	EXPECT_REGEX("a\\$", "a", false);
+}
+
+TEST(tfw_regex, syntax)
+{
+	EXPECT_REGEX("^/api/v[0-9]+/", "/api/v12/users", true);
+	EXPECT_REGEX("^/api/v[0-9]+/", "/api/v/users", false);
+	EXPECT_REGEX("\\.(php|cgi)$", "/a/b.PHP", true);
+	EXPECT_REGEX("\\.(php|cgi)$", "/a/b.php5", false);
+	EXPECT_REGEX("^a{2,3}$", "aa", true);
+	EXPECT_REGEX("^a{2,3}$", "aaaa", false);
+	EXPECT_REGEX("^a{2,}$", "aaaaa", true);
+	EXPECT_REGEX("^(ab){2}c?$", "ababc", true);
+	EXPECT_REGEX("^(ab){0,1}$", "", true);
+	EXPECT_REGEX("^[^a-c]+$", "xyz", true);
+	EXPECT_REGEX("^[^a-c]+$", "xAz", false);
+	EXPECT_REGEX("^[]a]$", "]", true);
+	EXPECT_REGEX("^[a-]$", "-", true);
+	EXPECT_REGEX("^\\d\\w\\s$", "1a ", true);
+	EXPECT_REGEX("^\\D$", "1", false);
+	EXPECT_REGEX(".*x.*y", "aaxbby", true);
+}
+
+TEST(tfw_regex, invalid)
+{
+	static const char *pats[] = {
+		"(", "a)", "[a", "a**", "^^a", "a$b", "a{3,2}", "\\", "*a",
+		"a{256}"
+	};
+	TfwRegex re;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(pats); ++i)
+		EXPECT_EQ(test_regex_compile(&re, &pats[i], 1), -EINVAL);
+}
+
+TEST(tfw_regex, too_complex)
+{
+	/* The DFA for the n-th byte from the end has 2^n states. */
+	const char *pat = "a(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)"
+			  "(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)";
+	TfwRegex re;
+
+	EXPECT_EQ(test_regex_compile(&re, &pat, 1), -E2BIG);
+}
+
+TEST(tfw_regex, first_matching_pattern)
+{
+	static const char *pats[] = {
+		"^/static/", "\\.jpg$", "^/static/x\\.jpg$", "img"
+	};
+	TfwRegex re;
+
+	EXPECT_ZERO(test_regex_compile(&re, pats, ARRAY_SIZE(pats)));
+	EXPECT_EQ(test_regex_match(&re, "/static/x.jpg"), 0);
+	EXPECT_EQ(test_regex_match(&re, "/s/x.jpg"), 1);
+	EXPECT_EQ(test_regex_match(&re, "/img/x.JPG"), 1);
+	EXPECT_EQ(test_regex_match(&re, "/img/x"), 3);
+	EXPECT_EQ(test_regex_match(&re, "/q"), TFW_REGEX_NOMATCH);
+	tfw_regex_free(&re);
+}
+
+TEST(tfw_regex, chunked_string)
+{
+	static const char *pats[] = { "^/foo/[a-z]+\\.htm$", "bar" };
+	TfwRegex re;
+	TfwStr s = {
+		.chunks = (TfwStr []){
+			{ .data = "/fo",	.len = 3 },
+			{ .data = "o/ba",	.len = 4 },
+			{ .data = "r.html",	.len = 6 },
+		},
+		.len = 13,
+		.nchunks = 3
+	};
+
+	EXPECT_ZERO(test_regex_compile(&re, pats, ARRAY_SIZE(pats)));
+	EXPECT_EQ(tfw_regex_match(&re, &s), 1);
+	s.nchunks = 2;
+	s.len = 7;
+	EXPECT_EQ(tfw_regex_match(&re, &s), TFW_REGEX_NOMATCH);
+	tfw_regex_free(&re);
+}
+
+TEST_SUITE(regex)
+{
+	TEST_RUN(tfw_regex, anchors);
+	TEST_RUN(tfw_regex, syntax);
+	TEST_RUN(tfw_regex, invalid);
+	TEST_RUN(tfw_regex, too_complex);
+	TEST_RUN(tfw_regex, first_matching_pattern);
+	TEST_RUN(tfw_regex, chunked_string);
+}
@@ -172,6 +172,66 @@ err:
 	test_sg_release_all();
 }
 
+TEST(tfw_sched_hash, sched_sg_bounded_load)
+{
+	size_t i, j;
+	TfwHashGrp *hg;
+	TfwSrvConn *srv_conn, *home_conn;
+
+	TfwSrvGroup *sg = test_create_sg("test");
+
+	for (i = 0; i < TFW_TEST_SG_MAX_SRV_N; ++i) {
+		TfwServer *srv = test_create_srv("127.0.0.1", sg);
+
+		for (j = 0; j < TFW_TEST_SRV_MAX_CONN_N; ++j)
+			test_create_srv_conn(srv);
+	}
+	test_start_sg(sg, sched_helper_hash.sched, TFW_SG_F_SCHED_HASH_BOUNDED);
+	hg = rcu_dereference_bh_check(sg->sched_data, 1);
+
+	/*
+	 * Overload the home connection and check that the requests are
+	 * spilled to the same another connection.
+	 */
+	for (i = 0; i < sched_helper_hash.conn_types; ++i) {
+		TfwMsg *msg = sched_helper_hash.get_sched_arg(i);
+		TfwSrvConn *exp_conn = NULL;
+
+		home_conn = sg->sched->sched_sg_conn(msg, sg);
+		EXPECT_NOT_NULL(home_conn);
+		if (!home_conn) {
+			sched_helper_hash.free_sched_arg(msg);
+			goto err;
+		}
+		tfw_srv_conn_put(home_conn);
+
+		WRITE_ONCE(hg->cap, 2);
+		home_conn->qsize = 2;
+
+		for (j = 0; j < TFW_TEST_SRV_MAX_CONN_N; ++j) {
+			srv_conn = sg->sched->sched_sg_conn(msg, sg);
+			EXPECT_NOT_NULL(srv_conn);
+			if (!srv_conn)
+				break;
+			EXPECT_NE(srv_conn, home_conn);
+
+			if (!exp_conn)
+				exp_conn = srv_conn;
+			else
+				EXPECT_EQ(srv_conn, exp_conn);
+
+			tfw_srv_conn_put(srv_conn);
+		}
+
+		home_conn->qsize = 0;
+		WRITE_ONCE(hg->cap, 0);
+		sched_helper_hash.free_sched_arg(msg);
+	}
+err:
+	test_conn_release_all(sg);
+	test_sg_release_all();
+}
+
 TEST(tfw_sched_hash, sched_srv_one_srv_max_conn)
 {
 	size_t i, j;
@@ -292,6 +352,7 @@ TEST_SUITE(sched_hash)
 
 	TEST_RUN(tfw_sched_hash, sched_sg_one_srv_max_conn);
 	TEST_RUN(tfw_sched_hash, sched_sg_max_srv_max_conn);
+	TEST_RUN(tfw_sched_hash, sched_sg_bounded_load);
 
 	TEST_RUN(tfw_sched_hash, sched_srv_one_srv_max_conn);
 	TEST_RUN(tfw_sched_hash, sched_srv_max_srv_max_conn);
@@ -0,0 +1,218 @@
+/**
+ *		Tempesta FW
+ *
+ * Copyright (C) 2020 Tempesta Technologies, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#include <linux/types.h>
+#include <asm/fpu/api.h>
+
+#undef tfw_sock_srv_init
+#define tfw_sock_srv_init test_p2c_sock_srv_conn_init
+#undef tfw_sock_srv_exit
+#define tfw_sock_srv_exit test_p2c_sock_srv_exit
+#undef tfw_srv_conn_release
+#define tfw_srv_conn_release test_p2c_srv_conn_release
+#undef tfw_sock_srv_mod
+#define tfw_sock_srv_mod test_p2c_sock_srv_mod
+
+#include "sock_srv.c"
+#include "http_sched_p2c.c"
+
+#include "helpers.h"
+#include "sched_helper.h"
+#include "server.h"
+#include "http_parser.h"
+#include "test.h"
+
+static TfwMsg *sched_p2c_get_arg(size_t conn_type);
+static void sched_p2c_free_arg(TfwMsg *msg);
+
+static struct TestSchedHelper sched_helper_p2c = {
+	.sched = "p2c",
+	.flags = TFW_PSTATS_IDX_AVG,
+	.conn_types = 1,
+	.get_sched_arg = &sched_p2c_get_arg,
+	.free_sched_arg = &sched_p2c_free_arg,
+};
+
+static TfwMsg *
+sched_p2c_get_arg(size_t conn_type)
+{
+	static char *str = "GET / HTTP/1.1\r\nHost: localhost\r\n\r\n";
+	TfwHttpReq *req = NULL;
+	unsigned int parsed;
+
+	BUG_ON(conn_type >= sched_helper_p2c.conn_types);
+
+	req = test_req_alloc(strlen(str));
+	tfw_http_parse_req(req, str, strlen(str), &parsed);
+
+	return (TfwMsg *)req;
+}
+
+static void
+sched_p2c_free_arg(TfwMsg *msg)
+{
+	test_req_free((TfwHttpReq *)msg);
+}
+
+static void
+test_srv_set_qsize(TfwServer *srv, unsigned int qsize)
+{
+	TfwSrvConn *srv_conn;
+
+	list_for_each_entry(srv_conn, &srv->conn_list, list)
+		srv_conn->qsize = qsize;
+}
+
+TEST(tfw_sched_p2c, sched_sg_max_srv_max_conn)
+{
+	size_t i, j;
+	TfwSrvGroup *sg = test_create_sg("test");
+	TfwServer *srv;
+	TfwSrvConn *srv_conn;
+
+	for (i = 0; i < TFW_TEST_SG_MAX_SRV_N; ++i) {
+		srv = test_create_srv("127.0.0.1", sg);
+
+		for (j = 0; j < TFW_TEST_SRV_MAX_CONN_N; ++j)
+			test_create_srv_conn(srv);
+	}
+	test_start_sg(sg, sched_helper_p2c.sched, sched_helper_p2c.flags);
+
+	/* Each request is scheduled to a connection of the group. */
+	for (i = 0; i < sched_helper_p2c.conn_types; ++i) {
+		TfwMsg *msg = sched_helper_p2c.get_sched_arg(i);
+
+		for (j = 0; j < TFW_TEST_SG_MAX_CONN_N; ++j) {
+			srv_conn = sg->sched->sched_sg_conn(msg, sg);
+			EXPECT_NOT_NULL(srv_conn);
+			if (!srv_conn) {
+				sched_helper_p2c.free_sched_arg(msg);
+				goto err;
+			}
+			EXPECT_EQ(((TfwServer *)srv_conn->peer)->sg, sg);
+
+			tfw_srv_conn_put(srv_conn);
+		}
+		sched_helper_p2c.free_sched_arg(msg);
+	}
+err:
+	test_conn_release_all(sg);
+	test_sg_release_all();
+}
+
+TEST(tfw_sched_p2c, sched_sg_less_loaded_srv)
+{
+	size_t i, j;
+	TfwSrvGroup *sg = test_create_sg("test");
+	TfwServer *srv_busy, *srv_idle;
+	TfwSrvConn *srv_conn;
+
+	srv_busy = test_create_srv("127.0.0.1", sg);
+	srv_idle = test_create_srv("127.0.0.1", sg);
+	for (j = 0; j < TFW_TEST_SRV_MAX_CONN_N; ++j) {
+		test_create_srv_conn(srv_busy);
+		test_create_srv_conn(srv_idle);
+	}
+	test_start_sg(sg, sched_helper_p2c.sched, sched_helper_p2c.flags);
+
+	/*
+	 * With two servers in the group both of them are always compared,
+	 * so all the requests must go to the server with shorter queues.
+	 */
+	test_srv_set_qsize(srv_busy, sg->max_qsize / 2);
+	for (i = 0; i < sched_helper_p2c.conn_types; ++i) {
+		TfwMsg *msg = sched_helper_p2c.get_sched_arg(i);
+
+		for (j = 0; j < TFW_TEST_SRV_MAX_CONN_N; ++j) {
+			srv_conn = sg->sched->sched_sg_conn(msg, sg);
+			EXPECT_NOT_NULL(srv_conn);
+			if (!srv_conn) {
+				sched_helper_p2c.free_sched_arg(msg);
+				goto err;
+			}
+			EXPECT_EQ((TfwServer *)srv_conn->peer, srv_idle);
+
+			tfw_srv_conn_put(srv_conn);
+		}
+		sched_helper_p2c.free_sched_arg(msg);
+	}
+err:
+	test_srv_set_qsize(srv_busy, 0);
+	test_conn_release_all(sg);
+	test_sg_release_all();
+}
+
+TEST(tfw_sched_p2c, sched_srv_max_srv_max_conn)
+{
+	size_t i, j;
+	TfwSrvGroup *sg = test_create_sg("test");
+	TfwServer *srv;
+	TfwSrvConn *srv_conn;
+
+	for (i = 0; i < TFW_TEST_SG_MAX_SRV_N; ++i) {
+		srv = test_create_srv("127.0.0.1", sg);
+
+		for (j = 0; j < TFW_TEST_SRV_MAX_CONN_N; ++j)
+			test_create_srv_conn(srv);
+	}
+	test_start_sg(sg, sched_helper_p2c.sched, sched_helper_p2c.flags);
+
+	for (i = 0; i < sched_helper_p2c.conn_types; ++i) {
+		TfwMsg *msg = sched_helper_p2c.get_sched_arg(i);
+
+		list_for_each_entry(srv, &sg->srv_list, list) {
+			for (j = 0; j < srv->conn_n; ++j) {
+				srv_conn = sg->sched->sched_srv_conn(msg, srv);
+				EXPECT_NOT_NULL(srv_conn);
+				if (!srv_conn) {
+					sched_helper_p2c.free_sched_arg(msg);
+					goto err;
+				}
+				EXPECT_EQ((TfwServer *)srv_conn->peer, srv);
+
+				tfw_srv_conn_put(srv_conn);
+			}
+		}
+		sched_helper_p2c.free_sched_arg(msg);
+	}
+err:
+	test_conn_release_all(sg);
+	test_sg_release_all();
+}
+
+TEST(tfw_sched_p2c, sched_srv_offline_srv)
+{
+	test_sched_srv_offline_srv(&sched_helper_p2c);
+}
+
+TEST_SUITE(sched_p2c)
+{
+	kernel_fpu_end();
+
+	tfw_server_init();
+	tfw_sched_p2c_init();
+
+	kernel_fpu_begin();
+
+	TEST_RUN(tfw_sched_p2c, sched_sg_max_srv_max_conn);
+	TEST_RUN(tfw_sched_p2c, sched_sg_less_loaded_srv);
+
+	TEST_RUN(tfw_sched_p2c, sched_srv_max_srv_max_conn);
+	TEST_RUN(tfw_sched_p2c, sched_srv_offline_srv);
+}
@@ -168,6 +168,56 @@ err:
 	test_sg_release_all();
 }
 
+TEST(tfw_sched_ratio, sched_sg_slow_start_srv)
+{
+	size_t i, j, ss_n = 0;
+	TfwSrvGroup *sg = test_create_sg("test");
+	TfwServer *srv, *srv_ss;
+	TfwSrvConn *srv_conn;
+
+	srv = test_create_srv("127.0.0.1", sg);
+	srv_ss = test_create_srv("127.0.0.1", sg);
+	for (j = 0; j < TFW_TEST_SRV_MAX_CONN_N; ++j) {
+		test_create_srv_conn(srv);
+		test_create_srv_conn(srv_ss);
+	}
+	test_start_sg(sg, sched_helper_ratio.sched, sched_helper_ratio.flags);
+
+	/*
+	 * The slow start has just begun, so the server must get a tiny part
+	 * of its half of the requests.
+	 */
+	sg->slow_start = 3600 * HZ;
+	tfw_srv_slow_start(srv_ss);
+	for (i = 0; i < sched_helper_ratio.conn_types; ++i) {
+		TfwMsg *msg = sched_helper_ratio.get_sched_arg(i);
+
+		for (j = 0; j < 2 * TFW_TEST_SRV_MAX_CONN_N; ++j) {
+			srv_conn = sg->sched->sched_sg_conn(msg, sg);
+			EXPECT_NOT_NULL(srv_conn);
+			if (!srv_conn) {
+				sched_helper_ratio.free_sched_arg(msg);
+				goto err;
+			}
+			ss_n += (TfwServer *)srv_conn->peer == srv_ss;
+
+			tfw_srv_conn_put(srv_conn);
+		}
+		sched_helper_ratio.free_sched_arg(msg);
+	}
+	EXPECT_LT(ss_n, TFW_TEST_SRV_MAX_CONN_N / 4);
+
+	/* The slow start is over, the server gets its share back. */
+	sg->slow_start = 0;
+	EXPECT_EQ(tfw_srv_slow_start_share(srv_ss), TFW_SRV_SS_SCALE);
+	EXPECT_FALSE(test_bit(TFW_SRV_B_SLOW_START, &srv_ss->flags));
+err:
+	sg->slow_start = 0;
+	clear_bit(TFW_SRV_B_SLOW_START, &srv_ss->flags);
+	test_conn_release_all(sg);
+	test_sg_release_all();
+}
+
 TEST(tfw_sched_ratio, sched_srv_one_srv_max_conn)
 {
 	size_t i, j;
@@ -308,6 +358,7 @@ TEST_SUITE(sched_ratio)
 	 */
 	TEST_RUN(tfw_sched_ratio, sched_sg_one_srv_max_conn);
 	TEST_RUN(tfw_sched_ratio, sched_sg_max_srv_max_conn);
+	TEST_RUN(tfw_sched_ratio, sched_sg_slow_start_srv);
 
 	TEST_RUN(tfw_sched_ratio, sched_srv_one_srv_max_conn);
 	TEST_RUN(tfw_sched_ratio, sched_srv_max_srv_max_conn);
@@ -112,6 +112,64 @@ TEST(cstr, simd_match)
 		     "0123\x98x56|95");
 }
 
+#define ACCEPT_HOST	"ABCDEFGHIJKLMNOPQRSTUVWXYZ"			\
+			"abcdefghijklmnopqrstuvwxyz"			\
+			"0123456789.-"
+
+#define __test_match_host(s)						\
+do {									\
+	EXPECT_TRUE(tfw_match_host(s, sizeof(s) - 1)			\
+		    == strspn(s, ACCEPT_HOST));				\
+} while (0)
+
+TEST(cstr, simd_match_host)
+{
+	__test_match_host("");
+	__test_match_host(":");
+	__test_match_host("a");
+	__test_match_host("a:");
+	__test_match_host("abc");
+	__test_match_host("a_bc");
+	__test_match_host("127.0.0.1");
+	__test_match_host("127.0.0.1:8080");
+	__test_match_host("tempesta-tech.com\r\n");
+	__test_match_host("www.tempesta-tech.com ");
+	__test_match_host("user@www.tempesta-tech.com");
+	__test_match_host("www.tempesta-tech.com/index.html");
+	__test_match_host("0123456789abcdefghijklmnopqrstuv"
+			  "WXYZ.-0123456789abcdefghijklmnop"
+			  "qrstuvwxyz\x98");
+	__test_match_host("0123456789abcdefghijklmnopqrstuv"
+			  "WXYZ.-0123456789abcdefghijklmnop"
+			  "qrstuvwxyz-ABCDEFGHIJKLMNOPQRSTU"
+			  "VWXYZ.0123456789-abcdefghijklmno"
+			  "pqrstuvwxyz:443");
+}
+
+#define ACCEPT_XDIGIT	"0123456789abcdefABCDEF"
+
+#define __test_match_xdigit(s)						\
+do {									\
+	EXPECT_TRUE(tfw_match_xdigit(s, sizeof(s) - 1)			\
+		    == strspn(s, ACCEPT_XDIGIT));			\
+} while (0)
+
+TEST(cstr, simd_match_xdigit)
+{
+	__test_match_xdigit("");
+	__test_match_xdigit("\r\n");
+	__test_match_xdigit("0\r\n");
+	__test_match_xdigit("1a;ext=val\r\n");
+	__test_match_xdigit("7FfF\r\n");
+	__test_match_xdigit("fg");
+	__test_match_xdigit("0123456789abcdefABCDEF0123456789"
+			    "abcdef\x86");
+	__test_match_xdigit("0123456789abcdefABCDEF0123456789"
+			    "abcdefABCDEF0123456789abcdefABCD"
+			    "EF0123456789abcdefABCDEF01234567"
+			    "89abcdefABCDEF0123456789abcdefAB:");
+}
+
 static void
 __test_ctext_vchar(const char *str, size_t len)
 {
@@ -1685,6 +1743,8 @@ TEST_SUITE(tfw_str)
 
 	TEST_RUN(cstr, tolower);
 	TEST_RUN(cstr, simd_match);
+	TEST_RUN(cstr, simd_match_host);
+	TEST_RUN(cstr, simd_match_xdigit);
 	TEST_RUN(cstr, simd_match_ctext_vchar);
 	TEST_RUN(cstr, simd_match_custom);
 	TEST_RUN(cstr, simd_strtolower);
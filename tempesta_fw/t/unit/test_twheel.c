@@ -0,0 +1,170 @@
+/**
+ *		Tempesta FW
+ *
+ * Copyright (C) 2020 Tempesta Technologies, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#include "test.h"
+#include "twheel.h"
+
+#include "twheel.c"
+
+static TfwTimerWheel test_w;
+static unsigned int test_fired;
+
+static void
+test_tw_cb(TfwTimer *t)
+{
+	++test_fired;
+}
+
+static void
+test_tw_init(unsigned long clk)
+{
+	memset(&test_w, 0, sizeof(test_w));
+	spin_lock_init(&test_w.lock);
+	test_w.clk = clk;
+	test_fired = 0;
+}
+
+/* Add a timer expiring in @slots slots plus @rem jiffies from the clock. */
+static void
+test_tw_add(TfwTimer *t, unsigned long slots, unsigned long rem)
+{
+	tfw_timer_setup(t, test_tw_cb);
+	t->expires = ((test_w.clk + slots) << TFW_TW_SHIFT) + rem;
+	spin_lock_bh(&test_w.lock);
+	__tfw_tw_add(&test_w, t);
+	spin_unlock_bh(&test_w.lock);
+}
+
+static void
+test_tw_run(unsigned long now)
+{
+	spin_lock_bh(&test_w.lock);
+	__tfw_tw_run(&test_w, now);
+	spin_unlock_bh(&test_w.lock);
+}
+
+TEST(tfw_twheel, fires_after_deadline)
+{
+	TfwTimer t;
+
+	test_tw_init(100);
+	test_tw_add(&t, 2, 1);
+	EXPECT_TRUE(tfw_timer_pending(&t));
+
+	test_tw_run(102);
+	EXPECT_EQ(test_fired, 0);
+	test_tw_run(103);
+	EXPECT_EQ(test_fired, 1);
+	EXPECT_FALSE(tfw_timer_pending(&t));
+	EXPECT_ZERO(test_w.n);
+}
+
+TEST(tfw_twheel, batch)
+{
+	TfwTimer t[4];
+	int i;
+
+	test_tw_init(0);
+	for (i = 0; i < ARRAY_SIZE(t); ++i)
+		test_tw_add(&t[i], 5, 0);
+	EXPECT_EQ(test_w.n, ARRAY_SIZE(t));
+
+	test_tw_run(4);
+	EXPECT_EQ(test_fired, 0);
+	test_tw_run(5);
+	EXPECT_EQ(test_fired, ARRAY_SIZE(t));
+	EXPECT_ZERO(test_w.n);
+}
+
+TEST(tfw_twheel, lazy_extension)
+{
+	TfwTimer t;
+
+	test_tw_init(10);
+	test_tw_add(&t, 4, 0);
+	/* The fast path of tfw_timer_mod(), the timer isn't relinked. */
+	t.expires += 10 << TFW_TW_SHIFT;
+
+	test_tw_run(14);
+	EXPECT_EQ(test_fired, 0);
+	EXPECT_TRUE(tfw_timer_pending(&t));
+	EXPECT_EQ(test_w.n, 1);
+	test_tw_run(23);
+	EXPECT_EQ(test_fired, 0);
+	test_tw_run(24);
+	EXPECT_EQ(test_fired, 1);
+}
+
+TEST(tfw_twheel, cascade)
+{
+	TfwTimer t;
+	unsigned long s = TFW_TW_L0_SZ * 3 + 10;
+
+	test_tw_init(5);
+	test_tw_add(&t, s, 0);
+	EXPECT_TRUE(hlist_empty(&test_w.l0[(5 + s) & TFW_TW_L0_MASK]));
+
+	test_tw_run(4 + s);
+	EXPECT_EQ(test_fired, 0);
+	test_tw_run(5 + s);
+	EXPECT_EQ(test_fired, 1);
+}
+
+TEST(tfw_twheel, beyond_upper_level)
+{
+	TfwTimer t;
+	unsigned long s = TFW_TW_L0_SZ * (TFW_TW_L1_SZ + 5) + 3;
+
+	test_tw_init(0);
+	test_tw_add(&t, s, 0);
+
+	test_tw_run(s - 1);
+	EXPECT_EQ(test_fired, 0);
+	EXPECT_TRUE(tfw_timer_pending(&t));
+	test_tw_run(s);
+	EXPECT_EQ(test_fired, 1);
+}
+
+TEST(tfw_twheel, del)
+{
+	TfwTimer t1, t2;
+
+	test_tw_init(0);
+	test_tw_add(&t1, 3, 0);
+	test_tw_add(&t2, 3, 0);
+	spin_lock_bh(&test_w.lock);
+	__tfw_tw_del(&test_w, &t1);
+	spin_unlock_bh(&test_w.lock);
+	EXPECT_FALSE(tfw_timer_pending(&t1));
+
+	test_tw_run(3);
+	EXPECT_EQ(test_fired, 1);
+	EXPECT_FALSE(tfw_timer_pending(&t2));
+	EXPECT_ZERO(test_w.n);
+}
+
+TEST_SUITE(twheel)
+{
+	TEST_RUN(tfw_twheel, fires_after_deadline);
+	TEST_RUN(tfw_twheel, batch);
+	TEST_RUN(tfw_twheel, lazy_extension);
+	TEST_RUN(tfw_twheel, cascade);
+	TEST_RUN(tfw_twheel, beyond_upper_level);
+	TEST_RUN(tfw_twheel, del);
+}
@@ -301,6 +301,53 @@ TEST(wq, many_prod_one_con)
 	tfw_test_wq_test(JOB_N * num_online_cpus(), 1);
 }
 
+TEST(wq, node_queue_batch)
+{
+	static int done[QSZ];
+	int i, n, node, popped = 0;
+	TfwTestWork items[8];
+	TfwWqStat stat = { 0 };
+	TfwNodeQueue nq = { 0 };
+
+	if (tfw_nq_init(&nq, numa_node_id())) {
+		TEST_FAIL("Cannot initialize node queue\n");
+		return;
+	}
+
+	/* Fill the sub-rings of all the nodes. */
+	for (i = 0; i < QSZ; ) {
+		for_each_node_with_cpus(node) {
+			TfwTestWork wq_item = { &done[i] };
+
+			done[i] = X_MISSED;
+			EXPECT_ZERO(__tfw_wq_push(&nq.rings[node], &wq_item));
+			if (++i == QSZ)
+				break;
+		}
+	}
+	EXPECT_EQ(tfw_nq_size(&nq), QSZ);
+
+	while ((n = tfw_nq_pop_batch(&nq, items, ARRAY_SIZE(items)))) {
+		EXPECT_TRUE(n <= ARRAY_SIZE(items));
+		for (i = 0; i < n; ++i) {
+			EXPECT_EQ(*items[i].work, X_MISSED);
+			*items[i].work = X_DONE;
+		}
+		popped += n;
+	}
+	EXPECT_EQ(popped, QSZ);
+	EXPECT_EQ(tfw_nq_size(&nq), 0);
+	for (i = 0; i < QSZ; ++i)
+		EXPECT_EQ(done[i], X_DONE);
+
+	/* There are no competing producers. */
+	tfw_nq_stat(&nq, &stat);
+	EXPECT_EQ(stat.contended, 0);
+	EXPECT_EQ(stat.full, 0);
+
+	tfw_nq_destroy(&nq);
+}
+
 TEST_SUITE(wq)
 {
 	TEST_SETUP(tfw_test_wq_suite_setup);
@@ -309,4 +356,5 @@ TEST_SUITE(wq)
 	/* The queue is MPSC queue, multiple consumers are not allowed. */
 	TEST_RUN(wq, one_prod_one_con);
 	TEST_RUN(wq, many_prod_one_con);
+	TEST_RUN(wq, node_queue_batch);
 }
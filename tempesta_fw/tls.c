@@ -25,23 +25,65 @@
 #include "msg.h"
 #include "procfs.h"
 #include "http_frame.h"
+#include "http_trace.h"
 #include "tls.h"
+#include "tls_conf.h"
+#include "tls_ticket.h"
 #include "vhost.h"
 
 /**
  * Global level TLS configuration.
  *
  * @cfg			- common tls configuration for all vhosts;
+ * @tickets		- session tickets keys, shared by all the vhosts: the
+ *			  tickets carry the server name hash to not resume
+ *			  a session for another vhost;
  * @allow_any_sni	- If set, all the unknown SNI are matched to default
  *			  vhost.
+ * @sign_cpus		- number of the last online CPUs signing the server
+ *			  handshake flights, zero to sign them in softirq on
+ *			  the receiving CPU;
  */
 static struct {
 	TlsCfg		cfg;
+	TlsTicketCtx	tickets;
 	bool		allow_any_sni;
+	int		sign_cpus;
 } tfw_tls;
 
+/* Size limits of the secret for the shared session tickets keys. */
+#define TFW_TLS_TICKET_SECRET_MIN	32
+#define TFW_TLS_TICKET_SECRET_MAX	256
+
 /* Temporal value for reconfiguration stage. */
 static bool allow_any_sni_reconfig;
+static int tfw_tls_ticket_lifetime;
+static unsigned char tfw_tls_ticket_secret[TFW_TLS_TICKET_SECRET_MAX];
+static size_t tfw_tls_ticket_secret_len;
+static int tfw_tls_sign_cpus;
+
+/*
+ * The handshake signatures are computed with disabled softirqs to use the
+ * per-CPU MPI pools, so the workqueue is bound and runs only one job on a CPU
+ * at a time.
+ */
+static struct workqueue_struct *tfw_tls_sign_wq;
+
+/**
+ * Per-CPU queue of the handshakes waiting for the signature. The connections
+ * queued while a worker is pending or running are signed by the same work
+ * run, so a handshake flood costs one work scheduling per batch rather than
+ * per handshake.
+ *
+ * @conns	- the queued connections, newest first;
+ * @work	- the worker signing all the queued connections;
+ */
+typedef struct {
+	struct llist_head	conns;
+	struct work_struct	work;
+} TfwTlsSignQueue;
+
+static DEFINE_PER_CPU(TfwTlsSignQueue, tfw_tls_sign_q);
 
 /**
  * Chop skb list with begin at @skb by TLS extra data at the begin and end of
@@ -53,7 +95,7 @@ tfw_tls_chop_skb_rec(TlsCtx *tls, struct sk_buff *skb,
 		     TfwFsmData *__restrict data)
 {
 	int r;
-	size_t off = ttls_payload_off(&tls->xfrm);
+	size_t off = tls->io_in.off + ttls_payload_off(&tls->xfrm);
 	size_t tail = ttls_xfrm_taglen(&tls->xfrm);
 
 	while (unlikely(skb->len <= off)) {
@@ -96,6 +138,7 @@ static int
 tfw_tls_msg_process(void *conn, TfwFsmData *data)
 {
 	int r, parsed;
+	unsigned int off = 0, hs_state;
 	struct sk_buff *nskb = NULL, *skb = data->skb;
 	TfwConn *c = conn;
 	TlsCtx *tls = tfw_tls_context(c);
@@ -109,10 +152,16 @@ tfw_tls_msg_process(void *conn, TfwFsmData *data)
 next_msg:
 	spin_lock(&tls->lock);
 	ss_skb_queue_tail(&tls->io_in.skb_list, skb);
+	if (off)
+		tls->io_in.off = off;
 
 	/* Call TLS layer to place skb into a TLS record on top of skb_list. */
 	parsed = 0;
-	r = ss_skb_process(skb, ttls_recv, tls, &tls->io_in.chunks, &parsed);
+	hs_state = tls->state;
+	r = ss_skb_process(skb, off, ttls_recv, tls, &tls->io_in.chunks,
+			   &parsed);
+	if (unlikely(tls->state != hs_state))
+		trace_tfw_tls_hs(c, tls->state);
 	switch (r) {
 	default:
 		T_WARN("Unrecognized TLS receive return code %d, drop packet\n",
@@ -134,8 +183,13 @@ next_msg:
 	}
 
 	/*
-	 * Possibly there are other TLS message in the @skb - create
-	 * an skb sibling and process it on the next iteration.
+	 * Possibly there are other TLS message in the @skb. Records not
+	 * passed to upper layers, i.e. handshake, alert and change cipher
+	 * spec records, are consumed here, so the next record is processed
+	 * in place, at offset @off in the same skb.
+	 *
+	 * An application data record is owned by the HTTP layer, so for it
+	 * create an skb sibling and process it on the next iteration.
 	 * If a part of incomplete TLS message leaves at the end of the
 	 * @skb, then store the skb in the TLS context for next FSM
 	 * shot.
@@ -152,8 +206,11 @@ next_msg:
 	 * Split @skb before calling HTTP layer to chop it and not let HTTP
 	 * to read after end of the message.
 	 */
-	if (parsed < skb->len) {
-		nskb = ss_skb_split(skb, parsed);
+	off += parsed;
+	if (off < skb->len
+	    && tls->io_in.msgtype == TTLS_MSG_APPLICATION_DATA)
+	{
+		nskb = ss_skb_split(skb, off);
 		if (unlikely(!nskb)) {
 			spin_unlock(&tls->lock);
 			TFW_INC_STAT_BH(clnt.msgs_otherr);
@@ -187,15 +244,21 @@ next_msg:
 	} else {
 		/*
 		 * The decrypted payload is not required for upper levels.
-		 * Lifetime of skbs in input contexts ends here.
+		 * Lifetime of skbs in input contexts ends here, except
+		 * @skb holding the next record.
 		 */
+		if (off < skb->len)
+			ss_skb_unlink(&tls->io_in.skb_list, skb);
 		tfw_tls_purge_io_ctx(&tls->io_in);
 		spin_unlock(&tls->lock);
+		if (off < skb->len)
+			goto next_msg;
 	}
 
 	if (nskb) {
 		skb = nskb;
 		nskb = NULL;
+		off = 0;
 		goto next_msg;
 	}
 
@@ -236,6 +299,60 @@ tfw_tls_tcp_propagate_dseq(struct sock *sk, struct sk_buff *skb)
 	tcb_next->end_seq = tcb_next->seq + next->len;
 }
 
+/* Congestion window size (in bytes) to start sending full size records. */
+#define TFW_TLS_REC_FULL_CWND	(TLS_MAX_PAYLOAD_SIZE * 4)
+
+/**
+ * Dynamic TLS record sizing.
+ *
+ * A client can decrypt a record only when it has received the whole record,
+ * so while the congestion window is small, i.e. at the beginning of a
+ * connection and after the window is restarted on an idle connection
+ * (RFC 5681 section 4.1), records fit one TCP segment to be processed as
+ * soon as the segment arrives. Full size records are used once the window
+ * carries several of them to reduce the per-record crypto and framing
+ * overhead.
+ *
+ * @return maximum payload size of the next TLS record sent through @sk.
+ */
+unsigned int
+tfw_tls_rec_payload(struct sock *sk)
+{
+	const struct tcp_sock *tp = tcp_sk(sk);
+	unsigned int mss = tp->mss_cache;
+
+	if (mss <= TLS_MAX_OVERHEAD
+	    || tp->snd_cwnd * mss >= TFW_TLS_REC_FULL_CWND)
+		return TLS_MAX_PAYLOAD_SIZE;
+
+	return min_t(unsigned int, mss - TLS_MAX_OVERHEAD,
+		     TLS_MAX_PAYLOAD_SIZE);
+}
+
+/**
+ * Upper layers mark the last skbs of their messages, e.g. HTTP/2 frames, by
+ * skb->tls_msg_end. A message starting at @skb should be put into the current
+ * record with @room bytes left only if it fits the record whole. A message
+ * larger than @rec_max, the maximum record payload, can't fit any record, so
+ * it's just split.
+ */
+static bool
+tfw_tls_msg_fits(struct sock *sk, struct sk_buff *skb, unsigned int room,
+		 unsigned int rec_max)
+{
+	unsigned int n = 0;
+
+	for ( ; ; skb = tcp_write_queue_next(sk, skb)) {
+		n += skb->len;
+		if (n > rec_max)
+			return true;
+		if (skb->tls_msg_end || tcp_skb_is_last(sk, skb))
+			break;
+	}
+
+	return n <= room;
+}
+
 /**
  * The callback is called by tcp_write_xmit() if @skb must be encrypted by TLS.
  * @skb is current head of the TCP send queue. @limit defines how much data
@@ -245,6 +362,23 @@ tfw_tls_tcp_propagate_dseq(struct sock *sk, struct sk_buff *skb)
  *
  * We extend the skbs on TCP transmission (when CWND is calculated), so we
  * also adjust TPC sequence numbers in the socket. See skb_entail().
+ *
+ * The record payload is also limited by tfw_tls_rec_payload(). Only whole
+ * skbs are added to the record and a record doesn't start a message, which
+ * doesn't fit it, so upper layers sizing their messages by
+ * tfw_tls_rec_payload() get a message per record.
+ *
+ * TODO NIC TLS TX offload. The records can be encrypted by a NIC supporting
+ * inline TLS: the traffic keys and the record sequence number are passed to
+ * the driver after the handshake, and we'd only reserve the header and the
+ * tag here and send plaintext skbs, keeping the software path below as the
+ * fallback. However, the kernel interface for that, net_device->tlsdev_ops
+ * and NETIF_F_HW_TLS_TX used by net/tls/tls_device.c, appeared in Linux 4.18
+ * and the drivers got the support even later, while our kernel patch is for
+ * Linux 4.14, which has neither. So the offload can be done only after the
+ * move to a newer kernel. tls_device also works with the kTLS socket context
+ * (tls_get_ctx()) and tracks the records for retransmissions on its own, so
+ * the patch for the new kernel will need an adapter for TlsCtx.
  */
 int
 tfw_tls_encrypt(struct sock *sk, struct sk_buff *skb, unsigned int limit)
@@ -256,7 +390,7 @@ tfw_tls_encrypt(struct sock *sk, struct sk_buff *skb, unsigned int limit)
 #define AUTO_SEGS_N	8
 
 	int r = -ENOMEM;
-	unsigned int head_sz, tag_sz, len, frags, t_sz, out_frags;
+	unsigned int head_sz, tag_sz, len, rec_sz, frags, t_sz, out_frags;
 	unsigned char type;
 	struct sk_buff *next = skb, *skb_tail = skb;
 	struct tcp_skb_cb *tcb = TCP_SKB_CB(skb);
@@ -294,6 +428,8 @@ tfw_tls_encrypt(struct sock *sk, struct sk_buff *skb, unsigned int limit)
 	head_sz = ttls_payload_off(xfrm);
 	tag_sz = ttls_xfrm_taglen(xfrm);
 	len = head_sz + skb->len + tag_sz;
+	rec_sz = head_sz + tfw_tls_rec_payload(sk) + tag_sz;
+	limit = min(limit, rec_sz);
 	type = tempesta_tls_skb_type(skb);
 	if (!type) {
 		T_WARN("%s: bad skb type %u\n", __func__, type);
@@ -318,6 +454,14 @@ tfw_tls_encrypt(struct sock *sk, struct sk_buff *skb, unsigned int limit)
 		/* Don't put different message types into the same record. */
 		if (type != tempesta_tls_skb_type(next))
 			break;
+		/*
+		 * The peer can process a message only when it decrypts the
+		 * whole message, so don't split a message between records.
+		 */
+		if (skb_tail->tls_msg_end
+		    && !tfw_tls_msg_fits(sk, next, limit - len,
+					 rec_sz - head_sz - tag_sz))
+			break;
 
 		/*
 		 * skb at @next may lag behind in sequence numbers. Recalculate
@@ -562,6 +706,84 @@ tfw_tls_send(TlsCtx *tls, struct sg_table *sgt, bool close)
 	return r;
 }
 
+/**
+ * Callback function which is called by TLS module under tls->lock to compute
+ * the signature of the server handshake flight out of softirq. Queue it to
+ * the next crypto worker CPU, round robin.
+ */
+static void
+tfw_tls_sign_queue(TlsCtx *tls)
+{
+	static atomic_t next = ATOMIC_INIT(0);
+	TfwTlsConn *conn = container_of(tls, TfwTlsConn, tls);
+	TfwTlsSignQueue *q;
+	int cpu, n = num_online_cpus();
+
+	n -= 1 + (unsigned int)atomic_inc_return(&next)
+		 % clamp(READ_ONCE(tfw_tls.sign_cpus), 1, n);
+	for_each_online_cpu(cpu)
+		if (!n--)
+			break;
+	if (cpu >= nr_cpu_ids)
+		cpu = cpumask_first(cpu_online_mask);
+
+	/* Keep the connection until the flight is sent. */
+	tfw_connection_get((TfwConn *)conn);
+	q = per_cpu_ptr(&tfw_tls_sign_q, cpu);
+	if (llist_add(&conn->sign_node, &q->conns))
+		queue_work_on(cpu, tfw_tls_sign_wq, &q->work);
+}
+
+/**
+ * Sign and send the server handshake flight queued by tfw_tls_sign_queue(),
+ * or close the connection if we can't.
+ */
+static void
+tfw_tls_sign_conn(TfwTlsConn *conn)
+{
+	int r;
+	TlsCtx *tls = &conn->tls;
+
+	local_bh_disable();
+
+	ttls_hs_sign(tls);
+
+	spin_lock(&tls->lock);
+	r = ttls_hs_sign_resume(tls);
+	trace_tfw_tls_hs(conn, tls->state);
+	spin_unlock(&tls->lock);
+	/* The socket can be already closed by the peer, that's fine. */
+	if (r) {
+		T_DBG("Cannot send TLS handshake flight (%d)\n", r);
+		ss_close(conn->cli_conn.sk, SS_F_SYNC);
+	}
+
+	local_bh_enable();
+
+	tfw_connection_put((TfwConn *)conn);
+}
+
+/**
+ * Sign the whole batch of the handshakes queued to the CPU in the queuing
+ * order. The MPI code is scalar, so the signatures are computed one by one
+ * and each flight is sent as soon as it's signed, without waiting for the
+ * rest of the batch. Softirqs are enabled between the signatures, so the
+ * batch doesn't block the network processing on the worker CPU.
+ */
+static void
+tfw_tls_sign_work(struct work_struct *work)
+{
+	TfwTlsConn *conn, *tmp;
+	struct llist_node *list;
+	TfwTlsSignQueue *q = container_of(work, TfwTlsSignQueue, work);
+
+	list = llist_reverse_order(llist_del_all(&q->conns));
+	llist_for_each_entry_safe(conn, tmp, list, sign_node) {
+		tfw_tls_sign_conn(conn);
+		cond_resched();
+	}
+}
+
 static void
 tfw_tls_conn_dtor(void *c)
 {
@@ -790,6 +1012,7 @@ tfw_tls_do_init(void)
 	int r;
 
 	ttls_config_init(&tfw_tls.cfg);
+	ttls_ticket_init(&tfw_tls.tickets);
 	/* Use cute ECDHE-ECDSA-AES128-GCM-SHA256 by default. */
 	r = ttls_config_defaults(&tfw_tls.cfg, TTLS_IS_SERVER);
 	if (r) {
@@ -804,6 +1027,7 @@ static void
 tfw_tls_do_cleanup(void)
 {
 	ttls_config_free(&tfw_tls.cfg);
+	ttls_ticket_free(&tfw_tls.tickets);
 }
 
 /*
@@ -889,6 +1113,10 @@ static int
 tfw_tls_cfgstart(void)
 {
 	allow_any_sni_reconfig = false;
+	bzero_fast(tfw_tls_ticket_secret, sizeof(tfw_tls_ticket_secret));
+	tfw_tls_ticket_secret_len = 0;
+	/* Drop the errors of the jobs of a previous failed configuration. */
+	tfw_tls_cert_cfg_wait();
 
 	return 0;
 }
@@ -896,6 +1124,9 @@ tfw_tls_cfgstart(void)
 static int
 tfw_tls_cfgend(void)
 {
+	if (tfw_tls_cert_cfg_wait())
+		return -EINVAL;
+
 	if (!(tfw_tls_cgf & TFW_TLS_CFG_F_REQUIRED)) {
 		if (tfw_tls_cgf)
 			T_WARN_NL("TLS: no HTTPS listener set, configuration "
@@ -922,12 +1153,100 @@ tfw_tls_cfgend(void)
 static int
 tfw_tls_start(void)
 {
+	int r;
+
 	tfw_tls.allow_any_sni = allow_any_sni_reconfig;
 
+	r = ttls_ticket_setup(&tfw_tls.tickets, tfw_tls_ticket_lifetime,
+			      tfw_tls_ticket_secret_len ? tfw_tls_ticket_secret
+							: NULL,
+			      tfw_tls_ticket_secret_len);
+	/* Only the key derived from the secret is kept. */
+	bzero_fast(tfw_tls_ticket_secret, sizeof(tfw_tls_ticket_secret));
+	tfw_tls_ticket_secret_len = 0;
+	if (r) {
+		T_ERR_NL("TLS: can't set up session tickets (%d)\n", r);
+		return r;
+	}
+	/*
+	 * The callbacks are never reset, so the handshakes in progress don't
+	 * race with the reconfiguration: disabled tickets are just rejected.
+	 */
+	if (tfw_tls_ticket_lifetime)
+		ttls_conf_session_tickets_cb(&tfw_tls.cfg, ttls_ticket_write,
+					     ttls_ticket_parse,
+					     &tfw_tls.tickets);
+
+	WRITE_ONCE(tfw_tls.sign_cpus, tfw_tls_sign_cpus);
+	tfw_tls.cfg.sign_async = !!tfw_tls_sign_cpus;
+
 	return 0;
 }
 
+/**
+ * Load the secret for the session ticket keys shared by the cluster nodes.
+ */
+static int
+tfw_cfgop_tls_ticket_secret(TfwCfgSpec *cs, TfwCfgEntry *ce)
+{
+	int r = 0;
+	char *data;
+	size_t size;
+
+	if (tfw_cfg_check_single_val(ce))
+		return -EINVAL;
+
+	if (!(data = tfw_cfg_read_file(ce->vals[0], &size, 0))) {
+		T_ERR_NL("%s: Can't read the secret file '%s'\n",
+			 ce->name, ce->vals[0]);
+		return -EINVAL;
+	}
+	/* The read size includes the terminating zero. */
+	if (--size < TFW_TLS_TICKET_SECRET_MIN
+	    || size > TFW_TLS_TICKET_SECRET_MAX)
+	{
+		T_ERR_NL("%s: the secret must be from %d to %d bytes long, "
+			 "but '%s' has %zu bytes\n", ce->name,
+			 TFW_TLS_TICKET_SECRET_MIN, TFW_TLS_TICKET_SECRET_MAX,
+			 ce->vals[0], size);
+		r = -EINVAL;
+	} else {
+		memcpy_fast(tfw_tls_ticket_secret, data, size);
+		tfw_tls_ticket_secret_len = size;
+	}
+	bzero_fast(data, size);
+	free_pages((unsigned long)data, get_order(size + 1));
+
+	return r;
+}
+
 static TfwCfgSpec tfw_tls_specs[] = {
+	{
+		.name = "tls_ticket_lifetime",
+		.deflt = "0",
+		.handler = tfw_cfg_set_int,
+		.dest = &tfw_tls_ticket_lifetime,
+		.spec_ext = &(TfwCfgSpecInt) {
+			.range = { 0, 7 * 24 * 3600 },
+		},
+		.allow_reconfig = true,
+	},
+	{
+		.name = "tls_ticket_secret",
+		.handler = tfw_cfgop_tls_ticket_secret,
+		.allow_none = true,
+		.allow_reconfig = true,
+	},
+	{
+		.name = "tls_sign_cpus",
+		.deflt = "0",
+		.handler = tfw_cfg_set_int,
+		.dest = &tfw_tls_sign_cpus,
+		.spec_ext = &(TfwCfgSpecInt) {
+			.range = { 0, NR_CPUS },
+		},
+		.allow_reconfig = true,
+	},
 	{ 0 }
 };
 
@@ -947,13 +1266,29 @@ TfwMod tfw_tls_mod = {
 int __init
 tfw_tls_init(void)
 {
-	int r;
+	int r, cpu;
 
 	r = tfw_tls_do_init();
 	if (r)
 		return -EINVAL;
 
-	ttls_register_callbacks(tfw_tls_send, tfw_tls_sni);
+	for_each_possible_cpu(cpu) {
+		TfwTlsSignQueue *q = per_cpu_ptr(&tfw_tls_sign_q, cpu);
+
+		init_llist_head(&q->conns);
+		INIT_WORK(&q->work, tfw_tls_sign_work);
+	}
+
+	ttls_register_callbacks(tfw_tls_send, tfw_tls_sni, tfw_tls_sign_queue);
+
+	tfw_tls_sign_wq = alloc_workqueue("tfw_tls_sign", WQ_HIGHPRI, 1);
+	if (!tfw_tls_sign_wq) {
+		r = -ENOMEM;
+		goto err_wq;
+	}
+
+	if ((r = tfw_tls_cert_init()))
+		goto err_cert;
 
 	if ((r = tfw_h2_init()))
 		goto err_h2;
@@ -969,6 +1304,10 @@ tfw_tls_init(void)
 err_fsm:
 	tfw_h2_cleanup();
 err_h2:
+	tfw_tls_cert_exit();
+err_cert:
+	destroy_workqueue(tfw_tls_sign_wq);
+err_wq:
 	tfw_tls_do_cleanup();
 
 	return r;
@@ -981,5 +1320,7 @@ tfw_tls_exit(void)
 	tfw_connection_hooks_unregister(TFW_FSM_TLS);
 	tfw_gfsm_unregister_fsm(TFW_FSM_TLS);
 	tfw_h2_cleanup();
+	tfw_tls_cert_exit();
+	destroy_workqueue(tfw_tls_sign_wq);
 	tfw_tls_do_cleanup();
 }
@@ -17,6 +17,10 @@
  * with this program; if not, write to the Free Software Foundation, Inc.,
  * 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
  */
+#include <linux/workqueue.h>
+#include <crypto/hash.h>
+#include <crypto/sha.h>
+
 #include "tls_conf.h"
 #include "tls.h"
 #include "vhost.h"
@@ -24,28 +28,275 @@
 #define TFW_TLS_CFG_F_EMPY	0U
 #define TFW_TLS_CFG_F_CERT	1U
 #define TFW_TLS_CFG_F_CKEY	2U
+#define TFW_TLS_CFG_F_OCSP	4U
 
 #define TLS_CONF_CERT_NUM	8
 
+/**
+ * Certificate with its private key, shared by all the vhosts configured with
+ * the same contents of the certificate and the key files. Parsing of the key
+ * is expensive, so configuration reload reuses the certificates of the
+ * running configuration if the files didn't change, and thousands of SNI
+ * vhosts with a few certificates parse each of them only once.
+ *
+ * @list	- member in tfw_tls_certs;
+ * @refcnt	- number of the vhosts using the certificate;
+ * @crt		- the certificate chain, parsed in place in @crt_pg_addr;
+ * @key		- the private key;
+ * @crt_pg_addr	- pages with the certificate file contents;
+ * @crt_pg_order - order of @crt_pg_addr;
+ * @crt_dgst	- digest of the certificate file contents;
+ * @key_dgst	- digest of the private key file contents;
+ */
+typedef struct {
+	struct list_head	list;
+	unsigned int		refcnt;
+	ttls_x509_crt		crt;
+	TlsPkCtx		key;
+	unsigned long		crt_pg_addr;
+	unsigned int		crt_pg_order;
+	unsigned char		crt_dgst[SHA256_DIGEST_SIZE];
+	unsigned char		key_dgst[SHA256_DIGEST_SIZE];
+} TlsCert;
+
+/**
+ * @cert	- the certificate and the key;
+ * @crt_pg_addr	- the certificate file contents if the same contents is
+ *		  already parsed, kept until the key file is read;
+ * @crt_size	- size of @crt_pg_addr;
+ * @crt_dgst	- digest of @crt_pg_addr;
+ * @ocsp_pg_addr - the OCSP response;
+ * @ocsp_pg_order - order of @ocsp_pg_addr;
+ * @conf_stage	- TFW_TLS_CFG_F_* directives processed for the certificate;
+ */
 typedef struct {
-	ttls_x509_crt	crt;
-	TlsPkCtx	key;
+	TlsCert		*cert;
 	unsigned long	crt_pg_addr;
-	unsigned int	crt_pg_order;
+	size_t		crt_size;
+	unsigned char	crt_dgst[SHA256_DIGEST_SIZE];
+	unsigned long	ocsp_pg_addr;
+	unsigned int	ocsp_pg_order;
 	unsigned int	conf_stage;
 } TlsCertConf;
 
+/**
+ * Private key parsing job. The key is referenced by the vhost TLS
+ * configuration only on handshakes, so the keys parsing, the most expensive
+ * part of configuration with many certificates, is done by the jobs in
+ * parallel with the configuration parsing and the jobs are waited for at
+ * the end of the configuration.
+ *
+ * @work	- the work item;
+ * @cert	- the certificate to parse the key for, referenced by the job;
+ * @key_data	- the private key file contents, owned by the job;
+ * @key_size	- size of @key_data;
+ * @path	- the private key file path for error reporting;
+ */
+typedef struct {
+	struct work_struct	work;
+	TlsCert			*cert;
+	void			*key_data;
+	size_t			key_size;
+	char			path[0];
+} TlsKeyJob;
+
 typedef struct {
 	TlsCertConf	certs[TLS_CONF_CERT_NUM];
 	unsigned int	certs_num;
 	unsigned int	init_done:1;
 } TlsConfEntry;
 
+/*
+ * The certificates of all the configurations. The last reference to a vhost
+ * may be put in softirq context, so the list is protected by a spinlock.
+ */
+static LIST_HEAD(tfw_tls_certs);
+static DEFINE_SPINLOCK(tfw_tls_certs_lock);
+
+/*
+ * The keys are parsed with the per-CPU MPI pools, so the workqueue is bound
+ * and runs only one job on a CPU at a time.
+ */
+static struct workqueue_struct *tfw_tls_key_wq;
+static int tfw_tls_key_err;
+
 size_t tfw_tls_vhost_priv_data_sz(void)
 {
 	return sizeof(TlsConfEntry);
 }
 
+static int
+tfw_tls_digest(const void *data, size_t len, unsigned char *dgst)
+{
+	int r;
+	struct crypto_shash *tfm;
+
+	tfm = crypto_alloc_shash("sha256", 0, 0);
+	if (IS_ERR(tfm)) {
+		T_ERR_NL("TLS: can't allocate sha256 transform\n");
+		return PTR_ERR(tfm);
+	}
+	{
+		SHASH_DESC_ON_STACK(desc, tfm);
+
+		desc->tfm = tfm;
+		desc->flags = 0;
+		r = crypto_shash_digest(desc, data, len, dgst);
+	}
+	crypto_free_shash(tfm);
+
+	return r;
+}
+
+static TlsCert *
+tfw_tls_cert_alloc(void)
+{
+	TlsCert *cert;
+
+	if (!(cert = kzalloc(sizeof(TlsCert), GFP_KERNEL)))
+		return NULL;
+	INIT_LIST_HEAD(&cert->list);
+	cert->refcnt = 1;
+	ttls_x509_crt_init(&cert->crt);
+	ttls_pk_init(&cert->key);
+
+	return cert;
+}
+
+/* Parse certificate file contents @data, owned by @cert on success. */
+static int
+tfw_tls_cert_parse_crt(TlsCert *cert, unsigned char *data, size_t size)
+{
+	int r;
+
+	if ((r = ttls_x509_crt_parse(&cert->crt, data, size)))
+		return r;
+	cert->crt_pg_addr = (unsigned long)data;
+	cert->crt_pg_order = get_order(size);
+
+	return 0;
+}
+
+static void
+tfw_tls_cert_put(TlsCert *cert)
+{
+	spin_lock_bh(&tfw_tls_certs_lock);
+	if (--cert->refcnt) {
+		spin_unlock_bh(&tfw_tls_certs_lock);
+		return;
+	}
+	list_del_init(&cert->list);
+	spin_unlock_bh(&tfw_tls_certs_lock);
+
+	ttls_x509_crt_free(&cert->crt);
+	ttls_pk_free(&cert->key);
+	if (cert->crt_pg_addr)
+		free_pages(cert->crt_pg_addr, cert->crt_pg_order);
+	kfree(cert);
+}
+
+/*
+ * Find a certificate parsed from the file contents with digest @crt_dgst
+ * and, if @key_dgst isn't NULL, with the key digest @key_dgst. In the latter
+ * case a reference to the certificate is taken.
+ */
+static TlsCert *
+tfw_tls_cert_lookup(const unsigned char *crt_dgst,
+		    const unsigned char *key_dgst)
+{
+	TlsCert *cert;
+
+	spin_lock_bh(&tfw_tls_certs_lock);
+	list_for_each_entry(cert, &tfw_tls_certs, list) {
+		if (memcmp(cert->crt_dgst, crt_dgst, SHA256_DIGEST_SIZE))
+			continue;
+		if (!key_dgst)
+			goto found;
+		if (!memcmp(cert->key_dgst, key_dgst, SHA256_DIGEST_SIZE)) {
+			++cert->refcnt;
+			goto found;
+		}
+	}
+	cert = NULL;
+found:
+	spin_unlock_bh(&tfw_tls_certs_lock);
+
+	return cert;
+}
+
+static void
+tfw_tls_key_parse_work(struct work_struct *work)
+{
+	TlsKeyJob *job = container_of(work, TlsKeyJob, work);
+	TlsCert *cert = job->cert;
+	int r;
+
+	if ((r = ttls_pk_parse_key(&cert->key, job->key_data, job->key_size))) {
+		T_ERR_NL("TLS: Invalid private key specified in '%s' (%x)\n",
+			 job->path, -r);
+		/* Don't share the certificate with further configurations. */
+		spin_lock_bh(&tfw_tls_certs_lock);
+		list_del_init(&cert->list);
+		spin_unlock_bh(&tfw_tls_certs_lock);
+		WRITE_ONCE(tfw_tls_key_err, -EINVAL);
+	}
+
+	free_pages((unsigned long)job->key_data, get_order(job->key_size));
+	tfw_tls_cert_put(cert);
+	kfree(job);
+}
+
+/*
+ * Make the new certificate @cert available for sharing and queue parsing
+ * of its private key @key_data, owned by the job on success, to the next
+ * online CPU.
+ */
+static int
+tfw_tls_key_parse_queue(TlsCert *cert, void *key_data, size_t key_size,
+			const char *path)
+{
+	static int cpu = -1;
+	TlsKeyJob *job;
+
+	if (!(job = kmalloc(sizeof(*job) + strlen(path) + 1, GFP_KERNEL)))
+		return -ENOMEM;
+	INIT_WORK(&job->work, tfw_tls_key_parse_work);
+	job->cert = cert;
+	job->key_data = key_data;
+	job->key_size = key_size;
+	strcpy(job->path, path);
+
+	spin_lock_bh(&tfw_tls_certs_lock);
+	++cert->refcnt;
+	list_add(&cert->list, &tfw_tls_certs);
+	spin_unlock_bh(&tfw_tls_certs_lock);
+
+	get_online_cpus();
+	cpu = cpumask_next(cpu, cpu_online_mask);
+	if (cpu >= nr_cpu_ids)
+		cpu = cpumask_first(cpu_online_mask);
+	queue_work_on(cpu, tfw_tls_key_wq, &job->work);
+	put_online_cpus();
+
+	return 0;
+}
+
+/**
+ * Wait for all the private keys of the configuration to be parsed and return
+ * an error if any of them is invalid.
+ */
+int
+tfw_tls_cert_cfg_wait(void)
+{
+	int r;
+
+	flush_workqueue(tfw_tls_key_wq);
+	r = READ_ONCE(tfw_tls_key_err);
+	WRITE_ONCE(tfw_tls_key_err, 0);
+
+	return r;
+}
+
 static int
 tfw_tls_peer_tls_init(TfwVhost *vhost)
 {
@@ -130,40 +381,52 @@ tfw_tls_set_cert(TfwVhost *vhost, TfwCfgSpec *cs, TfwCfgEntry *ce)
 	if (tfw_cfg_check_single_val(ce))
 		return -EINVAL;
 
-	ttls_x509_crt_init(&conf->crt);
-	/* Preserve 3 bytes for the certificate length. */
-	crt_data = tfw_cfg_read_file(ce->vals[0], &crt_size, TTLS_CERT_LEN_LEN);
+	/* The certificates are parsed in place, so keep the pages. */
+	crt_data = tfw_cfg_read_file(ce->vals[0], &crt_size, 0);
 	if (!crt_data) {
 		T_ERR_NL("%s: Can't read certificate file '%s'\n",
 			 ce->name, ce->vals[0]);
 		return -EINVAL;
 	}
+	if ((r = tfw_tls_digest(crt_data, crt_size, conf->crt_dgst)))
+		goto err;
+
+	/*
+	 * The same certificate is already parsed, wait for the key to find
+	 * the certificate to share.
+	 */
+	if (tfw_tls_cert_lookup(conf->crt_dgst, NULL)) {
+		conf->crt_pg_addr = (unsigned long)crt_data;
+		conf->crt_size = crt_size;
+		return 0;
+	}
 
-	r = ttls_x509_crt_parse(&conf->crt, crt_data + TTLS_CERT_LEN_LEN,
-				crt_size);
-	if (r) {
+	r = -ENOMEM;
+	if (!(conf->cert = tfw_tls_cert_alloc()))
+		goto err;
+	memcpy(conf->cert->crt_dgst, conf->crt_dgst, SHA256_DIGEST_SIZE);
+	if ((r = tfw_tls_cert_parse_crt(conf->cert, crt_data, crt_size))) {
 		T_ERR_NL("%s: Invalid certificate specified (%x)\n",
 			 cs->name, -r);
-		free_pages((unsigned long)crt_data, get_order(crt_size));
-		return -EINVAL;
+		r = -EINVAL;
+		goto err;
 	}
-	ttls_x509_write_cert_len(&conf->crt, crt_data);
-
-	conf->crt_pg_addr = (unsigned long)crt_data;
-	conf->crt_pg_order = get_order(crt_size);
 
 	return 0;
+err:
+	free_pages((unsigned long)crt_data, get_order(crt_size));
+	return r;
 }
 
 int
 tfw_tls_cert_cfg_finish_cert(TfwVhost *vhost)
 {
 	TlsConfEntry *conf_entry = vhost->tls_cfg.priv;
-	TlsCertConf *conf = &conf_entry->certs[conf_entry->certs_num];
+	TlsCert *cert = conf_entry->certs[conf_entry->certs_num].cert;
 	int r;
 
-	r = ttls_conf_own_cert(&vhost->tls_cfg, &conf->crt, &conf->key,
-			       conf->crt.next, NULL);
+	r = ttls_conf_own_cert(&vhost->tls_cfg, &cert->crt, &cert->key,
+			       cert->crt.next, NULL);
 	if (r) {
 		T_ERR_NL("TLS: can't set own certificate (%x)\n", r);
 		return -EINVAL;
@@ -189,7 +452,9 @@ tfw_tls_set_cert_key(TfwVhost *vhost, TfwCfgSpec *cs, TfwCfgEntry *ce)
 	int r;
 	void *key_data;
 	size_t key_size;
+	unsigned char key_dgst[SHA256_DIGEST_SIZE];
 	TlsCertConf *conf;
+	TlsCert *cert;
 
 	BUG_ON(!vhost->tls_cfg.priv);
 	if (tfw_cfg_check_single_val(ce))
@@ -197,25 +462,110 @@ tfw_tls_set_cert_key(TfwVhost *vhost, TfwCfgSpec *cs, TfwCfgEntry *ce)
 	if (!(conf = tfw_tls_get_cert_conf(vhost, TFW_TLS_CFG_F_CKEY)))
 		return -EINVAL;
 
-	ttls_pk_init(&conf->key);
-
 	key_data = tfw_cfg_read_file(ce->vals[0], &key_size, 0);
 	if (!key_data) {
 		T_ERR_NL("%s: Can't read certificate file '%s'\n",
 			 ce->name, ce->vals[0]);
 		return -EINVAL;
 	}
+	if ((r = tfw_tls_digest(key_data, key_size, key_dgst)))
+		goto out;
+
+	if (!conf->cert) {
+		cert = tfw_tls_cert_lookup(conf->crt_dgst, key_dgst);
+		if (cert) {
+			conf->cert = cert;
+			free_pages(conf->crt_pg_addr, get_order(conf->crt_size));
+			conf->crt_pg_addr = 0;
+			goto out;
+		}
+		/* The certificate is shared with a different key. */
+		r = -ENOMEM;
+		if (!(conf->cert = tfw_tls_cert_alloc()))
+			goto out;
+		memcpy(conf->cert->crt_dgst, conf->crt_dgst,
+		       SHA256_DIGEST_SIZE);
+		r = tfw_tls_cert_parse_crt(conf->cert,
+					   (unsigned char *)conf->crt_pg_addr,
+					   conf->crt_size);
+		if (r) {
+			T_ERR_NL("%s: Can't parse certificate (%x)\n",
+				 cs->name, -r);
+			r = -EINVAL;
+			goto out;
+		}
+		conf->crt_pg_addr = 0;
+	}
+	cert = conf->cert;
+	memcpy(cert->key_dgst, key_dgst, SHA256_DIGEST_SIZE);
+	r = tfw_tls_key_parse_queue(cert, key_data, key_size, ce->vals[0]);
+	if (!r)
+		key_data = NULL;
+out:
+	/* The key is copied on parsing, so free the paged data. */
+	if (key_data)
+		free_pages((unsigned long)key_data, get_order(key_size));
+	if (r)
+		return r;
+
+	return tfw_tls_cert_cfg_finish_cert(vhost);
+}
+
+/**
+ * Handle 'tls_certificate_ocsp <path>' config entry.
+ *
+ * The file contains DER encoded OCSP response for the certificate from the
+ * previous 'tls_certificate' and 'tls_certificate_key' directives. We don't
+ * fetch the responses on our own, so the handshake never blocks on OCSP: a
+ * user space helper must fetch fresh responses before the current ones
+ * expire and reload the configuration.
+ */
+int
+tfw_tls_set_cert_ocsp(TfwVhost *vhost, TfwCfgSpec *cs, TfwCfgEntry *ce)
+{
+	int r;
+	unsigned char *ocsp_data;
+	size_t ocsp_size;
+	TlsConfEntry *conf_entry = vhost->tls_cfg.priv;
+	TlsCertConf *conf;
+
+	BUG_ON(!conf_entry);
+	if (tfw_cfg_check_single_val(ce))
+		return -EINVAL;
+	if (!conf_entry->certs_num) {
+		T_WARN_NL("'%s' directive was found before 'tls_certificate'"
+			  " and 'tls_certificate_key'.\n", cs->name);
+		return -EINVAL;
+	}
+	conf = &conf_entry->certs[conf_entry->certs_num - 1];
+	if (conf->conf_stage & TFW_TLS_CFG_F_OCSP) {
+		T_WARN_NL("'%s' directive was found twice for the same"
+			  " 'tls_certificate' directive.\n", cs->name);
+		return -EINVAL;
+	}
 
-	r = ttls_pk_parse_key(&conf->key, key_data, key_size);
-	/* The key is copied, so free the paged data. */
-	free_pages((unsigned long)key_data, get_order(key_size));
+	/* Preserve the CertificateStatus header. */
+	ocsp_data = tfw_cfg_read_file(ce->vals[0], &ocsp_size,
+				      TTLS_CERT_STATUS_HDR_LEN);
+	if (!ocsp_data) {
+		T_ERR_NL("%s: Can't read OCSP response file '%s'\n",
+			 ce->name, ce->vals[0]);
+		return -EINVAL;
+	}
+	/* Don't count the '\0' appended by tfw_cfg_read_file(). */
+	r = ttls_conf_own_cert_ocsp(&vhost->tls_cfg, ocsp_data, ocsp_size - 1);
 	if (r) {
-		T_ERR_NL("%s: Invalid private key specified (%x)\n",
-			 cs->name, -r);
+		T_ERR_NL("%s: Invalid OCSP response specified\n", cs->name);
+		free_pages((unsigned long)ocsp_data,
+			   get_order(ocsp_size + TTLS_CERT_STATUS_HDR_LEN));
 		return -EINVAL;
 	}
 
-	return tfw_tls_cert_cfg_finish_cert(vhost);
+	conf->ocsp_pg_addr = (unsigned long)ocsp_data;
+	conf->ocsp_pg_order = get_order(ocsp_size + TTLS_CERT_STATUS_HDR_LEN);
+	conf->conf_stage |= TFW_TLS_CFG_F_OCSP;
+
+	return 0;
 }
 
 int
@@ -242,18 +592,18 @@ tfw_tls_cert_cfg_finish(TfwVhost *vhost)
 static void
 tfw_tls_cleanup_tls_cert(TlsCertConf *conf)
 {
-	if (!(conf->conf_stage & TFW_TLS_CFG_F_CERT))
-		return;
-	ttls_x509_crt_free(&conf->crt);
-	free_pages(conf->crt_pg_addr, conf->crt_pg_order);
+	if (conf->cert)
+		tfw_tls_cert_put(conf->cert);
+	if (conf->crt_pg_addr)
+		free_pages(conf->crt_pg_addr, get_order(conf->crt_size));
 }
 
 static void
-tfw_tls_cleanup_tls_ckey(TlsCertConf *conf)
+tfw_tls_cleanup_tls_ocsp(TlsCertConf *conf)
 {
-	if (!(conf->conf_stage & TFW_TLS_CFG_F_CKEY))
+	if (!(conf->conf_stage & TFW_TLS_CFG_F_OCSP))
 		return;
-	ttls_pk_free(&conf->key);
+	free_pages(conf->ocsp_pg_addr, conf->ocsp_pg_order);
 }
 
 void
@@ -267,7 +617,21 @@ tfw_tls_cert_clean(TfwVhost *vhost)
 		TlsCertConf *cconf = &conf->certs[i];
 
 		tfw_tls_cleanup_tls_cert(cconf);
-		tfw_tls_cleanup_tls_ckey(cconf);
+		tfw_tls_cleanup_tls_ocsp(cconf);
 	}
 	ttls_config_peer_free(&vhost->tls_cfg);
 }
+
+int
+tfw_tls_cert_init(void)
+{
+	tfw_tls_key_wq = alloc_workqueue("tfw_tls_key", 0, 1);
+
+	return tfw_tls_key_wq ? 0 : -ENOMEM;
+}
+
+void
+tfw_tls_cert_exit(void)
+{
+	destroy_workqueue(tfw_tls_key_wq);
+}
@@ -26,9 +26,13 @@
 
 int tfw_tls_set_cert(TfwVhost *vhost, TfwCfgSpec *cs, TfwCfgEntry *ce);
 int tfw_tls_set_cert_key(TfwVhost *vhost, TfwCfgSpec *cs, TfwCfgEntry *ce);
+int tfw_tls_set_cert_ocsp(TfwVhost *vhost, TfwCfgSpec *cs, TfwCfgEntry *ce);
 
 int tfw_tls_cert_cfg_finish(TfwVhost *vhost);
+int tfw_tls_cert_cfg_wait(void);
 void tfw_tls_cert_clean(TfwVhost *vhost);
+int tfw_tls_cert_init(void);
+void tfw_tls_cert_exit(void);
 
 size_t tfw_tls_vhost_priv_data_sz(void);
 
@@ -0,0 +1,314 @@
+/**
+ *		Tempesta FW
+ *
+ * Per-CPU timer wheel for coarse connection timeouts.
+ *
+ * Each client connection has a keepalive timer, which is moved forward on
+ * each message sent to the client. With the kernel timers each such move
+ * relinks the timer in the kernel timer wheel under the timer base lock,
+ * and the timers of the connections are spread over many slots, so each
+ * of them is processed separately.
+ *
+ * The wheel is private for each CPU and is driven by a single pinned kernel
+ * timer, which is armed only while there are pending timers on the wheel.
+ * The slots are TFW_TW_GRAN jiffies wide, so all the timers expiring within
+ * the same slot are processed in one run. The lower level covers about one
+ * second with HZ=1000 and the upper level covers about a minute. Timers at
+ * the upper level are moved to the lower one when the lower level turns
+ * around, and timers beyond the upper level are kept in its last slot.
+ *
+ * Moving a pending timer forward only updates its deadline: the timer stays
+ * in its old slot and is relinked when the slot is processed. Typically the
+ * keepalive timeout is much larger than the interval between the messages,
+ * so a busy connection has its timer relinked once per the timeout instead
+ * of once per message.
+ *
+ * Copyright (C) 2020 Tempesta Technologies, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#include <linux/percpu.h>
+#include <linux/spinlock.h>
+#include <linux/timer.h>
+
+#include "twheel.h"
+
+#define TFW_TW_SHIFT		2
+#define TFW_TW_GRAN		(1UL << TFW_TW_SHIFT)
+#define TFW_TW_L0_BITS		8
+#define TFW_TW_L0_SZ		(1UL << TFW_TW_L0_BITS)
+#define TFW_TW_L0_MASK		(TFW_TW_L0_SZ - 1)
+#define TFW_TW_L1_SZ		64
+#define TFW_TW_L1_MASK		(TFW_TW_L1_SZ - 1)
+
+/**
+ * Per-CPU timer wheel.
+ *
+ * @lock	- protects the wheel and the timers linked to it;
+ * @clk		- the next slot to process, in TFW_TW_GRAN units of jiffies;
+ * @n		- number of the timers linked to the wheel;
+ * @cpu		- CPU of the wheel;
+ * @in_run	- the wheel is being processed, so the driver timer is
+ *		  rearmed at the end of the run if necessary;
+ * @running	- the timer with the currently running callback;
+ * @timer	- the driver kernel timer;
+ * @l0		- the lower level slots, TFW_TW_GRAN jiffies each;
+ * @l1		- the upper level slots, a turn of @l0 each;
+ */
+typedef struct {
+	spinlock_t		lock;
+	unsigned long		clk;
+	unsigned long		n;
+	int			cpu;
+	bool			in_run;
+	TfwTimer		*running;
+	struct timer_list	timer;
+	struct hlist_head	l0[TFW_TW_L0_SZ];
+	struct hlist_head	l1[TFW_TW_L1_SZ];
+} TfwTimerWheel;
+
+static DEFINE_PER_CPU(TfwTimerWheel, tfw_twheel);
+
+/* The slot of a deadline: timers are never fired before the deadline. */
+static inline unsigned long
+tfw_tw_slot(unsigned long expires)
+{
+	return (expires + TFW_TW_GRAN - 1) >> TFW_TW_SHIFT;
+}
+
+/*
+ * Link @t to @w. Return true if the wheel was empty, so the driver timer
+ * must be armed.
+ */
+static bool
+__tfw_tw_add(TfwTimerWheel *w, TfwTimer *t)
+{
+	unsigned long s = tfw_tw_slot(t->expires);
+	struct hlist_head *head;
+
+	if (s < w->clk)
+		s = w->clk;
+	if (s - w->clk < TFW_TW_L0_SZ) {
+		head = &w->l0[s & TFW_TW_L0_MASK];
+	} else {
+		unsigned long g = s >> TFW_TW_L0_BITS;
+
+		g = min(g, (w->clk >> TFW_TW_L0_BITS) + TFW_TW_L1_SZ - 1);
+		head = &w->l1[g & TFW_TW_L1_MASK];
+	}
+	hlist_add_head(&t->node, head);
+	t->cpu = w->cpu;
+	WRITE_ONCE(t->pending, true);
+
+	return !w->n++;
+}
+
+static void
+__tfw_tw_del(TfwTimerWheel *w, TfwTimer *t)
+{
+	hlist_del_init(&t->node);
+	WRITE_ONCE(t->pending, false);
+	--w->n;
+}
+
+/* Move the upper level timers of the current turn to the lower level. */
+static void
+__tfw_tw_cascade(TfwTimerWheel *w)
+{
+	unsigned long g = w->clk >> TFW_TW_L0_BITS;
+	struct hlist_node *tmp;
+	TfwTimer *t;
+	HLIST_HEAD(list);
+
+	hlist_move_list(&w->l1[g & TFW_TW_L1_MASK], &list);
+	hlist_for_each_entry_safe(t, tmp, &list, node) {
+		__tfw_tw_del(w, t);
+		__tfw_tw_add(w, t);
+	}
+}
+
+/*
+ * Process all the slots of @w up to the @now slot. Called with the wheel
+ * lock held, the lock is released for the timer callbacks.
+ */
+static void
+__tfw_tw_run(TfwTimerWheel *w, unsigned long now)
+{
+	TfwTimer *t;
+	HLIST_HEAD(batch);
+
+	while (w->n && w->clk <= now) {
+		unsigned long idx = w->clk & TFW_TW_L0_MASK;
+
+		if (!idx)
+			__tfw_tw_cascade(w);
+		/*
+		 * The timers of the batch are still accounted in @w->n and
+		 * may be deleted by other CPUs while the lock is released.
+		 */
+		hlist_move_list(&w->l0[idx], &batch);
+		w->clk++;
+		while (!hlist_empty(&batch)) {
+			t = hlist_entry(batch.first, TfwTimer, node);
+			__tfw_tw_del(w, t);
+			/* The deadline was moved forward, relink the timer. */
+			if (tfw_tw_slot(READ_ONCE(t->expires)) >= w->clk) {
+				__tfw_tw_add(w, t);
+				continue;
+			}
+			w->running = t;
+			spin_unlock(&w->lock);
+
+			t->fn(t);
+
+			spin_lock(&w->lock);
+			w->running = NULL;
+		}
+	}
+}
+
+static void
+tfw_tw_arm(TfwTimerWheel *w)
+{
+	w->timer.expires = w->clk << TFW_TW_SHIFT;
+	add_timer_on(&w->timer, w->cpu);
+}
+
+static void
+tfw_tw_timer_cb(unsigned long data)
+{
+	TfwTimerWheel *w = (TfwTimerWheel *)data;
+
+	spin_lock(&w->lock);
+
+	w->in_run = true;
+	__tfw_tw_run(w, jiffies >> TFW_TW_SHIFT);
+	w->in_run = false;
+	if (w->n)
+		tfw_tw_arm(w);
+
+	spin_unlock(&w->lock);
+}
+
+/*
+ * Lock the wheel of the pending timer @t or the local wheel if the timer
+ * isn't pending. Return the locked wheel.
+ */
+static TfwTimerWheel *
+tfw_tw_lock(TfwTimer *t)
+{
+	TfwTimerWheel *w;
+
+	for ( ; ; ) {
+		local_bh_disable();
+		w = tfw_timer_pending(t)
+		    ? per_cpu_ptr(&tfw_twheel, READ_ONCE(t->cpu))
+		    : this_cpu_ptr(&tfw_twheel);
+		spin_lock(&w->lock);
+		/* The timer is moved between the wheels only if unlinked. */
+		if (!t->pending || t->cpu == w->cpu)
+			return w;
+		spin_unlock_bh(&w->lock);
+	}
+}
+
+/**
+ * Set the deadline of @t to @expires and add the timer to the local wheel
+ * if it isn't pending.
+ */
+void
+tfw_timer_mod(TfwTimer *t, unsigned long expires)
+{
+	TfwTimerWheel *w;
+
+	/*
+	 * Fast path: move the deadline forward, the timer is relinked when
+	 * its old slot is processed.
+	 */
+	if (tfw_timer_pending(t)
+	    && !time_before(expires, READ_ONCE(t->expires)))
+	{
+		WRITE_ONCE(t->expires, expires);
+		return;
+	}
+
+	w = tfw_tw_lock(t);
+
+	if (t->pending)
+		__tfw_tw_del(w, t);
+	t->expires = expires;
+	/* The wheel is empty and isn't processed, so restart its clock. */
+	if (!w->n && !w->in_run && !timer_pending(&w->timer))
+		w->clk = jiffies >> TFW_TW_SHIFT;
+	if (__tfw_tw_add(w, t) && !w->in_run && !timer_pending(&w->timer))
+		tfw_tw_arm(w);
+
+	spin_unlock_bh(&w->lock);
+}
+
+/**
+ * Delete @t and wait for its callback to finish if it's running. The
+ * callback must not call the function for its own timer.
+ */
+void
+tfw_timer_del_sync(TfwTimer *t)
+{
+	TfwTimerWheel *w;
+	bool running;
+
+	for ( ; ; ) {
+		w = per_cpu_ptr(&tfw_twheel, READ_ONCE(t->cpu));
+		spin_lock_bh(&w->lock);
+		if (t->cpu != w->cpu) {
+			spin_unlock_bh(&w->lock);
+			continue;
+		}
+		if (t->pending)
+			__tfw_tw_del(w, t);
+		running = w->running == t;
+		spin_unlock_bh(&w->lock);
+
+		if (!running)
+			return;
+		cpu_relax();
+	}
+}
+
+int __init
+tfw_twheel_init(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		TfwTimerWheel *w = per_cpu_ptr(&tfw_twheel, cpu);
+
+		spin_lock_init(&w->lock);
+		w->cpu = cpu;
+		setup_pinned_timer(&w->timer, tfw_tw_timer_cb,
+				   (unsigned long)w);
+	}
+
+	return 0;
+}
+
+void
+tfw_twheel_exit(void)
+{
+	int cpu;
+
+	/* All the timers are deleted on the connections release. */
+	for_each_possible_cpu(cpu)
+		del_timer_sync(&per_cpu_ptr(&tfw_twheel, cpu)->timer);
+}
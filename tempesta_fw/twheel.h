@@ -0,0 +1,67 @@
+/**
+ *		Tempesta FW
+ *
+ * Per-CPU timer wheel for coarse connection timeouts.
+ *
+ * Copyright (C) 2020 Tempesta Technologies, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#ifndef __TFW_TWHEEL_H__
+#define __TFW_TWHEEL_H__
+
+#include <linux/list.h>
+
+typedef struct tfw_timer_t TfwTimer;
+
+/**
+ * Timer of the wheel. The timer fires no earlier than its deadline and
+ * no later than a few jiffies after it.
+ *
+ * @node	- entry in a slot of the wheel;
+ * @expires	- the deadline in jiffies, may be moved forward without
+ *		  relinking of the timer, see tfw_timer_mod();
+ * @fn		- the callback, called in softirq context;
+ * @cpu		- CPU of the wheel, which the timer was added to last time;
+ * @pending	- the timer is linked to a wheel;
+ */
+struct tfw_timer_t {
+	struct hlist_node	node;
+	unsigned long		expires;
+	void			(*fn)(TfwTimer *t);
+	int			cpu;
+	bool			pending;
+};
+
+static inline void
+tfw_timer_setup(TfwTimer *t, void (*fn)(TfwTimer *t))
+{
+	INIT_HLIST_NODE(&t->node);
+	t->expires = 0;
+	t->fn = fn;
+	t->cpu = 0;
+	t->pending = false;
+}
+
+static inline bool
+tfw_timer_pending(const TfwTimer *t)
+{
+	return READ_ONCE(t->pending);
+}
+
+void tfw_timer_mod(TfwTimer *t, unsigned long expires);
+void tfw_timer_del_sync(TfwTimer *t);
+
+#endif /* __TFW_TWHEEL_H__ */
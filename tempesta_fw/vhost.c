@@ -17,13 +17,20 @@
  * with this program; if not, write to the Free Software Foundation, Inc.,
  * 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
  */
+#include <linux/ctype.h>
+#include <asm/tsc.h>
+
 #include "tempesta_fw.h"
+#include "apm.h"
 #include "hash.h"
+#include "hpack.h"
+#include "htype.h"
 #include "http.h"
 #include "http_limits.h"
 #include "http_match.h"
 #include "http_msg.h"
 #include "http_sess_conf.h"
+#include "mtree.h"
 #include "vhost.h"
 #include "str.h"
 #include "http_limits.h"
@@ -32,6 +39,25 @@
 #include "tls_conf.h"
 
 #define TFW_VH_HBITS	10
+
+/**
+ * Node of the trie of the reversed vhost names. Index 0 is the root, so zero
+ * @child and @sibling mean there is no such a node.
+ *
+ * @child	- the first child node;
+ * @sibling	- the next child of the parent node;
+ * @vhost	- vhost named by the reversed path to the node;
+ * @wc_vhost	- wildcard vhost '*.<name>' for the same name;
+ * @c		- the lower case byte of the node;
+ */
+typedef struct {
+	unsigned int	child;
+	unsigned int	sibling;
+	TfwVhost	*vhost;
+	TfwVhost	*wc_vhost;
+	unsigned char	c;
+} TfwVhostNode;
+
 /**
  * Control object for holding full set of virtual hosts specific for current
  * configuration/reconfiguration stage.
@@ -40,11 +66,14 @@
  *		  current configuration).
  * @expl_dflt	- Flag to indicate explicit configuration of default
  *		  virtual host.
+ * @trie	- Trie of the reversed names of the vhosts in @vh_hash, built
+ *		  on start for the lookups by host and server names.
  * @vh_hash	- Hash table with configured virtual hosts.
  */
 typedef struct {
 	TfwVhost	*vhost_dflt;
 	bool		expl_dflt;
+	TfwVhostNode	*trie;
 	DECLARE_HASHTABLE(vh_hash, TFW_VH_HBITS);
 } TfwVhostList;
 
@@ -54,6 +83,7 @@ static const TfwCfgEnum tfw_match_enum[] = {
 	{ "eq",		TFW_HTTP_MATCH_O_EQ },
 	{ "prefix",	TFW_HTTP_MATCH_O_PREFIX },
 	{ "suffix",	TFW_HTTP_MATCH_O_SUFFIX },
+	{ "regex",	TFW_HTTP_MATCH_O_REGEX },
 	{ 0 }
 };
 
@@ -95,6 +125,12 @@ static const TfwCfgEnum tfw_method_enum[] = {
  */
 #define TFW_NIPDEF_ARRAY_SZ	(64)
 
+/*
+ * Negative responses caching policies are put into a fixed size array
+ * within a location definition.
+ */
+#define TFW_CANEG_ARRAY_SZ	(16)
+
 /*
  * All 'location' directives are put into a fixed size array.
  * Duplicate directives are not allowed.
@@ -121,79 +157,23 @@ static TfwAddr	tfw_capuacl_dflt[TFW_CAPUACL_ARRAY_SZ];
 static const char s_hdr_via_dflt[] =
 	"tempesta_fw" " (" TFW_NAME " " TFW_VERSION ")";
 
-/*
- * Matching functions for match operators. A TfwStr{} is compared
- * with a plain C string according to a specified match operator.
- * The functions are generic.
- */
-static bool
-__tfw_match_wildcard(tfw_match_t op, const char *cstr, size_t len, TfwStr *arg)
-{
-	return ((op == TFW_HTTP_MATCH_O_WILDCARD)
-		&& (len == 1) && (*cstr == '*'));
-}
-
-static bool
-__tfw_match_suffix(tfw_match_t op, const char *cstr, size_t len, TfwStr *arg)
-{
-	tfw_str_eq_flags_t flags = TFW_STR_EQ_DEFAULT | TFW_STR_EQ_CASEI;
-	return tfw_str_eq_cstr_off(arg, arg->len - len, cstr, len, flags);
-}
-
-static bool
-__tfw_match_eq(tfw_match_t op, const char *cstr, size_t len, TfwStr *arg)
-{
-	tfw_str_eq_flags_t flags = TFW_STR_EQ_DEFAULT | TFW_STR_EQ_CASEI;
-	return tfw_str_eq_cstr(arg, cstr, len, flags);
-}
-
-static bool
-__tfw_match_prefix(tfw_match_t op, const char *cstr, size_t len, TfwStr *arg)
-{
-	tfw_str_eq_flags_t flags = TFW_STR_EQ_PREFIX | TFW_STR_EQ_CASEI;
-	return tfw_str_eq_cstr(arg, cstr, len, flags);
-}
-
-typedef bool (*__tfw_match_fn)(tfw_match_t, const char *, size_t, TfwStr *);
-
-static const __tfw_match_fn __tfw_match_fn_tbl[] = {
-	[0 ... _TFW_HTTP_MATCH_O_COUNT] = NULL,
-	[TFW_HTTP_MATCH_O_WILDCARD]	= __tfw_match_wildcard,
-	[TFW_HTTP_MATCH_O_EQ]		= __tfw_match_eq,
-	[TFW_HTTP_MATCH_O_PREFIX]	= __tfw_match_prefix,
-	[TFW_HTTP_MATCH_O_SUFFIX]	= __tfw_match_suffix,
-};
-
 /*
  * Find a matching non-idempotent request directive. Strings
  * are compared according to the match operator in the directive.
  * A pointer to the matching TfwNipDef structure is returned if
  * the match is found. NULL is returned if there's no match.
  */
-static inline bool
-__tfw_nipdef_match_fn(TfwNipDef *nipdef, TfwStr *arg)
-{
-	__tfw_match_fn match_fn = __tfw_match_fn_tbl[nipdef->op];
-	BUG_ON(!match_fn);
-
-	return match_fn(nipdef->op, nipdef->arg, nipdef->len, arg);
-}
-
 TfwNipDef *
 tfw_nipdef_match(TfwLocation *loc, unsigned char method, TfwStr *arg)
 {
-	size_t i;
+	unsigned int i;
 
 	BUG_ON(!loc);
 	BUG_ON(!arg);
 
-	for (i = 0; i < loc->nipdef_sz; ++i) {
-		TfwNipDef *nipdef = loc->nipdef[i];
-		if ((nipdef->method & (1 << method))
-		    && __tfw_nipdef_match_fn(nipdef, arg))
-			return nipdef;
-	}
-	return NULL;
+	i = tfw_mtree_match(loc->nipdef_mt, arg, 1UL << method);
+
+	return i == TFW_MTREE_NOMATCH ? NULL : loc->nipdef[i];
 }
 
 /*
@@ -201,31 +181,30 @@ tfw_nipdef_match(TfwLocation *loc, unsigned char method, TfwStr *arg)
  * according to the match operator in the directive. A pointer
  * to the matching TfwCaPolicy structure is returned if the
  * match is found. Null is returned if there's no match.
- *
- * TODO #732 use multi-pattern string matching.
  */
-static inline bool
-__tfw_capolicy_match_fn(TfwCaPolicy *capo, TfwStr *arg)
+TfwCaPolicy *
+tfw_capolicy_match(TfwLocation *loc, TfwStr *arg)
 {
-	__tfw_match_fn match_fn = __tfw_match_fn_tbl[capo->op];
-	BUG_ON(!match_fn);
+	unsigned int i;
+
+	BUG_ON(!loc);
+	BUG_ON(!arg);
 
-	return match_fn(capo->op, capo->arg, capo->len, arg);
+	i = tfw_mtree_match(loc->capo_mt, arg, ~0UL);
+
+	return i == TFW_MTREE_NOMATCH ? NULL : loc->capo[i];
 }
 
-TfwCaPolicy *
-tfw_capolicy_match(TfwLocation *loc, TfwStr *arg)
+TfwCaNeg *
+tfw_caneg_match(TfwLocation *loc, unsigned short status)
 {
 	size_t i;
 
 	BUG_ON(!loc);
-	BUG_ON(!arg);
 
-	for (i = 0; i < loc->capo_sz; ++i) {
-		TfwCaPolicy *capo = loc->capo[i];
-		if (__tfw_capolicy_match_fn(capo, arg))
-			return capo;
-	}
+	for (i = 0; i < loc->caneg_sz; ++i)
+		if (loc->caneg[i].status == status)
+			return &loc->caneg[i];
 	return NULL;
 }
 
@@ -234,30 +213,17 @@ tfw_capolicy_match(TfwLocation *loc, TfwStr *arg)
  * A pointer to the matching TfwLocation structure is returned
  * if the match is found. NULL is returned if there's no match.
  */
-static inline bool
-__tfw_location_match(TfwLocation *loc, TfwStr *arg)
-{
-	__tfw_match_fn match_fn = __tfw_match_fn_tbl[loc->op];
-	BUG_ON(!match_fn);
-
-	return match_fn(loc->op, loc->arg, loc->len, arg);
-}
-
 TfwLocation *
 tfw_location_match(TfwVhost *vhost, TfwStr *arg)
 {
-	size_t i;
+	unsigned int i;
 
 	BUG_ON(!vhost);
 	BUG_ON(!arg);
 
-	for (i = 0; i < vhost->loc_sz; ++i) {
-		TfwLocation *loc = &vhost->loc[i];
-		if (__tfw_location_match(loc, arg))
-			return loc;
-	}
+	i = tfw_mtree_match(vhost->loc_mt, arg, ~0UL);
 
-	return NULL;
+	return i == TFW_MTREE_NOMATCH ? NULL : &vhost->loc[i];
 }
 
 /*
@@ -315,13 +281,46 @@ tfw_vhost_get_srv_conn(TfwMsg *msg)
 	return srv_conn;
 }
 
+/*
+ * Get the location of the request's current vhost, which mirrors the
+ * request to a shadow server group, or NULL if the request isn't mirrored.
+ */
+TfwLocation *
+tfw_vhost_mirror_location(TfwMsg *msg)
+{
+	TfwHttpReq *req = (TfwHttpReq *)msg;
+	TfwLocation *loc = req->location;
+
+	if (loc && loc->mirror_sg)
+		return loc;
+	loc = req->vhost->loc_dflt;
+
+	return loc->mirror_sg ? loc : NULL;
+}
+
+/*
+ * Search server connection in the shadow server group for a mirrored
+ * request, which has the same vhost and location as the original one.
+ */
+TfwSrvConn *
+tfw_vhost_get_mirror_srv_conn(TfwMsg *msg)
+{
+	TfwSrvGroup *sg = tfw_vhost_mirror_location(msg)->mirror_sg;
+
+	if (unlikely(!sg->sched))
+		return NULL;
+	T_DBG2("vhost: mirror to server group: '%s'\n", sg->name);
+
+	return sg->sched->sched_sg_conn(msg, sg);
+}
+
 /**
  * Find a headers modification description according to target message type
  * and current location.
  *
  * @loc		- request URI location;
  * @vhost	- virtual host for the request;
- * @mod_type	- Target modification type, TFW_VHOST_HDRMOD_(REQ|RESP).
+ * @mod_type	- Target modification type, TFW_VHOST_HDRMOD_(REQ|RESP|HINTS).
  */
 TfwHdrMods*
 tfw_vhost_get_hdr_mods(TfwLocation *loc, TfwVhost *vhost, int mod_type)
@@ -365,6 +364,16 @@ static FrangVhostCfg	tfw_frang_vhost_reconfig;
 static FrangGlobCfg	tfw_frang_glob_reconfig;
 
 
+/*
+ * Wildcard vhost names are '*.<suffix>' and match all the names ending with
+ * '.<suffix>', see __tfw_vhost_trie_lookup().
+ */
+static inline bool
+tfw_vhost_name_is_wildcard(const char *name)
+{
+	return name[0] == '*' && name[1] == '.';
+}
+
 /**
  * Match vhost to requested name. Called in process context during configuration
  * processing, both strings are guaranteed to be plain.
@@ -378,15 +387,6 @@ tfw_vhost_name_match(TfwVhost *vh, const TfwStr *name)
 		&& !strncasecmp(vh->name.data, name->data, vh->name.len);
 }
 
-/**
- *  Match vhost to requested name. Can be called in softirq context only.
- */
-static bool
-tfw_vhost_name_match_fast(TfwVhost *vh, const TfwStr *name)
-{
-	return !tfw_stricmp(&vh->name, name);
-}
-
 static inline TfwVhost *
 __tfw_vhost_lookup(TfwVhostList *vh_list, const TfwStr *name,
 		   bool (*match_fn)(TfwVhost *, const TfwStr *))
@@ -417,9 +417,89 @@ tfw_vhost_lookup_reconfig(const char *name)
 				  tfw_vhost_name_match);
 }
 
+static inline const TfwVhostNode *
+__tfw_vhost_trie_child(const TfwVhostNode *trie, const TfwVhostNode *node,
+		       unsigned char c)
+{
+	unsigned int ch;
+
+	for (ch = node->child; ch; ch = trie[ch].sibling)
+		if (trie[ch].c == c)
+			return &trie[ch];
+
+	return NULL;
+}
+
+/*
+ * Length of the trailing ':port' of host @name, the port isn't a part of
+ * vhost names.
+ */
+static size_t
+__tfw_vhost_port_len(const TfwStr *name)
+{
+	const TfwStr *c = TFW_STR_CHUNK(name, 0);
+	size_t n = 0;
+	int k;
+
+	for (k = TFW_STR_PLAIN(name) ? 0 : name->nchunks - 1; k >= 0; --k) {
+		const unsigned char *p = c[k].data;
+		size_t j = c[k].len;
+
+		while (j--) {
+			++n;
+			if (p[j] == ':')
+				return n;
+			if (!isdigit(p[j]))
+				return 0;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Walk @name backward through the trie of the reversed vhost names. The
+ * vhost with exactly the same name wins, otherwise the wildcard vhost with
+ * the longest matching suffix, so "a.b.example.com" matches "*.b.example.com"
+ * rather than "*.example.com".
+ */
+static TfwVhost *
+__tfw_vhost_trie_lookup(const TfwVhostNode *trie, const TfwStr *name)
+{
+	const TfwVhostNode *node = trie;
+	const TfwStr *c = TFW_STR_CHUNK(name, 0);
+	TfwVhost *wc_vhost = NULL;
+	size_t skip = __tfw_vhost_port_len(name);
+	int k;
+
+	for (k = TFW_STR_PLAIN(name) ? 0 : name->nchunks - 1; k >= 0; --k) {
+		const unsigned char *p = c[k].data;
+		size_t j = c[k].len;
+
+		if (skip >= j) {
+			skip -= j;
+			continue;
+		}
+		j -= skip;
+		skip = 0;
+		while (j--) {
+			if (p[j] == '.' && node->wc_vhost)
+				wc_vhost = node->wc_vhost;
+			node = __tfw_vhost_trie_child(trie, node,
+						      TFW_LC(p[j]));
+			if (!node)
+				return wc_vhost;
+		}
+	}
+
+	return node->vhost ? : wc_vhost;
+}
+
 /**
- * Find vhost in the _running_ configuration, matching name @name. The operation
- * involves fast avx2 operations and can be done only in softirq context.
+ * Find vhost in the _running_ configuration, matching name @name exactly or
+ * by a wildcard vhost name '*.<suffix>'. A trailing port of @name is ignored,
+ * so the same lookup serves the Host header and TLS SNI, and the default
+ * vhost is left for the caller to decide. Can be done only in softirq context.
  * If vhost is found, an additional reference is taken. Caller is responsible to
  * release the reference after use.
  */
@@ -429,14 +509,14 @@ tfw_vhost_lookup(const TfwStr *name)
 	TfwVhost *vhost;
 	TfwVhostList *vhlist;
 
-	if (unlikely(TFW_STR_EMPTY(name)))
+	if (unlikely(TFW_STR_EMPTY(name) || TFW_STR_DUP(name)))
 		return NULL;
 
 	rcu_read_lock_bh();
 	vhlist = rcu_dereference_bh(tfw_vhosts);
 	BUG_ON(!vhlist);
-	vhost = __tfw_vhost_lookup(vhlist, name,
-				   tfw_vhost_name_match_fast);
+	if ((vhost = __tfw_vhost_trie_lookup(vhlist->trie, name)))
+		tfw_vhost_get(vhost);
 	rcu_read_unlock_bh();
 
 	return vhost;
@@ -608,7 +688,7 @@ tfw_cfgop_nonidempotent(TfwCfgSpec *cs, TfwCfgEntry *ce, TfwLocation *loc)
 	/* The match operator. */
 	in_op = ce->vals[1];
 	ret = tfw_cfg_map_enum(tfw_match_enum, in_op, &op);
-	if (ret) {
+	if (ret || op == TFW_HTTP_MATCH_O_REGEX) {
 		T_ERR_NL("Unsupported match OP: '%s %s'\n", cs->name, in_op);
 		return -EINVAL;
 	}
@@ -683,11 +763,12 @@ tfw_cfgop_mod_hdr_add(TfwLocation *loc, const char *name, const char *value,
 		T_WARN_NL("Can't create header.\n");
 		return -ENOMEM;
 	}
+	bzero_fast(desc, sizeof(*desc));
 	desc->hdr = hdr;
 	desc->append = append;
-	desc->hid = (mod_type == TFW_VHOST_HDRMOD_RESP)
-			? tfw_http_msg_resp_spec_hid(hdr)
-			: tfw_http_msg_req_spec_hid(hdr);
+	desc->hid = (mod_type == TFW_VHOST_HDRMOD_REQ)
+			? tfw_http_msg_req_spec_hid(hdr)
+			: tfw_http_msg_resp_spec_hid(hdr);
 	++h_mods->sz;
 
 	return 0;
@@ -827,6 +908,43 @@ tfw_cfgop_out_resp_hdr_set(TfwCfgSpec *cs, TfwCfgEntry *ce)
 				 TFW_VHOST_HDRMOD_RESP, false);
 }
 
+/**
+ * Parse 'early_hint' directive: the value of a Link header sent in 103 Early
+ * Hints before the response to a request forwarded to a backend server.
+ */
+static int
+tfw_cfgop_early_hint(TfwCfgSpec *cs, TfwCfgEntry *ce, TfwLocation *loc)
+{
+	if (ce->attr_n || ce->val_n != 1) {
+		T_ERR_NL("%s: Invalid number of arguments.\n", cs->name);
+		return -EINVAL;
+	}
+
+	return tfw_cfgop_mod_hdr_add(loc, "link", ce->vals[0],
+				     TFW_VHOST_HDRMOD_HINTS, true);
+}
+
+static int
+tfw_cfgop_loc_early_hint(TfwCfgSpec *cs, TfwCfgEntry *ce)
+{
+	BUG_ON(!tfwcfg_this_location);
+	return tfw_cfgop_early_hint(cs, ce, tfwcfg_this_location);
+}
+
+static int
+tfw_cfgop_in_early_hint(TfwCfgSpec *cs, TfwCfgEntry *ce)
+{
+	BUG_ON(!tfw_vhost_entry);
+	return tfw_cfgop_early_hint(cs, ce, tfw_vhost_entry->loc_dflt);
+}
+
+static int
+tfw_cfgop_out_early_hint(TfwCfgSpec *cs, TfwCfgEntry *ce)
+{
+	return tfw_cfgop_early_hint(cs, ce,
+				    tfw_vhosts_reconfig->vhost_dflt->loc_dflt);
+}
+
 /*
  * Find a cache policy directive entry.
  */
@@ -902,6 +1020,10 @@ tfw_cfgop_capolicy(TfwCfgSpec *cs, TfwCfgEntry *ce, TfwLocation *loc, int cmd)
 		T_ERR_NL("Unknown match OP: '%s %s'\n", cs->name, in_op);
 		return -EINVAL;
 	}
+	if (op == TFW_HTTP_MATCH_O_REGEX) {
+		T_ERR_NL("Unsupported match OP: '%s %s'\n", cs->name, in_op);
+		return -EINVAL;
+	}
 
 	/* Add each match string in the directive to the array.*/
 	for (i = 1; i < ce->val_n; ++i) {
@@ -966,77 +1088,350 @@ tfw_cfgop_in_cache_bypass(TfwCfgSpec *cs, TfwCfgEntry *ce)
 				  TFW_D_CACHE_BYPASS);
 }
 
+/*
+ * Process a negative responses caching directive. A repeated directive for
+ * the same status overrides the previous one with a warning.
+ */
 static int
-tfw_cfgop_in_http_post_validate(TfwCfgSpec *cs, TfwCfgEntry *ce)
+tfw_cfgop_caneg(TfwCfgSpec *cs, TfwCfgEntry *ce, TfwLocation *loc)
 {
-	tfw_vhost_entry->loc_dflt->validate_post_req = 1;
+	int status;
+	unsigned int ttl;
+	TfwCaNeg *caneg;
+
+	if (ce->attr_n) {
+		T_ERR_NL("%s: Arguments may not have the '=' sign\n",
+			 cs->name);
+		return -EINVAL;
+	}
+	if (tfw_cfg_check_val_n(ce, 2))
+		return -EINVAL;
+	if (tfw_cfg_parse_int(ce->vals[0], &status)
+	    || status < 400 || status > 599)
+	{
+		T_ERR_NL("%s: Invalid status code: '%s'\n", cs->name,
+			 ce->vals[0]);
+		return -EINVAL;
+	}
+	if (tfw_cfg_parse_uint(ce->vals[1], &ttl) || !ttl) {
+		T_ERR_NL("%s: Invalid lifetime: '%s'\n", cs->name,
+			 ce->vals[1]);
+		return -EINVAL;
+	}
+
+	if ((caneg = tfw_caneg_match(loc, status))) {
+		T_WARN_NL("%s: Duplicate entry for status %d, the last one"
+			  " is used\n", cs->name, status);
+	} else {
+		if (loc->caneg_sz == TFW_CANEG_ARRAY_SZ)
+			return -ENOMEM;
+		caneg = &loc->caneg[loc->caneg_sz++];
+	}
+	caneg->status = status;
+	caneg->ttl = ttl;
+
 	return 0;
 }
 
 static int
-tfw_cfgop_out_cache_fulfill(TfwCfgSpec *cs, TfwCfgEntry *ce)
+tfw_cfgop_loc_cache_negative(TfwCfgSpec *cs, TfwCfgEntry *ce)
 {
-	TfwVhost *vh_dflt = tfw_vhosts_reconfig->vhost_dflt;
-	return tfw_cfgop_capolicy(cs, ce, vh_dflt->loc_dflt,
-				  TFW_D_CACHE_FULFILL);
+	BUG_ON(!tfwcfg_this_location);
+	return tfw_cfgop_caneg(cs, ce, tfwcfg_this_location);
 }
 
 static int
-tfw_cfgop_out_cache_bypass(TfwCfgSpec *cs, TfwCfgEntry *ce)
+tfw_cfgop_in_cache_negative(TfwCfgSpec *cs, TfwCfgEntry *ce)
+{
+	BUG_ON(!tfw_vhost_entry);
+	return tfw_cfgop_caneg(cs, ce, tfw_vhost_entry->loc_dflt);
+}
+
+static int
+tfw_cfgop_out_cache_negative(TfwCfgSpec *cs, TfwCfgEntry *ce)
 {
 	TfwVhost *vh_dflt = tfw_vhosts_reconfig->vhost_dflt;
-	return tfw_cfgop_capolicy(cs, ce, vh_dflt->loc_dflt,
-				  TFW_D_CACHE_BYPASS);
+	return tfw_cfgop_caneg(cs, ce, vh_dflt->loc_dflt);
 }
 
+/*
+ * Process the requests hedging directive: the argument is the APM
+ * percentile of the server response time used as the hedging deadline.
+ */
 static int
-tfw_cfgop_out_http_post_validate(TfwCfgSpec *cs, TfwCfgEntry *ce)
+tfw_cfgop_hedge(TfwCfgSpec *cs, TfwCfgEntry *ce, TfwLocation *loc)
 {
-	tfw_vhosts_reconfig->vhost_dflt->loc_dflt->validate_post_req = 1;
+	unsigned int idx, value;
+
+	if (ce->attr_n) {
+		T_ERR_NL("%s: Arguments may not have the '=' sign\n",
+			 cs->name);
+		return -EINVAL;
+	}
+	if (tfw_cfg_check_val_n(ce, 1))
+		return -EINVAL;
+	if (tfw_cfg_parse_uint(ce->vals[0], &value)) {
+		T_ERR_NL("%s: Invalid value: '%s'\n", cs->name, ce->vals[0]);
+		return -EINVAL;
+	}
+	for (idx = TFW_PSTATS_IDX_ITH; idx < _TFW_PSTATS_IDX_COUNT; ++idx)
+		if (tfw_pstats_ith[idx] == value)
+			break;
+	if (idx == _TFW_PSTATS_IDX_COUNT) {
+		T_ERR_NL("%s: Unsupported percentile: '%s'\n", cs->name,
+			 ce->vals[0]);
+		return -EINVAL;
+	}
+	loc->hedge_pidx = idx;
+
 	return 0;
 }
 
 /*
- * Find a location directive entry. The entry is looked up
- * in the array that holds all location directives.
+ * Process the requests priority directive used for the load shedding.
  */
-static TfwLocation *
-tfw_location_lookup(TfwVhost *vhost, tfw_match_t op, const char *arg, size_t len)
+static int
+tfw_cfgop_priority(TfwCfgSpec *cs, TfwCfgEntry *ce, TfwLocation *loc)
 {
-	size_t i;
+	static const char *prio[] = {
+		[TFW_HTTP_PRIO_LOW]	= "low",
+		[TFW_HTTP_PRIO_NORMAL]	= "normal",
+		[TFW_HTTP_PRIO_HIGH]	= "high",
+	};
+	int i;
 
-	for (i = 0; i < vhost->loc_sz; ++i) {
-		TfwLocation *loc = &vhost->loc[i];
-		if ((loc->op == op) && (loc->len == len)
-		    && !strncasecmp(loc->arg, arg, len))
-			return loc;
+	if (ce->attr_n) {
+		T_ERR_NL("%s: Arguments may not have the '=' sign\n",
+			 cs->name);
+		return -EINVAL;
 	}
+	if (tfw_cfg_check_val_n(ce, 1))
+		return -EINVAL;
+	for (i = TFW_HTTP_PRIO_LOW; i < ARRAY_SIZE(prio); ++i)
+		if (!strcasecmp(ce->vals[0], prio[i])) {
+			loc->priority = i;
+			return 0;
+		}
+	T_ERR_NL("%s: Unsupported priority: '%s'\n", cs->name, ce->vals[0]);
 
-	return NULL;
+	return -EINVAL;
 }
 
 static int
-tfw_frang_cfg_inherit(FrangVhostCfg *curr, const FrangVhostCfg *from)
+tfw_cfgop_loc_http_priority(TfwCfgSpec *cs, TfwCfgEntry *ce)
 {
-	int r = 0;
+	BUG_ON(!tfwcfg_this_location);
+	return tfw_cfgop_priority(cs, ce, tfwcfg_this_location);
+}
 
-	memcpy(curr, from, sizeof(FrangVhostCfg));
+static int
+tfw_cfgop_in_http_priority(TfwCfgSpec *cs, TfwCfgEntry *ce)
+{
+	BUG_ON(!tfw_vhost_entry);
+	return tfw_cfgop_priority(cs, ce, tfw_vhost_entry->loc_dflt);
+}
 
-	if (from->http_ct_vals) {
-		size_t sz = from->http_ct_vals->alloc_sz;
-		FrangCtVal *val;
-		long delta;
+static int
+tfw_cfgop_out_http_priority(TfwCfgSpec *cs, TfwCfgEntry *ce)
+{
+	TfwVhost *vh_dflt = tfw_vhosts_reconfig->vhost_dflt;
+	return tfw_cfgop_priority(cs, ce, vh_dflt->loc_dflt);
+}
 
-		curr->http_ct_vals = kzalloc(sz, GFP_KERNEL);
-		if (!curr->http_ct_vals) {
-			r = -ENOMEM;
-		}
-		delta = (void *)from->http_ct_vals - (void *)curr->http_ct_vals;
-		memcpy(curr->http_ct_vals, from->http_ct_vals, sz);
-		curr->http_ct_vals->vals = (void *)curr->http_ct_vals
-				+ sizeof(FrangCtVals);
-		curr->http_ct_vals->data -= delta;
-		/* Restore data pointers. */
+static int
+tfw_cfgop_loc_http_hedge(TfwCfgSpec *cs, TfwCfgEntry *ce)
+{
+	BUG_ON(!tfwcfg_this_location);
+	return tfw_cfgop_hedge(cs, ce, tfwcfg_this_location);
+}
+
+static int
+tfw_cfgop_in_http_hedge(TfwCfgSpec *cs, TfwCfgEntry *ce)
+{
+	BUG_ON(!tfw_vhost_entry);
+	return tfw_cfgop_hedge(cs, ce, tfw_vhost_entry->loc_dflt);
+}
+
+static int
+tfw_cfgop_out_http_hedge(TfwCfgSpec *cs, TfwCfgEntry *ce)
+{
+	TfwVhost *vh_dflt = tfw_vhosts_reconfig->vhost_dflt;
+	return tfw_cfgop_hedge(cs, ce, vh_dflt->loc_dflt);
+}
+
+/*
+ * Enable end-to-end latency statistics for a location or a vhost.
+ */
+static int
+tfw_cfgop_lat_stats(TfwCfgSpec *cs, TfwCfgEntry *ce)
+{
+	if (ce->val_n || ce->attr_n) {
+		T_ERR_NL("%s: arguments are not allowed\n", cs->name);
+		return -EINVAL;
+	}
+	return 0;
+}
+
+static int
+tfw_cfgop_loc_latency_stats(TfwCfgSpec *cs, TfwCfgEntry *ce)
+{
+	BUG_ON(!tfwcfg_this_location);
+	tfwcfg_this_location->lat_stats = 1;
+	return tfw_cfgop_lat_stats(cs, ce);
+}
+
+static int
+tfw_cfgop_in_latency_stats(TfwCfgSpec *cs, TfwCfgEntry *ce)
+{
+	BUG_ON(!tfw_vhost_entry);
+	set_bit(TFW_VHOST_B_LAT_STATS, &tfw_vhost_entry->flags);
+	return tfw_cfgop_lat_stats(cs, ce);
+}
+
+static int
+tfw_cfgop_out_latency_stats(TfwCfgSpec *cs, TfwCfgEntry *ce)
+{
+	TfwVhost *vh_dflt = tfw_vhosts_reconfig->vhost_dflt;
+
+	set_bit(TFW_VHOST_B_LAT_STATS, &vh_dflt->flags);
+	return tfw_cfgop_lat_stats(cs, ce);
+}
+
+static int
+tfw_cfgop_in_http_post_validate(TfwCfgSpec *cs, TfwCfgEntry *ce)
+{
+	tfw_vhost_entry->loc_dflt->validate_post_req = 1;
+	return 0;
+}
+
+/*
+ * Soft limits of the vhost resources: 'cpu' is percent of time of each CPU
+ * and 'bandwidth' is the total bytes per second of the vhost requests and
+ * responses. The limits are converted to the budgets of each CPU for
+ * TFW_VHOST_BUDGET_WIN windows.
+ */
+static int
+tfw_cfgop_in_budget(TfwCfgSpec *cs, TfwCfgEntry *ce)
+{
+	int i;
+	long bw = 0;
+	unsigned int cpu = 0;
+	const char *key, *val;
+
+	BUG_ON(!tfw_vhost_entry);
+	if (ce->val_n || !ce->attr_n) {
+		T_ERR_NL("%s: 'cpu' or 'bandwidth' argument is required\n",
+			 cs->name);
+		return -EINVAL;
+	}
+	TFW_CFG_ENTRY_FOR_EACH_ATTR(ce, i, key, val) {
+		if (!strcasecmp(key, "cpu")) {
+			if (tfw_cfg_parse_uint(val, &cpu) || !cpu || cpu > 100) {
+				T_ERR_NL("%s: Invalid CPU percent: '%s'\n",
+					 cs->name, val);
+				return -EINVAL;
+			}
+		} else if (!strcasecmp(key, "bandwidth")) {
+			if (tfw_cfg_parse_long(val, &bw) || bw <= 0) {
+				T_ERR_NL("%s: Invalid bandwidth: '%s'\n",
+					 cs->name, val);
+				return -EINVAL;
+			}
+		} else {
+			T_ERR_NL("%s: Unsupported argument: '%s'\n",
+				 cs->name, key);
+			return -EINVAL;
+		}
+	}
+
+	tfw_vhost_entry->budget_cpu = cpu;
+	tfw_vhost_entry->budget_bw = bw;
+	tfw_vhost_entry->budget_cycles = div_u64((u64)tsc_khz * 1000 * cpu
+						 * TFW_VHOST_BUDGET_WIN,
+						 100 * HZ);
+	tfw_vhost_entry->budget_bytes = div_u64((u64)bw * TFW_VHOST_BUDGET_WIN,
+						HZ * num_online_cpus());
+
+	return 0;
+}
+
+static int
+tfw_cfgop_in_cache_quota(TfwCfgSpec *cs, TfwCfgEntry *ce)
+{
+	int r;
+
+	BUG_ON(!tfw_vhost_entry);
+	cs->dest = &tfw_vhost_entry->cache_quota;
+	r = tfw_cfg_set_int(cs, ce);
+	cs->dest = NULL;
+
+	return r;
+}
+
+static int
+tfw_cfgop_out_cache_fulfill(TfwCfgSpec *cs, TfwCfgEntry *ce)
+{
+	TfwVhost *vh_dflt = tfw_vhosts_reconfig->vhost_dflt;
+	return tfw_cfgop_capolicy(cs, ce, vh_dflt->loc_dflt,
+				  TFW_D_CACHE_FULFILL);
+}
+
+static int
+tfw_cfgop_out_cache_bypass(TfwCfgSpec *cs, TfwCfgEntry *ce)
+{
+	TfwVhost *vh_dflt = tfw_vhosts_reconfig->vhost_dflt;
+	return tfw_cfgop_capolicy(cs, ce, vh_dflt->loc_dflt,
+				  TFW_D_CACHE_BYPASS);
+}
+
+static int
+tfw_cfgop_out_http_post_validate(TfwCfgSpec *cs, TfwCfgEntry *ce)
+{
+	tfw_vhosts_reconfig->vhost_dflt->loc_dflt->validate_post_req = 1;
+	return 0;
+}
+
+/*
+ * Find a location directive entry. The entry is looked up
+ * in the array that holds all location directives.
+ */
+static TfwLocation *
+tfw_location_lookup(TfwVhost *vhost, tfw_match_t op, const char *arg, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < vhost->loc_sz; ++i) {
+		TfwLocation *loc = &vhost->loc[i];
+		if ((loc->op == op) && (loc->len == len)
+		    && !strncasecmp(loc->arg, arg, len))
+			return loc;
+	}
+
+	return NULL;
+}
+
+static int
+tfw_frang_cfg_inherit(FrangVhostCfg *curr, const FrangVhostCfg *from)
+{
+	int r = 0;
+
+	memcpy(curr, from, sizeof(FrangVhostCfg));
+
+	if (from->http_ct_vals) {
+		size_t sz = from->http_ct_vals->alloc_sz;
+		FrangCtVal *val;
+		long delta;
+
+		curr->http_ct_vals = kzalloc(sz, GFP_KERNEL);
+		if (!curr->http_ct_vals) {
+			r = -ENOMEM;
+		}
+		delta = (void *)from->http_ct_vals - (void *)curr->http_ct_vals;
+		memcpy(curr->http_ct_vals, from->http_ct_vals, sz);
+		curr->http_ct_vals->vals = (void *)curr->http_ct_vals
+				+ sizeof(FrangCtVals);
+		curr->http_ct_vals->data -= delta;
+		/* Restore data pointers. */
 		for (val = curr->http_ct_vals->vals; val->str; ++ val)
 			val->str -= delta;
 	}
@@ -1065,7 +1460,9 @@ tfw_location_init(TfwLocation *loc, tfw_match_t op, const char *arg,
 	size_t size = sizeof(FrangVhostCfg)
 		    + sizeof(TfwCaPolicy *) * TFW_CAPOLICY_ARRAY_SZ
 		    + sizeof(TfwNipDef *) * TFW_NIPDEF_ARRAY_SZ
-		    + sizeof(TfwHdrModsDesc) * TFW_USRHDRS_ARRAY_SZ * 2;
+		    + sizeof(TfwHdrModsDesc) * TFW_USRHDRS_ARRAY_SZ
+		      * TFW_VHOST_HDRMOD_NUM
+		    + sizeof(TfwCaNeg) * TFW_CANEG_ARRAY_SZ;
 
 	if ((argmem = kmalloc(len + 1, GFP_KERNEL)) == NULL)
 		return -ENOMEM;
@@ -1087,6 +1484,12 @@ tfw_location_init(TfwLocation *loc, tfw_match_t op, const char *arg,
 			(TfwHdrModsDesc *)(loc->nipdef + TFW_NIPDEF_ARRAY_SZ);
 	loc->mod_hdrs[TFW_VHOST_HDRMOD_RESP].hdrs =
 			loc->mod_hdrs[TFW_VHOST_HDRMOD_REQ].hdrs + TFW_USRHDRS_ARRAY_SZ;
+	loc->mod_hdrs[TFW_VHOST_HDRMOD_HINTS].hdrs =
+			loc->mod_hdrs[TFW_VHOST_HDRMOD_RESP].hdrs
+			+ TFW_USRHDRS_ARRAY_SZ;
+	loc->caneg = (TfwCaNeg *)(loc->mod_hdrs[TFW_VHOST_HDRMOD_HINTS].hdrs
+				  + TFW_USRHDRS_ARRAY_SZ);
+	loc->caneg_sz = 0;
 	memcpy((void *)loc->arg, (void *)arg, len + 1);
 
 	return 0;
@@ -1149,6 +1552,23 @@ tfw_cfgop_location_begin(TfwCfgSpec *cs, TfwCfgEntry *ce, TfwVhost *vhost)
 		return -EINVAL;
 	}
 
+	/*
+	 * The regex locations of a vhost are compiled together on start,
+	 * but check each expression here to report the invalid directive.
+	 */
+	if (op == TFW_HTTP_MATCH_O_REGEX) {
+		TfwRegex re;
+		TfwStr pat = { .data = (char *)arg, .len = len };
+
+		if ((ret = tfw_regex_compile(&re, &pat, 1))) {
+			T_ERR_NL("%s: Invalid or too complex regular expression:"
+				 " '%s %s %s'\n", cs->name, cs->name, in_op,
+				 arg);
+			return ret;
+		}
+		tfw_regex_free(&re);
+	}
+
 	/* Make sure the location is not a duplicate. */
 	if (tfw_location_lookup(vhost, op, arg, len)) {
 		T_ERR_NL("%s: Duplicate entry: '%s %s %s'\n",
@@ -1265,6 +1685,8 @@ tfw_location_del(TfwLocation *loc)
 		BUG_ON(!loc->nipdef[i]);
 		kfree(loc->nipdef[i]);
 	}
+	tfw_mtree_free(loc->capo_mt);
+	tfw_mtree_free(loc->nipdef_mt);
 
 	__tfw_frang_clean(loc->frang_cfg);
 	/*
@@ -1274,8 +1696,11 @@ tfw_location_del(TfwLocation *loc)
 	kfree(loc->arg);
 	kfree(loc->frang_cfg);
 
+	for (i = 0; i < TFW_LAT_STATS_NUM; ++i)
+		tfw_apm_free(loc->apm_lat[i]);
 	tfw_sg_put(loc->main_sg);
 	tfw_sg_put(loc->backup_sg);
+	tfw_sg_put(loc->mirror_sg);
 }
 
 /*
@@ -1489,6 +1914,52 @@ tfw_cfgop_in_proxy_pass(TfwCfgSpec *cs, TfwCfgEntry *ce)
 	return tfw_cfgop_proxy_pass(cs, ce, tfw_vhost_entry->loc_dflt);
 }
 
+/*
+ * Process the traffic mirroring directive: the given percent of requests
+ * is copied to a shadow server group. The responses are discarded.
+ */
+static int
+tfw_cfgop_proxy_mirror(TfwCfgSpec *cs, TfwCfgEntry *ce, TfwLocation *loc)
+{
+	int r;
+	unsigned int ratio = 100;
+	const char *in_sg, *in_ratio;
+
+	if ((r = tfw_cfg_check_val_n(ce, 1)))
+		return r;
+
+	in_sg = ce->vals[0];
+	in_ratio = tfw_cfg_get_attr(ce, "ratio", NULL);
+	if (in_ratio
+	    && (tfw_cfg_parse_uint(in_ratio, &ratio) || !ratio || ratio > 100))
+	{
+		T_ERR_NL("%s: invalid ratio: '%s'\n", cs->name, in_ratio);
+		return -EINVAL;
+	}
+	if (!(loc->mirror_sg = tfw_sg_lookup_reconfig(in_sg, strlen(in_sg)))) {
+		T_ERR_NL("%s: srv_group is not found: '%s'\n", cs->name,
+			 in_sg);
+		return -EINVAL;
+	}
+	loc->mirror_ratio = ratio;
+
+	return 0;
+}
+
+static int
+tfw_cfgop_loc_proxy_mirror(TfwCfgSpec *cs, TfwCfgEntry *ce)
+{
+	BUG_ON(!tfwcfg_this_location);
+	return tfw_cfgop_proxy_mirror(cs, ce, tfwcfg_this_location);
+}
+
+static int
+tfw_cfgop_in_proxy_mirror(TfwCfgSpec *cs, TfwCfgEntry *ce)
+{
+	BUG_ON(!tfw_vhost_entry);
+	return tfw_cfgop_proxy_mirror(cs, ce, tfw_vhost_entry->loc_dflt);
+}
+
 static int
 tfw_cfgop_in_sticky_begin(TfwCfgSpec *cs, TfwCfgEntry *ce)
 {
@@ -1534,10 +2005,14 @@ tfw_vhost_destroy(TfwVhost *vhost)
 	for (i = 0; i < vhost->loc_sz; ++i)
 		tfw_location_del(&vhost->loc[i]);
 	tfw_location_del(vhost->loc_dflt);
+	tfw_mtree_free(vhost->loc_mt);
+	for (i = 0; i < TFW_LAT_STATS_NUM; ++i)
+		tfw_apm_free(vhost->apm_lat[i]);
 	tfw_http_sess_cookie_clean(vhost);
 	tfw_vhost_put(vhost->vhost_dflt);
 	tfw_pool_destroy(vhost->hdrs_pool);
 	tfw_tls_cert_clean(vhost);
+	free_percpu(vhost->acct);
 	kfree(vhost);
 }
 
@@ -1578,6 +2053,8 @@ tfw_vhost_create(const char *name)
 	memcpy(vhost->name.data, name, name_strlen + 1);
 	vhost->hdrs_pool = pool;
 	atomic64_set(&vhost->refcnt, 1);
+	/* The accounting is optional, the vhost works without it. */
+	vhost->acct = alloc_percpu(TfwVhostAcct);
 
 	return vhost;
 }
@@ -2077,6 +2554,24 @@ tfw_cfgop_in_tls_certificate_key(TfwCfgSpec *cs, TfwCfgEntry *ce)
 	return tfw_tls_set_cert_key(tfw_vhost_entry, cs, ce);
 }
 
+static int
+tfw_cfgop_out_tls_certificate_ocsp(TfwCfgSpec *cs, TfwCfgEntry *ce)
+{
+	if (tfw_vhosts_reconfig->expl_dflt) {
+		T_ERR_NL("%s: global level certificates are to be configured "
+			 "outside of explicit '%s' vhost.\n",
+			 cs->name, TFW_VH_DFT_NAME);
+		return -EINVAL;
+	}
+	return tfw_tls_set_cert_ocsp(tfw_vhosts_reconfig->vhost_dflt, cs, ce);
+}
+
+static int
+tfw_cfgop_in_tls_certificate_ocsp(TfwCfgSpec *cs, TfwCfgEntry *ce)
+{
+	return tfw_tls_set_cert_ocsp(tfw_vhost_entry, cs, ce);
+}
+
 static int
 tfw_cfgop_tls_any_sni(TfwCfgSpec *cs, TfwCfgEntry *ce)
 {
@@ -2139,6 +2634,7 @@ tfw_vhost_cfgstart(void)
 	}
 
 	tfw_vhosts_reconfig->expl_dflt = false;
+	tfw_vhosts_reconfig->trie = NULL;
 	hash_init(tfw_vhosts_reconfig->vh_hash);
 	if(!(vh_dflt = tfw_vhost_new(TFW_VH_DFT_NAME))) {
 		T_ERR_NL("Unable to create default vhost.\n");
@@ -2205,6 +2701,12 @@ tfw_cfgop_vhost_begin(TfwCfgSpec *cs, TfwCfgEntry *ce)
 		T_ERR_NL("Unexpected attributes\n");
 		return -EINVAL;
 	}
+	if (tfw_vhost_name_is_wildcard(ce->vals[0])
+	    && (!ce->vals[0][2] || strchr(ce->vals[0] + 2, '*')))
+	{
+		T_ERR_NL("Invalid wildcard vhost name: '%s'\n", ce->vals[0]);
+		return -EINVAL;
+	}
 	hash_for_each(tfw_vhosts_reconfig->vh_hash, i, vhost, hlist) {
 		if (!strcasecmp(vhost->name.data, ce->vals[0])) {
 			T_ERR_NL("Duplicate vhost entry: '%s'\n",
@@ -2266,79 +2768,483 @@ tfw_cfgop_vhosts_list_free(TfwVhostList *vhosts)
 	if (!vhosts)
 		return;
 
+	/*
+	 * Waiting for the RCU callbacks on each vhost takes seconds for
+	 * thousands of vhosts, so wait only once for all of them.
+	 */
 	hash_for_each_safe((vhosts->vh_hash), i, tmp, vhost, hlist) {
 		hash_del(&vhost->hlist);
 		set_bit(TFW_VHOST_B_REMOVED, &vhost->flags);
 		tfw_vhost_put(vhost);
-		tfw_srv_loop_sched_rcu();
+		cond_resched_rcu_qs();
 	}
 	set_bit(TFW_VHOST_B_REMOVED, &vhosts->vhost_dflt->flags);
 	tfw_vhost_put(vhosts->vhost_dflt);
+	tfw_srv_loop_sched_rcu();
+	kvfree(vhosts->trie);
 	kfree(vhosts);
 }
 
+/*
+ * Allocate APM data for the enabled latency statistics. The APM module
+ * needs the whole configuration to be processed, so that's done on start
+ * rather than on the directives processing.
+ */
 static int
-tfw_vhost_start(void)
+tfw_vhost_lat_stats_alloc(TfwVhost *vhost)
 {
-	TfwVhostList *vh_list;
+	int i, k;
 
-	rcu_read_lock();
-	vh_list = rcu_dereference(tfw_vhosts);
-	rcu_read_unlock();
-	rcu_assign_pointer(tfw_vhosts, tfw_vhosts_reconfig);
-	synchronize_rcu();
+	for (k = 0; k < TFW_LAT_STATS_NUM; ++k) {
+		if (test_bit(TFW_VHOST_B_LAT_STATS, &vhost->flags)
+		    && !(vhost->apm_lat[k] = tfw_apm_new()))
+			return -ENOMEM;
+		for (i = 0; i < vhost->loc_sz; ++i) {
+			TfwLocation *loc = &vhost->loc[i];
 
-	tfw_cfgop_vhosts_list_free(vh_list);
-	tfw_vhosts_reconfig = NULL;
+			if (loc->lat_stats && !(loc->apm_lat[k] = tfw_apm_new()))
+				return -ENOMEM;
+		}
+	}
 
 	return 0;
 }
 
-static void
-__tfw_cfgop_vhosts_cleanup(void)
+/*
+ * Compile the headers modifications @h_mods into the forms ready to copy into
+ * messages: HTTP/1.1 headers for tfw_http_msg_hdr_xfrm_str(), serialized
+ * HTTP/1.1 lines and, for responses, HPACK representations. The lines and
+ * the HPACK representations of all the headers are laid out back to back, so
+ * a cached response without any of the headers gets all of them by one copy.
+ */
+static int
+tfw_hdr_mods_compile(TfwHdrMods *h_mods, TfwPool *pool, bool resp)
 {
-	tfw_cfgop_vhosts_list_free(tfw_vhosts_reconfig);
-	tfw_vhosts_reconfig = NULL;
+	size_t i, h1_len = 0, h2_len = 0;
+	char *h1, *h2 = NULL;
+	TfwStr *chunks;
 
-	if (!tfw_runstate_is_reconfig()) {
-		tfw_cfgop_vhosts_list_free(tfw_vhosts);
-		tfw_vhosts = NULL;
+	/* The default location may be also in the vhosts hash. */
+	if (!h_mods->sz || h_mods->hdrs[0].h1_hdr.chunks)
+		return 0;
+
+	for (i = 0; i < h_mods->sz; ++i) {
+		TfwStr *hdr = h_mods->hdrs[i].hdr;
+
+		if (hdr->nchunks < 2)
+			continue;
+		h1_len += hdr->len + SLEN(S_DLM) + SLEN(S_CRLF);
+		h2_len += hdr->len + HPACK_ENC_HDR_OVERHEAD;
+	}
+	chunks = tfw_pool_alloc(pool, h_mods->sz * 3 * sizeof(TfwStr));
+	h1 = tfw_pool_alloc_not_align(pool, h1_len);
+	if (resp)
+		h2 = tfw_pool_alloc_not_align(pool, h2_len);
+	if (!chunks || !h1 || (resp && !h2))
+		return -ENOMEM;
+	h_mods->h1.data = h1;
+	h_mods->h2.data = h2;
+
+	for (i = 0; i < h_mods->sz; ++i, chunks += 3) {
+		TfwHdrModsDesc *d = &h_mods->hdrs[i];
+		TfwStr *hdr = d->hdr, *name = &hdr->chunks[0];
+
+		/*
+		 * Header is stored optimized for HTTP2: without delimiter
+		 * between header and value.
+		 */
+		chunks[0] = *name;
+		chunks[1] = (TfwStr){ .data = S_DLM, .len = SLEN(S_DLM) };
+		d->h1_hdr = (TfwStr){
+			.chunks = chunks,
+			.len = hdr->len + SLEN(S_DLM),
+			.nchunks = 2,
+			.flags = hdr->flags & ~TFW_STR_CN_RESERVE,
+			.eolen = hdr->eolen
+		};
+		if (hdr->nchunks < 2)
+			continue;
+		chunks[2] = hdr->chunks[1];
+		d->h1_hdr.nchunks = 3;
+
+		d->h1.data = h1;
+		memcpy(h1, name->data, name->len);
+		h1 += name->len;
+		memcpy(h1, S_DLM, SLEN(S_DLM));
+		h1 += SLEN(S_DLM);
+		memcpy(h1, hdr->chunks[1].data, hdr->chunks[1].len);
+		h1 += hdr->chunks[1].len;
+		memcpy(h1, S_CRLF, SLEN(S_CRLF));
+		h1 += SLEN(S_CRLF);
+		d->h1.len = h1 - (char *)d->h1.data;
+		h_mods->h1.len += d->h1.len;
+
+		if (!resp)
+			continue;
+		d->h2.data = h2;
+		d->h2.len = tfw_hpack_encode_nodyn(hdr, h2);
+		h2 += d->h2.len;
+		h_mods->h2.len += d->h2.len;
 	}
-}
 
-static void
-tfw_cfgop_vhosts_cleanup(TfwCfgSpec *cs)
-{
-	__tfw_cfgop_vhosts_cleanup();
+	return 0;
 }
 
-static void
-tfw_vhost_cfgclean(void)
+static int
+tfw_location_hdr_mods_compile(TfwLocation *loc)
 {
-	__tfw_cfgop_vhosts_cleanup();
+	int r;
 
-	if (tfw_runstate_is_reconfig())
-		return;
+	r = tfw_hdr_mods_compile(&loc->mod_hdrs[TFW_VHOST_HDRMOD_REQ],
+				 loc->hdrs_pool, false);
+	if (r)
+		return r;
 
-	tfw_global.capuacl_sz =
-	tfw_global.cache_purge =
-	tfw_global.cache_purge_mode =
-	tfw_global.cache_purge_acl = 0;
+	r = tfw_hdr_mods_compile(&loc->mod_hdrs[TFW_VHOST_HDRMOD_RESP],
+				 loc->hdrs_pool, true);
+	if (r)
+		return r;
 
-	if (tfw_global.hdr_via && (tfw_global.hdr_via != s_hdr_via_dflt))
-		kfree(tfw_global.hdr_via);
-	tfw_global.hdr_via = s_hdr_via_dflt;
+	return tfw_hdr_mods_compile(&loc->mod_hdrs[TFW_VHOST_HDRMOD_HINTS],
+				    loc->hdrs_pool, true);
 }
 
 /*
- * Not all Frang specs can be applied to nested locations and can be applied
- * only as high-level options. It's possible to provide their own sets for
- * global and inner (location) options. But warning "line 32: the frang limit
- * can be assigned only at global level" is much more user friendly than generic
- * "line 32: unknown command".
+ * Compile the headers modifications of all the locations of @vhost, see
+ * tfw_hdr_mods_compile().
  */
-static TfwCfgSpec tfw_global_frang_specs[] = {
-	/* Options that can be enabled|disabled only globally. */
+static int
+tfw_vhost_hdr_mods_compile(TfwVhost *vhost)
+{
+	int r;
+	size_t i;
+
+	if ((r = tfw_location_hdr_mods_compile(vhost->loc_dflt)))
+		return r;
+	for (i = 0; i < vhost->loc_sz; ++i)
+		if ((r = tfw_location_hdr_mods_compile(&vhost->loc[i])))
+			return r;
+
+	return 0;
+}
+
+static int
+__tfw_mtree_build(TfwMtree **t, const TfwMtreeKey *keys, size_t n)
+{
+	TfwMtree *mt = tfw_mtree_new(keys, n);
+
+	if (IS_ERR(mt))
+		return PTR_ERR(mt);
+	*t = mt;
+
+	return 0;
+}
+
+/*
+ * Build the match trees of cache policies and non-idempotent requests
+ * definitions of @loc using @keys array of enough size.
+ */
+static int
+tfw_location_mtree_build(TfwLocation *loc, TfwMtreeKey *keys)
+{
+	int r;
+	size_t i;
+
+	for (i = 0; i < loc->capo_sz; ++i) {
+		TfwCaPolicy *capo = loc->capo[i];
+
+		keys[i] = (TfwMtreeKey){
+			.op = capo->op, .mask = ~0UL,
+			.arg = capo->arg, .len = capo->len
+		};
+	}
+	if ((r = __tfw_mtree_build(&loc->capo_mt, keys, loc->capo_sz)))
+		return r;
+
+	for (i = 0; i < loc->nipdef_sz; ++i) {
+		TfwNipDef *nipdef = loc->nipdef[i];
+
+		keys[i] = (TfwMtreeKey){
+			.op = nipdef->op, .mask = nipdef->method,
+			.arg = nipdef->arg, .len = nipdef->len
+		};
+	}
+
+	return __tfw_mtree_build(&loc->nipdef_mt, keys, loc->nipdef_sz);
+}
+
+/*
+ * Build the match trees for the locations of @vhost and for the directives
+ * of each location, so each lookup walks the URI once instead of the
+ * evaluation of each directive. The trees need the whole configuration of
+ * the locations, so that's done on start.
+ */
+static int
+tfw_vhost_mtree_build(TfwVhost *vhost)
+{
+	int r;
+	size_t i;
+	TfwMtreeKey *keys;
+
+	/* The default vhost may be also in the vhosts hash. */
+	if (vhost->loc_mt)
+		return 0;
+
+	keys = kmalloc_array(max3(TFW_LOCATION_ARRAY_SZ, TFW_CAPOLICY_ARRAY_SZ,
+				  TFW_NIPDEF_ARRAY_SZ),
+			     sizeof(*keys), GFP_KERNEL);
+	if (!keys)
+		return -ENOMEM;
+
+	if ((r = tfw_location_mtree_build(vhost->loc_dflt, keys)))
+		goto out;
+	for (i = 0; i < vhost->loc_sz; ++i)
+		if ((r = tfw_location_mtree_build(&vhost->loc[i], keys)))
+			goto out;
+
+	for (i = 0; i < vhost->loc_sz; ++i) {
+		TfwLocation *loc = &vhost->loc[i];
+
+		keys[i] = (TfwMtreeKey){
+			.op = loc->op, .mask = ~0UL,
+			.arg = loc->arg, .len = loc->len
+		};
+	}
+	r = __tfw_mtree_build(&vhost->loc_mt, keys, vhost->loc_sz);
+out:
+	if (r)
+		T_ERR_NL("Unable to compile locations of vhost '%s'\n",
+			 vhost->name.data);
+	kfree(keys);
+	return r;
+}
+
+/*
+ * Update end-to-end latency statistics of a request to @vhost and @loc
+ * for the response of @kind.
+ */
+void
+tfw_vhost_lat_stats_update(TfwVhost *vhost, TfwLocation *loc, int kind,
+			   unsigned long jrtt)
+{
+	if (vhost && vhost->apm_lat[kind])
+		tfw_apm_update_lat(vhost->apm_lat[kind], jrtt);
+	if (loc && loc->apm_lat[kind])
+		tfw_apm_update_lat(loc->apm_lat[kind], jrtt);
+}
+
+/**
+ * Account @cycles of CPU, @rx bytes received and @tx bytes sent for a request
+ * of @vhost on the current CPU.
+ */
+void
+tfw_vhost_acct(TfwVhost *vhost, u64 cycles, unsigned long rx,
+	       unsigned long tx)
+{
+	TfwVhostAcct *a;
+
+	if (unlikely(!vhost || !vhost->acct))
+		return;
+
+	local_bh_disable();
+	a = this_cpu_ptr(vhost->acct);
+	a->cycles += cycles;
+	a->rx_bytes += rx;
+	a->tx_bytes += tx;
+	++a->reqs;
+	a->win_cycles += cycles;
+	a->win_bytes += rx + tx;
+	local_bh_enable();
+}
+
+/**
+ * Tell if @vhost has exceeded its resource budget on the current CPU in the
+ * current budget window. The budgets are checked per CPU, so the check is
+ * cheap and an over-budget vhost is throttled on the CPUs it loads, before
+ * the other vhosts served by the CPUs are affected.
+ */
+bool
+tfw_vhost_over_budget(TfwVhost *vhost)
+{
+	TfwVhostAcct *a;
+
+	if (likely(!vhost->budget_cycles && !vhost->budget_bytes)
+	    || unlikely(!vhost->acct))
+		return false;
+
+	a = this_cpu_ptr(vhost->acct);
+	if (time_after_eq(jiffies, a->win_start + TFW_VHOST_BUDGET_WIN)) {
+		a->win_start = jiffies;
+		a->win_cycles = 0;
+		a->win_bytes = 0;
+		return false;
+	}
+	if ((vhost->budget_cycles && a->win_cycles > vhost->budget_cycles)
+	    || (vhost->budget_bytes && a->win_bytes > vhost->budget_bytes))
+	{
+		++a->throttled;
+		return true;
+	}
+
+	return false;
+}
+
+/*
+ * Call @cb for each active vhost. The function must be called only from
+ * start hooks, when the list of vhosts can't be replaced concurrently.
+ */
+int
+tfw_vhost_for_each(int (*cb)(TfwVhost *vhost))
+{
+	TfwVhostList *vh_list;
+	TfwVhost *vhost;
+	int i, r;
+
+	rcu_read_lock();
+	vh_list = rcu_dereference(tfw_vhosts);
+	rcu_read_unlock();
+	if (!vh_list)
+		return 0;
+
+	hash_for_each(vh_list->vh_hash, i, vhost, hlist)
+		if ((r = cb(vhost)))
+			return r;
+
+	return 0;
+}
+
+/*
+ * Build the trie of the reversed vhost names of @vh_list. A wildcard name
+ * '*.example.com' is inserted as 'example.com' marked as wildcard.
+ */
+static int
+tfw_vhost_trie_build(TfwVhostList *vh_list)
+{
+	TfwVhost *vhost;
+	TfwVhostNode *trie;
+	unsigned int n = 1;
+	int i;
+
+	hash_for_each(vh_list->vh_hash, i, vhost, hlist)
+		n += vhost->name.len;
+	if (!(trie = kvmalloc_array(n, sizeof(TfwVhostNode), GFP_KERNEL)))
+		return -ENOMEM;
+	memset(trie, 0, sizeof(TfwVhostNode));
+
+	n = 1;
+	hash_for_each(vh_list->vh_hash, i, vhost, hlist) {
+		TfwVhostNode *node = trie;
+		const unsigned char *name = vhost->name.data;
+		size_t len = vhost->name.len;
+		bool wc = tfw_vhost_name_is_wildcard(vhost->name.data);
+
+		if (wc) {
+			name += 2;
+			len -= 2;
+		}
+		while (len--) {
+			unsigned char c = TFW_LC(name[len]);
+			unsigned int ch;
+
+			for (ch = node->child; ch; ch = trie[ch].sibling)
+				if (trie[ch].c == c)
+					break;
+			if (!ch) {
+				ch = n++;
+				trie[ch] = (TfwVhostNode){
+					.sibling = node->child,
+					.c = c
+				};
+				node->child = ch;
+			}
+			node = &trie[ch];
+		}
+		if (wc)
+			node->wc_vhost = vhost;
+		else
+			node->vhost = vhost;
+	}
+	vh_list->trie = trie;
+
+	return 0;
+}
+
+static int
+tfw_vhost_start(void)
+{
+	TfwVhostList *vh_list;
+	TfwVhost *vhost;
+	int i, r;
+
+	hash_for_each(tfw_vhosts_reconfig->vh_hash, i, vhost, hlist)
+		if ((r = tfw_vhost_lat_stats_alloc(vhost))
+		    || (r = tfw_vhost_mtree_build(vhost))
+		    || (r = tfw_vhost_hdr_mods_compile(vhost)))
+			return r;
+	vhost = tfw_vhosts_reconfig->vhost_dflt;
+	if ((r = tfw_vhost_mtree_build(vhost))
+	    || (r = tfw_vhost_hdr_mods_compile(vhost)))
+		return r;
+	if ((r = tfw_vhost_trie_build(tfw_vhosts_reconfig)))
+		return r;
+
+	rcu_read_lock();
+	vh_list = rcu_dereference(tfw_vhosts);
+	rcu_read_unlock();
+	rcu_assign_pointer(tfw_vhosts, tfw_vhosts_reconfig);
+	synchronize_rcu();
+
+	tfw_cfgop_vhosts_list_free(vh_list);
+	tfw_vhosts_reconfig = NULL;
+
+	return 0;
+}
+
+static void
+__tfw_cfgop_vhosts_cleanup(void)
+{
+	tfw_cfgop_vhosts_list_free(tfw_vhosts_reconfig);
+	tfw_vhosts_reconfig = NULL;
+
+	if (!tfw_runstate_is_reconfig()) {
+		tfw_cfgop_vhosts_list_free(tfw_vhosts);
+		tfw_vhosts = NULL;
+	}
+}
+
+static void
+tfw_cfgop_vhosts_cleanup(TfwCfgSpec *cs)
+{
+	__tfw_cfgop_vhosts_cleanup();
+}
+
+static void
+tfw_vhost_cfgclean(void)
+{
+	__tfw_cfgop_vhosts_cleanup();
+
+	if (tfw_runstate_is_reconfig())
+		return;
+
+	tfw_global.capuacl_sz =
+	tfw_global.cache_purge =
+	tfw_global.cache_purge_mode =
+	tfw_global.cache_purge_acl = 0;
+
+	if (tfw_global.hdr_via && (tfw_global.hdr_via != s_hdr_via_dflt))
+		kfree(tfw_global.hdr_via);
+	tfw_global.hdr_via = s_hdr_via_dflt;
+}
+
+/*
+ * Not all Frang specs can be applied to nested locations and can be applied
+ * only as high-level options. It's possible to provide their own sets for
+ * global and inner (location) options. But warning "line 32: the frang limit
+ * can be assigned only at global level" is much more user friendly than generic
+ * "line 32: unknown command".
+ */
+static TfwCfgSpec tfw_global_frang_specs[] = {
+	/* Options that can be enabled|disabled only globally. */
 	{
 		.name = "ip_block",
 		.deflt = "off",
@@ -2369,6 +3275,13 @@ static TfwCfgSpec tfw_global_frang_specs[] = {
 		},
 		.allow_reconfig = true,
 	},
+	{
+		.name = "request_rate_gcra",
+		.deflt = "off",
+		.handler = tfw_cfgop_frang_glob_set_bool,
+		.dest = &tfw_frang_glob_reconfig.req_gcra,
+		.allow_reconfig = true,
+	},
 	{
 		.name = "connection_rate",
 		.deflt = "0",
@@ -2389,6 +3302,13 @@ static TfwCfgSpec tfw_global_frang_specs[] = {
 		},
 		.allow_reconfig = true,
 	},
+	{
+		.name = "connection_syn_limit",
+		.deflt = "off",
+		.handler = tfw_cfgop_frang_glob_set_bool,
+		.dest = &tfw_frang_glob_reconfig.conn_syn,
+		.allow_reconfig = true,
+	},
 	{
 		.name = "concurrent_connections",
 		.deflt = "0",
@@ -2399,6 +3319,16 @@ static TfwCfgSpec tfw_global_frang_specs[] = {
 		},
 		.allow_reconfig = true,
 	},
+	{
+		.name = "tunnel_rate",
+		.deflt = "0",
+		.handler = tfw_cfgop_frang_glob_set_int,
+		.dest = &tfw_frang_glob_reconfig.tunnel_rate,
+		.spec_ext = &(TfwCfgSpecInt) {
+			.range = { 0, INT_MAX },
+		},
+		.allow_reconfig = true,
+	},
 	{
 		.name = "client_header_timeout",
 		.deflt = "0",
@@ -2529,6 +3459,12 @@ static TfwCfgSpec tfw_vhost_frang_specs[] = {
 		.allow_reconfig = true,
 		.allow_none = true,
 	},
+	{
+		.name = "request_rate_gcra",
+		.handler = tfw_cfgop_frang_glob_in_vhost,
+		.allow_reconfig = true,
+		.allow_none = true,
+	},
 	{
 		.name = "connection_rate",
 		.handler = tfw_cfgop_frang_glob_in_vhost,
@@ -2541,12 +3477,24 @@ static TfwCfgSpec tfw_vhost_frang_specs[] = {
 		.allow_reconfig = true,
 		.allow_none = true,
 	},
+	{
+		.name = "connection_syn_limit",
+		.handler = tfw_cfgop_frang_glob_in_vhost,
+		.allow_reconfig = true,
+		.allow_none = true,
+	},
 	{
 		.name = "concurrent_connections",
 		.handler = tfw_cfgop_frang_glob_in_vhost,
 		.allow_reconfig = true,
 		.allow_none = true,
 	},
+	{
+		.name = "tunnel_rate",
+		.handler = tfw_cfgop_frang_glob_in_vhost,
+		.allow_reconfig = true,
+		.allow_none = true,
+	},
 	{
 		.name = "client_header_timeout",
 		.handler = tfw_cfgop_frang_glob_in_vhost,
@@ -2660,6 +3608,14 @@ static TfwCfgSpec tfw_vhost_location_specs[] = {
 		.allow_repeat = true,
 		.allow_reconfig = true,
 	},
+	{
+		.name = "cache_negative",
+		.deflt = NULL,
+		.handler = tfw_cfgop_loc_cache_negative,
+		.allow_none = true,
+		.allow_repeat = true,
+		.allow_reconfig = true,
+	},
 	{
 		.name = "nonidempotent",
 		.deflt = NULL,
@@ -2700,6 +3656,14 @@ static TfwCfgSpec tfw_vhost_location_specs[] = {
 		.allow_repeat = true,
 		.allow_reconfig = true,
 	},
+	{
+		.name = "early_hint",
+		.deflt = NULL,
+		.handler = tfw_cfgop_loc_early_hint,
+		.allow_none = true,
+		.allow_repeat = true,
+		.allow_reconfig = true,
+	},
 	{
 		.name = "http_post_validate",
 		.handler = tfw_cfgop_http_post_validate,
@@ -2707,6 +3671,27 @@ static TfwCfgSpec tfw_vhost_location_specs[] = {
 		.allow_repeat = false,
 		.allow_reconfig = true,
 	},
+	{
+		.name = "http_hedge",
+		.handler = tfw_cfgop_loc_http_hedge,
+		.allow_none = true,
+		.allow_repeat = false,
+		.allow_reconfig = true,
+	},
+	{
+		.name = "http_priority",
+		.handler = tfw_cfgop_loc_http_priority,
+		.allow_none = true,
+		.allow_repeat = false,
+		.allow_reconfig = true,
+	},
+	{
+		.name = "latency_stats",
+		.handler = tfw_cfgop_loc_latency_stats,
+		.allow_none = true,
+		.allow_repeat = false,
+		.allow_reconfig = true,
+	},
 	{
 		.name = "http_resp_code_block",
 		.handler = tfw_cfgop_frang_rsp_code_block,
@@ -2722,6 +3707,14 @@ static TfwCfgSpec tfw_vhost_location_specs[] = {
 		.allow_repeat = false,
 		.allow_reconfig = true,
 	},
+	{
+		.name = "proxy_mirror",
+		.deflt = NULL,
+		.handler = tfw_cfgop_loc_proxy_mirror,
+		.allow_none = true,
+		.allow_repeat = false,
+		.allow_reconfig = true,
+	},
 	{
 		.name = "frang_limits",
 		.handler = tfw_cfg_handle_children,
@@ -2751,6 +3744,14 @@ static TfwCfgSpec tfw_vhost_internal_specs[] = {
 		.allow_repeat = true,
 		.allow_reconfig = true,
 	},
+	{
+		.name = "cache_negative",
+		.deflt = NULL,
+		.handler = tfw_cfgop_in_cache_negative,
+		.allow_none = true,
+		.allow_repeat = true,
+		.allow_reconfig = true,
+	},
 	{
 		.name = "http_post_validate",
 		.deflt = NULL,
@@ -2759,6 +3760,49 @@ static TfwCfgSpec tfw_vhost_internal_specs[] = {
 		.allow_repeat = false,
 		.allow_reconfig = true,
 	},
+	{
+		.name = "http_hedge",
+		.deflt = NULL,
+		.handler = tfw_cfgop_in_http_hedge,
+		.allow_none = true,
+		.allow_repeat = false,
+		.allow_reconfig = true,
+	},
+	{
+		.name = "http_priority",
+		.deflt = NULL,
+		.handler = tfw_cfgop_in_http_priority,
+		.allow_none = true,
+		.allow_repeat = false,
+		.allow_reconfig = true,
+	},
+	{
+		.name = "latency_stats",
+		.deflt = NULL,
+		.handler = tfw_cfgop_in_latency_stats,
+		.allow_none = true,
+		.allow_repeat = false,
+		.allow_reconfig = true,
+	},
+	{
+		.name = "budget",
+		.deflt = NULL,
+		.handler = tfw_cfgop_in_budget,
+		.allow_none = true,
+		.allow_repeat = false,
+		.allow_reconfig = true,
+	},
+	{
+		.name = "cache_quota",
+		.deflt = NULL,
+		.handler = tfw_cfgop_in_cache_quota,
+		.spec_ext = &(TfwCfgSpecInt) {
+			.range = { 0, (1 << 30) },
+		},
+		.allow_none = true,
+		.allow_repeat = false,
+		.allow_reconfig = true,
+	},
 	{
 		.name = "nonidempotent",
 		.deflt = NULL,
@@ -2799,6 +3843,14 @@ static TfwCfgSpec tfw_vhost_internal_specs[] = {
 		.allow_repeat = true,
 		.allow_reconfig = true,
 	},
+	{
+		.name = "early_hint",
+		.deflt = NULL,
+		.handler = tfw_cfgop_in_early_hint,
+		.allow_none = true,
+		.allow_repeat = true,
+		.allow_reconfig = true,
+	},
 	{
 		.name = "proxy_pass",
 		.deflt = NULL,
@@ -2807,6 +3859,14 @@ static TfwCfgSpec tfw_vhost_internal_specs[] = {
 		.allow_repeat = false,
 		.allow_reconfig = true,
 	},
+	{
+		.name = "proxy_mirror",
+		.deflt = NULL,
+		.handler = tfw_cfgop_in_proxy_mirror,
+		.allow_none = true,
+		.allow_repeat = false,
+		.allow_reconfig = true,
+	},
 	{
 		.name = "tls_certificate",
 		.deflt = NULL,
@@ -2823,6 +3883,14 @@ static TfwCfgSpec tfw_vhost_internal_specs[] = {
 		.allow_repeat = true,
 		.allow_reconfig = true,
 	},
+	{
+		.name = "tls_certificate_ocsp",
+		.deflt = NULL,
+		.handler = tfw_cfgop_in_tls_certificate_ocsp,
+		.allow_none = true,
+		.allow_repeat = true,
+		.allow_reconfig = true,
+	},
 	{
 		.name = "tls_match_any_server_name",
 		.deflt = "false",
@@ -2909,6 +3977,14 @@ static TfwCfgSpec tfw_vhost_specs[] = {
 		.allow_repeat = true,
 		.allow_reconfig = true,
 	},
+	{
+		.name = "cache_negative",
+		.deflt = NULL,
+		.handler = tfw_cfgop_out_cache_negative,
+		.allow_none = true,
+		.allow_repeat = true,
+		.allow_reconfig = true,
+	},
 	{
 		.name = "http_post_validate",
 		.deflt = NULL,
@@ -2917,6 +3993,30 @@ static TfwCfgSpec tfw_vhost_specs[] = {
 		.allow_repeat = false,
 		.allow_reconfig = true,
 	},
+	{
+		.name = "http_hedge",
+		.deflt = NULL,
+		.handler = tfw_cfgop_out_http_hedge,
+		.allow_none = true,
+		.allow_repeat = false,
+		.allow_reconfig = true,
+	},
+	{
+		.name = "http_priority",
+		.deflt = NULL,
+		.handler = tfw_cfgop_out_http_priority,
+		.allow_none = true,
+		.allow_repeat = false,
+		.allow_reconfig = true,
+	},
+	{
+		.name = "latency_stats",
+		.deflt = NULL,
+		.handler = tfw_cfgop_out_latency_stats,
+		.allow_none = true,
+		.allow_repeat = false,
+		.allow_reconfig = true,
+	},
 	{
 		.name = "nonidempotent",
 		.deflt = NULL,
@@ -2957,6 +4057,14 @@ static TfwCfgSpec tfw_vhost_specs[] = {
 		.allow_repeat = true,
 		.allow_reconfig = true,
 	},
+	{
+		.name = "early_hint",
+		.deflt = NULL,
+		.handler = tfw_cfgop_out_early_hint,
+		.allow_none = true,
+		.allow_repeat = true,
+		.allow_reconfig = true,
+	},
 	{
 		.name = "tls_certificate",
 		.deflt = NULL,
@@ -2973,6 +4081,14 @@ static TfwCfgSpec tfw_vhost_specs[] = {
 		.allow_repeat = true,
 		.allow_reconfig = true,
 	},
+	{
+		.name = "tls_certificate_ocsp",
+		.deflt = NULL,
+		.handler = tfw_cfgop_out_tls_certificate_ocsp,
+		.allow_none = true,
+		.allow_repeat = true,
+		.allow_reconfig = true,
+	},
 	{
 		.name = "tls_match_any_server_name",
 		.deflt = "false",
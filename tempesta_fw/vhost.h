@@ -25,6 +25,7 @@
 #include "msg.h"
 #include "server.h"
 #include "tls.h"
+#include "mtree.h"
 
 /**
  * Non-Idempotent Request definition.
@@ -62,36 +63,69 @@ typedef struct {
 	const char	*arg;
 } TfwCaPolicy;
 
+/**
+ * Negative (error) responses caching policy.
+ *
+ * @status	- HTTP status of the responses;
+ * @ttl		- lifetime of the responses in the cache, in seconds;
+ */
+typedef struct {
+	unsigned short	status;
+	unsigned int	ttl;
+} TfwCaNeg;
+
 /**
  * Headers modification description.
  *
  * @hdr		- Header string, see @tfw_http_msg_hdr_xfrm_str();
  * @add_hdrs	- Headers to modify;
+ * @h1_hdr	- @hdr with the delimiter for tfw_http_msg_hdr_xfrm_str();
+ * @h1		- serialized HTTP/1.1 header line, empty for deletion;
+ * @h2		- HPACK representation without the dynamic index, empty for
+ *		  deletion and request headers;
  */
 struct tfw_hdr_mods_desc_t {
 	TfwStr		*hdr;
 	unsigned int	hid;
 	bool		append;
+	TfwStr		h1_hdr;
+	TfwStr		h1;
+	TfwStr		h2;
 };
 
 /**
- * Headers modification before forwarding HTTP message.
+ * Headers modification before forwarding HTTP message. The headers are
+ * compiled on start, see tfw_hdr_mods_compile().
  *
  * @sz		- Number of headers to modify;
  * @hdrs	- Headers to modify;
+ * @h1		- @h1 lines of all the @hdrs back to back;
+ * @h2		- @h2 representations of all the @hdrs back to back;
  */
 struct tfw_hdr_mods_t {
 	size_t		sz;
 	TfwHdrModsDesc	*hdrs;
+	TfwStr		h1;
+	TfwStr		h2;
 };
 
 enum {
 	TFW_VHOST_HDRMOD_REQ,
 	TFW_VHOST_HDRMOD_RESP,
+	/* Link headers of 103 Early Hints. */
+	TFW_VHOST_HDRMOD_HINTS,
 
 	TFW_VHOST_HDRMOD_NUM
 };
 
+/* Kinds of responses for the end-to-end latency statistics. */
+enum {
+	TFW_LAT_STATS_CACHE,
+	TFW_LAT_STATS_UPSTREAM,
+
+	TFW_LAT_STATS_NUM
+};
+
 /**
  * Group of policies by specific location.
  *
@@ -100,13 +134,26 @@ enum {
  * @len		- Length of the string in @arg.
  * @capo_sz	- Size of @capo array.
  * @nipdef_sz	- Size of @nipdef array.
+ * @caneg_sz	- Size of @caneg array.
  * @capo	- Array of pointers to Cache Policy definitions.
+ * @caneg	- Array of negative responses caching policies.
  * @nipdef	- Array of pointers to Non-Idempotent Request definitions.
+ * @capo_mt	- Match tree of @capo, built on start.
+ * @nipdef_mt	- Match tree of @nipdef, built on start.
  * @frang_cfg	- Pointer to location-specific Frang settings structure.
  * @main_sg	- Main server group to which requests must be proxied.
  * @backup_sg	- Backup server group.
  * @hdrs_pool	- Pointer to parent vhost's pool (for mod. headers allocation).
  * @mod_hdrs	- Modification of request/response headers before forwarding.
+ * @apm_lat	- APM data of the end-to-end latency by kinds of responses,
+ *		  allocated on start if @lat_stats is set.
+ * @lat_stats	- The latency statistics are enabled for the location.
+ * @mirror_sg	- Shadow server group to which the requests are mirrored.
+ * @hedge_pidx	- APM percentile index of the hedging deadline, 0 if
+ *		  the requests aren't hedged.
+ * @mirror_ratio - Percent of the requests mirrored to @mirror_sg.
+ * @priority	- Priority of the requests for the load shedding and
+ *		  forwarding.
  */
 typedef struct {
 	short			op;
@@ -114,14 +161,24 @@ typedef struct {
 	size_t			len;
 	size_t			capo_sz;
 	size_t			nipdef_sz;
+	size_t			caneg_sz;
 	TfwCaPolicy		**capo;
+	TfwCaNeg		*caneg;
 	TfwNipDef		**nipdef;
+	TfwMtree		*capo_mt;
+	TfwMtree		*nipdef_mt;
 	FrangVhostCfg		*frang_cfg;
 	TfwSrvGroup		*main_sg;
 	TfwSrvGroup		*backup_sg;
+	TfwSrvGroup		*mirror_sg;
 	TfwPool			*hdrs_pool;
 	TfwHdrMods		mod_hdrs[TFW_VHOST_HDRMOD_NUM];
+	void			*apm_lat[TFW_LAT_STATS_NUM];
 	unsigned int		validate_post_req:1;
+	unsigned int		lat_stats:1;
+	unsigned int		hedge_pidx:4;
+	unsigned int		mirror_ratio:7;
+	unsigned int		priority:2;
 } TfwLocation;
 
 /* Cache purge configuration modes. */
@@ -139,11 +196,39 @@ enum {
 	 * removed.
 	 */
 	TFW_VHOST_B_STICKY_SESS_FAILOVER,
+	/* End-to-end latency statistics are enabled for vhost. */
+	TFW_VHOST_B_LAT_STATS,
 };
 
 /* Max number of headers allowed for end user to modify. */
 #define TFW_USRHDRS_ARRAY_SZ	64
 
+/* Length of the windows the vhost resource budgets are checked in. */
+#define TFW_VHOST_BUDGET_WIN	(HZ / 10)
+
+/**
+ * Resource usage accounting of a vhost on a CPU.
+ *
+ * @cycles	- CPU cycles spent on the vhost requests and responses;
+ * @rx_bytes	- bytes of the vhost requests received from clients;
+ * @tx_bytes	- bytes of the vhost responses sent to clients;
+ * @reqs	- number of the accounted requests;
+ * @throttled	- number of the requests throttled due to the budget;
+ * @win_start	- start of the current budget window, in jiffies;
+ * @win_cycles	- CPU cycles spent in the current budget window;
+ * @win_bytes	- bytes received and sent in the current budget window;
+ */
+typedef struct {
+	u64		cycles;
+	u64		rx_bytes;
+	u64		tx_bytes;
+	u64		reqs;
+	u64		throttled;
+	unsigned long	win_start;
+	u64		win_cycles;
+	u64		win_bytes;
+} TfwVhostAcct;
+
 /**
  * Virtual host defined by directives and policies.
  *
@@ -152,6 +237,7 @@ enum {
  *		  which is not counted by 'len' member.
  * @loc		- Array of groups of policies by specific location.
  * @loc_dflt	- Default policy.
+ * @loc_mt	- Match tree of @loc, built on start.
  * @vhost_dflt	- Pointer to default virtual host with global policies.
  * @hdrs_pool	- Modification headers allocation pool for vhost's policies.
  * @frang_gconf	- Global frang configuration. Applicable only for 'default'
@@ -162,13 +248,24 @@ enum {
  * @refcnt	- Number of users of the virtual host object.
  * @loc_sz	- Count of elements in @loc array.
  * @flags	- flags.
+ * @cache_quota	- Max size of the vhost responses in a NUMA node cache, zero
+ *		  for unlimited.
+ * @cache_acct	- Cache usage accounting of the vhost, assigned by the cache
+ *		  on first use.
  * @tls_cfg	- TLS per-vhost configuration data used in data processing.
+ * @apm_lat	- APM data of the end-to-end latency by kinds of responses.
+ * @acct	- Per-CPU resource usage accounting of the vhost.
+ * @budget_cpu	- CPU budget, percent of each CPU time, zero for unlimited.
+ * @budget_bw	- Bandwidth budget, bytes per second, zero for unlimited.
+ * @budget_cycles - CPU cycles budget of a CPU in a budget window.
+ * @budget_bytes - Bandwidth budget of a CPU in a budget window.
  */
 struct  tfw_vhost_t {
 	struct hlist_node	hlist;
 	TfwStr			name;
 	TfwLocation		*loc;
 	TfwLocation		*loc_dflt;
+	TfwMtree		*loc_mt;
 	TfwVhost		*vhost_dflt;
 	TfwPool			*hdrs_pool;
 	FrangGlobCfg		*frang_gconf;
@@ -176,7 +273,15 @@ struct  tfw_vhost_t {
 	atomic64_t		refcnt;
 	size_t			loc_sz;
 	unsigned long		flags;
+	unsigned int		cache_quota;
+	TfwCacheAcct		*cache_acct;
 	TlsPeerCfg		tls_cfg;
+	void			*apm_lat[TFW_LAT_STATS_NUM];
+	TfwVhostAcct __percpu	*acct;
+	unsigned int		budget_cpu;
+	unsigned long		budget_bw;
+	u64			budget_cycles;
+	u64			budget_bytes;
 };
 
 #define TFW_VH_DFT_NAME		"default"
@@ -223,16 +328,25 @@ tfw_vhost_put(TfwVhost *vhost)
 TfwNipDef *tfw_nipdef_match(TfwLocation *loc, unsigned char meth, TfwStr *arg);
 bool tfw_capuacl_match(TfwAddr *addr);
 TfwCaPolicy *tfw_capolicy_match(TfwLocation *loc, TfwStr *arg);
+TfwCaNeg *tfw_caneg_match(TfwLocation *loc, unsigned short status);
 TfwLocation *tfw_location_match(TfwVhost *vhost, TfwStr *arg);
 TfwVhost *tfw_vhost_lookup_reconfig(const char *name);
 TfwVhost *tfw_vhost_lookup(const TfwStr *name);
 TfwVhost *tfw_vhost_lookup_default(void);
 bool tfw_vhost_is_default_reconfig(TfwVhost *vhost);
 TfwSrvConn *tfw_vhost_get_srv_conn(TfwMsg *msg);
+TfwLocation *tfw_vhost_mirror_location(TfwMsg *msg);
+TfwSrvConn *tfw_vhost_get_mirror_srv_conn(TfwMsg *msg);
 TfwVhost *tfw_vhost_new(const char *name);
 TfwGlobal *tfw_vhost_get_global(void);
 TfwHdrMods *tfw_vhost_get_hdr_mods(TfwLocation *loc, TfwVhost *vhost,
 				   int mod_type);
+void tfw_vhost_lat_stats_update(TfwVhost *vhost, TfwLocation *loc, int kind,
+				unsigned long jrtt);
+void tfw_vhost_acct(TfwVhost *vhost, u64 cycles, unsigned long rx,
+		    unsigned long tx);
+bool tfw_vhost_over_budget(TfwVhost *vhost);
+int tfw_vhost_for_each(int (*cb)(TfwVhost *vhost));
 
 static inline TfwVhost*
 tfw_vhost_from_tls_conf(const TlsPeerCfg *cfg)
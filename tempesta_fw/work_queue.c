@@ -5,7 +5,7 @@
  * complicated MPMC case at http://www.linuxjournal.com/content/lock-free- \
  * multi-producer-multi-consumer-queue-ring-buffer .
  *
- * Copyright (C) 2016-2018 Tempesta Technologies, Inc.
+ * Copyright (C) 2016-2020 Tempesta Technologies, Inc.
  *
  * This program is free software; you can redistribute it and/or modify it
  * under the terms of the GNU General Public License as published by
@@ -38,13 +38,15 @@ tfw_wq_init(TfwRBQueue *q, int node)
 {
 	int cpu;
 
-	q->heads = alloc_percpu(atomic64_t);
-	if (!q->heads)
+	q->prods = alloc_percpu(TfwWqProducer);
+	if (!q->prods)
 		return -ENOMEM;
 
 	for_each_possible_cpu(cpu) {
-		atomic64_t *local_head = per_cpu_ptr(q->heads, cpu);
-		atomic64_set(local_head, LLONG_MAX);
+		TfwWqProducer *prod = per_cpu_ptr(q->prods, cpu);
+		atomic64_set(&prod->head, LLONG_MAX);
+		prod->contended = 0;
+		prod->full = 0;
 	}
 	q->last_head = 0;
 	atomic64_set(&q->head, 0);
@@ -53,7 +55,7 @@ tfw_wq_init(TfwRBQueue *q, int node)
 
 	q->array = kmalloc_node(QSZ * WQ_ITEM_SZ, GFP_KERNEL, node);
 	if (!q->array) {
-		free_percpu(q->heads);
+		free_percpu(q->prods);
 		return -ENOMEM;
 	}
 
@@ -67,7 +69,7 @@ tfw_wq_destroy(TfwRBQueue *q)
 	WARN_ON_ONCE(tfw_wq_size(q));
 
 	kfree(q->array);
-	free_percpu(q->heads);
+	free_percpu(q->prods);
 }
 
 /**
@@ -79,7 +81,7 @@ long
 __tfw_wq_push(TfwRBQueue *q, void *ptr)
 {
 	long head, tail;
-	atomic64_t *head_local;
+	TfwWqProducer *prod;
 	int budget = 10;
 
 	/*
@@ -89,7 +91,7 @@ __tfw_wq_push(TfwRBQueue *q, void *ptr)
 	 */
 	local_bh_disable();
 
-	head_local = this_cpu_ptr(q->heads);
+	prod = this_cpu_ptr(q->prods);
 	/*
 	 * Set the head guard to make a consumer wait on this position.
 	 * We could update the guard in the loop to allow a consumer to make
@@ -97,7 +99,7 @@ __tfw_wq_push(TfwRBQueue *q, void *ptr)
 	 * of the atomic write is undesirable.
 	 */
 	head = atomic64_read(&q->head);
-	atomic64_set(head_local, head);
+	atomic64_set(&prod->head, head);
 
 	for ( ; ; head = atomic64_read(&q->head)) {
 		tail = atomic64_read(&q->tail);
@@ -111,6 +113,7 @@ __tfw_wq_push(TfwRBQueue *q, void *ptr)
 				cpu_relax();
 				continue;
 			}
+			prod->full++;
 			goto full_out;
 		}
 
@@ -122,6 +125,7 @@ __tfw_wq_push(TfwRBQueue *q, void *ptr)
 		 */
 		if (atomic64_cmpxchg(&q->head, head, head + 1) == head)
 			break;
+		prod->contended++;
 		cpu_relax();
 	}
 
@@ -131,11 +135,36 @@ __tfw_wq_push(TfwRBQueue *q, void *ptr)
 	head = 0;
 full_out:
 	/* Now it's safe to release current head position. */
-	atomic64_set(head_local, LONG_MAX);
+	atomic64_set(&prod->head, LONG_MAX);
 	local_bh_enable();
 	return head;
 }
 
+/**
+ * Actualize @last_head from heads of all current producers.
+ * We do it only when we need a new value, i.e. not so frequently, since
+ * atomic reads are faster than updates. Don't support switching off cpus
+ * in runtime.
+ */
+static long
+tfw_wq_last_head(TfwRBQueue *q)
+{
+	int cpu;
+
+	q->last_head = atomic64_read(&q->head);
+	for_each_online_cpu(cpu) {
+		TfwWqProducer *prod = per_cpu_ptr(q->prods, cpu);
+		long curr_h = atomic64_read(&prod->head);
+
+		/* Force compiler to use curr_h only once. */
+		barrier();
+		if (curr_h < q->last_head)
+			q->last_head = curr_h;
+	}
+
+	return q->last_head;
+}
+
 /**
  * Sets tail value to be compared with current turnstile ticket, so
  * @ticket is the identifier of currently successfully pop()'ed item or an item
@@ -144,7 +173,7 @@ full_out:
 int
 tfw_wq_pop_ticket(TfwRBQueue *q, void *buf, long *ticket)
 {
-	int cpu, r = -EBUSY;
+	int r = -EBUSY;
 	long tail;
 
 	local_bh_disable();
@@ -155,28 +184,8 @@ tfw_wq_pop_ticket(TfwRBQueue *q, void *buf, long *ticket)
 	 * and is going to fail on cmpxchg(). However, we still don't know how
 	 * far we can move, so probably we have to return with nothing now.
 	 */
-	if (unlikely(tail >= q->last_head)) {
-		/*
-		 * Actualize @last_head from heads of all current producers.
-		 * We do it here since atomic reads are faster than updates and
-		 * we can do this only when we need a new value, i.e. not so
-		 * frequently. Don't support switching off cpus in runtime.
-		 */
-		q->last_head = atomic64_read(&q->head);
-		for_each_online_cpu(cpu) {
-			atomic64_t *head_local = per_cpu_ptr(q->heads, cpu);
-			long curr_h = atomic64_read(head_local);
-
-			/* Force compiler to use curr_h only once. */
-			barrier();
-			if (curr_h < q->last_head)
-				q->last_head = curr_h;
-		}
-
-		/* Second try. */
-		if (tail >= q->last_head)
-			goto out;
-	}
+	if (unlikely(tail >= q->last_head) && tail >= tfw_wq_last_head(q))
+		goto out;
 
 	memcpy(buf, &q->array[tail & QMASK], WQ_ITEM_SZ);
 	mb();
@@ -193,3 +202,121 @@ out:
 		*ticket = tail;
 	return r;
 }
+
+/**
+ * Pop up to @n items to @buf with one tail update.
+ * @return the number of popped items.
+ */
+int
+tfw_wq_pop_batch(TfwRBQueue *q, void *buf, int n)
+{
+	long tail, i;
+
+	local_bh_disable();
+
+	tail = atomic64_read(&q->tail);
+	if (tail + n > q->last_head)
+		tfw_wq_last_head(q);
+	n = min_t(long, n, max(q->last_head - tail, 0L));
+
+	for (i = 0; i < n; ++i)
+		memcpy((char *)buf + i * WQ_ITEM_SZ,
+		       &q->array[(tail + i) & QMASK], WQ_ITEM_SZ);
+	mb();
+
+	atomic64_set(&q->tail, tail + n);
+
+	local_bh_enable();
+
+	return n;
+}
+
+/**
+ * Add the contention statistics of the queue producers to @stat.
+ */
+void
+tfw_wq_stat(TfwRBQueue *q, TfwWqStat *stat)
+{
+	int cpu;
+
+	for_each_online_cpu(cpu) {
+		TfwWqProducer *prod = per_cpu_ptr(q->prods, cpu);
+
+		stat->contended += READ_ONCE(prod->contended);
+		stat->full += READ_ONCE(prod->full);
+	}
+}
+
+int
+tfw_nq_init(TfwNodeQueue *nq, int node)
+{
+	int n, r;
+
+	nq->rings = kcalloc_node(nr_node_ids, sizeof(TfwRBQueue), GFP_KERNEL,
+				 node);
+	if (!nq->rings)
+		return -ENOMEM;
+
+	for_each_node_with_cpus(n) {
+		if ((r = tfw_wq_init(&nq->rings[n], node))) {
+			tfw_nq_destroy(nq);
+			return r;
+		}
+		/* The node queue raises IPIs, not the sub-rings. */
+		clear_bit(TFW_QUEUE_IPI, &nq->rings[n].flags);
+	}
+	nq->next = 0;
+	set_bit(TFW_QUEUE_IPI, &nq->flags);
+
+	return 0;
+}
+
+void
+tfw_nq_destroy(TfwNodeQueue *nq)
+{
+	int n;
+
+	if (!nq->rings)
+		return;
+	for_each_node_with_cpus(n)
+		if (nq->rings[n].array)
+			tfw_wq_destroy(&nq->rings[n]);
+	kfree(nq->rings);
+	nq->rings = NULL;
+}
+
+/**
+ * Pop up to @n items to @buf from the node sub-rings in round-robin order,
+ * so all the nodes make progress.
+ * @return the number of popped items.
+ */
+int
+tfw_nq_pop_batch(TfwNodeQueue *nq, void *buf, int n)
+{
+	int i, node, popped = 0;
+
+	for (i = 0, node = nq->next; i < nr_node_ids && popped < n; ++i) {
+		if (node_state(node, N_CPU))
+			popped += tfw_wq_pop_batch(&nq->rings[node],
+						   (char *)buf
+						   + popped * WQ_ITEM_SZ,
+						   n - popped);
+		if (++node == nr_node_ids)
+			node = 0;
+	}
+	nq->next = node;
+
+	return popped;
+}
+
+/**
+ * Add the contention statistics of all the sub-rings to @stat.
+ */
+void
+tfw_nq_stat(TfwNodeQueue *nq, TfwWqStat *stat)
+{
+	int node;
+
+	for_each_node_with_cpus(node)
+		tfw_wq_stat(&nq->rings[node], stat);
+}
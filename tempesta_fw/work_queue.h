@@ -1,7 +1,7 @@
 /**
  *		Tempesta FW
  *
- * Copyright (C) 2016-2017 Tempesta Technologies, Inc.
+ * Copyright (C) 2016-2020 Tempesta Technologies, Inc.
  *
  * This program is free software; you can redistribute it and/or modify it
  * under the terms of the GNU General Public License as published by
@@ -22,6 +22,7 @@
 
 #include <linux/interrupt.h>
 #include <linux/irq_work.h>
+#include <linux/topology.h>
 
 #include "log.h"
 
@@ -32,8 +33,21 @@ typedef struct {
 #define WQ_ITEM_SZ		sizeof(__WqItem)
 #define TFW_WQ_CHECKSZ(t)	BUILD_BUG_ON(sizeof(t) != WQ_ITEM_SZ)
 
+/**
+ * Per-CPU producer state of a queue.
+ *
+ * @head	- the head position the producer is pushing to or LLONG_MAX;
+ * @contended	- number of the head updates lost to other producers;
+ * @full	- number of failed pushes to the full queue;
+ */
 typedef struct {
-	atomic64_t __percpu	*heads;
+	atomic64_t		head;
+	unsigned long		contended;
+	unsigned long		full;
+} TfwWqProducer;
+
+typedef struct {
+	TfwWqProducer __percpu	*prods;
 	__WqItem		*array;
 	long			last_head;
 	atomic64_t		head ____cacheline_aligned;
@@ -41,6 +55,34 @@ typedef struct {
 	unsigned long		flags;
 } TfwRBQueue;
 
+/**
+ * MPSC queue with a sub-ring for the producers of each NUMA node, so the
+ * producers contend on the head of their node sub-ring only and don't bounce
+ * the cache line of one head between the nodes under heavy fan-in.
+ * The order of items of different nodes isn't preserved.
+ *
+ * @rings	- the sub-rings indexed by NUMA node, only the nodes with CPUs
+ *		  have initialized sub-rings;
+ * @next	- the node sub-ring to pop from first next time;
+ * @flags	- the same as for TfwRBQueue;
+ */
+typedef struct {
+	TfwRBQueue		*rings;
+	int			next;
+	unsigned long		flags;
+} TfwNodeQueue;
+
+/**
+ * Contention statistics of a queue.
+ *
+ * @contended	- number of the head updates lost to other producers;
+ * @full	- number of failed pushes to the full queue;
+ */
+typedef struct {
+	unsigned long		contended;
+	unsigned long		full;
+} TfwWqStat;
+
 enum {
 	/* Enable IPI generation. */
 	TFW_QUEUE_IPI = 0
@@ -59,6 +101,13 @@ int tfw_wq_init(TfwRBQueue *wq, int node);
 void tfw_wq_destroy(TfwRBQueue *wq);
 long __tfw_wq_push(TfwRBQueue *wq, void *ptr);
 int tfw_wq_pop_ticket(TfwRBQueue *wq, void *buf, long *ticket);
+int tfw_wq_pop_batch(TfwRBQueue *wq, void *buf, int n);
+void tfw_wq_stat(TfwRBQueue *wq, TfwWqStat *stat);
+
+int tfw_nq_init(TfwNodeQueue *nq, int node);
+void tfw_nq_destroy(TfwNodeQueue *nq);
+int tfw_nq_pop_batch(TfwNodeQueue *nq, void *buf, int n);
+void tfw_nq_stat(TfwNodeQueue *nq, TfwWqStat *stat);
 
 static inline int
 tfw_wq_size(TfwRBQueue *q)
@@ -79,21 +128,34 @@ tfw_raise_softirq(int cpu, struct irq_work *work,
 		local_cpu_cb(work);
 }
 
-static inline long
-tfw_wq_push(TfwRBQueue *q, void *ptr, int cpu, struct irq_work *work,
+static inline void
+tfw_wq_kick(unsigned long *flags, int cpu, struct irq_work *work,
 	    void (*local_cpu_cb)(struct irq_work *))
 {
-	long ticket = __tfw_wq_push(q, ptr);
-	if (unlikely(ticket))
-		return ticket;
 	/*
 	 * The atomic operation is 'atomic64_cmpxchg()' in
-	 * '__tfw_wq_push()' above.
+	 * '__tfw_wq_push()' called by the caller.
 	 */
 	smp_mb__after_atomic();
 
-	if (test_bit(TFW_QUEUE_IPI, &q->flags))
+	/*
+	 * Only the producer which makes the queue non-empty for the idle
+	 * consumer raises the IPI, the consumer drains the whole queue.
+	 */
+	if (test_bit(TFW_QUEUE_IPI, flags)
+	    && test_and_clear_bit(TFW_QUEUE_IPI, flags))
 		tfw_raise_softirq(cpu, work, local_cpu_cb);
+}
+
+static inline long
+tfw_wq_push(TfwRBQueue *q, void *ptr, int cpu, struct irq_work *work,
+	    void (*local_cpu_cb)(struct irq_work *))
+{
+	long ticket = __tfw_wq_push(q, ptr);
+	if (unlikely(ticket))
+		return ticket;
+
+	tfw_wq_kick(&q->flags, cpu, work, local_cpu_cb);
 
 	return 0;
 }
@@ -104,4 +166,33 @@ tfw_wq_pop(TfwRBQueue *wq, void *buf)
 	return tfw_wq_pop_ticket(wq, buf, NULL);
 }
 
+static inline int
+tfw_nq_size(TfwNodeQueue *nq)
+{
+	int node, n = 0;
+
+	for_each_node_with_cpus(node)
+		n += tfw_wq_size(&nq->rings[node]);
+
+	return n;
+}
+
+/**
+ * Push @ptr to the sub-ring of the current node and raise the consumer at
+ * @cpu, see tfw_wq_push(). Must be called with disabled preemption, so the
+ * current node doesn't change.
+ */
+static inline long
+tfw_nq_push(TfwNodeQueue *nq, void *ptr, int cpu, struct irq_work *work,
+	    void (*local_cpu_cb)(struct irq_work *))
+{
+	long ticket = __tfw_wq_push(&nq->rings[numa_node_id()], ptr);
+	if (unlikely(ticket))
+		return ticket;
+
+	tfw_wq_kick(&nq->flags, cpu, work, local_cpu_cb);
+
+	return 0;
+}
+
 #endif /* __TFW_WORK_QUEUE_H__ */
@@ -785,60 +785,15 @@ ttls_mpi_sub_int(TlsMpi *X, const TlsMpi *A, long b)
 	}
 }
 
-#define MULADDC_INIT							\
-	asm(	"xorq	%%r8, %%r8	\n\t"
-
-#define MULADDC_CORE							\
-		"movq	(%%rsi), %%rax	\n\t"				\
-		"mulq	%%rbx		\n\t"				\
-		"addq	$8, %%rsi	\n\t"				\
-		"addq	%%rcx, %%rax	\n\t"				\
-		"movq	%%r8, %%rcx	\n\t"				\
-		"adcq	$0, %%rdx	\n\t"				\
-		"nop			\n\t"				\
-		"addq	%%rax, (%%rdi)	\n\t"				\
-		"adcq	%%rdx, %%rcx	\n\t"				\
-		"addq	$8, %%rdi	\n\t"
-
-#define MULADDC_STOP							\
-		: "+c" (c), "+D" (d), "+S" (s)				\
-		: "b" (b)						\
-		: "rax", "rdx", "r8"					\
-	);
-
+/*
+ * D += S * B, where D has room for the carry after the N limbs.
+ */
 static void
 __mpi_mul(size_t n, const unsigned long *s, unsigned long *d, unsigned long b)
 {
-	unsigned long c = 0;
-
-	for ( ; n >= 16; n -= 16) {
-		MULADDC_INIT
-		MULADDC_CORE MULADDC_CORE
-		MULADDC_CORE MULADDC_CORE
-		MULADDC_CORE MULADDC_CORE
-		MULADDC_CORE MULADDC_CORE
-
-		MULADDC_CORE MULADDC_CORE
-		MULADDC_CORE MULADDC_CORE
-		MULADDC_CORE MULADDC_CORE
-		MULADDC_CORE MULADDC_CORE
-		MULADDC_STOP
-	}
-	for ( ; n >= 8; n -= 8) {
-		MULADDC_INIT
-		MULADDC_CORE MULADDC_CORE
-		MULADDC_CORE MULADDC_CORE
-
-		MULADDC_CORE MULADDC_CORE
-		MULADDC_CORE MULADDC_CORE
-		MULADDC_STOP
-	}
-	for ( ; n > 0; n--) {
-		MULADDC_INIT
-		MULADDC_CORE
-		MULADDC_STOP
-	}
+	unsigned long c = mpi_mul_add_x86_64(d, s, n, b);
 
+	d += n;
 	do {
 		*d += c;
 		c = *d < c;
@@ -846,6 +801,24 @@ __mpi_mul(size_t n, const unsigned long *s, unsigned long *d, unsigned long b)
 	} while (c);
 }
 
+/*
+ * D = A^2 for N limbs of A and 2 * N limbs of D. The cross products are
+ * computed only once and doubled, so the squaring takes about a half of the
+ * limb multiplications of __mpi_mul() rows.
+ */
+static void
+__mpi_sqr(unsigned long *d, const unsigned long *a, size_t n)
+{
+	size_t i;
+
+	bzero_fast(d, 2 * n * CIL);
+	/* Row i covers D[2i + 1 .. n + i - 1], D[n + i] isn't set yet. */
+	for (i = 0; i + 1 < n; i++)
+		d[n + i] = mpi_mul_add_x86_64(d + 2 * i + 1, a + i + 1,
+					      n - i - 1, a[i]);
+	mpi_sqr_diag_x86_64(d, a, n);
+}
+
 /**
  * Baseline multiplication: X = A * B.
  *
@@ -1136,6 +1109,28 @@ __mpi_montg_init(unsigned long *mm, const TlsMpi *N)
 	*mm = ~x + 1;
 }
 
+/**
+ * Copy the Montgomery product @d of N->used + 1 limbs, which is less than
+ * 2 * N, from temporary @T to @A and subtract N if necessary.
+ */
+static void
+__mpi_montfinal(TlsMpi *A, const unsigned long *d, const TlsMpi *N, TlsMpi *T)
+{
+	size_t n = N->used;
+
+	memcpy_fast(MPI_P(A), d, (n + 1) * CIL);
+	mpi_fixup_used(A, n + 1);
+
+	if (ttls_mpi_cmp_abs(A, N) >= 0) {
+		mpi_sub_x86_64(MPI_P(A), MPI_P(N), MPI_P(A), N->used, A->used);
+		mpi_fixup_used(A, A->used);
+	} else {
+		/* Prevent timing attacks. */
+		mpi_sub_x86_64(MPI_P(T), MPI_P(A), MPI_P(T), A->used, T->used);
+		mpi_fixup_used(T, T->used);
+	}
+}
+
 /**
  * Montgomery multiplication: A = A * B * R^-1 mod N  (HAC 14.36).
  */
@@ -1146,16 +1141,24 @@ __mpi_montmul(TlsMpi *A, const TlsMpi *B, const TlsMpi *N, unsigned long mm,
 	size_t i, n, m;
 	unsigned long u0, u1, *d;
 
-	BUG_ON(T->limbs < N->used + 1);
-	bzero_fast(MPI_P(T), T->limbs * CIL);
+	n = N->used;
+	BUG_ON(T->limbs < n * 2 + 2);
+	/*
+	 * Only the first window of T must be zeroed, the upper limbs are
+	 * cleared by the sliding d[n + 1] below.
+	 */
+	bzero_fast(MPI_P(T), (n + 2) * CIL);
 
 	d = MPI_P(T);
-	n = N->used;
 	m = (B->used < n) ? B->used : n;
 
 	for (i = 0; i < n; i++) {
-		/* T = (T + u0*B + u1*N) / 2^BIL */
-		u0 = MPI_P(A)[i];
+		/*
+		 * T = (T + u0*B + u1*N) / 2^BIL
+		 * The limbs of A above A->used aren't initialized, e.g. after
+		 * ttls_mpi_copy(), so don't read them.
+		 */
+		u0 = i < A->used ? MPI_P(A)[i] : 0;
 		u1 = (d[0] + u0 * MPI_P(B)[0]) * mm;
 
 		__mpi_mul(m, MPI_P(B), d, u0);
@@ -1166,17 +1169,35 @@ __mpi_montmul(TlsMpi *A, const TlsMpi *B, const TlsMpi *N, unsigned long mm,
 	}
 	mpi_fixup_used(T, T->limbs);
 
-	memcpy_fast(MPI_P(A), d, (n + 1) * CIL);
-	mpi_fixup_used(A, n + 1);
+	__mpi_montfinal(A, d, N, T);
 
-	if (ttls_mpi_cmp_abs(A, N) >= 0) {
-		mpi_sub_x86_64(MPI_P(A), MPI_P(N), MPI_P(A), N->used, A->used);
-		mpi_fixup_used(A, A->used);
-	} else {
-		/* Prevent timing attacks. */
-		mpi_sub_x86_64(MPI_P(T), MPI_P(A), MPI_P(T), A->used, T->used);
-		mpi_fixup_used(T, T->used);
-	}
+	return 0;
+}
+
+/**
+ * Montgomery squaring: A = A * A * R^-1 mod N.
+ *
+ * The same as __mpi_montmul(A, A, N, mm, T), but the square is computed
+ * first by __mpi_sqr() and is reduced by N then, which takes about 1.5 * n^2
+ * limb multiplications instead of 2 * n^2.
+ */
+static int
+__mpi_montsqr(TlsMpi *A, const TlsMpi *N, unsigned long mm, TlsMpi *T)
+{
+	size_t i, n = N->used, m = A->used;
+	unsigned long *d = MPI_P(T);
+
+	BUG_ON(T->limbs < n * 2 + 2 || m > n);
+
+	__mpi_sqr(d, MPI_P(A), m);
+	bzero_fast(d + m * 2, ((n - m) * 2 + 2) * CIL);
+
+	/* T = (T + u * N) / 2^BIL for each of the n least significant limbs. */
+	for (i = 0; i < n; i++)
+		__mpi_mul(n, MPI_P(N), d + i, d[i] * mm);
+	mpi_fixup_used(T, T->limbs);
+
+	__mpi_montfinal(A, d + n, N, T);
 
 	return 0;
 }
@@ -1194,6 +1215,22 @@ __mpi_montred(TlsMpi *A, const TlsMpi *N, unsigned long mm, TlsMpi *T)
 	return __mpi_montmul(A, &U, N, mm, T);
 }
 
+/**
+ * Pre-compute @RR = R^2 mod N on the first call for the modulus.
+ */
+static void
+__mpi_montg_rr(TlsMpi *RR, const TlsMpi *N)
+{
+	BUG_ON(!RR);
+	if (likely(!ttls_mpi_empty(RR)))
+		return;
+
+	ttls_mpi_alloc(RR, N->used * 2 + 2);
+	ttls_mpi_lset(RR, 1);
+	ttls_mpi_shift_l(RR, N->used * 2 * BIL);
+	ttls_mpi_mod_mpi(RR, RR, N);
+}
+
 /**
  * Sliding-window exponentiation: X = A^E mod N  (HAC 14.85).
  *
@@ -1247,16 +1284,7 @@ ttls_mpi_exp_mod(TlsMpi *X, const TlsMpi *A, const TlsMpi *E, const TlsMpi *N,
 		A = &Apos;
 	}
 
-	/*
-	 * If 1st call, pre-compute R^2 mod N
-	 */
-	BUG_ON(!RR);
-	if (unlikely(ttls_mpi_empty(RR))) {
-		ttls_mpi_alloc(RR, N->used * 2 + 2);
-		ttls_mpi_lset(RR, 1);
-		ttls_mpi_shift_l(RR, N->used * 2 * BIL);
-		ttls_mpi_mod_mpi(RR, RR, N);
-	}
+	__mpi_montg_rr(RR, N);
 
 	/* W[1] = A * R^2 * R^-1 mod N = A * R mod N */
 	if (ttls_mpi_cmp_mpi(A, N) >= 0)
@@ -1278,7 +1306,7 @@ ttls_mpi_exp_mod(TlsMpi *X, const TlsMpi *A, const TlsMpi *E, const TlsMpi *N,
 		ttls_mpi_copy(&W[j], &W[1]);
 
 		for (i = 0; i < wsize - 1; i++)
-			TTLS_MPI_CHK(__mpi_montmul(&W[j], &W[j], N, mm, &T));
+			TTLS_MPI_CHK(__mpi_montsqr(&W[j], N, mm, &T));
 
 		/* W[i] = W[i - 1] * W[1] */
 		for (i = j + 1; i < (1 << wsize); i++) {
@@ -1307,7 +1335,7 @@ ttls_mpi_exp_mod(TlsMpi *X, const TlsMpi *A, const TlsMpi *E, const TlsMpi *N,
 
 		if (!ei && state == 1) {
 			/* Out of window, square X. */
-			TTLS_MPI_CHK(__mpi_montmul(X, X, N, mm, &T));
+			TTLS_MPI_CHK(__mpi_montsqr(X, N, mm, &T));
 			continue;
 		}
 
@@ -1320,7 +1348,7 @@ ttls_mpi_exp_mod(TlsMpi *X, const TlsMpi *A, const TlsMpi *E, const TlsMpi *N,
 		if (nbits == wsize) {
 			/* X = X^wsize R^-1 mod N . */
 			for (i = 0; i < wsize; i++)
-				TTLS_MPI_CHK(__mpi_montmul(X, X, N, mm, &T));
+				TTLS_MPI_CHK(__mpi_montsqr(X, N, mm, &T));
 
 			/* X = X * W[wbits] R^-1 mod N. */
 			TTLS_MPI_CHK(__mpi_montmul(X, &W[wbits], N, mm, &T));
@@ -1333,7 +1361,7 @@ ttls_mpi_exp_mod(TlsMpi *X, const TlsMpi *A, const TlsMpi *E, const TlsMpi *N,
 
 	/* Process the remaining bits. */
 	for (i = 0; i < nbits; i++) {
-		TTLS_MPI_CHK(__mpi_montmul(X, X, N, mm, &T));
+		TTLS_MPI_CHK(__mpi_montsqr(X, N, mm, &T));
 
 		wbits <<= 1;
 		if (wbits & (1 << wsize))
@@ -1353,6 +1381,123 @@ cleanup:
 	return ret;
 }
 
+/* Bits of the window of the fixed-window exponentiation. */
+#define MPI_FW_SZ	5
+
+/*
+ * Get the window of MPI_FW_SZ bits of @E starting at bit @off.
+ */
+static unsigned long
+__mpi_fw_bits(const TlsMpi *E, size_t off)
+{
+	size_t l = off / BIL, s = off % BIL;
+	unsigned long v = MPI_P(E)[l] >> s;
+
+	if (s + MPI_FW_SZ > BIL && l + 1 < E->used)
+		v |= MPI_P(E)[l + 1] << (BIL - s);
+
+	return v & ((1UL << MPI_FW_SZ) - 1);
+}
+
+/*
+ * X = W[idx] for the N->used limbs table entries. All the entries are read
+ * and masked, so the memory access pattern doesn't depend on @idx.
+ */
+static void
+__mpi_fw_select(TlsMpi *X, const TlsMpi *W, unsigned long idx, size_t n)
+{
+	size_t i, j;
+	unsigned long mask, *x = MPI_P(X);
+
+	bzero_fast(x, (n + 1) * CIL);
+	for (i = 0; i < (1 << MPI_FW_SZ); i++) {
+		const unsigned long *w = MPI_P(&W[i]);
+
+		mask = -((((unsigned long)i ^ idx) - 1) >> (BIL - 1));
+		for (j = 0; j < n; j++)
+			x[j] |= w[j] & mask;
+	}
+	X->s = 1;
+	mpi_fixup_used(X, n);
+}
+
+/**
+ * Fixed-window exponentiation for secret exponents: X = A^E mod N.
+ *
+ * Unlike the sliding window of ttls_mpi_exp_mod(), the sequence of the
+ * Montgomery operations depends only on the bit length of @E: each window
+ * takes MPI_FW_SZ squarings and a multiplication, even if all its bits are
+ * zero, by an entry of the pre-computed table W[i] = A^i * R mod N read with
+ * __mpi_fw_select(). The arguments are the same as for ttls_mpi_exp_mod(),
+ * but @A must be non-negative.
+ */
+int
+ttls_mpi_exp_mod_fw(TlsMpi *X, const TlsMpi *A, const TlsMpi *E,
+		    const TlsMpi *N, TlsMpi *RR)
+{
+	int ret = -ENOMEM;
+	size_t i, j, n;
+	unsigned long mm;
+	TlsMpi T, S, *W;
+
+	if (ttls_mpi_cmp_int(N, 0) <= 0 || !(MPI_P(N)[0] & 1))
+		return -EINVAL;
+	if (ttls_mpi_cmp_int(E, 0) < 0 || A->s < 0)
+		return -EINVAL;
+
+	n = N->used;
+	if (WARN_ON_ONCE(X->limbs < n + 1))
+		return -ENOMEM;
+	__mpi_montg_init(&mm, N);
+	ttls_mpi_alloca_init(&T, (n + 1) * 2);
+	ttls_mpi_alloca_init(&S, n + 1);
+	W = ttls_mpool_alloc_stack(sizeof(TlsMpi) * (1 << MPI_FW_SZ));
+	bzero_fast(W, sizeof(TlsMpi) * (1 << MPI_FW_SZ));
+	for (i = 0; i < (1 << MPI_FW_SZ); i++)
+		ttls_mpi_alloc(&W[i], n + 1);
+
+	__mpi_montg_rr(RR, N);
+
+	/* W[0] = R mod N, W[1] = A * R mod N. */
+	ttls_mpi_copy(&W[0], RR);
+	TTLS_MPI_CHK(__mpi_montred(&W[0], N, mm, &T));
+	if (ttls_mpi_cmp_mpi(A, N) >= 0)
+		ttls_mpi_mod_mpi(&W[1], A, N);
+	else
+		ttls_mpi_copy(&W[1], A);
+	TTLS_MPI_CHK(__mpi_montmul(&W[1], RR, N, mm, &T));
+
+	for (i = 2; i < (1 << MPI_FW_SZ); i++) {
+		if (i & 1) {
+			ttls_mpi_copy(&W[i], &W[i - 1]);
+			TTLS_MPI_CHK(__mpi_montmul(&W[i], &W[1], N, mm, &T));
+		} else {
+			ttls_mpi_copy(&W[i], &W[i / 2]);
+			TTLS_MPI_CHK(__mpi_montsqr(&W[i], N, mm, &T));
+		}
+	}
+	/*
+	 * Start from the most significant window, X = W[0] for zero @E. The
+	 * lookups read all the n limbs of the entries, which are written by
+	 * __mpi_montfinal().
+	 */
+	i = (ttls_mpi_bitlen(E) + MPI_FW_SZ - 1) / MPI_FW_SZ;
+	__mpi_fw_select(X, W, i ? __mpi_fw_bits(E, --i * MPI_FW_SZ) : 0, n);
+	while (i--) {
+		for (j = 0; j < MPI_FW_SZ; j++)
+			TTLS_MPI_CHK(__mpi_montsqr(X, N, mm, &T));
+		__mpi_fw_select(&S, W, __mpi_fw_bits(E, i * MPI_FW_SZ), n);
+		TTLS_MPI_CHK(__mpi_montmul(X, &S, N, mm, &T));
+	}
+
+	/* X = A^E * R * R^-1 mod N = A^E mod N. */
+	TTLS_MPI_CHK(__mpi_montred(X, N, mm, &T));
+
+cleanup:
+	ttls_mpi_pool_cleanup_ctx((unsigned long)W, false);
+	return ret;
+}
+
 /**
  * Greatest common divisor: G = gcd(A, B)  (HAC 14.54)
  */
@@ -185,6 +185,8 @@ void ttls_mpi_mod_mpi(TlsMpi *R, const TlsMpi *A, const TlsMpi *B);
 
 int ttls_mpi_exp_mod(TlsMpi *X, const TlsMpi *A, const TlsMpi *E,
 		     const TlsMpi *N, TlsMpi *_RR);
+int ttls_mpi_exp_mod_fw(TlsMpi *X, const TlsMpi *A, const TlsMpi *E,
+			const TlsMpi *N, TlsMpi *RR);
 int ttls_mpi_inv_mod(TlsMpi *X, const TlsMpi *A, const TlsMpi *N);
 void ttls_mpi_gcd(TlsMpi *G, const TlsMpi *A, const TlsMpi *B);
 
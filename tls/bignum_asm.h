@@ -39,6 +39,10 @@ void mpi_shift_l_x86_64(unsigned long *x, size_t x_len, unsigned long bits);
 void mpi_shift_r_x86_64_4(unsigned long *x, unsigned long bits);
 void mpi_shift_r_x86_64(unsigned long *x, size_t x_len, unsigned long bits);
 
+unsigned long mpi_mul_add_x86_64(unsigned long *d, const unsigned long *s,
+				 size_t n, unsigned long b);
+void mpi_sqr_diag_x86_64(unsigned long *d, const unsigned long *a, size_t n);
+
 void mpi_mul_x86_64_4(unsigned long *x, unsigned long *a, unsigned long *b);
 void mpi_sqr_x86_64_4(unsigned long *x, unsigned long *a);
 
@@ -81,6 +81,14 @@ static TlsCiphersuite ciphersuite_definitions[] = {
 	  TTLS_MAJOR_VERSION_3, TTLS_MINOR_VERSION_3,
 	  0, { &cs_mp_ecdhe_secp256.mp, &cs_mp_ecdhe_secp384.mp,
 	       &cs_mp_ecdhe_curve25519.mp } },
+	{ TTLS_TLS_ECDHE_ECDSA_WITH_CHACHA20_POLY1305_SHA256,
+	  "TLS-ECDHE-ECDSA-WITH-CHACHA20-POLY1305-SHA256",
+	  TTLS_CIPHER_CHACHA20_POLY1305, TTLS_MD_SHA256,
+	  TTLS_KEY_EXCHANGE_ECDHE_ECDSA,
+	  TTLS_MAJOR_VERSION_3, TTLS_MINOR_VERSION_3,
+	  TTLS_MAJOR_VERSION_3, TTLS_MINOR_VERSION_3,
+	  0, { &cs_mp_ecdhe_secp256.mp, &cs_mp_ecdhe_secp384.mp,
+	       &cs_mp_ecdhe_curve25519.mp } },
 	{ TTLS_TLS_ECDHE_ECDSA_WITH_AES_256_CCM,
 	  "TLS-ECDHE-ECDSA-WITH-AES-256-CCM",
 	  TTLS_CIPHER_AES_256_CCM, TTLS_MD_SHA256,
@@ -131,6 +139,14 @@ static TlsCiphersuite ciphersuite_definitions[] = {
 	  TTLS_MAJOR_VERSION_3, TTLS_MINOR_VERSION_3,
 	  0, { &cs_mp_ecdhe_secp256.mp, &cs_mp_ecdhe_secp384.mp,
 	       &cs_mp_ecdhe_curve25519.mp } },
+	{ TTLS_TLS_ECDHE_RSA_WITH_CHACHA20_POLY1305_SHA256,
+	  "TLS-ECDHE-RSA-WITH-CHACHA20-POLY1305-SHA256",
+	  TTLS_CIPHER_CHACHA20_POLY1305, TTLS_MD_SHA256,
+	  TTLS_KEY_EXCHANGE_ECDHE_RSA,
+	  TTLS_MAJOR_VERSION_3, TTLS_MINOR_VERSION_3,
+	  TTLS_MAJOR_VERSION_3, TTLS_MINOR_VERSION_3,
+	  0, { &cs_mp_ecdhe_secp256.mp, &cs_mp_ecdhe_secp384.mp,
+	       &cs_mp_ecdhe_curve25519.mp } },
 	{ TTLS_TLS_DHE_RSA_WITH_AES_256_GCM_SHA384,
 	  "TLS-DHE-RSA-WITH-AES-256-GCM-SHA384",
 	  TTLS_CIPHER_AES_256_GCM, TTLS_MD_SHA384,
@@ -194,6 +210,7 @@ ttls_ciphersuite_addr_mp(void *addr)
 
 	__CS_ADDR_MP(ecdhe_secp256, x);
 	__CS_ADDR_MP(ecdhe_secp384, x);
+	__CS_ADDR_MP(ecdhe_curve25519, x);
 	__CS_ADDR_MP(dhe, x);
 
 	return NULL;
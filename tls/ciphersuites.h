@@ -47,6 +47,8 @@
 #define TTLS_TLS_ECDHE_ECDSA_WITH_AES_256_CCM		0xC0AD
 #define TTLS_TLS_ECDHE_ECDSA_WITH_AES_128_CCM_8		0xC0AE
 #define TTLS_TLS_ECDHE_ECDSA_WITH_AES_256_CCM_8		0xC0AF
+#define TTLS_TLS_ECDHE_RSA_WITH_CHACHA20_POLY1305_SHA256	0xCCA8
+#define TTLS_TLS_ECDHE_ECDSA_WITH_CHACHA20_POLY1305_SHA256	0xCCA9
 
 /*
  * Reminder: update ttls_premaster_secret when adding a new key exchange.
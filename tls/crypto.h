@@ -40,13 +40,14 @@ typedef enum {
 	TTLS_CIPHER_AES_128_CCM,
 	TTLS_CIPHER_AES_192_CCM,
 	TTLS_CIPHER_AES_256_CCM,
+	TTLS_CIPHER_CHACHA20_POLY1305,
 } ttls_cipher_type_t;
 
 /* Supported cipher modes. */
 typedef enum {
 	TTLS_MODE_NONE = 0,
 	TTLS_MODE_GCM,
-	TTLS_MODE_STREAM, /* TLS 1.3: ChaCha20-Poly1305 */
+	TTLS_MODE_CHACHAPOLY,
 	TTLS_MODE_CCM,
 } ttls_cipher_mode_t;
 
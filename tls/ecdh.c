@@ -190,6 +190,11 @@ ttls_ecdh_calc_secret(TlsECDHCtx *ctx, size_t *olen, unsigned char *buf,
 	if (WARN_ON_ONCE(ttls_mpi_size(&ctx->z.X) > blen))
 		return -EINVAL;
 
+	/* The premaster secret is the X25519 output (RFC 8422 5.10). */
+	if (ctx->grp->id == TTLS_ECP_DP_CURVE25519)
+		return ttls_ecp_point_write_binary(ctx->grp, &ctx->z, olen, buf,
+						   blen);
+
 	*olen = (ctx->grp->bits + 7) / 8;
 
 	return ttls_mpi_write_binary(&ctx->z.X, buf, *olen);
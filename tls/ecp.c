@@ -73,20 +73,27 @@ typedef enum {
  *
  * Secp256r1 is at the first postion as the most used one.
  *
- * TODO #1031 add Curve25519 and Curve448.
+ * TODO #1031 add Curve448.
  *
  * Reminder: update profiles in x509_crt.c when adding a new curves!
+ * X25519 is used for ECDHE only, so it's not in the profiles.
  */
 static const TlsEcpCurveInfo ecp_supported_curves[] = {
 	{ TTLS_ECP_DP_SECP256R1,	23,	 256,	"secp256r1"},
 	{ TTLS_ECP_DP_SECP384R1,	24,	 384,	"secp384r1"},
+	{ TTLS_ECP_DP_CURVE25519,	29,	 256,	"x25519"},
 	{ TTLS_ECP_DP_NONE,		0,	 0,	NULL},
 };
 
 #define ECP_NB_CURVES   sizeof(ecp_supported_curves) /	\
 			sizeof(ecp_supported_curves[0])
 
+/*
+ * ECDHE curves in order of our preference. X25519 is the cheapest one and
+ * it's preferred by most of the clients.
+ */
 ttls_ecp_group_id ttls_preset_curves[] = {
+	TTLS_ECP_DP_CURVE25519,
 	TTLS_ECP_DP_SECP256R1,
 	TTLS_ECP_DP_SECP384R1,
 	TTLS_ECP_DP_NONE
@@ -205,9 +212,32 @@ ttls_ecp_is_zero(TlsEcpPoint *pt)
 	return !ttls_mpi_cmp_int(&pt->Z, 0);
 }
 
+/*
+ * Copy X coordinate of a Montgomery curve point to/from 256-bit little-endian
+ * number, which is the X25519 public key format (RFC 7748 5).
+ */
+static void
+ecp_mont_get_x(unsigned long x[4], const TlsMpi *X)
+{
+	size_t n = min_t(size_t, X->used, 4);
+
+	memcpy_fast(x, MPI_P(X), n * CIL);
+	bzero_fast(x + n, (4 - n) * CIL);
+}
+
+static void
+ecp_mont_set_x(TlsMpi *X, const unsigned long x[4])
+{
+	ttls_mpi_alloc(X, 4);
+	memcpy_fast(MPI_P(X), x, 4 * CIL);
+	X->s = 1;
+	mpi_fixup_used(X, 4);
+}
+
 /*
  * Export a point into unsigned binary data (SEC1 2.3.3).
- * Uncompressed is the only point format supported by RFC 8422.
+ * Uncompressed is the only point format supported by RFC 8422, X25519 public
+ * keys are the little-endian X coordinates (RFC 8422 5.4).
  *
  * @grp		- Group to which the point should belong;
  * @p		- Point to export;
@@ -215,12 +245,22 @@ ttls_ecp_is_zero(TlsEcpPoint *pt)
  * @buf		- Output buffer;
  * @buflen	- Length of the output buffer.
  */
-static int
+int
 ttls_ecp_point_write_binary(const TlsEcpGrp *grp, const TlsEcpPoint *P,
 			    size_t *olen, unsigned char *buf, size_t buflen)
 {
 	size_t plen;
 
+	if (ecp_get_type(grp) == ECP_TYPE_MONTGOMERY) {
+		*olen = ttls_mpi_size(&grp->P);
+		if (buflen < *olen || *olen != 4 * CIL)
+			return -ENOSPC;
+
+		ecp_mont_get_x((unsigned long *)buf, &P->X);
+
+		return 0;
+	}
+
 	/* Common case: P == 0 . */
 	if (!ttls_mpi_cmp_int(&P->Z, 0)) {
 		if (buflen < 1)
@@ -256,6 +296,16 @@ ttls_ecp_point_read_binary(const TlsEcpGrp *grp, TlsEcpPoint *pt,
 {
 	size_t plen;
 
+	if (ecp_get_type(grp) == ECP_TYPE_MONTGOMERY) {
+		if (ilen != ttls_mpi_size(&grp->P) || ilen != 4 * CIL)
+			return TTLS_ERR_ECP_BAD_INPUT_DATA;
+
+		ecp_mont_set_x(&pt->X, (const unsigned long *)buf);
+		ttls_mpi_lset(&pt->Z, 1);
+
+		return 0;
+	}
+
 	if (ilen < 1)
 		return TTLS_ERR_ECP_BAD_INPUT_DATA;
 
@@ -992,6 +1042,62 @@ ecp_precompute_comb(const TlsEcpGrp *grp, TlsEcpPoint T[], const TlsEcpPoint *P,
 	return 0;
 }
 
+/*
+ * The comb table of the P-256 generator, w = 5, takes only half of
+ * TlsEcpGrp->T, so the second half keeps the second table 2^e * T, where e is
+ * the half of the d + 1 comb digits. The multiplication by G then costs e
+ * doublings instead of d + 1, see ecp_mul_comb_core().
+ */
+static unsigned char
+ecp_comb_tables(const TlsEcpGrp *grp, bool p_eq_g)
+{
+	return p_eq_g && grp->id == TTLS_ECP_DP_SECP256R1 ? 2 : 1;
+}
+
+/*
+ * The number of the comb digits but the most significant one: w * d must
+ * cover the group bits and d + 1 must be divisible by the number of tables.
+ */
+static size_t
+ecp_comb_d(const TlsEcpGrp *grp, unsigned char w, bool p_eq_g)
+{
+	size_t d = (grp->bits + w - 1) / w;
+
+	return ecp_comb_tables(grp, p_eq_g) == 2 ? d | 1 : d;
+}
+
+/*
+ * Precompute the comb table(s) for the group generator, T2[i] = 2^e * T[i]
+ * for the second table. Called on the MPI profile creation only, so the
+ * straightforward doubling of each point is fine.
+ *
+ * Cost: see ecp_precompute_comb() + 2^{w-1} e D + 1 N(2^{w-1})
+ */
+int
+ecp_precompute_comb_g(TlsEcpGrp *grp, unsigned char w)
+{
+	int i, j;
+	size_t d = ecp_comb_d(grp, w, true);
+	unsigned char t_len = 1U << (w - 1);
+	TlsEcpPoint *T2 = grp->T + t_len, *TT[TTLS_ECP_WINDOW_SIZE];
+
+	MPI_CHK(ecp_precompute_comb(grp, grp->T, &grp->G, w, d));
+	if (ecp_comb_tables(grp, true) == 1)
+		return 0;
+
+	BUG_ON(t_len * 2 > TTLS_ECP_WINDOW_SIZE);
+	for (i = 0; i < t_len; i++) {
+		/* The normalized points have no Z coordinate. */
+		ttls_ecp_copy(&T2[i], &grp->T[i]);
+		ttls_mpi_lset(&T2[i].Z, 1);
+		for (j = 0; j < (d + 1) / 2; j++)
+			MPI_CHK(ecp_double_jac(grp, &T2[i], &T2[i]));
+		TT[i] = &T2[i];
+	}
+
+	return ecp_normalize_jac_many(grp, TT, t_len);
+}
+
 /*
  * Select precomputed point: R = sign(i) * T[ abs(i) / 2 ]
  */
@@ -1019,15 +1125,20 @@ ecp_select_comb(const TlsEcpGrp *grp, TlsEcpPoint *R, const TlsEcpPoint T[],
  * Core multiplication algorithm for the (modified) comb method.
  * This part is actually common with the basic comb method (GECC 3.44)
  *
- * Cost: d A + d D + 1 R
+ * With two tables, see ecp_comb_tables(), the digits x[i] and x[i + e] are
+ * added at the same step, that is the comb method with two tables ([5] 3.45),
+ * and there are e = (d + 1) / 2 steps.
+ *
+ * Cost: d A + d D + 1 R		(one table)
+ *	 d A + (e - 1) D + 1 R		(two tables)
  */
 static int
 ecp_mul_comb_core(const TlsEcpGrp *grp, TlsEcpPoint *R, const TlsEcpPoint T[],
-		  unsigned char t_len, const unsigned char x[], size_t d,
-		  bool rnd)
+		  unsigned char t_len, unsigned char n_tbl,
+		  const unsigned char x[], size_t d, bool rnd)
 {
 	TlsEcpPoint *Txi;
-	size_t i;
+	size_t i, j, e = (d + 1) / n_tbl;
 
 	ttls_ecp_point_tmp_alloc_init(Txi, T->X.used, T->Y.used, 0);
 	ttls_mpi_alloc(&R->X, grp->bits * 2 / BIL);
@@ -1035,17 +1146,24 @@ ecp_mul_comb_core(const TlsEcpGrp *grp, TlsEcpPoint *R, const TlsEcpPoint T[],
 	ttls_mpi_alloc(&R->Z, grp->bits / BIL + 1);
 
 	/* Start with a non-zero point and randomize its coordinates */
-	i = d;
+	i = e - 1;
 	ecp_select_comb(grp, R, T, t_len, x[i]);
 	ttls_mpi_lset(&R->Z, 1);
 	if (rnd)
 		MPI_CHK(ecp_randomize_jac(grp, R));
+	for (j = 1; j < n_tbl; j++) {
+		ecp_select_comb(grp, Txi, T + j * t_len, t_len, x[i + j * e]);
+		MPI_CHK(ecp_add_mixed(grp, R, R, Txi));
+	}
 
 	while (i-- != 0) {
 		/* TODO #1064 use repeated doubling optimization. */
 		MPI_CHK(ecp_double_jac(grp, R, R));
-		ecp_select_comb(grp, Txi, T, t_len, x[i]);
-		MPI_CHK(ecp_add_mixed(grp, R, R, Txi));
+		for (j = 0; j < n_tbl; j++) {
+			ecp_select_comb(grp, Txi, T + j * t_len, t_len,
+					x[i + j * e]);
+			MPI_CHK(ecp_add_mixed(grp, R, R, Txi));
+		}
 	}
 
 	return 0;
@@ -1061,10 +1179,10 @@ ecp_mul_comb_core(const TlsEcpGrp *grp, TlsEcpPoint *R, const TlsEcpPoint T[],
  */
 static int
 ecp_mul_comb(const TlsEcpGrp *grp, TlsEcpPoint *R, const TlsMpi *m,
-	     const TlsEcpPoint *P, bool rnd)
+	     const TlsEcpPoint *P, bool p_eq_g, bool rnd)
 {
 	int ret = -EINVAL;
-	unsigned char w, m_is_odd, p_eq_g, pre_len;
+	unsigned char w, m_is_odd, pre_len;
 	size_t d = max(m->used, grp->N.used);
 	TlsEcpPoint *T;
 	TlsMpi *M, *mm;
@@ -1087,12 +1205,9 @@ ecp_mul_comb(const TlsEcpGrp *grp, TlsEcpPoint *R, const TlsMpi *m,
 	w = grp->bits == 384 ? 5 : 4;
 
 	/*
-	 * If P == G, pre-compute a bit more, since this may be re-used later.
-	 * Just adding one avoids upping the cost of the first mul too much,
-	 * and the memory cost too.
+	 * If P == G, the table with a bit larger window is precomputed for
+	 * the group, see ecp_precompute_comb_g().
 	 */
-	p_eq_g = !ttls_mpi_cmp_mpi(&P->Y, &grp->G.Y)
-		 && !ttls_mpi_cmp_mpi(&P->X, &grp->G.X);
 	if (p_eq_g) {
 		w++;
 		T = (TlsEcpPoint *)grp->T; /* we won't change it */
@@ -1107,7 +1222,7 @@ ecp_mul_comb(const TlsEcpGrp *grp, TlsEcpPoint *R, const TlsMpi *m,
 	pre_len = 1U << (w - 1);
 	if (WARN_ON_ONCE(pre_len > TTLS_ECP_WINDOW_SIZE))
 		goto cleanup;
-	d = (grp->bits + w - 1) / w;
+	d = ecp_comb_d(grp, w, p_eq_g);
 	BUG_ON(d > COMB_MAX_D);
 
 	/*
@@ -1128,7 +1243,9 @@ ecp_mul_comb(const TlsEcpGrp *grp, TlsEcpPoint *R, const TlsMpi *m,
 
 	/* Go for comb multiplication, R = M * P */
 	ecp_comb_fixed(k, d, w, M);
-	TTLS_MPI_CHK(ecp_mul_comb_core(grp, R, T, pre_len, k, d, rnd));
+	TTLS_MPI_CHK(ecp_mul_comb_core(grp, R, T, pre_len,
+				       ecp_comb_tables(grp, p_eq_g), k, d,
+				       rnd));
 
 	/* Now get m * P from M * P and normalize it. */
 	ecp_safe_invert_jac(grp, R, !m_is_odd);
@@ -1261,6 +1378,27 @@ ecp_double_add_mxz(const TlsEcpGrp *grp, TlsEcpPoint *R, TlsEcpPoint *S,
 	return 0;
 }
 
+/**
+ * R = m * P for X25519, see ttls_x25519(). R is zero if the result is zero,
+ * so low order points are rejected by the callers (RFC 8422 5.11).
+ */
+static int
+ecp_mul_x25519(TlsEcpPoint *R, const TlsMpi *m, const TlsEcpPoint *P)
+{
+	unsigned long k[4], u[4], r[4];
+
+	ecp_mont_get_x(k, m);
+	ecp_mont_get_x(u, &P->X);
+	ttls_x25519(r, k, u);
+	bzero_fast(k, sizeof(k));
+
+	ecp_mont_set_x(&R->X, r);
+	ttls_mpi_reset(&R->Y);
+	ttls_mpi_lset(&R->Z, !!(r[0] | r[1] | r[2] | r[3]));
+
+	return 0;
+}
+
 /**
  * Multiplication with Montgomery ladder in x/z coordinates,
  * for curves in Montgomery form.
@@ -1334,19 +1472,29 @@ ttls_ecp_mul(const TlsEcpGrp *grp, TlsEcpPoint *R, const TlsMpi *m,
 {
 	switch (ecp_get_type(grp)) {
 	case ECP_TYPE_MONTGOMERY:
+		if (grp->id == TTLS_ECP_DP_CURVE25519)
+			return ecp_mul_x25519(R, m, P);
 		return ecp_mul_mxz(grp, R, m, P, rnd);
 	case ECP_TYPE_SHORT_WEIERSTRASS:
-		return ecp_mul_comb(grp, R, m, P, rnd);
+		return ecp_mul_comb(grp, R, m, P,
+				    !ttls_mpi_cmp_mpi(&P->Y, &grp->G.Y)
+				    && !ttls_mpi_cmp_mpi(&P->X, &grp->G.X),
+				    rnd);
 	}
 	BUG();
 }
 
 /**
- * TODO #1064: Specialization for R = m * G.
+ * R = m * G, used by ECDHE key generation and ECDSA signing. Uses the comb
+ * tables precomputed for the group without comparing the point with G.
  */
 int
-ttls_ecp_mul_g(const TlsEcpGrp *grp, TlsEcpPoint *R, const TlsMpi *m,				     bool rnd)
+ttls_ecp_mul_g(const TlsEcpGrp *grp, TlsEcpPoint *R, const TlsMpi *m,
+	       bool rnd)
 {
+	if (ecp_get_type(grp) == ECP_TYPE_SHORT_WEIERSTRASS)
+		return ecp_mul_comb(grp, R, m, &grp->G, true, rnd);
+
 	return ttls_ecp_mul(grp, R, m, &grp->G, rnd);
 }
 
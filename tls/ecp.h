@@ -223,6 +223,9 @@ void ttls_ecp_keypair_free(TlsEcpKeypair *key);
 void ttls_ecp_copy(TlsEcpPoint *P, const TlsEcpPoint *Q);
 int ttls_ecp_is_zero(TlsEcpPoint *pt);
 
+int ttls_ecp_point_write_binary(const TlsEcpGrp *grp, const TlsEcpPoint *P,
+				size_t *olen, unsigned char *buf,
+				size_t buflen);
 int ttls_ecp_point_read_binary(const TlsEcpGrp *grp, TlsEcpPoint *P,
 			       const unsigned char *buf, size_t ilen);
 int ttls_ecp_tls_read_point(const TlsEcpGrp *grp, TlsEcpPoint *pt,
@@ -236,9 +239,12 @@ int ttls_ecp_tls_write_group(const TlsEcpGrp *grp, size_t *olen,
 
 TlsEcpGrp * ttls_ecp_group_lookup(ttls_ecp_group_id id);
 int ttls_ecp_group_load(TlsEcpGrp *grp, ttls_ecp_group_id id);
+void ttls_x25519(unsigned long r[4], const unsigned long k[4],
+		 const unsigned long u[4]);
 
 int ecp_precompute_comb(const TlsEcpGrp *grp, TlsEcpPoint T[],
 			const TlsEcpPoint *P,unsigned char w, size_t d);
+int ecp_precompute_comb_g(TlsEcpGrp *grp, unsigned char w);
 
 int ttls_ecp_mul(const TlsEcpGrp *grp, TlsEcpPoint *R, const TlsMpi *m,
 		 const TlsEcpPoint *P, bool rnd);
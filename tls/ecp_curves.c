@@ -319,6 +319,288 @@ ecp_mod_p255(TlsMpi *N)
 	ttls_mpi_add_abs(N, N, M);
 }
 
+/*
+ * X25519 (RFC 7748) field elements are in radix 2^51: 5 limbs of 51 bits.
+ * The arithmetic works on fixed-size arrays, so unlike the MPI code it
+ * doesn't need any memory allocations and its timing doesn't depend on the
+ * values.
+ */
+#define X25519_MASK	((1UL << 51) - 1)
+
+typedef unsigned long x25519_fe[5];
+
+#define X25519_CARRY(r, h)						\
+do {									\
+	unsigned long c;						\
+									\
+	c = (unsigned long)(r[0] >> 51);				\
+	r[1] += c;							\
+	c = (unsigned long)(r[1] >> 51);				\
+	r[2] += c;							\
+	c = (unsigned long)(r[2] >> 51);				\
+	r[3] += c;							\
+	c = (unsigned long)(r[3] >> 51);				\
+	r[4] += c;							\
+	c = (unsigned long)(r[4] >> 51);				\
+	h[0] = ((unsigned long)r[0] & X25519_MASK) + c * 19;		\
+	h[1] = ((unsigned long)r[1] & X25519_MASK) + (h[0] >> 51);	\
+	h[0] &= X25519_MASK;						\
+	h[2] = (unsigned long)r[2] & X25519_MASK;			\
+	h[3] = (unsigned long)r[3] & X25519_MASK;			\
+	h[4] = (unsigned long)r[4] & X25519_MASK;			\
+} while (0)
+
+static inline void
+x25519_fe_add(x25519_fe h, const x25519_fe f, const x25519_fe g)
+{
+	h[0] = f[0] + g[0];
+	h[1] = f[1] + g[1];
+	h[2] = f[2] + g[2];
+	h[3] = f[3] + g[3];
+	h[4] = f[4] + g[4];
+}
+
+/*
+ * h = f - g, 2 * p is added to keep the limbs positive, so @g must be
+ * reduced, i.e. the result of multiplication or squaring.
+ */
+static inline void
+x25519_fe_sub(x25519_fe h, const x25519_fe f, const x25519_fe g)
+{
+	h[0] = f[0] + 0xfffffffffffdaUL - g[0];
+	h[1] = f[1] + 0xffffffffffffeUL - g[1];
+	h[2] = f[2] + 0xffffffffffffeUL - g[2];
+	h[3] = f[3] + 0xffffffffffffeUL - g[3];
+	h[4] = f[4] + 0xffffffffffffeUL - g[4];
+}
+
+static void
+x25519_fe_mul(x25519_fe h, const x25519_fe f, const x25519_fe g)
+{
+	__uint128_t r[5];
+	unsigned long g1_19 = g[1] * 19, g2_19 = g[2] * 19;
+	unsigned long g3_19 = g[3] * 19, g4_19 = g[4] * 19;
+
+	r[0] = (__uint128_t)f[0] * g[0] + (__uint128_t)f[1] * g4_19
+	       + (__uint128_t)f[2] * g3_19 + (__uint128_t)f[3] * g2_19
+	       + (__uint128_t)f[4] * g1_19;
+	r[1] = (__uint128_t)f[0] * g[1] + (__uint128_t)f[1] * g[0]
+	       + (__uint128_t)f[2] * g4_19 + (__uint128_t)f[3] * g3_19
+	       + (__uint128_t)f[4] * g2_19;
+	r[2] = (__uint128_t)f[0] * g[2] + (__uint128_t)f[1] * g[1]
+	       + (__uint128_t)f[2] * g[0] + (__uint128_t)f[3] * g4_19
+	       + (__uint128_t)f[4] * g3_19;
+	r[3] = (__uint128_t)f[0] * g[3] + (__uint128_t)f[1] * g[2]
+	       + (__uint128_t)f[2] * g[1] + (__uint128_t)f[3] * g[0]
+	       + (__uint128_t)f[4] * g4_19;
+	r[4] = (__uint128_t)f[0] * g[4] + (__uint128_t)f[1] * g[3]
+	       + (__uint128_t)f[2] * g[2] + (__uint128_t)f[3] * g[1]
+	       + (__uint128_t)f[4] * g[0];
+
+	X25519_CARRY(r, h);
+}
+
+static void
+x25519_fe_sqr(x25519_fe h, const x25519_fe f)
+{
+	__uint128_t r[5];
+	unsigned long f0_2 = f[0] * 2, f1_2 = f[1] * 2;
+	unsigned long f3_19 = f[3] * 19, f4_19 = f[4] * 19;
+
+	r[0] = (__uint128_t)f[0] * f[0] + (__uint128_t)f1_2 * f4_19
+	       + (__uint128_t)(f[2] * 2) * f3_19;
+	r[1] = (__uint128_t)f0_2 * f[1] + (__uint128_t)(f[2] * 2) * f4_19
+	       + (__uint128_t)f[3] * f3_19;
+	r[2] = (__uint128_t)f0_2 * f[2] + (__uint128_t)f[1] * f[1]
+	       + (__uint128_t)(f[3] * 2) * f4_19;
+	r[3] = (__uint128_t)f0_2 * f[3] + (__uint128_t)f1_2 * f[2]
+	       + (__uint128_t)f[4] * f4_19;
+	r[4] = (__uint128_t)f0_2 * f[4] + (__uint128_t)f1_2 * f[3]
+	       + (__uint128_t)f[2] * f[2];
+
+	X25519_CARRY(r, h);
+}
+
+/* h = f * 121665, i.e. the (A - 2) / 4 constant of the ladder. */
+static void
+x25519_fe_mul_a24(x25519_fe h, const x25519_fe f)
+{
+	__uint128_t r[5];
+
+	r[0] = (__uint128_t)f[0] * 121665;
+	r[1] = (__uint128_t)f[1] * 121665;
+	r[2] = (__uint128_t)f[2] * 121665;
+	r[3] = (__uint128_t)f[3] * 121665;
+	r[4] = (__uint128_t)f[4] * 121665;
+
+	X25519_CARRY(r, h);
+}
+
+static void
+x25519_fe_sqr_n(x25519_fe h, const x25519_fe f, int n)
+{
+	x25519_fe_sqr(h, f);
+	while (--n)
+		x25519_fe_sqr(h, h);
+}
+
+/* h = f^(p - 2) = 1 / f. */
+static void
+x25519_fe_inv(x25519_fe h, const x25519_fe f)
+{
+	x25519_fe z2, z9, z11, z2_5_0, z2_10_0, z2_20_0, z2_50_0, z2_100_0, t;
+
+	x25519_fe_sqr(z2, f);
+	x25519_fe_sqr_n(t, z2, 2);
+	x25519_fe_mul(z9, t, f);
+	x25519_fe_mul(z11, z9, z2);
+	x25519_fe_sqr(t, z11);
+	x25519_fe_mul(z2_5_0, t, z9);
+	x25519_fe_sqr_n(t, z2_5_0, 5);
+	x25519_fe_mul(z2_10_0, t, z2_5_0);
+	x25519_fe_sqr_n(t, z2_10_0, 10);
+	x25519_fe_mul(z2_20_0, t, z2_10_0);
+	x25519_fe_sqr_n(t, z2_20_0, 20);
+	x25519_fe_mul(t, t, z2_20_0);
+	x25519_fe_sqr_n(t, t, 10);
+	x25519_fe_mul(z2_50_0, t, z2_10_0);
+	x25519_fe_sqr_n(t, z2_50_0, 50);
+	x25519_fe_mul(z2_100_0, t, z2_50_0);
+	x25519_fe_sqr_n(t, z2_100_0, 100);
+	x25519_fe_mul(t, t, z2_100_0);
+	x25519_fe_sqr_n(t, t, 50);
+	x25519_fe_mul(t, t, z2_50_0);
+	x25519_fe_sqr_n(t, t, 5);
+	x25519_fe_mul(h, t, z11);
+}
+
+/* Swap @f and @g if @swap is 1, in constant time. */
+static inline void
+x25519_fe_cswap(x25519_fe f, x25519_fe g, unsigned long swap)
+{
+	int i;
+	unsigned long m = 0 - swap;
+
+	for (i = 0; i < 5; ++i) {
+		unsigned long x = m & (f[i] ^ g[i]);
+
+		f[i] ^= x;
+		g[i] ^= x;
+	}
+}
+
+/* Load 256-bit little-endian @s ignoring the most significant bit. */
+static void
+x25519_fe_load(x25519_fe h, const unsigned long s[4])
+{
+	h[0] = s[0] & X25519_MASK;
+	h[1] = ((s[0] >> 51) | (s[1] << 13)) & X25519_MASK;
+	h[2] = ((s[1] >> 38) | (s[2] << 26)) & X25519_MASK;
+	h[3] = ((s[2] >> 25) | (s[3] << 39)) & X25519_MASK;
+	h[4] = (s[3] >> 12) & X25519_MASK;
+}
+
+/* Store fully reduced @f as 256-bit little-endian @s. */
+static void
+x25519_fe_store(unsigned long s[4], const x25519_fe f)
+{
+	int i;
+	unsigned long t[5] = { f[0], f[1], f[2], f[3], f[4] };
+
+#define CARRY_FULL()							\
+do {									\
+	t[1] += t[0] >> 51;						\
+	t[0] &= X25519_MASK;						\
+	t[2] += t[1] >> 51;						\
+	t[1] &= X25519_MASK;						\
+	t[3] += t[2] >> 51;						\
+	t[2] &= X25519_MASK;						\
+	t[4] += t[3] >> 51;						\
+	t[3] &= X25519_MASK;						\
+	t[0] += 19 * (t[4] >> 51);					\
+	t[4] &= X25519_MASK;						\
+} while (0)
+
+	CARRY_FULL();
+	CARRY_FULL();
+	/* Now 0 <= t < 2^255, subtract p if t >= p = 2^255 - 19. */
+	t[0] += 19;
+	CARRY_FULL();
+	/* 19 <= t < 2^255 + 19, add 2^255 - 19 to drop 2^255 by the carry. */
+	t[0] += (1UL << 51) - 19;
+	for (i = 1; i < 5; ++i)
+		t[i] += (1UL << 51) - 1;
+	for (i = 0; i < 4; ++i) {
+		t[i + 1] += t[i] >> 51;
+		t[i] &= X25519_MASK;
+	}
+	t[4] &= X25519_MASK;
+
+#undef CARRY_FULL
+
+	s[0] = t[0] | (t[1] << 51);
+	s[1] = (t[1] >> 13) | (t[2] << 38);
+	s[2] = (t[2] >> 26) | (t[3] << 25);
+	s[3] = (t[3] >> 39) | (t[4] << 12);
+}
+
+/**
+ * X25519 function (RFC 7748 5): @r = @k * @u, all the values are 256-bit
+ * little-endian numbers as in the TLS messages. The scalar is clamped here.
+ * Montgomery ladder is constant-time.
+ */
+void
+ttls_x25519(unsigned long r[4], const unsigned long k[4],
+	    const unsigned long u[4])
+{
+	int t;
+	unsigned long swap = 0, kt, e[4] = { k[0], k[1], k[2], k[3] };
+	x25519_fe x1, x2 = { 1 }, z2 = { 0 }, x3, z3 = { 1 };
+	x25519_fe a, aa, b, bb, c, d, da, cb, ee;
+
+	e[0] &= ~7UL;
+	e[3] &= ~(1UL << 63);
+	e[3] |= 1UL << 62;
+
+	x25519_fe_load(x1, u);
+	memcpy_fast(x3, x1, sizeof(x3));
+
+	for (t = 254; t >= 0; --t) {
+		kt = (e[t >> 6] >> (t & 63)) & 1;
+		swap ^= kt;
+		x25519_fe_cswap(x2, x3, swap);
+		x25519_fe_cswap(z2, z3, swap);
+		swap = kt;
+
+		x25519_fe_add(a, x2, z2);
+		x25519_fe_sqr(aa, a);
+		x25519_fe_sub(b, x2, z2);
+		x25519_fe_sqr(bb, b);
+		x25519_fe_sub(ee, aa, bb);
+		x25519_fe_add(c, x3, z3);
+		x25519_fe_sub(d, x3, z3);
+		x25519_fe_mul(da, d, a);
+		x25519_fe_mul(cb, c, b);
+		x25519_fe_add(x3, da, cb);
+		x25519_fe_sqr(x3, x3);
+		x25519_fe_sub(z3, da, cb);
+		x25519_fe_sqr(z3, z3);
+		x25519_fe_mul(z3, z3, x1);
+		x25519_fe_mul(x2, aa, bb);
+		x25519_fe_mul_a24(z2, ee);
+		x25519_fe_add(z2, z2, aa);
+		x25519_fe_mul(z2, z2, ee);
+	}
+	x25519_fe_cswap(x2, x3, swap);
+	x25519_fe_cswap(z2, z3, swap);
+
+	x25519_fe_inv(z2, z2);
+	x25519_fe_mul(x2, x2, z2);
+	x25519_fe_store(r, x2);
+
+	bzero_fast(e, sizeof(e));
+}
+
 /**
  * Create an MPI from embedded constants
  * (assumes len is an exact multiple of sizeof unsigned long).
@@ -378,6 +660,14 @@ ecp_group_load(TlsEcpGrp *grp, const unsigned long *p,  size_t plen,
 		ttls_mpi_alloc_tmp(&grp->T[i].Z, grp->G.Z.limbs);
 }
 
+/* P = 2^255 - 19 */
+static const unsigned long curve25519_p[] = {
+	BYTES_TO_T_UINT_8(0xED, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF),
+	BYTES_TO_T_UINT_8(0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF),
+	BYTES_TO_T_UINT_8(0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF),
+	BYTES_TO_T_UINT_8(0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x7F),
+};
+
 /*
  * Specialized function for creating the Curve25519 group
  */
@@ -387,10 +677,7 @@ ecp_use_curve25519(TlsEcpGrp *grp)
 	/* Actually (A + 2) / 4 */
 	ttls_mpi_read_binary(&grp->A, "\x01\xDB\x42", 3);
 
-	/* P = 2^255 - 19 */
-	ttls_mpi_lset(&grp->P, 1);
-	ttls_mpi_shift_l(&grp->P, 255);
-	ttls_mpi_sub_int(&grp->P, &grp->P, 19);
+	ecp_mpi_load(&grp->P, curve25519_p, sizeof(curve25519_p));
 
 	/*
 	 * Y intentionaly isn't set, since we use x/z coordinates.
@@ -436,7 +723,6 @@ ttls_ecp_group_load(TlsEcpGrp *grp, ttls_ecp_group_id id)
 		LOAD_GROUP(secp384r1);
 		break;
 	case TTLS_ECP_DP_CURVE25519:
-		T_WARN("Try to load ECP group for unsupported Curve25519.\n");
 		grp->modp = ecp_mod_p255;
 		ecp_use_curve25519(grp);
 		break;
@@ -35,7 +35,10 @@
  * with this program; if not, write to the Free Software Foundation, Inc.,
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
+#include <linux/atomic.h>
 #include <linux/preempt.h>
+#include <linux/shrinker.h>
+#include <linux/workqueue.h>
 
 #include "bignum.h"
 #include "ciphersuites.h"
@@ -52,6 +55,8 @@
 #define __MPOOL_STACK_ORDER	3
 /* Do our best to keep per-handshake MPI pools as tiny as possible. */
 #define __MPOOL_HS_ORDER	0
+/* Freed handshake pools kept on each CPU for following handshakes. */
+#define __MPOOL_HS_CACHE_SZ	16
 
 /*
  * Memory pool for temporal (stack allocated) MPIs which are used only during
@@ -62,6 +67,30 @@
  */
 static DEFINE_PER_CPU(TlsMpiPool *, g_tmp_mpool);
 
+/*
+ * Per-cpu cache of handshake MPI pools.
+ *
+ * Handshakes start and finish at high rates, so released handshake pools are
+ * kept in the cache to not bother the buddy allocator with a page allocation
+ * and freeing for each handshake. The counters are per-cpu and a pool can be
+ * freed on a different CPU than it was allocated on, so @in_use makes sense
+ * only as a sum for all the CPUs.
+ *
+ * The cached pools are returned to the buddy allocator under memory pressure
+ * by the shrinker: the cache is accessed only by the owning CPU with disabled
+ * softirqs, so the shrinker requests @trim pools to free and @trim_work frees
+ * them on the CPU.
+ */
+typedef struct {
+	long			in_use;
+	unsigned int		n;
+	unsigned int		trim;
+	struct work_struct	trim_work;
+	unsigned long		pages[__MPOOL_HS_CACHE_SZ];
+} TlsMpiPoolCache;
+
+static DEFINE_PER_CPU(TlsMpiPoolCache, g_hs_mpool_cache);
+
 /**
  * Return a pointer to an MPI pool of one of the following types:
  * 1. static cipher suite memory profile;
@@ -358,29 +387,33 @@ __mpi_profile_load_ec(TlsMpiPool *mp, TlsECDHCtx *ctx, unsigned char w,
 	if ((r = ttls_ecp_group_load(grp, ec))) {
 		T_DBG("cannot load Secp256r1 ECP group, %s (%d)\n",
 		      ec == TTLS_ECP_DP_SECP256R1 ? "Secp256r1" :
-		      ec == TTLS_ECP_DP_SECP384R1 ? "Secp384r1" : "unknown",
+		      ec == TTLS_ECP_DP_SECP384R1 ? "Secp384r1" :
+		      ec == TTLS_ECP_DP_CURVE25519 ? "Curve25519" : "unknown",
 		      r);
 		return r;
 	}
 	/*
-	 * Prepare precomputed points to use them in ecp_mul_comb().
+	 * Prepare precomputed points to use them in ecp_mul_comb(), there is
+	 * nothing to precompute (@w is zero) for the X25519 ladder.
 	 *
 	 * TODO #1064 replace the precomputation with static table to improve
 	 * spacial locality.
 	 * Can we precompute more data to save cycles on ecp_mul_comb_core()?
 	 * Probably wNAF should be used here.
-	 * It seems we can use fixed-base comb method with two tables instead
-	 * of the generic comb precomputation...
-	 * see M.Brown, D.Hankerson, J.Lopez, A.Menezes,
+	 * P-256 uses the comb method with two tables, see
+	 * ecp_precompute_comb_g(), while there is no room in TlsEcpGrp->T for
+	 * the second Secp384 table.
+	 * See M.Brown, D.Hankerson, J.Lopez, A.Menezes,
 	 * "Software implementation of the NIST elliptic curves over prime fields".
 	 * Fixed-base comb with w=6 requres about 41*A + 21*D time which seems
 	 * much larger than OpenSSL's 36*A.
 	 * w=4 gives even worse 59*A + 31*D time.
 	 */
-	n_sz = (grp->bits + w - 1) / w;
-	if (ecp_precompute_comb(grp, grp->T, &grp->G, w, n_sz))
-		return -EDOM;
-	ttls_mpool_shrink_tailtmp(mp, true);
+	if (w) {
+		if (ecp_precompute_comb_g(grp, w))
+			return -EDOM;
+		ttls_mpool_shrink_tailtmp(mp, true);
+	}
 	/*
 	 * Move the group to the tail part: the tail part will be referenced by
 	 * all the cloned profiles while the header part is directly copied.
@@ -430,8 +463,9 @@ ttls_mpi_profile_create_ec(TlsMpiPool *mp, ttls_ecp_group_id ec)
 			return r;
 		break;
 	case TTLS_ECP_DP_CURVE25519:
-		/* TODO #1031 nothing to do yet. */
-		return 0;
+		if ((r = __mpi_profile_load_ec(mp, ecdh_ctx, 0, ec)))
+			return r;
+		break;
 	default:
 		WARN_ONCE(1, "There is no EC profile for %d\n", ec);
 		return -EINVAL;
@@ -499,6 +533,33 @@ cleanup:
 	return r;
 }
 
+/**
+ * Get a page for a handshake MPI pool from the per-cpu cache or, if the cache
+ * is empty, from the buddy allocator.
+ */
+static char *
+__mpi_hs_pool_get(void)
+{
+	unsigned long addr;
+	TlsMpiPoolCache *pc;
+
+	local_bh_disable();
+	pc = this_cpu_ptr(&g_hs_mpool_cache);
+	if (pc->n) {
+		addr = pc->pages[--pc->n];
+	} else {
+		addr = __get_free_pages(GFP_ATOMIC, __MPOOL_HS_ORDER);
+		if (WARN_ON_ONCE(!addr)) {
+			local_bh_enable();
+			return NULL;
+		}
+	}
+	pc->in_use++;
+	local_bh_enable();
+
+	return (char *)addr;
+}
+
 /**
  * Create a new per-handshake MPI pool and clone an MPI profile into it.
  */
@@ -523,8 +584,7 @@ __mpi_profile_clone(TlsCtx *tls, int ec)
 		return -ENOMEM;
 	}
 
-	ptr = (char *)__get_free_pages(GFP_ATOMIC, __MPOOL_HS_ORDER);
-	if (WARN_ON_ONCE(!ptr))
+	if (!(ptr = __mpi_hs_pool_get()))
 		return -ENOMEM;
 
 	memcpy_fast(ptr, mp, MPI_PROFILE_SZ(mp));
@@ -579,24 +639,145 @@ curve_found:
 	}
 }
 
+/**
+ * Free the handshake MPI pool storing the crypto context @ctx, which was
+ * created by ttls_mpi_profile_clone(). The pool goes to the per-cpu cache if
+ * there is a room for it.
+ */
 void
-ttls_mpool_exit(void)
+ttls_mpi_profile_free(void *ctx)
+{
+	TlsMpiPool *mp = (TlsMpiPool *)ctx - 1;
+	TlsMpiPoolCache *pc;
+
+	WARN_ON_ONCE(mp->order != __MPOOL_HS_ORDER);
+
+	local_bh_disable();
+	pc = this_cpu_ptr(&g_hs_mpool_cache);
+	pc->in_use--;
+	if (pc->n < __MPOOL_HS_CACHE_SZ) {
+		bzero_fast(MPI_POOL_DATA(mp), mp->curr - sizeof(*mp));
+		pc->pages[pc->n++] = (unsigned long)mp;
+		local_bh_enable();
+		return;
+	}
+	local_bh_enable();
+
+	ttls_mpi_pool_free(ctx);
+}
+
+/**
+ * Collect memory, in bytes, of handshake MPI pools in use, @in_use, and kept
+ * in the per-cpu caches, @cached.
+ */
+void
+ttls_mpool_hs_stat(unsigned long *in_use, unsigned long *cached)
+{
+	int cpu;
+	long n = 0, c = 0;
+
+	for_each_possible_cpu(cpu) {
+		TlsMpiPoolCache *pc = per_cpu_ptr(&g_hs_mpool_cache, cpu);
+
+		n += pc->in_use;
+		c += pc->n;
+	}
+
+	*in_use = max(n, 0L) * (PAGE_SIZE << __MPOOL_HS_ORDER);
+	*cached = c * (PAGE_SIZE << __MPOOL_HS_ORDER);
+}
+
+static void
+ttls_mpool_hs_trim(struct work_struct *work)
+{
+	TlsMpiPoolCache *pc = container_of(work, TlsMpiPoolCache, trim_work);
+	unsigned int n = xchg(&pc->trim, 0);
+
+	local_bh_disable();
+	for (n = min_t(unsigned int, n, pc->n); n; --n)
+		free_pages(pc->pages[--pc->n], __MPOOL_HS_ORDER);
+	local_bh_enable();
+}
+
+static unsigned long
+ttls_mpool_hs_count(struct shrinker *s, struct shrink_control *sc)
+{
+	int cpu;
+	unsigned long n = 0;
+
+	for_each_online_cpu(cpu)
+		n += READ_ONCE(per_cpu_ptr(&g_hs_mpool_cache, cpu)->n);
+
+	return n;
+}
+
+/**
+ * Free up to @sc->nr_to_scan cached handshake pools. The pools are freed
+ * asynchronously on the owning CPUs, so they're reported as freed right
+ * after the request.
+ */
+static unsigned long
+ttls_mpool_hs_scan(struct shrinker *s, struct shrink_control *sc)
+{
+	int cpu;
+	unsigned long freed = 0;
+
+	for_each_online_cpu(cpu) {
+		TlsMpiPoolCache *pc = per_cpu_ptr(&g_hs_mpool_cache, cpu);
+		unsigned int n = min_t(unsigned long, READ_ONCE(pc->n),
+				       sc->nr_to_scan - freed);
+
+		if (!n)
+			continue;
+		WRITE_ONCE(pc->trim, n);
+		schedule_work_on(cpu, &pc->trim_work);
+		if ((freed += n) >= sc->nr_to_scan)
+			break;
+	}
+
+	return freed ? : SHRINK_STOP;
+}
+
+static struct shrinker ttls_mpool_hs_shrinker = {
+	.count_objects	= ttls_mpool_hs_count,
+	.scan_objects	= ttls_mpool_hs_scan,
+	.seeks		= DEFAULT_SEEKS,
+};
+
+static void
+__ttls_mpool_free(void)
 {
 	int i;
 	TlsMpiPool *mp;
 
 	for_each_possible_cpu(i) {
+		TlsMpiPoolCache *pc = per_cpu_ptr(&g_hs_mpool_cache, i);
+
+		cancel_work_sync(&pc->trim_work);
+		while (pc->n)
+			free_pages(pc->pages[--pc->n], __MPOOL_HS_ORDER);
 		mp = *per_cpu_ptr(&g_tmp_mpool, i);
 		ttls_bzero_safe(MPI_POOL_DATA(mp), mp->curr - sizeof(*mp));
 		free_pages((unsigned long)mp, mp->order);
 	}
 }
 
+void
+ttls_mpool_exit(void)
+{
+	unregister_shrinker(&ttls_mpool_hs_shrinker);
+	__ttls_mpool_free();
+}
+
 int __init
 ttls_mpool_init(void)
 {
 	int cpu;
 
+	for_each_possible_cpu(cpu)
+		INIT_WORK(&per_cpu_ptr(&g_hs_mpool_cache, cpu)->trim_work,
+			  ttls_mpool_hs_trim);
+
 	for_each_possible_cpu(cpu) {
 		TlsMpiPool **mp = per_cpu_ptr(&g_tmp_mpool, cpu);
 		if (!(*mp = ttls_mpi_pool_create(__MPOOL_STACK_ORDER,
@@ -606,9 +787,11 @@ ttls_mpool_init(void)
 
 	if (ttls_ciphersuite_for_all(ttls_mpi_profile_set))
 		goto err_cleanup;
+	if (register_shrinker(&ttls_mpool_hs_shrinker))
+		goto err_cleanup;
 
 	return 0;
 err_cleanup:
-	ttls_mpool_exit();
+	__ttls_mpool_free();
 	return -ENOMEM;
 }
@@ -31,6 +31,8 @@ int ttls_mpi_pool_alloc_mpi(TlsMpi *x, size_t n, bool tail);
 TlsMpiPool *ttls_mpi_pool_create(size_t order, gfp_t gfp_mask);
 void ttls_mpi_pool_free(void *ctx);
 int ttls_mpi_profile_clone(TlsCtx *tls);
+void ttls_mpi_profile_free(void *ctx);
+void ttls_mpool_hs_stat(unsigned long *in_use, unsigned long *cached);
 void ttls_mpi_pool_cleanup_ctx(unsigned long addr, bool zero);
 void ttls_mpool_shrink_tailtmp(TlsMpiPool *mp, bool fix_refs);
 
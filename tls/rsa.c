@@ -610,9 +610,11 @@ ttls_rsa_private(TlsRSACtx *ctx, const unsigned char *input,
 	 *
 	 * TP = input ^ dP mod P
 	 * TQ = input ^ dQ mod Q
+	 *
+	 * The exponents are secret, so use the fixed window.
 	 */
-	MPI_CHK(ttls_mpi_exp_mod(TP, T, DP_blind, &ctx->P, &ctx->RP));
-	MPI_CHK(ttls_mpi_exp_mod(TQ, T, DQ_blind, &ctx->Q, &ctx->RQ));
+	MPI_CHK(ttls_mpi_exp_mod_fw(TP, T, DP_blind, &ctx->P, &ctx->RP));
+	MPI_CHK(ttls_mpi_exp_mod_fw(TQ, T, DQ_blind, &ctx->Q, &ctx->RQ));
 
 	/* T = (TP - TQ) * (Q^-1 mod P) mod P */
 	ttls_mpi_sub_mpi(T, TP, TQ);
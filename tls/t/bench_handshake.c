@@ -0,0 +1,285 @@
+/**
+ *		Tempesta TLS handshake benchmark
+ *
+ * Measures the server side public key operations of a full TLS handshake,
+ * the dominating part of the handshake cost: RSA-2048 and ECDSA P-256
+ * ServerKeyExchange signatures and the ECDHE key exchanges on P-256 and
+ * X25519 including the per-handshake MPI pool cloning. The results are
+ * printed as one line of key=value pairs per operation: op, iters,
+ * cycles_per_op and ops_per_sec, so they can be tracked for regressions.
+ *
+ * Usage: bench_handshake [iterations]
+ *
+ * Copyright (C) 2020 Tempesta Technologies, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#include <time.h>
+#include <x86intrin.h>
+
+#include "ttls_mocks.h"
+#include "../asn1.c"
+#include "../bignum.c"
+#include "../ciphersuites.c"
+#include "../dhm.c"
+#include "../ecp.c"
+#include "../ecp_curves.c"
+#include "../ecdh.c"
+#include "../ecdsa.c"
+#include "../mpool.c"
+#include "../rsa.c"
+
+/*
+ * RSA-2048 keypair for the benchmark only.
+ */
+#define KEY_LEN	256
+
+#define RSA_N							   \
+	"\xC3\xDB\x5C\x68\x6E\x2F\x9D\x49\x5D\xB6\xD1\xAD\xD3\xCE\xB6\x70" \
+	"\xCA\xC0\x49\xE2\xCE\xEF\x26\x94\x9F\xBE\x15\xC3\x09\x75\x7B\x90" \
+	"\x48\x77\xBC\x26\xD0\x09\xB2\x03\x76\xE7\x7C\xA8\x91\xA3\xCD\x27" \
+	"\x56\x39\x02\xF0\x8D\x6D\x7B\xF1\xF0\xEE\x49\xF9\x38\x86\xF9\xF2" \
+	"\xBE\xF1\x1A\x8E\x1F\x72\xFD\xFE\x26\xA4\xC4\xB4\xE1\x72\xB5\xE2" \
+	"\xED\xF3\x68\xF5\x43\x8D\xF0\x4E\xFE\x65\x5C\xAB\xF8\x85\x78\x94" \
+	"\x92\x0C\x7A\x0F\xB1\xB8\xEC\xA3\x92\xAA\x48\x98\xFD\x84\xA6\x32" \
+	"\xF1\xC4\x69\x2B\xB6\x6C\xBD\x3D\x23\x1E\x97\xFE\x8D\xBD\x02\x66" \
+	"\x41\x0D\x05\x33\x5F\x06\x07\x56\x46\xDD\x0E\x8F\xD7\xEC\x41\x23" \
+	"\x50\xF3\x87\xC6\x52\x08\xAB\x86\xF5\x1E\x3E\x3D\x6D\x8B\xBB\x71" \
+	"\x97\x8B\xD1\xC0\x33\xF4\x9B\x67\xF8\x33\x8C\x82\x1E\x4E\xB4\xDF" \
+	"\x41\x8C\x21\x8D\x78\x54\x9E\x49\xD9\x4D\xB0\x2C\x08\x00\x26\xAB" \
+	"\x13\x91\x0B\xBA\xDD\x4B\x29\x86\x65\xB5\x50\x9B\x53\xD3\x1F\x3B" \
+	"\x22\xCE\xD0\x36\xD1\x7E\x4A\xF5\xA6\x32\x7A\x69\xF8\xB7\x22\xF7" \
+	"\x52\x23\x3C\xA2\x87\xE2\xFE\xF5\xE2\x8A\x98\xF4\x92\x27\xEC\xA0" \
+	"\x41\x44\x11\x85\x5F\xB3\x7C\xF9\x6C\x93\x73\x10\x84\x4A\xE1\x25"
+
+#define RSA_D							   \
+	"\x22\xD7\x31\x9D\xD1\x26\x0E\xB6\x87\xA1\x77\x34\xD3\x26\x25\x4D" \
+	"\xB4\xBF\x96\x95\x2E\x87\x1B\xE7\x99\xF0\x14\x4A\x74\xF3\x0D\x77" \
+	"\x49\xF0\xE4\xCB\x49\xBC\x43\xCA\xBA\x7A\xEC\xF1\xC6\xB0\xAB\x14" \
+	"\xC9\x91\x8C\x3C\x93\x08\x0C\x21\xAA\xA0\x95\x0F\xAC\xB6\xD4\x1D" \
+	"\x52\xCA\xAC\x94\xE6\x32\xCC\x4C\x8A\xFE\xCA\x10\x3C\x3F\xAD\xEB" \
+	"\xEF\xB4\xDA\x71\xB0\xE1\xFD\xC2\xEB\x9D\xC7\xE9\xBE\xA4\xAD\xA1" \
+	"\xCE\x46\x42\x6B\x6A\xCB\xD0\xEA\xBB\x33\x28\x05\x71\x29\xC8\xEF" \
+	"\xEC\x92\xAA\x3B\xD0\xB0\x90\xCC\x60\xA4\x37\x59\x1C\xC9\x27\xF5" \
+	"\x0D\x88\x03\x95\x1F\xDE\xFF\x20\xCE\x5B\x44\x6B\x4A\xFB\xD7\x98" \
+	"\x65\xC9\x1C\xEA\x26\x4A\x9A\xC1\x04\xE2\x24\xDD\x68\x78\x1C\x21" \
+	"\x1E\x00\x67\xD8\xBE\x2D\xFD\x69\xF8\x1F\x87\x96\xDD\xEE\xFA\x49" \
+	"\x7E\x4F\x6E\xD2\xEC\x35\xC6\x6C\x26\xA7\x81\x75\x38\x34\x14\x2D" \
+	"\x55\x97\x59\x60\xC0\x56\xA5\x10\xD5\x71\x89\xBD\xFF\x37\xC5\x00" \
+	"\x0B\xA2\x30\x2B\x36\xD0\x62\xE3\x3B\xCB\xC4\x6D\x2F\x45\xC1\x04" \
+	"\x97\x19\x16\xAF\xCC\x09\x6C\xA4\x07\x75\x62\xB2\xD4\x84\xA1\x95" \
+	"\xFC\xDC\xC7\x1E\x47\x3F\x7C\x90\x62\xFD\x42\x6C\x9E\x20\x77\xE1"
+
+#define RSA_P							   \
+	"\xE1\x42\xD9\x2B\xBB\x44\xBC\x97\x7C\x7F\xBA\x9E\xED\x9B\x35\x4C" \
+	"\x79\x8C\x36\xB7\x88\xC1\x6A\x7C\xD6\xC5\x6A\x6A\x5A\x5D\xDB\x81" \
+	"\xE3\xA3\xA1\xA1\x8F\x9B\xFC\x8F\x93\x41\xDF\x7A\x6E\x2B\xC9\x57" \
+	"\x7B\x42\x16\x7C\x48\xDF\xE1\x22\x74\xBB\xDC\x80\x5D\x88\x1E\x58" \
+	"\x77\x9A\x95\xA8\x47\x1C\x09\x49\x65\x4C\xE7\xCA\xFB\x27\x17\x48" \
+	"\x48\x8E\x98\x2C\xF2\x12\x3A\xA1\x40\x81\xCC\x01\x3C\xD9\x39\x4D" \
+	"\xCC\xBF\x0E\xB2\x71\x2B\xE0\x62\xA1\xAA\x97\x1A\xD2\x5A\xFE\xDE" \
+	"\x22\xB8\x3D\x69\x30\x6A\x5F\x7C\x73\xED\xAC\x71\xEB\x9B\xFA\xE1"
+
+#define RSA_Q							   \
+	"\xDE\x95\x52\x05\x55\xC4\x1D\x1A\x5B\xCD\x07\xFE\xDF\x47\x85\x19" \
+	"\xD2\xD4\x98\x5E\x4C\xB6\x48\x1F\xBD\x46\x64\xA5\x7F\x6F\x68\x87" \
+	"\xEA\xE6\xEC\x55\xDE\x16\x42\x5D\xFC\x17\x5E\x6B\x8F\xA9\xB4\x03" \
+	"\x90\x89\x34\x58\xDF\xD1\x85\xBF\x8B\x01\x40\xF8\x75\x18\xE1\xF2" \
+	"\x3F\xA2\x23\xF7\x81\xBF\x91\x1E\x11\x2B\xAF\x1E\x8D\x9B\xCB\x15" \
+	"\x4C\x1C\xD0\x99\x49\x0E\xC7\x5F\xF0\x1F\x8E\x8D\xB8\x0A\xB9\x5C" \
+	"\xA9\xBE\xDA\x05\x0B\x1C\x5B\x2A\x6F\xD7\x50\x49\xAD\xCE\x62\xFF" \
+	"\xA7\x7A\xF5\x8E\xB5\x2F\x16\x57\xE8\xC8\xE0\xF4\xC8\x7F\x12\xC5"
+
+#define RSA_E	"\x01\x00\x01"
+
+/* The same P-256 key as in test_ecdsa.c. */
+#define EC_Qx								   \
+	"\xB8\x81\xE6\x91\x1E\xAD\xA2\x23\x61\xC5\x48\x7D\x77\xC6\xD2\x49" \
+	"\xDD\x38\xFF\xF8\xF7\x5E\xC2\x8D\x08\xFA\x02\x5B\x8C\xD4\xCE\x5B"
+
+#define EC_Qy								   \
+	"\x80\xDF\x24\x74\xAB\x78\x97\x59\xF4\x09\x6A\x6C\xFD\xD4\x26\xD5" \
+	"\x32\x6D\x6B\xC3\xEA\x6F\xB5\x02\x2B\x1E\x7A\xB6\x79\x43\x62\x6A"
+
+#define EC_d								   \
+	"\xC7\x1C\xBC\x8A\xCA\x38\xF7\xC9\x97\xF9\x3A\x6C\xBD\xFD\xCF\x7F" \
+	"\x4C\x9D\x32\xAA\x35\x1F\x49\xDB\xF4\x7D\x72\xD6\x64\x2F\x06\xDC"
+
+/* Client public keys from test_ecdh.c. */
+#define CLNT_P256							   \
+	"\x41\x04\xCE\xD4\x8B\x4C\x8A\x45\xA2\x08\xF8\x1F\xFD\xAF\xA6\x8C" \
+	"\x75\x21\x19\x95\xC5\x10\xB1\xDB\x19\xA7\x0D\xA2\x9F\x33\x82\x70" \
+	"\x90\xE0\x94\xA3\x0B\xE5\xA4\xB1\xBD\x8A\x9B\x3E\xF3\x2C\x43\x02" \
+	"\x58\x88\x64\x88\x64\x22\xB8\xE6\xE9\x84\x9D\x52\x79\x7C\x9C\x74" \
+	"\x8F\x67"
+
+#define CLNT_X25519							   \
+	"\x20\xDE\x9E\xDB\x7D\x7B\x7D\xC1\xB4\xD3\x5B\x61\xC2\xEC\xE4\x35" \
+	"\x37\x3F\x83\x43\xC8\x5B\x78\x67\x4D\xAD\xFC\x7E\x14\x6F\x88\x2B" \
+	"\x4F"
+
+static unsigned long niters = 1000;
+
+typedef struct {
+	unsigned long	cycles;
+	struct timespec	ts;
+} BenchTime;
+
+static void
+bench_start(BenchTime *t)
+{
+	clock_gettime(CLOCK_MONOTONIC, &t->ts);
+	t->cycles = __rdtsc();
+}
+
+static void
+bench_stop(BenchTime *t, const char *op)
+{
+	unsigned long cycles = __rdtsc() - t->cycles;
+	struct timespec ts;
+	double ns;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	ns = (ts.tv_sec - t->ts.tv_sec) * 1e9 + ts.tv_nsec - t->ts.tv_nsec;
+
+	printf("op=%s iters=%lu cycles_per_op=%lu ops_per_sec=%.0f\n",
+	       op, niters, cycles / niters, niters * 1e9 / ns);
+}
+
+static void
+bench_rsa_sign(void)
+{
+	unsigned long i;
+	BenchTime t;
+	TlsMpiPool *mp;
+	TlsRSACtx *rsa;
+	unsigned char hash[32] = {1}, sig[KEY_LEN];
+
+	EXPECT_FALSE(!(mp = ttls_mpi_pool_create(TTLS_MPOOL_ORDER, GFP_KERNEL)));
+	EXPECT_FALSE(!(rsa = ttls_mpool_alloc_data(mp, sizeof(TlsRSACtx))));
+	memset(rsa, 0, sizeof(TlsRSACtx));
+	ttls_rsa_init(rsa, TTLS_RSA_PKCS_V15, 0);
+	EXPECT_ZERO(ttls_rsa_import_raw(rsa, RSA_N, KEY_LEN, RSA_P, KEY_LEN / 2,
+					RSA_Q, KEY_LEN / 2, RSA_D, KEY_LEN,
+					RSA_E, 3));
+	EXPECT_ZERO(ttls_rsa_check_pubkey(rsa));
+
+	kernel_fpu_begin();
+
+	bench_start(&t);
+	for (i = 0; i < niters; i++) {
+		EXPECT_ZERO(ttls_rsa_pkcs1_sign(rsa, TTLS_MD_SHA256, hash,
+						sig));
+		/* Cleanup the temporary data as after a handshake step. */
+		ttls_mpi_pool_cleanup_ctx(0, true);
+	}
+	bench_stop(&t, "rsa2048_sign");
+
+	EXPECT_ZERO(ttls_rsa_pkcs1_verify(rsa, TTLS_MD_SHA256, 32, hash, sig));
+
+	kernel_fpu_end();
+
+	ttls_rsa_free(rsa);
+	ttls_mpi_pool_free(rsa);
+}
+
+static void
+bench_ecdsa_sign(void)
+{
+	unsigned long i;
+	size_t slen;
+	BenchTime t;
+	TlsMpiPool *mp;
+	TlsEcpKeypair *ctx;
+	char hash[32] = {1}, sig[80];
+
+	EXPECT_FALSE(!(mp = ttls_mpi_pool_create(TTLS_MPOOL_ORDER, GFP_KERNEL)));
+	EXPECT_FALSE(!(ctx = ttls_mpool_alloc_data(mp, sizeof(*ctx))));
+	EXPECT_FALSE(!(ctx->grp = ttls_ecp_group_lookup(TTLS_ECP_DP_SECP256R1)));
+	ttls_mpi_read_binary(&ctx->Q.X, EC_Qx, 32);
+	ttls_mpi_read_binary(&ctx->Q.Y, EC_Qy, 32);
+	ttls_mpi_lset(&ctx->Q.Z, 1);
+	ttls_mpi_read_binary(&ctx->d, EC_d, 32);
+
+	bench_start(&t);
+	for (i = 0; i < niters; i++) {
+		EXPECT_ZERO(ttls_ecdsa_write_signature(ctx, hash, 32, sig,
+						       &slen));
+		/* Cleanup the temporary data as after a handshake step. */
+		ttls_mpi_pool_cleanup_ctx(0, true);
+	}
+	bench_stop(&t, "ecdsa_p256_sign");
+
+	EXPECT_ZERO(ttls_ecdsa_read_signature(ctx, hash, 32, sig, slen));
+
+	ttls_mpi_pool_free(ctx);
+}
+
+/**
+ * Server ECDHE as in a handshake: clone the context from the ciphersuite
+ * MPI profile, generate the ephemeral key and compute the premaster secret.
+ */
+static void
+bench_ecdhe(TlsMpiPool *prof, const char *clnt, size_t clnt_len,
+	    const char *op)
+{
+	unsigned long i;
+	size_t n;
+	BenchTime t;
+	TlsMpiPool *mp;
+	TlsECDHCtx *ctx;
+	unsigned char buf[128], pms[TTLS_PREMASTER_SIZE];
+
+	bench_start(&t);
+	for (i = 0; i < niters; i++) {
+		/* Handshake pools are one page, see __mpi_profile_clone(). */
+		EXPECT_FALSE(!(mp = ttls_mpi_pool_create(0, GFP_KERNEL)));
+		ctx = ttls_mpool_alloc_data(mp, prof->curr - sizeof(*mp));
+		EXPECT_FALSE(!ctx);
+		mp->curr = prof->curr;
+		memcpy_fast(ctx, MPI_POOL_DATA(prof),
+			    mp->curr - sizeof(*mp));
+
+		EXPECT_ZERO(ttls_ecdh_make_params(ctx, &n, buf, 128));
+		EXPECT_ZERO(ttls_ecdh_read_public(ctx, clnt, clnt_len));
+		EXPECT_ZERO(ttls_ecdh_calc_secret(ctx, &n, pms,
+						  TTLS_MPI_MAX_SIZE));
+
+		ttls_mpi_pool_free(ctx);
+		ttls_mpi_pool_cleanup_ctx(0, true);
+	}
+	bench_stop(&t, op);
+}
+
+int
+main(int argc, char *argv[])
+{
+	if (argc > 1 && !(niters = strtoul(argv[1], NULL, 10))) {
+		fprintf(stderr, "Usage: %s [iterations]\n", argv[0]);
+		return 1;
+	}
+
+	BUG_ON(ttls_mpool_init());
+
+	bench_rsa_sign();
+	bench_ecdsa_sign();
+	bench_ecdhe(&cs_mp_ecdhe_secp256.mp, CLNT_P256, 66, "ecdhe_p256");
+	bench_ecdhe(&cs_mp_ecdhe_curve25519.mp, CLNT_X25519, 33,
+		    "ecdhe_x25519");
+
+	ttls_mpool_exit();
+
+	return 0;
+}
@@ -82,12 +82,58 @@ ecdhe_srv(void)
 	ttls_mpi_pool_free(ctx);
 }
 
+/*
+ * X25519 ECDHE with Bob's key from RFC 7748 6.1 as the client key.
+ * The server key is random, so the results are checked against
+ * ttls_x25519() tested in test_ecp.c.
+ */
+static void
+ecdhe_srv_x25519(void)
+{
+	size_t n;
+	TlsECDHCtx *ctx;
+	TlsMpiPool *mp;
+	unsigned long d[4], r[4], base[4] = { 9 };
+	unsigned char buf[128] = {0}, pms[TTLS_PREMASTER_SIZE] = {0};
+	const char clnt_buf[33] = "\x20\xDE\x9E\xDB\x7D\x7B\x7D\xC1"
+				  "\xB4\xD3\x5B\x61\xC2\xEC\xE4\x35"
+				  "\x37\x3F\x83\x43\xC8\x5B\x78\x67"
+				  "\x4D\xAD\xFC\x7E\x14\x6F\x88\x2B"
+				  "\x4F";
+
+	EXPECT_FALSE(!(mp = ttls_mpi_pool_create(TTLS_MPOOL_ORDER, GFP_KERNEL)));
+
+	ctx = ttls_mpool_alloc_data(mp, cs_mp_ecdhe_curve25519.mp.curr
+					- sizeof(*mp));
+	EXPECT_FALSE(!ctx);
+	mp->curr = cs_mp_ecdhe_curve25519.mp.curr;
+	memcpy_fast(ctx, MPI_POOL_DATA(&cs_mp_ecdhe_curve25519.mp),
+		    mp->curr - sizeof(*mp));
+
+	EXPECT_ZERO(ttls_ecdh_make_params(ctx, &n, buf, 128));
+	EXPECT_TRUE(n == 36);
+	EXPECT_ZERO(memcmp(buf, "\x03\x00\x1D\x20", 4));
+	ecp_mont_get_x(d, &ctx->d);
+	ttls_x25519(r, d, base);
+	EXPECT_ZERO(memcmp(buf + 4, r, 32));
+
+	EXPECT_ZERO(ttls_ecdh_read_public(ctx, clnt_buf, 33));
+	EXPECT_ZERO(ttls_ecdh_calc_secret(ctx, &n, pms, TTLS_MPI_MAX_SIZE));
+	EXPECT_TRUE(n == 32);
+	memcpy(base, clnt_buf + 1, 32);
+	ttls_x25519(r, d, base);
+	EXPECT_ZERO(memcmp(pms, r, 32));
+
+	ttls_mpi_pool_free(ctx);
+}
+
 int
 main(int argc, char *argv[])
 {
 	BUG_ON(ttls_mpool_init());
 
 	ecdhe_srv();
+	ecdhe_srv_x25519();
 
 	ttls_mpool_exit();
 
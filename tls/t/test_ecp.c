@@ -156,6 +156,102 @@ ecp_mul(void)
 	ttls_mpi_pool_free(R);
 }
 
+/*
+ * X25519 test vectors from RFC 7748 5.2 and 6.1, all the values are
+ * little-endian byte strings.
+ */
+static void
+x25519_check(const char *k, const char *u, const char *exp)
+{
+	unsigned long r[4], kl[4], ul[4];
+
+	memcpy(kl, k, 32);
+	memcpy(ul, u, 32);
+	ttls_x25519(r, kl, ul);
+	EXPECT_ZERO(memcmp(r, exp, 32));
+}
+
+static void
+ecp_x25519(void)
+{
+	static const char base[32] = { 9 };
+
+	x25519_check(
+		"\xA5\x46\xE3\x6B\xF0\x52\x7C\x9D"
+		"\x3B\x16\x15\x4B\x82\x46\x5E\xDD"
+		"\x62\x14\x4C\x0A\xC1\xFC\x5A\x18"
+		"\x50\x6A\x22\x44\xBA\x44\x9A\xC4",
+		"\xE6\xDB\x68\x67\x58\x30\x30\xDB"
+		"\x35\x94\xC1\xA4\x24\xB1\x5F\x7C"
+		"\x72\x66\x24\xEC\x26\xB3\x35\x3B"
+		"\x10\xA9\x03\xA6\xD0\xAB\x1C\x4C",
+		"\xC3\xDA\x55\x37\x9D\xE9\xC6\x90"
+		"\x8E\x94\xEA\x4D\xF2\x8D\x08\x4F"
+		"\x32\xEC\xCF\x03\x49\x1C\x71\xF7"
+		"\x54\xB4\x07\x55\x77\xA2\x85\x52");
+	x25519_check(
+		"\x4B\x66\xE9\xD4\xD1\xB4\x67\x3C"
+		"\x5A\xD2\x26\x91\x95\x7D\x6A\xF5"
+		"\xC1\x1B\x64\x21\xE0\xEA\x01\xD4"
+		"\x2C\xA4\x16\x9E\x79\x18\xBA\x0D",
+		"\xE5\x21\x0F\x12\x78\x68\x11\xD3"
+		"\xF4\xB7\x95\x9D\x05\x38\xAE\x2C"
+		"\x31\xDB\xE7\x10\x6F\xC0\x3C\x3E"
+		"\xFC\x4C\xD5\x49\xC7\x15\xA4\x93",
+		"\x95\xCB\xDE\x94\x76\xE8\x90\x7D"
+		"\x7A\xAD\xE4\x5C\xB4\xB8\x73\xF8"
+		"\x8B\x59\x5A\x68\x79\x9F\xA1\x52"
+		"\xE6\xF8\xF7\x64\x7A\xAC\x79\x57");
+
+	/* Diffie-Hellman: Alice's and Bob's public keys and the shared key. */
+	x25519_check(
+		"\x77\x07\x6D\x0A\x73\x18\xA5\x7D"
+		"\x3C\x16\xC1\x72\x51\xB2\x66\x45"
+		"\xDF\x4C\x2F\x87\xEB\xC0\x99\x2A"
+		"\xB1\x77\xFB\xA5\x1D\xB9\x2C\x2A",
+		base,
+		"\x85\x20\xF0\x09\x89\x30\xA7\x54"
+		"\x74\x8B\x7D\xDC\xB4\x3E\xF7\x5A"
+		"\x0D\xBF\x3A\x0D\x26\x38\x1A\xF4"
+		"\xEB\xA4\xA9\x8E\xAA\x9B\x4E\x6A");
+	x25519_check(
+		"\x5D\xAB\x08\x7E\x62\x4A\x8A\x4B"
+		"\x79\xE1\x7F\x8B\x83\x80\x0E\xE6"
+		"\x6F\x3B\xB1\x29\x26\x18\xB6\xFD"
+		"\x1C\x2F\x8B\x27\xFF\x88\xE0\xEB",
+		base,
+		"\xDE\x9E\xDB\x7D\x7B\x7D\xC1\xB4"
+		"\xD3\x5B\x61\xC2\xEC\xE4\x35\x37"
+		"\x3F\x83\x43\xC8\x5B\x78\x67\x4D"
+		"\xAD\xFC\x7E\x14\x6F\x88\x2B\x4F");
+	x25519_check(
+		"\x77\x07\x6D\x0A\x73\x18\xA5\x7D"
+		"\x3C\x16\xC1\x72\x51\xB2\x66\x45"
+		"\xDF\x4C\x2F\x87\xEB\xC0\x99\x2A"
+		"\xB1\x77\xFB\xA5\x1D\xB9\x2C\x2A",
+		"\xDE\x9E\xDB\x7D\x7B\x7D\xC1\xB4"
+		"\xD3\x5B\x61\xC2\xEC\xE4\x35\x37"
+		"\x3F\x83\x43\xC8\x5B\x78\x67\x4D"
+		"\xAD\xFC\x7E\x14\x6F\x88\x2B\x4F",
+		"\x4A\x5D\x9D\x5B\xA4\xCE\x2D\xE1"
+		"\x72\x8E\x3B\xF4\x80\x35\x0F\x25"
+		"\xE0\x7E\x21\xC9\x47\xD1\x9E\x33"
+		"\x76\xF0\x9B\x3C\x1E\x16\x17\x42");
+	x25519_check(
+		"\x5D\xAB\x08\x7E\x62\x4A\x8A\x4B"
+		"\x79\xE1\x7F\x8B\x83\x80\x0E\xE6"
+		"\x6F\x3B\xB1\x29\x26\x18\xB6\xFD"
+		"\x1C\x2F\x8B\x27\xFF\x88\xE0\xEB",
+		"\x85\x20\xF0\x09\x89\x30\xA7\x54"
+		"\x74\x8B\x7D\xDC\xB4\x3E\xF7\x5A"
+		"\x0D\xBF\x3A\x0D\x26\x38\x1A\xF4"
+		"\xEB\xA4\xA9\x8E\xAA\x9B\x4E\x6A",
+		"\x4A\x5D\x9D\x5B\xA4\xCE\x2D\xE1"
+		"\x72\x8E\x3B\xF4\x80\x35\x0F\x25"
+		"\xE0\x7E\x21\xC9\x47\xD1\x9E\x33"
+		"\x76\xF0\x9B\x3C\x1E\x16\x17\x42");
+}
+
 /* Leave the code to make mod_p384() test. */
 #if 0
 static void
@@ -306,6 +402,7 @@ main(int argc, char *argv[])
 	BUG_ON(ttls_mpool_init());
 
 	ecp_mul();
+	ecp_x25519();
 	//ecp_mod256();
 
 	ttls_mpool_exit();
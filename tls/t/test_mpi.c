@@ -547,6 +547,8 @@ mpi_big(void)
 	ttls_mpi_mod_mpi(V, V, N);
 	EXPECT_ZERO(ttls_mpi_exp_mod(X, A, E, N, V));
 	EXPECT_TRUE(ttls_mpi_cmp_mpi(X, U) == 0);
+	EXPECT_ZERO(ttls_mpi_exp_mod_fw(X, A, E, N, V));
+	EXPECT_TRUE(ttls_mpi_cmp_mpi(X, U) == 0);
 
 	ttls_mpi_read_binary(U, "\x00\x3A\x0A\xAE\xDD\x7E\x78\x4F"
 				"\xC0\x7D\x8F\x9E\xC6\xE3\xBF\xD5"
@@ -572,6 +574,50 @@ mpi_big(void)
 #undef GCD_PAIR_COUNT
 }
 
+/*
+ * Montgomery squaring and the fixed-window exponentiation must give the same
+ * results as the generic multiplication and the sliding window for random
+ * moduli up to the 2048-bit CRT primes of RSA-4096 keys. The exponentiations
+ * get short intermediate values, which are copied to uninitialized limbs.
+ */
+static void
+mpi_montsqr(void)
+{
+	size_t n;
+	unsigned long mm;
+	TlsMpi *N, *A, *B, *E, *T, *RR;
+
+	N = ttls_mpi_alloc_stack_init(33);
+	A = ttls_mpi_alloc_stack_init(34);
+	B = ttls_mpi_alloc_stack_init(34);
+	E = ttls_mpi_alloc_stack_init(33);
+	T = ttls_mpi_alloc_stack_init(68);
+	RR = ttls_mpi_alloc_stack_init(68);
+
+	for (n = 1; n <= 33; n++) {
+		ttls_mpi_fill_random(N, n * CIL);
+		MPI_P(N)[0] |= 1;
+		MPI_P(N)[n - 1] |= 1UL << (BIL - 1);
+		__mpi_montg_init(&mm, N);
+
+		ttls_mpi_fill_random(A, n * CIL);
+		ttls_mpi_mod_mpi(A, A, N);
+		ttls_mpi_copy(B, A);
+
+		EXPECT_ZERO(__mpi_montmul(A, B, N, mm, T));
+		EXPECT_ZERO(__mpi_montsqr(B, N, mm, T));
+		EXPECT_ZERO(ttls_mpi_cmp_mpi(A, B));
+
+		ttls_mpi_fill_random(E, n * CIL);
+		ttls_mpi_reset(RR);
+		EXPECT_ZERO(ttls_mpi_exp_mod(A, B, E, N, RR));
+		EXPECT_ZERO(ttls_mpi_exp_mod_fw(T, B, E, N, RR));
+		EXPECT_ZERO(ttls_mpi_cmp_mpi(A, T));
+	}
+
+	ttls_mpi_pool_cleanup_ctx((unsigned long)N, true);
+}
+
 int
 main(int argc, char *argv[])
 {
@@ -589,6 +635,7 @@ main(int argc, char *argv[])
 	mpi_consts();
 	mpi_mul_div_simple();
 	mpi_big();
+	mpi_montsqr();
 
 	ttls_mpool_exit();
 
@@ -56,6 +56,13 @@ ttls_ecp_group_load(TlsEcpGrp *grp, ttls_ecp_group_id id)
 	BUG();
 }
 
+void
+ttls_x25519(unsigned long r[4], const unsigned long k[4],
+	    const unsigned long u[4])
+{
+	BUG();
+}
+
 TlsEcpPoint *
 ttls_mpool_ecp_create_tmp_T(int n, const TlsEcpPoint *P)
 {
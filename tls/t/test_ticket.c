@@ -0,0 +1,432 @@
+/**
+ *		Tempesta TLS session tickets unit test
+ *
+ * Copyright (C) 2020 Tempesta Technologies, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+#include "ttls_mocks.h"
+
+/*
+ * The hash mocks return zero digests, but the shared keys must depend on the
+ * secret and the rotation period, so emulate HMAC for the keys derivation.
+ */
+#define ttls_md_hmac_starts	test_hmac_starts
+#define ttls_md_hmac_reset	test_hmac_reset
+#define ttls_md_hmac_update	test_hmac_update
+#define ttls_md_hmac_finish	test_hmac_finish
+
+static u64 hmac_key, hmac_h;
+
+static u64
+fnv_hash(u64 h, const unsigned char *p, size_t n)
+{
+	while (n--)
+		h = (h ^ *p++) * 0x100000001b3UL;
+	return h;
+}
+
+static int
+test_hmac_starts(TlsMdCtx *ctx, const unsigned char *key, size_t keylen)
+{
+	hmac_key = hmac_h = fnv_hash(0xcbf29ce484222325UL, key, keylen);
+	return 0;
+}
+
+static int
+test_hmac_reset(TlsMdCtx *ctx)
+{
+	hmac_h = hmac_key;
+	return 0;
+}
+
+static int
+test_hmac_update(TlsMdCtx *ctx, const unsigned char *input, size_t ilen)
+{
+	hmac_h = fnv_hash(hmac_h, input, ilen);
+	return 0;
+}
+
+static int
+test_hmac_finish(TlsMdCtx *ctx, unsigned char *output)
+{
+	int i;
+
+	for (i = 0; i < 32; ++i) {
+		hmac_h = (hmac_h ^ i) * 0x100000001b3UL;
+		output[i] = hmac_h >> 56;
+	}
+	return 0;
+}
+
+#include "../tls_ticket.c"
+
+#define TICKET_LIFETIME		3600
+#define TICKET_SNI_HASH		0x5ca1ab1e0ddba11UL
+
+static const unsigned char secret1[] = "0123456789abcdef0123456789abcdef";
+static const unsigned char secret2[] = "fedcba9876543210fedcba9876543210";
+
+/*
+ * The kernel AES-GCM isn't available in user space, so emulate the AEAD
+ * transform with a keyed XOR stream and a checksum over the associated data
+ * and the ciphertext. That's enough to check that the tickets are
+ * authenticated and are bound to the key.
+ */
+struct crypto_aead {
+	unsigned int	authsize;
+	unsigned int	keylen;
+	u8		key[32];
+};
+
+const TlsCipherInfo *
+ttls_cipher_info_from_type(const ttls_cipher_type_t cipher_type)
+{
+	static struct crypto_alg alg;
+	static const TlsCipherInfo ci = {
+		.type		= TTLS_CIPHER_AES_256_GCM,
+		.key_len	= 32,
+		.alg		= &alg,
+	};
+
+	BUG_ON(cipher_type != TTLS_CIPHER_AES_256_GCM);
+
+	return &ci;
+}
+
+unsigned int
+ttls_aead_reqsize(void)
+{
+	return sizeof(struct aead_request);
+}
+
+struct crypto_aead *
+crypto_alloc_aead_atomic(struct crypto_alg *alg)
+{
+	struct crypto_aead *tfm = calloc(1, sizeof(*tfm));
+
+	return tfm ? : ERR_PTR(-ENOMEM);
+}
+
+int
+crypto_aead_setauthsize(struct crypto_aead *tfm, unsigned int authsize)
+{
+	tfm->authsize = authsize;
+	return 0;
+}
+
+int
+crypto_aead_setkey(struct crypto_aead *tfm, const u8 *key,
+		   unsigned int keylen)
+{
+	if (keylen > sizeof(tfm->key))
+		return -EINVAL;
+	memcpy(tfm->key, key, keylen);
+	tfm->keylen = keylen;
+	return 0;
+}
+
+void
+crypto_free_aead(struct crypto_aead *tfm)
+{
+	free(tfm);
+}
+
+static void
+aead_xor(struct aead_request *req, u8 *p, unsigned int n)
+{
+	unsigned int i;
+	struct crypto_aead *tfm = req->tfm;
+
+	for (i = 0; i < n; ++i)
+		p[i] ^= tfm->key[i % tfm->keylen]
+			^ req->iv[i % TTLS_TICKET_IV_LEN] ^ i;
+}
+
+static void
+aead_tag(struct aead_request *req, const u8 *p, unsigned int n, u8 *tag)
+{
+	unsigned int i;
+	struct crypto_aead *tfm = req->tfm;
+	u64 h[2] = { 0xcbf29ce484222325UL, 0x84222325cbf29ce4UL };
+
+	for (i = 0; i < tfm->keylen; ++i)
+		h[i & 1] = (h[i & 1] ^ tfm->key[i]) * 0x100000001b3UL;
+	for (i = 0; i < n; ++i)
+		h[i & 1] = (h[i & 1] ^ p[i]) * 0x100000001b3UL;
+
+	BUG_ON(tfm->authsize != sizeof(h));
+	memcpy(tag, h, sizeof(h));
+}
+
+int
+crypto_aead_encrypt(struct aead_request *req)
+{
+	u8 *p = sg_virt(req->src);
+
+	BUG_ON(req->src != req->dst);
+	BUG_ON(req->src->length < req->assoclen + req->cryptlen
+				  + req->tfm->authsize);
+
+	aead_xor(req, p + req->assoclen, req->cryptlen);
+	aead_tag(req, p, req->assoclen + req->cryptlen,
+		 p + req->assoclen + req->cryptlen);
+
+	return 0;
+}
+
+int
+crypto_aead_decrypt(struct aead_request *req)
+{
+	u8 tag[16], *p = sg_virt(req->src);
+	unsigned int n = req->cryptlen - req->tfm->authsize;
+
+	BUG_ON(req->src != req->dst);
+	BUG_ON(req->src->length < req->assoclen + req->cryptlen);
+
+	aead_tag(req, p, req->assoclen + n, tag);
+	if (memcmp(tag, p + req->assoclen + n, sizeof(tag)))
+		return -EBADMSG;
+	aead_xor(req, p + req->assoclen, n);
+
+	return 0;
+}
+
+static void
+sess_init(TlsSess *sess)
+{
+	bzero(sess, sizeof(*sess));
+	sess->start = ttls_time();
+	sess->ciphersuite = 0xC02B;
+	sess->verify_result = 0;
+	sess->etm = 1;
+	memset(sess->master, 0x5A, sizeof(sess->master));
+	sess->sni_hash = TICKET_SNI_HASH;
+}
+
+static size_t
+ticket_issue(TlsTicketCtx *ctx, const TlsSess *sess, unsigned char *buf,
+	     size_t len)
+{
+	size_t tlen;
+	uint32_t lifetime;
+
+	EXPECT_ZERO(ttls_ticket_write(ctx, sess, buf, buf + len, &tlen,
+				      &lifetime));
+	EXPECT_EQ(tlen, TTLS_TICKET_LEN);
+	EXPECT_EQ(lifetime, TICKET_LIFETIME);
+
+	return tlen;
+}
+
+static void
+ticket_roundtrip(TlsTicketCtx *ctx)
+{
+	size_t tlen;
+	TlsSess sess, res;
+	unsigned char buf[256];
+
+	sess_init(&sess);
+	tlen = ticket_issue(ctx, &sess, buf, sizeof(buf));
+	/* The state is encrypted. */
+	EXPECT_TRUE(memcmp(buf + TTLS_TICKET_AAD_LEN
+			   + offsetof(TlsTicketState, master),
+			   sess.master, sizeof(sess.master)));
+
+	bzero(&res, sizeof(res));
+	res.sni_hash = TICKET_SNI_HASH;
+	EXPECT_ZERO(ttls_ticket_parse(ctx, &res, buf, tlen));
+	EXPECT_EQ(res.start, sess.start);
+	EXPECT_EQ(res.ciphersuite, sess.ciphersuite);
+	EXPECT_EQ(res.verify_result, sess.verify_result);
+	EXPECT_EQ(res.etm, sess.etm);
+	EXPECT_ZERO(memcmp(res.master, sess.master, sizeof(res.master)));
+
+	/* Truncated tickets aren't ours. */
+	EXPECT_EQ(ttls_ticket_parse(ctx, &res, buf, tlen - 1),
+		  TTLS_ERR_BAD_INPUT_DATA);
+}
+
+static void
+ticket_expired(TlsTicketCtx *ctx)
+{
+	size_t tlen;
+	TlsSess sess, res;
+	unsigned char buf[256];
+
+	sess_init(&sess);
+	sess.start -= TICKET_LIFETIME + 1;
+	tlen = ticket_issue(ctx, &sess, buf, sizeof(buf));
+
+	bzero(&res, sizeof(res));
+	res.sni_hash = TICKET_SNI_HASH;
+	EXPECT_EQ(ttls_ticket_parse(ctx, &res, buf, tlen),
+		  TTLS_ERR_SESSION_TICKET_EXPIRED);
+	EXPECT_FALSE(res.ciphersuite);
+
+	/* A ticket for an unknown key is treated as an expired one. */
+	sess_init(&sess);
+	tlen = ticket_issue(ctx, &sess, buf, sizeof(buf));
+	buf[0] ^= 1;
+	EXPECT_EQ(ttls_ticket_parse(ctx, &res, buf, tlen),
+		  TTLS_ERR_SESSION_TICKET_EXPIRED);
+}
+
+static void
+ticket_tampered(TlsTicketCtx *ctx)
+{
+	size_t tlen, off;
+	TlsSess sess, res;
+	unsigned char buf[256];
+	/* IV, the encrypted state and the tag. */
+	const size_t offs[] = {
+		TTLS_TICKET_NAME_LEN,
+		TTLS_TICKET_AAD_LEN,
+		TTLS_TICKET_AAD_LEN + offsetof(TlsTicketState, master),
+		TTLS_TICKET_LEN - 1,
+	};
+
+	sess_init(&sess);
+	for (off = 0; off < ARRAY_SIZE(offs); ++off) {
+		tlen = ticket_issue(ctx, &sess, buf, sizeof(buf));
+		buf[offs[off]] ^= 0x80;
+
+		bzero(&res, sizeof(res));
+		res.sni_hash = TICKET_SNI_HASH;
+		EXPECT_EQ(ttls_ticket_parse(ctx, &res, buf, tlen),
+			  TTLS_ERR_INVALID_MAC);
+		EXPECT_FALSE(res.ciphersuite);
+	}
+}
+
+static void
+ticket_sni_mismatch(TlsTicketCtx *ctx)
+{
+	size_t tlen;
+	TlsSess sess, res;
+	unsigned char buf[256];
+
+	sess_init(&sess);
+	tlen = ticket_issue(ctx, &sess, buf, sizeof(buf));
+
+	bzero(&res, sizeof(res));
+	res.sni_hash = TICKET_SNI_HASH + 1;
+	EXPECT_EQ(ttls_ticket_parse(ctx, &res, buf, tlen),
+		  TTLS_ERR_SESSION_TICKET_SNI);
+	EXPECT_FALSE(res.ciphersuite);
+
+	/* The same ticket is still good for the right name. */
+	res.sni_hash = TICKET_SNI_HASH;
+	EXPECT_ZERO(ttls_ticket_parse(ctx, &res, buf, tlen));
+}
+
+static int
+ticket_parse(TlsTicketCtx *ctx, unsigned char *buf, size_t tlen)
+{
+	TlsSess res;
+
+	bzero(&res, sizeof(res));
+	res.sni_hash = TICKET_SNI_HASH;
+
+	return ttls_ticket_parse(ctx, &res, buf, tlen);
+}
+
+static void
+ticket_shared(TlsTicketCtx *rnd)
+{
+	size_t tlen;
+	TlsSess sess;
+	TlsTicketCtx a, b, c;
+	unsigned char buf[256];
+
+	ttls_ticket_init(&a);
+	ttls_ticket_init(&b);
+	ttls_ticket_init(&c);
+	EXPECT_ZERO(ttls_ticket_setup(&a, TICKET_LIFETIME, secret1,
+				      sizeof(secret1) - 1));
+	EXPECT_ZERO(ttls_ticket_setup(&b, TICKET_LIFETIME, secret1,
+				      sizeof(secret1) - 1));
+	EXPECT_ZERO(ttls_ticket_setup(&c, TICKET_LIFETIME, secret2,
+				      sizeof(secret2) - 1));
+
+	/* The nodes sharing the secret resume each other's sessions. */
+	sess_init(&sess);
+	tlen = ticket_issue(&a, &sess, buf, sizeof(buf));
+	EXPECT_ZERO(ticket_parse(&b, buf, tlen));
+	EXPECT_EQ(ticket_parse(&c, buf, tlen),
+		  TTLS_ERR_SESSION_TICKET_EXPIRED);
+	EXPECT_EQ(ticket_parse(rnd, buf, tlen),
+		  TTLS_ERR_SESSION_TICKET_EXPIRED);
+
+	/* The random keys aren't shared. */
+	tlen = ticket_issue(rnd, &sess, buf, sizeof(buf));
+	EXPECT_EQ(ticket_parse(&a, buf, tlen),
+		  TTLS_ERR_SESSION_TICKET_EXPIRED);
+
+	/*
+	 * The reconfiguration with the same secret keeps the keys, while a new
+	 * secret replaces them.
+	 */
+	tlen = ticket_issue(&b, &sess, buf, sizeof(buf));
+	EXPECT_ZERO(ttls_ticket_setup(&a, TICKET_LIFETIME, secret1,
+				      sizeof(secret1) - 1));
+	EXPECT_ZERO(ticket_parse(&a, buf, tlen));
+	EXPECT_ZERO(ttls_ticket_setup(&c, TICKET_LIFETIME, secret1,
+				      sizeof(secret1) - 1));
+	EXPECT_ZERO(ticket_parse(&c, buf, tlen));
+	EXPECT_ZERO(ttls_ticket_setup(&a, TICKET_LIFETIME, secret2,
+				      sizeof(secret2) - 1));
+	EXPECT_EQ(ticket_parse(&a, buf, tlen),
+		  TTLS_ERR_SESSION_TICKET_EXPIRED);
+
+	/* The random keys are generated again instead of the shared ones. */
+	EXPECT_ZERO(ttls_ticket_setup(&c, TICKET_LIFETIME, NULL, 0));
+	EXPECT_EQ(ticket_parse(&c, buf, tlen),
+		  TTLS_ERR_SESSION_TICKET_EXPIRED);
+	EXPECT_FALSE(c.shared);
+
+	ttls_ticket_free(&a);
+	ttls_ticket_free(&b);
+	ttls_ticket_free(&c);
+}
+
+int
+main(int argc, char *argv[])
+{
+	TlsTicketCtx ctx;
+	TlsTicketStat stat;
+
+	BUG_ON(ttls_ticket_modinit());
+	ttls_ticket_init(&ctx);
+	EXPECT_ZERO(ttls_ticket_setup(&ctx, TICKET_LIFETIME, NULL, 0));
+
+	ticket_roundtrip(&ctx);
+	ticket_expired(&ctx);
+	ticket_tampered(&ctx);
+	ticket_sni_mismatch(&ctx);
+	ticket_shared(&ctx);
+
+	ttls_ticket_stat(&stat);
+	EXPECT_EQ(stat.issued, 11);
+	EXPECT_EQ(stat.resumed, 5);
+	EXPECT_EQ(stat.rejected, 13);
+
+	ttls_ticket_free(&ctx);
+	ttls_ticket_modexit();
+
+	printf("success\n");
+
+	return 0;
+}
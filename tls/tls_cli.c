@@ -3,6 +3,13 @@
  *
  * TLS client-side functions.
  *
+ * The code isn't built until the TLS connections to the upstream servers are
+ * implemented, see TODO #769. The client handshakes to the upstreams should
+ * be resumed: cache the last session ID or ticket (RFC 5077) received from
+ * each server in the server's TLS context, so that a new connection made by
+ * tfw_sock_srv_connect_try() sends it in ClientHello via ttls_set_session(),
+ * and account the full and the resumed handshakes per server group.
+ *
  * Based on mbed TLS, https://tls.mbed.org.
  *
  * Copyright (C) 2006-2015, ARM Limited, All Rights Reserved
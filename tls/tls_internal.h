@@ -88,9 +88,18 @@
  *  explicit IV  handshake header    hash      tag
  *  -----------  ----------------  --------  --------
  *    8 bytes        4 bytes       12 bytes  16 bytes
+ *
+ * This is the maximum, ttls_finished_len() returns the actual length for
+ * the current cipher suite.
  */
 #define TTLS_HS_FINISHED_BODY_LEN	40
 
+/*
+ * Maximum length of a session ticket to resume, longer tickets can't be
+ * issued by us, so they're ignored.
+ */
+#define TTLS_HS_TICKET_MAX_LEN		128
+
 /*
  * Abstraction for a grid of allowed signature-hash-algorithm pairs.
  *
@@ -113,6 +122,32 @@ typedef struct {
 	unsigned int ecdsa;
 } TlsSigHashSet;
 
+/**
+ * Server flight waiting for the ServerKeyExchange signature computed by
+ * ttls_hs_sign().
+ *
+ * @sg		- the flight records written before ServerKeyExchange;
+ * @nents	- number of used entries in @sg;
+ * @pg		- the page the flight is written to;
+ * @p		- ServerKeyExchange record in @pg;
+ * @n		- ServerKeyExchange body length before the signature;
+ * @sig_len	- length of the signature;
+ * @err		- the signing error code;
+ * @md_alg	- hash algorithm for the signature;
+ * @hash	- hash of the key exchange parameters to sign;
+ */
+typedef struct {
+	struct scatterlist	sg[MAX_SKB_FRAGS];
+	unsigned int		nents;
+	struct page		*pg;
+	unsigned char		*p;
+	size_t			n;
+	size_t			sig_len;
+	int			err;
+	ttls_md_type_t		md_alg;
+	unsigned char		hash[64];
+} TlsHsFlight;
+
 /*
  * This structure contains the parameters only needed during handshake.
  *
@@ -126,8 +161,13 @@ typedef struct {
  * @new_session_ticket - use NewSessionTicket?
  * @resume	- session resume indicator;
  * @cli_exts	- client extension presence;
+ * @status_request - staple OCSP response (RFC 6066 8)?
  * @pmslen	- premaster length;
  * @key_cert	- chosen key/cert pair (server);
+ * @flight	- the server flight while ServerKeyExchange is being signed;
+ * @ticket_len	- length of @ticket, zero if there is no ticket to resume;
+ * @ticket	- session ticket from ClientHello, it's parsed once the server
+ *		  name is known, since the ticket is bound to the name;
  * @fin_sha{256,512} - checksum contexts;
  * @tmp_sha256	- temporal checksum buffer to handle both the checksum types on
  *		  early handhsahe steps;
@@ -150,10 +190,14 @@ struct tls_handshake_t {
 					resume			: 1,
 					cli_exts		: 1,
 					curves_ext		: 1,
-					secure_renegotiation	: 1;
+					secure_renegotiation	: 1,
+					status_request		: 1;
 
 	size_t				pmslen;
 	TlsKeyCert			*key_cert;
+	TlsHsFlight			*flight;
+	unsigned char			ticket_len;
+	unsigned char			ticket[TTLS_HS_TICKET_MAX_LEN];
 
 	void (*calc_verify)(TlsCtx *, unsigned char *);
 	void (*calc_finished)(TlsCtx *, unsigned char *, int);
@@ -254,17 +298,13 @@ int ttls_check_sig_hash(const TlsCtx *tls, ttls_md_type_t md);
 int ttls_match_sig_hashes(const TlsCtx *tls);
 void ttls_update_checksum(TlsCtx *tls, const unsigned char *buf, size_t len);
 
-static inline ttls_x509_crt *
-ttls_own_cert(TlsCtx *tls)
+static inline TlsKeyCert *
+ttls_own_key_cert(TlsCtx *tls)
 {
-	TlsKeyCert *key_cert;
-
 	if (tls->hs && tls->hs->key_cert)
-		key_cert = tls->hs->key_cert;
-	else
-		key_cert = tls->peer_conf ? tls->peer_conf->key_cert : NULL;
+		return tls->hs->key_cert;
 
-	return key_cert ? key_cert->cert : NULL;
+	return tls->peer_conf ? tls->peer_conf->key_cert : NULL;
 }
 
 /*
@@ -332,6 +372,7 @@ enum {
 	TTLS_HANDSHAKE_OVER		= __TTLS_FSM_ST(14),
 	TTLS_SERVER_NEW_SESSION_TICKET	= __TTLS_FSM_ST(15),
 	TTLS_SERVER_HELLO_VERIFY_REQUEST_SENT = __TTLS_FSM_ST(16),
+	TTLS_SERVER_KEY_EXCHANGE_SIGN	= __TTLS_FSM_ST(17),
 };
 
 /*
@@ -397,6 +438,14 @@ ttls_substate(const TlsCtx *tls)
 	return tls->state & __TTLS_FSM_SUBST_MASK;
 }
 
+/* Length of the encrypted Finished message body. */
+static inline unsigned int
+ttls_finished_len(const TlsXfrm *xfrm)
+{
+	return ttls_expiv_len(xfrm) + TTLS_HS_HDR_LEN + TLS_HASH_LEN
+	       + ttls_xfrm_taglen(xfrm);
+}
+
 #if defined(DEBUG) && DEBUG == 3
 /*
  * Make the things repeatable, simple and INSECURE on largest debug level -
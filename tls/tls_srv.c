@@ -22,6 +22,8 @@
  * with this program; if not, write to the Free Software Foundation, Inc.,
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
+#include <linux/ctype.h>
+
 #include "lib/str.h"
 #include "ecp.h"
 #include "mpool.h"
@@ -29,6 +31,7 @@
 #include "ttls.h"
 
 ttls_sni_cb_t *ttls_sni_cb;
+ttls_sign_cb_t *ttls_sign_cb;
 
 static int
 ttls_check_scsvs(TlsCtx *tls, unsigned short cipher_suite)
@@ -51,6 +54,21 @@ ttls_check_scsvs(TlsCtx *tls, unsigned short cipher_suite)
 	return 0;
 }
 
+/**
+ * FNV-1a hash of the server name @name of @len bytes, the name is case
+ * insensitive. Zero is reserved for connections w/o SNI.
+ */
+static unsigned long
+ttls_sni_hash(const unsigned char *name, size_t len)
+{
+	unsigned long h = 0xcbf29ce484222325UL;
+
+	while (len--)
+		h = (h ^ tolower(*name++)) * 0x100000001b3UL;
+
+	return h ? : 1;
+}
+
 static int
 ttls_parse_servername_ext(TlsCtx *tls, const unsigned char *buf, size_t len)
 {
@@ -83,8 +101,11 @@ ttls_parse_servername_ext(TlsCtx *tls, const unsigned char *buf, size_t len)
 			return TTLS_ERR_BAD_HS_CLIENT_HELLO;
 		}
 		if (p[0] == TTLS_TLS_EXT_SERVERNAME_HOSTNAME) {
-			if (!ttls_sni_cb(tls, p + 3, hostname_len))
+			if (!ttls_sni_cb(tls, p + 3, hostname_len)) {
+				tls->sess.sni_hash =
+					ttls_sni_hash(p + 3, hostname_len);
 				return 0;
+			}
 			T_WARN("TLS: server requested by client is not known.\n");
 			ttls_send_alert(tls, TTLS_ALERT_LEVEL_FATAL,
 					TTLS_ALERT_MSG_UNRECOGNIZED_NAME);
@@ -256,12 +277,35 @@ ttls_parse_extended_ms_ext(TlsCtx *tls, const unsigned char *buf, size_t len)
 	return 0;
 }
 
+/**
+ * RFC 6066 8: status_type (1 byte), responder_id_list (2-byte length) and
+ * request_extensions (2-byte length). We staple the same OCSP response for
+ * all the clients, so we don't care about the responders and extensions.
+ */
 static int
-ttls_parse_session_ticket_ext(TlsCtx *tls, unsigned char *buf, size_t len)
+ttls_parse_status_request_ext(TlsCtx *tls, const unsigned char *buf,
+			      size_t len)
 {
-	int r;
-	TlsSess session;
+	if (len < 5) {
+		T_DBG("ClientHello: bad status request extension\n");
+		ttls_send_alert(tls, TTLS_ALERT_LEVEL_FATAL,
+				TTLS_ALERT_MSG_DECODE_ERROR);
+		return TTLS_ERR_BAD_HS_CLIENT_HELLO;
+	}
+
+	if (buf[0] == TTLS_CERT_STATUS_OCSP)
+		tls->hs->status_request = 1;
 
+	return 0;
+}
+
+/**
+ * Save the session ticket @buf of @len bytes to resume the session, when the
+ * server name is known, in ttls_resume_ticket().
+ */
+static int
+ttls_parse_session_ticket_ext(TlsCtx *tls, unsigned char *buf, size_t len)
+{
 	if (!tls->conf->f_ticket_parse || !tls->conf->f_ticket_write)
 		return 0;
 
@@ -270,21 +314,48 @@ ttls_parse_session_ticket_ext(TlsCtx *tls, unsigned char *buf, size_t len)
 
 	T_DBG("ClientHello: ticket length: %lu\n", len);
 
-	if (!len)
+	if (len > sizeof(tls->hs->ticket)) {
+		T_DBG("ClientHello: ticket is too long\n");
 		return 0;
+	}
+	memcpy_fast(tls->hs->ticket, buf, len);
+	tls->hs->ticket_len = len;
+
+	return 0;
+}
+
+/**
+ * Resume the session from the ticket saved from ClientHello. The ticket
+ * must be issued for the same server name, RFC 6066 3, so @tls->sess.sni_hash
+ * is passed to the ticket parser for the check.
+ */
+static void
+ttls_resume_ticket(TlsCtx *tls)
+{
+	int r;
+	TlsSess session;
+
+	if (!tls->hs->ticket_len)
+		return;
 
 	/* Failures are ok: just ignore the ticket and proceed. */
 	bzero_fast(&session, sizeof(session));
-	r = tls->conf->f_ticket_parse(tls->conf->p_ticket, &session, buf, len);
+	session.sni_hash = tls->sess.sni_hash;
+	r = tls->conf->f_ticket_parse(tls->conf->p_ticket, &session,
+				      tls->hs->ticket, tls->hs->ticket_len);
+	bzero_fast(tls->hs->ticket, tls->hs->ticket_len);
+	tls->hs->ticket_len = 0;
 	if (r) {
 		bzero_fast(&session, sizeof(session));
 		if (r == TTLS_ERR_INVALID_MAC)
 			T_DBG("ClientHello: ticket is not authentic\n");
 		else if (r == TTLS_ERR_SESSION_TICKET_EXPIRED)
 			T_DBG("ClientHello: ticket is expired");
+		else if (r == TTLS_ERR_SESSION_TICKET_SNI)
+			T_DBG("ClientHello: ticket is for another server\n");
 		else
 			T_DBG("ClientHello: cannot parse ticket, %d\n", r);
-		return 0;
+		return;
 	}
 
 	/*
@@ -303,8 +374,6 @@ ttls_parse_session_ticket_ext(TlsCtx *tls, unsigned char *buf, size_t len)
 	tls->hs->resume = 1;
 	/* Don't send a new ticket after all, this one is OK */
 	tls->hs->new_session_ticket = 0;
-
-	return 0;
 }
 
 static int
@@ -541,26 +610,64 @@ ttls_ciphersuite_match(TlsCtx *tls, int suite_id, const TlsCiphersuite **ci)
 	return 0;
 }
 
+static bool
+ttls_ciphersuite_chachapoly(int id)
+{
+	const TlsCiphersuite *ci = ttls_ciphersuite_from_id(id);
+
+	return ci && ci->cipher == TTLS_CIPHER_CHACHA20_POLY1305;
+}
+
+/**
+ * @return true if the first cipher suite known to us in the ClientHello is
+ * ChaCha20-Poly1305, i.e. GREASE and TLS 1.3 suites are skipped.
+ */
+static bool
+ttls_client_prefers_chachapoly(const TlsHandshake *hs, unsigned int cs_cnt)
+{
+	const unsigned short *cs;
+
+	for (cs = hs->css; cs < hs->css + cs_cnt; cs++)
+		if (ttls_ciphersuite_from_id(*cs))
+			return ttls_ciphersuite_chachapoly(*cs);
+
+	return false;
+}
+
+/**
+ * Our ciphersuites preference is used, but clients w/o AES acceleration put
+ * ChaCha20-Poly1305 suites first, so they're chosen first for such clients.
+ */
 static int
 ttls_choose_ciphersuite(TlsCtx *tls)
 {
-	int r, i, got_common_suite = 0;
+	int r, i, pass, got_common_suite = 0;
 	const int *ciphersuites = tls->peer_conf->ciphersuite_list[tls->minor];
 	const TlsCiphersuite *ci = NULL;
 	const unsigned short *cs;
 	unsigned int cs_cnt = tls->hs->cs_total_len / 2;
 
-	for (i = 0; ciphersuites[i] != 0; i++)
-		for (cs = tls->hs->css; cs < tls->hs->css + cs_cnt; cs++) {
-			if (*cs != ciphersuites[i])
+	pass = !ttls_client_prefers_chachapoly(tls->hs, cs_cnt);
+	for ( ; pass < 2; ++pass) {
+		for (i = 0; ciphersuites[i] != 0; i++) {
+			if (!pass
+			    && !ttls_ciphersuite_chachapoly(ciphersuites[i]))
 				continue;
-			got_common_suite = 1;
-			r = ttls_ciphersuite_match(tls, ciphersuites[i], &ci);
-			if (r)
-				return r;
-			if (ci)
-				goto have_ciphersuite;
+			for (cs = tls->hs->css; cs < tls->hs->css + cs_cnt;
+			     cs++)
+			{
+				if (*cs != ciphersuites[i])
+					continue;
+				got_common_suite = 1;
+				r = ttls_ciphersuite_match(tls, ciphersuites[i],
+							   &ci);
+				if (r)
+					return r;
+				if (ci)
+					goto have_ciphersuite;
+			}
 		}
+	}
 
 	if (got_common_suite) {
 		T_WARN("None of the common ciphersuites is usable"
@@ -972,6 +1079,11 @@ ttls_parse_client_hello(TlsCtx *tls, unsigned char *buf, size_t len,
 			if (ttls_parse_extended_ms_ext(tls, tmp, ext_sz))
 				return TTLS_ERR_BAD_HS_CLIENT_HELLO;
 			break;
+		case TTLS_TLS_EXT_STATUS_REQUEST:
+			T_DBG("found status request extension\n");
+			if (ttls_parse_status_request_ext(tls, tmp, ext_sz))
+				return TTLS_ERR_BAD_HS_CLIENT_HELLO;
+			break;
 		case TTLS_TLS_EXT_SESSION_TICKET:
 			T_DBG("found session ticket extension\n");
 			if (ttls_parse_session_ticket_ext(tls, tmp, ext_sz))
@@ -1026,6 +1138,7 @@ ttls_parse_client_hello(TlsCtx *tls, unsigned char *buf, size_t len,
 			return -TTLS_ERR_BAD_HS_CLIENT_HELLO;
 		}
 	}
+	ttls_resume_ticket(tls);
 	/*
 	 * Server TLS configuration is found, match it with client capabilities.
 	 */
@@ -1111,6 +1224,33 @@ ttls_write_session_ticket_ext(TlsCtx *tls, unsigned char *p, size_t *olen)
 	*olen = 4;
 }
 
+/**
+ * RFC 6066 8: an empty status_request extension confirms that we send
+ * CertificateStatus right after Certificate, so send it only if we have
+ * an OCSP response for the chosen certificate.
+ */
+static void
+ttls_write_status_request_ext(TlsCtx *tls, unsigned char *p, size_t *olen)
+{
+	TlsHandshake *hs = tls->hs;
+
+	if (!hs->status_request || hs->resume || !hs->key_cert
+	    || !hs->key_cert->ocsp)
+	{
+		hs->status_request = 0;
+		*olen = 0;
+		return;
+	}
+
+	T_DBG("ServerHello: adding status request extension\n");
+
+	*(unsigned short *)p = htons(TTLS_TLS_EXT_STATUS_REQUEST);
+	p[2] = 0x00;
+	p[3] = 0x00;
+
+	*olen = 4;
+}
+
 static void
 ttls_write_supported_point_formats_ext(TlsCtx *tls, unsigned char *p,
 				       size_t *olen)
@@ -1257,6 +1397,8 @@ ttls_write_server_hello(TlsCtx *tls, struct sg_table *sgt,
 	ext_len += olen;
 	ttls_write_session_ticket_ext(tls, p + 2 + ext_len, &olen);
 	ext_len += olen;
+	ttls_write_status_request_ext(tls, p + 2 + ext_len, &olen);
+	ext_len += olen;
 	ttls_write_supported_point_formats_ext(tls, p + 2 + ext_len, &olen);
 	ext_len += olen;
 	ttls_write_alpn_ext(tls, p + 2 + ext_len, &olen);
@@ -1286,6 +1428,54 @@ ttls_write_server_hello(TlsCtx *tls, struct sg_table *sgt,
 	return 0;
 }
 
+/**
+ * Sign the key exchange parameters @hash and write the signature with its
+ * length to @p.
+ */
+static int
+ttls_sign_server_key_exchange(TlsHandshake *hs, unsigned char *p,
+			      ttls_md_type_t md_alg, const unsigned char *hash,
+			      size_t *sig_len)
+{
+	int r;
+
+	r = ttls_pk_sign(hs->key_cert->key, md_alg, hash, 0, p + 2, sig_len);
+	if (r) {
+		T_DBG("cannot sign the digest, %d\n", r);
+		return r;
+	}
+	p[0] = (unsigned char)(*sig_len >> 8);
+	p[1] = (unsigned char)(*sig_len);
+
+	T_DBG3_BUF("my signature", p + 2, *sig_len);
+	WARN_ON_ONCE(*sig_len > 512);
+
+	return 0;
+}
+
+/**
+ * Add the handshake header to ServerKeyExchange of @n bytes body at @in_buf
+ * and add the record.
+ */
+static void
+ttls_add_server_key_exchange(TlsCtx *tls, struct sg_table *sgt,
+			     unsigned char **in_buf, size_t n)
+{
+	TlsIOCtx *io = &tls->io_out;
+	unsigned char *hdr = *in_buf;
+
+	WARN_ON_ONCE(n > 1015);
+	io->msglen = TTLS_HS_HDR_LEN + n;
+	ttls_write_hshdr(TTLS_HS_SERVER_KEY_EXCHANGE, hdr + TLS_HEADER_SIZE,
+			 TTLS_HS_HDR_LEN + n);
+
+	*in_buf = hdr + TLS_HEADER_SIZE + TTLS_HS_HDR_LEN + n;
+	sg_set_buf(&sgt->sgl[sgt->nents++], hdr,
+		   TLS_HEADER_SIZE + TTLS_HS_HDR_LEN + n);
+	get_page(virt_to_page(hdr));
+	__ttls_add_record(tls, sgt, sgt->nents - 1, hdr);
+}
+
 /**
  * This is the latest phase of TLS handshake when we must allocate a key
  * exchange context. We use prepared MPI memory profiles to do only stream
@@ -1302,8 +1492,8 @@ ttls_write_server_key_exchange(TlsCtx *tls, struct sg_table *sgt,
 	ttls_pk_type_t sig_alg;
 	ttls_md_type_t md_alg;
 	const TlsCiphersuite *ci = tls->xfrm.ciphersuite_info;
-	TlsIOCtx *io = &tls->io_out;
 	TlsHandshake *hs = tls->hs;
+	TlsHsFlight *fl;
 	unsigned char *dig_signed, *p, *hdr = *in_buf;
 	unsigned char hash[64];
 
@@ -1438,31 +1628,52 @@ ttls_write_server_key_exchange(TlsCtx *tls, struct sg_table *sgt,
 	*(p++) = ttls_sig_from_pk_alg(sig_alg);
 	n += 2;
 
-	r = ttls_pk_sign(hs->key_cert->key, md_alg, hash, hashlen,
-			 p + 2, &sig_len);
-	if (r) {
-		T_DBG("cannot sign the digest, %d\n", r);
-		return r;
+	/*
+	 * The signature is the most expensive part of a full handshake, so
+	 * it can be computed by ttls_hs_sign() out of softirq on another CPU
+	 * to not delay data traffic on the current CPU under a handshake
+	 * flood. Leave @in_buf intact: the flight is finished and sent by
+	 * ttls_hs_sign_resume(). If we can't save the flight, then just sign
+	 * it here.
+	 */
+	if (tls->conf->sign_async && (fl = kmalloc(sizeof(*fl), GFP_ATOMIC))) {
+		fl->p = hdr;
+		fl->n = n;
+		fl->sig_len = 0;
+		fl->err = 0;
+		fl->md_alg = md_alg;
+		memcpy(fl->hash, hash, sizeof(hash));
+		hs->flight = fl;
+		return 0;
 	}
-	*(p++) = (unsigned char)(sig_len >> 8);
-	*(p++) = (unsigned char)(sig_len);
-	n += 2;
 
-	T_DBG3_BUF("my signature", p, sig_len);
-	n += sig_len;
-	WARN_ON_ONCE(sig_len > 512);
+	if ((r = ttls_sign_server_key_exchange(hs, p, md_alg, hash, &sig_len)))
+		return r;
 
 	/* Done with actual work; add handshake header and add the record. */
-	WARN_ON_ONCE(n > 1015);
-	io->msglen = TTLS_HS_HDR_LEN + n;
-	ttls_write_hshdr(TTLS_HS_SERVER_KEY_EXCHANGE, hdr + TLS_HEADER_SIZE,
-			 TTLS_HS_HDR_LEN + n);
+	ttls_add_server_key_exchange(tls, sgt, in_buf, n + 2 + sig_len);
 
-	*in_buf = hdr + TLS_HEADER_SIZE + TTLS_HS_HDR_LEN + n;
-	sg_set_buf(&sgt->sgl[sgt->nents++], hdr,
-		   TLS_HEADER_SIZE + TTLS_HS_HDR_LEN + n);
-	get_page(virt_to_page(hdr));
-	__ttls_add_record(tls, sgt, sgt->nents - 1, hdr);
+	return 0;
+}
+
+/**
+ * Finish ServerKeyExchange signed by ttls_hs_sign(). The saved flight
+ * context is freed and the flight pages are owned by the caller.
+ */
+static int
+ttls_write_server_key_exchange_sig(TlsCtx *tls, struct sg_table *sgt,
+				   unsigned char **in_buf)
+{
+	TlsHsFlight *fl = tls->hs->flight;
+	size_t n = fl->n + 2 + fl->sig_len;
+	int r = fl->err;
+
+	tls->hs->flight = NULL;
+	kfree(fl);
+	if (r)
+		return r;
+
+	ttls_add_server_key_exchange(tls, sgt, in_buf, n);
 
 	return 0;
 }
@@ -1606,6 +1817,45 @@ ttls_write_certificate_request(TlsCtx *tls, struct sg_table *sgt,
 	return 0;
 }
 
+/**
+ * Staple the OCSP response for our certificate (RFC 6066 8). The response
+ * is loaded from user space along with the certificate and is sent in
+ * zero-copy manner, so the handshake never waits for an OCSP responder.
+ */
+static int
+ttls_write_certificate_status(TlsCtx *tls, struct sg_table *sgt,
+			      unsigned char **in_buf)
+{
+	TlsIOCtx *io = &tls->io_out;
+	TlsKeyCert *key_cert = tls->hs->key_cert;
+	unsigned char *p = *in_buf;
+	unsigned int sg_i;
+
+	if (!tls->hs->status_request)
+		return 0;
+	if (unlikely(sgt->nents + 2 > MAX_SKB_FRAGS)) {
+		T_WARN("Too many frags for CertificateStatus\n");
+		return -ENOSPC;
+	}
+
+	T_DBG("sending CertificateStatus\n");
+
+	io->msglen = TTLS_HS_HDR_LEN + key_cert->ocsp_len;
+	ttls_write_hshdr(TTLS_HS_CERTIFICATE_STATUS, p + TLS_HEADER_SIZE,
+			 io->msglen);
+
+	*in_buf += TLS_HEADER_SIZE + TTLS_HS_HDR_LEN;
+	sg_i = sgt->nents++;
+	sg_set_buf(&sgt->sgl[sg_i], p, *in_buf - p);
+	get_page(virt_to_page(p));
+	sg_set_buf(&sgt->sgl[sgt->nents++], key_cert->ocsp, key_cert->ocsp_len);
+	get_page(virt_to_page(key_cert->ocsp));
+
+	__ttls_add_record(tls, sgt, sg_i, p);
+
+	return 0;
+}
+
 static int
 ttls_write_server_hello_done(TlsCtx *tls, struct sg_table *sgt,
 			     unsigned char **in_buf)
@@ -1941,13 +2191,22 @@ ttls_handshake_server_hello(TlsCtx *tls)
 	struct scatterlist sg[MAX_SKB_FRAGS];
 	struct sg_table sgt = { .sgl = sg };
 	struct page *pg;
+	TlsHsFlight *fl = tls->hs->flight;
 	T_FSM_INIT(tls->state, "TLS Server Handshake (ServerHello)");
 
-	begin = p = pg_skb_alloc(2048, GFP_ATOMIC, NUMA_NO_NODE);
-	if (!p)
-		return -ENOMEM;
-	pg = virt_to_page(p);
-	sg_init_table(sgt.sgl, MAX_SKB_FRAGS);
+	if (fl) {
+		/* Continue the flight signed by ttls_hs_sign(). */
+		memcpy(sg, fl->sg, sizeof(sg));
+		sgt.nents = fl->nents;
+		begin = p = fl->p;
+		pg = fl->pg;
+	} else {
+		begin = p = pg_skb_alloc(2048, GFP_ATOMIC, NUMA_NO_NODE);
+		if (!p)
+			return -ENOMEM;
+		pg = virt_to_page(p);
+		sg_init_table(sgt.sgl, MAX_SKB_FRAGS);
+	}
 
 	T_FSM_START(ttls_state(tls)) {
 	T_FSM_STATE(TTLS_SERVER_HELLO) {
@@ -1977,11 +2236,26 @@ ttls_handshake_server_hello(TlsCtx *tls)
 		if ((r = ttls_write_certificate(tls, &sgt, &p)))
 			T_FSM_EXIT();
 		CHECK_STATE(128);
+		if ((r = ttls_write_certificate_status(tls, &sgt, &p)))
+			T_FSM_EXIT();
+		CHECK_STATE(TLS_HEADER_SIZE + TTLS_HS_HDR_LEN);
 		T_FSM_JMP(TTLS_SERVER_KEY_EXCHANGE);
 	}
 	T_FSM_STATE(TTLS_SERVER_KEY_EXCHANGE) {
 		if ((r = ttls_write_server_key_exchange(tls, &sgt, &p)))
 			T_FSM_EXIT();
+		if ((fl = tls->hs->flight)) {
+			/*
+			 * The flight owns our page references until the
+			 * signature is ready.
+			 */
+			memcpy(fl->sg, sg, sizeof(sg));
+			fl->nents = sgt.nents;
+			fl->pg = pg;
+			tls->state = TTLS_SERVER_KEY_EXCHANGE_SIGN;
+			ttls_sign_cb(tls);
+			return 0;
+		}
 		CHECK_STATE(1024);
 		/*
 		 * RFC 5246 Certificate Request is optional, so don't request
@@ -1990,6 +2264,12 @@ ttls_handshake_server_hello(TlsCtx *tls)
 		 */
 		T_FSM_JMP(TTLS_SERVER_HELLO_DONE);
 	}
+	T_FSM_STATE(TTLS_SERVER_KEY_EXCHANGE_SIGN) {
+		if ((r = ttls_write_server_key_exchange_sig(tls, &sgt, &p)))
+			T_FSM_EXIT();
+		CHECK_STATE(1024);
+		T_FSM_JMP(TTLS_SERVER_HELLO_DONE);
+	}
 	T_FSM_STATE(TTLS_CERTIFICATE_REQUEST) {
 		if ((r = ttls_write_certificate_request(tls, &sgt, &p)))
 			T_FSM_EXIT();
@@ -2089,6 +2369,40 @@ ttls_handshake_finished(TlsCtx *tls)
 	return r;
 }
 
+/**
+ * Compute the ServerKeyExchange signature for the flight passed to the sign
+ * callback. The handshake FSM doesn't touch the flight until
+ * ttls_hs_sign_resume() is called, so tls->lock isn't required, but softirqs
+ * must be disabled to use the per-cpu MPI pools.
+ */
+void
+ttls_hs_sign(TlsCtx *tls)
+{
+	TlsHandshake *hs = tls->hs;
+	TlsHsFlight *fl = hs->flight;
+	unsigned char *p = fl->p + TLS_HEADER_SIZE + TTLS_HS_HDR_LEN + fl->n;
+
+	fl->err = ttls_sign_server_key_exchange(hs, p, fl->md_alg, fl->hash,
+						&fl->sig_len);
+
+	/* Cleanup security sensitive temporary data. */
+	ttls_mpi_pool_cleanup_ctx(0, true);
+}
+EXPORT_SYMBOL(ttls_hs_sign);
+
+/**
+ * Finish and send the server flight signed by ttls_hs_sign(), the handshake
+ * continues on the next client message. Must be called under tls->lock.
+ */
+int
+ttls_hs_sign_resume(TlsCtx *tls)
+{
+	BUG_ON(tls->state != TTLS_SERVER_KEY_EXCHANGE_SIGN || !tls->hs->flight);
+
+	return ttls_handshake_server_hello(tls);
+}
+EXPORT_SYMBOL(ttls_hs_sign_resume);
+
 /**
  * TLS handshake server side FSM, RFC 5246 chapter 7.
  */
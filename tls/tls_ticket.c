@@ -3,10 +3,13 @@
  *
  * TLS server tickets implementation (RFC 5077).
  *
- * Based on mbed TLS, https://tls.mbed.org.
+ * The ticket keeps only the fields of the session required to resume it, no
+ * certificates are stored, so the encrypted state is just 72 bytes. The
+ * ticket is protected by AES-256-GCM with the AEAD transforms set up on the
+ * key generation and with per-CPU requests, so issuing and parsing a ticket
+ * costs one AEAD operation and no memory allocations.
  *
- * Copyright (C) 2006-2015, ARM Limited, All Rights Reserved
- * Copyright (C) 2015-2018 Tempesta Technologies, Inc.
+ * Copyright (C) 2015-2020 Tempesta Technologies, Inc.
  *
  * This program is free software; you can redistribute it and/or modify
  * it under the terms of the GNU General Public License as published by
@@ -22,409 +25,579 @@
  * with this program; if not, write to the Free Software Foundation, Inc.,
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
-#if 0
+#include <crypto/aead.h>
+#include <linux/scatterlist.h>
+#include <linux/timex.h>
+
+#include "crypto.h"
+#include "tls_internal.h"
+#include "tls_ticket.h"
+
+#define TTLS_TICKET_IV_LEN		12
+#define TTLS_TICKET_KEY_LEN		32
+#define TTLS_TICKET_TAG_LEN		16
+#define TTLS_TICKET_AAD_LEN		(TTLS_TICKET_NAME_LEN		\
+					 + TTLS_TICKET_IV_LEN)
+#define TTLS_TICKET_LEN			(TTLS_TICKET_AAD_LEN		\
+					 + sizeof(TlsTicketState)	\
+					 + TTLS_TICKET_TAG_LEN)
 
-#include "ssl_ticket.h"
+/**
+ * Session state stored in a ticket.
+ *
+ * @start		- the session starting time;
+ * @verify_result	- the peer certificate verification result;
+ * @ciphersuite		- the session ciphersuite;
+ * @etm			- Encrypt-then-MAC is active;
+ * @master		- the master secret;
+ * @sni_hash		- hash of the server name the session is established
+ *			  for, the keys are shared by all the vhosts, so a
+ *			  ticket mustn't resume a session for another name;
+ */
+typedef struct {
+	u64		start;
+	u32		verify_result;
+	u16		ciphersuite;
+	u8		etm;
+	u8		__pad;
+	unsigned char	master[48];
+	u64		sni_hash;
+} __attribute__((packed)) TlsTicketState;
 
-/*
- * Initialize context
+/**
+ * Per-CPU scratch area for the ticket encryption and decryption.
+ *
+ * @buf	- the ticket: the key name, IV, the state and the tag;
+ * @req	- AEAD request, must be the last member;
  */
-void ttls_ticket_init(ttls_ticket_context *ctx)
-{
-	memset(ctx, 0, sizeof(ttls_ticket_context));
-	spin_lock_init(&ctx->mutex);
-}
+typedef struct {
+	unsigned char		buf[TTLS_TICKET_LEN];
+	struct aead_request	req;
+} TlsTicketScratch;
+
+static DEFINE_PER_CPU(TlsTicketScratch *, g_tkt_scratch);
+static DEFINE_PER_CPU(TlsTicketStat, g_tkt_stat);
 
-#define MAX_KEY_BYTES 32	/* 256 bits */
+static const unsigned char ttls_ticket_label[] = "tempesta ticket key";
 
-/*
- * Generate/update a key
- * TODO #1054 use a configuration option to generate the key with the random
- * number generator or on top of shared secret.
+/**
+ * HKDF-Extract (RFC 5869) with SHA-256 and no salt. Only the pseudorandom key
+ * @prk is kept, not the shared @secret of @len bytes itself.
  */
-static int ssl_ticket_gen_key(ttls_ticket_context *ctx,
-				   unsigned char index)
+static int
+ttls_ticket_hkdf_extract(unsigned char *prk, const unsigned char *secret,
+			 size_t len)
 {
-	int ret;
-	unsigned char buf[MAX_KEY_BYTES];
-	ttls_ticket_key *key = ctx->keys + index;
-
-	key->generation_time = (uint32_t) ttls_time();
+	int r;
+	TlsMdCtx md;
+	static const unsigned char salt[TTLS_TICKET_PRK_LEN];
 
-	ttls_rnd(key->name, sizeof(key->name));
-	ttls_rnd(buf, sizeof(buf));
+	ttls_md_init(&md);
+	r = ttls_md_setup(&md, ttls_md_info_from_type(TTLS_MD_SHA256), 1);
+	if (r)
+		return r;
 
-	/* With GCM and CCM, same context can encrypt & decrypt */
-	ret = ttls_cipher_setkey(&key->ctx, buf, key->ctx.cipher_info->key_len,
-				 TTLS_ENCRYPT);
-
-	bzero_fast(buf, sizeof(buf));
+	if (!(r = ttls_md_hmac_starts(&md, salt, sizeof(salt)))
+	    && !(r = ttls_md_hmac_update(&md, secret, len)))
+		r = ttls_md_hmac_finish(&md, prk);
+	ttls_md_free(&md);
 
-	return ret;
+	return r;
 }
 
-/*
- * Rotate/generate keys if necessary
+/**
+ * HKDF-Expand (RFC 5869) of @prk to @len bytes of @out. The info is the label
+ * and the big-endian rotation @period number, so all the nodes sharing the
+ * secret derive the same keys for the same period without any coordination.
  */
-static int ssl_ticket_update_keys(ttls_ticket_context *ctx)
+static int
+ttls_ticket_hkdf_expand(const unsigned char *prk, unsigned long period,
+			unsigned char *out, size_t len)
 {
-	if (ctx->ticket_lifetime != 0)
-	{
-		uint32_t current_time = (uint32_t) ttls_time();
-		uint32_t key_time = ctx->keys[ctx->active].generation_time;
-
-		if (current_time > key_time &&
-			current_time - key_time < ctx->ticket_lifetime)
-		{
-			return 0;
+	int r;
+	size_t n;
+	TlsMdCtx md;
+	unsigned char i, t[TTLS_TICKET_PRK_LEN];
+	__be64 info = cpu_to_be64(period);
+
+	ttls_md_init(&md);
+	r = ttls_md_setup(&md, ttls_md_info_from_type(TTLS_MD_SHA256), 1);
+	if (r)
+		return r;
+	if ((r = ttls_md_hmac_starts(&md, prk, TTLS_TICKET_PRK_LEN)))
+		goto out;
+
+	/* T(i) = HMAC(PRK, T(i - 1) | info | i), T(0) is empty. */
+	for (i = 1; len; ++i) {
+		if (i > 1) {
+			ttls_md_hmac_reset(&md);
+			ttls_md_hmac_update(&md, t, sizeof(t));
 		}
-
-		ctx->active = 1 - ctx->active;
-
-		return(ssl_ticket_gen_key(ctx, ctx->active));
+		ttls_md_hmac_update(&md, ttls_ticket_label,
+				    sizeof(ttls_ticket_label) - 1);
+		ttls_md_hmac_update(&md, (unsigned char *)&info, sizeof(info));
+		ttls_md_hmac_update(&md, &i, 1);
+		if ((r = ttls_md_hmac_finish(&md, t)))
+			goto out;
+
+		n = min_t(size_t, len, sizeof(t));
+		memcpy_fast(out, t, n);
+		out += n;
+		len -= n;
 	}
-	else
-		return 0;
+out:
+	bzero_fast(t, sizeof(t));
+	ttls_md_free(&md);
+
+	return r;
 }
 
 /**
- * Setup context for actual use.
- *
- * TODO #1054: Use strong enough, but fast, cipher, e.g. AES-GCM-256.
- * @lifetime should be configurable, and typically not so large, e.g. 2h.
+ * Allocate a key for the rotation @period of @lifetime seconds. The key name
+ * and the key are derived from the pseudorandom key @prk of the secret shared
+ * by the cluster nodes or are random if @prk is NULL.
  */
-int ttls_ticket_setup(ttls_ticket_context *ctx, ttls_cipher_type_t cipher,
-	uint32_t lifetime)
+static TlsTicketKey *
+ttls_ticket_key_alloc(const unsigned char *prk, unsigned long period,
+		      unsigned int lifetime)
 {
-	int ret;
-	const TlsCipherInfo *cipher_info;
-
-	ctx->ticket_lifetime = lifetime;
-
-	cipher_info = ttls_cipher_info_from_type(cipher);
-	if (cipher_info == NULL)
-		return(TTLS_ERR_BAD_INPUT_DATA);
-
-	if (cipher_info->mode != TTLS_MODE_GCM &&
-		cipher_info->mode != TTLS_MODE_CCM)
-	{
-		return(TTLS_ERR_BAD_INPUT_DATA);
+	int r;
+	unsigned char buf[TTLS_TICKET_NAME_LEN + TTLS_TICKET_KEY_LEN];
+	TlsTicketKey *key;
+	const TlsCipherInfo *ci;
+
+	ci = ttls_cipher_info_from_type(TTLS_CIPHER_AES_256_GCM);
+	BUG_ON(!ci || ci->key_len > TTLS_TICKET_KEY_LEN);
+
+	if (!(key = kmalloc(sizeof(*key), GFP_ATOMIC)))
+		return NULL;
+
+	key->tfm = crypto_alloc_aead_atomic(ci->alg);
+	if (IS_ERR(key->tfm))
+		goto err_free;
+	if (crypto_aead_setauthsize(key->tfm, TTLS_TICKET_TAG_LEN))
+		goto err_tfm;
+
+	if (prk) {
+		r = ttls_ticket_hkdf_expand(prk, period, buf,
+					    TTLS_TICKET_NAME_LEN + ci->key_len);
+		key->gen_time = period * lifetime;
+	} else {
+		ttls_rnd(buf, TTLS_TICKET_NAME_LEN + ci->key_len);
+		key->gen_time = ttls_time();
+		r = 0;
 	}
-
-	if (cipher_info->key_len > MAX_KEY_BYTES)
-		return(TTLS_ERR_BAD_INPUT_DATA);
-
-	/* TODO set correct auth tag size. */
-	if ((ret = ttls_cipher_setup(&ctx->keys[0].ctx, cipher_info, 16)) ||
-		(ret = ttls_cipher_setup(&ctx->keys[1].ctx, cipher_info, 16)))
-	{
-		return ret;
-	}
-
-	if ((ret = ssl_ticket_gen_key(ctx, 0)) != 0 ||
-		(ret = ssl_ticket_gen_key(ctx, 1)) != 0)
-	{
-		return ret;
+	if (!r) {
+		memcpy_fast(key->name, buf, TTLS_TICKET_NAME_LEN);
+		r = crypto_aead_setkey(key->tfm, buf + TTLS_TICKET_NAME_LEN,
+				       ci->key_len);
 	}
-
-	return 0;
+	bzero_fast(buf, sizeof(buf));
+	if (r)
+		goto err_tfm;
+
+	return key;
+err_tfm:
+	crypto_free_aead(key->tfm);
+err_free:
+	kfree(key);
+	return NULL;
 }
 
-/*
- * Serialize a session in the following format:
- *  0   .   n-1	 session structure, n = sizeof(TlsSess)
- *  n   .   n+2	 peer_cert length = m (0 if no certificate)
- *  n+3 .   n+2+m   peer cert ASN.1
- */
-static int ssl_save_session(const TlsSess *session,
-				 unsigned char *buf, size_t buf_len,
-				 size_t *olen)
+static void
+ttls_ticket_key_free(TlsTicketKey *key)
 {
-	unsigned char *p = buf;
-	size_t left = buf_len;
-	size_t cert_len;
-
-	if (left < sizeof(TlsSess))
-		return(TTLS_ERR_BUFFER_TOO_SMALL);
-
-	memcpy(p, session, sizeof(TlsSess));
-	p += sizeof(TlsSess);
-	left -= sizeof(TlsSess);
-
-	if (session->peer_cert == NULL)
-		cert_len = 0;
-	else
-		cert_len = session->peer_cert->raw.len;
-
-	if (left < 3 + cert_len)
-		return(TTLS_ERR_BUFFER_TOO_SMALL);
-
-	*p++ = (unsigned char)(cert_len >> 16 & 0xFF);
-	*p++ = (unsigned char)(cert_len >>  8 & 0xFF);
-	*p++ = (unsigned char)(cert_len	   & 0xFF);
-
-	if (session->peer_cert != NULL)
-		memcpy(p, session->peer_cert->raw.p, cert_len);
-
-	p += cert_len;
-
-	*olen = p - buf;
+	if (!key)
+		return;
+	crypto_free_aead(key->tfm);
+	bzero_fast(key->name, sizeof(key->name));
+	kfree(key);
+}
 
-	return 0;
+static void
+ttls_ticket_key_free_rcu(struct rcu_head *rcu)
+{
+	ttls_ticket_key_free(container_of(rcu, TlsTicketKey, rcu));
 }
 
-/*
- * Unserialise session, see ssl_save_session()
+/**
+ * Rotate the keys if the current key is older than the ticket @lifetime. The
+ * previous key is replaced by a new one, which becomes the current key. Only
+ * one CPU rotates the keys, while the others keep using the current key.
+ * Called under rcu_read_lock().
  */
-static int ssl_load_session(TlsSess *session,
-				 const unsigned char *buf, size_t len)
+static void
+ttls_ticket_update_keys(TlsTicketCtx *ctx, unsigned int lifetime)
 {
-	const unsigned char *p = buf;
-	const unsigned char * const end = buf + len;
-	size_t cert_len;
-
-	if (p + sizeof(TlsSess) > end)
-		return(TTLS_ERR_BAD_INPUT_DATA);
-
-	memcpy(session, p, sizeof(TlsSess));
-	p += sizeof(TlsSess);
-
-	if (p + 3 > end)
-		return(TTLS_ERR_BAD_INPUT_DATA);
-
-	cert_len = (p[0] << 16) | (p[1] << 8) | p[2];
-	p += 3;
-
-	if (cert_len == 0)
+	unsigned long period;
+	const unsigned char *prk;
+	TlsTicketKey *key, *cur, *prev, *old[2] = { NULL, NULL };
+	unsigned int a = READ_ONCE(ctx->active);
+
+	key = rcu_dereference(ctx->keys[a]);
+	if (likely(ttls_time() - key->gen_time < lifetime))
+		return;
+
+	if (!spin_trylock(&ctx->lock))
+		return;
+	if (a != ctx->active || lifetime != ctx->lifetime)
+		goto out;
+	prk = ctx->shared ? ctx->prk : NULL;
+	period = ttls_time() / lifetime;
+	if (!(key = ttls_ticket_key_alloc(prk, period, lifetime)))
+		goto out;
+
+	/*
+	 * The other nodes sharing the keys may issue tickets with the key of
+	 * the previous period, so derive it if there were no tickets for more
+	 * than a lifetime and the current key is older.
+	 */
+	cur = rcu_dereference_protected(ctx->keys[a],
+					lockdep_is_held(&ctx->lock));
+	if (prk && cur->gen_time != (period - 1) * lifetime
+	    && (prev = ttls_ticket_key_alloc(prk, period - 1, lifetime)))
 	{
-		session->peer_cert = NULL;
+		old[1] = cur;
+		rcu_assign_pointer(ctx->keys[a], prev);
 	}
-	else
-	{
-		int ret;
-
-		if (p + cert_len > end)
-			return(TTLS_ERR_BAD_INPUT_DATA);
-
-		session->peer_cert = kmalloc(sizeof(ttls_x509_crt), GFP_ATOMIC);
-
-		if (session->peer_cert == NULL)
-			return(TTLS_ERR_ALLOC_FAILED);
-
-		ttls_x509_crt_init(session->peer_cert);
+	old[0] = rcu_dereference_protected(ctx->keys[!a],
+					   lockdep_is_held(&ctx->lock));
+	rcu_assign_pointer(ctx->keys[!a], key);
+	WRITE_ONCE(ctx->active, !a);
+	spin_unlock(&ctx->lock);
+
+	T_DBG("session ticket keys rotated\n");
+
+	if (old[0])
+		call_rcu(&old[0]->rcu, ttls_ticket_key_free_rcu);
+	if (old[1])
+		call_rcu(&old[1]->rcu, ttls_ticket_key_free_rcu);
+	return;
+out:
+	spin_unlock(&ctx->lock);
+}
 
-		if ((ret = ttls_x509_crt_parse_der(session->peer_cert,
-				p, cert_len)) != 0)
-		{
-			ttls_x509_crt_free(session->peer_cert);
-			kfree(session->peer_cert);
-			session->peer_cert = NULL;
-			return ret;
-		}
+static TlsTicketKey *
+ttls_ticket_key_find(TlsTicketCtx *ctx, const unsigned char *name)
+{
+	int i;
+	TlsTicketKey *key;
 
-		p += cert_len;
+	for (i = 0; i < ARRAY_SIZE(ctx->keys); ++i) {
+		key = rcu_dereference(ctx->keys[i]);
+		if (key && !memcmp(key->name, name, TTLS_TICKET_NAME_LEN))
+			return key;
 	}
 
-	if (p != end)
-		return(TTLS_ERR_BAD_INPUT_DATA);
+	return NULL;
+}
 
-	return 0;
+/**
+ * Encrypt or decrypt, if @enc is false, the ticket in the per-CPU scratch
+ * buffer @s with @key. The key name and IV are the additional authenticated
+ * data.
+ */
+static int
+ttls_ticket_crypt(TlsTicketScratch *s, TlsTicketKey *key, bool enc)
+{
+	struct scatterlist sg;
+	unsigned char iv[TTLS_TICKET_IV_LEN];
+	struct aead_request *req = &s->req;
+
+	memcpy_fast(iv, s->buf + TTLS_TICKET_NAME_LEN, sizeof(iv));
+	sg_init_one(&sg, s->buf, sizeof(s->buf));
+
+	aead_request_set_tfm(req, key->tfm);
+	aead_request_set_callback(req, 0, NULL, NULL);
+	aead_request_set_ad(req, TTLS_TICKET_AAD_LEN);
+	if (enc) {
+		aead_request_set_crypt(req, &sg, &sg, sizeof(TlsTicketState),
+				       iv);
+		return crypto_aead_encrypt(req);
+	}
+	aead_request_set_crypt(req, &sg, &sg,
+			       sizeof(TlsTicketState) + TTLS_TICKET_TAG_LEN,
+			       iv);
+	return crypto_aead_decrypt(req);
 }
 
-/*
- * Create session ticket, with the following structure:
+/**
+ * Write a session ticket of the following structure:
  *
  *	struct {
- *		opaque key_name[4];
+ *		opaque key_name[16];
  *		opaque iv[12];
- *		opaque encrypted_state<0..2^16-1>;
+ *		opaque encrypted_state[72];
  *		opaque tag[16];
  *	} ticket;
- *
- * The key_name, iv, and length of encrypted_state are the additional
- * authenticated data.
  */
-int ttls_ticket_write(void *p_ticket,
-				  const TlsSess *session,
-				  unsigned char *start,
-				  const unsigned char *end,
-				  size_t *tlen,
-				  uint32_t *ticket_lifetime)
+int
+ttls_ticket_write(void *p_ticket, const TlsSess *sess, unsigned char *start,
+		  const unsigned char *end, size_t *tlen, uint32_t *lifetime)
 {
-	int ret;
-	ttls_ticket_context *ctx = p_ticket;
-	ttls_ticket_key *key;
-	unsigned char *key_name = start;
-	unsigned char *iv = start + 4;
-	unsigned char *state_len_bytes = iv + 12;
-	unsigned char *state = state_len_bytes + 2;
-	unsigned char *tag;
-	size_t clear_len, ciph_len;
+	int r;
+	TlsTicketKey *key;
+	TlsTicketCtx *ctx = p_ticket;
+	TlsTicketScratch *s = *this_cpu_ptr(&g_tkt_scratch);
+	TlsTicketState *st = (TlsTicketState *)(s->buf + TTLS_TICKET_AAD_LEN);
+	TlsTicketStat *stat = this_cpu_ptr(&g_tkt_stat);
+	cycles_t ts = get_cycles();
 
 	*tlen = 0;
+	*lifetime = READ_ONCE(ctx->lifetime);
+	if (!*lifetime)
+		return TTLS_ERR_BAD_INPUT_DATA;
+	if (end - start < TTLS_TICKET_LEN)
+		return TTLS_ERR_BUFFER_TOO_SMALL;
+
+	st->start = sess->start;
+	st->verify_result = sess->verify_result;
+	st->ciphersuite = sess->ciphersuite;
+	st->etm = sess->etm;
+	st->__pad = 0;
+	memcpy_fast(st->master, sess->master, sizeof(st->master));
+	st->sni_hash = sess->sni_hash;
+
+	rcu_read_lock();
+	ttls_ticket_update_keys(ctx, *lifetime);
+	key = rcu_dereference(ctx->keys[READ_ONCE(ctx->active)]);
+	memcpy_fast(s->buf, key->name, TTLS_TICKET_NAME_LEN);
+	ttls_rnd(s->buf + TTLS_TICKET_NAME_LEN, TTLS_TICKET_IV_LEN);
+	r = ttls_ticket_crypt(s, key, true);
+	rcu_read_unlock();
+
+	if (likely(!r)) {
+		memcpy_fast(start, s->buf, TTLS_TICKET_LEN);
+		*tlen = TTLS_TICKET_LEN;
+		stat->issued++;
+	}
+	bzero_fast(s->buf, sizeof(s->buf));
+	stat->write_cycles += get_cycles() - ts;
 
-	if (ctx == NULL)
-		return(TTLS_ERR_BAD_INPUT_DATA);
-
-	/* We need at least 4 bytes for key_name, 12 for IV, 2 for len 16 for tag,
-	 * in addition to session itself, that will be checked when writing it. */
-	if (end - start < 4 + 12 + 2 + 16)
-		return(TTLS_ERR_BUFFER_TOO_SMALL);
-
-	spin_lock(&ctx->mutex);
-
-	if ((ret = ssl_ticket_update_keys(ctx)) != 0)
-		goto cleanup;
-
-	key = &ctx->keys[ctx->active];
-
-	*ticket_lifetime = ctx->ticket_lifetime;
-
-	memcpy(key_name, key->name, 4);
+	return r;
+}
+EXPORT_SYMBOL(ttls_ticket_write);
 
-	ttls_rnd(iv, 12);
+/**
+ * Load the session from the ticket @buf of @len bytes, see
+ * ttls_ticket_write() for the ticket structure. The ticket is decrypted in
+ * the per-CPU buffer, so @buf isn't modified. @sess->sni_hash must be set to
+ * the hash of the server name requested by the client, the tickets issued
+ * for other names are rejected.
+ */
+int
+ttls_ticket_parse(void *p_ticket, TlsSess *sess, unsigned char *buf,
+		  size_t len)
+{
+	int r;
+	unsigned long now;
+	TlsTicketKey *key;
+	TlsTicketCtx *ctx = p_ticket;
+	TlsTicketScratch *s = *this_cpu_ptr(&g_tkt_scratch);
+	TlsTicketState *st = (TlsTicketState *)(s->buf + TTLS_TICKET_AAD_LEN);
+	TlsTicketStat *stat = this_cpu_ptr(&g_tkt_stat);
+	unsigned int lifetime = READ_ONCE(ctx->lifetime);
+	cycles_t ts = get_cycles();
+
+	if (unlikely(!lifetime || len != TTLS_TICKET_LEN)) {
+		r = TTLS_ERR_BAD_INPUT_DATA;
+		goto out;
+	}
 
-	/* Dump session state */
-	if ((ret = ssl_save_session(session,
-		  state, end - state, &clear_len)) != 0 ||
-		(unsigned long) clear_len > 65535)
-	{
-		 goto cleanup;
+	rcu_read_lock();
+	ttls_ticket_update_keys(ctx, lifetime);
+	if (!(key = ttls_ticket_key_find(ctx, buf))) {
+		rcu_read_unlock();
+		r = TTLS_ERR_SESSION_TICKET_EXPIRED;
+		goto out;
 	}
-	state_len_bytes[0] = (clear_len >> 8) & 0xff;
-	state_len_bytes[1] = (clear_len	 ) & 0xff;
-
-	/* Encrypt and authenticate */
-	tag = state + clear_len;
-	/* TODO #1054 replace with linux/crypto as in ttls.c. */
-	if ((ret = ttls_cipher_auth_encrypt(&key->ctx,
-		iv, 12, key_name, 4 + 12 + 2,
-		state, clear_len, state, &ciph_len, tag, 16)) != 0)
-	{
-		goto cleanup;
+	memcpy_fast(s->buf, buf, TTLS_TICKET_LEN);
+	r = ttls_ticket_crypt(s, key, false);
+	rcu_read_unlock();
+	if (r) {
+		r = r == -EBADMSG ? TTLS_ERR_INVALID_MAC
+				  : TTLS_ERR_BAD_INPUT_DATA;
+		goto out;
 	}
-	if (ciph_len != clear_len)
-	{
-		ret = TTLS_ERR_INTERNAL_ERROR;
-		goto cleanup;
+
+	now = ttls_time();
+	if (now < st->start || now - st->start > lifetime) {
+		r = TTLS_ERR_SESSION_TICKET_EXPIRED;
+		goto out;
+	}
+	if (st->sni_hash != sess->sni_hash) {
+		r = TTLS_ERR_SESSION_TICKET_SNI;
+		goto out;
 	}
 
-	*tlen = 4 + 12 + 2 + 16 + ciph_len;
+	sess->peer_cert = NULL;
+	sess->start = st->start;
+	sess->verify_result = st->verify_result;
+	sess->ciphersuite = st->ciphersuite;
+	sess->etm = st->etm;
+	memcpy_fast(sess->master, st->master, sizeof(sess->master));
+out:
+	if (r)
+		stat->rejected++;
+	else
+		stat->resumed++;
+	bzero_fast(s->buf, sizeof(s->buf));
+	stat->parse_cycles += get_cycles() - ts;
 
-cleanup:
-	spin_unlock(&ctx->mutex);
+	return r;
+}
+EXPORT_SYMBOL(ttls_ticket_parse);
 
-	return ret;
+void
+ttls_ticket_init(TlsTicketCtx *ctx)
+{
+	bzero_fast(ctx, sizeof(*ctx));
+	spin_lock_init(&ctx->lock);
 }
+EXPORT_SYMBOL(ttls_ticket_init);
 
-/*
- * Select key based on name
+/**
+ * Set up the tickets context @ctx or update the ticket @lifetime for the
+ * already set up context. The keys are derived from the @secret of @len bytes
+ * shared by the cluster nodes, or are random if @secret is NULL. Zero
+ * @lifetime disables issuing and resumption of the tickets, but the keys are
+ * kept to avoid the races with the handshakes in progress. Process context.
  */
-static ttls_ticket_key *ssl_ticket_select_key(
-		ttls_ticket_context *ctx,
-		const unsigned char name[4])
+int
+ttls_ticket_setup(TlsTicketCtx *ctx, unsigned int lifetime,
+		  const unsigned char *secret, size_t len)
 {
-	unsigned char i;
-
-	for (i = 0; i < sizeof(ctx->keys) / sizeof(*ctx->keys); i++)
-		if (memcmp(name, ctx->keys[i].name, 4) == 0)
-			return(&ctx->keys[i]);
+	int i, r = 0;
+	unsigned long period;
+	unsigned char prk[TTLS_TICKET_PRK_LEN] = { 0 };
+	TlsTicketKey *keys[2] = { NULL, NULL }, *old[2] = { NULL, NULL };
+	unsigned int a;
+
+	if (!lifetime) {
+		WRITE_ONCE(ctx->lifetime, 0);
+		return 0;
+	}
+	if (secret && (r = ttls_ticket_hkdf_extract(prk, secret, len)))
+		return r;
+
+	spin_lock_bh(&ctx->lock);
+	/*
+	 * The random keys survive the reconfiguration, while the shared keys
+	 * are derived again if the secret or the lifetime, defining the
+	 * rotation periods, change.
+	 */
+	if (rcu_access_pointer(ctx->keys[ctx->active])
+	    && ctx->shared == !!secret
+	    && (!secret || (lifetime == ctx->lifetime
+			    && !memcmp(prk, ctx->prk, sizeof(prk)))))
+		goto out;
+
+	/* The current and, for the shared keys, the previous period keys. */
+	period = ttls_time() / lifetime;
+	keys[0] = ttls_ticket_key_alloc(secret ? prk : NULL, period, lifetime);
+	if (secret && keys[0])
+		keys[1] = ttls_ticket_key_alloc(prk, period - 1, lifetime);
+	if (!keys[0] || (secret && !keys[1])) {
+		ttls_ticket_key_free(keys[0]);
+		r = -ENOMEM;
+		goto err;
+	}
 
-	return(NULL);
+	/* Keep the active index, so the readers never see the NULL key. */
+	a = ctx->active;
+	old[0] = rcu_dereference_protected(ctx->keys[a],
+					   lockdep_is_held(&ctx->lock));
+	old[1] = rcu_dereference_protected(ctx->keys[!a],
+					   lockdep_is_held(&ctx->lock));
+	rcu_assign_pointer(ctx->keys[a], keys[0]);
+	rcu_assign_pointer(ctx->keys[!a], keys[1]);
+	memcpy_fast(ctx->prk, prk, sizeof(prk));
+	ctx->shared = !!secret;
+out:
+	WRITE_ONCE(ctx->lifetime, lifetime);
+err:
+	spin_unlock_bh(&ctx->lock);
+	bzero_fast(prk, sizeof(prk));
+
+	for (i = 0; i < ARRAY_SIZE(old); ++i)
+		if (old[i])
+			call_rcu(&old[i]->rcu, ttls_ticket_key_free_rcu);
+
+	return r;
 }
+EXPORT_SYMBOL(ttls_ticket_setup);
 
-/*
- * Load session ticket (see ttls_ticket_write for structure)
+/**
+ * Free the keys of @ctx. There must be no handshakes using the context.
  */
-int ttls_ticket_parse(void *p_ticket,
-				  TlsSess *session,
-				  unsigned char *buf,
-				  size_t len)
+void
+ttls_ticket_free(TlsTicketCtx *ctx)
 {
-	int ret;
-	ttls_ticket_context *ctx = p_ticket;
-	ttls_ticket_key *key;
-	unsigned char *key_name = buf;
-	unsigned char *iv = buf + 4;
-	unsigned char *enc_len_p = iv + 12;
-	unsigned char *ticket = enc_len_p + 2;
-	unsigned char *tag;
-	size_t enc_len, clear_len;
-
-	if (ctx == NULL)
-		return(TTLS_ERR_BAD_INPUT_DATA);
-
-	/* See ttls_ticket_write() */
-	if (len < 4 + 12 + 2 + 16)
-		return(TTLS_ERR_BAD_INPUT_DATA);
-
-	spin_lock(&ctx->mutex);
+	int i;
 
-	if ((ret = ssl_ticket_update_keys(ctx)) != 0)
-		goto cleanup;
+	synchronize_rcu();
+	for (i = 0; i < ARRAY_SIZE(ctx->keys); ++i) {
+		ttls_ticket_key_free(rcu_dereference_protected(ctx->keys[i],
+							       true));
+		RCU_INIT_POINTER(ctx->keys[i], NULL);
+	}
+	ctx->lifetime = 0;
+	ctx->shared = false;
+	bzero_fast(ctx->prk, sizeof(ctx->prk));
+}
+EXPORT_SYMBOL(ttls_ticket_free);
 
-	enc_len = (enc_len_p[0] << 8) | enc_len_p[1];
-	tag = ticket + enc_len;
+void
+ttls_ticket_stat(TlsTicketStat *stat)
+{
+	int cpu;
 
-	if (len != 4 + 12 + 2 + enc_len + 16)
-	{
-		ret = TTLS_ERR_BAD_INPUT_DATA;
-		goto cleanup;
-	}
+	bzero_fast(stat, sizeof(*stat));
+	for_each_possible_cpu(cpu) {
+		TlsTicketStat *s = per_cpu_ptr(&g_tkt_stat, cpu);
 
-	/* Select key */
-	if ((key = ssl_ticket_select_key(ctx, key_name)) == NULL)
-	{
-		/* We can't know for sure but this is a likely option unless we're
-		 * under attack - this is only informative anyway */
-		ret = TTLS_ERR_SESSION_TICKET_EXPIRED;
-		goto cleanup;
+		stat->issued += s->issued;
+		stat->resumed += s->resumed;
+		stat->rejected += s->rejected;
+		stat->write_cycles += s->write_cycles;
+		stat->parse_cycles += s->parse_cycles;
 	}
+}
+EXPORT_SYMBOL(ttls_ticket_stat);
 
-	/* Decrypt and authenticate */
-	/* TODO #1054 replace with linux/crypto as in ttls.c. */
-	if ((ret = ttls_cipher_auth_decrypt(&key->ctx, iv, 12,
-		key_name, 4 + 12 + 2, ticket, enc_len,
-		ticket, &clear_len, tag, 16)) != 0)
-	{
-		goto cleanup;
-	}
-	if (clear_len != enc_len)
-	{
-		ret = TTLS_ERR_INTERNAL_ERROR;
-		goto cleanup;
-	}
+void
+ttls_ticket_modexit(void)
+{
+	int cpu;
 
-	/* Actually load session */
-	if ((ret = ssl_load_session(session, ticket, clear_len)) != 0)
-		goto cleanup;
+	/* Wait for the keys freed on the rotation. */
+	rcu_barrier();
 
-	{
-		/* Check for expiration */
-		time_t current_time = ttls_time();
-
-		if (current_time < session->start ||
-			(uint32_t)(current_time - session->start) > ctx->ticket_lifetime)
-		{
-			ret = TTLS_ERR_SESSION_TICKET_EXPIRED;
-			goto cleanup;
-		}
+	for_each_possible_cpu(cpu) {
+		kfree(*per_cpu_ptr(&g_tkt_scratch, cpu));
+		*per_cpu_ptr(&g_tkt_scratch, cpu) = NULL;
 	}
-
-cleanup:
-	spin_unlock(&ctx->mutex);
-
-	return ret;
 }
 
-/*
- * Free context
- */
-void ttls_ticket_free(ttls_ticket_context *ctx)
+int __init
+ttls_ticket_modinit(void)
 {
-	ttls_cipher_free(&ctx->keys[0].ctx);
-	ttls_cipher_free(&ctx->keys[1].ctx);
-	bzero_fast(ctx, sizeof(ttls_ticket_context));
-}
+	int cpu;
+	TlsTicketScratch **s;
+
+	BUILD_BUG_ON(sizeof(TlsTicketState) != 72);
+	BUILD_BUG_ON(TTLS_TICKET_LEN > TTLS_HS_TICKET_MAX_LEN);
+
+	for_each_possible_cpu(cpu) {
+		s = per_cpu_ptr(&g_tkt_scratch, cpu);
+		*s = kmalloc_node(offsetof(TlsTicketScratch, req)
+				  + ttls_aead_reqsize(), GFP_KERNEL,
+				  cpu_to_node(cpu));
+		if (!*s) {
+			ttls_ticket_modexit();
+			return -ENOMEM;
+		}
+	}
 
-#endif /* TODO #1054 remove me */
+	return 0;
+}
@@ -1,10 +1,9 @@
 /**
  *		Tempesta TLS
  *
- * Based on mbed TLS, https://tls.mbed.org.
+ * TLS server tickets implementation (RFC 5077).
  *
- * Copyright (C) 2006-2015, ARM Limited, All Rights Reserved
- * Copyright (C) 2015-2018 Tempesta Technologies, Inc.
+ * Copyright (C) 2015-2020 Tempesta Technologies, Inc.
  *
  * This program is free software; you can redistribute it and/or modify
  * it under the terms of the GNU General Public License as published by
@@ -20,95 +19,66 @@
  * with this program; if not, write to the Free Software Foundation, Inc.,
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
-#ifndef TTLS_TICKET_H
-#define TTLS_TICKET_H
+#ifndef __TTLS_TICKET_H__
+#define __TTLS_TICKET_H__
 
-/*
- * This implementation of the session ticket callbacks includes key
- * management, rotating the keys periodically in order to preserve forward
- * secrecy.
- */
+#include <linux/rcupdate.h>
+#include <linux/spinlock.h>
 
-#include "crypto.h"
 #include "ttls.h"
 
-/**
- * \brief   Information for session ticket protection
- */
-typedef struct
-{
-	unsigned char name[4];		/*!< random key identifier */
-	uint32_t generation_time;	/*!< key generation timestamp (seconds) */
-	TlsCipherCtx ctx;		/*!< context for auth enc/decryption	*/
-}
-ttls_ticket_key;
+#define TTLS_TICKET_NAME_LEN		16
+#define TTLS_TICKET_PRK_LEN		32
 
 /**
- * \brief   Context for session ticket handling functions
- */
-typedef struct
-{
-	ttls_ticket_key keys[2]; /*!< ticket protection keys			 */
-	unsigned char active;		   /*!< index of the currently active key  */
-
-	uint32_t ticket_lifetime;	   /*!< lifetime of tickets in seconds	 */
-
-	spinlock_t mutex;
-}
-ttls_ticket_context;
-
-/**
- * \brief		   Initialize a ticket context.
- *				  (Just make it ready for ttls_ticket_setup()
- *				  or ttls_ticket_free().)
+ * Session ticket protection key.
  *
- * \param ctx	   Context to be initialized
+ * @name	- key identifier sent in the tickets;
+ * @gen_time	- the key generation timestamp or, for the shared keys, the
+ *		  rotation period start, seconds;
+ * @tfm		- AEAD transform with the key set;
+ * @rcu		- RCU head to free the key after the rotation;
  */
-void ttls_ticket_init(ttls_ticket_context *ctx);
+typedef struct {
+	unsigned char		name[TTLS_TICKET_NAME_LEN];
+	unsigned long		gen_time;
+	struct crypto_aead	*tfm;
+	struct rcu_head		rcu;
+} TlsTicketKey;
 
 /**
- * \brief		   Prepare context to be actually used
- *
- * \param ctx	   Context to be set up
- * \param cipher	AEAD cipher to use for ticket protection.
- *				  Recommended value: TTLS_CIPHER_AES_256_GCM.
- * \param lifetime  Tickets lifetime in seconds
- *				  Recommended value: 86400 (one day).
- *
- * \note			It is highly recommended to select a cipher that is at
- *				  least as strong as the strongest ciphersuite
- *				  supported. Usually that means a 256-bit key.
- *
- * \note			The lifetime of the keys is twice the lifetime of tickets.
- *				  It is recommended to pick a reasonable lifetime so as not
- *				  to negate the benefits of forward secrecy.
+ * Session tickets context. The current key encrypts new tickets, while the
+ * previous one is kept for decryption only, so a key lives for two ticket
+ * lifetimes. The keys are read under RCU and are rotated on demand by the
+ * CPU issuing or parsing a ticket. The shared keys are derived from the secret
+ * and the number of the rotation period, the lifetime long, since the Epoch,
+ * so the cluster nodes rotate them at the same time.
  *
- * \return		  0 if successful,
- *				  or a specific TTLS_ERR_XXX error code
+ * @keys	- the current and the previous keys;
+ * @active	- index of the current key in @keys;
+ * @lifetime	- ticket lifetime in seconds, zero if the tickets are disabled;
+ * @shared	- the keys are derived from @prk;
+ * @prk		- HKDF pseudorandom key of the shared secret;
+ * @lock	- serializes the keys rotation;
  */
-int ttls_ticket_setup(ttls_ticket_context *ctx,
-	ttls_cipher_type_t cipher,
-	uint32_t lifetime);
+typedef struct {
+	TlsTicketKey __rcu	*keys[2];
+	unsigned int		active;
+	unsigned int		lifetime;
+	bool			shared;
+	unsigned char		prk[TTLS_TICKET_PRK_LEN];
+	spinlock_t		lock;
+} TlsTicketCtx;
 
-/**
- * \brief		   Implementation of the ticket write callback
- *
- * \note			See \c mbedlts_ticket_write_t for description
- */
-ttls_ticket_write_t ttls_ticket_write;
+void ttls_ticket_init(TlsTicketCtx *ctx);
+int ttls_ticket_setup(TlsTicketCtx *ctx, unsigned int lifetime,
+		      const unsigned char *secret, size_t len);
+void ttls_ticket_free(TlsTicketCtx *ctx);
 
-/**
- * \brief		   Implementation of the ticket parse callback
- *
- * \note			See \c mbedlts_ticket_parse_t for description
- */
+ttls_ticket_write_t ttls_ticket_write;
 ttls_ticket_parse_t ttls_ticket_parse;
 
-/**
- * \brief		   Free a context's content and zeroize it.
- *
- * \param ctx	   Context to be cleaned up
- */
-void ttls_ticket_free(ttls_ticket_context *ctx);
+int ttls_ticket_modinit(void);
+void ttls_ticket_modexit(void);
 
-#endif /* ssl_ticket.h */
+#endif /* __TTLS_TICKET_H__ */
@@ -5,6 +5,16 @@
  *
  * See RFC 5246 for TLS 1.2 specification.
  *
+ * TODO TLS 1.3 (RFC 8446) isn't supported yet. It needs a separate handshake
+ * state machine for the 1-RTT flight (key shares in ClientHello/ServerHello,
+ * the encrypted extensions and the certificate messages), the HKDF key
+ * schedule on top of the existing HMAC contexts, the record layer with the
+ * inner content type and the per-record nonce (AEAD ciphersuites only), and
+ * PSK resumption with the tickets of tls_ticket.c. 0-RTT data needs replay
+ * protection and must be allowed for idempotent requests only, so it also
+ * needs an interface to the HTTP layer. The ECDHE, AES-GCM and mpool code
+ * can be reused as is.
+ *
  * Based on mbed TLS, https://tls.mbed.org.
  *
  * Copyright (C) 2006-2015, ARM Limited, All Rights Reserved
@@ -28,6 +38,7 @@
 #include <asm/fpu/api.h>
 #include <crypto/aead.h>
 #include <crypto/algapi.h>
+#include <crypto/scatterwalk.h>
 #include <linux/module.h>
 #include <net/tls.h>
 
@@ -35,6 +46,7 @@
 #include "mpool.h"
 #include "oid.h"
 #include "tls_internal.h"
+#include "tls_ticket.h"
 #include "ttls.h"
 
 MODULE_AUTHOR("Tempesta Technologies, Inc");
@@ -43,10 +55,21 @@ MODULE_VERSION("0.3.1");
 MODULE_LICENSE("GPL");
 
 static DEFINE_PER_CPU(struct aead_request *, g_req) ____cacheline_aligned;
+/*
+ * Decryption request with the scatterlist placed right after it. Records
+ * of an skb are decrypted back-to-back on the same CPU, so the request
+ * reused for them stays hot in the cache. AAD and a record split over
+ * the page fragments of a GROed skb fit the scatterlist.
+ */
+#define TTLS_DEC_SG_N		(MAX_SKB_FRAGS + 4)
+static DEFINE_PER_CPU(struct aead_request *, g_dec_req) ____cacheline_aligned;
 
 static struct kmem_cache *ttls_hs_cache = NULL;
+/* Number of handshake contexts allocated on the CPU, can go negative. */
+static DEFINE_PER_CPU(long, g_hs_num);
 static ttls_send_cb_t *ttls_send_cb;
 extern ttls_sni_cb_t *ttls_sni_cb;
+extern ttls_sign_cb_t *ttls_sign_cb;
 
 static inline size_t
 ttls_max_ciphertext_len(const TlsXfrm *xfrm)
@@ -54,9 +77,10 @@ ttls_max_ciphertext_len(const TlsXfrm *xfrm)
 	/*
 	 * Although RFC 5246 6.2.3 allows ciphertexts to be as large as
 	 * (2^14 + 2048) bytes, actual limits are specific to particular
-	 * cipher suites. We are supporting only AEAD ciphers (GCM and CCM).
-	 * Their transforms increase data size by a constant amount of bytes.
-	 * To be specific, those are explicit part of IV and a tag.
+	 * cipher suites. We are supporting only AEAD ciphers (GCM, CCM and
+	 * ChaCha20-Poly1305). Their transforms increase data size by a constant
+	 * amount of bytes. To be specific, those are explicit part of IV (if
+	 * any) and a tag.
 	 */
 	return TLS_MAX_PAYLOAD_SIZE + xfrm->minlen;
 }
@@ -104,6 +128,10 @@ ttls_aad2hdriv(TlsXfrm *xfrm, unsigned char *buf)
 	unsigned short len, ivlen = ttls_expiv_len(xfrm);
 	long iv = *(long *)buf;
 
+	/* ttls_encrypt() writes the header w/o explicit IV. */
+	if (!ivlen)
+		return;
+
 	memmove(buf, buf + ivlen, TLS_HEADER_SIZE);
 	*(long *)(buf + TLS_HEADER_SIZE) = iv;
 
@@ -121,6 +149,13 @@ ttls_aad2hdriv(TlsXfrm *xfrm, unsigned char *buf)
 }
 EXPORT_SYMBOL(ttls_aad2hdriv);
 
+static void
+ttls_crypto_req_free(struct aead_request *req)
+{
+	if (req != *this_cpu_ptr(&g_dec_req))
+		kfree(req);
+}
+
 /**
  * Called to build crypto request with scatterlist acceptable by the crypto
  * layer from collected skbs when TLS sees the end of current message or
@@ -151,14 +186,19 @@ ttls_crypto_req_sglist(TlsCtx *tls, struct crypto_aead *tfm, unsigned int len,
 		off = 0;
 		n = *sgn + 1;
 	} else {
-		off = ttls_payload_off(&tls->xfrm);
+		off = io->off + ttls_payload_off(&tls->xfrm);
 		n = *sgn + io->chunks;
 	}
 	sz += n * sizeof(**sg);
 
-	/* Don't use g_req for better spacial locality. */
-	req = kmalloc(sz, GFP_ATOMIC);
-	if (!req)
+	/*
+	 * Don't use g_req for better spacial locality, the scatterlist
+	 * follows the request. Fallback to kmalloc() for records
+	 * scattered over too many chunks.
+	 */
+	if (likely(n <= TTLS_DEC_SG_N && aead_sz <= ttls_aead_reqsize()))
+		req = *this_cpu_ptr(&g_dec_req);
+	else if (!(req = kmalloc(sz, GFP_ATOMIC)))
 		return NULL;
 	*sg = (struct scatterlist *)((char *)req + aead_sz);
 	sg_init_table(*sg, n);
@@ -199,7 +239,7 @@ ttls_crypto_req_sglist(TlsCtx *tls, struct crypto_aead *tfm, unsigned int len,
 
 	return req;
 err:
-	kfree(req);
+	ttls_crypto_req_free(req);
 	return NULL;
 }
 
@@ -209,7 +249,7 @@ err:
 static int
 ttls_skb_extract_alert(TlsIOCtx *io, TlsXfrm *xfrm)
 {
-	size_t n, copied = 0, off = ttls_payload_off(xfrm);
+	size_t n, copied = 0, off = io->off + ttls_payload_off(xfrm);
 	struct sk_buff *skb = io->skb_list;
 
 	for ( ; skb && copied != TTLS_ALERT_LEN; skb = skb->next) {
@@ -230,10 +270,12 @@ ttls_skb_extract_alert(TlsIOCtx *io, TlsXfrm *xfrm)
  * Register I/O callbacks from the underlying network layer.
  */
 void
-ttls_register_callbacks(ttls_send_cb_t *send_cb, ttls_sni_cb_t *sni_cb)
+ttls_register_callbacks(ttls_send_cb_t *send_cb, ttls_sni_cb_t *sni_cb,
+			ttls_sign_cb_t *sign_cb)
 {
 	ttls_send_cb = send_cb;
 	ttls_sni_cb = sni_cb;
+	ttls_sign_cb = sign_cb;
 }
 EXPORT_SYMBOL(ttls_register_callbacks);
 
@@ -644,27 +686,17 @@ ttls_derive_keys(TlsCtx *tls)
 				+ ((xfrm->ciphersuite_info->flags
 				    & TTLS_CIPHERSUITE_SHORT_TAG) ? 8 : 16);
 	} else {
-		BUG_ON(ci->mode != TTLS_MODE_STREAM);
+		BUG_ON(ci->mode != TTLS_MODE_CHACHAPOLY);
 		/*
-		 * TODO #1031: Initialize HMAC contexts - do we need this for
-		 * CHACHA20_POLY1305?
+		 * ChaCha20-Poly1305 is also AEAD, but the whole IV is taken
+		 * from the key block and XORed with the record sequence number
+		 * (RFC 7905 2), so the minimum length is just the tag.
 		 */
-		if ((r = ttls_md_setup(&xfrm->md_ctx_enc, md_info, 1))
-		    || (r = ttls_md_setup(&xfrm->md_ctx_dec, md_info, 1)))
-		{
-			return r;
-		}
-
-		/* Get MAC length */
-		mac_key_len = ttls_md_get_size(md_info);
-		xfrm->maclen = mac_key_len;
-
-		/* IV length */
+		xfrm->maclen = 0;
+		mac_key_len = 0;
 		xfrm->ivlen = ci->iv_size;
-		WARN_ON_ONCE(xfrm->ivlen > 16);
-
-		/* Minimum length */
-		xfrm->minlen = xfrm->maclen;
+		xfrm->fixed_ivlen = ci->iv_size;
+		xfrm->minlen = tag_size;
 	}
 	T_DBG("keylen=%u minlen=%u ivlen=%u maclen=%u tagsize=%d"
 	      " mac_key_len=%lu\n", xfrm->keylen, xfrm->minlen, xfrm->ivlen,
@@ -743,6 +775,34 @@ ttls_make_aad(TlsCtx *tls, TlsIOCtx *io, unsigned char *aad_buf)
 		   TLS_AAD_SPACE_SIZE);
 }
 
+/*
+ * ChaCha20-Poly1305 nonce is the fixed IV XORed with the left-padded record
+ * sequence number, RFC 7905 2.
+ */
+static void
+ttls_chachapoly_nonce(unsigned char *nonce, const unsigned char *iv,
+		      unsigned long ctr)
+{
+	memcpy_fast(nonce, iv, 12);
+	*(unsigned long *)(nonce + 4) ^= __cpu_to_be64(ctr);
+}
+
+/*
+ * Build AEAD scatterlist @sg of AAD from @aad followed by @data w/o the TLS
+ * record header. Used if there is no explicit IV to place AAD instead of the
+ * header and the IV.
+ */
+static struct scatterlist *
+ttls_aad_sg(struct scatterlist sg[2], struct scatterlist fw[2],
+	    unsigned char *aad, struct scatterlist *data)
+{
+	sg_init_table(sg, 2);
+	sg_set_buf(sg, aad, TLS_AAD_SPACE_SIZE);
+	sg_chain(sg, 2, scatterwalk_ffwd(fw, data, TLS_HEADER_SIZE));
+
+	return sg;
+}
+
 /**
  * Use per-cpu AEAD crypto requests in static memory instead of allocating them
  * each time from the heap. Tempesta TLS works in softirq context, so there are
@@ -794,6 +854,10 @@ ttls_encrypt(TlsCtx *tls, struct sg_table *sgt, struct sg_table *out_sgt)
 	TlsIOCtx *io = &tls->io_out;
 	TlsCipherCtx *c_ctx = &xfrm->cipher_ctx_enc;
 	unsigned long iv = __cpu_to_be64(io->ctr);
+	unsigned char *nonce = xfrm->iv_enc;
+	unsigned char nonce_buf[12], aad_buf[TLS_AAD_SPACE_SIZE];
+	struct scatterlist *src = sgt->sgl, *dst = out_sgt->sgl;
+	struct scatterlist src_sg[2], src_fw[2], dst_sg[2], dst_fw[2];
 	struct aead_request *req;
 
 	WARN_ON_ONCE(!ttls_xfrm_ready(tls));
@@ -804,14 +868,30 @@ ttls_encrypt(TlsCtx *tls, struct sg_table *sgt, struct sg_table *out_sgt)
 	if (unlikely(!req))
 		return -ENOMEM;
 
-	*(long *)(xfrm->iv_enc + xfrm->fixed_ivlen) = iv;
-	T_DBG3_BUF("IV used", xfrm->iv_enc, xfrm->ivlen);
-
 	elen = ttls_msg2crypt_len(io, xfrm);
-	ttls_make_aad(tls, io, sg_virt(out_sgt->sgl));
+	if (ttls_expiv_len(xfrm)) {
+		*(long *)(xfrm->iv_enc + xfrm->fixed_ivlen) = iv;
+		ttls_make_aad(tls, io, sg_virt(out_sgt->sgl));
+	} else {
+		/*
+		 * There is no room for AAD in front of the payload, so the
+		 * record header is written right now.
+		 */
+		ttls_chachapoly_nonce(nonce_buf, xfrm->iv_enc, io->ctr);
+		nonce = nonce_buf;
+		ttls_make_aad(tls, io, aad_buf);
+		ttls_write_hdr(tls, io->msgtype, io->msglen,
+			       sg_virt(out_sgt->sgl));
+		src = ttls_aad_sg(src_sg, src_fw, aad_buf, sgt->sgl);
+		dst = sgt == out_sgt
+		      ? src
+		      : ttls_aad_sg(dst_sg, dst_fw, aad_buf, out_sgt->sgl);
+	}
+	T_DBG3_BUF("IV used", nonce, xfrm->ivlen);
+
 	aead_request_set_tfm(req, c_ctx->cipher_ctx);
 	aead_request_set_ad(req, TLS_AAD_SPACE_SIZE);
-	aead_request_set_crypt(req, sgt->sgl, out_sgt->sgl, elen, xfrm->iv_enc);
+	aead_request_set_crypt(req, src, dst, elen, nonce);
 
 	T_DBG3("%s encryption: tfm=%pK(req->tfm=%pK req=%pK) reqsize=%u"
 		" key_len=%u data_len=%d\n",
@@ -850,7 +930,7 @@ __ttls_decrypt(TlsCtx *tls, unsigned char *buf)
 	TlsIOCtx *io = &tls->io_in;
 	struct crypto_aead *tfm = xfrm->cipher_ctx_dec.cipher_ctx;
 	unsigned int sgn = 1;
-	unsigned char taglen;
+	unsigned char taglen, *nonce = xfrm->iv_dec, nonce_buf[12];
 	struct aead_request *req;
 	struct scatterlist *sg = NULL;
 	unsigned char aad_buf[TLS_AAD_SPACE_SIZE];
@@ -865,7 +945,8 @@ __ttls_decrypt(TlsCtx *tls, unsigned char *buf)
 	taglen = ttls_xfrm_taglen(xfrm);
 	mode = xfrm->cipher_ctx_enc.cipher_info->mode;
 
-	WARN_ON_ONCE(mode != TTLS_MODE_GCM && mode != TTLS_MODE_CCM);
+	WARN_ON_ONCE(mode != TTLS_MODE_GCM && mode != TTLS_MODE_CCM
+		     && mode != TTLS_MODE_CHACHAPOLY);
 	T_DBG2("decrypt input record from network: hdr=%pK msglen=%d chunks=%u"
 	       " taglen=%u eiv_len=%lu\n",
 	       io->hdr, io->msglen, io->chunks, taglen, expiv_len);
@@ -877,7 +958,13 @@ __ttls_decrypt(TlsCtx *tls, unsigned char *buf)
 
 	dec_msglen = io->msglen - expiv_len - taglen;
 
-	memcpy_fast(xfrm->iv_dec + xfrm->fixed_ivlen, io->iv, sizeof(io->iv));
+	if (expiv_len) {
+		memcpy_fast(xfrm->iv_dec + xfrm->fixed_ivlen, io->iv,
+			    sizeof(io->iv));
+	} else {
+		ttls_chachapoly_nonce(nonce_buf, xfrm->iv_dec, io->ctr);
+		nonce = nonce_buf;
+	}
 	req = ttls_crypto_req_sglist(tls, tfm, dec_msglen + taglen, buf,
 				     &sg, &sgn);
 	if (!req)
@@ -889,7 +976,7 @@ __ttls_decrypt(TlsCtx *tls, unsigned char *buf)
 	ttls_make_aad(tls, io, aad_buf);
 	sg_set_buf(sg, aad_buf, TLS_AAD_SPACE_SIZE);
 
-	T_DBG3_BUF("IV used", xfrm->iv_dec, xfrm->ivlen);
+	T_DBG3_BUF("IV used", nonce, xfrm->ivlen);
 	T_DBG3_SL("decrypt: AAD|msg|TAG", sg, sgn, 0, TLS_AAD_SPACE_SIZE +
 		  dec_msglen + taglen);
 
@@ -904,8 +991,7 @@ __ttls_decrypt(TlsCtx *tls, unsigned char *buf)
 	aead_request_set_tfm(req, tfm);
 	aead_request_set_ad(req, TLS_AAD_SPACE_SIZE);
 	/* The crypto layer expects AAD segment in output scatter list. */
-	aead_request_set_crypt(req, sg, sg, dec_msglen + taglen,
-			       xfrm->iv_dec);
+	aead_request_set_crypt(req, sg, sg, dec_msglen + taglen, nonce);
 	r = crypto_aead_decrypt(req);
 
 	T_DBG3_SL("raw buffer after decryption", sg + 1, sgn - 1, 0,
@@ -915,7 +1001,7 @@ __ttls_decrypt(TlsCtx *tls, unsigned char *buf)
 		T_WARN("incoming message counter would wrap\n");
 
 out:
-	kfree(req);
+	ttls_crypto_req_free(req);
 
 	return r;
 }
@@ -1269,10 +1355,20 @@ ttls_handshake_free(TlsHandshake *hs)
 	crypto_free_shash(hs->desc.tfm);
 
 	if (hs->crypto_ctx)
-		ttls_mpi_pool_free(hs->crypto_ctx);
+		ttls_mpi_profile_free(hs->crypto_ctx);
+
+	if (unlikely(hs->flight)) {
+		TlsHsFlight *fl = hs->flight;
+
+		while (fl->nents)
+			put_page(sg_page(&fl->sg[--fl->nents]));
+		put_page(fl->pg);
+		kfree(fl);
+	}
 
 	bzero_fast(hs, sizeof(TlsHandshake));
 	kmem_cache_free(ttls_hs_cache, hs);
+	this_cpu_dec(g_hs_num);
 }
 
 void
@@ -1343,8 +1439,8 @@ ttls_write_certificate(TlsCtx *tls, struct sg_table *sgt,
 		       unsigned char **in_buf)
 {
 	unsigned int sg_i;
-	size_t n, tot_len = 0;
-	const ttls_x509_crt *crt;
+	size_t n;
+	const TlsKeyCert *key_cert;
 	TlsIOCtx *io = &tls->io_out;
 	unsigned char *p = *in_buf;
 
@@ -1354,65 +1450,48 @@ ttls_write_certificate(TlsCtx *tls, struct sg_table *sgt,
 		return 0;
 	}
 
-	/*
-	 * Remember the sg index for record checksum update.
-	 * Set the fragment now, but write the certificate record later, when
-	 * we have the final record legth - if we fail somwhere at the middle,
-	 * let the called to cleanup all the frags.
-	 */
-	sg_i = sgt->nents++;
-	sg_set_buf(&sgt->sgl[sg_i], p, TLS_HEADER_SIZE + 7);
-	get_page(virt_to_page(p));
-
-	if (tls->conf->endpoint == TTLS_IS_SERVER && !ttls_own_cert(tls)) {
+	key_cert = ttls_own_key_cert(tls);
+	if (tls->conf->endpoint == TTLS_IS_SERVER
+	    && (!key_cert || !key_cert->chain))
+	{
 		T_DBG("got no certificate to send\n");
 		return TTLS_ERR_CERTIFICATE_REQUIRED;
 	}
-
-	/*
-	 *   7 . 9	length of cert. 1
-	 *  10 . n-1	peer certificate
-	 *   n . n+2	length of cert. 2
-	 * n+3 . ...	upper level cert, etc.
-	 */
-	for (crt = ttls_own_cert(tls); crt; crt = crt->next) {
-		if (unlikely(sgt->nents >= MAX_SKB_FRAGS)) {
-			T_WARN("Too many certfificates\n");
-			return -ENOSPC;
-		}
-
-		n = crt->raw.len + TTLS_CERT_LEN_LEN;
-		if (n + tot_len > TLS_MAX_PAYLOAD_SIZE - 7) {
-			T_WARN("certificate too large, %lu > %lu\n",
-			       tot_len + n + 7, TLS_MAX_PAYLOAD_SIZE);
-			return TTLS_ERR_CERTIFICATE_TOO_LARGE;
-		}
-
-		tot_len += n;
-		get_page(virt_to_page(ttls_x509_crt_page(crt)));
-		sg_set_buf(&sgt->sgl[sgt->nents++], ttls_x509_crt_page(crt), n);
-		T_DBG3("add cert page %pK,len=%lu seg=%u\n",
-		       crt->raw.p, n, sgt->nents - 1);
+	if (unlikely(sgt->nents + 2 > MAX_SKB_FRAGS)) {
+		T_WARN("Too many frags for Certificate\n");
+		return -ENOSPC;
 	}
-	if (crt)
-		T_WARN("Can not write full certificates chain\n");
 
 	/*
-	 * Write thr handshake headers on our own (TLS_HEADER_SIZE + 7 bytes).
+	 * Write the handshake headers on our own and send the certificates
+	 * chain serialized on configuration, see ttls_cert_chain_get().
 	 *
 	 *  0 . 4	record header (to be written in __ttls_add_record()
 	 *  5 . 5	handshake type (certificate)
 	 *  6 . 8	handshake length
-	 *  9 . 11	length of all certs
+	 *  9 . 11	length of all certs (empty list only)
 	 */
-	io->msglen = tot_len + 7;
-	ttls_write_hshdr(TTLS_HS_CERTIFICATE, p + TLS_HEADER_SIZE, tot_len + 7);
-	p[9] = (unsigned char)(tot_len >> 16);
-	p[10] = (unsigned char)(tot_len >> 8);
-	p[11] = (unsigned char)tot_len;
+	if (key_cert && key_cert->chain) {
+		n = TLS_HEADER_SIZE + TTLS_HS_HDR_LEN;
+		io->msglen = TTLS_HS_HDR_LEN + key_cert->chain->len;
+	} else {
+		n = TLS_HEADER_SIZE + TTLS_HS_HDR_LEN + TTLS_CERT_LEN_LEN;
+		io->msglen = TTLS_HS_HDR_LEN + TTLS_CERT_LEN_LEN;
+		p[9] = p[10] = p[11] = 0;
+	}
+	ttls_write_hshdr(TTLS_HS_CERTIFICATE, p + TLS_HEADER_SIZE, io->msglen);
+
+	sg_i = sgt->nents++;
+	sg_set_buf(&sgt->sgl[sg_i], p, n);
+	get_page(virt_to_page(p));
+	if (key_cert && key_cert->chain) {
+		sg_set_buf(&sgt->sgl[sgt->nents++], key_cert->chain->data,
+			   key_cert->chain->len);
+		get_page(virt_to_page(key_cert->chain->data));
+	}
 	__ttls_add_record(tls, sgt, sg_i, p);
 
-	*in_buf = p + TLS_HEADER_SIZE + 7;
+	*in_buf = p + n;
 
 	return 0;
 }
@@ -1722,7 +1801,7 @@ ttls_write_finished(TlsCtx *tls, struct sg_table *sgt, unsigned char **in_buf)
 	};
 
 	io->ctr = 0;
-	io->msglen = TTLS_HS_FINISHED_BODY_LEN;
+	io->msglen = ttls_finished_len(xfrm);
 	io->msgtype = TTLS_MSG_HANDSHAKE;
 	msg = p + ttls_payload_off(xfrm);
 
@@ -1730,13 +1809,13 @@ ttls_write_finished(TlsCtx *tls, struct sg_table *sgt, unsigned char **in_buf)
 	tls->hs->calc_finished(tls, msg + TTLS_HS_HDR_LEN, tls->conf->endpoint);
 
 	sg_init_table(&sg, 1);
-	sg_set_buf(&sg, p, TLS_HEADER_SIZE + TTLS_HS_FINISHED_BODY_LEN);
+	sg_set_buf(&sg, p, TLS_HEADER_SIZE + io->msglen);
 	if ((r = ttls_encrypt(tls, &enc_sgt, &enc_sgt)))
 		return r;
 
 	ttls_aad2hdriv(xfrm, p);
 
-	*in_buf += TLS_HEADER_SIZE + TTLS_HS_FINISHED_BODY_LEN;
+	*in_buf += TLS_HEADER_SIZE + io->msglen;
 	sg_set_buf(&sgt->sgl[sgt->nents++], p, *in_buf - p);
 	get_page(virt_to_page(p));
 
@@ -1761,7 +1840,7 @@ ttls_parse_finished(TlsCtx *tls, unsigned char *buf, size_t len,
 		T_WARN("TLS context isn't ready on Finished\n");
 		return TTLS_ERR_BAD_HS_FINISHED;
 	}
-	if (unlikely(io->msglen != TTLS_HS_FINISHED_BODY_LEN)) {
+	if (unlikely(io->msglen != ttls_finished_len(xfrm))) {
 		T_DBG("wrong ClientFinished message length: %u\n", io->msglen);
 		return TTLS_ERR_BAD_HS_FINISHED;
 	}
@@ -1826,6 +1905,7 @@ ttls_ctx_init(TlsCtx *tls, const TlsCfg *conf)
 	tls->hs = kmem_cache_alloc(ttls_hs_cache, GFP_ATOMIC);
 	if (!tls->hs)
 		return -ENOMEM;
+	this_cpu_inc(g_hs_num);
 	bzero_fast(tls->hs, sizeof(*tls->hs));
 
 	tls->hs->sni_authmode = TTLS_VERIFY_UNSET;
@@ -1834,6 +1914,26 @@ ttls_ctx_init(TlsCtx *tls, const TlsCfg *conf)
 }
 EXPORT_SYMBOL(ttls_ctx_init);
 
+/**
+ * Collect memory statistics for the handshakes in progress: number of the
+ * handshakes, memory used by them and memory cached for new handshakes.
+ */
+void
+ttls_hs_mem_stat(TlsHsMemStat *stat)
+{
+	int cpu;
+	long n = 0;
+	unsigned long pools;
+
+	for_each_possible_cpu(cpu)
+		n += *per_cpu_ptr(&g_hs_num, cpu);
+
+	ttls_mpool_hs_stat(&pools, &stat->cached);
+	stat->hs_num = max(n, 0L);
+	stat->in_use = stat->hs_num * sizeof(TlsHandshake) + pools;
+}
+EXPORT_SYMBOL(ttls_hs_mem_stat);
+
 /**
  * Set the certificate verification mode.
  * Default: NONE on server, REQUIRED on client.
@@ -1864,6 +1964,120 @@ ttls_set_session(TlsCtx *tls, const TlsSess *sess)
 	return 0;
 }
 
+static LIST_HEAD(ttls_cert_chains);
+static DEFINE_MUTEX(ttls_cert_chains_lock);
+
+static unsigned int
+ttls_cert_chain_order(size_t len)
+{
+	return get_order(sizeof(TlsCertChain) + len);
+}
+
+/**
+ * The self-signed root CA at the top of a chain may be omitted from the
+ * Certificate message (RFC 5246 7.4.2): a client must already have it to
+ * validate the chain. Self-issued intermediate certificates, e.g. for a CA
+ * key rollover, are sent as usual.
+ */
+static bool
+ttls_cert_chain_skip(const ttls_x509_crt *crt, const ttls_x509_crt *c)
+{
+	return c != crt && !c->next
+	       && c->issuer_raw.len == c->subject_raw.len
+	       && !memcmp(c->issuer_raw.p, c->subject_raw.p,
+			  c->subject_raw.len);
+}
+
+/**
+ * Serialize the Certificate message body for @crt chain once, so that the
+ * handshakes send it by reference, or reuse the same chain serialized for
+ * another vhost: there can be thousands of SNI vhosts with a few chains.
+ * A root CA is cut off from the chain to make the server first flight
+ * smaller, so it more likely fits the initial congestion window.
+ *
+ * The chain is page allocated since it's sent in zero-copy manner.
+ */
+static TlsCertChain *
+ttls_cert_chain_get(const ttls_x509_crt *crt)
+{
+	size_t len = TTLS_CERT_LEN_LEN;
+	const ttls_x509_crt *c;
+	TlsCertChain *ch, *cur;
+	unsigned char *p;
+
+	for (c = crt; c; c = c->next) {
+		if (ttls_cert_chain_skip(crt, c)) {
+			T_DBG("skip root CA of %u bytes in the chain\n",
+			      (unsigned int)c->raw.len);
+			continue;
+		}
+		len += TTLS_CERT_LEN_LEN + c->raw.len;
+	}
+	if (len + TTLS_HS_HDR_LEN > TLS_MAX_PAYLOAD_SIZE) {
+		T_WARN("certificate chain too large, %lu > %lu\n",
+		       len + TTLS_HS_HDR_LEN, TLS_MAX_PAYLOAD_SIZE);
+		return ERR_PTR(-E2BIG);
+	}
+
+	ch = (TlsCertChain *)__get_free_pages(GFP_KERNEL,
+					      ttls_cert_chain_order(len));
+	if (!ch)
+		return ERR_PTR(-ENOMEM);
+	ch->refcnt = 1;
+	ch->len = len;
+
+	/*
+	 *   0 . 2	length of all certs
+	 *   3 . 5	length of cert. 1
+	 *   6 . n-1	peer certificate
+	 *   n . n+2	length of cert. 2
+	 * n+3 . ...	upper level cert, etc.
+	 */
+	p = ch->data;
+	len -= TTLS_CERT_LEN_LEN;
+	p[0] = (unsigned char)(len >> 16);
+	p[1] = (unsigned char)(len >> 8);
+	p[2] = (unsigned char)len;
+	p += TTLS_CERT_LEN_LEN;
+	for (c = crt; c; c = c->next) {
+		if (ttls_cert_chain_skip(crt, c))
+			continue;
+		ttls_x509_write_cert_len(c, p);
+		memcpy(p + TTLS_CERT_LEN_LEN, c->raw.p, c->raw.len);
+		p += TTLS_CERT_LEN_LEN + c->raw.len;
+	}
+
+	mutex_lock(&ttls_cert_chains_lock);
+	list_for_each_entry(cur, &ttls_cert_chains, list) {
+		if (cur->len == ch->len && !memcmp(cur->data, ch->data, ch->len))
+		{
+			cur->refcnt++;
+			mutex_unlock(&ttls_cert_chains_lock);
+			free_pages((unsigned long)ch,
+				   ttls_cert_chain_order(ch->len));
+			return cur;
+		}
+	}
+	list_add(&ch->list, &ttls_cert_chains);
+	mutex_unlock(&ttls_cert_chains_lock);
+
+	return ch;
+}
+
+static void
+ttls_cert_chain_put(TlsCertChain *ch)
+{
+	mutex_lock(&ttls_cert_chains_lock);
+	if (--ch->refcnt) {
+		mutex_unlock(&ttls_cert_chains_lock);
+		return;
+	}
+	list_del(&ch->list);
+	mutex_unlock(&ttls_cert_chains_lock);
+
+	free_pages((unsigned long)ch, ttls_cert_chain_order(ch->len));
+}
+
 /**
  * Set own certificate chain and private key.
  *
@@ -1889,14 +2103,26 @@ ttls_conf_own_cert(TlsPeerCfg *conf, ttls_x509_crt *own_cert, TlsPkCtx *pk_key,
 		   ttls_x509_crt *ca_chain, ttls_x509_crl *ca_crl)
 {
 	TlsKeyCert *new;
+	TlsCertChain *chain = NULL;
 
-	if (!(new = kmalloc(sizeof(TlsKeyCert), GFP_KERNEL)))
+	if (own_cert) {
+		chain = ttls_cert_chain_get(own_cert);
+		if (IS_ERR(chain))
+			return PTR_ERR(chain);
+	}
+	if (!(new = kmalloc(sizeof(TlsKeyCert), GFP_KERNEL))) {
+		if (chain)
+			ttls_cert_chain_put(chain);
 		return -ENOMEM;
+	}
 
 	new->cert = own_cert;
 	new->key = pk_key;
 	new->ca_chain = ca_chain;
 	new->ca_crl = ca_crl;
+	new->chain = chain;
+	new->ocsp = NULL;
+	new->ocsp_len = 0;
 	new->next = NULL;
 
 	/* Update conf->key_cert if the list was NULL, else add to the end. */
@@ -1913,6 +2139,37 @@ ttls_conf_own_cert(TlsPeerCfg *conf, ttls_x509_crt *own_cert, TlsPkCtx *pk_key,
 }
 EXPORT_SYMBOL(ttls_conf_own_cert);
 
+/**
+ * Attach an OCSP response to staple to the last certificate added by
+ * ttls_conf_own_cert(). @ocsp must be page allocated since it's sent in
+ * zero-copy manner and must have TTLS_CERT_STATUS_HDR_LEN bytes reserved
+ * before the DER response of @len bytes.
+ *
+ * Called in process context on the startup.
+ */
+int
+ttls_conf_own_cert_ocsp(TlsPeerCfg *conf, unsigned char *ocsp, size_t len)
+{
+	TlsKeyCert *cur = conf->key_cert;
+
+	if (!cur || !len
+	    || len + TTLS_CERT_STATUS_HDR_LEN + TTLS_HS_HDR_LEN
+	       > TLS_MAX_PAYLOAD_SIZE)
+		return -EINVAL;
+	while (cur->next)
+		cur = cur->next;
+
+	ocsp[0] = TTLS_CERT_STATUS_OCSP;
+	ocsp[1] = (unsigned char)(len >> 16);
+	ocsp[2] = (unsigned char)(len >> 8);
+	ocsp[3] = (unsigned char)len;
+	cur->ocsp = ocsp;
+	cur->ocsp_len = len + TTLS_CERT_STATUS_HDR_LEN;
+
+	return 0;
+}
+EXPORT_SYMBOL(ttls_conf_own_cert_ocsp);
+
 /**
  * Required if we need to verify client certificate.
  */
@@ -2166,6 +2423,14 @@ ttls_recv(void *tls_data, unsigned char *buf, size_t len, unsigned int *read)
 					TTLS_ALERT_MSG_NO_RENEGOTIATION);
 			return TTLS_ERR_UNEXPECTED_MESSAGE;
 		}
+		/*
+		 * The client must wait for ServerHelloDone and the output
+		 * context is in use by our flight, so don't send an alert.
+		 */
+		if (unlikely(tls->state == TTLS_SERVER_KEY_EXCHANGE_SIGN)) {
+			T_DBG("handshake message while signing the flight\n");
+			return TTLS_ERR_UNEXPECTED_MESSAGE;
+		}
 
 		/*
 		 * We add ingress messages to the handshake session checksum
@@ -2256,6 +2521,8 @@ ttls_key_cert_free(TlsKeyCert *key_cert)
 
 	while (cur) {
 		next = cur->next;
+		if (cur->chain)
+			ttls_cert_chain_put(cur->chain);
 		kfree(cur);
 		cur = next;
 	}
@@ -2297,6 +2564,10 @@ static int ttls_default_ciphersuites[] = {
 	TTLS_TLS_ECDHE_ECDSA_WITH_AES_128_CCM_8,
 	TTLS_TLS_DHE_RSA_WITH_AES_128_CCM_8,
 
+	/* ChaCha20-Poly1305 ephemeral suites, see ttls_choose_ciphersuite() */
+	TTLS_TLS_ECDHE_ECDSA_WITH_CHACHA20_POLY1305_SHA256,
+	TTLS_TLS_ECDHE_RSA_WITH_CHACHA20_POLY1305_SHA256,
+
 	/* All AES-256 ephemeral suites */
 	TTLS_TLS_ECDHE_ECDSA_WITH_AES_256_GCM_SHA384,
 	TTLS_TLS_ECDHE_RSA_WITH_AES_256_GCM_SHA384,
@@ -2738,10 +3009,12 @@ ttls_exit(void)
 	int cpu;
 
 	kmem_cache_destroy(ttls_hs_cache);
+	ttls_ticket_modexit();
 
 	for_each_possible_cpu(cpu) {
 		struct aead_request **req = per_cpu_ptr(&g_req, cpu);
 		kfree(*req);
+		kfree(*per_cpu_ptr(&g_dec_req, cpu));
 	}
 
 	ttls_mpool_exit();
@@ -2766,8 +3039,17 @@ ttls_init(void)
 		*req = kmalloc(ttls_aead_reqsize(), GFP_KERNEL);
 		if (!*req)
 			goto err_free;
+		req = per_cpu_ptr(&g_dec_req, cpu);
+		*req = kmalloc(ttls_aead_reqsize()
+			       + TTLS_DEC_SG_N * sizeof(struct scatterlist),
+			       GFP_KERNEL);
+		if (!*req)
+			goto err_free;
 	}
 
+	if (ttls_ticket_modinit())
+		goto err_free;
+
 	ttls_hs_cache = kmem_cache_create("ttls_hs_cache", sizeof(TlsHandshake),
 					  0, 0, NULL);
 	if (!ttls_hs_cache)
@@ -98,6 +98,8 @@
 #define TTLS_ERR_BAD_HS_NEW_SESSION_TICKET	-0x6E00
 /* Session ticket has expired. */
 #define TTLS_ERR_SESSION_TICKET_EXPIRED		-0x6D80
+/* Session ticket was issued for another server name. */
+#define TTLS_ERR_SESSION_TICKET_SNI		-0x6D00
 /* Internal error (eg, unexpected failure in lower-level module). */
 #define TTLS_ERR_INTERNAL_ERROR			-0x6C00
 /* A buffer is too small to receive or write a message. */
@@ -216,6 +218,7 @@
 #define TTLS_HS_CERTIFICATE_VERIFY		15
 #define TTLS_HS_CLIENT_KEY_EXCHANGE		16
 #define TTLS_HS_FINISHED			20
+#define TTLS_HS_CERTIFICATE_STATUS		22
 #define TTLS_HS_INVALID				0xff
 
 /*
@@ -226,6 +229,7 @@
 #define TTLS_TLS_EXT_SERVERNAME_HOSTNAME	0
 #define TTLS_TLS_EXT_MAX_FRAGMENT_LENGTH	1
 #define TTLS_TLS_EXT_TRUNCATED_HMAC		4
+#define TTLS_TLS_EXT_STATUS_REQUEST		5
 #define TTLS_TLS_EXT_SUPPORTED_ELLIPTIC_CURVES	10
 #define TTLS_TLS_EXT_SUPPORTED_POINT_FORMATS	11
 #define TTLS_TLS_EXT_SIG_ALG			13
@@ -234,6 +238,10 @@
 #define TTLS_TLS_EXT_SESSION_TICKET		35
 #define TTLS_TLS_EXT_RENEGOTIATION_INFO		0xFF01
 
+/* CertificateStatusType (RFC 6066 8) and the CertificateStatus body header. */
+#define TTLS_CERT_STATUS_OCSP			1
+#define TTLS_CERT_STATUS_HDR_LEN		4
+
 /*
  * Supported protocols for APLN extension. Currently only two
  * protocols for ALPN are supported: HTTP/1.1 and HTTP/2.
@@ -290,6 +298,8 @@ struct ttls_alpn_proto {
  * @id			- session identifier;
  * @master		- the master secret (must be here to restore a session
  *			  from TLS ticket);
+ * @sni_hash		- hash of the server name requested by the client, zero
+ *			  if there was no SNI extension;
  * @ticket		- RFC 5077 session ticket (client-only);
  * @ticket_len		- session ticket length (client-only);
  * @ticket_lifetime	- ticket lifetime hint (client-only);
@@ -303,6 +313,7 @@ typedef struct {
 	unsigned char	id_len;
 	unsigned char	id[32];
 	unsigned char	master[48];
+	unsigned long	sni_hash;
 	unsigned char	*ticket;
 	size_t		ticket_len;
 	uint32_t	ticket_lifetime;
@@ -342,6 +353,23 @@ typedef struct {
 	unsigned char			iv_dec[16];
 } TlsXfrm;
 
+/*
+ * Certificate message body (RFC 5246 7.4.2) serialized on configuration and
+ * shared by all the key/cert pairs with the same certificate chain.
+ *
+ * @list		- list of all the serialized chains;
+ * @refcnt		- number of key/cert pairs using the chain;
+ * @len			- length of @data;
+ * @data		- total length of the certificates followed by the
+ *			  length prefixed DER certificates;
+ */
+typedef struct {
+	struct list_head		list;
+	unsigned int			refcnt;
+	unsigned int			len;
+	unsigned char			data[0];
+} TlsCertChain;
+
 /*
  * List of certificate + private key pairs
  *
@@ -349,12 +377,19 @@ typedef struct {
  * @key			- private key for the certificate;
  * @ca_chain		- trusted CA chain for the issues certificate;
  * @ca_crl		- trusted CAs CRLs;
+ * @chain		- serialized @cert chain to send in Certificate message;
+ * @ocsp		- CertificateStatus body to staple (RFC 6066 8): status
+ *			  type and length followed by the DER OCSP response;
+ * @ocsp_len		- length of @ocsp, zero if there is no OCSP response;
  */
 typedef struct ttls_key_cert {
 	ttls_x509_crt			*cert;
 	TlsPkCtx			*key;
 	ttls_x509_crt			*ca_chain;
 	ttls_x509_crl			*ca_crl;
+	TlsCertChain			*chain;
+	unsigned char			*ocsp;
+	size_t				ocsp_len;
 	struct ttls_key_cert		*next;
 } TlsKeyCert;
 
@@ -404,6 +439,7 @@ typedef struct {
  * @endpoint		- Peer type: 0: client, 1: server;
  * @authmode		- TTLS_VERIFY_XXX;
  * @cert_req_ca_list	- Enable sending CA list in Certificate Request messages;
+ * @sign_async		- Pass ServerKeyExchange signing to the sign callback;
  * @min_minor_ver	- minimum allowed minor version;
  * @max_minor_ver	- always 3 for now, and used for SCSV fallbacks only.
  *			  Preserved for TLS 1.3.
@@ -423,6 +459,7 @@ typedef struct {
 	unsigned int			endpoint : 1;
 	unsigned int			authmode : 2;
 	unsigned int			cert_req_ca_list : 1;
+	unsigned int			sign_async : 1;
 	unsigned char			min_minor_ver;
 	unsigned char			max_minor_ver;
 } TlsCfg;
@@ -449,6 +486,8 @@ typedef struct {
  * @rlen	- read bytes of the message body so far;
  * @skb_list	- list of skbs attached to the current I/O context;
  * @chunks	- number of contiguous memory chunks in all skbs in @skb_list;
+ * @off		- offset of the record in the first skb of @skb_list, if the
+ *		  skb also held previous records;
  */
 typedef struct {
 	unsigned long	ctr;
@@ -469,6 +508,7 @@ typedef struct {
 	unsigned short	rlen;
 	struct sk_buff	*skb_list;
 	unsigned int	chunks;
+	unsigned int	off;
 } TlsIOCtx;
 
 /* Declarations of internal TLS data structures. */
@@ -522,19 +562,54 @@ typedef struct ttls_context {
 	char			*hostname;
 } TlsCtx;
 
+/**
+ * Memory statistics of the handshakes in progress.
+ *
+ * @hs_num	- number of the handshakes in progress;
+ * @in_use	- memory, in bytes, used by the handshakes;
+ * @cached	- memory, in bytes, of released MPI pools cached for new
+ *		  handshakes;
+ */
+typedef struct {
+	unsigned long		hs_num;
+	unsigned long		in_use;
+	unsigned long		cached;
+} TlsHsMemStat;
+
+/**
+ * Session tickets statistics.
+ *
+ * @issued	- number of issued tickets;
+ * @resumed	- number of sessions resumed from tickets;
+ * @rejected	- number of tickets, which failed to resume a session;
+ * @write_cycles - CPU cycles spent to issue the tickets;
+ * @parse_cycles - CPU cycles spent to parse the tickets;
+ */
+typedef struct {
+	unsigned long		issued;
+	unsigned long		resumed;
+	unsigned long		rejected;
+	unsigned long		write_cycles;
+	unsigned long		parse_cycles;
+} TlsTicketStat;
+
 typedef int ttls_send_cb_t(TlsCtx *tls, struct sg_table *sgt, bool close);
 typedef int ttls_sni_cb_t(TlsCtx *tls, const unsigned char *data, size_t len);
+typedef void ttls_sign_cb_t(TlsCtx *tls);
 
 bool ttls_xfrm_ready(TlsCtx *tls);
 bool ttls_xfrm_need_encrypt(TlsCtx *tls);
 void ttls_write_hshdr(unsigned char type, unsigned char *buf,
 		      unsigned short len);
 void *ttls_alloc_crypto_req(unsigned int extra_size, unsigned int *rsz);
-void ttls_register_callbacks(ttls_send_cb_t *send_cb, ttls_sni_cb_t *sni_cb);
+void ttls_register_callbacks(ttls_send_cb_t *send_cb, ttls_sni_cb_t *sni_cb,
+			     ttls_sign_cb_t *sign_cb);
 
 const char *ttls_get_ciphersuite_name(const int ciphersuite_id);
 
 int ttls_ctx_init(TlsCtx *tls, const TlsCfg *conf);
+void ttls_hs_mem_stat(TlsHsMemStat *stat);
+void ttls_ticket_stat(TlsTicketStat *stat);
 
 void ttls_conf_authmode(TlsCfg *conf, int authmode);
 
@@ -552,6 +627,8 @@ int ttls_set_session(TlsCtx *ssl, const TlsSess *session);
 int ttls_conf_own_cert(TlsPeerCfg *conf, ttls_x509_crt *own_cert,
 		       TlsPkCtx *pk_key, ttls_x509_crt *ca_chain,
 		       ttls_x509_crl *ca_crl);
+int ttls_conf_own_cert_ocsp(TlsPeerCfg *conf, unsigned char *ocsp,
+			    size_t len);
 
 int ttls_set_hostname(TlsCtx *ssl, const char *hostname);
 void ttls_set_hs_authmode(TlsCtx *ssl, int authmode);
@@ -562,6 +639,8 @@ int ttls_get_session(const TlsCtx *ssl, TlsSess *session);
 
 int ttls_recv(void *tls_data, unsigned char *buf, size_t len,
 	      unsigned int *read);
+void ttls_hs_sign(TlsCtx *tls);
+int ttls_hs_sign_resume(TlsCtx *tls);
 int ttls_encrypt(TlsCtx *tls, struct sg_table *sgt, struct sg_table *out_sgt);
 
 int ttls_send_alert(TlsCtx *tls, unsigned char lvl, unsigned char msg);
@@ -588,10 +667,15 @@ ttls_xfrm_taglen(const TlsXfrm *xfrm)
 		? 8 : 16;
 }
 
+/*
+ * ChaCha20-Poly1305 records have no explicit IV (RFC 7905), the whole IV
+ * is fixed for them.
+ */
 static inline size_t
 ttls_expiv_len(const TlsXfrm *xfrm)
 {
-	BUG_ON(xfrm->ivlen - xfrm->fixed_ivlen != TTLS_IV_LEN);
+	BUG_ON(xfrm->ivlen != xfrm->fixed_ivlen
+	       && xfrm->ivlen - xfrm->fixed_ivlen != TTLS_IV_LEN);
 	return xfrm->ivlen - xfrm->fixed_ivlen;
 }
 
@@ -299,14 +299,4 @@ ttls_x509_write_cert_len(const ttls_x509_crt *crt, unsigned char *buf)
 	buf[2] = (unsigned char)n;
 }
 
-static inline void *
-ttls_x509_crt_page(const ttls_x509_crt *crt)
-{
-	unsigned long addr = (unsigned long)crt->raw.p - TTLS_CERT_LEN_LEN;
-
-	BUG_ON(addr & ~PAGE_MASK);
-
-	return (void *)addr;
-}
-
 #endif /* TTLS_X509_CRT_H */